@@ -15,6 +15,7 @@
 #include "HeapPattern.h"
 #include "Interpreter.h"
 #include "MarkAnalysis.h"
+#include "MarkMap.h"
 #include "Model.h"
 #include "MonoPair.h"
 #include "Opts.h"
@@ -23,11 +24,15 @@
 
 #include "llreve/dynamic/Invariant.h"
 #include "llreve/dynamic/Match.h"
+#include "llreve/dynamic/PatternSet.h"
+#include "llreve/dynamic/PolynomialEquation.h"
 
 #include "llvm/IR/Module.h"
 
 #include <thread>
 
+class TraceCache;
+
 namespace llreve {
 namespace dynamic {
 
@@ -53,17 +58,15 @@ using BlockNameMap = llvm::StringMap<llvm::SmallVector<Mark, 2>>;
 
 std::vector<smt::SharedSMTRef>
 driver(MonoPair<llvm::Module &> modules, AnalysisResultsMap &analysisResults,
-       std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>> patterns,
-       llreve::opts::FileOptions fileOpts);
+       const PatternSet &patterns, llreve::opts::FileOptions fileOpts);
 
 std::vector<smt::SharedSMTRef> cegarDriver(
     MonoPair<llvm::Module &> modules, AnalysisResultsMap &analysisResults,
-    std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>> patterns,
-    llreve::opts::FileOptions fileopts);
+    const PatternSet &patterns, llreve::opts::FileOptions fileopts);
 
 using Equality = MonoPair<std::string>;
 
-using LoopCountMap = std::map<Mark, std::vector<MonoPair<int>>>;
+using LoopCountMap = MarkMap<std::vector<MonoPair<int>>>;
 
 template <typename T> T identity(T x) { return x; }
 void insertInblockNameMap(BlockNameMap &nameMap,
@@ -139,9 +142,8 @@ Transformed analyzeMainCounterExample(
     AnalysisResultsMap &analysisResults,
     llvm::StringMap<const llvm::Value *> &instrNameMap,
     const MonoPair<BlockNameMap> &nameMap,
-    const std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>>
-        &patterns,
-    unsigned degree);
+    const PatternSet &patterns,
+    MarkDegrees &iterativeDegrees, unsigned degree);
 void analyzeRelationalCounterExample(
     MarkPair pathMarks, const ModelValues &vals,
     MonoPair<const llvm::Function *> functions,
@@ -156,23 +158,20 @@ void analyzeFunctionalCounterExample(
 
 void populateHeapPatterns(
     HeapPatternCandidatesMap &heapPatternCandidates,
-    const std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>>
-        &patterns,
+    const PatternSet &patterns,
     const std::vector<smt::SortedVar> &primitiveVariables,
     MatchInfo<const llvm::Value *> match, ExitIndex exitIndex);
 void populateHeapPatterns(
     RelationalFunctionInvariantMap<
         LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
         &heapPatternCandidates,
-    const std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>>
-        &patterns,
+    const PatternSet &patterns,
     const std::vector<smt::SortedVar> &primitiveVariables,
     CoupledCallInfo<const llvm::Value *> match,
     MonoPair<llvm::Value *> returnValues);
 void populateHeapPatterns(
     FunctionInvariantMap<HeapPatternCandidates> &heapPatternCandidates,
-    const std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>>
-        &patterns,
+    const PatternSet &patterns,
     const std::vector<smt::SortedVar> &primitiveVariables,
     UncoupledCallInfo<const llvm::Value *> match, llvm::Value *returnValue);
 void dumpPolynomials(
@@ -243,6 +242,85 @@ auto splitCallAtMarks(Call<T> call, const BlockNameMap &nameMap)
             std::move(call.returnState), std::move(pathSteps)};
 }
 
+// The path steps of a call are consumed through streams so they do not have to
+// be materialized. A stream provides
+//   atEnd() -> bool
+//   current() -> const PathStep<T> &, only valid if the stream is not at the end
+//   next() -> PathStep<T>, moves out the current path step and advances
+
+template <typename T> class SplitCallPathStream {
+  public:
+    explicit SplitCallPathStream(SplitCall<T> call) : call(std::move(call)) {}
+    auto atEnd() const -> bool { return index >= call.steps.size(); }
+    auto current() const -> const PathStep<T> & { return call.steps[index]; }
+    auto next() -> PathStep<T> { return std::move(call.steps[index++]); }
+
+  private:
+    SplitCall<T> call;
+    size_t index = 0;
+};
+
+// Groups the steps of the interpreter at the marks while they are produced,
+// only the steps between two marks are kept in memory. The grouping is the
+// same as the one of splitCallAtMarks.
+class InterpreterPathStream {
+  public:
+    using StepObserver =
+        std::function<void(const BlockStep<const llvm::Value *> &)>;
+    // The observer is called for every step once it has been interpreted
+    InterpreterPathStream(StepwiseInterpreter interpreter,
+                          const BlockNameMap &nameMap,
+                          StepObserver observer = nullptr)
+        : interpreter(std::move(interpreter)), nameMap(nameMap),
+          observer(std::move(observer)) {
+        advance();
+    }
+    auto atEnd() const -> bool { return !currentPath.hasValue(); }
+    auto current() const -> const PathStep<const llvm::Value *> & {
+        return *currentPath;
+    }
+    auto next() -> PathStep<const llvm::Value *> {
+        PathStep<const llvm::Value *> path = std::move(*currentPath);
+        advance();
+        return path;
+    }
+    auto ranOutOfSteps() const -> bool { return interpreter.ranOutOfSteps(); }
+
+  private:
+    StepwiseInterpreter interpreter;
+    const BlockNameMap &nameMap;
+    StepObserver observer;
+    llvm::Optional<PathStep<const llvm::Value *>> currentPath;
+    // The mark step that starts the next path
+    llvm::Optional<BlockStep<const llvm::Value *>> pendingStep;
+    bool finished = false;
+
+    void advance() {
+        if (finished) {
+            currentPath = llvm::None;
+            return;
+        }
+        std::vector<BlockStep<const llvm::Value *>> blockSteps;
+        if (pendingStep) {
+            blockSteps.push_back(std::move(*pendingStep));
+            pendingStep = llvm::None;
+        }
+        while (auto step = interpreter.next()) {
+            if (observer) {
+                observer(*step);
+            }
+            if (normalMarkBlock(nameMap, step->blockName)) {
+                pendingStep = std::move(step);
+                currentPath = PathStep<const llvm::Value *>(std::move(blockSteps));
+                return;
+            }
+            blockSteps.push_back(std::move(*step));
+        }
+        finished = true;
+        currentPath = PathStep<const llvm::Value *>(std::move(blockSteps));
+    }
+};
+
 template <typename T>
 auto extractCalls(const PathStep<T> &path) -> std::vector<Call<T>> {
     std::vector<Call<T>> calls;
@@ -441,126 +519,156 @@ void analyzeUncoupledCall(
     }
 }
 
-template <typename T>
-void analyzeExecution(
-    MonoPair<Call<T>> calls, const MonoPair<BlockNameMap> &nameMaps,
+// Matches the path steps of both programs at the marks. The streams have to
+// contain at least one path step.
+template <typename T, typename Stream>
+void analyzePathStreams(
+    Stream &stream1, Stream &stream2, const MonoPair<BlockNameMap> &nameMaps,
     const AnalysisResultsMap &analysisResults,
     std::function<void(MatchInfo<T>)> iterativeMatch,
     std::function<void(CoupledCallInfo<T>)> relationalCallMatch,
     std::function<void(UncoupledCallInfo<T>)> functionalCallMatch) {
-    const auto call1 = splitCallAtMarks(std::move(calls.first), nameMaps.first);
-    const auto call2 =
-        splitCallAtMarks(std::move(calls.second), nameMaps.second);
-    auto stepsIt1 = call1.steps.begin();
-    auto stepsIt2 = call2.steps.begin();
-    auto prevStepsIt1 = *stepsIt1;
-    auto prevStepsIt2 = *stepsIt2;
     // The first pathstep is at an entry node and is thus not interesting to
     // us so we can start by moving to the next pathstep.
-    ++stepsIt1;
-    ++stepsIt2;
-    while (stepsIt1 != call1.steps.end() && stepsIt2 != call2.steps.end()) {
+    PathStep<T> prevStep1 = stream1.next();
+    PathStep<T> prevStep2 = stream2.next();
+    while (!stream1.atEnd() && !stream2.atEnd()) {
         // There are two cases to consider, either both programs are at the
-        // same
-        // mark or they are at different marks. The latter case can occur
-        // when
-        // one program is waiting for the other to finish its loops
+        // same mark or they are at different marks. The latter case can occur
+        // when one program is waiting for the other to finish its loops
         auto blockNameIntersection = intersection(
-            nameMaps.first.find(stepsIt1->stepsOnPath.front().blockName)
+            nameMaps.first.find(stream1.current().stepsOnPath.front().blockName)
                 ->second,
-            nameMaps.second.find(stepsIt2->stepsOnPath.front().blockName)
+            nameMaps.second
+                .find(stream2.current().stepsOnPath.front().blockName)
                 ->second);
         if (!blockNameIntersection.empty()) {
             // We want to match calls on the paths that led us here
-            analyzeCallsOnPaths(prevStepsIt1, prevStepsIt2, nameMaps,
+            analyzeCallsOnPaths(prevStep1, prevStep2, nameMaps,
                                 analysisResults, relationalCallMatch,
                                 functionalCallMatch);
             // The flexible coupling is not yet supported so we should the
             // intersection should contain exactly one block
             assert(blockNameIntersection.size() == 1);
             Mark mark = *blockNameIntersection.begin();
-            iterativeMatch(
-                MatchInfo<T>(makeMonoPair(&stepsIt1->stepsOnPath.front(),
-                                          &stepsIt2->stepsOnPath.front()),
-                             LoopInfo::None, mark));
-            prevStepsIt1 = *stepsIt1;
-            prevStepsIt2 = *stepsIt2;
-            ++stepsIt1;
-            ++stepsIt2;
+            iterativeMatch(MatchInfo<T>(
+                makeMonoPair(&stream1.current().stepsOnPath.front(),
+                             &stream2.current().stepsOnPath.front()),
+                LoopInfo::None, mark));
+            prevStep1 = stream1.next();
+            prevStep2 = stream2.next();
         } else {
             // In this case one program should have stayed at the same mark
             LoopInfo loop = LoopInfo::Left;
             Program prog = Program::First;
-            auto stepsIt = stepsIt1;
-            auto prevStepIt = prevStepsIt1;
-            auto prevStepItOther = prevStepsIt2;
-            auto end = call1.steps.end();
-            auto nameMap = nameMaps.first;
-            auto otherNameMap = nameMaps.second;
-            if (stepsIt2->stepsOnPath.front().blockName ==
-                prevStepsIt2.stepsOnPath.front().blockName) {
+            Stream *stream = &stream1;
+            const PathStep<T> *prevStep = &prevStep1;
+            const PathStep<T> *prevStepOther = &prevStep2;
+            const BlockNameMap *nameMap = &nameMaps.first;
+            const BlockNameMap *otherNameMap = &nameMaps.second;
+            if (stream2.current().stepsOnPath.front().blockName ==
+                prevStep2.stepsOnPath.front().blockName) {
                 loop = LoopInfo::Right;
                 prog = Program::Second;
-                stepsIt = stepsIt2;
-                prevStepIt = prevStepsIt2;
-                prevStepItOther = prevStepsIt1;
-                end = call2.steps.end();
-                nameMap = nameMaps.second;
-                otherNameMap = nameMaps.first;
+                stream = &stream2;
+                prevStep = &prevStep2;
+                prevStepOther = &prevStep1;
+                nameMap = &nameMaps.second;
+                otherNameMap = &nameMaps.first;
             }
             // Keep looping one program until it moves on
             do {
-                analyzeUncoupledPath(prevStepIt, nameMap, prog, analysisResults,
-                                     functionalCallMatch);
+                analyzeUncoupledPath(*prevStep, *nameMap, prog,
+                                     analysisResults, functionalCallMatch);
                 const auto blockNameIntersection = intersection(
-                    nameMap.find(prevStepIt.stepsOnPath.front().blockName)
+                    nameMap->find(prevStep->stepsOnPath.front().blockName)
                         ->second,
                     otherNameMap
-                        .find(prevStepItOther.stepsOnPath.front().blockName)
+                        ->find(prevStepOther->stepsOnPath.front().blockName)
                         ->second);
                 assert(blockNameIntersection.size() == 1);
                 Mark mark = *blockNameIntersection.begin();
                 // Make sure the first program is always the first argument
                 if (loop == LoopInfo::Left) {
                     const BlockStep<T> *firstStep =
-                        &stepsIt->stepsOnPath.front();
+                        &stream->current().stepsOnPath.front();
                     const BlockStep<T> *secondStep =
-                        &prevStepItOther.stepsOnPath.front();
+                        &prevStepOther->stepsOnPath.front();
                     iterativeMatch(MatchInfo<T>(
                         makeMonoPair(firstStep, secondStep), loop, mark));
                 } else {
                     const BlockStep<T> *secondStep =
-                        &stepsIt->stepsOnPath.front();
+                        &stream->current().stepsOnPath.front();
                     const BlockStep<T> *firstStep =
-                        &prevStepItOther.stepsOnPath.front();
+                        &prevStepOther->stepsOnPath.front();
                     iterativeMatch(MatchInfo<T>(
                         makeMonoPair(firstStep, secondStep), loop, mark));
                 }
                 // Go to the next mark
-                ++stepsIt;
+                stream->next();
                 // Did we return to the same mark?
-            } while (stepsIt != end &&
-                     stepsIt->stepsOnPath.front().blockName ==
-                         prevStepIt.stepsOnPath.front().blockName);
-            // Copy the iterator values back to the corresponding terator
-            if (loop == LoopInfo::Left) {
-                stepsIt1 = stepsIt;
-            } else {
-                stepsIt2 = stepsIt;
-            }
+            } while (!stream->atEnd() &&
+                     stream->current().stepsOnPath.front().blockName ==
+                         prevStep->stepsOnPath.front().blockName);
         }
     }
     // There can be calls on the way to the return block which we need to
-    // take a
-    // look at here
-    analyzeCallsOnPaths(prevStepsIt1, prevStepsIt2, nameMaps, analysisResults,
+    // take a look at here
+    analyzeCallsOnPaths(prevStep1, prevStep2, nameMaps, analysisResults,
                         relationalCallMatch, functionalCallMatch);
-    // This assertion is only correct if the interpreter didn’t stop because it
-    // ran out of steps
-    // assert(stepsIt1 == call1.steps.end());
-    // assert(stepsIt2 == call2.steps.end());
+    // We can only check that both streams are at the end if the interpreter
+    // didn’t stop because it ran out of steps
+}
+
+template <typename T>
+void analyzeExecution(
+    MonoPair<Call<T>> calls, const MonoPair<BlockNameMap> &nameMaps,
+    const AnalysisResultsMap &analysisResults,
+    std::function<void(MatchInfo<T>)> iterativeMatch,
+    std::function<void(CoupledCallInfo<T>)> relationalCallMatch,
+    std::function<void(UncoupledCallInfo<T>)> functionalCallMatch) {
+    SplitCallPathStream<T> stream1(
+        splitCallAtMarks(std::move(calls.first), nameMaps.first));
+    SplitCallPathStream<T> stream2(
+        splitCallAtMarks(std::move(calls.second), nameMaps.second));
+    analyzePathStreams<T>(stream1, stream2, nameMaps, analysisResults,
+                          iterativeMatch, relationalCallMatch,
+                          functionalCallMatch);
 }
 
+// Interprets both functions and analyzes the execution while it is running
+// instead of collecting the complete calls first. The memory usage only
+// depends on the length of the paths between marks, so the block budget can
+// be 0 to interpret without a limit. The observers are called for every step.
+// If a trace cache is given, the complete calls are loaded from it or
+// interpreted and stored in it instead.
+void analyzeStreamedExecution(
+    MonoPair<const llvm::Function *> funs, MonoPair<FastState> entryStates,
+    MonoPair<const llvm::BasicBlock *> startBlocks, InterpreterBudget budget,
+    const MonoPair<BlockNameMap> &nameMaps,
+    const AnalysisResultsMap &analysisResults,
+    std::function<void(MatchInfo<const llvm::Value *>)> iterativeMatch,
+    std::function<void(CoupledCallInfo<const llvm::Value *>)>
+        relationalCallMatch,
+    std::function<void(UncoupledCallInfo<const llvm::Value *>)>
+        functionalCallMatch,
+    MonoPair<InterpreterPathStream::StepObserver> observers = {nullptr,
+                                                               nullptr},
+    const TraceCache *traceCache = nullptr);
+
+// The invariants whose equations or heap patterns have been updated since
+// their candidate definitions have last been built
+struct ChangedInvariants {
+    std::set<Mark> iterative;
+    std::set<std::pair<MonoPair<const llvm::Function *>, Mark>> relational;
+    std::set<std::pair<const llvm::Function *, Mark>> functional;
+    void clear() {
+        iterative.clear();
+        relational.clear();
+        functional.clear();
+    }
+};
+
 struct DynamicAnalysisResults {
     LoopCountsAndMark loopCounts;
     IterativeInvariantMap<PolynomialEquations> polynomialEquations;
@@ -568,11 +676,13 @@ struct DynamicAnalysisResults {
         LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>>
         relationalFunctionPolynomialEquations;
     FunctionInvariantMap<Matrix<mpq_class>> functionPolynomialEquations;
+    EquationTemplates equationTemplates;
     HeapPatternCandidatesMap heapPatternCandidates;
     RelationalFunctionInvariantMap<
         LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
         relationalFunctionHeapPatterns;
     FunctionInvariantMap<HeapPatternCandidates> functionHeapPatterns;
+    ChangedInvariants changedInvariants;
 };
 ModelValues initialModelValues(MonoPair<const llvm::Function *> funs);
 
@@ -582,7 +692,12 @@ ModelValues parseZ3Model(const z3::context &z3Cxt, const z3::model &model,
                          const llvm::StringMap<z3::expr> &nameMap,
                          const AnalysisResultsMap &analysisResults);
 
-ArrayVal getArrayVal(const z3::context &z3Cxt, z3::expr arrayExpr);
+// Reads the value of an array directly from a z3 model. The array is either a
+// chain of stores on top of a constant array or refers to the interpretation
+// of an auxiliary function (as-array), both are handled in time linear in the
+// number of stored values.
+ArrayVal getArrayVal(const z3::context &z3Cxt, const z3::model &model,
+                     z3::expr arrayExpr);
 
 void dumpCounterExample(Mark cexStart, Mark cexEndMark,
                         const FastVarMap &variableValues,
@@ -0,0 +1,140 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Integer.h"
+#include "InterpreterCore.h"
+
+#include <memory>
+#include <vector>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+namespace llreve {
+namespace dynamic {
+
+// Before a function is interpreted it is lowered to a register based bytecode.
+// Every argument and instruction gets a dense slot index and constants are
+// placed in slots after them, the layout is shared with the interpreter of the
+// slicing tool (see InterpreterCore.h). Executing an instruction then only
+// indexes into a vector of values instead of dispatching on the class of the
+// LLVM instruction and looking up its operands in a hash map.
+
+using interpreter::BlockIndex;
+using interpreter::NoBlock;
+using interpreter::Slot;
+
+enum class Opcode : uint8_t {
+    IntBinOp,
+    BoolBinOp,
+    ICmp,
+    BoolToInt,
+    ZExt,
+    SExt,
+    ZExtOrTrunc,
+    GEP,
+    Load,
+    Store,
+    Select,
+    Call,
+    // Reports an error when it is executed
+    Unsupported
+};
+
+// A variable index of a GEP, constant indices are folded into gepOffset
+struct GEPIndex {
+    // The size of the indexed type as a pointer
+    Integer size;
+    Slot index;
+};
+
+struct BytecodeInstruction {
+    Opcode opcode;
+    // The llvm::Instruction::BinaryOps or llvm::CmpInst::Predicate
+    unsigned subOpcode = 0;
+    // The width of the result for casts and the accessed bits for loads and
+    // stores
+    unsigned width = 0;
+    Slot result = 0;
+    // For calls these are the arguments, for GEPs only the pointer operand
+    llvm::SmallVector<Slot, 3> operands;
+    std::vector<GEPIndex> gepIndices;
+    // The sum of the constant indices of a GEP multiplied by their sizes, as a
+    // pointer. Not set if it is zero.
+    llvm::Optional<Integer> gepOffset;
+    const llvm::Function *callee = nullptr;
+    // The original instruction, used in error messages
+    const llvm::Instruction *instr;
+    // Only used for unsupported instructions
+    const char *errorMessage = nullptr;
+    const llvm::Value *errorValue = nullptr;
+    bool fatal = false;
+};
+
+enum class TerminatorKind : uint8_t {
+    Return,
+    Branch,
+    CondBranch,
+    Switch,
+    Unsupported
+};
+
+struct BytecodeTerminator {
+    TerminatorKind kind = TerminatorKind::Unsupported;
+    // The slot of the return instruction
+    Slot result = 0;
+    // The return value or the condition of a branch or switch
+    Slot value = 0;
+    // For a switch the successors of the cases followed by the default
+    llvm::SmallVector<BlockIndex, 2> successors;
+    llvm::SmallVector<Slot, 2> caseValues;
+    // Set if an operand cannot be interpreted
+    const llvm::Value *unsupportedOperand = nullptr;
+};
+
+// The phi nodes of a block evaluated when coming from 'predecessor'
+struct PhiMoves {
+    BlockIndex predecessor;
+    // Pairs of (phi, incoming value), assigned in order
+    llvm::SmallVector<std::pair<Slot, Slot>, 4> moves;
+    const llvm::Value *unsupportedOperand = nullptr;
+};
+
+struct BytecodeBlock {
+    const llvm::BasicBlock *block;
+    std::vector<PhiMoves> phis;
+    std::vector<BytecodeInstruction> instructions;
+    BytecodeTerminator terminator;
+};
+
+struct BytecodeFunction {
+    explicit BytecodeFunction(const llvm::Function &fun)
+        : function(&fun), layout(fun) {}
+    const llvm::Function *function;
+    // The slots of the arguments and instructions and the indices of the
+    // blocks
+    interpreter::SlotLayout layout;
+    // Ordered like the blocks of the layout
+    std::vector<BytecodeBlock> blocks;
+    // The values all slots start with, i.e. the constants in the slots after
+    // the variables
+    std::vector<Integer> initialValues;
+};
+
+// Constants depend on whether bitvectors are used so this has to be called
+// after the options have been initialized
+auto lowerFunction(const llvm::Function &fun)
+    -> std::unique_ptr<BytecodeFunction>;
+}
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace llreve {
+namespace dynamic {
+
+// A row-major matrix that stores all entries in a single allocation. Every row
+// starts at an address aligned to 'Alignment' bytes and is padded with zeros,
+// so kernels can always process complete vector registers. In contrast to
+// Matrix<T> this is only meant for plain machine types.
+template <typename T> class DenseMatrix {
+    static_assert(std::is_trivial<T>::value,
+                  "DenseMatrix only supports trivial types");
+
+  public:
+    static const size_t Alignment = 32;
+    static const size_t ElemsPerBlock = Alignment / sizeof(T);
+
+    DenseMatrix(size_t rows, size_t cols)
+        : numRows(rows), numCols(cols),
+          rowStride((cols + ElemsPerBlock - 1) / ElemsPerBlock *
+                    ElemsPerBlock) {
+        size_t bytes = std::max<size_t>(1, numRows * rowStride) * sizeof(T);
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, Alignment, bytes) != 0) {
+            throw std::bad_alloc();
+        }
+        std::memset(ptr, 0, bytes);
+        entries.reset(static_cast<T *>(ptr));
+    }
+
+    auto rows() const -> size_t { return numRows; }
+    auto cols() const -> size_t { return numCols; }
+    // The number of elements between the starts of two rows, a multiple of
+    // 'ElemsPerBlock'
+    auto stride() const -> size_t { return rowStride; }
+
+    auto row(size_t i) -> T * {
+        assert(i < numRows);
+        return entries.get() + i * rowStride;
+    }
+    auto row(size_t i) const -> const T * {
+        assert(i < numRows);
+        return entries.get() + i * rowStride;
+    }
+    auto operator()(size_t i, size_t j) -> T & {
+        assert(j < numCols);
+        return row(i)[j];
+    }
+    auto operator()(size_t i, size_t j) const -> const T & {
+        assert(j < numCols);
+        return row(i)[j];
+    }
+    void swapRows(size_t i, size_t j) {
+        if (i != j) {
+            std::swap_ranges(row(i), row(i) + rowStride, row(j));
+        }
+    }
+
+  private:
+    struct Free {
+        void operator()(T *ptr) const { free(ptr); }
+    };
+    size_t numRows;
+    size_t numCols;
+    size_t rowStride;
+    std::unique_ptr<T, Free> entries;
+};
+}
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Interpreter.h"
+#include "MonoPair.h"
+#include "SerializeTraces.h"
+
+#include <cstdint>
+#include <ostream>
+
+#include <gmpxx.h>
+
+namespace llreve {
+namespace dynamic {
+
+struct ExhaustiveOpts {
+    // Every argument takes all values in these bounds, upperbound included
+    mpz_class lowerBound;
+    mpz_class upperBound;
+    // The index of the first input, this allows resuming an enumeration
+    mpz_class firstInput;
+    unsigned jobs;
+    // The number of inputs a worker takes from the queue at once
+    size_t chunkSize;
+    InterpreterBudget budget;
+};
+
+struct ExhaustiveResult {
+    uint64_t inputs = 0;
+    // Inputs on which both functions return different values or heaps
+    uint64_t counterExamples = 0;
+    // Inputs on which one of the functions exceeded the budget
+    uint64_t earlyExits = 0;
+};
+
+// Bounded exhaustive testing: Interprets both functions on every combination
+// of argument values in the bounds. The inputs of the Range are split into
+// chunks which are interpreted by 'jobs' workers. Each result is
+// written to 'out' by a single writer thread together with the traces, if
+// 'traces' is given, so the workers never wait for each other. The results
+// are written in the order in which they are finished, the counter of each
+// line is the index of the input. Without traces the inputs of a chunk are
+// interpreted in lanes if a function allows it (see Lanes.h) and share the
+// prefixes of their traces otherwise (see PrefixSharingInterpreter).
+auto enumerateExhaustively(MonoPair<const llvm::Function *> funs,
+                           const AnalysisResultsMap &analysisResults,
+                           const ExhaustiveOpts &opts, std::ostream &out,
+                           TraceWriter *traces) -> ExhaustiveResult;
+}
+}
@@ -15,6 +15,8 @@
 #include "Permutation.h"
 #include "SerializeTraces.h"
 
+#include "llvm/ADT/STLExtras.h"
+
 namespace llreve {
 namespace dynamic {
 using HoleMap = std::map<size_t, mpz_class>;
@@ -41,10 +43,77 @@ struct VariablePlaceholder {
     }
 };
 
-mpz_class getHeapVal(HeapAddress addr, Heap heap);
+mpz_class getHeapVal(HeapAddress addr, const Heap &heap);
+
+// How a pattern uses one of its arguments
+enum class ArgumentRole {
+    Value,
+    // The argument is used to compute an address of the heap of program 1
+    FirstHeapAddress,
+    SecondHeapAddress
+};
+
+// Two ranges of arguments of the same length that are the operands of a
+// commutative operator or a symmetric relation and have the same structure,
+// e.g. a and b in a + b. Swapping the variables assigned to them gives an
+// equivalent instantiation.
+struct ArgumentSymmetry {
+    size_t first;
+    size_t second;
+    size_t length;
+};
+
+bool operator<(const ArgumentSymmetry &lhs, const ArgumentSymmetry &rhs);
+
+// Appends the symmetry between the operands of a binary node if 'symmetricOp'
+// and the symmetries within the operands, 'offset' is the index of the first
+// argument of the node
+template <typename Node>
+void appendOperandSymmetries(bool symmetricOp,
+                             const MonoPair<std::shared_ptr<Node>> &args,
+                             std::vector<ArgumentSymmetry> &symmetries,
+                             size_t offset) {
+    const size_t length = args.first->arguments();
+    if (symmetricOp && length > 0 && args.first->equalTo(*args.second)) {
+        symmetries.push_back({offset, offset + length, length});
+    }
+    args.first->argumentSymmetries(symmetries, offset);
+    args.second->argumentSymmetries(symmetries, offset + length);
+}
+
+// Calls 'f' for every assignment of variables to arguments with the given
+// roles. Unless -untyped-heap-addresses is set, heap addresses are only
+// computed from pointers of the corresponding program. 'returnValues' are
+// the return instructions used as result variables, they belong to the
+// first and the second program respectively. Of the assignments that only
+// differ by swapping the ranges of a symmetry, only the one in which the
+// variables of the first range do not come after the ones of the second
+// range in 'variables' is used.
+void forEachInstantiation(
+    const std::vector<ArgumentRole> &roles,
+    const std::vector<ArgumentSymmetry> &symmetries,
+    const std::vector<const llvm::Value *> &variables,
+    MonoPair<llvm::Value *> returnValues,
+    llvm::function_ref<void(const std::vector<const llvm::Value *> &)> f);
+
+// The llvm::Value*s corresponding to the variables, the result variables are
+// mapped to 'returnValues'
+// TODO the free vars map should simply use llvm::Value* to avoid this search
+auto valuesOfVariables(const std::vector<smt::SortedVar> &variables,
+                       const FastVarMap &variableValues,
+                       MonoPair<llvm::Value *> returnValues)
+    -> std::vector<const llvm::Value *>;
 
 template <typename T> struct HeapPattern {
     virtual size_t arguments() const = 0;
+    // Appends the roles of the arguments in the order in which
+    // distributeArguments assigns them
+    virtual void argumentRoles(std::vector<ArgumentRole> &roles) const = 0;
+    // Appends the symmetries of the arguments, 'offset' is the index of the
+    // first argument of this pattern
+    virtual void
+    argumentSymmetries(std::vector<ArgumentSymmetry> & /* unused */,
+                       size_t /* unused */) const {}
     virtual ~HeapPattern() = default;
     virtual PatternType getType() const = 0;
     std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>
@@ -59,54 +128,36 @@ template <typename T> struct HeapPattern {
                 const FastVarMap &variableValues,
                 const MonoPair<const Heap &> &heaps,
                 MonoPair<llvm::Value *> returnValues) const {
-        size_t k = this->arguments();
-        std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>
-            matchingPatterns;
-        // Find the llvm::Value*s corresponding to the variables
-        // TODO the free vars map should simply use llvm::Value* to avoid this
-        // search
-        std::vector<const llvm::Value *> variablePointers;
-        for (const auto &var : variables) {
-            bool isReturn1 = var.name == resultName(Program::First);
-            bool isReturn2 = var.name == resultName(Program::Second);
-            if (isReturn1) {
-                variablePointers.push_back(returnValues.first);
-            } else if (isReturn2) {
-                variablePointers.push_back(returnValues.second);
-            } else {
-                bool found = false;
-                for (auto val : variableValues) {
-                    if (var.name == val.first->getName()) {
-                        variablePointers.push_back(val.first);
-                        found = true;
-                        break;
-                    }
-                }
-                assert(found);
-            }
-        }
-
-        if (k == 0) {
-            auto pat = this->distributeArguments({});
-            if (pat->matches(variableValues, heaps)) {
-                matchingPatterns.push_back(pat);
-            }
-            return matchingPatterns;
-        }
-        for (const auto &vec :
-             Range(0, mpz_class(variablePointers.size()) - 1, k)) {
-            std::vector<const llvm::Value *> args(vec.size());
-            for (size_t i = 0; i < args.size(); ++i) {
-                args[i] = variablePointers[vec[i].get_ui()];
-            }
-            auto pattern = this->distributeArguments(args);
-
-            if (pattern->matches(variableValues, heaps)) {
-                matchingPatterns.push_back(pattern);
-            }
-        }
+        auto matchingPatterns =
+            allInstantiations(variables, variableValues, returnValues);
+        matchingPatterns.remove_if(
+            [&](const std::shared_ptr<HeapPattern<const llvm::Value *>> &pat) {
+                return !pat->matches(variableValues, heaps);
+            });
         return matchingPatterns;
     }
+    // All ways of distributing the variables on the arguments of this pattern
+    // without checking whether they hold
+    std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>
+    allInstantiations(const std::vector<smt::SortedVar> &variables,
+                      const FastVarMap &variableValues,
+                      MonoPair<llvm::Value *> returnValues) const {
+        std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>
+            patterns;
+        const std::vector<const llvm::Value *> variablePointers =
+            valuesOfVariables(variables, variableValues, returnValues);
+        std::vector<ArgumentRole> roles;
+        this->argumentRoles(roles);
+        assert(roles.size() == this->arguments());
+        std::vector<ArgumentSymmetry> symmetries;
+        this->argumentSymmetries(symmetries, 0);
+        forEachInstantiation(
+            roles, symmetries, variablePointers, returnValues,
+            [&](const std::vector<const llvm::Value *> &args) {
+                patterns.push_back(this->distributeArguments(args));
+            });
+        return patterns;
+    }
     virtual std::shared_ptr<HeapPattern<const llvm::Value *>>
     distributeArguments(std::vector<const llvm::Value *> variables) const = 0;
     virtual bool matches(const FastVarMap &variables,
@@ -142,6 +193,16 @@ template <typename T> struct BinaryHeapPattern : public HeapPattern<T> {
     size_t arguments() const override {
         return args.first->arguments() + args.second->arguments();
     }
+    void argumentRoles(std::vector<ArgumentRole> &roles) const override {
+        args.first->argumentRoles(roles);
+        args.second->argumentRoles(roles);
+    }
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        appendOperandSymmetries(op == BinaryBooleanOp::And ||
+                                    op == BinaryBooleanOp::Or,
+                                args, symmetries, offset);
+    }
     std::shared_ptr<HeapPattern<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         std::vector<const llvm::Value *> argsFirst;
@@ -218,6 +279,13 @@ template <typename T> struct UnaryHeapPattern : public HeapPattern<T> {
         : op(op), arg(arg) {}
     PatternType getType() const override { return PatternType::Unary; }
     size_t arguments() const override { return arg->arguments(); }
+    void argumentRoles(std::vector<ArgumentRole> &roles) const override {
+        arg->argumentRoles(roles);
+    }
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        arg->argumentSymmetries(symmetries, offset);
+    }
     std::shared_ptr<HeapPattern<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         return std::make_shared<UnaryHeapPattern<const llvm::Value *>>(
@@ -262,6 +330,8 @@ template <typename T> struct HeapEqual : public HeapPattern<T> {
     // All elements of the two heaps are equal
     HeapEqual() = default;
     size_t arguments() const override { return 0; }
+    void argumentRoles(
+        std::vector<ArgumentRole> & /* unused */) const override {}
     PatternType getType() const override { return PatternType::HeapEquality; }
     std::shared_ptr<HeapPattern<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> arguments) const override {
@@ -288,6 +358,16 @@ template <typename T> struct HeapEqual : public HeapPattern<T> {
 
 template <typename T> struct HeapExpr {
     virtual size_t arguments() const = 0;
+    // Appends the roles of the arguments in the order in which
+    // distributeArguments assigns them, 'context' is the role of this
+    // expression
+    virtual void argumentRoles(std::vector<ArgumentRole> &roles,
+                               ArgumentRole context) const = 0;
+    // Appends the symmetries of the arguments, 'offset' is the index of the
+    // first argument of this expression
+    virtual void
+    argumentSymmetries(std::vector<ArgumentSymmetry> & /* unused */,
+                       size_t /* unused */) const {}
     virtual ~HeapExpr() = default;
     virtual mpz_class eval(const FastVarMap &variables,
                            const MonoPair<const Heap &> &heaps,
@@ -305,6 +385,8 @@ template <typename T> struct HeapIndex : public HeapExpr<T> {
     HeapIndex(ProgramIndex index) : index(index) {}
     ExprType getType() const override { return ExprType::HeapIndex; }
     size_t arguments() const override { return 0; }
+    void argumentRoles(std::vector<ArgumentRole> & /* unused */,
+                       ArgumentRole /* unused */) const override {}
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> /* unused */) const override {
         logError("Cannot distribute arguments on heap index\n");
@@ -346,6 +428,8 @@ template <typename T> struct HeapValue : public HeapExpr<T> {
     HeapValue(ProgramIndex index) : index(index) {}
     ExprType getType() const override { return ExprType::HeapValue; }
     size_t arguments() const override { return 0; }
+    void argumentRoles(std::vector<ArgumentRole> & /* unused */,
+                       ArgumentRole /* unused */) const override {}
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> /* unused */) const override {
         logError("Cannot distribute arguments on heap value\n");
@@ -391,6 +475,16 @@ template <typename T> struct HeapAccess : public HeapExpr<T> {
         : programIndex(programIndex), atVal(atVal) {}
     ExprType getType() const override { return ExprType::HeapAccess; }
     size_t arguments() const override { return atVal->arguments(); }
+    void argumentRoles(std::vector<ArgumentRole> &roles,
+                       ArgumentRole /* unused */) const override {
+        atVal->argumentRoles(roles, programIndex == ProgramIndex::First
+                                        ? ArgumentRole::FirstHeapAddress
+                                        : ArgumentRole::SecondHeapAddress);
+    }
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        atVal->argumentSymmetries(symmetries, offset);
+    }
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         return std::make_shared<HeapAccess<const llvm::Value *>>(
@@ -443,6 +537,8 @@ template <typename T> struct Constant : public HeapExpr<T> {
     Constant(mpz_class value) : value(value) {}
     ExprType getType() const override { return ExprType::Constant; }
     size_t arguments() const override { return 0; }
+    void argumentRoles(std::vector<ArgumentRole> & /* unused */,
+                       ArgumentRole /* unused */) const override {}
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> arguments) const override {
         assert(arguments.empty());
@@ -477,6 +573,10 @@ template <typename T> struct Variable : public HeapExpr<T> {
     Variable(T varName) : varName(varName) {}
     ExprType getType() const override { return ExprType::Variable; }
     size_t arguments() const override { return 1; }
+    void argumentRoles(std::vector<ArgumentRole> &roles,
+                       ArgumentRole context) const override {
+        roles.push_back(context);
+    }
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         assert(variables.size() == 1);
@@ -513,6 +613,8 @@ template <typename T> struct Hole : public HeapExpr<T> {
     size_t index;
     ExprType getType() const override { return ExprType::Hole; }
     size_t arguments() const override { return 0; }
+    void argumentRoles(std::vector<ArgumentRole> & /* unused */,
+                       ArgumentRole /* unused */) const override {}
     Hole(size_t index) : index(index) {}
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
@@ -562,6 +664,17 @@ template <typename T> struct BinaryIntExpr : public HeapExpr<T> {
     size_t arguments() const override {
         return args.first->arguments() + args.second->arguments();
     }
+    void argumentRoles(std::vector<ArgumentRole> &roles,
+                       ArgumentRole context) const override {
+        args.first->argumentRoles(roles, context);
+        args.second->argumentRoles(roles, context);
+    }
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        appendOperandSymmetries(op == BinaryIntOp::Add ||
+                                    op == BinaryIntOp::Mul,
+                                args, symmetries, offset);
+    }
     std::shared_ptr<HeapExpr<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         auto mid = variables.begin() + args.first->arguments();
@@ -637,6 +750,14 @@ template <typename T> struct UnaryIntExpr : public HeapExpr<T> {
     UnaryIntOp op;
     std::shared_ptr<HeapExpr<T>> arg;
     size_t arguments() const override { return arg->arguments(); }
+    void argumentRoles(std::vector<ArgumentRole> &roles,
+                       ArgumentRole context) const override {
+        arg->argumentRoles(roles, context);
+    }
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        arg->argumentSymmetries(symmetries, offset);
+    }
     std::ostream &dump(std::ostream &os) const override {
         os << "(";
         os << "-";
@@ -678,6 +799,21 @@ template <typename T> struct RangeProp : public HeapPattern<T> {
         return bounds.first->arguments() + bounds.second->arguments() +
                pat->arguments();
     }
+    void argumentRoles(std::vector<ArgumentRole> &roles) const override {
+        bounds.first->argumentRoles(roles, ArgumentRole::Value);
+        bounds.second->argumentRoles(roles, ArgumentRole::Value);
+        pat->argumentRoles(roles);
+    }
+    // The bounds are not symmetric
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        const size_t patOffset =
+            offset + bounds.first->arguments() + bounds.second->arguments();
+        bounds.first->argumentSymmetries(symmetries, offset);
+        bounds.second->argumentSymmetries(
+            symmetries, offset + bounds.first->arguments());
+        pat->argumentSymmetries(symmetries, patOffset);
+    }
     std::shared_ptr<HeapPattern<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         auto mid1 =
@@ -775,6 +911,16 @@ template <typename T> struct HeapExprProp : public HeapPattern<T> {
     size_t arguments() const override {
         return args.first->arguments() + args.second->arguments();
     }
+    void argumentRoles(std::vector<ArgumentRole> &roles) const override {
+        args.first->argumentRoles(roles, ArgumentRole::Value);
+        args.second->argumentRoles(roles, ArgumentRole::Value);
+    }
+    void argumentSymmetries(std::vector<ArgumentSymmetry> &symmetries,
+                            size_t offset) const override {
+        appendOperandSymmetries(op == BinaryIntProp::EQ ||
+                                    op == BinaryIntProp::NE,
+                                args, symmetries, offset);
+    }
     std::shared_ptr<HeapPattern<const llvm::Value *>> distributeArguments(
         std::vector<const llvm::Value *> variables) const override {
         auto mid =
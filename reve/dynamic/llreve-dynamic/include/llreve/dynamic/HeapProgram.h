@@ -0,0 +1,113 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llreve/dynamic/HeapPattern.h"
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+
+namespace llreve {
+namespace dynamic {
+
+enum class HeapOpCode {
+    // Push the constant with index 'arg'
+    Constant,
+    // Push the value of the variable with index 'arg' in the batch
+    Variable,
+    // Push the current value of the hole 'arg'
+    Hole,
+    // Replace the top of the stack by the value of heap 'arg' at that address
+    Load,
+    Add,
+    Subtract,
+    Mul,
+    // Replace the two topmost values by the result of the BinaryIntProp 'arg'
+    Compare,
+    Not,
+    // If the top of the stack is false (true) continue at instruction 'arg'
+    // and keep it, otherwise pop it. This implements ∧ and ∨.
+    JumpIfFalse,
+    JumpIfTrue,
+    HeapEqual,
+    // Replace the two topmost values (the bounds) by the result of the range
+    // with index 'arg'
+    Range
+};
+
+struct HeapInstruction {
+    HeapOpCode op;
+    uint32_t arg;
+};
+
+// A HeapPattern lowered to a stack program. The instructions of the
+// pattern itself are in block 0, every range has its own block for its
+// body.
+struct HeapProgram {
+    struct RangeInfo {
+        RangeQuantifier quant;
+        size_t hole;
+        size_t block;
+    };
+    std::vector<std::vector<HeapInstruction>> blocks;
+    std::vector<mpz_class> constants;
+    std::vector<RangeInfo> ranges;
+};
+
+// The candidates of a heap invariant. The patterns are compiled once when the
+// candidates are created, filtering them only runs the compiled programs of
+// all candidates together and drops all refuted candidates at once.
+class HeapPatternCandidates {
+  public:
+    using Pattern = std::shared_ptr<HeapPattern<const llvm::Value *>>;
+    using const_iterator = std::vector<Pattern>::const_iterator;
+
+    HeapPatternCandidates() = default;
+    HeapPatternCandidates(std::list<Pattern> candidates);
+
+    auto begin() const -> const_iterator { return patterns.begin(); }
+    auto end() const -> const_iterator { return patterns.end(); }
+    auto size() const -> size_t { return patterns.size(); }
+    auto empty() const -> bool { return patterns.empty(); }
+
+    // Removes all candidates that do not hold for this state
+    void filter(const FastVarMap &variables,
+                const MonoPair<const Heap &> &heaps);
+
+  private:
+    std::vector<Pattern> patterns;
+    // programs[i] is the compiled version of patterns[i]
+    std::vector<HeapProgram> programs;
+    // The variables referenced by the programs
+    std::vector<const llvm::Value *> variables;
+    llvm::DenseMap<const llvm::Value *, uint32_t> variableIndices;
+    size_t numHoles = 0;
+
+    // Used while evaluating
+    std::vector<mpz_class> values;
+    std::vector<mpz_class> holes;
+    std::vector<mpz_class> stack;
+    size_t stackSize = 0;
+
+    void compile(const HeapPattern<const llvm::Value *> &pattern,
+                 HeapProgram &program, size_t block);
+    void compile(const HeapExpr<const llvm::Value *> &expr,
+                 HeapProgram &program, size_t block);
+    void push(const mpz_class &val);
+    // Pushes the result of the block
+    void run(const HeapProgram &program, size_t block,
+             const MonoPair<const Heap &> &heaps);
+};
+}
+}
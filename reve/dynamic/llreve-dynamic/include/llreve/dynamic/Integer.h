@@ -11,6 +11,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <gmpxx.h>
 #include <iostream>
 
@@ -20,30 +21,53 @@
 
 enum class IntType { Unbounded, Bounded };
 
+static_assert(sizeof(long) == sizeof(int64_t),
+              "small integers are converted to gmp using longs");
+
 struct Integer {
+    // Unbounded integers that fit in 64 bits are stored inline in 'small', gmp
+    // is only used for larger values. The representation is canonical, i.e.
+    // 'big' never holds a value that fits in 64 bits, so values can be
+    // compared and hashed without converting them.
     union {
-        mpz_class unbounded;
+        int64_t small;
+        mpz_class big;
         llvm::APInt bounded;
     };
     IntType type;
-    Integer() : unbounded(mpz_class(0)), type(IntType::Unbounded) {}
-    explicit Integer(mpz_class i)
-        : unbounded(std::move(i)), type(IntType::Unbounded) {}
+    bool isBig = false;
+    Integer() : small(0), type(IntType::Unbounded) {}
+    explicit Integer(mpz_class i) : type(IntType::Unbounded) {
+        if (i.fits_slong_p()) {
+            small = i.get_si();
+        } else {
+            new (&big) mpz_class(std::move(i));
+            isBig = true;
+        }
+    }
     explicit Integer(llvm::APInt i) : bounded(i), type(IntType::Bounded) {}
-    Integer(const Integer &other) : type(other.type) {
+    Integer(const Integer &other) : type(other.type), isBig(other.isBig) {
         switch (type) {
         case IntType::Unbounded:
-            new (&unbounded) mpz_class(other.unbounded);
+            if (isBig) {
+                new (&big) mpz_class(other.big);
+            } else {
+                small = other.small;
+            }
             break;
         case IntType::Bounded:
             new (&bounded) llvm::APInt(other.bounded);
             break;
         }
     }
-    Integer(Integer &&other) : type(std::move(other.type)) {
+    Integer(Integer &&other) : type(std::move(other.type)), isBig(other.isBig) {
         switch (type) {
         case IntType::Unbounded:
-            new (&unbounded) mpz_class(std::move(other.unbounded));
+            if (isBig) {
+                new (&big) mpz_class(std::move(other.big));
+            } else {
+                small = other.small;
+            }
             break;
         case IntType::Bounded:
             new (&bounded) llvm::APInt(std::move(other.bounded));
@@ -54,6 +78,11 @@ struct Integer {
     Integer &operator=(Integer &&other);
     ~Integer();
 
+    static Integer fromSmall(int64_t i) {
+        Integer result;
+        result.small = i;
+        return result;
+    }
     inline static Integer True() { return Integer(llvm::APInt(1, 1)); }
     inline static Integer False() { return Integer(llvm::APInt(1, 0)); }
     explicit Integer(bool val) : type(IntType::Bounded) {
@@ -64,13 +93,23 @@ struct Integer {
         }
     }
 
+    // True if this is an unbounded integer stored inline
+    bool isSmall() const { return type == IntType::Unbounded && !isBig; }
+
     Integer asPointer() const;
     Integer &operator+=(const Integer &other) {
         assert(type == other.type);
         switch (type) {
-        case IntType::Unbounded:
-            unbounded += other.unbounded;
+        case IntType::Unbounded: {
+            int64_t result;
+            if (isSmall() && other.isSmall() &&
+                !__builtin_add_overflow(small, other.small, &result)) {
+                small = result;
+            } else {
+                *this = Integer(asUnbounded() + other.asUnbounded());
+            }
             break;
+        }
         case IntType::Bounded:
             bounded += other.bounded;
             break;
@@ -84,14 +123,31 @@ struct Integer {
     Integer operator-() const {
         switch (type) {
         case IntType::Unbounded:
-            return Integer(-unbounded);
+            if (isSmall() && small != INT64_MIN) {
+                return fromSmall(-small);
+            }
+            return Integer(mpz_class(-asUnbounded()));
         case IntType::Bounded:
             return Integer(-bounded);
         }
     }
     Integer &operator-=(const Integer &other) {
         assert(type == other.type);
-        operator+=(-other);
+        switch (type) {
+        case IntType::Unbounded: {
+            int64_t result;
+            if (isSmall() && other.isSmall() &&
+                !__builtin_sub_overflow(small, other.small, &result)) {
+                small = result;
+            } else {
+                *this = Integer(asUnbounded() - other.asUnbounded());
+            }
+            break;
+        }
+        case IntType::Bounded:
+            operator+=(-other);
+            break;
+        }
         return *this;
     }
     friend Integer operator-(Integer lhs, const Integer &rhs) {
@@ -102,7 +158,7 @@ struct Integer {
         assert(type == other.type);
         switch (type) {
         case IntType::Unbounded:
-            unbounded /= other.unbounded;
+            *this = sdiv(other);
             break;
         case IntType::Bounded:
             logError("Use sdiv and udiv instead\n");
@@ -117,9 +173,16 @@ struct Integer {
     Integer operator*=(const Integer &other) {
         assert(type == other.type);
         switch (type) {
-        case IntType::Unbounded:
-            unbounded *= other.unbounded;
+        case IntType::Unbounded: {
+            int64_t result;
+            if (isSmall() && other.isSmall() &&
+                !__builtin_mul_overflow(small, other.small, &result)) {
+                small = result;
+            } else {
+                *this = Integer(asUnbounded() * other.asUnbounded());
+            }
             break;
+        }
         case IntType::Bounded:
             bounded *= other.bounded;
             break;
@@ -133,7 +196,7 @@ struct Integer {
     Integer &operator++() {
         switch (type) {
         case IntType::Unbounded:
-            unbounded++;
+            operator+=(fromSmall(1));
             break;
         case IntType::Bounded:
             bounded++;
@@ -149,7 +212,7 @@ struct Integer {
     Integer &operator--() {
         switch (type) {
         case IntType::Unbounded:
-            unbounded--;
+            operator-=(fromSmall(1));
             break;
         case IntType::Bounded:
             bounded--;
@@ -165,7 +228,10 @@ struct Integer {
     std::string get_str() const {
         switch (type) {
         case IntType::Unbounded:
-            return unbounded.get_str();
+            if (isBig) {
+                return big.get_str();
+            }
+            return std::to_string(small);
         case IntType::Bounded:
             return bounded.toString(10, true);
         }
@@ -173,13 +239,16 @@ struct Integer {
     mpz_class asUnbounded() const {
         switch (type) {
         case IntType::Unbounded:
-            return unbounded;
+            if (isBig) {
+                return big;
+            }
+            return mpz_class(static_cast<long>(small));
         case IntType::Bounded:
-            return bounded.getSExtValue();
+            return mpz_class(static_cast<long>(bounded.getSExtValue()));
         }
     }
-    Integer zext(unsigned width);
-    Integer sext(unsigned width);
+    Integer zext(unsigned width) const;
+    Integer sext(unsigned width) const;
     bool eq(const Integer &rhs) const;
     bool ne(const Integer &rhs) const;
     bool ult(const Integer &rhs) const;
@@ -203,14 +272,23 @@ struct Integer {
     Integer or_(const Integer &rhs) const;
     Integer xor_(const Integer &rhs) const;
 
-    Integer zextOrTrunc(unsigned width);
+    Integer zextOrTrunc(unsigned width) const;
 };
 
+// Compares two unbounded integers, -1, 0 or 1 like mpz_cmp
+inline int compareUnbounded(const Integer &lhs, const Integer &rhs) {
+    if (lhs.isSmall() && rhs.isSmall()) {
+        return (lhs.small > rhs.small) - (lhs.small < rhs.small);
+    }
+    int result = cmp(lhs.asUnbounded(), rhs.asUnbounded());
+    return (result > 0) - (result < 0);
+}
+
 inline bool operator<(const Integer &lhs, const Integer &rhs) {
     assert(lhs.type == rhs.type);
     switch (lhs.type) {
     case IntType::Unbounded:
-        return lhs.unbounded < rhs.unbounded;
+        return compareUnbounded(lhs, rhs) < 0;
     case IntType::Bounded:
         // Only used for putting it in a map
         return lhs.bounded.slt(rhs.bounded);
@@ -232,7 +310,11 @@ inline bool operator==(const Integer &lhs, const Integer &rhs) {
     assert(lhs.type == rhs.type);
     switch (lhs.type) {
     case IntType::Unbounded:
-        return lhs.unbounded == rhs.unbounded;
+        // The representation is canonical
+        if (lhs.isBig != rhs.isBig) {
+            return false;
+        }
+        return lhs.isBig ? lhs.big == rhs.big : lhs.small == rhs.small;
     case IntType::Bounded:
         return lhs.bounded == rhs.bounded;
     }
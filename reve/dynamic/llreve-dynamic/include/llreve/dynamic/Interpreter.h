@@ -14,12 +14,16 @@
 #include "Helper.h"
 #include "MonoPair.h"
 
+#include <chrono>
 #include <gmpxx.h>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instructions.h"
@@ -28,6 +32,8 @@
 #include "json.hpp"
 
 #include "Integer.h"
+#include "InterpreterCore.h"
+#include "PersistentMap.h"
 
 namespace llvm {
 template <> struct DenseMapInfo<std::string> {
@@ -39,6 +45,39 @@ template <> struct DenseMapInfo<std::string> {
     static bool isEqual(std::string LHS, std::string RHS) { return LHS == RHS; }
 };
 
+// Hashes the value without copying it, the hash is only consistent with
+// equality of integers of the same type
+inline unsigned hashIntegerValue(const Integer &val) {
+    switch (val.type) {
+    case IntType::Unbounded:
+        if (val.isSmall()) {
+            return (unsigned)(hash_value(val.small));
+        }
+        // abs is necessary because gmp is shitty
+        return (unsigned)(hash_combine_range(
+            val.big.get_mpz_t()->_mp_d,
+            val.big.get_mpz_t()->_mp_d +
+                std::abs(val.big.get_mpz_t()->_mp_size)));
+    case IntType::Bounded:
+        return (unsigned)(hash_value(val.bounded));
+    }
+    return 0;
+}
+
+// Compares integers of possibly different types and bitwidths
+inline bool integersEqual(const Integer &lhs, const Integer &rhs) {
+    if (lhs.type != rhs.type) {
+        return false;
+    }
+    // LLVM doesn’t allow comparison of APInts of different bitwidths, since
+    // this is the case for tombstones we have to treat them separately
+    if (lhs.type == IntType::Bounded &&
+        lhs.bounded.getBitWidth() != rhs.bounded.getBitWidth()) {
+        return false;
+    }
+    return lhs == rhs;
+}
+
 template <> struct DenseMapInfo<Integer> {
     // Odd bitwidths should never occur in practise, so these are good special
     // values
@@ -48,43 +87,11 @@ template <> struct DenseMapInfo<Integer> {
     static inline Integer getTombstoneKey() {
         return Integer(llvm::APInt::getMaxValue(5));
     }
-    static unsigned getHashValue(Integer val) {
-        switch (val.type) {
-        case IntType::Unbounded:
-            // abs is necessary because gmp is shitty
-            return (unsigned)(hash_combine_range(
-                val.unbounded.get_mpz_t()->_mp_d,
-                val.unbounded.get_mpz_t()->_mp_d +
-                    std::abs(val.unbounded.get_mpz_t()->_mp_size)));
-        case IntType::Bounded:
-            return (unsigned)(hash_value(val.bounded));
-        }
+    static unsigned getHashValue(const Integer &val) {
+        return hashIntegerValue(val);
     }
-    static bool isEqual(Integer lhs, Integer rhs) {
-        switch (lhs.type) {
-        case IntType::Unbounded:
-            switch (rhs.type) {
-            case IntType::Unbounded:
-                return lhs.unbounded == rhs.unbounded;
-            case IntType::Bounded:
-                return false;
-            }
-        case IntType::Bounded:
-            switch (rhs.type) {
-            case IntType::Unbounded:
-                return false;
-            case IntType::Bounded:
-                // LLVM doesn’t allow comparison of APInts of different
-                // bitwidths, since this is the case for tombstones we have to
-                // treat them separately
-                if (lhs.bounded.getBitWidth() == rhs.bounded.getBitWidth()) {
-                    return lhs.bounded == rhs.bounded;
-                } else {
-                    return false;
-                }
-            }
-        }
-        return lhs == rhs;
+    static bool isEqual(const Integer &lhs, const Integer &rhs) {
+        return integersEqual(lhs, rhs);
     }
 };
 
@@ -113,19 +120,55 @@ using HeapAddress = Integer;
 nlohmann::json toJSON(const Integer &v);
 bool unsafeBool(const Integer &v);
 
+// The key info of heaps. Addresses are machine words (small unbounded
+// integers or 64 bit APInts, see Integer::asPointer), for these hashing and
+// comparing only looks at the word. Other integers fall back to comparing the
+// values. Nothing is copied, so lookups don’t allocate.
+struct HeapAddressInfo {
+    static unsigned getHashValue(const HeapAddress &addr) {
+        if (addr.isSmall()) {
+            return (unsigned)(llvm::hash_value(addr.small));
+        }
+        if (addr.type == IntType::Bounded &&
+            addr.bounded.getBitWidth() <= 64) {
+            return (unsigned)(llvm::hash_combine(addr.bounded.getBitWidth(),
+                                                 addr.bounded.getZExtValue()));
+        }
+        return llvm::hashIntegerValue(addr);
+    }
+    static bool isEqual(const HeapAddress &lhs, const HeapAddress &rhs) {
+        if (lhs.isSmall() && rhs.isSmall()) {
+            return lhs.small == rhs.small;
+        }
+        if (lhs.type == IntType::Bounded && rhs.type == IntType::Bounded &&
+            lhs.bounded.getBitWidth() <= 64 &&
+            lhs.bounded.getBitWidth() == rhs.bounded.getBitWidth()) {
+            return lhs.bounded.getZExtValue() == rhs.bounded.getZExtValue();
+        }
+        return llvm::integersEqual(lhs, rhs);
+    }
+};
+
+// Heaps are copied into every state, the persistent map makes these copies
+// cheap since they share all locations that have not been modified
+using HeapMap = PersistentMap<HeapAddress, Integer, HeapAddressInfo>;
+
 struct Heap {
-    llvm::SmallDenseMap<HeapAddress, Integer> assignedValues;
+    HeapMap assignedValues;
     Integer background;
-    Heap() : assignedValues({}), background(mpz_class(0)) {}
-    Heap(llvm::SmallDenseMap<HeapAddress, Integer> assignedValues,
-         Integer background)
+    Heap() : background(mpz_class(0)) {}
+    Heap(HeapMap assignedValues, Integer background)
         : assignedValues(std::move(assignedValues)),
           background(std::move(background)) {}
+    Heap(const llvm::SmallDenseMap<HeapAddress, Integer> &values,
+         Integer background)
+        : background(std::move(background)) {
+        for (const auto &val : values) {
+            assignedValues.set(val.first, val.second);
+        }
+    }
 };
 
-bool isContainedIn(const llvm::SmallDenseMap<HeapAddress, Integer> &small,
-                   const Heap &big);
-
 bool operator==(const Heap &lhs, const Heap &rhs);
 
 template <typename T> using VarMap = llvm::DenseMap<T, Integer>;
@@ -149,6 +192,68 @@ nlohmann::json stateToJSON(State<T> state,
 
 using FastState = State<const llvm::Value *>;
 
+// A store or the first load of a location, which assigns the background value
+// to it. The events of a sparse heap trace (see -sparse-heap-trace) replace
+// the snapshots of the heap, so a trace only keeps the locations accessed by
+// each step.
+struct HeapEvent {
+    HeapAddress address;
+    // None if the location had not been assigned before
+    llvm::Optional<Integer> oldValue;
+    Integer newValue;
+};
+
+// The states at the beginning of each block of a call. Instead of a full copy
+// of the variables and the heap only the changes since the previous state are
+// stored. States are rebuilt by replaying the changes, which is cheap if they
+// are requested in order.
+template <typename T> class StateTrace {
+  public:
+    struct Delta {
+        std::vector<std::pair<T, Integer>> variables;
+        // Set if the heap has changed, copying it is cheap since it is
+        // persistent
+        llvm::Optional<Heap> heap;
+        // Applied to 'heap' or the heap of the previous state in order
+        std::vector<HeapEvent> heapEvents;
+    };
+    // Returns the index of the new state
+    auto push(Delta delta) -> size_t {
+        deltas.push_back(std::move(delta));
+        return deltas.size() - 1;
+    }
+    auto size() const -> size_t { return deltas.size(); }
+    auto delta(size_t index) const -> const Delta & { return deltas[index]; }
+    auto rebuild(size_t index) -> State<T> {
+        assert(index < deltas.size());
+        if (applied > index + 1) {
+            current = State<T>();
+            applied = 0;
+        }
+        for (; applied <= index; ++applied) {
+            const Delta &delta = deltas[applied];
+            for (const auto &var : delta.variables) {
+                current.variables[var.first] = var.second;
+            }
+            if (delta.heap) {
+                current.heap = *delta.heap;
+            }
+            for (const auto &event : delta.heapEvents) {
+                current.heap.assignedValues.set(event.address, event.newValue);
+            }
+        }
+        return current;
+    }
+
+  private:
+    std::vector<Delta> deltas;
+    // The state after applying the first 'applied' deltas
+    State<T> current;
+    size_t applied = 0;
+};
+
+using FastStateTrace = StateTrace<const llvm::Value *>;
+
 template <typename T> struct Step {
     virtual ~Step() = default;
     Step(const Step &other) = default;
@@ -195,12 +300,12 @@ using FastCall = Call<const llvm::Value *>;
 
 template <typename T> struct BlockStep : Step<T> {
     BlockName blockName;
-    State<T> state;
     // The calls performed in this block
     std::vector<Call<T>> calls;
-    BlockStep(BlockName blockName, State<T> state, std::vector<Call<T>> calls)
-        : blockName(std::move(blockName)), state(std::move(state)),
-          calls(std::move(calls)) {}
+    BlockStep(BlockName blockName, std::shared_ptr<StateTrace<T>> trace,
+              size_t stateIndex, std::vector<Call<T>> calls)
+        : blockName(std::move(blockName)), calls(std::move(calls)),
+          trace(std::move(trace)), stateIndex(stateIndex) {}
     BlockStep(BlockStep &&other) = default;
     BlockStep(const BlockStep &other) = default;
     BlockStep &operator=(BlockStep &&other) = default;
@@ -209,115 +314,206 @@ template <typename T> struct BlockStep : Step<T> {
     toJSON(std::function<std::string(T)> varName) const override {
         nlohmann::json j;
         j["block_name"] = blockName;
-        j["state"] = stateToJSON(state, varName);
+        j["state"] = stateToJSON(state(), varName);
         std::vector<nlohmann::json> jsonCalls;
-        for (auto call : calls) {
+        for (const auto &call : calls) {
             jsonCalls.push_back(call.toJSON(varName));
         }
         j["calls"] = jsonCalls;
         return j;
     }
+    // The state after the phi nodes of this block. It is rebuilt on the first
+    // access and kept afterwards, so only the steps that are actually used
+    // (e.g. the ones at marks) pay for a full copy.
+    auto state() const -> const State<T> & {
+        if (!cachedState) {
+            cachedState =
+                std::make_shared<const State<T>>(trace->rebuild(stateIndex));
+        }
+        return *cachedState;
+    }
+    // The changes compared to the state of the previous step of the call
+    auto stateDelta() const -> const typename StateTrace<T>::Delta & {
+        return trace->delta(stateIndex);
+    }
+
+  private:
+    std::shared_ptr<StateTrace<T>> trace;
+    size_t stateIndex;
+    mutable std::shared_ptr<const State<T>> cachedState;
 };
 
-template <typename T> struct BlockUpdate {
-    // State after phi nodes
-    State<T> step;
-    // next block, null if the block ended with a return instruction
-    const llvm::BasicBlock *nextBlock;
-    // function calls in this block in the order they were called
-    std::vector<Call<T>> calls;
-    // Indicates a stop because we ran out of steps
-    bool earlyExit;
-    // steps this block has needed, if there are no function calls exactly one
-    // step per block is needed
-    uint32_t blocksVisited;
-    BlockUpdate(State<T> step, // State end,
-                const llvm::BasicBlock *nextBlock, std::vector<Call<T>> calls,
-                bool earlyExit, uint32_t blocksVisited)
-        : step(std::move(step)), nextBlock(nextBlock), calls(std::move(calls)),
-          earlyExit(earlyExit), blocksVisited(blocksVisited) {}
-    BlockUpdate() = default;
+// The resources a single trace including all of its calls may use. Once one
+// of them is exhausted the trace is stopped and marked as an early exit. A
+// limit of 0 disables the instruction, time and heap budgets.
+struct InterpreterBudget {
+    uint32_t blocks;
+    uint64_t instructions;
+    std::chrono::milliseconds time;
+    // The number of assigned heap locations
+    size_t heapSize;
+    // The other budgets are taken from the command line
+    InterpreterBudget(uint32_t blocks);
+    InterpreterBudget(uint32_t blocks, uint64_t instructions,
+                      std::chrono::milliseconds time, size_t heapSize)
+        : blocks(blocks), instructions(instructions), time(time),
+          heapSize(heapSize) {}
 };
 
-struct TerminatorUpdate {
-    // State end;
-    const llvm::BasicBlock *nextBlock;
-    TerminatorUpdate(const llvm::BasicBlock *nextBlock)
-        : nextBlock(nextBlock) {}
-    TerminatorUpdate() = default;
+// The budget for the traces starting in this function, usually one of the
+// main functions. The budgets given for it using -interpret-budget take
+// precedence over 'blocks' and the global flags.
+auto budgetForFunction(const llvm::Function &mainFunction, uint32_t blocks)
+    -> InterpreterBudget;
+
+// Memoizes the calls of functions that do not write to the heap. A call is
+// looked up by the callee, the values of its arguments and, if the callee
+// reads from the heap or the steps are kept, the heap at the call. On a hit
+// the callee is not interpreted again but the summary of the previous call is
+// returned.
+//
+// While a CallMemo is alive, it is used by all interpreters of the thread
+// that created it and of the threads it is installed in using Scope, so the
+// traces of a batch share their calls. The memo of one verification is thus
+// never seen by the threads of another one. The functions must not be
+// modified while it is alive. Without one, each interpreter uses its own memo
+// if -interpret-memoize is passed.
+class CallMemo {
+  public:
+    // If 'keepSteps' is false the steps of the callee are dropped from the
+    // memoized calls and only their entry and return states are kept. If
+    // 'makeCurrent' is false the memo is only used by its owner.
+    explicit CallMemo(bool keepSteps, bool makeCurrent = true);
+    CallMemo(const CallMemo &) = delete;
+    CallMemo &operator=(const CallMemo &) = delete;
+    ~CallMemo();
+
+    // Makes 'memo' the current memo of this thread for the lifetime of the
+    // scope, 'memo' may be nullptr
+    class Scope {
+      public:
+        explicit Scope(CallMemo *memo);
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+
+      private:
+        CallMemo *previous;
+    };
+
+    // The innermost instance of this thread or nullptr
+    static auto current() -> CallMemo *;
+    // The summary of a previous call of 'fun' with the same arguments and a
+    // relevant heap. The heap of the returned call is the heap of 'entry'.
+    auto lookup(const llvm::Function &fun, const FastState &entry)
+        -> llvm::Optional<FastCall>;
+    // Only calls that have not exited early are memoized
+    void insert(const FastCall &call);
+    // Functions whose calls can be memoized
+    auto isMemoizable(const llvm::Function &fun) -> bool;
+
+  private:
+    // Calls are no longer memoized once this many are stored
+    static const size_t MaxEntries = 1 << 16;
+    struct Effects {
+        bool writesHeap;
+        bool readsHeap;
+    };
+    struct Entry {
+        llvm::Optional<Heap> heap;
+        FastCall call;
+    };
+    using Key = std::pair<const llvm::Function *, std::vector<Integer>>;
+    struct KeyLess {
+        auto operator()(const Key &lhs, const Key &rhs) const -> bool;
+    };
+    bool keepSteps;
+    std::mutex mutex;
+    llvm::DenseMap<const llvm::Function *, Effects> effects;
+    std::map<Key, std::vector<Entry>, KeyLess> calls;
+    size_t entries = 0;
+    bool isCurrent;
+    CallMemo *previous;
+
+    auto functionEffects(const llvm::Function &fun) -> Effects;
+    auto key(const llvm::Function &fun, const FastState &entry) const -> Key;
 };
 
+// A memo that is current while it is alive if -interpret-memoize is passed,
+// nullptr otherwise
+auto callMemoFromFlags() -> std::unique_ptr<CallMemo>;
+
 /// The variables in the entry state will be renamed appropriately for both
-/// programs
+/// programs. The functions are lowered to bytecode (see Bytecode.h) before
+/// they are interpreted.
 MonoPair<FastCall>
 interpretFunctionPair(MonoPair<const llvm::Function *> funs,
                       MonoPair<FastVarMap> variables, MonoPair<Heap> heaps,
-                      uint32_t maxSteps,
+                      InterpreterBudget budget,
                       const AnalysisResultsMap &analysisResults);
 MonoPair<FastCall> interpretFunctionPair(
     MonoPair<const llvm::Function *> funs, MonoPair<FastVarMap> variables,
     MonoPair<Heap> heaps, MonoPair<const llvm::BasicBlock *> startBlocks,
-    uint32_t maxSteps, const AnalysisResultsMap &analysisResults);
+    InterpreterBudget budget, const AnalysisResultsMap &analysisResults);
+/// If 'observer' is given it is notified of every interpreted block and
+/// instruction, see llreve::interpreter::TraceObserver.
 auto interpretFunction(const llvm::Function &fun, FastState entry,
-                       uint32_t maxSteps,
-                       const AnalysisResultsMap &analysisResults) -> FastCall;
+                       InterpreterBudget budget,
+                       const AnalysisResultsMap &analysisResults,
+                       interpreter::TraceObserver *observer = nullptr)
+    -> FastCall;
 auto interpretFunction(const llvm::Function &fun, FastState entry,
-                       const llvm::BasicBlock *bb, uint32_t maxSteps,
-                       const AnalysisResultsMap &analysisResults) -> FastCall;
-auto interpretBlock(const llvm::BasicBlock &block,
-                    const llvm::BasicBlock *prevBlock, FastState &state,
-                    bool skipPhi, uint32_t maxStep,
-                    const AnalysisResultsMap &analysisResults)
-    -> BlockUpdate<const llvm::Value *>;
-auto interpretPHI(const llvm::PHINode &instr, FastState &state,
-                  const llvm::BasicBlock *prevBlock) -> void;
-auto interpretInstruction(const llvm::Instruction *instr, FastState &state)
-    -> void;
-auto interpretTerminator(const llvm::TerminatorInst *instr, FastState &state)
-    -> TerminatorUpdate;
-auto resolveValue(const llvm::Value *val, const FastState &state,
-                  const llvm::Type *type) -> Integer;
-auto interpretICmpInst(const llvm::ICmpInst *instr, FastState &state) -> void;
-auto interpretIntPredicate(const llvm::ICmpInst *instr,
-                           llvm::CmpInst::Predicate pred, const Integer &i0,
-                           const Integer &i1, FastState &state) -> void;
-auto interpretBinOp(const llvm::BinaryOperator *instr, FastState &state)
-    -> void;
-auto interpretIntBinOp(const llvm::BinaryOperator *instr,
-                       llvm::Instruction::BinaryOps op, const Integer &i0,
-                       const Integer &i1, FastState &state) -> void;
-auto interpretBoolBinOp(const llvm::BinaryOperator *instr,
-                        llvm::Instruction::BinaryOps op, bool b0, bool b1,
-                        FastState &state) -> void;
-
-template <typename A, typename T> Integer resolveGEP(T &gep, State<A> &state) {
-    Integer offset = resolveValue(gep.getPointerOperand(), state,
-                                  gep.getPointerOperand()->getType());
-    const auto type = gep.getSourceElementType();
-    std::vector<llvm::Value *> indices;
-    for (auto ix = gep.idx_begin(), e = gep.idx_end(); ix != e; ++ix) {
-        // Try several ways of finding the module
-        const llvm::Module *mod = nullptr;
-        if (auto instr = llvm::dyn_cast<llvm::Instruction>(&gep)) {
-            mod = instr->getModule();
-        }
-        if (auto global =
-                llvm::dyn_cast<llvm::GlobalValue>(gep.getPointerOperand())) {
-            mod = global->getParent();
-        }
-        if (mod == nullptr) {
-            logErrorData("Couldn’t cast gep to an instruction:\n", gep);
-        }
-        indices.push_back(*ix);
-        const auto indexedType = llvm::GetElementPtrInst::getIndexedType(
-            type, llvm::ArrayRef<llvm::Value *>(indices));
-        const auto size = typeSize(indexedType, mod->getDataLayout());
-        Integer val = resolveValue(*ix, state, (*ix)->getType());
-        offset += Integer(mpz_class(size)).asPointer() *
-                  Integer(val.asUnbounded()).asPointer();
-    }
-    return offset;
-}
+                       const llvm::BasicBlock *bb, InterpreterBudget budget,
+                       const AnalysisResultsMap &analysisResults,
+                       interpreter::TraceObserver *observer = nullptr)
+    -> FastCall;
+
+// Interprets a function one block at a time. In contrast to
+// interpretFunction the steps are not collected, so the memory usage does not
+// grow with the length of the trace. Each step has its own complete state.
+class StepwiseInterpreter {
+  public:
+    StepwiseInterpreter(const llvm::Function &fun, const FastState &entry,
+                        const llvm::BasicBlock *startBlock,
+                        InterpreterBudget budget,
+                        const AnalysisResultsMap &analysisResults);
+    StepwiseInterpreter(StepwiseInterpreter &&other);
+    ~StepwiseInterpreter();
+    // Returns None once the function has returned or exhausted its budget
+    auto next() -> llvm::Optional<BlockStep<const llvm::Value *>>;
+    auto ranOutOfSteps() const -> bool;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Interprets a function on a sequence of inputs and continues the traces of
+// later inputs from the states of earlier ones. At the marks of a trace its
+// state is saved together with the values of the arguments it has read so
+// far. An input that has the same values for these arguments and the same
+// heap follows the same path up to the mark, so it is continued from the
+// saved state with the remaining arguments replaced. The longest matching
+// prefix is used, which for enumerated inputs is typically the setup code
+// before the first loop.
+//
+// The steps of a shared prefix are not repeated, so they are missing from
+// the returned calls while the return states are the same. This is only done
+// if the budget only limits the number of blocks and
+// -interpret-share-prefixes is passed, otherwise every trace starts at the
+// entry of the function.
+class PrefixSharingInterpreter {
+  public:
+    PrefixSharingInterpreter(const llvm::Function &fun,
+                             InterpreterBudget budget,
+                             const AnalysisResultsMap &analysisResults);
+    ~PrefixSharingInterpreter();
+    auto interpret(const FastState &entry) -> FastCall;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
 
 std::string valueName(const llvm::Value *val);
 
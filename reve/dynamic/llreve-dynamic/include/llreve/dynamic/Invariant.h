@@ -4,9 +4,11 @@
 #include "FreeVariables.h"
 
 #include "llreve/dynamic/HeapPattern.h"
+#include "llreve/dynamic/HeapProgram.h"
 #include "llreve/dynamic/Linear.h"
 
 #include <gmpxx.h>
+#include <set>
 
 namespace llreve {
 namespace dynamic {
@@ -58,8 +60,6 @@ using FunctionInvariantMap =
 using PolynomialEquations = LoopInfoData<Matrix<mpq_class>>;
 using PolynomialSolutions =
     IterativeInvariantMap<LoopInfoData<Matrix<mpz_class>>>;
-using HeapPatternCandidates =
-    std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>;
 // The optional is needed to indicate that we have seen a certain combination of
 // mark and exit index but not this loop synchronization
 using HeapPatternCandidatesMap =
@@ -67,11 +67,31 @@ using HeapPatternCandidatesMap =
 using BoundsMap =
     std::map<Mark, std::map<std::string, Bound<llvm::Optional<Integer>>>>;
 
+// The degree of the polynomial equations at each mark of the main functions.
+// All marks start at the initial degree. A mark is only raised to a higher
+// degree if its invariant can’t be refined otherwise, since the number of
+// terms grows combinatorially with the degree.
+class MarkDegrees {
+  public:
+    MarkDegrees(size_t initial, size_t maximal)
+        : initial(initial), maximal(maximal) {}
+    auto at(Mark mark) const -> size_t;
+    // Returns false if the mark already has the maximal degree
+    auto raise(Mark mark) -> bool;
+    // Moves all marks back to the initial degree
+    void reset() { raised.clear(); }
+
+  private:
+    size_t initial;
+    size_t maximal;
+    std::map<Mark, size_t> raised;
+};
+
 std::map<Mark, smt::SharedSMTRef> makeIterativeInvariantDefinitions(
     MonoPair<const llvm::Function *> functions,
     const IterativeInvariantMap<PolynomialEquations> &equations,
     const HeapPatternCandidatesMap &patterns,
-    const AnalysisResultsMap &analysisResults, size_t degree);
+    const AnalysisResultsMap &analysisResults, const MarkDegrees &degrees);
 RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
 makeRelationalFunctionInvariantDefinitions(
     const RelationalFunctionInvariantMap<
@@ -90,7 +110,34 @@ FunctionInvariantMap<smt::SharedSMTRef> makeFunctionInvariantDefinitions(
     const FunctionInvariantMap<Matrix<mpq_class>> &equations,
     const FunctionInvariantMap<HeapPatternCandidates> &patterns,
     const AnalysisResultsMap &analysisResults, size_t degree);
-Matrix<mpz_class> findSolutions(Matrix<mpq_class> equations);
+// The update functions only rebuild the definitions of the given invariants
+// and keep all others. Invariants without an existing definition are ignored.
+void updateIterativeInvariantDefinitions(
+    std::map<Mark, smt::SharedSMTRef> &definitions,
+    const std::set<Mark> &changedMarks,
+    MonoPair<const llvm::Function *> functions,
+    const IterativeInvariantMap<PolynomialEquations> &equations,
+    const HeapPatternCandidatesMap &patterns,
+    const AnalysisResultsMap &analysisResults, const MarkDegrees &degrees);
+void updateRelationalFunctionInvariantDefinitions(
+    RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
+        &definitions,
+    const std::set<std::pair<MonoPair<const llvm::Function *>, Mark>>
+        &changedInvariants,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>> &equations,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
+        &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree);
+void updateFunctionInvariantDefinitions(
+    FunctionInvariantMap<smt::SharedSMTRef> &definitions,
+    const std::set<std::pair<const llvm::Function *, Mark>> &changedInvariants,
+    MonoPair<const llvm::Module &> modules,
+    const FunctionInvariantMap<Matrix<mpq_class>> &equations,
+    const FunctionInvariantMap<HeapPatternCandidates> &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree);
+Matrix<mpz_class> findSolutions(const Matrix<mpq_class> &equations);
 PolynomialSolutions
 findSolutions(const IterativeInvariantMap<PolynomialEquations> &equationsMap);
 // This can return a nullpointer if the invariant is empty, conceptually this
@@ -0,0 +1,52 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Interpreter.h"
+
+#include <memory>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+
+namespace llreve {
+namespace dynamic {
+
+// Collects traces by running a function natively instead of interpreting it.
+// A copy of the module is instrumented so that every mark block reports the
+// integer values that are available at its start, the copy is then compiled
+// using ORC. The resulting calls only contain the steps at the entry and at
+// marks, which is all that splitCallAtMarks and analyzeExecution look at.
+//
+// Only bitvector configurations are supported because native integers wrap
+// around and only functions whose arguments and return value are integers of
+// at most 64 bits can be run. Calls to other functions are executed natively
+// and are not part of the trace.
+class JITTraceCollector {
+  public:
+    // Returns nullptr if the function cannot be run natively
+    static auto create(const llvm::Function &fun,
+                       const AnalysisResultsMap &analysisResults)
+        -> std::unique_ptr<JITTraceCollector>;
+    ~JITTraceCollector();
+    // 'maxMarks' limits the number of marks that are crossed, 0 means no
+    // limit. This can be called from several threads.
+    auto run(const FastVarMap &arguments, uint32_t maxMarks) const
+        -> FastCall;
+
+    struct Impl;
+
+  private:
+    std::unique_ptr<Impl> impl;
+    explicit JITTraceCollector(std::unique_ptr<Impl> impl);
+};
+}
+}
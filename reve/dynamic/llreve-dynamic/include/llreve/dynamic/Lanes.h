@@ -0,0 +1,87 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Bytecode.h"
+#include "Interpreter.h"
+
+#include <memory>
+#include <vector>
+
+namespace llreve {
+namespace dynamic {
+
+// Interprets a function on several inputs at once. The inputs are split into
+// groups of LaneCount lanes which step through the bytecode in lockstep, the
+// values of a slot are stored next to each other for all lanes so every
+// instruction is a loop over the lanes that the compiler can vectorize.
+//
+// This is only possible for functions that compute on bitvectors of at most
+// 64 bits without calls or heap accesses (see create). A group follows the
+// successor of its first lane, lanes taking a different branch leave the
+// group and continue in the scalar interpreter at the start of that block.
+// Lanes that run into undefined behavior are interpreted again by the scalar
+// interpreter, which reports the error. The results are the same as the ones
+// of interpretFunction.
+
+// The number of inputs in a group
+const unsigned LaneCount = 16;
+
+// The parts of a FastCall needed to compare two functions
+struct LaneResult {
+    // The value of the return instruction, None if it was not reached
+    llvm::Optional<Integer> returnValue;
+    Heap heap;
+    bool earlyExit = false;
+};
+
+// The result of a call of the scalar interpreter
+auto laneResult(const FastCall &call,
+                const AnalysisResultsMap &analysisResults) -> LaneResult;
+
+class LaneInterpreter {
+  public:
+    // Returns nullptr if the function cannot be interpreted in lanes, if
+    // -bitvect is not passed, the budget limits anything but the number of
+    // blocks or if -interpret-lanes=false is passed
+    static auto create(const llvm::Function &fun, InterpreterBudget budget,
+                       const AnalysisResultsMap &analysisResults)
+        -> std::unique_ptr<LaneInterpreter>;
+    // The results in the order of the inputs. This can be called from
+    // multiple threads concurrently.
+    auto interpret(const std::vector<FastVarMap> &inputs,
+                   const Heap &heap) const -> std::vector<LaneResult>;
+
+  private:
+    LaneInterpreter(const llvm::Function &fun,
+                    std::unique_ptr<BytecodeFunction> code,
+                    std::vector<unsigned> widths, InterpreterBudget budget,
+                    const AnalysisResultsMap &analysisResults);
+    const llvm::Function &fun;
+    std::unique_ptr<BytecodeFunction> code;
+    // The bit width of every slot, 0 for constants that are not bitvectors
+    std::vector<unsigned> widths;
+    // The values of all slots in all lanes a group starts with, the values of
+    // a slot are stored in LaneCount consecutive elements
+    std::vector<uint64_t> initialValues;
+    InterpreterBudget budget;
+    const AnalysisResultsMap &analysisResults;
+    const llvm::Value *returnInstruction;
+
+    struct Group;
+    void interpretGroup(Group &group) const;
+    void interpretInstruction(const BytecodeInstruction &instr,
+                              Group &group) const;
+    void leaveGroup(Group &group, unsigned lane, BlockIndex from,
+                    BlockIndex to, uint32_t blocksVisited) const;
+};
+}
+}
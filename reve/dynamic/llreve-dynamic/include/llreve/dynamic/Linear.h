@@ -37,9 +37,24 @@ template <typename T> void dumpMatrix(const Matrix<T> &m) {
 
 bool linearlyIndependent(const Matrix<mpq_class> &vectors,
                          std::vector<mpq_class> newVector);
+// Adds a row to a matrix in reduced row echelon form with leading entries of 1
+// (e.g. one that has only been built using this function) so that the result
+// is again in that form. Linearly dependent rows are not inserted, in that case
+// false is returned. This takes O(rows * columns) time.
+bool insertIntoRowEchelonForm(Matrix<mpq_class> &echelon,
+                              std::vector<mpq_class> row);
 std::vector<std::vector<mpq_class>> nullSpace(const Matrix<mpq_class> &m);
 std::vector<mpq_class> multiplyRow(std::vector<mpq_class> vec, mpq_class c);
 std::vector<mpz_class> ratToInt(std::vector<mpq_class> vec);
+// The rank of the matrix modulo a prime below 2^31. This is a lower bound for
+// the rank over the rationals so if it is equal to the number of columns the
+// null space is trivial.
+size_t modularRank(const Matrix<mpq_class> &m);
+// Returns the same basis as applying ratToInt to every vector returned by
+// nullSpace. The elimination is fraction-free so only integers are involved
+// and no gcds have to be computed while eliminating. Matrices that are already
+// in the form produced by insertIntoRowEchelonForm are not eliminated again.
+Matrix<mpz_class> integerNullSpace(const Matrix<mpq_class> &m);
 template <typename T>
 std::vector<T> matrixTimesVector(const Matrix<T> &m,
                                  const std::vector<T> &vec) {
@@ -0,0 +1,35 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "AnalysisResults.h"
+#include "MonoPair.h"
+
+#include "llvm/IR/Function.h"
+
+namespace llreve {
+namespace dynamic {
+
+// Runs random examples of the two main functions and counts how often each
+// program passes a mark before both leave it. If a loop consistently runs a
+// few more iterations in one program, that program is peeled, if it runs a
+// constant factor more iterations, that program is unrolled by this factor,
+// see findLoopTransformations. This makes the loops run in lockstep, so fewer
+// stutter paths are needed and the invariants are simpler.
+//
+// The paths and the free variables in 'analysisResults' as well as the heap
+// regions are updated accordingly. Returns true if one of the functions has
+// been transformed. This header doesn’t depend on GMP so llreve can use it as
+// a preprocessing step.
+bool synchronizeLoops(MonoPair<llvm::Function *> functions,
+                      AnalysisResultsMap &analysisResults);
+}
+}
@@ -42,30 +42,37 @@ struct ModelValues {
     MonoPair<const llvm::Function *> functions;
 };
 
+struct ITE;
+
 struct SMTExpr {
-    virtual std::set<std::string> references() const = 0;
+    // The identifiers occuring in the expression. Deeply nested expressions
+    // are walked using a worklist and all references are collected in a
+    // single set.
+    std::set<std::string> references() const;
+    // The identifiers referenced directly by this node
+    virtual void localReferences(std::set<std::string> &refs) const;
+    virtual void children(std::vector<const SMTExpr *> &worklist) const;
     virtual mpz_class getVal() const;
     virtual ArrayVal getArrayVal() const;
     virtual mpz_class getIndex() const;
+    virtual const ITE *asITE() const { return nullptr; }
     virtual ~SMTExpr();
 };
 
 struct AsArray : public SMTExpr {
     std::string arg;
     AsArray(std::string arg) : arg(arg) {}
-    std::set<std::string> references() const override;
+    void localReferences(std::set<std::string> &refs) const override;
 };
 
 struct String : public SMTExpr {
     std::string val;
     String(std::string val) : val(val) {}
-    std::set<std::string> references() const override;
 };
 
 struct Int : public SMTExpr {
     mpz_class val;
     Int(mpz_class val) : val(val) {}
-    std::set<std::string> references() const override;
     mpz_class getVal() const override;
     ArrayVal getArrayVal() const override;
 };
@@ -75,7 +82,7 @@ struct Eq : public SMTExpr {
     std::shared_ptr<SMTExpr> right;
     Eq(std::shared_ptr<SMTExpr> left, std::shared_ptr<SMTExpr> right)
         : left(left), right(right) {}
-    std::set<std::string> references() const override;
+    void children(std::vector<const SMTExpr *> &worklist) const override;
     mpz_class getIndex() const override;
 };
 
@@ -86,14 +93,16 @@ struct ITE : public SMTExpr {
     ITE(std::shared_ptr<SMTExpr> cond, std::shared_ptr<SMTExpr> ifTrue,
         std::shared_ptr<SMTExpr> ifFalse)
         : cond(cond), ifTrue(ifTrue), ifFalse(ifFalse) {}
-    std::set<std::string> references() const override;
+    void children(std::vector<const SMTExpr *> &worklist) const override;
+    // Arrays are modelled as chains of ITEs which are walked iteratively
     ArrayVal getArrayVal() const override;
+    const ITE *asITE() const override { return this; }
 };
 
 struct Identifier : public SMTExpr {
     std::string name;
     Identifier(std::string name) : name(name) {}
-    std::set<std::string> references() const override;
+    void localReferences(std::set<std::string> &refs) const override;
 };
 
 enum class Type { Int, IntArray, IntFun };
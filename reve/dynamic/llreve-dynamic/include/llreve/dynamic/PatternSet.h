@@ -0,0 +1,76 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llreve/dynamic/HeapPattern.h"
+
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llreve {
+namespace dynamic {
+
+using PatternList =
+    std::vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>>;
+
+// The patterns of the -patterns file grouped by the roles and symmetries of
+// their arguments. All patterns of a group accept the same argument
+// combinations, so the candidates for each argument are computed once per
+// group and groups for which some argument has no candidate, e.g. heap
+// addresses at a mark without pointers, are skipped without instantiating
+// any of their patterns.
+class PatternSet {
+  public:
+    PatternSet() = default;
+    explicit PatternSet(PatternList patterns);
+
+    auto patterns() const -> const PatternList & { return patternList; }
+    auto size() const -> size_t { return patternList.size(); }
+    // The same instantiations in the same order as calling allInstantiations
+    // on each pattern
+    auto allInstantiations(const std::vector<smt::SortedVar> &variables,
+                           const FastVarMap &variableValues,
+                           MonoPair<llvm::Value *> returnValues) const
+        -> std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>;
+
+  private:
+    struct Group {
+        std::vector<ArgumentRole> roles;
+        std::vector<ArgumentSymmetry> symmetries;
+        // Indices into 'patternList'
+        std::vector<size_t> patterns;
+    };
+    PatternList patternList;
+    std::vector<Group> groups;
+};
+
+// Checks that every hole of the patterns is bound by exactly one enclosing
+// range, the evaluation of the patterns relies on this
+auto validatePatterns(const PatternList &patterns) -> bool;
+
+// A compact representation of the patterns that can be read back without
+// running the parser, one pattern per line in prefix notation. Returns false
+// if one of the patterns has no serialized form.
+auto serializePatterns(const PatternList &patterns, std::ostream &os) -> bool;
+// Returns false if the data is not a valid serialization
+auto deserializePatterns(const std::string &data, PatternList &patterns)
+    -> bool;
+
+// Parses and validates the pattern file. If 'cacheDir' is not empty, the
+// patterns are stored there in serialized form under the hash of the file and
+// loaded from there on the next run.
+auto loadPatterns(const std::string &fileName, const std::string &cacheDir)
+    -> PatternSet;
+}
+}
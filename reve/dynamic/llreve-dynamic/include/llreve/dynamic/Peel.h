@@ -1,6 +1,9 @@
 #pragma once
 
 #include "MarkAnalysis.h"
+#include "llreve/dynamic/Transform.h"
 
+// Peels the first iteration of the loops at 'mark' and reports the changes to
+// 'loops'
 void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
-                std::string prefix);
+                LoopStructure &loops, std::string prefix);
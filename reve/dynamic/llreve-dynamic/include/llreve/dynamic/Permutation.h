@@ -59,6 +59,38 @@ std::list<std::vector<T>> kPermutations(std::vector<T> input, size_t k) {
     return output;
 }
 
+// Enumerates the multisets of size k over {0, …, n - 1} one at a time. Every
+// multiset is represented by its elements in non-increasing order, the first
+// element changes fastest. The current combination is kept in a single buffer
+// that is reused for all of them.
+class CombinationsWithRepetitions {
+    size_t n;
+    std::vector<size_t> combination;
+    bool done;
+
+  public:
+    CombinationsWithRepetitions(size_t n, size_t k)
+        : n(n), combination(k, 0), done(n == 0 || k == 0) {}
+    auto atEnd() const -> bool { return done; }
+    auto current() const -> const std::vector<size_t> & {
+        return combination;
+    }
+    void next() {
+        size_t i = 0;
+        while (i < combination.size() && combination[i] == n - 1) {
+            ++i;
+        }
+        if (i == combination.size()) {
+            done = true;
+            return;
+        }
+        ++combination[i];
+        for (size_t j = 0; j < i; ++j) {
+            combination[j] = combination[i];
+        }
+    }
+};
+
 std::vector<std::vector<size_t>> kCombinationsWithRepetitionsInt(size_t n,
                                                                  size_t k);
 
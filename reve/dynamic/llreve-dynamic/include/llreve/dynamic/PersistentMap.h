@@ -0,0 +1,242 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace llreve {
+namespace dynamic {
+
+// An immutable hash array mapped trie. Copies share the complete structure and
+// an update only copies the nodes on the path to the changed entry, so a copy
+// costs O(1) and an update O(log n).
+//
+// The shape of the trie only depends on the set of keys, which allows
+// comparing two maps in time proportional to the parts that are not shared.
+template <typename K, typename V, typename KeyInfo = llvm::DenseMapInfo<K>>
+class PersistentMap {
+    static const unsigned BitsPerLevel = 5;
+    static const unsigned Branching = 1u << BitsPerLevel;
+
+    struct Node {
+        // Leaves contain the entries of a single hash value, inner nodes have
+        // a child for every set bit of the bitmap
+        bool leaf;
+        unsigned hash = 0;
+        llvm::SmallVector<std::pair<K, V>, 1> entries;
+        uint32_t bitmap = 0;
+        llvm::SmallVector<std::shared_ptr<const Node>, 2> children;
+
+        explicit Node(bool leaf) : leaf(leaf) {}
+        auto childIndex(unsigned bit) const -> unsigned {
+            return static_cast<unsigned>(
+                __builtin_popcount(bitmap & ((1u << bit) - 1)));
+        }
+        auto child(unsigned bit) const -> const Node * {
+            if (!(bitmap & (1u << bit))) {
+                return nullptr;
+            }
+            return children[childIndex(bit)].get();
+        }
+    };
+    using NodeRef = std::shared_ptr<const Node>;
+
+    NodeRef root;
+    size_t numEntries = 0;
+
+    static auto bitAt(unsigned hash, unsigned shift) -> unsigned {
+        return (hash >> shift) & (Branching - 1);
+    }
+
+    static auto lookupIn(const Node *node, const K &key, unsigned hash,
+                         unsigned shift) -> const V * {
+        while (node && !node->leaf) {
+            node = node->child(bitAt(hash, shift));
+            shift += BitsPerLevel;
+        }
+        if (!node || node->hash != hash) {
+            return nullptr;
+        }
+        for (const auto &entry : node->entries) {
+            if (KeyInfo::isEqual(entry.first, key)) {
+                return &entry.second;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns the new node and sets 'inserted' if the key was not present.
+    // 'stored' is set to the value in the new node.
+    static auto setIn(const NodeRef &node, K key, V val, unsigned hash,
+                      unsigned shift, bool &inserted, const V *&stored)
+        -> NodeRef {
+        if (!node) {
+            auto leaf = std::make_shared<Node>(true);
+            leaf->hash = hash;
+            leaf->entries.push_back({std::move(key), std::move(val)});
+            stored = &leaf->entries.back().second;
+            inserted = true;
+            return leaf;
+        }
+        if (node->leaf) {
+            if (node->hash == hash) {
+                auto leaf = std::make_shared<Node>(*node);
+                for (auto &entry : leaf->entries) {
+                    if (KeyInfo::isEqual(entry.first, key)) {
+                        entry.second = std::move(val);
+                        stored = &entry.second;
+                        return leaf;
+                    }
+                }
+                leaf->entries.push_back({std::move(key), std::move(val)});
+                stored = &leaf->entries.back().second;
+                inserted = true;
+                return leaf;
+            }
+            // Push the existing leaf one level down and insert next to it
+            auto inner = std::make_shared<Node>(false);
+            inner->bitmap = 1u << bitAt(node->hash, shift);
+            inner->children.push_back(node);
+            return setIn(inner, std::move(key), std::move(val), hash, shift,
+                         inserted, stored);
+        }
+        auto inner = std::make_shared<Node>(*node);
+        unsigned bit = bitAt(hash, shift);
+        unsigned index = inner->childIndex(bit);
+        if (inner->bitmap & (1u << bit)) {
+            inner->children[index] =
+                setIn(inner->children[index], std::move(key), std::move(val),
+                      hash, shift + BitsPerLevel, inserted, stored);
+        } else {
+            inner->bitmap |= 1u << bit;
+            inner->children.insert(
+                inner->children.begin() + index,
+                setIn(nullptr, std::move(key), std::move(val), hash,
+                      shift + BitsPerLevel, inserted, stored));
+        }
+        return inner;
+    }
+
+    template <typename F> static void forEachIn(const Node *node, F &f) {
+        if (!node) {
+            return;
+        }
+        if (node->leaf) {
+            for (const auto &entry : node->entries) {
+                f(entry.first, entry.second);
+            }
+            return;
+        }
+        for (const auto &child : node->children) {
+            forEachIn(child.get(), f);
+        }
+    }
+
+    static auto allEqualTo(const Node *node, const V &def) -> bool {
+        bool equal = true;
+        auto check = [&](const K &, const V &val) {
+            equal = equal && val == def;
+        };
+        forEachIn(node, check);
+        return equal;
+    }
+
+    // Checks that every entry of 'node' has the same value in 'other' and
+    // that 'def' is used for keys not present in 'other'
+    static auto containedIn(const Node *node, const Node *other,
+                            unsigned shift, const V &def) -> bool {
+        bool equal = true;
+        auto check = [&](const K &key, const V &val) {
+            if (!equal) {
+                return;
+            }
+            const V *otherVal =
+                lookupIn(other, key, KeyInfo::getHashValue(key), shift);
+            equal = otherVal ? val == *otherVal : val == def;
+        };
+        forEachIn(node, check);
+        return equal;
+    }
+
+    static auto equalIn(const Node *lhs, const Node *rhs, unsigned shift,
+                        const V &def) -> bool {
+        if (lhs == rhs) {
+            return true;
+        }
+        if (!lhs) {
+            return allEqualTo(rhs, def);
+        }
+        if (!rhs) {
+            return allEqualTo(lhs, def);
+        }
+        if (lhs->leaf || rhs->leaf) {
+            return containedIn(lhs, rhs, shift, def) &&
+                   containedIn(rhs, lhs, shift, def);
+        }
+        for (unsigned bit = 0; bit < Branching; ++bit) {
+            if (!equalIn(lhs->child(bit), rhs->child(bit),
+                         shift + BitsPerLevel, def)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  public:
+    auto size() const -> size_t { return numEntries; }
+    auto empty() const -> bool { return numEntries == 0; }
+
+    // Returns nullptr if the key is not present
+    auto lookup(const K &key) const -> const V * {
+        return lookupIn(root.get(), key, KeyInfo::getHashValue(key), 0);
+    }
+    // Inserts the value or replaces the existing one
+    void set(K key, V val) {
+        bool inserted = false;
+        const V *stored = nullptr;
+        unsigned hash = KeyInfo::getHashValue(key);
+        root = setIn(root, std::move(key), std::move(val), hash, 0, inserted,
+                     stored);
+        if (inserted) {
+            ++numEntries;
+        }
+    }
+    // Only inserts the value if the key is not already present. Returns the
+    // value stored for the key and true if the value has been inserted.
+    // The key is hashed once and not copied.
+    auto insert(K key, V val) -> std::pair<const V &, bool> {
+        const unsigned hash = KeyInfo::getHashValue(key);
+        if (const V *existing = lookupIn(root.get(), key, hash, 0)) {
+            return {*existing, false};
+        }
+        bool inserted = false;
+        const V *stored = nullptr;
+        root = setIn(root, std::move(key), std::move(val), hash, 0, inserted,
+                     stored);
+        ++numEntries;
+        return {*stored, true};
+    }
+    // Calls f(key, value) for every entry
+    template <typename F> void forEach(F f) const { forEachIn(root.get(), f); }
+    // Compares the maps treating missing keys as mapped to 'def'. Shared
+    // subtrees are skipped.
+    auto equalWithDefault(const PersistentMap &other, const V &def) const
+        -> bool {
+        return equalIn(root.get(), other.root.get(), 0, def);
+    }
+};
+}
+}
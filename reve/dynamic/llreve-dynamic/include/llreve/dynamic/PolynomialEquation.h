@@ -3,19 +3,98 @@
 #include "llreve/dynamic/Invariant.h"
 #include "llreve/dynamic/Match.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <map>
+#include <set>
+
 namespace llreve {
 namespace dynamic {
 
-void populateEquationsMap(
+// The terms of the polynomial equation of a mark. Each term is a list of
+// indices into the variables of the mark. The variables are looked up by name
+// in the states of the first sample, all further samples are evaluated using
+// the resolved values directly.
+class EquationTemplate {
+  public:
+    EquationTemplate() = default;
+    // The last 'numExtraValues' variables are not part of the states but are
+    // passed to 'evaluate' explicitly, e.g. return values
+    EquationTemplate(const std::vector<smt::SortedVar> &variables,
+                     size_t degree, size_t numExtraValues);
+    // True if this template has been created for these parameters
+    auto fits(size_t numVariables, size_t degree) const -> bool;
+    // Looks up the values of the variables, the states are searched in
+    // order and the first one that contains a variable determines its value.
+    // Returns false if the same values have already been loaded for this exit
+    // index and loop info. Their equation is in the row space of the
+    // equations then and does not have to be evaluated again.
+    auto load(llvm::ArrayRef<const FastVarMap *> states,
+              llvm::ArrayRef<const Integer *> extraValues,
+              const ExitIndex &exitIndex, LoopInfo loopInfo) -> bool;
+    // The equation of the loaded values. The last entry represents the
+    // constant.
+    auto evaluate() const -> std::vector<mpq_class>;
+    // A template of another degree for the same variables which has already
+    // loaded the samples of this one
+    auto withDegree(const std::vector<smt::SortedVar> &variables,
+                    size_t degree) const -> EquationTemplate;
+    // Calls 'f' with the equation of each loaded sample
+    void forEachSampleEquation(
+        llvm::function_ref<void(const ExitIndex &, LoopInfo,
+                                std::vector<mpq_class>)>
+            f) const;
+
+  private:
+    struct Slot {
+        size_t state;
+        const llvm::Value *value;
+    };
+    size_t degree = 0;
+    size_t numExtraValues = 0;
+    std::vector<std::string> names;
+    std::vector<llvm::SmallVector<uint32_t, 4>> terms;
+    // Empty until the first sample has been evaluated
+    std::vector<Slot> slots;
+    std::vector<const Integer *> values;
+    // Loops revisit the same values at a mark over and over again
+    std::map<std::pair<ExitIndex, LoopInfo>, std::set<std::vector<Integer>>>
+        samples;
+
+    void resolve(llvm::ArrayRef<const FastVarMap *> states);
+};
+
+// The templates used by populateEquationsMap, they are only valid for the
+// programs they have been created for
+struct EquationTemplates {
+    std::map<Mark, EquationTemplate> iterative;
+    RelationalFunctionInvariantMap<FunctionInvariant<EquationTemplate>>
+        relational;
+    FunctionInvariantMap<EquationTemplate> functional;
+};
+
+// Returns true if the sample has changed the equations
+bool populateEquationsMap(
     IterativeInvariantMap<PolynomialEquations> &equationsMap,
+    EquationTemplates &templates,
     const std::vector<smt::SortedVar> &primitiveVariables,
     MatchInfo<const llvm::Value *> match, ExitIndex exitIndex, size_t degree);
+// Builds the equations of the mark again from the samples seen so far using
+// terms up to the given degree
+void raiseDegree(IterativeInvariantMap<PolynomialEquations> &equationsMap,
+                 EquationTemplates &templates,
+                 const std::vector<smt::SortedVar> &primitiveVariables,
+                 Mark mark, size_t degree);
 void populateEquationsMap(
     RelationalFunctionInvariantMap<
         LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>> &equationsMap,
+    EquationTemplates &templates,
     const std::vector<smt::SortedVar> &primitiveVariables,
     CoupledCallInfo<const llvm::Value *> match, size_t degree);
 void populateEquationsMap(FunctionInvariantMap<Matrix<mpq_class>> &equationsMap,
+                          EquationTemplates &templates,
                           const std::vector<smt::SortedVar> &primitiveVariables,
                           UncoupledCallInfo<const llvm::Value *> match,
                           size_t degree);
@@ -0,0 +1,103 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Interpreter.h"
+#include "MonoPair.h"
+
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gmpxx.h>
+
+namespace llreve {
+namespace dynamic {
+
+enum class SamplingStrategy {
+    // Uniformly distributed values inside the bounds
+    Random,
+    // Combinations of the bounds, 0, ±1 and the middle of the range followed
+    // by random values
+    Boundary,
+    // Inputs close to inputs that visited block pairs that have not been seen
+    // before, random values if there are none
+    Coverage
+};
+
+// Returns false if the name does not describe a strategy
+auto parseSamplingStrategy(const std::string &name, SamplingStrategy &strategy)
+    -> bool;
+
+struct SamplingOpts {
+    SamplingStrategy strategy;
+    // Bounds of the argument values, both are included
+    mpz_class lowerBound;
+    mpz_class upperBound;
+    unsigned maxExamples;
+    unsigned batchSize;
+    // Stop after this many consecutive batches did not change the result,
+    // 0 means that all examples are used
+    unsigned stableBatches;
+    SamplingOpts(SamplingStrategy strategy, mpz_class lowerBound,
+                 mpz_class upperBound, unsigned maxExamples,
+                 unsigned batchSize, unsigned stableBatches)
+        : strategy(strategy), lowerBound(std::move(lowerBound)),
+          upperBound(std::move(upperBound)), maxExamples(maxExamples),
+          batchSize(batchSize), stableBatches(stableBatches) {}
+};
+
+using Example = std::vector<mpz_class>;
+
+// Generates the inputs that are interpreted in batches. After a batch has
+// been analyzed the caller reports whether it changed the result, sampling
+// stops once the result is stable or the maximal number of examples has been
+// reached.
+class InputSampler {
+  public:
+    InputSampler(SamplingOpts opts, size_t numArgs);
+    // Returns an empty batch once sampling is done
+    auto nextBatch() -> std::vector<Example>;
+    // Consecutive blocks of a trace
+    using BlockPair = std::pair<BlockName, BlockName>;
+
+    // Has to be called with the block pairs visited by every example of the
+    // last batch before 'finishBatch', this can be called from several
+    // threads
+    void recordCoverage(const Example &example,
+                        const MonoPair<std::set<BlockPair>> &blockPairs);
+    void finishBatch(bool resultChanged);
+
+  private:
+    SamplingOpts opts;
+    size_t numArgs;
+    std::mt19937 gen;
+    unsigned examplesUsed = 0;
+    unsigned unchangedBatches = 0;
+    bool done = false;
+    // The next combination of boundary values, empty once all of them have
+    // been used
+    std::vector<size_t> boundaryIndices;
+    std::vector<mpz_class> boundaryValues;
+    std::mutex coverageMutex;
+    MonoPair<std::set<BlockPair>> seenBlockPairs;
+    // Examples that have reached new block pairs in the last batch
+    std::vector<Example> interestingExamples;
+
+    auto randomExample() -> Example;
+    auto nextBoundaryExample(Example &example) -> bool;
+    auto mutate(const Example &example) -> Example;
+    auto clamp(mpz_class val) const -> mpz_class;
+};
+}
+}
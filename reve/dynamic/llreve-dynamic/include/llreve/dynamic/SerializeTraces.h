@@ -16,38 +16,83 @@
 
 #include "gmpxx.h"
 
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Function.h"
 
-// All combinations of values inside the bounds, upperbound included
+// All combinations of values inside the bounds, upperbound included. The
+// combinations are numbered in mixed radix with the first value as the least
+// significant digit, so an iterator can be placed at any combination in
+// constant time and the range can be split into sub ranges that are
+// enumerated independently, e.g. by different workers or to resume an
+// enumeration. If the bounds and the number of combinations fit in 64 bits
+// the iterators only use machine integers for counting.
 class Range {
     mpz_class lowerBound;
     mpz_class upperBound;
     size_t n;
+    // The number of values of a single argument
+    mpz_class radix;
+    mpz_class count;
+    bool small;
+    int64_t smallLowerBound;
+    uint64_t smallRadix;
+    uint64_t smallCount;
 
   public:
-    Range(mpz_class lowerBound, mpz_class upperBound, size_t n)
-        : lowerBound(lowerBound), upperBound(upperBound), n(n) {}
+    Range(mpz_class lowerBound, mpz_class upperBound, size_t n);
     class RangeIterator
         : std::iterator<std::forward_iterator_tag, std::vector<mpz_class>> {
-        mpz_class lowerBound;
-        mpz_class upperBound;
+        const Range *range;
+        // The number of the current combination, 'smallIndex' and 'digits'
+        // are used instead if the range is small
+        mpz_class index;
+        uint64_t smallIndex;
+        std::vector<uint64_t> digits;
         std::vector<mpz_class> vals;
 
       public:
-        RangeIterator(mpz_class lowerBound, mpz_class upperBound,
-                      std::vector<mpz_class> vals)
-            : lowerBound(lowerBound), upperBound(upperBound), vals(vals) {}
+        // Indices past the end are clamped to the end
+        RangeIterator(const Range &range, const mpz_class &index);
         RangeIterator &operator++();
-        bool operator==(const RangeIterator &other) {
-            return vals == other.vals;
+        bool operator==(const RangeIterator &other) const {
+            return range->small ? smallIndex == other.smallIndex
+                                : index == other.index;
         }
-        bool operator!=(const RangeIterator &other) {
-            return vals != other.vals;
+        bool operator!=(const RangeIterator &other) const {
+            return !(*this == other);
         }
         std::vector<mpz_class> &operator*() { return vals; }
+        auto position() const -> mpz_class {
+            return range->small ? mpz_class(smallIndex) : index;
+        }
+    };
+    // The combinations with an index in [first, last)
+    class SubRange {
+        RangeIterator first;
+        RangeIterator last;
+
+      public:
+        SubRange(RangeIterator first, RangeIterator last)
+            : first(std::move(first)), last(std::move(last)) {}
+        RangeIterator begin() const { return first; }
+        RangeIterator end() const { return last; }
     };
-    RangeIterator begin();
-    RangeIterator end();
+    // The number of combinations. There is exactly one if n is 0.
+    auto size() const -> const mpz_class & { return count; }
+    RangeIterator begin() const;
+    RangeIterator end() const;
+    // The iterator at the combination with the given index
+    RangeIterator at(const mpz_class &index) const;
+    auto subRange(const mpz_class &first, const mpz_class &last) const
+        -> SubRange;
 };
 
 struct WorkItem {
@@ -55,5 +100,90 @@ struct WorkItem {
     MonoPair<mpz_class> heapBackgrounds;
     MonoPair<llreve::dynamic::Heap> heaps;
     bool heapSet;
-    int counter;
+    // The index of the input in the enumeration
+    uint64_t counter;
+};
+
+// Traces can be dumped for offline analysis. The binary format stores every
+// call as columns of varint encoded block names, changed variables, values
+// and heaps which is a lot smaller and faster to write than JSON. Strings
+// are interned and defined inline on their first use.
+enum class TraceFormat { Binary, JSON };
+
+class TraceWriter {
+    std::ofstream out;
+    TraceFormat format;
+    std::mutex mutex;
+    llvm::StringMap<uint64_t> strings;
+
+    void writeString(std::string &buf, llvm::StringRef str);
+    void writeState(std::string &buf, const llreve::dynamic::FastState &state);
+    void writeCall(std::string &buf, const llreve::dynamic::FastCall &call);
+
+  public:
+    TraceWriter(const std::string &fileName, TraceFormat format);
+    // Can be called from several threads
+    void write(const llreve::dynamic::FastCall &call);
+};
+
+// Reads the binary format from a memory mapped file
+class TraceReader {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    // The block names of the calls that have been read point into this
+    std::deque<std::string> strings;
+    std::function<const llvm::Function *(llvm::StringRef)> lookupFunction;
+
+    auto readVarint() -> uint64_t;
+    auto readBytes(size_t count) -> llvm::StringRef;
+    auto readString() -> llvm::StringRef;
+    auto readInteger() -> Integer;
+    auto readHeap() -> llreve::dynamic::Heap;
+    auto readState() -> llreve::dynamic::State<std::string>;
+    auto readCall() -> llreve::dynamic::Call<std::string>;
+
+  public:
+    // Function names are resolved with 'lookupFunction', the functions of
+    // the calls are null if none is given
+    explicit TraceReader(
+        const std::string &fileName,
+        std::function<const llvm::Function *(llvm::StringRef)>
+            lookupFunction = [](llvm::StringRef) { return nullptr; });
+    ~TraceReader();
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+    // Returns None at the end of the file. Calls are only valid as long as
+    // the reader is alive.
+    auto next() -> llvm::Optional<llreve::dynamic::Call<std::string>>;
+};
+
+// Stores the traces of pairs of calls in the binary format in a directory, so
+// later runs on the same programs and inputs load them instead of
+// interpreting the functions again. An entry is found by the hash of the
+// modules of both functions, the start blocks, the entry states including the
+// heaps and the budget.
+class TraceCache {
+    std::string directory;
+    MonoPair<const llvm::Function *> funs;
+    std::string programHash;
+
+  public:
+    // The hash of the modules is computed once, so they must not be modified
+    // while the cache is used
+    TraceCache(std::string directory, MonoPair<const llvm::Function *> funs);
+    // The name of the entry, empty if the traces are not cached because a
+    // time budget makes them depend on the machine
+    auto key(const MonoPair<llreve::dynamic::FastState> &entryStates,
+             MonoPair<const llvm::BasicBlock *> startBlocks,
+             const llreve::dynamic::InterpreterBudget &budget) const
+        -> std::string;
+    // Returns None if there is no entry or it refers to values that don’t
+    // exist in the functions
+    auto load(const std::string &key) const
+        -> llvm::Optional<MonoPair<llreve::dynamic::FastCall>>;
+    // Failures to write are only reported as warnings. Can be called from
+    // several threads.
+    void store(const std::string &key,
+               const MonoPair<llreve::dynamic::FastCall> &calls) const;
 };
@@ -10,9 +10,15 @@
 
 #pragma once
 
+#include <atomic>
+#include <cassert>
 #include <condition_variable>
+#include <cstddef>
 #include <mutex>
 #include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 template <typename T> class ThreadSafeQueue {
   private:
@@ -24,7 +30,7 @@ template <typename T> class ThreadSafeQueue {
     void push(T &&val) {
         {
             std::lock_guard<std::mutex> lock(m);
-            q.push(val);
+            q.push(std::move(val));
         }
         cv.notify_one();
     }
@@ -40,8 +46,128 @@ template <typename T> class ThreadSafeQueue {
         while (q.empty()) {
             cv.wait(lock);
         }
-        T r = q.front();
+        T r = std::move(q.front());
         q.pop();
         return r;
     }
 };
+
+// A bounded lock-free queue for multiple producers and consumers (Dmitry
+// Vyukov’s bounded MPMC queue). Each cell carries a sequence number which
+// tells producers and consumers whether it is free or filled for the current
+// lap, so the only contention is a compare and swap on the head or tail. The
+// values only have to be movable.
+template <typename T> class BoundedQueue {
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+    static const size_t CacheLineSize = 64;
+
+    std::vector<Cell> cells;
+    const size_t mask;
+    alignas(CacheLineSize) std::atomic<size_t> enqueuePos;
+    alignas(CacheLineSize) std::atomic<size_t> dequeuePos;
+
+    auto value(Cell &cell) -> T * { return reinterpret_cast<T *>(&cell.storage); }
+
+  public:
+    // The capacity has to be a power of two
+    explicit BoundedQueue(size_t capacity)
+        : cells(capacity), mask(capacity - 1), enqueuePos(0), dequeuePos(0) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+    ~BoundedQueue() {
+        size_t end = enqueuePos.load(std::memory_order_relaxed);
+        for (size_t pos = dequeuePos.load(std::memory_order_relaxed);
+             pos != end; ++pos) {
+            value(cells[pos & mask])->~T();
+        }
+    }
+
+    // Returns false without moving from 'val' if the queue is full
+    bool tryPush(T &&val) {
+        Cell *cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) -
+                        static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        new (&cell->storage) T(std::move(val));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    // Returns false if the queue is empty
+    bool tryPop(T &val) {
+        Cell *cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) -
+                        static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        T *stored = value(*cell);
+        val = std::move(*stored);
+        stored->~T();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+    // The blocking variants spin until there is space or an element
+    void push(T &&val) {
+        while (!tryPush(std::move(val))) {
+            std::this_thread::yield();
+        }
+    }
+    T pop() {
+        T val;
+        while (!tryPop(val)) {
+            std::this_thread::yield();
+        }
+        return val;
+    }
+    // Moves elements from [first, last) into the queue until it is full and
+    // returns the first element that has not been pushed
+    template <typename It> It tryPushBatch(It first, It last) {
+        for (; first != last && tryPush(std::move(*first)); ++first) {
+        }
+        return first;
+    }
+    // Appends up to 'maxElements' elements to 'out' and returns their number
+    size_t tryPopBatch(std::vector<T> &out, size_t maxElements) {
+        size_t popped = 0;
+        T val;
+        for (; popped < maxElements && tryPop(val); ++popped) {
+            out.push_back(std::move(val));
+        }
+        return popped;
+    }
+};
@@ -4,6 +4,33 @@
 
 std::set<llvm::BasicBlock *> blocksInLoop(llvm::BasicBlock *start,
                                           const BidirBlockMarkMap &marks);
+
+// The blocks of the loops at all marked blocks of a function, see
+// blocksInLoop. They are computed once before the loops are transformed. Each
+// transformation reports the blocks outside of the transformed loop that it
+// changed, only the loops containing one of them have to be computed again and
+// only the paths and free variables of their marks have to be updated.
+class LoopStructure {
+  public:
+    explicit LoopStructure(const BidirBlockMarkMap &marks);
+    // The blocks of the loop starting at the marked block 'header'
+    auto loopBlocks(llvm::BasicBlock *header)
+        -> const std::set<llvm::BasicBlock *> &;
+    // Called after the loop starting at 'header' has been transformed.
+    // 'changedBlocks' are the blocks whose instructions or successors have
+    // been changed.
+    void transformed(llvm::BasicBlock *header,
+                     const std::set<llvm::BasicBlock *> &changedBlocks);
+    // The marks whose paths start in a changed block
+    auto changedMarks() const -> const std::set<Mark> & { return changed; }
+
+  private:
+    const BidirBlockMarkMap &marks;
+    std::map<llvm::BasicBlock *, std::set<llvm::BasicBlock *>> loops;
+    // The headers whose loops have to be computed again
+    std::set<llvm::BasicBlock *> stale;
+    std::set<Mark> changed;
+};
 llvm::BasicBlock *
 createUniqueBackedge(llvm::BasicBlock *markedBlock, llvm::BasicBlock *preHeader,
                      const std::vector<llvm::BasicBlock *> &backedgeBlocks,
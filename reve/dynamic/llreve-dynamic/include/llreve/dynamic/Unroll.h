@@ -11,8 +11,11 @@
 #pragma once
 
 #include "MarkAnalysis.h"
+#include "llreve/dynamic/Transform.h"
 
 #include "llvm/Analysis/LoopInfo.h"
 
+// Unrolls the loops at 'mark' 'factor' times and reports the changes to
+// 'loops'
 void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
-                  size_t factor);
+                  LoopStructure &loops, size_t factor);
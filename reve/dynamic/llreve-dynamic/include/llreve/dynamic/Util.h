@@ -4,6 +4,9 @@
 #include "MonoPair.h"
 #include "SMT.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+
 namespace llreve {
 namespace dynamic {
 std::vector<smt::SortedVar>
@@ -19,7 +22,9 @@ std::vector<smt::SortedVar>
 getPrimitiveFreeVariables(const llvm::Function *function, Mark mark,
                           const AnalysisResultsMap &analysisResults);
 
-std::vector<std::vector<std::string>>
-polynomialTermsOfDegree(std::vector<smt::SortedVar> variables, size_t degree);
+// Calls 'f' with the terms of the given degree as indices into a list of
+// 'numVariables' variables. The indices are only valid during the call.
+void forEachPolynomialTerm(size_t numVariables, size_t degree,
+                           llvm::function_ref<void(llvm::ArrayRef<size_t>)> f);
 }
 }
@@ -11,23 +11,30 @@
 #include "llreve/dynamic/Analysis.h"
 
 #include "Compat.h"
+#include "HeapRegions.h"
 #include "MarkAnalysis.h"
 #include "ModuleSMTGeneration.h"
 #include "MonoPair.h"
 #include "PathAnalysis.h"
 #include "Serialize.h"
+#include "Statistics.h"
 #include "llreve/dynamic/HeapPattern.h"
 #include "llreve/dynamic/Interpreter.h"
+#include "llreve/dynamic/JIT.h"
 #include "llreve/dynamic/Linear.h"
+#include "llreve/dynamic/LoopSynchronization.h"
 #include "llreve/dynamic/Peel.h"
 #include "llreve/dynamic/PolynomialEquation.h"
+#include "llreve/dynamic/Sampling.h"
 #include "llreve/dynamic/SerializeTraces.h"
+#include "llreve/dynamic/ThreadSafeQueue.h"
 #include "llreve/dynamic/Unroll.h"
 #include "llreve/dynamic/Util.h"
 
 #include <fstream>
 #include <iostream>
-#include <random>
+#include <limits>
+#include <sstream>
 #include <regex>
 #include <thread>
 
@@ -36,7 +43,10 @@
 #include <stdio.h>
 #include <sys/stat.h>
 
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 using llvm::Module;
 using llvm::Optional;
@@ -67,6 +77,11 @@ static llreve::cl::opt<unsigned>
     DegreeFlag("degree",
                llreve::cl::desc("Degree of the polynomial invariants"),
                llreve::cl::init(1));
+static llreve::cl::opt<bool> AdaptiveDegreeFlag(
+    "adaptive-degree",
+    llreve::cl::desc("Start the loop invariants of each mark at degree 1 and "
+                     "only raise them up to -degree if a counterexample "
+                     "can’t be ruled out otherwise"));
 static llreve::cl::opt<bool, true> ImplicationsFlagStorage(
     "implications",
     llreve::cl::desc("Add implications instead of replacing invariants"),
@@ -77,16 +92,170 @@ static llreve::cl::opt<bool>
                  "Pause after each counterexample until return is pressed"));
 static llreve::cl::opt<bool> DumpIntermediateSMTFlag(
     "intermediate-smt",
-    llreve::cl::desc("Dump intermediate SMT files for debugginr purposes"));
+    llreve::cl::desc("Dump the query of each CEGAR round to out.N.smt2 for "
+                     "debugging purposes"));
+static llreve::cl::opt<bool> CompressIntermediateSMTFlag(
+    "intermediate-smt-compress",
+    llreve::cl::desc("Compress the intermediate SMT files using zlib"));
 // 10 seems to perform pretty well in the benchmarks I tried
 static llreve::cl::opt<unsigned> InterpretStepsFlag(
     "interpret-steps",
     llreve::cl::desc(
         "The number of instructions that are interpreted for each example"),
     cl::init(10));
+static llreve::cl::opt<string> SamplingFlag(
+    "sampling",
+    llreve::cl::desc("Strategy for choosing the inputs of the random examples "
+                     "(random, boundary or coverage)"),
+    llreve::cl::init("random"));
+static llreve::cl::opt<unsigned>
+    MaxExamplesFlag("max-examples",
+                    llreve::cl::desc("Maximal number of random examples"),
+                    llreve::cl::init(50));
+static llreve::cl::opt<unsigned> SampleBatchFlag(
+    "sample-batch",
+    llreve::cl::desc("Number of random examples that are analyzed together"),
+    llreve::cl::init(10));
+static llreve::cl::opt<unsigned> CegarModelsFlag(
+    "cegar-models",
+    llreve::cl::desc("Maximal number of counterexamples that are analyzed in "
+                     "each round of the CEGAR loop"),
+    llreve::cl::init(1));
+static llreve::cl::opt<unsigned> StableBatchesFlag(
+    "stable-batches",
+    llreve::cl::desc("Stop sampling after this many batches did not change "
+                     "the result, 0 uses all examples"),
+    llreve::cl::init(3));
+
+static llreve::cl::opt<unsigned> ExampleStepsFlag(
+    "example-steps",
+    llreve::cl::desc("The number of blocks that are interpreted for each "
+                     "random example, 0 means no limit"),
+    llreve::cl::init(0));
+
+static llreve::cl::opt<bool> JITFlag(
+    "jit",
+    llreve::cl::desc("Run the random examples natively instead of "
+                     "interpreting them, requires -bitvect and integer "
+                     "arguments. -example-steps then limits the number of "
+                     "marks."));
+
+static llreve::cl::opt<string> DumpTracesFlag(
+    "dump-traces",
+    llreve::cl::desc("Write the traces of all interpreted examples to a file"),
+    llreve::cl::value_desc("filename"));
+static llreve::cl::opt<bool> JSONTracesFlag(
+    "json-traces",
+    llreve::cl::desc("Dump traces as JSON instead of the binary format"));
+
+static llreve::cl::opt<string> TraceCacheFlag(
+    "trace-cache",
+    llreve::cl::desc("Directory in which the traces of the interpreted "
+                     "examples and counterexamples are stored, so later runs "
+                     "on the same programs and inputs load them instead of "
+                     "interpreting the programs again"),
+    llreve::cl::value_desc("directory"));
 
 bool ImplicationsFlag;
 
+static void dumpTrace(const Call<const llvm::Value *> &call) {
+    if (DumpTracesFlag.empty()) {
+        return;
+    }
+    static TraceWriter writer(DumpTracesFlag, JSONTracesFlag
+                                                  ? TraceFormat::JSON
+                                                  : TraceFormat::Binary);
+    writer.write(call);
+}
+
+static void dumpTraces(const MonoPair<Call<const llvm::Value *>> &calls) {
+    dumpTrace(calls.first);
+    dumpTrace(calls.second);
+}
+
+// nullptr unless -trace-cache is passed
+static auto traceCacheFromFlags(MonoPair<const llvm::Function *> funs)
+    -> std::unique_ptr<TraceCache> {
+    if (TraceCacheFlag.empty()) {
+        return nullptr;
+    }
+    return make_unique<TraceCache>(TraceCacheFlag, funs);
+}
+
+// The calls are loaded from the cache if it has them, otherwise they are
+// interpreted and stored in it
+static auto interpretCachedFunctionPair(
+    MonoPair<const llvm::Function *> funs, MonoPair<FastState> entryStates,
+    MonoPair<const llvm::BasicBlock *> startBlocks, InterpreterBudget budget,
+    const AnalysisResultsMap &analysisResults, const TraceCache *traceCache)
+    -> MonoPair<FastCall> {
+    string key;
+    if (traceCache) {
+        key = traceCache->key(entryStates, startBlocks, budget);
+        if (auto calls = traceCache->load(key)) {
+            stats::count("traces.cache hits");
+            return std::move(*calls);
+        }
+    }
+    auto calls = interpretFunctionPair(
+        funs, {entryStates.first.variables, entryStates.second.variables},
+        {entryStates.first.heap, entryStates.second.heap}, startBlocks, budget,
+        analysisResults);
+    if (traceCache) {
+        traceCache->store(key, calls);
+    }
+    return calls;
+}
+
+void analyzeStreamedExecution(
+    MonoPair<const llvm::Function *> funs, MonoPair<FastState> entryStates,
+    MonoPair<const llvm::BasicBlock *> startBlocks, InterpreterBudget budget,
+    const MonoPair<BlockNameMap> &nameMaps,
+    const AnalysisResultsMap &analysisResults,
+    std::function<void(MatchInfo<const llvm::Value *>)> iterativeMatch,
+    std::function<void(CoupledCallInfo<const llvm::Value *>)>
+        relationalCallMatch,
+    std::function<void(UncoupledCallInfo<const llvm::Value *>)>
+        functionalCallMatch,
+    MonoPair<InterpreterPathStream::StepObserver> observers,
+    const TraceCache *traceCache) {
+    if (budget.blocks == 0) {
+        budget.blocks = std::numeric_limits<uint32_t>::max();
+    }
+    if (!DumpTracesFlag.empty() || traceCache) {
+        // Dumping and caching need the complete traces
+        auto calls = interpretCachedFunctionPair(
+            funs, entryStates, startBlocks, budget, analysisResults,
+            traceCache);
+        dumpTraces(calls);
+        for (const auto &step : calls.first.steps) {
+            if (observers.first) {
+                observers.first(step);
+            }
+        }
+        for (const auto &step : calls.second.steps) {
+            if (observers.second) {
+                observers.second(step);
+            }
+        }
+        analyzeExecution<const llvm::Value *>(
+            std::move(calls), nameMaps, analysisResults, iterativeMatch,
+            relationalCallMatch, functionalCallMatch);
+        return;
+    }
+    InterpreterPathStream stream1(
+        StepwiseInterpreter(*funs.first, entryStates.first, startBlocks.first,
+                            budget, analysisResults),
+        nameMaps.first, observers.first);
+    InterpreterPathStream stream2(
+        StepwiseInterpreter(*funs.second, entryStates.second,
+                            startBlocks.second, budget, analysisResults),
+        nameMaps.second, observers.second);
+    analyzePathStreams<const llvm::Value *>(
+        stream1, stream2, nameMaps, analysisResults, iterativeMatch,
+        relationalCallMatch, functionalCallMatch);
+}
+
 static void wait() {
     if (StepFlag) {
         string line;
@@ -100,9 +269,11 @@ Transformed analyzeMainCounterExample(
     AnalysisResultsMap &analysisResults,
     llvm::StringMap<const llvm::Value *> &instrNameMap,
     const MonoPair<BlockNameMap> &nameMap,
-    const vector<shared_ptr<HeapPattern<VariablePlaceholder>>> &patterns,
-    unsigned degree) {
-    const auto markMaps = getBlockMarkMaps(functions, analysisResults);
+    const PatternSet &patterns,
+    MarkDegrees &iterativeDegrees, unsigned degree) {
+    // A copy since applyLoopTransformation updates the analysis results
+    const MonoPair<BidirBlockMarkMap> markMaps(
+        getBlockMarkMaps(functions, analysisResults));
     // reconstruct input from counterexample
     auto variableValues = getVarMapFromModel(
         instrNameMap,
@@ -124,19 +295,28 @@ Transformed analyzeMainCounterExample(
     auto secondBlock =
         *markMaps.second.MarkToBlocksMap.at(pathMarks.startMark).begin();
 
-    MonoPair<Call<const llvm::Value *>> calls = interpretFunctionPair(
-        functions, variableValues, getHeapsFromModel(vals.arrays),
-        {firstBlock, secondBlock}, InterpretStepsFlag, analysisResults);
-    analyzeExecution<const llvm::Value *>(
-        std::move(calls), nameMap, analysisResults,
+    const auto heaps = getHeapsFromModel(vals.arrays);
+    const auto traceCache = traceCacheFromFlags(functions);
+    bool refined = false;
+    analyzeStreamedExecution(
+        functions,
+        {FastState(variableValues.first, heaps.first),
+         FastState(variableValues.second, heaps.second)},
+        {firstBlock, secondBlock},
+        budgetForFunction(*functions.first, InterpretStepsFlag), nameMap,
+        analysisResults,
         [&](MatchInfo<const llvm::Value *> match) {
             ExitIndex exitIndex = getExitIndex(match);
             findLoopCounts<const llvm::Value *>(
                 dynamicAnalysisResults.loopCounts, match);
             const auto primitiveVariables = getPrimitiveFreeVariables(
                 functions, match.mark, analysisResults);
-            populateEquationsMap(dynamicAnalysisResults.polynomialEquations,
-                                 primitiveVariables, match, exitIndex, degree);
+            dynamicAnalysisResults.changedInvariants.iterative.insert(
+                match.mark);
+            refined |= populateEquationsMap(
+                dynamicAnalysisResults.polynomialEquations,
+                dynamicAnalysisResults.equationTemplates, primitiveVariables,
+                match, exitIndex, iterativeDegrees.at(match.mark));
             populateHeapPatterns(dynamicAnalysisResults.heapPatternCandidates,
                                  patterns, primitiveVariables, match,
                                  exitIndex);
@@ -146,9 +326,12 @@ Transformed analyzeMainCounterExample(
                 match.functions, match.mark, analysisResults);
             auto returnInstrs =
                 getReturnInstructions(match.functions, analysisResults);
+            dynamicAnalysisResults.changedInvariants.relational.insert(
+                {match.functions, match.mark});
             populateEquationsMap(
                 dynamicAnalysisResults.relationalFunctionPolynomialEquations,
-                primitiveVariables, match, degree);
+                dynamicAnalysisResults.equationTemplates, primitiveVariables,
+                match, degree);
             populateHeapPatterns(
                 dynamicAnalysisResults.relationalFunctionHeapPatterns, patterns,
                 primitiveVariables, match, returnInstrs);
@@ -156,15 +339,19 @@ Transformed analyzeMainCounterExample(
         [&](UncoupledCallInfo<const llvm::Value *> match) {
             const auto primitiveVariables = getPrimitiveFreeVariables(
                 match.function, match.mark, analysisResults);
+            dynamicAnalysisResults.changedInvariants.functional.insert(
+                {match.function, match.mark});
             populateEquationsMap(
                 dynamicAnalysisResults.functionPolynomialEquations,
-                primitiveVariables, match, degree);
+                dynamicAnalysisResults.equationTemplates, primitiveVariables,
+                match, degree);
             populateHeapPatterns(
                 dynamicAnalysisResults.functionHeapPatterns, patterns,
                 primitiveVariables, match,
                 analysisResults.at(match.function).returnInstruction);
 
-        });
+        },
+        {nullptr, nullptr}, traceCache.get());
     auto loopTransformations =
         findLoopTransformations(dynamicAnalysisResults.loopCounts.loopCounts);
     dumpLoopTransformations(loopTransformations);
@@ -174,20 +361,30 @@ Transformed analyzeMainCounterExample(
                                 markMaps)) {
         // Reset data and start over
         dynamicAnalysisResults = DynamicAnalysisResults();
+        iterativeDegrees.reset();
         vals = initialModelValues(functions);
-        // The paths have changed so we need to update the free variables
-        analysisResults.at(functions.first).freeVariables =
-            freeVars(analysisResults.at(functions.first).paths,
-                     analysisResults.at(functions.first).functionArguments,
-                     Program::First);
-        analysisResults.at(functions.second).freeVariables =
-            freeVars(analysisResults.at(functions.second).paths,
-                     analysisResults.at(functions.second).functionArguments,
-                     Program::Second);
         instrNameMap = instructionNameMap(functions);
         std::cerr << "Transformed program, resetting inputs\n";
         return Transformed::Yes;
     }
+    if (!refined) {
+        // All states of the counterexample already satisfy the equations, so
+        // more samples of the same degree won’t rule it out
+        for (Mark mark : set<Mark>{pathMarks.startMark, pathMarks.endMark}) {
+            if (dynamicAnalysisResults.polynomialEquations.count(mark) == 0 ||
+                !iterativeDegrees.raise(mark)) {
+                continue;
+            }
+            std::cerr << "Raising the degree of mark " << mark << " to "
+                      << iterativeDegrees.at(mark) << "\n";
+            raiseDegree(dynamicAnalysisResults.polynomialEquations,
+                        dynamicAnalysisResults.equationTemplates,
+                        getPrimitiveFreeVariables(functions, mark,
+                                                  analysisResults),
+                        mark, iterativeDegrees.at(mark));
+            dynamicAnalysisResults.changedInvariants.iterative.insert(mark);
+        }
+    }
     return Transformed::No;
 }
 
@@ -197,7 +394,9 @@ void analyzeRelationalCounterExample(
     DynamicAnalysisResults &dynamicAnalysisResults,
     const MonoPair<BlockNameMap> &nameMap,
     const AnalysisResultsMap &analysisResults, unsigned maxDegree) {
-    const auto markMaps = getBlockMarkMaps(functions, analysisResults);
+    // A copy since applyLoopTransformation updates the analysis results
+    const MonoPair<BidirBlockMarkMap> markMaps(
+        getBlockMarkMaps(functions, analysisResults));
     auto primitiveFreeVariables = getPrimitiveFreeVariables(
         functions, pathMarks.startMark, analysisResults);
     // reconstruct input from counterexample
@@ -223,21 +422,34 @@ void analyzeRelationalCounterExample(
     auto secondBlock =
         *markMaps.second.MarkToBlocksMap.at(pathMarks.startMark).begin();
 
-    MonoPair<Call<const llvm::Value *>> calls = interpretFunctionPair(
-        functions, variableValues, getHeapsFromModel(vals.arrays),
-        {firstBlock, secondBlock}, InterpretStepsFlag, analysisResults);
+    const auto heaps = getHeapsFromModel(vals.arrays);
+    const auto traceCache = traceCacheFromFlags(functions);
+    MonoPair<Call<const llvm::Value *>> calls = interpretCachedFunctionPair(
+        functions,
+        {FastState(variableValues.first, heaps.first),
+         FastState(variableValues.second, heaps.second)},
+        {firstBlock, secondBlock},
+        budgetForFunction(*functions.first, InterpretStepsFlag),
+        analysisResults, traceCache.get());
+    dumpTraces(calls);
     analyzeCoupledCalls<const llvm::Value *>(
         calls.first, calls.second, nameMap, analysisResults,
         [&](CoupledCallInfo<const llvm::Value *> match) {
             const auto primitiveVariables = getPrimitiveFreeVariables(
                 match.functions, match.mark, analysisResults);
+            dynamicAnalysisResults.changedInvariants.relational.insert(
+                {match.functions, match.mark});
             populateEquationsMap(
                 dynamicAnalysisResults.relationalFunctionPolynomialEquations,
-                primitiveVariables, match, maxDegree);
+                dynamicAnalysisResults.equationTemplates, primitiveVariables,
+                match, maxDegree);
         },
         [&](UncoupledCallInfo<const llvm::Value *> match) {
+            dynamicAnalysisResults.changedInvariants.functional.insert(
+                {match.function, match.mark});
             populateEquationsMap(
                 dynamicAnalysisResults.functionPolynomialEquations,
+                dynamicAnalysisResults.equationTemplates,
                 removeHeapVariables(analysisResults.at(match.function)
                                         .freeVariables.at(match.mark)),
                 match, maxDegree);
@@ -271,13 +483,18 @@ void analyzeFunctionalCounterExample(
     Call<const llvm::Value *> call = interpretFunction(
         *function,
         FastState(variableValues, getHeapFromModel(vals.arrays, program)),
-        startBlock, InterpretStepsFlag, analysisResults);
+        startBlock, budgetForFunction(*function, InterpretStepsFlag),
+        analysisResults);
+    dumpTrace(call);
     std::cout << "analyzing trace\n";
     analyzeUncoupledCall<const llvm::Value *>(
         call, blockNameMap, program, analysisResults,
         [&](UncoupledCallInfo<const llvm::Value *> match) {
+            dynamicAnalysisResults.changedInvariants.functional.insert(
+                {match.function, match.mark});
             populateEquationsMap(
                 dynamicAnalysisResults.functionPolynomialEquations,
+                dynamicAnalysisResults.equationTemplates,
                 removeHeapVariables(analysisResults.at(match.function)
                                         .freeVariables.at(match.mark)),
                 match, maxDegree);
@@ -317,208 +534,712 @@ randomHeap(const llvm::Function &fun, const FastVarMap &variableValues,
     return heap;
 }
 static void analyzeExample(
-    std::function<void(MonoPair<Call<const llvm::Value *>>)> callback,
+    std::function<void(MatchInfo<const llvm::Value *>)> iterativeMatch,
     MonoPair<std::vector<mpz_class>> initialValues,
     MonoPair<const llvm::Function *> funs,
-    AnalysisResultsMap &analysisResults) {
+    const MonoPair<BlockNameMap> &nameMaps,
+    const AnalysisResultsMap &analysisResults,
+    MonoPair<const JITTraceCollector *> collectors,
+    const TraceCache *traceCache,
+    MonoPair<std::set<InputSampler::BlockPair>> &blockPairs) {
     unsigned int seedp = static_cast<unsigned int>(time(NULL));
+    if (traceCache) {
+        // The heap is part of the key of the cached traces, so the same
+        // example needs the same heap in every run
+        seedp = 0;
+        for (const auto &val : initialValues.first) {
+            seedp = seedp * 31 +
+                    static_cast<unsigned int>(
+                        std::hash<string>()(val.get_str()));
+        }
+    }
     MonoPair<FastVarMap> variableValues = {FastVarMap(), FastVarMap()};
     variableValues.first = getVarMap(funs.first, initialValues.first);
     variableValues.second = getVarMap(funs.second, initialValues.second);
+    if (collectors.first) {
+        MonoPair<Call<const llvm::Value *>> calls = {
+            collectors.first->run(variableValues.first, ExampleStepsFlag),
+            collectors.second->run(variableValues.second, ExampleStepsFlag)};
+        dumpTraces(calls);
+        // Only the blocks at marks are part of the traces
+        auto insertPairs = [](const Call<const llvm::Value *> &call,
+                              std::set<InputSampler::BlockPair> &pairs) {
+            for (size_t i = 1; i < call.steps.size(); ++i) {
+                pairs.insert(
+                    {call.steps[i - 1].blockName, call.steps[i].blockName});
+            }
+        };
+        insertPairs(calls.first, blockPairs.first);
+        insertPairs(calls.second, blockPairs.second);
+        analyzeExecution<const llvm::Value *>(
+            std::move(calls), nameMaps, analysisResults, iterativeMatch,
+            [](auto match) {}, [](auto match) {});
+        return;
+    }
     auto heap =
         randomHeap(*funs.first, variableValues.first, 5, -20, 20, &seedp);
-    MonoPair<Heap> heaps = {{heap, Integer(0)}, {heap, Integer(0)}};
-    MonoPair<Call<const llvm::Value *>> calls = interpretFunctionPair(
-        funs, std::move(variableValues), heaps, 10000, analysisResults);
-    callback(std::move(calls));
+    MonoPair<BlockName> prevBlocks = {"", ""};
+    auto observer = [](BlockName &prevBlock,
+                       std::set<InputSampler::BlockPair> &pairs) {
+        return [&](const BlockStep<const llvm::Value *> &step) {
+            if (!prevBlock.empty()) {
+                pairs.insert({prevBlock, step.blockName});
+            }
+            prevBlock = step.blockName;
+        };
+    };
+    analyzeStreamedExecution(
+        funs,
+        {FastState(variableValues.first, Heap(heap, Integer(0))),
+         FastState(variableValues.second, Heap(heap, Integer(0)))},
+        {&funs.first->getEntryBlock(), &funs.second->getEntryBlock()},
+        budgetForFunction(*funs.first, ExampleStepsFlag), nameMaps,
+        analysisResults, iterativeMatch,
+        // We ignore functions for now
+        [](auto match) {}, [](auto match) {},
+        {observer(prevBlocks.first, blockPairs.first),
+         observer(prevBlocks.second, blockPairs.second)},
+        traceCache);
 }
 
-static unsigned randomExamples = 50;
-static void iterateTracesInRange(
-    MonoPair<llvm::Function *> funs, mpz_class lowerBound, mpz_class upperBound,
-    AnalysisResultsMap &analysisResults,
-    std::function<void(MonoPair<Call<const llvm::Value *>>)> callback) {
+// The interpreter does not modify the functions, so the examples of a batch
+// are interpreted and analyzed in parallel. The matches of each example are
+// accumulated into its own result while it is interpreted and the results are
+// merged in the order of the examples. Sampling stops once 'changed' reports
+// that the merged result has been stable for enough batches.
+template <typename Result>
+static auto iterateTracesInRange(
+    MonoPair<llvm::Function *> funs, const SamplingOpts &samplingOpts,
+    const MonoPair<BlockNameMap> &nameMaps,
+    const AnalysisResultsMap &analysisResults,
+    std::function<void(MatchInfo<const llvm::Value *>, Result &)> callback,
+    std::function<void(Result &, Result)> merge,
+    std::function<bool(const Result &before, const Result &after)> changed)
+    -> Result {
     assert(!(funs.first->isVarArg() || funs.second->isVarArg()));
-    std::vector<Integer> argValues;
 
     assert(funs.first->getArgumentList().size() ==
            funs.second->getArgumentList().size());
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distribution(0, 100);
-    for (unsigned i = 0; i < randomExamples; ++i) {
-        std::vector<mpz_class> vals(funs.first->getArgumentList().size());
-        for (auto &val : vals) {
-            val = mpz_class(distribution(gen));
+    InputSampler sampler(samplingOpts, funs.first->getArgumentList().size());
+    std::unique_ptr<JITTraceCollector> firstCollector;
+    std::unique_ptr<JITTraceCollector> secondCollector;
+    if (JITFlag) {
+        firstCollector = JITTraceCollector::create(*funs.first, analysisResults);
+        secondCollector =
+            JITTraceCollector::create(*funs.second, analysisResults);
+        if (!firstCollector || !secondCollector) {
+            std::cerr << "Falling back to the interpreter\n";
+            firstCollector.reset();
+            secondCollector.reset();
+        }
+    }
+    const MonoPair<const JITTraceCollector *> collectors = {
+        firstCollector.get(), secondCollector.get()};
+    // The functions are not transformed while they are sampled
+    const auto traceCache = traceCacheFromFlags(funs);
+    // The examples share the memoized calls
+    const auto callMemo = callMemoFromFlags();
+    Result result;
+    unsigned examplesUsed = 0;
+    for (auto examples = sampler.nextBatch(); !examples.empty();
+         examples = sampler.nextBatch()) {
+        for (const auto &vals : examples) {
+            for (const auto &val : vals) {
+                std::cout << val << ", ";
+            }
+            std::cout << "\n";
         }
-        for (auto val : vals) {
-            std::cout << val << ", ";
+        vector<Result> results(examples.size());
+        vector<std::function<void()>> tasks;
+        for (size_t i = 0; i < examples.size(); ++i) {
+            tasks.push_back([&, i] {
+                CallMemo::Scope memoScope(callMemo.get());
+                MonoPair<std::set<InputSampler::BlockPair>> blockPairs = {
+                    {}, {}};
+                analyzeExample(
+                    [&](MatchInfo<const llvm::Value *> match) {
+                        callback(match, results[i]);
+                    },
+                    {examples[i], examples[i]}, funs, nameMaps,
+                    analysisResults, collectors, traceCache.get(),
+                    blockPairs);
+                sampler.recordCoverage(examples[i], blockPairs);
+            });
         }
-        std::cout << "\n";
-        analyzeExample(callback, {vals, vals}, funs, analysisResults);
+        runInParallel(tasks, SMTGenerationOpts::getInstance().Jobs);
+
+        Result before = result;
+        for (auto &exampleResult : results) {
+            merge(result, std::move(exampleResult));
+        }
+        sampler.finishBatch(changed(before, result));
+        examplesUsed += static_cast<unsigned>(examples.size());
     }
+    std::cerr << "Used " << examplesUsed << " examples\n";
+    return result;
 }
 
-vector<SharedSMTRef>
-driver(MonoPair<llvm::Module &> modules, AnalysisResultsMap &analysisResults,
-       vector<shared_ptr<HeapPattern<VariablePlaceholder>>> patterns,
-       FileOptions fileOpts) {
-    auto functionPair = SMTGenerationOpts::getInstance().MainFunctions;
-    const MonoPair<BidirBlockMarkMap> markMaps =
-        getBlockMarkMaps(functionPair, analysisResults);
+static void mergeLoopCounts(LoopCountsAndMark &result,
+                            LoopCountsAndMark exampleCounts) {
+    for (auto &counts : exampleCounts.loopCounts) {
+        auto &resultCounts = result.loopCounts[counts.first];
+        resultCounts.insert(resultCounts.end(), counts.second.begin(),
+                            counts.second.end());
+    }
+    result.mark = exampleCounts.mark;
+}
+
+static bool loopTransformationsChanged(const LoopCountsAndMark &before,
+                                       const LoopCountsAndMark &after) {
+    LoopCountMap beforeCounts = before.loopCounts;
+    LoopCountMap afterCounts = after.loopCounts;
+    auto beforeTransformations = findLoopTransformations(beforeCounts);
+    auto afterTransformations = findLoopTransformations(afterCounts);
+    return !std::equal(
+        beforeTransformations.begin(), beforeTransformations.end(),
+        afterTransformations.begin(), afterTransformations.end(),
+        [](const std::pair<const Mark, LoopTransformation> &lhs,
+           const std::pair<const Mark, LoopTransformation> &rhs) {
+            return lhs.first == rhs.first &&
+                   lhs.second.type == rhs.second.type &&
+                   lhs.second.side == rhs.second.side &&
+                   lhs.second.count == rhs.second.count;
+        });
+}
+
+bool synchronizeLoops(MonoPair<llvm::Function *> functions,
+                      AnalysisResultsMap &analysisResults) {
+    stats::ScopedTimer timer("preprocess.synchronize loops");
+    if (functions.first->isVarArg() || functions.second->isVarArg() ||
+        functions.first->arg_size() != functions.second->arg_size()) {
+        logWarning("Loops are only synchronized if the main functions take "
+                   "the same number of arguments\n");
+        return false;
+    }
+    // A copy since applyLoopTransformation updates the analysis results
+    const MonoPair<BidirBlockMarkMap> markMaps(
+        getBlockMarkMaps(functions, analysisResults));
     MonoPair<BlockNameMap> nameMap = getBlockNameMaps(analysisResults);
-    const auto funArgsPair =
-        getFunctionArguments(functionPair, analysisResults);
-    std::vector<SortedVar> funArgs;
-    funArgs.insert(funArgs.end(), funArgsPair.first.begin(),
-                   funArgsPair.second.end());
-    funArgs.insert(funArgs.end(), funArgsPair.second.begin(),
-                   funArgsPair.second.end());
 
     // Collect loop info
-    LoopCountsAndMark loopCounts;
-    iterateTracesInRange(functionPair, 47, 50, analysisResults,
-                         [&](MonoPair<Call<const llvm::Value *>> calls) {
-                             analyzeExecution<const llvm::Value *>(
-                                 std::move(calls), nameMap, analysisResults,
-                                 [&](MatchInfo<const llvm::Value *> matchInfo) {
-                                     findLoopCounts<const llvm::Value *>(
-                                         loopCounts, matchInfo);
-                                 },
-                                 // We ignore functions for now
-                                 [](auto match) {}, [](auto match) {});
-                         });
+    SamplingStrategy strategy;
+    if (!parseSamplingStrategy(SamplingFlag, strategy)) {
+        logError("Unknown sampling strategy: " + SamplingFlag + "\n");
+        exit(1);
+    }
+    SamplingOpts samplingOpts(strategy, 0, 100, MaxExamplesFlag,
+                              std::max<unsigned>(SampleBatchFlag, 1),
+                              StableBatchesFlag);
+    LoopCountsAndMark loopCounts = iterateTracesInRange<LoopCountsAndMark>(
+        functions, samplingOpts, nameMap, analysisResults,
+        [](MatchInfo<const llvm::Value *> matchInfo,
+           LoopCountsAndMark &exampleCounts) {
+            findLoopCounts<const llvm::Value *>(exampleCounts, matchInfo);
+        },
+        mergeLoopCounts, loopTransformationsChanged);
     auto loopTransformations = findLoopTransformations(loopCounts.loopCounts);
     dumpLoopTransformations(loopTransformations);
 
     // Peel and unroll loops
-    applyLoopTransformation(functionPair, analysisResults, loopTransformations,
-                            markMaps);
-    analysisResults.at(functionPair.first).freeVariables =
-        freeVars(analysisResults.at(functionPair.first).paths,
-                 analysisResults.at(functionPair.first).functionArguments,
-                 Program::First);
-    analysisResults.at(functionPair.second).freeVariables =
-        freeVars(analysisResults.at(functionPair.second).paths,
-                 analysisResults.at(functionPair.second).functionArguments,
-                 Program::Second);
+    if (!applyLoopTransformation(functions, analysisResults,
+                                 loopTransformations, markMaps)) {
+        return false;
+    }
+    stats::count("loops.transformed", loopTransformations.size());
+    // The regions are assigned to values so the copies of the loop bodies
+    // don’t have one yet
+    const auto &smtOpts = SMTGenerationOpts::getInstance();
+    if (smtOpts.PartitionHeap && smtOpts.Heap == HeapOpt::Enabled) {
+        assignHeapRegions({*functions.first->getParent(),
+                           *functions.second->getParent()});
+    }
+    return true;
+}
 
+vector<SharedSMTRef>
+driver(MonoPair<llvm::Module &> modules, AnalysisResultsMap &analysisResults,
+       const PatternSet &patterns, FileOptions fileOpts) {
+    auto functionPair = SMTGenerationOpts::getInstance().MainFunctions;
+    synchronizeLoops(functionPair, analysisResults);
     return generateSMT(modules, analysisResults, fileOpts);
 }
 
+// The invariant candidates of one CEGAR round, these are the only clauses
+// that change between rounds unless the programs have been transformed
+static auto candidateDefinitions(const SMTGenerationOpts &opts)
+    -> vector<shared_ptr<FunDef>> {
+    // All candidates are constructed as definitions
+    vector<shared_ptr<FunDef>> candidates;
+    for (const auto &invariant : opts.IterativeRelationalInvariants) {
+        candidates.push_back(static_pointer_cast<FunDef>(invariant.second));
+    }
+    for (const auto &functionInvariants :
+         opts.FunctionalFunctionalInvariants) {
+        for (const auto &invariant : functionInvariants.second) {
+            candidates.push_back(
+                static_pointer_cast<FunDef>(invariant.second.preCondition));
+            candidates.push_back(
+                static_pointer_cast<FunDef>(invariant.second.postCondition));
+        }
+    }
+    for (const auto &functionInvariants :
+         opts.FunctionalRelationalInvariants) {
+        for (const auto &invariant : functionInvariants.second) {
+            candidates.push_back(
+                static_pointer_cast<FunDef>(invariant.second.preCondition));
+            candidates.push_back(
+                static_pointer_cast<FunDef>(invariant.second.postCondition));
+        }
+    }
+    return candidates;
+}
+
+static z3::sort z3ArgumentSort(z3::context &cxt, const SortedVar &var) {
+    if (var.type.getTag() == TypeTag::Int) {
+        return cxt.int_sort();
+    } else if (var.type.getTag() == TypeTag::Array) {
+        return cxt.array_sort(cxt.int_sort(), cxt.int_sort());
+    } else if (var.type.getTag() == TypeTag::Bool) {
+        return cxt.bool_sort();
+    }
+    std::cerr << "Unknown argument type: " << *var.type.toSExpr() << "\n";
+    exit(1);
+}
+
+// Collect all applications of the given functions
+static llvm::StringMap<vector<z3::expr>>
+collectApplications(const z3::expr_vector &assertions,
+                    const llvm::StringSet<> &functionNames) {
+    llvm::StringMap<vector<z3::expr>> applications;
+    set<unsigned> visited;
+    vector<z3::expr> stack;
+    for (unsigned i = 0; i < assertions.size(); ++i) {
+        stack.push_back(assertions[i]);
+    }
+    while (!stack.empty()) {
+        z3::expr e = stack.back();
+        stack.pop_back();
+        if (!visited.insert(Z3_get_ast_id(e.ctx(), e)).second) {
+            continue;
+        }
+        if (e.is_app()) {
+            string name = e.decl().name().str();
+            if (functionNames.count(name) > 0) {
+                applications[name].push_back(e);
+            }
+            for (unsigned i = 0; i < e.num_args(); ++i) {
+                stack.push_back(e.arg(i));
+            }
+        } else if (e.is_quantifier()) {
+            stack.push_back(e.body());
+        }
+    }
+    return applications;
+}
+
+namespace {
+// The z3 session used by the CEGAR loop. In each round only the definitions
+// of the invariant candidates change, so the remaining clauses are asserted
+// once and the candidates are uninterpreted functions in them. The
+// definitions are asserted in a scope that is replaced in each round. This
+// way z3 keeps what it has learned about the base clauses. The base clauses
+// are only asserted again if the programs have been transformed.
+struct CegarZ3Session {
+    z3::context &cxt;
+    z3::solver solver;
+    llvm::StringMap<z3::expr> nameMap;
+    llvm::StringMap<smt::Z3DefineFun> defineFunMap;
+    // The base clauses with foralls removed
+    vector<SharedSMTRef> baseZ3Clauses;
+    set<SortedVar> introducedVariables;
+    // Applications of the candidate functions in the base clauses
+    llvm::StringMap<vector<z3::expr>> candidateApplications;
+    // The instantiations of the definition of each candidate. They are
+    // reused until the definition of the candidate is replaced.
+    llvm::StringMap<std::pair<shared_ptr<FunDef>, vector<z3::expr>>>
+        encodedDefinitions;
+    bool inCandidateScope = false;
+
+    explicit CegarZ3Session(z3::context &cxt) : cxt(cxt), solver(cxt) {}
+
+    // Asserts all clauses that are not candidate definitions, this has to be
+    // called again whenever the programs change
+    void setBaseClauses(const vector<SharedSMTRef> &clauses,
+                        const vector<shared_ptr<FunDef>> &definitions) {
+        set<const smt::SMTExpr *> candidates;
+        for (const auto &definition : definitions) {
+            candidates.insert(definition.get());
+        }
+        baseZ3Clauses.clear();
+        introducedVariables.clear();
+        vector<SharedSMTRef> baseClauseExprs;
+        for (const auto &clause : clauses) {
+            if (candidates.count(clause.get()) == 0) {
+                baseClauseExprs.push_back(
+                    removeForalls(*clause, introducedVariables));
+            }
+        }
+        for (const auto &var : introducedVariables) {
+            baseZ3Clauses.push_back(make_unique<VarDecl>(var));
+        }
+        baseZ3Clauses.insert(baseZ3Clauses.end(), baseClauseExprs.begin(),
+                             baseClauseExprs.end());
+
+        solver.reset();
+        inCandidateScope = false;
+        nameMap.clear();
+        defineFunMap.clear();
+        encodedDefinitions.clear();
+        llvm::StringSet<> candidateNames;
+        for (const auto &definition : definitions) {
+            FunDecl(definition->funName, argumentTypes(*definition),
+                    definition->outType)
+                .toZ3(cxt, solver, nameMap, defineFunMap);
+            candidateNames.insert(definition->funName);
+        }
+        for (const auto &clause : baseZ3Clauses) {
+            clause->toZ3(cxt, solver, nameMap, defineFunMap);
+        }
+        candidateApplications =
+            collectApplications(solver.assertions(), candidateNames);
+    }
+
+    // Replaces the definitions of the previous round, only definitions that
+    // have changed since then are encoded again
+    void setCandidates(const vector<shared_ptr<FunDef>> &definitions) {
+        if (inCandidateScope) {
+            solver.pop();
+        }
+        solver.push();
+        inCandidateScope = true;
+        for (const auto &definition : definitions) {
+            auto &encoded = encodedDefinitions[definition->funName];
+            if (encoded.first != definition) {
+                encoded = {definition, instantiateDefinition(*definition)};
+            }
+            for (const auto &instantiation : encoded.second) {
+                solver.add(instantiation);
+            }
+        }
+    }
+
+    // The clauses with foralls removed as they would have been passed to z3
+    // without the incremental session (used for debugging)
+    auto clauses(const vector<shared_ptr<FunDef>> &definitions)
+        -> vector<SharedSMTRef> {
+        vector<SharedSMTRef> z3Clauses = baseZ3Clauses;
+        for (const auto &definition : definitions) {
+            z3Clauses.push_back(removeForalls(*definition, introducedVariables));
+        }
+        return z3Clauses;
+    }
+
+  private:
+    // Instead of a quantified definition we only instantiate the definition
+    // for the applications in the base clauses which are all ground
+    auto instantiateDefinition(const FunDef &definition) -> vector<z3::expr> {
+        vector<z3::expr> instantiations;
+        auto applicationsIt = candidateApplications.find(definition.funName);
+        if (applicationsIt == candidateApplications.end()) {
+            return instantiations;
+        }
+        // The arguments must not shadow the variables used in the model
+        llvm::StringMap<z3::expr> argNameMap = nameMap;
+        z3::expr_vector vars(cxt);
+        for (const auto &arg : definition.args) {
+            z3::expr c =
+                cxt.constant(arg.name.c_str(), z3ArgumentSort(cxt, arg));
+            vars.push_back(c);
+            auto it = argNameMap.insert({arg.name, c});
+            if (!it.second) {
+                it.first->second = c;
+            }
+        }
+        z3::expr body =
+            definition.body->toZ3Expr(cxt, argNameMap, defineFunMap);
+        for (auto &application : applicationsIt->second) {
+            z3::expr_vector args(cxt);
+            for (unsigned i = 0; i < application.num_args(); ++i) {
+                args.push_back(application.arg(i));
+            }
+            instantiations.push_back(application ==
+                                     body.substitute(vars, args));
+        }
+        return instantiations;
+    }
+
+    static auto argumentTypes(const FunDef &definition) -> vector<smt::Type> {
+        vector<smt::Type> types;
+        for (const auto &arg : definition.args) {
+            types.push_back(arg.type);
+        }
+        return types;
+    }
+};
+}
+
+namespace {
+// Writes the queries of the CEGAR rounds on a background thread, so dumping
+// them barely slows down the loop. The query of round i is written to
+// out.i.smt2, compressed files get the additional suffix .z.
+class IntermediateSMTWriter {
+  public:
+    explicit IntermediateSMTWriter(bool compress)
+        : compress(compress), writer([this] { run(); }) {}
+    IntermediateSMTWriter(const IntermediateSMTWriter &) = delete;
+    IntermediateSMTWriter &operator=(const IntermediateSMTWriter &) = delete;
+    // Waits until all queries have been written
+    ~IntermediateSMTWriter() {
+        queries.push(Query{0, {}, true});
+        writer.join();
+    }
+    void write(vector<SharedSMTRef> clauses) {
+        queries.push(Query{rounds++, std::move(clauses), false});
+    }
+
+  private:
+    struct Query {
+        unsigned round;
+        vector<SharedSMTRef> clauses;
+        bool last;
+    };
+    bool compress;
+    unsigned rounds = 0;
+    ThreadSafeQueue<Query> queries;
+    // Started last, all other members have to be initialized
+    std::thread writer;
+
+    void run() {
+        for (Query query = queries.pop(); !query.last;
+             query = queries.pop()) {
+            const string fileName =
+                "out." + std::to_string(query.round) + ".smt2";
+            serializeSMT(std::move(query.clauses), false,
+                         SerializeOpts(fileName, true, false, true, false));
+            if (compress) {
+                compressFile(fileName);
+            }
+        }
+    }
+
+    static void compressFile(const string &fileName) {
+        if (!llvm::zlib::isAvailable()) {
+            logWarning("LLVM has been built without zlib, " + fileName +
+                       " is not compressed\n");
+            return;
+        }
+        auto buffer = llvm::MemoryBuffer::getFile(fileName);
+        llvm::SmallVector<char, 0> compressed;
+        if (!buffer || llvm::zlib::compress((*buffer)->getBuffer(),
+                                            compressed) !=
+                           llvm::zlib::StatusOK) {
+            logWarning("Could not compress " + fileName + "\n");
+            return;
+        }
+        std::ofstream out(fileName + ".z", ios::binary);
+        out.write(compressed.data(),
+                  static_cast<std::streamsize>(compressed.size()));
+        if (out) {
+            std::remove(fileName.c_str());
+        }
+    }
+};
+}
+
+// Holds in every model that assigns the same values as the counterexample to
+// the marks and the free variables
+static z3::expr sameCounterExample(z3::context &cxt,
+                                   const llvm::StringMap<z3::expr> &nameMap,
+                                   const ModelValues &vals) {
+    z3::expr same = cxt.bool_val(true);
+    for (const auto &value : vals.values) {
+        auto it = nameMap.find(value.first);
+        if (it != nameMap.end()) {
+            same = same &&
+                   it->second == cxt.int_val(value.second.get_str().c_str());
+        }
+    }
+    return same;
+}
+
+// The counterexample of the model of the last check followed by up to count -
+// 1 others. Each one has to differ from the previous ones in the marks or the
+// free variables, so they usually refine different invariants.
+static vector<ModelValues>
+collectCounterExamples(z3::context &cxt, CegarZ3Session &session,
+                       const AnalysisResultsMap &analysisResults,
+                       unsigned count) {
+    z3::solver &solver = session.solver;
+    vector<ModelValues> counterExamples;
+    counterExamples.push_back(parseZ3Model(cxt, solver.get_model(),
+                                           session.nameMap, analysisResults));
+    if (count > 1) {
+        // The blocking constraints are nested in the scope of the candidates
+        // and removed before the candidates are replaced
+        solver.push();
+        while (counterExamples.size() < count) {
+            solver.add(!sameCounterExample(cxt, session.nameMap,
+                                           counterExamples.back()));
+            if (solver.check() != z3::sat) {
+                break;
+            }
+            counterExamples.push_back(parseZ3Model(
+                cxt, solver.get_model(), session.nameMap, analysisResults));
+        }
+        solver.pop();
+    }
+    stats::count("cegar.counterexamples", counterExamples.size());
+    return counterExamples;
+}
+
 std::vector<smt::SharedSMTRef>
 cegarDriver(MonoPair<llvm::Module &> modules,
             AnalysisResultsMap &analysisResults,
-            vector<shared_ptr<HeapPattern<VariablePlaceholder>>> patterns,
-            FileOptions fileOpts) {
+            const PatternSet &patterns, FileOptions fileOpts) {
     auto functions = SMTGenerationOpts::getInstance().MainFunctions;
     MonoPair<BlockNameMap> blockNameMap = getBlockNameMaps(analysisResults);
 
     // Run the interpreter on the unrolled code
     DynamicAnalysisResults dynamicAnalysisResults;
     size_t degree = DegreeFlag;
-    ModelValues vals = initialModelValues(functions);
+    MarkDegrees iterativeDegrees(AdaptiveDegreeFlag ? 1 : degree, degree);
+    vector<ModelValues> counterExamples;
+    counterExamples.push_back(initialModelValues(functions));
     auto instrNameMap = instructionNameMap(functions);
     z3::context z3Cxt;
-    z3::solver z3Solver(z3Cxt);
+    CegarZ3Session session(z3Cxt);
+    z3::solver &z3Solver = session.solver;
+    // The candidates are only used for these queries so we don’t modify the
+    // options of the caller
+    SMTGenerationOpts candidateOpts = SMTGenerationOpts::getInstance();
+    // A counterexample only changes the invariants on its path, the other
+    // candidates and the clauses are only built again if the programs have
+    // changed
+    bool programsChanged = true;
+    std::unique_ptr<IntermediateSMTWriter> intermediateSMTWriter;
+    if (DumpIntermediateSMTFlag) {
+        intermediateSMTWriter =
+            make_unique<IntermediateSMTWriter>(CompressIntermediateSMTFlag);
+    }
     // We start by assuming equivalence and change it to non equivalence
     LlreveResult result = LlreveResult::Equivalent;
     do {
-        Mark cexStartMark(
-            static_cast<int>(vals.values.at("INV_INDEX_START").get_si()));
-        Mark cexEndMark(
-            static_cast<int>(vals.values.at("INV_INDEX_END").get_si()));
-        std::cout << "MAIN: " << vals.main << "\n";
-        std::cout << "startMark: " << cexStartMark << "\n";
-        std::cout << "endMark: " << cexEndMark << "\n";
-        if (vals.functions.first) {
-            std::cout << "function 1: " << vals.functions.first->getName().str()
-                      << "\n";
-        }
-        if (vals.functions.second) {
-            std::cout << "function 2: "
-                      << vals.functions.second->getName().str() << "\n";
-        }
-        // TODO we can’t stop if there is a function call on this path so for
-        // now we disable this
-        // if ((vals.main && cexEndMark == EXIT_MARK) ||
-        //     cexEndMark == FORBIDDEN_MARK) {
-        //     // There are two cases in which no invariant refinement is
-        //     possible:
-        //     // we can’t refine the fixed exit relation and we can’t refine
-        //     // anything if the programs diverge
-        //     result = LlreveResult::NotEquivalent;
-        //     break;
-        // }
-
-        assert(vals.functions.first || vals.functions.second);
-        if (vals.main) {
-            Transformed transformed = analyzeMainCounterExample(
-                {cexStartMark, cexEndMark}, vals, functions,
-                dynamicAnalysisResults, analysisResults, instrNameMap,
-                blockNameMap, patterns, degree);
-            if (transformed == Transformed::Yes) {
-                continue;
+        // The invariants are only updated once all counterexamples of the
+        // round have been analyzed
+        bool transformed = false;
+        for (size_t i = 0; i < counterExamples.size() && !transformed; ++i) {
+            ModelValues &vals = counterExamples[i];
+            Mark cexStartMark(
+                static_cast<int>(vals.values.at("INV_INDEX_START").get_si()));
+            Mark cexEndMark(
+                static_cast<int>(vals.values.at("INV_INDEX_END").get_si()));
+            std::cout << "MAIN: " << vals.main << "\n";
+            std::cout << "startMark: " << cexStartMark << "\n";
+            std::cout << "endMark: " << cexEndMark << "\n";
+            if (vals.functions.first) {
+                std::cout << "function 1: "
+                          << vals.functions.first->getName().str() << "\n";
+            }
+            if (vals.functions.second) {
+                std::cout << "function 2: "
+                          << vals.functions.second->getName().str() << "\n";
+            }
+            // TODO we can’t stop if there is a function call on this path so
+            // for now we disable this
+            // if ((vals.main && cexEndMark == EXIT_MARK) ||
+            //     cexEndMark == FORBIDDEN_MARK) {
+            //     // There are two cases in which no invariant refinement
+            //     // is possible: we can’t refine the fixed exit relation
+            //     // and we can’t refine anything if the programs diverge
+            //     result = LlreveResult::NotEquivalent;
+            //     break;
+            // }
+
+            assert(vals.functions.first || vals.functions.second);
+            if (vals.main) {
+                if (analyzeMainCounterExample(
+                        {cexStartMark, cexEndMark}, vals, functions,
+                        dynamicAnalysisResults, analysisResults, instrNameMap,
+                        blockNameMap, patterns, iterativeDegrees,
+                        degree) == Transformed::Yes) {
+                    // The remaining counterexamples refer to the programs
+                    // before the transformation. Like a single
+                    // counterexample, this one is analyzed again.
+                    counterExamples.erase(counterExamples.begin() + i + 1,
+                                          counterExamples.end());
+                    counterExamples.erase(counterExamples.begin(),
+                                          counterExamples.begin() + i);
+                    programsChanged = true;
+                    transformed = true;
+                }
+            } else if (vals.functions.first && vals.functions.second) {
+                analyzeRelationalCounterExample(
+                    {cexStartMark, cexEndMark}, vals, vals.functions,
+                    dynamicAnalysisResults, blockNameMap, analysisResults,
+                    degree);
+            } else if (vals.functions.first) {
+                analyzeFunctionalCounterExample(
+                    {cexStartMark, cexEndMark}, vals, vals.functions.first,
+                    Program::First, dynamicAnalysisResults, blockNameMap.first,
+                    analysisResults, degree);
+            } else if (vals.functions.second) {
+                analyzeFunctionalCounterExample(
+                    {cexStartMark, cexEndMark}, vals, vals.functions.second,
+                    Program::Second, dynamicAnalysisResults,
+                    blockNameMap.second, analysisResults, degree);
             }
-        } else if (vals.functions.first && vals.functions.second) {
-            analyzeRelationalCounterExample(
-                {cexStartMark, cexEndMark}, vals, vals.functions,
-                dynamicAnalysisResults, blockNameMap, analysisResults, degree);
-        } else if (vals.functions.first) {
-            analyzeFunctionalCounterExample(
-                {cexStartMark, cexEndMark}, vals, vals.functions.first,
-                Program::First, dynamicAnalysisResults, blockNameMap.first,
-                analysisResults, degree);
-        } else if (vals.functions.second) {
-            analyzeFunctionalCounterExample(
-                {cexStartMark, cexEndMark}, vals, vals.functions.second,
-                Program::Second, dynamicAnalysisResults, blockNameMap.second,
-                analysisResults, degree);
+        }
+        if (transformed) {
+            continue;
         }
 
-        auto invariantCandidates = makeIterativeInvariantDefinitions(
-            functions, dynamicAnalysisResults.polynomialEquations,
-            dynamicAnalysisResults.heapPatternCandidates, analysisResults,
-            DegreeFlag);
-        auto relationalFunctionInvariantCandidates =
-            makeRelationalFunctionInvariantDefinitions(
+        if (programsChanged) {
+            candidateOpts.IterativeRelationalInvariants =
+                makeIterativeInvariantDefinitions(
+                    functions, dynamicAnalysisResults.polynomialEquations,
+                    dynamicAnalysisResults.heapPatternCandidates,
+                    analysisResults, iterativeDegrees);
+            candidateOpts.FunctionalRelationalInvariants =
+                makeRelationalFunctionInvariantDefinitions(
+                    dynamicAnalysisResults
+                        .relationalFunctionPolynomialEquations,
+                    dynamicAnalysisResults.relationalFunctionHeapPatterns,
+                    analysisResults, DegreeFlag);
+            candidateOpts.FunctionalFunctionalInvariants =
+                makeFunctionInvariantDefinitions(
+                    modules, dynamicAnalysisResults.functionPolynomialEquations,
+                    dynamicAnalysisResults.functionHeapPatterns,
+                    analysisResults, DegreeFlag);
+            session.setBaseClauses(
+                generateSMT(modules, analysisResults, fileOpts, candidateOpts),
+                candidateDefinitions(candidateOpts));
+            programsChanged = false;
+        } else {
+            const ChangedInvariants &changed =
+                dynamicAnalysisResults.changedInvariants;
+            updateIterativeInvariantDefinitions(
+                candidateOpts.IterativeRelationalInvariants, changed.iterative,
+                functions, dynamicAnalysisResults.polynomialEquations,
+                dynamicAnalysisResults.heapPatternCandidates, analysisResults,
+                iterativeDegrees);
+            updateRelationalFunctionInvariantDefinitions(
+                candidateOpts.FunctionalRelationalInvariants,
+                changed.relational,
                 dynamicAnalysisResults.relationalFunctionPolynomialEquations,
                 dynamicAnalysisResults.relationalFunctionHeapPatterns,
                 analysisResults, DegreeFlag);
-        auto functionInvariantCandidates = makeFunctionInvariantDefinitions(
-            modules, dynamicAnalysisResults.functionPolynomialEquations,
-            dynamicAnalysisResults.functionHeapPatterns, analysisResults,
-            DegreeFlag);
-
-        SMTGenerationOpts::getInstance().IterativeRelationalInvariants =
-            invariantCandidates;
-        SMTGenerationOpts::getInstance().FunctionalRelationalInvariants =
-            relationalFunctionInvariantCandidates;
-        SMTGenerationOpts::getInstance().FunctionalFunctionalInvariants =
-            functionInvariantCandidates;
-        vector<SharedSMTRef> clauses =
-            generateSMT(modules, analysisResults, fileOpts);
-        z3Solver.reset();
-        llvm::StringMap<z3::expr> nameMap;
-        llvm::StringMap<smt::Z3DefineFun> defineFunMap;
-        vector<SharedSMTRef> z3Clauses;
-        set<SortedVar> introducedVariables;
-        for (const auto &clause : clauses) {
-            z3Clauses.push_back(removeForalls(*clause, introducedVariables));
-        }
-        vector<SharedSMTRef> introducedClauses;
-        for (const auto &var : introducedVariables) {
-            introducedClauses.push_back(make_unique<VarDecl>(var));
-            VarDecl(var).toZ3(z3Cxt, z3Solver, nameMap, defineFunMap);
-        }
-        z3Clauses.insert(z3Clauses.begin(), introducedClauses.begin(),
-                         introducedClauses.end());
-        for (const auto &clause : z3Clauses) {
-            clause->toZ3(z3Cxt, z3Solver, nameMap, defineFunMap);
+            updateFunctionInvariantDefinitions(
+                candidateOpts.FunctionalFunctionalInvariants,
+                changed.functional, modules,
+                dynamicAnalysisResults.functionPolynomialEquations,
+                dynamicAnalysisResults.functionHeapPatterns, analysisResults,
+                DegreeFlag);
         }
-        if (DumpIntermediateSMTFlag) {
-            serializeSMT(z3Clauses, false,
-                         SerializeOpts("out.smt2", true, false, true, false));
+        dynamicAnalysisResults.changedInvariants.clear();
+        const auto definitions = candidateDefinitions(candidateOpts);
+        session.setCandidates(definitions);
+        if (intermediateSMTWriter) {
+            intermediateSMTWriter->write(session.clauses(definitions));
         }
         bool unsat = false;
         switch (z3Solver.check()) {
@@ -536,35 +1257,18 @@ cegarDriver(MonoPair<llvm::Module &> modules,
         if (unsat) {
             break;
         }
-        z3::model z3Model = z3Solver.get_model();
-        vals = parseZ3Model(z3Cxt, z3Model, nameMap, analysisResults);
+        counterExamples = collectCounterExamples(z3Cxt, session,
+                                                 analysisResults,
+                                                 CegarModelsFlag);
     } while (1 /* sat */);
 
     vector<SharedSMTRef> clauses;
     switch (result) {
     case LlreveResult::Equivalent: {
         std::cerr << "The programs have been proven equivalent\n";
-        auto invariantCandidates = makeIterativeInvariantDefinitions(
-            functions, dynamicAnalysisResults.polynomialEquations,
-            dynamicAnalysisResults.heapPatternCandidates, analysisResults,
-            DegreeFlag);
-        auto relationalFunctionInvariantCandidates =
-            makeRelationalFunctionInvariantDefinitions(
-                dynamicAnalysisResults.relationalFunctionPolynomialEquations,
-                dynamicAnalysisResults.relationalFunctionHeapPatterns,
-                analysisResults, DegreeFlag);
-        auto functionInvariantCandidates = makeFunctionInvariantDefinitions(
-            modules, dynamicAnalysisResults.functionPolynomialEquations,
-            dynamicAnalysisResults.functionHeapPatterns, analysisResults,
-            DegreeFlag);
-
-        SMTGenerationOpts::getInstance().IterativeRelationalInvariants =
-            invariantCandidates;
-        SMTGenerationOpts::getInstance().FunctionalRelationalInvariants =
-            relationalFunctionInvariantCandidates;
-        SMTGenerationOpts::getInstance().FunctionalFunctionalInvariants =
-            functionInvariantCandidates;
-        clauses = generateSMT(modules, analysisResults, fileOpts);
+        // The candidates of the last round are the invariants
+        clauses =
+            generateSMT(modules, analysisResults, fileOpts, candidateOpts);
         break;
     }
     case LlreveResult::NotEquivalent: {
@@ -652,11 +1356,11 @@ ModelValues parseZ3Model(const z3::context &z3Cxt, const z3::model &model,
         llreve::opts::HeapOpt::Enabled) {
         if (program1) {
             auto heap1Eval = model.eval(nameMap.find("HEAP$1_old")->second);
-            arrays.insert({"HEAP$1_old", getArrayVal(z3Cxt, heap1Eval)});
+            arrays.insert({"HEAP$1_old", getArrayVal(z3Cxt, model, heap1Eval)});
         }
         if (program2) {
             auto heap2Eval = model.eval(nameMap.find("HEAP$2_old")->second);
-            arrays.insert({"HEAP$2_old", getArrayVal(z3Cxt, heap2Eval)});
+            arrays.insert({"HEAP$2_old", getArrayVal(z3Cxt, model, heap2Eval)});
         }
     }
 
@@ -664,8 +1368,27 @@ ModelValues parseZ3Model(const z3::context &z3Cxt, const z3::model &model,
                        {function1, function2});
 }
 
-ArrayVal getArrayVal(const z3::context &z3Cxt, z3::expr arrayExpr) {
+ArrayVal getArrayVal(const z3::context &z3Cxt, const z3::model &model,
+                     z3::expr arrayExpr) {
     ArrayVal ret;
+    if (Z3_is_as_array(z3Cxt, arrayExpr)) {
+        z3::func_decl fun(arrayExpr.ctx(),
+                          Z3_get_as_array_func_decl(z3Cxt, arrayExpr));
+        z3::func_interp interp = model.get_func_interp(fun);
+        for (unsigned i = 0; i < interp.num_entries(); ++i) {
+            z3::func_entry entry = interp.entry(i);
+            ret.vals.insert(
+                {mpz_class(Z3_get_numeral_string(z3Cxt, entry.arg(0))),
+                 mpz_class(Z3_get_numeral_string(z3Cxt, entry.value()))});
+        }
+        z3::expr background = interp.else_value();
+        if (!background || !background.is_numeral()) {
+            logError("Expected a numeral as the default value of an array\n");
+            exit(1);
+        }
+        ret.background = mpz_class(Z3_get_numeral_string(z3Cxt, background));
+        return ret;
+    }
     while (arrayExpr.decl().decl_kind() == Z3_OP_STORE) {
         ret.vals.insert(
             {mpz_class(Z3_get_numeral_string(z3Cxt, arrayExpr.arg(1))),
@@ -680,11 +1403,31 @@ ArrayVal getArrayVal(const z3::context &z3Cxt, z3::expr arrayExpr) {
     return ret;
 }
 
+// Updates the paths and free variables of the marks whose paths have been
+// changed by transforming loops
+static void updateTransformedPaths(AnalysisResults &results,
+                                   const LoopStructure &loops,
+                                   Program prog) {
+    const auto &changedMarks = loops.changedMarks();
+    if (changedMarks.empty()) {
+        return;
+    }
+    stats::count("loops.updated marks", changedMarks.size());
+    updatePaths(results.paths, results.blockMarkMap, changedMarks);
+    updateLocalFreeVars(results.paths, changedMarks,
+                        results.localFreeVariables);
+    results.freeVariables = freeVars(results.localFreeVariables,
+                                     results.functionArguments, prog);
+}
+
 bool applyLoopTransformation(
     MonoPair<llvm::Function *> &functions, AnalysisResultsMap &analysisResults,
     const map<Mark, LoopTransformation> &loopTransformations,
     const MonoPair<BidirBlockMarkMap> &marks) {
     bool modified = false;
+    // The loop structure is shared by all transformations of a function
+    MonoPair<LoopStructure> loops{LoopStructure(marks.first),
+                                  LoopStructure(marks.second)};
     for (auto mapIt : loopTransformations) {
         switch (mapIt.second.type) {
         case LoopTransformType::Peel:
@@ -695,10 +1438,12 @@ bool applyLoopTransformation(
             switch (mapIt.second.side) {
             case LoopTransformSide::Left:
                 assert(mapIt.second.count == 1);
-                peelAtMark(*functions.first, mapIt.first, marks.first, "1");
+                peelAtMark(*functions.first, mapIt.first, marks.first,
+                           loops.first, "1");
                 break;
             case LoopTransformSide::Right:
-                peelAtMark(*functions.second, mapIt.first, marks.second, "2");
+                peelAtMark(*functions.second, mapIt.first, marks.second,
+                           loops.second, "2");
                 break;
             }
             break;
@@ -707,19 +1452,21 @@ bool applyLoopTransformation(
             switch (mapIt.second.side) {
             case LoopTransformSide::Left:
                 unrollAtMark(*functions.first, mapIt.first, marks.first,
-                             mapIt.second.count);
+                             loops.first, mapIt.second.count);
                 break;
             case LoopTransformSide::Right:
                 unrollAtMark(*functions.second, mapIt.first, marks.second,
-                             mapIt.second.count);
+                             loops.second, mapIt.second.count);
                 break;
             }
             break;
         }
     }
-    // Update path analysis
-    analysisResults.at(functions.first).paths = findPaths(marks.first);
-    analysisResults.at(functions.second).paths = findPaths(marks.second);
+    // Only the marks whose paths went through a changed block are updated
+    updateTransformedPaths(analysisResults.at(functions.first), loops.first,
+                           Program::First);
+    updateTransformedPaths(analysisResults.at(functions.second), loops.second,
+                           Program::Second);
     return modified;
 }
 
@@ -752,9 +1499,9 @@ void dumpLoopTransformations(
 map<Mark, LoopTransformation> findLoopTransformations(LoopCountMap &map) {
     std::map<Mark, int32_t> peelCount;
     std::map<Mark, float> unrollQuotients;
-    for (auto mapIt : map) {
+    for (const auto &mapIt : map) {
         Mark mark = mapIt.first;
-        for (auto sample : mapIt.second) {
+        for (const auto &sample : mapIt.second) {
             if (sample.first < 3 || sample.second < 3) {
                 continue;
             }
@@ -813,12 +1560,12 @@ map<Mark, LoopTransformation> findLoopTransformations(LoopCountMap &map) {
 }
 
 ExitIndex getExitIndex(const MatchInfo<const llvm::Value *> match) {
-    for (auto var : match.steps.first->state.variables) {
+    for (auto var : match.steps.first->state().variables) {
         if (var.first->getName() == "exitIndex$1_" + match.mark.toString()) {
             return var.second.asUnbounded();
         }
     }
-    for (auto var : match.steps.second->state.variables) {
+    for (auto var : match.steps.second->state().variables) {
         if (var.first->getName() == "exitIndex$1_" + match.mark.toString()) {
             return var.second.asUnbounded();
         }
@@ -826,42 +1573,26 @@ ExitIndex getExitIndex(const MatchInfo<const llvm::Value *> match) {
     return 0;
 }
 
-static void filterPatterns(HeapPatternCandidates &patterns,
-                           const FastVarMap &variables,
-                           MonoPair<const Heap &> heaps) {
-    auto listIt = patterns.begin();
-    while (listIt != patterns.end()) {
-        if (!(*listIt)->matches(variables, heaps)) {
-            listIt = patterns.erase(listIt);
-        } else {
-            ++listIt;
-        }
-    }
-}
-
 void populateHeapPatterns(
     HeapPatternCandidatesMap &heapPatternCandidates,
-    const vector<shared_ptr<HeapPattern<VariablePlaceholder>>> &patterns,
+    const PatternSet &patterns,
     const vector<SortedVar> &primitiveVariables,
     MatchInfo<const llvm::Value *> match, ExitIndex exitIndex) {
-    VarMap<const llvm::Value *> variables(match.steps.first->state.variables);
-    variables.insert(match.steps.second->state.variables.begin(),
-                     match.steps.second->state.variables.end());
+    VarMap<const llvm::Value *> variables(match.steps.first->state().variables);
+    variables.insert(match.steps.second->state().variables.begin(),
+                     match.steps.second->state().variables.end());
     // TODO don’t copy heaps
-    MonoPair<const Heap &> heaps(match.steps.first->state.heap,
-                                 match.steps.second->state.heap);
+    MonoPair<const Heap &> heaps(match.steps.first->state().heap,
+                                 match.steps.second->state().heap);
     bool newCandidates =
         heapPatternCandidates[match.mark].count(exitIndex) == 0 ||
         !getDataForLoopInfo(heapPatternCandidates.at(match.mark).at(exitIndex),
                             match.loopInfo)
              .hasValue();
     if (newCandidates) {
-        list<shared_ptr<HeapPattern<const llvm::Value *>>> candidates;
-        for (auto pat : patterns) {
-            auto newCandidates =
-                pat->instantiate(primitiveVariables, variables, heaps);
-            candidates.splice(candidates.end(), newCandidates);
-        }
+        list<shared_ptr<HeapPattern<const llvm::Value *>>> candidates =
+            patterns.allInstantiations(primitiveVariables, variables,
+                                       {nullptr, nullptr});
         // This entry could already be present
         auto it = heapPatternCandidates.at(match.mark)
                       .insert({exitIndex,
@@ -871,28 +1602,25 @@ void populateHeapPatterns(
         auto &patternCandidates =
             getDataForLoopInfo(it.first->second, match.loopInfo);
         assert(!patternCandidates.hasValue());
-        patternCandidates = std::move(candidates);
-    } else {
-        HeapPatternCandidates &patterns =
-            getDataForLoopInfo(
-                heapPatternCandidates.at(match.mark).at(exitIndex),
-                match.loopInfo)
-                .getValue();
-        filterPatterns(patterns, variables, heaps);
+        patternCandidates = HeapPatternCandidates(std::move(candidates));
     }
+    getDataForLoopInfo(heapPatternCandidates.at(match.mark).at(exitIndex),
+                       match.loopInfo)
+        .getValue()
+        .filter(variables, heaps);
 }
 
 void populateHeapPatterns(
     RelationalFunctionInvariantMap<
         LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
         &heapPatternCandidates,
-    const vector<shared_ptr<HeapPattern<VariablePlaceholder>>> &patterns,
+    const PatternSet &patterns,
     const vector<SortedVar> &primitiveVariables,
     CoupledCallInfo<const llvm::Value *> match,
     MonoPair<llvm::Value *> returnValues) {
-    VarMap<const llvm::Value *> variables(match.steps.first->state.variables);
-    variables.insert(match.steps.second->state.variables.begin(),
-                     match.steps.second->state.variables.end());
+    VarMap<const llvm::Value *> variables(match.steps.first->state().variables);
+    variables.insert(match.steps.second->state().variables.begin(),
+                     match.steps.second->state().variables.end());
     variables.insert({returnValues.first, match.returnValues.first});
     variables.insert({returnValues.second, match.returnValues.second});
     vector<SortedVar> preVariables = primitiveVariables;
@@ -900,8 +1628,8 @@ void populateHeapPatterns(
     postVariables.emplace_back(resultName(Program::First), int64Type());
     postVariables.emplace_back(resultName(Program::Second), int64Type());
     // TODO don’t copy heaps
-    MonoPair<Heap> heaps = makeMonoPair(match.steps.first->state.heap,
-                                        match.steps.second->state.heap);
+    MonoPair<Heap> heaps = makeMonoPair(match.steps.first->state().heap,
+                                        match.steps.second->state().heap);
     bool newCandidates =
         heapPatternCandidates[match.functions].count(match.mark) == 0 ||
         !getDataForLoopInfo(
@@ -909,16 +1637,11 @@ void populateHeapPatterns(
              match.loopInfo)
              .hasValue();
     if (newCandidates) {
-        list<shared_ptr<HeapPattern<const llvm::Value *>>> preCandidates;
-        list<shared_ptr<HeapPattern<const llvm::Value *>>> postCandidates;
-        for (const auto &pat : patterns) {
-            auto newCandidates =
-                pat->instantiate(preVariables, variables, heaps);
-            preCandidates.splice(preCandidates.end(), newCandidates);
-            newCandidates =
-                pat->instantiate(postVariables, variables, heaps, returnValues);
-            postCandidates.splice(postCandidates.end(), newCandidates);
-        }
+        list<shared_ptr<HeapPattern<const llvm::Value *>>> preCandidates =
+            patterns.allInstantiations(preVariables, variables,
+                                       {nullptr, nullptr});
+        list<shared_ptr<HeapPattern<const llvm::Value *>>> postCandidates =
+            patterns.allInstantiations(postVariables, variables, returnValues);
         // This entry could already be present but insert will not do anything
         // in that case
         llvm::Optional<FunctionInvariant<HeapPatternCandidates>> emptyInvariant;
@@ -929,64 +1652,60 @@ void populateHeapPatterns(
         auto &patternCandidates =
             getDataForLoopInfo(it.first->second, match.loopInfo);
         assert(!patternCandidates.hasValue());
-        patternCandidates = {std::move(preCandidates),
-                             std::move(postCandidates)};
-    } else {
-        FunctionInvariant<HeapPatternCandidates> &patterns =
-            getDataForLoopInfo(
-                heapPatternCandidates.at(match.functions).at(match.mark),
-                match.loopInfo)
-                .getValue();
-        filterPatterns(patterns.preCondition, variables, heaps);
-        filterPatterns(patterns.postCondition, variables, heaps);
+        patternCandidates = FunctionInvariant<HeapPatternCandidates>{
+            HeapPatternCandidates(std::move(preCandidates)),
+            HeapPatternCandidates(std::move(postCandidates))};
     }
+    FunctionInvariant<HeapPatternCandidates> &candidates =
+        getDataForLoopInfo(
+            heapPatternCandidates.at(match.functions).at(match.mark),
+            match.loopInfo)
+            .getValue();
+    candidates.preCondition.filter(variables, heaps);
+    candidates.postCondition.filter(variables, heaps);
 }
 
 void populateHeapPatterns(
     FunctionInvariantMap<HeapPatternCandidates> &heapPatternCandidates,
-    const vector<shared_ptr<HeapPattern<VariablePlaceholder>>> &patterns,
+    const PatternSet &patterns,
     const vector<SortedVar> &primitiveVariables,
     UncoupledCallInfo<const llvm::Value *> match, llvm::Value *returnValue) {
-    VarMap<const llvm::Value *> variables(match.step->state.variables);
+    VarMap<const llvm::Value *> variables(match.step->state().variables);
     variables.insert({returnValue, match.returnValue});
     vector<SortedVar> preVariables = primitiveVariables;
     vector<SortedVar> postVariables = preVariables;
     postVariables.emplace_back(resultName(match.prog), int64Type());
     MonoPair<Heap> heaps = {Heap(), Heap()};
     if (match.prog == Program::First) {
-        heaps = {match.step->state.heap, {}};
+        heaps = {match.step->state().heap, {}};
     } else {
-        heaps = {{}, match.step->state.heap};
+        heaps = {{}, match.step->state().heap};
     }
     bool newCandidates =
         heapPatternCandidates[match.function].count(match.mark) == 0;
     if (newCandidates) {
-        list<shared_ptr<HeapPattern<const llvm::Value *>>> preCandidates;
-        list<shared_ptr<HeapPattern<const llvm::Value *>>> postCandidates;
         MonoPair<llvm::Value *> returnInstructions(nullptr, nullptr);
         if (match.prog == Program::First) {
             returnInstructions.first = returnValue;
         } else {
             returnInstructions.second = returnValue;
         }
-        for (auto pat : patterns) {
-            auto newCandidates = pat->instantiate(primitiveVariables, variables,
-                                                  heaps, returnInstructions);
-            preCandidates.splice(preCandidates.end(), newCandidates);
-            newCandidates = pat->instantiate(primitiveVariables, variables,
-                                             heaps, returnInstructions);
-            postCandidates.splice(postCandidates.end(), newCandidates);
-        }
+        list<shared_ptr<HeapPattern<const llvm::Value *>>> preCandidates =
+            patterns.allInstantiations(primitiveVariables, variables,
+                                       returnInstructions);
+        list<shared_ptr<HeapPattern<const llvm::Value *>>> postCandidates =
+            patterns.allInstantiations(primitiveVariables, variables,
+                                       returnInstructions);
         // TODO figure out postcondition
         heapPatternCandidates.at(match.function)
             .insert({match.mark,
-                     {std::move(preCandidates), std::move(postCandidates)}});
-    } else {
-        FunctionInvariant<HeapPatternCandidates> &patterns =
-            heapPatternCandidates.at(match.function).at(match.mark);
-        filterPatterns(patterns.preCondition, variables, heaps);
-        filterPatterns(patterns.postCondition, variables, heaps);
+                     {HeapPatternCandidates(std::move(preCandidates)),
+                      HeapPatternCandidates(std::move(postCandidates))}});
     }
+    FunctionInvariant<HeapPatternCandidates> &candidates =
+        heapPatternCandidates.at(match.function).at(match.mark);
+    candidates.preCondition.filter(variables, heaps);
+    candidates.postCondition.filter(variables, heaps);
 }
 
 void insertInBlockNameMap(BlockNameMap &nameMap,
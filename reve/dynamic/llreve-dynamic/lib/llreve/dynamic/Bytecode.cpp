@@ -0,0 +1,315 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/Bytecode.h"
+
+#include "Helper.h"
+#include "Opts.h"
+
+#include <algorithm>
+
+#include "llvm/IR/Constants.h"
+
+using llvm::BasicBlock;
+using llvm::BinaryOperator;
+using llvm::BranchInst;
+using llvm::CastInst;
+using llvm::ConstantInt;
+using llvm::GetElementPtrInst;
+using llvm::ICmpInst;
+using llvm::Instruction;
+using llvm::LoadInst;
+using llvm::Optional;
+using llvm::PHINode;
+using llvm::ReturnInst;
+using llvm::SelectInst;
+using llvm::StoreInst;
+using llvm::SwitchInst;
+using llvm::Value;
+using llvm::dyn_cast;
+using llvm::isa;
+
+using std::vector;
+
+using namespace llreve::opts;
+
+namespace llreve {
+namespace dynamic {
+
+namespace {
+class Lowering {
+  public:
+    explicit Lowering(BytecodeFunction &code)
+        : code(code), bitVect(SMTGenerationOpts::getInstance().BitVect),
+          constants(code.layout) {}
+
+    void lower();
+
+  private:
+    BytecodeFunction &code;
+    bool bitVect;
+    interpreter::ConstantPool<Integer> constants;
+    // Set by 'operand' if a value cannot be interpreted
+    const Value *unsupportedOperand = nullptr;
+
+    auto addConstant(Integer val) -> Slot {
+        return constants.add(std::move(val));
+    }
+    auto convertConstant(const Value &val) -> Optional<Integer>;
+    auto operand(const Value *val) -> Slot;
+    auto slot(const Value *val) -> Slot { return *code.layout.slot(val); }
+    auto block(const BasicBlock *bb) -> BlockIndex {
+        return code.layout.blockIndex(*bb);
+    }
+    auto lowerInstruction(const Instruction &instr) -> BytecodeInstruction;
+    auto lowerTerminator(const Instruction &instr) -> BytecodeTerminator;
+};
+}
+
+static auto unsupported(const Instruction &instr, const char *message,
+                        const Value *value, bool fatal)
+    -> BytecodeInstruction {
+    BytecodeInstruction result;
+    result.opcode = Opcode::Unsupported;
+    result.instr = &instr;
+    result.errorMessage = message;
+    result.errorValue = value;
+    result.fatal = fatal;
+    return result;
+}
+
+auto Lowering::convertConstant(const Value &val) -> Optional<Integer> {
+    if (const auto constInt = dyn_cast<ConstantInt>(&val)) {
+        if (constInt->getBitWidth() == 1 || bitVect) {
+            return Integer(constInt->getValue());
+        }
+        return Integer(mpz_class(constInt->getSExtValue()));
+    }
+    if (isa<llvm::ConstantPointerNull>(&val)) {
+        return Integer(makeBoundedInt(64, 0));
+    }
+    return llvm::None;
+}
+
+auto Lowering::operand(const Value *val) -> Slot {
+    if (isa<Instruction>(val) || isa<llvm::Argument>(val)) {
+        return slot(val);
+    }
+    auto constant = constants.constant(
+        val, [this](const Value &c) { return convertConstant(c); });
+    if (!constant) {
+        if (!unsupportedOperand) {
+            unsupportedOperand = val;
+        }
+        return 0;
+    }
+    return *constant;
+}
+
+void Lowering::lower() {
+    const auto &layout = code.layout;
+    code.blocks.resize(layout.blockCount());
+    for (BlockIndex i = 0; i < layout.blockCount(); ++i) {
+        code.blocks[i].block = &layout.block(i);
+    }
+
+    for (auto &bytecodeBlock : code.blocks) {
+        const BasicBlock &bb = *bytecodeBlock.block;
+        for (auto instrIt = bb.begin(); instrIt != bb.end(); ++instrIt) {
+            const Instruction &instr = *instrIt;
+            if (const auto phi = dyn_cast<PHINode>(&instr)) {
+                for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i) {
+                    BlockIndex pred = block(phi->getIncomingBlock(i));
+                    auto moves = std::find_if(
+                        bytecodeBlock.phis.begin(), bytecodeBlock.phis.end(),
+                        [pred](const PhiMoves &m) {
+                            return m.predecessor == pred;
+                        });
+                    if (moves == bytecodeBlock.phis.end()) {
+                        bytecodeBlock.phis.push_back({pred, {}, nullptr});
+                        moves = bytecodeBlock.phis.end() - 1;
+                    } else if (!moves->moves.empty() &&
+                               moves->moves.back().first ==
+                                   slot(phi)) {
+                        // A predecessor can be listed several times (e.g. for
+                        // switches) but always with the same value
+                        continue;
+                    }
+                    unsupportedOperand = nullptr;
+                    Slot incoming = operand(phi->getIncomingValue(i));
+                    if (unsupportedOperand && !moves->unsupportedOperand) {
+                        moves->unsupportedOperand = unsupportedOperand;
+                    }
+                    moves->moves.push_back({slot(phi), incoming});
+                }
+            } else if (&instr == bb.getTerminator()) {
+                bytecodeBlock.terminator = lowerTerminator(instr);
+            } else {
+                bytecodeBlock.instructions.push_back(lowerInstruction(instr));
+            }
+        }
+    }
+    code.initialValues.resize(layout.variableCount());
+    code.initialValues.insert(code.initialValues.end(),
+                              constants.values().begin(),
+                              constants.values().end());
+}
+
+auto Lowering::lowerInstruction(const Instruction &instr)
+    -> BytecodeInstruction {
+    BytecodeInstruction result;
+    result.instr = &instr;
+    result.result = slot(&instr);
+    unsupportedOperand = nullptr;
+    if (const auto call = dyn_cast<llvm::CallInst>(&instr)) {
+        result.opcode = Opcode::Call;
+        result.callee = call->getCalledFunction();
+        for (const auto &arg : call->arg_operands()) {
+            result.operands.push_back(operand(arg));
+        }
+    } else if (const auto binOp = dyn_cast<BinaryOperator>(&instr)) {
+        result.opcode = binOp->getType()->getIntegerBitWidth() == 1
+                            ? Opcode::BoolBinOp
+                            : Opcode::IntBinOp;
+        result.subOpcode = binOp->getOpcode();
+        result.operands = {operand(binOp->getOperand(0)),
+                           operand(binOp->getOperand(1))};
+    } else if (const auto icmp = dyn_cast<ICmpInst>(&instr)) {
+        result.opcode = Opcode::ICmp;
+        result.subOpcode = icmp->getPredicate();
+        result.operands = {operand(icmp->getOperand(0)),
+                           operand(icmp->getOperand(1))};
+    } else if (const auto cast = dyn_cast<CastInst>(&instr)) {
+        assert(cast->getNumOperands() == 1);
+        result.operands = {operand(cast->getOperand(0))};
+        if (cast->getSrcTy()->isIntegerTy(1) &&
+            cast->getDestTy()->getIntegerBitWidth() > 1) {
+            // Convert a bool to an integer
+            result.opcode = Opcode::BoolToInt;
+            result.width = cast->getType()->getIntegerBitWidth();
+        } else if (isa<llvm::ZExtInst>(cast)) {
+            result.opcode = Opcode::ZExt;
+            result.width = cast->getType()->getIntegerBitWidth();
+        } else if (isa<llvm::SExtInst>(cast)) {
+            result.opcode = Opcode::SExt;
+            result.width = cast->getType()->getIntegerBitWidth();
+        } else if (isa<llvm::TruncInst>(cast) ||
+                   isa<llvm::PtrToIntInst>(cast)) {
+            result.opcode = Opcode::ZExtOrTrunc;
+            result.width = cast->getType()->getIntegerBitWidth();
+        } else if (isa<llvm::IntToPtrInst>(cast)) {
+            result.opcode = Opcode::ZExtOrTrunc;
+            result.width = 64;
+        } else {
+            return unsupported(instr, "Unsupported instruction:\n", &instr,
+                               true);
+        }
+    } else if (const auto gep = dyn_cast<GetElementPtrInst>(&instr)) {
+        result.opcode = Opcode::GEP;
+        result.operands = {operand(gep->getPointerOperand())};
+        const auto type = gep->getSourceElementType();
+        const auto &layout = instr.getModule()->getDataLayout();
+        vector<Value *> indices;
+        mpz_class constantOffset = 0;
+        for (auto ix = gep->idx_begin(), e = gep->idx_end(); ix != e; ++ix) {
+            indices.push_back(*ix);
+            const auto indexedType = GetElementPtrInst::getIndexedType(
+                type, llvm::ArrayRef<Value *>(indices));
+            const auto size = typeSize(indexedType, layout);
+            if (const auto constIx = dyn_cast<ConstantInt>(*ix)) {
+                constantOffset += mpz_class(size) *
+                                  mpz_class(constIx->getSExtValue());
+            } else {
+                result.gepIndices.push_back(
+                    {Integer(mpz_class(size)).asPointer(), operand(*ix)});
+            }
+        }
+        if (constantOffset != 0) {
+            result.gepOffset = Integer(constantOffset).asPointer();
+        }
+    } else if (const auto load = dyn_cast<LoadInst>(&instr)) {
+        result.opcode = Opcode::Load;
+        result.operands = {operand(load->getPointerOperand())};
+        if (load->getType()->isIntegerTy()) {
+            result.width = load->getType()->getIntegerBitWidth();
+        }
+    } else if (const auto store = dyn_cast<StoreInst>(&instr)) {
+        result.opcode = Opcode::Store;
+        result.operands = {operand(store->getPointerOperand()),
+                           operand(store->getValueOperand())};
+        if (store->getValueOperand()->getType()->isIntegerTy()) {
+            result.width =
+                store->getValueOperand()->getType()->getIntegerBitWidth();
+        }
+    } else if (const auto select = dyn_cast<SelectInst>(&instr)) {
+        result.opcode = Opcode::Select;
+        result.operands = {operand(select->getCondition()),
+                           operand(select->getTrueValue()),
+                           operand(select->getFalseValue())};
+    } else {
+        return unsupported(instr, "unsupported instruction:\n", &instr, false);
+    }
+    if (unsupportedOperand) {
+        return unsupported(instr, "Operators are not yet handled\n",
+                           unsupportedOperand, true);
+    }
+    return result;
+}
+
+auto Lowering::lowerTerminator(const Instruction &instr) -> BytecodeTerminator {
+    BytecodeTerminator result;
+    unsupportedOperand = nullptr;
+    if (const auto retInst = dyn_cast<ReturnInst>(&instr)) {
+        result.kind = TerminatorKind::Return;
+        result.result = slot(retInst);
+        if (retInst->getReturnValue() == nullptr) {
+            result.value = addConstant(Integer(mpz_class(0)));
+        } else {
+            result.value = operand(retInst->getReturnValue());
+        }
+    } else if (const auto branchInst = dyn_cast<BranchInst>(&instr)) {
+        if (branchInst->isUnconditional()) {
+            assert(branchInst->getNumSuccessors() == 1);
+            result.kind = TerminatorKind::Branch;
+            result.successors = {block(branchInst->getSuccessor(0))};
+        } else {
+            assert(branchInst->getNumSuccessors() == 2);
+            result.kind = TerminatorKind::CondBranch;
+            result.value = operand(branchInst->getCondition());
+            result.successors = {block(branchInst->getSuccessor(0)),
+                                 block(branchInst->getSuccessor(1))};
+        }
+    } else if (const auto switchInst = dyn_cast<SwitchInst>(&instr)) {
+        result.kind = TerminatorKind::Switch;
+        result.value = operand(switchInst->getCondition());
+        for (auto c : switchInst->cases()) {
+            if (bitVect) {
+                result.caseValues.push_back(
+                    addConstant(Integer(c.getCaseValue()->getValue())));
+            } else {
+                result.caseValues.push_back(addConstant(
+                    Integer(mpz_class(c.getCaseValue()->getSExtValue()))));
+            }
+            result.successors.push_back(block(c.getCaseSuccessor()));
+        }
+        result.successors.push_back(block(switchInst->getDefaultDest()));
+    }
+    result.unsupportedOperand = unsupportedOperand;
+    return result;
+}
+
+auto lowerFunction(const llvm::Function &fun)
+    -> std::unique_ptr<BytecodeFunction> {
+    auto code = std::make_unique<BytecodeFunction>(fun);
+    Lowering(*code).lower();
+    return code;
+}
+}
+}
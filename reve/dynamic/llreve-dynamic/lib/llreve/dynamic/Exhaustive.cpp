@@ -0,0 +1,254 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/Exhaustive.h"
+
+#include "llreve/dynamic/Analysis.h"
+#include "llreve/dynamic/Lanes.h"
+#include "llreve/dynamic/ThreadSafeQueue.h"
+
+#include "Opts.h"
+
+#include <limits>
+#include <mutex>
+#include <thread>
+
+using std::vector;
+
+using llreve::opts::HeapOpt;
+using llreve::opts::SMTGenerationOpts;
+
+namespace llreve {
+namespace dynamic {
+
+namespace {
+// The outcome of interpreting one input
+struct ExhaustiveRecord {
+    uint64_t counter;
+    vector<mpz_class> vals;
+    MonoPair<llvm::Optional<Integer>> results;
+    bool earlyExit;
+    bool differs;
+    // Only kept if the traces are written
+    llvm::Optional<MonoPair<FastCall>> calls;
+};
+}
+
+static bool sameResult(const llvm::Optional<Integer> &a,
+                       const llvm::Optional<Integer> &b) {
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return *a == *b;
+}
+
+static auto compareResults(uint64_t counter, vector<mpz_class> vals,
+                           MonoPair<LaneResult> results) -> ExhaustiveRecord {
+    ExhaustiveRecord record{counter,
+                            std::move(vals),
+                            {std::move(results.first.returnValue),
+                             std::move(results.second.returnValue)},
+                            results.first.earlyExit ||
+                                results.second.earlyExit,
+                            false,
+                            llvm::None};
+    if (!record.earlyExit) {
+        record.differs =
+            !sameResult(record.results.first, record.results.second) ||
+            (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled &&
+             !(results.first.heap == results.second.heap));
+    }
+    return record;
+}
+
+static auto interpretWorkItem(WorkItem &item,
+                              MonoPair<const llvm::Function *> funs,
+                              const AnalysisResultsMap &analysisResults,
+                              InterpreterBudget budget) -> ExhaustiveRecord {
+    MonoPair<FastCall> calls = interpretFunctionPair(
+        funs,
+        {getVarMap(funs.first, item.vals.first),
+         getVarMap(funs.second, item.vals.second)},
+        item.heaps, budget, analysisResults);
+    ExhaustiveRecord record =
+        compareResults(item.counter, item.vals.first,
+                       {laneResult(calls.first, analysisResults),
+                        laneResult(calls.second, analysisResults)});
+    record.calls = std::move(calls);
+    return record;
+}
+
+// The results of one of the functions on the inputs of a chunk, using the
+// lane interpreter if there is one
+static auto interpretChunk(const llvm::Function &fun,
+                           const LaneInterpreter *lanes,
+                           PrefixSharingInterpreter &prefixes,
+                           const vector<vector<mpz_class>> &inputs,
+                           const Heap &heap,
+                           const AnalysisResultsMap &analysisResults)
+    -> vector<LaneResult> {
+    vector<FastVarMap> variables;
+    variables.reserve(inputs.size());
+    for (const auto &vals : inputs) {
+        variables.push_back(getVarMap(&fun, vals));
+    }
+    if (lanes) {
+        return lanes->interpret(variables, heap);
+    }
+    vector<LaneResult> results;
+    results.reserve(inputs.size());
+    for (auto &vars : variables) {
+        results.push_back(laneResult(
+            prefixes.interpret(FastState(std::move(vars), heap)),
+            analysisResults));
+    }
+    return results;
+}
+
+static void writeRecord(std::ostream &out, const ExhaustiveRecord &record) {
+    out << record.counter << ":";
+    for (size_t i = 0; i < record.vals.size(); ++i) {
+        out << (i == 0 ? " " : ", ") << record.vals[i];
+    }
+    out << " ->";
+    for (const auto &result : {record.results.first, record.results.second}) {
+        out << " " << (result ? result->get_str() : "void");
+    }
+    if (record.earlyExit) {
+        out << " early exit";
+    } else if (record.differs) {
+        out << " counterexample";
+    }
+    out << "\n";
+}
+
+ExhaustiveResult
+enumerateExhaustively(MonoPair<const llvm::Function *> funs,
+                      const AnalysisResultsMap &analysisResults,
+                      const ExhaustiveOpts &opts, std::ostream &out,
+                      TraceWriter *traces) {
+    assert(!(funs.first->isVarArg() || funs.second->isVarArg()));
+    assert(funs.first->getArgumentList().size() ==
+           funs.second->getArgumentList().size());
+    const unsigned jobs = std::max(opts.jobs, 1u);
+    const size_t chunkSize = std::max<size_t>(opts.chunkSize, 1);
+    InterpreterBudget budget = opts.budget;
+    if (budget.blocks == 0) {
+        budget.blocks = std::numeric_limits<uint32_t>::max();
+    }
+
+    const size_t numArgs = funs.first->getArgumentList().size();
+    const Range range(opts.lowerBound, opts.upperBound, numArgs);
+    // Workers claim the chunks in order, seeking to the start of a chunk is
+    // cheap so nothing has to be materialized
+    std::mutex chunkMutex;
+    mpz_class nextChunk = opts.firstInput;
+    auto claimChunk = [&](mpz_class &first, mpz_class &last) {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        if (nextChunk >= range.size()) {
+            return false;
+        }
+        first = nextChunk;
+        nextChunk += chunkSize;
+        last = nextChunk;
+        return true;
+    };
+    ThreadSafeQueue<vector<ExhaustiveRecord>> records;
+
+    ExhaustiveResult result;
+    std::thread writer([&] {
+        for (auto batch = records.pop(); !batch.empty();
+             batch = records.pop()) {
+            for (const auto &record : batch) {
+                writeRecord(out, record);
+                if (traces && record.calls) {
+                    traces->write(record.calls->first);
+                    traces->write(record.calls->second);
+                }
+                ++result.inputs;
+                result.earlyExits += record.earlyExit;
+                result.counterExamples += record.differs;
+            }
+            out.flush();
+        }
+    });
+
+    // The heaps are persistent, so the copy in every work item shares the
+    // locations and is private to the worker interpreting it
+    const Heap heap;
+    // Without traces the inputs of a chunk are interpreted in lanes if the
+    // functions allow it and share their prefixes otherwise, the results
+    // are the same
+    MonoPair<std::unique_ptr<LaneInterpreter>> lanes = {nullptr, nullptr};
+    if (!traces) {
+        lanes = {LaneInterpreter::create(*funs.first, budget, analysisResults),
+                 LaneInterpreter::create(*funs.second, budget,
+                                         analysisResults)};
+    }
+    vector<std::thread> workers;
+    for (unsigned i = 0; i < jobs; ++i) {
+        workers.emplace_back([&] {
+            // Snapshots are shared by consecutive inputs of the worker
+            PrefixSharingInterpreter firstPrefixes(*funs.first, budget,
+                                                   analysisResults);
+            PrefixSharingInterpreter secondPrefixes(*funs.second, budget,
+                                                    analysisResults);
+            mpz_class first;
+            mpz_class last;
+            while (claimChunk(first, last)) {
+                vector<ExhaustiveRecord> batch;
+                batch.reserve(chunkSize);
+                if (!traces) {
+                    vector<uint64_t> counters;
+                    vector<vector<mpz_class>> inputs;
+                    for (auto it = range.at(first), end = range.at(last);
+                         it != end; ++it) {
+                        counters.push_back(it.position().get_ui());
+                        inputs.push_back(*it);
+                    }
+                    MonoPair<vector<LaneResult>> results = {
+                        interpretChunk(*funs.first, lanes.first.get(),
+                                       firstPrefixes, inputs, heap,
+                                       analysisResults),
+                        interpretChunk(*funs.second, lanes.second.get(),
+                                       secondPrefixes, inputs, heap,
+                                       analysisResults)};
+                    for (size_t i = 0; i < inputs.size(); ++i) {
+                        batch.push_back(compareResults(
+                            counters[i], std::move(inputs[i]),
+                            {std::move(results.first[i]),
+                             std::move(results.second[i])}));
+                    }
+                    records.push(std::move(batch));
+                    continue;
+                }
+                for (auto it = range.at(first), end = range.at(last);
+                     it != end; ++it) {
+                    WorkItem item{{*it, *it},
+                                  {0, 0},
+                                  {heap, heap},
+                                  true,
+                                  it.position().get_ui()};
+                    batch.push_back(interpretWorkItem(item, funs,
+                                                      analysisResults, budget));
+                }
+                records.push(std::move(batch));
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    records.push(vector<ExhaustiveRecord>());
+    writer.join();
+    return result;
+}
+}
+}
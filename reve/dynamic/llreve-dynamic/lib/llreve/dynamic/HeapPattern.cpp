@@ -10,8 +10,147 @@
 
 #include "llreve/dynamic/HeapPattern.h"
 
+#include "CommandLine.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <tuple>
+
+using std::vector;
+
 namespace llreve {
 namespace dynamic {
+
+static llreve::cl::opt<bool> UntypedHeapAddressesFlag(
+    "untyped-heap-addresses",
+    llreve::cl::desc("Instantiate heap addresses in patterns with all "
+                     "variables instead of only with pointers of the "
+                     "corresponding program"));
+
+static auto isPointer(const llvm::Value *var) -> bool {
+    if (auto retInst = llvm::dyn_cast<llvm::ReturnInst>(var)) {
+        return retInst->getReturnValue() != nullptr &&
+               retInst->getReturnValue()->getType()->isPointerTy();
+    }
+    return var->getType()->isPointerTy();
+}
+
+static auto canBeAddressOf(const llvm::Value *var, int program,
+                           MonoPair<llvm::Value *> returnValues) -> bool {
+    if (!isPointer(var)) {
+        return false;
+    }
+    if (var == returnValues.first) {
+        return program == 1;
+    }
+    if (var == returnValues.second) {
+        return program == 2;
+    }
+    return varBelongsTo(var->getName(), program);
+}
+
+vector<const llvm::Value *>
+valuesOfVariables(const vector<smt::SortedVar> &variables,
+                  const FastVarMap &variableValues,
+                  MonoPair<llvm::Value *> returnValues) {
+    vector<const llvm::Value *> values;
+    values.reserve(variables.size());
+    for (const auto &var : variables) {
+        bool isReturn1 = var.name == resultName(Program::First);
+        bool isReturn2 = var.name == resultName(Program::Second);
+        if (isReturn1) {
+            values.push_back(returnValues.first);
+        } else if (isReturn2) {
+            values.push_back(returnValues.second);
+        } else {
+            bool found = false;
+            for (auto val : variableValues) {
+                if (var.name == val.first->getName()) {
+                    values.push_back(val.first);
+                    found = true;
+                    break;
+                }
+            }
+            assert(found);
+            unused(found);
+        }
+    }
+    return values;
+}
+
+bool operator<(const ArgumentSymmetry &lhs, const ArgumentSymmetry &rhs) {
+    return std::tie(lhs.first, lhs.second, lhs.length) <
+           std::tie(rhs.first, rhs.second, rhs.length);
+}
+
+void forEachInstantiation(
+    const vector<ArgumentRole> &roles,
+    const vector<ArgumentSymmetry> &symmetries,
+    const vector<const llvm::Value *> &variables,
+    MonoPair<llvm::Value *> returnValues,
+    llvm::function_ref<void(const vector<const llvm::Value *> &)> f) {
+    // The variables that can be used for each argument
+    vector<vector<const llvm::Value *>> candidates(roles.size());
+    for (size_t i = 0; i < roles.size(); ++i) {
+        for (const llvm::Value *var : variables) {
+            bool allowed = true;
+            if (!UntypedHeapAddressesFlag) {
+                switch (roles[i]) {
+                case ArgumentRole::Value:
+                    break;
+                case ArgumentRole::FirstHeapAddress:
+                    allowed = canBeAddressOf(var, 1, returnValues);
+                    break;
+                case ArgumentRole::SecondHeapAddress:
+                    allowed = canBeAddressOf(var, 2, returnValues);
+                    break;
+                }
+            }
+            if (allowed) {
+                candidates[i].push_back(var);
+            }
+        }
+        if (candidates[i].empty()) {
+            return;
+        }
+    }
+    // The ranges of a symmetry have the same roles and thus the same
+    // candidates, so comparing the indices into them compares the positions
+    // of the variables
+    auto canonical = [&](const vector<size_t> &indices) {
+        for (const auto &symmetry : symmetries) {
+            const auto first = indices.begin() + symmetry.first;
+            const auto second = indices.begin() + symmetry.second;
+            if (std::lexicographical_compare(second, second + symmetry.length,
+                                             first,
+                                             first + symmetry.length)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    // Count through all combinations, the first argument changes fastest
+    vector<size_t> indices(roles.size(), 0);
+    vector<const llvm::Value *> args(roles.size());
+    while (true) {
+        if (canonical(indices)) {
+            for (size_t i = 0; i < roles.size(); ++i) {
+                args[i] = candidates[i][indices[i]];
+            }
+            f(args);
+        }
+        size_t i = 0;
+        for (; i < roles.size(); ++i) {
+            if (++indices[i] < candidates[i].size()) {
+                break;
+            }
+            indices[i] = 0;
+        }
+        if (i == roles.size()) {
+            return;
+        }
+    }
+}
 template <>
 mpz_class
 Variable<const llvm::Value *>::eval(const FastVarMap &variables,
@@ -27,10 +166,9 @@ std::ostream &Variable<const llvm::Value *>::dump(std::ostream &os) const {
     return os;
 }
 
-mpz_class getHeapVal(HeapAddress addr, Heap heap) {
-    auto it = heap.assignedValues.find(addr);
-    if (it != heap.assignedValues.end()) {
-        return it->second.asUnbounded();
+mpz_class getHeapVal(HeapAddress addr, const Heap &heap) {
+    if (const Integer *val = heap.assignedValues.lookup(addr)) {
+        return val->asUnbounded();
     } else {
         return heap.background.asUnbounded();
     }
@@ -0,0 +1,309 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/HeapProgram.h"
+
+#include <algorithm>
+
+using std::list;
+using std::vector;
+
+namespace llreve {
+namespace dynamic {
+
+HeapPatternCandidates::HeapPatternCandidates(list<Pattern> candidates)
+    : patterns(std::make_move_iterator(candidates.begin()),
+               std::make_move_iterator(candidates.end())) {
+    programs.resize(patterns.size());
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        programs[i].blocks.emplace_back();
+        compile(*patterns[i], programs[i], 0);
+    }
+    holes.resize(numHoles);
+}
+
+static void emit(HeapProgram &program, size_t block, HeapOpCode op,
+                 uint32_t arg = 0) {
+    program.blocks[block].push_back({op, arg});
+}
+
+void HeapPatternCandidates::compile(
+    const HeapPattern<const llvm::Value *> &pattern, HeapProgram &program,
+    size_t block) {
+    switch (pattern.getType()) {
+    case PatternType::Binary: {
+        const auto &binPattern =
+            static_cast<const BinaryHeapPattern<const llvm::Value *> &>(
+                pattern);
+        compile(*binPattern.args.first, program, block);
+        HeapOpCode jump;
+        switch (binPattern.op) {
+        case BinaryBooleanOp::And:
+            jump = HeapOpCode::JumpIfFalse;
+            break;
+        case BinaryBooleanOp::Or:
+            jump = HeapOpCode::JumpIfTrue;
+            break;
+        case BinaryBooleanOp::Impl:
+            emit(program, block, HeapOpCode::Not);
+            jump = HeapOpCode::JumpIfTrue;
+            break;
+        }
+        size_t jumpPos = program.blocks[block].size();
+        emit(program, block, jump);
+        compile(*binPattern.args.second, program, block);
+        program.blocks[block][jumpPos].arg =
+            static_cast<uint32_t>(program.blocks[block].size());
+        break;
+    }
+    case PatternType::Unary: {
+        const auto &unPattern =
+            static_cast<const UnaryHeapPattern<const llvm::Value *> &>(
+                pattern);
+        compile(*unPattern.arg, program, block);
+        switch (unPattern.op) {
+        case UnaryBooleanOp::Neg:
+            emit(program, block, HeapOpCode::Not);
+            break;
+        }
+        break;
+    }
+    case PatternType::HeapEquality:
+        emit(program, block, HeapOpCode::HeapEqual);
+        break;
+    case PatternType::Range: {
+        const auto &range =
+            static_cast<const RangeProp<const llvm::Value *> &>(pattern);
+        compile(*range.bounds.first, program, block);
+        compile(*range.bounds.second, program, block);
+        size_t body = program.blocks.size();
+        program.blocks.emplace_back();
+        compile(*range.pat, program, body);
+        numHoles = std::max(numHoles, range.index + 1);
+        emit(program, block, HeapOpCode::Range,
+             static_cast<uint32_t>(program.ranges.size()));
+        program.ranges.push_back({range.quant, range.index, body});
+        break;
+    }
+    case PatternType::ExprProp: {
+        const auto &prop =
+            static_cast<const HeapExprProp<const llvm::Value *> &>(pattern);
+        compile(*prop.args.first, program, block);
+        compile(*prop.args.second, program, block);
+        emit(program, block, HeapOpCode::Compare,
+             static_cast<uint32_t>(prop.op));
+        break;
+    }
+    }
+}
+
+void HeapPatternCandidates::compile(const HeapExpr<const llvm::Value *> &expr,
+                                    HeapProgram &program, size_t block) {
+    switch (expr.getType()) {
+    case ExprType::HeapAccess: {
+        const auto &access =
+            static_cast<const HeapAccess<const llvm::Value *> &>(expr);
+        compile(*access.atVal, program, block);
+        emit(program, block, HeapOpCode::Load,
+             access.programIndex == ProgramIndex::First ? 0 : 1);
+        break;
+    }
+    case ExprType::Constant:
+        emit(program, block, HeapOpCode::Constant,
+             static_cast<uint32_t>(program.constants.size()));
+        program.constants.push_back(
+            static_cast<const Constant<const llvm::Value *> &>(expr).value);
+        break;
+    case ExprType::Variable: {
+        const llvm::Value *var =
+            static_cast<const Variable<const llvm::Value *> &>(expr).varName;
+        auto it = variableIndices.insert(
+            {var, static_cast<uint32_t>(variables.size())});
+        if (it.second) {
+            variables.push_back(var);
+        }
+        emit(program, block, HeapOpCode::Variable, it.first->second);
+        break;
+    }
+    case ExprType::Hole: {
+        size_t index =
+            static_cast<const Hole<const llvm::Value *> &>(expr).index;
+        numHoles = std::max(numHoles, index + 1);
+        emit(program, block, HeapOpCode::Hole, static_cast<uint32_t>(index));
+        break;
+    }
+    case ExprType::Binary: {
+        const auto &binExpr =
+            static_cast<const BinaryIntExpr<const llvm::Value *> &>(expr);
+        compile(*binExpr.args.first, program, block);
+        compile(*binExpr.args.second, program, block);
+        switch (binExpr.op) {
+        case BinaryIntOp::Mul:
+            emit(program, block, HeapOpCode::Mul);
+            break;
+        case BinaryIntOp::Add:
+            emit(program, block, HeapOpCode::Add);
+            break;
+        case BinaryIntOp::Subtract:
+            emit(program, block, HeapOpCode::Subtract);
+            break;
+        }
+        break;
+    }
+    case ExprType::Unary:
+    case ExprType::HeapIndex:
+    case ExprType::HeapValue:
+        logError("Cannot compile heap expression\n");
+        exit(1);
+    }
+}
+
+void HeapPatternCandidates::push(const mpz_class &val) {
+    if (stackSize == stack.size()) {
+        stack.push_back(val);
+    } else {
+        stack[stackSize] = val;
+    }
+    ++stackSize;
+}
+
+static auto compare(BinaryIntProp op, const mpz_class &val1,
+                    const mpz_class &val2) -> bool {
+    int result = cmp(val1, val2);
+    switch (op) {
+    case BinaryIntProp::LT:
+        return result < 0;
+    case BinaryIntProp::LE:
+        return result <= 0;
+    case BinaryIntProp::EQ:
+        return result == 0;
+    case BinaryIntProp::NE:
+        return result != 0;
+    case BinaryIntProp::GE:
+        return result >= 0;
+    case BinaryIntProp::GT:
+        return result > 0;
+    }
+}
+
+void HeapPatternCandidates::run(const HeapProgram &program, size_t block,
+                                const MonoPair<const Heap &> &heaps) {
+    const auto &code = program.blocks[block];
+    size_t pc = 0;
+    while (pc < code.size()) {
+        const HeapInstruction &inst = code[pc++];
+        switch (inst.op) {
+        case HeapOpCode::Constant:
+            push(program.constants[inst.arg]);
+            break;
+        case HeapOpCode::Variable:
+            push(values[inst.arg]);
+            break;
+        case HeapOpCode::Hole:
+            push(holes[inst.arg]);
+            break;
+        case HeapOpCode::Load: {
+            mpz_class &addr = stack[stackSize - 1];
+            addr = getHeapVal(Integer(addr).asPointer(),
+                              inst.arg == 0 ? heaps.first : heaps.second);
+            break;
+        }
+        case HeapOpCode::Add:
+            --stackSize;
+            stack[stackSize - 1] += stack[stackSize];
+            break;
+        case HeapOpCode::Subtract:
+            --stackSize;
+            stack[stackSize - 1] -= stack[stackSize];
+            break;
+        case HeapOpCode::Mul:
+            --stackSize;
+            stack[stackSize - 1] *= stack[stackSize];
+            break;
+        case HeapOpCode::Compare:
+            --stackSize;
+            stack[stackSize - 1] =
+                compare(static_cast<BinaryIntProp>(inst.arg),
+                        stack[stackSize - 1], stack[stackSize])
+                    ? 1
+                    : 0;
+            break;
+        case HeapOpCode::Not:
+            stack[stackSize - 1] = stack[stackSize - 1] == 0 ? 1 : 0;
+            break;
+        case HeapOpCode::JumpIfFalse:
+            if (stack[stackSize - 1] == 0) {
+                pc = inst.arg;
+            } else {
+                --stackSize;
+            }
+            break;
+        case HeapOpCode::JumpIfTrue:
+            if (stack[stackSize - 1] != 0) {
+                pc = inst.arg;
+            } else {
+                --stackSize;
+            }
+            break;
+        case HeapOpCode::HeapEqual:
+            push(heaps.first == heaps.second ? 1 : 0);
+            break;
+        case HeapOpCode::Range: {
+            const auto &range = program.ranges[inst.arg];
+            // The stack can grow while the body is evaluated
+            const mpz_class upper = stack[--stackSize];
+            const mpz_class lower = stack[--stackSize];
+            bool result = range.quant == RangeQuantifier::All;
+            for (holes[range.hole] = lower; holes[range.hole] <= upper;
+                 ++holes[range.hole]) {
+                run(program, range.block, heaps);
+                bool matches = stack[--stackSize] != 0;
+                if (matches && range.quant == RangeQuantifier::Any) {
+                    result = true;
+                    break;
+                } else if (!matches && range.quant == RangeQuantifier::All) {
+                    result = false;
+                    break;
+                }
+            }
+            push(result ? 1 : 0);
+            break;
+        }
+        }
+    }
+}
+
+void HeapPatternCandidates::filter(const FastVarMap &variableValues,
+                                   const MonoPair<const Heap &> &heaps) {
+    values.resize(variables.size());
+    for (size_t i = 0; i < variables.size(); ++i) {
+        auto it = variableValues.find(variables[i]);
+        assert(it != variableValues.end());
+        values[i] = it->second.asUnbounded();
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        stackSize = 0;
+        run(programs[i], 0, heaps);
+        assert(stackSize == 1);
+        if (stack[0] == 0) {
+            continue;
+        }
+        if (kept != i) {
+            patterns[kept] = std::move(patterns[i]);
+            programs[kept] = std::move(programs[i]);
+        }
+        ++kept;
+    }
+    patterns.resize(kept);
+    programs.resize(kept);
+}
+}
+}
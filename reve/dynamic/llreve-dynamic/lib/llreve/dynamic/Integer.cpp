@@ -15,51 +15,29 @@
 using namespace llreve::opts;
 
 Integer &Integer::operator=(const Integer &other) {
-    switch (type) {
-    case IntType::Unbounded:
-        unbounded.~mpz_class();
-        break;
-    case IntType::Bounded:
-        bounded.~APInt();
-        break;
-    }
-    type = other.type;
-    switch (type) {
-    case IntType::Unbounded:
-        new (&unbounded) mpz_class(other.unbounded);
-        break;
-    case IntType::Bounded:
-        new (&bounded) llvm::APInt(other.bounded);
-        break;
+    if (this == &other) {
+        return *this;
     }
+    this->~Integer();
+    new (this) Integer(other);
     return *this;
 }
 
 Integer &Integer::operator=(Integer &&other) {
-    switch (type) {
-    case IntType::Unbounded:
-        unbounded.~mpz_class();
-        break;
-    case IntType::Bounded:
-        bounded.~APInt();
-        break;
-    }
-    type = other.type;
-    switch (type) {
-    case IntType::Unbounded:
-        new (&unbounded) mpz_class(std::move(other.unbounded));
-        break;
-    case IntType::Bounded:
-        new (&bounded) llvm::APInt(std::move(other.bounded));
-        break;
+    if (this == &other) {
+        return *this;
     }
+    this->~Integer();
+    new (this) Integer(std::move(other));
     return *this;
 }
 
 Integer::~Integer() {
     switch (type) {
     case IntType::Unbounded:
-        unbounded.~mpz_class();
+        if (isBig) {
+            big.~mpz_class();
+        }
         break;
     case IntType::Bounded:
         bounded.~APInt();
@@ -81,7 +59,7 @@ std::ostream &operator<<(std::ostream &os, const Integer &obj) {
     return os;
 }
 
-Integer Integer::zext(unsigned width) {
+Integer Integer::zext(unsigned width) const {
     Integer res(*this);
     switch (res.type) {
     case IntType::Unbounded:
@@ -93,7 +71,7 @@ Integer Integer::zext(unsigned width) {
     return res;
 }
 
-Integer Integer::zextOrTrunc(unsigned width) {
+Integer Integer::zextOrTrunc(unsigned width) const {
     Integer res(*this);
     switch (res.type) {
     case IntType::Unbounded:
@@ -105,7 +83,7 @@ Integer Integer::zextOrTrunc(unsigned width) {
     return res;
 }
 
-Integer Integer::sext(unsigned width) {
+Integer Integer::sext(unsigned width) const {
     Integer res(*this);
     switch (res.type) {
     case IntType::Unbounded:
@@ -117,11 +95,26 @@ Integer Integer::sext(unsigned width) {
     return res;
 }
 
+// Compares the absolute values of two unbounded integers
+static int compareMagnitude(const Integer &lhs, const Integer &rhs) {
+    if (lhs.isSmall() && rhs.isSmall()) {
+        uint64_t l = lhs.small < 0 ? 0 - static_cast<uint64_t>(lhs.small)
+                                   : static_cast<uint64_t>(lhs.small);
+        uint64_t r = rhs.small < 0 ? 0 - static_cast<uint64_t>(rhs.small)
+                                   : static_cast<uint64_t>(rhs.small);
+        return (l > r) - (l < r);
+    }
+    mpz_class l = lhs.asUnbounded();
+    mpz_class r = rhs.asUnbounded();
+    int result = mpz_cmpabs(l.get_mpz_t(), r.get_mpz_t());
+    return (result > 0) - (result < 0);
+}
+
 bool Integer::eq(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return unbounded == rhs.unbounded;
+        return compareUnbounded(*this, rhs) == 0;
     case IntType::Bounded:
         return bounded.eq(rhs.bounded);
     }
@@ -130,7 +123,7 @@ bool Integer::ne(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return unbounded != rhs.unbounded;
+        return compareUnbounded(*this, rhs) != 0;
     case IntType::Bounded:
         return bounded.ne(rhs.bounded);
     }
@@ -140,9 +133,9 @@ bool Integer::ult(const Integer &rhs) const {
     switch (type) {
     case IntType::Unbounded:
         if (SMTGenerationOpts::getInstance().EverythingSigned) {
-            return unbounded < rhs.unbounded;
+            return compareUnbounded(*this, rhs) < 0;
         }
-        return abs(unbounded) < abs(rhs.unbounded);
+        return compareMagnitude(*this, rhs) < 0;
     case IntType::Bounded:
         return bounded.ult(rhs.bounded);
     }
@@ -151,7 +144,7 @@ bool Integer::slt(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return unbounded < rhs.unbounded;
+        return compareUnbounded(*this, rhs) < 0;
     case IntType::Bounded:
         return bounded.slt(rhs.bounded);
     }
@@ -161,9 +154,9 @@ bool Integer::ule(const Integer &rhs) const {
     switch (type) {
     case IntType::Unbounded:
         if (SMTGenerationOpts::getInstance().EverythingSigned) {
-            return unbounded <= rhs.unbounded;
+            return compareUnbounded(*this, rhs) <= 0;
         }
-        return abs(unbounded) <= abs(rhs.unbounded);
+        return compareMagnitude(*this, rhs) <= 0;
     case IntType::Bounded:
         return bounded.ule(rhs.bounded);
     }
@@ -172,7 +165,7 @@ bool Integer::sle(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return unbounded <= rhs.unbounded;
+        return compareUnbounded(*this, rhs) <= 0;
     case IntType::Bounded:
         return bounded.sle(rhs.bounded);
     }
@@ -182,9 +175,9 @@ bool Integer::ugt(const Integer &rhs) const {
     switch (type) {
     case IntType::Unbounded:
         if (SMTGenerationOpts::getInstance().EverythingSigned) {
-            return unbounded > rhs.unbounded;
+            return compareUnbounded(*this, rhs) > 0;
         }
-        return abs(unbounded) > abs(rhs.unbounded);
+        return compareMagnitude(*this, rhs) > 0;
     case IntType::Bounded:
         return bounded.ugt(rhs.bounded);
     }
@@ -193,7 +186,7 @@ bool Integer::sgt(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return unbounded > rhs.unbounded;
+        return compareUnbounded(*this, rhs) > 0;
     case IntType::Bounded:
         return bounded.sgt(rhs.bounded);
     }
@@ -203,9 +196,9 @@ bool Integer::uge(const Integer &rhs) const {
     switch (type) {
     case IntType::Unbounded:
         if (SMTGenerationOpts::getInstance().EverythingSigned) {
-            return unbounded >= rhs.unbounded;
+            return compareUnbounded(*this, rhs) >= 0;
         }
-        return abs(unbounded) >= abs(rhs.unbounded);
+        return compareMagnitude(*this, rhs) >= 0;
     case IntType::Bounded:
         return bounded.uge(rhs.bounded);
     }
@@ -214,17 +207,36 @@ bool Integer::sge(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return unbounded >= rhs.unbounded;
+        return compareUnbounded(*this, rhs) >= 0;
     case IntType::Bounded:
         return bounded.sge(rhs.bounded);
     }
 }
 
+// Both round towards zero like the gmp operators
+static Integer divideUnbounded(const Integer &lhs, const Integer &rhs) {
+    if (lhs.isSmall() && rhs.isSmall() && rhs.small != 0 &&
+        !(lhs.small == INT64_MIN && rhs.small == -1)) {
+        return Integer::fromSmall(lhs.small / rhs.small);
+    }
+    return Integer(mpz_class(lhs.asUnbounded() / rhs.asUnbounded()));
+}
+
+static Integer remainderUnbounded(const Integer &lhs, const Integer &rhs) {
+    if (lhs.isSmall() && rhs.isSmall() && rhs.small != 0) {
+        if (rhs.small == -1) {
+            return Integer::fromSmall(0);
+        }
+        return Integer::fromSmall(lhs.small % rhs.small);
+    }
+    return Integer(mpz_class(lhs.asUnbounded() % rhs.asUnbounded()));
+}
+
 Integer Integer::sdiv(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return Integer(unbounded / rhs.unbounded);
+        return divideUnbounded(*this, rhs);
     case IntType::Bounded:
         return Integer(bounded.sdiv(rhs.bounded));
     }
@@ -233,7 +245,7 @@ Integer Integer::udiv(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return Integer(unbounded / rhs.unbounded);
+        return divideUnbounded(*this, rhs);
     case IntType::Bounded:
         return Integer(bounded.udiv(rhs.bounded));
     }
@@ -242,7 +254,7 @@ Integer Integer::srem(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return Integer(unbounded % rhs.unbounded);
+        return remainderUnbounded(*this, rhs);
     case IntType::Bounded:
         return Integer(bounded.srem(rhs.bounded));
     }
@@ -251,7 +263,7 @@ Integer Integer::urem(const Integer &rhs) const {
     assert(type == rhs.type);
     switch (type) {
     case IntType::Unbounded:
-        return Integer(unbounded % rhs.unbounded);
+        return remainderUnbounded(*this, rhs);
     case IntType::Bounded:
         return Integer(bounded.urem(rhs.bounded));
     }
@@ -290,7 +302,12 @@ Integer Integer::xor_(const Integer &rhs) const {
 
 Integer Integer::asPointer() const {
     if (!SMTGenerationOpts::getInstance().BitVect) {
-        return Integer(asUnbounded());
+        switch (type) {
+        case IntType::Unbounded:
+            return *this;
+        case IntType::Bounded:
+            return Integer::fromSmall(bounded.getSExtValue());
+        }
     }
     switch (type) {
     case IntType::Bounded:
@@ -300,8 +317,8 @@ Integer Integer::asPointer() const {
         }
         return Integer(bounded.sext(64));
     case IntType::Unbounded:
-        assert(unbounded.fits_slong_p());
-        return Integer(makeBoundedInt(64, unbounded.get_si()));
+        assert(isSmall());
+        return Integer(makeBoundedInt(64, small));
     }
 }
 
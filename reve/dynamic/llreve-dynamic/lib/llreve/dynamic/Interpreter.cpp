@@ -10,32 +10,22 @@
 
 #include "llreve/dynamic/Interpreter.h"
 
+#include "llreve/dynamic/Bytecode.h"
+
 #include "Compat.h"
 #include "Helper.h"
 
 #include "llvm/IR/Constants.h"
 
-using llvm::LoadInst;
-using llvm::StoreInst;
-using llvm::GetElementPtrInst;
-using llvm::Argument;
+#include <algorithm>
+
 using llvm::BasicBlock;
-using llvm::BinaryOperator;
-using llvm::BranchInst;
 using llvm::Function;
-using llvm::SwitchInst;
-using llvm::ICmpInst;
 using llvm::CmpInst;
 using llvm::Instruction;
-using llvm::SelectInst;
-using llvm::PHINode;
-using llvm::ReturnInst;
-using llvm::TerminatorInst;
-using llvm::Value;
-using llvm::dyn_cast;
-using llvm::isa;
-using llvm::ConstantInt;
-using llvm::CastInst;
+
+using llreve::interpreter::EvalStatus;
+using llreve::interpreter::TraceObserver;
 
 using std::vector;
 using std::string;
@@ -57,6 +47,83 @@ static llreve::cl::opt<unsigned, true> // The parser
     HeapElemSize("heap-elem-size",
                  llreve::cl::desc("Size for a random heap element"),
                  llreve::cl::location(HeapElemSizeFlag), llreve::cl::init(8));
+static llreve::cl::opt<unsigned long long> InterpretInstructionsFlag(
+    "interpret-instructions",
+    llreve::cl::desc("The number of instructions that are interpreted for "
+                     "each trace, 0 means no limit"),
+    llreve::cl::init(0));
+static llreve::cl::opt<unsigned> InterpretTimeoutFlag(
+    "interpret-timeout",
+    llreve::cl::desc("The time in milliseconds that is spent interpreting "
+                     "each trace, 0 means no limit"),
+    llreve::cl::init(0));
+static llreve::cl::opt<unsigned> InterpretHeapSizeFlag(
+    "interpret-heap-size",
+    llreve::cl::desc("The number of heap locations each trace may assign, 0 "
+                     "means no limit"),
+    llreve::cl::init(0));
+static llreve::cl::opt<bool> InterpretMemoizeFlag(
+    "interpret-memoize",
+    llreve::cl::desc("Reuse the results of calls of functions that do not "
+                     "write to the heap instead of interpreting them again"));
+static llreve::cl::opt<bool> InterpretMemoizeStepsFlag(
+    "interpret-memoize-steps",
+    llreve::cl::desc("Keep the steps of memoized calls in the traces"),
+    llreve::cl::init(true));
+static llreve::cl::opt<bool> SparseHeapTraceFlag(
+    "sparse-heap-trace",
+    llreve::cl::desc("Record the heap accesses of each step instead of a "
+                     "snapshot of the heap, the heaps at the steps are "
+                     "rebuilt from the accesses when they are needed"));
+static llreve::cl::opt<bool> InterpretSharePrefixesFlag(
+    "interpret-share-prefixes",
+    llreve::cl::desc("Continue traces from snapshots of previous traces at "
+                     "marks if the inputs only differ in arguments that have "
+                     "not been read yet"),
+    llreve::cl::init(true));
+static llreve::cl::list<string> InterpretBudgetFlag(
+    "interpret-budget",
+    llreve::cl::desc("The budget for the traces of a main function as "
+                     "<function>:<blocks>,<instructions>,<milliseconds>,"
+                     "<heap size>, empty fields keep the default"));
+
+InterpreterBudget::InterpreterBudget(uint32_t blocks)
+    : blocks(blocks), instructions(InterpretInstructionsFlag),
+      time(InterpretTimeoutFlag), heapSize(InterpretHeapSizeFlag) {}
+
+auto budgetForFunction(const llvm::Function &mainFunction, uint32_t blocks)
+    -> InterpreterBudget {
+    InterpreterBudget budget(blocks);
+    for (const auto &flag : InterpretBudgetFlag) {
+        size_t colon = flag.rfind(':');
+        if (colon == string::npos) {
+            logError("Could not parse '" + flag + "' as a budget\n");
+            exit(1);
+        }
+        if (flag.substr(0, colon) != mainFunction.getName()) {
+            continue;
+        }
+        vector<string> fields = split(flag.substr(colon + 1), ',');
+        if (fields.size() > 4) {
+            logError("Could not parse '" + flag + "' as a budget\n");
+            exit(1);
+        }
+        fields.resize(4);
+        if (!fields[0].empty()) {
+            budget.blocks = static_cast<uint32_t>(std::stoul(fields[0]));
+        }
+        if (!fields[1].empty()) {
+            budget.instructions = std::stoull(fields[1]);
+        }
+        if (!fields[2].empty()) {
+            budget.time = std::chrono::milliseconds(std::stoul(fields[2]));
+        }
+        if (!fields[3].empty()) {
+            budget.heapSize = std::stoul(fields[3]);
+        }
+    }
+    return budget;
+}
 
 json toJSON(const Integer &v) { return v.get_str(); }
 bool unsafeBool(const Integer &val) {
@@ -74,500 +141,1135 @@ bool unsafeBool(const Integer &val) {
     }
 }
 
-bool isContainedIn(const llvm::SmallDenseMap<HeapAddress, Integer> &small,
-                   const Heap &big) {
-    for (const auto &val : small) {
-        auto it = big.assignedValues.find(val.first);
-        if (it != big.assignedValues.end()) {
-            if (val.second != it->second) {
-                return false;
-            }
-        } else {
-            if (val.second != big.background) {
-                return false;
-            }
-        }
-    }
-    return true;
-}
-
 bool operator==(const Heap &lhs, const Heap &rhs) {
     if (lhs.background != rhs.background) {
         return false;
     }
-    return isContainedIn(lhs.assignedValues, rhs) &&
-           isContainedIn(rhs.assignedValues, lhs);
+    return lhs.assignedValues.equalWithDefault(rhs.assignedValues,
+                                               lhs.background);
 }
 
-MonoPair<FastCall>
-interpretFunctionPair(MonoPair<const Function *> funs,
-                      MonoPair<FastVarMap> variables, MonoPair<Heap> heaps,
-                      uint32_t maxSteps,
-                      const AnalysisResultsMap &analysisResults) {
-    return makeMonoPair(
-        interpretFunction(*funs.first, FastState(variables.first, heaps.first),
-                          maxSteps, analysisResults),
-        interpretFunction(*funs.second,
-                          FastState(variables.second, heaps.second), maxSteps,
-                          analysisResults));
+static thread_local CallMemo *currentCallMemo = nullptr;
+
+CallMemo::CallMemo(bool keepSteps, bool makeCurrent)
+    : keepSteps(keepSteps), isCurrent(makeCurrent), previous(currentCallMemo) {
+    if (isCurrent) {
+        currentCallMemo = this;
+    }
 }
 
-MonoPair<FastCall> interpretFunctionPair(
-    MonoPair<const llvm::Function *> funs, MonoPair<FastVarMap> variables,
-    MonoPair<Heap> heaps, MonoPair<const llvm::BasicBlock *> startBlocks,
-    uint32_t maxSteps, const AnalysisResultsMap &analysisResults) {
-    return makeMonoPair(
-        interpretFunction(*funs.first, FastState(variables.first, heaps.first),
-                          startBlocks.first, maxSteps, analysisResults),
-        interpretFunction(*funs.second,
-                          FastState(variables.second, heaps.second),
-                          startBlocks.second, maxSteps, analysisResults));
+CallMemo::~CallMemo() {
+    if (isCurrent) {
+        currentCallMemo = previous;
+    }
 }
 
-FastCall interpretFunction(const Function &fun, FastState entry,
-                           const llvm::BasicBlock *startBlock,
-                           uint32_t maxSteps,
-                           const AnalysisResultsMap &analysisResults) {
-    const BasicBlock *prevBlock = nullptr;
-    const BasicBlock *currentBlock = startBlock;
-    vector<BlockStep<const llvm::Value *>> steps;
-    FastState currentState = entry;
-    BlockUpdate<const llvm::Value *> update;
-    uint32_t blocksVisited = 0;
-    bool firstBlock = true;
-    do {
-        update =
-            interpretBlock(*currentBlock, prevBlock, currentState, firstBlock,
-                           maxSteps - blocksVisited, analysisResults);
-        firstBlock = false;
-        blocksVisited += update.blocksVisited;
-        steps.emplace_back(currentBlock->getName(), std::move(update.step),
-                           std::move(update.calls));
-        prevBlock = currentBlock;
-        currentBlock = update.nextBlock;
-        if (blocksVisited > maxSteps || update.earlyExit) {
-            return FastCall(&fun, std::move(entry), std::move(currentState),
-                            std::move(steps), true, blocksVisited);
-        }
-    } while (currentBlock != nullptr);
-    return FastCall(&fun, std::move(entry), std::move(currentState),
-                    std::move(steps), false, blocksVisited);
+CallMemo::Scope::Scope(CallMemo *memo) : previous(currentCallMemo) {
+    currentCallMemo = memo;
 }
 
-FastCall interpretFunction(const Function &fun, FastState entry,
-                           uint32_t maxSteps,
-                           const AnalysisResultsMap &analysisResults) {
-    return interpretFunction(fun, entry, &fun.getEntryBlock(), maxSteps,
-                             analysisResults);
+CallMemo::Scope::~Scope() { currentCallMemo = previous; }
+
+CallMemo *CallMemo::current() { return currentCallMemo; }
+
+std::unique_ptr<CallMemo> callMemoFromFlags() {
+    if (!InterpretMemoizeFlag) {
+        return nullptr;
+    }
+    return std::make_unique<CallMemo>(InterpretMemoizeStepsFlag);
 }
 
-BlockUpdate<const llvm::Value *>
-interpretBlock(const BasicBlock &block, const BasicBlock *prevBlock,
-               FastState &state, bool skipPhi, uint32_t maxSteps,
-               const AnalysisResultsMap &analysisResults) {
-    uint32_t blocksVisited = 1;
-    const Instruction *firstNonPhi = block.getFirstNonPHI();
-    const Instruction *terminator = block.getTerminator();
-    // Handle phi instructions
-    BasicBlock::const_iterator instrIterator;
-    for (instrIterator = block.begin(); &*instrIterator != firstNonPhi;
-         ++instrIterator) {
-        const Instruction *inst = &*instrIterator;
-        assert(isa<PHINode>(inst));
-        if (!skipPhi) {
-            interpretPHI(*dyn_cast<PHINode>(inst), state, prevBlock);
-        }
+// Orders integers of different types and widths instead of asserting that
+// they are equal, null pointers are bounded even if the other integers are not
+static bool integerLess(const Integer &lhs, const Integer &rhs) {
+    if (lhs.type != rhs.type) {
+        return lhs.type < rhs.type;
+    }
+    if (lhs.type == IntType::Bounded &&
+        lhs.bounded.getBitWidth() != rhs.bounded.getBitWidth()) {
+        return lhs.bounded.getBitWidth() < rhs.bounded.getBitWidth();
     }
-    FastState step(state);
+    return lhs < rhs;
+}
 
-    vector<FastCall> calls;
-    // Handle non phi instructions
-    for (; &*instrIterator != terminator; ++instrIterator) {
-        if (const auto call = dyn_cast<llvm::CallInst>(&*instrIterator)) {
-            const Function *fun = call->getCalledFunction();
-            FastVarMap args;
-            auto argIt = fun->getArgumentList().begin();
-            for (const auto &arg : call->arg_operands()) {
-                args.insert(std::make_pair(
-                    &*argIt, resolveValue(arg, state, arg->getType())));
-                ++argIt;
-            }
-            FastCall c =
-                interpretFunction(*fun, FastState(args, state.heap),
-                                  maxSteps - blocksVisited, analysisResults);
-            blocksVisited += c.blocksVisited;
-            if (blocksVisited > maxSteps || c.earlyExit) {
-                return BlockUpdate<const llvm::Value *>(
-                    std::move(step), nullptr, std::move(calls), true,
-                    blocksVisited);
-            }
-            state.heap = c.returnState.heap;
-            insertOrReplace(
-                state.variables,
-                {call, c.returnState.variables
-                           .find(analysisResults.at(fun).returnInstruction)
-                           ->second});
-            calls.push_back(std::move(c));
-        } else {
-            interpretInstruction(&*instrIterator, state);
-        }
-    }
-
-    // Terminator instruction
-    TerminatorUpdate update = interpretTerminator(block.getTerminator(), state);
-
-    return BlockUpdate<const llvm::Value *>(std::move(step), update.nextBlock,
-                                            std::move(calls), false,
-                                            blocksVisited);
-}
-
-void interpretInstruction(const Instruction *instr, FastState &state) {
-    if (const auto binOp = dyn_cast<BinaryOperator>(instr)) {
-        interpretBinOp(binOp, state);
-    } else if (const auto icmp = dyn_cast<ICmpInst>(instr)) {
-        interpretICmpInst(icmp, state);
-    } else if (const auto cast = dyn_cast<CastInst>(instr)) {
-        assert(cast->getNumOperands() == 1);
-        if (cast->getSrcTy()->isIntegerTy(1) &&
-            cast->getDestTy()->getIntegerBitWidth() > 1) {
-            // Convert a bool to an integer
-            Integer operand = state.variables.find(cast->getOperand(0))->second;
-            if (SMTGenerationOpts::getInstance().BitVect) {
-                insertOrReplace(
-                    state.variables,
-                    {cast, Integer(makeBoundedInt(
-                               cast->getType()->getIntegerBitWidth(),
-                               unsafeBool(operand) ? 1 : 0))});
-            } else {
-                insertOrReplace(
-                    state.variables,
-                    {cast, Integer(mpz_class(unsafeBool(operand) ? 1 : 0))});
-            }
-        } else {
-            if (const auto zext = dyn_cast<llvm::ZExtInst>(instr)) {
-                insertOrReplace(
-                    state.variables,
-                    {zext,
-                     resolveValue(zext->getOperand(0), state, zext->getType())
-                         .zext(zext->getType()->getIntegerBitWidth())});
-            } else if (const auto sext = dyn_cast<llvm::SExtInst>(instr)) {
-                insertOrReplace(
-                    state.variables,
-                    {sext,
-                     resolveValue(sext->getOperand(0), state, sext->getType())
-                         .sext(sext->getType()->getIntegerBitWidth())});
-            } else if (const auto trunc = dyn_cast<llvm::TruncInst>(instr)) {
-                insertOrReplace(
-                    state.variables,
-                    {trunc,
-                     resolveValue(trunc->getOperand(0), state, trunc->getType())
-                         .zextOrTrunc(trunc->getType()->getIntegerBitWidth())});
-            } else if (const auto ptrToInt =
-                           dyn_cast<llvm::PtrToIntInst>(instr)) {
-                insertOrReplace(
-                    state.variables,
-                    {ptrToInt,
-                     resolveValue(ptrToInt->getPointerOperand(), state,
-                                  ptrToInt->getPointerOperand()->getType())
-                         .zextOrTrunc(
-                             ptrToInt->getType()->getIntegerBitWidth())});
-            } else if (const auto intToPtr =
-                           dyn_cast<llvm::IntToPtrInst>(instr)) {
-                insertOrReplace(
-                    state.variables,
-                    {ptrToInt, resolveValue(intToPtr->getOperand(0), state,
-                                            intToPtr->getOperand(0)->getType())
-                                   .zextOrTrunc(64)});
-            } else {
-                logErrorData("Unsupported instruction:\n", *instr);
-                exit(1);
-            }
+bool CallMemo::KeyLess::operator()(const Key &lhs, const Key &rhs) const {
+    if (lhs.first != rhs.first) {
+        return std::less<const Function *>()(lhs.first, rhs.first);
+    }
+    return std::lexicographical_compare(lhs.second.begin(), lhs.second.end(),
+                                        rhs.second.begin(), rhs.second.end(),
+                                        integerLess);
+}
+
+// The effects of the function and all functions it calls transitively
+CallMemo::Effects CallMemo::functionEffects(const Function &fun) {
+    auto it = effects.find(&fun);
+    if (it != effects.end()) {
+        return it->second;
+    }
+    Effects result{false, false};
+    vector<const Function *> worklist = {&fun};
+    llvm::SmallPtrSet<const Function *, 8> visited;
+    visited.insert(&fun);
+    while (!worklist.empty() && !result.writesHeap) {
+        const Function *f = worklist.back();
+        worklist.pop_back();
+        if (f->isDeclaration()) {
+            // External functions can’t be interpreted anyway
+            result.writesHeap = true;
+            break;
         }
-    } else if (const auto gep = dyn_cast<GetElementPtrInst>(instr)) {
-        insertOrReplace(state.variables, {gep, resolveGEP(*gep, state)});
-    } else if (const auto load = dyn_cast<LoadInst>(instr)) {
-        Integer ptr = resolveValue(load->getPointerOperand(), state,
-                                   load->getPointerOperand()->getType());
-        // This will only insert 0 if there is not already a different element
-        if (SMTGenerationOpts::getInstance().BitVect) {
-            unsigned bytes = load->getType()->getIntegerBitWidth() / 8;
-            llvm::APInt val =
-                makeBoundedInt(load->getType()->getIntegerBitWidth(), 0);
-            for (unsigned i = 0; i < bytes; ++i) {
-                auto heapIt = state.heap.assignedValues.insert(std::make_pair(
-                    ptr.asPointer() + Integer(mpz_class(i)).asPointer(),
-                    Integer(makeBoundedInt(
-                        8, state.heap.background.asUnbounded().get_si()))));
-                assert(heapIt.first->second.type == IntType::Bounded);
-                assert(heapIt.first->second.bounded.getBitWidth() == 8);
-                val = (val << 8) |
-                      (heapIt.first->second.bounded).sextOrSelf(bytes * 8);
-            }
-            insertOrReplace(state.variables, {load, Integer(val)});
-        } else {
-            auto heapIt = state.heap.assignedValues.insert(
-                std::make_pair(ptr.asPointer(), state.heap.background));
-            insertOrReplace(state.variables, {load, heapIt.first->second});
-        }
-    } else if (const auto store = dyn_cast<StoreInst>(instr)) {
-        HeapAddress addr = resolveValue(store->getPointerOperand(), state,
-                                        store->getPointerOperand()->getType());
-        Integer val = resolveValue(store->getValueOperand(), state,
-                                   store->getValueOperand()->getType());
-        if (SMTGenerationOpts::getInstance().BitVect) {
-            int bytes =
-                store->getValueOperand()->getType()->getIntegerBitWidth() / 8;
-            assert(val.type == IntType::Bounded);
-            llvm::APInt bval = val.bounded;
-            if (bytes == 1) {
-                state.heap.assignedValues[addr] = val;
-            } else {
-                uint64_t i = 0;
-                for (; bytes >= 0; --bytes) {
-                    llvm::APInt el = bval.trunc(8);
-                    bval = bval.ashr(8);
-                    state.heap
-                        .assignedValues[addr + Integer(llvm::APInt(
-                                                   64, static_cast<uint64_t>(
-                                                           bytes)))] =
-                        Integer(el);
-                    ++i;
+        for (const auto &block : *f) {
+            for (const auto &instr : block) {
+                if (llvm::isa<llvm::LoadInst>(instr)) {
+                    result.readsHeap = true;
+                } else if (const auto call =
+                               llvm::dyn_cast<llvm::CallInst>(&instr)) {
+                    const Function *callee = call->getCalledFunction();
+                    if (!callee) {
+                        result.writesHeap = true;
+                    } else if (visited.insert(callee).second) {
+                        worklist.push_back(callee);
+                    }
+                } else if (instr.mayWriteToMemory()) {
+                    result.writesHeap = true;
                 }
             }
-        } else {
-            state.heap.assignedValues[addr] = val;
-        }
-    } else if (const auto select = dyn_cast<SelectInst>(instr)) {
-        Integer cond = resolveValue(select->getCondition(), state,
-                                    select->getCondition()->getType());
-        bool condVal = unsafeBool(cond);
-        if (condVal) {
-            Integer var =
-                resolveValue(select->getTrueValue(), state, select->getType());
-            insertOrReplace(state.variables, {select, var});
-        } else {
-            Integer var =
-                resolveValue(select->getFalseValue(), state, select->getType());
-            insertOrReplace(state.variables, {select, var});
         }
+    }
+    effects.insert({&fun, result});
+    return result;
+}
 
-    } else {
-        logErrorData("unsupported instruction:\n", *instr);
+bool CallMemo::isMemoizable(const Function &fun) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !functionEffects(fun).writesHeap;
+}
+
+CallMemo::Key CallMemo::key(const Function &fun,
+                            const FastState &entry) const {
+    vector<Integer> args;
+    for (const auto &arg : fun.args()) {
+        auto it = entry.variables.find(&arg);
+        assert(it != entry.variables.end());
+        args.push_back(it->second);
     }
+    return {&fun, std::move(args)};
 }
 
-void interpretPHI(const PHINode &instr, FastState &state,
-                  const BasicBlock *prevBlock) {
-    const Value *val = instr.getIncomingValueForBlock(prevBlock);
-    Integer var = resolveValue(val, state, val->getType());
-    insertOrReplace(state.variables, {&instr, var});
+llvm::Optional<FastCall> CallMemo::lookup(const Function &fun,
+                                          const FastState &entry) {
+    Key k = key(fun, entry);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = calls.find(k);
+    if (it == calls.end()) {
+        return llvm::None;
+    }
+    for (const auto &memoized : it->second) {
+        if (memoized.heap && !(*memoized.heap == entry.heap)) {
+            continue;
+        }
+        FastCall call = memoized.call;
+        // The callee does not write to the heap, so this is only different
+        // if the heap is not relevant for the call
+        call.entryState.heap = entry.heap;
+        call.returnState.heap = entry.heap;
+        return call;
+    }
+    return llvm::None;
 }
 
-TerminatorUpdate interpretTerminator(const TerminatorInst *instr,
-                                     FastState &state) {
-    if (const auto retInst = dyn_cast<ReturnInst>(instr)) {
-        if (retInst->getReturnValue() == nullptr) {
-            insertOrReplace(state.variables, {retInst, Integer(mpz_class(0))});
-        } else {
-            insertOrReplace(
-                state.variables,
-                {retInst, resolveValue(retInst->getReturnValue(), state,
-                                       retInst->getReturnValue()->getType())});
-        }
-        return TerminatorUpdate(nullptr);
-    } else if (const auto branchInst = dyn_cast<BranchInst>(instr)) {
-        if (branchInst->isUnconditional()) {
-            assert(branchInst->getNumSuccessors() == 1);
-            return TerminatorUpdate(branchInst->getSuccessor(0));
-        } else {
-            Integer cond = resolveValue(branchInst->getCondition(), state,
-                                        branchInst->getCondition()->getType());
-            bool condVal = unsafeBool(cond);
-            assert(branchInst->getNumSuccessors() == 2);
-            if (condVal) {
-                return TerminatorUpdate(branchInst->getSuccessor(0));
+void CallMemo::insert(const FastCall &call) {
+    assert(!call.earlyExit);
+    Key k = key(*call.function, call.entryState);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries >= MaxEntries) {
+        return;
+    }
+    const Effects callEffects = functionEffects(*call.function);
+    // The steps contain the heap so it is relevant if they are kept
+    llvm::Optional<Heap> heap;
+    if (callEffects.readsHeap || keepSteps) {
+        heap = call.entryState.heap;
+    }
+    FastCall memoized = call;
+    if (!keepSteps) {
+        memoized.steps.clear();
+    }
+    calls[std::move(k)].push_back({std::move(heap), std::move(memoized)});
+    ++entries;
+}
+
+namespace {
+// The state of a function while its bytecode is interpreted
+class Frame {
+  public:
+    const BytecodeFunction &code;
+    vector<Integer> values;
+
+    Frame(const BytecodeFunction &code, const FastState &entry)
+        : code(code), values(code.initialValues), heap(entry.heap),
+          assigned(code.layout.variableCount(), false),
+          changed(code.layout.variableCount(), false) {
+        for (const auto &var : entry.variables) {
+            auto slot = code.layout.slot(var.first);
+            if (slot) {
+                assign(*slot, var.second);
             } else {
-                return TerminatorUpdate(branchInst->getSuccessor(1));
+                otherVariables.insert(var);
             }
         }
-    } else if (const auto switchInst = dyn_cast<SwitchInst>(instr)) {
-        Integer condVal = resolveValue(switchInst->getCondition(), state,
-                                       switchInst->getCondition()->getType());
-        for (auto c : switchInst->cases()) {
-            Integer caseVal;
-            if (SMTGenerationOpts::getInstance().BitVect) {
-                caseVal = Integer(c.getCaseValue()->getValue());
-            } else {
-                caseVal = Integer(mpz_class(c.getCaseValue()->getSExtValue()));
+    }
+    void assign(Slot slot, Integer val) {
+        if (!assigned[slot]) {
+            assigned[slot] = true;
+            assignedSlots.push_back(slot);
+        }
+        if (!changed[slot]) {
+            changed[slot] = true;
+            changedSlots.push_back(slot);
+        }
+        values[slot] = std::move(val);
+    }
+    auto getHeap() const -> const Heap & { return heap; }
+    void replaceHeap(Heap newHeap) {
+        heap = std::move(newHeap);
+        heapChanged = true;
+    }
+    void store(HeapAddress addr, Integer val) {
+        if (SparseHeapTraceFlag && !heapChanged) {
+            const Integer *old = heap.assignedValues.lookup(addr);
+            heapEvents.push_back(
+                {addr, old ? llvm::Optional<Integer>(*old) : llvm::None, val});
+        }
+        heap.assignedValues.set(std::move(addr), std::move(val));
+        heapChanged = heapChanged || !SparseHeapTraceFlag;
+    }
+    // Locations that have not been written to are initialized to 'def'
+    auto load(HeapAddress addr, Integer def) -> const Integer & {
+        auto it = heap.assignedValues.insert(addr, std::move(def));
+        if (it.second) {
+            if (SparseHeapTraceFlag && !heapChanged) {
+                heapEvents.push_back({std::move(addr), llvm::None, it.first});
             }
-            if (caseVal == condVal) {
-                return TerminatorUpdate(c.getCaseSuccessor());
+            heapChanged = heapChanged || !SparseHeapTraceFlag;
+        }
+        return it.first;
+    }
+    // Only variables that have been assigned are part of the state
+    auto toState() const -> FastState {
+        FastVarMap variables(otherVariables);
+        for (Slot slot : assignedSlots) {
+            variables.insert({code.layout.variable(slot), values[slot]});
+        }
+        return FastState(std::move(variables), heap);
+    }
+    // The changes since the last call, the first delta contains the complete
+    // state
+    auto takeDelta() -> FastStateTrace::Delta {
+        FastStateTrace::Delta delta;
+        if (!otherVariablesTaken) {
+            delta.variables.insert(delta.variables.end(),
+                                   otherVariables.begin(),
+                                   otherVariables.end());
+            otherVariablesTaken = true;
+        }
+        for (Slot slot : changedSlots) {
+            delta.variables.push_back(
+                {code.layout.variable(slot), values[slot]});
+            changed[slot] = false;
+        }
+        changedSlots.clear();
+        // A snapshot already contains the effects of the events
+        if (heapChanged) {
+            delta.heap = heap;
+            heapChanged = false;
+        } else {
+            delta.heapEvents = std::move(heapEvents);
+        }
+        heapEvents.clear();
+        return delta;
+    }
+    // A delta that contains the complete state
+    auto takeFullDelta() -> FastStateTrace::Delta {
+        FastStateTrace::Delta delta = takeDelta();
+        FastState state = toState();
+        delta.variables.assign(state.variables.begin(), state.variables.end());
+        delta.heap = std::move(state.heap);
+        delta.heapEvents.clear();
+        return delta;
+    }
+
+  private:
+    Heap heap;
+    vector<bool> assigned;
+    vector<Slot> assignedSlots;
+    // Slots that have changed since the last delta
+    vector<bool> changed;
+    vector<Slot> changedSlots;
+    // Whether the next delta needs a snapshot of the heap. Without
+    // -sparse-heap-trace this is the case whenever the heap has changed,
+    // otherwise only if it has been replaced.
+    bool heapChanged = true;
+    // The accesses since the last delta if there is no snapshot
+    vector<HeapEvent> heapEvents;
+    // Variables of the entry state that don’t belong to this function
+    FastVarMap otherVariables;
+    bool otherVariablesTaken = false;
+};
+
+// The instruction, time and heap budget of a trace, it is shared by all calls
+// in the trace. Once it is exhausted it stays exhausted.
+class BudgetTracker {
+  public:
+    explicit BudgetTracker(const InterpreterBudget &budget)
+        : budget(budget), start(std::chrono::steady_clock::now()) {}
+    // Accounts for the next instruction, returns false if the budget does not
+    // allow to interpret it
+    auto consume(const Frame &frame) -> bool {
+        if (exhausted) {
+            return false;
+        }
+        ++instructions;
+        if (budget.instructions != 0 && instructions > budget.instructions) {
+            exhausted = true;
+        } else if (budget.heapSize != 0 &&
+                   frame.getHeap().assignedValues.size() > budget.heapSize) {
+            exhausted = true;
+        } else if (budget.time.count() != 0 &&
+                   instructions % TimeCheckInterval == 0 &&
+                   std::chrono::steady_clock::now() - start > budget.time) {
+            // Reading the clock is too expensive to do it for every
+            // instruction
+            exhausted = true;
+        }
+        return !exhausted;
+    }
+
+  private:
+    static const uint64_t TimeCheckInterval = 1024;
+    InterpreterBudget budget;
+    std::chrono::steady_clock::time_point start;
+    uint64_t instructions = 0;
+    bool exhausted = false;
+};
+
+struct BlockResult {
+    // Changes of the state up to the end of the phi nodes
+    FastStateTrace::Delta step;
+    BlockIndex nextBlock;
+    vector<FastCall> calls;
+    // Indicates a stop because the budget is exhausted
+    bool earlyExit;
+    uint32_t blocksVisited;
+};
+
+// A call that is interpreted block by block
+struct Execution {
+    const Function &fun;
+    const BytecodeFunction &code;
+    Frame frame;
+    BlockIndex prevBlock = NoBlock;
+    BlockIndex currentBlock;
+    uint32_t maxSteps;
+    uint32_t blocksVisited = 0;
+    std::shared_ptr<BudgetTracker> budget;
+    bool firstBlock = true;
+    // Set if the budget is exhausted
+    bool earlyExit = false;
+    Execution(const Function &fun, const BytecodeFunction &code,
+              const FastState &entry, const BasicBlock *startBlock,
+              uint32_t maxSteps, std::shared_ptr<BudgetTracker> budget)
+        : fun(fun), code(code), frame(code, entry),
+          currentBlock(code.layout.blockIndex(*startBlock)),
+          maxSteps(maxSteps), budget(std::move(budget)) {}
+    auto finished() const -> bool {
+        return earlyExit || currentBlock == NoBlock;
+    }
+};
+
+// Functions are lowered on their first call, the bytecode is only valid as
+// long as the functions are not modified.
+class BytecodeInterpreter {
+  public:
+    // If 'observer' is not null it is notified of every block and instruction
+    // that is interpreted including those of called functions
+    explicit BytecodeInterpreter(const AnalysisResultsMap &analysisResults,
+                                 TraceObserver *observer = nullptr)
+        : analysisResults(analysisResults),
+          bitVect(SMTGenerationOpts::getInstance().BitVect),
+          observer(observer) {
+        // The observer has to see every instruction
+        if (!observer) {
+            memo = CallMemo::current();
+            if (!memo && InterpretMemoizeFlag) {
+                ownMemo = std::make_unique<CallMemo>(InterpretMemoizeStepsFlag,
+                                                     false);
+                memo = ownMemo.get();
             }
         }
-        return TerminatorUpdate(switchInst->getDefaultDest());
+    }
+    auto interpretFunction(const Function &fun, FastState entry,
+                           const BasicBlock *startBlock,
+                           const InterpreterBudget &budget) -> FastCall {
+        return interpretFunction(fun, std::move(entry), startBlock,
+                                 budget.blocks,
+                                 std::make_shared<BudgetTracker>(budget));
+    }
+    auto startExecution(const Function &fun, const FastState &entry,
+                        const BasicBlock *startBlock,
+                        const InterpreterBudget &budget)
+        -> std::unique_ptr<Execution> {
+        return std::make_unique<Execution>(
+            fun, lowered(fun), entry, startBlock, budget.blocks,
+            std::make_shared<BudgetTracker>(budget));
+    }
+    // Interprets the next block of an execution that has not finished. If
+    // 'fullState' is set the delta stored in the trace contains the complete
+    // state instead of the changes since the last step.
+    auto step(Execution &exec, const std::shared_ptr<FastStateTrace> &trace,
+              bool fullState) -> BlockStep<const llvm::Value *>;
 
-    } else {
-        logError("Only return and branches are supported\n");
-        return TerminatorUpdate(nullptr);
+  private:
+    const AnalysisResultsMap &analysisResults;
+    bool bitVect;
+    TraceObserver *observer;
+    std::unique_ptr<CallMemo> ownMemo;
+    CallMemo *memo = nullptr;
+    llvm::DenseMap<const Function *, std::unique_ptr<BytecodeFunction>>
+        functions;
+
+    auto lowered(const Function &fun) -> const BytecodeFunction & {
+        auto &code = functions[&fun];
+        if (!code) {
+            code = lowerFunction(fun);
+        }
+        return *code;
     }
+    // Calls share the budget of their caller
+    auto interpretFunction(const Function &fun, FastState entry,
+                           const BasicBlock *startBlock, uint32_t maxSteps,
+                           std::shared_ptr<BudgetTracker> budget) -> FastCall;
+    auto interpretBlock(const BytecodeBlock &block, BlockIndex prevBlock,
+                        Frame &frame, bool skipPhi, uint32_t maxSteps,
+                        const std::shared_ptr<BudgetTracker> &budget,
+                        bool fullState) -> BlockResult;
+    void interpretInstruction(const BytecodeInstruction &instr, Frame &frame);
+    auto interpretTerminator(const BytecodeTerminator &terminator,
+                             const Frame &frame) -> BlockIndex;
+};
 }
 
-Integer resolveValue(const Value *val, const FastState &state,
-                     const llvm::Type * /* unused */) {
-    if (isa<Instruction>(val) || isa<Argument>(val)) {
-        return state.variables.find(val)->second;
-    } else if (const auto constInt = dyn_cast<ConstantInt>(val)) {
-        if (constInt->getBitWidth() == 1) {
-            return Integer(constInt->getValue());
-        } else if (!SMTGenerationOpts::getInstance().BitVect) {
-            return Integer(mpz_class(constInt->getSExtValue()));
-        } else {
-            return Integer(constInt->getValue());
+namespace {
+// The arithmetic of the interpreter core on integers that are bounded if
+// -bitvect is passed and unbounded otherwise. Shifts and bitwise operations
+// are only defined on bounded integers.
+struct IntegerArithmetic {
+    using Value = Integer;
+
+    static auto isZero(const Integer &a) -> bool {
+        switch (a.type) {
+        case IntType::Unbounded:
+            // Zero is always stored inline
+            return a.isSmall() && a.small == 0;
+        case IntType::Bounded:
+            return a.bounded == 0;
         }
-    } else if (llvm::isa<llvm::ConstantPointerNull>(val)) {
-        return Integer(makeBoundedInt(64, 0));
+        return false;
+    }
+    static auto divisionOverflows(const Integer &a, const Integer &b)
+        -> bool {
+        return a.type == IntType::Bounded &&
+               interpreter::BoundedArithmetic::divisionOverflows(a.bounded,
+                                                                 b.bounded);
+    }
+    static auto shiftOutOfRange(const Integer &a, const Integer &b) -> bool {
+        return a.type == IntType::Bounded &&
+               interpreter::BoundedArithmetic::shiftOutOfRange(a.bounded,
+                                                               b.bounded);
     }
-    logErrorData("Operators are not yet handled\n", *val);
-    exit(1);
-}
 
-void interpretICmpInst(const ICmpInst *instr, FastState &state) {
-    assert(instr->getNumOperands() == 2);
-    Integer op0 = resolveValue(instr->getOperand(0), state,
-                               instr->getOperand(0)->getType());
-    Integer op1 = resolveValue(instr->getOperand(1), state,
-                               instr->getOperand(0)->getType());
-    switch (instr->getPredicate()) {
-    default:
-        interpretIntPredicate(instr, instr->getPredicate(), std::move(op0),
-                              std::move(op1), state);
+    static auto add(const Integer &a, const Integer &b) -> Integer {
+        return a + b;
+    }
+    static auto sub(const Integer &a, const Integer &b) -> Integer {
+        return a - b;
+    }
+    static auto mul(const Integer &a, const Integer &b) -> Integer {
+        return a * b;
+    }
+    static auto udiv(const Integer &a, const Integer &b) -> Integer {
+        return a.udiv(b);
+    }
+    static auto sdiv(const Integer &a, const Integer &b) -> Integer {
+        return a.sdiv(b);
+    }
+    static auto urem(const Integer &a, const Integer &b) -> Integer {
+        return a.urem(b);
+    }
+    static auto srem(const Integer &a, const Integer &b) -> Integer {
+        return a.srem(b);
+    }
+    static auto shl(const Integer &a, const Integer &b) -> Integer {
+        return a.shl(b);
+    }
+    static auto lshr(const Integer &a, const Integer &b) -> Integer {
+        return a.lshr(b);
+    }
+    static auto ashr(const Integer &a, const Integer &b) -> Integer {
+        return a.ashr(b);
+    }
+    static auto and_(const Integer &a, const Integer &b) -> Integer {
+        return a.and_(b);
+    }
+    static auto or_(const Integer &a, const Integer &b) -> Integer {
+        return a.or_(b);
+    }
+    static auto xor_(const Integer &a, const Integer &b) -> Integer {
+        return a.xor_(b);
     }
-}
 
-void interpretIntPredicate(const ICmpInst *instr, CmpInst::Predicate pred,
-                           const Integer &i0, const Integer &i1,
-                           FastState &state) {
-    bool predVal = false;
-    switch (pred) {
-    case CmpInst::ICMP_EQ:
-        predVal = i0.eq(i1);
-        break;
-    case CmpInst::ICMP_NE:
-        predVal = i0.ne(i1);
-        break;
-    case CmpInst::ICMP_SGE:
-        predVal = i0.sge(i1);
-        break;
-    case CmpInst::ICMP_SGT:
-        predVal = i0.sgt(i1);
-        break;
-    case CmpInst::ICMP_SLE:
-        predVal = i0.sle(i1);
-        break;
-    case CmpInst::ICMP_SLT:
-        predVal = i0.slt(i1);
-        break;
-    case CmpInst::ICMP_UGE:
-        predVal = i0.uge(i1);
-        break;
-    case CmpInst::ICMP_UGT:
-        predVal = i0.ugt(i1);
-        break;
-    case CmpInst::ICMP_ULE:
-        predVal = i0.ule(i1);
-        break;
-    case CmpInst::ICMP_ULT:
-        predVal = i0.ult(i1);
-        break;
-    default:
-        logErrorData("Unsupported predicate:\n", *instr);
+    static auto eq(const Integer &a, const Integer &b) -> bool {
+        return a.eq(b);
+    }
+    static auto ne(const Integer &a, const Integer &b) -> bool {
+        return a.ne(b);
+    }
+    static auto ugt(const Integer &a, const Integer &b) -> bool {
+        return a.ugt(b);
+    }
+    static auto uge(const Integer &a, const Integer &b) -> bool {
+        return a.uge(b);
+    }
+    static auto ult(const Integer &a, const Integer &b) -> bool {
+        return a.ult(b);
+    }
+    static auto ule(const Integer &a, const Integer &b) -> bool {
+        return a.ule(b);
+    }
+    static auto sgt(const Integer &a, const Integer &b) -> bool {
+        return a.sgt(b);
+    }
+    static auto sge(const Integer &a, const Integer &b) -> bool {
+        return a.sge(b);
     }
-    insertOrReplace(state.variables, {instr, Integer(predVal)});
+    static auto slt(const Integer &a, const Integer &b) -> bool {
+        return a.slt(b);
+    }
+    static auto sle(const Integer &a, const Integer &b) -> bool {
+        return a.sle(b);
+    }
+};
 }
 
-void interpretBinOp(const BinaryOperator *instr, FastState &state) {
-    const Integer op0 = resolveValue(instr->getOperand(0), state,
-                                     instr->getOperand(0)->getType());
-    const Integer op1 = resolveValue(instr->getOperand(1), state,
-                                     instr->getOperand(1)->getType());
-    if (instr->getType()->getIntegerBitWidth() == 1) {
-        bool b0 = unsafeBool(op0);
-        bool b1 = unsafeBool(op1);
-        interpretBoolBinOp(instr, instr->getOpcode(), b0, b1, state);
-    } else {
-        interpretIntBinOp(instr, instr->getOpcode(), std::move(op0),
-                          std::move(op1), state);
+static auto interpretIntPredicate(const Instruction *instr,
+                                  CmpInst::Predicate pred, const Integer &i0,
+                                  const Integer &i1) -> bool {
+    bool result = false;
+    if (!interpreter::evalPredicate<IntegerArithmetic>(pred, i0, i1, result)) {
+        logErrorData("Unsupported predicate:\n", *instr);
     }
+    return result;
 }
 
-void interpretBoolBinOp(const BinaryOperator *instr, Instruction::BinaryOps op,
-                        bool b0, bool b1, FastState &state) {
-    bool result = false;
+static auto interpretBoolBinOp(const Instruction *instr,
+                               Instruction::BinaryOps op, bool b0, bool b1)
+    -> bool {
     switch (op) {
     case Instruction::Or:
-        result = b0 || b1;
-        break;
+        return b0 || b1;
     case Instruction::And:
-        result = b0 && b1;
-        break;
+        return b0 && b1;
     case Instruction::Xor:
-        result = b0 ^ b1;
-        break;
+        return b0 ^ b1;
     default:
         logErrorData("Unsupported binop:\n", *instr);
         llvm::errs() << "\n";
+        return false;
     }
-    insertOrReplace(state.variables, {instr, Integer(result)});
 }
 
-void interpretIntBinOp(const BinaryOperator *instr, Instruction::BinaryOps op,
-                       const Integer &i0, const Integer &i1, FastState &state) {
+static auto interpretIntBinOp(const Instruction *instr,
+                              Instruction::BinaryOps op, const Integer &i0,
+                              const Integer &i1) -> Integer {
     Integer result;
-    switch (op) {
-    case Instruction::Add:
-        result = i0 + i1;
+    EvalStatus status;
+    if (!interpreter::evalBinaryOp<IntegerArithmetic>(op, i0, i1, result,
+                                                      status)) {
+        logErrorData("Unsupported binop:\n", *instr);
+        llvm::errs() << "\n";
+        return Integer();
+    }
+    if (status != EvalStatus::Ok) {
+        logErrorData(string("Undefined behavior (") +
+                         interpreter::evalStatusMessage(status) + "):\n",
+                     *instr);
+        exit(1);
+    }
+    return result;
+}
+
+FastCall BytecodeInterpreter::interpretFunction(
+    const Function &fun, FastState entry, const BasicBlock *startBlock,
+    uint32_t maxSteps, std::shared_ptr<BudgetTracker> budget) {
+    Execution exec(fun, lowered(fun), entry, startBlock, maxSteps,
+                   std::move(budget));
+    auto trace = std::make_shared<FastStateTrace>();
+    vector<BlockStep<const llvm::Value *>> steps;
+    do {
+        steps.push_back(step(exec, trace, false));
+    } while (!exec.finished());
+    return FastCall(&fun, std::move(entry), exec.frame.toState(),
+                    std::move(steps), exec.earlyExit, exec.blocksVisited);
+}
+
+auto BytecodeInterpreter::step(Execution &exec,
+                               const std::shared_ptr<FastStateTrace> &trace,
+                               bool fullState)
+    -> BlockStep<const llvm::Value *> {
+    const BytecodeBlock &block = exec.code.blocks[exec.currentBlock];
+    BlockResult update =
+        interpretBlock(block, exec.prevBlock, exec.frame, exec.firstBlock,
+                       exec.maxSteps - exec.blocksVisited, exec.budget,
+                       fullState);
+    exec.firstBlock = false;
+    exec.blocksVisited += update.blocksVisited;
+    exec.prevBlock = exec.currentBlock;
+    exec.currentBlock = update.nextBlock;
+    if (exec.blocksVisited > exec.maxSteps || update.earlyExit) {
+        exec.earlyExit = true;
+    }
+    return BlockStep<const llvm::Value *>(block.block->getName(), trace,
+                                          trace->push(std::move(update.step)),
+                                          std::move(update.calls));
+}
+
+BlockResult BytecodeInterpreter::interpretBlock(
+    const BytecodeBlock &block, BlockIndex prevBlock, Frame &frame,
+    bool skipPhi, uint32_t maxSteps, const shared_ptr<BudgetTracker> &budget,
+    bool fullState) {
+    uint32_t blocksVisited = 1;
+    if (observer) {
+        observer->enterBlock(*block.block,
+                             prevBlock == NoBlock
+                                 ? nullptr
+                                 : frame.code.blocks[prevBlock].block);
+    }
+    if (!skipPhi) {
+        for (const auto &phis : block.phis) {
+            if (phis.predecessor != prevBlock) {
+                continue;
+            }
+            if (phis.unsupportedOperand) {
+                logErrorData("Operators are not yet handled\n",
+                             *phis.unsupportedOperand);
+                exit(1);
+            }
+            for (const auto &move : phis.moves) {
+                frame.assign(move.first, frame.values[move.second]);
+                if (observer) {
+                    observer->executeInstruction(
+                        *llvm::cast<Instruction>(
+                            frame.code.layout.variable(move.first)),
+                        move.first);
+                }
+            }
+            break;
+        }
+    }
+    FastStateTrace::Delta step =
+        fullState ? frame.takeFullDelta() : frame.takeDelta();
+
+    vector<FastCall> calls;
+    for (const auto &instr : block.instructions) {
+        if (!budget->consume(frame)) {
+            return {std::move(step), NoBlock, std::move(calls), true,
+                    blocksVisited};
+        }
+        if (instr.opcode != Opcode::Call) {
+            interpretInstruction(instr, frame);
+            if (observer) {
+                observer->executeInstruction(*instr.instr, instr.result);
+            }
+            continue;
+        }
+        const Function *fun = instr.callee;
+        FastVarMap args;
+        auto argIt = fun->arg_begin();
+        for (Slot arg : instr.operands) {
+            args.insert(std::make_pair(&*argIt, frame.values[arg]));
+            ++argIt;
+        }
+        FastState entry(args, frame.getHeap());
+        const bool memoizable = memo && memo->isMemoizable(*fun);
+        llvm::Optional<FastCall> memoized;
+        if (memoizable) {
+            memoized = memo->lookup(*fun, entry);
+        }
+        FastCall c = memoized ? std::move(*memoized)
+                              : interpretFunction(*fun, std::move(entry),
+                                                  &fun->getEntryBlock(),
+                                                  maxSteps - blocksVisited,
+                                                  budget);
+        if (memoizable && !memoized && !c.earlyExit) {
+            memo->insert(c);
+        }
+        blocksVisited += c.blocksVisited;
+        if (blocksVisited > maxSteps || c.earlyExit) {
+            return {std::move(step), NoBlock, std::move(calls), true,
+                    blocksVisited};
+        }
+        frame.replaceHeap(c.returnState.heap);
+        frame.assign(instr.result,
+                     c.returnState.variables
+                         .find(analysisResults.at(fun).returnInstruction)
+                         ->second);
+        calls.push_back(std::move(c));
+        if (observer) {
+            observer->executeInstruction(*instr.instr, instr.result);
+        }
+    }
+
+    BlockIndex nextBlock = interpretTerminator(block.terminator, frame);
+    if (block.terminator.kind == TerminatorKind::Return) {
+        frame.assign(block.terminator.result,
+                     frame.values[block.terminator.value]);
+    }
+    if (observer) {
+        const Instruction &terminator = *block.block->getTerminator();
+        observer->executeInstruction(terminator,
+                                     *frame.code.layout.slot(&terminator));
+        if (block.terminator.kind == TerminatorKind::Return) {
+            observer->exitFunction(*frame.code.function);
+        }
+    }
+    return {std::move(step), nextBlock, std::move(calls), false,
+            blocksVisited};
+}
+
+void BytecodeInterpreter::interpretInstruction(
+    const BytecodeInstruction &instr, Frame &frame) {
+    const auto &values = frame.values;
+    switch (instr.opcode) {
+    case Opcode::IntBinOp:
+        frame.assign(instr.result,
+                     interpretIntBinOp(
+                         instr.instr,
+                         static_cast<Instruction::BinaryOps>(instr.subOpcode),
+                         values[instr.operands[0]], values[instr.operands[1]]));
         break;
-    case Instruction::Sub:
-        result = i0 - i1;
+    case Opcode::BoolBinOp:
+        frame.assign(
+            instr.result,
+            Integer(interpretBoolBinOp(
+                instr.instr,
+                static_cast<Instruction::BinaryOps>(instr.subOpcode),
+                unsafeBool(values[instr.operands[0]]),
+                unsafeBool(values[instr.operands[1]]))));
         break;
-    case Instruction::Mul:
-        result = i0 * i1;
+    case Opcode::ICmp:
+        frame.assign(instr.result,
+                     Integer(interpretIntPredicate(
+                         instr.instr,
+                         static_cast<CmpInst::Predicate>(instr.subOpcode),
+                         values[instr.operands[0]],
+                         values[instr.operands[1]])));
         break;
-    case Instruction::SDiv:
-        result = i0.sdiv(i1);
+    case Opcode::BoolToInt: {
+        int val = unsafeBool(values[instr.operands[0]]) ? 1 : 0;
+        if (bitVect) {
+            frame.assign(instr.result,
+                         Integer(makeBoundedInt(instr.width, val)));
+        } else {
+            frame.assign(instr.result, Integer(mpz_class(val)));
+        }
         break;
-    case Instruction::UDiv:
-        result = i0.udiv(i1);
+    }
+    case Opcode::ZExt:
+        frame.assign(instr.result,
+                     values[instr.operands[0]].zext(instr.width));
         break;
-    case Instruction::SRem:
-        result = i0.srem(i1);
+    case Opcode::SExt:
+        frame.assign(instr.result,
+                     values[instr.operands[0]].sext(instr.width));
         break;
-    case Instruction::URem:
-        result = i0.urem(i1);
+    case Opcode::ZExtOrTrunc:
+        frame.assign(instr.result,
+                     values[instr.operands[0]].zextOrTrunc(instr.width));
         break;
-    case Instruction::Shl:
-        result = i0.shl(i1);
+    case Opcode::GEP: {
+        Integer offset = values[instr.operands[0]];
+        if (instr.gepOffset) {
+            offset += *instr.gepOffset;
+        }
+        for (const auto &index : instr.gepIndices) {
+            offset += index.size * values[index.index].asPointer();
+        }
+        frame.assign(instr.result, std::move(offset));
         break;
-    case Instruction::LShr:
-        result = i0.lshr(i1);
+    }
+    case Opcode::Load: {
+        const Integer &ptr = values[instr.operands[0]];
+        const Heap &heap = frame.getHeap();
+        // This will only insert 0 if there is not already a different element
+        if (bitVect) {
+            unsigned bytes = instr.width / 8;
+            llvm::APInt val = makeBoundedInt(instr.width, 0);
+            for (unsigned i = 0; i < bytes; ++i) {
+                const Integer &byte = frame.load(
+                    ptr.asPointer() + Integer(mpz_class(i)).asPointer(),
+                    Integer(makeBoundedInt(
+                        8, heap.background.asUnbounded().get_si())));
+                assert(byte.type == IntType::Bounded);
+                assert(byte.bounded.getBitWidth() == 8);
+                val = (val << 8) | byte.bounded.sextOrSelf(bytes * 8);
+            }
+            frame.assign(instr.result, Integer(val));
+        } else {
+            Integer val = frame.load(ptr.asPointer(), heap.background);
+            frame.assign(instr.result, std::move(val));
+        }
         break;
-    case Instruction::AShr:
-        result = i0.ashr(i1);
+    }
+    case Opcode::Store: {
+        const HeapAddress &addr = values[instr.operands[0]];
+        const Integer &val = values[instr.operands[1]];
+        if (bitVect) {
+            int bytes = static_cast<int>(instr.width / 8);
+            assert(val.type == IntType::Bounded);
+            llvm::APInt bval = val.bounded;
+            if (bytes == 1) {
+                frame.store(addr, val);
+            } else {
+                for (; bytes >= 0; --bytes) {
+                    llvm::APInt el = bval.trunc(8);
+                    bval = bval.ashr(8);
+                    frame.store(addr + Integer(llvm::APInt(
+                                           64, static_cast<uint64_t>(bytes))),
+                                Integer(el));
+                }
+            }
+        } else {
+            frame.store(addr, val);
+        }
         break;
-    case Instruction::And:
-        result = i0.and_(i1);
+    }
+    case Opcode::Select:
+        if (unsafeBool(values[instr.operands[0]])) {
+            frame.assign(instr.result, values[instr.operands[1]]);
+        } else {
+            frame.assign(instr.result, values[instr.operands[2]]);
+        }
         break;
-    case Instruction::Or:
-        result = i0.or_(i1);
+    case Opcode::Call:
+        // Calls are handled by interpretBlock
         break;
-    case Instruction::Xor:
-        result = i0.xor_(i1);
+    case Opcode::Unsupported:
+        logErrorData(instr.errorMessage, *instr.errorValue);
+        if (instr.fatal) {
+            exit(1);
+        }
         break;
-    default:
-        logErrorData("Unsupported binop:\n", *instr);
-        llvm::errs() << "\n";
     }
-    insertOrReplace(state.variables, {instr, result});
+}
+
+BlockIndex
+BytecodeInterpreter::interpretTerminator(const BytecodeTerminator &terminator,
+                                         const Frame &frame) {
+    if (terminator.unsupportedOperand) {
+        logErrorData("Operators are not yet handled\n",
+                     *terminator.unsupportedOperand);
+        exit(1);
+    }
+    switch (terminator.kind) {
+    case TerminatorKind::Return:
+        return NoBlock;
+    case TerminatorKind::Branch:
+        return terminator.successors[0];
+    case TerminatorKind::CondBranch:
+        if (unsafeBool(frame.values[terminator.value])) {
+            return terminator.successors[0];
+        } else {
+            return terminator.successors[1];
+        }
+    case TerminatorKind::Switch: {
+        const Integer &condVal = frame.values[terminator.value];
+        for (size_t i = 0; i < terminator.caseValues.size(); ++i) {
+            if (frame.values[terminator.caseValues[i]] == condVal) {
+                return terminator.successors[i];
+            }
+        }
+        return terminator.successors.back();
+    }
+    case TerminatorKind::Unsupported:
+        logError("Only return and branches are supported\n");
+        return NoBlock;
+    }
+    return NoBlock;
+}
+
+MonoPair<FastCall>
+interpretFunctionPair(MonoPair<const Function *> funs,
+                      MonoPair<FastVarMap> variables, MonoPair<Heap> heaps,
+                      InterpreterBudget budget,
+                      const AnalysisResultsMap &analysisResults) {
+    return interpretFunctionPair(
+        funs, std::move(variables), std::move(heaps),
+        {&funs.first->getEntryBlock(), &funs.second->getEntryBlock()},
+        budget, analysisResults);
+}
+
+MonoPair<FastCall> interpretFunctionPair(
+    MonoPair<const llvm::Function *> funs, MonoPair<FastVarMap> variables,
+    MonoPair<Heap> heaps, MonoPair<const llvm::BasicBlock *> startBlocks,
+    InterpreterBudget budget, const AnalysisResultsMap &analysisResults) {
+    // Both programs share the lowered functions, each of them has its own
+    // budget
+    BytecodeInterpreter interpreter(analysisResults);
+    return makeMonoPair(
+        interpreter.interpretFunction(
+            *funs.first, FastState(variables.first, heaps.first),
+            startBlocks.first, budget),
+        interpreter.interpretFunction(
+            *funs.second, FastState(variables.second, heaps.second),
+            startBlocks.second, budget));
+}
+
+FastCall interpretFunction(const Function &fun, FastState entry,
+                           const llvm::BasicBlock *startBlock,
+                           InterpreterBudget budget,
+                           const AnalysisResultsMap &analysisResults,
+                           TraceObserver *observer) {
+    return BytecodeInterpreter(analysisResults, observer)
+        .interpretFunction(fun, std::move(entry), startBlock, budget);
+}
+
+FastCall interpretFunction(const Function &fun, FastState entry,
+                           InterpreterBudget budget,
+                           const AnalysisResultsMap &analysisResults,
+                           TraceObserver *observer) {
+    return interpretFunction(fun, entry, &fun.getEntryBlock(), budget,
+                             analysisResults, observer);
+}
+
+struct StepwiseInterpreter::Impl {
+    BytecodeInterpreter interpreter;
+    std::unique_ptr<Execution> execution;
+    explicit Impl(const AnalysisResultsMap &analysisResults)
+        : interpreter(analysisResults) {}
+};
+
+StepwiseInterpreter::StepwiseInterpreter(
+    const Function &fun, const FastState &entry, const BasicBlock *startBlock,
+    InterpreterBudget budget, const AnalysisResultsMap &analysisResults)
+    : impl(std::make_unique<Impl>(analysisResults)) {
+    impl->execution =
+        impl->interpreter.startExecution(fun, entry, startBlock, budget);
+}
+
+StepwiseInterpreter::StepwiseInterpreter(StepwiseInterpreter &&other) =
+    default;
+StepwiseInterpreter::~StepwiseInterpreter() = default;
+
+auto StepwiseInterpreter::next()
+    -> llvm::Optional<BlockStep<const llvm::Value *>> {
+    if (impl->execution->finished()) {
+        return llvm::None;
+    }
+    // Every step gets its own trace so it can be dropped independently
+    return impl->interpreter.step(*impl->execution,
+                                  std::make_shared<FastStateTrace>(), true);
+}
+
+auto StepwiseInterpreter::ranOutOfSteps() const -> bool {
+    return impl->execution->earlyExit;
+}
+
+struct PrefixSharingInterpreter::Impl {
+    struct Snapshot {
+        // The arguments read before the snapshot and their values
+        vector<std::pair<Slot, Integer>> arguments;
+        Heap heap;
+        std::unique_ptr<Execution> execution;
+    };
+    const Function &fun;
+    InterpreterBudget budget;
+    const AnalysisResultsMap &analysisResults;
+    BytecodeInterpreter interpreter;
+    const bool share;
+    // Indexed by the blocks of the lowered function, empty until the first
+    // input has been interpreted
+    vector<bool> marks;
+    // The argument slots read by the phis, instructions and terminator of
+    // each block
+    vector<vector<Slot>> argumentReads;
+    // Ordered by the length of their prefixes, each of them has read more
+    // arguments than the previous one
+    vector<Snapshot> snapshots;
+
+    Impl(const Function &fun, InterpreterBudget budget,
+         const AnalysisResultsMap &analysisResults)
+        : fun(fun), budget(budget), analysisResults(analysisResults),
+          interpreter(analysisResults),
+          share(InterpretSharePrefixesFlag && budget.instructions == 0 &&
+                budget.time.count() == 0) {}
+    void analyze(const BytecodeFunction &code,
+                 const BidirBlockMarkMap &markMap);
+    auto matches(const Snapshot &snapshot, const FastState &entry) const
+        -> bool;
+};
+
+void PrefixSharingInterpreter::Impl::analyze(
+    const BytecodeFunction &code, const BidirBlockMarkMap &markMap) {
+    const interpreter::SlotLayout &layout = code.layout;
+    marks.assign(layout.blockCount(), false);
+    for (const auto &entry : markMap.BlockToMarksMap) {
+        marks[layout.blockIndex(*entry.first)] = true;
+    }
+    argumentReads.resize(code.blocks.size());
+    for (size_t i = 0; i < code.blocks.size(); ++i) {
+        const BytecodeBlock &block = code.blocks[i];
+        vector<Slot> reads;
+        for (const auto &phis : block.phis) {
+            for (const auto &move : phis.moves) {
+                reads.push_back(move.second);
+            }
+        }
+        for (const auto &instr : block.instructions) {
+            reads.insert(reads.end(), instr.operands.begin(),
+                         instr.operands.end());
+            for (const auto &index : instr.gepIndices) {
+                reads.push_back(index.index);
+            }
+        }
+        const BytecodeTerminator &terminator = block.terminator;
+        if (terminator.kind != TerminatorKind::Branch &&
+            terminator.kind != TerminatorKind::Unsupported) {
+            reads.push_back(terminator.value);
+        }
+        reads.insert(reads.end(), terminator.caseValues.begin(),
+                     terminator.caseValues.end());
+        std::sort(reads.begin(), reads.end());
+        reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+        for (Slot slot : reads) {
+            if (slot < layout.variableCount() &&
+                llvm::isa<llvm::Argument>(layout.variable(slot))) {
+                argumentReads[i].push_back(slot);
+            }
+        }
+    }
+}
+
+bool PrefixSharingInterpreter::Impl::matches(const Snapshot &snapshot,
+                                             const FastState &entry) const {
+    const interpreter::SlotLayout &layout = snapshot.execution->code.layout;
+    for (const auto &argument : snapshot.arguments) {
+        auto it = entry.variables.find(layout.variable(argument.first));
+        if (it == entry.variables.end() || !(it->second == argument.second)) {
+            return false;
+        }
+    }
+    return entry.heap == snapshot.heap;
+}
+
+PrefixSharingInterpreter::PrefixSharingInterpreter(
+    const Function &fun, InterpreterBudget budget,
+    const AnalysisResultsMap &analysisResults)
+    : impl(std::make_unique<Impl>(fun, budget, analysisResults)) {}
+
+PrefixSharingInterpreter::~PrefixSharingInterpreter() = default;
+
+auto PrefixSharingInterpreter::interpret(const FastState &entry) -> FastCall {
+    const Function &fun = impl->fun;
+    // Unread arguments are replaced in the snapshots, this requires that
+    // the entry state only consists of the arguments
+    bool onlyArguments = entry.variables.size() == fun.arg_size();
+    for (const auto &arg : fun.args()) {
+        onlyArguments = onlyArguments && entry.variables.count(&arg) > 0;
+    }
+    if (!impl->share || !onlyArguments) {
+        return impl->interpreter.interpretFunction(
+            fun, entry, &fun.getEntryBlock(), impl->budget);
+    }
+    size_t matched = impl->snapshots.size();
+    while (matched > 0 && !impl->matches(impl->snapshots[matched - 1], entry)) {
+        --matched;
+    }
+    std::unique_ptr<Execution> exec;
+    vector<Slot> readArguments;
+    if (matched > 0) {
+        const Impl::Snapshot &snapshot = impl->snapshots[matched - 1];
+        exec = std::make_unique<Execution>(*snapshot.execution);
+        exec->budget = std::make_shared<BudgetTracker>(impl->budget);
+        for (const auto &argument : snapshot.arguments) {
+            readArguments.push_back(argument.first);
+        }
+    } else {
+        exec = impl->interpreter.startExecution(fun, entry,
+                                                &fun.getEntryBlock(),
+                                                impl->budget);
+    }
+    impl->snapshots.erase(impl->snapshots.begin() + matched,
+                          impl->snapshots.end());
+    const interpreter::SlotLayout &layout = exec->code.layout;
+    if (impl->marks.empty()) {
+        impl->analyze(exec->code,
+                      impl->analysisResults.at(&fun).blockMarkMap);
+    }
+    vector<bool> isRead(layout.variableCount(), false);
+    for (Slot slot : readArguments) {
+        isRead[slot] = true;
+    }
+    if (matched > 0) {
+        for (const auto &arg : fun.args()) {
+            const Slot slot = *layout.slot(&arg);
+            if (!isRead[slot]) {
+                exec->frame.assign(slot, entry.variables.find(&arg)->second);
+            }
+        }
+    }
+    auto trace = std::make_shared<FastStateTrace>();
+    vector<BlockStep<const llvm::Value *>> steps;
+    // The trace of a continued snapshot starts with the complete state
+    bool fullState = matched > 0;
+    bool tracking = readArguments.size() < fun.arg_size();
+    do {
+        steps.push_back(impl->interpreter.step(*exec, trace, fullState));
+        fullState = false;
+        if (!tracking) {
+            continue;
+        }
+        for (Slot slot : impl->argumentReads[exec->prevBlock]) {
+            if (!isRead[slot]) {
+                isRead[slot] = true;
+                readArguments.push_back(slot);
+            }
+        }
+        if (readArguments.size() == fun.arg_size()) {
+            tracking = false;
+            continue;
+        }
+        if (exec->finished() || !impl->marks[exec->currentBlock]) {
+            continue;
+        }
+        Impl::Snapshot snapshot;
+        for (Slot slot : readArguments) {
+            snapshot.arguments.push_back(
+                {slot, entry.variables.find(layout.variable(slot))->second});
+        }
+        snapshot.heap = entry.heap;
+        snapshot.execution = std::make_unique<Execution>(*exec);
+        // A longer prefix that reads the same arguments replaces the
+        // shorter one
+        if (!impl->snapshots.empty() &&
+            impl->snapshots.back().arguments.size() == readArguments.size()) {
+            impl->snapshots.back() = std::move(snapshot);
+        } else {
+            impl->snapshots.push_back(std::move(snapshot));
+        }
+    } while (!exec->finished());
+    return FastCall(&fun, entry, exec->frame.toState(), std::move(steps),
+                    exec->earlyExit, exec->blocksVisited);
 }
 
 bool varValEq(const Integer &lhs, const Integer &rhs) { return lhs == rhs; }
@@ -581,14 +1283,21 @@ json stateToJSON(State<T> state, function<string(T)> getName) {
         string varName = getName(var.first);
         jsonVariables.insert({varName, toJSON(var.second)});
     }
-    for (const auto &index : state.heap.assignedValues) {
-        jsonHeap.insert({index.first.get_str(), index.second.get_str()});
-    }
+    state.heap.assignedValues.forEach(
+        [&jsonHeap](const HeapAddress &addr, const Integer &val) {
+            jsonHeap.insert({addr.get_str(), val.get_str()});
+        });
     json j;
     j["variables"] = jsonVariables;
     j["heap"] = jsonHeap;
     j["heapBackground"] = toJSON(state.heap.background);
     return j;
 }
+
+template json stateToJSON<const llvm::Value *>(
+    State<const llvm::Value *> state,
+    function<string(const llvm::Value *)> getName);
+template json stateToJSON<string>(State<string> state,
+                                  function<string(string)> getName);
 }
 }
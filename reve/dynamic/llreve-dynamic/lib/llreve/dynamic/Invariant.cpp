@@ -11,6 +11,7 @@ using std::string;
 using std::make_unique;
 using std::make_shared;
 using std::multiset;
+using std::set;
 
 using llvm::Optional;
 
@@ -25,74 +26,239 @@ static std::unique_ptr<ConstantInt> smtFromMpz(unsigned bitWidth, mpz_class i) {
         llvm::APInt(bitWidth, i.get_str(), 10));
 }
 
+static auto findSolutions(
+    const std::map<ExitIndex, PolynomialEquations> &equationsForMark)
+    -> std::map<ExitIndex, LoopInfoData<Matrix<mpz_class>>> {
+    std::map<ExitIndex, LoopInfoData<Matrix<mpz_class>>> solutions;
+    for (const auto &exitMapIt : equationsForMark) {
+        solutions.insert(
+            {exitMapIt.first,
+             LoopInfoData<Matrix<mpz_class>>(
+                 findSolutions(exitMapIt.second.left),
+                 findSolutions(exitMapIt.second.right),
+                 findSolutions(exitMapIt.second.none))});
+    }
+    return solutions;
+}
+
+size_t MarkDegrees::at(Mark mark) const {
+    auto it = raised.find(mark);
+    return it == raised.end() ? initial : it->second;
+}
+
+bool MarkDegrees::raise(Mark mark) {
+    const size_t degree = at(mark);
+    if (degree >= maximal) {
+        return false;
+    }
+    raised[mark] = degree + 1;
+    return true;
+}
+
+static auto makeIterativeInvariantDefinition(
+    MonoPair<const llvm::Function *> functions, Mark mark,
+    const IterativeInvariantMap<PolynomialEquations> &equations,
+    const HeapPatternCandidatesMap &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree)
+    -> SharedSMTRef {
+    vector<SortedVar> args;
+    for (const auto &var :
+         analysisResults.at(functions.first).freeVariables.at(mark)) {
+        args.push_back(var);
+    }
+    for (const auto &var :
+         analysisResults.at(functions.second).freeVariables.at(mark)) {
+        args.push_back(var);
+    }
+    auto equationsIt = equations.find(mark);
+    vector<SharedSMTRef> exitClauses;
+    if (equationsIt == equations.end()) {
+        exitClauses.push_back(make_unique<ConstantBool>(false));
+    } else {
+        for (auto exitIt : findSolutions(equationsIt->second)) {
+            ExitIndex exit = exitIt.first;
+            const auto freeVariables =
+                getFreeVariablesForMark(functions, mark, analysisResults);
+            SharedSMTRef left = makeInvariantDefinition(
+                exitIt.second.left, patterns.at(mark).at(exit).left,
+                freeVariables, degree);
+            SharedSMTRef right = makeInvariantDefinition(
+                exitIt.second.right, patterns.at(mark).at(exit).right,
+                freeVariables, degree);
+            SharedSMTRef none = makeInvariantDefinition(
+                exitIt.second.none, patterns.at(mark).at(exit).none,
+                freeVariables, degree);
+            if (left == nullptr && right == nullptr && none == nullptr) {
+                continue;
+            }
+            vector<SharedSMTRef> invariantDisjunction;
+            if (left != nullptr) {
+                invariantDisjunction.push_back(left);
+            }
+            if (right != nullptr) {
+                invariantDisjunction.push_back(right);
+            }
+            if (none != nullptr) {
+                invariantDisjunction.push_back(none);
+            }
+            SharedSMTRef invariant =
+                make_shared<Op>("or", invariantDisjunction);
+            exitClauses.push_back(invariant);
+        }
+    }
+    string invariantName = "INV_MAIN_" + mark.toString();
+    if (ImplicationsFlag) {
+        invariantName += "_INFERRED";
+    }
+    SMTRef body;
+    if (exitClauses.empty()) {
+        body = make_unique<ConstantBool>(true);
+    } else {
+        body = make_unique<Op>("or", exitClauses);
+    }
+    return make_shared<FunDef>(invariantName, args, boolType(),
+                               std::move(body));
+}
+
+// The marks are independent so the null spaces and definitions are computed
+// in parallel, every task writes to its own slot
+static void buildIterativeInvariantDefinitions(
+    map<Mark, SharedSMTRef> &definitions, const vector<Mark> &marks,
+    MonoPair<const llvm::Function *> functions,
+    const IterativeInvariantMap<PolynomialEquations> &equations,
+    const HeapPatternCandidatesMap &patterns,
+    const AnalysisResultsMap &analysisResults, const MarkDegrees &degrees) {
+    vector<SharedSMTRef> results(marks.size());
+    vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < marks.size(); ++i) {
+        tasks.push_back([&, i] {
+            results[i] = makeIterativeInvariantDefinition(
+                functions, marks[i], equations, patterns, analysisResults,
+                degrees.at(marks[i]));
+        });
+    }
+    runInParallel(tasks, SMTGenerationOpts::getInstance().Jobs);
+    for (size_t i = 0; i < marks.size(); ++i) {
+        definitions[marks[i]] = std::move(results[i]);
+    }
+}
+
 map<Mark, SharedSMTRef> makeIterativeInvariantDefinitions(
     MonoPair<const llvm::Function *> functions,
     const IterativeInvariantMap<PolynomialEquations> &equations,
     const HeapPatternCandidatesMap &patterns,
-    const AnalysisResultsMap &analysisResults, size_t degree) {
-    const auto solutions = findSolutions(equations);
+    const AnalysisResultsMap &analysisResults, const MarkDegrees &degrees) {
+    vector<Mark> marks;
+    for (const auto &mapIt :
+         analysisResults.at(functions.first).freeVariables) {
+        marks.push_back(mapIt.first);
+    }
     map<Mark, SharedSMTRef> definitions;
-    for (auto mapIt : analysisResults.at(functions.first).freeVariables) {
-        Mark mark = mapIt.first;
-        vector<SortedVar> args;
-        for (const auto &var :
-             analysisResults.at(functions.first).freeVariables.at(mark)) {
-            args.push_back(var);
-        }
-        for (const auto &var :
-             analysisResults.at(functions.second).freeVariables.at(mark)) {
-            args.push_back(var);
+    buildIterativeInvariantDefinitions(definitions, marks, functions,
+                                       equations, patterns, analysisResults,
+                                       degrees);
+    return definitions;
+}
+
+void updateIterativeInvariantDefinitions(
+    map<Mark, SharedSMTRef> &definitions, const set<Mark> &changedMarks,
+    MonoPair<const llvm::Function *> functions,
+    const IterativeInvariantMap<PolynomialEquations> &equations,
+    const HeapPatternCandidatesMap &patterns,
+    const AnalysisResultsMap &analysisResults, const MarkDegrees &degrees) {
+    vector<Mark> marks;
+    for (Mark mark : changedMarks) {
+        if (definitions.count(mark) > 0) {
+            marks.push_back(mark);
         }
-        auto solutionsMapIt = solutions.find(mark);
-        vector<SharedSMTRef> exitClauses;
-        if (solutionsMapIt == solutions.end()) {
-            exitClauses.push_back(make_unique<ConstantBool>(false));
-        } else {
-            for (auto exitIt : solutionsMapIt->second) {
-                ExitIndex exit = exitIt.first;
-                const auto freeVariables =
-                    getFreeVariablesForMark(functions, mark, analysisResults);
-                SharedSMTRef left = makeInvariantDefinition(
-                    exitIt.second.left, patterns.at(mark).at(exit).left,
-                    freeVariables, degree);
-                SharedSMTRef right = makeInvariantDefinition(
-                    exitIt.second.right, patterns.at(mark).at(exit).right,
-                    freeVariables, degree);
-                SharedSMTRef none = makeInvariantDefinition(
-                    exitIt.second.none, patterns.at(mark).at(exit).none,
-                    freeVariables, degree);
-                if (left == nullptr && right == nullptr && none == nullptr) {
-                    continue;
-                }
-                vector<SharedSMTRef> invariantDisjunction;
-                if (left != nullptr) {
-                    invariantDisjunction.push_back(left);
-                }
-                if (right != nullptr) {
-                    invariantDisjunction.push_back(right);
-                }
-                if (none != nullptr) {
-                    invariantDisjunction.push_back(none);
-                }
-                SharedSMTRef invariant =
-                    make_shared<Op>("or", invariantDisjunction);
-                exitClauses.push_back(invariant);
+    }
+    buildIterativeInvariantDefinitions(definitions, marks, functions,
+                                       equations, patterns, analysisResults,
+                                       degrees);
+}
+
+static auto makeRelationalFunctionInvariantDefinition(
+    MonoPair<const llvm::Function *> coupledFunctions, Mark mark,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>> &equations,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
+        &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree)
+    -> FunctionInvariant<SharedSMTRef> {
+    const AnalysisResults &analysisResults1 =
+        analysisResults.at(coupledFunctions.first);
+    const AnalysisResults &analysisResults2 =
+        analysisResults.at(coupledFunctions.second);
+    vector<SortedVar> invariantArgsPost;
+    vector<SortedVar> invariantArgsPre;
+    invariantArgsPost.insert(invariantArgsPost.end(),
+                             analysisResults1.freeVariables.at(mark).begin(),
+                             analysisResults1.freeVariables.at(mark).end());
+    invariantArgsPost.insert(invariantArgsPost.end(),
+                             analysisResults2.freeVariables.at(mark).begin(),
+                             analysisResults2.freeVariables.at(mark).end());
+    invariantArgsPre = invariantArgsPost;
+    invariantArgsPost.push_back({resultName(Program::First), int64Type()});
+    invariantArgsPost.push_back({resultName(Program::Second), int64Type()});
+    string preName =
+        invariantName(mark, ProgramSelection::Both,
+                      getFunctionName(coupledFunctions), InvariantAttr::PRE);
+    string postName = invariantName(mark, ProgramSelection::Both,
+                                    getFunctionName(coupledFunctions));
+    SharedSMTRef preInvBody = make_unique<ConstantBool>(false);
+    SharedSMTRef postInvBody = make_unique<ConstantBool>(false);
+    auto equationsIt = equations.find(coupledFunctions);
+    if (equationsIt != equations.end()) {
+        auto markIt = equationsIt->second.find(mark);
+        if (markIt != equationsIt->second.end()) {
+            const auto &patternsForMark =
+                patterns.at(coupledFunctions).at(mark).none.getValue();
+            // TODO this needs to handle the optional properly
+            preInvBody = makeInvariantDefinition(
+                findSolutions(markIt->second.none.preCondition),
+                patternsForMark.preCondition, invariantArgsPre, degree);
+            if (preInvBody == nullptr) {
+                preInvBody = make_unique<ConstantBool>(true);
+            }
+            postInvBody = makeInvariantDefinition(
+                findSolutions(markIt->second.none.postCondition),
+                patternsForMark.postCondition, invariantArgsPost, degree);
+            if (postInvBody == nullptr) {
+                postInvBody = make_unique<ConstantBool>(true);
             }
         }
-        string invariantName = "INV_MAIN_" + mark.toString();
-        if (ImplicationsFlag) {
-            invariantName += "_INFERRED";
-        }
-        SMTRef body;
-        if (exitClauses.empty()) {
-            body = make_unique<ConstantBool>(true);
-        } else {
-            body = make_unique<Op>("or", exitClauses);
-        }
-        definitions[mark] = make_shared<FunDef>(invariantName, args, boolType(),
-                                                std::move(body));
     }
-    return definitions;
+    auto preInv =
+        make_shared<FunDef>(preName, invariantArgsPre, boolType(), preInvBody);
+    auto postInv = make_shared<FunDef>(postName, invariantArgsPost,
+                                       boolType(), postInvBody);
+    return {preInv, postInv};
+}
+
+static void buildRelationalFunctionInvariantDefinitions(
+    RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
+        &definitions,
+    const vector<std::pair<MonoPair<const llvm::Function *>, Mark>> &work,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>> &equations,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
+        &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree) {
+    vector<FunctionInvariant<SharedSMTRef>> results(work.size());
+    vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < work.size(); ++i) {
+        tasks.push_back([&, i] {
+            results[i] = makeRelationalFunctionInvariantDefinition(
+                work[i].first, work[i].second, equations, patterns,
+                analysisResults, degree);
+        });
+    }
+    runInParallel(tasks, SMTGenerationOpts::getInstance().Jobs);
+    for (size_t i = 0; i < work.size(); ++i) {
+        definitions[work[i].first][work[i].second] = std::move(results[i]);
+    }
 }
 
 RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
@@ -103,77 +269,49 @@ makeRelationalFunctionInvariantDefinitions(
         LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
         &patterns,
     const AnalysisResultsMap &analysisResults, size_t degree) {
-    RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
-        definitions;
+    vector<std::pair<MonoPair<const llvm::Function *>, Mark>> work;
     for (const auto &coupledFunctions :
          SMTGenerationOpts::getInstance().CoupledFunctions) {
         // Taking the intersection of the freevars maps would be the correct
         // thing to do here but defining too many functions does no harm and
         // intersecting maps is a pain in the ass in c++
-        for (const auto mapIt :
+        for (const auto &mapIt :
              analysisResults.at(coupledFunctions.first).freeVariables) {
-            const AnalysisResults &analysisResults1 =
-                analysisResults.at(coupledFunctions.first);
-            const AnalysisResults &analysisResults2 =
-                analysisResults.at(coupledFunctions.second);
-            Mark mark = mapIt.first;
-            if (!mark.hasInvariant()) {
-                continue;
-            }
-            vector<SortedVar> invariantArgsPost;
-            vector<SortedVar> invariantArgsPre;
-            invariantArgsPost.insert(
-                invariantArgsPost.end(),
-                analysisResults1.freeVariables.at(mark).begin(),
-                analysisResults1.freeVariables.at(mark).end());
-            invariantArgsPost.insert(
-                invariantArgsPost.end(),
-                analysisResults2.freeVariables.at(mark).begin(),
-                analysisResults2.freeVariables.at(mark).end());
-            invariantArgsPre = invariantArgsPost;
-            invariantArgsPost.push_back(
-                {resultName(Program::First), int64Type()});
-            invariantArgsPost.push_back(
-                {resultName(Program::Second), int64Type()});
-            string preName = invariantName(mark, ProgramSelection::Both,
-                                           getFunctionName(coupledFunctions),
-                                           InvariantAttr::PRE);
-            string postName = invariantName(mark, ProgramSelection::Both,
-                                            getFunctionName(coupledFunctions));
-            SharedSMTRef preInvBody = make_unique<ConstantBool>(false);
-            SharedSMTRef postInvBody = make_unique<ConstantBool>(false);
-            auto equationsIt = equations.find(coupledFunctions);
-            if (equationsIt != equations.end()) {
-                auto markIt = equationsIt->second.find(mark);
-                if (markIt != equationsIt->second.end()) {
-                    const auto &patternsForMark =
-                        patterns.at(coupledFunctions).at(mark).none.getValue();
-                    // TODO this needs to handle the optional properly
-                    preInvBody = makeInvariantDefinition(
-                        findSolutions(markIt->second.none.preCondition),
-                        patternsForMark.preCondition, invariantArgsPre, degree);
-                    if (preInvBody == nullptr) {
-                        preInvBody = make_unique<ConstantBool>(true);
-                    }
-                    postInvBody = makeInvariantDefinition(
-                        findSolutions(markIt->second.none.postCondition),
-                        patternsForMark.postCondition, invariantArgsPost,
-                        degree);
-                    if (postInvBody == nullptr) {
-                        postInvBody = make_unique<ConstantBool>(true);
-                    }
-                }
+            if (mapIt.first.hasInvariant()) {
+                work.push_back({coupledFunctions, mapIt.first});
             }
-            auto preInv = make_shared<FunDef>(preName, invariantArgsPre,
-                                              boolType(), preInvBody);
-            auto postInv = make_shared<FunDef>(postName, invariantArgsPost,
-                                               boolType(), postInvBody);
-            definitions[coupledFunctions].insert({mark, {preInv, postInv}});
         }
     }
+    RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
+        definitions;
+    buildRelationalFunctionInvariantDefinitions(
+        definitions, work, equations, patterns, analysisResults, degree);
     return definitions;
 }
 
+void updateRelationalFunctionInvariantDefinitions(
+    RelationalFunctionInvariantMap<FunctionInvariant<smt::SharedSMTRef>>
+        &definitions,
+    const set<std::pair<MonoPair<const llvm::Function *>, Mark>>
+        &changedInvariants,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>> &equations,
+    const RelationalFunctionInvariantMap<
+        LoopInfoData<llvm::Optional<FunctionInvariant<HeapPatternCandidates>>>>
+        &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree) {
+    vector<std::pair<MonoPair<const llvm::Function *>, Mark>> work;
+    for (const auto &invariant : changedInvariants) {
+        auto functionsIt = definitions.find(invariant.first);
+        if (functionsIt != definitions.end() &&
+            functionsIt->second.count(invariant.second) > 0) {
+            work.push_back(invariant);
+        }
+    }
+    buildRelationalFunctionInvariantDefinitions(
+        definitions, work, equations, patterns, analysisResults, degree);
+}
+
 FunctionInvariantMap<smt::SharedSMTRef> makeFunctionInvariantDefinitions(
     MonoPair<const llvm::Module &> modules,
     const FunctionInvariantMap<Matrix<mpq_class>> &equations,
@@ -189,65 +327,128 @@ FunctionInvariantMap<smt::SharedSMTRef> makeFunctionInvariantDefinitions(
     return invariants;
 }
 
+static auto makeFunctionInvariantDefinition(
+    const llvm::Function &function, Mark mark,
+    const vector<SortedVar> &freeVariables,
+    const FunctionInvariantMap<Matrix<mpq_class>> &equations,
+    const FunctionInvariantMap<HeapPatternCandidates> &patterns, Program prog,
+    size_t degree) -> FunctionInvariant<SharedSMTRef> {
+    vector<SortedVar> invariantArgsPost;
+    vector<SortedVar> invariantArgsPre;
+    invariantArgsPost.insert(invariantArgsPost.end(), freeVariables.begin(),
+                             freeVariables.end());
+    invariantArgsPre = invariantArgsPost;
+    invariantArgsPost.push_back({resultName(prog), int64Type()});
+    string preName = invariantName(mark, asSelection(prog), function.getName(),
+                                   InvariantAttr::PRE);
+    string postName =
+        invariantName(mark, asSelection(prog), function.getName());
+    SharedSMTRef preCondition = make_unique<ConstantBool>(false);
+    SharedSMTRef postCondition = make_unique<ConstantBool>(false);
+    auto functionIt = equations.find(&function);
+    if (functionIt != equations.end()) {
+        auto markIt = functionIt->second.find(mark);
+        if (markIt != functionIt->second.end()) {
+            preCondition = makeInvariantDefinition(
+                findSolutions(markIt->second.preCondition),
+                patterns.at(&function).at(mark).preCondition,
+                invariantArgsPre, degree);
+            postCondition = makeInvariantDefinition(
+                findSolutions(markIt->second.postCondition),
+                patterns.at(&function).at(mark).postCondition,
+                invariantArgsPost, degree);
+            if (preCondition == nullptr) {
+                preCondition = make_unique<ConstantBool>(true);
+            }
+            if (postCondition == nullptr) {
+                postCondition = make_unique<ConstantBool>(true);
+            }
+        }
+    }
+    auto preConditionDef = make_unique<FunDef>(preName, invariantArgsPre,
+                                               boolType(), preCondition);
+    auto postConditionDef = make_unique<FunDef>(postName, invariantArgsPost,
+                                                boolType(), postCondition);
+    return {std::move(preConditionDef), std::move(postConditionDef)};
+}
+
+namespace {
+struct FunctionInvariantWork {
+    const llvm::Function *function;
+    Mark mark;
+    Program prog;
+};
+}
+
+static void buildFunctionInvariantDefinitions(
+    FunctionInvariantMap<smt::SharedSMTRef> &definitions,
+    const vector<FunctionInvariantWork> &work,
+    const FunctionInvariantMap<Matrix<mpq_class>> &equations,
+    const FunctionInvariantMap<HeapPatternCandidates> &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree) {
+    vector<FunctionInvariant<SharedSMTRef>> results(work.size());
+    vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < work.size(); ++i) {
+        tasks.push_back([&, i] {
+            const llvm::Function &function = *work[i].function;
+            results[i] = makeFunctionInvariantDefinition(
+                function, work[i].mark,
+                analysisResults.at(&function).freeVariables.at(work[i].mark),
+                equations, patterns, work[i].prog, degree);
+        });
+    }
+    runInParallel(tasks, SMTGenerationOpts::getInstance().Jobs);
+    for (size_t i = 0; i < work.size(); ++i) {
+        definitions[work[i].function][work[i].mark] = std::move(results[i]);
+    }
+}
+
 FunctionInvariantMap<smt::SharedSMTRef> makeFunctionInvariantDefinitions(
     const llvm::Module &module,
     const FunctionInvariantMap<Matrix<mpq_class>> &equations,
     const FunctionInvariantMap<HeapPatternCandidates> &patterns,
     const AnalysisResultsMap &analysisResults, Program prog, size_t degree) {
-    FunctionInvariantMap<smt::SharedSMTRef> definitions;
+    vector<FunctionInvariantWork> work;
     for (const auto &function : module) {
         if (hasFixedAbstraction(function)) {
             continue;
         }
-        for (const auto mapIt : analysisResults.at(&function).freeVariables) {
-            const Mark mark = mapIt.first;
-            if (!mark.hasInvariant()) {
-                continue;
+        for (const auto &mapIt :
+             analysisResults.at(&function).freeVariables) {
+            if (mapIt.first.hasInvariant()) {
+                work.push_back({&function, mapIt.first, prog});
             }
-            vector<SortedVar> invariantArgsPost;
-            vector<SortedVar> invariantArgsPre;
-            invariantArgsPost.insert(invariantArgsPost.end(),
-                                     mapIt.second.begin(), mapIt.second.end());
-            invariantArgsPre = invariantArgsPost;
-            invariantArgsPost.push_back({resultName(prog), int64Type()});
-            string preName =
-                invariantName(mark, asSelection(prog), function.getName(),
-                              InvariantAttr::PRE);
-            string postName =
-                invariantName(mark, asSelection(prog), function.getName());
-            SharedSMTRef preCondition = make_unique<ConstantBool>(false);
-            SharedSMTRef postCondition = make_unique<ConstantBool>(false);
-            nestedLookup(equations, &function, mark,
-                         [&](auto mapIt) {
-                             preCondition = makeInvariantDefinition(
-                                 findSolutions(mapIt->second.preCondition),
-                                 patterns.at(&function).at(mark).preCondition,
-                                 invariantArgsPre, degree);
-                             postCondition = makeInvariantDefinition(
-                                 findSolutions(mapIt->second.postCondition),
-                                 patterns.at(&function).at(mark).postCondition,
-                                 invariantArgsPost, degree);
-                             if (preCondition == nullptr) {
-                                 preCondition = make_unique<ConstantBool>(true);
-                             }
-                             if (postCondition == nullptr) {
-                                 postCondition =
-                                     make_unique<ConstantBool>(true);
-                             }
-                         },
-                         [] {});
-            auto preConditionDef = make_unique<FunDef>(
-                preName, invariantArgsPre, boolType(), preCondition);
-            auto postConditionDef = make_unique<FunDef>(
-                postName, invariantArgsPost, boolType(), postCondition);
-            definitions[&function].insert(
-                {mark,
-                 {std::move(preConditionDef), std::move(postConditionDef)}});
         }
     }
+    FunctionInvariantMap<smt::SharedSMTRef> definitions;
+    buildFunctionInvariantDefinitions(definitions, work, equations, patterns,
+                                      analysisResults, degree);
     return definitions;
 }
 
+void updateFunctionInvariantDefinitions(
+    FunctionInvariantMap<smt::SharedSMTRef> &definitions,
+    const set<std::pair<const llvm::Function *, Mark>> &changedInvariants,
+    MonoPair<const llvm::Module &> modules,
+    const FunctionInvariantMap<Matrix<mpq_class>> &equations,
+    const FunctionInvariantMap<HeapPatternCandidates> &patterns,
+    const AnalysisResultsMap &analysisResults, size_t degree) {
+    vector<FunctionInvariantWork> work;
+    for (const auto &invariant : changedInvariants) {
+        auto functionIt = definitions.find(invariant.first);
+        if (functionIt == definitions.end() ||
+            functionIt->second.count(invariant.second) == 0) {
+            continue;
+        }
+        Program prog = invariant.first->getParent() == &modules.first
+                           ? Program::First
+                           : Program::Second;
+        work.push_back({invariant.first, invariant.second, prog});
+    }
+    buildFunctionInvariantDefinitions(definitions, work, equations, patterns,
+                                      analysisResults, degree);
+}
+
 SharedSMTRef
 makeBoundsDefinitions(const map<string, Bound<Optional<Integer>>> &bounds) {
     vector<SharedSMTRef> constraints;
@@ -303,20 +504,22 @@ SharedSMTRef makeEquation(const vector<mpz_class> &eq,
     vector<SharedSMTRef> right;
     vector<SharedSMTRef> polynomialTerms;
     for (size_t i = 1; i <= degree; ++i) {
-        auto kCombinations = polynomialTermsOfDegree(freeVars, i);
-        for (auto vec : kCombinations) {
-            multiset<string> vars;
-            vars.insert(vec.begin(), vec.end());
-            vector<SharedSMTRef> args;
-            for (auto var : vars) {
-                args.push_back(smt::stringExpr(var));
-            }
-            if (args.size() == 1) {
-                polynomialTerms.push_back(args.front());
-            } else {
-                polynomialTerms.push_back(make_shared<Op>("*", args));
-            }
-        }
+        forEachPolynomialTerm(
+            freeVars.size(), i, [&](llvm::ArrayRef<size_t> indices) {
+                multiset<string> vars;
+                for (size_t index : indices) {
+                    vars.insert(freeVars[index].name);
+                }
+                vector<SharedSMTRef> args;
+                for (const auto &var : vars) {
+                    args.push_back(smt::stringExpr(var));
+                }
+                if (args.size() == 1) {
+                    polynomialTerms.push_back(args.front());
+                } else {
+                    polynomialTerms.push_back(make_shared<Op>("*", args));
+                }
+            });
     }
     assert(polynomialTerms.size() + 1 == eq.size());
     for (size_t i = 0; i < polynomialTerms.size(); ++i) {
@@ -371,27 +574,16 @@ SharedSMTRef makeEquation(const vector<mpz_class> &eq,
     return makeOp("=", leftSide, rightSide);
 }
 
-Matrix<mpz_class> findSolutions(Matrix<mpq_class> equations) {
-    Matrix<mpq_class> solution = nullSpace(equations);
-    Matrix<mpz_class> integerSolution(solution.size());
-    for (size_t i = 0; i < solution.size(); ++i) {
-        integerSolution.at(i) = ratToInt(solution.at(i));
-    }
-    return integerSolution;
+Matrix<mpz_class> findSolutions(const Matrix<mpq_class> &equations) {
+    // populateEquationsMap keeps the equations in reduced row echelon form so
+    // this does not need to eliminate them again
+    return integerNullSpace(equations);
 }
 PolynomialSolutions findSolutions(
     const IterativeInvariantMap<PolynomialEquations> &polynomialEquations) {
     PolynomialSolutions map;
-    for (auto eqMapIt : polynomialEquations) {
-        Mark mark = eqMapIt.first;
-        for (auto exitMapIt : eqMapIt.second) {
-            ExitIndex exitIndex = exitMapIt.first;
-            LoopInfoData<Matrix<mpz_class>> n = {
-                findSolutions(exitMapIt.second.left),
-                findSolutions(exitMapIt.second.right),
-                findSolutions(exitMapIt.second.none)};
-            map[mark].insert(make_pair(exitMapIt.first, n));
-        }
+    for (const auto &eqMapIt : polynomialEquations) {
+        map[eqMapIt.first] = findSolutions(eqMapIt.second);
     }
     return map;
 }
@@ -0,0 +1,428 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/JIT.h"
+
+#include "Helper.h"
+#include "MarkAnalysis.h"
+#include "Opts.h"
+
+#include <limits>
+#include <mutex>
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using llvm::BasicBlock;
+using llvm::Function;
+using llvm::Instruction;
+using llvm::IRBuilder;
+using llvm::Value;
+using llvm::cast;
+using llvm::dyn_cast;
+
+using std::string;
+using std::vector;
+
+using namespace llreve::opts;
+
+namespace llreve {
+namespace dynamic {
+
+static const char *const RecordMarkName = "__llreve_record_mark";
+static const char *const EntryName = "__llreve_entry";
+
+// The values that are reported when a mark block is entered
+struct MarkBlock {
+    BlockName name;
+    vector<const Value *> values;
+    vector<unsigned> widths;
+};
+
+struct JITTraceCollector::Impl {
+    using ObjectLayer = llvm::orc::ObjectLinkingLayer<>;
+    using CompileLayer = llvm::orc::IRCompileLayer<ObjectLayer>;
+    using EntryFunction = int64_t (*)(const int64_t *);
+
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    const llvm::DataLayout dataLayout;
+    ObjectLayer objectLayer;
+    CompileLayer compileLayer;
+
+    const Function &function;
+    const Value *returnInstruction;
+    // 0 for functions that do not return a value
+    unsigned returnWidth = 0;
+    vector<MarkBlock> markBlocks;
+    EntryFunction entry = nullptr;
+
+    Impl(const Function &function, const Value *returnInstruction)
+        : targetMachine(llvm::EngineBuilder().selectTarget()),
+          dataLayout(targetMachine->createDataLayout()),
+          compileLayer(objectLayer, llvm::orc::SimpleCompiler(*targetMachine)),
+          function(function), returnInstruction(returnInstruction) {}
+
+    auto mangle(const string &name) const -> string {
+        string mangled;
+        llvm::raw_string_ostream stream(mangled);
+        llvm::Mangler::getNameWithPrefix(stream, name, dataLayout);
+        return stream.str();
+    }
+    auto compile(std::unique_ptr<llvm::Module> module) -> bool;
+};
+
+namespace {
+// The marks recorded by the function that is currently run on this thread
+struct Recording {
+    const JITTraceCollector::Impl &impl;
+    vector<std::pair<uint32_t, vector<int64_t>>> marks;
+    uint32_t maxMarks;
+    bool earlyExit = false;
+    Recording(const JITTraceCollector::Impl &impl, uint32_t maxMarks)
+        : impl(impl), maxMarks(maxMarks) {}
+};
+}
+
+static thread_local Recording *currentRecording = nullptr;
+
+// Called by the instrumented code, a nonzero result makes the function return
+// immediately
+static int32_t recordMark(uint32_t block, const int64_t *values) {
+    Recording &recording = *currentRecording;
+    if (recording.marks.size() >= recording.maxMarks) {
+        recording.earlyExit = true;
+        return 1;
+    }
+    size_t numValues = recording.impl.markBlocks[block].values.size();
+    recording.marks.push_back(
+        {block, vector<int64_t>(values, values + numValues)});
+    return 0;
+}
+
+static auto supportedIntegerType(const llvm::Type *type) -> bool {
+    return type->isIntegerTy() && type->getIntegerBitWidth() <= 64;
+}
+
+static void initializeNativeTarget() {
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+        llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    });
+}
+
+// The marks have already been used by the analyses and cannot be called
+static void removeIntrinsicCalls(llvm::Module &module) {
+    for (auto &fun : module) {
+        vector<Instruction *> calls;
+        for (auto &bb : fun) {
+            for (auto &instr : bb) {
+                if (const auto call = dyn_cast<llvm::CallInst>(&instr)) {
+                    if (call->getCalledFunction() &&
+                        isLlreveIntrinsic(*call->getCalledFunction())) {
+                        calls.push_back(call);
+                    }
+                }
+            }
+        }
+        for (auto call : calls) {
+            if (!call->getType()->isVoidTy()) {
+                call->replaceAllUsesWith(
+                    llvm::Constant::getNullValue(call->getType()));
+            }
+            call->eraseFromParent();
+        }
+    }
+}
+
+// Reports the values in 'markBlock.values' at the start of 'block' and
+// returns early if the recording asks for it
+static void instrumentMarkBlock(BasicBlock *block, uint32_t index,
+                                const vector<Value *> &values,
+                                llvm::AllocaInst *buffer,
+                                Function *recordMarkFun,
+                                BasicBlock *abortBlock) {
+    auto &cxt = block->getContext();
+    Instruction *insertPoint = &*block->getFirstInsertionPt();
+    IRBuilder<> builder(insertPoint);
+    auto int64Ty = llvm::Type::getInt64Ty(cxt);
+    for (uint32_t i = 0; i < values.size(); ++i) {
+        builder.CreateStore(
+            builder.CreateZExtOrTrunc(values[i], int64Ty),
+            builder.CreateConstInBoundsGEP2_32(buffer->getAllocatedType(),
+                                               buffer, 0, i));
+    }
+    auto stop = builder.CreateCall(
+        recordMarkFun,
+        {builder.getInt32(index),
+         builder.CreateConstInBoundsGEP2_32(buffer->getAllocatedType(), buffer,
+                                            0, 0)});
+    BasicBlock *rest = block->splitBasicBlock(insertPoint);
+    block->getTerminator()->eraseFromParent();
+    builder.SetInsertPoint(block);
+    builder.CreateCondBr(builder.CreateICmpNE(stop, builder.getInt32(0)),
+                         abortBlock, rest);
+}
+
+// Calls 'fun' with the arguments read from an array of 64 bit integers and
+// returns the result as a 64 bit integer
+static void createEntryFunction(llvm::Module &module, Function &fun) {
+    auto &cxt = module.getContext();
+    auto int64Ty = llvm::Type::getInt64Ty(cxt);
+    auto entry = Function::Create(
+        llvm::FunctionType::get(int64Ty, {int64Ty->getPointerTo()}, false),
+        Function::ExternalLinkage, EntryName, &module);
+    IRBuilder<> builder(BasicBlock::Create(cxt, "entry", entry));
+    Value *argArray = &*entry->arg_begin();
+    vector<Value *> args;
+    for (const auto &arg : fun.args()) {
+        Value *argPtr =
+            builder.CreateConstInBoundsGEP1_32(int64Ty, argArray, arg.getArgNo());
+        args.push_back(builder.CreateZExtOrTrunc(builder.CreateLoad(argPtr),
+                                                 arg.getType()));
+    }
+    Value *result = builder.CreateCall(&fun, args);
+    if (fun.getReturnType()->isVoidTy()) {
+        builder.CreateRet(builder.getInt64(0));
+    } else {
+        builder.CreateRet(builder.CreateZExtOrTrunc(result, int64Ty));
+    }
+}
+
+auto JITTraceCollector::Impl::compile(std::unique_ptr<llvm::Module> module)
+    -> bool {
+    module->setDataLayout(dataLayout);
+    const string recordMarkName = mangle(RecordMarkName);
+    auto resolver = llvm::orc::createLambdaResolver(
+        [this](const string &name) {
+            if (auto sym = compileLayer.findSymbol(name, false)) {
+                return sym;
+            }
+            return llvm::JITSymbol(nullptr);
+        },
+        [recordMarkName](const string &name) {
+            if (name == recordMarkName) {
+                return llvm::JITSymbol(
+                    reinterpret_cast<llvm::JITTargetAddress>(&recordMark),
+                    llvm::JITSymbolFlags::Exported);
+            }
+            if (auto addr =
+                    llvm::RTDyldMemoryManager::getSymbolAddressInProcess(
+                        name)) {
+                return llvm::JITSymbol(addr, llvm::JITSymbolFlags::Exported);
+            }
+            return llvm::JITSymbol(nullptr);
+        });
+    vector<std::unique_ptr<llvm::Module>> modules;
+    modules.push_back(std::move(module));
+    compileLayer.addModuleSet(std::move(modules),
+                              std::make_unique<llvm::SectionMemoryManager>(),
+                              std::move(resolver));
+    auto sym = compileLayer.findSymbol(mangle(EntryName), true);
+    if (!sym) {
+        return false;
+    }
+    entry = reinterpret_cast<EntryFunction>(
+        static_cast<uintptr_t>(sym.getAddress()));
+    return entry != nullptr;
+}
+
+auto JITTraceCollector::create(const Function &fun,
+                               const AnalysisResultsMap &analysisResults)
+    -> std::unique_ptr<JITTraceCollector> {
+    if (!SMTGenerationOpts::getInstance().BitVect) {
+        logError("Native trace collection requires bitvectors\n");
+        return nullptr;
+    }
+    for (const auto &arg : fun.args()) {
+        if (!supportedIntegerType(arg.getType())) {
+            logError("Cannot run " + fun.getName().str() +
+                     " natively, only integer arguments are supported\n");
+            return nullptr;
+        }
+    }
+    if (!fun.getReturnType()->isVoidTy() &&
+        !supportedIntegerType(fun.getReturnType())) {
+        logError("Cannot run " + fun.getName().str() +
+                 " natively, only integer return values are supported\n");
+        return nullptr;
+    }
+    initializeNativeTarget();
+    const AnalysisResults &results = analysisResults.at(&fun);
+    auto impl = std::make_unique<Impl>(fun, results.returnInstruction);
+    if (!fun.getReturnType()->isVoidTy()) {
+        impl->returnWidth = fun.getReturnType()->getIntegerBitWidth();
+    }
+
+    llvm::ValueToValueMapTy valueMap;
+    std::unique_ptr<llvm::Module> module =
+        llvm::CloneModule(fun.getParent(), valueMap);
+    Function *clone = cast<Function>(valueMap[&fun]);
+    removeIntrinsicCalls(*module);
+
+    // Pairs of original and cloned values that can be reported
+    vector<std::pair<const Value *, Value *>> candidates;
+    for (const auto &arg : fun.args()) {
+        candidates.push_back({&arg, valueMap[&arg]});
+    }
+    for (const auto &bb : fun) {
+        for (const auto &instr : bb) {
+            if (supportedIntegerType(instr.getType())) {
+                candidates.push_back({&instr, valueMap[&instr]});
+            }
+        }
+    }
+
+    // Only values that dominate the start of a mark block are available there
+    llvm::DominatorTree domTree(*clone);
+    vector<std::pair<BasicBlock *, vector<Value *>>> instrumentedBlocks;
+    size_t maxValues = 1;
+    for (const auto &blockMarks : results.blockMarkMap.BlockToMarksMap) {
+        if (blockMarks.second.count(ENTRY_MARK)) {
+            continue;
+        }
+        auto block = cast<BasicBlock>(valueMap[blockMarks.first]);
+        const Instruction *start = &*block->getFirstInsertionPt();
+        MarkBlock markBlock;
+        markBlock.name = blockMarks.first->getName();
+        vector<Value *> values;
+        for (const auto &candidate : candidates) {
+            const auto instr = dyn_cast<Instruction>(candidate.second);
+            if (instr && (!domTree.isReachableFromEntry(instr->getParent()) ||
+                          !domTree.dominates(instr, start))) {
+                continue;
+            }
+            markBlock.values.push_back(candidate.first);
+            markBlock.widths.push_back(
+                candidate.second->getType()->getIntegerBitWidth());
+            values.push_back(candidate.second);
+        }
+        maxValues = std::max(maxValues, values.size());
+        impl->markBlocks.push_back(std::move(markBlock));
+        instrumentedBlocks.push_back({block, std::move(values)});
+    }
+
+    auto &cxt = module->getContext();
+    auto recordMarkFun = Function::Create(
+        llvm::FunctionType::get(
+            llvm::Type::getInt32Ty(cxt),
+            {llvm::Type::getInt32Ty(cxt),
+             llvm::Type::getInt64Ty(cxt)->getPointerTo()},
+            false),
+        Function::ExternalLinkage, RecordMarkName, module.get());
+    IRBuilder<> builder(&*clone->getEntryBlock().getFirstInsertionPt());
+    auto buffer = builder.CreateAlloca(
+        llvm::ArrayType::get(llvm::Type::getInt64Ty(cxt), maxValues));
+    auto abortBlock = BasicBlock::Create(cxt, "llreve_abort", clone);
+    builder.SetInsertPoint(abortBlock);
+    if (clone->getReturnType()->isVoidTy()) {
+        builder.CreateRetVoid();
+    } else {
+        builder.CreateRet(llvm::Constant::getNullValue(clone->getReturnType()));
+    }
+    for (uint32_t i = 0; i < instrumentedBlocks.size(); ++i) {
+        instrumentMarkBlock(instrumentedBlocks[i].first, i,
+                            instrumentedBlocks[i].second, buffer,
+                            recordMarkFun, abortBlock);
+    }
+    createEntryFunction(*module, *clone);
+
+    if (llvm::verifyModule(*module, &llvm::errs())) {
+        logError("Instrumenting " + fun.getName().str() +
+                 " produced an invalid module\n");
+        return nullptr;
+    }
+    if (!impl->compile(std::move(module))) {
+        logError("Could not compile " + fun.getName().str() + "\n");
+        return nullptr;
+    }
+    return std::unique_ptr<JITTraceCollector>(
+        new JITTraceCollector(std::move(impl)));
+}
+
+JITTraceCollector::JITTraceCollector(std::unique_ptr<Impl> impl)
+    : impl(std::move(impl)) {}
+JITTraceCollector::~JITTraceCollector() = default;
+
+static auto rawValue(const Integer &val) -> int64_t {
+    if (val.type == IntType::Bounded) {
+        return static_cast<int64_t>(val.bounded.getZExtValue());
+    }
+    return val.asUnbounded().get_si();
+}
+
+auto JITTraceCollector::run(const FastVarMap &arguments,
+                            uint32_t maxMarks) const -> FastCall {
+    vector<int64_t> args;
+    for (const auto &arg : impl->function.args()) {
+        args.push_back(rawValue(arguments.find(&arg)->second));
+    }
+    Recording recording(
+        *impl, maxMarks == 0 ? std::numeric_limits<uint32_t>::max() : maxMarks);
+    Recording *prevRecording = currentRecording;
+    currentRecording = &recording;
+    int64_t result = impl->entry(args.data());
+    currentRecording = prevRecording;
+
+    // The entry state only consists of the arguments and the heap is not
+    // observed
+    auto trace = std::make_shared<FastStateTrace>();
+    vector<BlockStep<const Value *>> steps;
+    FastStateTrace::Delta entryDelta;
+    entryDelta.variables.assign(arguments.begin(), arguments.end());
+    entryDelta.heap = Heap();
+    steps.emplace_back(impl->function.getEntryBlock().getName(), trace,
+                       trace->push(std::move(entryDelta)), vector<FastCall>());
+    for (const auto &mark : recording.marks) {
+        const MarkBlock &markBlock = impl->markBlocks[mark.first];
+        FastStateTrace::Delta delta;
+        for (size_t i = 0; i < markBlock.values.size(); ++i) {
+            delta.variables.push_back(
+                {markBlock.values[i],
+                 Integer(llvm::APInt(markBlock.widths[i],
+                                     static_cast<uint64_t>(mark.second[i])))});
+        }
+        steps.emplace_back(markBlock.name, trace, trace->push(std::move(delta)),
+                           vector<FastCall>());
+    }
+    FastState returnState = trace->rebuild(trace->size() - 1);
+    if (!recording.earlyExit) {
+        if (impl->returnWidth == 0) {
+            returnState.variables[impl->returnInstruction] =
+                Integer(mpz_class(0));
+        } else {
+            returnState.variables[impl->returnInstruction] =
+                Integer(llvm::APInt(impl->returnWidth,
+                                    static_cast<uint64_t>(result)));
+        }
+    }
+    return FastCall(&impl->function, FastState(arguments, Heap()),
+                    std::move(returnState), std::move(steps),
+                    recording.earlyExit,
+                    static_cast<uint32_t>(recording.marks.size() + 1));
+}
+}
+}
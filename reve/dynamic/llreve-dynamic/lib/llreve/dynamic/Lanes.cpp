@@ -0,0 +1,616 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/Lanes.h"
+
+#include "Compat.h"
+#include "Opts.h"
+#include "Statistics.h"
+
+#include <algorithm>
+
+using llvm::CmpInst;
+using llvm::Function;
+using llvm::Instruction;
+
+using std::vector;
+
+using llreve::opts::SMTGenerationOpts;
+
+namespace llreve {
+namespace dynamic {
+
+static llreve::cl::opt<bool> InterpretLanesFlag(
+    "interpret-lanes",
+    llreve::cl::desc("Interpret functions that only use bitvector arithmetic "
+                     "on several inputs at once if -bitvect is passed"),
+    llreve::cl::init(true));
+
+static auto widthMask(unsigned width) -> uint64_t {
+    return width >= 64 ? ~static_cast<uint64_t>(0)
+                       : (static_cast<uint64_t>(1) << width) - 1;
+}
+
+static auto signExtend(uint64_t value, unsigned width) -> int64_t {
+    const unsigned shift = 64 - width;
+    return static_cast<int64_t>(value << shift) >> shift;
+}
+
+LaneResult laneResult(const FastCall &call,
+                      const AnalysisResultsMap &analysisResults) {
+    LaneResult result;
+    const llvm::Value *returnInstruction =
+        analysisResults.at(call.function).returnInstruction;
+    auto it = call.returnState.variables.find(returnInstruction);
+    if (it != call.returnState.variables.end()) {
+        result.returnValue = it->second;
+    }
+    result.heap = call.returnState.heap;
+    result.earlyExit = call.earlyExit;
+    return result;
+}
+
+struct LaneInterpreter::Group {
+    const vector<FastVarMap> &inputs;
+    vector<LaneResult> &results;
+    // The index of the input in the first lane
+    size_t first;
+    const Heap &heap;
+    vector<uint64_t> values;
+    // Since all lanes follow the same path the same slots are assigned in
+    // all of them
+    vector<bool> assigned;
+    vector<Slot> assignedSlots;
+    bool active[LaneCount];
+    // Lanes that ran into undefined behavior
+    bool undefined[LaneCount];
+    uint64_t diverged = 0;
+    Group(const vector<FastVarMap> &inputs, vector<LaneResult> &results,
+          size_t first, const Heap &heap, const vector<uint64_t> &values,
+          Slot variables)
+        : inputs(inputs), results(results), first(first), heap(heap),
+          values(values), assigned(variables, false) {
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            active[lane] = first + lane < inputs.size();
+            undefined[lane] = false;
+        }
+    }
+    auto row(Slot slot) -> uint64_t * { return &values[slot * LaneCount]; }
+    void assign(Slot slot) {
+        if (!assigned[slot]) {
+            assigned[slot] = true;
+            assignedSlots.push_back(slot);
+        }
+    }
+    auto anyActive() const -> bool {
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            if (active[lane]) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static auto supportedInstruction(const BytecodeInstruction &instr,
+                                 const vector<unsigned> &widths) -> bool {
+    for (Slot operand : instr.operands) {
+        if (widths[operand] == 0) {
+            return false;
+        }
+    }
+    switch (instr.opcode) {
+    case Opcode::IntBinOp:
+        switch (instr.subOpcode) {
+        case Instruction::Add:
+        case Instruction::Sub:
+        case Instruction::Mul:
+        case Instruction::And:
+        case Instruction::Or:
+        case Instruction::Xor:
+        case Instruction::UDiv:
+        case Instruction::URem:
+        case Instruction::SDiv:
+        case Instruction::SRem:
+        case Instruction::Shl:
+        case Instruction::LShr:
+        case Instruction::AShr:
+            return true;
+        default:
+            return false;
+        }
+    case Opcode::BoolBinOp:
+        return instr.subOpcode == Instruction::And ||
+               instr.subOpcode == Instruction::Or ||
+               instr.subOpcode == Instruction::Xor;
+    case Opcode::ICmp:
+        return CmpInst::isIntPredicate(
+            static_cast<CmpInst::Predicate>(instr.subOpcode));
+    case Opcode::BoolToInt:
+    case Opcode::ZExt:
+    case Opcode::SExt:
+    case Opcode::ZExtOrTrunc:
+    case Opcode::Select:
+        return true;
+    case Opcode::GEP:
+    case Opcode::Load:
+    case Opcode::Store:
+    case Opcode::Call:
+    case Opcode::Unsupported:
+        return false;
+    }
+    return false;
+}
+
+std::unique_ptr<LaneInterpreter>
+LaneInterpreter::create(const Function &fun, InterpreterBudget budget,
+                        const AnalysisResultsMap &analysisResults) {
+    if (!InterpretLanesFlag || !SMTGenerationOpts::getInstance().BitVect ||
+        budget.instructions != 0 || budget.time.count() != 0 ||
+        budget.heapSize != 0 || analysisResults.count(&fun) == 0) {
+        return nullptr;
+    }
+    std::unique_ptr<BytecodeFunction> code = lowerFunction(fun);
+    const interpreter::SlotLayout &layout = code->layout;
+    vector<unsigned> widths(code->initialValues.size(), 0);
+    for (Slot slot = 0; slot < layout.variableCount(); ++slot) {
+        const llvm::Type *type = layout.variable(slot)->getType();
+        if (type->isIntegerTy()) {
+            widths[slot] = type->getIntegerBitWidth();
+            if (widths[slot] > 64) {
+                return nullptr;
+            }
+        } else if (!type->isVoidTy()) {
+            return nullptr;
+        }
+    }
+    for (Slot slot = layout.variableCount(); slot < widths.size(); ++slot) {
+        const Integer &val = code->initialValues[slot];
+        if (val.type == IntType::Bounded && val.bounded.getBitWidth() <= 64) {
+            widths[slot] = val.bounded.getBitWidth();
+        }
+    }
+    for (auto &block : code->blocks) {
+        for (const auto &phis : block.phis) {
+            if (phis.unsupportedOperand) {
+                return nullptr;
+            }
+            for (const auto &move : phis.moves) {
+                if (widths[move.first] == 0 || widths[move.second] == 0) {
+                    return nullptr;
+                }
+            }
+        }
+        for (const auto &instr : block.instructions) {
+            if (!supportedInstruction(instr, widths)) {
+                return nullptr;
+            }
+        }
+        const BytecodeTerminator &terminator = block.terminator;
+        if (terminator.unsupportedOperand) {
+            return nullptr;
+        }
+        switch (terminator.kind) {
+        case TerminatorKind::Return:
+            // The return value of a void function is an unbounded constant
+            // which is passed on unchanged
+            if (widths[terminator.value] == 0 &&
+                terminator.value < layout.variableCount()) {
+                return nullptr;
+            }
+            widths[terminator.result] = widths[terminator.value];
+            break;
+        case TerminatorKind::Branch:
+            break;
+        case TerminatorKind::CondBranch:
+        case TerminatorKind::Switch:
+            if (widths[terminator.value] == 0) {
+                return nullptr;
+            }
+            for (Slot caseValue : terminator.caseValues) {
+                if (widths[caseValue] == 0) {
+                    return nullptr;
+                }
+            }
+            break;
+        case TerminatorKind::Unsupported:
+            return nullptr;
+        }
+    }
+    return std::unique_ptr<LaneInterpreter>(new LaneInterpreter(
+        fun, std::move(code), std::move(widths), budget, analysisResults));
+}
+
+LaneInterpreter::LaneInterpreter(const Function &fun,
+                                 std::unique_ptr<BytecodeFunction> code,
+                                 vector<unsigned> widths,
+                                 InterpreterBudget budget,
+                                 const AnalysisResultsMap &analysisResults)
+    : fun(fun), code(std::move(code)), widths(std::move(widths)),
+      initialValues(this->widths.size() * LaneCount, 0), budget(budget),
+      analysisResults(analysisResults),
+      returnInstruction(analysisResults.at(&fun).returnInstruction) {
+    for (Slot slot = this->code->layout.variableCount();
+         slot < this->widths.size(); ++slot) {
+        if (this->widths[slot] == 0) {
+            continue;
+        }
+        const uint64_t val =
+            this->code->initialValues[slot].bounded.getZExtValue();
+        std::fill_n(&initialValues[slot * LaneCount], LaneCount, val);
+    }
+}
+
+vector<LaneResult> LaneInterpreter::interpret(const vector<FastVarMap> &inputs,
+                                              const Heap &heap) const {
+    vector<LaneResult> results(inputs.size());
+    uint64_t diverged = 0;
+    uint64_t undefined = 0;
+    for (size_t first = 0; first < inputs.size(); first += LaneCount) {
+        Group group(inputs, results, first, heap, initialValues,
+                    code->layout.variableCount());
+        for (const auto &arg : fun.args()) {
+            const Slot slot = *code->layout.slot(&arg);
+            uint64_t *values = group.row(slot);
+            group.assign(slot);
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                if (!group.active[lane]) {
+                    continue;
+                }
+                auto it = inputs[first + lane].find(&arg);
+                if (it == inputs[first + lane].end() ||
+                    it->second.type != IntType::Bounded ||
+                    it->second.bounded.getBitWidth() != widths[slot]) {
+                    group.active[lane] = false;
+                    group.undefined[lane] = true;
+                    continue;
+                }
+                values[lane] = it->second.bounded.getZExtValue();
+            }
+        }
+        interpretGroup(group);
+        diverged += group.diverged;
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            if (!group.undefined[lane]) {
+                continue;
+            }
+            // The scalar interpreter reports the error
+            ++undefined;
+            results[first + lane] = laneResult(
+                interpretFunction(fun, FastState(inputs[first + lane], heap),
+                                  budget, analysisResults),
+                analysisResults);
+        }
+    }
+    stats::count("lanes.inputs", inputs.size());
+    stats::count("lanes.diverged", diverged);
+    stats::count("lanes.undefined", undefined);
+    return results;
+}
+
+void LaneInterpreter::interpretGroup(Group &group) const {
+    BlockIndex prevBlock = NoBlock;
+    BlockIndex currentBlock = code->layout.blockIndex(fun.getEntryBlock());
+    uint32_t blocksVisited = 0;
+    while (group.anyActive()) {
+        const BytecodeBlock &block = code->blocks[currentBlock];
+        ++blocksVisited;
+        if (prevBlock != NoBlock) {
+            for (const auto &phis : block.phis) {
+                if (phis.predecessor != prevBlock) {
+                    continue;
+                }
+                for (const auto &move : phis.moves) {
+                    std::copy_n(group.row(move.second), LaneCount,
+                                group.row(move.first));
+                    group.assign(move.first);
+                }
+                break;
+            }
+        }
+        for (const auto &instr : block.instructions) {
+            interpretInstruction(instr, group);
+        }
+        const bool exhausted = blocksVisited > budget.blocks;
+        const BytecodeTerminator &terminator = block.terminator;
+        if (terminator.kind == TerminatorKind::Return || exhausted) {
+            const bool returned = terminator.kind == TerminatorKind::Return &&
+                                  code->layout.variable(terminator.result) ==
+                                      returnInstruction;
+            const unsigned width = widths[terminator.value];
+            const uint64_t *values = group.row(terminator.value);
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                if (!group.active[lane]) {
+                    continue;
+                }
+                LaneResult &result = group.results[group.first + lane];
+                result.heap = group.heap;
+                result.earlyExit = exhausted;
+                if (!returned) {
+                    continue;
+                }
+                if (width == 0) {
+                    result.returnValue = code->initialValues[terminator.value];
+                } else {
+                    result.returnValue =
+                        Integer(llvm::APInt(width, values[lane]));
+                }
+            }
+            return;
+        }
+        BlockIndex successors[LaneCount];
+        const uint64_t *values = group.row(terminator.value);
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            switch (terminator.kind) {
+            case TerminatorKind::Branch:
+                successors[lane] = terminator.successors[0];
+                break;
+            case TerminatorKind::CondBranch:
+                successors[lane] = terminator.successors[values[lane] ? 0 : 1];
+                break;
+            default:
+                successors[lane] = terminator.successors.back();
+                for (size_t i = 0; i < terminator.caseValues.size(); ++i) {
+                    if (group.row(terminator.caseValues[i])[lane] ==
+                        values[lane]) {
+                        successors[lane] = terminator.successors[i];
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+        BlockIndex nextBlock = NoBlock;
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            if (!group.active[lane]) {
+                continue;
+            }
+            if (nextBlock == NoBlock) {
+                nextBlock = successors[lane];
+            } else if (successors[lane] != nextBlock) {
+                leaveGroup(group, lane, currentBlock, successors[lane],
+                           blocksVisited);
+            }
+        }
+        prevBlock = currentBlock;
+        currentBlock = nextBlock;
+    }
+}
+
+void LaneInterpreter::leaveGroup(Group &group, unsigned lane, BlockIndex from,
+                                 BlockIndex to, uint32_t blocksVisited) const {
+    ++group.diverged;
+    group.active[lane] = false;
+    const interpreter::SlotLayout &layout = code->layout;
+    auto value = [&](Slot slot) {
+        return Integer(llvm::APInt(widths[slot], group.row(slot)[lane]));
+    };
+    FastVarMap variables;
+    for (Slot slot : group.assignedSlots) {
+        variables[layout.variable(slot)] = value(slot);
+    }
+    // The scalar interpreter skips the phi nodes of the block it starts in
+    for (const auto &phis : code->blocks[to].phis) {
+        if (phis.predecessor != from) {
+            continue;
+        }
+        for (const auto &move : phis.moves) {
+            group.row(move.first)[lane] = group.row(move.second)[lane];
+            variables[layout.variable(move.first)] = value(move.first);
+        }
+        break;
+    }
+    InterpreterBudget remaining = budget;
+    remaining.blocks = budget.blocks - blocksVisited;
+    group.results[group.first + lane] = laneResult(
+        interpretFunction(fun, FastState(std::move(variables), group.heap),
+                          &layout.block(to), remaining, analysisResults),
+        analysisResults);
+}
+
+void LaneInterpreter::interpretInstruction(const BytecodeInstruction &instr,
+                                           Group &group) const {
+    const unsigned width = widths[instr.result];
+    const uint64_t mask = widthMask(width);
+    uint64_t *result = group.row(instr.result);
+    const uint64_t *a = group.row(instr.operands[0]);
+    const uint64_t *b =
+        instr.operands.size() > 1 ? group.row(instr.operands[1]) : a;
+    // Set for lanes whose operands make the instruction undefined, the
+    // operands are replaced so the result can still be computed for all
+    // lanes
+    bool undefined[LaneCount] = {};
+    group.assign(instr.result);
+    switch (instr.opcode) {
+    case Opcode::IntBinOp: {
+        const unsigned operandWidth = widths[instr.operands[0]];
+        switch (instr.subOpcode) {
+        case Instruction::Add:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = (a[lane] + b[lane]) & mask;
+            }
+            break;
+        case Instruction::Sub:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = (a[lane] - b[lane]) & mask;
+            }
+            break;
+        case Instruction::Mul:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = (a[lane] * b[lane]) & mask;
+            }
+            break;
+        case Instruction::And:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = a[lane] & b[lane];
+            }
+            break;
+        case Instruction::Or:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = a[lane] | b[lane];
+            }
+            break;
+        case Instruction::Xor:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = a[lane] ^ b[lane];
+            }
+            break;
+        case Instruction::UDiv:
+        case Instruction::URem: {
+            const bool rem = instr.subOpcode == Instruction::URem;
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                undefined[lane] = b[lane] == 0;
+                const uint64_t divisor = undefined[lane] ? 1 : b[lane];
+                result[lane] = rem ? a[lane] % divisor : a[lane] / divisor;
+            }
+            break;
+        }
+        case Instruction::SDiv:
+        case Instruction::SRem: {
+            const bool rem = instr.subOpcode == Instruction::SRem;
+            const uint64_t minValue = static_cast<uint64_t>(1)
+                                      << (operandWidth - 1);
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                undefined[lane] =
+                    b[lane] == 0 || (a[lane] == minValue && b[lane] == mask);
+                const int64_t dividend = signExtend(a[lane], operandWidth);
+                const int64_t divisor =
+                    undefined[lane] ? 1 : signExtend(b[lane], operandWidth);
+                result[lane] = static_cast<uint64_t>(rem ? dividend % divisor
+                                                         : dividend / divisor) &
+                               mask;
+            }
+            break;
+        }
+        case Instruction::Shl:
+        case Instruction::LShr:
+        case Instruction::AShr:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                undefined[lane] = b[lane] >= operandWidth;
+                const uint64_t shift = undefined[lane] ? 0 : b[lane];
+                switch (instr.subOpcode) {
+                case Instruction::Shl:
+                    result[lane] = (a[lane] << shift) & mask;
+                    break;
+                case Instruction::LShr:
+                    result[lane] = a[lane] >> shift;
+                    break;
+                default:
+                    result[lane] = static_cast<uint64_t>(
+                                       signExtend(a[lane], operandWidth) >>
+                                       shift) &
+                                   mask;
+                    break;
+                }
+            }
+            break;
+        }
+        break;
+    }
+    case Opcode::BoolBinOp:
+        switch (instr.subOpcode) {
+        case Instruction::And:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = a[lane] & b[lane];
+            }
+            break;
+        case Instruction::Or:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = a[lane] | b[lane];
+            }
+            break;
+        default:
+            for (unsigned lane = 0; lane < LaneCount; ++lane) {
+                result[lane] = a[lane] ^ b[lane];
+            }
+            break;
+        }
+        break;
+    case Opcode::ICmp: {
+        const unsigned operandWidth = widths[instr.operands[0]];
+        const auto pred = static_cast<CmpInst::Predicate>(instr.subOpcode);
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            const int64_t x = signExtend(a[lane], operandWidth);
+            const int64_t y = signExtend(b[lane], operandWidth);
+            bool cmp = false;
+            switch (pred) {
+            case CmpInst::ICMP_EQ:
+                cmp = a[lane] == b[lane];
+                break;
+            case CmpInst::ICMP_NE:
+                cmp = a[lane] != b[lane];
+                break;
+            case CmpInst::ICMP_UGT:
+                cmp = a[lane] > b[lane];
+                break;
+            case CmpInst::ICMP_UGE:
+                cmp = a[lane] >= b[lane];
+                break;
+            case CmpInst::ICMP_ULT:
+                cmp = a[lane] < b[lane];
+                break;
+            case CmpInst::ICMP_ULE:
+                cmp = a[lane] <= b[lane];
+                break;
+            case CmpInst::ICMP_SGT:
+                cmp = x > y;
+                break;
+            case CmpInst::ICMP_SGE:
+                cmp = x >= y;
+                break;
+            case CmpInst::ICMP_SLT:
+                cmp = x < y;
+                break;
+            default:
+                cmp = x <= y;
+                break;
+            }
+            result[lane] = cmp;
+        }
+        break;
+    }
+    case Opcode::BoolToInt:
+    case Opcode::ZExt:
+        std::copy_n(a, LaneCount, result);
+        break;
+    case Opcode::SExt: {
+        const unsigned operandWidth = widths[instr.operands[0]];
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            result[lane] =
+                static_cast<uint64_t>(signExtend(a[lane], operandWidth)) &
+                mask;
+        }
+        break;
+    }
+    case Opcode::ZExtOrTrunc:
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            result[lane] = a[lane] & mask;
+        }
+        break;
+    case Opcode::Select: {
+        const uint64_t *c = group.row(instr.operands[2]);
+        for (unsigned lane = 0; lane < LaneCount; ++lane) {
+            result[lane] = a[lane] ? b[lane] : c[lane];
+        }
+        break;
+    }
+    default:
+        // Excluded by create
+        break;
+    }
+    for (unsigned lane = 0; lane < LaneCount; ++lane) {
+        if (group.active[lane] && undefined[lane]) {
+            group.active[lane] = false;
+            group.undefined[lane] = true;
+        }
+    }
+}
+}
+}
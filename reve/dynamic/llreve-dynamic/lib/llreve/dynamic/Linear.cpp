@@ -10,8 +10,16 @@
 
 #include "llreve/dynamic/Linear.h"
 
+#include "llreve/dynamic/DenseMatrix.h"
+
 #include <gmpxx.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using llreve::dynamic::DenseMatrix;
+
 using std::vector;
 
 // This is not completely reduced as the leading entries are not normalized
@@ -90,6 +98,66 @@ bool linearlyIndependent(const Matrix<mpq_class> &vectors,
     return false;
 }
 
+// Returns the size of the row for zero rows
+static size_t leadingColumn(const vector<mpq_class> &row) {
+    size_t col = 0;
+    while (col < row.size() && row[col] == 0) {
+        ++col;
+    }
+    return col;
+}
+
+bool insertIntoRowEchelonForm(Matrix<mpq_class> &echelon,
+                              vector<mpq_class> row) {
+    assert(echelon.empty() || echelon[0].size() == row.size());
+    // The pivot columns are zero in all other rows, so eliminating them one
+    // after the other does not reintroduce earlier ones
+    mpq_class product;
+    for (size_t i = 0; i < echelon.size(); ++i) {
+        const auto &echelonRow = echelon[i];
+        const size_t pivotCol = leadingColumn(echelonRow);
+        if (row[pivotCol] == 0) {
+            continue;
+        }
+        const mpq_class factor = row[pivotCol];
+        for (size_t j = pivotCol; j < row.size(); ++j) {
+            if (echelonRow[j] != 0) {
+                product = factor * echelonRow[j];
+                row[j] -= product;
+            }
+        }
+    }
+    const size_t pivotCol = leadingColumn(row);
+    if (pivotCol == row.size()) {
+        return false;
+    }
+    const mpq_class pivot = row[pivotCol];
+    for (size_t j = pivotCol; j < row.size(); ++j) {
+        row[j] /= pivot;
+    }
+    // Eliminate the new pivot from the existing rows
+    size_t insertAt = 0;
+    for (size_t i = 0; i < echelon.size(); ++i) {
+        auto &echelonRow = echelon[i];
+        if (leadingColumn(echelonRow) < pivotCol) {
+            insertAt = i + 1;
+        }
+        if (echelonRow[pivotCol] == 0) {
+            continue;
+        }
+        const mpq_class factor = echelonRow[pivotCol];
+        for (size_t j = pivotCol; j < row.size(); ++j) {
+            if (row[j] != 0) {
+                product = factor * row[j];
+                echelonRow[j] -= product;
+            }
+        }
+    }
+    echelon.insert(echelon.begin() + static_cast<std::ptrdiff_t>(insertAt),
+                   std::move(row));
+    return true;
+}
+
 vector<mpq_class> multiplyRow(vector<mpq_class> vec, mpq_class c) {
     for (auto &entry : vec) {
         entry *= c;
@@ -168,3 +236,295 @@ vector<mpz_class> ratToInt(vector<mpq_class> vec) {
     }
     return output;
 }
+
+// Scales every row so that it only contains integers, this does not change
+// the null space
+static Matrix<mpz_class> integerRows(const Matrix<mpq_class> &m) {
+    Matrix<mpz_class> result;
+    result.reserve(m.size());
+    for (const auto &row : m) {
+        mpz_class denominator = 1;
+        for (const auto &entry : row) {
+            denominator = lcm(denominator, entry.get_den());
+        }
+        vector<mpz_class> integerRow(row.size());
+        for (size_t i = 0; i < row.size(); ++i) {
+            integerRow[i] = row[i].get_num() * (denominator / row[i].get_den());
+        }
+        result.push_back(std::move(integerRow));
+    }
+    return result;
+}
+
+// Fraction-free Gauss-Jordan elimination (Bareiss). Every entry stays a minor
+// of the input, so the divisions by the previous pivot are exact and the
+// entries only grow linearly in size. At the end all pivots are equal to the
+// last pivot. Returns the pivot columns.
+static vector<size_t> fractionFreeRowEchelonForm(Matrix<mpz_class> &m) {
+    vector<size_t> pivotCols;
+    mpz_class prevPivot = 1;
+    mpz_class product;
+    size_t currentRow = 0;
+    for (size_t currentCol = 0;
+         currentCol < m.at(0).size() && currentRow < m.size(); ++currentCol) {
+        size_t nonZeroRow = currentRow;
+        while (nonZeroRow < m.size() && m[nonZeroRow][currentCol] == 0) {
+            ++nonZeroRow;
+        }
+        if (nonZeroRow == m.size()) {
+            continue;
+        }
+        swap(m[nonZeroRow], m[currentRow]);
+        const vector<mpz_class> &pivotRow = m[currentRow];
+        const mpz_class &pivot = pivotRow[currentCol];
+        for (size_t i = 0; i < m.size(); ++i) {
+            if (i == currentRow) {
+                continue;
+            }
+            vector<mpz_class> &row = m[i];
+            const mpz_class factor = row[currentCol];
+            for (size_t j = 0; j < row.size(); ++j) {
+                if (j == currentCol) {
+                    continue;
+                }
+                row[j] *= pivot;
+                product = factor * pivotRow[j];
+                row[j] -= product;
+                mpz_divexact(row[j].get_mpz_t(), row[j].get_mpz_t(),
+                             prevPivot.get_mpz_t());
+            }
+            row[currentCol] = 0;
+        }
+        prevPivot = pivot;
+        pivotCols.push_back(currentCol);
+        ++currentRow;
+    }
+    return pivotCols;
+}
+
+// Checks for the form produced by insertIntoRowEchelonForm
+static bool isNormalizedRowEchelonForm(const Matrix<mpq_class> &m,
+                                       vector<size_t> &pivotCols) {
+    pivotCols.clear();
+    for (const auto &row : m) {
+        const size_t col = leadingColumn(row);
+        if (col == row.size() || row[col] != 1 ||
+            (!pivotCols.empty() && col <= pivotCols.back())) {
+            return false;
+        }
+        pivotCols.push_back(col);
+    }
+    for (size_t row = 0; row < m.size(); ++row) {
+        for (size_t other = 0; other < m.size(); ++other) {
+            if (other != row && m[other][pivotCols[row]] != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The basis of the null space can be read off directly, every free column
+// yields the vector with the entries of that column at the pivot columns and
+// -1 at the free column
+static Matrix<mpz_class>
+normalizedRowEchelonNullSpace(const Matrix<mpq_class> &m,
+                              const vector<size_t> &pivotCols) {
+    const size_t cols = m.at(0).size();
+    Matrix<mpz_class> basis;
+    size_t nextPivot = 0;
+    for (size_t col = 0; col < cols; ++col) {
+        if (nextPivot < pivotCols.size() && pivotCols[nextPivot] == col) {
+            ++nextPivot;
+            continue;
+        }
+        vector<mpq_class> basisVector(cols, 0);
+        for (size_t row = 0; row < pivotCols.size(); ++row) {
+            basisVector[pivotCols[row]] = m[row][col];
+        }
+        basisVector[col] = -1;
+        basis.push_back(ratToInt(std::move(basisVector)));
+    }
+    return basis;
+}
+
+// 2^31 - 1, reductions only need shifts and masks
+static const uint32_t ModularPrime = 2147483647u;
+
+static auto reduceModPrime(uint64_t x) -> uint32_t {
+    x = (x & ModularPrime) + (x >> 31);
+    x = (x & ModularPrime) + (x >> 31);
+    return static_cast<uint32_t>(x >= ModularPrime ? x - ModularPrime : x);
+}
+
+static auto powModPrime(uint32_t base, uint32_t exp) -> uint32_t {
+    uint64_t result = 1;
+    uint64_t power = base;
+    for (; exp > 0; exp >>= 1) {
+        if (exp & 1) {
+            result = reduceModPrime(result * power);
+        }
+        power = reduceModPrime(power * power);
+    }
+    return static_cast<uint32_t>(result);
+}
+
+static auto inverseModPrime(uint32_t x) -> uint32_t {
+    return powModPrime(x, ModularPrime - 2);
+}
+
+// dst -= factor * src for 'n' entries
+static void mulSubRowScalar(uint32_t *dst, const uint32_t *src,
+                            uint32_t factor, size_t n) {
+    const uint64_t negFactor = ModularPrime - factor;
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = reduceModPrime(dst[i] + negFactor * src[i]);
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) static __m256i
+reduceModPrimeAVX2(__m256i x) {
+    const __m256i prime = _mm256_set1_epi64x(ModularPrime);
+    x = _mm256_add_epi64(_mm256_and_si256(x, prime), _mm256_srli_epi64(x, 31));
+    x = _mm256_add_epi64(_mm256_and_si256(x, prime), _mm256_srli_epi64(x, 31));
+    // Subtract the prime from the lanes that are not smaller than it
+    const __m256i tooLarge =
+        _mm256_cmpgt_epi64(x, _mm256_set1_epi64x(ModularPrime - 1));
+    return _mm256_sub_epi64(x, _mm256_and_si256(tooLarge, prime));
+}
+
+// Processes 8 entries at once, the rows have to be aligned and 'n' has to be a
+// multiple of 8. The 32x32 bit multiplications only use the even lanes so the
+// odd lanes are shifted down and handled separately.
+__attribute__((target("avx2"))) static void
+mulSubRowAVX2(uint32_t *dst, const uint32_t *src, uint32_t factor, size_t n) {
+    const __m256i negFactor = _mm256_set1_epi64x(ModularPrime - factor);
+    const __m256i lowMask = _mm256_set1_epi64x(0xffffffffu);
+    for (size_t i = 0; i < n; i += 8) {
+        __m256i s = _mm256_load_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i d = _mm256_load_si256(reinterpret_cast<const __m256i *>(dst + i));
+        __m256i even = _mm256_add_epi64(_mm256_mul_epu32(s, negFactor),
+                                        _mm256_and_si256(d, lowMask));
+        __m256i odd = _mm256_add_epi64(
+            _mm256_mul_epu32(_mm256_srli_epi64(s, 32), negFactor),
+            _mm256_srli_epi64(d, 32));
+        __m256i result =
+            _mm256_or_si256(reduceModPrimeAVX2(even),
+                            _mm256_slli_epi64(reduceModPrimeAVX2(odd), 32));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(dst + i), result);
+    }
+}
+#endif
+
+using MulSubRow = void (*)(uint32_t *, const uint32_t *, uint32_t, size_t);
+
+static auto selectMulSubRow() -> MulSubRow {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        return mulSubRowAVX2;
+    }
+#endif
+    return mulSubRowScalar;
+}
+
+static auto toModularMatrix(const Matrix<mpz_class> &m)
+    -> DenseMatrix<uint32_t> {
+    DenseMatrix<uint32_t> result(m.size(), m.at(0).size());
+    for (size_t i = 0; i < m.size(); ++i) {
+        for (size_t j = 0; j < m[i].size(); ++j) {
+            result(i, j) = static_cast<uint32_t>(
+                mpz_fdiv_ui(m[i][j].get_mpz_t(), ModularPrime));
+        }
+    }
+    return result;
+}
+
+static Matrix<mpz_class> integerRows(const Matrix<mpq_class> &m);
+
+size_t modularRank(const Matrix<mpq_class> &m) {
+    if (m.empty()) {
+        return 0;
+    }
+    static const MulSubRow mulSubRow = selectMulSubRow();
+    // Scaling the rows to integers avoids inverting denominators modulo the
+    // prime
+    DenseMatrix<uint32_t> modular = toModularMatrix(integerRows(m));
+    const size_t stride = modular.stride();
+    size_t rank = 0;
+    for (size_t col = 0; col < modular.cols() && rank < modular.rows();
+         ++col) {
+        size_t pivotRow = rank;
+        while (pivotRow < modular.rows() && modular(pivotRow, col) == 0) {
+            ++pivotRow;
+        }
+        if (pivotRow == modular.rows()) {
+            continue;
+        }
+        modular.swapRows(pivotRow, rank);
+        uint32_t *pivot = modular.row(rank);
+        const uint64_t inverse = inverseModPrime(pivot[col]);
+        for (size_t j = 0; j < stride; ++j) {
+            pivot[j] = reduceModPrime(pivot[j] * inverse);
+        }
+        for (size_t i = rank + 1; i < modular.rows(); ++i) {
+            uint32_t *row = modular.row(i);
+            if (row[col] != 0) {
+                mulSubRow(row, pivot, row[col], stride);
+            }
+        }
+        ++rank;
+    }
+    return rank;
+}
+
+Matrix<mpz_class> integerNullSpace(const Matrix<mpq_class> &m) {
+    if (m.empty()) {
+        // See nullSpace
+        return {};
+    }
+    vector<size_t> echelonPivotCols;
+    if (isNormalizedRowEchelonForm(m, echelonPivotCols)) {
+        return normalizedRowEchelonNullSpace(m, echelonPivotCols);
+    }
+    // Checking for a trivial null space modulo a prime is a lot cheaper than
+    // the exact elimination
+    if (m.size() >= m.at(0).size() && modularRank(m) == m.at(0).size()) {
+        return {};
+    }
+    Matrix<mpz_class> rowEchelon = integerRows(m);
+    const vector<size_t> pivotCols = fractionFreeRowEchelonForm(rowEchelon);
+    const size_t cols = rowEchelon.at(0).size();
+    // The rational basis vector of a free column has the entries
+    // row[free] / pivot at the pivot columns and -1 at the free column.
+    // Multiplying it by |pivot| keeps the sign and yields integers.
+    mpz_class pivot = 1;
+    if (!pivotCols.empty()) {
+        pivot = rowEchelon[0][pivotCols[0]];
+    }
+    const int sign = sgn(pivot);
+    const mpz_class absPivot = abs(pivot);
+    Matrix<mpz_class> basis;
+    size_t nextPivot = 0;
+    for (size_t col = 0; col < cols; ++col) {
+        if (nextPivot < pivotCols.size() && pivotCols[nextPivot] == col) {
+            ++nextPivot;
+            continue;
+        }
+        vector<mpz_class> basisVector(cols, 0);
+        for (size_t row = 0; row < pivotCols.size(); ++row) {
+            basisVector[pivotCols[row]] = sign * rowEchelon[row][col];
+        }
+        basisVector[col] = -absPivot;
+        mpz_class greatestCommonDivisor = 0;
+        for (const auto &entry : basisVector) {
+            greatestCommonDivisor = gcd(greatestCommonDivisor, entry);
+        }
+        for (auto &entry : basisVector) {
+            mpz_divexact(entry.get_mpz_t(), entry.get_mpz_t(),
+                         greatestCommonDivisor.get_mpz_t());
+        }
+        basis.push_back(std::move(basisVector));
+    }
+    return basis;
+}
@@ -17,6 +17,7 @@
 using std::set;
 using std::map;
 using std::string;
+using std::vector;
 
 TopLevelExpr::~TopLevelExpr() = default;
 SMTExpr::~SMTExpr() = default;
@@ -25,6 +26,21 @@ mpz_class SMTExpr::getVal() const {
     exit(1);
 }
 
+set<string> SMTExpr::references() const {
+    set<string> refs;
+    vector<const SMTExpr *> worklist = {this};
+    while (!worklist.empty()) {
+        const SMTExpr *expr = worklist.back();
+        worklist.pop_back();
+        expr->localReferences(refs);
+        expr->children(worklist);
+    }
+    return refs;
+}
+
+void SMTExpr::localReferences(set<string> & /* unused */) const {}
+void SMTExpr::children(vector<const SMTExpr *> & /* unused */) const {}
+
 ArrayVal SMTExpr::getArrayVal() const { return {}; }
 mpz_class SMTExpr::getIndex() const {
     logError("Can’t get exit ouf of smtexpr\n");
@@ -58,42 +74,40 @@ Type DefineFun::type() const {
 mpz_class DefineFun::getVal() const { return definition->getVal(); }
 ArrayVal DefineFun::getArrayVal() const { return definition->getArrayVal(); }
 
-set<string> AsArray::references() const { return {arg}; }
-
-set<string> String::references() const { return {}; }
-
-set<string> Int::references() const { return {}; }
+void AsArray::localReferences(set<string> &refs) const { refs.insert(arg); }
 
 mpz_class Int::getVal() const { return val; }
 ArrayVal Int::getArrayVal() const { return {val, {}}; }
 
-set<string> Eq::references() const {
-    set<string> leftRefs = left->references();
-    set<string> rightRefs = right->references();
-    leftRefs.insert(rightRefs.begin(), rightRefs.end());
-    return leftRefs;
+void Eq::children(vector<const SMTExpr *> &worklist) const {
+    worklist.push_back(left.get());
+    worklist.push_back(right.get());
 }
 
 mpz_class Eq::getIndex() const { return right->getVal(); }
 
-set<string> ITE::references() const {
-    set<string> condRefs = cond->references();
-    set<string> trueRefs = ifTrue->references();
-    set<string> falseRefs = ifFalse->references();
-    condRefs.insert(trueRefs.begin(), trueRefs.end());
-    condRefs.insert(falseRefs.begin(), falseRefs.end());
-    return condRefs;
+void ITE::children(vector<const SMTExpr *> &worklist) const {
+    worklist.push_back(cond.get());
+    worklist.push_back(ifTrue.get());
+    worklist.push_back(ifFalse.get());
 }
 
 ArrayVal ITE::getArrayVal() const {
-    mpz_class i = cond->getIndex();
-    mpz_class val = ifTrue->getVal();
-    ArrayVal acc = ifFalse->getArrayVal();
-    acc.vals.insert({i, val});
-    return acc;
+    ArrayVal result;
+    const SMTExpr *expr = this;
+    // The outer conditions take precedence so existing entries are never
+    // overwritten
+    while (const ITE *ite = expr->asITE()) {
+        result.vals.insert({ite->cond->getIndex(), ite->ifTrue->getVal()});
+        expr = ite->ifFalse.get();
+    }
+    ArrayVal rest = expr->getArrayVal();
+    result.background = rest.background;
+    result.vals.insert(rest.vals.begin(), rest.vals.end());
+    return result;
 }
 
-set<string> Identifier::references() const { return {name}; }
+void Identifier::localReferences(set<string> &refs) const { refs.insert(name); }
 
 Result::~Result() = default;
 
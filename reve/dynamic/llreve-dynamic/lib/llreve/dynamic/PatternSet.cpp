@@ -0,0 +1,520 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/PatternSet.h"
+
+#include "Statistics.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include <sys/stat.h>
+
+using std::list;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace llreve {
+namespace dynamic {
+
+// Changing the serialized form requires changing the version so old cache
+// entries are not read anymore
+static const char *const PatternFormatVersion = "llreve-patterns 1";
+
+PatternSet::PatternSet(PatternList patterns)
+    : patternList(std::move(patterns)) {
+    std::map<std::pair<vector<ArgumentRole>, vector<ArgumentSymmetry>>,
+             size_t>
+        groupIndices;
+    for (size_t i = 0; i < patternList.size(); ++i) {
+        vector<ArgumentRole> roles;
+        patternList[i]->argumentRoles(roles);
+        vector<ArgumentSymmetry> symmetries;
+        patternList[i]->argumentSymmetries(symmetries, 0);
+        auto it = groupIndices.insert({{roles, symmetries}, groups.size()});
+        if (it.second) {
+            groups.push_back({std::move(roles), std::move(symmetries), {}});
+        }
+        groups[it.first->second].patterns.push_back(i);
+    }
+}
+
+list<shared_ptr<HeapPattern<const llvm::Value *>>>
+PatternSet::allInstantiations(const vector<smt::SortedVar> &variables,
+                              const FastVarMap &variableValues,
+                              MonoPair<llvm::Value *> returnValues) const {
+    const vector<const llvm::Value *> values =
+        valuesOfVariables(variables, variableValues, returnValues);
+    // Collected per pattern to keep the order of the patterns
+    vector<list<shared_ptr<HeapPattern<const llvm::Value *>>>> instantiations(
+        patternList.size());
+    for (const auto &group : groups) {
+        forEachInstantiation(
+            group.roles, group.symmetries, values, returnValues,
+            [&](const vector<const llvm::Value *> &args) {
+                for (size_t pattern : group.patterns) {
+                    instantiations[pattern].push_back(
+                        patternList[pattern]->distributeArguments(args));
+                }
+            });
+    }
+    list<shared_ptr<HeapPattern<const llvm::Value *>>> result;
+    for (auto &patternInstantiations : instantiations) {
+        result.splice(result.end(), patternInstantiations);
+    }
+    return result;
+}
+
+static bool holesAreBound(const HeapExpr<VariablePlaceholder> &expr,
+                          const std::set<size_t> &bound) {
+    switch (expr.getType()) {
+    case ExprType::Hole:
+        return bound.count(
+                   static_cast<const Hole<VariablePlaceholder> &>(expr)
+                       .index) == 1;
+    case ExprType::HeapAccess:
+        return holesAreBound(
+            *static_cast<const HeapAccess<VariablePlaceholder> &>(expr).atVal,
+            bound);
+    case ExprType::Binary: {
+        const auto &binExpr =
+            static_cast<const BinaryIntExpr<VariablePlaceholder> &>(expr);
+        return holesAreBound(*binExpr.args.first, bound) &&
+               holesAreBound(*binExpr.args.second, bound);
+    }
+    default:
+        return true;
+    }
+}
+
+static bool holesAreBound(const HeapPattern<VariablePlaceholder> &pattern,
+                          std::set<size_t> &bound) {
+    switch (pattern.getType()) {
+    case PatternType::Binary: {
+        const auto &binPat =
+            static_cast<const BinaryHeapPattern<VariablePlaceholder> &>(
+                pattern);
+        return holesAreBound(*binPat.args.first, bound) &&
+               holesAreBound(*binPat.args.second, bound);
+    }
+    case PatternType::Unary:
+        return holesAreBound(
+            *static_cast<const UnaryHeapPattern<VariablePlaceholder> &>(
+                 pattern)
+                 .arg,
+            bound);
+    case PatternType::HeapEquality:
+        return true;
+    case PatternType::Range: {
+        const auto &range =
+            static_cast<const RangeProp<VariablePlaceholder> &>(pattern);
+        // The bounds are evaluated before the index is bound
+        if (bound.count(range.index) == 1 ||
+            !holesAreBound(*range.bounds.first, bound) ||
+            !holesAreBound(*range.bounds.second, bound)) {
+            return false;
+        }
+        bound.insert(range.index);
+        const bool result = holesAreBound(*range.pat, bound);
+        bound.erase(range.index);
+        return result;
+    }
+    case PatternType::ExprProp: {
+        const auto &prop =
+            static_cast<const HeapExprProp<VariablePlaceholder> &>(pattern);
+        return holesAreBound(*prop.args.first, bound) &&
+               holesAreBound(*prop.args.second, bound);
+    }
+    }
+    return false;
+}
+
+bool validatePatterns(const PatternList &patterns) {
+    for (const auto &pattern : patterns) {
+        std::set<size_t> bound;
+        if (!holesAreBound(*pattern, bound)) {
+            std::ostringstream dump;
+            pattern->dump(dump);
+            logError("Unbound or rebound index in pattern " + dump.str() +
+                     "\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false if the expression is not produced by the parser
+static bool serializeExpr(const HeapExpr<VariablePlaceholder> &expr,
+                          std::ostream &os) {
+    switch (expr.getType()) {
+    case ExprType::Variable:
+        os << " V";
+        return true;
+    case ExprType::Constant:
+        os << " C"
+           << static_cast<const Constant<VariablePlaceholder> &>(expr)
+                  .value.get_str();
+        return true;
+    case ExprType::Hole:
+        os << " h"
+           << static_cast<const Hole<VariablePlaceholder> &>(expr).index;
+        return true;
+    case ExprType::HeapAccess: {
+        const auto &access =
+            static_cast<const HeapAccess<VariablePlaceholder> &>(expr);
+        os << " M" << (access.programIndex == ProgramIndex::First ? 1 : 2);
+        return serializeExpr(*access.atVal, os);
+    }
+    case ExprType::Binary: {
+        const auto &binExpr =
+            static_cast<const BinaryIntExpr<VariablePlaceholder> &>(expr);
+        os << " b" << static_cast<int>(binExpr.op);
+        return serializeExpr(*binExpr.args.first, os) &&
+               serializeExpr(*binExpr.args.second, os);
+    }
+    default:
+        return false;
+    }
+}
+
+static bool serializePattern(const HeapPattern<VariablePlaceholder> &pattern,
+                             std::ostream &os) {
+    switch (pattern.getType()) {
+    case PatternType::Binary: {
+        const auto &binPat =
+            static_cast<const BinaryHeapPattern<VariablePlaceholder> &>(
+                pattern);
+        os << " B" << static_cast<int>(binPat.op);
+        return serializePattern(*binPat.args.first, os) &&
+               serializePattern(*binPat.args.second, os);
+    }
+    case PatternType::Unary:
+        os << " N";
+        return serializePattern(
+            *static_cast<const UnaryHeapPattern<VariablePlaceholder> &>(
+                 pattern)
+                 .arg,
+            os);
+    case PatternType::HeapEquality:
+        os << " E";
+        return true;
+    case PatternType::Range: {
+        const auto &range =
+            static_cast<const RangeProp<VariablePlaceholder> &>(pattern);
+        os << " R" << static_cast<int>(range.quant) << " " << range.index;
+        return serializeExpr(*range.bounds.first, os) &&
+               serializeExpr(*range.bounds.second, os) &&
+               serializePattern(*range.pat, os);
+    }
+    case PatternType::ExprProp: {
+        const auto &prop =
+            static_cast<const HeapExprProp<VariablePlaceholder> &>(pattern);
+        os << " P" << static_cast<int>(prop.op);
+        return serializeExpr(*prop.args.first, os) &&
+               serializeExpr(*prop.args.second, os);
+    }
+    }
+    return false;
+}
+
+bool serializePatterns(const PatternList &patterns, std::ostream &os) {
+    os << PatternFormatVersion << "\n";
+    for (const auto &pattern : patterns) {
+        if (!serializePattern(*pattern, os)) {
+            return false;
+        }
+        os << "\n";
+    }
+    return static_cast<bool>(os);
+}
+
+namespace {
+// Reads the tokens of a single serialized pattern
+class PatternReader {
+  public:
+    explicit PatternReader(const string &line) : tokens(line) {}
+    auto pattern() -> shared_ptr<HeapPattern<VariablePlaceholder>>;
+    auto expr() -> shared_ptr<HeapExpr<VariablePlaceholder>>;
+    auto atEnd() -> bool {
+        string rest;
+        return !(tokens >> rest);
+    }
+
+  private:
+    std::istringstream tokens;
+    // Reads an operator encoded by its index, returns false if it is larger
+    // than 'max'
+    template <typename Op> auto op(string arg, int max, Op &result) -> bool {
+        int index;
+        if (!parseNumber(arg, index) || index < 0 || index > max) {
+            return false;
+        }
+        result = static_cast<Op>(index);
+        return true;
+    }
+    template <typename N> static auto parseNumber(string arg, N &result) {
+        std::istringstream stream(arg);
+        return (stream >> result) && stream.eof();
+    }
+};
+}
+
+shared_ptr<HeapExpr<VariablePlaceholder>> PatternReader::expr() {
+    string token;
+    if (!(tokens >> token)) {
+        return nullptr;
+    }
+    const string arg = token.substr(1);
+    switch (token[0]) {
+    case 'V':
+        return make_shared<Variable<VariablePlaceholder>>(
+            VariablePlaceholder());
+    case 'C': {
+        mpz_class value;
+        if (value.set_str(arg, 10) != 0) {
+            return nullptr;
+        }
+        return make_shared<Constant<VariablePlaceholder>>(value);
+    }
+    case 'h': {
+        size_t index;
+        if (!parseNumber(arg, index)) {
+            return nullptr;
+        }
+        return make_shared<Hole<VariablePlaceholder>>(index);
+    }
+    case 'M': {
+        if (arg != "1" && arg != "2") {
+            return nullptr;
+        }
+        auto atVal = expr();
+        if (!atVal) {
+            return nullptr;
+        }
+        return make_shared<HeapAccess<VariablePlaceholder>>(
+            arg == "1" ? ProgramIndex::First : ProgramIndex::Second, atVal);
+    }
+    case 'b': {
+        BinaryIntOp binOp;
+        if (!op(arg, static_cast<int>(BinaryIntOp::Subtract), binOp)) {
+            return nullptr;
+        }
+        auto first = expr();
+        auto second = first ? expr() : nullptr;
+        if (!second) {
+            return nullptr;
+        }
+        return make_shared<BinaryIntExpr<VariablePlaceholder>>(
+            binOp, makeMonoPair(first, second));
+    }
+    default:
+        return nullptr;
+    }
+}
+
+shared_ptr<HeapPattern<VariablePlaceholder>> PatternReader::pattern() {
+    string token;
+    if (!(tokens >> token)) {
+        return nullptr;
+    }
+    const string arg = token.substr(1);
+    switch (token[0]) {
+    case 'B': {
+        BinaryBooleanOp binOp;
+        if (!op(arg, static_cast<int>(BinaryBooleanOp::Impl), binOp)) {
+            return nullptr;
+        }
+        auto first = pattern();
+        auto second = first ? pattern() : nullptr;
+        if (!second) {
+            return nullptr;
+        }
+        return make_shared<BinaryHeapPattern<VariablePlaceholder>>(
+            binOp, makeMonoPair(first, second));
+    }
+    case 'N': {
+        auto negated = pattern();
+        if (!negated) {
+            return nullptr;
+        }
+        return make_shared<UnaryHeapPattern<VariablePlaceholder>>(
+            UnaryBooleanOp::Neg, negated);
+    }
+    case 'E':
+        return make_shared<HeapEqual<VariablePlaceholder>>();
+    case 'R': {
+        RangeQuantifier quant;
+        size_t index;
+        string indexToken;
+        if (!op(arg, static_cast<int>(RangeQuantifier::Any), quant) ||
+            !(tokens >> indexToken) || !parseNumber(indexToken, index)) {
+            return nullptr;
+        }
+        auto lower = expr();
+        auto upper = lower ? expr() : nullptr;
+        auto pat = upper ? pattern() : nullptr;
+        if (!pat) {
+            return nullptr;
+        }
+        return make_shared<RangeProp<VariablePlaceholder>>(
+            quant, makeMonoPair(lower, upper), index, pat);
+    }
+    case 'P': {
+        BinaryIntProp prop;
+        if (!op(arg, static_cast<int>(BinaryIntProp::GT), prop)) {
+            return nullptr;
+        }
+        auto first = expr();
+        auto second = first ? expr() : nullptr;
+        if (!second) {
+            return nullptr;
+        }
+        return make_shared<HeapExprProp<VariablePlaceholder>>(
+            prop, makeMonoPair(first, second));
+    }
+    default:
+        return nullptr;
+    }
+}
+
+bool deserializePatterns(const string &data, PatternList &patterns) {
+    std::istringstream lines(data);
+    string line;
+    if (!std::getline(lines, line) || line != PatternFormatVersion) {
+        return false;
+    }
+    PatternList result;
+    while (std::getline(lines, line)) {
+        PatternReader reader(line);
+        auto pattern = reader.pattern();
+        if (!pattern || !reader.atEnd()) {
+            return false;
+        }
+        result.push_back(std::move(pattern));
+    }
+    patterns = std::move(result);
+    return true;
+}
+
+static void checkPatternFile(const string &fileName) {
+    // fopen doesn’t signal if the path points to a directory, thus we have to
+    // check for that separately and to catch the error.
+    struct stat s;
+    int ret = stat(fileName.c_str(), &s);
+    if (ret != 0) {
+        logError("Couldn’t open pattern file\n");
+        exit(1);
+    }
+    if (s.st_mode & S_IFDIR) {
+        logError("Pattern file points to a directory\n");
+        exit(1);
+    }
+}
+
+static PatternList parsePatternFile(const string &fileName) {
+    FILE *patternFile = fopen(fileName.c_str(), "r");
+    if (patternFile == nullptr) {
+        logError("Couldn’t open pattern file\n");
+        exit(1);
+    }
+    auto patterns = parsePatterns(patternFile);
+    fclose(patternFile);
+    if (!validatePatterns(patterns)) {
+        exit(1);
+    }
+    return patterns;
+}
+
+static string patternCachePath(const string &cacheDir,
+                               const string &contents) {
+    llvm::MD5 hash;
+    hash.update(PatternFormatVersion);
+    hash.update(contents);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    llvm::SmallString<128> path(cacheDir);
+    llvm::sys::path::append(path, hexResult.str() + ".patterns");
+    return path.str().str();
+}
+
+static void storeCachedPatterns(const string &path,
+                                const PatternList &patterns) {
+    std::ostringstream serialized;
+    if (!serializePatterns(patterns, serialized)) {
+        return;
+    }
+    // Write to a temporary file first so that concurrent runs never see
+    // partially written patterns
+    int fd;
+    llvm::SmallString<128> tmpPath;
+    if (std::error_code errorCode = llvm::sys::fs::createUniqueFile(
+            path + ".tmp-%%%%%%", fd, tmpPath)) {
+        logWarning("Couldn’t write to pattern cache: " + errorCode.message() +
+                   "\n");
+        return;
+    }
+    {
+        llvm::raw_fd_ostream stream(fd, true);
+        stream << serialized.str();
+    }
+    if (llvm::sys::fs::rename(tmpPath, path)) {
+        llvm::sys::fs::remove(tmpPath);
+    }
+}
+
+static string readFile(const string &fileName) {
+    std::ifstream stream(fileName);
+    return string((std::istreambuf_iterator<char>(stream)),
+                  std::istreambuf_iterator<char>());
+}
+
+PatternSet loadPatterns(const string &fileName, const string &cacheDir) {
+    checkPatternFile(fileName);
+    if (cacheDir.empty()) {
+        return PatternSet(parsePatternFile(fileName));
+    }
+    std::ifstream fileStream(fileName);
+    if (!fileStream) {
+        logError("Couldn’t open pattern file\n");
+        exit(1);
+    }
+    const string contents((std::istreambuf_iterator<char>(fileStream)),
+                          std::istreambuf_iterator<char>());
+    const string path = patternCachePath(cacheDir, contents);
+    PatternList patterns;
+    // Only validated patterns are stored, a corrupted entry is parsed again
+    if (std::ifstream(path) && deserializePatterns(readFile(path), patterns)) {
+        stats::count("patterns.cache hits");
+        return PatternSet(std::move(patterns));
+    }
+    patterns = parsePatternFile(fileName);
+    if (std::error_code errorCode =
+            llvm::sys::fs::create_directories(cacheDir)) {
+        logWarning("Couldn’t create pattern cache directory: " +
+                   errorCode.message() + "\n");
+    } else {
+        storeCachedPatterns(path, patterns);
+    }
+    return PatternSet(std::move(patterns));
+}
+}
+}
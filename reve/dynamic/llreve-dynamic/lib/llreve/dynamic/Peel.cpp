@@ -18,18 +18,16 @@ using llvm::ValueToValueMapTy;
 using llvm::BasicBlock;
 using llvm::BranchInst;
 
-void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
-                std::string prefix) {
-    assert(marks.MarkToBlocksMap.at(mark).size() ==
-           1); // For now we assume that there is only block per mark
-    BasicBlock *markedBlock = *marks.MarkToBlocksMap.at(mark).begin();
-    set<BasicBlock *> loopBlocks = blocksInLoop(markedBlock, marks);
-    set<llvm::Instruction *> loopInstructions;
-    for (auto bb : loopBlocks) {
-        for (llvm::Instruction &i : *bb) {
-            loopInstructions.insert(&i);
-        }
-    }
+// Instructions are part of the loop if their block is, no set of them is
+// needed. The blocks outside of the loop that are changed are added to
+// 'changedBlocks'.
+static void peelLoop(llvm::Function &f, BasicBlock *markedBlock, Mark mark,
+                     LoopStructure &loops, std::string prefix,
+                     set<BasicBlock *> &changedBlocks) {
+    set<BasicBlock *> loopBlocks = loops.loopBlocks(markedBlock);
+    auto inLoop = [&loopBlocks](llvm::Instruction *instr) {
+        return loopBlocks.count(instr->getParent()) > 0;
+    };
 
     // Create a preheader
     vector<BasicBlock *> outsideBlocks;
@@ -42,13 +40,12 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
         }
     }
 
+    changedBlocks.insert(outsideBlocks.begin(), outsideBlocks.end());
+
     BasicBlock *preHeader = createPreheader(markedBlock, outsideBlocks);
     BasicBlock *backEdge =
         createUniqueBackedge(markedBlock, preHeader, backedgeBlocks, f);
     loopBlocks.insert(backEdge);
-    for (auto &i : *backEdge) {
-        loopInstructions.insert(&i);
-    }
 
     BasicBlock *prologPreHeader = SplitEdge(preHeader, markedBlock);
     prologPreHeader->setName(markedBlock->getName() + ".prol.preheader");
@@ -135,7 +132,7 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
             llvm::PHINode *newPN =
                 llvm::PHINode::Create(pn->getType(), 2, pn->getName() + ".unr",
                                       prologExit->getFirstNonPHI());
-            if (loopInstructions.count(pn) > 0) {
+            if (inLoop(pn)) {
                 // TODO Do I really need this?
                 // newPN->addIncoming(pn->getIncomingValueForBlock(newPreHeader),
                 //                    preHeader);
@@ -147,14 +144,14 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
             llvm::Value *v = pn->getIncomingValueForBlock(latch);
             if (llvm::Instruction *I = llvm::dyn_cast<llvm::Instruction>(v)) {
                 // If it was not a constant find the mapping
-                if (loopInstructions.count(I) > 0) {
+                if (inLoop(I)) {
                     v = vmap.lookup(I);
                 }
             }
 
             newPN->addIncoming(v, prologLatch);
 
-            if (loopInstructions.count(pn) > 0) {
+            if (inLoop(pn)) {
                 pn->setIncomingValue(
                     static_cast<uint32_t>(pn->getBasicBlockIndex(newPreHeader)),
                     newPN);
@@ -178,6 +175,7 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
         }
         // Split all edges that go outside of the loop
         for (auto target : edgeTargets) {
+            changedBlocks.insert(target);
             BasicBlock *newBB = llvm::cast<llvm::BasicBlock>(vmap[bb]);
             // SplitEdge segfaults if the phi nodes in target are not valid
             // To make them valid at this point we need to add incoming values
@@ -222,9 +220,6 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
     // Split the original markedBlock since we want to use a switch here
     BasicBlock *split = SplitBlock(markedBlock, markedBlock->getTerminator());
     loopBlocks.insert(split);
-    for (auto &instr : *split) {
-        loopInstructions.insert(&instr);
-    }
 
     // Create a phi node with the index of the loop exit
     llvm::PHINode *exitIndex =
@@ -277,9 +272,10 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
     }
 
     // We cloned instructions so we need to merge their uses outside of the loop
+    llvm::SmallVector<llvm::PHINode *, 8> insertedPhis;
     for (auto bb : loopBlocks) {
         for (auto &instr : *bb) {
-            llvm::SSAUpdater ssaUpdate;
+            llvm::SSAUpdater ssaUpdate(&insertedPhis);
             if (instr.getType()->isVoidTy() || !vmap[&instr])
                 continue;
             llvm::Instruction *otherInstr =
@@ -302,9 +298,10 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
                 if (!user) {
                     continue;
                 }
-                if (loopInstructions.count(user) == 0) {
+                if (!inLoop(user)) {
                     // Find uses outside the loop
                     usesOutsideLoop.push_back(&use);
+                    changedBlocks.insert(user->getParent());
                 }
             }
             for (auto use : usesOutsideLoop) {
@@ -312,4 +309,17 @@ void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
             }
         }
     }
+    for (auto phi : insertedPhis) {
+        changedBlocks.insert(phi->getParent());
+    }
+}
+
+void peelAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
+                LoopStructure &loops, std::string prefix) {
+    // Each block of the mark is the header of its own loop
+    for (auto markedBlock : marks.MarkToBlocksMap.at(mark)) {
+        set<BasicBlock *> changedBlocks;
+        peelLoop(f, markedBlock, mark, loops, prefix, changedBlocks);
+        loops.transformed(markedBlock, changedBlocks);
+    }
 }
@@ -2,6 +2,8 @@
 
 #include "llreve/dynamic/Util.h"
 
+#include "llvm/ADT/StringMap.h"
+
 using std::vector;
 using std::string;
 
@@ -11,146 +13,284 @@ using smt::SortedVar;
 namespace llreve {
 namespace dynamic {
 
-static mpz_class evalTerm(const std::vector<std::string> &term,
-                          const VarMap<string> &variables) {
+EquationTemplate::EquationTemplate(const vector<SortedVar> &variables,
+                                   size_t degree, size_t numExtraValues)
+    : degree(degree), numExtraValues(numExtraValues) {
+    assert(numExtraValues <= variables.size());
+    for (const auto &var : variables) {
+        names.push_back(var.name);
+    }
+    for (size_t i = 1; i <= degree; ++i) {
+        forEachPolynomialTerm(variables.size(), i,
+                              [&](llvm::ArrayRef<size_t> indices) {
+                                  terms.emplace_back(indices.begin(),
+                                                     indices.end());
+                              });
+    }
+}
+
+auto EquationTemplate::fits(size_t numVariables, size_t degree) const
+    -> bool {
+    return names.size() == numVariables && this->degree == degree;
+}
+
+void EquationTemplate::resolve(llvm::ArrayRef<const FastVarMap *> states) {
+    size_t numStateVariables = names.size() - numExtraValues;
+    llvm::StringMap<size_t> indices;
+    for (size_t i = 0; i < numStateVariables; ++i) {
+        indices.insert({names[i], i});
+    }
+    slots.assign(numStateVariables, {0, nullptr});
+    // Walk the states backwards so that earlier states take precedence
+    for (size_t state = states.size(); state-- > 0;) {
+        for (const auto &varIt : *states[state]) {
+            auto indexIt = indices.find(varIt.first->getName());
+            if (indexIt != indices.end()) {
+                slots[indexIt->second] = {state, varIt.first};
+            }
+        }
+    }
+    for (size_t i = 0; i < numStateVariables; ++i) {
+        if (slots[i].value == nullptr) {
+            logError("Variable " + names[i] + " is not part of the state\n");
+            exit(1);
+        }
+    }
+}
+
+static auto evalTerm(llvm::ArrayRef<uint32_t> term,
+                     const vector<const Integer *> &values) -> mpq_class {
+    int64_t small = 1;
+    size_t i = 0;
+    for (; i < term.size(); ++i) {
+        const Integer &val = *values[term[i]];
+        if (!val.isSmall() ||
+            __builtin_mul_overflow(small, val.small, &small)) {
+            break;
+        }
+    }
+    if (i == term.size()) {
+        return mpq_class(static_cast<long>(small));
+    }
     mpz_class termVal = 1;
-    for (const auto &var : term) {
-        termVal *= variables.find(var)->second.asUnbounded();
+    for (uint32_t var : term) {
+        termVal *= values[var]->asUnbounded();
+    }
+    return mpq_class(termVal);
+}
+
+auto EquationTemplate::load(llvm::ArrayRef<const FastVarMap *> states,
+                            llvm::ArrayRef<const Integer *> extraValues,
+                            const ExitIndex &exitIndex, LoopInfo loopInfo)
+    -> bool {
+    assert(extraValues.size() == numExtraValues);
+    if (slots.empty() && names.size() > numExtraValues) {
+        resolve(states);
+    }
+    values.resize(names.size());
+    for (size_t i = 0; i < slots.size(); ++i) {
+        auto valIt = states[slots[i].state]->find(slots[i].value);
+        assert(valIt != states[slots[i].state]->end());
+        values[i] = &valIt->second;
     }
-    return termVal;
+    std::copy(extraValues.begin(), extraValues.end(),
+              values.begin() + slots.size());
+    vector<Integer> sample;
+    sample.reserve(values.size());
+    for (const Integer *value : values) {
+        sample.push_back(*value);
+    }
+    return samples[{exitIndex, loopInfo}].insert(std::move(sample)).second;
 }
 
-static vector<mpq_class>
-createEquation(const vector<SortedVar> &primitiveVariables,
-               const VarMap<string> &variables, unsigned maxDegree) {
+static auto evalTerms(llvm::ArrayRef<llvm::SmallVector<uint32_t, 4>> terms,
+                      const vector<const Integer *> &values)
+    -> vector<mpq_class> {
     vector<mpq_class> equation;
-    for (size_t i = 1; i <= maxDegree; ++i) {
-        auto polynomialTerms = polynomialTermsOfDegree(primitiveVariables, i);
-        for (const auto &term : polynomialTerms) {
-            equation.push_back(evalTerm(term, variables));
-        }
+    equation.reserve(terms.size() + 1);
+    for (const auto &term : terms) {
+        equation.push_back(evalTerm(term, values));
     }
     // this represents the constant
     equation.push_back(1);
     return equation;
 }
 
-static void insertInStringMap(const FastVarMap &variables,
-                              VarMap<string> &stringVariables) {
-    for (const auto &varIt : variables) {
-        stringVariables.insert({varIt.first->getName(), varIt.second});
+auto EquationTemplate::evaluate() const -> vector<mpq_class> {
+    return evalTerms(terms, values);
+}
+
+auto EquationTemplate::withDegree(const vector<SortedVar> &variables,
+                                  size_t degree) const -> EquationTemplate {
+    EquationTemplate result(variables, degree, numExtraValues);
+    result.samples = samples;
+    return result;
+}
+
+void EquationTemplate::forEachSampleEquation(
+    llvm::function_ref<void(const ExitIndex &, LoopInfo, vector<mpq_class>)>
+        f) const {
+    vector<const Integer *> sampleValues;
+    for (const auto &samplesIt : samples) {
+        for (const auto &sample : samplesIt.second) {
+            sampleValues.clear();
+            for (const Integer &value : sample) {
+                sampleValues.push_back(&value);
+            }
+            f(samplesIt.first.first, samplesIt.first.second,
+              evalTerms(terms, sampleValues));
+        }
     }
 }
 
-static VarMap<string> getStringVarMap(const FastVarMap &variables) {
-    VarMap<string> stringVariables(variables.size());
-    insertInStringMap(variables, stringVariables);
-    return stringVariables;
+template <typename K>
+static auto getTemplate(std::map<K, EquationTemplate> &templates, const K &key,
+                        const vector<SortedVar> &variables, size_t degree,
+                        size_t numExtraValues) -> EquationTemplate & {
+    auto &equationTemplate = templates[key];
+    if (!equationTemplate.fits(variables.size(), degree)) {
+        equationTemplate = EquationTemplate(variables, degree, numExtraValues);
+    }
+    return equationTemplate;
 }
 
-static VarMap<string> getStringVarMap(const FastVarMap &variables1,
-                                      const FastVarMap &variables2) {
-    VarMap<string> stringVariables(variables1.size() + variables2.size());
-    insertInStringMap(variables1, stringVariables);
-    insertInStringMap(variables2, stringVariables);
-    return stringVariables;
+// The postcondition additionally refers to the return values
+static auto getTemplates(
+    std::map<Mark, FunctionInvariant<EquationTemplate>> &templates, Mark mark,
+    const vector<SortedVar> &primitiveVariables,
+    const vector<string> &resultNames, size_t degree)
+    -> FunctionInvariant<EquationTemplate> & {
+    auto &equationTemplates = templates[mark];
+    if (!equationTemplates.preCondition.fits(primitiveVariables.size(),
+                                             degree)) {
+        vector<SortedVar> postVariables = primitiveVariables;
+        for (const auto &name : resultNames) {
+            postVariables.emplace_back(name, int64Type());
+        }
+        equationTemplates.preCondition =
+            EquationTemplate(primitiveVariables, degree, 0);
+        equationTemplates.postCondition =
+            EquationTemplate(postVariables, degree, resultNames.size());
+    }
+    return equationTemplates;
 }
 
-void populateEquationsMap(
+bool populateEquationsMap(
     IterativeInvariantMap<PolynomialEquations> &polynomialEquations,
+    EquationTemplates &templates,
     const vector<smt::SortedVar> &primitiveVariables,
     MatchInfo<const llvm::Value *> match, ExitIndex exitIndex, size_t degree) {
-    VarMap<string> variables =
-        getStringVarMap(match.steps.first->state.variables,
-                        match.steps.second->state.variables);
-    vector<mpq_class> equation =
-        createEquation(primitiveVariables, variables, degree);
-    if (polynomialEquations[match.mark].count(exitIndex) == 0) {
-        polynomialEquations.at(match.mark)
-            .insert(make_pair(exitIndex,
-                              LoopInfoData<Matrix<mpq_class>>({}, {}, {})));
-        getDataForLoopInfo(polynomialEquations.at(match.mark).at(exitIndex),
-                           match.loopInfo) = {equation};
-    } else {
-        Matrix<mpq_class> &vecs = getDataForLoopInfo(
-            polynomialEquations.at(match.mark).at(exitIndex), match.loopInfo);
-        if (linearlyIndependent(vecs, equation)) {
-            vecs.push_back(equation);
-            reducedRowEchelonForm(vecs);
-        }
+    auto &equationTemplate = getTemplate(templates.iterative, match.mark,
+                                         primitiveVariables, degree, 0);
+    if (!equationTemplate.load({&match.steps.first->state().variables,
+                                &match.steps.second->state().variables},
+                               {}, exitIndex, match.loopInfo)) {
+        return false;
+    }
+    vector<mpq_class> equation = equationTemplate.evaluate();
+    auto &equationsForMark = polynomialEquations[match.mark];
+    auto equationsIt = equationsForMark.find(exitIndex);
+    if (equationsIt == equationsForMark.end()) {
+        equationsIt =
+            equationsForMark
+                .insert(make_pair(exitIndex,
+                                  LoopInfoData<Matrix<mpq_class>>({}, {}, {})))
+                .first;
+    }
+    return insertIntoRowEchelonForm(
+        getDataForLoopInfo(equationsIt->second, match.loopInfo),
+        std::move(equation));
+}
+
+void raiseDegree(
+    IterativeInvariantMap<PolynomialEquations> &polynomialEquations,
+    EquationTemplates &templates, const vector<SortedVar> &primitiveVariables,
+    Mark mark, size_t degree) {
+    auto templateIt = templates.iterative.find(mark);
+    if (templateIt == templates.iterative.end()) {
+        return;
     }
+    templateIt->second =
+        templateIt->second.withDegree(primitiveVariables, degree);
+    // The rows of the old degree have fewer columns
+    auto &equationsForMark = polynomialEquations[mark];
+    equationsForMark.clear();
+    templateIt->second.forEachSampleEquation(
+        [&](const ExitIndex &exitIndex, LoopInfo loopInfo,
+            vector<mpq_class> equation) {
+            auto equationsIt =
+                equationsForMark
+                    .insert({exitIndex, PolynomialEquations({}, {}, {})})
+                    .first;
+            insertIntoRowEchelonForm(
+                getDataForLoopInfo(equationsIt->second, loopInfo),
+                std::move(equation));
+        });
 }
 
 void populateEquationsMap(
     RelationalFunctionInvariantMap<
         LoopInfoData<FunctionInvariant<Matrix<mpq_class>>>> &equationsMap,
+    EquationTemplates &templates,
     const vector<SortedVar> &primitiveVariables,
     CoupledCallInfo<const llvm::Value *> match, size_t degree) {
     auto &polynomialEquations = equationsMap[match.functions];
-    VarMap<string> variables =
-        getStringVarMap(match.steps.first->state.variables,
-                        match.steps.second->state.variables);
-    variables.insert({resultName(Program::First), match.returnValues.first});
-    variables.insert({resultName(Program::Second), match.returnValues.second});
-    vector<smt::SortedVar> preVariables = primitiveVariables;
-    vector<smt::SortedVar> postVariables = preVariables;
-    postVariables.emplace_back(resultName(Program::First), int64Type());
-    postVariables.emplace_back(resultName(Program::Second), int64Type());
-    vector<mpq_class> preEquation =
-        createEquation(preVariables, variables, degree);
-    vector<mpq_class> postEquation =
-        createEquation(postVariables, variables, degree);
+    auto &equationTemplates =
+        getTemplates(templates.relational[match.functions], match.mark,
+                     primitiveVariables,
+                     {resultName(Program::First), resultName(Program::Second)},
+                     degree);
+    const FastVarMap *states[] = {&match.steps.first->state().variables,
+                                  &match.steps.second->state().variables};
+    const bool newPreSample = equationTemplates.preCondition.load(
+        states, {}, 0, match.loopInfo);
+    const bool newPostSample = equationTemplates.postCondition.load(
+        states, {&match.returnValues.first, &match.returnValues.second}, 0,
+        match.loopInfo);
     if (polynomialEquations.count(match.mark) == 0) {
         polynomialEquations.insert(
             {match.mark, {{{}, {}}, {{}, {}}, {{}, {}}}});
-        getDataForLoopInfo(polynomialEquations.at(match.mark),
-                           match.loopInfo) = {{preEquation}, {postEquation}};
-    } else {
-        auto &vecsRef = getDataForLoopInfo(polynomialEquations.at(match.mark),
-                                           match.loopInfo);
-        auto &preVecs = vecsRef.preCondition;
-        auto &postVecs = vecsRef.postCondition;
-        if (linearlyIndependent(preVecs, preEquation)) {
-            preVecs.push_back(preEquation);
-            reducedRowEchelonForm(preVecs);
-        }
-        if (linearlyIndependent(postVecs, postEquation)) {
-            postVecs.push_back(postEquation);
-            reducedRowEchelonForm(postVecs);
-        }
+    }
+    auto &vecsRef =
+        getDataForLoopInfo(polynomialEquations.at(match.mark), match.loopInfo);
+    if (newPreSample) {
+        insertIntoRowEchelonForm(vecsRef.preCondition,
+                                 equationTemplates.preCondition.evaluate());
+    }
+    if (newPostSample) {
+        insertIntoRowEchelonForm(vecsRef.postCondition,
+                                 equationTemplates.postCondition.evaluate());
     }
 }
 
 void populateEquationsMap(FunctionInvariantMap<Matrix<mpq_class>> &equationsMap,
+                          EquationTemplates &templates,
                           const vector<SortedVar> &primitiveVariables,
                           UncoupledCallInfo<const llvm::Value *> match,
                           size_t degree) {
     auto &polynomialEquations = equationsMap[match.function];
-    VarMap<string> variables = getStringVarMap(match.step->state.variables);
-    variables.insert({resultName(match.prog), match.returnValue});
-    vector<smt::SortedVar> preVariables = primitiveVariables;
-    vector<smt::SortedVar> postVariables = preVariables;
-    postVariables.emplace_back(resultName(match.prog), int64Type());
-    vector<mpq_class> preEquation =
-        createEquation(preVariables, variables, degree);
-    vector<mpq_class> postEquation =
-        createEquation(postVariables, variables, degree);
+    auto &equationTemplates =
+        getTemplates(templates.functional[match.function], match.mark,
+                     primitiveVariables, {resultName(match.prog)}, degree);
+    const FastVarMap *state = &match.step->state().variables;
+    // Uncoupled calls have no loop info
+    const bool newPreSample = equationTemplates.preCondition.load(
+        state, {}, 0, LoopInfo::None);
+    const bool newPostSample = equationTemplates.postCondition.load(
+        state, &match.returnValue, 0, LoopInfo::None);
     auto polynomialEquationsIt = polynomialEquations.find(match.mark);
     if (polynomialEquationsIt == polynomialEquations.end()) {
-        polynomialEquations.insert(
-            {match.mark, {{preEquation}, {postEquation}}});
-    } else {
-        auto &equationsForMark = polynomialEquationsIt->second;
-        auto &preVecs = equationsForMark.preCondition;
-        auto &postVecs = equationsForMark.postCondition;
-        if (linearlyIndependent(preVecs, preEquation)) {
-            preVecs.push_back(preEquation);
-            reducedRowEchelonForm(preVecs);
-        }
-        if (linearlyIndependent(postVecs, postEquation)) {
-            postVecs.push_back(postEquation);
-            reducedRowEchelonForm(postVecs);
-        }
+        polynomialEquationsIt =
+            polynomialEquations.insert({match.mark, {{}, {}}}).first;
+    }
+    auto &equationsForMark = polynomialEquationsIt->second;
+    if (newPreSample) {
+        insertIntoRowEchelonForm(equationsForMark.preCondition,
+                                 equationTemplates.preCondition.evaluate());
+    }
+    if (newPostSample) {
+        insertIntoRowEchelonForm(equationsForMark.postCondition,
+                                 equationTemplates.postCondition.evaluate());
     }
 }
 }
@@ -0,0 +1,200 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llreve/dynamic/Sampling.h"
+
+#include <algorithm>
+
+using std::set;
+using std::string;
+using std::vector;
+
+namespace llreve {
+namespace dynamic {
+
+auto parseSamplingStrategy(const string &name, SamplingStrategy &strategy)
+    -> bool {
+    if (name == "random") {
+        strategy = SamplingStrategy::Random;
+    } else if (name == "boundary") {
+        strategy = SamplingStrategy::Boundary;
+    } else if (name == "coverage") {
+        strategy = SamplingStrategy::Coverage;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+InputSampler::InputSampler(SamplingOpts opts, size_t numArgs)
+    : opts(std::move(opts)), numArgs(numArgs), gen(std::random_device()()),
+      seenBlockPairs(set<BlockPair>(), set<BlockPair>()) {
+    if (numArgs == 0) {
+        // All examples are the same
+        this->opts.maxExamples = std::min(this->opts.maxExamples, 1u);
+    }
+    const mpz_class &lower = this->opts.lowerBound;
+    const mpz_class &upper = this->opts.upperBound;
+    for (mpz_class val :
+         {mpz_class(lower), mpz_class(lower + 1), mpz_class(-1), mpz_class(0),
+          mpz_class(1), mpz_class((lower + upper) / 2), mpz_class(upper - 1),
+          mpz_class(upper)}) {
+        if (val >= lower && val <= upper) {
+            boundaryValues.push_back(val);
+        }
+    }
+    std::sort(boundaryValues.begin(), boundaryValues.end());
+    boundaryValues.erase(
+        std::unique(boundaryValues.begin(), boundaryValues.end()),
+        boundaryValues.end());
+    if (!boundaryValues.empty()) {
+        boundaryIndices.resize(numArgs, 0);
+    }
+}
+
+auto InputSampler::clamp(mpz_class val) const -> mpz_class {
+    if (val < opts.lowerBound) {
+        return opts.lowerBound;
+    }
+    if (val > opts.upperBound) {
+        return opts.upperBound;
+    }
+    return val;
+}
+
+auto InputSampler::randomExample() -> Example {
+    Example example(numArgs);
+    mpz_class range = opts.upperBound - opts.lowerBound + 1;
+    for (auto &val : example) {
+        // The ranges we use are small, so this is not biased in practice
+        val = opts.lowerBound + mpz_class(gen()) % range;
+    }
+    return example;
+}
+
+// Counts through all combinations of the boundary values
+auto InputSampler::nextBoundaryExample(Example &example) -> bool {
+    if (boundaryIndices.empty()) {
+        return false;
+    }
+    example.resize(numArgs);
+    for (size_t i = 0; i < numArgs; ++i) {
+        example[i] = boundaryValues[boundaryIndices[i]];
+    }
+    size_t i = 0;
+    for (; i < numArgs; ++i) {
+        if (++boundaryIndices[i] < boundaryValues.size()) {
+            break;
+        }
+        boundaryIndices[i] = 0;
+    }
+    if (i == numArgs) {
+        boundaryIndices.clear();
+    }
+    return true;
+}
+
+auto InputSampler::mutate(const Example &example) -> Example {
+    Example result = example;
+    if (result.empty()) {
+        return result;
+    }
+    auto &val = result[gen() % result.size()];
+    mpz_class step = std::max<mpz_class>(
+        1, mpz_class((opts.upperBound - opts.lowerBound) / 10));
+    switch (gen() % 6) {
+    case 0:
+        val += 1;
+        break;
+    case 1:
+        val -= 1;
+        break;
+    case 2:
+        val += step;
+        break;
+    case 3:
+        val -= step;
+        break;
+    case 4:
+        val *= 2;
+        break;
+    default:
+        val /= 2;
+        break;
+    }
+    val = clamp(val);
+    return result;
+}
+
+auto InputSampler::nextBatch() -> vector<Example> {
+    vector<Example> batch;
+    if (done || examplesUsed >= opts.maxExamples) {
+        return batch;
+    }
+    unsigned size = std::min(opts.batchSize, opts.maxExamples - examplesUsed);
+    for (unsigned i = 0; i < size; ++i) {
+        Example example;
+        switch (opts.strategy) {
+        case SamplingStrategy::Random:
+            example = randomExample();
+            break;
+        case SamplingStrategy::Boundary:
+            if (!nextBoundaryExample(example)) {
+                example = randomExample();
+            }
+            break;
+        case SamplingStrategy::Coverage:
+            // Every other example is random so we don’t get stuck if the
+            // neighbourhood of the interesting examples is exhausted
+            if (!interestingExamples.empty() && i % 2 == 0) {
+                example = mutate(
+                    interestingExamples[gen() % interestingExamples.size()]);
+            } else {
+                example = randomExample();
+            }
+            break;
+        }
+        batch.push_back(std::move(example));
+    }
+    examplesUsed += size;
+    interestingExamples.clear();
+    return batch;
+}
+
+static void insertBlockPairs(const set<InputSampler::BlockPair> &newPairs,
+                             set<InputSampler::BlockPair> &pairs,
+                             bool &newPair) {
+    for (const auto &blockPair : newPairs) {
+        newPair |= pairs.insert(blockPair).second;
+    }
+}
+
+void InputSampler::recordCoverage(
+    const Example &example, const MonoPair<set<BlockPair>> &blockPairs) {
+    if (opts.strategy != SamplingStrategy::Coverage) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(coverageMutex);
+    bool newPair = false;
+    insertBlockPairs(blockPairs.first, seenBlockPairs.first, newPair);
+    insertBlockPairs(blockPairs.second, seenBlockPairs.second, newPair);
+    if (newPair) {
+        interestingExamples.push_back(example);
+    }
+}
+
+void InputSampler::finishBatch(bool resultChanged) {
+    unchangedBatches = resultChanged ? 0 : unchangedBatches + 1;
+    if (opts.stableBatches > 0 && unchangedBatches >= opts.stableBatches) {
+        done = true;
+    }
+}
+}
+}
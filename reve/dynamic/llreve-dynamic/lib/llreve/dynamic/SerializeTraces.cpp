@@ -13,58 +13,683 @@
 #include "llreve/dynamic/Interpreter.h"
 #include "llreve/dynamic/ThreadSafeQueue.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <thread>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueSymbolTable.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
 using std::vector;
 using std::string;
 using std::make_shared;
 using std::map;
 
 using llvm::Function;
+using llvm::StringRef;
+
+using namespace llreve::dynamic;
+
+static const char TraceMagic[] = {'L', 'L', 'R', 'T'};
+static const uint8_t TraceVersion = 2;
+
+enum class IntegerTag : uint8_t { Small, Big, Bounded, WideBounded };
 
-Range::RangeIterator Range::begin() {
-    vector<mpz_class> vals(n);
-    if (n == 0) {
-        return RangeIterator(lowerBound, upperBound, vals);
+Range::Range(mpz_class lowerBound, mpz_class upperBound, size_t n)
+    : lowerBound(lowerBound), upperBound(upperBound), n(n),
+      radix(lowerBound > upperBound ? mpz_class(0)
+                                    : mpz_class(upperBound - lowerBound + 1)),
+      small(false), smallLowerBound(0), smallRadix(0), smallCount(0) {
+    mpz_pow_ui(count.get_mpz_t(), radix.get_mpz_t(), n);
+    small = lowerBound.fits_slong_p() && upperBound.fits_slong_p() &&
+            radix.fits_ulong_p() && count.fits_ulong_p();
+    if (small) {
+        smallLowerBound = lowerBound.get_si();
+        smallRadix = radix.get_ui();
+        smallCount = count.get_ui();
     }
-    if (lowerBound > upperBound) {
-        return end();
+}
+
+Range::RangeIterator::RangeIterator(const Range &range, const mpz_class &index)
+    : range(&range), index(index < range.count ? index : range.count),
+      smallIndex(0), vals(range.n) {
+    if (range.count == 0) {
+        return;
     }
-    for (size_t i = 0; i < vals.size(); ++i) {
-        vals[i] = lowerBound;
+    if (range.small) {
+        smallIndex = this->index.get_ui();
+        digits.resize(range.n);
+        uint64_t rest = smallIndex;
+        for (size_t i = 0; i < range.n; ++i) {
+            digits[i] = rest % range.smallRadix;
+            rest /= range.smallRadix;
+            // The sum fits since it is at most the upper bound, it is
+            // computed unsigned to avoid signed overflow
+            vals[i] = static_cast<long>(static_cast<int64_t>(
+                static_cast<uint64_t>(range.smallLowerBound) + digits[i]));
+        }
+        return;
+    }
+    mpz_class rest = this->index;
+    mpz_class digit;
+    for (size_t i = 0; i < range.n; ++i) {
+        mpz_fdiv_qr(rest.get_mpz_t(), digit.get_mpz_t(), rest.get_mpz_t(),
+                    range.radix.get_mpz_t());
+        vals[i] = range.lowerBound + digit;
     }
-    return RangeIterator(lowerBound, upperBound, vals);
 }
 
-Range::RangeIterator Range::end() {
-    vector<mpz_class> vals(n);
-    if (n == 0) {
-        return RangeIterator(lowerBound, upperBound, vals);
+Range::RangeIterator Range::begin() const { return RangeIterator(*this, 0); }
+
+Range::RangeIterator Range::end() const { return RangeIterator(*this, count); }
+
+Range::RangeIterator Range::at(const mpz_class &index) const {
+    return RangeIterator(*this, index);
+}
+
+auto Range::subRange(const mpz_class &first, const mpz_class &last) const
+    -> SubRange {
+    return SubRange(at(first), at(last < first ? first : last));
+}
+
+// Only the digits that change are updated, on average this is less than two
+Range::RangeIterator &Range::RangeIterator::operator++() {
+    if (range->small) {
+        ++smallIndex;
+        for (size_t i = 0; i < digits.size(); ++i) {
+            if (++digits[i] < range->smallRadix) {
+                vals[i] += 1;
+                return *this;
+            }
+            digits[i] = 0;
+            vals[i] = range->lowerBound;
+        }
+        return *this;
+    }
+    ++index;
+    for (size_t i = 0; i < vals.size(); ++i) {
+        if (vals[i] < range->upperBound) {
+            ++vals[i];
+            return *this;
+        }
+        vals[i] = range->lowerBound;
     }
-    vals[0] = upperBound + 1;
-    for (size_t i = 1; i < vals.size(); ++i) {
-        vals[i] = lowerBound;
+    return *this;
+}
+
+static void writeVarint(string &buf, uint64_t val) {
+    while (val >= 0x80) {
+        buf.push_back(static_cast<char>((val & 0x7f) | 0x80));
+        val >>= 7;
     }
-    return RangeIterator(lowerBound, upperBound, vals);
+    buf.push_back(static_cast<char>(val));
 }
 
-Range::RangeIterator &Range::RangeIterator::operator++() {
-    mpz_class carry = 1;
-    size_t index = 0;
-    while (carry == 1 && index < vals.size()) {
-        vals[index]++;
-        if (vals[index] == upperBound + 1) {
-            carry = 1;
-            vals[index] = lowerBound;
+static auto zigZag(int64_t val) -> uint64_t {
+    return (static_cast<uint64_t>(val) << 1) ^
+           static_cast<uint64_t>(val >> 63);
+}
+
+static auto unZigZag(uint64_t val) -> int64_t {
+    return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+}
+
+static void writeBytes(string &buf, StringRef bytes) {
+    writeVarint(buf, bytes.size());
+    buf.append(bytes.data(), bytes.size());
+}
+
+static void writeInteger(string &buf, const Integer &val) {
+    switch (val.type) {
+    case IntType::Unbounded:
+        if (val.isSmall()) {
+            buf.push_back(static_cast<char>(IntegerTag::Small));
+            writeVarint(buf, zigZag(val.small));
+        } else {
+            buf.push_back(static_cast<char>(IntegerTag::Big));
+            writeBytes(buf, val.big.get_str());
+        }
+        break;
+    case IntType::Bounded:
+        if (val.bounded.getBitWidth() <= 64) {
+            buf.push_back(static_cast<char>(IntegerTag::Bounded));
+            writeVarint(buf, val.bounded.getBitWidth());
+            writeVarint(buf, val.bounded.getZExtValue());
         } else {
-            carry = 0;
+            buf.push_back(static_cast<char>(IntegerTag::WideBounded));
+            writeVarint(buf, val.bounded.getBitWidth());
+            writeBytes(buf, val.bounded.toString(10, false));
         }
-        ++index;
+        break;
+    }
+}
+
+static void writeHeap(string &buf, const Heap &heap) {
+    writeInteger(buf, heap.background);
+    writeVarint(buf, heap.assignedValues.size());
+    heap.assignedValues.forEach(
+        [&buf](const HeapAddress &addr, const Integer &val) {
+            writeInteger(buf, addr);
+            writeInteger(buf, val);
+        });
+}
+
+TraceWriter::TraceWriter(const string &fileName, TraceFormat format)
+    : out(fileName, std::ios::binary), format(format) {
+    if (!out) {
+        logError("Couldn’t open trace file " + fileName + "\n");
+        exit(1);
     }
-    if (carry == 1) {
-        vals[0] = upperBound + 1;
+    if (format == TraceFormat::Binary) {
+        out.write(TraceMagic, sizeof(TraceMagic));
+        out.put(static_cast<char>(TraceVersion));
+    }
+}
+
+void TraceWriter::writeString(string &buf, StringRef str) {
+    auto it = strings.find(str);
+    if (it != strings.end()) {
+        writeVarint(buf, it->second);
+        return;
+    }
+    uint64_t id = strings.size();
+    strings.insert({str, id});
+    writeVarint(buf, id);
+    writeBytes(buf, str);
+}
+
+void TraceWriter::writeState(string &buf, const FastState &state) {
+    writeVarint(buf, state.variables.size());
+    for (const auto &var : state.variables) {
+        writeString(buf, var.first->getName());
+    }
+    for (const auto &var : state.variables) {
+        writeInteger(buf, var.second);
+    }
+    writeHeap(buf, state.heap);
+}
+
+// The steps are stored column by column
+void TraceWriter::writeCall(string &buf, const FastCall &call) {
+    writeString(buf, call.function ? call.function->getName() : "");
+    buf.push_back(static_cast<char>(call.earlyExit));
+    writeVarint(buf, call.blocksVisited);
+    writeState(buf, call.entryState);
+    writeState(buf, call.returnState);
+    writeVarint(buf, call.steps.size());
+    for (const auto &step : call.steps) {
+        writeString(buf, step.blockName);
+    }
+    for (const auto &step : call.steps) {
+        writeVarint(buf, step.stateDelta().variables.size());
+    }
+    for (const auto &step : call.steps) {
+        for (const auto &var : step.stateDelta().variables) {
+            writeString(buf, var.first->getName());
+        }
+    }
+    for (const auto &step : call.steps) {
+        for (const auto &var : step.stateDelta().variables) {
+            writeInteger(buf, var.second);
+        }
+    }
+    for (const auto &step : call.steps) {
+        buf.push_back(static_cast<char>(step.stateDelta().heap.hasValue()));
+    }
+    for (const auto &step : call.steps) {
+        if (step.stateDelta().heap) {
+            writeHeap(buf, *step.stateDelta().heap);
+        }
+    }
+    for (const auto &step : call.steps) {
+        writeVarint(buf, step.stateDelta().heapEvents.size());
+    }
+    for (const auto &step : call.steps) {
+        for (const auto &event : step.stateDelta().heapEvents) {
+            writeInteger(buf, event.address);
+            buf.push_back(static_cast<char>(event.oldValue.hasValue()));
+            if (event.oldValue) {
+                writeInteger(buf, *event.oldValue);
+            }
+            writeInteger(buf, event.newValue);
+        }
+    }
+    for (const auto &step : call.steps) {
+        writeVarint(buf, step.calls.size());
+    }
+    for (const auto &step : call.steps) {
+        for (const auto &nestedCall : step.calls) {
+            writeCall(buf, nestedCall);
+        }
+    }
+}
+
+void TraceWriter::write(const FastCall &call) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (format == TraceFormat::JSON) {
+        out << call.toJSON([](const llvm::Value *val) {
+                   return val->getName().str();
+               })
+            << "\n";
+        return;
+    }
+    string buf;
+    writeCall(buf, call);
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+TraceReader::TraceReader(
+    const string &fileName,
+    std::function<const llvm::Function *(StringRef)> lookupFunction)
+    : lookupFunction(std::move(lookupFunction)) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat s;
+    if (fd < 0 || fstat(fd, &s) != 0) {
+        logError("Couldn’t open trace file " + fileName + "\n");
+        exit(1);
+    }
+    size = static_cast<size_t>(s.st_size);
+    if (size > 0) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            logError("Couldn’t map trace file " + fileName + "\n");
+            exit(1);
+        }
+        data = static_cast<const uint8_t *>(mapped);
+    }
+    close(fd);
+    if (size < sizeof(TraceMagic) + 1 ||
+        !std::equal(TraceMagic, TraceMagic + sizeof(TraceMagic), data) ||
+        data[sizeof(TraceMagic)] != TraceVersion) {
+        logError("Not a binary trace file: " + fileName + "\n");
+        exit(1);
+    }
+    pos = sizeof(TraceMagic) + 1;
+}
+
+TraceReader::~TraceReader() {
+    if (data) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+}
+
+auto TraceReader::readVarint() -> uint64_t {
+    uint64_t val = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos >= size) {
+            break;
+        }
+        uint8_t byte = data[pos++];
+        val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return val;
+        }
+    }
+    logError("Truncated trace file\n");
+    exit(1);
+}
+
+auto TraceReader::readBytes(size_t count) -> StringRef {
+    if (count > size - pos) {
+        logError("Truncated trace file\n");
+        exit(1);
+    }
+    StringRef bytes(reinterpret_cast<const char *>(data + pos), count);
+    pos += count;
+    return bytes;
+}
+
+auto TraceReader::readString() -> StringRef {
+    uint64_t id = readVarint();
+    if (id == strings.size()) {
+        strings.push_back(readBytes(readVarint()).str());
+    } else if (id > strings.size()) {
+        logError("Invalid string reference in trace file\n");
+        exit(1);
+    }
+    return strings[id];
+}
+
+auto TraceReader::readInteger() -> Integer {
+    auto tag = static_cast<IntegerTag>(readBytes(1)[0]);
+    switch (tag) {
+    case IntegerTag::Small:
+        return Integer::fromSmall(unZigZag(readVarint()));
+    case IntegerTag::Big:
+        return Integer(mpz_class(readBytes(readVarint()).str()));
+    case IntegerTag::Bounded: {
+        auto width = static_cast<unsigned>(readVarint());
+        return Integer(llvm::APInt(width, readVarint()));
+    }
+    case IntegerTag::WideBounded: {
+        auto width = static_cast<unsigned>(readVarint());
+        return Integer(llvm::APInt(width, readBytes(readVarint()), 10));
+    }
+    }
+    logError("Invalid integer in trace file\n");
+    exit(1);
+}
+
+auto TraceReader::readHeap() -> Heap {
+    Heap heap;
+    heap.background = readInteger();
+    uint64_t entries = readVarint();
+    for (uint64_t i = 0; i < entries; ++i) {
+        Integer addr = readInteger();
+        heap.assignedValues.set(std::move(addr), readInteger());
+    }
+    return heap;
+}
+
+auto TraceReader::readState() -> State<string> {
+    State<string> state;
+    vector<StringRef> names(readVarint());
+    for (auto &name : names) {
+        name = readString();
+    }
+    for (const auto &name : names) {
+        state.variables.insert({name.str(), readInteger()});
+    }
+    state.heap = readHeap();
+    return state;
+}
+
+auto TraceReader::readCall() -> Call<string> {
+    const llvm::Function *function = lookupFunction(readString());
+    bool earlyExit = readBytes(1)[0] != 0;
+    auto blocksVisited = static_cast<uint32_t>(readVarint());
+    State<string> entryState = readState();
+    State<string> returnState = readState();
+
+    vector<StringRef> blockNames(readVarint());
+    for (auto &blockName : blockNames) {
+        blockName = readString();
+    }
+    vector<StateTrace<string>::Delta> deltas(blockNames.size());
+    vector<size_t> numVariables(blockNames.size());
+    for (auto &num : numVariables) {
+        num = readVarint();
+    }
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        for (size_t j = 0; j < numVariables[i]; ++j) {
+            deltas[i].variables.push_back({readString().str(), Integer()});
+        }
+    }
+    for (auto &delta : deltas) {
+        for (auto &var : delta.variables) {
+            var.second = readInteger();
+        }
+    }
+    vector<bool> heapChanged(deltas.size());
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        heapChanged[i] = readBytes(1)[0] != 0;
+    }
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        if (heapChanged[i]) {
+            deltas[i].heap = readHeap();
+        }
+    }
+    vector<size_t> numHeapEvents(deltas.size());
+    for (auto &num : numHeapEvents) {
+        num = readVarint();
+    }
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        for (size_t j = 0; j < numHeapEvents[i]; ++j) {
+            HeapEvent event;
+            event.address = readInteger();
+            if (readBytes(1)[0] != 0) {
+                event.oldValue = readInteger();
+            }
+            event.newValue = readInteger();
+            deltas[i].heapEvents.push_back(std::move(event));
+        }
+    }
+    vector<size_t> numCalls(deltas.size());
+    for (auto &num : numCalls) {
+        num = readVarint();
+    }
+
+    auto trace = std::make_shared<StateTrace<string>>();
+    vector<BlockStep<string>> steps;
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        size_t stateIndex = trace->push(std::move(deltas[i]));
+        vector<Call<string>> calls;
+        for (size_t j = 0; j < numCalls[i]; ++j) {
+            calls.push_back(readCall());
+        }
+        steps.emplace_back(blockNames[i], trace, stateIndex,
+                           std::move(calls));
+    }
+    return Call<string>(function, std::move(entryState),
+                        std::move(returnState), std::move(steps), earlyExit,
+                        blocksVisited);
+}
+
+auto TraceReader::next() -> llvm::Optional<Call<string>> {
+    if (pos >= size) {
+        return llvm::None;
+    }
+    return readCall();
+}
+
+namespace {
+// Feeds everything that is written to it into a hash
+class HashStream : public llvm::raw_ostream {
+    llvm::MD5 &hash;
+    uint64_t written = 0;
+    void write_impl(const char *ptr, size_t size) override {
+        hash.update(StringRef(ptr, size));
+        written += size;
+    }
+    uint64_t current_pos() const override { return written; }
+
+  public:
+    explicit HashStream(llvm::MD5 &hash) : hash(hash) {}
+    ~HashStream() override { flush(); }
+};
+}
+
+static auto hexDigest(llvm::MD5 &hash) -> string {
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    return hexResult.str().str();
+}
+
+static auto cacheEntryPath(const string &directory, const string &key)
+    -> string {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, key + ".trace");
+    return path.str().str();
+}
+
+TraceCache::TraceCache(string directory, MonoPair<const Function *> funs)
+    : directory(std::move(directory)), funs(funs) {
+    llvm::MD5 hash;
+    // Entries of other versions of the format are never looked up
+    hash.update(StringRef(TraceMagic, sizeof(TraceMagic)));
+    hash.update(TraceVersion);
+    {
+        HashStream stream(hash);
+        funs.first->getParent()->print(stream, nullptr);
+        stream << "\n" << funs.first->getName() << "\n";
+        funs.second->getParent()->print(stream, nullptr);
+        stream << "\n" << funs.second->getName() << "\n";
+    }
+    programHash = hexDigest(hash);
+}
+
+// The variables and heap locations are sorted since the order of the maps
+// depends on the addresses of the values
+static void writeKeyState(string &buf, const FastState &state) {
+    vector<string> entries;
+    for (const auto &var : state.variables) {
+        string entry;
+        writeBytes(entry, var.first->getName());
+        writeInteger(entry, var.second);
+        entries.push_back(std::move(entry));
+    }
+    std::sort(entries.begin(), entries.end());
+    writeVarint(buf, entries.size());
+    for (const auto &entry : entries) {
+        buf += entry;
+    }
+    entries.clear();
+    state.heap.assignedValues.forEach(
+        [&entries](const HeapAddress &addr, const Integer &val) {
+            string entry;
+            writeInteger(entry, addr);
+            writeInteger(entry, val);
+            entries.push_back(std::move(entry));
+        });
+    std::sort(entries.begin(), entries.end());
+    writeInteger(buf, state.heap.background);
+    writeVarint(buf, entries.size());
+    for (const auto &entry : entries) {
+        buf += entry;
+    }
+}
+
+auto TraceCache::key(const MonoPair<FastState> &entryStates,
+                     MonoPair<const llvm::BasicBlock *> startBlocks,
+                     const InterpreterBudget &budget) const -> string {
+    if (budget.time.count() != 0) {
+        return "";
+    }
+    string buf;
+    writeBytes(buf, programHash);
+    writeBytes(buf, startBlocks.first->getName());
+    writeBytes(buf, startBlocks.second->getName());
+    writeVarint(buf, budget.blocks);
+    writeVarint(buf, budget.instructions);
+    writeVarint(buf, budget.heapSize);
+    writeKeyState(buf, entryStates.first);
+    writeKeyState(buf, entryStates.second);
+    llvm::MD5 hash;
+    hash.update(buf);
+    return hexDigest(hash);
+}
+
+// Replaces the names of the variables by the values of the called function,
+// returns None if one of them doesn’t exist
+static auto resolveCall(const Call<string> &call) -> llvm::Optional<FastCall> {
+    if (!call.function) {
+        return llvm::None;
+    }
+    const llvm::ValueSymbolTable *symbols =
+        call.function->getValueSymbolTable();
+    bool resolved = true;
+    auto lookup = [&](const string &name) -> const llvm::Value * {
+        const llvm::Value *val = symbols->lookup(name);
+        resolved = resolved && val;
+        return val;
+    };
+    auto resolveState = [&](const State<string> &state) {
+        FastState resolvedState;
+        resolvedState.heap = state.heap;
+        for (const auto &var : state.variables) {
+            resolvedState.variables.insert({lookup(var.first), var.second});
+        }
+        return resolvedState;
+    };
+    FastState entryState = resolveState(call.entryState);
+    FastState returnState = resolveState(call.returnState);
+    auto trace = make_shared<FastStateTrace>();
+    vector<BlockStep<const llvm::Value *>> steps;
+    for (const auto &step : call.steps) {
+        const auto &delta = step.stateDelta();
+        FastStateTrace::Delta resolvedDelta;
+        for (const auto &var : delta.variables) {
+            resolvedDelta.variables.push_back({lookup(var.first), var.second});
+        }
+        resolvedDelta.heap = delta.heap;
+        resolvedDelta.heapEvents = delta.heapEvents;
+        vector<FastCall> calls;
+        for (const auto &nestedCall : step.calls) {
+            auto resolvedCall = resolveCall(nestedCall);
+            if (!resolvedCall) {
+                return llvm::None;
+            }
+            calls.push_back(std::move(*resolvedCall));
+        }
+        size_t stateIndex = trace->push(std::move(resolvedDelta));
+        steps.emplace_back(step.blockName, trace, stateIndex,
+                           std::move(calls));
+    }
+    if (!resolved) {
+        return llvm::None;
+    }
+    return FastCall(call.function, std::move(entryState),
+                    std::move(returnState), std::move(steps), call.earlyExit,
+                    call.blocksVisited);
+}
+
+auto TraceCache::load(const string &key) const
+    -> llvm::Optional<MonoPair<FastCall>> {
+    const string path = cacheEntryPath(directory, key);
+    if (key.empty() || !llvm::sys::fs::exists(path)) {
+        return llvm::None;
+    }
+    // The calls of each program are resolved in its own module
+    const llvm::Module *module = funs.first->getParent();
+    TraceReader reader(path, [&module](StringRef name) -> const Function * {
+        return module->getFunction(name);
+    });
+    auto first = reader.next();
+    module = funs.second->getParent();
+    auto second = reader.next();
+    if (!first || !second) {
+        return llvm::None;
+    }
+    auto firstCall = resolveCall(*first);
+    auto secondCall = resolveCall(*second);
+    if (!firstCall || !secondCall) {
+        return llvm::None;
+    }
+    return MonoPair<FastCall>(std::move(*firstCall), std::move(*secondCall));
+}
+
+void TraceCache::store(const string &key,
+                       const MonoPair<FastCall> &calls) const {
+    if (key.empty()) {
+        return;
+    }
+    if (std::error_code errorCode =
+            llvm::sys::fs::create_directories(directory)) {
+        logWarning("Couldn’t create trace cache directory: " +
+                   errorCode.message() + "\n");
+        return;
+    }
+    const string path = cacheEntryPath(directory, key);
+    // Write to a temporary file first so that concurrent runs never see
+    // partially written traces
+    int fd;
+    llvm::SmallString<128> tmpPath;
+    if (std::error_code errorCode = llvm::sys::fs::createUniqueFile(
+            path + ".tmp-%%%%%%", fd, tmpPath)) {
+        logWarning("Couldn’t write to trace cache: " + errorCode.message() +
+                   "\n");
+        return;
+    }
+    close(fd);
+    {
+        TraceWriter writer(tmpPath.str().str(), TraceFormat::Binary);
+        writer.write(calls.first);
+        writer.write(calls.second);
+    }
+    if (llvm::sys::fs::rename(tmpPath, path)) {
+        llvm::sys::fs::remove(tmpPath);
     }
-    return *this;
 }
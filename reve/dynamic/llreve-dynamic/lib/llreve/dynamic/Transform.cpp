@@ -34,6 +34,47 @@ set<BasicBlock *> blocksInLoop(llvm::BasicBlock *markedBlock,
     return blocks;
 }
 
+LoopStructure::LoopStructure(const BidirBlockMarkMap &marks) : marks(marks) {
+    for (const auto &it : marks.MarkToBlocksMap) {
+        // No paths start at these marks
+        if (it.first == EXIT_MARK || it.first == UNREACHABLE_MARK) {
+            continue;
+        }
+        for (auto header : it.second) {
+            loops.insert({header, blocksInLoop(header, marks)});
+        }
+    }
+}
+
+auto LoopStructure::loopBlocks(BasicBlock *header)
+    -> const set<BasicBlock *> & {
+    auto it = loops.find(header);
+    if (it == loops.end()) {
+        it = loops.insert({header, blocksInLoop(header, marks)}).first;
+    } else if (stale.erase(header) > 0) {
+        it->second = blocksInLoop(header, marks);
+    }
+    return it->second;
+}
+
+void LoopStructure::transformed(BasicBlock *header,
+                                const set<BasicBlock *> &changedBlocks) {
+    for (auto &loop : loops) {
+        bool isChanged = loop.first == header;
+        for (auto it = changedBlocks.begin();
+             !isChanged && it != changedBlocks.end(); ++it) {
+            isChanged = loop.second.count(*it) > 0;
+        }
+        // Loops that are already stale don’t contain the blocks created by
+        // the transformation that made them stale but they are computed
+        // again anyway
+        if (isChanged && stale.insert(loop.first).second) {
+            const auto &headerMarks = marks.BlockToMarksMap.at(loop.first);
+            changed.insert(headerMarks.begin(), headerMarks.end());
+        }
+    }
+}
+
 BasicBlock *createUniqueBackedge(BasicBlock *markedBlock, BasicBlock *preHeader,
                                  const vector<BasicBlock *> &backedgeBlocks,
                                  llvm::Function &f) {
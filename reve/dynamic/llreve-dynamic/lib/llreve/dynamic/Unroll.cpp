@@ -33,14 +33,12 @@ using llvm::BasicBlock;
 using llvm::ValueToValueMapTy;
 using llvm::BranchInst;
 
-void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
-                  size_t factor) {
-    if (factor <= 1) {
-        return;
-    }
-    assert(marks.MarkToBlocksMap.at(mark).size() == 1);
-    BasicBlock *markedBlock = *marks.MarkToBlocksMap.at(mark).begin();
-    set<BasicBlock *> loopBlocks = blocksInLoop(markedBlock, marks);
+// The blocks outside of the loop that are changed are added to
+// 'changedBlocks'
+static void unrollLoop(llvm::Function &f, BasicBlock *markedBlock,
+                       LoopStructure &loops, size_t factor,
+                       set<BasicBlock *> &changedBlocks) {
+    set<BasicBlock *> loopBlocks = loops.loopBlocks(markedBlock);
 
     vector<BasicBlock *> outsideBlocks;
     vector<BasicBlock *> backedgeBlocks;
@@ -52,6 +50,8 @@ void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
         }
     }
 
+    changedBlocks.insert(outsideBlocks.begin(), outsideBlocks.end());
+
     BasicBlock *preHeader = createPreheader(markedBlock, outsideBlocks);
     BasicBlock *backEdge =
         createUniqueBackedge(markedBlock, preHeader, backedgeBlocks, f);
@@ -137,20 +137,16 @@ void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
                                  newBlocks[0]->getIterator(), f.end());
 
     set<BasicBlock *> originalLoopBlocks = loopBlocks;
+    // Instructions are part of the loop if their block is
     loopBlocks.insert(newBlocks.begin(), newBlocks.end());
-    set<llvm::Instruction *> loopInstructions;
-    for (auto bb : loopBlocks) {
-        for (auto &instr : *bb) {
-            loopInstructions.insert(&instr);
-        }
-    }
 
     // Merge uses outside the loop
+    llvm::SmallVector<llvm::PHINode *, 8> insertedPhis;
     for (auto bb : originalLoopBlocks) {
         for (auto &instr : *bb) {
             if (instr.getType()->isVoidTy() || !vmap[&instr])
                 continue;
-            llvm::SSAUpdater ssaUpdate;
+            llvm::SSAUpdater ssaUpdate(&insertedPhis);
             ssaUpdate.Initialize(instr.getType(), instr.getName());
             ssaUpdate.AddAvailableValue(instr.getParent(), &instr);
             // Add all mappings
@@ -170,9 +166,10 @@ void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
                 if (!user) {
                     continue;
                 }
-                if (loopInstructions.count(user) == 0) {
+                if (loopBlocks.count(user->getParent()) == 0) {
                     // Find uses outside the loop
                     usesOutsideLoop.push_back(&use);
+                    changedBlocks.insert(user->getParent());
                 }
             }
             for (auto use : usesOutsideLoop) {
@@ -180,4 +177,20 @@ void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
             }
         }
     }
+    for (auto phi : insertedPhis) {
+        changedBlocks.insert(phi->getParent());
+    }
+}
+
+void unrollAtMark(llvm::Function &f, Mark mark, const BidirBlockMarkMap &marks,
+                  LoopStructure &loops, size_t factor) {
+    if (factor <= 1) {
+        return;
+    }
+    // Each block of the mark is the header of its own loop
+    for (auto markedBlock : marks.MarkToBlocksMap.at(mark)) {
+        set<BasicBlock *> changedBlocks;
+        unrollLoop(f, markedBlock, loops, factor, changedBlocks);
+        loops.transformed(markedBlock, changedBlocks);
+    }
 }
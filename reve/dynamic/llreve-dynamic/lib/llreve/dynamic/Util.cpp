@@ -15,27 +15,19 @@ namespace dynamic {
 static llreve::cl::opt<bool>
     MultinomialsFlag("multinomials", llreve::cl::desc("Use true multinomials"));
 
-vector<vector<string>> polynomialTermsOfDegree(vector<smt::SortedVar> variables,
-                                               size_t degree) {
+void forEachPolynomialTerm(size_t numVariables, size_t degree,
+                           llvm::function_ref<void(llvm::ArrayRef<size_t>)> f) {
     if (MultinomialsFlag) {
-        vector<vector<SortedVar>> res =
-            kCombinationsWithRepetitions(variables, degree);
-        vector<vector<string>> resString;
-        for (const auto &vec : res) {
-            vector<string> innerString;
-            for (const auto &var : vec) {
-                innerString.push_back(var.name);
-            }
-            resString.push_back(std::move(innerString));
+        for (CombinationsWithRepetitions combinations(numVariables, degree);
+             !combinations.atEnd(); combinations.next()) {
+            f(combinations.current());
         }
-        return resString;
     } else {
-        vector<vector<string>> terms;
-        for (auto var : variables) {
-            vector<string> term(degree, var.name);
-            terms.push_back(term);
+        vector<size_t> term(degree);
+        for (size_t i = 0; i < numVariables; ++i) {
+            std::fill(term.begin(), term.end(), i);
+            f(term);
         }
-        return terms;
     }
 }
 
@@ -8,8 +8,12 @@
  * See LICENSE (distributed with this file) for details.
  */
 
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "Compat.h"
@@ -20,18 +24,20 @@
 #include "Preprocess.h"
 #include "Serialize.h"
 #include "llreve/dynamic/Analysis.h"
+#include "llreve/dynamic/Exhaustive.h"
 #include "llreve/dynamic/Model.h"
+#include "llreve/dynamic/PatternSet.h"
 #include "llreve/dynamic/SerializeTraces.h"
 
 #include "clang/Driver/Compilation.h"
 
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Transforms/IPO.h"
 
-#include <sys/stat.h>
-
 using std::string;
 using std::vector;
 using std::shared_ptr;
@@ -59,6 +65,11 @@ static llreve::cl::opt<string>
     PatternFileFlag("patterns",
                     llreve::cl::desc("Path to file containing patterns"),
                     llreve::cl::Required);
+static llreve::cl::opt<string> PatternCacheFlag(
+    "pattern-cache",
+    llreve::cl::desc("Directory in which the parsed patterns are stored under "
+                     "the hash of the pattern file so later runs don’t have "
+                     "to parse them again"));
 static llreve::cl::list<string> IncludesFlag("I",
                                              llreve::cl::desc("Include path"));
 static llreve::cl::opt<string> ResourceDirFlag(
@@ -74,6 +85,18 @@ static llreve::cl::opt<bool>
 
 static llreve::cl::opt<string> MainFunctionFlag(
     "fun", llreve::cl::desc("Name of the function which should be verified"));
+static llreve::cl::list<string> MainFunctionsFlag(
+    "funs",
+    llreve::cl::desc("Verify each of these functions like -fun. Up to -jobs "
+                     "pairs are verified concurrently, each of them on its "
+                     "own copy of the compiled programs. The exit code is 1 "
+                     "unless all pairs have been proven equivalent"),
+    llreve::cl::CommaSeparated);
+static llreve::cl::opt<string> OutputDirFlag(
+    "output-dir",
+    llreve::cl::desc("Directory to which the SMT of each function of -funs "
+                     "is written as <function>.smt2"),
+    llreve::cl::value_desc("directory"));
 // Serialize flags
 static llreve::cl::opt<string>
     OutputFileNameFlag("o", llreve::cl::desc("SMT output filename"),
@@ -87,82 +110,283 @@ static llreve::cl::opt<bool>
 static llreve::cl::opt<bool>
     OnlyTransform("only-transform",
                   llreve::cl::desc("Only infer unroll and peel factors"));
+static llreve::cl::opt<unsigned> JobsFlag(
+    "jobs",
+    llreve::cl::desc("Number of threads used for generating the clauses of "
+                     "different functions and interpreting random examples"),
+    llreve::cl::init(1));
+
+static llreve::cl::opt<bool> ExhaustiveFlag(
+    "exhaustive",
+    llreve::cl::desc("Interpret the main functions on every combination of "
+                     "argument values in the bounds given by "
+                     "-exhaustive-lower and -exhaustive-upper instead of "
+                     "inferring invariants. The results are printed once per "
+                     "input, inputs on which the functions differ are marked "
+                     "as counterexamples"));
+static llreve::cl::opt<int>
+    ExhaustiveLowerFlag("exhaustive-lower",
+                        llreve::cl::desc("Lower bound of the arguments"),
+                        llreve::cl::init(-5));
+static llreve::cl::opt<int>
+    ExhaustiveUpperFlag("exhaustive-upper",
+                        llreve::cl::desc("Upper bound of the arguments"),
+                        llreve::cl::init(5));
+static llreve::cl::opt<string> ExhaustiveFirstFlag(
+    "exhaustive-first",
+    llreve::cl::desc("Index of the first input of -exhaustive, the index of "
+                     "each input is printed with its result so an "
+                     "interrupted enumeration can be resumed"),
+    llreve::cl::init("0"));
+static llreve::cl::opt<unsigned> ExhaustiveStepsFlag(
+    "exhaustive-steps",
+    llreve::cl::desc("The number of blocks that are interpreted for each "
+                     "input, 0 means no limit"),
+    llreve::cl::init(10000));
+static llreve::cl::opt<unsigned> ExhaustiveChunkFlag(
+    "exhaustive-chunk",
+    llreve::cl::desc("Number of inputs a worker interprets at once"),
+    llreve::cl::init(256));
+static llreve::cl::opt<string> ExhaustiveOutputFlag(
+    "exhaustive-output",
+    llreve::cl::desc("Write the results of -exhaustive to a file instead of "
+                     "stdout"),
+    llreve::cl::value_desc("filename"));
+static llreve::cl::opt<string> ExhaustiveTracesFlag(
+    "exhaustive-traces",
+    llreve::cl::desc("Write the traces of all inputs of -exhaustive to a file "
+                     "in the binary trace format"),
+    llreve::cl::value_desc("filename"));
+
+static int runExhaustive(const AnalysisResultsMap &analysisResults) {
+    MonoPair<const llvm::Function *> funs =
+        SMTGenerationOpts::getInstance().MainFunctions;
+    if (funs.first->isVarArg() || funs.second->isVarArg() ||
+        funs.first->getArgumentList().size() !=
+            funs.second->getArgumentList().size()) {
+        logError("Exhaustive testing requires main functions with the same "
+                 "number of arguments\n");
+        exit(1);
+    }
+    mpz_class firstInput;
+    if (firstInput.set_str(ExhaustiveFirstFlag, 10) != 0 || firstInput < 0) {
+        logError("Invalid value for -exhaustive-first: " +
+                 ExhaustiveFirstFlag + "\n");
+        exit(1);
+    }
+    ExhaustiveOpts opts{mpz_class(ExhaustiveLowerFlag),
+                        mpz_class(ExhaustiveUpperFlag),
+                        firstInput,
+                        JobsFlag,
+                        ExhaustiveChunkFlag,
+                        budgetForFunction(*funs.first, ExhaustiveStepsFlag)};
+    std::ofstream file;
+    if (!ExhaustiveOutputFlag.empty()) {
+        file.open(ExhaustiveOutputFlag);
+        if (!file) {
+            logError("Couldn’t open " + ExhaustiveOutputFlag + "\n");
+            exit(1);
+        }
+    }
+    std::unique_ptr<TraceWriter> traces;
+    if (!ExhaustiveTracesFlag.empty()) {
+        traces = std::make_unique<TraceWriter>(ExhaustiveTracesFlag,
+                                               TraceFormat::Binary);
+    }
+    ExhaustiveResult result = enumerateExhaustively(
+        funs, analysisResults, opts,
+        ExhaustiveOutputFlag.empty() ? std::cout : file, traces.get());
+    std::cerr << "Interpreted " << result.inputs << " inputs, "
+              << result.counterExamples << " counterexamples, "
+              << result.earlyExits << " early exits\n";
+    return result.counterExamples > 0 ? 1 : 0;
+}
 
 static void printVersion() {
     std::cout << "llreve-dynamic version " << g_GIT_SHA1 << "\n";
 }
 
-int main(int argc, const char **argv) {
-    llreve::cl::SetVersionPrinter(printVersion);
-    llreve::cl::ParseCommandLineOptions(argc, argv);
-    InputOpts inputOpts(IncludesFlag, ResourceDirFlag, FileName1Flag,
-                        FileName2Flag);
-    PreprocessOpts preprocessOpts(ShowCFGFlag, ShowMarkedCFGFlag, false);
-
-    std::unique_ptr<CodeGenAction> act1 =
-        std::make_unique<clang::EmitLLVMOnlyAction>();
-    std::unique_ptr<CodeGenAction> act2 =
-        std::make_unique<clang::EmitLLVMOnlyAction>();
-    MonoPair<shared_ptr<llvm::Module>> modules =
-        compileToModules(argv[0], inputOpts, {*act1, *act2});
-    MonoPair<llvm::Module &> moduleRefs = {*modules.first, *modules.second};
-
+// Sets up the options of the current thread for verifying 'function'
+static void initializeOptions(MonoPair<llvm::Module &> modules,
+                              const string &function, unsigned jobs) {
     std::map<const llvm::Function *, int> functionNumerals;
     MonoPair<std::map<int, const llvm::Function *>> reversedFunctionNumerals = {
         {}, {}};
     std::tie(functionNumerals, reversedFunctionNumerals) =
-        generateFunctionMap(moduleRefs);
+        generateFunctionMap(modules);
 
     SMTGenerationOpts::initialize(
-        findMainFunction(moduleRefs, MainFunctionFlag),
+        findMainFunction(modules, function),
         HeapFlag ? llreve::opts::HeapOpt::Enabled
                  : llreve::opts::HeapOpt::Disabled,
         StackOpt::Disabled, GlobalConstantsOpt::Disabled,
         FunctionEncoding::Iterative, ByteHeapOpt::Enabled, EverythingSignedFlag,
         OnlyTransform ? SMTFormat::Z3 : SMTFormat::SMTHorn,
         PerfectSynchronization::Disabled, false, BoundedFlag, !OnlyTransform,
-        false, false, {}, {}, {}, {}, inferCoupledFunctionsByName(moduleRefs),
+        false, false, {}, {}, {}, {}, inferCoupledFunctionsByName(modules),
         functionNumerals, reversedFunctionNumerals);
+    SMTGenerationOpts::getInstance().Jobs = jobs;
+}
+
+// Empty if the programs could not be proven equivalent
+static auto runDriver(MonoPair<llvm::Module &> modules,
+                      AnalysisResultsMap &analysisResults,
+                      const PatternSet &patterns, const FileOptions &fileOpts)
+    -> vector<smt::SharedSMTRef> {
+    if (OnlyTransform) {
+        return driver(modules, analysisResults, patterns, fileOpts);
+    }
+    return cegarDriver(modules, analysisResults, patterns, fileOpts);
+}
+
+static auto serializeOptions(const string &fileName) -> SerializeOpts {
+    return SerializeOpts(fileName, !InstantiateFlag, MergeImplications, true,
+                         false);
+}
 
+static auto writeBitcode(const llvm::Module &mod)
+    -> llvm::SmallVector<char, 0> {
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream stream(bitcode);
+    llvm::WriteBitcodeToFile(&mod, stream);
+    return bitcode;
+}
+
+static auto parseModule(const llvm::SmallVector<char, 0> &bitcode,
+                        const string &fileName, llvm::LLVMContext &context)
+    -> std::unique_ptr<llvm::Module> {
+    auto parsed = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()),
+                              fileName),
+        context);
+    if (!parsed) {
+        logError("Couldn’t copy module: " +
+                 llvm::toString(parsed.takeError()) + "\n");
+        exit(1);
+    }
+    return std::move(parsed.get());
+}
+
+// Verifies one function of -funs on a thread of its own. The analysis
+// transforms the modules and LLVM contexts can’t be shared between threads,
+// so every pair parses the compiled programs into a context of its own and
+// has its own options and analysis results. Returns true if the programs
+// have been proven equivalent.
+static bool verifyFunction(const MonoPair<llvm::SmallVector<char, 0>> &bitcode,
+                           const string &function,
+                           const PreprocessOpts &preprocessOpts,
+                           const PatternSet &patterns,
+                           const FileOptions &fileOpts) {
+    llvm::LLVMContext context;
+    MonoPair<std::unique_ptr<llvm::Module>> modules = {
+        parseModule(bitcode.first, FileName1Flag, context),
+        parseModule(bitcode.second, FileName2Flag, context)};
+    MonoPair<llvm::Module &> moduleRefs = {*modules.first, *modules.second};
+    SMTGenerationOpts smtOpts;
+    SMTGenerationOpts::Scope optsScope(smtOpts);
+    // The pairs are verified concurrently instead of using threads within
+    // the verification of one pair
+    initializeOptions(moduleRefs, function, 1);
     AnalysisResultsMap analysisResults =
         preprocessModules(moduleRefs, preprocessOpts);
-    // fopen doesn’t signal if the path points to a directory, thus we have to
-    // check for that separately and to catch the error.
-    struct stat s;
-    int ret = stat(PatternFileFlag.c_str(), &s);
-    if (ret != 0) {
-        logError("Couldn’t open pattern file\n");
-        exit(1);
+    vector<smt::SharedSMTRef> smtExprs =
+        runDriver(moduleRefs, analysisResults, patterns, fileOpts);
+    if (!smtExprs.empty() && !OutputDirFlag.empty()) {
+        serializeSMT(smtExprs, OnlyTransform,
+                     serializeOptions(OutputDirFlag + "/" + function +
+                                      ".smt2"));
     }
-    if (s.st_mode & S_IFDIR) {
-        logError("Pattern file points to a directory\n");
-        exit(1);
+    return !smtExprs.empty();
+}
+
+static int verifyFunctions(MonoPair<llvm::Module &> modules,
+                           const PreprocessOpts &preprocessOpts,
+                           const PatternSet &patterns,
+                           const FileOptions &fileOpts) {
+    const MonoPair<llvm::SmallVector<char, 0>> bitcode = {
+        writeBitcode(modules.first), writeBitcode(modules.second)};
+    const vector<string> functions(MainFunctionsFlag.begin(),
+                                   MainFunctionsFlag.end());
+    std::atomic<size_t> nextFunction{0};
+    std::mutex resultMutex;
+    size_t proven = 0;
+    auto worker = [&] {
+        for (size_t i = nextFunction++; i < functions.size();
+             i = nextFunction++) {
+            const bool equivalent = verifyFunction(
+                bitcode, functions[i], preprocessOpts, patterns, fileOpts);
+            std::lock_guard<std::mutex> lock(resultMutex);
+            std::cerr << functions[i] << ": "
+                      << (equivalent ? "proven equivalent"
+                                     : "not proven equivalent")
+                      << "\n";
+            proven += equivalent;
+        }
+    };
+    vector<std::thread> threads;
+    const size_t numThreads =
+        std::min<size_t>(std::max<unsigned>(JobsFlag, 1), functions.size());
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads.emplace_back(worker);
     }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    std::cerr << proven << " of " << functions.size()
+              << " functions have been proven equivalent\n";
+    return proven == functions.size() ? 0 : 1;
+}
 
-    FILE *patternFile = fopen(PatternFileFlag.c_str(), "r");
-    if (patternFile == nullptr) {
-        logError("Couldn’t open pattern file\n");
+int main(int argc, const char **argv) {
+    llreve::cl::SetVersionPrinter(printVersion);
+    llreve::cl::ParseCommandLineOptions(argc, argv);
+    if (!MainFunctionsFlag.empty() &&
+        (!MainFunctionFlag.empty() || !OutputFileNameFlag.empty() ||
+         ExhaustiveFlag)) {
+        logError("-funs cannot be combined with -fun, -o or -exhaustive\n");
         exit(1);
     }
-    auto patterns = parsePatterns(patternFile);
+    InputOpts inputOpts(IncludesFlag, ResourceDirFlag, FileName1Flag,
+                        FileName2Flag);
+    PreprocessOpts preprocessOpts(ShowCFGFlag, ShowMarkedCFGFlag, false);
+
+    std::unique_ptr<CodeGenAction> act1 =
+        std::make_unique<clang::EmitLLVMOnlyAction>();
+    std::unique_ptr<CodeGenAction> act2 =
+        std::make_unique<clang::EmitLLVMOnlyAction>();
+    MonoPair<shared_ptr<llvm::Module>> modules =
+        compileToModules(argv[0], inputOpts, {*act1, *act2});
+    MonoPair<llvm::Module &> moduleRefs = {*modules.first, *modules.second};
+
+    AnalysisResultsMap analysisResults;
+    if (MainFunctionsFlag.empty()) {
+        initializeOptions(moduleRefs, MainFunctionFlag, JobsFlag);
+        analysisResults = preprocessModules(moduleRefs, preprocessOpts);
+    }
+    if (ExhaustiveFlag) {
+        int ret = runExhaustive(analysisResults);
+        llvm::llvm_shutdown();
+        return ret;
+    }
+    const PatternSet patterns = loadPatterns(PatternFileFlag, PatternCacheFlag);
     std::cerr << "Found " << patterns.size() << " patterns\n";
-    for (auto pat : patterns) {
+    for (const auto &pat : patterns.patterns()) {
         pat->dump(std::cerr);
         std::cerr << "\n";
     }
-    fclose(patternFile);
 
     FileOptions fileOpts = getFileOptions(inputOpts.FileNames);
-    vector<smt::SharedSMTRef> smtExprs;
-    if (OnlyTransform) {
-        smtExprs = driver(moduleRefs, analysisResults, patterns, fileOpts);
-    } else {
-        smtExprs = cegarDriver(moduleRefs, analysisResults, patterns, fileOpts);
+    if (!MainFunctionsFlag.empty()) {
+        int ret =
+            verifyFunctions(moduleRefs, preprocessOpts, patterns, fileOpts);
+        llvm::llvm_shutdown();
+        return ret;
     }
+    vector<smt::SharedSMTRef> smtExprs =
+        runDriver(moduleRefs, analysisResults, patterns, fileOpts);
     if (!smtExprs.empty() && !OutputFileNameFlag.empty()) {
         serializeSMT(smtExprs, OnlyTransform,
-                     SerializeOpts(OutputFileNameFlag, !InstantiateFlag,
-                                   MergeImplications, true, false));
+                     serializeOptions(OutputFileNameFlag));
     }
 
     llvm::llvm_shutdown();
@@ -0,0 +1,456 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+// Micro benchmarks for the hot paths of llreve-dynamic: the interpreter, the
+// arithmetic on Integers, the Gaussian elimination in Linear.cpp and the
+// evaluation of heap patterns. The inputs are derived from a pair of example
+// programs, e.g.
+//
+//   llreve-dynamic-bench examples/loop/barthe_{1,2}.c \
+//       -patterns dynamic/patterns/looppatterns
+//   llreve-dynamic-bench examples/heap/memcpy_a_{1,2}.c \
+//       -patterns dynamic/patterns/heappatterns
+//
+// Both programs are interpreted on a fixed input. The states at the blocks
+// of the resulting traces are the rows of the matrices passed to the linear
+// algebra and the values the heap patterns are evaluated on.
+
+#include "Compile.h"
+#include "ModuleSMTGeneration.h"
+#include "Opts.h"
+#include "Preprocess.h"
+#include "llreve/dynamic/Analysis.h"
+#include "llreve/dynamic/HeapPattern.h"
+#include "llreve/dynamic/Integer.h"
+#include "llreve/dynamic/Interpreter.h"
+#include "llreve/dynamic/Linear.h"
+#include "llreve/dynamic/PatternSet.h"
+
+#include "clang/CodeGen/CodeGenAction.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ManagedStatic.h"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+using clang::CodeGenAction;
+
+using namespace llreve::dynamic;
+using namespace llreve::opts;
+
+static llreve::cl::opt<string> FileName1Flag(llreve::cl::Positional,
+                                             llreve::cl::desc("FILE1"),
+                                             llreve::cl::Required);
+static llreve::cl::opt<string> FileName2Flag(llreve::cl::Positional,
+                                             llreve::cl::desc("FILE2"),
+                                             llreve::cl::Required);
+static llreve::cl::opt<string>
+    PatternFileFlag("patterns",
+                    llreve::cl::desc("Path to file containing patterns"),
+                    llreve::cl::Required);
+static llreve::cl::list<string> IncludesFlag("I",
+                                             llreve::cl::desc("Include path"));
+static llreve::cl::opt<string> ResourceDirFlag(
+    "resource-dir",
+    llreve::cl::desc("Directory containing the clang resource files, "
+                     "e.g. /usr/local/lib/clang/3.8.0"));
+static llreve::cl::opt<string> MainFunctionFlag(
+    "fun", llreve::cl::desc("Name of the function which should be verified"));
+static llreve::cl::opt<string> FilterFlag(
+    "filter",
+    llreve::cl::desc("Only run the benchmarks whose name contains this"));
+static llreve::cl::opt<double> MinTimeFlag(
+    "min-time",
+    llreve::cl::desc("Minimal time in seconds each benchmark is run for"),
+    llreve::cl::init(0.5));
+static llreve::cl::opt<unsigned> InputFlag(
+    "input",
+    llreve::cl::desc("The value of the integer arguments of the programs"),
+    llreve::cl::init(20));
+
+using Clock = std::chrono::steady_clock;
+
+// Runs the body of a benchmark in batches of doubling size until the minimal
+// time has passed, similar to benchmark::State in Google Benchmark:
+//
+//   while (state.keepRunning()) { … }
+class BenchmarkState {
+  public:
+    explicit BenchmarkState(double minSeconds)
+        : minTime(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(minSeconds))),
+          start(Clock::now()) {}
+    auto keepRunning() -> bool {
+        if (remaining > 0) {
+            --remaining;
+            ++iterations;
+            return true;
+        }
+        const auto now = Clock::now();
+        if (now - start >= minTime && iterations > 0) {
+            elapsed = now - start;
+            return false;
+        }
+        batch *= 2;
+        remaining = batch - 1;
+        ++iterations;
+        return true;
+    }
+    auto iterationCount() const -> uint64_t { return iterations; }
+    auto nanosecondsPerIteration() const -> double {
+        return std::chrono::duration<double, std::nano>(elapsed).count() /
+               static_cast<double>(iterations);
+    }
+
+  private:
+    Clock::duration minTime;
+    Clock::time_point start;
+    Clock::duration elapsed = Clock::duration::zero();
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    uint64_t remaining = 0;
+};
+
+// Prevents the compiler from optimizing away the computation of 'value'
+template <typename T> static void doNotOptimize(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Benchmark {
+    string name;
+    std::function<void(BenchmarkState &)> body;
+};
+
+static void runBenchmarks(const vector<Benchmark> &benchmarks) {
+    std::cout << std::left << std::setw(40) << "Benchmark" << std::right
+              << std::setw(16) << "Time" << std::setw(14) << "Iterations"
+              << "\n";
+    for (const auto &benchmark : benchmarks) {
+        if (benchmark.name.find(FilterFlag) == string::npos) {
+            continue;
+        }
+        BenchmarkState state(MinTimeFlag);
+        benchmark.body(state);
+        std::cout << std::left << std::setw(40) << benchmark.name
+                  << std::right << std::setw(13) << std::fixed
+                  << std::setprecision(0) << state.nanosecondsPerIteration()
+                  << " ns" << std::setw(14) << state.iterationCount() << "\n";
+    }
+}
+
+// Integer arguments get the value of -input, the pointer arguments point to
+// disjoint arrays of -input elements
+static auto entryState(const llvm::Function &fun) -> FastState {
+    vector<mpz_class> values;
+    llvm::SmallDenseMap<HeapAddress, Integer> heap;
+    unsigned arrays = 0;
+    for (const auto &arg : fun.args()) {
+        if (arg.getType()->isPointerTy()) {
+            mpz_class address = 1000 * ++arrays;
+            for (unsigned i = 0; i < InputFlag; ++i) {
+                heap.insert({Integer(mpz_class(address + i)).asPointer(),
+                             Integer(mpz_class(i % 7))});
+            }
+            values.push_back(address);
+        } else {
+            values.push_back(mpz_class(static_cast<unsigned>(InputFlag)));
+        }
+    }
+    return FastState(getVarMap(&fun, values), Heap(heap, Integer(0)));
+}
+
+// The states at the blocks of a trace
+static auto blockStates(const FastCall &call) -> vector<FastState> {
+    vector<FastState> states;
+    for (const auto &step : call.steps) {
+        states.push_back(step.state());
+    }
+    return states;
+}
+
+// One row per state containing 1 followed by the values of the variables
+// that are defined in the first state
+static auto stateMatrix(const vector<FastState> &states) -> Matrix<mpq_class> {
+    Matrix<mpq_class> matrix;
+    if (states.empty()) {
+        return matrix;
+    }
+    vector<const llvm::Value *> columns;
+    for (const auto &var : states.front().variables) {
+        if (var.second.type == IntType::Unbounded) {
+            columns.push_back(var.first);
+        }
+    }
+    for (const auto &state : states) {
+        vector<mpq_class> row = {1};
+        for (const auto *column : columns) {
+            auto it = state.variables.find(column);
+            row.push_back(it == state.variables.end()
+                              ? mpq_class(0)
+                              : mpq_class(it->second.asUnbounded()));
+        }
+        matrix.push_back(std::move(row));
+    }
+    return matrix;
+}
+
+static void addIntegerBenchmarks(vector<Benchmark> &benchmarks) {
+    // Each iteration performs 1000 operations
+    benchmarks.push_back({"integer/small add mul x1000", [](auto &state) {
+                              while (state.keepRunning()) {
+                                  Integer x = Integer::fromSmall(1);
+                                  const Integer three = Integer::fromSmall(3);
+                                  for (int i = 0; i < 1000; ++i) {
+                                      x = x * three - Integer::fromSmall(i);
+                                      x = x / three;
+                                  }
+                                  doNotOptimize(x);
+                              }
+                          }});
+    benchmarks.push_back(
+        {"integer/big add mul x1000", [](auto &state) {
+             const Integer big(mpz_class("123456789012345678901234567890"));
+             while (state.keepRunning()) {
+                 Integer x = big;
+                 const Integer three = Integer::fromSmall(3);
+                 for (int i = 0; i < 1000; ++i) {
+                     x = x * three - big;
+                     x = x / three;
+                 }
+                 doNotOptimize(x);
+             }
+         }});
+    benchmarks.push_back(
+        {"integer/bounded add mul x1000", [](auto &state) {
+             while (state.keepRunning()) {
+                 Integer x(llvm::APInt(32, 1));
+                 const Integer three(llvm::APInt(32, 3));
+                 for (int i = 0; i < 1000; ++i) {
+                     x = x * three - Integer(llvm::APInt(32, i));
+                     x = x.sdiv(three);
+                 }
+                 doNotOptimize(x);
+             }
+         }});
+    benchmarks.push_back({"integer/compare x1000", [](auto &state) {
+                              const Integer a = Integer::fromSmall(17);
+                              while (state.keepRunning()) {
+                                  unsigned less = 0;
+                                  for (int i = 0; i < 1000; ++i) {
+                                      less += Integer::fromSmall(i) < a;
+                                  }
+                                  doNotOptimize(less);
+                              }
+                          }});
+}
+
+static void addLinearBenchmarks(vector<Benchmark> &benchmarks,
+                                const Matrix<mpq_class> &matrix) {
+    std::cerr << "Matrix of " << matrix.size() << " states and "
+              << (matrix.empty() ? 0 : matrix.front().size()) << " columns\n";
+    benchmarks.push_back(
+        {"linear/reducedRowEchelonForm", [matrix](auto &state) {
+             while (state.keepRunning()) {
+                 Matrix<mpq_class> m = matrix;
+                 reducedRowEchelonForm(m);
+                 doNotOptimize(m);
+             }
+         }});
+    benchmarks.push_back({"linear/nullSpace", [matrix](auto &state) {
+                              while (state.keepRunning()) {
+                                  doNotOptimize(nullSpace(matrix));
+                              }
+                          }});
+    benchmarks.push_back({"linear/integerNullSpace", [matrix](auto &state) {
+                              while (state.keepRunning()) {
+                                  doNotOptimize(integerNullSpace(matrix));
+                              }
+                          }});
+    benchmarks.push_back(
+        {"linear/insertIntoRowEchelonForm", [matrix](auto &state) {
+             while (state.keepRunning()) {
+                 Matrix<mpq_class> echelon;
+                 for (const auto &row : matrix) {
+                     insertIntoRowEchelonForm(echelon, row);
+                 }
+                 doNotOptimize(echelon);
+             }
+         }});
+}
+
+// The variables of the two states of a pair of steps, the same way the
+// analysis passes them to the patterns
+struct PatternInput {
+    vector<smt::SortedVar> variables;
+    FastVarMap values;
+    MonoPair<Heap> heaps;
+};
+
+static auto patternInputs(const MonoPair<vector<FastState>> &states)
+    -> vector<PatternInput> {
+    vector<PatternInput> inputs;
+    const size_t count = std::min(states.first.size(), states.second.size());
+    for (size_t i = 0; i < count; ++i) {
+        PatternInput input{{},
+                           states.first[i].variables,
+                           {states.first[i].heap, states.second[i].heap}};
+        for (const auto &var : states.second[i].variables) {
+            input.values.insert(var);
+        }
+        for (const auto &var : input.values) {
+            input.variables.push_back(
+                {var.first->getName().str(), smt::int64Type()});
+        }
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+static void addPatternBenchmarks(
+    vector<Benchmark> &benchmarks,
+    const vector<std::shared_ptr<HeapPattern<VariablePlaceholder>>> &patterns,
+    const vector<PatternInput> &inputs) {
+    using Instantiations =
+        std::list<std::shared_ptr<HeapPattern<const llvm::Value *>>>;
+    // The instantiations of all patterns that hold for the input
+    auto instantiate = [&patterns](const PatternInput &input) {
+        Instantiations instantiations;
+        for (const auto &pattern : patterns) {
+            instantiations.splice(
+                instantiations.end(),
+                pattern->instantiate(input.variables, input.values,
+                                     {input.heaps.first, input.heaps.second}));
+        }
+        return instantiations;
+    };
+    benchmarks.push_back(
+        {"heap pattern/instantiate", [&inputs, instantiate](auto &state) {
+             while (state.keepRunning()) {
+                 size_t matching = 0;
+                 for (const auto &input : inputs) {
+                     matching += instantiate(input).size();
+                 }
+                 doNotOptimize(matching);
+             }
+         }});
+    // Only the evaluation of the instantiations that hold in the first state,
+    // which is what the analysis does for every later state
+    auto instantiations = std::make_shared<Instantiations>();
+    if (!inputs.empty()) {
+        *instantiations = instantiate(inputs.front());
+    }
+    benchmarks.push_back(
+        {"heap pattern/matches", [&inputs, instantiations](auto &state) {
+             while (state.keepRunning()) {
+                 size_t matching = 0;
+                 for (const auto &input : inputs) {
+                     for (const auto &pattern : *instantiations) {
+                         matching += pattern->matches(
+                             input.values,
+                             {input.heaps.first, input.heaps.second});
+                     }
+                 }
+                 doNotOptimize(matching);
+             }
+         }});
+    // Only building the candidates, which the analysis does once per mark
+    auto patternSet = std::make_shared<PatternSet>(patterns);
+    benchmarks.push_back(
+        {"heap pattern/all instantiations",
+         [&inputs, patternSet](auto &state) {
+             while (state.keepRunning()) {
+                 size_t candidates = 0;
+                 for (const auto &input : inputs) {
+                     candidates += patternSet
+                                       ->allInstantiations(input.variables,
+                                                           input.values,
+                                                           {nullptr, nullptr})
+                                       .size();
+                 }
+                 doNotOptimize(candidates);
+             }
+         }});
+}
+
+int main(int argc, const char **argv) {
+    llreve::cl::ParseCommandLineOptions(argc, argv);
+    InputOpts inputOpts(IncludesFlag, ResourceDirFlag, FileName1Flag,
+                        FileName2Flag);
+    PreprocessOpts preprocessOpts(false, false, false);
+
+    std::unique_ptr<CodeGenAction> act1 =
+        std::make_unique<clang::EmitLLVMOnlyAction>();
+    std::unique_ptr<CodeGenAction> act2 =
+        std::make_unique<clang::EmitLLVMOnlyAction>();
+    MonoPair<std::shared_ptr<llvm::Module>> modules =
+        compileToModules(argv[0], inputOpts, {*act1, *act2});
+    MonoPair<llvm::Module &> moduleRefs = {*modules.first, *modules.second};
+
+    std::map<const llvm::Function *, int> functionNumerals;
+    MonoPair<std::map<int, const llvm::Function *>> reversedFunctionNumerals = {
+        {}, {}};
+    std::tie(functionNumerals, reversedFunctionNumerals) =
+        generateFunctionMap(moduleRefs);
+    const auto mainFunctions = findMainFunction(moduleRefs, MainFunctionFlag);
+    SMTGenerationOpts::initialize(
+        mainFunctions, HeapOpt::Enabled, StackOpt::Disabled,
+        GlobalConstantsOpt::Disabled, FunctionEncoding::Iterative,
+        ByteHeapOpt::Enabled, false, SMTFormat::SMTHorn,
+        PerfectSynchronization::Disabled, false, false, true, false, false, {},
+        {}, {}, {}, inferCoupledFunctionsByName(moduleRefs), functionNumerals,
+        reversedFunctionNumerals);
+    const AnalysisResultsMap analysisResults =
+        preprocessModules(moduleRefs, preprocessOpts);
+
+    FILE *patternFile = fopen(PatternFileFlag.c_str(), "r");
+    if (patternFile == nullptr) {
+        logError("Couldn’t open pattern file\n");
+        exit(1);
+    }
+    const auto patterns = parsePatterns(patternFile);
+    fclose(patternFile);
+
+    const MonoPair<const llvm::Function *> funs = {mainFunctions.first,
+                                                   mainFunctions.second};
+    const MonoPair<FastState> entryStates = {entryState(*funs.first),
+                                             entryState(*funs.second)};
+    const InterpreterBudget budget(10000, 0, std::chrono::milliseconds(0), 0);
+    const MonoPair<vector<FastState>> states = {
+        blockStates(interpretFunction(*funs.first, entryStates.first, budget,
+                                      analysisResults)),
+        blockStates(interpretFunction(*funs.second, entryStates.second,
+                                      budget, analysisResults))};
+    const vector<PatternInput> inputs = patternInputs(states);
+
+    vector<Benchmark> benchmarks;
+    benchmarks.push_back(
+        {"interpreter/interpretFunction", [&](auto &state) {
+             while (state.keepRunning()) {
+                 doNotOptimize(interpretFunction(
+                     *funs.first, entryStates.first, budget, analysisResults));
+             }
+         }});
+    addIntegerBenchmarks(benchmarks);
+    addLinearBenchmarks(benchmarks, stateMatrix(states.first));
+    addPatternBenchmarks(benchmarks, patterns, inputs);
+    runBenchmarks(benchmarks);
+
+    llvm::llvm_shutdown();
+}
@@ -0,0 +1,9 @@
+/*
+ * The stores only commute if a and b don't alias. For a == b the first
+ * program returns 2 and the second one returns 1.
+ */
+int f(int *a, int *b) {
+  *a = 1;
+  *b = 2;
+  return *a;
+}
@@ -0,0 +1,5 @@
+int f(int *a, int *b) {
+  *b = 2;
+  *a = 1;
+  return *a;
+}
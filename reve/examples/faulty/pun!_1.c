@@ -0,0 +1,14 @@
+/*
+ * Storing a long clears both fields of the pair, so the result differs from
+ * the second program unless p->b is 0. Mapping every primitive to a single
+ * cell would only clear p->a.
+ */
+struct pair {
+  int a;
+  int b;
+};
+
+int f(struct pair *p) {
+  *(long *)p = 0;
+  return p->b;
+}
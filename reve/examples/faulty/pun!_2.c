@@ -0,0 +1,9 @@
+struct pair {
+  int a;
+  int b;
+};
+
+int f(struct pair *p) {
+  p->a = 0;
+  return p->b;
+}
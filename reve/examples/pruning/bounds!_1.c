@@ -0,0 +1,11 @@
+/* Without -bitvect integers are unbounded, so x can be less than INT_MIN */
+int f(int x, int d) {
+  int r = 0;
+  if (x < -2147483647) {
+    r = 100 / d;
+  }
+  if (x != -2147483647 - 1) {
+    r = r * 2;
+  }
+  return r;
+}
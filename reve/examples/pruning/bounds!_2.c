@@ -0,0 +1,7 @@
+int f(int x, int d) {
+  int r = 0;
+  if (x < -2147483647) {
+    r = 100 / d;
+  }
+  return r;
+}
@@ -0,0 +1,10 @@
+int f(int x, int d) {
+  int r = 0;
+  if (x < 5) {
+    r = 100 / d;
+  }
+  if (x > 10) {
+    r = r * 2;
+  }
+  return r;
+}
@@ -0,0 +1,7 @@
+int f(int x, int d) {
+  int r = 0;
+  if (x < 5) {
+    r = 100 / d;
+  }
+  return r;
+}
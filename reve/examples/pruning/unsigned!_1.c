@@ -0,0 +1,12 @@
+/* Without -bitvect unsigned comparisons compare absolute values, so u = -1
+   satisfies both conditions and the programs are not equivalent */
+int f(unsigned u, int d) {
+  int r = 0;
+  if (u < 10u) {
+    r = 100 / d;
+  }
+  if (u == 4294967295u) {
+    r = r * 2;
+  }
+  return r;
+}
@@ -0,0 +1,7 @@
+int f(unsigned u, int d) {
+  int r = 0;
+  if (u < 10u) {
+    r = 100 / d;
+  }
+  return r;
+}
@@ -0,0 +1,208 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+// Cuts a slow query down before it is reported or used to tune the encoding.
+// The clauses and the arguments of the predicates are removed by delta
+// debugging (see minimizeQuery) as long as the solver still takes longer than
+// the time limit on the reduced query. The minimized query starts with a
+// comment listing the marks its predicates were generated for.
+
+#include "BinaryClauses.h"
+#include "GitSHA1.h"
+#include "Logging.h"
+#include "Opts.h"
+#include "Portfolio.h"
+#include "QueryMinimization.h"
+#include "Serialize.h"
+#include "SolverStatistics.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Path.h"
+
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using std::string;
+using std::vector;
+
+using llreve::opts::SerializeOpts;
+using llreve::opts::SMTFormat;
+using llreve::opts::SMTGenerationOpts;
+
+using Clock = std::chrono::steady_clock;
+
+static llreve::cl::OptionCategory
+    MinimizeCategory("Minimizer options", "Options for llreve-minimize.");
+
+static llreve::cl::opt<string>
+    InputFlag(llreve::cl::Positional, llreve::cl::desc("QUERY"),
+              llreve::cl::Required, llreve::cl::cat(MinimizeCategory));
+static llreve::cl::opt<string> OutputFlag(
+    "o",
+    llreve::cl::desc("Output file for the minimized query, defaults to the "
+                     "name of the query with the extension .min.smt2"),
+    llreve::cl::cat(MinimizeCategory));
+static llreve::cl::opt<unsigned> TimeLimitFlag(
+    "time-limit",
+    llreve::cl::desc("Seconds the solver has to take on a reduction for it "
+                     "to be kept"),
+    llreve::cl::init(10), llreve::cl::cat(MinimizeCategory));
+static llreve::cl::opt<string> EngineFlag(
+    "engine",
+    llreve::cl::desc("The solver that is timed, one of the backends (see "
+                     "-solver-backend)"),
+    llreve::cl::init("spacer"), llreve::cl::cat(MinimizeCategory));
+static llreve::cl::opt<unsigned> JobsFlag(
+    "jobs",
+    llreve::cl::desc("Number of reductions that are tested at the same time, "
+                     "0 for the number of cores"),
+    llreve::cl::init(0), llreve::cl::cat(MinimizeCategory));
+static llreve::cl::list<string> SolverBackendFlags(
+    "solver-backend",
+    llreve::cl::desc("Register a solver reading the CHC-COMP format as "
+                     "NAME=COMMAND, the query is appended to COMMAND"),
+    llreve::cl::value_desc("NAME=COMMAND"), llreve::cl::cat(MinimizeCategory));
+static llreve::cl::opt<bool>
+    BitVectFlag("bitvect",
+                llreve::cl::desc("The query uses bitvectors instead of "
+                                 "unbounded ints"),
+                llreve::cl::cat(MinimizeCategory));
+
+static void printVersion() {
+    std::cout << "llreve-minimize version " << g_GIT_SHA1 << "\n";
+}
+
+static auto serializeOpts(const string &outputFileName,
+                          const SolverBackend &backend) -> SerializeOpts {
+    // The arrays in the query have already been instantiated if necessary
+    SerializeOpts opts(outputFileName, true, false, true, false);
+    opts.ChcComp = backend.format() == BackendFormat::ChcComp;
+    return opts;
+}
+
+// True if the engine exceeds the time limit on the query
+static auto isSlow(const vector<smt::SharedSMTRef> &query,
+                   const SolverEngine &engine) -> bool {
+    llvm::SmallString<128> queryFile;
+    if (std::error_code errorCode = llvm::sys::fs::createTemporaryFile(
+            "llreve-minimize", "smt2", queryFile)) {
+        logError("Could not create a temporary file: " + errorCode.message() +
+                 "\n");
+        exit(1);
+    }
+    {
+        std::ofstream out(queryFile.str().str());
+        writeSMT(out, query, false,
+                 serializeOpts(queryFile.str().str(), *engine.Backend));
+    }
+    const auto start = Clock::now();
+    PortfolioResult result = runPortfolio({engine}, queryFile.str().str());
+    const auto elapsed = Clock::now() - start;
+    llvm::sys::fs::remove(queryFile);
+    // The engine also answers unknown if it fails
+    return result.Result == SolverResult::Unknown &&
+           elapsed >= std::chrono::seconds(engine.Timeout);
+}
+
+static void writeMinimizedQuery(const vector<smt::SharedSMTRef> &query,
+                                const string &outputFileName,
+                                const SolverBackend &backend) {
+    std::ofstream out(outputFileName);
+    if (!out) {
+        logError("Could not open " + outputFileName + "\n");
+        exit(1);
+    }
+    out << "; Minimized from " << InputFlag << ", " << EngineFlag
+        << " takes longer than " << TimeLimitFlag << "s\n";
+    for (const auto &predicate : declaredPredicates(query)) {
+        const string origin = predicateOrigin(predicate);
+        if (!origin.empty()) {
+            out << "; " << predicate << ": " << origin << "\n";
+        }
+    }
+    writeSMT(out, query, false, serializeOpts(outputFileName, backend));
+}
+
+static auto countClauses(const vector<smt::SharedSMTRef> &query) -> size_t {
+    return static_cast<size_t>(
+        std::count_if(query.begin(), query.end(),
+                      [](const smt::SharedSMTRef &expr) {
+                          return expr->asAssert() != nullptr;
+                      }));
+}
+
+static int minimize() {
+    for (const auto &description : SolverBackendFlags) {
+        if (!registerSolverBackend(description)) {
+            logError("Invalid solver backend: " + description + "\n");
+            return 1;
+        }
+    }
+    const SolverBackend *backend = findSolverBackend(EngineFlag);
+    if (!backend) {
+        logError("Unknown solver engine: " + EngineFlag + "\n");
+        return 1;
+    }
+    const SolverEngine engine = {backend, TimeLimitFlag};
+    if (TimeLimitFlag == 0) {
+        logError("-time-limit has to be positive\n");
+        return 1;
+    }
+    string outputFileName = OutputFlag;
+    if (outputFileName.empty()) {
+        llvm::SmallString<128> path(InputFlag);
+        llvm::sys::path::replace_extension(path, "min.smt2");
+        outputFileName = path.str().str();
+    }
+    // The types are serialized depending on these options
+    SMTGenerationOpts::getInstance().BitVect = BitVectFlag;
+    SMTGenerationOpts::getInstance().OutputFormat = SMTFormat::SMTHorn;
+
+    smt::HashConsFactory factory;
+    const auto query = smt::readClauseFile(InputFlag, factory);
+    if (!isSlow(query, engine)) {
+        logError(EngineFlag + " does not exceed the time limit on " +
+                 InputFlag + "\n");
+        return 1;
+    }
+    unsigned jobs = JobsFlag;
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    MinimizedQuery minimized = minimizeQuery(
+        query,
+        [&](const vector<smt::SharedSMTRef> &reduced) {
+            return isSlow(reduced, engine);
+        },
+        jobs);
+    writeMinimizedQuery(minimized.Query, outputFileName, *backend);
+    std::cout << "Reduced " << countClauses(query) << " clauses to "
+              << countClauses(minimized.Query) << " after "
+              << minimized.Tests << " tests, written to " << outputFileName
+              << "\n";
+    return 0;
+}
+
+int main(int argc, const char **argv) {
+    llreve::cl::SetVersionPrinter(printVersion);
+    llreve::cl::HideUnrelatedOptions(MinimizeCategory);
+    llreve::cl::ParseCommandLineOptions(argc, argv,
+                                        "Minimizer for slow queries\n");
+    const int exitCode = minimize();
+    llvm::llvm_shutdown();
+    return exitCode;
+}
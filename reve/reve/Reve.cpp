@@ -8,19 +8,64 @@
  * See LICENSE (distributed with this file) for details.
  */
 
+#include "Arena.h"
+#include "Batch.h"
+#include "BinaryClauses.h"
+#include "BoundedModelChecking.h"
 #include "Compile.h"
+#include "Components.h"
+#include "CostModel.h"
+#include "Distributed.h"
+#include "DuplicateClauses.h"
+#include "FailureLocalization.h"
+#include "FixedAbstraction.h"
+#include "FloatAbstraction.h"
+#include "FunctionSummaries.h"
 #include "GitSHA1.h"
+#include "Helper.h"
+#include "IdenticalFunctions.h"
+#include "Incremental.h"
+#include "InvariantCache.h"
+#include "LoopAcceleration.h"
 #include "ModuleSMTGeneration.h"
 #include "Opts.h"
+#include "Portfolio.h"
+#include "PredicateElimination.h"
 #include "Preprocess.h"
+#include "ResultCache.h"
+#include "SMTReader.h"
 #include "Serialize.h"
+#include "Statistics.h"
+#include "StructuralCoupling.h"
+
+#ifdef LLREVE_SYNCHRONIZE_LOOPS
+#include "llreve/dynamic/LoopSynchronization.h"
+#endif
 
 #include "clang/Driver/Compilation.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
 
 #include "llvm/Transforms/IPO.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using clang::CodeGenAction;
 
 using clang::driver::ArgStringList;
@@ -60,14 +105,64 @@ static llreve::cl::opt<string> ResourceDirFlag(
     llreve::cl::desc("Directory containing the clang resource files, "
                      "e.g. /usr/local/lib/clang/3.8.0"),
     llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> CacheDirFlag(
+    "cache-dir",
+    llreve::cl::desc("Directory in which compiled modules are cached, "
+                     "caching is disabled if this is not set"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> IncludePCHFlag(
+    "include-pch",
+    llreve::cl::desc("Precompiled header that is included before both inputs, "
+                     "e.g. created with clang -x c-header"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> CodeGenNeededOnlyFlag(
+    "codegen-needed-only",
+    llreve::cl::desc("Only generate code for the main function pair, the "
+                     "coupled functions and the functions and globals they "
+                     "refer to. Requires -fun"),
+    llreve::cl::cat(ReveCategory));
+// The input files are only optional in server and batch mode
 static llreve::cl::opt<string> FileName1Flag(llreve::cl::Positional,
                                              llreve::cl::desc("FILE1"),
-                                             llreve::cl::Required,
                                              llreve::cl::cat(ReveCategory));
 static llreve::cl::opt<string> FileName2Flag(llreve::cl::Positional,
                                              llreve::cl::desc("FILE2"),
-                                             llreve::cl::Required,
                                              llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ServerFlag(
+    "server",
+    llreve::cl::desc(
+        "Read requests of the form 'FILE1 FILE2 OUTPUT' from stdin, one per "
+        "line, and answer each of them with 'ok OUTPUT' or 'error CODE'. The "
+        "remaining options apply to all requests"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> WatchFlag(
+    "watch",
+    llreve::cl::desc("Verify FILE1 and FILE2 again every time one of them "
+                     "changes, a verification that is still running is "
+                     "restarted. The invariants and results of earlier "
+                     "runs are reused. With -incremental, FILE is replaced "
+                     "by FILE.new once the programs are proven equivalent. "
+                     "Requires -solve"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> WatchIntervalFlag(
+    "watch-interval",
+    llreve::cl::desc("Milliseconds between two checks of the input files in "
+                     "-watch mode, a change is only picked up once the "
+                     "files have stayed the same for this long"),
+    llreve::cl::init(200), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> BatchFlag(
+    "batch",
+    llreve::cl::desc("Verify all function pairs listed in the JSON manifest "
+                     "FILE. Each pair of input files is only compiled once "
+                     "and up to -jobs pairs are verified concurrently. One "
+                     "JSON result per pair is written to -batch-results"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> BatchResultsFlag(
+    "batch-results",
+    llreve::cl::desc("File to which the results of -batch are written, one "
+                     "line per pair in the order in which they finish. "
+                     "Defaults to stdout"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
 
 static llreve::cl::opt<string> IRFileName1(
     "write-ir-1",
@@ -97,6 +192,22 @@ static llreve::cl::opt<bool> InferMarksFlag(
     "infer-marks",
     llreve::cl::desc("Infer marks instead of relying on annotations"),
     llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> InferredPathLimitFlag(
+    "inferred-path-limit",
+    llreve::cl::desc("Drop inferred marks of loops whose cycles are cut by "
+                     "other marks, as long as at most this many paths start "
+                     "at each remaining mark. This is decided for each "
+                     "program on its own, so the two programs may end up "
+                     "with different marks. 0 (the default) marks the "
+                     "top-level loops and their subloops"),
+    llreve::cl::init(0), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ScalarizeAllocasFlag(
+    "scalarize-allocas",
+    llreve::cl::desc("Replace local structs and arrays that do not escape and "
+                     "are only accessed at constant offsets by scalar "
+                     "variables. If no allocas remain, the stack is not "
+                     "encoded at all"),
+    llreve::cl::cat(ReveCategory));
 
 // SMT generation opts
 static llreve::cl::opt<string> MainFunctionFlag(
@@ -118,11 +229,38 @@ static llreve::cl::opt<bool>
     OnlyRecursiveFlag("only-rec",
                       llreve::cl::desc("Only generate recursive invariants"),
                       llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> AutoEncodingFlag(
+    "auto-encoding",
+    llreve::cl::desc("Choose between the iterative and the recursive "
+                     "encoding of the main functions based on the size of "
+                     "the invariants and the number of paths"),
+    llreve::cl::cat(ReveCategory));
 
 static llreve::cl::opt<bool> NoByteHeapFlag(
     "no-byte-heap",
     llreve::cl::desc("Treat each primitive type as a single array entry"),
     llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> WordHeapFlag(
+    "word-heap",
+    llreve::cl::desc("Treat each primitive type as a single array entry if "
+                     "both programs only access memory in aligned units of "
+                     "whole primitives through pointers of matching types"),
+    llreve::cl::cat(ReveCategory));
+
+static llreve::cl::opt<bool> AbstractFloatsFlag(
+    "abstract-floats",
+    llreve::cl::desc("Encode floating point operations as uninterpreted "
+                     "functions and only encode them precisely if the "
+                     "clauses are unsatisfiable with the abstraction"),
+    llreve::cl::cat(ReveCategory));
+
+static llreve::cl::opt<bool> LazyExternsFlag(
+    "lazy-extern-abstraction",
+    llreve::cl::desc("Leave the results of coupled extern calls unconstrained "
+                     "at first and only abstract an extern pair as "
+                     "equivalent once the clauses are unsatisfiable and an "
+                     "unsatisfiable query calls it"),
+    llreve::cl::cat(ReveCategory));
 
 static llreve::cl::opt<bool> EverythingSignedFlag(
     "signed", llreve::cl::desc("Treat all operations as signed operatons"),
@@ -161,6 +299,20 @@ static llreve::cl::opt<bool> DisableAutoCouplingFlag(
     "disable-auto-coupling",
     llreve::cl::desc("Disable automatic coupling based on function names"),
     llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> CoupleByStructureFlag(
+    "couple-by-structure",
+    llreve::cl::desc("Additionally couple renamed functions that have the "
+                     "same structure after preprocessing, i.e. the same "
+                     "types, shape of the CFG and number of instructions of "
+                     "each kind, if the match is unique"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> SkipIdenticalFlag(
+    "skip-identical",
+    llreve::cl::desc("Assume coupled functions that are identical up to the "
+                     "names of their values after preprocessing to be "
+                     "equivalent if the functions they call are, instead of "
+                     "generating clauses for them"),
+    llreve::cl::cat(ReveCategory));
 static llreve::cl::opt<bool> DisableAutoAbstraction(
     "disable-auto-abstraction",
     llreve::cl::desc(
@@ -174,6 +326,316 @@ static llreve::cl::opt<bool>
 static llreve::cl::opt<bool> InlineLets("inline-lets",
                                         llreve::cl::desc("Inline lets"),
                                         llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ShareSubtermsFlag(
+    "share-subterms",
+    llreve::cl::desc("Bind subterms that would be printed more than once to "
+                     "lets, mostly useful together with -inline-lets. Only "
+                     "affects the SMT-HORN format"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> SimplifyFlag(
+    "simplify",
+    llreve::cl::desc("Fold constants in the clauses and drop the clauses that "
+                     "are trivially true. Only affects the SMT-HORN format"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> CompressFlag(
+    "compress",
+    llreve::cl::desc("Write the SMT output file gzip compressed, the "
+                     "compression runs on a separate thread. Compressed "
+                     "files can be passed to -load-smt and the solvers"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> JobsFlag(
+    "jobs",
+    llreve::cl::desc("Number of threads used for generating the clauses of "
+                     "different functions and for serializing them"),
+    llreve::cl::init(1), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> MergePathsFlag(
+    "merge-paths",
+    llreve::cl::desc("Encode all paths between two marks in a single clause "
+                     "instead of one clause per path. This avoids an "
+                     "exponential number of clauses for sequential branches"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> LinearForbiddenPathsFlag(
+    "linear-forbidden-paths",
+    llreve::cl::desc("Encode forbidden paths using one clause per path and an "
+                     "auxiliary predicate instead of one clause per pair of "
+                     "paths. Calls on these paths are not coupled"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> SharedPathRelationsFlag(
+    "shared-path-relations",
+    llreve::cl::desc("Define the transition relation of each path between "
+                     "two marks once and refer to it from the synchronized, "
+                     "forbidden and stutter clauses instead of repeating its "
+                     "assignments in each of them"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ReduceInvariantArgsFlag(
+    "reduce-invariant-args",
+    llreve::cl::desc("Pass only one of the variables that are provably equal "
+                     "at a mark, e.g. the arguments of the two programs, to "
+                     "the invariants of the main functions"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> HeapRegionsFlag(
+    "heap-regions",
+    llreve::cl::desc("Split the heap into one array per region of memory that "
+                     "alias analysis proves disjoint from the other regions. "
+                     "Not supported together with the stack or custom "
+                     "relations"),
+    llreve::cl::cat(ReveCategory));
+#ifdef LLREVE_SYNCHRONIZE_LOOPS
+// The sampling uses the interpreter of llreve-dynamic
+static llreve::cl::opt<bool> SynchronizeLoopsFlag(
+    "synchronize-loops",
+    llreve::cl::desc("Run random examples and peel or unroll the loops of "
+                     "the main functions so that they run in lockstep, see "
+                     "-max-examples and -sampling"),
+    llreve::cl::cat(ReveCategory));
+#endif
+#ifdef LLREVE_VERIFY
+// llreve-verify is a replacement for the llreve.py wrapper: it solves the
+// clauses in process and reports the verdict and timing as JSON by default.
+static const char *const DefaultSolver = "z3";
+static const bool DefaultReportJSON = true;
+#else
+static const char *const DefaultSolver = "";
+static const bool DefaultReportJSON = false;
+#endif
+static llreve::cl::opt<string> SolveFlag(
+    "solve",
+    llreve::cl::desc("Solve the generated clauses in process using the given "
+                     "solver instead of writing them out. The result (sat, "
+                     "unsat or unknown) is printed to stdout. 'z3' solves "
+                     "them using the z3 API, 'portfolio' writes them to the "
+                     "output file and runs Eldarica, z3 spacer and z3 "
+                     "duality on it in parallel, 'distributed' writes them "
+                     "to the output file and solves them using the "
+                     "-solver-worker commands, 'bmc' unrolls them up to "
+                     "-bmc-bound steps and only finds counterexamples, i.e. "
+                     "it answers unsat or unknown"),
+    llreve::cl::init(DefaultSolver), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> BMCBoundFlag(
+    "bmc-bound",
+    llreve::cl::desc("The maximal number of steps from mark to mark that "
+                     "-solve=bmc unrolls, the depth is increased one step at "
+                     "a time until a counterexample is found"),
+    llreve::cl::init(10), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ReportJSONFlag(
+    "report-json",
+    llreve::cl::desc("Print a JSON object containing the verdict (EQUAL, "
+                     "NOT_EQUAL or UNKNOWN, only if -solve is used) and the "
+                     "time in seconds spent in each phase instead of the "
+                     "solver result"),
+    llreve::cl::init(DefaultReportJSON), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> StatsJSONFlag(
+    "stats-json",
+    llreve::cl::desc("Write the time spent in each phase and counters such as "
+                     "the number of paths, clauses and SMT nodes as JSON to "
+                     "the given file"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> StatsTraceFlag(
+    "stats-trace",
+    llreve::cl::desc("Write the timed phases in the Chrome trace event format "
+                     "to the given file"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> ResultCacheFlag(
+    "result-cache",
+    llreve::cl::desc("Directory in which the results of -solve are cached. "
+                     "Queries that only differ in the names of bound "
+                     "variables share an entry"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> DedupClausesFlag(
+    "dedup-clauses",
+    llreve::cl::desc("Remove clauses that are identical to an earlier one up "
+                     "to the names of bound variables and the order of "
+                     "conjuncts and disjuncts"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ConeOfInfluenceFlag(
+    "cone-of-influence",
+    llreve::cl::desc("Remove clauses and predicates that the queries do not "
+                     "depend on, e.g. unused functional abstractions, before "
+                     "writing out or solving the clauses"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> AccelerateLoopsFlag(
+    "accelerate-loops",
+    llreve::cl::desc("Replace loops that only add constants to integers and "
+                     "whose conditions are linear by their closed form, so "
+                     "no invariant is needed for them. Requires the loop to "
+                     "be the only recursive clause of its predicate, e.g. "
+                     "with -perfect-sync"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> EliminatePredicatesFlag(
+    "eliminate-predicates",
+    llreve::cl::desc("Inline predicates that are defined by a single clause "
+                     "and used once, e.g. the marks along straight-line "
+                     "code. The model lists their definitions after the "
+                     "model of the solver"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> EliminatePredicatesMaxSizeFlag(
+    "eliminate-predicates-max-size",
+    llreve::cl::desc("Only inline a predicate if the resulting clause has at "
+                     "most this many nodes"),
+    llreve::cl::init(10000), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> SplitComponentsFlag(
+    "split-components",
+    llreve::cl::desc("Split the clauses into independent components that "
+                     "share no predicates. Component i is written to "
+                     "OUTPUT.i.smt2 and the components are solved "
+                     "separately (using up to -jobs threads)"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> RefuteFirstFlag(
+    "refute-first",
+    llreve::cl::desc("Before solving the complete system with -solve, solve "
+                     "each clause that applies no invariant on its own, e.g. "
+                     "the synchronized loop-free paths from entry to exit. "
+                     "If one of them is unsat, the programs are reported as "
+                     "not equivalent without searching for invariants"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ShardOutputFlag(
+    "shard-output",
+    llreve::cl::desc("Write the declarations to OUTPUT.header.smt2 and the "
+                     "clauses of each independent component to OUTPUT.i.smt2 "
+                     "(using up to -jobs threads) and list the files in "
+                     "OUTPUT.manifest.json. The header together with any "
+                     "shard is a complete query"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> EldaricaTimeoutFlag(
+    "eldarica-timeout",
+    llreve::cl::desc("Time limit in seconds for Eldarica in the solver "
+                     "portfolio, 0 means no limit"),
+    llreve::cl::init(0), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> SpacerTimeoutFlag(
+    "spacer-timeout",
+    llreve::cl::desc("Time limit in seconds for z3 spacer in the solver "
+                     "portfolio, 0 means no limit"),
+    llreve::cl::init(0), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> DualityTimeoutFlag(
+    "duality-timeout",
+    llreve::cl::desc("Time limit in seconds for z3 duality in the solver "
+                     "portfolio, 0 means no limit"),
+    llreve::cl::init(0), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> PortfolioEnginesFlag(
+    "portfolio-engines",
+    llreve::cl::desc("Comma separated solver backends that -solve=portfolio "
+                     "runs in parallel, see -solver-backend"),
+    llreve::cl::init("eldarica,spacer,duality"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::list<string> SolverBackendFlags(
+    "solver-backend",
+    llreve::cl::desc("Register an external Horn solver as NAME=COMMAND, it "
+                     "is run as COMMAND followed by a query in the CHC-COMP "
+                     "format and has to answer sat or unsat. Can be used in "
+                     "-portfolio-engines, -distributed-engines and "
+                     "-worker-engine"),
+    llreve::cl::value_desc("NAME=COMMAND"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> BackendTimeoutFlag(
+    "backend-timeout",
+    llreve::cl::desc("Time limit in seconds for the solvers in the portfolio "
+                     "that have no limit of their own, 0 means no limit"),
+    llreve::cl::init(0), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> ChcCompFlag(
+    "chc-comp",
+    llreve::cl::desc("Write the clauses strictly in the format of the CHC "
+                     "competition, e.g. without (get-model). Lets are "
+                     "inlined and implications merged"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> ClauseOrderFlag(
+    "clause-order",
+    llreve::cl::desc("The order of the predicates and clauses in the SMT-HORN "
+                     "output: 'generation' keeps the order they are generated "
+                     "in, 'topological' declares the predicates from the "
+                     "entry to the queries and groups the clauses defining "
+                     "a predicate"),
+    llreve::cl::value_desc("generation|topological"),
+    llreve::cl::init("generation"), llreve::cl::cat(ReveCategory));
+static llreve::cl::list<string> SolverWorkerFlags(
+    "solver-worker",
+    llreve::cl::desc("Command that starts a solver worker for "
+                     "-solve=distributed, e.g. 'ssh node1 llreve'. The query "
+                     "is passed on stdin. Can be given multiple times, each "
+                     "worker solves one query at a time"),
+    llreve::cl::value_desc("COMMAND"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> DistributedEnginesFlag(
+    "distributed-engines",
+    llreve::cl::desc("Comma separated engines that -solve=distributed tries "
+                     "on each query in this order until one of them answers "
+                     "sat or unsat. Supported are z3 (using the z3 API), "
+                     "eldarica, spacer and duality"),
+    llreve::cl::init("spacer,eldarica,duality"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<unsigned> DistributedTimeoutFlag(
+    "distributed-timeout",
+    llreve::cl::desc("Time limit in seconds for each engine in "
+                     "-solve=distributed, 0 means no limit"),
+    llreve::cl::init(0), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> CostModelFlag(
+    "cost-model",
+    llreve::cl::desc("File in which the solving times of -batch and "
+                     "-solve=distributed are learned. Both start the "
+                     "function pairs and queries that are predicted to be "
+                     "cheapest first, without this file the prediction "
+                     "only depends on their size"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> SolveWorkerFlag(
+    "solve-worker",
+    llreve::cl::desc("Read a query in SMT-LIB or the binary clause format "
+                     "from stdin, solve it using -worker-engine and print the "
+                     "result. This is the worker mode of -solve=distributed"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> WorkerEngineFlag(
+    "worker-engine",
+    llreve::cl::desc("The engine used by -solve-worker, one of the engines "
+                     "of -distributed-engines"),
+    llreve::cl::init("z3"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> IncrementalFlag(
+    "incremental",
+    llreve::cl::desc("File containing the hashes of previously proven "
+                     "function pairs. Unchanged pairs are assumed to be "
+                     "equivalent. The hash of the main functions is added "
+                     "and written to FILE.new, replace FILE by it once the "
+                     "generated SMT has been proven"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> LocalizeFailuresFlag(
+    "localize-failures",
+    llreve::cl::desc("Solve the inverted query (-invert) with z3, find all "
+                     "functions with a violated clause and write them to "
+                     "FILE. If FILE names failing functions of an earlier "
+                     "run, their clauses are checked first and the others "
+                     "only if they hold now. Combine it with -incremental "
+                     "to reuse the proofs of unchanged function pairs"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> FunctionSummariesFlag(
+    "function-summaries",
+    llreve::cl::desc("File containing define-funs of the entry invariants of "
+                     "abstracted functions, e.g. INV_REC_f__1. They are used "
+                     "at every call site instead of an unknown predicate. If "
+                     "the clauses are solved, the summaries of the model are "
+                     "written to FILE.new"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> InvariantCacheFlag(
+    "invariant-cache",
+    llreve::cl::desc("Directory in which the solved invariants are stored by "
+                     "the signature of their predicate. Cached invariants "
+                     "are checked first when solving, if they are not "
+                     "inductive the clauses are solved without them"),
+    llreve::cl::value_desc("DIR"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<string> LoadSMTFlag(
+    "load-smt",
+    llreve::cl::desc("Read the clauses from FILE instead of generating them "
+                     "from the input programs. FILE can be in SMT-LIB or in "
+                     "the format written by -binary-clauses. The clauses are "
+                     "solved if -solve is given and otherwise written out "
+                     "as SMT-LIB"),
+    llreve::cl::value_desc("FILE"), llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> BinaryClausesFlag(
+    "binary-clauses",
+    llreve::cl::desc("Write the generated clauses in a compact binary format "
+                     "instead of SMT-LIB. Shared subterms are only written "
+                     "once and the file can be read back quickly using "
+                     "-load-smt"),
+    llreve::cl::cat(ReveCategory));
+static llreve::cl::opt<bool> NoPrettyFlag(
+    "no-pretty",
+    llreve::cl::desc("Don’t pretty print the SMT output. This writes the "
+                     "output directly which is faster and needs less memory"),
+    llreve::cl::cat(ReveCategory));
 
 static void printVersion() {
     std::cout << "llreve version " << g_GIT_SHA1 << "\n";
@@ -188,25 +650,742 @@ static void printModule(llvm::Module &mod, llvm::StringRef fileName) {
     mod.print(stream, nullptr);
 }
 
-int main(int argc, const char **argv) {
-    llreve::cl::SetVersionPrinter(printVersion);
-    parseCommandLineArguments(argc, argv);
+using Clock = std::chrono::steady_clock;
+
+// Wall clock time spent in the phases of a single verification, in the order
+// in which they were recorded
+class PhaseTimes {
+  public:
+    void add(const string &phase, Clock::duration duration) {
+        phases.push_back({phase, duration});
+    }
+    void addSince(const string &phase, Clock::time_point start) {
+        add(phase, Clock::now() - start);
+    }
+    void printJSON(std::ostream &out, const string &verdict) const {
+        out << "{";
+        if (!verdict.empty()) {
+            out << "\"verdict\": \"" << verdict << "\", ";
+        }
+        out << "\"times\": {";
+        for (size_t i = 0; i < phases.size(); ++i) {
+            if (i > 0) {
+                out << ", ";
+            }
+            out << "\"" << phases[i].first << "\": "
+                << std::chrono::duration<double>(phases[i].second).count();
+        }
+        out << "}}\n";
+    }
+
+  private:
+    vector<std::pair<string, Clock::duration>> phases;
+};
+
+// Time spent writing out queries for external solvers. The queries can be
+// solved on several threads so this is the sum over all of them.
+static std::atomic<Clock::rep> SerializeTicks{0};
+
+static void timedSerializeSMT(const vector<SharedSMTRef> &query, bool muZ,
+                              const SerializeOpts &opts) {
+    auto start = Clock::now();
+    serializeSMT(query, muZ, opts);
+    SerializeTicks += (Clock::now() - start).count();
+}
+
+static void writeBinaryClauseFile(const vector<SharedSMTRef> &clauses,
+                                  const string &fileName) {
+    stats::ScopedTimer timer("serialize");
+    if (fileName.empty()) {
+        smt::writeBinaryClauses(clauses, std::cout);
+        return;
+    }
+    std::ofstream out(fileName, std::ios::binary);
+    smt::writeBinaryClauses(clauses, out);
+}
 
+// The engines of -portfolio-engines
+static auto portfolioEngines() -> vector<SolverEngine> {
+    vector<SolverEngine> engines;
+    for (const auto &name : split(PortfolioEnginesFlag, ',')) {
+        if (name.empty()) {
+            continue;
+        }
+        const SolverBackend *backend = findSolverBackend(name);
+        if (!backend) {
+            logError("Unknown solver backend: " + name + "\n");
+            exit(1);
+        }
+        const BackendCapabilities capabilities = backend->capabilities();
+        if ((BitVectFlag && !capabilities.BitVectors) ||
+            (DontInstantiate && !capabilities.Arrays)) {
+            logWarning(name + " does not support the encoding, it is not "
+                              "part of the portfolio\n");
+            continue;
+        }
+        unsigned timeout = BackendTimeoutFlag;
+        if (name == "eldarica") {
+            timeout = EldaricaTimeoutFlag;
+        } else if (name == "spacer") {
+            timeout = SpacerTimeoutFlag;
+        } else if (name == "duality") {
+            timeout = DualityTimeoutFlag;
+        }
+        engines.push_back({backend, timeout});
+    }
+    if (engines.empty()) {
+        logError("The solver portfolio is empty\n");
+        exit(1);
+    }
+    return engines;
+}
+
+static SolverOutput solveQuery(const vector<SharedSMTRef> &query,
+                               const SerializeOpts &opts) {
+    string hash;
+    SolverOutput output = {SolverResult::Unknown, ""};
+    if (!ResultCacheFlag.empty()) {
+        hash = queryHash(query, opts);
+        if (lookupCachedResult(ResultCacheFlag, hash, output)) {
+            llvm::errs() << "Using cached result for " << hash << "\n";
+            return output;
+        }
+    }
+    if (SolveFlag == "z3") {
+        output = solveWithZ3(query, opts);
+    } else if (SolveFlag == "bmc") {
+        output = boundedModelCheck(query, opts, BMCBoundFlag);
+    } else {
+        const vector<SolverEngine> engines = portfolioEngines();
+        SerializeOpts portfolioOpts = opts;
+        if (portfolioFormat(engines) == BackendFormat::ChcComp) {
+            portfolioOpts.ChcComp = true;
+        }
+        timedSerializeSMT(query, false, portfolioOpts);
+        auto portfolioResult = runPortfolio(engines, opts.OutputFileName);
+        if (!portfolioResult.Engine.empty()) {
+            llvm::errs() << "Solved " << opts.OutputFileName << " by "
+                         << portfolioResult.Engine << "\n";
+        }
+        output = {portfolioResult.Result, portfolioResult.Model};
+    }
+    if (!ResultCacheFlag.empty()) {
+        storeCachedResult(ResultCacheFlag, hash, output);
+    }
+    return output;
+}
+
+// The queries are written to their output files and shipped to the workers
+static SolverOutput
+solveQueriesDistributed(const vector<vector<SharedSMTRef>> &queries,
+                        const vector<SerializeOpts> &queryOpts) {
+    vector<string> queryFiles;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (BinaryClausesFlag) {
+            writeBinaryClauseFile(queries[i], queryOpts[i].OutputFileName);
+        } else {
+            timedSerializeSMT(queries[i], false, queryOpts[i]);
+        }
+        queryFiles.push_back(queryOpts[i].OutputFileName);
+    }
+    DistributedOpts opts;
+    for (const auto &worker : SolverWorkerFlags) {
+        vector<string> command;
+        for (const auto &word : split(worker, ' ')) {
+            if (!word.empty()) {
+                command.push_back(word);
+            }
+        }
+        opts.Workers.push_back(command);
+    }
+    if (BitVectFlag) {
+        opts.WorkerArgs.push_back("-bitvect");
+    }
+    opts.Engines = split(DistributedEnginesFlag, ',');
+    opts.Timeout = DistributedTimeoutFlag;
+    CostModel costModel(CostModelFlag, "queries");
+    vector<vector<double>> features;
+    for (const auto &query : queries) {
+        features.push_back(queryFeatures(query));
+        opts.Costs.push_back(costModel.predict(features.back()));
+    }
+    vector<double> solveTimes;
+    SolverOutput output = solveDistributed(queryFiles, opts, solveTimes);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (solveTimes[i] >= 0) {
+            costModel.record(features[i], solveTimes[i]);
+        }
+    }
+    costModel.save();
+    return output;
+}
+
+// The queries are independent so they are solved in parallel. The combined
+// result is sat only if all queries are sat, so we stop as soon as one of
+// them is not. The model is the union of the models of all queries.
+static SolverOutput solveQueries(const vector<vector<SharedSMTRef>> &queries,
+                                 const vector<SerializeOpts> &queryOpts) {
+    if (SolveFlag == "distributed") {
+        return solveQueriesDistributed(queries, queryOpts);
+    }
+    vector<SolverOutput> outputs(queries.size(), {SolverResult::Sat, ""});
+    size_t threadCount =
+        std::min<size_t>(std::max<unsigned>(JobsFlag, 1), queries.size());
+    // If the queries are already solved in parallel each one is serialized
+    // on the thread that solves it
+    vector<SerializeOpts> opts = queryOpts;
+    if (threadCount > 1) {
+        for (auto &queryOpt : opts) {
+            queryOpt.Jobs = 1;
+        }
+    }
+    std::atomic<size_t> nextQuery{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]() {
+        size_t i;
+        while (!failed && (i = nextQuery++) < queries.size()) {
+            outputs[i] = solveQuery(queries[i], opts[i]);
+            // Bounded model checking never answers sat, so only a
+            // counterexample makes the other queries irrelevant
+            if (outputs[i].Result == SolverResult::Unsat ||
+                (outputs[i].Result == SolverResult::Unknown &&
+                 SolveFlag != "bmc")) {
+                failed = true;
+            }
+        }
+    };
+    if (threadCount <= 1) {
+        worker();
+    } else {
+        vector<std::thread> threads;
+        for (size_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back(worker);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+    SolverOutput combined = {SolverResult::Sat, ""};
+    for (const auto &output : outputs) {
+        if (output.Result == SolverResult::Unsat) {
+            return {SolverResult::Unsat, ""};
+        }
+        if (output.Result == SolverResult::Unknown) {
+            combined.Result = SolverResult::Unknown;
+        }
+        combined.Model += output.Model;
+    }
+    if (combined.Result != SolverResult::Sat) {
+        combined.Model.clear();
+    }
+    return combined;
+}
+
+// Solves the clauses without invariants of the queries one at a time, in the
+// order in which they are generated. Returns true as soon as one of them is
+// unsat, the complete system is unsat as well in that case.
+static bool refuteClosedClauses(const vector<vector<SharedSMTRef>> &queries,
+                                const SerializeOpts &serializeOpts) {
+    vector<vector<SharedSMTRef>> closedQueries;
+    for (const auto &query : queries) {
+        for (auto &closedQuery : closedClauseQueries(query)) {
+            closedQueries.push_back(std::move(closedQuery));
+        }
+    }
+    if (closedQueries.empty()) {
+        return false;
+    }
+    llvm::errs() << "Checking " << closedQueries.size()
+                 << " clauses without invariants first\n";
+    stats::ScopedTimer timer("refute first");
+    for (size_t i = 0; i < closedQueries.size(); ++i) {
+        SerializeOpts opts = serializeOpts;
+        if (!opts.OutputFileName.empty()) {
+            opts.OutputFileName = componentFileName(
+                serializeOpts.OutputFileName, "closed." + std::to_string(i));
+        }
+        stats::count("refute first.queries");
+        if (solveQueries({closedQueries[i]}, {opts}).Result ==
+            SolverResult::Unsat) {
+            llvm::errs() << "Clause " << i << " without invariants is unsat\n";
+            return true;
+        }
+    }
+    return false;
+}
+
+// The definitions of the predicates removed by -eliminate-predicates
+static string eliminatedDefinitions;
+
+// Generates the clauses and splits them into the queries that are solved or
+// serialized
+static vector<vector<SharedSMTRef>>
+generateQueries(MonoPair<const llvm::Module &> modules,
+                const AnalysisResultsMap &analysisResults,
+                const FileOptions &fileOpts) {
+    vector<SharedSMTRef> smtExprs =
+        generateSMT(modules, analysisResults, fileOpts);
+    if (DedupClausesFlag) {
+        size_t exprCount = smtExprs.size();
+        smtExprs = removeDuplicateClauses(smtExprs);
+        llvm::errs() << "Removed " << exprCount - smtExprs.size()
+                     << " duplicate clauses and declarations\n";
+    }
+    if (AccelerateLoopsFlag) {
+        llvm::errs() << "Accelerated " << accelerateLoops(smtExprs)
+                     << " loops\n";
+    }
+    if (ConeOfInfluenceFlag) {
+        size_t exprCount = smtExprs.size();
+        smtExprs = removeIrrelevantClauses(smtExprs);
+        llvm::errs() << "Removed " << exprCount - smtExprs.size()
+                     << " irrelevant clauses and declarations\n";
+    }
+    if (EliminatePredicatesFlag) {
+        auto eliminated =
+            eliminatePredicates(smtExprs, EliminatePredicatesMaxSizeFlag);
+        llvm::errs() << "Eliminated " << eliminated.Definitions.size()
+                     << " predicates\n";
+        smtExprs = std::move(eliminated.Clauses);
+        // The expressions only live as long as the arena, so the definitions
+        // are kept as text for printing the model
+        std::ostringstream text;
+        for (const auto &def : eliminated.Definitions) {
+            def->serialize(text, 0);
+            text << "\n";
+        }
+        eliminatedDefinitions = text.str();
+    }
+
+    vector<vector<SharedSMTRef>> queries;
+    if (SplitComponentsFlag) {
+        queries = splitIndependentComponents(smtExprs);
+        llvm::errs() << "Split clauses into " << queries.size()
+                     << " components\n";
+    } else {
+        queries.push_back(std::move(smtExprs));
+    }
+    return queries;
+}
+
+static vector<SerializeOpts> queryOptions(size_t queryCount,
+                                          const SerializeOpts &serializeOpts,
+                                          const string &outputFileName) {
+    vector<SerializeOpts> queryOpts(queryCount, serializeOpts);
+    if (SplitComponentsFlag && !outputFileName.empty()) {
+        for (size_t i = 0; i < queryCount; ++i) {
+            queryOpts[i].OutputFileName = componentFileName(outputFileName, i);
+        }
+    }
+    return queryOpts;
+}
+
+// Solves the clauses in which the cached invariants are defined. The result
+// is only meaningful if it is sat, otherwise one of the cached invariants may
+// not be inductive anymore. The definitions are removed afterwards.
+static SolverOutput
+solveWithCachedInvariants(const InvariantSignatures &signatures,
+                          MonoPair<const llvm::Module &> modules,
+                          const AnalysisResultsMap &analysisResults,
+                          const FileOptions &fileOpts,
+                          const SerializeOpts &serializeOpts,
+                          const string &outputFileName) {
+    auto &smtOpts = SMTGenerationOpts::getInstance();
+    const auto iterativeInvariants = smtOpts.IterativeRelationalInvariants;
+    const auto relationalInvariants = smtOpts.FunctionalRelationalInvariants;
+    size_t applied = applyCachedInvariants(InvariantCacheFlag, signatures,
+                                           analysisResults, smtOpts);
+    SolverOutput output = {SolverResult::Unknown, ""};
+    if (applied > 0) {
+        llvm::errs() << "Checking " << applied << " of " << signatures.size()
+                     << " invariants from the cache\n";
+        auto queries = generateQueries(modules, analysisResults, fileOpts);
+        output = solveQueries(
+            queries,
+            queryOptions(queries.size(), serializeOpts, outputFileName));
+        if (output.Result != SolverResult::Sat) {
+            llvm::errs() << "Cached invariants are not inductive, solving "
+                            "without them\n";
+        }
+    }
+    smtOpts.IterativeRelationalInvariants = iterativeInvariants;
+    smtOpts.FunctionalRelationalInvariants = relationalInvariants;
+    return output;
+}
+
+// An unsat result may be caused by the abstraction of the floating point
+// operations, so the clauses are solved again with the next class of
+// operations encoded precisely until they are sat or nothing is left to refine
+static SolverOutput
+solveRefiningFloats(SolverOutput output, MonoPair<const llvm::Module &> modules,
+                    const AnalysisResultsMap &analysisResults,
+                    const FileOptions &fileOpts,
+                    const SerializeOpts &serializeOpts,
+                    const string &outputFileName) {
+    auto &smtOpts = SMTGenerationOpts::getInstance();
+    while (output.Result == SolverResult::Unsat &&
+           refineFloatAbstraction(smtOpts.AbstractFloatOps)) {
+        llvm::errs() << "Refining the floating point abstraction\n";
+        auto queries = generateQueries(modules, analysisResults, fileOpts);
+        output = solveQueries(
+            queries,
+            queryOptions(queries.size(), serializeOpts, outputFileName));
+    }
+    return output;
+}
+
+// With -lazy-extern-abstraction an unsat result may be caused by the
+// unconstrained extern calls, so the extern pairs applied by the unsat
+// queries are abstracted as equivalent and the clauses are solved again until
+// they are sat or the unsat queries apply no unconstrained pair
+static SolverOutput
+solveRefiningExterns(SolverOutput output, vector<vector<SharedSMTRef>> queries,
+                     MonoPair<const llvm::Module &> modules,
+                     const AnalysisResultsMap &analysisResults,
+                     const FileOptions &fileOpts,
+                     const SerializeOpts &serializeOpts,
+                     const string &outputFileName) {
+    auto &smtOpts = SMTGenerationOpts::getInstance();
+    while (output.Result == SolverResult::Unsat) {
+        vector<SerializeOpts> queryOpts =
+            queryOptions(queries.size(), serializeOpts, outputFileName);
+        set<MonoPair<const llvm::Function *>> refined;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            // A single query is known to be unsat, otherwise the unsat ones
+            // have to be found
+            if (queries.size() > 1 &&
+                solveQueries({queries[i]}, {queryOpts[i]}).Result !=
+                    SolverResult::Unsat) {
+                continue;
+            }
+            auto applied = appliedExternAbstractions(
+                queries[i], smtOpts.UnconstrainedExterns);
+            refined.insert(applied.begin(), applied.end());
+        }
+        if (refined.empty()) {
+            break;
+        }
+        for (const auto &funPair : refined) {
+            smtOpts.UnconstrainedExterns.erase(funPair);
+        }
+        stats::count("lazy externs.refined", refined.size());
+        llvm::errs() << "Abstracting " << refined.size()
+                     << " extern function pairs as equivalent\n";
+        queries = generateQueries(modules, analysisResults, fileOpts);
+        output = solveQueries(
+            queries,
+            queryOptions(queries.size(), serializeOpts, outputFileName));
+    }
+    return output;
+}
+
+static void writeStatistics() {
+    if (!StatsJSONFlag.empty()) {
+        std::ofstream out(StatsJSONFlag);
+        stats::writeJSON(out);
+    }
+    if (!StatsTraceFlag.empty()) {
+        std::ofstream out(StatsTraceFlag);
+        stats::writeTrace(out);
+    }
+}
+
+// The result printed last as for the clauses that are not inverted, used by
+// -watch to decide whether the hashes of the proven pairs can be kept
+static SolverResult LastSolverResult = SolverResult::Unknown;
+
+// 'inverted' tells whether the result belongs to the negated clauses of
+// -invert, a model of them is a counterexample
+static void printSolverOutput(const SolverOutput &output,
+                              const PhaseTimes &times, bool inverted) {
+    SolverResult result = output.Result;
+    if (inverted && result != SolverResult::Unknown) {
+        result = result == SolverResult::Sat ? SolverResult::Unsat
+                                             : SolverResult::Sat;
+    }
+    LastSolverResult = result;
+    if (ReportJSONFlag) {
+        // In the SMT-HORN encoding the programs are equivalent iff the
+        // clauses are satisfiable
+        switch (result) {
+        case SolverResult::Sat:
+            times.printJSON(std::cout, "EQUAL");
+            break;
+        case SolverResult::Unsat:
+            times.printJSON(std::cout, "NOT_EQUAL");
+            break;
+        case SolverResult::Unknown:
+            times.printJSON(std::cout, "UNKNOWN");
+            break;
+        }
+    } else {
+        switch (output.Result) {
+        case SolverResult::Sat:
+            std::cout << "sat\n" << output.Model << eliminatedDefinitions;
+            break;
+        case SolverResult::Unsat:
+            std::cout << "unsat\n";
+            break;
+        case SolverResult::Unknown:
+            std::cout << "unknown\n";
+            break;
+        }
+    }
+}
+
+static auto clauseOrder() -> ClauseOrder {
+    if (ClauseOrderFlag == "generation") {
+        return ClauseOrder::Generation;
+    }
+    if (ClauseOrderFlag == "topological") {
+        return ClauseOrder::Topological;
+    }
+    logError("Unsupported clause order: " + string(ClauseOrderFlag) + "\n");
+    exit(1);
+}
+
+static void checkSolveFlags(const string &outputFileName) {
+    if (SolveFlag != "z3" && SolveFlag != "portfolio" &&
+        SolveFlag != "distributed" && SolveFlag != "bmc") {
+        logError("Unsupported solver: " + string(SolveFlag) + "\n");
+        exit(1);
+    }
+    if (SolveFlag == "portfolio" && outputFileName.empty()) {
+        logError("The solver portfolio requires an output file\n");
+        exit(1);
+    }
+    if (SolveFlag == "distributed") {
+        if (outputFileName.empty()) {
+            logError("Distributed solving requires an output file\n");
+            exit(1);
+        }
+        if (SolverWorkerFlags.empty()) {
+            logError("Distributed solving requires at least one "
+                     "-solver-worker\n");
+            exit(1);
+        }
+    }
+    if (MuZFlag) {
+        logError("Solving is not supported for the muZ format\n");
+        exit(1);
+    }
+    // These solve the clauses using the z3 API
+    if (BitVectFlag && (SolveFlag == "z3" || SolveFlag == "bmc")) {
+        logError("-bitvect is only supported by -solve=portfolio and "
+                 "-solve=distributed\n");
+        exit(1);
+    }
+    if (BitVectFlag && SolveFlag == "distributed") {
+        const auto engines = split(DistributedEnginesFlag, ',');
+        if (std::find(engines.begin(), engines.end(), "z3") != engines.end()) {
+            logError("-bitvect cannot be combined with the z3 engine of "
+                     "-distributed-engines\n");
+            exit(1);
+        }
+    }
+    // These rely on a model of the clauses being an invariant
+    if (InvertFlag &&
+        (RefuteFirstFlag || !InvariantCacheFlag.empty() ||
+         !FunctionSummariesFlag.empty() || AbstractFloatsFlag ||
+         LazyExternsFlag)) {
+        logError("Solving -invert cannot be combined with -refute-first, "
+                 "-invariant-cache, -function-summaries, -abstract-floats "
+                 "or -lazy-extern-abstraction\n");
+        exit(1);
+    }
+}
+
+// Solve or convert previously generated clauses without compiling and
+// analyzing the programs again
+static int loadSMTFile(const string &fileName, string outputFileName) {
+    if (!SolveFlag.empty()) {
+        checkSolveFlags(outputFileName);
+    }
+    if (ShardOutputFlag) {
+        if (MuZFlag || !SolveFlag.empty() || SplitComponentsFlag ||
+            BinaryClausesFlag) {
+            logError("-shard-output only supports writing the SMT-HORN "
+                     "format and cannot be combined with -solve, "
+                     "-split-components or -binary-clauses\n");
+            exit(1);
+        }
+        if (outputFileName.empty()) {
+            logError("-shard-output requires an output file\n");
+            exit(1);
+        }
+    }
+
+    if (!StatsJSONFlag.empty() || !StatsTraceFlag.empty()) {
+        stats::enable(!StatsTraceFlag.empty());
+    }
+    // The types are serialized depending on these options
+    SMTGenerationOpts::getInstance().BitVect = BitVectFlag;
+    SMTGenerationOpts::getInstance().OutputFormat =
+        MuZFlag ? SMTFormat::Z3 : SMTFormat::SMTHorn;
+    SerializeOpts serializeOpts(outputFileName, DontInstantiate, BitVectFlag,
+                                !NoPrettyFlag, InlineLets);
+    serializeOpts.Jobs = JobsFlag;
+    serializeOpts.ShareSubterms = ShareSubtermsFlag;
+    serializeOpts.Simplify = SimplifyFlag;
+    serializeOpts.Compress = CompressFlag;
+    serializeOpts.ChcComp = ChcCompFlag;
+    serializeOpts.Order = clauseOrder();
+
+    PhaseTimes times;
+    auto start = Clock::now();
+    smt::HashConsFactory factory;
+    vector<vector<SharedSMTRef>> queries;
+    {
+        stats::ScopedTimer timer("load");
+        queries.push_back(smt::readClauseFile(fileName, factory));
+    }
+    times.addSince("load", start);
+    SerializeTicks = 0;
+    if (SolveFlag.empty()) {
+        timedSerializeSMT(queries.front(), MuZFlag, serializeOpts);
+        times.add("serialize", Clock::duration(SerializeTicks));
+        if (ReportJSONFlag) {
+            times.printJSON(std::cout, "");
+        }
+    } else {
+        start = Clock::now();
+        SolverOutput output = {SolverResult::Unsat, ""};
+        if (!RefuteFirstFlag || !refuteClosedClauses(queries, serializeOpts)) {
+            output = solveQueries(queries, {serializeOpts});
+        }
+        times.add("serialize", Clock::duration(SerializeTicks));
+        times.addSince("solve", start);
+        printSolverOutput(output, times, InvertFlag);
+    }
+    writeStatistics();
+    return 0;
+}
+
+static void checkVerifyFlags(const string &outputFileName) {
+    if (!SolveFlag.empty()) {
+        checkSolveFlags(outputFileName);
+        if (BinaryClausesFlag && SolveFlag != "distributed") {
+            logError("-binary-clauses can only be combined with "
+                     "-solve=distributed\n");
+            exit(1);
+        }
+    }
+    if (ChcCompFlag && MuZFlag) {
+        logError("-chc-comp cannot be combined with -muz\n");
+        exit(1);
+    }
+    if (ConeOfInfluenceFlag && MuZFlag) {
+        logError("The cone of influence reduction is not supported for the "
+                 "muZ format\n");
+        exit(1);
+    }
+    if (AccelerateLoopsFlag && (MuZFlag || BitVectFlag || InvertFlag)) {
+        logError("Loop acceleration is only supported for the SMT-HORN "
+                 "format with integers\n");
+        exit(1);
+    }
+    if (LazyExternsFlag &&
+        (SolveFlag.empty() || !LocalizeFailuresFlag.empty())) {
+        logError("-lazy-extern-abstraction requires -solve and cannot be "
+                 "combined with -localize-failures\n");
+        exit(1);
+    }
+    if (!LocalizeFailuresFlag.empty() &&
+        (!InvertFlag || SolveFlag != "z3" || MuZFlag || SplitComponentsFlag ||
+         ShardOutputFlag)) {
+        logError("-localize-failures requires -invert and -solve=z3 and "
+                 "cannot be combined with -muz, -split-components or "
+                 "-shard-output\n");
+        exit(1);
+    }
+    if (CodeGenNeededOnlyFlag && MainFunctionFlag.empty()) {
+        logError("-codegen-needed-only requires -fun\n");
+        exit(1);
+    }
+    if (AutoEncodingFlag && OnlyRecursiveFlag) {
+        logError("-auto-encoding cannot be combined with -only-rec\n");
+        exit(1);
+    }
+    if (EliminatePredicatesFlag && MuZFlag) {
+        logError("Eliminating predicates is not supported for the muZ "
+                 "format\n");
+        exit(1);
+    }
+    if (SplitComponentsFlag) {
+        if (MuZFlag) {
+            logError("Splitting components is not supported for the muZ "
+                     "format\n");
+            exit(1);
+        }
+        if (SolveFlag != "z3" && outputFileName.empty()) {
+            logError("Splitting components requires an output file\n");
+            exit(1);
+        }
+    }
+}
+
+// The compiled input programs. The actions own the contexts of the modules so
+// they have to stay alive as long as the modules are used.
+struct CompiledPrograms {
+    unique_ptr<CodeGenAction> FirstAction;
+    unique_ptr<CodeGenAction> SecondAction;
+    MonoPair<unique_ptr<llvm::Module>> Modules;
+    FileOptions FileOpts;
+    Clock::duration CompileTime;
+};
+
+static auto compilePrograms(const char *exeName, InputOpts inputOpts)
+    -> unique_ptr<CompiledPrograms> {
+    auto start = Clock::now();
+    unique_ptr<CodeGenAction> act1 = makeCodeGenAction(inputOpts);
+    unique_ptr<CodeGenAction> act2 = makeCodeGenAction(inputOpts);
+    MonoPair<unique_ptr<llvm::Module>> modules =
+        compileToModules(exeName, inputOpts, {*act1, *act2});
+    FileOptions fileOpts = getFileOptions(inputOpts.FileNames);
+    return unique_ptr<CompiledPrograms>(new CompiledPrograms{
+        std::move(act1), std::move(act2), std::move(modules),
+        std::move(fileOpts), Clock::now() - start});
+}
+
+// Frees the modules, their contexts and the analysis results which make up
+// most of the memory for large inputs. The function pointers in
+// SMTGenerationOpts dangle afterwards.
+static void releasePrograms(CompiledPrograms &programs,
+                            AnalysisResultsMap &analysisResults) {
+    stats::ScopedTimer timer("release programs");
+    analysisResults.clear();
+    // The modules belong to the contexts of the actions
+    programs.Modules.first.reset();
+    programs.Modules.second.reset();
+    programs.FirstAction.reset();
+    programs.SecondAction.reset();
+}
+
+// Verify the pair of functions named 'mainFunctionName' in the compiled
+// programs and write the SMT to 'outputFileName' (stdout if it is empty). The
+// modules are preprocessed for this pair so they can’t be used for another
+// one afterwards and they are freed as soon as they are no longer needed.
+static int verifyPrograms(CompiledPrograms &programs,
+                          const string &mainFunctionName,
+                          const string &outputFileName) {
     PreprocessOpts preprocessOpts(ShowCFGFlag, ShowMarkedCFGFlag,
                                   InferMarksFlag);
-    InputOpts inputOpts(IncludesFlag, ResourceDirFlag, FileName1Flag,
-                        FileName2Flag);
-    FileOptions fileOpts = getFileOptions(inputOpts.FileNames);
-    SerializeOpts serializeOpts(OutputFileNameFlag, DontInstantiate,
-                                BitVectFlag, true, InlineLets);
+    preprocessOpts.InferredPathLimit = InferredPathLimitFlag;
+    preprocessOpts.ScalarizeAllocas = ScalarizeAllocasFlag;
+    const FileOptions &fileOpts = programs.FileOpts;
+    SerializeOpts serializeOpts(outputFileName, DontInstantiate, BitVectFlag,
+                                !NoPrettyFlag, InlineLets);
+    serializeOpts.Jobs = JobsFlag;
+    serializeOpts.ShareSubterms = ShareSubtermsFlag;
+    serializeOpts.Simplify = SimplifyFlag;
+    serializeOpts.Compress = CompressFlag;
+    serializeOpts.ChcComp = ChcCompFlag;
+    serializeOpts.Order = clauseOrder();
 
-    std::unique_ptr<CodeGenAction> act1 =
-        std::make_unique<clang::EmitLLVMOnlyAction>();
-    std::unique_ptr<CodeGenAction> act2 =
-        std::make_unique<clang::EmitLLVMOnlyAction>();
-    MonoPair<unique_ptr<llvm::Module>> modules =
-        compileToModules(argv[0], inputOpts, {*act1, *act2});
-    MonoPair<llvm::Module &> moduleRefs = {*modules.first, *modules.second};
+    PhaseTimes times;
+    times.add("compile", programs.CompileTime);
+    MonoPair<llvm::Module &> moduleRefs = {*programs.Modules.first,
+                                           *programs.Modules.second};
 
     std::map<const llvm::Function *, int> functionNumerals;
     MonoPair<std::map<int, const llvm::Function *>> reversedFunctionNumerals = {
@@ -214,14 +1393,18 @@ int main(int argc, const char **argv) {
     std::tie(functionNumerals, reversedFunctionNumerals) =
         generateFunctionMap(moduleRefs);
     SMTGenerationOpts::initialize(
-        findMainFunction(moduleRefs, MainFunctionFlag),
+        findMainFunction(moduleRefs, mainFunctionName),
         HeapFlag ? HeapOpt::Enabled : HeapOpt::Disabled,
         StackFlag ? StackOpt::Enabled : StackOpt::Disabled,
         GlobalConstantsFlag ? GlobalConstantsOpt::Enabled
                             : GlobalConstantsOpt::Disabled,
-        OnlyRecursiveFlag ? FunctionEncoding::OnlyRecursive
-                          : FunctionEncoding::Iterative,
-        NoByteHeapFlag ? ByteHeapOpt::Disabled : ByteHeapOpt::Enabled,
+        OnlyRecursiveFlag
+            ? FunctionEncoding::OnlyRecursive
+            : AutoEncodingFlag ? FunctionEncoding::Automatic
+                               : FunctionEncoding::Iterative,
+        NoByteHeapFlag
+            ? ByteHeapOpt::Disabled
+            : WordHeapFlag ? ByteHeapOpt::Automatic : ByteHeapOpt::Enabled,
         EverythingSignedFlag, MuZFlag ? SMTFormat::Z3 : SMTFormat::SMTHorn,
         PerfectSyncFlag ? PerfectSynchronization::Enabled
                         : PerfectSynchronization::Disabled,
@@ -232,19 +1415,670 @@ int main(int argc, const char **argv) {
         getCoupledFunctions(moduleRefs, DisableAutoCouplingFlag,
                             parseFunctionPairFlags(CoupleFunctionsFlag)),
         functionNumerals, reversedFunctionNumerals);
+    SMTGenerationOpts::getInstance().Jobs = JobsFlag;
+    SMTGenerationOpts::getInstance().MergePaths = MergePathsFlag;
+    SMTGenerationOpts::getInstance().LinearForbiddenPaths =
+        LinearForbiddenPathsFlag;
+    SMTGenerationOpts::getInstance().SharedPathRelations =
+        SharedPathRelationsFlag;
+    SMTGenerationOpts::getInstance().ReduceInvariantArguments =
+        ReduceInvariantArgsFlag;
+    if (HeapRegionsFlag && (fileOpts.InRelation || fileOpts.OutRelation)) {
+        logWarning("Custom relations refer to the complete heap, ignoring "
+                   "-heap-regions\n");
+    } else {
+        SMTGenerationOpts::getInstance().PartitionHeap = HeapRegionsFlag;
+    }
 
-    const auto analysisResults = preprocessModules(moduleRefs, preprocessOpts);
-    printModule(*modules.first, IRFileName1);
-    printModule(*modules.second, IRFileName2);
+    auto start = Clock::now();
+    auto analysisResults = preprocessModules(moduleRefs, preprocessOpts);
+#ifdef LLREVE_SYNCHRONIZE_LOOPS
+    if (SynchronizeLoopsFlag) {
+        llreve::dynamic::synchronizeLoops(
+            SMTGenerationOpts::getInstance().MainFunctions, analysisResults);
+    }
+#endif
+    times.addSince("preprocess", start);
+    printModule(moduleRefs.first, IRFileName1);
+    printModule(moduleRefs.second, IRFileName2);
 
-    vector<SharedSMTRef> smtExprs =
-        generateSMT(moduleRefs, analysisResults, fileOpts);
+    if (CoupleByStructureFlag) {
+        size_t coupled = coupleFunctionsByStructure(
+            moduleRefs, analysisResults,
+            SMTGenerationOpts::getInstance().CoupledFunctions);
+        llvm::errs() << "Coupled " << coupled
+                     << " function pairs by their structure\n";
+    }
+    if (SkipIdenticalFlag) {
+        size_t identical = assumeIdenticalPairsEquivalent(
+            SMTGenerationOpts::getInstance(), fileOpts);
+        llvm::errs() << "Skipping " << identical
+                     << " identical function pairs\n";
+    }
+
+    if (!IncrementalFlag.empty()) {
+        // Hashes have to be computed after preprocessing since this removes
+        // irrelevant differences, e.g. in the names of variables
+        auto proven = readProvenPairHashes(IncrementalFlag);
+        auto &smtOpts = SMTGenerationOpts::getInstance();
+        size_t assumed =
+            assumeProvenPairsEquivalent(proven, smtOpts, fileOpts);
+        llvm::errs() << "Reusing " << assumed << " function pairs\n";
+        // Pairs assumed by -assume-equivalent were never proven
+        string hash = AssumeEquivalentFlags.empty()
+                          ? standaloneProofHash(smtOpts, fileOpts)
+                          : "";
+        if (!hash.empty()) {
+            proven.insert(hash);
+        }
+        writeProvenPairHashes(IncrementalFlag + ".new", proven);
+    }
+    // The programs may be released before solving
+    MonoPair<std::map<int, string>> functionNames = {{}, {}};
+    if (!LocalizeFailuresFlag.empty()) {
+        functionNames =
+            functionNamesByNumeral(SMTGenerationOpts::getInstance());
+    }
+    std::map<string, SharedSMTRef> summaries;
+    if (!FunctionSummariesFlag.empty()) {
+        summaries = readFunctionSummaries(FunctionSummariesFlag);
+        size_t applied =
+            applyFunctionSummaries(summaries, moduleRefs, analysisResults,
+                                   SMTGenerationOpts::getInstance());
+        llvm::errs() << "Reusing " << applied << " function summaries\n";
+    }
 
-    serializeSMT(smtExprs,
-                 SMTGenerationOpts::getInstance().OutputFormat == SMTFormat::Z3,
-                 serializeOpts);
+    if (AbstractFloatsFlag) {
+        auto &smtOpts = SMTGenerationOpts::getInstance();
+        smtOpts.AbstractFloatOps =
+            declareFloatAbstractions(moduleRefs, smtOpts);
+    }
+    if (LazyExternsFlag) {
+        auto &smtOpts = SMTGenerationOpts::getInstance();
+        smtOpts.UnconstrainedExterns = lazyExternAbstractions(smtOpts);
+        llvm::errs() << "Leaving " << smtOpts.UnconstrainedExterns.size()
+                     << " extern function pairs unconstrained\n";
+    }
 
-    llvm::llvm_shutdown();
+    {
+        // The SMT nodes of the generated query are only needed until they have
+        // been serialized so we allocate them in an arena and free them at
+        // once.
+        Arena smtArena;
+        ArenaScope arenaScope(smtArena);
+        start = Clock::now();
+        vector<vector<SharedSMTRef>> queries =
+            generateQueries(moduleRefs, analysisResults, fileOpts);
+        stats::count("smt nodes", smtArena.allocations());
+        times.addSince("generate", start);
+        if (SolveFlag.empty() || (InvariantCacheFlag.empty() &&
+                                  !AbstractFloatsFlag && !LazyExternsFlag)) {
+            // Only the invariant cache and the refinement of the float and
+            // extern abstractions generate clauses again, the rest just
+            // works on the SMT which refers to the programs by name
+            releasePrograms(programs, analysisResults);
+        }
+        vector<SerializeOpts> queryOpts =
+            queryOptions(queries.size(), serializeOpts, outputFileName);
+
+        SerializeTicks = 0;
+        if (ShardOutputFlag) {
+            start = Clock::now();
+            serializeShards(queries.front(), serializeOpts);
+            times.addSince("serialize", start);
+            if (ReportJSONFlag) {
+                times.printJSON(std::cout, "");
+            }
+        } else if (SolveFlag.empty()) {
+            for (size_t i = 0; i < queries.size(); ++i) {
+                if (BinaryClausesFlag) {
+                    writeBinaryClauseFile(queries[i],
+                                          queryOpts[i].OutputFileName);
+                    continue;
+                }
+                timedSerializeSMT(
+                    queries[i],
+                    SMTGenerationOpts::getInstance().OutputFormat ==
+                        SMTFormat::Z3,
+                    queryOpts[i]);
+            }
+            times.add("serialize", Clock::duration(SerializeTicks));
+            if (ReportJSONFlag) {
+                times.printJSON(std::cout, "");
+            }
+        } else if (!LocalizeFailuresFlag.empty()) {
+            start = Clock::now();
+            LocalizedOutput localized = solveLocalizingFailures(
+                queries.front(), readFailingFunctions(LocalizeFailuresFlag),
+                functionNames, serializeOpts);
+            times.addSince("solve", start);
+            for (const auto &failing : localized.Failing) {
+                llvm::errs() << "Failing functions: "
+                             << describeFailingFunctions(failing) << "\n";
+            }
+            // An unknown result tells nothing about the earlier failures
+            if (localized.Result != SolverResult::Unknown) {
+                writeFailingFunctions(LocalizeFailuresFlag,
+                                      localized.Failing);
+            }
+            // A model of the inverted query is a counterexample, the result
+            // is reported as for the clauses that are not inverted
+            SolverOutput output = {SolverResult::Unknown, ""};
+            if (localized.Result == SolverResult::Sat) {
+                output.Result = SolverResult::Unsat;
+            } else if (localized.Result == SolverResult::Unsat) {
+                output.Result = SolverResult::Sat;
+            }
+            printSolverOutput(output, times, false);
+        } else {
+            start = Clock::now();
+            SolverOutput output = {SolverResult::Unknown, ""};
+            InvariantSignatures signatures;
+            const bool refuted = RefuteFirstFlag &&
+                                 refuteClosedClauses(queries, serializeOpts);
+            if (refuted) {
+                output = {SolverResult::Unsat, ""};
+            } else if (!InvariantCacheFlag.empty()) {
+                for (const auto &query : queries) {
+                    auto querySignatures = invariantSignatures(query);
+                    signatures.insert(querySignatures.begin(),
+                                      querySignatures.end());
+                }
+                output = solveWithCachedInvariants(
+                    signatures, moduleRefs, analysisResults, fileOpts,
+                    serializeOpts, outputFileName);
+            }
+            if (!refuted && output.Result != SolverResult::Sat) {
+                output = solveQueries(queries, queryOpts);
+            }
+            if (LazyExternsFlag) {
+                output = solveRefiningExterns(output, queries, moduleRefs,
+                                              analysisResults, fileOpts,
+                                              serializeOpts, outputFileName);
+            }
+            if (AbstractFloatsFlag) {
+                output = solveRefiningFloats(output, moduleRefs,
+                                             analysisResults, fileOpts,
+                                             serializeOpts, outputFileName);
+            }
+            if (!InvariantCacheFlag.empty() &&
+                output.Result == SolverResult::Sat) {
+                storeSolvedInvariants(InvariantCacheFlag, signatures,
+                                      output.Model);
+            }
+            times.add("serialize", Clock::duration(SerializeTicks));
+            times.addSince("solve", start);
+            printSolverOutput(output, times, InvertFlag);
+            if (!FunctionSummariesFlag.empty() &&
+                output.Result == SolverResult::Sat) {
+                writeFunctionSummaries(FunctionSummariesFlag + ".new",
+                                       output.Model, summaries);
+            }
+        }
+    }
+    writeStatistics();
+    return 0;
+}
+
+// Run a single verification and write the SMT to 'outputFileName' (stdout if
+// it is empty)
+static int verify(const char *exeName, InputOpts inputOpts,
+                  string outputFileName) {
+    checkVerifyFlags(outputFileName);
+    if (!StatsJSONFlag.empty() || !StatsTraceFlag.empty()) {
+        stats::enable(!StatsTraceFlag.empty());
+    }
+    if (CodeGenNeededOnlyFlag) {
+        // Batch mode verifies several functions of the same programs, so this
+        // is only done for a single verification
+        inputOpts.CodeGenRoots.insert(MainFunctionFlag);
+        for (const auto &funPair :
+             parseFunctionPairFlags(CoupleFunctionsFlag)) {
+            inputOpts.CodeGenRoots.insert(funPair.first);
+            inputOpts.CodeGenRoots.insert(funPair.second);
+        }
+    }
+    unique_ptr<CompiledPrograms> programs = compilePrograms(exeName, inputOpts);
+    return verifyPrograms(*programs, MainFunctionFlag, outputFileName);
+}
 
+// Answer verification requests read from stdin. Everything that is expensive
+// to set up (loading the binary, parsing the options, static initialization
+// of clang & LLVM) is only done once. Each request is handled in a forked
+// child so a failing request (we exit on errors) cannot take down the server
+// and no state leaks from one request into the next.
+static int runServer(const char *exeName) {
+#ifdef _WIN32
+    logError("Server mode is not supported on Windows\n");
+    return 1;
+#else
+    string line;
+    while (std::getline(std::cin, line)) {
+        vector<string> request;
+        for (const auto &part : split(line, ' ')) {
+            if (!part.empty()) {
+                request.push_back(part);
+            }
+        }
+        if (request.empty()) {
+            continue;
+        }
+        if (request.size() != 3) {
+            std::cout << "error invalid request" << std::endl;
+            continue;
+        }
+        // Make sure the child doesn’t inherit buffered output
+        std::cout.flush();
+        llvm::errs().flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cout << "error fork failed" << std::endl;
+            continue;
+        }
+        if (pid == 0) {
+            InputOpts inputOpts(IncludesFlag, ResourceDirFlag, request.at(0),
+                                request.at(1));
+            inputOpts.CacheDir = CacheDirFlag;
+            inputOpts.PrecompiledHeader = IncludePCHFlag;
+            int exitCode = verify(exeName, inputOpts, request.at(2));
+            std::cout.flush();
+            llvm::errs().flush();
+            _exit(exitCode);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            std::cout << "ok " << request.at(2) << std::endl;
+        } else if (WIFEXITED(status)) {
+            std::cout << "error " << WEXITSTATUS(status) << std::endl;
+        } else {
+            std::cout << "error crashed" << std::endl;
+        }
+    }
     return 0;
+#endif
+}
+
+#ifndef _WIN32
+// Identifies the contents of a file without reading it, empty if the file
+// doesn’t exist (e.g. while an editor replaces it)
+static auto fileVersion(const string &fileName) -> string {
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0) {
+        return "";
+    }
+#ifdef __APPLE__
+    const long nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+    const long nanoseconds = st.st_mtim.tv_nsec;
+#endif
+    return std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) +
+           ":" + std::to_string(st.st_mtime) + "." +
+           std::to_string(nanoseconds);
+}
+
+static auto inputVersions() -> MonoPair<string> {
+    return {fileVersion(FileName1Flag), fileVersion(FileName2Flag)};
+}
+
+// Sets the caches that carry state from one verification to the next to
+// directories of this session unless they are given explicitly
+static void initializeWatchSession() {
+    // -incremental is not enabled by default, proofs only carry over to
+    // pairs that are main functions themselves
+    if ((InvertFlag || !InvariantCacheFlag.empty()) &&
+        !ResultCacheFlag.empty()) {
+        return;
+    }
+    llvm::SmallString<128> session;
+    if (std::error_code errorCode =
+            llvm::sys::fs::createUniqueDirectory("llreve-watch", session)) {
+        logError("Couldn’t create a directory for the session: " +
+                 errorCode.message() + "\n");
+        exit(1);
+    }
+    const string dir = session.str().str();
+    // A model of the inverted clauses is no invariant
+    if (InvariantCacheFlag.empty() && !InvertFlag) {
+        InvariantCacheFlag = dir + "/invariants";
+    }
+    if (ResultCacheFlag.empty()) {
+        ResultCacheFlag = dir + "/results";
+    }
+    llvm::errs() << "Caching the state of the session in " << dir << "\n";
+}
+#endif
+
+// Verify the input files every time they change. Like in server mode every
+// verification runs in a forked child, so clang and LLVM are only set up once
+// and an error only ends that verification. The children share their state
+// through the files of -invariant-cache and -result-cache (and -incremental
+// if it is given): verifications start from the invariants found before and
+// reverting an edit reuses the earlier result.
+static int runWatch(const char *exeName) {
+#ifdef _WIN32
+    logError("Watch mode is not supported on Windows\n");
+    return 1;
+#else
+    if (FileName1Flag.empty() || FileName2Flag.empty()) {
+        logError("Two input files are required\n");
+        return 1;
+    }
+    if (SolveFlag.empty()) {
+        logError("-watch requires -solve\n");
+        return 1;
+    }
+    checkVerifyFlags(OutputFileNameFlag);
+    initializeWatchSession();
+
+    const auto interval = std::chrono::milliseconds(WatchIntervalFlag);
+    MonoPair<string> verified = {"", ""};
+    pid_t child = -1;
+    Clock::time_point start;
+    while (true) {
+        const MonoPair<string> current = inputVersions();
+        const bool changed = !(current == verified) &&
+                             !current.first.empty() &&
+                             !current.second.empty();
+        if (changed) {
+            // Editors often write a file in several steps
+            std::this_thread::sleep_for(interval);
+            if (!(inputVersions() == current)) {
+                continue;
+            }
+            if (child > 0) {
+                kill(child, SIGKILL);
+                waitpid(child, nullptr, 0);
+                llvm::errs() << "Restarting the verification\n";
+            }
+            verified = current;
+            // Make sure the child doesn’t inherit buffered output
+            std::cout.flush();
+            llvm::errs().flush();
+            child = fork();
+            if (child < 0) {
+                logError("fork failed\n");
+                return 1;
+            }
+            if (child == 0) {
+                InputOpts inputOpts(IncludesFlag, ResourceDirFlag,
+                                    FileName1Flag, FileName2Flag);
+                inputOpts.CacheDir = CacheDirFlag;
+                inputOpts.PrecompiledHeader = IncludePCHFlag;
+                int exitCode = verify(exeName, inputOpts, OutputFileNameFlag);
+                // The result is reported as for clauses that are not
+                // inverted, so sat is the verdict EQUAL
+                if (exitCode == 0 && !IncrementalFlag.empty() &&
+                    LastSolverResult == SolverResult::Sat) {
+                    llvm::sys::fs::rename(IncrementalFlag + ".new",
+                                          IncrementalFlag);
+                }
+                std::cout.flush();
+                llvm::errs().flush();
+                _exit(exitCode);
+            }
+            start = Clock::now();
+        }
+        if (child > 0) {
+            int status = 0;
+            if (waitpid(child, &status, WNOHANG) == child) {
+                child = -1;
+                const double seconds =
+                    std::chrono::duration<double>(Clock::now() - start)
+                        .count();
+                if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                    llvm::errs() << "Verified in " << seconds << "s\n";
+                } else if (WIFEXITED(status)) {
+                    llvm::errs() << "Verification failed with exit code "
+                                 << WEXITSTATUS(status) << "\n";
+                } else {
+                    llvm::errs() << "Verification crashed\n";
+                }
+                llvm::errs() << "Waiting for changes of " << FileName1Flag
+                             << " or " << FileName2Flag << "\n";
+                continue;
+            }
+        }
+        std::this_thread::sleep_for(interval);
+    }
+#endif
+}
+
+#ifndef _WIN32
+namespace {
+// A pair that is verified in a forked child, its stdout is read from 'Fd'
+struct BatchChild {
+    pid_t Pid;
+    int Fd;
+    size_t Pair;
+    string Output;
+    Clock::time_point Start;
+};
+}
+
+static auto batchResult(int status, string output) -> BatchResult {
+    if (WIFEXITED(status)) {
+        return {WEXITSTATUS(status) == 0 ? BatchStatus::Ok
+                                         : BatchStatus::Error,
+                WEXITSTATUS(status), std::move(output)};
+    }
+    return {BatchStatus::Crashed, -1, std::move(output)};
+}
+#endif
+
+// Verify all pairs of a manifest. Compiling the programs (starting clang,
+// parsing the headers) is done once for each pair of input files in this
+// process. Like in server mode each pair is then verified in a forked child
+// which gets its own copy-on-write copy of the modules, since preprocessing
+// modifies them for the main function of the pair, and exiting on errors only
+// affects the pair that failed.
+static int runBatch(const char *exeName) {
+#ifdef _WIN32
+    logError("Batch mode is not supported on Windows\n");
+    return 1;
+#else
+    if (!OutputFileNameFlag.empty()) {
+        logError("-o cannot be combined with -batch, the output files are "
+                 "listed in the manifest\n");
+        exit(1);
+    }
+    if (!StatsJSONFlag.empty() || !StatsTraceFlag.empty()) {
+        logError("-stats-json and -stats-trace cannot be combined with "
+                 "-batch\n");
+        exit(1);
+    }
+    vector<BatchPair> pairs =
+        readBatchManifest(BatchFlag, {FileName1Flag, FileName2Flag});
+    for (const auto &pair : pairs) {
+        checkVerifyFlags(pair.OutputFileName);
+    }
+
+    std::map<MonoPair<string>, unique_ptr<CompiledPrograms>> programs;
+    for (const auto &pair : pairs) {
+        auto &compiled = programs[pair.FileNames];
+        if (!compiled) {
+            InputOpts inputOpts(IncludesFlag, ResourceDirFlag,
+                                pair.FileNames.first, pair.FileNames.second);
+            inputOpts.CacheDir = CacheDirFlag;
+            inputOpts.PrecompiledHeader = IncludePCHFlag;
+            compiled = compilePrograms(exeName, inputOpts);
+        }
+    }
+    llvm::errs() << "Compiled " << programs.size() << " pairs of programs for "
+                 << pairs.size() << " function pairs\n";
+
+    // Cheap pairs are verified first, so the results of most pairs (and
+    // failures in particular) are known early and the expensive pairs don’t
+    // block the free jobs
+    CostModel costModel(CostModelFlag, "programs");
+    vector<vector<double>> features;
+    vector<double> costs;
+    for (const auto &pair : pairs) {
+        const auto &modules = programs.at(pair.FileNames)->Modules;
+        const string function =
+            pair.Function.empty() ? string(MainFunctionFlag) : pair.Function;
+        features.push_back(
+            programFeatures({modules.first->getFunction(function),
+                             modules.second->getFunction(function)}));
+        costs.push_back(costModel.predict(features.back()));
+    }
+    const vector<size_t> order = shortestFirst(costs);
+
+    std::ofstream resultFile;
+    if (!BatchResultsFlag.empty()) {
+        resultFile.open(BatchResultsFlag);
+        if (!resultFile) {
+            logError("Couldn’t open " + string(BatchResultsFlag) + "\n");
+            exit(1);
+        }
+    }
+    std::ostream &results = BatchResultsFlag.empty() ? std::cout : resultFile;
+
+    // The pairs are verified concurrently instead of using threads within
+    // the verification of one pair
+    const size_t jobs = std::max<unsigned>(JobsFlag, 1);
+    vector<BatchChild> running;
+    size_t nextPair = 0;
+    int exitCode = 0;
+    while (nextPair < pairs.size() || !running.empty()) {
+        while (nextPair < pairs.size() && running.size() < jobs) {
+            const BatchPair &pair = pairs[order[nextPair]];
+            int fds[2];
+            if (pipe(fds) != 0) {
+                logError("Couldn’t create a pipe\n");
+                exit(1);
+            }
+            // Make sure the child doesn’t inherit buffered output
+            std::cout.flush();
+            results.flush();
+            llvm::errs().flush();
+            pid_t pid = fork();
+            if (pid < 0) {
+                close(fds[0]);
+                close(fds[1]);
+                writeBatchResult(results, pair, {BatchStatus::Error, -1, ""});
+                exitCode = 1;
+                ++nextPair;
+                continue;
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                dup2(fds[1], STDOUT_FILENO);
+                close(fds[1]);
+                JobsFlag = 1;
+                int childExitCode = verifyPrograms(
+                    *programs.at(pair.FileNames),
+                    pair.Function.empty() ? string(MainFunctionFlag)
+                                          : pair.Function,
+                    pair.OutputFileName);
+                std::cout.flush();
+                llvm::errs().flush();
+                _exit(childExitCode);
+            }
+            close(fds[1]);
+            running.push_back(
+                {pid, fds[0], order[nextPair], "", Clock::now()});
+            ++nextPair;
+        }
+        if (running.empty()) {
+            continue;
+        }
+
+        // Read the output of the children as it arrives so that none of them
+        // blocks on a full pipe
+        vector<pollfd> pollFds;
+        for (const auto &child : running) {
+            pollFds.push_back({child.Fd, POLLIN, 0});
+        }
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logError("poll failed\n");
+            exit(1);
+        }
+        vector<BatchChild> stillRunning;
+        for (size_t i = 0; i < running.size(); ++i) {
+            BatchChild &child = running[i];
+            if (pollFds[i].revents != 0) {
+                char buffer[4096];
+                ssize_t bytes = read(child.Fd, buffer, sizeof(buffer));
+                if (bytes > 0) {
+                    child.Output.append(buffer, bytes);
+                } else if (bytes == 0 || errno != EINTR) {
+                    close(child.Fd);
+                    int status = 0;
+                    waitpid(child.Pid, &status, 0);
+                    BatchResult result =
+                        batchResult(status, std::move(child.Output));
+                    if (result.Status != BatchStatus::Ok) {
+                        exitCode = 1;
+                    } else {
+                        costModel.record(
+                            features[child.Pair],
+                            std::chrono::duration<double>(Clock::now() -
+                                                          child.Start)
+                                .count());
+                    }
+                    writeBatchResult(results, pairs[child.Pair], result);
+                    results.flush();
+                    continue;
+                }
+            }
+            stillRunning.push_back(std::move(child));
+        }
+        running = std::move(stillRunning);
+    }
+    costModel.save();
+    return exitCode;
+#endif
+}
+
+// Solve a single query for the coordinator of -solve=distributed
+static int runWorker() {
+    // The types are serialized depending on these options
+    SMTGenerationOpts::getInstance().BitVect = BitVectFlag;
+    SMTGenerationOpts::getInstance().OutputFormat = SMTFormat::SMTHorn;
+    SerializeOpts serializeOpts("", DontInstantiate, BitVectFlag,
+                                !NoPrettyFlag, InlineLets);
+    return runSolverWorker(WorkerEngineFlag, serializeOpts, std::cin,
+                           std::cout);
+}
+
+int main(int argc, const char **argv) {
+    llreve::cl::SetVersionPrinter(printVersion);
+    parseCommandLineArguments(argc, argv);
+    for (const auto &description : SolverBackendFlags) {
+        if (!registerSolverBackend(description)) {
+            logError("Invalid solver backend: " + description + "\n");
+            return 1;
+        }
+    }
+
+    int exitCode = 0;
+    if (ServerFlag) {
+        exitCode = runServer(argv[0]);
+    } else if (WatchFlag) {
+        exitCode = runWatch(argv[0]);
+    } else if (SolveWorkerFlag) {
+        exitCode = runWorker();
+    } else if (!BatchFlag.empty()) {
+        exitCode = runBatch(argv[0]);
+    } else if (!LoadSMTFlag.empty()) {
+        exitCode = loadSMTFile(LoadSMTFlag, OutputFileNameFlag);
+    } else {
+        if (FileName1Flag.empty() || FileName2Flag.empty()) {
+            logError("Two input files are required\n");
+            return 1;
+        }
+        InputOpts inputOpts(IncludesFlag, ResourceDirFlag, FileName1Flag,
+                            FileName2Flag);
+        inputOpts.CacheDir = CacheDirFlag;
+        inputOpts.PrecompiledHeader = IncludePCHFlag;
+        exitCode = verify(argv[0], inputOpts, OutputFileNameFlag);
+    }
+
+    llvm::llvm_shutdown();
+
+    return exitCode;
 }
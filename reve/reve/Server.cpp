@@ -0,0 +1,719 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+// An HTTP service for verifying pairs of programs. Jobs are submitted as JSON,
+// queued by priority and run by a bounded pool of workers. Every job runs in
+// a forked child, so that the CPU and memory limits only apply to the job and
+// the errors of the API (which exit the process) only fail the job. The
+// server itself is single threaded and multiplexes the connections and the
+// workers using poll.
+//
+//   POST /jobs             submit a job, returns its id
+//   GET  /jobs/<id>        the state and the events of the job so far
+//   GET  /jobs/<id>/events stream the events as newline delimited JSON until
+//                          the job is done
+//   GET  /status           the number of queued and running jobs
+
+#include "GitSHA1.h"
+#include "Helper.h"
+#include "Http.h"
+#include "JobQueue.h"
+#include "Json.h"
+#include "Llreve.h"
+#include "ResultCache.h"
+
+#include "llvm/Support/ManagedStatic.h"
+
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+
+namespace api = llreve::api;
+
+static llreve::cl::OptionCategory ServerCategory("Server options",
+                                                 "Options for llreve-server.");
+
+static llreve::cl::opt<unsigned>
+    PortFlag("port", llreve::cl::desc("Port on which the server listens"),
+             llreve::cl::init(8080), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<string>
+    AddressFlag("address",
+                llreve::cl::desc("IPv4 address on which the server listens"),
+                llreve::cl::init("127.0.0.1"),
+                llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<unsigned>
+    WorkersFlag("workers",
+                llreve::cl::desc("Number of jobs that are run concurrently"),
+                llreve::cl::init(2), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<unsigned> CPULimitFlag(
+    "cpu-limit",
+    llreve::cl::desc("CPU time in seconds after which a job is killed, 0 for "
+                     "no limit"),
+    llreve::cl::init(0), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<unsigned> MemoryLimitFlag(
+    "memory-limit",
+    llreve::cl::desc("Address space in MiB that a job may use, 0 for no "
+                     "limit"),
+    llreve::cl::init(0), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<unsigned> MaxQueuedFlag(
+    "max-queued",
+    llreve::cl::desc("Number of queued jobs after which submissions are "
+                     "rejected"),
+    llreve::cl::init(1000), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<unsigned> MaxJobsFlag(
+    "max-finished",
+    llreve::cl::desc("Number of finished jobs whose results are kept"),
+    llreve::cl::init(10000), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<unsigned> MaxRequestFlag(
+    "max-request-size",
+    llreve::cl::desc("Largest accepted request body in MiB"),
+    llreve::cl::init(16), llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<string> ResultCacheFlag(
+    "result-cache",
+    llreve::cl::desc("Directory in which the results of the solver are "
+                     "cached, shared with llreve -result-cache"),
+    llreve::cl::cat(ServerCategory));
+static llreve::cl::list<string>
+    IncludesFlag("I", llreve::cl::desc("Include path for all jobs"),
+                 llreve::cl::cat(ServerCategory));
+static llreve::cl::opt<string> ResourceDirFlag(
+    "resource-dir",
+    llreve::cl::desc("Directory containing the clang resource files, e.g. "
+                     "/usr/local/lib/clang/3.8.0"),
+    llreve::cl::cat(ServerCategory));
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+struct Connection {
+    int Fd;
+    string Input;
+    string Output;
+    // The job whose events are streamed, 0 if none
+    uint64_t StreamJob = 0;
+    size_t EventsSent = 0;
+    // Close the connection once the output is written
+    bool Done = false;
+};
+
+// A running job, its events are read from 'EventFd' and its stderr from
+// 'ErrorFd'
+struct Worker {
+    pid_t Pid;
+    uint64_t JobId;
+    int EventFd;
+    int ErrorFd;
+    string Events;
+    string Errors;
+};
+} // namespace
+
+static void printVersion() {
+    std::cout << "llreve-server version " << g_GIT_SHA1 << "\n";
+}
+
+static void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void writeAll(int fd, const string &data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t bytes = write(fd, data.data() + written, data.size() - written);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return;
+        }
+        written += bytes;
+    }
+}
+
+static string seconds(Clock::duration duration) {
+    return std::to_string(std::chrono::duration<double>(duration).count());
+}
+
+static string timesJSON(const api::Timings &times) {
+    return "{\"compile\":" + seconds(times.Compile) +
+           ",\"preprocess\":" + seconds(times.Preprocess) +
+           ",\"generate\":" + seconds(times.Generate) +
+           ",\"solve\":" + seconds(times.Solve) + "}";
+}
+
+static const char *verdictName(api::Verdict verdict) {
+    switch (verdict) {
+    case api::Verdict::Equal:
+        return "equal";
+    case api::Verdict::NotEqual:
+        return "not-equal";
+    case api::Verdict::Unknown:
+        return "unknown";
+    }
+    return "unknown";
+}
+
+static const char *stateName(JobState state) {
+    switch (state) {
+    case JobState::Queued:
+        return "queued";
+    case JobState::Running:
+        return "running";
+    case JobState::Finished:
+        return "finished";
+    case JobState::Failed:
+        return "failed";
+    }
+    return "failed";
+}
+
+static void applyLimits() {
+    if (CPULimitFlag > 0) {
+        // The hard limit kills the job if it ignores SIGXCPU
+        rlimit limit = {CPULimitFlag, CPULimitFlag + 1};
+        setrlimit(RLIMIT_CPU, &limit);
+    }
+    if (MemoryLimitFlag > 0) {
+        const rlim_t bytes = static_cast<rlim_t>(MemoryLimitFlag) << 20;
+        rlimit limit = {bytes, bytes};
+        setrlimit(RLIMIT_AS, &limit);
+    }
+}
+
+// Runs in the forked child, the events are written to 'fd' one per line
+static void runJob(const JobRequest &request, int fd) {
+    const api::Options &opts = request.Opts;
+    api::Clauses clauses =
+        api::generateClauses(request.First, request.Second, opts);
+    writeAll(fd, "{\"event\":\"generated\",\"clauses\":" +
+                     std::to_string(clauses.Exprs.size()) +
+                     ",\"times\":" + timesJSON(clauses.Times) + "}\n");
+
+    // Identical queries of different jobs (e.g. programs that only differ in
+    // comments) are answered from the cache
+    const string hash =
+        ResultCacheFlag.empty() ? "" : api::clausesHash(clauses, opts);
+    SolverOutput cached;
+    if (!hash.empty() && lookupCachedResult(ResultCacheFlag, hash, cached)) {
+        const api::Verdict verdict = cached.Result == SolverResult::Sat
+                                         ? api::Verdict::Equal
+                                         : api::Verdict::NotEqual;
+        writeAll(fd, "{\"event\":\"done\",\"cached\":true,\"result\":\"" +
+                         string(verdictName(verdict)) +
+                         "\",\"model\":" + jsonString(cached.Model) +
+                         ",\"times\":" + timesJSON(clauses.Times) + "}\n");
+        return;
+    }
+
+    writeAll(fd, "{\"event\":\"solving\"}\n");
+    const api::VerificationResult result =
+        api::solveClauses(std::move(clauses), opts);
+    if (!hash.empty() && result.Result != api::Verdict::Unknown) {
+        storeCachedResult(ResultCacheFlag, hash,
+                          {result.Result == api::Verdict::Equal
+                               ? SolverResult::Sat
+                               : SolverResult::Unsat,
+                           result.Model});
+    }
+    writeAll(fd, "{\"event\":\"done\",\"cached\":false,\"result\":\"" +
+                     string(verdictName(result.Result)) +
+                     "\",\"model\":" + jsonString(result.Model) +
+                     ",\"times\":" + timesJSON(result.Times) + "}\n");
+}
+
+static bool startWorker(Job &job, const vector<int> &serverFds,
+                        vector<Worker> &workers) {
+    int events[2];
+    int errors[2];
+    if (pipe(events) != 0) {
+        return false;
+    }
+    if (pipe(errors) != 0) {
+        close(events[0]);
+        close(events[1]);
+        return false;
+    }
+    std::cout.flush();
+    llvm::errs().flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        for (int fd : {events[0], events[1], errors[0], errors[1]}) {
+            close(fd);
+        }
+        return false;
+    }
+    if (pid == 0) {
+        for (int fd : serverFds) {
+            close(fd);
+        }
+        close(events[0]);
+        close(errors[0]);
+        dup2(errors[1], STDERR_FILENO);
+        close(errors[1]);
+        applyLimits();
+        runJob(job.Request, events[1]);
+        llvm::errs().flush();
+        _exit(0);
+    }
+    close(events[1]);
+    close(errors[1]);
+    setNonBlocking(events[0]);
+    setNonBlocking(errors[0]);
+    workers.push_back({pid, job.Id, events[0], errors[0], "", ""});
+    return true;
+}
+
+// The event that is recorded if the child did not report a result
+static string failureEvent(int status, const string &errors) {
+    string reason;
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU) {
+        reason = "cpu limit exceeded";
+    } else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL &&
+               CPULimitFlag > 0) {
+        reason = "killed, probably because of the cpu limit";
+    } else if (WIFSIGNALED(status)) {
+        reason = string("terminated by signal ") + strsignal(WTERMSIG(status));
+    } else {
+        reason = "exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+    // Errors caused by the memory limit show up as failed allocations
+    const size_t maxErrors = 4096;
+    const string tail = errors.size() > maxErrors
+                            ? errors.substr(errors.size() - maxErrors)
+                            : errors;
+    return "{\"event\":\"failed\",\"reason\":" + jsonString(reason) +
+           ",\"stderr\":" + jsonString(tail) + "}";
+}
+
+static void finishWorker(Worker &worker, JobQueue &jobs) {
+    int status = 0;
+    while (waitpid(worker.Pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    Job *job = jobs.find(worker.JobId);
+    if (!job) {
+        return;
+    }
+    std::istringstream lines(worker.Events);
+    string line;
+    bool done = false;
+    while (std::getline(lines, line)) {
+        done = done || line.find("\"event\":\"done\"") != string::npos;
+        job->Events.push_back(line);
+    }
+    const bool failed = !done || !WIFEXITED(status) || WEXITSTATUS(status);
+    if (failed) {
+        job->Events.push_back(failureEvent(status, worker.Errors));
+    }
+    jobs.finish(*job, failed);
+}
+
+// Returns false once the pipe is closed
+static bool readPipe(int fd, string &buffer) {
+    char data[4096];
+    while (true) {
+        ssize_t bytes = read(fd, data, sizeof(data));
+        if (bytes > 0) {
+            buffer.append(data, bytes);
+        } else if (bytes < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+}
+
+static bool parseFunctionPairs(const JsonValue *value,
+                               vector<std::pair<string, string>> &pairs) {
+    if (!value) {
+        return true;
+    }
+    if (value->ValueKind != JsonValue::Kind::Array) {
+        return false;
+    }
+    for (const auto &pair : value->Elements) {
+        if (pair.ValueKind != JsonValue::Kind::Array ||
+            pair.Elements.size() != 2 ||
+            pair.Elements[0].ValueKind != JsonValue::Kind::String ||
+            pair.Elements[1].ValueKind != JsonValue::Kind::String) {
+            return false;
+        }
+        pairs.push_back({pair.Elements[0].Text, pair.Elements[1].Text});
+    }
+    return true;
+}
+
+static bool parseInput(const JsonValue *value, api::Input &input) {
+    if (!value) {
+        return false;
+    }
+    const JsonValue *name = value->member("name");
+    const JsonValue *contents = value->member("contents");
+    if (!name || name->ValueKind != JsonValue::Kind::String || !contents ||
+        contents->ValueKind != JsonValue::Kind::String) {
+        return false;
+    }
+    input = {name->Text, contents->Text};
+    return true;
+}
+
+// Returns an empty string on success and the error otherwise
+static string parseJobRequest(const string &body, JobRequest &request) {
+    JsonValue document;
+    string error;
+    if (!parseJson(body, document, error)) {
+        return error;
+    }
+    if (!parseInput(document.member("first"), request.First) ||
+        !parseInput(document.member("second"), request.Second)) {
+        return "first and second need a name and contents";
+    }
+    if (request.First.Name == request.Second.Name) {
+        return "the inputs need different names";
+    }
+    api::Options &opts = request.Opts;
+    opts.Includes = IncludesFlag;
+    opts.ResourceDir = ResourceDirFlag;
+    if (const JsonValue *function = document.member("function")) {
+        if (function->ValueKind != JsonValue::Kind::String) {
+            return "function has to be a string";
+        }
+        opts.Function = function->Text;
+    }
+    if (const JsonValue *priority = document.member("priority")) {
+        if (priority->ValueKind != JsonValue::Kind::Number) {
+            return "priority has to be a number";
+        }
+        request.Priority = static_cast<int>(priority->Number);
+    }
+    const JsonValue *options = document.member("options");
+    if (!options) {
+        return "";
+    }
+    const std::pair<const char *, bool *> flags[] = {
+        {"heap", &opts.Heap},
+        {"stack", &opts.Stack},
+        {"strings", &opts.GlobalConstants},
+        {"only-rec", &opts.OnlyRecursive},
+        {"signed", &opts.EverythingSigned},
+        {"bitvect", &opts.BitVect},
+        {"infer-marks", &opts.InferMarks},
+        {"disable-auto-coupling", &opts.DisableAutoCoupling}};
+    for (const auto &flag : flags) {
+        if (const JsonValue *value = options->member(flag.first)) {
+            if (value->ValueKind != JsonValue::Kind::Bool) {
+                return string(flag.first) + " has to be a boolean";
+            }
+            *flag.second = value->Bool;
+        }
+    }
+    if (!parseFunctionPairs(options->member("couple-functions"),
+                            opts.CoupledFunctions) ||
+        !parseFunctionPairs(options->member("assume-equivalent"),
+                            opts.AssumeEquivalent)) {
+        return "function pairs have to be arrays of two names";
+    }
+    return "";
+}
+
+static string jobStatus(const Job &job) {
+    string events;
+    for (const auto &event : job.Events) {
+        events += (events.empty() ? "" : ",") + event;
+    }
+    return "{\"id\":" + std::to_string(job.Id) + ",\"state\":\"" +
+           stateName(job.State) +
+           "\",\"priority\":" + std::to_string(job.Request.Priority) +
+           ",\"events\":[" + events + "]}";
+}
+
+static string errorResponse(int status, const string &message) {
+    return httpResponse(status, "application/json",
+                        "{\"error\":" + jsonString(message) + "}");
+}
+
+static string handleRequest(const HttpRequest &request, JobQueue &jobs,
+                            Connection &connection, size_t running) {
+    llvm::StringRef path = llvm::StringRef(request.Path).split('?').first;
+    if (path == "/status") {
+        return httpResponse(200, "application/json",
+                            "{\"queued\":" + std::to_string(jobs.queued()) +
+                                ",\"running\":" + std::to_string(running) +
+                                "}");
+    }
+    if (path == "/jobs") {
+        if (request.Method != "POST") {
+            return errorResponse(405, "jobs are submitted using POST");
+        }
+        if (jobs.queued() >= MaxQueuedFlag) {
+            return errorResponse(503, "too many queued jobs");
+        }
+        JobRequest jobRequest;
+        const string error = parseJobRequest(request.Body, jobRequest);
+        if (!error.empty()) {
+            return errorResponse(400, error);
+        }
+        auto submitted = jobs.submit(std::move(jobRequest));
+        const string id = std::to_string(submitted.first.Id);
+        if (submitted.second) {
+            return httpResponse(200, "application/json",
+                                "{\"id\":" + id + ",\"duplicate\":true}");
+        }
+        return httpResponse(201, "application/json", "{\"id\":" + id + "}");
+    }
+    if (!path.startswith("/jobs/")) {
+        return errorResponse(404, "unknown path");
+    }
+    if (request.Method != "GET") {
+        return errorResponse(405, "jobs are queried using GET");
+    }
+    llvm::StringRef idString, rest;
+    std::tie(idString, rest) = path.drop_front(6).split('/');
+    uint64_t id = 0;
+    if (idString.getAsInteger(10, id) || (!rest.empty() && rest != "events")) {
+        return errorResponse(404, "unknown path");
+    }
+    const Job *job = jobs.find(id);
+    if (!job) {
+        return errorResponse(404, "unknown job");
+    }
+    if (rest.empty()) {
+        return httpResponse(200, "application/json", jobStatus(*job));
+    }
+    connection.StreamJob = id;
+    connection.EventsSent = 0;
+    return httpStreamHeader(200, "application/x-ndjson");
+}
+
+// Sends the events the connection has not seen yet, the stream ends once
+// the job is done
+static void streamEvents(Connection &connection, JobQueue &jobs) {
+    const Job *job = jobs.find(connection.StreamJob);
+    if (job) {
+        for (; connection.EventsSent < job->Events.size();
+             ++connection.EventsSent) {
+            connection.Output +=
+                httpChunk(job->Events[connection.EventsSent] + "\n");
+        }
+    }
+    if (!job || job->State == JobState::Finished ||
+        job->State == JobState::Failed) {
+        connection.Output += httpChunk("");
+        connection.StreamJob = 0;
+        connection.Done = true;
+    }
+}
+
+static int listenSocket() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        logError("Couldn’t create a socket\n");
+        exit(1);
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PortFlag);
+    if (inet_pton(AF_INET, AddressFlag.c_str(), &address.sin_addr) != 1) {
+        logError("Invalid address " + string(AddressFlag) + "\n");
+        exit(1);
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+            0 ||
+        listen(fd, 64) != 0) {
+        logError("Couldn’t listen on " + string(AddressFlag) + ":" +
+                 std::to_string(PortFlag) + ": " + strerror(errno) + "\n");
+        exit(1);
+    }
+    setNonBlocking(fd);
+    return fd;
+}
+
+static int runServer() {
+    // Writes to closed connections are handled using the return value
+    signal(SIGPIPE, SIG_IGN);
+    // Done once here instead of in every child
+    api::initialize();
+    const int listenFd = listenSocket();
+    llvm::errs() << "Listening on " << string(AddressFlag) << ":"
+                 << PortFlag << "\n";
+
+    JobQueue jobs(MaxJobsFlag);
+    vector<Connection> connections;
+    vector<Worker> workers;
+    const size_t maxBody = static_cast<size_t>(MaxRequestFlag) << 20;
+    const size_t maxWorkers = std::max<unsigned>(WorkersFlag, 1);
+
+    while (true) {
+        while (workers.size() < maxWorkers) {
+            Job *job = jobs.startNext();
+            if (!job) {
+                break;
+            }
+            vector<int> serverFds = {listenFd};
+            for (const auto &connection : connections) {
+                serverFds.push_back(connection.Fd);
+            }
+            for (const auto &worker : workers) {
+                serverFds.push_back(worker.EventFd);
+                serverFds.push_back(worker.ErrorFd);
+            }
+            job->Events.push_back("{\"event\":\"started\"}");
+            if (!startWorker(*job, serverFds, workers)) {
+                job->Events.push_back(
+                    "{\"event\":\"failed\",\"reason\":\"fork failed\"}");
+                jobs.finish(*job, true);
+            }
+        }
+        for (auto &connection : connections) {
+            if (connection.StreamJob != 0) {
+                streamEvents(connection, jobs);
+            }
+        }
+
+        vector<pollfd> pollFds = {{listenFd, POLLIN, 0}};
+        for (const auto &connection : connections) {
+            pollFds.push_back(
+                {connection.Fd,
+                 static_cast<short>(connection.Output.empty() ? POLLIN
+                                                              : POLLOUT),
+                 0});
+        }
+        for (const auto &worker : workers) {
+            pollFds.push_back({worker.EventFd, POLLIN, 0});
+            pollFds.push_back({worker.ErrorFd, POLLIN, 0});
+        }
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logError("poll failed\n");
+            exit(1);
+        }
+
+        size_t index = 1;
+        vector<Connection> openConnections;
+        for (auto &connection : connections) {
+            const short events = pollFds[index++].revents;
+            bool open = true;
+            if (events & POLLOUT) {
+                ssize_t bytes = write(connection.Fd, connection.Output.data(),
+                                      connection.Output.size());
+                if (bytes > 0) {
+                    connection.Output.erase(0, bytes);
+                } else if (bytes < 0 && errno != EAGAIN && errno != EINTR) {
+                    open = false;
+                }
+                if (connection.Output.empty() && connection.Done) {
+                    open = false;
+                }
+            } else if (events & POLLIN) {
+                char data[4096];
+                ssize_t bytes = read(connection.Fd, data, sizeof(data));
+                if (bytes > 0) {
+                    connection.Input.append(data, bytes);
+                } else if (bytes == 0 ||
+                           (errno != EAGAIN && errno != EINTR)) {
+                    open = false;
+                }
+            } else if (events & (POLLERR | POLLHUP | POLLNVAL)) {
+                open = false;
+            }
+            if (open && !connection.Done && connection.StreamJob == 0 &&
+                !connection.Input.empty()) {
+                HttpRequest request;
+                size_t consumed = 0;
+                switch (parseHttpRequest(connection.Input, maxBody, request,
+                                         consumed)) {
+                case HttpParse::Incomplete:
+                    break;
+                case HttpParse::Invalid:
+                    connection.Output = errorResponse(400, "invalid request");
+                    connection.Done = true;
+                    break;
+                case HttpParse::TooLarge:
+                    connection.Output = errorResponse(413, "request too large");
+                    connection.Done = true;
+                    break;
+                case HttpParse::Complete:
+                    connection.Input.clear();
+                    connection.Output = handleRequest(request, jobs, connection,
+                                                      workers.size());
+                    connection.Done = connection.StreamJob == 0;
+                    break;
+                }
+            }
+            if (open) {
+                openConnections.push_back(std::move(connection));
+            } else {
+                close(connection.Fd);
+            }
+        }
+        connections = std::move(openConnections);
+
+        vector<Worker> runningWorkers;
+        for (auto &worker : workers) {
+            if (pollFds[index++].revents && worker.EventFd >= 0 &&
+                !readPipe(worker.EventFd, worker.Events)) {
+                close(worker.EventFd);
+                worker.EventFd = -1;
+            }
+            if (pollFds[index++].revents && worker.ErrorFd >= 0 &&
+                !readPipe(worker.ErrorFd, worker.Errors)) {
+                close(worker.ErrorFd);
+                worker.ErrorFd = -1;
+            }
+            if (worker.EventFd < 0 && worker.ErrorFd < 0) {
+                finishWorker(worker, jobs);
+            } else {
+                runningWorkers.push_back(std::move(worker));
+            }
+        }
+        workers = std::move(runningWorkers);
+
+        if (pollFds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                setNonBlocking(fd);
+                connections.push_back({fd, "", "", 0, 0, false});
+            }
+        }
+    }
+}
+
+int main(int argc, const char **argv) {
+    llreve::cl::SetVersionPrinter(printVersion);
+    llreve::cl::HideUnrelatedOptions(ServerCategory);
+    llreve::cl::ParseCommandLineOptions(argc, argv,
+                                        "HTTP service for llreve\n");
+    const int exitCode = runServer();
+    llvm::llvm_shutdown();
+    return exitCode;
+}
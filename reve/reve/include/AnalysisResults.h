@@ -18,29 +18,37 @@ struct AnalysisResults {
     BidirBlockMarkMap blockMarkMap;
     PathMap paths;
     std::vector<smt::SortedVar> functionArguments;
+    // Kept so that the free variables can be updated after a transformation
+    // changed the paths of some marks
+    LocalFreeVarsMap localFreeVariables;
     FreeVarsMap freeVariables;
     llvm::Value *returnInstruction;
     AnalysisResults(BidirBlockMarkMap marks, PathMap pm,
-                    std::vector<smt::SortedVar> funArgs, FreeVarsMap freeVars,
+                    std::vector<smt::SortedVar> funArgs,
+                    LocalFreeVarsMap localFreeVars, FreeVarsMap freeVars,
                     llvm::Value *returnInstruction)
-        : blockMarkMap(marks), paths(pm), functionArguments(funArgs),
-          freeVariables(freeVars), returnInstruction(returnInstruction) {}
+        : blockMarkMap(std::move(marks)), paths(std::move(pm)),
+          functionArguments(std::move(funArgs)),
+          localFreeVariables(std::move(localFreeVars)),
+          freeVariables(std::move(freeVars)),
+          returnInstruction(returnInstruction) {}
 };
 
 using AnalysisResultsMap = std::map<const llvm::Function *, AnalysisResults>;
-MonoPair<PathMap>
-
+// The getters return views of the results, which must not outlive the entries
+// of the functions in the AnalysisResultsMap
+MonoPairView<PathMap>
 getPathMaps(MonoPair<const llvm::Function *> functions,
             const AnalysisResultsMap &analysisResults);
-MonoPair<BidirBlockMarkMap>
+MonoPairView<BidirBlockMarkMap>
 getBlockMarkMaps(MonoPair<const llvm::Function *> functions,
                  const AnalysisResultsMap &analysisResults);
-MonoPair<std::vector<smt::SortedVar>>
+MonoPairView<std::vector<smt::SortedVar>>
 getFunctionArguments(MonoPair<const llvm::Function *> functions,
                      const AnalysisResultsMap &analysisResults);
 FreeVarsMap getFreeVarsMap(MonoPair<const llvm::Function *> functions,
                            const AnalysisResultsMap &analysisResults);
-MonoPair<FreeVarsMap>
+MonoPairView<FreeVarsMap>
 getFreeVarsPair(MonoPair<const llvm::Function *> functions,
                 const AnalysisResultsMap &analysisResults);
 std::string getFunctionName(MonoPair<const llvm::Function *> functions);
@@ -0,0 +1,99 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+// A bump allocator for the short lived nodes of SMT and SExpr trees. Freeing a
+// single node is a no-op, the memory of all nodes is released at once when
+// the arena is destroyed.
+//
+// If nodes allocated in an arena are still alive when the arena is destroyed
+// (e.g. because they have been stored somewhere globally) the memory is only
+// released once the last of these nodes has been freed.
+//
+// Allocating from the same arena on multiple threads is not supported, use one
+// arena per thread instead (runInParallel gives every worker its own arena if
+// the calling thread has one). Nodes can be freed on any thread.
+//
+// The arena only makes allocating and freeing the nodes cheaper, their
+// ownership is unchanged: nodes are still held by shared_ptr and reference
+// counted, and every node carries a header pointing to its arena so it can be
+// freed after the arena is gone. Freeing a node is an atomic decrement,
+// allocating one is not.
+class Arena {
+  public:
+    explicit Arena(size_t blockSize = 1 << 20);
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+    auto allocate(size_t size) -> void *;
+    // The number of nodes that have been allocated in this arena so far
+    auto allocations() const -> size_t { return allocationCount; }
+
+    struct Blocks;
+
+  private:
+    size_t blockSize;
+    size_t allocationCount = 0;
+    char *current = nullptr;
+    char *end = nullptr;
+    Blocks *blocks;
+    friend auto arenaAllocate(size_t size) -> void *;
+};
+
+// While an ArenaScope is alive all SMTExpr and SExpr nodes allocated on the
+// current thread are placed in the given arena. Scopes can be nested.
+class ArenaScope {
+  public:
+    explicit ArenaScope(Arena &arena);
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+    ~ArenaScope();
+
+  private:
+    Arena *previous;
+};
+
+// Used to implement operator new/delete of the node classes. Falls back to the
+// global heap if there is no active arena.
+auto arenaAllocate(size_t size) -> void *;
+auto arenaDeallocate(void *ptr) noexcept -> void;
+auto hasActiveArena() -> bool;
+
+// Places the nodes created by std::allocate_shared, including their control
+// blocks, in the active arena. std::make_shared doesn't use the operator new
+// of the node classes.
+template <typename T> struct ArenaAllocator {
+    using value_type = T;
+    ArenaAllocator() = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> & /*unused*/) {}
+    auto allocate(size_t n) -> T * {
+        return static_cast<T *>(arenaAllocate(n * sizeof(T)));
+    }
+    auto deallocate(T *ptr, size_t /*unused*/) -> void {
+        arenaDeallocate(ptr);
+    }
+    template <typename U> bool operator==(const ArenaAllocator<U> &) const {
+        return true;
+    }
+    template <typename U> bool operator!=(const ArenaAllocator<U> &) const {
+        return false;
+    }
+};
+
+template <typename T, typename... Args>
+auto makeArenaShared(Args &&... args) -> std::shared_ptr<T> {
+    return std::allocate_shared<T>(ArenaAllocator<T>(),
+                                   std::forward<Args>(args)...);
+}
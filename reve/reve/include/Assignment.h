@@ -15,6 +15,9 @@
 
 #include "llvm/IR/Instructions.h"
 
+#include <map>
+#include <tuple>
+
 /* -------------------------------------------------------------------------- */
 // Functions related to the conversion of single instructions/basic
 // blocks to SMT assignments
@@ -48,6 +51,31 @@ struct DefOrCallInfo {
           tag(DefOrCallInfoTag::Call) {}
 };
 
+// While a BlockAssignmentCache is alive, blockAssignments reuses the
+// assignments of blocks that have already been converted on the current thread.
+// The results share their SMT nodes, which is fine since SMT trees are never
+// modified in place. The assignments depend on the memory options, so a cache
+// must not be kept across different SMTGenerationOpts. Caches can be nested.
+class BlockAssignmentCache {
+  public:
+    BlockAssignmentCache();
+    BlockAssignmentCache(const BlockAssignmentCache &) = delete;
+    BlockAssignmentCache &operator=(const BlockAssignmentCache &) = delete;
+    ~BlockAssignmentCache();
+
+    using Key = std::tuple<const llvm::BasicBlock *, const llvm::BasicBlock *,
+                           bool, Program>;
+    // The innermost cache of the current thread or nullptr
+    static auto current() -> BlockAssignmentCache *;
+    auto lookup(const Key &key) const -> const std::vector<DefOrCallInfo> *;
+    void insert(const Key &key, const std::vector<DefOrCallInfo> &defs);
+
+  private:
+    std::map<Key, std::vector<DefOrCallInfo>> entries;
+    BlockAssignmentCache *previous;
+};
+
+auto copyDefOrCallInfo(const DefOrCallInfo &def) -> DefOrCallInfo;
 auto blockAssignments(const llvm::BasicBlock &bb,
                       const llvm::BasicBlock *prevBb, bool onlyPhis,
                       Program prog) -> std::vector<DefOrCallInfo>;
@@ -64,6 +92,8 @@ auto combineOp(const llvm::BinaryOperator &op, std::string opName,
                smt::SMTRef firstArg, smt::SMTRef secondArg) -> smt::SMTRef;
 auto memcpyIntrinsic(const llvm::CallInst *callInst, Program prog)
     -> std::vector<DefOrCallInfo>;
+auto memsetIntrinsic(const llvm::CallInst *callInst, Program prog)
+    -> std::vector<DefOrCallInfo>;
 auto toCallInfo(std::string assignedTo, Program prog,
                 const llvm::CallInst &callInst) -> std::unique_ptr<CallInfo>;
 auto isPtrDiff(const llvm::Instruction &instr) -> bool;
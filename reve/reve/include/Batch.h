@@ -0,0 +1,58 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Batch mode verifies many function pairs in one process. The pairs are
+// listed in a manifest of the form
+//
+//   {"files": ["prog_1.c", "prog_2.c"],
+//    "pairs": [{"fun": "f", "output": "f.smt2"},
+//              {"fun": "g", "output": "g.smt2", "files": ["a.c", "b.c"]}]}
+//
+// "files" at the top level is optional and defaults to the positional input
+// files, a pair can override it. "output" is the SMT output file of the pair
+// and a pair can also be given only by the name of its function. Relative
+// paths are interpreted relative to the working directory, just like the
+// command line arguments.
+
+struct BatchPair {
+    MonoPair<std::string> FileNames;
+    // The main function, if this is empty -fun is used
+    std::string Function;
+    std::string OutputFileName;
+};
+
+// Reads the pairs of the manifest in the order in which they are listed.
+// Exits on errors.
+auto readBatchManifest(const std::string &fileName,
+                       MonoPair<std::string> defaultFileNames)
+    -> std::vector<BatchPair>;
+
+// How the verification of one pair ended
+enum class BatchStatus { Ok, Error, Crashed };
+
+struct BatchResult {
+    BatchStatus Status;
+    int ExitCode;
+    // Everything the verification printed to stdout, i.e. the solver result
+    // or the JSON report
+    std::string Output;
+};
+
+// Writes the result as a single line of JSON
+auto writeBatchResult(std::ostream &out, const BatchPair &pair,
+                      const BatchResult &result) -> void;
@@ -0,0 +1,49 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "HashCons.h"
+#include "SMT.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <ostream>
+#include <vector>
+
+// A compact binary format for passing generated clauses between processes
+// without printing and parsing SMT-LIB. The file consists of
+//
+//   the magic string, followed by
+//   the string table: count, then length and bytes of each string
+//   the type table:   count, then tag and operands of each type
+//   the node table:   count, then tag and operands of each node
+//   the roots:        count, then the node index of each clause
+//
+// All integers are unsigned LEB128 varints. Strings, types and nodes are
+// referenced by their index and each table only references earlier entries,
+// so nodes that are shared in memory are written once and the file can be
+// read in a single pass.
+namespace smt {
+
+auto isBinaryClauses(llvm::StringRef data) -> bool;
+void writeBinaryClauses(const std::vector<SharedSMTRef> &clauses,
+                        std::ostream &out);
+// Errors in the input are fatal. 'bufferName' is only used in error
+// messages.
+auto readBinaryClauses(llvm::StringRef data, llvm::StringRef bufferName,
+                       HashConsFactory &factory) -> std::vector<SharedSMTRef>;
+
+// Reads the clauses from a file that is either in the binary format or in
+// SMT-LIB. The file is mapped into memory instead of being copied if it is
+// large enough.
+auto readClauseFile(const std::string &fileName, HashConsFactory &factory)
+    -> std::vector<SharedSMTRef>;
+}
@@ -0,0 +1,36 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include "llvm/IR/InstrTypes.h"
+
+#include <cstdint>
+#include <string>
+
+// The encoding of instructions used by -bitvect. Operations on constants are
+// folded and operations with a neutral or absorbing constant operand are
+// simplified, so the clauses only contain the bitvector terms the solver
+// actually has to bit-blast.
+namespace bv {
+
+// 'opName' applied to both arguments, e.g. bvadd
+auto binaryOp(const llvm::BinaryOperator &op, std::string opName,
+              smt::SMTRef firstArg, smt::SMTRef secondArg) -> smt::SMTRef;
+// Casts between types of the same width are dropped
+auto cast(const llvm::CastInst &cast, smt::SMTRef operand) -> smt::SMTRef;
+// The bits 'high' to 'low' of the 'width' bits of 'value'
+auto extract(smt::SharedSMTRef value, unsigned width, unsigned high,
+             unsigned low) -> smt::SharedSMTRef;
+// The address 'offset' bytes after the 64 bit 'pointer'
+auto offset(smt::SharedSMTRef pointer, uint64_t offset) -> smt::SharedSMTRef;
+}
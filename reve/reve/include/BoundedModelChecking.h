@@ -0,0 +1,28 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Opts.h"
+#include "Serialize.h"
+
+#include <vector>
+
+// Bounded model checking of the Horn clauses: The clauses are unrolled up to
+// 'maxDepth' derivation steps, i.e. transitions between marks, and each
+// unrolling is a single quantifier-free query which is checked incrementally.
+// A counterexample at some depth means the clauses are unsatisfiable, so the
+// result is either unsat or unknown, the latter if no counterexample exists up
+// to 'maxDepth'. Only linear clauses are supported, i.e. every clause applies
+// at most one predicate in its premises, for other clauses the result is
+// unknown. The clauses are converted to z3 as in solveWithZ3.
+auto boundedModelCheck(std::vector<smt::SharedSMTRef> smtExprs,
+                       const llreve::opts::SerializeOpts &opts,
+                       unsigned maxDepth) -> SolverOutput;
@@ -18,7 +18,35 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Option/Option.h"
 
-/// compiles the input files to llvm modules
+#include <set>
+#include <string>
+
+/// Generates code only for the functions named in 'roots' and the functions
+/// and global variables they refer to, directly or through the initializers
+/// of global variables. The other definitions are dropped before they reach
+/// code generation, so for inputs that include large headers (e.g. the linux
+/// and redis examples) the time and memory depend on the relevant code
+/// instead of the size of the translation unit.
+class RestrictedCodeGenAction : public clang::EmitLLVMOnlyAction {
+  public:
+    explicit RestrictedCodeGenAction(std::set<std::string> roots)
+        : roots(std::move(roots)) {}
+
+  protected:
+    std::unique_ptr<clang::ASTConsumer>
+    CreateASTConsumer(clang::CompilerInstance &ci,
+                      llvm::StringRef inFile) override;
+
+  private:
+    std::set<std::string> roots;
+};
+
+/// A RestrictedCodeGenAction if opts.CodeGenRoots is not empty and an
+/// EmitLLVMOnlyAction otherwise
+auto makeCodeGenAction(const llreve::opts::InputOpts &opts)
+    -> std::unique_ptr<clang::CodeGenAction>;
+/// compiles the input files to llvm modules, inputs that are already LLVM IR
+/// (.bc or .ll) are read directly
 /// \param exeName should be argv[0] in most cases
 /// This calls exit internally if it is not successful
 /// IMPORTANT: The lifetime of the module is tied to the lifetime of the
@@ -28,12 +56,41 @@ auto compileToModules(
     const char *exeName, llreve::opts::InputOpts &opts,
     std::pair<clang::CodeGenAction &, clang::CodeGenAction &> actions)
     -> MonoPair<std::unique_ptr<llvm::Module>>;
+/// Like compileToModules but modules are loaded from and stored in
+/// opts.CacheDir. A module is only reused if the input, its path and the
+/// contents of all files read while compiling it (as listed by -MD) are
+/// unchanged. A new header that shadows an included one in an earlier include
+/// directory is not detected.
+/// Both programs are compiled concurrently if the actions use different
+/// LLVMContexts.
+auto compileToModulesCached(
+    const char *exeName, llreve::opts::InputOpts &opts,
+    std::pair<clang::CodeGenAction &, clang::CodeGenAction &> actions)
+    -> MonoPair<std::unique_ptr<llvm::Module>>;
+/// True if the file is LLVM bitcode or textual IR, judging by its extension
+auto isIRFile(const std::string &fileName) -> bool;
+/// Reads an IR file into the context of the action. The function bodies are
+/// not materialized.
+auto loadIRModule(const std::string &fileName, clang::CodeGenAction &act)
+    -> std::unique_ptr<llvm::Module>;
+/// Like loadIRModule but parses the bitcode or textual IR in 'contents'
+auto loadIRModule(const std::string &name, llvm::StringRef contents,
+                  clang::CodeGenAction &act) -> std::unique_ptr<llvm::Module>;
+/// Compiles both inputs, or only the first one if both are the same file in
+/// which case the second module is a copy in the context of the second action
 auto executeCodeGenActions(
     const char *exeName, llreve::opts::InputOpts &opts,
-    std::pair<clang::CodeGenAction &, clang::CodeGenAction &> actions) -> void;
+    std::pair<clang::CodeGenAction &, clang::CodeGenAction &> actions)
+    -> MonoPair<std::unique_ptr<llvm::Module>>;
+/// Runs the action on the input of 'ccArgs'. The inputs of 'opts' are used
+/// instead of the files if they are in memory. If 'dependencies' is not null,
+/// it is set to all files that have been read, including the input.
 auto executeCodeGenAction(const llvm::opt::ArgStringList &ccArgs,
                           clang::DiagnosticsEngine &diags,
-                          clang::CodeGenAction &act) -> void;
+                          clang::CodeGenAction &act,
+                          const llreve::opts::InputOpts &opts,
+                          std::vector<std::string> *dependencies = nullptr)
+    -> void;
 auto initializeArgs(const char *exeName, llreve::opts::InputOpts &opts)
     -> std::vector<const char *>;
 auto initializeDiagnostics(void) -> std::unique_ptr<clang::DiagnosticsEngine>;
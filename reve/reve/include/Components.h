@@ -0,0 +1,80 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include <string>
+#include <vector>
+
+// The independent components of a Horn system as computed by
+// splitIndependentComponents, without copying the expressions
+struct ComponentAssignment {
+    // Expressions that are not assertions or declarations of predicates
+    static const size_t SharedComponent = static_cast<size_t>(-1);
+    // Declarations of predicates that are not used by any assertion
+    static const size_t NoComponent = static_cast<size_t>(-2);
+    size_t ComponentCount;
+    // The component of each toplevel expression or one of the above
+    std::vector<size_t> Components;
+};
+
+auto assignComponents(const std::vector<smt::SharedSMTRef> &smtExprs)
+    -> ComponentAssignment;
+
+// Split a Horn system into independent queries. Two clauses depend on each
+// other if they (transitively) reference the same uninterpreted predicate.
+// The system is satisfiable iff every component is satisfiable so the
+// components can be solved separately.
+//
+// Declarations of predicates are moved to the component using them.
+// Everything else that is not an assertion (set-logic, define-fun,
+// check-sat, …) is copied to every component. Only the SMT-HORN format is
+// supported.
+auto splitIndependentComponents(const std::vector<smt::SharedSMTRef> &smtExprs)
+    -> std::vector<std::vector<smt::SharedSMTRef>>;
+
+// The assertions that apply no uninterpreted predicate, e.g. the clauses for
+// the synchronized loop-free paths from the entry to the exit of the main
+// functions. Each of them is returned as a separate query containing the
+// assertion and everything that is copied to every component. These queries
+// need no fixpoint computation and the system is unsatisfiable if one of them
+// is. Only the SMT-HORN format is supported.
+auto closedClauseQueries(const std::vector<smt::SharedSMTRef> &smtExprs)
+    -> std::vector<std::vector<smt::SharedSMTRef>>;
+
+// Cone of influence reduction: removes the clauses and declarations of all
+// predicates the queries do not (transitively) depend on. A clause whose head
+// is such a predicate can always be satisfied by interpreting the predicate as
+// true, so the result is satisfiable iff the original system is. Clauses
+// whose head is not a single predicate application (e.g. queries) are always
+// kept. Only the SMT-HORN format is supported.
+auto removeIrrelevantClauses(const std::vector<smt::SharedSMTRef> &smtExprs)
+    -> std::vector<smt::SharedSMTRef>;
+
+// Orders a Horn system for the solvers, which are sensitive to the order of
+// the predicates and clauses: The predicates are declared in a topological
+// order of the dependencies between them, from the predicates defined by
+// facts (e.g. the entry of the main functions) to the ones the queries use.
+// Predicates on a cycle (loops and recursion) are ordered by a depth first
+// search from the entry. The clauses defining a predicate follow each other
+// in this order, then come the clauses whose head is no predicate (the
+// queries). Everything else keeps its relative order and precedes the
+// declarations, except that (check-sat) and (get-model) come last and
+// comments are dropped. Only the SMT-HORN format is supported.
+auto orderClauses(const std::vector<smt::SharedSMTRef> &smtExprs)
+    -> std::vector<smt::SharedSMTRef>;
+
+// The name of the file for the i-th component, e.g. out.smt2 -> out.1.smt2
+auto componentFileName(const std::string &fileName, size_t i) -> std::string;
+// The same for other parts of the output, e.g. out.smt2 -> out.header.smt2
+auto componentFileName(const std::string &fileName, const std::string &part)
+    -> std::string;
@@ -0,0 +1,65 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+#include "SMT.h"
+
+#include "llvm/IR/Function.h"
+
+#include <string>
+#include <vector>
+
+// Most queries are solved within seconds while a few of them take minutes, so
+// batch runs and -solve=distributed start the work that is predicted to be
+// cheapest first. The prediction is a linear model over the logarithms of a
+// few counts that are cheap to compute, e.g. the number of clauses and the
+// arity of the predicates, which estimates the logarithm of the solving time.
+// The model is refined with each recorded solving time and can be kept in a
+// file across runs.
+
+// The features of a query: clauses, predicates, the maximal arity of the
+// predicates and the heap arguments of the predicates
+auto queryFeatures(const std::vector<smt::SharedSMTRef> &query)
+    -> std::vector<double>;
+// The features of a pair of functions before the clauses are generated:
+// basic blocks, conditional branches (paths multiply with them), memory
+// accesses and calls. Missing functions contribute nothing.
+auto programFeatures(MonoPair<const llvm::Function *> functions)
+    -> std::vector<double>;
+// Both kinds of features have this many entries
+static const size_t CostFeatureCount = 4;
+
+class CostModel {
+  public:
+    // Reads the model named 'kind' from 'fileName'. If the file is empty or
+    // doesn’t contain the model, a default model is used which only assumes
+    // that larger queries are harder.
+    CostModel(std::string fileName, std::string kind);
+    // The predicted solving time in seconds
+    auto predict(const std::vector<double> &features) const -> double;
+    // Moves the prediction for 'features' towards 'seconds'
+    auto record(const std::vector<double> &features, double seconds) -> void;
+    // Writes the model back to the file, keeping the other models in it. Does
+    // nothing if the file name is empty or nothing has been recorded.
+    auto save() const -> void;
+
+  private:
+    std::string fileName;
+    std::string kind;
+    // The first weight is the constant term
+    std::vector<double> weights;
+    bool changed = false;
+};
+
+// The indices of 'costs' in the order of ascending cost, ties keep their
+// original order
+auto shortestFirst(const std::vector<double> &costs) -> std::vector<size_t>;
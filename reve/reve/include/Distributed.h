@@ -0,0 +1,63 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Opts.h"
+#include "Serialize.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Distributed solving: A coordinator spreads the independent queries (e.g.
+// the components of a split query) over a set of workers. A worker is started
+// by a command such as "ssh node1 llreve" and the coordinator appends the
+// arguments for worker mode. The serialized query (in SMT-LIB or the binary
+// clause format) is passed on stdin and the worker answers with "sat"
+// followed by the model, "unsat" or "unknown" on stdout, so any transport
+// that forwards stdin and stdout can be used.
+
+struct DistributedOpts {
+    // The commands that start the workers, at most one query is solved by
+    // each worker at a time
+    std::vector<std::vector<std::string>> Workers;
+    // Appended to the command of every worker after the arguments for worker
+    // mode, e.g. -bitvect
+    std::vector<std::string> WorkerArgs;
+    // The engines that are tried for a query in this order, the next one is
+    // only used if the previous one answered unknown or exceeded its time
+    // limit
+    std::vector<std::string> Engines;
+    // Time limit in seconds for each attempt, 0 means no limit
+    unsigned Timeout;
+    // The predicted cost of each query, the cheapest queries are started
+    // first. If this is empty, the queries are started in the given order.
+    std::vector<double> Costs;
+};
+
+// Solves the queries stored in the given files. The result is sat if all
+// queries are sat and the model is the union of their models. The result is
+// unsat as soon as one of them is unsat, the remaining attempts are stopped
+// in that case. A worker that fails (i.e. exits with an error) is not used
+// again and its query is retried on another worker. 'solveTimes' is set to
+// the seconds spent on each query by all engines together, or to a negative
+// value for the queries that were not finished.
+auto solveDistributed(const std::vector<std::string> &queryFiles,
+                      const DistributedOpts &opts,
+                      std::vector<double> &solveTimes) -> SolverOutput;
+
+// Worker mode: Reads a query from 'in', solves it using 'engine' and prints
+// the result to 'out'. 'engine' is either z3, which uses the z3 API, or the
+// name of one of the engines of the default portfolio. Returns the exit code.
+auto runSolverWorker(const std::string &engine,
+                     const llreve::opts::SerializeOpts &serializeOpts,
+                     std::istream &in, std::ostream &out) -> int;
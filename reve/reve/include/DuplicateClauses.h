@@ -0,0 +1,31 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include <string>
+#include <vector>
+
+// A canonical representation of the expression: bound variables are renamed
+// by their binding depth and the arguments of 'and' and 'or' are sorted, so
+// two expressions with the same representation are equivalent. Returns false
+// if the expression contains a node that has no canonical representation
+// (e.g. a floating point operation).
+auto canonicalForm(const smt::SMTExpr &expr, std::string &form) -> bool;
+
+// Removes assertions that have the same canonical form as an earlier one and
+// repeated declarations of the same predicate. Paths that only differ in
+// blocks without side effects often result in the same clause, as do the
+// different generators of clauses. The first occurrence is kept, so the order
+// of the remaining expressions doesn’t change.
+auto removeDuplicateClauses(const std::vector<smt::SharedSMTRef> &smtExprs)
+    -> std::vector<smt::SharedSMTRef>;
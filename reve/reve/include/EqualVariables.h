@@ -0,0 +1,32 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+
+#include "llvm/IR/Function.h"
+
+#include <map>
+#include <string>
+
+// Global value numbering across the two main functions. Two values get the
+// same number if they are the same operation applied to values with the same
+// numbers, so they are equal at every mark at which both are defined. If
+// 'equalArguments' is set, the arguments of the two functions are equal at the
+// entry (which is the case for the default IN_INV) and get the same number as
+// the argument at the same position of the other function.
+//
+// Only side effect free operations whose result depends only on their operands
+// are numbered, phi nodes, loads and calls always get a new number. The result
+// maps the names of all values that are equal to some other value to their
+// number.
+auto findEqualVariables(MonoPair<const llvm::Function *> functions,
+                        bool equalArguments) -> std::map<std::string, unsigned>;
@@ -0,0 +1,71 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+#include "Opts.h"
+#include "SMT.h"
+#include "Serialize.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Failure localization for inverted queries (-invert): The negated clauses of
+// every function are constrained to the numerals of the functions
+// (FUNCTION_1, FUNCTION_2), whether they belong to the main functions (MAIN)
+// and to which programs (PROGRAM_1, PROGRAM_2), so every model of the
+// inverted query names the functions of a violated clause. Enumerating the
+// models yields all failing functions, which are checked first in the next
+// run.
+
+// The functions of a violated clause. They are stored by name since the
+// numerals change with the programs. Functional abstractions only belong to
+// one of the programs, the name for the other one is empty.
+struct FailingFunctions {
+    bool Main;
+    std::string Function1;
+    std::string Function2;
+    bool operator<(const FailingFunctions &other) const;
+};
+
+// "main f^g" for a pair of main functions, "f^-" for a functional abstraction
+// of the first program
+auto describeFailingFunctions(const FailingFunctions &failing) -> std::string;
+
+// The names of the functions by their numerals. They have to be looked up
+// before the programs are released.
+auto functionNamesByNumeral(const llreve::opts::SMTGenerationOpts &smtOpts)
+    -> MonoPair<std::map<int, std::string>>;
+
+// A missing file is treated as an empty set
+auto readFailingFunctions(const std::string &fileName)
+    -> std::set<FailingFunctions>;
+auto writeFailingFunctions(const std::string &fileName,
+                           const std::set<FailingFunctions> &failing) -> void;
+
+struct LocalizedOutput {
+    SolverResult Result;
+    // The functions of all violated clauses that were found if the result is
+    // sat, i.e. if the programs could not be proven equivalent
+    std::set<FailingFunctions> Failing;
+};
+
+// Solves the inverted query using z3 and enumerates the functions of all
+// violated clauses. The clauses of the 'previous' failing functions are
+// checked first. If one of them is still violated, the failures are only
+// localized among them and the other clauses are not checked at all.
+auto solveLocalizingFailures(
+    std::vector<smt::SharedSMTRef> invertedQuery,
+    const std::set<FailingFunctions> &previous,
+    const MonoPair<std::map<int, std::string>> &functionNames,
+    const llreve::opts::SerializeOpts &opts) -> LocalizedOutput;
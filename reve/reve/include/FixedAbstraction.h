@@ -1,5 +1,7 @@
 #pragma once
 
+#include "MonoPair.h"
+#include "Opts.h"
 #include "Program.h"
 #include "SMT.h"
 
@@ -19,3 +21,18 @@ auto equivalentExternDecls(const llvm::Function &fun1,
 auto notEquivalentExternDecls(const llvm::Function &fun1,
                               const llvm::Function &fun2)
     -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+
+// Lazy refinement of the extern abstractions: The results of calls of coupled
+// extern functions start out unconstrained (see
+// SMTGenerationOpts::UnconstrainedExterns) and the equivalence of a pair is
+// only assumed once an unsat query applies its abstraction.
+
+// The coupled extern functions whose calls are abstracted as equivalent, except
+// for the floating point abstraction which is refined separately
+auto lazyExternAbstractions(const llreve::opts::SMTGenerationOpts &smtOpts)
+    -> std::set<MonoPair<const llvm::Function *>>;
+// The pairs whose abstraction is applied in the query
+auto appliedExternAbstractions(
+    const std::vector<smt::SharedSMTRef> &query,
+    const std::set<MonoPair<const llvm::Function *>> &pairs)
+    -> std::set<MonoPair<const llvm::Function *>>;
@@ -0,0 +1,51 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+#include "Opts.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+#include <set>
+
+// Floating point operations are encoded as operations on reals which are
+// expensive for the solver, in particular the nonlinear ones. Instead they can
+// be encoded as calls of uninterpreted functions, one per operation and type,
+// e.g. __llreve_fp_fmul64 for the multiplication of doubles. The functions are
+// declared in both modules and coupled, so coupled calls are abstracted as
+// equivalent: equal operands imply equal results. This suffices if both
+// programs perform the same operations on the same values.
+//
+// The abstraction is sound for proving equivalence but may make the clauses
+// unsatisfiable. If that is the case the operations are refined, i.e. encoded
+// precisely, one class at a time, see refineFloatAbstraction.
+
+// Declares and couples the abstraction functions of all floating point
+// operations in the modules. Returns the opcodes of these operations.
+auto declareFloatAbstractions(MonoPair<llvm::Module &> modules,
+                              llreve::opts::SMTGenerationOpts &smtOpts)
+    -> std::set<unsigned>;
+// The function that abstracts the instruction or nullptr if the instruction is
+// encoded precisely
+auto floatAbstraction(const llvm::Instruction &instr)
+    -> const llvm::Function *;
+auto isFloatAbstraction(const llvm::Function &fun) -> bool;
+// The abstraction functions don’t access memory, so the heap and the stack are
+// not passed to their calls
+auto passesMemory(const llvm::Function &fun) -> bool;
+// Removes the cheapest class of operations from the abstracted operations,
+// first addition and subtraction, then multiplication and division. The
+// remainder has no precise encoding and is never refined. Returns false if
+// there is nothing left to refine.
+auto refineFloatAbstraction(std::set<unsigned> &abstractOps) -> bool;
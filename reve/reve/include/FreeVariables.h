@@ -5,8 +5,26 @@
 #include "Program.h"
 #include "SMT.h"
 
-using FreeVarsMap = std::map<Mark, std::vector<smt::SortedVar>>;
-auto freeVars(PathMap map, std::vector<smt::SortedVar> funArgs, Program prog)
+using FreeVarsMap = MarkMap<std::vector<smt::SortedVar>>;
+
+// The variables accessed on the paths starting at a mark and the variables
+// constructed on all of them for each mark they end at. These only depend on
+// the paths starting at the mark, the free variables are the least fixpoint
+// over all marks.
+struct LocalFreeVars {
+    std::set<smt::SortedVar> accessed;
+    MarkMap<std::set<smt::SortedVar>> constructed;
+};
+using LocalFreeVarsMap = MarkMap<LocalFreeVars>;
+
+auto localFreeVars(const PathMap &map) -> LocalFreeVarsMap;
+// Computes the entries of 'marks' again after their paths have changed
+void updateLocalFreeVars(const PathMap &map, const std::set<Mark> &marks,
+                         LocalFreeVarsMap &locals);
+auto freeVars(const LocalFreeVarsMap &locals,
+              const std::vector<smt::SortedVar> &funArgs, Program prog)
     -> FreeVarsMap;
+auto freeVars(const PathMap &map, const std::vector<smt::SortedVar> &funArgs,
+              Program prog) -> FreeVarsMap;
 auto addMemoryArrays(std::vector<smt::SortedVar> vars, Program prog)
     -> std::vector<smt::SortedVar>;
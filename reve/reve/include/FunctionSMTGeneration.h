@@ -15,6 +15,7 @@
 #include "Helper.h"
 #include "Memory.h"
 #include "MonoPair.h"
+#include "Opts.h"
 #include "PathAnalysis.h"
 #include "Preprocess.h"
 #include "Program.h"
@@ -58,11 +59,11 @@ the function. Each jump is modeled as a possibly recursive call.
 auto relationalFunctionAssertions(
     MonoPair<const llvm::Function *> preprocessedFuns,
     const AnalysisResultsMap &analysisResults)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    -> std::vector<smt::SharedSMTRef>;
 auto functionalFunctionAssertions(
     MonoPair<const llvm::Function *> preprocessedFun,
     const AnalysisResultsMap &analysisResults, Program prog)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    -> std::vector<smt::SharedSMTRef>;
 
 /// Create the assertion for the passed main function.
 /**
@@ -72,7 +73,21 @@ encoding it seems to perform better in some cases.
  */
 auto relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
                                    const AnalysisResultsMap &analysisResults)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    -> std::vector<smt::SharedSMTRef>;
+
+/// Choose the cheaper encoding of the main functions.
+/**
+The cost of an encoding is the number of arguments of the invariant at each mark
+weighted by the number of pairs of paths starting at the mark, with arrays
+counting more than integers. The recursive invariants additionally contain the
+return values and the heaps at the exit, so the iterative encoding is cheaper
+unless the main functions call themselves. In that case the iterative encoding
+needs the recursive one for the calls in addition and the recursive one is
+chosen. The estimates are recorded in the statistics.
+ */
+auto chooseFunctionEncoding(MonoPair<const llvm::Function *> functions,
+                            const AnalysisResultsMap &analysisResults)
+    -> llreve::opts::FunctionEncoding;
 
 /// Get all combinations of paths that have the same start and end mark.
 /**
@@ -81,7 +96,7 @@ auto relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
   needs to hold
           at the end mark.
  */
-using ReturnInvariantGenerator = std::function<smt::SMTRef(Mark, Mark)>;
+using ReturnInvariantGenerator = std::function<smt::SharedSMTRef(Mark, Mark)>;
 struct MarkPair {
     Mark startMark;
     Mark endMark;
@@ -102,7 +117,7 @@ auto getSynchronizedPaths(const PathMap &pathMap1, const PathMap &pathMap2,
                           const FreeVarsMap &freeVarsMap1,
                           const FreeVarsMap &freeVarsMap2,
                           ReturnInvariantGenerator generateReturnInvariant)
-    -> std::map<MarkPair, std::vector<std::unique_ptr<smt::SMTExpr>>>;
+    -> std::map<MarkPair, std::vector<smt::SharedSMTRef>>;
 
 /// Find all paths with the same start but different end marks
 /**
@@ -111,22 +126,22 @@ only
 move away from the current block (e.g. the loop condition is no longer true) the
 other is still allowed to loop at its block.
  */
-auto getForbiddenPaths(const MonoPair<PathMap> &pathMaps,
-                       const MonoPair<BidirBlockMarkMap> &marked,
+auto getForbiddenPaths(MonoPairView<PathMap> pathMaps,
+                       MonoPairView<BidirBlockMarkMap> marked,
                        const FreeVarsMap &freeVarsMap1,
                        const FreeVarsMap &freeVarsMap2, std::string funName,
                        bool main)
-    -> std::map<Mark, std::vector<std::unique_ptr<smt::SMTExpr>>>;
+    -> std::map<Mark, std::vector<smt::SharedSMTRef>>;
 /// Get the assertions for a single program
 auto nonmutualPaths(
     const PathMap &pathMap, const FreeVarsMap &freeVarsMap, Program prog,
     std::string funName, const llvm::Type *type,
-    std::vector<std::unique_ptr<smt::SMTExpr>> functionNumeralConstraints)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    std::vector<smt::SharedSMTRef> functionNumeralConstraints)
+    -> std::vector<smt::SharedSMTRef>;
 auto getStutterPaths(const PathMap &pathMap1, const PathMap &pathMap2,
                      const FreeVarsMap &freeVarsMap, std::string funName,
                      bool main)
-    -> std::map<MarkPair, std::vector<std::unique_ptr<smt::SMTExpr>>>;
+    -> std::map<MarkPair, std::vector<smt::SharedSMTRef>>;
 
 /* -------------------------------------------------------------------------- */
 // Functions for generating SMT for a single/mutual path
@@ -134,25 +149,25 @@ auto getStutterPaths(const PathMap &pathMap1, const PathMap &pathMap2,
 auto assignmentsOnPath(const Path &path, Program prog,
                        const std::vector<smt::SortedVar> &freeVars, bool toEnd)
     -> std::vector<AssignmentCallBlock>;
-auto interleaveAssignments(std::unique_ptr<smt::SMTExpr> endClause,
+auto interleaveAssignments(smt::SharedSMTRef endClause,
                            llvm::ArrayRef<AssignmentCallBlock> assignment1,
                            llvm::ArrayRef<AssignmentCallBlock> assignment2)
-    -> std::unique_ptr<smt::SMTExpr>;
-auto nonmutualSMT(std::unique_ptr<smt::SMTExpr> endClause,
+    -> smt::SharedSMTRef;
+auto nonmutualSMT(smt::SharedSMTRef endClause,
                   llvm::ArrayRef<AssignmentCallBlock> assignments, Program prog)
-    -> std::unique_ptr<smt::SMTExpr>;
+    -> smt::SharedSMTRef;
 
 /* -------------------------------------------------------------------------- */
 // Functions to generate various foralls
 
-auto mutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
-                        MonoPair<CallInfo> callPair) -> smt::SMTRef;
-auto nonMutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause, CallInfo call,
-                           Program prog) -> smt::SMTRef;
-auto forallStartingAt(std::unique_ptr<smt::SMTExpr> clause,
+auto mutualFunctionCall(smt::SharedSMTRef clause,
+                        MonoPair<CallInfo> callPair) -> smt::SharedSMTRef;
+auto nonMutualFunctionCall(smt::SharedSMTRef clause, CallInfo call,
+                           Program prog) -> smt::SharedSMTRef;
+auto forallStartingAt(smt::SharedSMTRef clause,
                       std::vector<smt::SortedVar> freeVars, Mark blockIndex,
                       ProgramSelection prog, std::string funName, bool main)
-    -> std::unique_ptr<smt::SMTExpr>;
+    -> smt::SharedSMTRef;
 
 /* -------------------------------------------------------------------------- */
 // Functions forcing arguments to be equal
@@ -160,14 +175,14 @@ auto forallStartingAt(std::unique_ptr<smt::SMTExpr> clause,
 auto makeFunArgsEqual(smt::SharedSMTRef clause, smt::SharedSMTRef preClause,
                       std::vector<smt::SortedVar> args1,
                       std::vector<smt::SortedVar> args2)
-    -> std::unique_ptr<smt::SMTExpr>;
+    -> smt::SharedSMTRef;
 auto equalInputsEqualOutputs(const std::vector<smt::SortedVar> &funArgs1,
                              const std::vector<smt::SortedVar> &funArgs2,
                              const llvm::Function &function1,
                              const llvm::Function &function2,
                              std::string funName,
                              const FreeVarsMap &freeVarsMap)
-    -> std::unique_ptr<smt::SMTExpr>;
+    -> smt::SharedSMTRef;
 
 /* -------------------------------------------------------------------------- */
 // Miscellanous helper functions that don't really belong anywhere
@@ -185,13 +200,13 @@ auto splitAssignmentsFromCalls(
 
 auto checkPathMaps(const PathMap &map1, const PathMap &map2) -> void;
 auto mapSubset(const PathMap &map1, const PathMap &map2) -> bool;
-auto getDontLoopInvariant(smt::SMTRef endClause, Mark startIndex,
+auto getDontLoopInvariant(smt::SharedSMTRef endClause, Mark startIndex,
                           const PathMap &pathMap,
                           const FreeVarsMap &freeVarsMap, Program prog)
-    -> smt::SMTRef;
-auto addAssignments(std::unique_ptr<smt::SMTExpr> end,
+    -> smt::SharedSMTRef;
+auto addAssignments(smt::SharedSMTRef end,
                     llvm::ArrayRef<AssignmentBlock> assignments)
-    -> std::unique_ptr<smt::SMTExpr>;
+    -> smt::SharedSMTRef;
 auto addMemory(std::vector<smt::SharedSMTRef> &implArgs)
     -> std::function<void(CallInfo call, int index)>;
 
@@ -219,14 +234,14 @@ auto generateRelationalIterativeSMT(
     std::vector<smt::SharedSMTRef> &declarations) -> void;
 
 auto getFunctionNumeralConstraints(const llvm::Function *f, Program prog)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    -> std::vector<smt::SharedSMTRef>;
 auto getFunctionNumeralConstraints(MonoPair<const llvm::Function *> functions)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    -> std::vector<smt::SharedSMTRef>;
 auto clauseMapToClauseVector(
-    std::map<MarkPair, std::vector<std::unique_ptr<smt::SMTExpr>>> clauseMap,
+    std::map<MarkPair, std::vector<smt::SharedSMTRef>> clauseMap,
     bool main, ProgramSelection programSelection,
-    std::vector<std::unique_ptr<smt::SMTExpr>> functionNumeralConstraints)
-    -> std::vector<std::unique_ptr<smt::SMTExpr>>;
+    std::vector<smt::SharedSMTRef> functionNumeralConstraints)
+    -> std::vector<smt::SharedSMTRef>;
 
 template <typename T>
 std::vector<InterleaveStep> matchFunCalls(
@@ -0,0 +1,52 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "AnalysisResults.h"
+#include "MonoPair.h"
+#include "Opts.h"
+#include "SMT.h"
+
+#include "llvm/IR/Module.h"
+
+#include <map>
+#include <string>
+
+// Support for reusing the summaries of called functions: The functional
+// abstraction of a function that is not coupled is the invariant INV_REC_f
+// (and its precondition INV_REC_f_PRE) at the entry mark. Usually these are
+// unknowns of the Horn system and every call site constrains them again. If a
+// summary is known, either from the model of an earlier run or supplied by
+// the user, it is defined instead so the call sites only refer to a closed
+// formula. The clauses of the function itself are still generated, so a
+// summary that doesn’t hold makes them unsatisfiable.
+
+// The define-funs of the invariants at entry marks in the file by name. A
+// missing file is treated as an empty set.
+auto readFunctionSummaries(const std::string &fileName)
+    -> std::map<std::string, smt::SharedSMTRef>;
+
+// Extracts the invariants at entry marks from the model printed by the solver
+// and writes them to 'fileName' in the format read by readFunctionSummaries.
+// The summaries in 'reused' are defined so they are not part of the model,
+// they are written as well unless the model contains a newer one.
+auto writeFunctionSummaries(
+    const std::string &fileName, const std::string &model,
+    const std::map<std::string, smt::SharedSMTRef> &reused) -> void;
+
+// Defines the entry invariants of all abstracted functions that have a
+// summary. A missing precondition is defined as true. Returns the number of
+// functions that use a summary.
+auto applyFunctionSummaries(
+    const std::map<std::string, smt::SharedSMTRef> &summaries,
+    MonoPair<const llvm::Module &> modules,
+    const AnalysisResultsMap &analysisResults,
+    llreve::opts::SMTGenerationOpts &smtOpts) -> size_t;
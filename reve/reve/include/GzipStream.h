@@ -0,0 +1,78 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+// A stream buffer that writes a gzip compressed file. The output is collected
+// in blocks which are compressed and written by a separate thread, so the
+// compression overlaps with producing the output. At most a few blocks are
+// pending, the producer waits if the compression can’t keep up.
+class GzipFileBuffer : public std::streambuf {
+  public:
+    explicit GzipFileBuffer(const std::string &fileName);
+    GzipFileBuffer(const GzipFileBuffer &) = delete;
+    GzipFileBuffer &operator=(const GzipFileBuffer &) = delete;
+    ~GzipFileBuffer() override;
+
+    auto isOpen() const -> bool { return started; }
+    // Compresses the remaining output and writes the gzip trailer. Returns
+    // false if the file could not be written.
+    auto close() -> bool;
+
+  protected:
+    auto overflow(int_type c) -> int_type override;
+    auto xsputn(const char *s, std::streamsize n) -> std::streamsize override;
+    // Only supports querying the position for tellp, which is the number of
+    // uncompressed bytes
+    auto seekoff(off_type off, std::ios_base::seekdir dir,
+                 std::ios_base::openmode which) -> pos_type override;
+
+  private:
+    static const size_t BlockSize = 1 << 20;
+    static const size_t MaxPendingBlocks = 4;
+
+    std::ofstream file;
+    z_stream stream;
+    bool started = false;
+    bool closed = false;
+    uint64_t submittedBytes = 0;
+    std::vector<char> block;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> pending;
+    bool finished = false;
+    bool failed = false;
+    std::thread compressor;
+
+    // Returns false if the compression has failed
+    auto submitBlock() -> bool;
+    void compressBlocks();
+    auto deflateBlock(const std::vector<char> &input, int flush) -> bool;
+};
+
+// True if the data starts with the magic number of gzip
+auto isGzip(llvm::StringRef data) -> bool;
+// Decompresses gzip data, returns false if it is not valid
+auto gunzip(llvm::StringRef data, std::string &result) -> bool;
@@ -0,0 +1,123 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+#include "Symbol.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <functional>
+#include <unordered_map>
+
+namespace smt {
+
+// Creates SMT expressions in such a way that structurally identical terms are
+// represented by the same node. Two expressions created by (or interned into)
+// the same factory are equal iff they are the same pointer and each node has
+// its hash computed exactly once.
+//
+// Nodes handed out by the factory are shared between all their users, so they
+// must not be modified. This is already the contract of the SMTVisitor (which
+// always operates on copies) and of the other transformations on SMT
+// expressions.
+class HashConsFactory {
+  public:
+    auto variable(std::string name, Type type) -> SharedSMTRef;
+    auto constantString(std::string value) -> SharedSMTRef;
+    auto constantBool(bool value) -> SharedSMTRef;
+    auto constantInt(llvm::APInt value) -> SharedSMTRef;
+    auto op(std::string opName, std::vector<SharedSMTRef> args,
+            bool instantiate = true) -> SharedSMTRef;
+
+    // Rebuild 'expr' bottom up so that all subterms supported by the factory
+    // are shared. Nodes that are not hash-consed (e.g. lets and quantifiers)
+    // are kept but their children are shared.
+    auto intern(const SMTExpr &expr) -> SharedSMTRef;
+    // Register a node that is not hash-consed (e.g. a let) and whose children
+    // have been created by this factory, so 'op' doesn’t intern it again when
+    // it is used as an argument
+    auto adopt(SharedSMTRef expr) -> SharedSMTRef;
+
+    // Only valid for nodes created by this factory
+    auto hash(const SMTExpr &expr) const -> size_t;
+    auto size() const -> size_t { return table.size(); }
+
+  private:
+    enum class NodeKind { Variable, String, Bool, Int, Op };
+    struct Key {
+        NodeKind kind;
+        // Filled in by 'lookup', derived from the other members
+        size_t hash;
+        // The name of a variable or operator, the value of a string
+        Symbol name;
+        // The type of a variable, the value of a bool, the bitwidth of an
+        // int, whether an operator is instantiated
+        uint64_t extra;
+        std::vector<const SMTExpr *> children;
+        // The value of an int. Only compared if the bitwidths are equal.
+        llvm::APInt value = llvm::APInt(1, 0);
+        bool operator==(const Key &other) const {
+            return hash == other.hash && kind == other.kind &&
+                   name == other.name && extra == other.extra &&
+                   children == other.children && value == other.value;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &key) const { return key.hash; }
+    };
+
+    auto lookup(Key key, std::function<SharedSMTRef()> create)
+        -> SharedSMTRef;
+    // The symbols of the nodes that are interned are already stored in them
+    auto variable(Symbol name, const Type &type) -> SharedSMTRef;
+    auto canonicalOp(Symbol opName, std::vector<SharedSMTRef> args,
+                     bool instantiate) -> SharedSMTRef;
+    void registerOpaque(SharedSMTRef expr);
+    friend struct HashConsVisitor;
+
+    std::unordered_map<Key, SharedSMTRef, KeyHash> table;
+    llvm::DenseMap<const SMTExpr *, size_t> hashes;
+    // Keeps nodes alive that are referenced by pointer in 'hashes' but are
+    // not part of the table
+    std::vector<SharedSMTRef> opaque;
+};
+
+// While a HashConsScope is alive, the terms built by 'hashConsOp' and
+// 'hashConsVariable' on the current thread are shared through the given
+// factory, e.g. the heap selects and invariant applications that clause
+// generation builds again for every path. Factories are not thread safe, so
+// every thread needs its own scope. Scopes can be nested.
+class HashConsScope {
+  public:
+    explicit HashConsScope(HashConsFactory &factory);
+    HashConsScope(const HashConsScope &) = delete;
+    HashConsScope &operator=(const HashConsScope &) = delete;
+    ~HashConsScope();
+
+  private:
+    HashConsFactory *previous;
+};
+
+// Without an active scope these create a new node
+auto hashConsOp(std::string opName, std::vector<SharedSMTRef> args,
+                bool instantiate = true) -> SharedSMTRef;
+auto hashConsVariable(std::string name, Type type) -> SharedSMTRef;
+
+// Bind subterms that occur more than once in the clause to lets, so they are
+// printed only once. Occurrences are identified by pointer, so this is meant
+// for clauses whose subterms have been interned, e.g. after inlining lets.
+// The bindings are placed directly below the outermost foralls. Only terms
+// that also occur outside of nested foralls are bound, so they can’t refer to
+// the variables quantified there. Occurrences below a nested forall that
+// rebinds one of the names in the term are left alone.
+auto bindSharedSubterms(const SharedSMTRef &clause) -> SharedSMTRef;
+}
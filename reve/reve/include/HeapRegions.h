@@ -0,0 +1,35 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+
+#include "llvm/IR/Module.h"
+
+// Partitions the heap into regions such that every memory access only touches
+// a single region and the accesses of different regions can’t alias. Each
+// region is encoded as a separate array, so the invariants only relate the
+// regions instead of the complete heap and the solver has to reason about
+// fewer stores per array.
+//
+// The regions are derived from the pointer arguments of the main functions:
+// arguments that alias analysis proves to be disjoint start separate regions,
+// and all pointers derived from them via getelementptr, casts, phis, selects
+// and calls of defined functions belong to the same region. Pointers of
+// unknown origin, e.g. loaded pointers, globals or the arguments of external
+// functions, and everything they are combined with belong to region 0.
+//
+// Sets HeapRegionCount and HeapRegions of the current SMTGenerationOpts. The
+// heap is not partitioned if the stack is used or if the regions of the
+// arguments of the two main functions don’t match.
+auto assignHeapRegions(MonoPair<llvm::Module &> modules) -> void;
+// The region of the memory 'pointer' points to
+auto heapRegion(const llvm::Value *pointer) -> unsigned;
@@ -14,6 +14,7 @@
 #include "Opts.h"
 #include "SMT.h"
 
+#include <functional>
 #include <string>
 
 #include "llvm/IR/Instructions.h"
@@ -148,6 +149,14 @@ bool varBelongsTo(std::string varName, int program);
 auto heapName(Program prog) -> std::string;
 auto heapName(int progIndex) -> std::string;
 auto heapResultName(Program prog) -> std::string;
+// The array of one region of the heap, see HeapRegions.h. Region 0 is the
+// complete heap if the heap is not partitioned.
+auto heapName(Program prog, unsigned region) -> std::string;
+auto heapName(int progIndex, unsigned region) -> std::string;
+auto heapResultName(Program prog, unsigned region) -> std::string;
+// The arrays of all regions ordered by region
+auto heapNames(Program prog) -> std::vector<std::string>;
+auto heapResultNames(Program prog) -> std::vector<std::string>;
 auto stackName(Program progIndex) -> std::string;
 auto stackName(int progIndex) -> std::string;
 auto stackResultName(Program prog) -> std::string;
@@ -175,6 +184,11 @@ auto calledFunctions(const llvm::Function &f)
 
 auto dropSuffixFromName(std::string) -> std::string;
 
+// Run the tasks using up to 'jobs' threads. The tasks are started in order but
+// may finish in any order, so each task should write to its own result slot.
+void runInParallel(const std::vector<std::function<void()>> &tasks,
+                   unsigned jobs);
+
 template <typename U, typename... T> bool oneOf(U &&u, T &&... t) {
     bool match = false;
     (void)std::initializer_list<bool>{(match = match || u == t)...};
@@ -0,0 +1,46 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <string>
+
+// The subset of HTTP/1.1 needed by llreve-server: requests have a
+// Content-Length (chunked request bodies are rejected) and responses either
+// have a fixed length or, for progress streams, use chunked encoding.
+
+struct HttpRequest {
+    std::string Method;
+    // Including the query string
+    std::string Path;
+    // The names are converted to lower case
+    std::map<std::string, std::string> Headers;
+    std::string Body;
+};
+
+enum class HttpParse { Incomplete, Complete, Invalid, TooLarge };
+
+// Parses the request at the start of 'buffer'. If it is complete, 'consumed'
+// is set to its size including the body. Bodies larger than 'maxBody' bytes
+// are rejected without waiting for them.
+auto parseHttpRequest(llvm::StringRef buffer, size_t maxBody,
+                      HttpRequest &request, size_t &consumed) -> HttpParse;
+
+// A complete response, the connection is closed afterwards
+auto httpResponse(int status, llvm::StringRef contentType,
+                  llvm::StringRef body) -> std::string;
+// The header of a response whose body is sent using httpChunk
+auto httpStreamHeader(int status, llvm::StringRef contentType)
+    -> std::string;
+// An empty chunk terminates the body
+auto httpChunk(llvm::StringRef data) -> std::string;
@@ -0,0 +1,39 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+#include "Opts.h"
+
+#include "llvm/IR/Function.h"
+
+#include <set>
+
+// Many coupled functions are not changed at all between the two programs.
+// After preprocessing they only differ in the names of their values, which
+// UniqueNamePass prefixes with the program. Such pairs are equivalent if the
+// functions they call are, so they can be assumed to be equivalent instead of
+// generating (and solving) clauses for them.
+
+// Whether the preprocessed functions are identical up to the names of their
+// arguments, blocks and instructions. Globals have to have the same names.
+// The called functions are not compared, their pairs are added to 'callees'.
+auto identicalFunctions(MonoPair<const llvm::Function *> functions,
+                        std::set<MonoPair<const llvm::Function *>> &callees)
+    -> bool;
+
+// Adds the coupled pairs of identical functions whose callees are identical
+// (or the same declarations) to the pairs that are assumed to be equivalent.
+// The main functions and functions with custom conditions are never
+// assumed to be equivalent. Returns the number of added pairs.
+auto assumeIdenticalPairsEquivalent(llreve::opts::SMTGenerationOpts &smtOpts,
+                                    const llreve::opts::FileOptions &fileOpts)
+    -> size_t;
@@ -0,0 +1,54 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MonoPair.h"
+#include "Opts.h"
+
+#include "llvm/IR/Function.h"
+
+#include <set>
+#include <string>
+
+// Support for incremental verification: Once the main functions have been
+// proven equivalent for all equal inputs, the hash of the pair is recorded. In
+// later runs coupled pairs with a recorded hash are assumed to be equivalent
+// so no clauses have to be generated (and solved) for them. The other coupled
+// pairs of a query are never recorded, their invariants only need to hold for
+// the arguments passed by the main functions.
+
+// The hash of a coupled pair after preprocessing. This changes if one of the
+// functions, one of the functions they call transitively, the options relevant
+// for the encoding or the custom conditions for one of these functions change.
+auto functionPairHash(MonoPair<const llvm::Function *> funPair,
+                      const llreve::opts::SMTGenerationOpts &smtOpts,
+                      const llreve::opts::FileOptions &fileOpts)
+    -> std::string;
+
+// A missing file is treated as an empty set
+auto readProvenPairHashes(const std::string &fileName)
+    -> std::set<std::string>;
+auto writeProvenPairHashes(const std::string &fileName,
+                           const std::set<std::string> &hashes) -> void;
+
+// Add all coupled pairs whose hash is contained in 'proven' to the pairs that
+// are assumed to be equivalent. Returns the number of pairs added.
+auto assumeProvenPairsEquivalent(const std::set<std::string> &proven,
+                                 llreve::opts::SMTGenerationOpts &smtOpts,
+                                 const llreve::opts::FileOptions &fileOpts)
+    -> size_t;
+
+// The hash to record once the main functions are proven, empty if the proof
+// does not show equal outputs for all equal inputs, e.g. because of a custom
+// relation
+auto standaloneProofHash(const llreve::opts::SMTGenerationOpts &smtOpts,
+                         const llreve::opts::FileOptions &fileOpts)
+    -> std::string;
@@ -17,15 +17,29 @@
 #include <map>
 #include <set>
 
+// Places marks at the entry, the exit and the loop headers. By default the
+// top-level loops and their direct subloops are marked, so programs with the
+// same loop structure get the same marks.
+//
+// With a 'pathLimit' fewer marks are placed, since fewer marks mean fewer
+// synchronization points: Starting with all loop headers, a header is dropped
+// if the others still cut all cycles and at most 'pathLimit' paths start at
+// each of the remaining marks. The paths are only counted and not enumerated,
+// so this stays cheap for large functions. This only looks at one function,
+// two versions of a loop nest with different branches can end up with
+// different marks. In both cases inner loops are numbered first.
 class InferMarksAnalysis : public llvm::AnalysisInfoMixin<InferMarksAnalysis> {
   public:
     using Result = BidirBlockMarkMap;
+    explicit InferMarksAnalysis(uint64_t pathLimit = 0)
+        : PathLimit(pathLimit) {}
     Result run(llvm::Function &Fun, llvm::FunctionAnalysisManager &am);
     // it’s not possible to have non default constructors with the legacy
     // passmanager so we can’t just pass a pointer there to escape this
     BidirBlockMarkMap BlockMarkMap;
 
   private:
+    uint64_t PathLimit;
     friend llvm::AnalysisInfoMixin<InferMarksAnalysis>;
     static llvm::AnalysisKey Key;
 };
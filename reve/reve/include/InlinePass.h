@@ -10,10 +10,27 @@
 
 #pragma once
 
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/IR/PassManager.h"
 
+// Inlines calls wrapped in __inlineCall and calls of functions marked
+// always_inline. Callees are processed bottom-up: the inline requests of a
+// callee are resolved in the callee itself before it is copied, so they are
+// resolved once and not in every copy. The pass remembers which functions it
+// has processed, so the pipeline has to use one instance per module.
 class InlinePass : public llvm::PassInfoMixin<InlinePass> {
   public:
     llvm::PreservedAnalyses run(llvm::Function &fun,
                                 llvm::FunctionAnalysisManager &fam);
+
+  private:
+    // Functions whose inline requests have been resolved
+    llvm::DenseSet<const llvm::Function *> processed;
+    // Functions whose inline requests are currently being resolved, calls of
+    // them are recursive and are not inlined
+    llvm::DenseSet<const llvm::Function *> inProgress;
+
+    // Returns true if 'fun' has been changed
+    auto process(llvm::Function &fun, llvm::FunctionAnalysisManager &fam)
+        -> bool;
 };
@@ -0,0 +1,332 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instruction.h"
+
+#include <cstdint>
+#include <vector>
+
+// The parts of an LLVM IR interpreter that don’t depend on how values and the
+// heap are represented. They are shared by the interpreter of llreve-dynamic,
+// which uses unbounded integers unless -bitvect is passed, and the fixed width
+// interpreter of the slicing tool.
+
+namespace llreve {
+namespace interpreter {
+
+using Slot = uint32_t;
+using BlockIndex = uint32_t;
+static const BlockIndex NoBlock = static_cast<BlockIndex>(-1);
+
+// Numbers the values of a function densely so that a state is a vector indexed
+// by slots instead of a map. The arguments come first followed by all
+// instructions in the order of the function, so the instructions of a block
+// have consecutive slots. Constants are placed after them, see ConstantPool.
+class SlotLayout {
+  public:
+    explicit SlotLayout(const llvm::Function &fun);
+
+    auto function() const -> const llvm::Function & { return *fun; }
+    // The slot of an argument or instruction, None for all other values
+    auto slot(const llvm::Value *val) const -> llvm::Optional<Slot>;
+    // The number of arguments and instructions
+    auto variableCount() const -> Slot {
+        return static_cast<Slot>(variables.size());
+    }
+    // The argument or instruction stored in 'slot'
+    auto variable(Slot slot) const -> const llvm::Value * {
+        return variables[slot];
+    }
+    auto blockCount() const -> BlockIndex {
+        return static_cast<BlockIndex>(blocks.size());
+    }
+    auto block(BlockIndex index) const -> const llvm::BasicBlock & {
+        return *blocks[index];
+    }
+    auto blockIndex(const llvm::BasicBlock &block) const -> BlockIndex;
+    // The slot of the first instruction of the block
+    auto firstSlot(BlockIndex index) const -> Slot {
+        return blockBegins[index];
+    }
+
+  private:
+    const llvm::Function *fun;
+    llvm::DenseMap<const llvm::Value *, Slot> slots;
+    std::vector<const llvm::Value *> variables;
+    llvm::DenseMap<const llvm::BasicBlock *, BlockIndex> blockIndices;
+    std::vector<const llvm::BasicBlock *> blocks;
+    std::vector<Slot> blockBegins;
+};
+
+// The constants of a function, they get the slots after the variables of the
+// layout. Constants are pooled by their llvm::Value so each of them is
+// converted only once per function and not every time it is used.
+template <typename V> class ConstantPool {
+  public:
+    explicit ConstantPool(const SlotLayout &layout)
+        : firstSlot(layout.variableCount()) {}
+
+    // Adds a value that doesn’t correspond to a constant of the function,
+    // these are not pooled
+    auto add(V value) -> Slot {
+        constants.push_back(std::move(value));
+        return firstSlot + static_cast<Slot>(constants.size() - 1);
+    }
+    // 'convert' returns None if the constant can’t be represented, in that
+    // case None is returned as well
+    template <typename F>
+    auto constant(const llvm::Value *val, F convert) -> llvm::Optional<Slot> {
+        auto it = slots.find(val);
+        if (it != slots.end()) {
+            return it->second;
+        }
+        llvm::Optional<V> converted = convert(*val);
+        if (!converted) {
+            return llvm::None;
+        }
+        const Slot slot = add(std::move(*converted));
+        slots.insert({val, slot});
+        return slot;
+    }
+    // The slot of a constant that has already been added
+    auto lookup(const llvm::Value *val) const -> llvm::Optional<Slot> {
+        auto it = slots.find(val);
+        if (it == slots.end()) {
+            return llvm::None;
+        }
+        return it->second;
+    }
+    // The values of the slots starting at 'begin()'
+    auto values() const -> const std::vector<V> & { return constants; }
+    auto begin() const -> Slot { return firstSlot; }
+
+  private:
+    Slot firstSlot;
+    std::vector<V> constants;
+    llvm::DenseMap<const llvm::Value *, Slot> slots;
+};
+
+enum class EvalStatus { Ok, DivisionByZero, Overflow, ShiftOutOfRange };
+
+// Arithmetic on llvm::APInt which has the semantics of the LLVM instructions.
+// Other arithmetics have to provide the same static functions.
+struct BoundedArithmetic {
+    using Value = llvm::APInt;
+
+    static auto isZero(const Value &a) -> bool { return a == 0; }
+    // True if a / b doesn’t fit in the bit width of the operands
+    static auto divisionOverflows(const Value &a, const Value &b) -> bool {
+        return a.isMinSignedValue() && b.isAllOnesValue();
+    }
+    // True if shifting a by b is undefined
+    static auto shiftOutOfRange(const Value &a, const Value &b) -> bool {
+        return b.uge(a.getBitWidth());
+    }
+
+    static auto add(const Value &a, const Value &b) -> Value { return a + b; }
+    static auto sub(const Value &a, const Value &b) -> Value { return a - b; }
+    static auto mul(const Value &a, const Value &b) -> Value { return a * b; }
+    static auto udiv(const Value &a, const Value &b) -> Value {
+        return a.udiv(b);
+    }
+    static auto sdiv(const Value &a, const Value &b) -> Value {
+        return a.sdiv(b);
+    }
+    static auto urem(const Value &a, const Value &b) -> Value {
+        return a.urem(b);
+    }
+    static auto srem(const Value &a, const Value &b) -> Value {
+        return a.srem(b);
+    }
+    static auto shl(const Value &a, const Value &b) -> Value {
+        return a.shl(b);
+    }
+    static auto lshr(const Value &a, const Value &b) -> Value {
+        return a.lshr(b);
+    }
+    static auto ashr(const Value &a, const Value &b) -> Value {
+        return a.ashr(b);
+    }
+    static auto and_(const Value &a, const Value &b) -> Value { return a & b; }
+    static auto or_(const Value &a, const Value &b) -> Value { return a | b; }
+    static auto xor_(const Value &a, const Value &b) -> Value { return a ^ b; }
+
+    static auto eq(const Value &a, const Value &b) -> bool { return a == b; }
+    static auto ne(const Value &a, const Value &b) -> bool { return a != b; }
+    static auto ugt(const Value &a, const Value &b) -> bool {
+        return a.ugt(b);
+    }
+    static auto uge(const Value &a, const Value &b) -> bool {
+        return a.uge(b);
+    }
+    static auto ult(const Value &a, const Value &b) -> bool {
+        return a.ult(b);
+    }
+    static auto ule(const Value &a, const Value &b) -> bool {
+        return a.ule(b);
+    }
+    static auto sgt(const Value &a, const Value &b) -> bool {
+        return a.sgt(b);
+    }
+    static auto sge(const Value &a, const Value &b) -> bool {
+        return a.sge(b);
+    }
+    static auto slt(const Value &a, const Value &b) -> bool {
+        return a.slt(b);
+    }
+    static auto sle(const Value &a, const Value &b) -> bool {
+        return a.sle(b);
+    }
+};
+
+// Evaluates an integer binary operator. Returns false if 'opcode' is not one
+// of them, 'status' is only set in that case.
+template <typename Arith>
+auto evalBinaryOp(unsigned opcode, const typename Arith::Value &a,
+                  const typename Arith::Value &b,
+                  typename Arith::Value &result, EvalStatus &status) -> bool {
+    status = EvalStatus::Ok;
+    switch (opcode) {
+    case llvm::Instruction::Add:
+        result = Arith::add(a, b);
+        return true;
+    case llvm::Instruction::Sub:
+        result = Arith::sub(a, b);
+        return true;
+    case llvm::Instruction::Mul:
+        result = Arith::mul(a, b);
+        return true;
+    case llvm::Instruction::And:
+        result = Arith::and_(a, b);
+        return true;
+    case llvm::Instruction::Or:
+        result = Arith::or_(a, b);
+        return true;
+    case llvm::Instruction::Xor:
+        result = Arith::xor_(a, b);
+        return true;
+    case llvm::Instruction::UDiv:
+    case llvm::Instruction::URem:
+    case llvm::Instruction::SDiv:
+    case llvm::Instruction::SRem:
+        if (Arith::isZero(b)) {
+            status = EvalStatus::DivisionByZero;
+            return true;
+        }
+        switch (opcode) {
+        case llvm::Instruction::UDiv:
+            result = Arith::udiv(a, b);
+            return true;
+        case llvm::Instruction::URem:
+            result = Arith::urem(a, b);
+            return true;
+        default:
+            break;
+        }
+        if (Arith::divisionOverflows(a, b)) {
+            status = EvalStatus::Overflow;
+            return true;
+        }
+        result = opcode == llvm::Instruction::SDiv ? Arith::sdiv(a, b)
+                                                   : Arith::srem(a, b);
+        return true;
+    case llvm::Instruction::Shl:
+    case llvm::Instruction::LShr:
+    case llvm::Instruction::AShr:
+        if (Arith::shiftOutOfRange(a, b)) {
+            status = EvalStatus::ShiftOutOfRange;
+            return true;
+        }
+        switch (opcode) {
+        case llvm::Instruction::Shl:
+            result = Arith::shl(a, b);
+            break;
+        case llvm::Instruction::LShr:
+            result = Arith::lshr(a, b);
+            break;
+        default:
+            result = Arith::ashr(a, b);
+            break;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Evaluates an integer comparison. Returns false if 'pred' is not an integer
+// predicate.
+template <typename Arith>
+auto evalPredicate(llvm::CmpInst::Predicate pred,
+                   const typename Arith::Value &a,
+                   const typename Arith::Value &b, bool &result) -> bool {
+    switch (pred) {
+    case llvm::CmpInst::ICMP_EQ:
+        result = Arith::eq(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_NE:
+        result = Arith::ne(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_UGT:
+        result = Arith::ugt(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_UGE:
+        result = Arith::uge(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_ULT:
+        result = Arith::ult(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_ULE:
+        result = Arith::ule(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_SGT:
+        result = Arith::sgt(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_SGE:
+        result = Arith::sge(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_SLT:
+        result = Arith::slt(a, b);
+        return true;
+    case llvm::CmpInst::ICMP_SLE:
+        result = Arith::sle(a, b);
+        return true;
+    default:
+        return false;
+    }
+}
+
+auto evalStatusMessage(EvalStatus status) -> const char *;
+
+// Receives the events of an interpreted function, e.g. to record a trace. The
+// interpreters only notify an observer if one has been installed, so tracing
+// costs nothing otherwise. All methods do nothing by default.
+class TraceObserver {
+  public:
+    virtual ~TraceObserver();
+    // Called before the phi nodes of the block are evaluated. 'predecessor'
+    // is null for the first block of a call.
+    virtual void enterBlock(const llvm::BasicBlock &block,
+                            const llvm::BasicBlock *predecessor);
+    // Called after an instruction has been executed, its result (if it has
+    // one) is stored in 'slot'
+    virtual void executeInstruction(const llvm::Instruction &instr,
+                                    Slot slot);
+    virtual void exitFunction(const llvm::Function &fun);
+};
+}
+}
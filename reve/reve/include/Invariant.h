@@ -21,15 +21,19 @@
 enum class InvariantAttr { MAIN, PRE, NONE };
 
 auto functionalCouplingPredicate(Mark StartIndex, Mark EndIndex,
-                                 std::vector<smt::SortedVar> InputArgs,
-                                 std::vector<smt::SortedVar> EndArgs,
-                                 ProgramSelection SMTFor, std::string FunName,
-                                 FreeVarsMap freeVarsMap) -> smt::SMTRef;
+                                 const std::vector<smt::SortedVar> &InputArgs,
+                                 const std::vector<smt::SortedVar> &EndArgs,
+                                 ProgramSelection SMTFor,
+                                 const std::string &FunName,
+                                 const FreeVarsMap &freeVarsMap)
+    -> smt::SharedSMTRef;
 auto iterativeCouplingPredicate(Mark EndIndex,
-                                std::vector<smt::SortedVar> FreeVars,
-                                std::string FunName) -> smt::SMTRef;
-auto invariantDeclaration(Mark BlockIndex, std::vector<smt::SortedVar> FreeVars,
-                          ProgramSelection For, std::string FunName,
+                                const std::vector<smt::SortedVar> &FreeVars,
+                                const std::string &FunName)
+    -> smt::SharedSMTRef;
+auto invariantDeclaration(Mark BlockIndex,
+                          const std::vector<smt::SortedVar> &FreeVars,
+                          ProgramSelection For, const std::string &FunName,
                           const llvm::Type *resultType)
     -> MonoPair<smt::SMTRef>;
 auto mainInvariantComment(Mark blockIndex,
@@ -37,12 +41,33 @@ auto mainInvariantComment(Mark blockIndex,
                           ProgramSelection selection, std::string funName)
     -> smt::SMTRef;
 auto mainInvariantDeclaration(Mark BlockIndex,
-                              std::vector<smt::SortedVar> FreeVars,
-                              ProgramSelection For, std::string FunName)
+                              const std::vector<smt::SortedVar> &FreeVars,
+                              ProgramSelection For, const std::string &FunName)
     -> smt::SMTRef;
-auto invariantName(Mark Index, ProgramSelection For, std::string FunName,
+auto invariantName(Mark Index, ProgramSelection For,
+                   const std::string &FunName,
                    InvariantAttr attr = InvariantAttr::NONE,
                    uint32_t VarArgs = 0) -> std::string;
+// The auxiliary predicate of the linear forbidden path encoding. It relates
+// the variables of the second program at the start mark to the end of a path
+// of the first program.
+auto forbiddenSelectorName(Mark startIndex, const std::string &funName)
+    -> std::string;
+auto forbiddenSelectorDeclaration(Mark startIndex,
+                                  const std::vector<smt::SortedVar> &freeVars2,
+                                  const std::string &funName) -> smt::SMTRef;
 
-auto invariantArgs(std::vector<smt::SortedVar> freeVars, ProgramSelection prog,
-                   InvariantAttr attr) -> size_t;
+// The variables passed to the invariant of the main functions at a mark.
+// Variables that are provably equal to an earlier variable at the mark are
+// dropped if ReduceInvariantArguments is set. Variables with an "_old" suffix
+// are treated like the variables without it.
+auto mainInvariantArguments(const std::vector<smt::SortedVar> &freeVars)
+    -> std::vector<smt::SortedVar>;
+// The equalities between the variables dropped by mainInvariantArguments and
+// the variables that are kept, after appending 'suffix' to both
+auto mainInvariantEqualities(const std::vector<smt::SortedVar> &freeVars,
+                             const std::string &suffix)
+    -> std::vector<smt::SharedSMTRef>;
+
+auto invariantArgs(const std::vector<smt::SortedVar> &freeVars,
+                   ProgramSelection prog, InvariantAttr attr) -> size_t;
@@ -0,0 +1,47 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "AnalysisResults.h"
+#include "Opts.h"
+#include "SMT.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// A cache of solved invariants on disk. When a pair is verified again after a
+// small change, most of the invariants found by the solver are usually still
+// valid. Each solved invariant is stored under the signature of its predicate
+// and later runs use the cached definitions as candidates: If they are still
+// inductive, solving the Horn system is only a check.
+
+// The signature of a predicate is a hash of its declaration (name, i.e. the
+// mark, and argument types) and of all clauses that apply it. Maps the names
+// of the declared invariants to their signatures.
+using InvariantSignatures = std::map<std::string, std::string>;
+
+auto invariantSignatures(const std::vector<smt::SharedSMTRef> &clauses)
+    -> InvariantSignatures;
+
+// Defines the relational invariants of the main and the coupled functions for
+// which a definition with the same signature is cached. The invariants of a
+// coupled pair are only defined if both its precondition and postcondition
+// are cached. Returns the number of defined invariants.
+auto applyCachedInvariants(const std::string &cacheDir,
+                           const InvariantSignatures &signatures,
+                           const AnalysisResultsMap &analysisResults,
+                           llreve::opts::SMTGenerationOpts &smtOpts) -> size_t;
+
+// Stores the definitions of the model for all invariants in 'signatures'
+auto storeSolvedInvariants(const std::string &cacheDir,
+                           const InvariantSignatures &signatures,
+                           const std::string &model) -> void;
@@ -0,0 +1,77 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Llreve.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// The jobs of llreve-server. The queue only does the bookkeeping, running the
+// jobs is up to the server.
+
+enum class JobState { Queued, Running, Finished, Failed };
+
+struct JobRequest {
+    llreve::api::Input First;
+    llreve::api::Input Second;
+    llreve::api::Options Opts;
+    // Jobs with a higher priority are started first
+    int Priority = 0;
+};
+
+struct Job {
+    uint64_t Id;
+    JobRequest Request;
+    // Submissions with the same key are the same job, see jobKey
+    std::string Key;
+    JobState State = JobState::Queued;
+    // The progress of the job as JSON objects in the order they were
+    // reported
+    std::vector<std::string> Events;
+};
+
+// Everything that influences the result of a job, the priority is not part
+// of the key
+auto jobKey(const JobRequest &request) -> std::string;
+
+class JobQueue {
+  public:
+    // Keeps at most 'maxJobs' finished jobs, the oldest are dropped first
+    explicit JobQueue(size_t maxJobs) : MaxJobs(maxJobs) {}
+    // Returns the job and whether it was queued by an earlier submission. In
+    // that case the priority of the queued job is raised if the new one is
+    // higher. Jobs that failed are not reused.
+    auto submit(JobRequest request) -> std::pair<Job &, bool>;
+    // nullptr if there is no such job (any more)
+    auto find(uint64_t id) -> Job *;
+    // Marks the queued job with the highest priority as running, jobs with
+    // the same priority are started in the order they were submitted.
+    // Returns nullptr if no job is queued.
+    auto startNext() -> Job *;
+    // Frees the inputs of the job, they are not needed once it is done
+    auto finish(Job &job, bool failed) -> void;
+    auto queued() const -> size_t { return Queue.size(); }
+
+  private:
+    size_t MaxJobs;
+    uint64_t NextId = 1;
+    std::map<uint64_t, std::unique_ptr<Job>> Jobs;
+    std::map<std::string, uint64_t> JobsByKey;
+    // (-priority, id) so that the first element is the next job
+    std::set<std::pair<int64_t, uint64_t>> Queue;
+    // Finished jobs, oldest first
+    std::vector<uint64_t> Done;
+};
@@ -0,0 +1,43 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// A parsed JSON document. Unlike the manifest parser of the batch mode this
+// reports errors to the caller instead of exiting, since the documents come
+// from clients of the server.
+struct JsonValue {
+    enum class Kind { Null, Bool, Number, String, Array, Object };
+    Kind ValueKind = Kind::Null;
+    bool Bool = false;
+    double Number = 0;
+    std::string Text;
+    std::vector<JsonValue> Elements;
+    // In the order of the document
+    std::vector<std::pair<std::string, JsonValue>> Members;
+
+    // The value of the first member with this key, nullptr if there is none
+    // or this is not an object
+    auto member(llvm::StringRef key) const -> const JsonValue *;
+};
+
+// Returns false and sets 'error' if 'text' is not a single JSON value. Values
+// nested more than 64 levels deep are rejected.
+auto parseJson(llvm::StringRef text, JsonValue &value, std::string &error)
+    -> bool;
+
+// The string as a JSON string literal including the quotes
+auto jsonString(llvm::StringRef str) -> std::string;
@@ -0,0 +1,121 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The interface for embedding llreve in other programs. The inputs are passed
+// as buffers and the results are returned instead of being written to files
+// or stdout, diagnostics still go to stderr.
+//
+// All functions can be called concurrently from multiple threads. Every call
+// compiles the programs into contexts of its own and uses its own
+// SMTGenerationOpts, the process wide setup (see initialize) is only done
+// once. Like the command line tool, invalid inputs or options and unsupported
+// programs terminate the process, so untrusted inputs should be verified in a
+// separate process.
+namespace llreve {
+namespace api {
+
+// A C program or an LLVM module (bitcode or textual IR). The name is used in
+// diagnostics and determines the kind of the input: names ending in .bc or
+// .ll are LLVM IR, everything else is C. Both inputs of a call have to be of
+// the same kind and need different names.
+struct Input {
+    std::string Name;
+    std::string Contents;
+};
+
+// The subset of the command line options that is relevant for embedding, the
+// defaults are the ones of the command line tool
+struct Options {
+    // The function pair that is verified, inferred as for -fun if empty
+    std::string Function;
+    std::vector<std::string> Includes;
+    std::string ResourceDir;
+    bool Heap = false;
+    bool Stack = false;
+    bool GlobalConstants = false;
+    bool OnlyRecursive = false;
+    bool EverythingSigned = false;
+    bool BitVect = false;
+    bool InferMarks = false;
+    // Use the muZ format instead of SMT-HORN. Such clauses can be serialized
+    // but not solved.
+    bool MuZ = false;
+    bool Pretty = true;
+    bool InlineLets = false;
+    // Couple only these function pairs instead of the ones with the same name
+    bool DisableAutoCoupling = false;
+    std::vector<std::pair<std::string, std::string>> CoupledFunctions;
+    std::vector<std::pair<std::string, std::string>> AssumeEquivalent;
+    // Threads used within one call, see SMTGenerationOpts::Jobs
+    unsigned Jobs = 1;
+};
+
+// Time spent in the phases of a call, phases that were not run are zero
+struct Timings {
+    std::chrono::steady_clock::duration Compile{0};
+    std::chrono::steady_clock::duration Preprocess{0};
+    std::chrono::steady_clock::duration Generate{0};
+    std::chrono::steady_clock::duration Serialize{0};
+    std::chrono::steady_clock::duration Solve{0};
+};
+
+struct Clauses {
+    // Declarations, definitions and assertions in the order in which they
+    // are serialized. They don’t refer to the compiled programs, which are
+    // freed before the call returns.
+    std::vector<smt::SharedSMTRef> Exprs;
+    // Whether they are in the muZ format
+    bool MuZ;
+    Timings Times;
+};
+
+struct SerializedSMT {
+    std::string SMT;
+    Timings Times;
+};
+
+enum class Verdict { Equal, NotEqual, Unknown };
+
+struct VerificationResult {
+    Verdict Result;
+    // The invariants found by the solver, only set if the programs are equal
+    std::string Model;
+    Timings Times;
+};
+
+// Sets up everything that is shared by all calls. This is done by the first
+// call automatically, calling it explicitly moves the cost out of the first
+// verification.
+auto initialize() -> void;
+
+auto generateClauses(const Input &first, const Input &second,
+                     const Options &opts) -> Clauses;
+// Generates the clauses and serializes them like the command line tool
+auto serializeClauses(const Input &first, const Input &second,
+                      const Options &opts) -> SerializedSMT;
+// Solves the clauses in process using z3, the times of the clauses are
+// included in the result
+auto solveClauses(Clauses clauses, const Options &opts) -> VerificationResult;
+// Like generateClauses followed by solveClauses
+auto verify(const Input &first, const Input &second, const Options &opts)
+    -> VerificationResult;
+// The key of the clauses in the result cache, see queryHash
+auto clausesHash(const Clauses &clauses, const Options &opts) -> std::string;
+} // namespace api
+} // namespace llreve
@@ -0,0 +1,36 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include <vector>
+
+// Replaces simple counting loops by their closed form. A predicate P whose
+// only recursive clause is
+//
+//   (forall (x) (=> (and (P x) (G x)) (P (+ x c))))
+//
+// where c are integer constants (zero for arrays) and G is a conjunction of
+// linear inequalities over x, e.g. the loop of (for i = 0; i < n; i++), is
+// reachable after k ≥ 0 iterations iff G holds for the first and the last
+// iteration, since the values of G along the iterations are convex in k.
+// Every clause deriving (P t) therefore derives
+//
+//   (=> (or (= k 0) (and (G t) (G (+ t (* c (- k 1)))))) (P (+ t (* c k))))
+//
+// for a fresh k ≥ 0 instead and the recursive clause is removed. This
+// preserves the least solution of P, so the result is satisfiable iff the
+// original system is, but the solver no longer has to find an inductive
+// invariant for P. A model of the result does not have to be inductive for
+// the removed clause. Only the SMT-HORN format with integers is supported.
+// Returns the number of accelerated predicates.
+auto accelerateLoops(std::vector<smt::SharedSMTRef> &smtExprs) -> size_t;
@@ -0,0 +1,235 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "MarkAnalysis.h"
+
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A map from marks to values stored in a vector indexed by the marks. Marks are
+// small integers, so this replaces the tree walks of an std::map by a single
+// index operation. The special marks are negative and are stored in the first
+// slots, so iterating yields the marks in ascending order just like an
+// std::map.
+//
+// The interface is the subset of std::map that is used for marks, references
+// and iterators to other entries stay valid when an entry is erased but not
+// when a larger mark is inserted.
+template <typename T> class MarkMap {
+  public:
+    using key_type = Mark;
+    using mapped_type = T;
+    using value_type = std::pair<const Mark, T>;
+    using size_type = std::size_t;
+
+  private:
+    struct Slot {
+        value_type value;
+        bool present;
+        explicit Slot(Mark mark) : value(mark, T()), present(false) {}
+    };
+
+    template <typename SlotT, typename Value> class Iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value *;
+        using reference = Value &;
+
+        Iterator(SlotT *slot, SlotT *last) : slot(slot), last(last) {
+            skipEmpty();
+        }
+        // Allows converting an iterator into a const_iterator
+        template <typename OtherSlot, typename OtherValue,
+                  typename = std::enable_if_t<
+                      std::is_convertible<OtherSlot *, SlotT *>::value>>
+        Iterator(const Iterator<OtherSlot, OtherValue> &other)
+            : slot(other.slot), last(other.last) {}
+
+        reference operator*() const { return slot->value; }
+        pointer operator->() const { return &slot->value; }
+        Iterator &operator++() {
+            ++slot;
+            skipEmpty();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        bool operator==(const Iterator &other) const {
+            return slot == other.slot;
+        }
+        bool operator!=(const Iterator &other) const {
+            return slot != other.slot;
+        }
+
+      private:
+        SlotT *slot;
+        SlotT *last;
+        void skipEmpty() {
+            while (slot != last && !slot->present) {
+                ++slot;
+            }
+        }
+        template <typename, typename> friend class Iterator;
+    };
+
+  public:
+    using iterator = Iterator<Slot, value_type>;
+    using const_iterator = Iterator<const Slot, const value_type>;
+
+    MarkMap() = default;
+    MarkMap(std::initializer_list<value_type> values) {
+        for (const auto &value : values) {
+            insert(value);
+        }
+    }
+    MarkMap(const MarkMap &other) = default;
+    MarkMap(MarkMap &&other) = default;
+    // The keys of the slots are const, so the slots can’t be assigned
+    MarkMap &operator=(MarkMap other) {
+        slots.swap(other.slots);
+        std::swap(entries, other.entries);
+        return *this;
+    }
+
+    iterator begin() { return {first(), last()}; }
+    iterator end() { return {last(), last()}; }
+    const_iterator begin() const { return {first(), last()}; }
+    const_iterator end() const { return {last(), last()}; }
+
+    size_type size() const { return entries; }
+    bool empty() const { return entries == 0; }
+    size_type count(Mark mark) const { return contains(mark) ? 1 : 0; }
+
+    iterator find(Mark mark) {
+        if (!contains(mark)) {
+            return end();
+        }
+        return {&slots[slotIndex(mark)], last()};
+    }
+    const_iterator find(Mark mark) const {
+        if (!contains(mark)) {
+            return end();
+        }
+        return {&slots[slotIndex(mark)], last()};
+    }
+
+    T &at(Mark mark) {
+        if (!contains(mark)) {
+            throw std::out_of_range("MarkMap::at");
+        }
+        return slots[slotIndex(mark)].value.second;
+    }
+    const T &at(Mark mark) const {
+        if (!contains(mark)) {
+            throw std::out_of_range("MarkMap::at");
+        }
+        return slots[slotIndex(mark)].value.second;
+    }
+    T &operator[](Mark mark) { return slot(mark).value.second; }
+
+    std::pair<iterator, bool> insert(const value_type &value) {
+        const bool inserted = !contains(value.first);
+        Slot &s = slot(value.first);
+        if (inserted) {
+            s.value.second = value.second;
+        }
+        return {iterator(&s, last()), inserted};
+    }
+    std::pair<iterator, bool> insert(value_type &&value) {
+        const bool inserted = !contains(value.first);
+        Slot &s = slot(value.first);
+        if (inserted) {
+            s.value.second = std::move(value.second);
+        }
+        return {iterator(&s, last()), inserted};
+    }
+
+    size_type erase(Mark mark) {
+        if (!contains(mark)) {
+            return 0;
+        }
+        Slot &s = slots[slotIndex(mark)];
+        s.value.second = T();
+        s.present = false;
+        --entries;
+        return 1;
+    }
+    iterator erase(const_iterator it) {
+        const Mark mark = it->first;
+        iterator next(&slots[slotIndex(mark)] + 1, last());
+        erase(mark);
+        return next;
+    }
+    void clear() {
+        slots.clear();
+        entries = 0;
+    }
+
+  private:
+    // FORBIDDEN_MARK is the smallest special mark
+    static const int Offset = 4;
+    std::vector<Slot> slots;
+    size_type entries = 0;
+
+    static size_type slotIndex(Mark mark) {
+        return static_cast<size_type>(mark.asInt() + Offset);
+    }
+    bool contains(Mark mark) const {
+        const size_type index = slotIndex(mark);
+        return index < slots.size() && slots[index].present;
+    }
+    // The slot of the mark, creating the entry if it does not exist yet
+    Slot &slot(Mark mark) {
+        const size_type index = slotIndex(mark);
+        while (slots.size() <= index) {
+            slots.emplace_back(Mark(static_cast<int>(slots.size()) - Offset));
+        }
+        Slot &s = slots[index];
+        if (!s.present) {
+            s.present = true;
+            ++entries;
+        }
+        return s;
+    }
+    Slot *first() { return slots.data(); }
+    Slot *last() { return slots.data() + slots.size(); }
+    const Slot *first() const { return slots.data(); }
+    const Slot *last() const { return slots.data() + slots.size(); }
+};
+
+template <typename T>
+bool operator==(const MarkMap<T> &a, const MarkMap<T> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (const auto &entry : a) {
+        auto it = b.find(entry.first);
+        if (it == b.end() || !(it->second == entry.second)) {
+            return false;
+        }
+    }
+    return true;
+}
+template <typename T>
+bool operator!=(const MarkMap<T> &a, const MarkMap<T> &b) {
+    return !(a == b);
+}
@@ -10,9 +10,23 @@
 
 #pragma once
 
-#include <regex>
+#include "llvm/ADT/StringRef.h"
 
-const std::regex HEAP_REGEX =
-    std::regex("^(HEAP|STACK)\\$(1|2)(.*?)$", std::regex::ECMAScript);
-const std::regex INDEX_REGEX =
-    std::regex("^i(1|2)(_res|_old|_stack)?$", std::regex::ECMAScript);
+#include <cstdint>
+
+// The part a variable plays in the encoding of the memory, which is encoded
+// in its name
+enum class VarRole : uint8_t {
+    Plain,
+    // HEAP$1, HEAP$2_old, …
+    Heap,
+    // STACK$1, STACK$2_res, …
+    Stack,
+    // The index variables of instantiated heaps: i1, i2, i1_res, i2_old and
+    // i1_stack
+    Index
+};
+
+// Classifies the variable by its name without using a regex, this is called
+// once for every variable that is created
+auto variableRole(llvm::StringRef name) -> VarRole;
@@ -0,0 +1,47 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "PathAnalysis.h"
+#include "Program.h"
+#include "SMT.h"
+
+#include <functional>
+
+// An alternative to encoding each path between two marks separately (large
+// block encoding). All blocks on the paths are encoded once in topological
+// order and the path that is taken is tracked by boolean variables. Variables
+// whose value depends on the path (e.g. phi nodes or the heap) are merged
+// using if-then-else expressions at blocks with several predecessors.
+//
+// This makes the size of the SMT linear in the number of blocks instead of
+// the number of paths, e.g. k sequential if/else diamonds result in a single
+// clause of size O(k) instead of 2^k clauses.
+
+// Creates the clause that is reached at the end of the paths. The argument is
+// the last block of the path, the clause can use the same variables as the
+// end clause in the path based encoding.
+using MergedEndClause =
+    std::function<smt::SharedSMTRef(llvm::BasicBlock *endBlock)>;
+
+// Function calls need to be synchronized between the two programs based on the
+// path that is taken, so paths containing calls can’t be merged.
+auto canMergePaths(const Paths &paths) -> bool;
+
+// Returns true if the merged encoding should be used for the given paths of
+// the first and second program (both can be the same)
+auto shouldMergePaths(const Paths &paths1, const Paths &paths2) -> bool;
+
+// The merged counterpart of assignmentsOnPath + nonmutualSMT. The paths must
+// all end at the same mark and 'canMergePaths' has to be true for them.
+auto mergedPathsSMT(const Paths &paths, Program prog,
+                    const std::vector<smt::SortedVar> &freeVars, bool toEnd,
+                    MergedEndClause endClause) -> smt::SharedSMTRef;
@@ -22,12 +22,21 @@ auto generateSMT(MonoPair<const llvm::Module &> modules,
                  const AnalysisResultsMap &analysisResults,
                  llreve::opts::FileOptions fileOpts)
     -> std::vector<smt::SharedSMTRef>;
+// Generate the SMT using the given options instead of the options of the
+// current thread
+auto generateSMT(MonoPair<const llvm::Module &> modules,
+                 const AnalysisResultsMap &analysisResults,
+                 llreve::opts::FileOptions fileOpts,
+                 llreve::opts::SMTGenerationOpts &smtOpts)
+    -> std::vector<smt::SharedSMTRef>;
 auto generateSMTForMainFunctions(MonoPair<const llvm::Module &> modules,
                                  const AnalysisResultsMap &analysisResults,
                                  llreve::opts::FileOptions fileOpts,
                                  std::vector<smt::SharedSMTRef> &assertions,
                                  std::vector<smt::SharedSMTRef> &declarations)
     -> void;
+auto needsFunctionalAbstraction(const llvm::Function &fun,
+                                const llvm::Function &mainFunction) -> bool;
 auto generateFunctionalAbstractions(
     const llvm::Module &module, const llvm::Function *mainFunction,
     const AnalysisResultsMap &analysisResults, Program prog,
@@ -40,13 +49,20 @@ auto globalDeclarations(const llvm::Module &mod1, const llvm::Module &mod2)
 auto globalDeclarationsForMod(int globalPointer, const llvm::Module &mod,
                               const llvm::Module &otherMod, int program)
     -> std::vector<smt::SharedSMTRef>;
-auto stringConstants(const llvm::Module &mod, std::string heap)
+// For each constant array of the module that is loaded from, a function
+// CONST_<global> of the heap stating the values of the loaded cells. All cells
+// are constrained if the array is used in some other way.
+auto constantArrayDefinitions(const llvm::Module &mod, Program prog)
+    -> std::vector<smt::SharedSMTRef>;
+// The applications of the definitions to the heaps
+auto stringConstants(
+    const std::vector<smt::SharedSMTRef> &constantArrayDefinitions)
     -> std::vector<smt::SharedSMTRef>;
 auto inInvariant(MonoPair<const llvm::Function *> funs,
                  const AnalysisResultsMap &analysisResults,
-                 smt::SharedSMTRef body, const llvm::Module &mod1,
-                 const llvm::Module &mod2, bool strings, bool inInvariant)
-    -> std::unique_ptr<smt::FunDef>;
+                 smt::SharedSMTRef body,
+                 const std::vector<smt::SharedSMTRef> &constantArrays,
+                 bool inInvariant) -> std::unique_ptr<smt::FunDef>;
 auto outInvariant(MonoPair<std::vector<smt::SortedVar>> funArgs,
                   smt::SharedSMTRef body, const llvm::Type *type)
     -> std::unique_ptr<smt::FunDef>;
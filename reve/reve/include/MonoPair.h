@@ -16,6 +16,8 @@
 
 #include "Program.h"
 
+template <typename T> struct MonoPairView;
+
 // Monomorphic pair
 // Monomorphic refers to the fact that both elements have the same type
 template <typename T> struct MonoPair {
@@ -24,6 +26,10 @@ template <typename T> struct MonoPair {
 
     MonoPair(const T &first, const T &second) : first(first), second(second) {}
 
+    // Copies the viewed elements
+    explicit MonoPair(const MonoPairView<T> &view)
+        : first(view.first), second(view.second) {}
+
     template <typename T1, typename = std::enable_if_t<
                                std::is_convertible<const T1 &, T>::value>>
     MonoPair(const MonoPair<T1> &p) : first(p.first), second(p.second) {}
@@ -73,6 +79,25 @@ template <typename T> struct MonoPair {
     }
 };
 
+// A pair of references to two elements of the same type, e.g. the results of
+// analysing two functions. Unlike a MonoPair the elements are not copied, so
+// the view must not outlive them.
+template <typename T> struct MonoPairView {
+    const T &first;
+    const T &second;
+
+    MonoPairView(const T &first, const T &second)
+        : first(first), second(second) {}
+    MonoPairView(const MonoPair<T> &p) : first(p.first), second(p.second) {}
+    // The elements of a temporary pair would be destroyed before the view
+    MonoPairView(MonoPair<T> &&p) = delete;
+
+    template <typename NewT>
+    MonoPair<NewT> map(std::function<NewT(const T &)> f) const {
+        return {f(first), f(second)};
+    }
+};
+
 // This weird template magic is stolen from libc++
 template <class _Tp> struct __make_pair_return_impl { typedef _Tp type; };
 template <class _Tp>
@@ -93,20 +118,21 @@ MonoPair<typename __make_pair_return<T>::type> makeMonoPair(T &&first,
 }
 
 template <typename A, typename B, typename C>
-MonoPair<C> zipWith(MonoPair<A> pairA, MonoPair<B> pairB,
+MonoPair<C> zipWith(const MonoPair<A> &pairA, const MonoPair<B> &pairB,
                     std::function<C(A, B)> f) {
     return {f(pairA.first, pairB.first), f(pairA.second, pairB.second)};
 }
 
 template <typename A, typename B>
-MonoPair<std::pair<A, B>> zip(MonoPair<A> pairA, MonoPair<B> pairB) {
+MonoPair<std::pair<A, B>> zip(const MonoPair<A> &pairA,
+                              const MonoPair<B> &pairB) {
     return zipWith<A, B, std::pair<A, B>>(
         pairA, pairB,
         [](A a, B b) -> std::pair<A, B> { return std::make_pair(a, b); });
 }
 
 template <typename A>
-void appendTo(std::vector<A> &to, MonoPair<std::vector<A>> pair) {
+void appendTo(std::vector<A> &to, const MonoPair<std::vector<A>> &pair) {
     to.insert(to.end(), pair.first.begin(), pair.first.end());
     to.insert(to.end(), pair.second.begin(), pair.second.end());
 }
@@ -130,6 +156,6 @@ bool operator<(const MonoPair<T> &lhs, const MonoPair<T> &rhs) {
 }
 
 template <typename T>
-bool operator==(const MonoPair<T> lhs, const MonoPair<T> &rhs) {
+bool operator==(const MonoPair<T> &lhs, const MonoPair<T> &rhs) {
     return lhs.first == rhs.first && lhs.second == rhs.second;
 }
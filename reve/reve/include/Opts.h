@@ -35,6 +35,13 @@ class PreprocessOpts {
     bool ShowCFG;
     bool ShowMarkedCFG;
     bool InferMarks;
+    // Inferred marks are only dropped if at most this many paths start at
+    // each of the remaining marks, 0 keeps all of them, see
+    // InferMarksAnalysis
+    unsigned InferredPathLimit = 0;
+    // Split allocas of structs and arrays that don’t escape and are only
+    // indexed by constants into scalars, so they don’t need the stack array
+    bool ScalarizeAllocas = false;
     PreprocessOpts(bool showCFG, bool showMarkedCFG, bool inferMarks)
         : ShowCFG(showCFG), ShowMarkedCFG(showMarkedCFG),
           InferMarks(inferMarks) {}
@@ -46,20 +53,45 @@ enum class StackOpt { Enabled, Disabled };
 
 enum class GlobalConstantsOpt { Enabled, Disabled };
 
-enum class FunctionEncoding { OnlyRecursive, Iterative };
+// Automatic picks one of the other two for the main functions based on an
+// estimate of the size of the clauses, see chooseFunctionEncoding
+enum class FunctionEncoding { OnlyRecursive, Iterative, Automatic };
 
-enum class ByteHeapOpt { Enabled, Disabled };
+// Automatic uses one entry per scalar (Disabled) if all accesses to memory are
+// aligned accesses of whole scalars, see hasWordAlignedAccesses
+enum class ByteHeapOpt { Enabled, Disabled, Automatic };
 enum class SMTFormat { Z3, SMTHorn };
 enum class PerfectSynchronization { Enabled, Disabled };
+// Generation keeps the order in which the clauses have been generated,
+// Topological groups them by predicate, see orderClauses
+enum class ClauseOrder { Generation, Topological };
 
-/// Singleton for the options used for SMT generation to avoid having to pass
-/// around the config object
+/// Options used for SMT generation. To avoid having to pass around the config
+/// object they are accessed via getInstance() which returns the options of the
+/// current thread. By default all threads share one global instance. A
+/// separate set of options can be installed for the current thread using
+/// SMTGenerationOpts::Scope which allows running multiple independent
+/// verifications in one process.
 class SMTGenerationOpts {
   public:
-    static SMTGenerationOpts &getInstance() {
-        static SMTGenerationOpts instance;
-        return instance;
-    }
+    SMTGenerationOpts() = default;
+    SMTGenerationOpts(const SMTGenerationOpts &) = default;
+    SMTGenerationOpts &operator=(const SMTGenerationOpts &) = default;
+
+    static SMTGenerationOpts &getInstance();
+
+    /// Makes 'opts' the options returned by getInstance() on the current
+    /// thread for the lifetime of the scope. Scopes can be nested.
+    class Scope {
+      public:
+        explicit Scope(SMTGenerationOpts &opts);
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+
+      private:
+        SMTGenerationOpts *previous;
+    };
     // Convenience method to make sure you don’t forget to set parameters
     static void initialize(
         MonoPair<llvm::Function *> mainFunctions, HeapOpt heap, StackOpt stack,
@@ -105,6 +137,10 @@ class SMTGenerationOpts {
              std::map<Mark, FunctionInvariant<smt::SharedSMTRef>>>
         FunctionalRelationalInvariants;
     std::set<MonoPair<const llvm::Function *>> AssumeEquivalent;
+    // Coupled extern functions whose calls are not (yet) abstracted as
+    // equivalent, i.e. their results are unconstrained, see
+    // lazyExternAbstractions
+    std::set<MonoPair<const llvm::Function *>> UnconstrainedExterns;
     // The order in the pairs is normalized so that the first function is always
     // in the first module.
     std::set<MonoPair<llvm::Function *>> CoupledFunctions;
@@ -114,11 +150,39 @@ class SMTGenerationOpts {
     // This is just a reversed version of the above map separated by module
     MonoPair<std::map<int, const llvm::Function *>> ReversedFunctionNumerals = {
         {}, {}};
-
-  private:
-    SMTGenerationOpts() = default;
-    SMTGenerationOpts(SMTGenerationOpts const &) = delete;
-    void operator=(SMTGenerationOpts const &) = delete;
+    // Number of threads used for generating the clauses of independent
+    // functions and for preprocessing the two modules if they use separate
+    // contexts. This does not affect the generated SMT.
+    unsigned Jobs = 1;
+    // Encode all paths between two marks in a single clause instead of one
+    // clause per path, see MergedPaths.h
+    bool MergePaths = false;
+    // Encode forbidden paths using an auxiliary predicate per start mark
+    // instead of one clause per pair of paths, see addLinearForbiddenPaths
+    bool LinearForbiddenPaths = false;
+    // Define the transition relation of each path once and apply it in the
+    // synchronized, forbidden and stutter clauses, see PathRelations.h
+    bool SharedPathRelations = false;
+    // Split the heap into one array per region of memory that is only
+    // accessed via pointers which can’t alias the ones of the other regions,
+    // see HeapRegions.h
+    bool PartitionHeap = false;
+    // The number of arrays each heap is split into. Pointers that are not in
+    // HeapRegions point to region 0 which uses the unsuffixed heap name.
+    unsigned HeapRegionCount = 1;
+    std::map<const llvm::Value *, unsigned> HeapRegions;
+    // Pass only one of the variables that are provably equal at a mark to the
+    // invariants of the main functions, see mainInvariantArguments
+    bool ReduceInvariantArguments = false;
+    // The classes of provably equal variables of the main functions, see
+    // findEqualVariables. Set during SMT generation.
+    std::map<std::string, unsigned> EqualVariables;
+    // The encoding of the main functions, which is OnlyRecursive with the
+    // automatic choice resolved. Set during SMT generation.
+    FunctionEncoding MainEncoding = FunctionEncoding::Iterative;
+    // The opcodes of the floating point operations that are encoded as calls
+    // of uninterpreted functions, see FloatAbstraction.h
+    std::set<unsigned> AbstractFloatOps;
 };
 
 /// Options used for reading the C source and compiling it to llvm modules
@@ -127,6 +191,19 @@ class InputOpts {
     std::vector<std::string> Includes;
     std::string ResourceDir;
     MonoPair<std::string> FileNames;
+    // Directory used for caching compiled modules, caching is disabled if this
+    // is empty
+    std::string CacheDir;
+    // Precompiled header that is included before both inputs, e.g. for the
+    // headers in examples/headers
+    std::string PrecompiledHeader;
+    // If this is not empty, code is only generated for these functions and
+    // the declarations they refer to, see RestrictedCodeGenAction
+    std::set<std::string> CodeGenRoots;
+    // If this is set the inputs are not read from disk, the file names are
+    // only used to refer to them (e.g. in diagnostics), see Llreve.h
+    bool InMemory = false;
+    MonoPair<std::string> Contents = {"", ""};
     InputOpts(std::vector<std::string> includes, std::string resourceDir,
               std::string file1, std::string file2)
         : Includes(includes), ResourceDir(resourceDir),
@@ -141,6 +218,25 @@ class SerializeOpts {
     bool MergeImplications;
     bool Pretty;
     bool InlineLets;
+    // Number of threads used to prepare and print the clauses. The output
+    // doesn’t depend on it.
+    unsigned Jobs = 1;
+    // Bind subterms that are printed more than once to lets, see
+    // bindSharedSubterms
+    bool ShareSubterms = false;
+    // Fold constants and drop clauses that are trivially true, see simplify
+    bool Simplify = false;
+    // Write the output file gzip compressed, see GzipFileBuffer
+    bool Compress = false;
+    // Only write what the format of the CHC competition allows: the HORN
+    // logic, declarations of predicates, clauses with merged implications
+    // and without lets, and (check-sat) followed by (exit). Definitions and
+    // uninterpreted functions are errors. Only affects the SMT-HORN format.
+    bool ChcComp = false;
+    // The order of the declarations and clauses, solvers number the
+    // predicates by their declarations and their heuristics depend on it.
+    // Only affects the SMT-HORN format.
+    ClauseOrder Order = ClauseOrder::Generation;
     SerializeOpts(std::string outputFileName, bool DontInstantiate,
                   bool MergeImplications, bool Pretty, bool InlineLets)
         : OutputFileName(outputFileName), DontInstantiate(DontInstantiate),
@@ -178,6 +274,8 @@ auto getInlineOpts(const char *file1, const char *file2)
 // Search for options that can only be specified as special comments inside the
 // programs
 auto getFileOptions(MonoPair<std::string> fileNames) -> FileOptions;
+// Like getFileOptions but searches the given sources instead of reading them
+auto getFileOptionsFromSources(MonoPair<std::string> sources) -> FileOptions;
 
 auto searchCustomRelations(MonoPair<std::string> fileNames, bool &additionalIn)
     -> MonoPair<smt::SharedSMTRef>;
@@ -11,23 +11,42 @@
 #pragma once
 
 #include "MarkAnalysis.h"
+#include "MarkMap.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Instructions.h"
+
+#include <memory>
+
 namespace smt {
 class SMTExpr;
 }
 
+// The values an integer variable can still have on a path
+using ValueRanges = llvm::DenseMap<const llvm::Value *, llvm::ConstantRange>;
+
 class Condition {
   public:
     virtual std::unique_ptr<smt::SMTExpr> toSmt() const = 0;
+    // Narrows 'ranges' to the values for which the condition holds. Returns
+    // false if it is known that the condition can’t hold. This only does cheap
+    // checks, true doesn’t imply that the condition is satisfiable.
+    virtual auto restrict(ValueRanges &ranges) const -> bool = 0;
     virtual ~Condition();
 };
 
+// A path takes the edge to 'Block' if 'Cond' holds, nullptr for unconditional
+// branches. The condition is owned by the ConditionTable of the PathMap
+// containing the path, the edges only refer to it so that paths are plain
+// arrays that can be copied cheaply.
 class Edge {
   public:
-    std::shared_ptr<Condition> Cond;
+    const Condition *Cond;
     llvm::BasicBlock *Block;
 
-    Edge(std::shared_ptr<Condition> Cond, llvm::BasicBlock *Block)
-        : Cond(std::move(Cond)), Block(std::move(Block)) {}
+    Edge(const Condition *Cond, llvm::BasicBlock *Block)
+        : Cond(Cond), Block(Block) {}
 };
 
 class Path {
@@ -45,6 +64,7 @@ class BooleanCondition : public Condition {
     const llvm::Value *Cond;
     bool True;
     std::unique_ptr<smt::SMTExpr> toSmt() const override;
+    auto restrict(ValueRanges &ranges) const -> bool override;
 };
 
 class SwitchCondition : public Condition {
@@ -54,15 +74,40 @@ class SwitchCondition : public Condition {
     const llvm::Value *const Cond;
     llvm::APInt Val;
     std::unique_ptr<smt::SMTExpr> toSmt() const override;
+    auto restrict(ValueRanges &ranges) const -> bool override;
 };
 
+// None of the cases of the switch matches
 class SwitchDefault : public Condition {
   public:
-    SwitchDefault(const llvm::Value *Cond, std::vector<llvm::APInt> Vals)
-        : Cond(std::move(Cond)), Vals(std::move(Vals)) {}
+    explicit SwitchDefault(const llvm::SwitchInst *Switch)
+        : Cond(Switch->getCondition()), Switch(Switch) {}
     const llvm::Value *const Cond;
-    const std::vector<llvm::APInt> Vals;
+    const llvm::SwitchInst *const Switch;
     std::unique_ptr<smt::SMTExpr> toSmt() const override;
+    auto restrict(ValueRanges &ranges) const -> bool override;
+};
+
+// Owns the conditions of the paths in a PathMap. Every successor of a
+// terminator gets one condition which is shared by all paths taking that
+// edge, so the number of conditions is linear in the size of the CFG instead
+// of the number of paths.
+class ConditionTable {
+  public:
+    // The condition under which 'term' jumps to its successor 'index'
+    auto successorCondition(const llvm::Instruction *term, unsigned index)
+        -> const Condition *;
+    // Conditions created afterwards aren’t shared with earlier ones. This is
+    // necessary when blocks have been changed since a new terminator can end
+    // up at the address of a deleted one. The earlier conditions are kept
+    // since paths may still refer to them.
+    auto startGeneration() -> void { Interned.clear(); }
+
+  private:
+    std::vector<std::unique_ptr<Condition>> Conditions;
+    std::map<std::pair<const llvm::Instruction *, unsigned>,
+             const Condition *>
+        Interned;
 };
 
 // I really suck at finding nice names
@@ -70,22 +115,34 @@ using Path_ = std::vector<Edge>;
 using Paths_ = std::vector<Path_>;
 using Paths = std::vector<Path>;
 
-// This just wraps an std::map specialized to the appropriate types. The only
+// This just wraps a MarkMap specialized to the appropriate types. The only
 // reason why this is a struct instead of a type is to avoid ADL kicking in when
 // instantiating this pass
 struct PathMap {
   private:
-    std::map<Mark, std::map<Mark, Paths>> value;
+    MarkMap<MarkMap<Paths>> value;
+    // Shared by copies of the map
+    std::shared_ptr<ConditionTable> conditionTable;
 
   public:
+    PathMap() : conditionTable(std::make_shared<ConditionTable>()) {}
+    // An empty map for a subset of the paths of 'other', the conditions of
+    // these paths are owned by the table of 'other'
+    static auto sharingConditions(const PathMap &other) -> PathMap {
+        PathMap result;
+        result.conditionTable = other.conditionTable;
+        return result;
+    }
+    ConditionTable &conditions() const { return *conditionTable; }
     auto begin() { return value.begin(); }
     auto end() { return value.end(); }
     auto begin() const { return value.begin(); }
     auto end() const { return value.end(); }
-    std::map<Mark, Paths> &at(Mark mark) { return value.at(mark); }
-    const std::map<Mark, Paths> &at(Mark mark) const { return value.at(mark); }
+    MarkMap<Paths> &at(Mark mark) { return value.at(mark); }
+    const MarkMap<Paths> &at(Mark mark) const { return value.at(mark); }
     auto find(Mark mark) { return value.find(mark); }
     auto find(Mark mark) const { return value.find(mark); }
+    auto erase(Mark mark) { return value.erase(mark); }
     auto &operator[](Mark mark) { return value[mark]; }
 };
 
@@ -103,17 +160,37 @@ class PathAnalysis : public llvm::AnalysisInfoMixin<PathAnalysis> {
     static llvm::AnalysisKey Key;
 };
 
-auto lastBlock(Path Path) -> llvm::BasicBlock *;
+auto lastBlock(const Path &path) -> llvm::BasicBlock *;
+// False if the conditions on the path contradict each other, e.g. because the
+// same value is compared with constants in incompatible ways. Since a path
+// never evaluates the terminator of a block twice, all occurrences of a value
+// in its conditions refer to the same dynamic value.
+auto isFeasible(const Path &path) -> bool;
+
+auto findPaths(const BidirBlockMarkMap &markedBlocks) -> PathMap;
+// Finds the paths starting at 'marks' again after the blocks on them have been
+// changed, the paths starting at other marks are kept
+void updatePaths(PathMap &pathMap, const BidirBlockMarkMap &markedBlocks,
+                 const std::set<Mark> &marks);
 
-auto findPaths(BidirBlockMarkMap markedBlocks) -> PathMap;
+// Memoizes the paths from an unmarked block to the next marked blocks. These
+// don’t depend on where the path started so this avoids enumerating the same
+// suffixes once for every route leading to a block.
+using SuffixMap = std::map<const llvm::BasicBlock *, Paths_>;
 
 auto findPathsStartingAt(Mark For, llvm::BasicBlock *BB,
-                         BidirBlockMarkMap MarkedBlocks)
-    -> std::map<Mark, Paths>;
+                         const BidirBlockMarkMap &MarkedBlocks,
+                         SuffixMap &Suffixes, ConditionTable &Conditions)
+    -> MarkMap<Paths>;
 
-auto traverse(llvm::BasicBlock *BB, BidirBlockMarkMap MarkedBlocks, bool First,
-              std::set<const llvm::BasicBlock *> Visited) -> Paths_;
+// Visited contains the blocks on the path to BB and is used to detect cycles
+// without marks
+auto traverse(llvm::BasicBlock *BB, const BidirBlockMarkMap &MarkedBlocks,
+              bool First, std::set<const llvm::BasicBlock *> &Visited,
+              SuffixMap &Suffixes, ConditionTable &Conditions) -> Paths_;
 
-auto isMarked(llvm::BasicBlock &BB, BidirBlockMarkMap MarkedBlocks) -> bool;
+auto isMarked(llvm::BasicBlock &BB, const BidirBlockMarkMap &MarkedBlocks)
+    -> bool;
 
-auto isReturn(llvm::BasicBlock &BB, BidirBlockMarkMap MarkedBlocks) -> bool;
+auto isReturn(llvm::BasicBlock &BB, const BidirBlockMarkMap &MarkedBlocks)
+    -> bool;
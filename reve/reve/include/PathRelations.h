@@ -0,0 +1,85 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "PathAnalysis.h"
+#include "Program.h"
+#include "SMT.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// A path of one program occurs in a synchronized clause for every path of the
+// other program with the same marks, in the forbidden clauses and in the
+// stutter clause of its loop. Instead of repeating its assignments in each of
+// them, its transition relation is defined once as
+//
+//   (define-fun PATH_f^f_1_2_0 ((i$1_0_old Int) ... (i$1_0_new Int) ...)
+//     Bool (and cond (let ((i$1_0 ...)) (and (= i$1_0_new i$1_0) ...))))
+//
+// and the clauses quantify the values at the end of the paths and apply the
+// relations to them, so the size of the clauses is linear in the number of
+// paths instead of the number of pairs of paths.
+//
+// Only paths between two marks (i.e. not ending at the exit) without calls are
+// factored out. Calls need to be matched with the calls of the other program
+// and the result of a function is not one of the free variables at the exit.
+// Paths on which the heap or the stack is live are not factored out either
+// since equalities of arrays are instantiated using quantifiers.
+
+// While a PathRelations is alive, pathRelation defines the relations of the
+// paths on the current thread. The definitions have to be added to the
+// declarations of the function.
+class PathRelations {
+  public:
+    explicit PathRelations(std::string funName);
+    PathRelations(const PathRelations &) = delete;
+    PathRelations &operator=(const PathRelations &) = delete;
+    ~PathRelations();
+
+    // The innermost instance of the current thread or nullptr
+    static auto current() -> PathRelations *;
+    // The name of the relation of the path, defining it on the first use.
+    // Empty if the path contains calls.
+    auto relationName(const Path &path, Program prog, Mark startMark,
+                      Mark endMark,
+                      const std::vector<smt::SortedVar> &startVars,
+                      const std::vector<smt::SortedVar> &endVars)
+        -> std::string;
+    // The definitions in the order in which they have been created
+    auto takeDefinitions() -> std::vector<smt::SharedSMTRef>;
+
+  private:
+    using Key = std::tuple<
+        Program, const llvm::BasicBlock *,
+        std::vector<std::pair<const Condition *, const llvm::BasicBlock *>>,
+        std::vector<std::string>, std::vector<std::string>>;
+    std::string funName;
+    std::map<Key, std::string> names;
+    std::vector<smt::SharedSMTRef> definitions;
+    PathRelations *previous;
+};
+
+// If a PathRelations is alive and the path can be factored out, returns the
+// application of its relation to the values at the start (suffixed by _old)
+// and at the end (unsuffixed) of the path. Otherwise returns nullptr and the
+// path has to be encoded by its assignments.
+auto pathRelation(const Path &path, Program prog, Mark startMark, Mark endMark,
+                  const std::vector<smt::SortedVar> &startVars,
+                  const std::vector<smt::SortedVar> &endVars)
+    -> smt::SharedSMTRef;
+
+// Quantifies the values at the end of the paths and assumes the relations
+auto assumePathRelations(std::vector<smt::SharedSMTRef> relations,
+                         const std::vector<smt::SortedVar> &endVars,
+                         smt::SharedSMTRef clause) -> smt::SharedSMTRef;
@@ -0,0 +1,54 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Serialize.h"
+#include "SolverBackends.h"
+
+#include <string>
+#include <vector>
+
+// An external solver of the registry (see SolverBackends.h) that is run on a
+// file containing the query
+struct SolverEngine {
+    const SolverBackend *Backend;
+    // Time limit in seconds, 0 means no limit
+    unsigned Timeout;
+};
+
+struct PortfolioResult {
+    SolverResult Result;
+    // The engine that produced the result, empty if no engine produced a
+    // definitive answer
+    std::string Engine;
+    // The output of the engine following a sat result (usually the model)
+    std::string Model;
+};
+
+// Eldarica, z3 using spacer and z3 using duality
+auto defaultPortfolio(unsigned eldaricaTimeout, unsigned spacerTimeout,
+                      unsigned dualityTimeout) -> std::vector<SolverEngine>;
+
+// The format the query has to be written in for all engines to read it. The
+// CHC-COMP format is also accepted by the solvers that read SMT-HORN.
+auto portfolioFormat(const std::vector<SolverEngine> &engines)
+    -> BackendFormat;
+
+// Creates a pipe whose ends are closed in the child processes that are
+// started concurrently by other threads. Returns false if it can't be created.
+// Not available on Windows.
+auto closeOnExecPipe(int fds[2]) -> bool;
+
+// Run all engines in parallel on the given file. The first definitive answer
+// (sat or unsat) is returned and the remaining engines are killed. Engines
+// that exceed their time limit are killed and count as unknown.
+auto runPortfolio(const std::vector<SolverEngine> &engines,
+                  const std::string &smtFileName) -> PortfolioResult;
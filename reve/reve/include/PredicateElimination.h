@@ -0,0 +1,45 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include <string>
+#include <vector>
+
+struct EliminatedPredicates {
+    // The Horn system without the eliminated predicates
+    std::vector<smt::SharedSMTRef> Clauses;
+    // A definition of every eliminated predicate in terms of the remaining
+    // ones, ordered such that each definition only uses predicates defined
+    // by the model of the solver or by an earlier definition. Together with
+    // a model of 'Clauses' they are a model of the original system.
+    std::vector<smt::SharedSMTRef> Definitions;
+};
+
+// Resolves away predicates that are defined by a single clause and applied
+// exactly once in the premise of another clause, e.g. the marks along
+// straight-line coupled calls or the INIT predicates of -init-pred. For the
+// defining clause
+//
+//   (forall (x) (=> (B x) (P (t x))))
+//
+// the application (P s) in the using clause is replaced by
+// (and (B x') (= s (t x'))), where x' are the renamed variables of the
+// defining clause which are quantified by the using clause. The result is
+// satisfiable iff the original system is.
+//
+// Predicates with array arguments are kept, as are predicates whose use is
+// not a conjunct of a premise (e.g. below a negation) and those for which the
+// resolved clause would have more than 'maxClauseSize' nodes. Only the
+// SMT-HORN format is supported.
+auto eliminatePredicates(const std::vector<smt::SharedSMTRef> &smtExprs,
+                         size_t maxClauseSize) -> EliminatedPredicates;
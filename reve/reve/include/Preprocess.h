@@ -24,8 +24,24 @@ struct PassAnalysisResults {
     llvm::Value *returnInstruction;
 };
 
+// Functions that are not called transitively from the main functions are
+// turned into declarations first. Of lazily loaded modules only the remaining
+// functions are materialized.
 AnalysisResultsMap preprocessModules(MonoPair<llvm::Module &> modules,
                                      llreve::opts::PreprocessOpts opts);
+// Preprocess the modules using the given options instead of the options of the
+// current thread. Memory options that are detected during preprocessing are
+// stored in 'smtOpts'.
+AnalysisResultsMap preprocessModules(MonoPair<llvm::Module &> modules,
+                                     llreve::opts::PreprocessOpts opts,
+                                     llreve::opts::SMTGenerationOpts &smtOpts);
+// Preprocess only one of the programs. Merging the results for both programs
+// and calling detectMemoryOptions on the preprocessed pair is equivalent to
+// preprocessModules, so the results of a program that is compared against
+// several others can be reused.
+AnalysisResultsMap preprocessModule(llvm::Module &module, Program prog,
+                                    llreve::opts::PreprocessOpts opts);
+void detectMemoryOptions(MonoPair<const llvm::Module &> modules);
 void runFunctionPasses(
     llvm::Module &module, llreve::opts::PreprocessOpts opts,
     std::map<const llvm::Function *, PassAnalysisResults> &passResults,
@@ -43,4 +59,11 @@ auto runAnalyses(
     -> AnalysisResults;
 
 auto doesAccessHeap(const llvm::Module &mod) -> bool;
+// Whether memory is only accessed as whole, naturally aligned integers or
+// doubles through pointers of the type of the accessed object. No pointer is
+// cast to a pointer to a type of a different size (except for the arguments
+// of memcpy and memset) or converted to an integer, so no cell can be
+// accessed with different widths and addressing each scalar by its index
+// instead of its byte offset preserves the semantics.
+auto hasWordAlignedAccesses(const llvm::Module &mod) -> bool;
 auto doesAccessStack(const llvm::Module &mod) -> bool;
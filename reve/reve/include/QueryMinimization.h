@@ -0,0 +1,45 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+#include <functional>
+#include <vector>
+
+// Whether a reduced query still shows the behaviour that is being minimized,
+// e.g. that a solver takes longer than some time limit. It is called from
+// several threads at the same time.
+using QueryProperty =
+    std::function<bool(const std::vector<smt::SharedSMTRef> &)>;
+
+struct MinimizedQuery {
+    std::vector<smt::SharedSMTRef> Query;
+    // The number of reductions that were tested
+    unsigned Tests = 0;
+};
+
+// Delta debugging (ddmin) of a Horn system in the SMT-HORN format. First the
+// clauses (the assert commands) are minimized, then the arguments of the
+// predicates, i.e. the declared functions returning Bool, which are removed
+// from the declaration and all applications. Everything else is kept. The
+// query itself is assumed to have the property.
+//
+// The candidates of a round are tested in parallel using up to 'jobs'
+// threads and the first one in order that has the property is taken, so for
+// a deterministic property the result does not depend on 'jobs'.
+auto minimizeQuery(const std::vector<smt::SharedSMTRef> &query,
+                   const QueryProperty &property, unsigned jobs)
+    -> MinimizedQuery;
+
+// The names of the predicates declared by the query in order
+auto declaredPredicates(const std::vector<smt::SharedSMTRef> &query)
+    -> std::vector<std::string>;
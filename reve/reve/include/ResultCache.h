@@ -0,0 +1,24 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Serialize.h"
+
+#include <string>
+
+// A cache of solver results on disk. Entries are keyed by 'queryHash' and
+// store the result and the model. Only definitive results are cached.
+
+// Returns true and sets 'output' if there is an entry for the hash
+auto lookupCachedResult(const std::string &cacheDir, const std::string &hash,
+                        SolverOutput &output) -> bool;
+auto storeCachedResult(const std::string &cacheDir, const std::string &hash,
+                       const SolverOutput &output) -> void;
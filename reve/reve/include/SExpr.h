@@ -10,6 +10,9 @@
 
 #pragma once
 
+#include "Arena.h"
+#include "Statistics.h"
+
 #include <algorithm>
 #include <memory>
 #include <ostream>
@@ -23,21 +26,85 @@ namespace sexpr {
 class SExpr;
 using SExprRef = std::unique_ptr<const sexpr::SExpr>;
 
+// Collects the output in a fixed size buffer and only passes complete chunks
+// to the stream. This is a lot faster than writing every token and every
+// indentation to the stream on its own.
+class OutputBuffer {
+  public:
+    explicit OutputBuffer(std::ostream &os) : os(os) {}
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+    ~OutputBuffer() { flush(); }
+    void write(llvm::StringRef str) {
+        if (str.size() > Capacity - size) {
+            writeSlow(str);
+            return;
+        }
+        std::copy(str.begin(), str.end(), buffer + size);
+        size += str.size();
+    }
+    void put(char c) {
+        if (size == Capacity) {
+            flush();
+        }
+        buffer[size++] = c;
+    }
+    // Write a newline followed by 'indent' spaces
+    void newline(size_t indent);
+    void flush();
+
+  private:
+    static const size_t Capacity = 1 << 14;
+    std::ostream &os;
+    size_t size = 0;
+    char buffer[Capacity];
+    void writeSlow(llvm::StringRef str);
+};
+
+// An element of the output that is still to be written: the separator in
+// front of it followed by the expression or, if there is none, the closing
+// parenthesis of the enclosing application or list
+struct PendingWrite {
+    enum class Separator { None, Space, Newline };
+    Separator separator;
+    // The indentation of the line started by a newline separator
+    size_t newlineIndent;
+    const SExpr *expr;
+    size_t indent;
+};
+using WriteStack = std::vector<PendingWrite>;
+
 class SExpr {
   public:
-    virtual void serialize(std::ostream &os, size_t indent,
-                           bool pretty) const = 0;
+    // Only sets up the buffer and the stack of pending writes, the actual
+    // work is done by 'write'
+    void serialize(std::ostream &os, size_t indent, bool pretty) const;
+    // Writes the beginning of the expression and pushes the remaining
+    // elements in reverse order onto 'pending'. The children are thereby
+    // written without recursion, which would overflow the stack for the
+    // long chains of lets and stores that occur in practice.
+    virtual void write(OutputBuffer &out, size_t indent, bool pretty,
+                       WriteStack &pending) const = 0;
     virtual ~SExpr() = default;
     SExpr() = default;
     SExpr(const SExpr &sExpr) = default;
+    // Nodes are placed in the active arena if there is one, see Arena.h
+    static void *operator new(size_t size) {
+        stats::nodeAllocated(stats::NodeKind::SExpr);
+        return arenaAllocate(size);
+    }
+    static void operator delete(void *ptr) {
+        stats::nodeFreed(stats::NodeKind::SExpr);
+        arenaDeallocate(ptr);
+    }
 };
 
 class Value : public SExpr {
   public:
     std::string val;
     explicit Value(std::string val) : val(std::move(val)) {}
-    void serialize(std::ostream &os, size_t /*unused*/,
-                   bool /* unused */) const override;
+    void write(OutputBuffer &out, size_t /*unused*/, bool /* unused */,
+               WriteStack & /* unused */) const override;
 };
 
 using SExprVec = llvm::SmallVector<SExprRef, 3>;
@@ -45,17 +112,19 @@ class Apply : public SExpr {
   public:
     std::string fun;
     SExprVec args;
-    const static llvm::StringSet<> atomicOps;
-    const static llvm::StringSet<> forceIndentOps;
     Apply(std::string fun, SExprVec args)
         : fun(std::move(fun)), args(std::move(args)) {}
-    void serialize(std::ostream &os, size_t indent, bool pretty) const override;
+    ~Apply() override;
+    void write(OutputBuffer &out, size_t indent, bool pretty,
+               WriteStack &pending) const override;
 };
 
 class List : public SExpr {
   public:
     explicit List(SExprVec elements) : elements(std::move(elements)) {}
-    void serialize(std::ostream &os, size_t indent, bool pretty) const override;
+    ~List() override;
+    void write(OutputBuffer &out, size_t indent, bool pretty,
+               WriteStack &pending) const override;
     std::string fun;
     SExprVec elements;
 };
@@ -63,8 +132,8 @@ class List : public SExpr {
 class Comment : public SExpr {
   public:
     explicit Comment(std::string val) : val(std::move(val)) {}
-    void serialize(std::ostream &os, size_t /*unused*/,
-                   bool /* unused */) const override;
+    void write(OutputBuffer &out, size_t /*unused*/, bool /* unused */,
+               WriteStack & /* unused */) const override;
     std::string val;
 };
 
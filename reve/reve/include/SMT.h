@@ -10,7 +10,11 @@
 
 #pragma once
 
+#include "Arena.h"
+#include "Memory.h"
 #include "SExpr.h"
+#include "Statistics.h"
+#include "Symbol.h"
 #include "Type.h"
 
 #include "llvm/ADT/APInt.h"
@@ -68,6 +72,30 @@ class FunDef;
 class Comment;
 class VarDecl;
 
+// The concrete type of an expression, see SMTExpr::getTag
+enum class ExprTag {
+    SetLogic,
+    Assert,
+    TypedVariable,
+    Forall,
+    CheckSat,
+    GetModel,
+    Let,
+    ConstantFP,
+    ConstantInt,
+    ConstantBool,
+    ConstantString,
+    Op,
+    FPCmp,
+    BinaryFPOperator,
+    TypeCast,
+    Query,
+    FunDecl,
+    FunDef,
+    Comment,
+    VarDecl
+};
+
 struct SMTVisitor;
 class SMTExpr : public std::enable_shared_from_this<SMTExpr> {
   public:
@@ -75,15 +103,39 @@ class SMTExpr : public std::enable_shared_from_this<SMTExpr> {
     SMTExpr &operator=(SMTExpr &) = delete;
     SMTExpr() = default;
     virtual ~SMTExpr() = default;
+    // Nodes are placed in the active arena if there is one, see Arena.h
+    static void *operator new(size_t size) {
+        stats::nodeAllocated(stats::NodeKind::SMT);
+        return arenaAllocate(size);
+    }
+    static void operator delete(void *ptr) {
+        stats::nodeFreed(stats::NodeKind::SMT);
+        arenaDeallocate(ptr);
+    }
     virtual std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const = 0;
+    // Allows dispatching on the type of an expression without copying it,
+    // which the visitor does
+    virtual ExprTag getTag() const = 0;
     virtual sexpr::SExprRef toSExpr() const = 0;
+    // Write the expression to the stream without building an SExpr tree
+    // first. The output is identical to the non pretty printed SExpr. The
+    // indent is needed because lists are always split into multiple lines.
+    // The children are written using an explicit stack, so deeply nested
+    // expressions don’t overflow the stack.
+    void serialize(std::ostream &os, size_t indent) const;
     virtual std::vector<SharedSMTRef> splitConjunctions();
+    // Turns nested implications into a single implication whose premise is
+    // the conjunction of all premises. 'conditions' are the premises
+    // collected so far, it is restored before returning. Only the nodes on
+    // the path to the conclusion are rebuilt.
     // TODO implement using visitor
     virtual SharedSMTRef
-    mergeImplications(std::vector<SharedSMTRef> conditions);
+    mergeImplications(std::vector<SharedSMTRef> &conditions);
     virtual std::unique_ptr<const HeapInfo> heapInfo() const;
-    virtual SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments);
+    // Replaces the variables bound by lets by their definitions and the free
+    // variables in 'assignments' by their values. Like 'serialize' this
+    // doesn’t recurse.
+    SharedSMTRef inlineLets(std::map<std::string, SharedSMTRef> assignments);
     virtual void toZ3(z3::context &cxt, z3::solver &solver,
                       llvm::StringMap<z3::expr> &nameMap,
                       llvm::StringMap<Z3DefineFun> &defineFunMap) const;
@@ -93,17 +145,26 @@ class SMTExpr : public std::enable_shared_from_this<SMTExpr> {
     // Needed because we compile without rtti and thereby can’t use a dynamic
     // cast to check the type
     virtual bool isConstantFalse() const { return false; }
+    // For the same reason, these return the expression itself if it is of the
+    // respective type and nullptr otherwise
+    virtual const Assert *asAssert() const { return nullptr; }
+    virtual const Forall *asForall() const { return nullptr; }
+    virtual const Op *asOp() const { return nullptr; }
 };
 
 using SMTRef = std::unique_ptr<SMTExpr>;
-auto makeAssignment(std::string name, std::unique_ptr<SMTExpr> val)
+auto makeAssignment(std::string name, SharedSMTRef val)
     -> std::unique_ptr<Assignment>;
 
 class SetLogic : public SMTExpr {
   public:
     explicit SetLogic(std::string logic) : logic(std::move(logic)) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::SetLogic; }
     sexpr::SExprRef toSExpr() const override;
+    void toZ3(z3::context &cxt, z3::solver &solver,
+              llvm::StringMap<z3::expr> &nameMap,
+              llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
     std::string logic;
 };
 
@@ -112,12 +173,12 @@ class Assert : public SMTExpr {
     std::shared_ptr<SMTExpr> expr;
     explicit Assert(std::shared_ptr<SMTExpr> expr) : expr(std::move(expr)) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::Assert; }
+    const Assert *asAssert() const override { return this; }
     sexpr::SExprRef toSExpr() const override;
     SharedSMTRef
-    mergeImplications(std::vector<SharedSMTRef> conditions) override;
+    mergeImplications(std::vector<SharedSMTRef> &conditions) override;
     std::vector<SharedSMTRef> splitConjunctions() override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
     void toZ3(z3::context &cxt, z3::solver &solver,
               llvm::StringMap<z3::expr> &nameMap,
               llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
@@ -130,13 +191,26 @@ class TypedVariable : public SMTExpr {
   public:
     std::string name;
     Type type;
+    // Derived from the name when the variable is created, so names should
+    // only be changed using 'rename'
+    VarRole role;
+    // The interned name, also kept up to date by 'rename'
+    Symbol symbol;
     TypedVariable(std::string name, Type type)
-        : name(std::move(name)), type(std::move(type)) {}
+        : name(std::move(name)), type(std::move(type)),
+          role(variableRole(this->name)), symbol(this->name) {}
+    TypedVariable(Symbol name, Type type)
+        : name(name.str()), type(std::move(type)),
+          role(variableRole(this->name)), symbol(name) {}
+    void rename(std::string newName) {
+        name = std::move(newName);
+        role = variableRole(name);
+        symbol = Symbol(name);
+    }
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::TypedVariable; }
     std::unique_ptr<const HeapInfo> heapInfo() const override;
     sexpr::SExprRef toSExpr() const override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
              const llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
@@ -149,6 +223,7 @@ class SortedVar {
     SortedVar(std::string name, Type type)
         : name(std::move(name)), type(std::move(type)) {}
     sexpr::SExprRef toSExpr() const;
+    void serialize(std::ostream &os, size_t indent) const;
 };
 
 inline bool operator<(const SortedVar &lhs, const SortedVar &rhs) {
@@ -181,18 +256,23 @@ class Forall : public SMTExpr {
     std::shared_ptr<SMTExpr> expr;
     Forall(std::vector<SortedVar> vars, std::shared_ptr<SMTExpr> expr)
         : vars(std::move(vars)), expr(std::move(expr)) {}
+    ~Forall() override;
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::Forall; }
+    const Forall *asForall() const override { return this; }
     sexpr::SExprRef toSExpr() const override;
     SharedSMTRef
-    mergeImplications(std::vector<SharedSMTRef> conditions) override;
+    mergeImplications(std::vector<SharedSMTRef> &conditions) override;
     std::vector<SharedSMTRef> splitConjunctions() override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
+    z3::expr
+    toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
+             const llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
 };
 
 class CheckSat : public SMTExpr {
   public:
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::CheckSat; }
     sexpr::SExprRef toSExpr() const override;
     void toZ3(z3::context &cxt, z3::solver &solver,
               llvm::StringMap<z3::expr> &nameMap,
@@ -202,6 +282,7 @@ class CheckSat : public SMTExpr {
 class GetModel : public SMTExpr {
   public:
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::GetModel; }
     sexpr::SExprRef toSExpr() const override;
     void toZ3(z3::context &cxt, z3::solver &solver,
               llvm::StringMap<z3::expr> &nameMap,
@@ -214,13 +295,13 @@ class Let : public SMTExpr {
     std::shared_ptr<SMTExpr> expr;
     Let(AssignmentVec defs, std::shared_ptr<SMTExpr> expr)
         : defs(std::move(defs)), expr(std::move(expr)) {}
+    ~Let() override;
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::Let; }
     sexpr::SExprRef toSExpr() const override;
     SharedSMTRef
-    mergeImplications(std::vector<SharedSMTRef> conditions) override;
+    mergeImplications(std::vector<SharedSMTRef> &conditions) override;
     std::vector<SharedSMTRef> splitConjunctions() override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
              const llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
@@ -233,6 +314,7 @@ class ConstantFP : public SMTExpr {
     llvm::APFloat value;
     explicit ConstantFP(const llvm::APFloat value) : value(value) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::ConstantFP; }
     sexpr::SExprRef toSExpr() const override;
 };
 
@@ -241,6 +323,7 @@ class ConstantInt : public SMTExpr {
     llvm::APInt value;
     explicit ConstantInt(const llvm::APInt value) : value(value) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::ConstantInt; }
     sexpr::SExprRef toSExpr() const override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
@@ -252,6 +335,7 @@ class ConstantBool : public SMTExpr {
     bool value;
     explicit ConstantBool(bool value) : value(value) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::ConstantBool; }
     sexpr::SExprRef toSExpr() const override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
@@ -266,9 +350,8 @@ class ConstantString : public SMTExpr {
     std::string value;
     explicit ConstantString(std::string value) : value(value) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::ConstantString; }
     sexpr::SExprRef toSExpr() const override; //  {
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
              const llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
@@ -280,19 +363,27 @@ class Op : public SMTExpr {
     std::vector<std::shared_ptr<SMTExpr>> args;
     // whether to instantiate arrays for eldarica or not
     bool instantiate;
+    // The interned operator name
+    Symbol opSymbol;
     Op(std::string opName, std::vector<std::shared_ptr<SMTExpr>> args)
-        : opName(std::move(opName)), args(std::move(args)), instantiate(true) {}
+        : opName(std::move(opName)), args(std::move(args)), instantiate(true),
+          opSymbol(this->opName) {}
     Op(std::string opName, std::vector<std::shared_ptr<SMTExpr>> args,
        bool instantiate)
         : opName(std::move(opName)), args(std::move(args)),
-          instantiate(instantiate) {}
+          instantiate(instantiate), opSymbol(this->opName) {}
+    Op(Symbol opName, std::vector<std::shared_ptr<SMTExpr>> args,
+       bool instantiate)
+        : opName(opName.str()), args(std::move(args)),
+          instantiate(instantiate), opSymbol(opName) {}
+    ~Op() override;
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::Op; }
+    const Op *asOp() const override { return this; }
     sexpr::SExprRef toSExpr() const override;
     SharedSMTRef
-    mergeImplications(std::vector<SharedSMTRef> conditions) override;
+    mergeImplications(std::vector<SharedSMTRef> &conditions) override;
     std::vector<SharedSMTRef> splitConjunctions() override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
              const llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
@@ -327,10 +418,10 @@ class FPCmp : public SMTExpr {
     SharedSMTRef op1;
     FPCmp(Predicate op, Type type, SharedSMTRef op0, SharedSMTRef op1)
         : op(op), type(std::move(type)), op0(op0), op1(op1) {}
+    ~FPCmp() override;
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::FPCmp; }
     sexpr::SExprRef toSExpr() const override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
 };
 
 class BinaryFPOperator : public SMTExpr {
@@ -344,10 +435,10 @@ class BinaryFPOperator : public SMTExpr {
                      std::shared_ptr<SMTExpr> op1)
         : op(std::move(op)), type(std::move(type)), op0(std::move(op0)),
           op1(std::move(op1)) {}
+    ~BinaryFPOperator() override;
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::BinaryFPOperator; }
     sexpr::SExprRef toSExpr() const override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
 };
 
 class TypeCast : public SMTExpr {
@@ -361,10 +452,10 @@ class TypeCast : public SMTExpr {
              std::shared_ptr<SMTExpr> operand)
         : op(std::move(op)), sourceType(std::move(sourceType)),
           destType(std::move(destType)), operand(std::move(operand)) {}
+    ~TypeCast() override;
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::TypeCast; }
     sexpr::SExprRef toSExpr() const override;
-    SharedSMTRef
-    inlineLets(std::map<std::string, SharedSMTRef> assignments) override;
     z3::expr
     toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &,
              const llvm::StringMap<Z3DefineFun> &funMap) const override;
@@ -375,7 +466,9 @@ class Query : public SMTExpr {
 
   public:
     Query(std::string queryName) : queryName(std::move(queryName)) {}
+    const std::string &getQueryName() const { return queryName; }
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::Query; }
     sexpr::SExprRef toSExpr() const override;
 };
 
@@ -386,9 +479,12 @@ auto makeSMTRef(std::string arg) -> std::shared_ptr<SMTExpr>;
 
 template <typename... Args>
 auto makeOp(std::string opName, Args... args) -> std::unique_ptr<Op> {
-    std::vector<std::shared_ptr<SMTExpr>> args_ = {
-        makeSMTRef(std::move(args))...};
-    return std::make_unique<Op>(opName, args_);
+    std::vector<std::shared_ptr<SMTExpr>> args_;
+    args_.reserve(sizeof...(Args));
+    // An initializer list would copy every argument, this moves them
+    int expand[] = {0, (args_.push_back(makeSMTRef(std::move(args))), 0)...};
+    (void)expand;
+    return std::make_unique<Op>(std::move(opName), std::move(args_));
 }
 
 auto makeOp(std::string opName, std::vector<std::string> args)
@@ -404,7 +500,13 @@ class FunDecl : public SMTExpr {
         : funName(std::move(funName)), inTypes(std::move(inTypes)),
           outType(std::move(outType)) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::FunDecl; }
     sexpr::SExprRef toSExpr() const override;
+    // Uninterpreted functions are registered in 'defineFunMap' as an
+    // application to fresh variables so they can be used like defined ones
+    void toZ3(z3::context &cxt, z3::solver &solver,
+              llvm::StringMap<z3::expr> &nameMap,
+              llvm::StringMap<Z3DefineFun> &defineFunMap) const override;
 };
 
 class FunDef : public SMTExpr {
@@ -419,6 +521,7 @@ class FunDef : public SMTExpr {
         : funName(std::move(funName)), args(std::move(args)),
           outType(std::move(outType)), body(std::move(body)) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::FunDef; }
     sexpr::SExprRef toSExpr() const override;
     void toZ3(z3::context &cxt, z3::solver &solver,
               llvm::StringMap<z3::expr> &nameMap,
@@ -431,6 +534,7 @@ class Comment : public SMTExpr {
 
     Comment(std::string val) : val(std::move(val)) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::Comment; }
     sexpr::SExprRef toSExpr() const override;
 };
 
@@ -440,6 +544,7 @@ class VarDecl : public SMTExpr {
 
     VarDecl(SortedVar var) : var(std::move(var)) {}
     std::shared_ptr<SMTExpr> accept(SMTVisitor &visitor) const override;
+    ExprTag getTag() const override { return ExprTag::VarDecl; }
     sexpr::SExprRef toSExpr() const override;
     void toZ3(z3::context &cxt, z3::solver &solver,
               llvm::StringMap<z3::expr> &nameMap,
@@ -452,11 +557,25 @@ class VarDecl : public SMTExpr {
 // the final expression that is returned. 'dispatch' and 'reassemble' both
 // operate on copies of the original value since expressions are sometimes
 // shared and modifying directly can create problems in that case.
+//
+// Copying is skipped for nodes the visitor doesn’t handle, these are
+// returned as they are if none of their children changed. We therefore only
+// allocate for the nodes that are handled and the nodes on the path to them.
 struct SMTVisitor {
     // Do not traverse let bindings
     bool ignoreLetBindings = false;
     SMTVisitor() = default;
     SMTVisitor(bool ignoreLetBindings) : ignoreLetBindings(ignoreLetBindings) {}
+    virtual ~SMTVisitor() = default;
+    // Whether 'dispatch' or 'reassemble' are overridden for this type of
+    // node. Visitors that only override some of them should say so to avoid
+    // copying the other nodes.
+    virtual bool handles(ExprTag /* unused */) const { return true; }
+    // The same decision for a particular node, for visitors that only rewrite
+    // some of the nodes of a type
+    virtual bool handlesNode(const SMTExpr &expr) const {
+        return handles(expr.getTag());
+    }
     virtual void dispatch(SetLogic &expr) {}
     virtual void dispatch(Assert &expr) {}
     virtual void dispatch(TypedVariable &expr) {}
@@ -539,12 +658,15 @@ struct SMTVisitor {
     }
 };
 
+// Visit 'expr' without copying the nodes that the visitor doesn’t handle.
+// Unlike expr->accept(visitor) this returns 'expr' itself if nothing changed.
+auto visit(const SharedSMTRef &expr, SMTVisitor &visitor) -> SharedSMTRef;
+
 auto nestLets(SharedSMTRef clause, llvm::ArrayRef<Assignment> defs)
     -> SharedSMTRef;
 
-auto fastNestLets(std::unique_ptr<smt::SMTExpr> clause,
-                  llvm::ArrayRef<Assignment> defs)
-    -> std::unique_ptr<smt::SMTExpr>;
+auto fastNestLets(SharedSMTRef clause, llvm::ArrayRef<Assignment> defs)
+    -> SharedSMTRef;
 
 bool isArray(const Type &type);
 
@@ -552,5 +674,3 @@ std::unique_ptr<SMTExpr> memoryVariable(std::string name);
 std::unique_ptr<TypedVariable> typedVariableFromSortedVar(const SortedVar &var);
 SortedVar sortedVarFromTypedVariable(const TypedVariable &var);
 }
-void setSMTLexerInput(const char *input);
-smt::SharedSMTRef parseSMT(const std::string &input);
@@ -0,0 +1,125 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "HashCons.h"
+#include "SMT.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace smt {
+
+enum class SMTDialect {
+    // Regular SMT-LIB and the muZ extensions (rule, query, declare-rel and
+    // declare-var) as written by serializeSMT
+    SMTLib,
+    // The custom relations in the C sources. Identifiers refer to the
+    // variables at the entry of the functions so they get the suffix "_0"
+    // except for the results and the heaps, numerals and 'Int' are 32 bit.
+    CustomRelation
+};
+
+// Reads SMT expressions directly from a buffer. Tokens are references into
+// the buffer, only names that end up in a node are copied. All terms
+// supported by the factory are created by it and are therefore shared. All
+// state is local to the reader, so independent readers can be used at the
+// same time. Syntax errors are fatal.
+class SMTReader {
+  public:
+    // 'bufferName' is only used in error messages. The input has to outlive
+    // the reader.
+    SMTReader(llvm::StringRef input, llvm::StringRef bufferName,
+              HashConsFactory &factory,
+              SMTDialect dialect = SMTDialect::SMTLib);
+
+    auto readTerm() -> SharedSMTRef;
+    // Reads all remaining commands. Commands that only configure the solver
+    // (set-option, set-info, exit, …) have no representation and are skipped.
+    auto readCommands() -> std::vector<SharedSMTRef>;
+    // True if only whitespace and comments are left
+    auto atEnd() -> bool;
+
+  private:
+    enum class TokenKind {
+        LPar,
+        RPar,
+        Symbol,
+        Keyword,
+        Numeral,
+        Hexadecimal,
+        Binary,
+        String,
+        End
+    };
+    struct Token {
+        TokenKind kind;
+        llvm::StringRef text;
+    };
+    // A variable bound by a quantifier, a let or the arguments of a
+    // define-fun. Variables bound by lets have no type.
+    struct Binding {
+        llvm::StringRef name;
+        std::string boundName;
+        std::unique_ptr<Type> type;
+    };
+
+    llvm::StringRef input;
+    llvm::StringRef bufferName;
+    HashConsFactory &factory;
+    SMTDialect dialect;
+    const char *pos;
+    std::vector<Binding> scope;
+
+    auto peek() -> Token;
+    auto next() -> Token;
+    auto expect(TokenKind kind, llvm::StringRef what) -> Token;
+    [[noreturn]] void error(llvm::StringRef message, const char *at);
+    void skipWhitespace();
+    // Skips the rest of the current list including the closing parenthesis
+    void skipList();
+    // The text of a list with normalized whitespace, used for indexed
+    // identifiers such as (_ extract 7 0), the opening parenthesis has
+    // already been read
+    auto readIndexedName() -> std::string;
+
+    auto readCommand(llvm::StringRef name) -> SharedSMTRef;
+    auto readSort() -> Type;
+    auto readSorts() -> std::vector<Type>;
+    auto readSortedVars() -> std::vector<SortedVar>;
+    auto readList() -> SharedSMTRef;
+    auto readBinder(llvm::StringRef binder) -> SharedSMTRef;
+    auto readNumeral(llvm::StringRef text, unsigned radix, unsigned bitWidth)
+        -> SharedSMTRef;
+    auto identifier(llvm::StringRef name) -> SharedSMTRef;
+    auto variableName(llvm::StringRef name) -> std::string;
+    auto intWidth() const -> unsigned;
+    void bind(llvm::StringRef name, std::string boundName,
+              std::unique_ptr<Type> type);
+};
+
+// Reads all commands of an .smt2 file, e.g. one written by serializeSMT. The
+// file is mapped into memory instead of being copied if it is large enough.
+auto readSMTFile(const std::string &fileName, HashConsFactory &factory)
+    -> std::vector<SharedSMTRef>;
+
+// The text of the define-funs in a model printed by a solver by name. Solvers
+// wrap the definitions differently, e.g. z3 puts them in a (model ...)
+// command which the reader doesn’t support, so they are extracted textually.
+auto modelDefinitions(llvm::StringRef model)
+    -> std::map<std::string, std::string>;
+}
+
+// Parse a custom relation
+smt::SharedSMTRef parseSMT(llvm::StringRef input);
@@ -13,8 +13,54 @@
 #include "Opts.h"
 #include "SMT.h"
 
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringSet.h"
+
 void serializeSMT(std::vector<smt::SharedSMTRef> smtExprs, bool muZ,
                   llreve::opts::SerializeOpts opts);
+// Writes the same output as serializeSMT to 'out', opts.OutputFileName and
+// opts.Compress are ignored
+void writeSMT(std::ostream &out, std::vector<smt::SharedSMTRef> smtExprs,
+              bool muZ, const llreve::opts::SerializeOpts &opts);
+
+// Writes the clauses in the SMT-HORN format split by their independent
+// components (see splitIndependentComponents) using up to opts.Jobs threads.
+// The declarations and definitions go to OUTPUT.header.smt2 and the clauses
+// of component i followed by (check-sat) etc. go to OUTPUT.i.smt2, so the
+// header together with any shard is a complete query. The files are listed in
+// the JSON manifest (see manifestFileName) which is written last.
+void serializeShards(const std::vector<smt::SharedSMTRef> &smtExprs,
+                     const llreve::opts::SerializeOpts &opts);
+// The manifest of the sharded output, e.g. out.smt2 -> out.manifest.json
+auto manifestFileName(const std::string &fileName) -> std::string;
+
+enum class SolverResult { Sat, Unsat, Unknown };
+
+struct SolverOutput {
+    SolverResult Result;
+    // The model (i.e. the invariants) found by the solver, only set if the
+    // result is sat
+    std::string Model;
+};
+
+// Pass the clauses to z3 using its API instead of serializing them and solve
+// them in process. Only the SMT-HORN format (not muZ) is supported.
+SolverOutput solveWithZ3(std::vector<smt::SharedSMTRef> smtExprs,
+                         llreve::opts::SerializeOpts opts);
+// Converts the assertions to z3 expressions in the same way as solveWithZ3
+// but without solving them. The names of the declared predicates are added to
+// 'predicates'. Returns None if the clauses use bitvectors, which are not
+// supported by the z3 API, in that case solveWithZ3 returns unknown.
+auto hornClausesToZ3(std::vector<smt::SharedSMTRef> smtExprs,
+                     const llreve::opts::SerializeOpts &opts,
+                     z3::context &cxt, llvm::StringSet<> &predicates)
+    -> llvm::Optional<std::vector<z3::expr>>;
+
+// A hash of the clauses as they are passed to the solver. Bound variables are
+// renamed canonically before hashing so the hash does not change if only the
+// names of variables change. Only the SMT-HORN format is supported.
+std::string queryHash(std::vector<smt::SharedSMTRef> smtExprs,
+                      llreve::opts::SerializeOpts opts);
 
 // Remove forall and collect quantified variables. These variables are then
 // declared as global variables for Z3.
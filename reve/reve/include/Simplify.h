@@ -0,0 +1,32 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SMT.h"
+
+namespace smt {
+
+// Semantics preserving simplification of an expression:
+//  - folding of integer arithmetic (+, -, *) and comparisons on constants,
+//    a fold that does not fit into 64 bits is not done
+//  - boolean absorption, e.g. (and true x) -> x, (or x true) -> true,
+//    (=> false x) -> true and (not (not x)) -> x
+//  - (= x x) -> true and if-then-else with a constant condition or equal
+//    branches
+//  - lets and foralls whose body is a constant are replaced by it
+// The rewriting is bottom up and subterms that don’t change are shared with
+// the input, also the ones that occur more than once.
+auto simplify(const SharedSMTRef &expr) -> SharedSMTRef;
+
+// Whether the expression is the assertion of true, e.g. a simplified clause
+// whose premises are false. These can be dropped.
+auto isTriviallyTrue(const SMTExpr &expr) -> bool;
+}
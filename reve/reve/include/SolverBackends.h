@@ -0,0 +1,75 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "Serialize.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The external Horn solvers llreve can run. Every solver is described by a
+// driver in a single registry, the encoder and the portfolio only talk to the
+// drivers, so a new solver can be used by registering a driver for it (see
+// -solver-backend) without changing either of them.
+
+enum class BackendFormat {
+    // The clauses as written by serializeSMT
+    SMTHorn,
+    // The restricted format of the CHC competition (see
+    // SerializeOpts::ChcComp), which most Horn solvers read
+    ChcComp
+};
+
+struct BackendCapabilities {
+    // A model is printed after a sat result
+    bool Models = true;
+    // Predicates may have array arguments
+    bool Arrays = true;
+    bool BitVectors = true;
+};
+
+class SolverBackend {
+  public:
+    virtual ~SolverBackend() = default;
+    virtual auto name() const -> std::string = 0;
+    virtual auto format() const -> BackendFormat = 0;
+    virtual auto capabilities() const -> BackendCapabilities = 0;
+    // The command solving the query in 'fileName'. If 'log' is set the
+    // solver should also report its progress, see recordSolverLog.
+    virtual auto launchCommand(const std::string &fileName, bool log) const
+        -> std::vector<std::string> = 0;
+    // The answer given by a line of the output, unknown if the line is not an
+    // answer. The default accepts the answers of SMT-LIB, "sat" and "unsat".
+    virtual auto parseLine(llvm::StringRef line) const -> SolverResult;
+};
+
+// A solver that is run as 'command' followed by the name of the query and
+// answers in SMT-LIB
+auto commandLineBackend(std::string name, std::vector<std::string> command,
+                        BackendFormat format,
+                        BackendCapabilities capabilities)
+    -> std::unique_ptr<SolverBackend>;
+
+// Replaces the backend of the same name if there is one. The registry is not
+// synchronized, backends have to be registered before solving starts.
+auto registerSolverBackend(std::unique_ptr<SolverBackend> backend) -> void;
+// nullptr if there is no such backend. Eldarica ("eldarica") and z3 using
+// spacer ("spacer") or duality ("duality") are always registered.
+auto findSolverBackend(llvm::StringRef name) -> const SolverBackend *;
+// The names of all registered backends in the order they were registered
+auto solverBackendNames() -> std::vector<std::string>;
+
+// Registers a CHC-COMP solver given as NAME=COMMAND, e.g. from
+// -solver-backend. Returns false if the description is malformed.
+auto registerSolverBackend(llvm::StringRef description) -> bool;
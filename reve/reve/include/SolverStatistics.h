@@ -0,0 +1,42 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+
+#include "z3++.h"
+
+#include <string>
+
+// Where the effort of the solvers goes. Their statistics are recorded as
+// counters named "solver.<engine>.<statistic>" and the effort is attributed to
+// the predicates of the clauses (see stats::predicateEffort), so a slow query
+// can be traced back to the marks whose invariants are hard to find. Nothing
+// is recorded unless the statistics are enabled.
+
+// The mark and the functions a predicate generated by llreve belongs to, e.g.
+// "mark 3 of f^f (functions 0^0)" for INV_MAIN_3. The functions are numbered
+// as in SMTGenerationOpts::FunctionNumerals. INV_<mark> does not name its
+// function, so only the mark is known. Empty if the name is not one of the
+// predicates of llreve.
+auto predicateOrigin(llvm::StringRef predicate) -> std::string;
+
+// Records the statistics of the in-process z3 solver after a check. If the
+// check was sat the size of the invariant found for each predicate is added
+// as its "invariant size" (the number of distinct subterms).
+auto recordZ3Statistics(z3::solver &solver,
+                        const llvm::StringSet<> &predicates, bool sat) -> void;
+
+// Attributes the verbose output of an external engine to the predicates that
+// are mentioned in it. Every line counts once for each predicate it mentions,
+// the measure is "<engine> log lines".
+auto recordSolverLog(llvm::StringRef engine, llvm::StringRef log) -> void;
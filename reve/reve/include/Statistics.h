@@ -0,0 +1,84 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Counters and timers describing where the time of a single run goes. Nothing
+// is recorded until 'enable' has been called, until then all functions return
+// after checking a single flag so the instrumentation can stay in hot code.
+//
+// Recording is thread safe, timers started on different threads show up on
+// different rows of the trace.
+namespace stats {
+
+// Discards everything recorded so far. If 'trace' is set every timer is also
+// recorded as an individual event for 'writeTrace'.
+auto enable(bool trace) -> void;
+auto enabled() -> bool;
+
+// Add 'n' to the counter of the given name
+auto count(llvm::StringRef counter, uint64_t n = 1) -> void;
+// Set the counter to 'n' if it is currently smaller
+auto maximum(llvm::StringRef counter, uint64_t n) -> void;
+
+// Add 'n' to a measure of the solver effort spent on a predicate of the
+// clauses, e.g. how often the solver mentioned it in its log. 'origin'
+// describes the mark and the functions the predicate belongs to (see
+// predicateOrigin), the first one recorded for a predicate is kept.
+auto predicateEffort(llvm::StringRef predicate, llvm::StringRef origin,
+                     llvm::StringRef measure, uint64_t n) -> void;
+
+// The kinds of nodes whose live instances are counted. Only nodes allocated
+// while recording is enabled are counted.
+enum class NodeKind { SMT, SExpr };
+auto nodeAllocated(NodeKind kind) -> void;
+auto nodeFreed(NodeKind kind) -> void;
+
+// Adds the time between construction and destruction to the phase. Phases can
+// be nested and the same phase can be timed several times, also in parallel,
+// in which case the total is the sum over all threads. The name is not
+// copied and has to outlive the timer.
+//
+// The timer also records the peak number of bytes that were live on the heap
+// while it was running. Once recording is enabled, the global operator new
+// keeps track of the live bytes of the whole process, so phases running in
+// parallel with other phases are charged for their memory as well.
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(llvm::StringRef phase);
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+    ~ScopedTimer();
+
+  private:
+    llvm::StringRef phase;
+    bool active;
+    // The slot in which the peak memory of this timer is recorded, -1 if all
+    // slots are in use
+    int slot = -1;
+    std::chrono::steady_clock::time_point start;
+};
+
+// {"times": {<phase>: <seconds>, ...}, "counters": {<counter>: <n>, ...},
+//  "memory": {<phase>: <peak bytes>, ...},
+//  "predicates": {<predicate>: {"origin": <origin>, <measure>: <n>, ...}}}
+// The counters include the peak number of live heap bytes and nodes and the
+// maximum resident set size of the process.
+auto writeJSON(std::ostream &out) -> void;
+// The timer events in the Chrome trace event format which can be loaded in
+// chrome://tracing
+auto writeTrace(std::ostream &out) -> void;
+}
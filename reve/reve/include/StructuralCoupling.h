@@ -0,0 +1,37 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "AnalysisResults.h"
+#include "MonoPair.h"
+
+#include "llvm/IR/Function.h"
+
+#include <cstdint>
+#include <set>
+
+// Coupling of functions that have been renamed between the two programs. Two
+// functions are matched if they have the same structural hash and no other
+// uncoupled function of either program has this hash.
+
+// A hash of a preprocessed function that does not depend on the names of the
+// function, its values or its callees: the types of the arguments and the
+// result, the number of predecessors and successors of each block and the
+// number of instructions with each opcode. Calls contribute the number of
+// arguments instead of the callee.
+auto structuralHash(const llvm::Function &fun) -> uint64_t;
+
+// Adds the pairs of preprocessed functions that are matched by their
+// structural hash to 'coupledFunctions'. Functions that are already coupled
+// are not considered. Returns the number of added pairs.
+auto coupleFunctionsByStructure(
+    MonoPair<llvm::Module &> modules, const AnalysisResultsMap &analysisResults,
+    std::set<MonoPair<llvm::Function *>> &coupledFunctions) -> size_t;
@@ -0,0 +1,71 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <functional>
+
+namespace smt {
+
+// A name interned in a global table. Two symbols are equal iff their names
+// are equal, so comparing and hashing symbols are integer operations.
+//
+// Interning is thread safe. Each thread first looks the name up in its own
+// cache, so the table is only locked for names that are new to the thread.
+// Reading the name of a symbol never locks.
+//
+// The table is never cleared, so the names returned by 'str' stay valid until
+// the program exits. It only grows with the number of distinct names, and the
+// server and -watch run every job in a forked child, which takes its table
+// with it.
+class Symbol {
+  public:
+    // The empty name
+    Symbol() = default;
+    explicit Symbol(llvm::StringRef name);
+    auto str() const -> llvm::StringRef;
+    auto id() const -> uint32_t { return symbolId; }
+    bool operator==(Symbol other) const { return symbolId == other.symbolId; }
+    bool operator!=(Symbol other) const { return symbolId != other.symbolId; }
+    // This is the order in which the symbols have been interned, not the
+    // lexicographic order of the names
+    bool operator<(Symbol other) const { return symbolId < other.symbolId; }
+
+  private:
+    explicit Symbol(uint32_t id) : symbolId(id) {}
+    uint32_t symbolId = 0;
+    friend struct llvm::DenseMapInfo<Symbol>;
+};
+}
+
+namespace llvm {
+template <> struct DenseMapInfo<smt::Symbol> {
+    static auto getEmptyKey() -> smt::Symbol { return smt::Symbol(~0u); }
+    static auto getTombstoneKey() -> smt::Symbol {
+        return smt::Symbol(~0u - 1);
+    }
+    static auto getHashValue(smt::Symbol symbol) -> unsigned {
+        return DenseMapInfo<uint32_t>::getHashValue(symbol.id());
+    }
+    static auto isEqual(smt::Symbol lhs, smt::Symbol rhs) -> bool {
+        return lhs == rhs;
+    }
+};
+}
+
+namespace std {
+template <> struct hash<smt::Symbol> {
+    size_t operator()(smt::Symbol symbol) const { return symbol.id(); }
+};
+}
@@ -23,6 +23,10 @@ struct Type {
     TypeTag getTag() const { return self->getTag(); }
     sexpr::SExprRef toSExpr() const { return self->toSExpr(); }
     unsigned unsafeBitWidth() const { return self->unsafeBitWidth(); }
+    // The wrapped type, 'T' has to be the type corresponding to the tag
+    template <typename T> const T &get() const {
+        return *static_cast<const T *>(self->value());
+    }
 
   private:
     struct Concept {
@@ -31,6 +35,7 @@ struct Type {
         virtual TypeTag getTag() const = 0;
         virtual sexpr::SExprRef toSExpr() const = 0;
         virtual unsigned unsafeBitWidth() const = 0;
+        virtual const void *value() const = 0;
     };
 
     template <typename T> struct Model : Concept {
@@ -42,6 +47,7 @@ struct Type {
         unsigned unsafeBitWidth() const override {
             return data.unsafeBitWidth();
         }
+        const void *value() const override { return &data; }
     };
 
     std::unique_ptr<const Concept> self;
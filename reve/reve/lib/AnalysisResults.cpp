@@ -5,20 +5,21 @@ using smt::SortedVar;
 using std::vector;
 using std::string;
 
-MonoPair<PathMap> getPathMaps(MonoPair<const llvm::Function *> functions,
-                              const AnalysisResultsMap &analysisResults) {
-    return makeMonoPair(analysisResults.at(functions.first).paths,
-                        analysisResults.at(functions.second).paths);
+MonoPairView<PathMap>
+getPathMaps(MonoPair<const llvm::Function *> functions,
+            const AnalysisResultsMap &analysisResults) {
+    return {analysisResults.at(functions.first).paths,
+            analysisResults.at(functions.second).paths};
 }
 
-MonoPair<BidirBlockMarkMap>
+MonoPairView<BidirBlockMarkMap>
 getBlockMarkMaps(MonoPair<const llvm::Function *> functions,
                  const AnalysisResultsMap &analysisResults) {
-    return makeMonoPair(analysisResults.at(functions.first).blockMarkMap,
-                        analysisResults.at(functions.second).blockMarkMap);
+    return {analysisResults.at(functions.first).blockMarkMap,
+            analysisResults.at(functions.second).blockMarkMap};
 }
 
-MonoPair<vector<SortedVar>>
+MonoPairView<vector<SortedVar>>
 getFunctionArguments(MonoPair<const llvm::Function *> functions,
                      const AnalysisResultsMap &analysisResults) {
     return {analysisResults.at(functions.first).functionArguments,
@@ -27,11 +28,16 @@ getFunctionArguments(MonoPair<const llvm::Function *> functions,
 
 FreeVarsMap getFreeVarsMap(MonoPair<const llvm::Function *> functions,
                            const AnalysisResultsMap &analysisResults) {
-    return mergeVectorMaps(analysisResults.at(functions.first).freeVariables,
-                           analysisResults.at(functions.second).freeVariables);
+    // The variables of the first program come first at each mark
+    FreeVarsMap merged = analysisResults.at(functions.first).freeVariables;
+    for (const auto &it : analysisResults.at(functions.second).freeVariables) {
+        auto &vars = merged[it.first];
+        vars.insert(vars.end(), it.second.begin(), it.second.end());
+    }
+    return merged;
 }
 
-MonoPair<FreeVarsMap>
+MonoPairView<FreeVarsMap>
 getFreeVarsPair(MonoPair<const llvm::Function *> functions,
                 const AnalysisResultsMap &analysisResults) {
     return {analysisResults.at(functions.first).freeVariables,
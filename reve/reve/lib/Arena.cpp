@@ -0,0 +1,113 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Arena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// The memory owned by an arena. This is separate from the arena itself so
+// that it can outlive it if there are still nodes referencing it.
+struct Arena::Blocks {
+    std::vector<char *> blocks;
+    // The allocations are only counted by the arena itself and added when it
+    // is destroyed, so allocating doesn't need an atomic operation. Until then
+    // the bias keeps the count above zero no matter how many nodes have been
+    // freed.
+    static const int64_t LiveBias = int64_t(1) << 62;
+    std::atomic<int64_t> liveObjects{LiveBias};
+    ~Blocks() {
+        for (char *block : blocks) {
+            ::operator delete(block);
+        }
+    }
+    void release(int64_t count = 1) {
+        if (liveObjects.fetch_sub(count) == count) {
+            delete this;
+        }
+    }
+};
+
+// Every allocation is prefixed by a header that records which arena it came
+// from (nullptr for the global heap). This way nodes can be freed correctly
+// even if they outlive the scope in which they were allocated.
+namespace {
+union AllocationHeader {
+    Arena::Blocks *blocks;
+    std::max_align_t align;
+};
+}
+
+static size_t alignSize(size_t size) {
+    const size_t alignment = alignof(std::max_align_t);
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize), blocks(new Blocks) {}
+
+Arena::~Arena() {
+    blocks->release(Blocks::LiveBias - static_cast<int64_t>(allocationCount));
+}
+
+void *Arena::allocate(size_t size) {
+    size = alignSize(size);
+    ++allocationCount;
+    if (size > blockSize) {
+        // Don’t waste the rest of the current block for large allocations
+        char *block = static_cast<char *>(::operator new(size));
+        blocks->blocks.push_back(block);
+        return block;
+    }
+    if (current == nullptr || static_cast<size_t>(end - current) < size) {
+        current = static_cast<char *>(::operator new(blockSize));
+        end = current + blockSize;
+        blocks->blocks.push_back(current);
+    }
+    void *result = current;
+    current += size;
+    return result;
+}
+
+static thread_local Arena *currentArena = nullptr;
+
+ArenaScope::ArenaScope(Arena &arena) : previous(currentArena) {
+    currentArena = &arena;
+}
+
+ArenaScope::~ArenaScope() { currentArena = previous; }
+
+void *arenaAllocate(size_t size) {
+    size_t totalSize = sizeof(AllocationHeader) + size;
+    if (currentArena) {
+        auto header =
+            static_cast<AllocationHeader *>(currentArena->allocate(totalSize));
+        header->blocks = currentArena->blocks;
+        return header + 1;
+    }
+    auto header = static_cast<AllocationHeader *>(::operator new(totalSize));
+    header->blocks = nullptr;
+    return header + 1;
+}
+
+bool hasActiveArena() { return currentArena != nullptr; }
+
+void arenaDeallocate(void *ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    AllocationHeader *header = static_cast<AllocationHeader *>(ptr) - 1;
+    if (header->blocks) {
+        header->blocks->release();
+    } else {
+        ::operator delete(header);
+    }
+}
@@ -10,6 +10,10 @@
 
 #include "Assignment.h"
 
+#include "BitVectorEncoding.h"
+#include "FloatAbstraction.h"
+#include "HashCons.h"
+#include "HeapRegions.h"
 #include "Helper.h"
 #include "Opts.h"
 
@@ -28,10 +32,88 @@ using llvm::CmpInst;
 using namespace smt;
 using namespace llreve::opts;
 
+static thread_local BlockAssignmentCache *currentBlockAssignmentCache =
+    nullptr;
+
+BlockAssignmentCache::BlockAssignmentCache()
+    : previous(currentBlockAssignmentCache) {
+    currentBlockAssignmentCache = this;
+}
+
+BlockAssignmentCache::~BlockAssignmentCache() {
+    currentBlockAssignmentCache = previous;
+}
+
+BlockAssignmentCache *BlockAssignmentCache::current() {
+    return currentBlockAssignmentCache;
+}
+
+const vector<DefOrCallInfo> *
+BlockAssignmentCache::lookup(const Key &key) const {
+    auto it = entries.find(key);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+void BlockAssignmentCache::insert(const Key &key,
+                                  const vector<DefOrCallInfo> &defs) {
+    vector<DefOrCallInfo> copies;
+    copies.reserve(defs.size());
+    for (const auto &def : defs) {
+        copies.push_back(copyDefOrCallInfo(def));
+    }
+    entries.insert({key, std::move(copies)});
+}
+
+DefOrCallInfo copyDefOrCallInfo(const DefOrCallInfo &def) {
+    if (def.tag == DefOrCallInfoTag::Def) {
+        return DefOrCallInfo(make_unique<Assignment>(*def.definition));
+    }
+    return DefOrCallInfo(make_unique<CallInfo>(*def.callInfo));
+}
+
+static vector<DefOrCallInfo>
+convertBlockAssignments(const llvm::BasicBlock &BB,
+                        const llvm::BasicBlock *prevBb, bool onlyPhis,
+                        Program prog);
+
 /// Convert a basic block to a list of assignments
 vector<DefOrCallInfo> blockAssignments(const llvm::BasicBlock &BB,
                                        const llvm::BasicBlock *prevBb,
                                        bool onlyPhis, Program prog) {
+    BlockAssignmentCache *cache = BlockAssignmentCache::current();
+    if (!cache) {
+        return convertBlockAssignments(BB, prevBb, onlyPhis, prog);
+    }
+    // The callers take the assignments apart, so they get their own copies
+    // which only share the SMT nodes
+    const BlockAssignmentCache::Key key{&BB, prevBb, onlyPhis, prog};
+    if (const auto cached = cache->lookup(key)) {
+        vector<DefOrCallInfo> definitions;
+        definitions.reserve(cached->size());
+        for (const auto &def : *cached) {
+            definitions.push_back(copyDefOrCallInfo(def));
+        }
+        return definitions;
+    }
+    auto definitions = convertBlockAssignments(BB, prevBb, onlyPhis, prog);
+    cache->insert(key, definitions);
+    return definitions;
+}
+
+// The call of the function which abstracts a floating point operation, see
+// FloatAbstraction.h
+static unique_ptr<CallInfo> abstractionCallInfo(const llvm::Instruction &instr,
+                                                const llvm::Function &fun) {
+    vector<SharedSMTRef> args = {instrNameOrVal(instr.getOperand(0)),
+                                 instrNameOrVal(instr.getOperand(1))};
+    return make_unique<CallInfo>(instr.getName().str(), fun.getName().str(),
+                                  args, 0, fun);
+}
+
+static vector<DefOrCallInfo>
+convertBlockAssignments(const llvm::BasicBlock &BB,
+                        const llvm::BasicBlock *prevBb, bool onlyPhis,
+                        Program prog) {
     const int progIndex = programIndex(prog);
     vector<DefOrCallInfo> definitions;
     definitions.reserve(BB.size());
@@ -60,20 +142,28 @@ vector<DefOrCallInfo> blockAssignments(const llvm::BasicBlock &BB,
                     for (auto &def : defs) {
                         definitions.emplace_back(std::move(def));
                     }
+                } else if (fun->getIntrinsicID() == llvm::Intrinsic::memset) {
+                    vector<DefOrCallInfo> defs =
+                        memsetIntrinsic(CallInst, prog);
+                    for (auto &def : defs) {
+                        definitions.emplace_back(std::move(def));
+                    }
                 } else {
                     if (SMTGenerationOpts::getInstance().Heap ==
                         HeapOpt::Enabled) {
-                        definitions.emplace_back(makeAssignment(
-                            heapName(progIndex),
-                            memoryVariable(heapName(progIndex))));
+                        for (const auto &heap : heapNames(prog)) {
+                            definitions.emplace_back(
+                                makeAssignment(heap, memoryVariable(heap)));
+                        }
                     }
                     definitions.emplace_back(
                         toCallInfo(CallInst->getName(), prog, *CallInst));
                     if (SMTGenerationOpts::getInstance().Heap ==
                         HeapOpt::Enabled) {
-                        definitions.emplace_back(makeAssignment(
-                            heapName(progIndex),
-                            memoryVariable(heapResultName(prog))));
+                        for (const auto &heap : heapNames(prog)) {
+                            definitions.emplace_back(makeAssignment(
+                                heap, memoryVariable(heap + "_res")));
+                        }
                     }
                     if (SMTGenerationOpts::getInstance().Stack ==
                         StackOpt::Enabled) {
@@ -82,6 +172,9 @@ vector<DefOrCallInfo> blockAssignments(const llvm::BasicBlock &BB,
                             memoryVariable(stackResultName(prog))));
                     }
                 }
+            } else if (const auto abstraction = floatAbstraction(*instr)) {
+                definitions.emplace_back(
+                    abstractionCallInfo(*instr, *abstraction));
             } else {
                 auto assignments = instrAssignment(*instr, prevBb, prog);
                 for (auto &assignment : assignments) {
@@ -102,8 +195,10 @@ vector<DefOrCallInfo> blockAssignments(const llvm::BasicBlock &BB,
         definitions.push_back(DefOrCallInfo(
             makeAssignment(resultName(prog), std::move(retName))));
         if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-            definitions.push_back(DefOrCallInfo(makeAssignment(
-                heapResultName(prog), memoryVariable(heapName(progIndex)))));
+            for (const auto &heap : heapNames(prog)) {
+                definitions.push_back(DefOrCallInfo(
+                    makeAssignment(heap + "_res", memoryVariable(heap))));
+            }
         }
         if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
             definitions.push_back(DefOrCallInfo(makeAssignment(
@@ -239,79 +334,79 @@ instrAssignment(const llvm::Instruction &Instr, const llvm::BasicBlock *prevBb,
     }
     if (const auto loadInst = llvm::dyn_cast<llvm::LoadInst>(&Instr)) {
         SharedSMTRef pointer = instrNameOrVal(loadInst->getOperand(0));
+        const string heap =
+            heapName(progIndex, heapRegion(loadInst->getPointerOperand()));
         if (SMTGenerationOpts::getInstance().BitVect) {
             // We load single bytes
             unsigned bytes = loadInst->getType()->getIntegerBitWidth() / 8;
-            auto load =
-                makeOp("select", memoryVariable(heapName(progIndex)), pointer);
+            SharedSMTRef memory = hashConsVariable(heap, memoryType());
+            SharedSMTRef load = hashConsOp("select", {memory, pointer});
             for (unsigned i = 1; i < bytes; ++i) {
-                load =
-                    makeOp("concat", std::move(load),
-                           makeOp("select", memoryVariable(heapName(progIndex)),
-                                  makeOp("bvadd", pointer,
-                                         std::make_unique<ConstantInt>(
-                                             llvm::APInt(64, i)))));
+                load = hashConsOp(
+                    "concat",
+                    {std::move(load),
+                     hashConsOp("select", {memory, bv::offset(pointer, i)})});
             }
             return vecSingleton(
                 makeAssignment(loadInst->getName(), std::move(load)));
         } else {
             if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
-                SMTRef load =
-                    makeOp("select_", memoryVariable(heapName(progIndex)),
-                           memoryVariable(stackName(progIndex)), pointer,
-                           instrLocation(loadInst->getPointerOperand()));
+                SharedSMTRef load = hashConsOp(
+                    "select_",
+                    {hashConsVariable(heap, memoryType()),
+                     hashConsVariable(stackName(progIndex), memoryType()),
+                     pointer, instrLocation(loadInst->getPointerOperand())});
                 return vecSingleton(
                     makeAssignment(loadInst->getName(), std::move(load)));
             } else {
-                SMTRef load = makeOp(
-                    "select", memoryVariable(heapName(progIndex)), pointer);
+                SharedSMTRef load = hashConsOp(
+                    "select", {hashConsVariable(heap, memoryType()), pointer});
                 return vecSingleton(
                     makeAssignment(loadInst->getName(), std::move(load)));
             }
         }
     }
     if (const auto storeInst = llvm::dyn_cast<llvm::StoreInst>(&Instr)) {
-        string heap = heapName(progIndex);
+        const string heap =
+            heapName(progIndex, heapRegion(storeInst->getPointerOperand()));
         SharedSMTRef pointer = instrNameOrVal(storeInst->getPointerOperand());
         SharedSMTRef val = instrNameOrVal(storeInst->getValueOperand());
         if (SMTGenerationOpts::getInstance().BitVect) {
             int bytes =
                 storeInst->getValueOperand()->getType()->getIntegerBitWidth() /
                 8;
-            auto newHeap = memoryVariable(heap);
+            SharedSMTRef newHeap = hashConsVariable(heap, memoryType());
             for (int i = 0; i < bytes; ++i) {
-                SharedSMTRef offset =
-                    makeOp("bvadd", pointer,
-                           std::make_unique<ConstantInt>(llvm::APInt(64, i)));
-                SharedSMTRef elem = makeOp(
-                    "(_ extract " + std::to_string(8 * (bytes - i - 1) + 7) +
-                        " " + std::to_string(8 * (bytes - i - 1)) + ")",
-                    val);
-                std::vector<SharedSMTRef> args = {std::move(newHeap), offset,
-                                                  elem};
-                newHeap = make_unique<Op>("store", std::move(args));
+                SharedSMTRef offset = bv::offset(pointer, i);
+                const unsigned low = 8 * (bytes - i - 1);
+                SharedSMTRef elem = bv::extract(val, 8 * bytes, low + 7, low);
+                newHeap =
+                    hashConsOp("store", {std::move(newHeap), offset, elem});
             }
-            return vecSingleton(
-                makeAssignment(heapName(progIndex), std::move(newHeap)));
+            return vecSingleton(makeAssignment(heap, std::move(newHeap)));
         } else {
             if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
-                const std::vector<SharedSMTRef> args = {
-                    memoryVariable(heap), memoryVariable(stackName(progIndex)),
-                    pointer, instrLocation(storeInst->getPointerOperand()),
-                    val};
-                auto store = make_unique<Op>("store_", args);
-                return vecSingleton(
-                    makeAssignment(heapName(progIndex), std::move(store)));
+                auto store = hashConsOp(
+                    "store_",
+                    {hashConsVariable(heap, memoryType()),
+                     hashConsVariable(stackName(progIndex), memoryType()),
+                     pointer, instrLocation(storeInst->getPointerOperand()),
+                     val});
+                return vecSingleton(makeAssignment(heap, std::move(store)));
             } else {
-                const std::vector<SharedSMTRef> args = {memoryVariable(heap),
-                                                        pointer, val};
-                auto store = make_unique<Op>("store", args);
-                return vecSingleton(
-                    makeAssignment(heapName(progIndex), std::move(store)));
+                auto store = hashConsOp(
+                    "store",
+                    {hashConsVariable(heap, memoryType()), pointer, val});
+                return vecSingleton(makeAssignment(heap, std::move(store)));
             }
         }
     }
     if (const auto bitCast = llvm::dyn_cast<llvm::CastInst>(&Instr)) {
+        if (SMTGenerationOpts::getInstance().BitVect) {
+            return vecSingleton(makeAssignment(
+                bitCast->getName(),
+                bv::cast(*bitCast, instrNameOrVal(bitCast->getOperand(0)))));
+        }
         auto cast = std::make_unique<TypeCast>(
             bitCast->getOpcode(), llvmType(bitCast->getSrcTy()),
             llvmType(bitCast->getDestTy()),
@@ -540,10 +635,13 @@ string opName(const llvm::BinaryOperator &Op) {
 
 SMTRef combineOp(const llvm::BinaryOperator &Op, std::string opName,
                  SMTRef firstArg, SMTRef secondArg) {
-    if (!SMTGenerationOpts::getInstance().BitVect &&
-        (Op.getOpcode() == Instruction::AShr ||
-         Op.getOpcode() == Instruction::LShr ||
-         Op.getOpcode() == Instruction::Shl)) {
+    if (SMTGenerationOpts::getInstance().BitVect) {
+        return bv::binaryOp(Op, std::move(opName), std::move(firstArg),
+                            std::move(secondArg));
+    }
+    if (Op.getOpcode() == Instruction::AShr ||
+        Op.getOpcode() == Instruction::LShr ||
+        Op.getOpcode() == Instruction::Shl) {
         // We can only do that if there is a constant on the right side
         if (const auto constInt =
                 llvm::dyn_cast<llvm::ConstantInt>(Op.getOperand(1))) {
@@ -561,61 +659,187 @@ SMTRef combineOp(const llvm::BinaryOperator &Op, std::string opName,
     return makeOp(std::move(opName), std::move(firstArg), std::move(secondArg));
 }
 
+// The offsets of the scalars making up a value of type 'ty' stored at
+// 'offset'. The offsets are measured in the cells used by typeSize.
+static void scalarOffsets(llvm::Type *ty, const llvm::DataLayout &layout,
+                          int offset,
+                          vector<std::pair<int, llvm::Type *>> &scalars) {
+    if (const auto structTy = llvm::dyn_cast<llvm::StructType>(ty)) {
+        for (const auto elTy : structTy->elements()) {
+            scalarOffsets(elTy, layout, offset, scalars);
+            offset += typeSize(elTy, layout);
+        }
+    } else if (const auto arrayTy = llvm::dyn_cast<llvm::ArrayType>(ty)) {
+        const auto elTy = arrayTy->getElementType();
+        const int elSize = typeSize(elTy, layout);
+        for (uint64_t i = 0; i < arrayTy->getNumElements(); ++i) {
+            scalarOffsets(elTy, layout, offset, scalars);
+            offset += elSize;
+        }
+    } else {
+        scalars.push_back({offset, ty});
+    }
+}
+
+// The type pointed to by an argument of memcpy or memset before it has been
+// cast to i8*, nullptr if the argument is not a cast
+static auto intrinsicPointeeType(const llvm::Value *ptr) -> llvm::Type * {
+    const auto castInst = llvm::dyn_cast<llvm::CastInst>(ptr);
+    if (!castInst) {
+        return nullptr;
+    }
+    const auto ptrTy = llvm::dyn_cast<llvm::PointerType>(castInst->getSrcTy());
+    if (!ptrTy) {
+        return nullptr;
+    }
+    return ptrTy->getElementType();
+}
+
+static auto pointerOffset(SharedSMTRef pointer, int offset) -> SharedSMTRef {
+    if (SMTGenerationOpts::getInstance().BitVect) {
+        return bv::offset(std::move(pointer), static_cast<uint64_t>(offset));
+    }
+    if (offset == 0) {
+        return pointer;
+    }
+    return makeOp("+", std::move(pointer),
+                  std::make_unique<ConstantInt>(llvm::APInt(64, offset)));
+}
+
+// The number of heap entries a scalar occupies, in the bitvector encoding
+// integers are stored byte by byte
+static auto storedEntries(llvm::Type *ty, const llvm::DataLayout &layout)
+    -> int {
+    if (SMTGenerationOpts::getInstance().BitVect) {
+        if (ty->isIntegerTy()) {
+            return static_cast<int>(ty->getIntegerBitWidth() / 8);
+        }
+        // Pointers are 64 bits wide
+        return static_cast<int>(layout.getTypeStoreSize(ty));
+    }
+    return 1;
+}
+
+// Only copies and assignments of whole objects are supported, the length has
+// to be the size of the type
+static void checkLength(const llvm::CallInst *callInst, llvm::Type *ty,
+                        const llvm::DataLayout &layout) {
+    const auto length =
+        llvm::dyn_cast<llvm::ConstantInt>(callInst->getArgOperand(2));
+    if (!length || length->getZExtValue() != layout.getTypeAllocSize(ty)) {
+        logErrorData("only intrinsics on whole objects of a constant size "
+                     "are supported\n",
+                     *callInst);
+        exit(1);
+    }
+}
+
+static auto heapStore(SharedSMTRef heap, SharedSMTRef pointer,
+                      SharedSMTRef value) -> SharedSMTRef {
+    return hashConsOp("store",
+                      {std::move(heap), std::move(pointer), std::move(value)});
+}
+
+// Instead of one assignment per copied cell, the copy is encoded as a single
+// assignment of nested stores with one store per scalar. All selects refer to
+// the heap before the copy, so overlapping copies would be wrong but memcpy
+// does not allow them anyway.
 vector<DefOrCallInfo> memcpyIntrinsic(const llvm::CallInst *callInst,
                                       Program prog) {
+    llvm::Type *destTy = intrinsicPointeeType(callInst->getArgOperand(0));
+    llvm::Type *srcTy = intrinsicPointeeType(callInst->getArgOperand(1));
+    if (!destTy || !srcTy) {
+        logError("currently only memcpy of "
+                 "bitcasted pointers is supported\n");
+        exit(1);
+    }
+    const auto &layout = callInst->getModule()->getDataLayout();
+    if (layout.getTypeAllocSize(destTy) != layout.getTypeAllocSize(srcTy)) {
+        logErrorData("memcpy between types of different size\n", *callInst);
+        exit(1);
+    }
+    checkLength(callInst, srcTy, layout);
+    vector<std::pair<int, llvm::Type *>> scalars;
+    scalarOffsets(srcTy, layout, 0, scalars);
+
+    SharedSMTRef basePointerDest = instrNameOrVal(callInst->getArgOperand(0));
+    SharedSMTRef basePointerSrc = instrNameOrVal(callInst->getArgOperand(1));
+    const string heapNameSelect =
+        heapName(prog, heapRegion(callInst->getArgOperand(1)));
+    const string heapNameStore =
+        heapName(prog, heapRegion(callInst->getArgOperand(0)));
+    SharedSMTRef heapSelect = hashConsVariable(heapNameSelect, memoryType());
+    SharedSMTRef newHeap = hashConsVariable(heapNameStore, memoryType());
+    for (const auto &scalar : scalars) {
+        for (int i = 0; i < storedEntries(scalar.second, layout); ++i) {
+            const int offset = scalar.first + i;
+            SharedSMTRef select = hashConsOp(
+                "select", {heapSelect, pointerOffset(basePointerSrc, offset)});
+            newHeap = heapStore(std::move(newHeap),
+                                pointerOffset(basePointerDest, offset),
+                                std::move(select));
+        }
+    }
     vector<DefOrCallInfo> definitions;
-    const auto castInst0 =
-        llvm::dyn_cast<llvm::CastInst>(callInst->getArgOperand(0));
-    const auto castInst1 =
-        llvm::dyn_cast<llvm::CastInst>(callInst->getArgOperand(1));
-    if (castInst0 && castInst1) {
-        const auto ty0 =
-            llvm::dyn_cast<llvm::PointerType>(castInst0->getSrcTy());
-        const auto ty1 =
-            llvm::dyn_cast<llvm::PointerType>(castInst1->getSrcTy());
-        const auto StructTy0 =
-            llvm::dyn_cast<llvm::StructType>(ty0->getElementType());
-        const auto StructTy1 =
-            llvm::dyn_cast<llvm::StructType>(ty1->getElementType());
-        if (StructTy0 && StructTy1) {
-            assert(StructTy0->isLayoutIdentical(StructTy1));
-            SharedSMTRef basePointerDest =
-                instrNameOrVal(callInst->getArgOperand(0));
-            SharedSMTRef basePointerSrc =
-                instrNameOrVal(callInst->getArgOperand(1));
-            string heapNameSelect = heapName(prog);
-            string heapNameStore = heapName(prog);
-            int i = 0;
-            for (const auto elTy : StructTy0->elements()) {
-                SharedSMTRef heapSelect = memoryVariable(heapNameSelect);
-                SharedSMTRef heapStore = memoryVariable(heapNameStore);
-                for (int j = 0;
-                     j < typeSize(elTy, callInst->getModule()->getDataLayout());
-                     ++j) {
-                    SMTRef select = makeOp("select", heapSelect,
-                                           makeOp("+", basePointerSrc,
-                                                  std::make_unique<ConstantInt>(
-                                                      llvm::APInt(64, i))));
-                    const vector<SharedSMTRef> args = {
-                        heapStore, makeOp("+", basePointerDest,
-                                          std::make_unique<ConstantInt>(
-                                              llvm::APInt(64, i))),
-                        std::move(select)};
-                    definitions.push_back(makeAssignment(
-                        heapNameStore, make_unique<Op>("store", args)));
-                    ++i;
-                }
+    definitions.push_back(makeAssignment(heapNameStore, std::move(newHeap)));
+    return definitions;
+}
+
+vector<DefOrCallInfo> memsetIntrinsic(const llvm::CallInst *callInst,
+                                      Program prog) {
+    llvm::Type *destTy = intrinsicPointeeType(callInst->getArgOperand(0));
+    if (!destTy) {
+        logError("currently only memset of "
+                 "bitcasted pointers is supported\n");
+        exit(1);
+    }
+    const auto byteVal =
+        llvm::dyn_cast<llvm::ConstantInt>(callInst->getArgOperand(1));
+    if (!byteVal) {
+        logErrorData("currently only memset with a constant value is "
+                     "supported\n",
+                     *callInst);
+        exit(1);
+    }
+    const llvm::APInt byte = byteVal->getValue().trunc(8);
+    const auto &layout = callInst->getModule()->getDataLayout();
+    checkLength(callInst, destTy, layout);
+    vector<std::pair<int, llvm::Type *>> scalars;
+    scalarOffsets(destTy, layout, 0, scalars);
+
+    const bool bitVect = SMTGenerationOpts::getInstance().BitVect;
+    SharedSMTRef basePointer = instrNameOrVal(callInst->getArgOperand(0));
+    const string heap = heapName(prog, heapRegion(callInst->getArgOperand(0)));
+    SharedSMTRef newHeap = hashConsVariable(heap, memoryType());
+    for (const auto &scalar : scalars) {
+        llvm::Type *ty = scalar.second;
+        const bool nullPointer = ty->isPointerTy() && byte == 0;
+        if (!nullPointer &&
+            (!ty->isIntegerTy() || ty->getIntegerBitWidth() % 8 != 0)) {
+            logErrorData("currently only memset of integers and null "
+                         "pointers is supported\n",
+                         *callInst);
+            exit(1);
+        }
+        if (bitVect) {
+            for (int i = 0; i < storedEntries(ty, layout); ++i) {
+                const int offset = scalar.first + i;
+                newHeap = heapStore(std::move(newHeap),
+                                    pointerOffset(basePointer, offset),
+                                    make_unique<ConstantInt>(byte));
             }
         } else {
-            logError("currently only memcpy of structs is "
-                     "supported\n");
-            exit(1);
+            const llvm::APInt value =
+                nullPointer
+                    ? llvm::APInt(64, 0)
+                    : llvm::APInt::getSplat(ty->getIntegerBitWidth(), byte);
+            newHeap = heapStore(std::move(newHeap),
+                                pointerOffset(basePointer, scalar.first),
+                                make_unique<ConstantInt>(value));
         }
-    } else {
-        logError("currently only memcpy of "
-                 "bitcasted pointers is supported\n");
-        exit(1);
     }
+    vector<DefOrCallInfo> definitions;
+    definitions.push_back(makeAssignment(heap, std::move(newHeap)));
     return definitions;
 }
 
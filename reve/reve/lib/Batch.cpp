@@ -0,0 +1,265 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Batch.h"
+
+#include "Json.h"
+#include "Logging.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <functional>
+
+using std::string;
+using std::vector;
+
+namespace {
+// Just enough of a JSON parser for the manifest. Values other than objects,
+// arrays and strings are only skipped.
+class ManifestParser {
+  public:
+    ManifestParser(llvm::StringRef text, const string &fileName)
+        : text(text), fileName(fileName) {}
+    auto parseString() -> string;
+    auto parseStringPair() -> MonoPair<string>;
+    // Calls 'member' for every key, which has to consume the value
+    auto parseObject(const std::function<void(const string &)> &member)
+        -> void;
+    auto parseArray(const std::function<void()> &element) -> void;
+    auto skipValue() -> void;
+    auto peek() -> char;
+    auto expectEnd() -> void;
+    [[noreturn]] auto fail(const string &message) -> void;
+
+  private:
+    llvm::StringRef text;
+    size_t pos = 0;
+    const string &fileName;
+    auto expect(char c) -> void;
+};
+}
+
+void ManifestParser::fail(const string &message) {
+    logError("Invalid batch manifest " + fileName + " at offset " +
+             std::to_string(pos) + ": " + message + "\n");
+    exit(1);
+}
+
+char ManifestParser::peek() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                 text[pos] == '\n' || text[pos] == '\r')) {
+        ++pos;
+    }
+    return pos < text.size() ? text[pos] : '\0';
+}
+
+void ManifestParser::expect(char c) {
+    if (peek() != c) {
+        fail(string("expected '") + c + "'");
+    }
+    ++pos;
+}
+
+void ManifestParser::expectEnd() {
+    if (peek() != '\0') {
+        fail("unexpected characters after the manifest");
+    }
+}
+
+string ManifestParser::parseString() {
+    expect('"');
+    string result;
+    while (pos < text.size() && text[pos] != '"') {
+        char c = text[pos++];
+        if (c == '\\') {
+            if (pos >= text.size()) {
+                break;
+            }
+            c = text[pos++];
+            switch (c) {
+            case 'n':
+                c = '\n';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            default:
+                fail(string("unsupported escape sequence \\") + c);
+            }
+        }
+        result += c;
+    }
+    expect('"');
+    return result;
+}
+
+MonoPair<string> ManifestParser::parseStringPair() {
+    vector<string> strings;
+    parseArray([&] { strings.push_back(parseString()); });
+    if (strings.size() != 2) {
+        fail("expected exactly two files");
+    }
+    return {strings[0], strings[1]};
+}
+
+void ManifestParser::parseObject(
+    const std::function<void(const string &)> &member) {
+    expect('{');
+    if (peek() == '}') {
+        ++pos;
+        return;
+    }
+    while (true) {
+        const string key = parseString();
+        expect(':');
+        member(key);
+        if (peek() != ',') {
+            break;
+        }
+        ++pos;
+    }
+    expect('}');
+}
+
+void ManifestParser::parseArray(const std::function<void()> &element) {
+    expect('[');
+    if (peek() == ']') {
+        ++pos;
+        return;
+    }
+    while (true) {
+        element();
+        if (peek() != ',') {
+            break;
+        }
+        ++pos;
+    }
+    expect(']');
+}
+
+void ManifestParser::skipValue() {
+    switch (peek()) {
+    case '{':
+        parseObject([this](const string &) { skipValue(); });
+        break;
+    case '[':
+        parseArray([this] { skipValue(); });
+        break;
+    case '"':
+        parseString();
+        break;
+    default: {
+        // Numbers, booleans and null
+        const size_t begin = pos;
+        while (pos < text.size() && llvm::StringRef(",]} \t\r\n").find(
+                                        text[pos]) == llvm::StringRef::npos) {
+            ++pos;
+        }
+        if (pos == begin) {
+            fail("expected a value");
+        }
+    }
+    }
+}
+
+vector<BatchPair> readBatchManifest(const string &fileName,
+                                    MonoPair<string> defaultFileNames) {
+    auto buffer = llvm::MemoryBuffer::getFile(fileName);
+    if (!buffer) {
+        logError("Cannot read " + fileName + ": " +
+                 buffer.getError().message() + "\n");
+        exit(1);
+    }
+    ManifestParser parser((*buffer)->getBuffer(), fileName);
+    // The pairs only inherit the default files once the whole manifest has
+    // been read since "files" may come after "pairs"
+    vector<BatchPair> pairs;
+    vector<bool> hasFiles;
+    parser.parseObject([&](const string &key) {
+        if (key == "files") {
+            defaultFileNames = parser.parseStringPair();
+        } else if (key == "pairs") {
+            parser.parseArray([&] {
+                BatchPair pair{defaultFileNames, "", ""};
+                bool files = false;
+                if (parser.peek() == '"') {
+                    pair.Function = parser.parseString();
+                } else {
+                    parser.parseObject([&](const string &pairKey) {
+                        if (pairKey == "fun") {
+                            pair.Function = parser.parseString();
+                        } else if (pairKey == "output") {
+                            pair.OutputFileName = parser.parseString();
+                        } else if (pairKey == "files") {
+                            pair.FileNames = parser.parseStringPair();
+                            files = true;
+                        } else {
+                            parser.skipValue();
+                        }
+                    });
+                }
+                pairs.push_back(pair);
+                hasFiles.push_back(files);
+            });
+        } else {
+            parser.skipValue();
+        }
+    });
+    parser.expectEnd();
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (!hasFiles[i]) {
+            pairs[i].FileNames = defaultFileNames;
+        }
+        if (pairs[i].FileNames.first.empty() ||
+            pairs[i].FileNames.second.empty()) {
+            logError("No input files for pair " + std::to_string(i) +
+                     " of the batch manifest\n");
+            exit(1);
+        }
+    }
+    return pairs;
+}
+
+void writeBatchResult(std::ostream &out, const BatchPair &pair,
+                      const BatchResult &result) {
+    out << "{\"fun\": ";
+    out << jsonString(pair.Function);
+    out << ", \"files\": [";
+    out << jsonString(pair.FileNames.first);
+    out << ", ";
+    out << jsonString(pair.FileNames.second);
+    out << "], \"output\": ";
+    out << jsonString(pair.OutputFileName);
+    switch (result.Status) {
+    case BatchStatus::Ok:
+        out << ", \"status\": \"ok\"";
+        break;
+    case BatchStatus::Error:
+        out << ", \"status\": \"error\", \"exit code\": " << result.ExitCode;
+        break;
+    case BatchStatus::Crashed:
+        out << ", \"status\": \"crashed\"";
+        break;
+    }
+    // The first line is the result of the solver or the JSON report
+    const string firstLine = result.Output.substr(0, result.Output.find('\n'));
+    if (!firstLine.empty()) {
+        out << ", \"result\": ";
+        out << jsonString(firstLine);
+    }
+    out << ", \"stdout\": ";
+    out << jsonString(result.Output);
+    out << "}\n";
+}
@@ -0,0 +1,591 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "BinaryClauses.h"
+
+#include "GzipStream.h"
+#include "Logging.h"
+#include "SMTReader.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+namespace smt {
+
+// The version is part of the magic string and has to be changed whenever the
+// encoding changes
+static const llvm::StringRef Magic("llreve-clauses-1\n");
+
+static void writeVarint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+namespace {
+class ClauseWriter {
+  public:
+    auto addNode(const SMTExpr &expr) -> uint64_t;
+    void write(const vector<SharedSMTRef> &clauses, std::ostream &out);
+
+  private:
+    llvm::StringMap<uint64_t> stringIndices;
+    vector<llvm::StringRef> strings;
+    // Types are identified by their encoding
+    llvm::StringMap<uint64_t> typeIndices;
+    string typeTable;
+    llvm::DenseMap<const SMTExpr *, uint64_t> nodeIndices;
+    string nodeTable;
+
+    auto addString(llvm::StringRef str) -> uint64_t;
+    auto addType(const Type &type) -> uint64_t;
+};
+}
+
+auto ClauseWriter::addString(llvm::StringRef str) -> uint64_t {
+    auto it = stringIndices.insert({str, strings.size()});
+    if (it.second) {
+        // The key is owned by the map
+        strings.push_back(it.first->getKey());
+    }
+    return it.first->second;
+}
+
+auto ClauseWriter::addType(const Type &type) -> uint64_t {
+    std::string encoded;
+    encoded.push_back(static_cast<char>(type.getTag()));
+    switch (type.getTag()) {
+    case TypeTag::Bool:
+        break;
+    case TypeTag::Int:
+        writeVarint(encoded, type.get<IntType>().bitWidth);
+        break;
+    case TypeTag::Float: {
+        const auto &floatType = type.get<FloatType>();
+        writeVarint(encoded, floatType.exponentWidth);
+        writeVarint(encoded, floatType.significandWidth);
+        break;
+    }
+    case TypeTag::Array: {
+        const auto &arrayType = type.get<ArrayType>();
+        uint64_t domain = addType(arrayType.domain);
+        uint64_t target = addType(arrayType.target);
+        writeVarint(encoded, domain);
+        writeVarint(encoded, target);
+        break;
+    }
+    }
+    auto it = typeIndices.insert({encoded, typeIndices.size()});
+    if (it.second) {
+        typeTable += encoded;
+    }
+    return it.first->second;
+}
+
+auto ClauseWriter::addNode(const SMTExpr &expr) -> uint64_t {
+    auto it = nodeIndices.find(&expr);
+    if (it != nodeIndices.end()) {
+        return it->second;
+    }
+    // The operands have to be written before the node itself, so the indices
+    // are collected before anything is appended to the node table
+    vector<uint64_t> operands;
+    auto add = [&](uint64_t operand) { operands.push_back(operand); };
+    switch (expr.getTag()) {
+    case ExprTag::SetLogic:
+        add(addString(static_cast<const SetLogic &>(expr).logic));
+        break;
+    case ExprTag::Assert:
+        add(addNode(*static_cast<const Assert &>(expr).expr));
+        break;
+    case ExprTag::TypedVariable: {
+        const auto &var = static_cast<const TypedVariable &>(expr);
+        add(addString(var.name));
+        add(addType(var.type));
+        break;
+    }
+    case ExprTag::Forall: {
+        const auto &forall = static_cast<const Forall &>(expr);
+        add(forall.vars.size());
+        for (const auto &var : forall.vars) {
+            add(addString(var.name));
+            add(addType(var.type));
+        }
+        add(addNode(*forall.expr));
+        break;
+    }
+    case ExprTag::CheckSat:
+    case ExprTag::GetModel:
+        break;
+    case ExprTag::Let: {
+        const auto &let = static_cast<const Let &>(expr);
+        add(let.defs.size());
+        for (const auto &def : let.defs) {
+            add(addString(def.first));
+            add(addNode(*def.second));
+        }
+        add(addNode(*let.expr));
+        break;
+    }
+    case ExprTag::ConstantFP: {
+        llvm::APInt bits =
+            static_cast<const ConstantFP &>(expr).value.bitcastToAPInt();
+        add(bits.getBitWidth());
+        for (unsigned i = 0; i < bits.getNumWords(); ++i) {
+            add(bits.getRawData()[i]);
+        }
+        break;
+    }
+    case ExprTag::ConstantInt: {
+        const llvm::APInt &value = static_cast<const ConstantInt &>(expr).value;
+        add(value.getBitWidth());
+        for (unsigned i = 0; i < value.getNumWords(); ++i) {
+            add(value.getRawData()[i]);
+        }
+        break;
+    }
+    case ExprTag::ConstantBool:
+        add(static_cast<const ConstantBool &>(expr).value);
+        break;
+    case ExprTag::ConstantString:
+        add(addString(static_cast<const ConstantString &>(expr).value));
+        break;
+    case ExprTag::Op: {
+        const auto &op = static_cast<const Op &>(expr);
+        add(addString(op.opName));
+        add(op.instantiate);
+        add(op.args.size());
+        for (const auto &arg : op.args) {
+            add(addNode(*arg));
+        }
+        break;
+    }
+    case ExprTag::FPCmp: {
+        const auto &cmp = static_cast<const FPCmp &>(expr);
+        add(static_cast<uint64_t>(cmp.op));
+        add(addType(cmp.type));
+        add(addNode(*cmp.op0));
+        add(addNode(*cmp.op1));
+        break;
+    }
+    case ExprTag::BinaryFPOperator: {
+        const auto &binOp = static_cast<const BinaryFPOperator &>(expr);
+        add(static_cast<uint64_t>(binOp.op));
+        add(addType(binOp.type));
+        add(addNode(*binOp.op0));
+        add(addNode(*binOp.op1));
+        break;
+    }
+    case ExprTag::TypeCast: {
+        const auto &cast = static_cast<const TypeCast &>(expr);
+        add(static_cast<uint64_t>(cast.op));
+        add(addType(cast.sourceType));
+        add(addType(cast.destType));
+        add(addNode(*cast.operand));
+        break;
+    }
+    case ExprTag::Query:
+        add(addString(static_cast<const Query &>(expr).getQueryName()));
+        break;
+    case ExprTag::FunDecl: {
+        const auto &decl = static_cast<const FunDecl &>(expr);
+        add(addString(decl.funName));
+        add(decl.inTypes.size());
+        for (const auto &inType : decl.inTypes) {
+            add(addType(inType));
+        }
+        add(addType(decl.outType));
+        break;
+    }
+    case ExprTag::FunDef: {
+        const auto &def = static_cast<const FunDef &>(expr);
+        add(addString(def.funName));
+        add(def.args.size());
+        for (const auto &arg : def.args) {
+            add(addString(arg.name));
+            add(addType(arg.type));
+        }
+        add(addType(def.outType));
+        add(addNode(*def.body));
+        break;
+    }
+    case ExprTag::Comment:
+        add(addString(static_cast<const Comment &>(expr).val));
+        break;
+    case ExprTag::VarDecl: {
+        const auto &decl = static_cast<const VarDecl &>(expr);
+        add(addString(decl.var.name));
+        add(addType(decl.var.type));
+        break;
+    }
+    }
+    nodeTable.push_back(static_cast<char>(expr.getTag()));
+    for (uint64_t operand : operands) {
+        writeVarint(nodeTable, operand);
+    }
+    uint64_t index = nodeIndices.size();
+    nodeIndices.insert({&expr, index});
+    return index;
+}
+
+void ClauseWriter::write(const vector<SharedSMTRef> &clauses,
+                         std::ostream &out) {
+    vector<uint64_t> roots;
+    roots.reserve(clauses.size());
+    for (const auto &clause : clauses) {
+        roots.push_back(addNode(*clause));
+    }
+    std::string header;
+    writeVarint(header, strings.size());
+    for (llvm::StringRef str : strings) {
+        writeVarint(header, str.size());
+        header.append(str.data(), str.size());
+    }
+    writeVarint(header, typeIndices.size());
+    out.write(Magic.data(), Magic.size());
+    out << header << typeTable;
+    std::string counts;
+    writeVarint(counts, nodeIndices.size());
+    out << counts << nodeTable;
+    std::string rootTable;
+    writeVarint(rootTable, roots.size());
+    for (uint64_t root : roots) {
+        writeVarint(rootTable, root);
+    }
+    out << rootTable;
+}
+
+void writeBinaryClauses(const vector<SharedSMTRef> &clauses,
+                        std::ostream &out) {
+    ClauseWriter writer;
+    writer.write(clauses, out);
+}
+
+auto isBinaryClauses(llvm::StringRef data) -> bool {
+    return data.startswith(Magic);
+}
+
+namespace {
+class ClauseReader {
+  public:
+    ClauseReader(llvm::StringRef data, llvm::StringRef bufferName,
+                 HashConsFactory &factory)
+        : pos(data.begin()), end(data.end()), bufferName(bufferName),
+          factory(factory) {}
+    auto read() -> vector<SharedSMTRef>;
+
+  private:
+    const char *pos;
+    const char *end;
+    llvm::StringRef bufferName;
+    HashConsFactory &factory;
+    // References into the input
+    vector<llvm::StringRef> strings;
+    vector<Type> types;
+    vector<SharedSMTRef> nodes;
+
+    [[noreturn]] void corrupt(llvm::StringRef reason);
+    auto varint() -> uint64_t;
+    auto nextCount() -> size_t;
+    auto nextString() -> std::string;
+    auto nextType() -> const Type &;
+    auto nextNode() -> SharedSMTRef;
+    auto sortedVar() -> SortedVar;
+    auto apInt() -> llvm::APInt;
+    auto readType() -> Type;
+    auto readNode() -> SharedSMTRef;
+};
+}
+
+void ClauseReader::corrupt(llvm::StringRef reason) {
+    logError(bufferName.str() + ": corrupt binary clause file (" +
+             reason.str() + ")\n");
+    exit(1);
+}
+
+auto ClauseReader::varint() -> uint64_t {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos == end) {
+            corrupt("unexpected end of file");
+        }
+        uint8_t byte = static_cast<uint8_t>(*pos++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    corrupt("varint out of range");
+}
+
+// Counts are bounded by the remaining input since every entry takes at least
+// one byte, this prevents huge allocations for corrupt input
+auto ClauseReader::nextCount() -> size_t {
+    uint64_t n = varint();
+    if (n > static_cast<uint64_t>(end - pos)) {
+        corrupt("count out of range");
+    }
+    return n;
+}
+
+auto ClauseReader::nextString() -> std::string {
+    uint64_t index = varint();
+    if (index >= strings.size()) {
+        corrupt("invalid string index");
+    }
+    return strings[index].str();
+}
+
+auto ClauseReader::nextType() -> const Type & {
+    uint64_t index = varint();
+    if (index >= types.size()) {
+        corrupt("invalid type index");
+    }
+    return types[index];
+}
+
+auto ClauseReader::nextNode() -> SharedSMTRef {
+    uint64_t index = varint();
+    if (index >= nodes.size()) {
+        corrupt("invalid node index");
+    }
+    return nodes[index];
+}
+
+auto ClauseReader::sortedVar() -> SortedVar {
+    std::string name = nextString();
+    return SortedVar(std::move(name), nextType());
+}
+
+auto ClauseReader::apInt() -> llvm::APInt {
+    uint64_t bitWidth = varint();
+    if (bitWidth == 0 || bitWidth > llvm::IntegerType::MAX_INT_BITS) {
+        corrupt("invalid bit width");
+    }
+    vector<uint64_t> words((bitWidth + 63) / 64);
+    for (auto &word : words) {
+        word = varint();
+    }
+    return llvm::APInt(static_cast<unsigned>(bitWidth), words);
+}
+
+static auto floatSemantics(unsigned bitWidth) -> const llvm::fltSemantics * {
+    switch (bitWidth) {
+    case 16:
+        return &llvm::APFloat::IEEEhalf();
+    case 32:
+        return &llvm::APFloat::IEEEsingle();
+    case 64:
+        return &llvm::APFloat::IEEEdouble();
+    case 80:
+        return &llvm::APFloat::x87DoubleExtended();
+    case 128:
+        return &llvm::APFloat::IEEEquad();
+    default:
+        return nullptr;
+    }
+}
+
+auto ClauseReader::readType() -> Type {
+    if (pos == end) {
+        corrupt("unexpected end of file");
+    }
+    switch (static_cast<TypeTag>(*pos++)) {
+    case TypeTag::Bool:
+        return boolType();
+    case TypeTag::Int:
+        return IntType(static_cast<unsigned>(varint()));
+    case TypeTag::Float: {
+        unsigned exponentWidth = static_cast<unsigned>(varint());
+        return FloatType(exponentWidth, static_cast<unsigned>(varint()));
+    }
+    case TypeTag::Array: {
+        Type domain = nextType();
+        return ArrayType(domain, nextType());
+    }
+    }
+    corrupt("invalid type tag");
+}
+
+auto ClauseReader::readNode() -> SharedSMTRef {
+    if (pos == end) {
+        corrupt("unexpected end of file");
+    }
+    auto tag = static_cast<ExprTag>(*pos++);
+    switch (tag) {
+    case ExprTag::SetLogic:
+        return make_shared<SetLogic>(nextString());
+    case ExprTag::Assert:
+        return make_shared<Assert>(nextNode());
+    case ExprTag::TypedVariable: {
+        std::string name = nextString();
+        return factory.variable(std::move(name), nextType());
+    }
+    case ExprTag::Forall: {
+        vector<SortedVar> vars;
+        for (size_t i = 0, n = nextCount(); i < n; ++i) {
+            vars.push_back(sortedVar());
+        }
+        return factory.adopt(make_shared<Forall>(std::move(vars), nextNode()));
+    }
+    case ExprTag::CheckSat:
+        return make_shared<CheckSat>();
+    case ExprTag::GetModel:
+        return make_shared<GetModel>();
+    case ExprTag::Let: {
+        AssignmentVec defs;
+        for (size_t i = 0, n = nextCount(); i < n; ++i) {
+            std::string name = nextString();
+            defs.push_back({std::move(name), nextNode()});
+        }
+        return factory.adopt(make_shared<Let>(std::move(defs), nextNode()));
+    }
+    case ExprTag::ConstantFP: {
+        llvm::APInt bits = apInt();
+        const llvm::fltSemantics *semantics =
+            floatSemantics(bits.getBitWidth());
+        if (!semantics) {
+            corrupt("unsupported floating point width");
+        }
+        return make_shared<ConstantFP>(llvm::APFloat(*semantics, bits));
+    }
+    case ExprTag::ConstantInt:
+        return factory.constantInt(apInt());
+    case ExprTag::ConstantBool:
+        return factory.constantBool(varint() != 0);
+    case ExprTag::ConstantString:
+        return factory.constantString(nextString());
+    case ExprTag::Op: {
+        std::string opName = nextString();
+        bool instantiate = varint() != 0;
+        vector<SharedSMTRef> args;
+        for (size_t i = 0, n = nextCount(); i < n; ++i) {
+            args.push_back(nextNode());
+        }
+        return factory.op(std::move(opName), std::move(args), instantiate);
+    }
+    case ExprTag::FPCmp: {
+        auto op = static_cast<FPCmp::Predicate>(varint());
+        Type cmpType = nextType();
+        SharedSMTRef op0 = nextNode();
+        return make_shared<FPCmp>(op, std::move(cmpType), op0, nextNode());
+    }
+    case ExprTag::BinaryFPOperator: {
+        auto op = static_cast<BinaryFPOperator::Opcode>(varint());
+        Type opType = nextType();
+        SharedSMTRef op0 = nextNode();
+        return make_shared<BinaryFPOperator>(op, std::move(opType), op0,
+                                             nextNode());
+    }
+    case ExprTag::TypeCast: {
+        auto op = static_cast<llvm::Instruction::CastOps>(varint());
+        Type sourceType = nextType();
+        Type destType = nextType();
+        return make_shared<TypeCast>(op, std::move(sourceType),
+                                     std::move(destType), nextNode());
+    }
+    case ExprTag::Query:
+        return make_shared<Query>(nextString());
+    case ExprTag::FunDecl: {
+        std::string funName = nextString();
+        vector<Type> inTypes;
+        for (size_t i = 0, n = nextCount(); i < n; ++i) {
+            inTypes.push_back(nextType());
+        }
+        return make_shared<FunDecl>(std::move(funName), std::move(inTypes),
+                                    nextType());
+    }
+    case ExprTag::FunDef: {
+        std::string funName = nextString();
+        vector<SortedVar> args;
+        for (size_t i = 0, n = nextCount(); i < n; ++i) {
+            args.push_back(sortedVar());
+        }
+        Type outType = nextType();
+        return make_shared<FunDef>(std::move(funName), std::move(args),
+                                   std::move(outType), nextNode());
+    }
+    case ExprTag::Comment:
+        return make_shared<Comment>(nextString());
+    case ExprTag::VarDecl:
+        return make_shared<VarDecl>(sortedVar());
+    }
+    corrupt("invalid node tag");
+}
+
+auto ClauseReader::read() -> vector<SharedSMTRef> {
+    if (!llvm::StringRef(pos, end - pos).startswith(Magic)) {
+        corrupt("missing header");
+    }
+    pos += Magic.size();
+    for (size_t i = 0, n = nextCount(); i < n; ++i) {
+        uint64_t length = varint();
+        if (length > static_cast<uint64_t>(end - pos)) {
+            corrupt("string out of range");
+        }
+        strings.emplace_back(pos, length);
+        pos += length;
+    }
+    for (size_t i = 0, n = nextCount(); i < n; ++i) {
+        types.push_back(readType());
+    }
+    size_t nodeCount = nextCount();
+    nodes.reserve(nodeCount);
+    for (size_t i = 0; i < nodeCount; ++i) {
+        nodes.push_back(readNode());
+    }
+    vector<SharedSMTRef> clauses;
+    for (size_t i = 0, n = nextCount(); i < n; ++i) {
+        clauses.push_back(nextNode());
+    }
+    if (pos != end) {
+        corrupt("trailing data");
+    }
+    return clauses;
+}
+
+auto readBinaryClauses(llvm::StringRef data, llvm::StringRef bufferName,
+                       HashConsFactory &factory) -> vector<SharedSMTRef> {
+    ClauseReader reader(data, bufferName, factory);
+    return reader.read();
+}
+
+auto readClauseFile(const std::string &fileName, HashConsFactory &factory)
+    -> vector<SharedSMTRef> {
+    auto buffer = llvm::MemoryBuffer::getFile(fileName);
+    if (!buffer) {
+        logError("Cannot read " + fileName + ": " +
+                 buffer.getError().message() + "\n");
+        exit(1);
+    }
+    llvm::StringRef data = (*buffer)->getBuffer();
+    std::string decompressed;
+    if (isGzip(data)) {
+        if (!gunzip(data, decompressed)) {
+            logError("Cannot decompress " + fileName + "\n");
+            exit(1);
+        }
+        data = decompressed;
+    }
+    if (isBinaryClauses(data)) {
+        return readBinaryClauses(data, fileName, factory);
+    }
+    SMTReader reader(data, fileName, factory);
+    return reader.readCommands();
+}
+}
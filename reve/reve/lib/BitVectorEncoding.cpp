@@ -0,0 +1,246 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "BitVectorEncoding.h"
+
+#include "Type.h"
+
+#include "llvm/ADT/Optional.h"
+
+using std::make_unique;
+using std::string;
+using llvm::APInt;
+using llvm::Instruction;
+
+using namespace smt;
+
+namespace bv {
+
+static auto constantValue(const SMTExpr &expr) -> const APInt * {
+    if (expr.getTag() == ExprTag::ConstantInt) {
+        return &static_cast<const ConstantInt &>(expr).value;
+    }
+    return nullptr;
+}
+
+// Only folds operations that are defined in LLVM, e.g. no division by zero,
+// since SMT-LIB defines them differently
+static auto foldBinaryOp(Instruction::BinaryOps opcode, const APInt &first,
+                         const APInt &second) -> llvm::Optional<APInt> {
+    if (first.getBitWidth() != second.getBitWidth()) {
+        return llvm::None;
+    }
+    const unsigned width = first.getBitWidth();
+    switch (opcode) {
+    case Instruction::Add:
+        return first + second;
+    case Instruction::Sub:
+        return first - second;
+    case Instruction::Mul:
+        return first * second;
+    case Instruction::UDiv:
+        if (second == 0) {
+            return llvm::None;
+        }
+        return first.udiv(second);
+    case Instruction::URem:
+        if (second == 0) {
+            return llvm::None;
+        }
+        return first.urem(second);
+    case Instruction::SDiv:
+    case Instruction::SRem:
+        if (second == 0 ||
+            (first.isMinSignedValue() && second.isMaxValue())) {
+            return llvm::None;
+        }
+        return opcode == Instruction::SDiv ? first.sdiv(second)
+                                           : first.srem(second);
+    case Instruction::And:
+        return first & second;
+    case Instruction::Or:
+        return first | second;
+    case Instruction::Xor:
+        return first ^ second;
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr: {
+        if (second.uge(width)) {
+            return llvm::None;
+        }
+        const unsigned shift = static_cast<unsigned>(second.getZExtValue());
+        if (opcode == Instruction::Shl) {
+            return first.shl(shift);
+        }
+        return opcode == Instruction::LShr ? first.lshr(shift)
+                                           : first.ashr(shift);
+    }
+    default:
+        return llvm::None;
+    }
+}
+
+// The result if 'constant' is the first (or second, depending on
+// 'constantFirst') argument and makes the operation trivial. The other
+// argument is returned in 'other' if it's the result.
+static auto simplifyBinaryOp(Instruction::BinaryOps opcode,
+                             const APInt &constant, bool constantFirst,
+                             SMTRef &other) -> SMTRef {
+    const unsigned width = constant.getBitWidth();
+    switch (opcode) {
+    case Instruction::Add:
+    case Instruction::Or:
+    case Instruction::Xor:
+        if (constant == 0) {
+            return std::move(other);
+        }
+        if (opcode == Instruction::Or && constant.isMaxValue()) {
+            return make_unique<ConstantInt>(constant);
+        }
+        return nullptr;
+    case Instruction::Sub:
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+        if (!constantFirst && constant == 0) {
+            return std::move(other);
+        }
+        return nullptr;
+    case Instruction::Mul:
+        if (constant == 1) {
+            return std::move(other);
+        }
+        if (constant == 0) {
+            return make_unique<ConstantInt>(APInt(width, 0));
+        }
+        return nullptr;
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+        if (!constantFirst && constant == 1) {
+            return std::move(other);
+        }
+        return nullptr;
+    case Instruction::URem:
+    case Instruction::SRem:
+        if (!constantFirst && constant == 1) {
+            return make_unique<ConstantInt>(APInt(width, 0));
+        }
+        return nullptr;
+    case Instruction::And:
+        if (constant == 0) {
+            return make_unique<ConstantInt>(APInt(width, 0));
+        }
+        if (constant.isMaxValue()) {
+            return std::move(other);
+        }
+        return nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+SMTRef binaryOp(const llvm::BinaryOperator &op, string opName,
+                SMTRef firstArg, SMTRef secondArg) {
+    // Booleans are not bitvectors
+    if (op.getType()->isIntegerTy(1)) {
+        return makeOp(std::move(opName), std::move(firstArg),
+                      std::move(secondArg));
+    }
+    const APInt *first = constantValue(*firstArg);
+    const APInt *second = constantValue(*secondArg);
+    if (first && second) {
+        if (auto folded = foldBinaryOp(op.getOpcode(), *first, *second)) {
+            return make_unique<ConstantInt>(*folded);
+        }
+    } else if (first) {
+        if (auto simplified =
+                simplifyBinaryOp(op.getOpcode(), *first, true, secondArg)) {
+            return simplified;
+        }
+    } else if (second) {
+        if (auto simplified =
+                simplifyBinaryOp(op.getOpcode(), *second, false, firstArg)) {
+            return simplified;
+        }
+    }
+    return makeOp(std::move(opName), std::move(firstArg),
+                  std::move(secondArg));
+}
+
+// Pointers are 64 bit wide bitvectors
+static auto bitWidth(const llvm::Type *type) -> unsigned {
+    if (type->isPointerTy()) {
+        return 64;
+    }
+    if (type->isIntegerTy()) {
+        return type->getIntegerBitWidth();
+    }
+    return 0;
+}
+
+SMTRef cast(const llvm::CastInst &cast, SMTRef operand) {
+    const unsigned sourceWidth = bitWidth(cast.getSrcTy());
+    const unsigned destWidth = bitWidth(cast.getDestTy());
+    const auto opcode = cast.getOpcode();
+    if (sourceWidth > 1 && destWidth > 1) {
+        if (sourceWidth == destWidth &&
+            (opcode == Instruction::BitCast ||
+             opcode == Instruction::PtrToInt ||
+             opcode == Instruction::IntToPtr)) {
+            return operand;
+        }
+        if (const APInt *value = constantValue(*operand)) {
+            switch (opcode) {
+            case Instruction::Trunc:
+                return make_unique<ConstantInt>(value->trunc(destWidth));
+            case Instruction::ZExt:
+                return make_unique<ConstantInt>(value->zext(destWidth));
+            case Instruction::SExt:
+                return make_unique<ConstantInt>(value->sext(destWidth));
+            default:
+                break;
+            }
+        }
+    } else if (opcode == Instruction::ZExt && destWidth > 1 &&
+               operand->getTag() == ExprTag::ConstantBool) {
+        const bool value = static_cast<const ConstantBool &>(*operand).value;
+        return make_unique<ConstantInt>(APInt(destWidth, value ? 1 : 0));
+    }
+    return make_unique<TypeCast>(opcode, llvmType(cast.getSrcTy()),
+                                 llvmType(cast.getDestTy()),
+                                 std::move(operand));
+}
+
+SharedSMTRef extract(SharedSMTRef value, unsigned width, unsigned high,
+                     unsigned low) {
+    if (low == 0 && high + 1 == width) {
+        return value;
+    }
+    if (const APInt *constant = constantValue(*value)) {
+        return make_unique<ConstantInt>(
+            constant->lshr(low).trunc(high - low + 1));
+    }
+    return makeOp("(_ extract " + std::to_string(high) + " " +
+                      std::to_string(low) + ")",
+                  std::move(value));
+}
+
+SharedSMTRef offset(SharedSMTRef pointer, uint64_t offset) {
+    if (offset == 0) {
+        return pointer;
+    }
+    const APInt *constant = constantValue(*pointer);
+    if (constant && constant->getBitWidth() == 64) {
+        return make_unique<ConstantInt>(*constant + APInt(64, offset));
+    }
+    return makeOp("bvadd", std::move(pointer),
+                  make_unique<ConstantInt>(APInt(64, offset)));
+}
+}
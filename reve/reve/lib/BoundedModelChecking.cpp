@@ -0,0 +1,270 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "BoundedModelChecking.h"
+
+#include "Logging.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+
+using smt::SharedSMTRef;
+using std::string;
+using std::vector;
+
+using llreve::opts::SerializeOpts;
+
+namespace {
+// A clause whose quantified variables have been replaced by constants
+struct Instance {
+    // The premises that do not apply a predicate
+    vector<z3::expr> Constraints;
+    // The predicate applied in the premises, if any
+    llvm::Optional<z3::expr> Body;
+    // Either the application of a predicate or, for queries, a formula
+    z3::expr Head;
+};
+
+// A predicate after a number of derivation steps: 'Reached' holds if the
+// predicate has been derived for 'Args' in exactly this step
+struct Step {
+    z3::expr Reached;
+    z3::expr_vector Args;
+};
+
+class Unrolling {
+  public:
+    Unrolling(z3::context &cxt, const llvm::StringSet<> &predicates)
+        : cxt(cxt), predicates(predicates) {}
+    // Returns None if the clause is not linear
+    auto instantiate(const z3::expr &clause, const string &prefix)
+        -> llvm::Optional<Instance>;
+    auto isPredicate(const z3::expr &e) const -> bool;
+    auto step(const z3::func_decl &predicate, unsigned depth) -> const Step &;
+    // The premises of the clause at 'depth', the predicate in the premises
+    // refers to the previous step
+    auto premises(const Instance &instance, unsigned depth) -> z3::expr;
+    // The predicates which are the head of at least one clause
+    llvm::StringSet<> Derivable;
+
+  private:
+    z3::context &cxt;
+    const llvm::StringSet<> &predicates;
+    std::map<std::pair<string, unsigned>, Step> steps;
+    // Indexed by the ids of the asts, only valid during instantiate
+    std::map<unsigned, bool> containsPredicateCache;
+    auto containsPredicate(const z3::expr &e) -> bool;
+};
+}
+
+bool Unrolling::isPredicate(const z3::expr &e) const {
+    return e.is_app() && e.decl().decl_kind() == Z3_OP_UNINTERPRETED &&
+           predicates.count(e.decl().name().str()) > 0;
+}
+
+bool Unrolling::containsPredicate(const z3::expr &e) {
+    const unsigned id = Z3_get_ast_id(cxt, e);
+    auto it = containsPredicateCache.find(id);
+    if (it != containsPredicateCache.end()) {
+        return it->second;
+    }
+    bool result = isPredicate(e);
+    if (!result && e.is_app()) {
+        for (unsigned i = 0; i < e.num_args() && !result; ++i) {
+            result = containsPredicate(e.arg(i));
+        }
+    } else if (!result && e.is_quantifier()) {
+        result = containsPredicate(e.body());
+    }
+    containsPredicateCache.insert({id, result});
+    return result;
+}
+
+llvm::Optional<Instance> Unrolling::instantiate(const z3::expr &clause,
+                                                const string &prefix) {
+    containsPredicateCache.clear();
+    z3::expr e = clause;
+    vector<z3::expr> premises;
+    unsigned fresh = 0;
+    while (true) {
+        if (e.is_quantifier() && Z3_is_quantifier_forall(cxt, e)) {
+            const unsigned n = Z3_get_quantifier_num_bound(cxt, e);
+            z3::expr_vector constants(cxt);
+            // The de Bruijn index i refers to the (n - 1 - i)-th bound
+            // variable
+            for (unsigned i = 0; i < n; ++i) {
+                z3::sort sort(cxt,
+                              Z3_get_quantifier_bound_sort(cxt, e, n - 1 - i));
+                constants.push_back(cxt.constant(
+                    (prefix + std::to_string(fresh++)).c_str(), sort));
+            }
+            e = e.body().substitute(constants);
+        } else if (e.is_app() && e.decl().decl_kind() == Z3_OP_IMPLIES) {
+            premises.push_back(e.arg(0));
+            e = e.arg(1);
+        } else if (e.is_app() && e.decl().decl_kind() == Z3_OP_NOT &&
+                   containsPredicate(e.arg(0))) {
+            // (=> premises false) is serialized as (not premises)
+            premises.push_back(e.arg(0));
+            e = cxt.bool_val(false);
+        } else {
+            break;
+        }
+    }
+    Instance instance{{}, llvm::None, e};
+    while (!premises.empty()) {
+        z3::expr premise = premises.back();
+        premises.pop_back();
+        if (premise.is_app() && premise.decl().decl_kind() == Z3_OP_AND) {
+            for (unsigned i = 0; i < premise.num_args(); ++i) {
+                premises.push_back(premise.arg(i));
+            }
+        } else if (isPredicate(premise)) {
+            if (instance.Body) {
+                return llvm::None;
+            }
+            instance.Body = premise;
+        } else if (containsPredicate(premise)) {
+            return llvm::None;
+        } else {
+            instance.Constraints.push_back(premise);
+        }
+    }
+    if (!isPredicate(instance.Head) && containsPredicate(instance.Head)) {
+        return llvm::None;
+    }
+    return instance;
+}
+
+const Step &Unrolling::step(const z3::func_decl &predicate, unsigned depth) {
+    const string name = predicate.name().str();
+    const auto key = std::make_pair(name, depth);
+    auto it = steps.find(key);
+    if (it == steps.end()) {
+        const string prefix = "bmc!" + name + "!" + std::to_string(depth);
+        z3::expr_vector args(cxt);
+        for (unsigned i = 0; i < predicate.arity(); ++i) {
+            args.push_back(
+                cxt.constant((prefix + "!" + std::to_string(i)).c_str(),
+                             predicate.domain(i)));
+        }
+        it = steps.insert({key, Step{cxt.bool_const(prefix.c_str()), args}})
+                 .first;
+    }
+    return it->second;
+}
+
+z3::expr Unrolling::premises(const Instance &instance, unsigned depth) {
+    z3::expr result = cxt.bool_val(true);
+    for (const auto &constraint : instance.Constraints) {
+        result = result && constraint;
+    }
+    if (instance.Body) {
+        const z3::expr &body = *instance.Body;
+        if (depth == 0 || Derivable.count(body.decl().name().str()) == 0) {
+            return cxt.bool_val(false);
+        }
+        const Step &previous = step(body.decl(), depth - 1);
+        result = result && previous.Reached;
+        for (unsigned i = 0; i < body.num_args(); ++i) {
+            result = result && previous.Args[i] == body.arg(i);
+        }
+    }
+    return result;
+}
+
+static auto unrollAndCheck(z3::context &cxt, const vector<z3::expr> &clauses,
+                           const llvm::StringSet<> &predicates,
+                           unsigned maxDepth) -> SolverOutput {
+    Unrolling unrolling(cxt, predicates);
+    for (const auto &clause : clauses) {
+        auto instance = unrolling.instantiate(clause, "bmc!check!");
+        if (!instance) {
+            logWarning("Bounded model checking only supports clauses with at "
+                       "most one predicate in their premises\n");
+            return {SolverResult::Unknown, ""};
+        }
+        if (unrolling.isPredicate(instance->Head)) {
+            unrolling.Derivable.insert(instance->Head.decl().name().str());
+        }
+    }
+    auto prefix = [](size_t clause, unsigned depth) {
+        return "bmc!clause!" + std::to_string(clause) + "!" +
+               std::to_string(depth) + "!";
+    };
+
+    z3::solver solver(cxt);
+    for (unsigned depth = 0; depth <= maxDepth; ++depth) {
+        // A predicate is reached in this step only through one of the clauses
+        // deriving it, these constraints stay for the deeper unrollings
+        std::map<string, std::pair<z3::expr, z3::expr>> derivations;
+        z3::expr violation = cxt.bool_val(false);
+        for (size_t i = 0; i < clauses.size(); ++i) {
+            const Instance instance =
+                *unrolling.instantiate(clauses[i], prefix(i, depth));
+            if (unrolling.isPredicate(instance.Head)) {
+                const z3::expr &head = instance.Head;
+                const Step &current = unrolling.step(head.decl(), depth);
+                z3::expr derivation = unrolling.premises(instance, depth);
+                for (unsigned j = 0; j < head.num_args(); ++j) {
+                    derivation = derivation && current.Args[j] == head.arg(j);
+                }
+                auto it = derivations
+                              .insert({head.decl().name().str(),
+                                       {current.Reached, cxt.bool_val(false)}})
+                              .first;
+                it->second.second = it->second.second || derivation;
+            } else if (depth == 0 || instance.Body) {
+                // Queries without a predicate in their premises do not depend
+                // on the depth so they are only checked once
+                violation = violation || (unrolling.premises(instance, depth) &&
+                                          !instance.Head);
+            }
+        }
+        for (const auto &derivation : derivations) {
+            solver.add(z3::implies(derivation.second.first,
+                                   derivation.second.second));
+        }
+
+        stats::count("bmc.depth");
+        solver.push();
+        solver.add(violation);
+        const z3::check_result result = solver.check();
+        solver.pop();
+        if (result == z3::sat) {
+            llvm::errs() << "Found a counterexample at depth " << depth << "\n";
+            return {SolverResult::Unsat, ""};
+        }
+        if (result == z3::unknown) {
+            logWarning("z3 returned unknown at depth " +
+                       std::to_string(depth) + "\n");
+            return {SolverResult::Unknown, ""};
+        }
+    }
+    llvm::errs() << "No counterexample up to depth " << maxDepth << "\n";
+    return {SolverResult::Unknown, ""};
+}
+
+auto boundedModelCheck(vector<SharedSMTRef> smtExprs, const SerializeOpts &opts,
+                       unsigned maxDepth) -> SolverOutput {
+    stats::ScopedTimer timer("bmc");
+    z3::context cxt;
+    llvm::StringSet<> predicates;
+    const auto clauses =
+        hornClausesToZ3(std::move(smtExprs), opts, cxt, predicates);
+    if (!clauses) {
+        return {SolverResult::Unknown, ""};
+    }
+    return unrollAndCheck(cxt, *clauses, predicates, maxDepth);
+}
@@ -11,16 +11,37 @@
 #include "Compile.h"
 
 #include "Helper.h"
+#include "Statistics.h"
 
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Driver/Compilation.h"
 #include "clang/Driver/Tool.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Frontend/Utils.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <fstream>
+#include <functional>
 
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 using clang::CodeGenAction;
 using clang::CompilerInstance;
 using clang::CompilerInvocation;
@@ -37,22 +58,385 @@ using namespace llreve::opts;
 MonoPair<unique_ptr<llvm::Module>>
 compileToModules(const char *exeName, InputOpts &opts,
                  std::pair<CodeGenAction &, CodeGenAction &> actions) {
-    executeCodeGenActions(exeName, opts, actions);
+    stats::ScopedTimer timer("compile");
+    const bool firstIsIR = isIRFile(opts.FileNames.first);
+    const bool secondIsIR = isIRFile(opts.FileNames.second);
+    if (firstIsIR != secondIsIR) {
+        logError("Either both or none of the inputs have to be LLVM IR\n");
+        exit(1);
+    }
+    if (firstIsIR) {
+        // The function bodies are materialized by the preprocessing
+        if (opts.InMemory) {
+            return {loadIRModule(opts.FileNames.first, opts.Contents.first,
+                                 actions.first),
+                    loadIRModule(opts.FileNames.second, opts.Contents.second,
+                                 actions.second)};
+        }
+        return {loadIRModule(opts.FileNames.first, actions.first),
+                loadIRModule(opts.FileNames.second, actions.second)};
+    }
+    if (!opts.CacheDir.empty()) {
+        return compileToModulesCached(exeName, opts, actions);
+    }
+    return executeCodeGenActions(exeName, opts, actions);
+}
 
-    unique_ptr<llvm::Module> mod1 = actions.first.takeModule();
-    unique_ptr<llvm::Module> mod2 = actions.second.takeModule();
-    if (!mod1 || !mod2) {
-        logError("Module was not successful\n");
+static string inputContents(const string &fileName, const InputOpts &opts) {
+    if (opts.InMemory) {
+        return fileName == opts.FileNames.first ? opts.Contents.first
+                                                : opts.Contents.second;
+    }
+    std::ifstream fileStream(fileName);
+    if (!fileStream) {
+        logError("Couldn’t read " + fileName + "\n");
         exit(1);
     }
-    return {std::move(mod1), std::move(mod2)};
+    return string((std::istreambuf_iterator<char>(fileStream)),
+                  std::istreambuf_iterator<char>());
+}
+
+/// The absolute path of the file without "." and ".." components. Relative
+/// includes are resolved against its directory.
+static string canonicalPath(const string &fileName) {
+    llvm::SmallString<128> path(fileName);
+    llvm::sys::fs::make_absolute(path);
+    llvm::sys::path::remove_dots(path, true);
+    return path.str();
+}
+
+static string hexDigest(llvm::MD5 &hash) {
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    return hexResult.str();
+}
+
+/// The key of an input in the cache. This consists of everything that
+/// influences the result of the compilation except for the included headers,
+/// which are only known after compiling it (see dependencyHash).
+static string moduleCacheKey(const string &fileName, const InputOpts &opts) {
+    const string contents = inputContents(fileName, opts);
+    llvm::MD5 hash;
+    hash.update(LLVM_VERSION_STRING);
+    hash.update(canonicalPath(fileName));
+    hash.update(llvm::StringRef("\0", 1));
+    hash.update(contents);
+    for (const auto &include : opts.Includes) {
+        // Separate the entries so that different lists can’t collide
+        hash.update(llvm::StringRef("\0-I", 3));
+        hash.update(include);
+    }
+    hash.update(llvm::StringRef("\0-resource-dir", 14));
+    hash.update(opts.ResourceDir);
+    hash.update(llvm::StringRef("\0-include-pch", 13));
+    hash.update(opts.PrecompiledHeader);
+    for (const auto &root : opts.CodeGenRoots) {
+        hash.update(llvm::StringRef("\0-root", 7));
+        hash.update(root);
+    }
+    return hexDigest(hash);
+}
+
+/// Hashes the paths and the current contents of the files the preprocessor
+/// read while compiling 'fileName' (the input itself and all headers). None
+/// if one of them can no longer be read.
+static llvm::Optional<string> dependencyHash(const vector<string> &dependencies,
+                                             const string &fileName,
+                                             const InputOpts &opts) {
+    llvm::MD5 hash;
+    for (const auto &dependency : dependencies) {
+        hash.update(dependency);
+        hash.update(llvm::StringRef("\0", 1));
+        if (dependency == fileName) {
+            hash.update(inputContents(fileName, opts));
+        } else {
+            auto buffer = llvm::MemoryBuffer::getFile(dependency);
+            if (!buffer) {
+                return llvm::None;
+            }
+            hash.update(buffer.get()->getBuffer());
+        }
+        hash.update(llvm::StringRef("\0", 1));
+    }
+    return hexDigest(hash);
+}
+
+static string cacheFilePath(const string &cacheDir, const string &name) {
+    llvm::SmallString<128> path(cacheDir);
+    llvm::sys::path::append(path, name);
+    return path.str();
+}
+
+// The dependencies of an input are listed in "<key>.deps", one path per line.
+// The module is stored in "<key>-<dependency hash>.bc", so it is only found
+// again if none of the dependencies has changed.
+static string manifestPath(const string &cacheDir, const string &key) {
+    return cacheFilePath(cacheDir, key + ".deps");
+}
+
+static string moduleCachePath(const string &cacheDir, const string &key,
+                              const string &dependencyHash) {
+    return cacheFilePath(cacheDir, key + "-" + dependencyHash + ".bc");
+}
+
+// Modules loaded from the cache don’t belong to a CodeGenAction so they need a
+// context that stays alive until the end of the program
+static llvm::LLVMContext &cachedModuleContext() {
+    static llvm::LLVMContext context;
+    return context;
+}
+
+bool isIRFile(const string &fileName) {
+    const llvm::StringRef extension = llvm::sys::path::extension(fileName);
+    return extension == ".bc" || extension == ".ll";
+}
+
+// Modules that are not compiled use the context of the action so they have
+// the same lifetime as a compiled module
+static llvm::LLVMContext &actionContext(CodeGenAction &act) {
+    llvm::LLVMContext *context = act.getCodeGenVMContext();
+    return context ? *context : cachedModuleContext();
 }
 
-/// Compile the inputs to llvm assembly and return the corresponding
-/// CodeGenActions
-void executeCodeGenActions(
+unique_ptr<llvm::Module> loadIRModule(const string &fileName,
+                                      CodeGenAction &act) {
+    llvm::SMDiagnostic err;
+    // Function bodies are only read when they are materialized
+    unique_ptr<llvm::Module> mod =
+        llvm::getLazyIRFileModule(fileName, err, actionContext(act));
+    if (!mod) {
+        err.print("reve", llvm::errs());
+        exit(1);
+    }
+    return mod;
+}
+
+unique_ptr<llvm::Module> loadIRModule(const string &name,
+                                      llvm::StringRef contents,
+                                      CodeGenAction &act) {
+    llvm::SMDiagnostic err;
+    unique_ptr<llvm::Module> mod = llvm::getLazyIRModule(
+        llvm::MemoryBuffer::getMemBufferCopy(contents, name), err,
+        actionContext(act));
+    if (!mod) {
+        err.print("reve", llvm::errs());
+        exit(1);
+    }
+    return mod;
+}
+
+static unique_ptr<llvm::Module> loadCachedModule(const string &path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        return nullptr;
+    }
+    auto mod = llvm::parseBitcodeFile(buffer.get()->getMemBufferRef(),
+                                      cachedModuleContext());
+    if (!mod) {
+        // A corrupted cache entry is not fatal, we just recompile
+        llvm::consumeError(mod.takeError());
+        return nullptr;
+    }
+    return std::move(mod.get());
+}
+
+static void
+writeCacheFile(const string &path,
+               const std::function<void(llvm::raw_ostream &)> &write) {
+    // Write to a temporary file first so that concurrent runs never see a
+    // partially written file
+    int fd;
+    llvm::SmallString<128> tmpPath;
+    if (std::error_code errorCode =
+            llvm::sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, tmpPath)) {
+        logWarning("Couldn’t write to module cache: " + errorCode.message() +
+                   "\n");
+        return;
+    }
+    {
+        llvm::raw_fd_ostream stream(fd, true);
+        write(stream);
+    }
+    if (llvm::sys::fs::rename(tmpPath, path)) {
+        llvm::sys::fs::remove(tmpPath);
+    }
+}
+
+static unique_ptr<llvm::Module> lookupCachedModule(const string &fileName,
+                                                   const string &key,
+                                                   const InputOpts &opts) {
+    auto manifest =
+        llvm::MemoryBuffer::getFile(manifestPath(opts.CacheDir, key));
+    if (!manifest) {
+        return nullptr;
+    }
+    llvm::SmallVector<llvm::StringRef, 16> lines;
+    manifest.get()->getBuffer().split(lines, '\n', -1, false);
+    vector<string> dependencies(lines.begin(), lines.end());
+    auto hash = dependencyHash(dependencies, fileName, opts);
+    if (!hash) {
+        return nullptr;
+    }
+    return loadCachedModule(moduleCachePath(opts.CacheDir, key, *hash));
+}
+
+static void storeCachedModule(const string &fileName, const string &key,
+                              const vector<string> &dependencies,
+                              const InputOpts &opts, const llvm::Module &mod) {
+    auto hash = dependencyHash(dependencies, fileName, opts);
+    if (!hash) {
+        return;
+    }
+    // The module is written first, so a manifest always refers to modules
+    // that exist
+    writeCacheFile(moduleCachePath(opts.CacheDir, key, *hash),
+                   [&mod](llvm::raw_ostream &stream) {
+                       llvm::WriteBitcodeToFile(&mod, stream);
+                   });
+    writeCacheFile(manifestPath(opts.CacheDir, key),
+                   [&dependencies](llvm::raw_ostream &stream) {
+                       for (const auto &dependency : dependencies) {
+                           stream << dependency << "\n";
+                       }
+                   });
+}
+
+/// Clang and LLVM keep all mutable state in the CompilerInstance and the
+/// LLVMContext, so the two programs can be compiled at the same time unless
+/// their actions have been created with the same context.
+static unsigned
+compilationJobs(std::pair<CodeGenAction &, CodeGenAction &> actions) {
+    return actions.first.getCodeGenVMContext() ==
+                   actions.second.getCodeGenVMContext()
+               ? 1
+               : 2;
+}
+
+MonoPair<unique_ptr<llvm::Module>>
+compileToModulesCached(const char *exeName, InputOpts &opts,
+                       std::pair<CodeGenAction &, CodeGenAction &> actions) {
+    if (std::error_code errorCode =
+            llvm::sys::fs::create_directories(opts.CacheDir)) {
+        logError("Couldn’t create cache directory: " + errorCode.message() +
+                 "\n");
+        exit(1);
+    }
+    const auto keys = opts.FileNames.map<string>(
+        [&opts](const string &fileName) {
+            return moduleCacheKey(fileName, opts);
+        });
+    MonoPair<unique_ptr<llvm::Module>> modules = {
+        lookupCachedModule(opts.FileNames.first, keys.first, opts),
+        lookupCachedModule(opts.FileNames.second, keys.second, opts)};
+    stats::count("compile.cache hits",
+                 (modules.first ? 1 : 0) + (modules.second ? 1 : 0));
+    if (modules.first && modules.second) {
+        return modules;
+    }
+
+    auto diags = initializeDiagnostics();
+    auto driver = initializeDriver(*diags);
+    auto args = initializeArgs(exeName, opts);
+    unique_ptr<Compilation> comp(driver->BuildCompilation(args));
+    if (!comp) {
+        logError("Couldn’t initiate compilation\n");
+        exit(1);
+    }
+    auto cmdArgsOrError = getCmd(*comp, *diags);
+    if (!cmdArgsOrError) {
+        logError("Couldn’t get cmd args\n");
+        exit(1);
+    }
+    auto cmdArgs = cmdArgsOrError.get();
+
+    // Every compilation gets its own diagnostics engine so that they can run
+    // on separate threads
+    auto compile = [&opts](const ArgStringList &ccArgs, CodeGenAction &act,
+                           const string &fileName, const string &key) {
+        auto actDiags = initializeDiagnostics();
+        vector<string> dependencies;
+        executeCodeGenAction(ccArgs, *actDiags, act, opts, &dependencies);
+        unique_ptr<llvm::Module> mod = act.takeModule();
+        if (!mod) {
+            logError("Module was not successful\n");
+            exit(1);
+        }
+        storeCachedModule(fileName, key, dependencies, opts, *mod);
+        return mod;
+    };
+    vector<std::function<void()>> tasks;
+    if (!modules.first) {
+        tasks.push_back([&] {
+            modules.first = compile(cmdArgs.first, actions.first,
+                                    opts.FileNames.first, keys.first);
+        });
+    }
+    if (!modules.second) {
+        tasks.push_back([&] {
+            modules.second = compile(cmdArgs.second, actions.second,
+                                     opts.FileNames.second, keys.second);
+        });
+    }
+    runInParallel(tasks, compilationJobs(actions));
+    return modules;
+}
+
+/// Copies the module into the context of the action. CloneModule can’t move
+/// a module to another context, so in that case the copy goes through
+/// bitcode which is still a lot cheaper than running the frontend again.
+static unique_ptr<llvm::Module> copyModule(const llvm::Module &mod,
+                                           CodeGenAction &act,
+                                           const string &fileName) {
+    stats::ScopedTimer timer("compile.clone");
+    llvm::LLVMContext &context = actionContext(act);
+    unique_ptr<llvm::Module> copy;
+    if (&context == &mod.getContext()) {
+        copy = llvm::CloneModule(&mod);
+    } else {
+        llvm::SmallVector<char, 0> bitcode;
+        {
+            llvm::raw_svector_ostream stream(bitcode);
+            llvm::WriteBitcodeToFile(&mod, stream);
+        }
+        auto parsed = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(
+                llvm::StringRef(bitcode.data(), bitcode.size()), fileName),
+            context);
+        if (!parsed) {
+            logError("Couldn’t copy module: " +
+                     llvm::toString(parsed.takeError()) + "\n");
+            exit(1);
+        }
+        copy = std::move(parsed.get());
+    }
+    copy->setModuleIdentifier(fileName);
+    copy->setSourceFileName(fileName);
+    return copy;
+}
+
+/// True if both inputs are the same file. Equal contents are not enough since
+/// relative includes are resolved against the directory of the file.
+static bool isSameInput(const InputOpts &opts) {
+    if (opts.InMemory) {
+        return opts.FileNames.first == opts.FileNames.second &&
+               opts.Contents.first == opts.Contents.second;
+    }
+    llvm::sys::fs::UniqueID first, second;
+    return !llvm::sys::fs::getUniqueID(opts.FileNames.first, first) &&
+           !llvm::sys::fs::getUniqueID(opts.FileNames.second, second) &&
+           first == second;
+}
+
+/// Compile the inputs to llvm assembly using the CodeGenActions. Comparing a
+/// program with itself is common (e.g. for noninterference), so in that case
+/// the input is only compiled once.
+MonoPair<unique_ptr<llvm::Module>> executeCodeGenActions(
     const char *exeName, InputOpts &opts,
     std::pair<CodeGenAction &, CodeGenAction &> actions) {
+    const bool identicalInputs = isSameInput(opts);
+
     auto diags = initializeDiagnostics();
     auto driver = initializeDriver(*diags);
     auto args = initializeArgs(exeName, opts);
@@ -70,17 +454,69 @@ void executeCodeGenActions(
     }
     auto cmdArgs = cmdArgsOrError.get();
 
-    executeCodeGenAction(cmdArgs.first, *diags, actions.first);
-    executeCodeGenAction(cmdArgs.second, *diags, actions.second);
+    if (identicalInputs) {
+        stats::count("compile.identical inputs");
+        executeCodeGenAction(cmdArgs.first, *diags, actions.first, opts);
+    } else {
+        runInParallel(
+            {[&cmdArgs, &actions, &opts] {
+                 auto actDiags = initializeDiagnostics();
+                 executeCodeGenAction(cmdArgs.first, *actDiags, actions.first,
+                                      opts);
+             },
+             [&cmdArgs, &actions, &opts] {
+                 auto actDiags = initializeDiagnostics();
+                 executeCodeGenAction(cmdArgs.second, *actDiags,
+                                      actions.second, opts);
+             }},
+            compilationJobs(actions));
+    }
+
+    unique_ptr<llvm::Module> mod1 = actions.first.takeModule();
+    unique_ptr<llvm::Module> mod2 =
+        identicalInputs && mod1
+            ? copyModule(*mod1, actions.second, opts.FileNames.second)
+            : actions.second.takeModule();
+    if (!mod1 || !mod2) {
+        logError("Module was not successful\n");
+        exit(1);
+    }
+    return {std::move(mod1), std::move(mod2)};
+}
+
+namespace {
+// Records every file the preprocessor reads, including system headers, like
+// the dependency file written by -MD
+class AllDependencies : public clang::DependencyCollector {
+  public:
+    bool needSystemDependencies() override { return true; }
+};
 }
 
 /// Build the CodeGenAction corresponding to the arguments
 void executeCodeGenAction(const ArgStringList &ccArgs,
-                          clang::DiagnosticsEngine &diags, CodeGenAction &act) {
+                          clang::DiagnosticsEngine &diags, CodeGenAction &act,
+                          const InputOpts &opts,
+                          vector<string> *dependencies) {
+    stats::ScopedTimer timer("compile.clang");
     auto ci = std::make_unique<CompilerInvocation>();
     CompilerInvocation::CreateFromArgs(*ci, (ccArgs.data()),
                                        (ccArgs.data()) + ccArgs.size(), diags);
     ci->getFrontendOpts().DisableFree = false;
+    if (opts.InMemory) {
+        // The preprocessor takes ownership of the buffers
+        auto &preprocessorOpts = ci->getPreprocessorOpts();
+        preprocessorOpts.addRemappedFile(
+            opts.FileNames.first,
+            llvm::MemoryBuffer::getMemBufferCopy(opts.Contents.first,
+                                                 opts.FileNames.first)
+                .release());
+        preprocessorOpts.addRemappedFile(
+            opts.FileNames.second,
+            llvm::MemoryBuffer::getMemBufferCopy(opts.Contents.second,
+                                                 opts.FileNames.second)
+                .release());
+    }
     CompilerInstance clang;
     clang.setInvocation(std::move(ci));
     clang.createDiagnostics();
@@ -88,10 +524,152 @@ void executeCodeGenAction(const ArgStringList &ccArgs,
         logError("Couldn’t enable diagnostics\n");
         exit(1);
     }
+    std::shared_ptr<AllDependencies> collector;
+    if (dependencies) {
+        collector = std::make_shared<AllDependencies>();
+        clang.addDependencyCollector(collector);
+    }
     if (!clang.ExecuteAction(act)) {
         logError("Couldn’t execute action\n");
         exit(1);
     }
+    if (collector) {
+        const auto collected = collector->getDependencies();
+        dependencies->assign(collected.begin(), collected.end());
+    }
+}
+
+namespace {
+// The functions and global variables that are reachable from the roots
+class ReferencedDecls : public clang::RecursiveASTVisitor<ReferencedDecls> {
+  public:
+    void add(clang::Decl *decl) {
+        if (needed.insert(decl->getCanonicalDecl()).second) {
+            worklist.push_back(decl);
+        }
+    }
+    void findReferences() {
+        while (!worklist.empty()) {
+            clang::Decl *decl = worklist.back();
+            worklist.pop_back();
+            if (const auto fun = llvm::dyn_cast<clang::FunctionDecl>(decl)) {
+                const clang::FunctionDecl *definition;
+                if (fun->hasBody(definition)) {
+                    TraverseStmt(definition->getBody());
+                }
+            } else if (const auto var = llvm::dyn_cast<clang::VarDecl>(decl)) {
+                const clang::VarDecl *definition;
+                if (const auto init = var->getAnyInitializer(definition)) {
+                    TraverseStmt(const_cast<clang::Expr *>(init));
+                }
+            }
+        }
+    }
+    bool contains(const clang::Decl *decl) const {
+        return needed.count(decl->getCanonicalDecl()) > 0;
+    }
+    bool VisitDeclRefExpr(clang::DeclRefExpr *expr) {
+        clang::ValueDecl *decl = expr->getDecl();
+        if (llvm::isa<clang::FunctionDecl>(decl)) {
+            add(decl);
+        } else if (const auto var = llvm::dyn_cast<clang::VarDecl>(decl)) {
+            if (var->hasGlobalStorage()) {
+                add(var);
+            }
+        }
+        return true;
+    }
+
+  private:
+    std::set<const clang::Decl *> needed;
+    vector<clang::Decl *> worklist;
+};
+
+// Holds back the top level declarations until the translation unit is
+// complete and then only passes on the ones that are needed for the roots
+class RestrictedConsumer : public clang::MultiplexConsumer {
+  public:
+    RestrictedConsumer(std::vector<unique_ptr<clang::ASTConsumer>> codeGen,
+                       const std::set<string> &roots)
+        : MultiplexConsumer(std::move(codeGen)), roots(roots) {}
+    bool HandleTopLevelDecl(clang::DeclGroupRef group) override {
+        decls.insert(decls.end(), group.begin(), group.end());
+        return true;
+    }
+    // Declarations deserialized from a precompiled header
+    void HandleInterestingDecl(clang::DeclGroupRef group) override {
+        HandleTopLevelDecl(group);
+    }
+    void CompleteTentativeDefinition(clang::VarDecl *decl) override {
+        tentativeDefinitions.push_back(decl);
+    }
+    void HandleTranslationUnit(clang::ASTContext &ctx) override;
+
+  private:
+    const std::set<string> &roots;
+    vector<clang::Decl *> decls;
+    vector<clang::VarDecl *> tentativeDefinitions;
+};
+}
+
+// Only definitions are dropped, declarations don’t generate any code unless
+// they are used
+static bool isDefinition(const clang::Decl &decl) {
+    if (const auto fun = llvm::dyn_cast<clang::FunctionDecl>(&decl)) {
+        return fun->doesThisDeclarationHaveABody();
+    }
+    if (const auto var = llvm::dyn_cast<clang::VarDecl>(&decl)) {
+        return var->hasGlobalStorage() &&
+               var->isThisDeclarationADefinition() !=
+                   clang::VarDecl::DeclarationOnly;
+    }
+    return false;
+}
+
+void RestrictedConsumer::HandleTranslationUnit(clang::ASTContext &ctx) {
+    ReferencedDecls referenced;
+    for (const auto decl : decls) {
+        const auto fun = llvm::dyn_cast<clang::FunctionDecl>(decl);
+        if (fun && roots.count(fun->getNameAsString()) > 0) {
+            referenced.add(fun);
+        }
+    }
+    referenced.findReferences();
+    size_t dropped = 0;
+    for (const auto decl : decls) {
+        if (isDefinition(*decl) && !referenced.contains(decl)) {
+            ++dropped;
+            continue;
+        }
+        MultiplexConsumer::HandleTopLevelDecl(clang::DeclGroupRef(decl));
+    }
+    for (const auto var : tentativeDefinitions) {
+        if (referenced.contains(var)) {
+            MultiplexConsumer::CompleteTentativeDefinition(var);
+        }
+    }
+    stats::count("compile.dropped definitions", dropped);
+    MultiplexConsumer::HandleTranslationUnit(ctx);
+}
+
+unique_ptr<clang::ASTConsumer>
+RestrictedCodeGenAction::CreateASTConsumer(CompilerInstance &ci,
+                                           llvm::StringRef inFile) {
+    // The action still owns the code generator through the consumer, so the
+    // module can be taken from the action as usual
+    std::vector<unique_ptr<clang::ASTConsumer>> codeGen;
+    codeGen.push_back(EmitLLVMOnlyAction::CreateASTConsumer(ci, inFile));
+    if (!codeGen.back()) {
+        return nullptr;
+    }
+    return std::make_unique<RestrictedConsumer>(std::move(codeGen), roots);
+}
+
+unique_ptr<CodeGenAction> makeCodeGenAction(const InputOpts &opts) {
+    if (opts.CodeGenRoots.empty()) {
+        return std::make_unique<clang::EmitLLVMOnlyAction>();
+    }
+    return std::make_unique<RestrictedCodeGenAction>(opts.CodeGenRoots);
 }
 
 /// Initialize the argument vector to produce the llvm assembly for
@@ -112,6 +690,10 @@ std::vector<const char *> initializeArgs(const char *exeName, InputOpts &opts) {
         args.push_back("-resource-dir");
         args.push_back(opts.ResourceDir.c_str());
     }
+    if (!opts.PrecompiledHeader.empty()) {
+        args.push_back("-include-pch");
+        args.push_back(opts.PrecompiledHeader.c_str());
+    }
     args.push_back(opts.FileNames.first.c_str());  // add input file
     args.push_back(opts.FileNames.second.c_str()); // add input file
     args.push_back("-fsyntax-only"); // don't do more work than necessary
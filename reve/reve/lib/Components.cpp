@@ -0,0 +1,400 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Components.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+using smt::SharedSMTRef;
+using std::string;
+using std::vector;
+
+namespace {
+// Records what kind of toplevel expression has been visited and which
+// functions it applies
+struct ClassifyVisitor : smt::SMTVisitor {
+    bool isAssert = false;
+    string declaredFunction;
+    llvm::StringSet<> appliedFunctions;
+    // For assertions the function applied in the conclusion of the
+    // (innermost) implication below the quantifiers and lets, i.e. the head
+    // of the clause. This is only a predicate if the head is a single
+    // predicate application.
+    string head;
+    bool handles(smt::ExprTag tag) const override {
+        return tag == smt::ExprTag::Assert || tag == smt::ExprTag::FunDecl ||
+               tag == smt::ExprTag::Op || tag == smt::ExprTag::Let ||
+               tag == smt::ExprTag::Forall;
+    }
+    void dispatch(smt::Assert & /* unused */) override { isAssert = true; }
+    void dispatch(smt::FunDecl &decl) override {
+        declaredFunction = decl.funName;
+    }
+    void dispatch(smt::Op &op) override { appliedFunctions.insert(op.opName); }
+
+    // The heads are computed bottom up, the nodes passed to reassemble are
+    // the copies referenced by their reassembled parents
+    llvm::DenseMap<const smt::SMTExpr *, string> heads;
+    auto headOf(const smt::SMTExpr &expr) const -> string {
+        auto it = heads.find(&expr);
+        return it == heads.end() ? "" : it->second;
+    }
+    SharedSMTRef reassemble(smt::Op &op) override {
+        if (op.opName == "=>" && op.args.size() == 2) {
+            heads[&op] = headOf(*op.args.at(1));
+        } else {
+            heads[&op] = op.opName;
+        }
+        return op.shared_from_this();
+    }
+    SharedSMTRef reassemble(smt::Let &let) override {
+        heads[&let] = headOf(*let.expr);
+        return let.shared_from_this();
+    }
+    SharedSMTRef reassemble(smt::Forall &forall) override {
+        heads[&forall] = headOf(*forall.expr);
+        return forall.shared_from_this();
+    }
+    SharedSMTRef reassemble(smt::Assert &assertion) override {
+        head = headOf(*assertion.expr);
+        heads.clear();
+        return assertion.shared_from_this();
+    }
+};
+
+struct UnionFind {
+    vector<size_t> parent;
+    auto add() -> size_t {
+        parent.push_back(parent.size());
+        return parent.size() - 1;
+    }
+    auto find(size_t i) -> size_t {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+    void unite(size_t i, size_t j) { parent[find(i)] = find(j); }
+};
+}
+
+static const size_t Shared = static_cast<size_t>(-1);
+
+auto assignComponents(const vector<SharedSMTRef> &smtExprs)
+    -> ComponentAssignment {
+    vector<ClassifyVisitor> classified(smtExprs.size());
+    llvm::StringMap<size_t> predicates;
+    UnionFind sets;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        smtExprs[i]->accept(classified[i]);
+        if (!classified[i].declaredFunction.empty()) {
+            predicates.insert({classified[i].declaredFunction, sets.add()});
+        }
+    }
+
+    // The set each toplevel expression belongs to
+    vector<size_t> exprSets(smtExprs.size(), Shared);
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const auto &info = classified[i];
+        if (!info.declaredFunction.empty()) {
+            exprSets[i] = predicates.find(info.declaredFunction)->second;
+        } else if (info.isAssert) {
+            // Clauses without predicates form their own component
+            exprSets[i] = sets.add();
+            for (const auto &fun : info.appliedFunctions) {
+                auto it = predicates.find(fun.getKey());
+                if (it != predicates.end()) {
+                    sets.unite(exprSets[i], it->second);
+                }
+            }
+        }
+    }
+
+    // Number the components in the order of their first assertion, components
+    // without assertions are trivially satisfiable and are dropped
+    vector<size_t> componentIndices(sets.parent.size(), Shared);
+    ComponentAssignment assignment;
+    assignment.ComponentCount = 0;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        if (classified[i].isAssert) {
+            size_t root = sets.find(exprSets[i]);
+            if (componentIndices[root] == Shared) {
+                componentIndices[root] = assignment.ComponentCount++;
+            }
+        }
+    }
+
+    assignment.Components.resize(smtExprs.size());
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        if (exprSets[i] == Shared) {
+            assignment.Components[i] = ComponentAssignment::SharedComponent;
+        } else {
+            size_t component = componentIndices[sets.find(exprSets[i])];
+            if (component == Shared) {
+                assignment.Components[i] = ComponentAssignment::NoComponent;
+            } else {
+                assignment.Components[i] = component;
+            }
+        }
+    }
+    return assignment;
+}
+
+auto splitIndependentComponents(const vector<SharedSMTRef> &smtExprs)
+    -> vector<vector<SharedSMTRef>> {
+    const ComponentAssignment assignment = assignComponents(smtExprs);
+    vector<vector<SharedSMTRef>> components(assignment.ComponentCount);
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const size_t component = assignment.Components[i];
+        if (component == ComponentAssignment::SharedComponent) {
+            for (auto &exprs : components) {
+                exprs.push_back(smtExprs[i]);
+            }
+        } else if (component != ComponentAssignment::NoComponent) {
+            components[component].push_back(smtExprs[i]);
+        }
+    }
+    return components;
+}
+
+auto closedClauseQueries(const vector<SharedSMTRef> &smtExprs)
+    -> vector<vector<SharedSMTRef>> {
+    const ComponentAssignment assignment = assignComponents(smtExprs);
+    vector<ClassifyVisitor> classified(smtExprs.size());
+    llvm::StringSet<> predicates;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        smtExprs[i]->accept(classified[i]);
+        if (!classified[i].declaredFunction.empty()) {
+            predicates.insert(classified[i].declaredFunction);
+        }
+    }
+    auto appliesPredicate = [&](const ClassifyVisitor &info) {
+        for (const auto &fun : info.appliedFunctions) {
+            if (predicates.count(fun.getKey()) > 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    vector<vector<SharedSMTRef>> queries;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        if (!classified[i].isAssert || appliesPredicate(classified[i])) {
+            continue;
+        }
+        vector<SharedSMTRef> query;
+        for (size_t j = 0; j < smtExprs.size(); ++j) {
+            if (j == i || assignment.Components[j] ==
+                              ComponentAssignment::SharedComponent) {
+                query.push_back(smtExprs[j]);
+            }
+        }
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+auto removeIrrelevantClauses(const vector<SharedSMTRef> &smtExprs)
+    -> vector<SharedSMTRef> {
+    vector<ClassifyVisitor> classified(smtExprs.size());
+    llvm::StringSet<> predicates;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        smtExprs[i]->accept(classified[i]);
+        if (!classified[i].declaredFunction.empty()) {
+            predicates.insert(classified[i].declaredFunction);
+        }
+    }
+
+    llvm::StringSet<> relevant;
+    vector<llvm::StringRef> worklist;
+    auto markRelevant = [&](const ClassifyVisitor &info) {
+        for (const auto &fun : info.appliedFunctions) {
+            if (predicates.count(fun.getKey()) > 0 &&
+                relevant.insert(fun.getKey()).second) {
+                worklist.push_back(relevant.find(fun.getKey())->getKey());
+            }
+        }
+    };
+    // Queries and everything else that does not define a single predicate
+    // are the roots of the cone
+    llvm::StringMap<vector<size_t>> clausesWithHead;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const auto &info = classified[i];
+        if (info.isAssert && predicates.count(info.head) > 0) {
+            clausesWithHead[info.head].push_back(i);
+        } else if (info.declaredFunction.empty()) {
+            markRelevant(info);
+        }
+    }
+    while (!worklist.empty()) {
+        llvm::StringRef predicate = worklist.back();
+        worklist.pop_back();
+        auto it = clausesWithHead.find(predicate);
+        if (it != clausesWithHead.end()) {
+            for (size_t i : it->second) {
+                markRelevant(classified[i]);
+            }
+        }
+    }
+
+    vector<SharedSMTRef> result;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const auto &info = classified[i];
+        if (!info.declaredFunction.empty()) {
+            if (relevant.count(info.declaredFunction) == 0) {
+                continue;
+            }
+        } else if (info.isAssert && predicates.count(info.head) > 0 &&
+                   relevant.count(info.head) == 0) {
+            continue;
+        }
+        result.push_back(smtExprs[i]);
+    }
+    return result;
+}
+
+static auto isPredicateDecl(const smt::SMTExpr &expr) -> bool {
+    return expr.getTag() == smt::ExprTag::FunDecl &&
+           static_cast<const smt::FunDecl &>(expr).outType.getTag() ==
+               smt::TypeTag::Bool;
+}
+
+auto orderClauses(const vector<SharedSMTRef> &smtExprs)
+    -> vector<SharedSMTRef> {
+    vector<ClassifyVisitor> classified(smtExprs.size());
+    // The predicates in the order of their declarations
+    vector<size_t> predicateDecls;
+    llvm::StringMap<size_t> predicateIndices;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        smtExprs[i]->accept(classified[i]);
+        if (isPredicateDecl(*smtExprs[i])) {
+            predicateIndices.insert(
+                {classified[i].declaredFunction, predicateDecls.size()});
+            predicateDecls.push_back(i);
+        }
+    }
+    const size_t predicates = predicateDecls.size();
+
+    // An edge from every predicate in the premise of a clause to its head
+    vector<vector<size_t>> successors(predicates);
+    vector<vector<size_t>> definingClauses(predicates);
+    vector<bool> definedByFact(predicates, false);
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const auto &info = classified[i];
+        if (!info.isAssert) {
+            continue;
+        }
+        auto head = predicateIndices.find(info.head);
+        if (head == predicateIndices.end()) {
+            continue;
+        }
+        definingClauses[head->second].push_back(i);
+        bool fact = true;
+        for (const auto &fun : info.appliedFunctions) {
+            auto body = predicateIndices.find(fun.getKey());
+            if (body != predicateIndices.end() &&
+                body->second != head->second) {
+                successors[body->second].push_back(head->second);
+                fact = false;
+            }
+        }
+        if (fact) {
+            definedByFact[head->second] = true;
+        }
+    }
+
+    // Reverse postorder of a depth first search, starting at the predicates
+    // defined by facts. The search uses an explicit stack since the chains
+    // of marks can be long.
+    vector<bool> visited(predicates, false);
+    vector<size_t> postorder;
+    auto search = [&](size_t root) {
+        if (visited[root]) {
+            return;
+        }
+        visited[root] = true;
+        // (predicate, index of the next successor)
+        vector<std::pair<size_t, size_t>> stack = {{root, 0}};
+        while (!stack.empty()) {
+            auto &top = stack.back();
+            if (top.second < successors[top.first].size()) {
+                const size_t next = successors[top.first][top.second++];
+                if (!visited[next]) {
+                    visited[next] = true;
+                    stack.push_back({next, 0});
+                }
+            } else {
+                postorder.push_back(top.first);
+                stack.pop_back();
+            }
+        }
+    };
+    // Roots are searched last to first, so that independent predicates end
+    // up in the order of their declarations
+    for (size_t i = predicates; i-- > 0;) {
+        if (definedByFact[i]) {
+            search(i);
+        }
+    }
+    for (size_t i = predicates; i-- > 0;) {
+        search(i);
+    }
+    const vector<size_t> order(postorder.rbegin(), postorder.rend());
+
+    vector<SharedSMTRef> result;
+    vector<SharedSMTRef> declarations;
+    vector<SharedSMTRef> queries;
+    vector<SharedSMTRef> commands;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const auto &info = classified[i];
+        const smt::ExprTag tag = smtExprs[i]->getTag();
+        if (tag == smt::ExprTag::Comment) {
+            continue;
+        }
+        if (tag == smt::ExprTag::CheckSat || tag == smt::ExprTag::GetModel) {
+            commands.push_back(smtExprs[i]);
+        } else if (isPredicateDecl(*smtExprs[i])) {
+            continue;
+        } else if (info.isAssert) {
+            if (predicateIndices.count(info.head) == 0) {
+                queries.push_back(smtExprs[i]);
+            }
+        } else {
+            result.push_back(smtExprs[i]);
+        }
+    }
+    for (size_t predicate : order) {
+        result.push_back(smtExprs[predicateDecls[predicate]]);
+    }
+    for (size_t predicate : order) {
+        for (size_t clause : definingClauses[predicate]) {
+            result.push_back(smtExprs[clause]);
+        }
+    }
+    result.insert(result.end(), queries.begin(), queries.end());
+    result.insert(result.end(), commands.begin(), commands.end());
+    return result;
+}
+
+auto componentFileName(const string &fileName, const string &part)
+    -> string {
+    size_t dot = fileName.rfind('.');
+    size_t slash = fileName.rfind('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) {
+        return fileName + "." + part;
+    }
+    return fileName.substr(0, dot) + "." + part + fileName.substr(dot);
+}
+
+auto componentFileName(const string &fileName, size_t i) -> string {
+    return componentFileName(fileName, std::to_string(i));
+}
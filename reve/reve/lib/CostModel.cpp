@@ -0,0 +1,199 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "CostModel.h"
+
+#include "Logging.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+
+using smt::SharedSMTRef;
+using std::string;
+using std::vector;
+
+static const char *const CostModelHeader = "llreve-cost-model 1";
+// How far each recorded time moves the prediction towards it
+static const double LearningRate = 0.5;
+
+static auto logFeatures(const vector<size_t> &counts) -> vector<double> {
+    vector<double> features;
+    for (size_t count : counts) {
+        features.push_back(std::log1p(static_cast<double>(count)));
+    }
+    return features;
+}
+
+auto queryFeatures(const vector<SharedSMTRef> &query) -> vector<double> {
+    size_t clauses = 0;
+    size_t predicates = 0;
+    size_t maxArity = 0;
+    size_t heapArguments = 0;
+    for (const auto &expr : query) {
+        if (expr->getTag() == smt::ExprTag::Assert) {
+            ++clauses;
+        } else if (expr->getTag() == smt::ExprTag::FunDecl) {
+            const auto &decl = static_cast<const smt::FunDecl &>(*expr);
+            ++predicates;
+            maxArity = std::max(maxArity, decl.inTypes.size());
+            heapArguments += static_cast<size_t>(std::count_if(
+                decl.inTypes.begin(), decl.inTypes.end(),
+                [](const smt::Type &type) {
+                    return type.getTag() == smt::TypeTag::Array;
+                }));
+        }
+    }
+    return logFeatures({clauses, predicates, maxArity, heapArguments});
+}
+
+auto programFeatures(MonoPair<const llvm::Function *> functions)
+    -> vector<double> {
+    size_t blocks = 0;
+    size_t branches = 0;
+    size_t memoryAccesses = 0;
+    size_t calls = 0;
+    functions.forEach([&](const llvm::Function *fun) {
+        if (fun == nullptr) {
+            return;
+        }
+        for (const auto &block : *fun) {
+            ++blocks;
+            for (const auto &instr : block) {
+                if (const auto branch =
+                        llvm::dyn_cast<llvm::BranchInst>(&instr)) {
+                    branches += branch->isConditional();
+                } else if (llvm::isa<llvm::SwitchInst>(instr)) {
+                    ++branches;
+                } else if (llvm::isa<llvm::LoadInst>(instr) ||
+                           llvm::isa<llvm::StoreInst>(instr)) {
+                    ++memoryAccesses;
+                } else if (llvm::isa<llvm::CallInst>(instr)) {
+                    ++calls;
+                }
+            }
+        }
+    });
+    return logFeatures({blocks, branches, memoryAccesses, calls});
+}
+
+// Reads the models of the file, indexed by their kind. Malformed lines are
+// skipped so a broken file only loses the history.
+static auto readCostModels(const string &fileName)
+    -> std::map<string, vector<double>> {
+    std::map<string, vector<double>> models;
+    std::ifstream file(fileName);
+    string line;
+    if (!file || !std::getline(file, line) || line != CostModelHeader) {
+        return models;
+    }
+    while (std::getline(file, line)) {
+        std::istringstream words(line);
+        string kind;
+        vector<double> weights;
+        double weight;
+        words >> kind;
+        while (words >> weight) {
+            weights.push_back(weight);
+        }
+        if (!kind.empty() && weights.size() == CostFeatureCount + 1 &&
+            words.eof()) {
+            models[kind] = weights;
+        }
+    }
+    return models;
+}
+
+CostModel::CostModel(string fileName, string kind)
+    : fileName(std::move(fileName)), kind(std::move(kind)),
+      weights(CostFeatureCount + 1, 0.5) {
+    weights.front() = 0;
+    if (this->fileName.empty()) {
+        return;
+    }
+    auto models = readCostModels(this->fileName);
+    auto it = models.find(this->kind);
+    if (it != models.end()) {
+        weights = it->second;
+    }
+}
+
+double CostModel::predict(const vector<double> &features) const {
+    const double logTime = std::inner_product(
+        features.begin(), features.end(), weights.begin() + 1, weights.front());
+    return std::expm1(std::max(logTime, 0.0));
+}
+
+// A normalized least mean squares step on the logarithm of the time
+void CostModel::record(const vector<double> &features, double seconds) {
+    const double error = std::log1p(std::max(seconds, 0.0)) -
+                         std::log1p(predict(features));
+    const double norm = 1 + std::inner_product(features.begin(),
+                                               features.end(),
+                                               features.begin(), 0.0);
+    const double step = LearningRate * error / norm;
+    weights.front() += step;
+    for (size_t i = 0; i < features.size(); ++i) {
+        weights[i + 1] += step * features[i];
+    }
+    changed = true;
+    stats::count("cost model.recorded");
+}
+
+void CostModel::save() const {
+    if (fileName.empty() || !changed) {
+        return;
+    }
+    // Other runs may have updated the other models in the meantime
+    auto models = readCostModels(fileName);
+    models[kind] = weights;
+    int fd;
+    llvm::SmallString<128> tmpPath;
+    if (std::error_code errorCode = llvm::sys::fs::createUniqueFile(
+            fileName + ".tmp-%%%%%%", fd, tmpPath)) {
+        logWarning("Couldn’t write the cost model: " + errorCode.message() +
+                   "\n");
+        return;
+    }
+    {
+        llvm::raw_fd_ostream stream(fd, true);
+        stream << CostModelHeader << "\n";
+        for (const auto &model : models) {
+            stream << model.first;
+            for (double weight : model.second) {
+                stream << " " << llvm::format("%.6g", weight);
+            }
+            stream << "\n";
+        }
+    }
+    if (llvm::sys::fs::rename(tmpPath, fileName)) {
+        llvm::sys::fs::remove(tmpPath);
+        logWarning("Couldn’t write the cost model to " + fileName + "\n");
+    }
+}
+
+auto shortestFirst(const vector<double> &costs) -> vector<size_t> {
+    vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+        return costs[i] < costs[j];
+    });
+    return order;
+}
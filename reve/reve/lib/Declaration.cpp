@@ -17,7 +17,7 @@ relationalFunctionDeclarations(MonoPair<const llvm::Function *> functions,
     const string functionName = getFunctionName(functions);
     const auto pathMaps = getPathMaps(functions, analysisResults);
     // TODO Do we need to take the intersection of the pathmaps here?
-    const auto pathMap = pathMaps.first;
+    const auto &pathMap = pathMaps.first;
     const auto returnType = functions.first->getReturnType();
     const auto functionArguments =
         getFunctionArguments(functions, analysisResults);
@@ -40,6 +40,13 @@ relationalFunctionDeclarations(MonoPair<const llvm::Function *> functions,
                          declarations.push_back(std::move(invariants.first));
                          declarations.push_back(std::move(invariants.second));
                      });
+        if (SMTGenerationOpts::getInstance().LinearForbiddenPaths) {
+            declarations.push_back(forbiddenSelectorDeclaration(
+                startIndex,
+                analysisResults.at(functions.second)
+                    .freeVariables.at(startIndex),
+                functionName));
+        }
     }
     return declarations;
 }
@@ -49,7 +56,7 @@ functionalFunctionDeclarations(const llvm::Function *function,
                                const AnalysisResultsMap &analysisResults,
                                Program prog) {
     const string functionName = function->getName().str();
-    const auto pathMap = analysisResults.at(function).paths;
+    const auto &pathMap = analysisResults.at(function).paths;
     const auto returnType = function->getReturnType();
     const auto functionArguments =
         analysisResults.at(function).functionArguments;
@@ -81,7 +88,7 @@ vector<SharedSMTRef> relationalIterativeDeclarations(
     const AnalysisResultsMap &analysisResults) {
     const auto pathMaps = getPathMaps(preprocessedFunctions, analysisResults);
     // TODO Do we need to take the intersection of the pathmaps here?
-    const auto pathMap = pathMaps.first;
+    const auto &pathMap = pathMaps.first;
     const string functionName = getFunctionName(preprocessedFunctions);
     const auto functionArguments =
         getFunctionArguments(preprocessedFunctions, analysisResults);
@@ -109,6 +116,13 @@ vector<SharedSMTRef> relationalIterativeDeclarations(
                 declarations.push_back(foundIt->second);
             }
         }
+        if (SMTGenerationOpts::getInstance().LinearForbiddenPaths) {
+            declarations.push_back(forbiddenSelectorDeclaration(
+                startIndex,
+                analysisResults.at(preprocessedFunctions.second)
+                    .freeVariables.at(startIndex),
+                functionName));
+        }
     }
     return declarations;
 }
@@ -0,0 +1,393 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Distributed.h"
+
+#include "BinaryClauses.h"
+#include "CostModel.h"
+#include "GzipStream.h"
+#include "Logging.h"
+#include "Portfolio.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iterator>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using smt::SharedSMTRef;
+using std::string;
+using std::vector;
+
+using llreve::opts::SerializeOpts;
+
+using Clock = std::chrono::steady_clock;
+
+#ifdef _WIN32
+auto solveDistributed(const vector<string> & /* unused */,
+                      const DistributedOpts & /* unused */,
+                      vector<double> & /* unused */) -> SolverOutput {
+    logError("Distributed solving is not supported on Windows\n");
+    exit(1);
+}
+#else
+namespace {
+// One query that is being solved by a worker
+struct Attempt {
+    size_t Query;
+    // Index into the engines
+    size_t Engine;
+    pid_t Pid;
+    int OutputFd;
+    Clock::time_point Start;
+    Clock::time_point Deadline;
+    string Output;
+};
+
+// A query that still has to be solved together with the next engine
+struct PendingQuery {
+    size_t Query;
+    size_t Engine;
+};
+}
+
+static auto startAttempt(const vector<string> &command, const string &engine,
+                         const string &queryFile, PendingQuery query,
+                         const DistributedOpts &opts) -> Attempt {
+    // Only async-signal-safe functions may be called between fork and exec,
+    // see startEngine in Portfolio.cpp
+    vector<string> args = command;
+    args.push_back("-solve-worker");
+    args.push_back("-worker-engine=" + engine);
+    args.insert(args.end(), opts.WorkerArgs.begin(), opts.WorkerArgs.end());
+    vector<char *> argv;
+    for (const auto &arg : args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    int queryFd = open(queryFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (queryFd < 0) {
+        logError("Could not open " + queryFile + "\n");
+        exit(1);
+    }
+    int fds[2];
+    if (!closeOnExecPipe(fds)) {
+        logError("Could not create pipe for a solver worker\n");
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        logError("Could not start a solver worker\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(queryFd, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(queryFd);
+        close(fds[1]);
+        execvp(argv.front(), argv.data());
+        _exit(127);
+    }
+    close(queryFd);
+    close(fds[1]);
+    stats::count("distributed.attempts");
+    const Clock::time_point start = Clock::now();
+    Clock::time_point deadline = Clock::time_point::max();
+    if (opts.Timeout > 0) {
+        deadline = start + std::chrono::seconds(opts.Timeout);
+    }
+    return {query.Query, query.Engine, pid, fds[0], start, deadline, ""};
+}
+
+static void stopAttempt(Attempt &attempt, bool kill, int *status) {
+    if (kill) {
+        ::kill(attempt.Pid, SIGKILL);
+    }
+    close(attempt.OutputFd);
+    attempt.OutputFd = -1;
+    waitpid(attempt.Pid, status, 0);
+}
+
+// The answer of a worker, the first line is the result and the model follows
+static auto parseWorkerOutput(const string &output) -> SolverOutput {
+    const size_t lineEnd = output.find('\n');
+    const string line = output.substr(0, lineEnd);
+    if (line == "sat") {
+        return {SolverResult::Sat,
+                lineEnd == string::npos ? "" : output.substr(lineEnd + 1)};
+    }
+    if (line == "unsat") {
+        return {SolverResult::Unsat, ""};
+    }
+    return {SolverResult::Unknown, ""};
+}
+
+auto solveDistributed(const vector<string> &queryFiles,
+                      const DistributedOpts &opts,
+                      vector<double> &solveTimes) -> SolverOutput {
+    stats::ScopedTimer timer("distributed");
+    if (opts.Workers.empty() || opts.Engines.empty()) {
+        logError("Distributed solving requires at least one worker and one "
+                 "engine\n");
+        exit(1);
+    }
+    std::deque<PendingQuery> pending;
+    if (opts.Costs.size() == queryFiles.size()) {
+        for (size_t i : shortestFirst(opts.Costs)) {
+            pending.push_back({i, 0});
+        }
+    } else {
+        for (size_t i = 0; i < queryFiles.size(); ++i) {
+            pending.push_back({i, 0});
+        }
+    }
+    vector<SolverOutput> outputs(queryFiles.size(),
+                                 {SolverResult::Unknown, ""});
+    // Attempts on failed workers are not counted
+    vector<double> spentTimes(queryFiles.size(), 0);
+    solveTimes.assign(queryFiles.size(), -1);
+    // The attempt running on each worker
+    vector<llvm::Optional<Attempt>> workers(opts.Workers.size());
+    vector<bool> failedWorkers(opts.Workers.size(), false);
+    bool unsat = false;
+
+    auto isIdle = [&](size_t worker) {
+        return !workers[worker] && !failedWorkers[worker];
+    };
+    auto anyRunning = [&] {
+        return std::any_of(
+            workers.begin(), workers.end(),
+            [](const llvm::Optional<Attempt> &attempt) { return !!attempt; });
+    };
+    while (!unsat && (!pending.empty() || anyRunning())) {
+        for (size_t i = 0; i < workers.size() && !pending.empty(); ++i) {
+            if (isIdle(i)) {
+                PendingQuery query = pending.front();
+                pending.pop_front();
+                workers[i] = startAttempt(
+                    opts.Workers[i], opts.Engines[query.Engine],
+                    queryFiles[query.Query], query, opts);
+            }
+        }
+        if (!anyRunning()) {
+            // All workers failed, the remaining queries stay unknown
+            logWarning("No solver worker left for " +
+                       std::to_string(pending.size()) + " queries\n");
+            break;
+        }
+
+        vector<pollfd> fds;
+        vector<size_t> polled;
+        Clock::time_point now = Clock::now();
+        Clock::time_point nextDeadline = Clock::time_point::max();
+        for (size_t i = 0; i < workers.size(); ++i) {
+            if (workers[i]) {
+                nextDeadline = std::min(nextDeadline, workers[i]->Deadline);
+                fds.push_back({workers[i]->OutputFd, POLLIN, 0});
+                polled.push_back(i);
+            }
+        }
+        int timeout = -1;
+        if (nextDeadline != Clock::time_point::max()) {
+            timeout = static_cast<int>(
+                std::max<Clock::rep>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        nextDeadline - now)
+                        .count(),
+                    0) +
+                1);
+        }
+        if (poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logError("Waiting for the solver workers failed\n");
+            exit(1);
+        }
+        now = Clock::now();
+        for (size_t j = 0; j < polled.size(); ++j) {
+            const size_t worker = polled[j];
+            Attempt &attempt = *workers[worker];
+            const string &engine = opts.Engines[attempt.Engine];
+            int status = 0;
+            SolverOutput output = {SolverResult::Unknown, ""};
+            if (fds[j].revents != 0) {
+                char buffer[4096];
+                ssize_t n = read(attempt.OutputFd, buffer, sizeof(buffer));
+                if (n > 0) {
+                    attempt.Output.append(buffer, static_cast<size_t>(n));
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                stopAttempt(attempt, false, &status);
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    // The worker (or the connection to it) is broken, so the
+                    // same engine is tried again on another worker
+                    logWarning("Solver worker " + std::to_string(worker) +
+                               " failed, not using it anymore\n");
+                    failedWorkers[worker] = true;
+                    pending.push_front({attempt.Query, attempt.Engine});
+                    workers[worker].reset();
+                    continue;
+                }
+                output = parseWorkerOutput(attempt.Output);
+            } else if (attempt.Deadline <= now) {
+                logWarning(engine + " exceeded its time limit on " +
+                           queryFiles[attempt.Query] + "\n");
+                stopAttempt(attempt, true, &status);
+            } else {
+                continue;
+            }
+
+            const PendingQuery query = {attempt.Query, attempt.Engine};
+            spentTimes[query.Query] +=
+                std::chrono::duration<double>(now - attempt.Start).count();
+            workers[worker].reset();
+            if (output.Result == SolverResult::Unknown) {
+                if (query.Engine + 1 < opts.Engines.size()) {
+                    stats::count("distributed.retries");
+                    pending.push_back({query.Query, query.Engine + 1});
+                } else {
+                    solveTimes[query.Query] = spentTimes[query.Query];
+                }
+                continue;
+            }
+            solveTimes[query.Query] = spentTimes[query.Query];
+            llvm::errs() << "Solved " << queryFiles[query.Query] << " by "
+                         << engine << " on worker " << worker << "\n";
+            outputs[query.Query] = output;
+            if (output.Result == SolverResult::Unsat) {
+                unsat = true;
+                break;
+            }
+        }
+    }
+    for (auto &attempt : workers) {
+        if (attempt) {
+            stopAttempt(*attempt, true, nullptr);
+        }
+    }
+
+    if (unsat) {
+        return {SolverResult::Unsat, ""};
+    }
+    SolverOutput combined = {SolverResult::Sat, ""};
+    for (const auto &output : outputs) {
+        if (output.Result != SolverResult::Sat) {
+            return {SolverResult::Unknown, ""};
+        }
+        combined.Model += output.Model;
+    }
+    return combined;
+}
+#endif
+
+static void printWorkerOutput(const SolverOutput &output, std::ostream &out) {
+    switch (output.Result) {
+    case SolverResult::Sat:
+        out << "sat\n" << output.Model;
+        break;
+    case SolverResult::Unsat:
+        out << "unsat\n";
+        break;
+    case SolverResult::Unknown:
+        out << "unknown\n";
+        break;
+    }
+    out.flush();
+}
+
+static auto writeTemporaryFile(const string &suffix, const string &contents,
+                               llvm::SmallString<128> &path) -> bool {
+    int fd;
+    if (std::error_code errorCode = llvm::sys::fs::createTemporaryFile(
+            "llreve-worker", suffix, fd, path)) {
+        logError("Could not create a temporary file: " + errorCode.message() +
+                 "\n");
+        return false;
+    }
+    llvm::raw_fd_ostream stream(fd, true);
+    stream << contents;
+    return true;
+}
+
+auto runSolverWorker(const string &engine, const SerializeOpts &serializeOpts,
+                     std::istream &in, std::ostream &out) -> int {
+    string query((std::istreambuf_iterator<char>(in)),
+                 std::istreambuf_iterator<char>());
+    if (isGzip(query)) {
+        string plain;
+        if (!gunzip(query, plain)) {
+            logError("Cannot decompress the query\n");
+            return 1;
+        }
+        query = std::move(plain);
+    }
+    llvm::SmallString<128> queryFile;
+    if (!writeTemporaryFile("smt2", query, queryFile)) {
+        return 1;
+    }
+    SerializeOpts opts = serializeOpts;
+    SolverOutput output = {SolverResult::Unknown, ""};
+    if (engine == "z3") {
+        smt::HashConsFactory factory;
+        output = solveWithZ3(
+            smt::readClauseFile(queryFile.str().str(), factory), opts);
+    } else {
+        const SolverBackend *backend = findSolverBackend(engine);
+        if (!backend) {
+            logError("Unknown solver engine: " + engine + "\n");
+            llvm::sys::fs::remove(queryFile);
+            return 1;
+        }
+        // The external engines only read SMT-LIB, possibly restricted to the
+        // CHC-COMP format
+        llvm::SmallString<128> smtFile = queryFile;
+        const bool chcComp = backend->format() == BackendFormat::ChcComp;
+        if (smt::isBinaryClauses(query) || chcComp) {
+            smt::HashConsFactory factory;
+            auto clauses = smt::readClauseFile(queryFile.str().str(), factory);
+            if (!writeTemporaryFile("smt2", "", smtFile)) {
+                llvm::sys::fs::remove(queryFile);
+                return 1;
+            }
+            opts.OutputFileName = smtFile.str().str();
+            opts.Compress = false;
+            opts.ChcComp = chcComp;
+            serializeSMT(clauses, false, opts);
+        }
+        PortfolioResult result =
+            runPortfolio({{backend, 0}}, smtFile.str().str());
+        output = {result.Result, result.Model};
+        if (smtFile != queryFile) {
+            llvm::sys::fs::remove(smtFile);
+        }
+    }
+    llvm::sys::fs::remove(queryFile);
+    printWorkerOutput(output, out);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "DuplicateClauses.h"
+
+#include "Statistics.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <algorithm>
+#include <sstream>
+
+using smt::SharedSMTRef;
+using std::string;
+using std::vector;
+
+namespace {
+class Canonicalizer {
+  public:
+    auto canonical(const smt::SMTExpr &expr, string &out) -> bool;
+
+  private:
+    // The canonical names of the bound variables, innermost binding last
+    llvm::StringMap<vector<string>> bound;
+    unsigned depth = 0;
+
+    auto bind(const string &name) -> void;
+    auto unbind(const string &name) -> void;
+    auto variable(const string &name) const -> string;
+};
+}
+
+static string printed(const smt::SMTExpr &expr) {
+    std::ostringstream out;
+    out << *expr.toSExpr();
+    return out.str();
+}
+
+static string printed(const smt::Type &type) {
+    std::ostringstream out;
+    out << *type.toSExpr();
+    return out.str();
+}
+
+void Canonicalizer::bind(const string &name) {
+    bound[name].push_back("!" + std::to_string(depth++));
+}
+
+void Canonicalizer::unbind(const string &name) {
+    --depth;
+    auto it = bound.find(name);
+    it->second.pop_back();
+    if (it->second.empty()) {
+        bound.erase(it);
+    }
+}
+
+string Canonicalizer::variable(const string &name) const {
+    auto it = bound.find(name);
+    return it == bound.end() ? name : it->second.back();
+}
+
+bool Canonicalizer::canonical(const smt::SMTExpr &expr, string &out) {
+    switch (expr.getTag()) {
+    case smt::ExprTag::Assert:
+        out += "(assert ";
+        if (!canonical(*static_cast<const smt::Assert &>(expr).expr, out)) {
+            return false;
+        }
+        out += ")";
+        return true;
+    case smt::ExprTag::Forall: {
+        const auto &forall = static_cast<const smt::Forall &>(expr);
+        out += "(forall (";
+        for (const auto &var : forall.vars) {
+            bind(var.name);
+            out += "(" + variable(var.name) + " " + printed(var.type) + ")";
+        }
+        out += ") ";
+        const bool ok = canonical(*forall.expr, out);
+        for (auto it = forall.vars.rbegin(); it != forall.vars.rend(); ++it) {
+            unbind(it->name);
+        }
+        out += ")";
+        return ok;
+    }
+    case smt::ExprTag::Let: {
+        // The definitions are evaluated outside of the let
+        const auto &let = static_cast<const smt::Let &>(expr);
+        out += "(let (";
+        for (const auto &def : let.defs) {
+            out += "(";
+            if (!canonical(*def.second, out)) {
+                return false;
+            }
+            out += ")";
+        }
+        out += ") ";
+        for (const auto &def : let.defs) {
+            bind(def.first);
+        }
+        const bool ok = canonical(*let.expr, out);
+        for (auto it = let.defs.rbegin(); it != let.defs.rend(); ++it) {
+            unbind(it->first);
+        }
+        out += ")";
+        return ok;
+    }
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        vector<string> args;
+        for (const auto &arg : op.args) {
+            string canonicalArg;
+            if (!canonical(*arg, canonicalArg)) {
+                return false;
+            }
+            args.push_back(std::move(canonicalArg));
+        }
+        if (op.opName == "and" || op.opName == "or") {
+            std::sort(args.begin(), args.end());
+        }
+        out += "(" + variable(op.opName) + (op.instantiate ? "" : "!");
+        for (const auto &arg : args) {
+            out += " " + arg;
+        }
+        out += ")";
+        return true;
+    }
+    case smt::ExprTag::TypedVariable: {
+        const auto &var = static_cast<const smt::TypedVariable &>(expr);
+        out += variable(var.name);
+        return true;
+    }
+    case smt::ExprTag::ConstantString:
+        out += variable(static_cast<const smt::ConstantString &>(expr).value);
+        return true;
+    case smt::ExprTag::ConstantInt:
+    case smt::ExprTag::ConstantBool:
+        out += printed(expr);
+        return true;
+    default:
+        // The remaining nodes may refer to bound variables in a way that is
+        // not renamed here
+        return false;
+    }
+}
+
+bool canonicalForm(const smt::SMTExpr &expr, string &form) {
+    form.clear();
+    Canonicalizer canonicalizer;
+    return canonicalizer.canonical(expr, form);
+}
+
+vector<SharedSMTRef>
+removeDuplicateClauses(const vector<SharedSMTRef> &smtExprs) {
+    llvm::StringSet<> clauses;
+    llvm::StringSet<> declarations;
+    vector<SharedSMTRef> result;
+    size_t removedClauses = 0;
+    size_t removedDeclarations = 0;
+    string form;
+    for (const auto &expr : smtExprs) {
+        if (expr->getTag() == smt::ExprTag::Assert &&
+            canonicalForm(*expr, form) && !clauses.insert(form).second) {
+            ++removedClauses;
+            continue;
+        }
+        if (expr->getTag() == smt::ExprTag::FunDecl &&
+            !declarations.insert(printed(*expr)).second) {
+            ++removedDeclarations;
+            continue;
+        }
+        result.push_back(expr);
+    }
+    stats::count("dedup.clauses", removedClauses);
+    stats::count("dedup.declarations", removedDeclarations);
+    return result;
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "EqualVariables.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+class ValueNumbering {
+  public:
+    auto fresh() -> unsigned { return nextNumber++; }
+    auto number(const llvm::Value *value) -> unsigned;
+    void addInstruction(const llvm::Instruction &inst);
+
+    map<const llvm::Value *, unsigned> numbers;
+
+  private:
+    unsigned nextNumber = 0;
+    // Constants are identified by their textual representation which includes
+    // their type, this also works if the modules use different contexts
+    map<string, unsigned> constants;
+    // Opcode, predicate, result type and the numbers of the operands
+    using Operation = std::tuple<unsigned, unsigned, string, vector<unsigned>>;
+    map<Operation, unsigned> operations;
+};
+}
+
+static auto printed(const llvm::Type &type) -> string {
+    string result;
+    llvm::raw_string_ostream stream(result);
+    stream << type;
+    return stream.str();
+}
+
+static auto printed(const llvm::Constant &constant) -> string {
+    string result;
+    llvm::raw_string_ostream stream(result);
+    stream << constant;
+    return stream.str();
+}
+
+auto ValueNumbering::number(const llvm::Value *value) -> unsigned {
+    auto it = numbers.find(value);
+    if (it != numbers.end()) {
+        return it->second;
+    }
+    // Globals are renamed per program so they could never be equal anyway
+    const auto constant = llvm::dyn_cast<llvm::Constant>(value);
+    if (constant && !llvm::isa<llvm::GlobalValue>(constant)) {
+        auto constantIt = constants.insert({printed(*constant), nextNumber});
+        if (constantIt.second) {
+            ++nextNumber;
+        }
+        return constantIt.first->second;
+    }
+    const unsigned newNumber = fresh();
+    numbers.insert({value, newNumber});
+    return newNumber;
+}
+
+static bool isPureOperation(const llvm::Instruction &inst) {
+    return llvm::isa<llvm::BinaryOperator>(inst) ||
+           llvm::isa<llvm::CmpInst>(inst) || llvm::isa<llvm::CastInst>(inst) ||
+           llvm::isa<llvm::SelectInst>(inst);
+}
+
+void ValueNumbering::addInstruction(const llvm::Instruction &inst) {
+    if (!isPureOperation(inst)) {
+        numbers[&inst] = fresh();
+        return;
+    }
+    vector<unsigned> operands;
+    for (const auto &operand : inst.operands()) {
+        operands.push_back(number(operand));
+    }
+    if (inst.isCommutative()) {
+        std::sort(operands.begin(), operands.end());
+    }
+    unsigned predicate = 0;
+    if (const auto cmp = llvm::dyn_cast<llvm::CmpInst>(&inst)) {
+        predicate = cmp->getPredicate();
+    }
+    const Operation operation{inst.getOpcode(), predicate,
+                              printed(*inst.getType()), operands};
+    auto it = operations.insert({operation, nextNumber});
+    if (it.second) {
+        ++nextNumber;
+    }
+    numbers[&inst] = it.first->second;
+}
+
+auto findEqualVariables(MonoPair<const llvm::Function *> functions,
+                        bool equalArguments) -> map<string, unsigned> {
+    ValueNumbering numbering;
+    if (equalArguments &&
+        functions.first->arg_size() == functions.second->arg_size()) {
+        auto arg2 = functions.second->arg_begin();
+        for (const auto &arg1 : functions.first->args()) {
+            if (printed(*arg1.getType()) == printed(*arg2->getType())) {
+                const unsigned number = numbering.fresh();
+                numbering.numbers.insert({&arg1, number});
+                numbering.numbers.insert({&*arg2, number});
+            }
+            ++arg2;
+        }
+    }
+    // Apart from phi nodes, which are not numbered, the operands of an
+    // instruction are visited before the instruction itself
+    functions.forEach([&numbering](const llvm::Function *fun) {
+        llvm::ReversePostOrderTraversal<const llvm::Function *> blocks(fun);
+        for (const llvm::BasicBlock *block : blocks) {
+            for (const auto &inst : *block) {
+                numbering.addInstruction(inst);
+            }
+        }
+    });
+
+    map<unsigned, unsigned> classSizes;
+    for (const auto &value : numbering.numbers) {
+        if (value.first->hasName()) {
+            ++classSizes[value.second];
+        }
+    }
+    map<string, unsigned> equalVariables;
+    for (const auto &value : numbering.numbers) {
+        if (value.first->hasName() && classSizes[value.second] > 1) {
+            equalVariables.insert({value.first->getName().str(), value.second});
+        }
+    }
+    return equalVariables;
+}
@@ -0,0 +1,286 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "FailureLocalization.h"
+
+#include "Helper.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Function.h"
+
+#include <fstream>
+#include <sstream>
+#include <tuple>
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+using namespace smt;
+using namespace llreve::opts;
+
+// The variables that identify the functions of a negated clause
+static const char *const LocalizationVariables[] = {
+    "MAIN", "PROGRAM_1", "PROGRAM_2", "FUNCTION_1", "FUNCTION_2"};
+
+bool FailingFunctions::operator<(const FailingFunctions &other) const {
+    return std::tie(Main, Function1, Function2) <
+           std::tie(other.Main, other.Function1, other.Function2);
+}
+
+string describeFailingFunctions(const FailingFunctions &failing) {
+    return string(failing.Main ? "main " : "") +
+           (failing.Function1.empty() ? "-" : failing.Function1) + "^" +
+           (failing.Function2.empty() ? "-" : failing.Function2);
+}
+
+MonoPair<map<int, string>>
+functionNamesByNumeral(const SMTGenerationOpts &smtOpts) {
+    MonoPair<map<int, string>> names = {{}, {}};
+    for (const auto &numeral : smtOpts.ReversedFunctionNumerals.first) {
+        names.first[numeral.first] = numeral.second->getName().str();
+    }
+    for (const auto &numeral : smtOpts.ReversedFunctionNumerals.second) {
+        names.second[numeral.first] = numeral.second->getName().str();
+    }
+    return names;
+}
+
+// Every line is "main NAME_1 NAME_2" or "other NAME_1 NAME_2", a missing
+// function is written as "-"
+set<FailingFunctions> readFailingFunctions(const string &fileName) {
+    set<FailingFunctions> failing;
+    std::ifstream file(fileName);
+    string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        string kind, function1, function2;
+        if (!(fields >> kind >> function1 >> function2)) {
+            continue;
+        }
+        failing.insert({kind == "main", function1 == "-" ? "" : function1,
+                        function2 == "-" ? "" : function2});
+    }
+    return failing;
+}
+
+void writeFailingFunctions(const string &fileName,
+                           const set<FailingFunctions> &failing) {
+    std::ofstream file(fileName);
+    if (!file) {
+        logError("Couldn’t open " + fileName + "\n");
+        exit(1);
+    }
+    for (const auto &functions : failing) {
+        file << (functions.Main ? "main" : "other") << " "
+             << (functions.Function1.empty() ? "-" : functions.Function1)
+             << " "
+             << (functions.Function2.empty() ? "-" : functions.Function2)
+             << "\n";
+    }
+}
+
+static auto numeralOf(const map<int, string> &names, const string &name)
+    -> int {
+    for (const auto &numeral : names) {
+        if (numeral.second == name) {
+            return numeral.first;
+        }
+    }
+    return -1;
+}
+
+static auto numeralConstraint(const string &variable, int numeral)
+    -> SharedSMTRef {
+    return makeOp("=", variable,
+                  std::make_unique<ConstantInt>(llvm::APInt(64, numeral)));
+}
+
+static auto boolConstraint(const string &variable, bool value)
+    -> SharedSMTRef {
+    return makeOp("=", variable, std::make_unique<ConstantBool>(value));
+}
+
+// Selects the negated clauses of the given functions, nullptr if none of them
+// exist anymore
+static auto
+selectFunctions(const set<FailingFunctions> &failing,
+                const MonoPair<map<int, string>> &functionNames)
+    -> SharedSMTRef {
+    vector<SharedSMTRef> disjuncts;
+    for (const auto &functions : failing) {
+        const bool program1 = !functions.Function1.empty();
+        const bool program2 = !functions.Function2.empty();
+        vector<SharedSMTRef> conjuncts = {
+            boolConstraint("MAIN", functions.Main),
+            boolConstraint("PROGRAM_1", program1),
+            boolConstraint("PROGRAM_2", program2)};
+        if (program1) {
+            const int numeral =
+                numeralOf(functionNames.first, functions.Function1);
+            if (numeral < 0) {
+                continue;
+            }
+            conjuncts.push_back(numeralConstraint("FUNCTION_1", numeral));
+        }
+        if (program2) {
+            const int numeral =
+                numeralOf(functionNames.second, functions.Function2);
+            if (numeral < 0) {
+                continue;
+            }
+            conjuncts.push_back(numeralConstraint("FUNCTION_2", numeral));
+        }
+        disjuncts.push_back(std::make_unique<Op>("and", conjuncts));
+    }
+    if (disjuncts.empty()) {
+        return nullptr;
+    }
+    return std::make_unique<Op>("or", disjuncts);
+}
+
+// The query with an additional assertion before (check-sat)
+static auto restrictQuery(const vector<SharedSMTRef> &query,
+                          SharedSMTRef restriction)
+    -> vector<SharedSMTRef> {
+    vector<SharedSMTRef> restricted;
+    for (const auto &expr : query) {
+        if (expr->getTag() == ExprTag::CheckSat) {
+            restricted.push_back(std::make_unique<Assert>(restriction));
+        }
+        restricted.push_back(expr);
+    }
+    return restricted;
+}
+
+// Solves the query and blocks the functions of every model until it becomes
+// unsat, so that all failing functions are found
+static auto enumerateFailures(const vector<SharedSMTRef> &query,
+                              const MonoPair<map<int, string>> &functionNames,
+                              const SerializeOpts &opts) -> LocalizedOutput {
+    z3::context cxt;
+    // The inverted query is no Horn problem, z3 picks the logic itself
+    z3::solver solver(cxt);
+    llvm::StringSet<> predicates;
+    const auto clauses = hornClausesToZ3(query, opts, cxt, predicates);
+    if (!clauses) {
+        return {SolverResult::Unknown, {}};
+    }
+    for (const auto &clause : *clauses) {
+        solver.add(clause);
+    }
+
+    LocalizedOutput output = {SolverResult::Unsat, {}};
+    while (true) {
+        stats::count("localization.checks");
+        const z3::check_result result = solver.check();
+        if (result == z3::unsat) {
+            return output;
+        }
+        if (result != z3::sat) {
+            // The failures found so far are still reported, but the
+            // programs cannot be proven equivalent either way
+            output.Result = output.Failing.empty() ? SolverResult::Unknown
+                                                   : SolverResult::Sat;
+            return output;
+        }
+        output.Result = SolverResult::Sat;
+
+        const z3::model model = solver.get_model();
+        map<string, z3::expr> values;
+        map<string, z3::func_decl> decls;
+        for (unsigned i = 0; i < model.num_consts(); ++i) {
+            const z3::func_decl decl = model.get_const_decl(i);
+            const string name = decl.name().str();
+            for (const char *variable : LocalizationVariables) {
+                if (name == variable) {
+                    values.insert({name, model.get_const_interp(decl)});
+                    decls.insert({name, decl});
+                }
+            }
+        }
+        auto isTrue = [&](const string &variable) {
+            auto it = values.find(variable);
+            return it != values.end() &&
+                   Z3_get_bool_value(cxt, it->second) == Z3_L_TRUE;
+        };
+        auto numeral = [&](const string &variable) {
+            int64_t value = -1;
+            auto it = values.find(variable);
+            if (it != values.end()) {
+                Z3_get_numeral_int64(cxt, it->second, &value);
+            }
+            return static_cast<int>(value);
+        };
+        auto name = [](const map<int, string> &names, int numeral) {
+            auto it = names.find(numeral);
+            return it == names.end() ? string("?") : it->second;
+        };
+
+        FailingFunctions failing = {isTrue("MAIN"), "", ""};
+        const bool program1 = isTrue("PROGRAM_1");
+        const bool program2 = isTrue("PROGRAM_2");
+        if (program1) {
+            failing.Function1 =
+                name(functionNames.first, numeral("FUNCTION_1"));
+        }
+        if (program2) {
+            failing.Function2 =
+                name(functionNames.second, numeral("FUNCTION_2"));
+        }
+        if (!output.Failing.insert(failing).second) {
+            // The blocking clause excludes every model seen before
+            logWarning("Failure localization found " +
+                       describeFailingFunctions(failing) + " twice\n");
+            return output;
+        }
+
+        // Unconstrained function numerals are irrelevant for the clauses of
+        // the other program
+        z3::expr block = cxt.bool_val(true);
+        for (const char *variable : LocalizationVariables) {
+            const string var = variable;
+            if ((var == "FUNCTION_1" && !program1) ||
+                (var == "FUNCTION_2" && !program2)) {
+                continue;
+            }
+            auto it = values.find(var);
+            if (it != values.end()) {
+                block = block && decls.at(var)() == it->second;
+            }
+        }
+        solver.add(!block);
+    }
+}
+
+LocalizedOutput
+solveLocalizingFailures(vector<SharedSMTRef> invertedQuery,
+                        const set<FailingFunctions> &previous,
+                        const MonoPair<map<int, string>> &functionNames,
+                        const SerializeOpts &opts) {
+    const SharedSMTRef previouslyFailing =
+        selectFunctions(previous, functionNames);
+    if (!previouslyFailing) {
+        return enumerateFailures(invertedQuery, functionNames, opts);
+    }
+    llvm::errs() << "Checking " << previous.size()
+                 << " previously failing functions first\n";
+    LocalizedOutput output = enumerateFailures(
+        restrictQuery(invertedQuery, previouslyFailing), functionNames, opts);
+    if (output.Result != SolverResult::Unsat) {
+        stats::count("localization.skipped rest");
+        return output;
+    }
+    return enumerateFailures(
+        restrictQuery(invertedQuery, makeOp("not", previouslyFailing)),
+        functionNames, opts);
+}
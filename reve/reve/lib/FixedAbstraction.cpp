@@ -1,11 +1,14 @@
 #include "FixedAbstraction.h"
 
 #include "Compat.h"
+#include "FloatAbstraction.h"
 #include "Helper.h"
 #include "Invariant.h"
 #include "MarkAnalysis.h"
 #include "Opts.h"
 
+#include "llvm/ADT/StringSet.h"
+
 #include <set>
 
 using std::make_unique;
@@ -18,6 +21,11 @@ using namespace llreve::opts;
 
 std::set<uint32_t> getVarArgs(const llvm::Function &fun) {
     std::set<uint32_t> varArgs;
+    // The abstraction functions are not called by any instruction
+    if (isFloatAbstraction(fun)) {
+        varArgs.insert(0);
+        return varArgs;
+    }
     for (auto User : fun.users()) {
         if (const auto callInst = llvm::dyn_cast<llvm::CallInst>(User)) {
             varArgs.insert(callInst->getNumArgOperands() -
@@ -33,8 +41,13 @@ static void appendExternInputArgs(const llvm::Function &fun, Program progIndex,
                                   std::vector<SortedVar> &args) {
     auto funArgs = functionArgs(fun);
     args.insert(args.end(), funArgs.begin(), funArgs.end());
+    if (!passesMemory(fun)) {
+        return;
+    }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        args.emplace_back(heapName(progIndex), memoryType());
+        for (const auto &heap : heapNames(progIndex)) {
+            args.emplace_back(heap, memoryType());
+        }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         args.emplace_back(stackPointerName(progIndex), pointerType());
@@ -54,35 +67,37 @@ static std::vector<SortedVar> externDeclArgs(const llvm::Function &fun1,
     return args;
 }
 
+static bool isAbstractedAsEquivalent(MonoPair<const llvm::Function *> funPair,
+                                     const SMTGenerationOpts &smtOpts) {
+    // The floating point abstraction is always equivalent
+    if (!smtOpts.DisableAutoAbstraction || isFloatAbstraction(*funPair.first)) {
+        return true;
+    }
+    return smtOpts.AssumeEquivalent.find(funPair) !=
+           smtOpts.AssumeEquivalent.end();
+}
+
 void externDeclarations(const llvm::Module &mod1, const llvm::Module &mod2,
                         std::vector<SharedSMTRef> &declarations,
                         std::multimap<string, string> funCondMap) {
-    for (const auto &functionPair :
-         SMTGenerationOpts::getInstance().CoupledFunctions) {
+    const auto &smtOpts = SMTGenerationOpts::getInstance();
+    for (const auto &functionPair : smtOpts.CoupledFunctions) {
         if (hasMutualFixedAbstraction(functionPair)) {
-            if (SMTGenerationOpts::getInstance().DisableAutoAbstraction) {
-                const auto assumeEquivalent =
-                    SMTGenerationOpts::getInstance().AssumeEquivalent;
-                if (assumeEquivalent.find(functionPair) !=
-                    assumeEquivalent.end()) {
-                    auto decls = equivalentExternDecls(
-                        *functionPair.first, *functionPair.second, funCondMap);
-                    declarations.insert(declarations.end(),
-                                        std::make_move_iterator(decls.begin()),
-                                        std::make_move_iterator(decls.end()));
-                } else {
-                    auto decls = notEquivalentExternDecls(*functionPair.first,
-                                                          *functionPair.second);
-                    declarations.insert(declarations.end(),
-                                        std::make_move_iterator(decls.begin()),
-                                        std::make_move_iterator(decls.end()));
-                }
-            } else {
+            const MonoPair<const llvm::Function *> constPair = functionPair;
+            if (isAbstractedAsEquivalent(constPair, smtOpts) &&
+                smtOpts.UnconstrainedExterns.find(constPair) ==
+                    smtOpts.UnconstrainedExterns.end()) {
                 auto decls = equivalentExternDecls(
                     *functionPair.first, *functionPair.second, funCondMap);
                 declarations.insert(declarations.end(),
                                     std::make_move_iterator(decls.begin()),
                                     std::make_move_iterator(decls.end()));
+            } else {
+                auto decls = notEquivalentExternDecls(*functionPair.first,
+                                                      *functionPair.second);
+                declarations.insert(declarations.end(),
+                                    std::make_move_iterator(decls.begin()),
+                                    std::make_move_iterator(decls.end()));
             }
         }
     }
@@ -104,17 +119,23 @@ void externDeclarations(const llvm::Module &mod1, const llvm::Module &mod2,
     }
 }
 
-static SMTRef equalOutputs(std::string functionName,
+static SMTRef equalOutputs(const llvm::Function &fun,
                            std::multimap<string, string> funCondMap) {
     std::vector<SharedSMTRef> equalClauses;
     equalClauses.emplace_back(
         makeOp("=", resultName(Program::First), resultName(Program::Second)));
-    if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        equalClauses.emplace_back(
-            makeOp("=", memoryVariable(heapResultName(Program::First)),
-                   memoryVariable(heapResultName(Program::Second))));
+    const bool memory = passesMemory(fun);
+    if (memory && SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
+        const unsigned regions =
+            SMTGenerationOpts::getInstance().HeapRegionCount;
+        for (unsigned region = 0; region < regions; ++region) {
+            equalClauses.emplace_back(makeOp(
+                "=", memoryVariable(heapResultName(Program::First, region)),
+                memoryVariable(heapResultName(Program::Second, region))));
+        }
     }
-    if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
+    if (memory &&
+        SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         equalClauses.emplace_back(
             makeOp("=", memoryVariable(stackResultName(Program::First)),
                    memoryVariable(stackResultName(Program::Second))));
@@ -123,7 +144,7 @@ static SMTRef equalOutputs(std::string functionName,
 
     std::vector<SharedSMTRef> equalOut;
     // TODO remove dependency on a single name
-    auto range = funCondMap.equal_range(functionName);
+    auto range = funCondMap.equal_range(fun.getName().str());
     for (auto i = range.first; i != range.second; ++i) {
         equalOut.push_back(stringExpr(i->second));
     }
@@ -147,11 +168,18 @@ static SMTRef equalInputs(const llvm::Function &fun1,
                        return makeOp("=", typedVariableFromSortedVar(var1),
                                      typedVariableFromSortedVar(var2));
                    });
+    if (!passesMemory(fun1)) {
+        return make_unique<Op>("and", equal);
+    }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        SharedSMTRef heapInEqual =
-            makeOp("=", memoryVariable(heapName(Program::First)),
-                   memoryVariable(heapName(Program::Second)));
-        equal.push_back(heapInEqual);
+        const unsigned regions =
+            SMTGenerationOpts::getInstance().HeapRegionCount;
+        for (unsigned region = 0; region < regions; ++region) {
+            SharedSMTRef heapInEqual =
+                makeOp("=", memoryVariable(heapName(Program::First, region)),
+                       memoryVariable(heapName(Program::Second, region)));
+            equal.push_back(heapInEqual);
+        }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         SharedSMTRef stackPtrEqual =
@@ -184,7 +212,7 @@ equivalentExternDecls(const llvm::Function &fun1, const llvm::Function &fun2,
                           fun1.getName().str() + "^" + fun2.getName().str(),
                           InvariantAttr::NONE, argNum);
 
-        SMTRef eqOutputs = equalOutputs(fun1.getName(), funCondMap);
+        SMTRef eqOutputs = equalOutputs(fun1, funCondMap);
         SMTRef eqInputs = equalInputs(fun1, fun2, argNum);
         SMTRef body = makeOp("=>", std::move(eqInputs), std::move(eqOutputs));
 
@@ -217,16 +245,76 @@ notEquivalentExternDecls(const llvm::Function &fun1,
     return declarations;
 }
 
+set<MonoPair<const llvm::Function *>>
+lazyExternAbstractions(const SMTGenerationOpts &smtOpts) {
+    set<MonoPair<const llvm::Function *>> pairs;
+    for (const auto &functionPair : smtOpts.CoupledFunctions) {
+        const MonoPair<const llvm::Function *> constPair = functionPair;
+        if (hasMutualFixedAbstraction(functionPair) &&
+            !isFloatAbstraction(*functionPair.first) &&
+            isAbstractedAsEquivalent(constPair, smtOpts)) {
+            pairs.insert(constPair);
+        }
+    }
+    return pairs;
+}
+
+namespace {
+struct AppliedFunctionsVisitor : smt::SMTVisitor {
+    llvm::StringSet<> appliedFunctions;
+    bool handles(smt::ExprTag tag) const override {
+        return tag == smt::ExprTag::Op;
+    }
+    void dispatch(smt::Op &op) override { appliedFunctions.insert(op.opName); }
+};
+}
+
+set<MonoPair<const llvm::Function *>>
+appliedExternAbstractions(const vector<SharedSMTRef> &query,
+                          const set<MonoPair<const llvm::Function *>> &pairs) {
+    AppliedFunctionsVisitor visitor;
+    for (const auto &expr : query) {
+        expr->accept(visitor);
+    }
+    set<MonoPair<const llvm::Function *>> applied;
+    for (const auto &funPair : pairs) {
+        set<uint32_t> varArgs = getVarArgs(*funPair.first);
+        set<uint32_t> varArgs2 = getVarArgs(*funPair.second);
+        varArgs.insert(varArgs2.begin(), varArgs2.end());
+        for (const auto argNum : varArgs) {
+            const string funName = invariantName(
+                ENTRY_MARK, ProgramSelection::Both,
+                funPair.first->getName().str() + "^" +
+                    funPair.second->getName().str(),
+                InvariantAttr::NONE, argNum);
+            if (visitor.appliedFunctions.count(funName) > 0) {
+                applied.insert(funPair);
+                break;
+            }
+        }
+    }
+    return applied;
+}
+
 std::vector<std::unique_ptr<smt::SMTExpr>>
 externFunDecl(const llvm::Function &fun, Program program) {
     std::vector<std::unique_ptr<smt::SMTExpr>> decls;
     set<uint32_t> varArgs = getVarArgs(fun);
     for (auto argNum : varArgs) {
         std::vector<SortedVar> args = functionArgs(fun);
-        if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
+        const bool memory = passesMemory(fun);
+        if (memory &&
+            SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
             args.push_back(SortedVar("HEAP", memoryType()));
+            const unsigned regions =
+                SMTGenerationOpts::getInstance().HeapRegionCount;
+            for (unsigned region = 1; region < regions; ++region) {
+                args.push_back(SortedVar("HEAP_r" + std::to_string(region),
+                                         memoryType()));
+            }
         }
-        if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
+        if (memory &&
+            SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
             args.emplace_back("SP", pointerType());
             args.emplace_back("STACK", memoryType());
         }
@@ -0,0 +1,136 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "FloatAbstraction.h"
+
+#include "Statistics.h"
+#include "UniqueNamePass.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/InstrTypes.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::set;
+using std::string;
+using std::vector;
+
+using namespace llreve::opts;
+
+static const char *const AbstractionPrefix = "__llreve_fp_";
+
+static string abstractionName(unsigned opcode, const llvm::Type *type) {
+    return AbstractionPrefix +
+           string(llvm::Instruction::getOpcodeName(opcode)) +
+           std::to_string(type->getPrimitiveSizeInBits());
+}
+
+static bool isAbstractableOperation(const llvm::Instruction &instr) {
+    return llvm::isa<llvm::BinaryOperator>(instr) &&
+           instr.getType()->isFloatingPointTy();
+}
+
+static llvm::Function *declareAbstraction(llvm::Module &mod, Program prog,
+                                          unsigned opcode, llvm::Type *type) {
+    const string name = abstractionName(opcode, type);
+    if (llvm::Function *fun = mod.getFunction(name)) {
+        return fun;
+    }
+    auto funType = llvm::FunctionType::get(type, {type, type}, false);
+    llvm::Function *fun = llvm::Function::Create(
+        funType, llvm::GlobalValue::ExternalLinkage, name, &mod);
+    fun->setDoesNotAccessMemory();
+    // Same as the names of the other declarations, see preprocessModule
+    std::map<string, int> argNames;
+    for (auto &arg : fun->args()) {
+        makePrefixed(arg, std::to_string(programIndex(prog)), argNames);
+    }
+    return fun;
+}
+
+set<unsigned> declareFloatAbstractions(MonoPair<llvm::Module &> modules,
+                                       SMTGenerationOpts &smtOpts) {
+    // Both modules need the functions of the operations used by either of
+    // them, otherwise they can’t be coupled
+    vector<std::pair<unsigned, llvm::Type *>> operations;
+    set<unsigned> opcodes;
+    modules.forEach([&](llvm::Module &mod) {
+        for (const auto &fun : mod) {
+            for (const auto &block : fun) {
+                for (const auto &instr : block) {
+                    if (isAbstractableOperation(instr)) {
+                        operations.emplace_back(instr.getOpcode(),
+                                                instr.getType());
+                        opcodes.insert(instr.getOpcode());
+                    }
+                }
+            }
+        }
+    });
+    // The modules may have separate contexts, so the types are only compared
+    // by their names
+    std::map<string, std::pair<unsigned, llvm::Type *>> uniqueOperations;
+    for (const auto &operation : operations) {
+        uniqueOperations.insert(
+            {abstractionName(operation.first, operation.second), operation});
+    }
+    for (const auto &operation : uniqueOperations) {
+        const unsigned opcode = operation.second.first;
+        const llvm::Type *type = operation.second.second;
+        llvm::Function *fun1 = declareAbstraction(
+            modules.first, Program::First, opcode,
+            llvm::Type::getPrimitiveType(modules.first.getContext(),
+                                         type->getTypeID()));
+        llvm::Function *fun2 = declareAbstraction(
+            modules.second, Program::Second, opcode,
+            llvm::Type::getPrimitiveType(modules.second.getContext(),
+                                         type->getTypeID()));
+        smtOpts.CoupledFunctions.insert({fun1, fun2});
+    }
+    stats::count("float abstraction.functions", uniqueOperations.size());
+    return opcodes;
+}
+
+const llvm::Function *floatAbstraction(const llvm::Instruction &instr) {
+    const auto &abstractOps = SMTGenerationOpts::getInstance().AbstractFloatOps;
+    if (!isAbstractableOperation(instr) ||
+        abstractOps.find(instr.getOpcode()) == abstractOps.end()) {
+        return nullptr;
+    }
+    return instr.getModule()->getFunction(
+        abstractionName(instr.getOpcode(), instr.getType()));
+}
+
+bool isFloatAbstraction(const llvm::Function &fun) {
+    return fun.isDeclaration() && fun.getName().startswith(AbstractionPrefix);
+}
+
+bool passesMemory(const llvm::Function &fun) {
+    return !isFloatAbstraction(fun);
+}
+
+bool refineFloatAbstraction(set<unsigned> &abstractOps) {
+    const vector<vector<unsigned>> refinements = {
+        {llvm::Instruction::FAdd, llvm::Instruction::FSub},
+        {llvm::Instruction::FMul, llvm::Instruction::FDiv}};
+    for (const auto &opcodes : refinements) {
+        bool refined = false;
+        for (unsigned opcode : opcodes) {
+            refined |= abstractOps.erase(opcode) > 0;
+        }
+        if (refined) {
+            stats::count("float abstraction.refinements");
+            return true;
+        }
+    }
+    return false;
+}
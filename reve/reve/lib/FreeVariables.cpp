@@ -3,6 +3,8 @@
 #include "Helper.h"
 #include "Opts.h"
 
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Instructions.h"
 
 using std::map;
@@ -43,87 +45,162 @@ inline bool operator!=(const FreeVar &lhs, const FreeVar &rhs) {
 
 struct VariablesResult {
     std::set<FreeVar> accessed;
-    std::map<Mark, std::set<FreeVar>> constructed;
+    MarkMap<std::set<FreeVar>> constructed;
 };
 
 static FreeVar llvmValToFreeVar(const llvm::Value *val) {
     return {llvmValToSortedVar(val), val->getType()};
 }
 
-static void freeVarsInBlock(llvm::BasicBlock &block,
-                            const llvm::BasicBlock *prev,
-                            set<FreeVar> &freeVars, set<FreeVar> &constructed) {
+namespace {
+// The variables used and defined by the blocks of a function as bitsets over
+// dense value numbers. A block occurs on many paths but its summary only has
+// to be computed once for every predecessor it is entered from.
+class BlockSummaries {
+  public:
+    // The values used in 'block' when it is entered from 'prev' which are not
+    // defined before in the block itself. 'prev' is nullptr for the first
+    // block of a path, phi nodes are free in that case.
+    auto uses(const llvm::BasicBlock &block, const llvm::BasicBlock *prev)
+        -> const llvm::BitVector &;
+    // The values defined in 'block'
+    auto defs(const llvm::BasicBlock &block) -> const llvm::BitVector &;
+    auto toFreeVars(const llvm::BitVector &vars) const -> std::set<FreeVar>;
+
+  private:
+    llvm::DenseMap<const llvm::Value *, unsigned> ids;
+    vector<const llvm::Value *> values;
+    llvm::DenseMap<std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>,
+                   llvm::BitVector>
+        useSummaries;
+    llvm::DenseMap<const llvm::BasicBlock *, llvm::BitVector> defSummaries;
+
+    auto id(const llvm::Value *val) -> unsigned;
+    static void addVar(llvm::BitVector &vars, unsigned id);
+};
+}
+
+auto BlockSummaries::id(const llvm::Value *val) -> unsigned {
+    auto it = ids.insert({val, static_cast<unsigned>(values.size())});
+    if (it.second) {
+        values.push_back(val);
+    }
+    return it.first->second;
+}
+
+// The bitsets only grow as far as needed since values are numbered in the
+// order they are encountered. The BitVector operations handle different sizes.
+void BlockSummaries::addVar(llvm::BitVector &vars, unsigned id) {
+    if (vars.size() <= id) {
+        vars.resize(id + 1);
+    }
+    vars.set(id);
+}
+
+auto BlockSummaries::uses(const llvm::BasicBlock &block,
+                          const llvm::BasicBlock *prev)
+    -> const llvm::BitVector & {
+    auto it = useSummaries.find({&block, prev});
+    if (it != useSummaries.end()) {
+        return it->second;
+    }
+    llvm::BitVector used;
+    llvm::BitVector constructed;
     for (auto &instr : block) {
-        constructed.insert(llvmValToFreeVar(&instr));
+        addVar(constructed, id(&instr));
+        auto isConstructed = [&](const llvm::Value *val) {
+            unsigned valId = id(val);
+            return valId < constructed.size() && constructed.test(valId);
+        };
         if (const auto phiInst = llvm::dyn_cast<llvm::PHINode>(&instr)) {
             if (prev == nullptr) {
                 // This is needed for phi nodes in a marked block since we can’t
                 // resolve theme here
-                freeVars.insert(llvmValToFreeVar(&instr));
+                addVar(used, id(&instr));
             } else {
                 const auto incoming = phiInst->getIncomingValueForBlock(prev);
-                if (constructed.find(llvmValToFreeVar(incoming)) ==
-                        constructed.end() &&
-                    !incoming->getName().empty() &&
-                    !llvm::isa<llvm::BasicBlock>(incoming)) {
-                    freeVars.insert(llvmValToFreeVar(incoming));
+                if (!incoming->getName().empty() &&
+                    !llvm::isa<llvm::BasicBlock>(incoming) &&
+                    !isConstructed(incoming)) {
+                    addVar(used, id(incoming));
                 }
             }
         } else {
             for (const auto op : instr.operand_values()) {
-                if (llvm::isa<llvm::Instruction>(op) ||
-                    llvm::isa<llvm::Argument>(op)) {
-                    if (constructed.find(llvmValToFreeVar(op)) ==
-                            constructed.end() &&
-                        !op->getName().empty() &&
-                        !llvm::isa<llvm::BasicBlock>(op) &&
-                        !llvm::isa<llvm::GlobalValue>(op)) {
-                        freeVars.insert(llvmValToFreeVar(op));
-                    }
+                if ((llvm::isa<llvm::Instruction>(op) ||
+                     llvm::isa<llvm::Argument>(op)) &&
+                    !op->getName().empty() && !isConstructed(op)) {
+                    addVar(used, id(op));
                 }
             }
         }
     }
+    return useSummaries.insert({{&block, prev}, std::move(used)})
+        .first->second;
 }
+
+auto BlockSummaries::defs(const llvm::BasicBlock &block)
+    -> const llvm::BitVector & {
+    auto it = defSummaries.find(&block);
+    if (it != defSummaries.end()) {
+        return it->second;
+    }
+    llvm::BitVector defined;
+    for (auto &instr : block) {
+        addVar(defined, id(&instr));
+    }
+    return defSummaries.insert({&block, std::move(defined)}).first->second;
+}
+
+auto BlockSummaries::toFreeVars(const llvm::BitVector &vars) const
+    -> std::set<FreeVar> {
+    std::set<FreeVar> freeVars;
+    for (int i = vars.find_first(); i != -1; i = vars.find_next(i)) {
+        freeVars.insert(llvmValToFreeVar(values[i]));
+    }
+    return freeVars;
+}
+
 /// Collect the free variables for all paths starting at some mark
-static VariablesResult freeVarsOnPaths(map<Mark, Paths> pathMap) {
-    set<FreeVar> freeVars;
-    map<Mark, set<FreeVar>> constructedIntersection;
+static VariablesResult freeVarsOnPaths(const MarkMap<Paths> &pathMap,
+                                       BlockSummaries &summaries) {
+    llvm::BitVector freeVars;
+    MarkMap<llvm::BitVector> constructedIntersection;
+    llvm::BitVector freeOnBlock;
     for (const auto &paths : pathMap) {
         for (const auto &path : paths.second) {
             const llvm::BasicBlock *prev = path.Start;
-            set<FreeVar> constructed;
-
-            freeVarsInBlock(*path.Start, nullptr, freeVars, constructed);
+            llvm::BitVector constructed = summaries.defs(*path.Start);
+            freeVars |= summaries.uses(*path.Start, nullptr);
 
             // now deal with the rest
             for (const auto &edge : path.Edges) {
-                freeVarsInBlock(*edge.Block, prev, freeVars, constructed);
+                freeOnBlock = summaries.uses(*edge.Block, prev);
+                freeOnBlock.reset(constructed);
+                freeVars |= freeOnBlock;
+                constructed |= summaries.defs(*edge.Block);
                 prev = edge.Block;
             }
 
             // A variable is constructed on a way to a mark if it is constructed
             // on all paths. We thus have to take the intersection of the
             // constructed variables.
-            set<FreeVar> newConstructedIntersection;
-            if (constructedIntersection.find(paths.first) ==
-                constructedIntersection.end()) {
+            auto it = constructedIntersection.find(paths.first);
+            if (it == constructedIntersection.end()) {
                 constructedIntersection.insert(
-                    make_pair(paths.first, constructed));
-                ;
+                    std::make_pair(paths.first, std::move(constructed)));
             } else {
-                std::set_intersection(
-                    constructed.begin(), constructed.end(),
-                    constructedIntersection.at(paths.first).begin(),
-                    constructedIntersection.at(paths.first).end(),
-                    inserter(newConstructedIntersection,
-                             newConstructedIntersection.begin()));
-                constructedIntersection.insert(
-                    make_pair(paths.first, newConstructedIntersection));
+                it->second &= constructed;
             }
         }
     }
-    return {freeVars, constructedIntersection};
+    VariablesResult result;
+    result.accessed = summaries.toFreeVars(freeVars);
+    for (const auto &it : constructedIntersection) {
+        result.constructed.insert(
+            {it.first, summaries.toFreeVars(it.second)});
+    }
+    return result;
 }
 
 static set<SortedVar> addMemoryLocations(const set<FreeVar> &freeVars) {
@@ -142,7 +219,9 @@ auto addMemoryArrays(vector<smt::SortedVar> vars, Program prog)
     -> vector<smt::SortedVar> {
     int index = programIndex(prog);
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        vars.push_back(SortedVar(heapName(index), memoryType()));
+        for (const auto &heap : heapNames(prog)) {
+            vars.push_back(SortedVar(heap, memoryType()));
+        }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         vars.push_back(SortedVar(stackPointerName(index), pointerType()));
@@ -150,25 +229,52 @@ auto addMemoryArrays(vector<smt::SortedVar> vars, Program prog)
     }
     return vars;
 }
-FreeVarsMap freeVars(PathMap map, vector<smt::SortedVar> funArgs,
-                     Program prog) {
-    std::map<Mark, set<SortedVar>> freeVarsMap;
-    FreeVarsMap freeVarsMapVect;
-    std::map<Mark, std::map<Mark, set<SortedVar>>> constructed;
-    for (const auto &it : map) {
-        const Mark index = it.first;
-        auto freeVarsResult = freeVarsOnPaths(map.at(index));
 
-        const auto accessed = addMemoryLocations(freeVarsResult.accessed);
-        freeVarsMap.insert(make_pair(index, accessed));
+static auto localFreeVarsOf(const MarkMap<Paths> &paths,
+                            BlockSummaries &summaries) -> LocalFreeVars {
+    auto freeVarsResult = freeVarsOnPaths(paths, summaries);
+    LocalFreeVars locals;
+    locals.accessed = addMemoryLocations(freeVarsResult.accessed);
+    for (const auto &it : freeVarsResult.constructed) {
+        locals.constructed.insert({it.first, addMemoryLocations(it.second)});
+    }
+    return locals;
+}
 
-        std::map<Mark, set<SortedVar>> constructedVarsMap;
-        for (const auto &it : freeVarsResult.constructed) {
-            const auto constructedVars = addMemoryLocations(it.second);
-            constructedVarsMap.insert({it.first, constructedVars});
+auto localFreeVars(const PathMap &map) -> LocalFreeVarsMap {
+    LocalFreeVarsMap locals;
+    BlockSummaries summaries;
+    for (const auto &it : map) {
+        locals.insert({it.first, localFreeVarsOf(it.second, summaries)});
+    }
+    return locals;
+}
+
+void updateLocalFreeVars(const PathMap &map, const std::set<Mark> &marks,
+                         LocalFreeVarsMap &locals) {
+    // The summaries of changed blocks would be outdated, so they are only
+    // shared by the marks that are computed again
+    BlockSummaries summaries;
+    for (Mark mark : marks) {
+        locals.erase(mark);
+        auto it = map.find(mark);
+        if (it != map.end()) {
+            locals.insert({mark, localFreeVarsOf(it->second, summaries)});
         }
+    }
+}
 
-        constructed.insert(make_pair(index, constructedVarsMap));
+FreeVarsMap freeVars(const PathMap &map, const vector<smt::SortedVar> &funArgs,
+                     Program prog) {
+    return freeVars(localFreeVars(map), funArgs, prog);
+}
+
+FreeVarsMap freeVars(const LocalFreeVarsMap &locals,
+                     const vector<smt::SortedVar> &funArgs, Program prog) {
+    MarkMap<set<SortedVar>> freeVarsMap;
+    FreeVarsMap freeVarsMapVect;
+    for (const auto &it : locals) {
+        freeVarsMap.insert({it.first, it.second.accessed});
     }
 
     freeVarsMap[EXIT_MARK] = {};
@@ -183,13 +289,12 @@ FreeVarsMap freeVars(PathMap map, vector<smt::SortedVar> funArgs,
     bool changed = true;
     while (changed) {
         changed = false;
-        for (const auto &it : map) {
+        for (const auto &it : locals) {
             const Mark startIndex = it.first;
-            for (const auto &itInner : it.second) {
+            for (const auto &itInner : it.second.constructed) {
                 const Mark endIndex = itInner.first;
-                for (auto var : freeVarsMap.at(endIndex)) {
-                    if (constructed.at(startIndex).at(endIndex).find(var) ==
-                        constructed.at(startIndex).at(endIndex).end()) {
+                for (const auto &var : freeVarsMap.at(endIndex)) {
+                    if (itInner.second.find(var) == itInner.second.end()) {
                         const auto inserted =
                             freeVarsMap.at(startIndex).insert(var);
                         changed = changed || inserted.second;
@@ -199,13 +304,10 @@ FreeVarsMap freeVars(PathMap map, vector<smt::SortedVar> funArgs,
         }
     }
 
-    for (auto it : freeVarsMap) {
+    for (const auto &it : freeVarsMap) {
         const Mark index = it.first;
-        vector<smt::SortedVar> varsVect;
-        for (const auto &var : it.second) {
-            varsVect.push_back(var);
-        }
-        freeVarsMapVect[index] = addMemoryArrays(varsVect, prog);
+        vector<smt::SortedVar> varsVect(it.second.begin(), it.second.end());
+        freeVarsMapVect[index] = addMemoryArrays(std::move(varsVect), prog);
     }
 
     // The input arguments should be in the function argument order so we can’t
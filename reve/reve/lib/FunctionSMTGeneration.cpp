@@ -12,16 +12,25 @@
 
 #include "Compat.h"
 #include "Declaration.h"
+#include "FloatAbstraction.h"
 #include "FreeVariables.h"
+#include "HashCons.h"
 #include "Invariant.h"
+#include "MergedPaths.h"
 #include "ModuleSMTGeneration.h"
 #include "Opts.h"
+#include "PathRelations.h"
+#include "Statistics.h"
 
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/Operator.h"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 
 using llvm::CmpInst;
 
@@ -38,9 +47,12 @@ using std::vector;
 using namespace smt;
 using namespace llreve::opts;
 
-vector<std::unique_ptr<smt::SMTExpr>>
+vector<SharedSMTRef>
 relationalFunctionAssertions(MonoPair<const llvm::Function *> functions,
                              const AnalysisResultsMap &analysisResults) {
+    stats::ScopedTimer timer("generate.relational");
+    // The same blocks occur on the synchronized, forbidden and stutter paths
+    BlockAssignmentCache assignmentCache;
     const auto pathMaps = getPathMaps(functions, analysisResults);
     checkPathMaps(pathMaps.first, pathMaps.second);
     const auto marked = getBlockMarkMaps(functions, analysisResults);
@@ -59,8 +71,9 @@ relationalFunctionAssertions(MonoPair<const llvm::Function *> functions,
                 freeVarsMap);
         });
 
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> smtExprs;
+    map<MarkPair, vector<SharedSMTRef>> smtExprs;
     for (auto &it : synchronizedPaths) {
+        stats::count("clauses.synchronized", it.second.size());
         for (auto &path : it.second) {
             auto clause = forallStartingAt(
                 std::move(path), freeVarsMap.at(it.first.startMark),
@@ -72,6 +85,7 @@ relationalFunctionAssertions(MonoPair<const llvm::Function *> functions,
     auto forbiddenPaths = getForbiddenPaths(pathMaps, marked, freeVarsMap1,
                                             freeVarsMap2, funName, false);
     for (auto &it : forbiddenPaths) {
+        stats::count("clauses.forbidden", it.second.size());
         for (auto &path : it.second) {
             auto clause = forallStartingAt(
                 std::move(path), freeVarsMap.at(it.first), it.first,
@@ -85,6 +99,7 @@ relationalFunctionAssertions(MonoPair<const llvm::Function *> functions,
         auto stutterPaths = getStutterPaths(pathMaps.first, pathMaps.second,
                                             freeVarsMap, funName, false);
         for (auto &it : stutterPaths) {
+            stats::count("clauses.stutter", it.second.size());
             for (auto &path : it.second) {
                 auto clause = forallStartingAt(
                     std::move(path), freeVarsMap.at(it.first.startMark),
@@ -103,9 +118,12 @@ relationalFunctionAssertions(MonoPair<const llvm::Function *> functions,
 // the main function that we want to check doesn’t need the output
 // parameters in
 // the assertions since it is never called
-vector<std::unique_ptr<smt::SMTExpr>>
+vector<SharedSMTRef>
 relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
                               const AnalysisResultsMap &analysisResults) {
+    stats::ScopedTimer timer("generate.iterative");
+    // The same blocks occur on the synchronized, forbidden and stutter paths
+    BlockAssignmentCache assignmentCache;
     const auto pathMaps = getPathMaps(functions, analysisResults);
     checkPathMaps(pathMaps.first, pathMaps.second);
     const auto marked = getBlockMarkMaps(functions, analysisResults);
@@ -115,9 +133,9 @@ relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
     const auto freeVarsMap1 = analysisResults.at(functions.first).freeVariables;
     const auto freeVarsMap2 =
         analysisResults.at(functions.second).freeVariables;
-    vector<std::unique_ptr<smt::SMTExpr>> smtExprs;
+    vector<SharedSMTRef> smtExprs;
 
-    if (SMTGenerationOpts::getInstance().OnlyRecursive ==
+    if (SMTGenerationOpts::getInstance().MainEncoding ==
         FunctionEncoding::OnlyRecursive) {
         smtExprs.push_back(equalInputsEqualOutputs(
             freeVarsMap1.at(ENTRY_MARK), freeVarsMap2.at(ENTRY_MARK),
@@ -128,7 +146,7 @@ relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
     auto synchronizedPaths = getSynchronizedPaths(
         pathMaps.first, pathMaps.second, freeVarsMap1, freeVarsMap2,
         [&freeVarsMap, funName](Mark startIndex, Mark endIndex) {
-            SMTRef endInvariant = iterativeCouplingPredicate(
+            SharedSMTRef endInvariant = iterativeCouplingPredicate(
                 endIndex, freeVarsMap.at(endIndex), funName);
             if (SMTGenerationOpts::getInstance().OutputFormat ==
                     SMTFormat::Z3 &&
@@ -148,8 +166,9 @@ relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
                                             std::move(stutterPaths));
     }
 
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> clauses;
+    map<MarkPair, vector<SharedSMTRef>> clauses;
     for (auto &it : synchronizedPaths) {
+        stats::count("clauses.synchronized", it.second.size());
         for (auto &path : it.second) {
             auto clause = forallStartingAt(
                 std::move(path), freeVarsMap.at(it.first.startMark),
@@ -161,6 +180,7 @@ relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
     auto forbiddenPaths = getForbiddenPaths(pathMaps, marked, freeVarsMap1,
                                             freeVarsMap2, funName, true);
     for (auto &it : forbiddenPaths) {
+        stats::count("clauses.forbidden", it.second.size());
         for (auto &path : it.second) {
             auto clause = forallStartingAt(
                 std::move(path), freeVarsMap.at(it.first), it.first,
@@ -174,6 +194,60 @@ relationalIterativeAssertions(MonoPair<const llvm::Function *> functions,
                                    getFunctionNumeralConstraints(functions));
 }
 
+// Array arguments make the invariants much harder to find than integers
+static const uint64_t ArrayArgumentCost = 4;
+
+static uint64_t argumentCost(const vector<SortedVar> &vars) {
+    uint64_t cost = 0;
+    for (const auto &var : vars) {
+        cost += isArray(var.type) ? ArrayArgumentCost : 1;
+    }
+    return cost;
+}
+
+FunctionEncoding
+chooseFunctionEncoding(MonoPair<const llvm::Function *> functions,
+                       const AnalysisResultsMap &analysisResults) {
+    const auto pathMaps = getPathMaps(functions, analysisResults);
+    const auto freeVarsMap = getFreeVarsMap(functions, analysisResults);
+    // The return values and heaps at the exit of both programs
+    uint64_t resultCost = 2;
+    if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
+        resultCost += ArrayArgumentCost *
+                      (heapResultNames(Program::First).size() +
+                       heapResultNames(Program::Second).size());
+    }
+    uint64_t iterativeCost = 0;
+    uint64_t recursiveCost = 0;
+    for (const auto &start : pathMaps.first) {
+        const Mark mark = start.first;
+        auto start2 = pathMaps.second.find(mark);
+        if (start2 == pathMaps.second.end()) {
+            continue;
+        }
+        uint64_t pathPairs = 0;
+        for (const auto &paths1 : start.second) {
+            auto paths2 = start2->second.find(paths1.first);
+            if (paths2 != start2->second.end()) {
+                pathPairs += paths1.second.size() * paths2->second.size();
+            }
+        }
+        const uint64_t argsCost = argumentCost(freeVarsMap.at(mark));
+        iterativeCost += argsCost * pathPairs;
+        recursiveCost += (argsCost + resultCost) * pathPairs;
+    }
+    // Recursive calls of the main functions are abstracted by the recursive
+    // invariants, so the iterative encoding contains both
+    if (callsTransitively(*functions.first, *functions.first) &&
+        callsTransitively(*functions.second, *functions.second)) {
+        iterativeCost += recursiveCost;
+    }
+    stats::count("encoding.cost iterative", iterativeCost);
+    stats::count("encoding.cost recursive", recursiveCost);
+    return recursiveCost < iterativeCost ? FunctionEncoding::OnlyRecursive
+                                         : FunctionEncoding::Iterative;
+}
+
 /* --------------------------------------------------------------------------
  */
 // Generate SMT for all paths
@@ -183,9 +257,37 @@ static void addSynchronizedPaths(
     const std::vector<Path> &paths2, const FreeVarsMap &freeVarsMap1,
     const FreeVarsMap &freeVarsMap2,
     ReturnInvariantGenerator generateReturnInvariant,
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> &clauses) {
+    map<MarkPair, vector<SharedSMTRef>> &clauses) {
+    if (shouldMergePaths(paths1, paths2)) {
+        bool returnPath = endMark == EXIT_MARK;
+        clauses[{startMark, endMark}].push_back(mergedPathsSMT(
+            paths1, Program::First, freeVarsMap1.at(startMark), returnPath,
+            [&](llvm::BasicBlock * /* unused */) {
+                return mergedPathsSMT(
+                    paths2, Program::Second, freeVarsMap2.at(startMark),
+                    returnPath, [&](llvm::BasicBlock * /* unused */) {
+                        return generateReturnInvariant(startMark, endMark);
+                    });
+            }));
+        return;
+    }
+    vector<SortedVar> endVars = freeVarsMap1.at(endMark);
+    const auto &endVars2 = freeVarsMap2.at(endMark);
+    endVars.insert(endVars.end(), endVars2.begin(), endVars2.end());
     for (const auto &path1 : paths1) {
         for (const auto &path2 : paths2) {
+            SharedSMTRef relation1 = pathRelation(
+                path1, Program::First, startMark, endMark,
+                freeVarsMap1.at(startMark), freeVarsMap1.at(endMark));
+            SharedSMTRef relation2 = pathRelation(
+                path2, Program::Second, startMark, endMark,
+                freeVarsMap2.at(startMark), freeVarsMap2.at(endMark));
+            if (relation1 && relation2) {
+                clauses[{startMark, endMark}].push_back(assumePathRelations(
+                    {relation1, relation2}, endVars,
+                    generateReturnInvariant(startMark, endMark)));
+                continue;
+            }
             bool returnPath = endMark == EXIT_MARK;
             const auto assignments1 = assignmentsOnPath(
                 path1, Program::First, freeVarsMap1.at(startMark), returnPath);
@@ -198,12 +300,32 @@ static void addSynchronizedPaths(
     }
 }
 
-map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>>
-getSynchronizedPaths(const PathMap &pathMap1, const PathMap &pathMap2,
+// Drops the paths whose conditions contradict each other. Clauses for these
+// paths and every combination with a path of the other program are trivially
+// true, so there is no need to generate them.
+static PathMap feasiblePaths(const PathMap &pathMap) {
+    PathMap feasible = PathMap::sharingConditions(pathMap);
+    for (const auto &pathMapIt : pathMap) {
+        auto &feasibleFrom = feasible[pathMapIt.first];
+        for (const auto &innerPathMapIt : pathMapIt.second) {
+            auto &feasibleTo = feasibleFrom[innerPathMapIt.first];
+            std::copy_if(innerPathMapIt.second.begin(),
+                         innerPathMapIt.second.end(),
+                         std::back_inserter(feasibleTo),
+                         [](const Path &path) { return isFeasible(path); });
+        }
+    }
+    return feasible;
+}
+
+map<MarkPair, vector<SharedSMTRef>>
+getSynchronizedPaths(const PathMap &allPaths1, const PathMap &allPaths2,
                      const FreeVarsMap &freeVarsMap1,
                      const FreeVarsMap &freeVarsMap2,
                      ReturnInvariantGenerator generateReturnInvariant) {
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> clauses;
+    const PathMap pathMap1 = feasiblePaths(allPaths1);
+    const PathMap pathMap2 = feasiblePaths(allPaths2);
+    map<MarkPair, vector<SharedSMTRef>> clauses;
     for (const auto &pathMapIt : pathMap1) {
         const Mark startIndex = pathMapIt.first;
         for (const auto &innerPathMapIt : pathMapIt.second) {
@@ -212,6 +334,9 @@ getSynchronizedPaths(const PathMap &pathMap1, const PathMap &pathMap2,
                 pathMap2.at(startIndex).end()) {
                 const auto &paths1 = innerPathMapIt.second;
                 const auto &paths2 = pathMap2.at(startIndex).at(endIndex);
+                if (paths1.empty() || paths2.empty()) {
+                    continue;
+                }
                 addSynchronizedPaths(startIndex, endIndex, paths1, paths2,
                                      freeVarsMap1, freeVarsMap2,
                                      generateReturnInvariant, clauses);
@@ -222,54 +347,228 @@ getSynchronizedPaths(const PathMap &pathMap1, const PathMap &pathMap2,
     return clauses;
 }
 
+static bool isForbiddenPair(Mark startIndex, Mark endIndex1, Mark endIndex2,
+                            llvm::BasicBlock *endBlock1,
+                            llvm::BasicBlock *endBlock2,
+                            MonoPairView<BidirBlockMarkMap> marked) {
+    const auto endIndices =
+        makeMonoPair(marked.first.BlockToMarksMap.at(endBlock1),
+                     marked.second.BlockToMarksMap.at(endBlock2));
+    return intersection(endIndices.first, endIndices.second).empty() &&
+           (SMTGenerationOpts::getInstance().PerfectSync ==
+                PerfectSynchronization::Enabled ||
+            (startIndex != endIndex1 && // no cycles
+             startIndex != endIndex2));
+}
+
 static void addForbiddenPaths(
     Mark startIndex, Mark endIndex1, Mark endIndex2,
     const std::vector<Path> &paths1, const std::vector<Path> &paths2,
     const FreeVarsMap &freeVarsMap1, const FreeVarsMap &freeVarsMap2,
-    const MonoPair<BidirBlockMarkMap> &marked,
-    map<Mark, vector<std::unique_ptr<smt::SMTExpr>>> &pathExprs) {
+    MonoPairView<BidirBlockMarkMap> marked,
+    map<Mark, vector<SharedSMTRef>> &pathExprs) {
+    auto isForbidden = [&](llvm::BasicBlock *endBlock1,
+                           llvm::BasicBlock *endBlock2) {
+        return isForbiddenPair(startIndex, endIndex1, endIndex2, endBlock1,
+                               endBlock2, marked);
+    };
+    if (shouldMergePaths(paths1, paths2)) {
+        bool anyForbidden = false;
+        for (const Path &path1 : paths1) {
+            for (const Path &path2 : paths2) {
+                anyForbidden = anyForbidden ||
+                               isForbidden(lastBlock(path1), lastBlock(path2));
+            }
+        }
+        if (!anyForbidden) {
+            return;
+        }
+        pathExprs[startIndex].push_back(mergedPathsSMT(
+            paths1, Program::First, freeVarsMap1.at(startIndex),
+            endIndex1 == EXIT_MARK, [&](llvm::BasicBlock *endBlock1) {
+                return mergedPathsSMT(
+                    paths2, Program::Second, freeVarsMap2.at(startIndex),
+                    endIndex2 == EXIT_MARK,
+                    [&](llvm::BasicBlock *endBlock2) -> SharedSMTRef {
+                        return make_unique<ConstantBool>(
+                            !isForbidden(endBlock1, endBlock2));
+                    });
+            }));
+        return;
+    }
     for (const Path &path1 : paths1) {
         for (const Path &path2 : paths2) {
-            const auto endBlocks =
-                makeMonoPair(path1, path2).map<llvm::BasicBlock *>(lastBlock);
-            const auto endIndices = makeMonoPair(
-                marked.first.BlockToMarksMap.at(endBlocks.first),
-                marked.second.BlockToMarksMap.at(endBlocks.second));
-            if (intersection(endIndices.first, endIndices.second).empty() &&
-                (SMTGenerationOpts::getInstance().PerfectSync ==
-                     PerfectSynchronization::Enabled ||
-                 (startIndex != endIndex1 && // no cycles
-                  startIndex != endIndex2))) {
-                const auto smt2 = assignmentsOnPath(path2, Program::Second,
-                                                    freeVarsMap2.at(startIndex),
-                                                    endIndex2 == EXIT_MARK);
-                const auto smt1 = assignmentsOnPath(path1, Program::First,
-                                                    freeVarsMap1.at(startIndex),
-                                                    endIndex1 == EXIT_MARK);
-                // We need to interleave here, because
-                // otherwise
-                // extern functions are not matched
-                auto smt = interleaveAssignments(
-                    make_unique<ConstantBool>(false), smt1, smt2);
-                pathExprs[startIndex].push_back(std::move(smt));
+            if (!isForbidden(lastBlock(path1), lastBlock(path2))) {
+                continue;
+            }
+            SharedSMTRef relation1 = pathRelation(
+                path1, Program::First, startIndex, endIndex1,
+                freeVarsMap1.at(startIndex), freeVarsMap1.at(endIndex1));
+            SharedSMTRef relation2 = pathRelation(
+                path2, Program::Second, startIndex, endIndex2,
+                freeVarsMap2.at(startIndex), freeVarsMap2.at(endIndex2));
+            if (relation1 && relation2) {
+                vector<SortedVar> endVars = freeVarsMap1.at(endIndex1);
+                const auto &endVars2 = freeVarsMap2.at(endIndex2);
+                endVars.insert(endVars.end(), endVars2.begin(),
+                               endVars2.end());
+                pathExprs[startIndex].push_back(assumePathRelations(
+                    {relation1, relation2}, endVars,
+                    make_unique<ConstantBool>(false)));
+                continue;
             }
+            const auto smt2 = assignmentsOnPath(path2, Program::Second,
+                                                freeVarsMap2.at(startIndex),
+                                                endIndex2 == EXIT_MARK);
+            const auto smt1 = assignmentsOnPath(path1, Program::First,
+                                                freeVarsMap1.at(startIndex),
+                                                endIndex1 == EXIT_MARK);
+            // We need to interleave here, because
+            // otherwise
+            // extern functions are not matched
+            auto smt = interleaveAssignments(make_unique<ConstantBool>(false),
+                                             smt1, smt2);
+            pathExprs[startIndex].push_back(std::move(smt));
         }
     }
 };
 
-map<Mark, vector<std::unique_ptr<smt::SMTExpr>>>
-getForbiddenPaths(const MonoPair<PathMap> &pathMaps,
-                  const MonoPair<BidirBlockMarkMap> &marked,
+static SharedSMTRef forbiddenSelector(Mark startIndex,
+                                      const string &funName,
+                                      const vector<SortedVar> &freeVars2,
+                                      SharedSMTRef selector) {
+    vector<SharedSMTRef> args;
+    for (const auto &var : freeVars2) {
+        args.push_back(make_unique<TypedVariable>(var.name + "_old", var.type));
+    }
+    args.push_back(std::move(selector));
+    return make_unique<Op>(forbiddenSelectorName(startIndex, funName),
+                           std::move(args));
+}
+
+/// Instead of one clause per forbidden pair of paths, the first program
+/// passes the end of its path to an auxiliary predicate which the paths of the
+/// second program then check. Each end of a path of the first program (its end
+/// mark and last block) is identified by a number. This needs one clause per
+/// path instead of one per pair but calls of the two programs are no longer
+/// matched.
+static void addLinearForbiddenPaths(
+    Mark startIndex, const MarkMap<Paths> &paths1,
+    const MarkMap<Paths> &paths2, const FreeVarsMap &freeVarsMap1,
+    const FreeVarsMap &freeVarsMap2, MonoPairView<BidirBlockMarkMap> marked,
+    const string &funName,
+    map<Mark, vector<SharedSMTRef>> &pathExprs) {
+    auto selectorValue = [](size_t end) -> SharedSMTRef {
+        return make_unique<ConstantInt>(llvm::APInt(64, end));
+    };
+    vector<std::pair<Mark, llvm::BasicBlock *>> ends;
+    for (const auto &pathsLeadingTo1 : paths1) {
+        for (const auto &path1 : pathsLeadingTo1.second) {
+            const std::pair<Mark, llvm::BasicBlock *> end = {
+                pathsLeadingTo1.first, lastBlock(path1)};
+            if (std::find(ends.begin(), ends.end(), end) == ends.end()) {
+                ends.push_back(end);
+            }
+        }
+    }
+
+    const SortedVar selector("FORBIDDEN_END", int64Type());
+    vector<bool> usedEnds(ends.size(), false);
+    vector<SharedSMTRef> secondClauses;
+    for (const auto &pathsLeadingTo2 : paths2) {
+        const Mark endIndex2 = pathsLeadingTo2.first;
+        for (const auto &path2 : pathsLeadingTo2.second) {
+            vector<SharedSMTRef> forbiddenEnds;
+            for (size_t i = 0; i < ends.size(); ++i) {
+                if (ends[i].first != endIndex2 &&
+                    isForbiddenPair(startIndex, ends[i].first, endIndex2,
+                                    ends[i].second, lastBlock(path2),
+                                    marked)) {
+                    forbiddenEnds.push_back(
+                        makeOp("=", typedVariableFromSortedVar(selector),
+                               selectorValue(i)));
+                    usedEnds[i] = true;
+                }
+            }
+            if (forbiddenEnds.empty()) {
+                continue;
+            }
+            SharedSMTRef isForbiddenEnd =
+                forbiddenEnds.size() == 1
+                    ? forbiddenEnds.front()
+                    : make_unique<Op>("or", std::move(forbiddenEnds));
+            SharedSMTRef endClause = makeOp(
+                "=>",
+                makeOp("and",
+                       forbiddenSelector(startIndex, funName,
+                                         freeVarsMap2.at(startIndex),
+                                         typedVariableFromSortedVar(selector)),
+                       std::move(isForbiddenEnd)),
+                make_unique<ConstantBool>(false));
+            const auto defs = assignmentsOnPath(
+                path2, Program::Second, freeVarsMap2.at(startIndex),
+                endIndex2 == EXIT_MARK);
+            // The selector only occurs in the premise, so it is quantified
+            // together with the variables at the start of the path (see
+            // forallStartingAt) instead of below the assignments
+            secondClauses.push_back(make_unique<Forall>(
+                vector<SortedVar>{selector},
+                nonmutualSMT(std::move(endClause), defs, Program::Second)));
+        }
+    }
+
+    // Only the ends that take part in a forbidden pair need to be passed on
+    for (const auto &pathsLeadingTo1 : paths1) {
+        for (const auto &path1 : pathsLeadingTo1.second) {
+            const size_t end =
+                std::find(ends.begin(), ends.end(),
+                          std::make_pair(pathsLeadingTo1.first,
+                                         lastBlock(path1))) -
+                ends.begin();
+            if (!usedEnds[end]) {
+                continue;
+            }
+            const auto defs = assignmentsOnPath(
+                path1, Program::First, freeVarsMap1.at(startIndex),
+                pathsLeadingTo1.first == EXIT_MARK);
+            pathExprs[startIndex].push_back(nonmutualSMT(
+                forbiddenSelector(startIndex, funName,
+                                  freeVarsMap2.at(startIndex),
+                                  selectorValue(end)),
+                defs, Program::First));
+        }
+    }
+    for (auto &clause : secondClauses) {
+        pathExprs[startIndex].push_back(std::move(clause));
+    }
+}
+
+map<Mark, vector<SharedSMTRef>>
+getForbiddenPaths(MonoPairView<PathMap> allPaths,
+                  MonoPairView<BidirBlockMarkMap> marked,
                   const FreeVarsMap &freeVarsMap1,
                   const FreeVarsMap &freeVarsMap2, string funName, bool main) {
-    map<Mark, vector<std::unique_ptr<smt::SMTExpr>>> pathExprs;
+    stats::ScopedTimer timer("generate.forbidden");
+    const auto pathMaps = allPaths.map<PathMap>(feasiblePaths);
+    map<Mark, vector<SharedSMTRef>> pathExprs;
+    if (SMTGenerationOpts::getInstance().LinearForbiddenPaths) {
+        for (const auto &pathMapIt : pathMaps.first) {
+            addLinearForbiddenPaths(pathMapIt.first, pathMapIt.second,
+                                    pathMaps.second.at(pathMapIt.first),
+                                    freeVarsMap1, freeVarsMap2, marked,
+                                    funName, pathExprs);
+        }
+        return pathExprs;
+    }
     for (const auto &pathMapIt : pathMaps.first) {
         const Mark startIndex = pathMapIt.first;
         for (const auto &pathsLeadingTo1 : pathMapIt.second) {
             const Mark endIndex1 = pathsLeadingTo1.first;
             for (auto &pathsLeadingTo2 : pathMaps.second.at(startIndex)) {
                 const Mark endIndex2 = pathsLeadingTo2.first;
-                if (endIndex1 != endIndex2) {
+                if (endIndex1 != endIndex2 &&
+                    !pathsLeadingTo1.second.empty() &&
+                    !pathsLeadingTo2.second.empty()) {
                     addForbiddenPaths(startIndex, endIndex1, endIndex2,
                                       pathsLeadingTo1.second,
                                       pathsLeadingTo2.second, freeVarsMap1,
@@ -281,10 +580,12 @@ getForbiddenPaths(const MonoPair<PathMap> &pathMaps,
     return pathExprs;
 }
 
-vector<std::unique_ptr<smt::SMTExpr>>
+vector<SharedSMTRef>
 functionalFunctionAssertions(const llvm::Function *f,
                              const AnalysisResultsMap &analysisResults,
                              Program prog) {
+    stats::ScopedTimer timer("generate.functional");
+    BlockAssignmentCache assignmentCache;
     const auto pathMap = analysisResults.at(f).paths;
     const auto funName = f->getName();
     const auto returnType = f->getReturnType();
@@ -293,17 +594,34 @@ functionalFunctionAssertions(const llvm::Function *f,
     return nonmutualPaths(pathMap, freeVarsMap, prog, funName, returnType,
                           getFunctionNumeralConstraints(f, prog));
 }
-vector<std::unique_ptr<smt::SMTExpr>> nonmutualPaths(
+vector<SharedSMTRef> nonmutualPaths(
     const PathMap &pathMap, const FreeVarsMap &freeVarsMap, Program prog,
     string funName, const llvm::Type *returnType,
-    vector<std::unique_ptr<smt::SMTExpr>> functionNumeralConstraints) {
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> smtExprs;
+    vector<SharedSMTRef> functionNumeralConstraints) {
+    map<MarkPair, vector<SharedSMTRef>> smtExprs;
     for (const auto &pathMapIt : pathMap) {
         const Mark startIndex = pathMapIt.first;
         for (const auto &innerPathMapIt : pathMapIt.second) {
             const Mark endIndex = innerPathMapIt.first;
-            for (const auto &path : innerPathMapIt.second) {
-                SMTRef endInvariant1 = functionalCouplingPredicate(
+            const auto &paths = innerPathMapIt.second;
+            if (shouldMergePaths(paths, paths)) {
+                stats::count("clauses.nonmutual");
+                auto clause = mergedPathsSMT(
+                    paths, prog, freeVarsMap.at(startIndex),
+                    endIndex == EXIT_MARK,
+                    [&](llvm::BasicBlock * /* unused */) {
+                        return functionalCouplingPredicate(
+                            startIndex, endIndex, freeVarsMap.at(startIndex),
+                            freeVarsMap.at(endIndex), asSelection(prog),
+                            funName, freeVarsMap);
+                    });
+                smtExprs[{startIndex, endIndex}].push_back(forallStartingAt(
+                    std::move(clause), freeVarsMap.at(startIndex), startIndex,
+                    asSelection(prog), funName, false));
+                continue;
+            }
+            for (const auto &path : paths) {
+                SharedSMTRef endInvariant1 = functionalCouplingPredicate(
                     startIndex, endIndex, freeVarsMap.at(startIndex),
                     freeVarsMap.at(endIndex), asSelection(prog), funName,
                     freeVarsMap);
@@ -316,6 +634,7 @@ vector<std::unique_ptr<smt::SMTExpr>> nonmutualPaths(
                     funName, false);
                 smtExprs[{startIndex, endIndex}].push_back(std::move(clause));
             }
+            stats::count("clauses.nonmutual", paths.size());
         }
     }
 
@@ -343,10 +662,10 @@ static void
 addStutterPaths(Mark loopMark, const std::vector<Path> &loopingPaths,
                 llvm::StringRef functionName, Program loopingProgram,
                 const FreeVarsMap &freeVarsMap, const PathMap &otherPathMap,
-                map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> &clauses,
+                map<MarkPair, vector<SharedSMTRef>> &clauses,
                 bool iterative) {
     const int progIndex = programIndex(loopingProgram);
-    for (const auto &path : loopingPaths) {
+    auto stutterEndClause = [&]() {
         const auto waitingArgs =
             filterVars(swapIndex(progIndex), freeVarsMap.at(loopMark));
         const auto loopingArgs =
@@ -355,7 +674,7 @@ addStutterPaths(Mark loopMark, const std::vector<Path> &loopingPaths,
         // Depending on which program we are looking at
         appendStutterArguments(loopingProgram, loopingArgs, waitingArgs,
                                std::back_inserter(couplingPredicateArguments));
-        SMTRef endInvariant;
+        SharedSMTRef endInvariant;
         if (iterative) {
             endInvariant = iterativeCouplingPredicate(
                 loopMark, couplingPredicateArguments, functionName);
@@ -365,23 +684,42 @@ addStutterPaths(Mark loopMark, const std::vector<Path> &loopingPaths,
                 couplingPredicateArguments, ProgramSelection::Both,
                 functionName, freeVarsMap);
         }
-        SMTRef dontLoopInvariant = getDontLoopInvariant(
-            std::move(endInvariant), loopMark, otherPathMap, freeVarsMap,
-            swapProgram(loopingProgram));
+        return getDontLoopInvariant(std::move(endInvariant), loopMark,
+                                    otherPathMap, freeVarsMap,
+                                    swapProgram(loopingProgram));
+    };
+    if (shouldMergePaths(loopingPaths, loopingPaths)) {
+        clauses[{loopMark, loopMark}].push_back(mergedPathsSMT(
+            loopingPaths, loopingProgram,
+            filterVars(progIndex, freeVarsMap.at(loopMark)), false,
+            [&](llvm::BasicBlock * /* unused */) {
+                return stutterEndClause();
+            }));
+        return;
+    }
+    const auto loopingVars = filterVars(progIndex, freeVarsMap.at(loopMark));
+    for (const auto &path : loopingPaths) {
+        if (SharedSMTRef relation =
+                pathRelation(path, loopingProgram, loopMark, loopMark,
+                             loopingVars, loopingVars)) {
+            clauses[{loopMark, loopMark}].push_back(assumePathRelations(
+                {std::move(relation)}, loopingVars, stutterEndClause()));
+            continue;
+        }
         const auto defs = assignmentsOnPath(
             path, loopingProgram,
             filterVars(programIndex(loopingProgram), freeVarsMap.at(loopMark)),
             false);
         clauses[{loopMark, loopMark}].push_back(
-            nonmutualSMT(std::move(dontLoopInvariant), defs, loopingProgram));
+            nonmutualSMT(stutterEndClause(), defs, loopingProgram));
     }
 }
 
-static map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>>
+static map<MarkPair, vector<SharedSMTRef>>
 stutterPathsForProg(const PathMap &pathMap, const PathMap &otherPathMap,
                     const FreeVarsMap &freeVarsMap, Program prog,
                     string funName, bool iterative) {
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> clauses;
+    map<MarkPair, vector<SharedSMTRef>> clauses;
     for (const auto &pathMapIt : pathMap) {
         const Mark startMark = pathMapIt.first;
         for (const auto &pathsLeadingTo : pathMapIt.second) {
@@ -396,7 +734,7 @@ stutterPathsForProg(const PathMap &pathMap, const PathMap &otherPathMap,
     return clauses;
 }
 
-map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>>
+map<MarkPair, vector<SharedSMTRef>>
 getStutterPaths(const PathMap &pathMap1, const PathMap &pathMap2,
                 const FreeVarsMap &freeVarsMap, string funName, bool main) {
     auto firstPaths = stutterPathsForProg(pathMap1, pathMap2, freeVarsMap,
@@ -445,25 +783,112 @@ vector<AssignmentCallBlock> assignmentsOnPath(const Path &path, Program prog,
     return allDefs;
 }
 
-std::unique_ptr<smt::SMTExpr>
-addAssignments(std::unique_ptr<smt::SMTExpr> end,
+// Collects every name that may refer to a variable. Bound variables are not
+// excluded, so this over-approximates the free variables. The expressions
+// are only read, a visitor would copy the nodes it handles.
+static void addUsedNames(const SMTExpr &expr, llvm::StringSet<> &names,
+                         llvm::DenseSet<const SMTExpr *> &visited) {
+    if (!visited.insert(&expr).second) {
+        return;
+    }
+    switch (expr.getTag()) {
+    case ExprTag::Assert:
+        addUsedNames(*static_cast<const Assert &>(expr).expr, names, visited);
+        break;
+    case ExprTag::Forall:
+        addUsedNames(*static_cast<const Forall &>(expr).expr, names, visited);
+        break;
+    case ExprTag::Let: {
+        const auto &let = static_cast<const Let &>(expr);
+        for (const auto &def : let.defs) {
+            addUsedNames(*def.second, names, visited);
+        }
+        addUsedNames(*let.expr, names, visited);
+        break;
+    }
+    case ExprTag::Op: {
+        const auto &op = static_cast<const Op &>(expr);
+        names.insert(op.opName);
+        for (const auto &arg : op.args) {
+            addUsedNames(*arg, names, visited);
+        }
+        break;
+    }
+    case ExprTag::FPCmp: {
+        const auto &cmp = static_cast<const FPCmp &>(expr);
+        addUsedNames(*cmp.op0, names, visited);
+        addUsedNames(*cmp.op1, names, visited);
+        break;
+    }
+    case ExprTag::BinaryFPOperator: {
+        const auto &binOp = static_cast<const BinaryFPOperator &>(expr);
+        addUsedNames(*binOp.op0, names, visited);
+        addUsedNames(*binOp.op1, names, visited);
+        break;
+    }
+    case ExprTag::TypeCast:
+        addUsedNames(*static_cast<const TypeCast &>(expr).operand, names,
+                     visited);
+        break;
+    case ExprTag::TypedVariable:
+        names.insert(static_cast<const TypedVariable &>(expr).name);
+        break;
+    case ExprTag::ConstantString:
+        names.insert(static_cast<const ConstantString &>(expr).value);
+        break;
+    default:
+        break;
+    }
+}
+
+static void addUsedNames(const SMTExpr &expr, llvm::StringSet<> &names) {
+    llvm::DenseSet<const SMTExpr *> visited;
+    addUsedNames(expr, names, visited);
+}
+
+SharedSMTRef
+addAssignments(SharedSMTRef end,
                llvm::ArrayRef<AssignmentBlock> assignments) {
-    std::unique_ptr<smt::SMTExpr> clause = std::move(end);
+    SharedSMTRef clause = std::move(end);
+    // Definitions are only kept if their value reaches the end of the clause,
+    // i.e. the arguments of the invariant at the end mark, the calls after
+    // the blocks or one of the path conditions
+    llvm::StringSet<> live;
+    addUsedNames(*clause, live);
+    uint64_t dead = 0;
     for (auto assgnIt = assignments.rbegin(); assgnIt != assignments.rend();
          ++assgnIt) {
-        clause = fastNestLets(std::move(clause), assgnIt->definitions);
+        vector<Assignment> liveDefinitions;
+        const auto &definitions = assgnIt->definitions;
+        for (auto defIt = definitions.rbegin(); defIt != definitions.rend();
+             ++defIt) {
+            if (live.find(defIt->first) == live.end()) {
+                ++dead;
+                continue;
+            }
+            // A variable can be redefined, e.g. the heap by a store
+            live.erase(defIt->first);
+            addUsedNames(*defIt->second, live);
+            liveDefinitions.push_back(*defIt);
+        }
+        std::reverse(liveDefinitions.begin(), liveDefinitions.end());
+        clause = fastNestLets(std::move(clause), liveDefinitions);
         if (assgnIt->condition) {
+            addUsedNames(*assgnIt->condition, live);
             clause = makeOp("=>", assgnIt->condition, std::move(clause));
         }
     }
+    if (dead > 0) {
+        stats::count("clauses.dead definitions", dead);
+    }
     return clause;
 }
 
-std::unique_ptr<smt::SMTExpr> interleaveAssignments(
-    std::unique_ptr<smt::SMTExpr> endClause,
+SharedSMTRef interleaveAssignments(
+    SharedSMTRef endClause,
     llvm::ArrayRef<AssignmentCallBlock> assignmentCallBlocks1,
     llvm::ArrayRef<AssignmentCallBlock> assignmentCallBlocks2) {
-    std::unique_ptr<smt::SMTExpr> clause = std::move(endClause);
+    SharedSMTRef clause = std::move(endClause);
     const auto splitAssignments1 =
         splitAssignmentsFromCalls(assignmentCallBlocks1);
     const auto splitAssignments2 =
@@ -534,11 +959,11 @@ std::unique_ptr<smt::SMTExpr> interleaveAssignments(
     return clause;
 }
 
-std::unique_ptr<smt::SMTExpr>
-nonmutualSMT(std::unique_ptr<smt::SMTExpr> endClause,
+SharedSMTRef
+nonmutualSMT(SharedSMTRef endClause,
              llvm::ArrayRef<AssignmentCallBlock> assignmentCallBlocks,
              Program prog) {
-    std::unique_ptr<smt::SMTExpr> clause = std::move(endClause);
+    SharedSMTRef clause = std::move(endClause);
     const auto splitAssignments =
         splitAssignmentsFromCalls(assignmentCallBlocks);
     const auto assignmentBlocks = splitAssignments.assignments;
@@ -558,8 +983,8 @@ nonmutualSMT(std::unique_ptr<smt::SMTExpr> endClause,
     return clause;
 }
 
-SMTRef mutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
-                          MonoPair<CallInfo> callPair) {
+SharedSMTRef mutualFunctionCall(SharedSMTRef clause,
+                                MonoPair<CallInfo> callPair) {
     const uint32_t varArgs = callPair.first.varArgs;
     const vector<SortedVar> resultValues =
         getMutualResultValues(callPair.first.assignedTo, callPair.first.fun,
@@ -567,7 +992,7 @@ SMTRef mutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
 
     vector<SharedSMTRef> preInvariantArguments;
     callPair.indexedForEach(addMemory(preInvariantArguments));
-    SMTRef preInvariant = std::make_unique<Op>(
+    SharedSMTRef preInvariant = hashConsOp(
         invariantName(ENTRY_MARK, ProgramSelection::Both,
                       callPair.first.callName + "^" + callPair.second.callName,
                       InvariantAttr::PRE),
@@ -577,13 +1002,14 @@ SMTRef mutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
     std::transform(resultValues.begin(), resultValues.end(),
                    std::back_inserter(postInvariantArguments),
                    typedVariableFromSortedVar);
-    SMTRef postInvariant = std::make_unique<Op>(
+    SharedSMTRef postInvariant = hashConsOp(
         invariantName(ENTRY_MARK, ProgramSelection::Both,
                       callPair.first.callName + "^" + callPair.second.callName,
                       InvariantAttr::NONE, varArgs),
         postInvariantArguments, !hasFixedAbstraction(callPair.first.fun));
 
-    SMTRef result = makeOp("=>", std::move(postInvariant), std::move(clause));
+    SharedSMTRef result =
+        makeOp("=>", std::move(postInvariant), std::move(clause));
     result = std::make_unique<Forall>(resultValues, std::move(result));
     if (hasMutualFixedAbstraction(
             {&callPair.first.fun, &callPair.second.fun})) {
@@ -592,29 +1018,30 @@ SMTRef mutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
     return makeOp("and", std::move(preInvariant), std::move(result));
 }
 
-SMTRef nonMutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
-                             CallInfo call, Program prog) {
+SharedSMTRef nonMutualFunctionCall(SharedSMTRef clause, CallInfo call,
+                                   Program prog) {
     const uint32_t varArgs = call.varArgs;
     vector<SortedVar> resultValues =
         getResultValues(prog, call.assignedTo, call.fun);
 
     vector<SharedSMTRef> preInvariantArguments;
     addMemory(preInvariantArguments)(call, programIndex(prog));
-    SMTRef preInvariant =
-        make_unique<Op>(invariantName(ENTRY_MARK, asSelection(prog),
-                                      call.callName, InvariantAttr::PRE),
-                        preInvariantArguments);
+    SharedSMTRef preInvariant =
+        hashConsOp(invariantName(ENTRY_MARK, asSelection(prog),
+                                 call.callName, InvariantAttr::PRE),
+                   preInvariantArguments);
 
     vector<SharedSMTRef> postInvariantArguments = preInvariantArguments;
     std::transform(resultValues.begin(), resultValues.end(),
                    std::back_inserter(postInvariantArguments),
                    typedVariableFromSortedVar);
-    SMTRef postInvariant = make_unique<Op>(
+    SharedSMTRef postInvariant = hashConsOp(
         invariantName(ENTRY_MARK, asSelection(prog), call.callName,
                       InvariantAttr::NONE, varArgs),
         postInvariantArguments, !hasFixedAbstraction(call.fun));
 
-    SMTRef result = makeOp("=>", std::move(postInvariant), std::move(clause));
+    SharedSMTRef result =
+        makeOp("=>", std::move(postInvariant), std::move(clause));
     result = std::make_unique<Forall>(resultValues, std::move(result));
     if (hasFixedAbstraction(call.fun)) {
         return result;
@@ -623,8 +1050,8 @@ SMTRef nonMutualFunctionCall(std::unique_ptr<smt::SMTExpr> clause,
 }
 
 /// Wrap the clause in a forall
-std::unique_ptr<smt::SMTExpr>
-forallStartingAt(std::unique_ptr<smt::SMTExpr> clause,
+SharedSMTRef
+forallStartingAt(SharedSMTRef clause,
                  vector<SortedVar> freeVars, Mark blockIndex,
                  ProgramSelection prog, string funName, bool main) {
     vector<SortedVar> vars;
@@ -633,12 +1060,29 @@ forallStartingAt(std::unique_ptr<smt::SMTExpr> clause,
         std::smatch matchResult;
         vars.push_back(SortedVar(arg.name + "_old", arg.type));
         preVars.push_back(
-            make_unique<TypedVariable>(arg.name + "_old", arg.type));
+            hashConsVariable(arg.name + "_old", arg.type));
     }
 
     if (vars.empty()) {
         return clause;
     }
+    // Variables quantified at the top of the clause (e.g. FORBIDDEN_END) are
+    // added to the outer forall, so they don't end up in a quantifier in the
+    // conclusion. This is only done if they can't clash with the premise.
+    vector<SortedVar> innerVars;
+    if (const Forall *inner = clause->asForall()) {
+        bool clashes = std::any_of(
+            inner->vars.begin(), inner->vars.end(), [&](const SortedVar &v) {
+                return std::any_of(vars.begin(), vars.end(),
+                                   [&](const SortedVar &outer) {
+                                       return outer.name == v.name;
+                                   });
+            });
+        if (!clashes) {
+            innerVars = inner->vars;
+            clause = inner->expr;
+        }
+    }
 
     if (main && blockIndex == ENTRY_MARK) {
         string opname =
@@ -647,19 +1091,37 @@ forallStartingAt(std::unique_ptr<smt::SMTExpr> clause,
         vector<SharedSMTRef> args;
         for (const auto &arg : freeVars) {
             args.push_back(
-                make_unique<TypedVariable>(arg.name + "_old", arg.type));
+                hashConsVariable(arg.name + "_old", arg.type));
         }
 
-        clause = makeOp("=>", make_unique<Op>(opname, std::move(args)),
+        clause = makeOp("=>", hashConsOp(opname, std::move(args)),
                         std::move(clause));
 
+    } else if (main) {
+        vector<SharedSMTRef> arguments;
+        for (const auto &arg : mainInvariantArguments(freeVars)) {
+            arguments.push_back(
+                hashConsVariable(arg.name + "_old", arg.type));
+        }
+        SharedSMTRef preInv = hashConsOp(
+            invariantName(blockIndex, prog, funName, InvariantAttr::MAIN),
+            std::move(arguments));
+        // The variables that are not passed to the invariant are equal to
+        // one that is
+        auto equalities = mainInvariantEqualities(freeVars, "_old");
+        if (!equalities.empty()) {
+            equalities.insert(equalities.begin(), std::move(preInv));
+            preInv = make_unique<Op>("and", std::move(equalities));
+        }
+        clause = makeOp("=>", std::move(preInv), std::move(clause));
     } else {
-        InvariantAttr attr = main ? InvariantAttr::MAIN : InvariantAttr::PRE;
-        SMTRef preInv = make_unique<Op>(
-            invariantName(blockIndex, prog, funName, attr), preVars);
+        SharedSMTRef preInv = hashConsOp(
+            invariantName(blockIndex, prog, funName, InvariantAttr::PRE),
+            preVars);
         clause = makeOp("=>", std::move(preInv), std::move(clause));
     }
 
+    vars.insert(vars.end(), innerVars.begin(), innerVars.end());
     return std::make_unique<Forall>(vars, std::move(clause));
 }
 
@@ -667,10 +1129,9 @@ forallStartingAt(std::unique_ptr<smt::SMTExpr> clause,
  */
 // Functions forcing arguments to be equal
 
-std::unique_ptr<smt::SMTExpr> makeFunArgsEqual(SharedSMTRef clause,
-                                               SharedSMTRef preClause,
-                                               vector<SortedVar> Args1,
-                                               vector<SortedVar> Args2) {
+SharedSMTRef makeFunArgsEqual(SharedSMTRef clause, SharedSMTRef preClause,
+                              vector<SortedVar> Args1,
+                              vector<SortedVar> Args2) {
     assert(Args1.size() == Args2.size());
 
     vector<SharedSMTRef> args;
@@ -681,7 +1142,7 @@ std::unique_ptr<smt::SMTExpr> makeFunArgsEqual(SharedSMTRef clause,
         args.push_back(typedVariableFromSortedVar(arg));
     }
 
-    auto inInv = make_unique<Op>("IN_INV", std::move(args));
+    auto inInv = hashConsOp("IN_INV", std::move(args));
 
     return makeOp("=>", std::move(inInv), makeOp("and", clause, preClause));
 }
@@ -689,7 +1150,7 @@ std::unique_ptr<smt::SMTExpr> makeFunArgsEqual(SharedSMTRef clause,
 /// Create an assertion to require that if the recursive invariant holds and
 /// the
 /// arguments are equal the outputs are equal
-std::unique_ptr<smt::SMTExpr> equalInputsEqualOutputs(
+SharedSMTRef equalInputsEqualOutputs(
     const vector<SortedVar> &funArgs1, const vector<SortedVar> &funArgs2,
     const llvm::Function &function1, const llvm::Function &function2,
     string funName, const FreeVarsMap &freeVarsMap) {
@@ -734,7 +1195,9 @@ std::unique_ptr<smt::SMTExpr> equalInputsEqualOutputs(
         }
     }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        outArgs.push_back(memoryVariable(heapResultName(Program::First)));
+        for (const auto &heap : heapResultNames(Program::First)) {
+            outArgs.push_back(memoryVariable(heap));
+        }
     }
     if (SMTGenerationOpts::getInstance().PassInputThrough) {
         for (const auto &arg : funArgs2) {
@@ -744,14 +1207,16 @@ std::unique_ptr<smt::SMTExpr> equalInputsEqualOutputs(
         }
     }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        outArgs.push_back(memoryVariable(heapResultName(Program::Second)));
+        for (const auto &heap : heapResultNames(Program::Second)) {
+            outArgs.push_back(memoryVariable(heap));
+        }
     }
     const SharedSMTRef equalResults = makeOp(
         "=>",
         make_unique<Op>(
             invariantName(ENTRY_MARK, ProgramSelection::Both, funName), args),
         make_unique<Op>("OUT_INV", outArgs));
-    SMTRef preInv =
+    SharedSMTRef preInv =
         make_unique<Op>(invariantName(ENTRY_MARK, ProgramSelection::Both,
                                       funName, InvariantAttr::PRE),
                         preInvArgs);
@@ -817,10 +1282,10 @@ bool mapSubset(const PathMap &map1, const PathMap &map2) {
     return true;
 }
 
-SMTRef getDontLoopInvariant(SMTRef endClause, Mark startIndex,
-                            const PathMap &pathMap, const FreeVarsMap &freeVars,
-                            Program prog) {
-    SMTRef clause = std::move(endClause);
+SharedSMTRef getDontLoopInvariant(SharedSMTRef endClause, Mark startIndex,
+                                  const PathMap &pathMap,
+                                  const FreeVarsMap &freeVars, Program prog) {
+    SharedSMTRef clause = std::move(endClause);
     vector<Path> dontLoopPaths;
     for (auto pathMapIt : pathMap.at(startIndex)) {
         if (pathMapIt.first == startIndex) {
@@ -850,8 +1315,15 @@ auto addMemory(vector<SharedSMTRef> &implArgs)
         for (auto arg : call.args) {
             implArgs.push_back(arg);
         }
-        if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-            implArgs.push_back(memoryVariable(heapName(index)));
+        if (!passesMemory(call.fun)) {
+            return;
+        }
+        const auto &opts = SMTGenerationOpts::getInstance();
+        if (opts.Heap == HeapOpt::Enabled) {
+            for (unsigned region = 0; region < opts.HeapRegionCount;
+                 ++region) {
+                implArgs.push_back(memoryVariable(heapName(index, region)));
+            }
         }
         if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
             implArgs.push_back(memoryVariable(stackPointerName(index)));
@@ -860,10 +1332,32 @@ auto addMemory(vector<SharedSMTRef> &implArgs)
     };
 }
 
+// The paths of a function pair share their relations, see PathRelations.h.
+// Inverted clauses and the muZ format use the assignments directly.
+static auto makePathRelations(string funName) -> unique_ptr<PathRelations> {
+    const auto &opts = SMTGenerationOpts::getInstance();
+    if (!opts.SharedPathRelations || opts.Invert ||
+        opts.OutputFormat != SMTFormat::SMTHorn) {
+        return nullptr;
+    }
+    return make_unique<PathRelations>(std::move(funName));
+}
+
+static void addPathRelations(PathRelations *pathRelations,
+                             vector<SharedSMTRef> &declarations) {
+    if (pathRelations) {
+        for (auto &definition : pathRelations->takeDefinitions()) {
+            declarations.push_back(std::move(definition));
+        }
+    }
+}
+
 void generateRelationalFunctionSMT(
     MonoPair<const llvm::Function *> preprocessedFunction,
     const AnalysisResultsMap &analysisResults, vector<SharedSMTRef> &assertions,
     vector<SharedSMTRef> &declarations) {
+    auto pathRelations =
+        makePathRelations(getFunctionName(preprocessedFunction));
     auto newAssertions =
         relationalFunctionAssertions(preprocessedFunction, analysisResults);
     auto newDeclarations =
@@ -874,6 +1368,7 @@ void generateRelationalFunctionSMT(
     declarations.insert(declarations.end(),
                         std::make_move_iterator(newDeclarations.begin()),
                         std::make_move_iterator(newDeclarations.end()));
+    addPathRelations(pathRelations.get(), declarations);
 }
 void generateFunctionalFunctionSMT(const llvm::Function *preprocessedFunction,
                                    const AnalysisResultsMap &analysisResults,
@@ -896,6 +1391,8 @@ void generateRelationalIterativeSMT(
     MonoPair<const llvm::Function *> preprocessedFunctions,
     const AnalysisResultsMap &analysisResults, vector<SharedSMTRef> &assertions,
     vector<SharedSMTRef> &declarations) {
+    auto pathRelations =
+        makePathRelations(getFunctionName(preprocessedFunctions));
     auto newAssertions =
         relationalIterativeAssertions(preprocessedFunctions, analysisResults);
     auto newDeclarations =
@@ -906,25 +1403,25 @@ void generateRelationalIterativeSMT(
     declarations.insert(declarations.end(),
                         std::make_move_iterator(newDeclarations.begin()),
                         std::make_move_iterator(newDeclarations.end()));
+    addPathRelations(pathRelations.get(), declarations);
 }
 
-vector<std::unique_ptr<smt::SMTExpr>> clauseMapToClauseVector(
-    map<MarkPair, vector<std::unique_ptr<smt::SMTExpr>>> clauseMap, bool main,
+vector<SharedSMTRef> clauseMapToClauseVector(
+    map<MarkPair, vector<SharedSMTRef>> clauseMap, bool main,
     ProgramSelection programSelection,
-    vector<std::unique_ptr<smt::SMTExpr>> functionNumeralConstraints) {
+    vector<SharedSMTRef> functionNumeralConstraints) {
     if (SMTGenerationOpts::getInstance().Invert) {
         bool program1 = oneOf(programSelection, ProgramSelection::First,
                               ProgramSelection::Both);
         bool program2 = oneOf(programSelection, ProgramSelection::Second,
                               ProgramSelection::Both);
-        vector<std::unique_ptr<smt::SMTExpr>> clauses;
+        vector<SharedSMTRef> clauses;
         for (auto &it : clauseMap) {
             vector<SharedSMTRef> clausesForMark;
             for (auto &path : it.second) {
                 clausesForMark.push_back(makeOp("not", std::move(path)));
             }
-            vector<std::unique_ptr<smt::SMTExpr>> conjuncts =
-                std::move(functionNumeralConstraints);
+            vector<SharedSMTRef> conjuncts = functionNumeralConstraints;
             conjuncts.push_back(
                 makeOp("=", "INV_INDEX_START",
                        std::make_unique<ConstantInt>(llvm::APInt(
@@ -941,11 +1438,11 @@ vector<std::unique_ptr<smt::SMTExpr>> clauseMapToClauseVector(
                 "=", "PROGRAM_2", std::make_unique<ConstantBool>(program2)));
             conjuncts.push_back(make_unique<Op>("or", clausesForMark));
             clauses.push_back(
-                make_unique<Op>("and", toVecOfSharedPtr(std::move(conjuncts))));
+                make_unique<Op>("and", std::move(conjuncts)));
         }
         return clauses;
     } else {
-        vector<std::unique_ptr<smt::SMTExpr>> clauses;
+        vector<SharedSMTRef> clauses;
         for (auto &it : clauseMap) {
             for (auto &clause : it.second) {
                 clauses.push_back(std::move(clause));
@@ -955,10 +1452,10 @@ vector<std::unique_ptr<smt::SMTExpr>> clauseMapToClauseVector(
     }
 }
 
-vector<std::unique_ptr<smt::SMTExpr>>
+vector<SharedSMTRef>
 getFunctionNumeralConstraints(const llvm::Function *f, Program prog) {
     string name = prog == Program::First ? "FUNCTION_1" : "FUNCTION_2";
-    vector<std::unique_ptr<smt::SMTExpr>> vec;
+    vector<SharedSMTRef> vec;
     vec.emplace_back(makeOp(
         "=", name,
         std::make_unique<ConstantInt>(llvm::APInt(
@@ -966,9 +1463,9 @@ getFunctionNumeralConstraints(const llvm::Function *f, Program prog) {
     return vec;
 }
 
-vector<std::unique_ptr<smt::SMTExpr>>
+vector<SharedSMTRef>
 getFunctionNumeralConstraints(MonoPair<const llvm::Function *> functions) {
-    vector<std::unique_ptr<smt::SMTExpr>> vec;
+    vector<SharedSMTRef> vec;
     vec.emplace_back(
         makeOp("=", "FUNCTION_1",
                std::make_unique<ConstantInt>(llvm::APInt(
@@ -0,0 +1,128 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "FunctionSummaries.h"
+
+#include "Helper.h"
+#include "Invariant.h"
+#include "ModuleSMTGeneration.h"
+#include "SMTReader.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <fstream>
+#include <set>
+
+using std::make_shared;
+using std::map;
+using std::string;
+
+using smt::ConstantBool;
+using smt::ExprTag;
+using smt::FunDef;
+using smt::SharedSMTRef;
+
+using namespace llreve::opts;
+
+static bool isEntryInvariant(llvm::StringRef name) {
+    return name.startswith("INV_REC_");
+}
+
+map<string, SharedSMTRef> readFunctionSummaries(const string &fileName) {
+    map<string, SharedSMTRef> summaries;
+    if (!std::ifstream(fileName)) {
+        return summaries;
+    }
+    smt::HashConsFactory factory;
+    for (const auto &command : smt::readSMTFile(fileName, factory)) {
+        if (command->getTag() != ExprTag::FunDef) {
+            continue;
+        }
+        const auto &def = static_cast<const FunDef &>(*command);
+        if (isEntryInvariant(def.funName)) {
+            summaries[def.funName] = command;
+        }
+    }
+    return summaries;
+}
+
+void writeFunctionSummaries(const string &fileName, const string &model,
+                            const map<string, SharedSMTRef> &reused) {
+    std::ofstream file(fileName);
+    if (!file) {
+        logError("Couldn’t open " + fileName + "\n");
+        exit(1);
+    }
+    std::set<string> written;
+    for (const auto &definition : smt::modelDefinitions(model)) {
+        if (isEntryInvariant(definition.first)) {
+            file << definition.second << "\n";
+            written.insert(definition.first);
+        }
+    }
+    // Defined invariants are not part of the model
+    for (const auto &summary : reused) {
+        if (written.find(summary.first) == written.end()) {
+            file << *summary.second->toSExpr() << "\n";
+        }
+    }
+}
+
+// Defines the entry invariants of 'fun' if there is a summary for its
+// postcondition
+static bool applySummary(const map<string, SharedSMTRef> &summaries,
+                         const llvm::Function &fun, Program prog,
+                         const AnalysisResultsMap &analysisResults,
+                         SMTGenerationOpts &smtOpts) {
+    const string funName = fun.getName().str();
+    const auto postIt =
+        summaries.find(invariantName(ENTRY_MARK, asSelection(prog), funName));
+    if (postIt == summaries.end()) {
+        return false;
+    }
+    const string preName = invariantName(ENTRY_MARK, asSelection(prog),
+                                         funName, InvariantAttr::PRE);
+    const auto preIt = summaries.find(preName);
+    SharedSMTRef preCondition;
+    if (preIt != summaries.end()) {
+        preCondition = preIt->second;
+    } else {
+        preCondition = make_shared<FunDef>(
+            preName,
+            analysisResults.at(&fun).freeVariables.at(ENTRY_MARK),
+            smt::boolType(), make_shared<ConstantBool>(true));
+    }
+    smtOpts.FunctionalFunctionalInvariants[&fun][ENTRY_MARK] = {
+        preCondition, postIt->second};
+    return true;
+}
+
+size_t applyFunctionSummaries(const map<string, SharedSMTRef> &summaries,
+                              MonoPair<const llvm::Module &> modules,
+                              const AnalysisResultsMap &analysisResults,
+                              SMTGenerationOpts &smtOpts) {
+    size_t applied = 0;
+    makeMonoPair(&modules.first, &modules.second)
+        .indexedForEachProgram([&](const llvm::Module *module, Program prog) {
+            const llvm::Function *mainFunction =
+                prog == Program::First ? smtOpts.MainFunctions.first
+                                       : smtOpts.MainFunctions.second;
+            for (const auto &fun : *module) {
+                if (needsFunctionalAbstraction(fun, *mainFunction) &&
+                    applySummary(summaries, fun, prog, analysisResults,
+                                 smtOpts)) {
+                    ++applied;
+                }
+            }
+        });
+    stats::count("function summaries", applied);
+    return applied;
+}
@@ -0,0 +1,202 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "GzipStream.h"
+
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+// Adding 16 to the window bits selects the gzip format instead of zlib
+static const int GzipWindowBits = 15 + 16;
+static const size_t OutputChunkSize = 1 << 16;
+
+GzipFileBuffer::GzipFileBuffer(const string &fileName) : block(BlockSize) {
+    std::memset(&stream, 0, sizeof(stream));
+    file.open(fileName, std::ios::binary);
+    if (!file || deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              GzipWindowBits, 8,
+                              Z_DEFAULT_STRATEGY) != Z_OK) {
+        return;
+    }
+    started = true;
+    setp(block.data(), block.data() + block.size());
+    compressor = std::thread([this] { compressBlocks(); });
+}
+
+GzipFileBuffer::~GzipFileBuffer() { close(); }
+
+bool GzipFileBuffer::close() {
+    if (!started || closed) {
+        return started;
+    }
+    submitBlock();
+    closed = true;
+    setp(nullptr, nullptr);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    changed.notify_all();
+    compressor.join();
+    deflateEnd(&stream);
+    file.close();
+    return !failed && !file.fail();
+}
+
+GzipFileBuffer::int_type GzipFileBuffer::overflow(int_type c) {
+    if (!started || closed || !submitBlock()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize GzipFileBuffer::xsputn(const char *s, std::streamsize n) {
+    if (!started || closed) {
+        return 0;
+    }
+    std::streamsize written = 0;
+    while (written < n) {
+        if (pptr() == epptr() && !submitBlock()) {
+            break;
+        }
+        const std::streamsize chunk =
+            std::min<std::streamsize>(n - written, epptr() - pptr());
+        std::memcpy(pptr(), s + written, static_cast<size_t>(chunk));
+        pbump(static_cast<int>(chunk));
+        written += chunk;
+    }
+    return written;
+}
+
+GzipFileBuffer::pos_type
+GzipFileBuffer::seekoff(off_type off, std::ios_base::seekdir dir,
+                        std::ios_base::openmode which) {
+    if (off != 0 || dir != std::ios_base::cur ||
+        (which & std::ios_base::out) == 0 || !started) {
+        return pos_type(off_type(-1));
+    }
+    return pos_type(
+        static_cast<off_type>(submittedBytes + (pptr() - pbase())));
+}
+
+bool GzipFileBuffer::submitBlock() {
+    const size_t size = static_cast<size_t>(pptr() - pbase());
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] {
+            return pending.size() < MaxPendingBlocks || failed;
+        });
+        if (failed) {
+            return false;
+        }
+        if (size > 0) {
+            block.resize(size);
+            pending.push_back(std::move(block));
+            submittedBytes += size;
+        }
+    }
+    changed.notify_all();
+    if (size > 0) {
+        block = vector<char>(BlockSize);
+    }
+    setp(block.data(), block.data() + block.size());
+    return true;
+}
+
+void GzipFileBuffer::compressBlocks() {
+    stats::ScopedTimer timer("serialize.compress");
+    while (true) {
+        vector<char> input;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock,
+                         [this] { return !pending.empty() || finished; });
+            if (!pending.empty()) {
+                input = std::move(pending.front());
+                pending.pop_front();
+            }
+        }
+        changed.notify_all();
+        // The queue is only empty here once the output is complete
+        const int flush = input.empty() ? Z_FINISH : Z_NO_FLUSH;
+        if (!deflateBlock(input, flush)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = true;
+            pending.clear();
+            changed.notify_all();
+            return;
+        }
+        if (flush == Z_FINISH) {
+            return;
+        }
+    }
+}
+
+bool GzipFileBuffer::deflateBlock(const vector<char> &input, int flush) {
+    vector<char> output(OutputChunkSize);
+    stream.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    size_t compressedBytes = 0;
+    int status;
+    do {
+        stream.next_out = reinterpret_cast<Bytef *>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+        status = deflate(&stream, flush);
+        if (status == Z_STREAM_ERROR) {
+            return false;
+        }
+        const size_t size = output.size() - stream.avail_out;
+        file.write(output.data(), static_cast<std::streamsize>(size));
+        compressedBytes += size;
+    } while (flush == Z_FINISH ? status != Z_STREAM_END
+                               : stream.avail_out == 0);
+    stats::count("serialize.compressed bytes", compressedBytes);
+    return static_cast<bool>(file);
+}
+
+bool isGzip(llvm::StringRef data) {
+    return data.size() >= 2 && static_cast<unsigned char>(data[0]) == 0x1f &&
+           static_cast<unsigned char>(data[1]) == 0x8b;
+}
+
+bool gunzip(llvm::StringRef data, string &result) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, GzipWindowBits) != Z_OK) {
+        return false;
+    }
+    stream.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    vector<char> output(OutputChunkSize);
+    int status;
+    do {
+        stream.next_out = reinterpret_cast<Bytef *>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            inflateEnd(&stream);
+            return false;
+        }
+        result.append(output.data(), output.size() - stream.avail_out);
+    } while (status != Z_STREAM_END);
+    inflateEnd(&stream);
+    return true;
+}
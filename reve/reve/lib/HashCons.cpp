@@ -0,0 +1,438 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "HashCons.h"
+
+#include "Arena.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <set>
+#include <sstream>
+
+using std::set;
+using std::string;
+using std::vector;
+
+namespace smt {
+
+static string typeKey(const Type &type) {
+    std::ostringstream out;
+    out << *type.toSExpr();
+    return out.str();
+}
+
+// Identifies the type of a variable without printing it. The tag is stored in
+// the lowest three bits, only nested arrays have to fall back to the printed
+// type.
+static uint64_t typeCode(const Type &type) {
+    switch (type.getTag()) {
+    case TypeTag::Bool:
+        return 1;
+    case TypeTag::Int:
+        return static_cast<uint64_t>(type.get<IntType>().bitWidth) << 3 | 2;
+    case TypeTag::Float: {
+        const auto &floatType = type.get<FloatType>();
+        return static_cast<uint64_t>(floatType.significandWidth) << 35 |
+               static_cast<uint64_t>(floatType.exponentWidth) << 3 | 3;
+    }
+    case TypeTag::Array: {
+        const auto &arrayType = type.get<ArrayType>();
+        const uint64_t domain = typeCode(arrayType.domain);
+        const uint64_t target = typeCode(arrayType.target);
+        if (domain < (1ull << 30) && target < (1ull << 30)) {
+            return domain << 33 | target << 3 | 4;
+        }
+        break;
+    }
+    }
+    return static_cast<uint64_t>(Symbol(typeKey(type)).id()) << 3 | 5;
+}
+
+size_t HashConsFactory::hash(const SMTExpr &expr) const {
+    auto it = hashes.find(&expr);
+    assert(it != hashes.end() && "expression was not created by this factory");
+    return it->second;
+}
+
+SharedSMTRef HashConsFactory::lookup(Key key,
+                                     std::function<SharedSMTRef()> create) {
+    llvm::hash_code code = llvm::hash_combine(static_cast<int>(key.kind),
+                                              key.name.id(), key.extra);
+    if (key.kind == NodeKind::Int) {
+        code = llvm::hash_combine(code, llvm::hash_value(key.value));
+    }
+    for (const auto child : key.children) {
+        code = llvm::hash_combine(code, hash(*child));
+    }
+    key.hash = code;
+    auto it = table.find(key);
+    if (it != table.end()) {
+        return it->second;
+    }
+    SharedSMTRef expr = create();
+    hashes.insert({expr.get(), key.hash});
+    table.insert({std::move(key), expr});
+    return expr;
+}
+
+SharedSMTRef HashConsFactory::variable(string name, Type type) {
+    return variable(Symbol(name), type);
+}
+
+SharedSMTRef HashConsFactory::variable(Symbol name, const Type &type) {
+    return lookup({NodeKind::Variable, 0, name, typeCode(type), {}},
+                  [&] { return makeArenaShared<TypedVariable>(name, type); });
+}
+
+SharedSMTRef HashConsFactory::constantString(string value) {
+    return lookup({NodeKind::String, 0, Symbol(value), 0, {}},
+                  [&] { return makeArenaShared<ConstantString>(value); });
+}
+
+SharedSMTRef HashConsFactory::constantBool(bool value) {
+    return lookup({NodeKind::Bool, 0, Symbol(), value, {}},
+                  [&] { return makeArenaShared<ConstantBool>(value); });
+}
+
+SharedSMTRef HashConsFactory::constantInt(llvm::APInt value) {
+    // The bitwidth is part of the identity of a constant
+    return lookup({NodeKind::Int, 0, Symbol(), value.getBitWidth(), {}, value},
+                  [&] { return makeArenaShared<ConstantInt>(value); });
+}
+
+SharedSMTRef HashConsFactory::op(string opName, vector<SharedSMTRef> args,
+                                 bool instantiate) {
+    // Arguments have to be canonical for pointer equality to imply structural
+    // equality
+    for (auto &arg : args) {
+        if (hashes.find(arg.get()) == hashes.end()) {
+            arg = intern(*arg);
+        }
+    }
+    return canonicalOp(Symbol(opName), std::move(args), instantiate);
+}
+
+SharedSMTRef HashConsFactory::canonicalOp(Symbol opName,
+                                          vector<SharedSMTRef> args,
+                                          bool instantiate) {
+    vector<const SMTExpr *> children;
+    children.reserve(args.size());
+    for (const auto &arg : args) {
+        if (hashes.find(arg.get()) == hashes.end()) {
+            registerOpaque(arg);
+        }
+        children.push_back(arg.get());
+    }
+    Key key{NodeKind::Op, 0, opName, instantiate, std::move(children)};
+    return lookup(std::move(key), [&] {
+        return makeArenaShared<Op>(opName, std::move(args), instantiate);
+    });
+}
+
+void HashConsFactory::registerOpaque(SharedSMTRef expr) {
+    // Nodes that are not hash-consed are only identical to themselves
+    hashes.insert({expr.get(), llvm::hash_value(expr.get())});
+    opaque.push_back(std::move(expr));
+}
+
+SharedSMTRef HashConsFactory::adopt(SharedSMTRef expr) {
+    if (hashes.find(expr.get()) == hashes.end()) {
+        registerOpaque(expr);
+    }
+    return expr;
+}
+
+struct HashConsVisitor : SMTVisitor {
+    // The arguments of an Op have already been interned when it is
+    // reassembled, so we can skip the check done by HashConsFactory::op
+    HashConsFactory &factory;
+    HashConsVisitor(HashConsFactory &factory) : factory(factory) {}
+    // Other nodes are kept unless their children change
+    bool handles(ExprTag tag) const override {
+        return tag == ExprTag::TypedVariable ||
+               tag == ExprTag::ConstantString ||
+               tag == ExprTag::ConstantBool || tag == ExprTag::ConstantInt ||
+               tag == ExprTag::Op;
+    }
+    SharedSMTRef reassemble(TypedVariable &var) override {
+        return factory.variable(var.symbol, var.type);
+    }
+    SharedSMTRef reassemble(ConstantString &str) override {
+        return factory.constantString(str.value);
+    }
+    SharedSMTRef reassemble(ConstantBool &cbool) override {
+        return factory.constantBool(cbool.value);
+    }
+    SharedSMTRef reassemble(ConstantInt &cint) override {
+        return factory.constantInt(cint.value);
+    }
+    SharedSMTRef reassemble(Op &op) override {
+        return factory.canonicalOp(op.opSymbol, std::move(op.args),
+                                   op.instantiate);
+    }
+};
+
+SharedSMTRef HashConsFactory::intern(const SMTExpr &expr) {
+    HashConsVisitor visitor{*this};
+    return expr.accept(visitor);
+}
+
+static thread_local HashConsFactory *currentFactory = nullptr;
+
+HashConsScope::HashConsScope(HashConsFactory &factory)
+    : previous(currentFactory) {
+    currentFactory = &factory;
+}
+
+HashConsScope::~HashConsScope() { currentFactory = previous; }
+
+SharedSMTRef hashConsOp(string opName, vector<SharedSMTRef> args,
+                        bool instantiate) {
+    if (currentFactory) {
+        return currentFactory->op(std::move(opName), std::move(args),
+                                  instantiate);
+    }
+    return makeArenaShared<Op>(std::move(opName), std::move(args),
+                               instantiate);
+}
+
+SharedSMTRef hashConsVariable(string name, Type type) {
+    if (currentFactory) {
+        return currentFactory->variable(std::move(name), std::move(type));
+    }
+    return makeArenaShared<TypedVariable>(std::move(name), std::move(type));
+}
+
+// Binding smaller terms doesn’t make the output any shorter
+static const size_t MinSharedSize = 4;
+
+// Only terms are bound, predicates and connectives stay where they are so the
+// clauses keep their Horn structure
+static bool isSharableOp(const string &opName) {
+    static const llvm::StringSet<> sharableOps = {
+        "select", "store",  "+",      "-",      "*",      "div",
+        "mod",    "bvadd",  "bvsub",  "bvmul",  "bvudiv", "bvsdiv",
+        "bvurem", "bvsrem", "bvshl",  "bvlshr", "bvashr", "bvand",
+        "bvor",   "bvxor",  "concat"};
+    return sharableOps.count(opName) > 0;
+}
+
+namespace {
+// The nodes of a clause are visited at most twice (once below nested foralls
+// and once outside of them), so this is linear in the size of the DAG even if
+// printing the clause takes exponential space.
+class SubtermSharing {
+  public:
+    // The names bound by the nested foralls around a subterm. Occurrences of
+    // a term that mention one of them refer to other variables than the
+    // occurrences outside, so they are not replaced by the binding.
+    struct Scope {
+        llvm::StringSet<> bound;
+        llvm::DenseMap<const SMTExpr *, bool> mentions;
+        llvm::DenseMap<const SMTExpr *, SharedSMTRef> rewritten;
+    };
+    void analyze(const SMTExpr &expr, bool nested);
+    void countUses(const SMTExpr &expr);
+    auto rewrite(const SharedSMTRef &expr, Scope *scope) -> SharedSMTRef;
+    std::vector<Assignment> defs;
+
+  private:
+    auto mentionsBound(const SMTExpr &expr, Scope &scope) -> bool;
+    auto rewriteForall(const Forall &forall, Scope *scope) -> SharedSMTRef;
+    struct Info {
+        // The size of the printed term, saturates at MinSharedSize
+        size_t size = 1;
+        size_t uses = 0;
+        bool visitedNested = false;
+        bool visitedOutside = false;
+    };
+    llvm::DenseMap<const SMTExpr *, Info> infos;
+    llvm::DenseMap<const SMTExpr *, SharedSMTRef> rewritten;
+    set<const SMTExpr *> counted;
+};
+}
+
+void SubtermSharing::analyze(const SMTExpr &expr, bool nested) {
+    {
+        Info &info = infos[&expr];
+        bool &visited = nested ? info.visitedNested : info.visitedOutside;
+        if (visited || (nested && info.visitedOutside)) {
+            return;
+        }
+        visited = true;
+    }
+    size_t size = 1;
+    if (const Op *op = expr.asOp()) {
+        for (const auto &arg : op->args) {
+            analyze(*arg, nested);
+            size += infos[arg.get()].size;
+        }
+    } else if (const Forall *forall = expr.asForall()) {
+        analyze(*forall->expr, true);
+    }
+    // The map may have been resized by the recursive calls
+    infos[&expr].size = std::min(size, MinSharedSize);
+}
+
+void SubtermSharing::countUses(const SMTExpr &expr) {
+    if (!counted.insert(&expr).second) {
+        return;
+    }
+    if (const Op *op = expr.asOp()) {
+        for (const auto &arg : op->args) {
+            ++infos[arg.get()].uses;
+            countUses(*arg);
+        }
+    } else if (const Forall *forall = expr.asForall()) {
+        ++infos[forall->expr.get()].uses;
+        countUses(*forall->expr);
+    }
+}
+
+// Conservative: terms that are not traversed by the rewriting count as
+// mentioning every name
+bool SubtermSharing::mentionsBound(const SMTExpr &expr, Scope &scope) {
+    auto it = scope.mentions.find(&expr);
+    if (it != scope.mentions.end()) {
+        return it->second;
+    }
+    bool mentions = true;
+    switch (expr.getTag()) {
+    case ExprTag::TypedVariable:
+        mentions = scope.bound.count(
+                       static_cast<const TypedVariable &>(expr).name) > 0;
+        break;
+    case ExprTag::ConstantString:
+        mentions = scope.bound.count(
+                       static_cast<const ConstantString &>(expr).value) > 0;
+        break;
+    case ExprTag::ConstantInt:
+    case ExprTag::ConstantBool:
+    case ExprTag::ConstantFP:
+        mentions = false;
+        break;
+    case ExprTag::Op:
+        mentions = false;
+        for (const auto &arg : expr.asOp()->args) {
+            if (mentionsBound(*arg, scope)) {
+                mentions = true;
+                break;
+            }
+        }
+        break;
+    case ExprTag::Forall:
+        mentions = mentionsBound(*expr.asForall()->expr, scope);
+        break;
+    default:
+        break;
+    }
+    scope.mentions.insert({&expr, mentions});
+    return mentions;
+}
+
+SharedSMTRef SubtermSharing::rewriteForall(const Forall &forall,
+                                           Scope *scope) {
+    Scope nested;
+    if (scope) {
+        for (const auto &name : scope->bound) {
+            nested.bound.insert(name.getKey());
+        }
+    }
+    for (const auto &var : forall.vars) {
+        nested.bound.insert(var.name);
+    }
+    SharedSMTRef body = rewrite(forall.expr, &nested);
+    if (body == forall.expr) {
+        return nullptr;
+    }
+    return makeArenaShared<Forall>(forall.vars, std::move(body));
+}
+
+SharedSMTRef SubtermSharing::rewrite(const SharedSMTRef &expr, Scope *scope) {
+    if (scope && mentionsBound(*expr, *scope)) {
+        // Rewrite the arguments but don't bind the term itself
+        auto it = scope->rewritten.find(expr.get());
+        if (it != scope->rewritten.end()) {
+            return it->second;
+        }
+        SharedSMTRef result = expr;
+        if (const Op *op = expr->asOp()) {
+            vector<SharedSMTRef> args;
+            args.reserve(op->args.size());
+            bool changed = false;
+            for (const auto &arg : op->args) {
+                args.push_back(rewrite(arg, scope));
+                changed = changed || args.back() != arg;
+            }
+            if (changed) {
+                result = makeArenaShared<Op>(op->opName, std::move(args),
+                                             op->instantiate);
+            }
+        } else if (const Forall *forall = expr->asForall()) {
+            if (SharedSMTRef rewrittenForall = rewriteForall(*forall, scope)) {
+                result = std::move(rewrittenForall);
+            }
+        }
+        scope->rewritten.insert({expr.get(), result});
+        return result;
+    }
+    // The term means the same everywhere, so the rewritten term can be reused
+    auto it = rewritten.find(expr.get());
+    if (it != rewritten.end()) {
+        return it->second;
+    }
+    SharedSMTRef result = expr;
+    if (const Op *op = expr->asOp()) {
+        vector<SharedSMTRef> args;
+        args.reserve(op->args.size());
+        bool changed = false;
+        for (const auto &arg : op->args) {
+            args.push_back(rewrite(arg, scope));
+            changed = changed || args.back() != arg;
+        }
+        if (changed) {
+            result = makeArenaShared<Op>(op->opName, std::move(args),
+                                         op->instantiate);
+        }
+        const Info &info = infos[expr.get()];
+        if (info.visitedOutside && info.uses > 1 &&
+            info.size >= MinSharedSize && isSharableOp(op->opName)) {
+            // Arguments are rewritten first, so bindings only refer to
+            // earlier bindings
+            string name = "shared$" + std::to_string(defs.size());
+            defs.push_back({name, std::move(result)});
+            result = stringExpr(name);
+        }
+    } else if (const Forall *forall = expr->asForall()) {
+        if (SharedSMTRef rewrittenForall = rewriteForall(*forall, scope)) {
+            result = std::move(rewrittenForall);
+        }
+    }
+    rewritten.insert({expr.get(), result});
+    return result;
+}
+
+SharedSMTRef bindSharedSubterms(const SharedSMTRef &clause) {
+    if (const Assert *assertion = clause->asAssert()) {
+        return makeArenaShared<Assert>(bindSharedSubterms(assertion->expr));
+    }
+    if (const Forall *forall = clause->asForall()) {
+        return makeArenaShared<Forall>(forall->vars,
+                                       bindSharedSubterms(forall->expr));
+    }
+    SubtermSharing sharing;
+    sharing.analyze(*clause, false);
+    sharing.countUses(*clause);
+    SharedSMTRef body = sharing.rewrite(clause, nullptr);
+    return nestLets(std::move(body), sharing.defs);
+}
+}
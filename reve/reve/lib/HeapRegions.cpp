@@ -0,0 +1,352 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "HeapRegions.h"
+
+#include "Logging.h"
+#include "Opts.h"
+#include "Statistics.h"
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/ScopedNoAliasAA.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Passes/PassBuilder.h"
+
+#include <algorithm>
+
+using std::map;
+using std::vector;
+
+using namespace llreve::opts;
+
+namespace {
+// A union-find over the pointers of one module. Node 0 stands for memory that
+// may also be reached via pointers of unknown origin.
+class PointerClasses {
+  public:
+    static const size_t Unknown = 0;
+
+    auto node(const llvm::Value *pointer) -> size_t;
+    auto returnNode(const llvm::Function &fun) -> size_t;
+    auto find(size_t node) -> size_t;
+    void join(size_t first, size_t second);
+    void join(const llvm::Value *first, const llvm::Value *second) {
+        join(node(first), node(second));
+    }
+    void escape(const llvm::Value *pointer) { join(node(pointer), Unknown); }
+
+    map<const llvm::Value *, size_t> nodes;
+
+  private:
+    auto freshNode() -> size_t;
+
+    vector<size_t> parents = {Unknown};
+    map<const llvm::Function *, size_t> returnNodes;
+};
+}
+
+auto PointerClasses::freshNode() -> size_t {
+    parents.push_back(parents.size());
+    return parents.size() - 1;
+}
+
+auto PointerClasses::node(const llvm::Value *pointer) -> size_t {
+    // Every null or undefined pointer gets its own node, otherwise comparing
+    // two unrelated pointers to null would merge their regions
+    if (llvm::isa<llvm::ConstantPointerNull>(pointer) ||
+        llvm::isa<llvm::UndefValue>(pointer)) {
+        return freshNode();
+    }
+    // Globals and constant expressions, the string constants are stored in the
+    // heap of region 0
+    if (llvm::isa<llvm::Constant>(pointer)) {
+        return Unknown;
+    }
+    auto it = nodes.find(pointer);
+    if (it != nodes.end()) {
+        return it->second;
+    }
+    const size_t newNode = freshNode();
+    nodes.insert({pointer, newNode});
+    return newNode;
+}
+
+auto PointerClasses::returnNode(const llvm::Function &fun) -> size_t {
+    auto it = returnNodes.find(&fun);
+    if (it != returnNodes.end()) {
+        return it->second;
+    }
+    const size_t newNode = freshNode();
+    returnNodes.insert({&fun, newNode});
+    return newNode;
+}
+
+auto PointerClasses::find(size_t node) -> size_t {
+    while (parents[node] != node) {
+        parents[node] = parents[parents[node]];
+        node = parents[node];
+    }
+    return node;
+}
+
+// The smaller node becomes the root so Unknown always stays a root
+void PointerClasses::join(size_t first, size_t second) {
+    first = find(first);
+    second = find(second);
+    parents[std::max(first, second)] = std::min(first, second);
+}
+
+static bool isPointer(const llvm::Value *value) {
+    return value->getType()->isPointerTy();
+}
+
+static void escapePointerOperands(const llvm::Instruction &inst,
+                                  PointerClasses &classes) {
+    for (const auto &operand : inst.operands()) {
+        if (isPointer(operand)) {
+            classes.escape(operand);
+        }
+    }
+    if (isPointer(&inst)) {
+        classes.escape(&inst);
+    }
+}
+
+static void addCall(const llvm::CallInst &call, PointerClasses &classes) {
+    const llvm::Function *callee = call.getCalledFunction();
+    if (const auto memcpy = llvm::dyn_cast<llvm::MemCpyInst>(&call)) {
+        classes.join(memcpy->getRawDest(), memcpy->getRawSource());
+        return;
+    }
+    // memset only stores constants so it does not relate any pointers
+    if (llvm::isa<llvm::MemSetInst>(&call)) {
+        return;
+    }
+    if (!callee || hasFixedAbstraction(*callee)) {
+        // The marks only take integers so this is a noop for them
+        escapePointerOperands(call, classes);
+        return;
+    }
+    auto param = callee->arg_begin();
+    for (unsigned i = 0; i < call.getNumArgOperands(); ++i, ++param) {
+        const llvm::Value *arg = call.getArgOperand(i);
+        if (param == callee->arg_end()) {
+            // Varargs
+            if (isPointer(arg)) {
+                classes.escape(arg);
+            }
+        } else if (isPointer(arg)) {
+            classes.join(arg, &*param);
+        }
+    }
+    if (isPointer(&call)) {
+        classes.join(classes.node(&call), classes.returnNode(*callee));
+    }
+}
+
+static void addInstruction(const llvm::Instruction &inst,
+                           PointerClasses &classes) {
+    if (const auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&inst)) {
+        classes.join(gep, gep->getPointerOperand());
+    } else if (const auto cast = llvm::dyn_cast<llvm::CastInst>(&inst)) {
+        if (isPointer(cast) && isPointer(cast->getOperand(0))) {
+            classes.join(cast, cast->getOperand(0));
+        } else if (isPointer(cast)) {
+            classes.escape(cast);
+        } else if (isPointer(cast->getOperand(0))) {
+            classes.escape(cast->getOperand(0));
+        }
+    } else if (const auto phi = llvm::dyn_cast<llvm::PHINode>(&inst)) {
+        if (isPointer(phi)) {
+            for (const auto &incoming : phi->incoming_values()) {
+                classes.join(phi, incoming);
+            }
+        }
+    } else if (const auto select = llvm::dyn_cast<llvm::SelectInst>(&inst)) {
+        if (isPointer(select)) {
+            classes.join(select, select->getTrueValue());
+            classes.join(select, select->getFalseValue());
+        }
+    } else if (const auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+        classes.node(load->getPointerOperand());
+        if (isPointer(load)) {
+            classes.escape(load);
+        }
+    } else if (const auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        classes.node(store->getPointerOperand());
+        if (isPointer(store->getValueOperand())) {
+            classes.escape(store->getValueOperand());
+        }
+    } else if (const auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        addCall(*call, classes);
+    } else if (const auto ret = llvm::dyn_cast<llvm::ReturnInst>(&inst)) {
+        const llvm::Value *value = ret->getReturnValue();
+        if (value && isPointer(value)) {
+            classes.join(classes.node(value),
+                         classes.returnNode(*inst.getFunction()));
+        }
+    } else if (!llvm::isa<llvm::CmpInst>(&inst) && !inst.isTerminator()) {
+        escapePointerOperands(inst, classes);
+    }
+}
+
+// Parameters that are not only passed by direct calls in the module can point
+// anywhere
+static bool hasOnlyDirectCalls(const llvm::Function &fun) {
+    if (fun.user_empty()) {
+        return false;
+    }
+    return std::all_of(fun.user_begin(), fun.user_end(), [&fun](auto user) {
+        const auto call = llvm::dyn_cast<llvm::CallInst>(user);
+        return call && call->getCalledFunction() == &fun;
+    });
+}
+
+static auto pointerArguments(const llvm::Function &fun)
+    -> vector<const llvm::Argument *> {
+    vector<const llvm::Argument *> pointers;
+    for (const auto &arg : fun.args()) {
+        if (isPointer(&arg)) {
+            pointers.push_back(&arg);
+        }
+    }
+    return pointers;
+}
+
+// The arguments of the main function are the roots of the regions, those that
+// may alias share a region. Only noalias (restrict) arguments are guaranteed
+// not to alias memory that is reached via pointers of unknown origin.
+static void joinAliasingArguments(llvm::Function &fun,
+                                  PointerClasses &classes) {
+    llvm::FunctionAnalysisManager fam(false);
+    // Has to be registered before the default analyses to take precedence
+    // over the empty AAManager registered by the PassBuilder
+    fam.registerPass([] {
+        llvm::AAManager aa;
+        aa.registerFunctionAnalysis<llvm::BasicAA>();
+        aa.registerFunctionAnalysis<llvm::ScopedNoAliasAA>();
+        return aa;
+    });
+    llvm::PassBuilder pb;
+    pb.registerFunctionAnalyses(fam);
+    auto &aa = fam.getResult<llvm::AAManager>(fun);
+    const auto pointers = pointerArguments(fun);
+    for (size_t i = 0; i < pointers.size(); ++i) {
+        if (!pointers[i]->hasNoAliasAttr()) {
+            classes.escape(pointers[i]);
+        }
+        for (size_t j = i + 1; j < pointers.size(); ++j) {
+            if (aa.alias(llvm::MemoryLocation(pointers[i]),
+                         llvm::MemoryLocation(pointers[j])) !=
+                llvm::AliasResult::NoAlias) {
+                classes.join(pointers[i], pointers[j]);
+            }
+        }
+    }
+}
+
+static auto pointerClasses(llvm::Module &module, llvm::Function &mainFunction)
+    -> PointerClasses {
+    PointerClasses classes;
+    for (const auto &fun : module) {
+        if (fun.isDeclaration()) {
+            continue;
+        }
+        if (&fun != &mainFunction && !hasOnlyDirectCalls(fun)) {
+            for (const auto &arg : fun.args()) {
+                if (isPointer(&arg)) {
+                    classes.escape(&arg);
+                }
+            }
+        }
+        for (const auto &block : fun) {
+            for (const auto &inst : block) {
+                addInstruction(inst, classes);
+            }
+        }
+    }
+    joinAliasingArguments(mainFunction, classes);
+    return classes;
+}
+
+// Regions are numbered in the order of the first argument of the main
+// function that points to them
+static auto numberRegions(PointerClasses &classes,
+                          const llvm::Function &mainFunction,
+                          map<size_t, unsigned> &regionOfClass)
+    -> vector<unsigned> {
+    regionOfClass = {{PointerClasses::Unknown, 0}};
+    vector<unsigned> argumentRegions;
+    for (const auto arg : pointerArguments(mainFunction)) {
+        const size_t root = classes.find(classes.node(arg));
+        auto it = regionOfClass.find(root);
+        if (it == regionOfClass.end()) {
+            const unsigned region = static_cast<unsigned>(regionOfClass.size());
+            it = regionOfClass.insert({root, region}).first;
+        }
+        argumentRegions.push_back(it->second);
+    }
+    return argumentRegions;
+}
+
+void assignHeapRegions(MonoPair<llvm::Module &> modules) {
+    stats::ScopedTimer timer("preprocess.heap regions");
+    auto &opts = SMTGenerationOpts::getInstance();
+    opts.HeapRegionCount = 1;
+    opts.HeapRegions.clear();
+    if (opts.Stack == StackOpt::Enabled) {
+        logWarning("The heap is not partitioned if the stack is used\n");
+        return;
+    }
+    if (!opts.MainFunctions.first || !opts.MainFunctions.second) {
+        return;
+    }
+    auto classes = makeMonoPair(
+        pointerClasses(modules.first, *opts.MainFunctions.first),
+        pointerClasses(modules.second, *opts.MainFunctions.second));
+    MonoPair<map<size_t, unsigned>> regionOfClass = {{}, {}};
+    const auto argumentRegions = makeMonoPair(
+        numberRegions(classes.first, *opts.MainFunctions.first,
+                      regionOfClass.first),
+        numberRegions(classes.second, *opts.MainFunctions.second,
+                      regionOfClass.second));
+    if (argumentRegions.first != argumentRegions.second) {
+        logWarning("The heap regions of the two programs don’t match, the "
+                   "heap is not partitioned\n");
+        return;
+    }
+    opts.HeapRegionCount = static_cast<unsigned>(regionOfClass.first.size());
+    stats::count("heap regions", opts.HeapRegionCount);
+    if (opts.HeapRegionCount == 1) {
+        return;
+    }
+    auto addRegions = [&opts](PointerClasses &pointers,
+                              const map<size_t, unsigned> &regions) {
+        for (const auto &pointer : pointers.nodes) {
+            auto it = regions.find(pointers.find(pointer.second));
+            if (it != regions.end() && it->second > 0) {
+                opts.HeapRegions.insert({pointer.first, it->second});
+            }
+        }
+    };
+    addRegions(classes.first, regionOfClass.first);
+    addRegions(classes.second, regionOfClass.second);
+}
+
+auto heapRegion(const llvm::Value *pointer) -> unsigned {
+    const auto &regions = SMTGenerationOpts::getInstance().HeapRegions;
+    auto it = regions.find(pointer);
+    if (it == regions.end()) {
+        return 0;
+    }
+    return it->second;
+}
@@ -9,6 +9,8 @@
  */
 
 #include "Helper.h"
+#include "Arena.h"
+#include "FloatAbstraction.h"
 
 #include "Memory.h"
 #include "Opts.h"
@@ -16,6 +18,9 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Operator.h"
 
+#include <atomic>
+#include <thread>
+
 using std::make_unique;
 using std::set;
 using std::string;
@@ -139,6 +144,33 @@ std::string heapName(int progIndex) {
     return "HEAP$" + std::to_string(progIndex);
 }
 std::string heapResultName(Program prog) { return heapName(prog) + "_res"; }
+std::string heapName(Program prog, unsigned region) {
+    return heapName(programIndex(prog), region);
+}
+std::string heapName(int progIndex, unsigned region) {
+    if (region == 0) {
+        return heapName(progIndex);
+    }
+    return heapName(progIndex) + "_r" + std::to_string(region);
+}
+std::string heapResultName(Program prog, unsigned region) {
+    return heapName(prog, region) + "_res";
+}
+std::vector<std::string> heapNames(Program prog) {
+    std::vector<std::string> names;
+    const unsigned regions = SMTGenerationOpts::getInstance().HeapRegionCount;
+    for (unsigned region = 0; region < regions; ++region) {
+        names.push_back(heapName(prog, region));
+    }
+    return names;
+}
+std::vector<std::string> heapResultNames(Program prog) {
+    std::vector<std::string> names;
+    for (const auto &name : heapNames(prog)) {
+        names.push_back(name + "_res");
+    }
+    return names;
+}
 
 std::string stackName(Program prog) { return stackName(programIndex(prog)); }
 std::string stackName(int progIndex) {
@@ -189,10 +221,17 @@ std::vector<SortedVar> getMutualResultValues(const llvm::StringRef assignedTo1,
     std::vector<SortedVar> resultValues;
     resultValues.emplace_back(assignedTo1, llvmType(function1.getReturnType()));
     resultValues.emplace_back(assignedTo2, llvmType(function2.getReturnType()));
+    // Coupled functions either both pass memory or both don’t
+    if (!passesMemory(function1)) {
+        return resultValues;
+    }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        resultValues.emplace_back(heapResultName(Program::First), memoryType());
-        resultValues.emplace_back(heapResultName(Program::Second),
-                                  memoryType());
+        for (const auto &heap : heapResultNames(Program::First)) {
+            resultValues.emplace_back(heap, memoryType());
+        }
+        for (const auto &heap : heapResultNames(Program::Second)) {
+            resultValues.emplace_back(heap, memoryType());
+        }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         resultValues.emplace_back(stackResultName(Program::First),
@@ -208,8 +247,13 @@ std::vector<SortedVar> getResultValues(Program prog,
                                        const llvm::Function &function) {
     std::vector<SortedVar> resultValues;
     resultValues.emplace_back(assignedTo, llvmType(function.getReturnType()));
+    if (!passesMemory(function)) {
+        return resultValues;
+    }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        resultValues.emplace_back(heapResultName(prog), memoryType());
+        for (const auto &heap : heapResultNames(prog)) {
+            resultValues.emplace_back(heap, memoryType());
+        }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         resultValues.emplace_back(stackResultName(prog), memoryType());
@@ -256,3 +300,38 @@ auto dropSuffixFromName(string name) -> string {
     }
     return name;
 }
+
+void runInParallel(const vector<std::function<void()>> &tasks, unsigned jobs) {
+    if (jobs <= 1 || tasks.size() <= 1) {
+        for (const auto &task : tasks) {
+            task();
+        }
+        return;
+    }
+    std::atomic<size_t> nextTask{0};
+    // The workers need to see the same options as the calling thread
+    SMTGenerationOpts &smtOpts = SMTGenerationOpts::getInstance();
+    // Arenas can only be used by one thread, so each worker gets its own. The
+    // nodes can outlive it, see Arena.h.
+    const bool useArena = hasActiveArena();
+    auto worker = [&tasks, &nextTask, &smtOpts, useArena] {
+        SMTGenerationOpts::Scope optsScope(smtOpts);
+        std::unique_ptr<Arena> arena;
+        std::unique_ptr<ArenaScope> arenaScope;
+        if (useArena) {
+            arena = std::make_unique<Arena>();
+            arenaScope = std::make_unique<ArenaScope>(*arena);
+        }
+        for (size_t i = nextTask++; i < tasks.size(); i = nextTask++) {
+            tasks[i]();
+        }
+    };
+    vector<std::thread> threads;
+    const size_t numThreads = std::min<size_t>(jobs, tasks.size());
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
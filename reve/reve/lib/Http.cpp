@@ -0,0 +1,117 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Http.h"
+
+#include <cstdio>
+#include <tuple>
+
+using std::string;
+
+// Requests with larger headers are rejected
+static const size_t MaxHeaderSize = 64 * 1024;
+
+HttpParse parseHttpRequest(llvm::StringRef buffer, size_t maxBody,
+                           HttpRequest &request, size_t &consumed) {
+    const size_t headerEnd = buffer.find("\r\n\r\n");
+    if (headerEnd == llvm::StringRef::npos) {
+        return buffer.size() > MaxHeaderSize ? HttpParse::TooLarge
+                                             : HttpParse::Incomplete;
+    }
+    request = HttpRequest();
+    llvm::StringRef header = buffer.substr(0, headerEnd);
+    llvm::StringRef requestLine;
+    std::tie(requestLine, header) = header.split("\r\n");
+
+    llvm::StringRef method, path, version;
+    std::tie(method, path) = requestLine.split(' ');
+    std::tie(path, version) = path.split(' ');
+    if (method.empty() || !path.startswith("/") ||
+        !version.startswith("HTTP/1.")) {
+        return HttpParse::Invalid;
+    }
+    request.Method = method.str();
+    request.Path = path.str();
+
+    while (!header.empty()) {
+        llvm::StringRef line, name, value;
+        std::tie(line, header) = header.split("\r\n");
+        std::tie(name, value) = line.split(':');
+        if (name.empty() || name.size() == line.size()) {
+            return HttpParse::Invalid;
+        }
+        request.Headers[name.trim().lower()] = value.trim().str();
+    }
+    if (request.Headers.count("transfer-encoding")) {
+        return HttpParse::Invalid;
+    }
+
+    size_t length = 0;
+    auto contentLength = request.Headers.find("content-length");
+    if (contentLength != request.Headers.end() &&
+        llvm::StringRef(contentLength->second).getAsInteger(10, length)) {
+        return HttpParse::Invalid;
+    }
+    if (length > maxBody) {
+        return HttpParse::TooLarge;
+    }
+    const size_t bodyStart = headerEnd + 4;
+    if (buffer.size() - bodyStart < length) {
+        return HttpParse::Incomplete;
+    }
+    request.Body = buffer.substr(bodyStart, length).str();
+    consumed = bodyStart + length;
+    return HttpParse::Complete;
+}
+
+static const char *statusText(int status) {
+    switch (status) {
+    case 200:
+        return "OK";
+    case 201:
+        return "Created";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 413:
+        return "Payload Too Large";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+static string statusLine(int status, llvm::StringRef contentType) {
+    return "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) +
+           "\r\nContent-Type: " + contentType.str() +
+           "\r\nConnection: close\r\n";
+}
+
+string httpResponse(int status, llvm::StringRef contentType,
+                    llvm::StringRef body) {
+    return statusLine(status, contentType) +
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" +
+           body.str();
+}
+
+string httpStreamHeader(int status, llvm::StringRef contentType) {
+    return statusLine(status, contentType) +
+           "Transfer-Encoding: chunked\r\n\r\n";
+}
+
+string httpChunk(llvm::StringRef data) {
+    char size[32];
+    snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return size + data.str() + "\r\n";
+}
@@ -0,0 +1,274 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "IdenticalFunctions.h"
+
+#include "Statistics.h"
+#include "StructuralCoupling.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+
+using std::set;
+using std::string;
+
+using namespace llreve::opts;
+
+using FunctionPair = MonoPair<const llvm::Function *>;
+using ValueMapping = llvm::DenseMap<const llvm::Value *, const llvm::Value *>;
+
+// The modules may have separate contexts, so types and constants are
+// compared by their textual representation
+template <typename T> static string printed(const T &printable) {
+    string result;
+    llvm::raw_string_ostream stream(result);
+    printable.print(stream);
+    return stream.str();
+}
+
+// Constants referring to a function could call it indirectly, so their
+// bodies would have to be compared as well
+static bool refersToFunction(const llvm::Constant &constant) {
+    if (llvm::isa<llvm::Function>(constant)) {
+        return true;
+    }
+    if (llvm::isa<llvm::GlobalValue>(constant)) {
+        return false;
+    }
+    for (const auto &operand : constant.operands()) {
+        if (refersToFunction(*llvm::cast<llvm::Constant>(operand))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool sameOperand(const llvm::Value *value1, const llvm::Value *value2,
+                        const ValueMapping &values,
+                        set<FunctionPair> &callees) {
+    if (printed(*value1->getType()) != printed(*value2->getType())) {
+        return false;
+    }
+    if (llvm::isa<llvm::Instruction>(value1) ||
+        llvm::isa<llvm::Argument>(value1) ||
+        llvm::isa<llvm::BasicBlock>(value1)) {
+        return values.lookup(value1) == value2;
+    }
+    if (const auto fun1 = llvm::dyn_cast<llvm::Function>(value1)) {
+        const auto fun2 = llvm::dyn_cast<llvm::Function>(value2);
+        if (fun2 == nullptr) {
+            return false;
+        }
+        callees.insert({fun1, fun2});
+        return true;
+    }
+    if (const auto global1 = llvm::dyn_cast<llvm::GlobalVariable>(value1)) {
+        // The definitions include the name and the initializer
+        const auto global2 = llvm::dyn_cast<llvm::GlobalVariable>(value2);
+        return global2 != nullptr && printed(*global1) == printed(*global2) &&
+               !(global1->hasInitializer() &&
+                 refersToFunction(*global1->getInitializer()));
+    }
+    if (const auto constant1 = llvm::dyn_cast<llvm::Constant>(value1)) {
+        return llvm::isa<llvm::Constant>(value2) &&
+               !llvm::isa<llvm::GlobalValue>(value2) &&
+               !refersToFunction(*constant1) &&
+               printed(*value1) == printed(*value2);
+    }
+    return false;
+}
+
+// The instructions whose semantics are determined by the opcode, the
+// optional flags (nsw, exact, …), the types and the operands together with
+// the attributes compared below
+static bool isComparableInstruction(const llvm::Instruction &instr) {
+    return instr.isBinaryOp() || instr.isCast() ||
+           llvm::isa<llvm::CmpInst>(instr) ||
+           llvm::isa<llvm::LoadInst>(instr) ||
+           llvm::isa<llvm::StoreInst>(instr) ||
+           llvm::isa<llvm::AllocaInst>(instr) ||
+           llvm::isa<llvm::GetElementPtrInst>(instr) ||
+           llvm::isa<llvm::CallInst>(instr) ||
+           llvm::isa<llvm::PHINode>(instr) ||
+           llvm::isa<llvm::SelectInst>(instr) ||
+           llvm::isa<llvm::BranchInst>(instr) ||
+           llvm::isa<llvm::SwitchInst>(instr) ||
+           llvm::isa<llvm::ReturnInst>(instr) ||
+           llvm::isa<llvm::UnreachableInst>(instr) ||
+           llvm::isa<llvm::ExtractValueInst>(instr) ||
+           llvm::isa<llvm::InsertValueInst>(instr);
+}
+
+static bool sameInstruction(const llvm::Instruction &instr1,
+                            const llvm::Instruction &instr2,
+                            const ValueMapping &values,
+                            set<FunctionPair> &callees) {
+    if (!isComparableInstruction(instr1) ||
+        instr1.getOpcode() != instr2.getOpcode() ||
+        instr1.getNumOperands() != instr2.getNumOperands() ||
+        instr1.getRawSubclassOptionalData() !=
+            instr2.getRawSubclassOptionalData() ||
+        printed(*instr1.getType()) != printed(*instr2.getType())) {
+        return false;
+    }
+    if (const auto cmp1 = llvm::dyn_cast<llvm::CmpInst>(&instr1)) {
+        if (cmp1->getPredicate() !=
+            llvm::cast<llvm::CmpInst>(instr2).getPredicate()) {
+            return false;
+        }
+    } else if (const auto alloca1 = llvm::dyn_cast<llvm::AllocaInst>(&instr1)) {
+        if (printed(*alloca1->getAllocatedType()) !=
+            printed(*llvm::cast<llvm::AllocaInst>(instr2).getAllocatedType())) {
+            return false;
+        }
+    } else if (const auto extract1 =
+                   llvm::dyn_cast<llvm::ExtractValueInst>(&instr1)) {
+        if (extract1->getIndices() !=
+            llvm::cast<llvm::ExtractValueInst>(instr2).getIndices()) {
+            return false;
+        }
+    } else if (const auto insert1 =
+                   llvm::dyn_cast<llvm::InsertValueInst>(&instr1)) {
+        if (insert1->getIndices() !=
+            llvm::cast<llvm::InsertValueInst>(instr2).getIndices()) {
+            return false;
+        }
+    } else if (const auto phi1 = llvm::dyn_cast<llvm::PHINode>(&instr1)) {
+        // The incoming blocks are not operands
+        const auto &phi2 = llvm::cast<llvm::PHINode>(instr2);
+        for (unsigned i = 0; i < phi1->getNumIncomingValues(); ++i) {
+            if (values.lookup(phi1->getIncomingBlock(i)) !=
+                phi2.getIncomingBlock(i)) {
+                return false;
+            }
+        }
+    }
+    for (unsigned i = 0; i < instr1.getNumOperands(); ++i) {
+        if (!sameOperand(instr1.getOperand(i), instr2.getOperand(i), values,
+                         callees)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool identicalFunctions(FunctionPair functions, set<FunctionPair> &callees) {
+    const llvm::Function &fun1 = *functions.first;
+    const llvm::Function &fun2 = *functions.second;
+    // The hash is cheap and rejects most pairs that differ
+    if (structuralHash(fun1) != structuralHash(fun2) ||
+        printed(*fun1.getFunctionType()) != printed(*fun2.getFunctionType()) ||
+        fun1.size() != fun2.size()) {
+        return false;
+    }
+    // Values are matched by their position, operands may refer to values that
+    // are defined later (e.g. in phi nodes) so the mapping is built first
+    ValueMapping values;
+    auto arg2 = fun2.arg_begin();
+    for (const auto &arg1 : fun1.args()) {
+        values[&arg1] = &*arg2++;
+    }
+    auto block2 = fun2.begin();
+    for (const auto &block1 : fun1) {
+        if (block1.size() != block2->size()) {
+            return false;
+        }
+        values[&block1] = &*block2;
+        auto instr2 = block2->begin();
+        for (const auto &instr1 : block1) {
+            values[&instr1] = &*instr2++;
+        }
+        ++block2;
+    }
+    for (const auto &block1 : fun1) {
+        for (const auto &instr1 : block1) {
+            const auto instr2 =
+                llvm::cast<llvm::Instruction>(values.lookup(&instr1));
+            if (!sameInstruction(instr1, *instr2, values, callees)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Calls of declarations are encoded as equivalent if the declarations are
+// coupled, intrinsics are encoded by their name
+static bool equivalentDeclarations(FunctionPair functions,
+                                   const set<FunctionPair> &coupled) {
+    if (!functions.first->isDeclaration() ||
+        !functions.second->isDeclaration()) {
+        return false;
+    }
+    if (coupled.find(functions) != coupled.end()) {
+        return true;
+    }
+    return functions.first->getName() == functions.second->getName() &&
+           (functions.first->isIntrinsic() ||
+            isLlreveIntrinsic(*functions.first));
+}
+
+size_t assumeIdenticalPairsEquivalent(SMTGenerationOpts &smtOpts,
+                                      const FileOptions &fileOpts) {
+    set<FunctionPair> coupled;
+    for (const auto &funPair : smtOpts.CoupledFunctions) {
+        coupled.insert(funPair);
+    }
+    const auto &conditions = fileOpts.FunctionConditions;
+    // The callees of every identical pair
+    std::map<FunctionPair, set<FunctionPair>> identical;
+    for (const auto &funPair : coupled) {
+        if (funPair == FunctionPair(smtOpts.MainFunctions) ||
+            funPair.first->isDeclaration() ||
+            funPair.second->isDeclaration() ||
+            conditions.count(funPair.first->getName().str()) > 0 ||
+            conditions.count(funPair.second->getName().str()) > 0) {
+            continue;
+        }
+        set<FunctionPair> callees;
+        if (identicalFunctions(funPair, callees)) {
+            identical.insert({funPair, callees});
+        }
+    }
+    // A pair whose callees are not all identical is removed, which may in
+    // turn invalidate its callers. The remaining pairs can call each other
+    // recursively, which is fine since they behave the same on every step.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = identical.begin(); it != identical.end();) {
+            bool calleesIdentical = true;
+            for (const auto &callee : it->second) {
+                if (identical.find(callee) == identical.end() &&
+                    !equivalentDeclarations(callee, coupled)) {
+                    calleesIdentical = false;
+                    break;
+                }
+            }
+            if (calleesIdentical) {
+                ++it;
+            } else {
+                it = identical.erase(it);
+                changed = true;
+            }
+        }
+    }
+    size_t added = 0;
+    for (const auto &entry : identical) {
+        added += smtOpts.AssumeEquivalent.insert(entry.first).second;
+    }
+    stats::count("identical functions.assumed equivalent", added);
+    return added;
+}
@@ -0,0 +1,144 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Incremental.h"
+
+#include "Helper.h"
+
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+
+using std::set;
+using std::string;
+using std::vector;
+
+using namespace llreve::opts;
+
+// The function itself and all functions it calls transitively, ordered by
+// name so that the hash does not depend on pointer values
+static std::map<string, const llvm::Function *>
+transitiveCallees(const llvm::Function &fun) {
+    std::map<string, const llvm::Function *> callees;
+    vector<const llvm::Function *> toProcess = {&fun};
+    while (!toProcess.empty()) {
+        const llvm::Function *f = toProcess.back();
+        toProcess.pop_back();
+        if (!callees.insert({f->getName().str(), f}).second) {
+            continue;
+        }
+        for (const auto callee : calledFunctions(*f)) {
+            // Indirect calls don’t have a called function
+            if (callee) {
+                toProcess.push_back(callee);
+            }
+        }
+    }
+    return callees;
+}
+
+static void hashFunctions(llvm::MD5 &hash, const llvm::Function &fun,
+                          const FileOptions &fileOpts) {
+    for (const auto &callee : transitiveCallees(fun)) {
+        string ir;
+        llvm::raw_string_ostream irStream(ir);
+        callee.second->print(irStream);
+        irStream.flush();
+        hash.update(ir);
+        auto conditions = fileOpts.FunctionConditions.equal_range(callee.first);
+        for (auto it = conditions.first; it != conditions.second; ++it) {
+            hash.update(it->second);
+        }
+    }
+}
+
+string functionPairHash(MonoPair<const llvm::Function *> funPair,
+                        const SMTGenerationOpts &smtOpts,
+                        const FileOptions &fileOpts) {
+    llvm::MD5 hash;
+    // Only options that change the meaning of the encoding are relevant
+    string options = std::to_string(static_cast<int>(smtOpts.Heap)) +
+                     std::to_string(static_cast<int>(smtOpts.Stack)) +
+                     std::to_string(static_cast<int>(smtOpts.GlobalConstants)) +
+                     std::to_string(static_cast<int>(smtOpts.ByteHeap)) +
+                     std::to_string(static_cast<int>(smtOpts.PerfectSync)) +
+                     std::to_string(smtOpts.EverythingSigned) +
+                     std::to_string(smtOpts.BitVect);
+    hash.update(options);
+    hashFunctions(hash, *funPair.first, fileOpts);
+    // Separates the two sides so that moving code from one to the other
+    // changes the hash
+    hash.update(llvm::StringRef("\0", 1));
+    hashFunctions(hash, *funPair.second, fileOpts);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    return hexResult.str();
+}
+
+set<string> readProvenPairHashes(const string &fileName) {
+    set<string> hashes;
+    std::ifstream file(fileName);
+    string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) {
+            hashes.insert(line);
+        }
+    }
+    return hashes;
+}
+
+void writeProvenPairHashes(const string &fileName, const set<string> &hashes) {
+    std::ofstream file(fileName);
+    if (!file) {
+        logError("Couldn’t open " + fileName + "\n");
+        exit(1);
+    }
+    for (const auto &hash : hashes) {
+        file << hash << "\n";
+    }
+}
+
+size_t assumeProvenPairsEquivalent(const set<string> &proven,
+                                   SMTGenerationOpts &smtOpts,
+                                   const FileOptions &fileOpts) {
+    size_t assumed = 0;
+    for (const auto &funPair : smtOpts.CoupledFunctions) {
+        // The main functions are what we want to prove so they are never
+        // abstracted. Declarations are already abstracted as equivalent.
+        if (funPair == smtOpts.MainFunctions ||
+            funPair.first->isDeclaration() || funPair.second->isDeclaration()) {
+            continue;
+        }
+        MonoPair<const llvm::Function *> constPair = funPair;
+        if (proven.find(functionPairHash(constPair, smtOpts, fileOpts)) !=
+                proven.end() &&
+            smtOpts.AssumeEquivalent.insert(constPair).second) {
+            ++assumed;
+        }
+    }
+    return assumed;
+}
+
+string standaloneProofHash(const SMTGenerationOpts &smtOpts,
+                           const FileOptions &fileOpts) {
+    const auto &mainPair = smtOpts.MainFunctions;
+    // A custom relation or condition only proves the pair for some of its
+    // inputs while callers rely on equal outputs for all equal inputs
+    if (fileOpts.InRelation || fileOpts.OutRelation ||
+        fileOpts.FunctionConditions.count(mainPair.first->getName()) > 0 ||
+        fileOpts.FunctionConditions.count(mainPair.second->getName()) > 0) {
+        return "";
+    }
+    MonoPair<const llvm::Function *> constPair = mainPair;
+    return functionPairHash(constPair, smtOpts, fileOpts);
+}
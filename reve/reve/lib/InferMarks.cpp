@@ -10,39 +10,209 @@
 
 #include "InferMarks.h"
 
+#include "Statistics.h"
 #include "UnifyFunctionExitNodes.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 
 using std::make_pair;
 using std::set;
+using std::vector;
 
 llvm::AnalysisKey InferMarksAnalysis::Key;
 
+namespace {
+// Counts the paths between marks like findPaths enumerates them for a set of
+// marked blocks. The counts saturate so they can’t overflow.
+class PathCounter {
+  public:
+    PathCounter(const llvm::DenseSet<const llvm::BasicBlock *> &marked,
+                const llvm::BasicBlock *returnBlock, uint64_t limit)
+        : Marked(marked), ReturnBlock(returnBlock), Limit(limit) {}
+    // The number of paths starting at the marked block 'start', None if
+    // there is a cycle without a mark
+    auto pathsFrom(const llvm::BasicBlock &start) -> llvm::Optional<uint64_t>;
+
+  private:
+    const llvm::DenseSet<const llvm::BasicBlock *> &Marked;
+    const llvm::BasicBlock *ReturnBlock;
+    uint64_t Limit;
+    // The paths from an unmarked block to the next marks, these are shared
+    // by all start blocks as in findPaths
+    llvm::DenseMap<const llvm::BasicBlock *, uint64_t> Suffixes;
+    llvm::DenseSet<const llvm::BasicBlock *> OnPath;
+    bool Cyclic = false;
+
+    auto successorPaths(const llvm::BasicBlock &block) -> uint64_t;
+    auto suffixPaths(const llvm::BasicBlock &block) -> uint64_t;
+};
+}
+
+auto PathCounter::pathsFrom(const llvm::BasicBlock &start)
+    -> llvm::Optional<uint64_t> {
+    const uint64_t count = successorPaths(start);
+    if (Cyclic) {
+        return llvm::None;
+    }
+    return count;
+}
+
+auto PathCounter::successorPaths(const llvm::BasicBlock &block) -> uint64_t {
+    if (&block == ReturnBlock) {
+        return 1;
+    }
+    uint64_t count = 0;
+    for (const auto succ : successors(&block)) {
+        count = std::min(count + suffixPaths(*succ), Limit + 1);
+    }
+    return count;
+}
+
+auto PathCounter::suffixPaths(const llvm::BasicBlock &block) -> uint64_t {
+    if (Marked.count(&block) > 0) {
+        return 1;
+    }
+    auto it = Suffixes.find(&block);
+    if (it != Suffixes.end()) {
+        return it->second;
+    }
+    if (!OnPath.insert(&block).second) {
+        Cyclic = true;
+        return 0;
+    }
+    const uint64_t count = successorPaths(block);
+    OnPath.erase(&block);
+    Suffixes.insert({&block, count});
+    return count;
+}
+
+// The largest number of paths starting at one of the marked blocks, None if
+// they don’t cut all cycles
+static auto maxPaths(const vector<const llvm::BasicBlock *> &startBlocks,
+                     const llvm::DenseSet<const llvm::BasicBlock *> &marked,
+                     const llvm::BasicBlock *returnBlock, uint64_t limit)
+    -> llvm::Optional<uint64_t> {
+    PathCounter counter(marked, returnBlock, limit);
+    uint64_t max = 0;
+    for (const auto block : startBlocks) {
+        auto count = counter.pathsFrom(*block);
+        if (!count) {
+            return llvm::None;
+        }
+        max = std::max(max, *count);
+    }
+    return max;
+}
+
+// Outer loops come first so that their headers are dropped when the headers
+// of the inner loops cut all of their cycles
+static void collectHeaders(const llvm::Loop &loop,
+                           vector<llvm::BasicBlock *> &headers) {
+    headers.push_back(loop.getHeader());
+    for (auto subLoop : loop.getSubLoops()) {
+        collectHeaders(*subLoop, headers);
+    }
+}
+
+// The headers of the loops without the ones whose cycles are cut by the
+// others, as long as at most 'pathLimit' paths start at each of the remaining
+// marks
+static auto
+minimalHeaders(llvm::Function &Fun, const llvm::BasicBlock *returnBlock,
+               const llvm::LoopInfo &loopInfo, uint64_t pathLimit)
+    -> llvm::DenseSet<const llvm::BasicBlock *> {
+    vector<llvm::BasicBlock *> headers;
+    for (auto loop : loopInfo) {
+        collectHeaders(*loop, headers);
+    }
+    llvm::DenseSet<const llvm::BasicBlock *> marked;
+    marked.insert(&Fun.getEntryBlock());
+    marked.insert(returnBlock);
+    marked.insert(headers.begin(), headers.end());
+    vector<const llvm::BasicBlock *> startBlocks = {&Fun.getEntryBlock()};
+    startBlocks.insert(startBlocks.end(), headers.begin(), headers.end());
+
+    // If all loop headers don’t cut the cycles the CFG is irreducible and
+    // path analysis fails anyway
+    llvm::Optional<uint64_t> paths =
+        maxPaths(startBlocks, marked, returnBlock, pathLimit);
+    llvm::DenseSet<const llvm::BasicBlock *> kept;
+    for (auto header : headers) {
+        if (!paths) {
+            kept.insert(header);
+            continue;
+        }
+        marked.erase(header);
+        startBlocks.erase(
+            std::find(startBlocks.begin(), startBlocks.end(), header));
+        auto newPaths = maxPaths(startBlocks, marked, returnBlock, pathLimit);
+        // Dropping a mark can’t decrease the number of paths, it is allowed
+        // to exceed the limit if the marks that have to be kept already do
+        if (newPaths && *newPaths <= std::max(pathLimit, *paths)) {
+            paths = newPaths;
+            stats::count("infer marks.dropped");
+        } else {
+            marked.insert(header);
+            startBlocks.push_back(header);
+            kept.insert(header);
+        }
+    }
+    return kept;
+}
+
+// Inner loops come first
+static void numberHeaders(const llvm::Loop &loop,
+                          const llvm::DenseSet<const llvm::BasicBlock *> &kept,
+                          vector<llvm::BasicBlock *> &headers) {
+    for (auto subLoop : loop.getSubLoops()) {
+        numberHeaders(*subLoop, kept, headers);
+    }
+    if (kept.count(loop.getHeader()) > 0) {
+        headers.push_back(loop.getHeader());
+    }
+}
+
 BidirBlockMarkMap InferMarksAnalysis::run(llvm::Function &Fun,
                                           llvm::FunctionAnalysisManager &am) {
     std::map<Mark, set<llvm::BasicBlock *>> MarkedBlocks;
     std::map<llvm::BasicBlock *, set<Mark>> BlockedMarks;
+    llvm::BasicBlock *returnBlock =
+        am.getResult<FunctionExitNodeAnalysis>(Fun).returnBlock;
     MarkedBlocks[ENTRY_MARK].insert(&Fun.getEntryBlock());
     BlockedMarks[&Fun.getEntryBlock()].insert(ENTRY_MARK);
-    MarkedBlocks[EXIT_MARK].insert(
-        am.getResult<FunctionExitNodeAnalysis>(Fun).returnBlock);
-    BlockedMarks[am.getResult<FunctionExitNodeAnalysis>(Fun).returnBlock]
-        .insert(EXIT_MARK);
+    MarkedBlocks[EXIT_MARK].insert(returnBlock);
+    BlockedMarks[returnBlock].insert(EXIT_MARK);
     llvm::LoopInfo &loopInfo = am.getResult<llvm::LoopAnalysis>(Fun);
-    int i = 1;
-    for (auto loop : loopInfo) {
-        for (auto subLoop : loop->getSubLoops()) {
-            MarkedBlocks.insert({Mark(i), {subLoop->getHeader()}});
-            BlockedMarks.insert({subLoop->getHeader(), {Mark(i)}});
-            ++i;
+
+    vector<llvm::BasicBlock *> headers;
+    if (PathLimit == 0) {
+        for (auto loop : loopInfo) {
+            for (auto subLoop : loop->getSubLoops()) {
+                headers.push_back(subLoop->getHeader());
+            }
+            headers.push_back(loop->getHeader());
+        }
+    } else {
+        const auto kept =
+            minimalHeaders(Fun, returnBlock, loopInfo, PathLimit);
+        for (auto loop : loopInfo) {
+            numberHeaders(*loop, kept, headers);
         }
-        MarkedBlocks.insert({Mark(i), {loop->getHeader()}});
-        BlockedMarks.insert({loop->getHeader(), {Mark(i)}});
+    }
+
+    int i = 1;
+    for (auto header : headers) {
+        MarkedBlocks.insert({Mark(i), {header}});
+        BlockedMarks.insert({header, {Mark(i)}});
         ++i;
     }
 
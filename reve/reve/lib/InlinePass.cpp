@@ -10,47 +10,136 @@
 
 #include "InlinePass.h"
 #include "Helper.h"
-#include "llvm/CodeGen/IntrinsicLowering.h"
+#include "Statistics.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
-llvm::PreservedAnalyses InlinePass::run(llvm::Function &fun,
-                                        llvm::FunctionAnalysisManager &fam) {
-    std::vector<llvm::Instruction *> toDelete;
-    std::vector<llvm::CallInst *> toBeInlined;
+using llvm::CallInst;
+using llvm::Function;
+using llvm::FunctionAnalysisManager;
+using llvm::PreservedAnalyses;
+using llvm::Value;
+using llvm::WeakVH;
+
+using std::pair;
+using std::vector;
+
+static auto isInlineWrapper(const Function &fun) -> bool {
+    return fun.getName() == "__inlineCall";
+}
+
+static auto isInlineRequest(const CallInst &call) -> bool {
+    const Function *callee = call.getCalledFunction();
+    // It is possible that we do not have a representation of the function
+    // (in case of indirect function invocation)
+    if (!callee) {
+        return false;
+    }
+    return isInlineWrapper(*callee) ||
+           callee->hasFnAttribute(llvm::Attribute::AlwaysInline);
+}
+
+namespace {
+// The callees through which a call site has been exposed, as in LLVM’s
+// inliner. Each entry is a callee and the index of the entry it was exposed
+// through, -1 for calls of the original function.
+using InlineHistory = vector<pair<const Function *, int>>;
+}
+
+static auto inHistory(const Function &callee, int index,
+                      const InlineHistory &history) -> bool {
+    for (; index >= 0; index = history[static_cast<size_t>(index)].second) {
+        if (history[static_cast<size_t>(index)].first == &callee) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PreservedAnalyses InlinePass::run(Function &fun,
+                                  FunctionAnalysisManager &fam) {
+    // Inlining changes the CFG of 'fun' so no analysis survives it, but
+    // usually there is nothing to inline and then the analyses are still
+    // valid
+    if (process(fun, fam)) {
+        return PreservedAnalyses::none();
+    }
+    return PreservedAnalyses::all();
+}
+
+auto InlinePass::process(Function &fun, FunctionAnalysisManager &fam)
+    -> bool {
+    if (processed.count(&fun) > 0) {
+        return false;
+    }
+    inProgress.insert(&fun);
+    // The handles are cleared if a call is erased, e.g. if a call wrapped in
+    // __inlineCall has been inlined before the wrapper is visited
+    vector<pair<WeakVH, int>> worklist;
+    InlineHistory history;
     for (auto &bb : fun) {
         for (auto &instr : bb) {
-            if (auto inlineCall = llvm::dyn_cast<llvm::CallInst>(&instr)) {
-                auto fun = inlineCall->getCalledFunction();
-                // It is possible that we do not have a representation of the
-                // function,
-                // (in case of indirect function invocation) so we need to check
-                // the return value:
-                if (fun) {
-                    if (fun->getName() == "__inlineCall") {
-                        if (auto callInst = llvm::dyn_cast<llvm::CallInst>(
-                                inlineCall->getOperand(0))) {
-                            for (auto user : inlineCall->users()) {
-                                user->replaceUsesOfWith(inlineCall, callInst);
-                            }
-                            toDelete.push_back(inlineCall);
-                            toBeInlined.push_back(callInst);
-                        }
-                    }
-                    if (fun->hasFnAttribute(llvm::Attribute::AlwaysInline)) {
-                        toBeInlined.push_back(inlineCall);
-                    }
+            if (auto call = llvm::dyn_cast<CallInst>(&instr)) {
+                if (isInlineRequest(*call)) {
+                    worklist.push_back({call, -1});
                 }
             }
         }
     }
-
-    for (auto instr : toDelete) {
-        instr->eraseFromParent();
-    }
-    for (auto instr : toBeInlined) {
-        llvm::InlineFunctionInfo InlineInfo;
-        llvm::InlineFunction(instr, InlineInfo);
+    bool changed = false;
+    while (!worklist.empty()) {
+        auto call = llvm::dyn_cast_or_null<CallInst>(
+            static_cast<Value *>(worklist.back().first));
+        const int exposedThrough = worklist.back().second;
+        worklist.pop_back();
+        if (!call) {
+            continue;
+        }
+        if (isInlineWrapper(*call->getCalledFunction())) {
+            Value *wrapped = call->getArgOperand(0);
+            call->replaceAllUsesWith(wrapped);
+            call->eraseFromParent();
+            changed = true;
+            call = llvm::dyn_cast<CallInst>(wrapped);
+            if (!call || !call->getCalledFunction()) {
+                continue;
+            }
+        }
+        Function *callee = call->getCalledFunction();
+        // Inlining a recursive call would expose the same call again
+        if (callee->isDeclaration() || inProgress.count(callee) > 0 ||
+            inHistory(*callee, exposedThrough, history)) {
+            continue;
+        }
+        // The callee is simplified before it is copied. It is not the
+        // function the pass is running on, so its analyses are invalidated
+        // here.
+        if (process(*callee, fam)) {
+            fam.invalidate(*callee, PreservedAnalyses::none());
+        }
+        llvm::InlineFunctionInfo inlineInfo;
+        if (!llvm::InlineFunction(call, inlineInfo)) {
+            continue;
+        }
+        stats::count("preprocess.inlined calls");
+        changed = true;
+        // The requests of the callee have been resolved, so the copy only
+        // contains requests that were skipped because they are recursive.
+        // They are checked again since the call chain is different here, the
+        // history makes sure that this terminates.
+        history.push_back({callee, exposedThrough});
+        const int historyIndex = static_cast<int>(history.size()) - 1;
+        for (auto &inlined : inlineInfo.InlinedCalls) {
+            auto inlinedCall = llvm::dyn_cast_or_null<CallInst>(
+                static_cast<Value *>(inlined));
+            if (inlinedCall && isInlineRequest(*inlinedCall)) {
+                worklist.push_back({inlinedCall, historyIndex});
+            }
+        }
     }
-    return llvm::PreservedAnalyses::none();
+    inProgress.erase(&fun);
+    processed.insert(&fun);
+    return changed;
 }
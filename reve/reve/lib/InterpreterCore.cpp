@@ -0,0 +1,75 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "InterpreterCore.h"
+
+namespace llreve {
+namespace interpreter {
+
+using llvm::BasicBlock;
+using llvm::Function;
+using llvm::Instruction;
+using llvm::Optional;
+using llvm::Value;
+
+SlotLayout::SlotLayout(const Function &fun) : fun(&fun) {
+    for (const auto &arg : fun.args()) {
+        slots.insert({&arg, static_cast<Slot>(variables.size())});
+        variables.push_back(&arg);
+    }
+    for (const auto &bb : fun) {
+        blockIndices.insert({&bb, static_cast<BlockIndex>(blocks.size())});
+        blocks.push_back(&bb);
+        blockBegins.push_back(static_cast<Slot>(variables.size()));
+        for (const auto &instr : bb) {
+            slots.insert({&instr, static_cast<Slot>(variables.size())});
+            variables.push_back(&instr);
+        }
+    }
+}
+
+auto SlotLayout::slot(const Value *val) const -> Optional<Slot> {
+    auto it = slots.find(val);
+    if (it == slots.end()) {
+        return llvm::None;
+    }
+    return it->second;
+}
+
+auto SlotLayout::blockIndex(const BasicBlock &block) const -> BlockIndex {
+    auto it = blockIndices.find(&block);
+    if (it == blockIndices.end()) {
+        return NoBlock;
+    }
+    return it->second;
+}
+
+auto evalStatusMessage(EvalStatus status) -> const char * {
+    switch (status) {
+    case EvalStatus::Ok:
+        return "ok";
+    case EvalStatus::DivisionByZero:
+        return "division by zero";
+    case EvalStatus::Overflow:
+        return "signed division overflow";
+    case EvalStatus::ShiftOutOfRange:
+        return "shift amount exceeds the bit width";
+    }
+    return "unknown status";
+}
+
+TraceObserver::~TraceObserver() = default;
+void TraceObserver::enterBlock(const BasicBlock & /* unused */,
+                               const BasicBlock * /* unused */) {}
+void TraceObserver::executeInstruction(const Instruction & /* unused */,
+                                       Slot /* unused */) {}
+void TraceObserver::exitFunction(const Function & /* unused */) {}
+}
+}
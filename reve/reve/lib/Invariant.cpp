@@ -10,6 +10,7 @@
 
 #include "Invariant.h"
 
+#include "HashCons.h"
 #include "Helper.h"
 #include "Opts.h"
 
@@ -25,6 +26,60 @@ using namespace llreve::opts;
 /* -------------------------------------------------------------------------- */
 // Functions related to generating invariants
 
+// For each variable the index of the first variable that is provably equal,
+// which is the variable itself if it is kept
+static auto equalVariableRepresentatives(const vector<SortedVar> &freeVars)
+    -> vector<size_t> {
+    const auto &opts = SMTGenerationOpts::getInstance();
+    vector<size_t> representatives;
+    map<unsigned, size_t> classRepresentatives;
+    for (size_t i = 0; i < freeVars.size(); ++i) {
+        representatives.push_back(i);
+        if (!opts.ReduceInvariantArguments) {
+            continue;
+        }
+        llvm::StringRef name = freeVars[i].name;
+        if (name.endswith("_old")) {
+            name = name.drop_back(4);
+        }
+        auto it = opts.EqualVariables.find(name.str());
+        if (it != opts.EqualVariables.end()) {
+            representatives[i] =
+                classRepresentatives.insert({it->second, i}).first->second;
+        }
+    }
+    return representatives;
+}
+
+vector<SortedVar> mainInvariantArguments(const vector<SortedVar> &freeVars) {
+    const auto representatives = equalVariableRepresentatives(freeVars);
+    vector<SortedVar> arguments;
+    for (size_t i = 0; i < freeVars.size(); ++i) {
+        if (representatives[i] == i) {
+            arguments.push_back(freeVars[i]);
+        }
+    }
+    return arguments;
+}
+
+vector<SharedSMTRef> mainInvariantEqualities(const vector<SortedVar> &freeVars,
+                                             const string &suffix) {
+    const auto representatives = equalVariableRepresentatives(freeVars);
+    vector<SharedSMTRef> equalities;
+    for (size_t i = 0; i < freeVars.size(); ++i) {
+        if (representatives[i] != i) {
+            const SortedVar &representative = freeVars[representatives[i]];
+            equalities.push_back(makeOp(
+                "=",
+                make_unique<TypedVariable>(freeVars[i].name + suffix,
+                                           freeVars[i].type),
+                make_unique<TypedVariable>(representative.name + suffix,
+                                           representative.type)));
+        }
+    }
+    return equalities;
+}
+
 static void
 addArgumentsForSelection(ProgramSelection SMTFor,
                          std::function<std::string(Program)> getVarName,
@@ -43,35 +98,60 @@ addArgumentsForSelection(ProgramSelection SMTFor,
     }
 }
 
-static std::unique_ptr<TypedVariable>
-cloneTypedVariable(const TypedVariable &var) {
-    return make_unique<TypedVariable>(var.name, var.type);
+static SharedSMTRef cloneTypedVariable(const TypedVariable &var) {
+    return hashConsVariable(var.name, var.type);
+}
+
+static SharedSMTRef sharedVariable(const SortedVar &var) {
+    return hashConsVariable(var.name, var.type);
+}
+
+// The variables of the selected program, only copied if some of them have to
+// be filtered out
+static auto selectedVars(ProgramSelection selection,
+                         const vector<SortedVar> &vars,
+                         vector<SortedVar> &filtered)
+    -> const vector<SortedVar> & {
+    if (selection == ProgramSelection::Both) {
+        return vars;
+    }
+    filtered = filterVars(selection == ProgramSelection::First ? 1 : 2, vars);
+    return filtered;
 }
 
-SMTRef functionalCouplingPredicate(Mark currentCallMark, Mark tailCallMark,
-                                   vector<SortedVar> currentCallArguments,
-                                   vector<SortedVar> tailCallArguments,
-                                   ProgramSelection SMTFor,
-                                   std::string functionName,
-                                   FreeVarsMap freeVarsMap) {
+SharedSMTRef
+functionalCouplingPredicate(Mark currentCallMark, Mark tailCallMark,
+                            const vector<SortedVar> &currentCallVars,
+                            const vector<SortedVar> &tailCallVars,
+                            ProgramSelection SMTFor,
+                            const std::string &functionName,
+                            const FreeVarsMap & /* unused */) {
     // we want to end up with something like
     // (and pre (=> (tailcall newargs res) (currentcall oldargs res)))
 
     // TODO get rid of filtering
-    if (SMTFor == ProgramSelection::First) {
-        currentCallArguments = filterVars(1, currentCallArguments);
-        tailCallArguments = filterVars(1, tailCallArguments);
-    }
-    if (SMTFor == ProgramSelection::Second) {
-        currentCallArguments = filterVars(2, currentCallArguments);
-        tailCallArguments = filterVars(2, tailCallArguments);
-    }
+    vector<SortedVar> filteredCurrentCallVars;
+    vector<SortedVar> filteredTailCallVars;
+    const auto &currentCallArguments =
+        selectedVars(SMTFor, currentCallVars, filteredCurrentCallVars);
+    const auto &tailCallArguments =
+        selectedVars(SMTFor, tailCallVars, filteredTailCallVars);
 
     vector<TypedVariable> resultValues;
     addArgumentsForSelection(SMTFor, resultName, int64Type(), resultValues);
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        addArgumentsForSelection(SMTFor, heapResultName, memoryType(),
-                                 resultValues);
+        // All regions of the first program come before those of the second
+        // one, see getMutualResultValues
+        if (SMTFor != ProgramSelection::Second) {
+            for (const auto &heap : heapResultNames(Program::First)) {
+                resultValues.emplace_back(heap, memoryType());
+            }
+        }
+        if (SMTFor != ProgramSelection::First) {
+            for (const auto &heap : heapResultNames(Program::Second)) {
+                resultValues.emplace_back(heap, memoryType());
+            }
+        }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
         addArgumentsForSelection(SMTFor, stackResultName, memoryType(),
@@ -83,14 +163,14 @@ SMTRef functionalCouplingPredicate(Mark currentCallMark, Mark tailCallMark,
     std::transform(
         currentCallArguments.begin(), currentCallArguments.end(),
         std::back_inserter(currentCallArgumentsPost), [](const SortedVar &var) {
-            return make_unique<TypedVariable>(var.name + "_old", var.type);
+            return hashConsVariable(var.name + "_old", var.type);
         });
     std::transform(resultValues.begin(), resultValues.end(),
                    std::back_inserter(currentCallArgumentsPost),
                    cloneTypedVariable);
-    SMTRef currentCallInvariant =
-        make_unique<Op>(invariantName(currentCallMark, SMTFor, functionName),
-                        currentCallArgumentsPost);
+    SharedSMTRef currentCallInvariant =
+        hashConsOp(invariantName(currentCallMark, SMTFor, functionName),
+                   currentCallArgumentsPost);
 
     if (tailCallMark == EXIT_MARK) {
         return currentCallInvariant;
@@ -111,8 +191,8 @@ SMTRef functionalCouplingPredicate(Mark currentCallMark, Mark tailCallMark,
     vector<SharedSMTRef> tailCallArgumentsPre;
     std::transform(tailCallArguments.begin(), tailCallArguments.end(),
                    std::back_inserter(tailCallArgumentsPre),
-                   typedVariableFromSortedVar);
-    SMTRef tailCallInvariantPre = make_unique<Op>(
+                   sharedVariable);
+    SharedSMTRef tailCallInvariantPre = hashConsOp(
         invariantName(tailCallMark, SMTFor, functionName, InvariantAttr::PRE),
         tailCallArgumentsPre);
 
@@ -120,9 +200,9 @@ SMTRef functionalCouplingPredicate(Mark currentCallMark, Mark tailCallMark,
     std::transform(resultValues.begin(), resultValues.end(),
                    std::back_inserter(tailCallArgumentsPost),
                    cloneTypedVariable);
-    SMTRef tailCallInvariantPost =
-        make_unique<Op>(invariantName(tailCallMark, SMTFor, functionName),
-                        tailCallArgumentsPost);
+    SharedSMTRef tailCallInvariantPost =
+        hashConsOp(invariantName(tailCallMark, SMTFor, functionName),
+                   tailCallArgumentsPost);
 
     SMTRef clause = makeOp("=>", std::move(tailCallInvariantPost),
                            std::move(currentCallInvariant));
@@ -133,8 +213,9 @@ SMTRef functionalCouplingPredicate(Mark currentCallMark, Mark tailCallMark,
     return make_unique<Forall>(forallArguments, std::move(clause));
 }
 
-SMTRef iterativeCouplingPredicate(Mark EndIndex, vector<SortedVar> FreeVars,
-                                  string FunName) {
+SharedSMTRef iterativeCouplingPredicate(Mark EndIndex,
+                                        const vector<SortedVar> &FreeVars,
+                                        const string &FunName) {
     if (EndIndex == EXIT_MARK) {
         vector<SharedSMTRef> args = {stringExpr(resultName(Program::First)),
                                      stringExpr(resultName(Program::Second))};
@@ -142,30 +223,31 @@ SMTRef iterativeCouplingPredicate(Mark EndIndex, vector<SortedVar> FreeVars,
             // No stack in output
             if (arg.name.compare(0, 5, "STACK") &&
                 arg.name.compare(0, 2, "SP")) {
-                args.push_back(typedVariableFromSortedVar(arg));
+                args.push_back(sharedVariable(arg));
             }
         }
-        return make_unique<Op>("OUT_INV", std::move(args));
+        return hashConsOp("OUT_INV", std::move(args));
     } else if (EndIndex == UNREACHABLE_MARK) {
         return make_unique<ConstantBool>(true);
     } else {
         vector<SharedSMTRef> args;
-        for (auto &arg : FreeVars) {
-            args.push_back(typedVariableFromSortedVar(arg));
+        for (auto &arg : mainInvariantArguments(FreeVars)) {
+            args.push_back(sharedVariable(arg));
         }
-        return make_unique<Op>(invariantName(EndIndex, ProgramSelection::Both,
-                                             FunName, InvariantAttr::MAIN),
-                               std::move(args));
+        return hashConsOp(invariantName(EndIndex, ProgramSelection::Both,
+                                        FunName, InvariantAttr::MAIN),
+                          std::move(args));
     }
 }
 
 /// Declare an invariant
 MonoPair<SMTRef> invariantDeclaration(Mark BlockIndex,
-                                      vector<SortedVar> FreeVars,
-                                      ProgramSelection For, std::string FunName,
+                                      const vector<SortedVar> &FreeVars,
+                                      ProgramSelection For,
+                                      const std::string &FunName,
                                       const llvm::Type *resultType) {
     vector<Type> args;
-    for (auto arg : FreeVars) {
+    for (const auto &arg : FreeVars) {
         args.push_back(arg.type);
     }
     vector<Type> preArgs = args;
@@ -175,9 +257,13 @@ MonoPair<SMTRef> invariantDeclaration(Mark BlockIndex,
         args.push_back(llvmType(resultType));
     }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        args.push_back(memoryType());
-        if (For == ProgramSelection::Both) {
+        const unsigned regions =
+            SMTGenerationOpts::getInstance().HeapRegionCount;
+        for (unsigned region = 0; region < regions; ++region) {
             args.push_back(memoryType());
+            if (For == ProgramSelection::Both) {
+                args.push_back(memoryType());
+            }
         }
     }
     if (SMTGenerationOpts::getInstance().Stack == StackOpt::Enabled) {
@@ -195,7 +281,7 @@ MonoPair<SMTRef> invariantDeclaration(Mark BlockIndex,
             std::move(preArgs), boolType()));
 }
 
-size_t invariantArgs(vector<SortedVar> freeVars, ProgramSelection prog,
+size_t invariantArgs(const vector<SortedVar> &freeVars, ProgramSelection prog,
                      InvariantAttr attr) {
     size_t numArgs = freeVars.size();
     if (attr == InvariantAttr::NONE) {
@@ -204,20 +290,22 @@ size_t invariantArgs(vector<SortedVar> freeVars, ProgramSelection prog,
         numArgs += 1 + (prog == ProgramSelection::Both ? 1 : 0);
         if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
             // index + value at that index
+            const unsigned regions =
+                SMTGenerationOpts::getInstance().HeapRegionCount;
             if (prog == ProgramSelection::Both) {
-                numArgs += 2;
+                numArgs += 2 * regions;
             } else {
-                numArgs += 1;
+                numArgs += regions;
             }
         }
     }
     return numArgs;
 }
 
-size_t maxArgs(FreeVarsMap freeVarsMap, ProgramSelection prog,
+size_t maxArgs(const FreeVarsMap &freeVarsMap, ProgramSelection prog,
                InvariantAttr attr) {
     size_t maxArgs = 0;
-    for (auto It : freeVarsMap) {
+    for (const auto &It : freeVarsMap) {
         size_t numArgs = invariantArgs(It.second, prog, attr);
         if (numArgs > maxArgs) {
             maxArgs = numArgs;
@@ -231,7 +319,7 @@ SMTRef mainInvariantComment(Mark blockIndex, const vector<SortedVar> &freeVars,
     std::string name =
         invariantName(blockIndex, selection, funName, InvariantAttr::MAIN);
     std::string comment = ":annot (" + name;
-    for (auto &arg : freeVars) {
+    for (auto &arg : mainInvariantArguments(freeVars)) {
         comment += " " + arg.name;
     }
     comment += ")";
@@ -239,10 +327,10 @@ SMTRef mainInvariantComment(Mark blockIndex, const vector<SortedVar> &freeVars,
 }
 
 std::unique_ptr<smt::SMTExpr>
-mainInvariantDeclaration(Mark BlockIndex, vector<SortedVar> FreeVars,
-                         ProgramSelection For, std::string FunName) {
+mainInvariantDeclaration(Mark BlockIndex, const vector<SortedVar> &FreeVars,
+                         ProgramSelection For, const std::string &FunName) {
     vector<Type> args;
-    for (auto &arg : FreeVars) {
+    for (auto &arg : mainInvariantArguments(FreeVars)) {
         args.push_back(arg.type);
     }
     return make_unique<FunDecl>(
@@ -251,8 +339,9 @@ mainInvariantDeclaration(Mark BlockIndex, vector<SortedVar> FreeVars,
 }
 
 /// Return the invariant name, special casing the entry block
-string invariantName(Mark Index, ProgramSelection For, std::string FunName,
-                     InvariantAttr attr, uint32_t VarArgs) {
+string invariantName(Mark Index, ProgramSelection For,
+                     const std::string &FunName, InvariantAttr attr,
+                     uint32_t VarArgs) {
     string Name;
     if (attr == InvariantAttr::MAIN) {
         Name = "INV_MAIN";
@@ -278,3 +367,19 @@ string invariantName(Mark Index, ProgramSelection For, std::string FunName,
     }
     return Name;
 }
+
+string forbiddenSelectorName(Mark startIndex, const string &funName) {
+    return "FORBIDDEN_" + funName + "_" + startIndex.toString();
+}
+
+SMTRef forbiddenSelectorDeclaration(Mark startIndex,
+                                    const vector<SortedVar> &freeVars2,
+                                    const string &funName) {
+    vector<Type> args;
+    for (const auto &arg : freeVars2) {
+        args.push_back(arg.type);
+    }
+    args.push_back(int64Type());
+    return make_unique<FunDecl>(forbiddenSelectorName(startIndex, funName),
+                                std::move(args), boolType());
+}
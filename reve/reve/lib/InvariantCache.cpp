@@ -0,0 +1,215 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "InvariantCache.h"
+
+#include "Invariant.h"
+#include "Logging.h"
+#include "SMTReader.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <sstream>
+
+using smt::SharedSMTRef;
+using std::map;
+using std::string;
+using std::vector;
+
+using namespace llreve::opts;
+
+namespace {
+// Collects the functions applied by a clause and the predicate declared by a
+// declaration
+struct ApplicationVisitor : smt::SMTVisitor {
+    string declaredFunction;
+    llvm::StringSet<> appliedFunctions;
+    bool handles(smt::ExprTag tag) const override {
+        return tag == smt::ExprTag::FunDecl || tag == smt::ExprTag::Op;
+    }
+    void dispatch(smt::FunDecl &decl) override {
+        declaredFunction = decl.funName;
+    }
+    void dispatch(smt::Op &op) override { appliedFunctions.insert(op.opName); }
+};
+}
+
+static bool isInvariant(llvm::StringRef name) {
+    return name.startswith("INV_");
+}
+
+static string serialized(const smt::SMTExpr &expr) {
+    std::ostringstream out;
+    expr.serialize(out, 0);
+    return out.str();
+}
+
+InvariantSignatures invariantSignatures(const vector<SharedSMTRef> &clauses) {
+    vector<ApplicationVisitor> visited(clauses.size());
+    map<string, llvm::MD5> hashes;
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        clauses[i]->accept(visited[i]);
+        if (isInvariant(visited[i].declaredFunction)) {
+            hashes[visited[i].declaredFunction].update(serialized(*clauses[i]));
+        }
+    }
+    // The clauses are hashed in the order in which they are generated, so the
+    // signature only changes if one of them does
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        if (clauses[i]->getTag() != smt::ExprTag::Assert) {
+            continue;
+        }
+        string clause;
+        for (const auto &fun : visited[i].appliedFunctions) {
+            auto hashIt = hashes.find(fun.getKey().str());
+            if (hashIt == hashes.end()) {
+                continue;
+            }
+            if (clause.empty()) {
+                clause = serialized(*clauses[i]);
+            }
+            hashIt->second.update(clause);
+            hashIt->second.update(llvm::StringRef("\0", 1));
+        }
+    }
+    InvariantSignatures signatures;
+    for (auto &hash : hashes) {
+        llvm::MD5::MD5Result result;
+        hash.second.final(result);
+        llvm::SmallString<32> hexResult;
+        llvm::MD5::stringifyResult(result, hexResult);
+        signatures[hash.first] = string(hexResult.str());
+    }
+    return signatures;
+}
+
+static string cachedInvariantPath(const string &cacheDir,
+                                  const string &signature) {
+    llvm::SmallString<128> path(cacheDir);
+    llvm::sys::path::append(path, signature + ".smt2");
+    return path.str();
+}
+
+// The cached definition of the invariant or null if there is none
+static SharedSMTRef cachedInvariant(const string &cacheDir,
+                                    const InvariantSignatures &signatures,
+                                    const string &name) {
+    auto signatureIt = signatures.find(name);
+    if (signatureIt == signatures.end()) {
+        return nullptr;
+    }
+    const string path = cachedInvariantPath(cacheDir, signatureIt->second);
+    if (!std::ifstream(path)) {
+        return nullptr;
+    }
+    smt::HashConsFactory factory;
+    for (const auto &command : smt::readSMTFile(path, factory)) {
+        if (command->getTag() == smt::ExprTag::FunDef &&
+            static_cast<const smt::FunDef &>(*command).funName == name) {
+            return command;
+        }
+    }
+    logWarning("Ignoring invalid entry in invariant cache: " +
+               signatureIt->second + "\n");
+    return nullptr;
+}
+
+size_t applyCachedInvariants(const string &cacheDir,
+                             const InvariantSignatures &signatures,
+                             const AnalysisResultsMap &analysisResults,
+                             SMTGenerationOpts &smtOpts) {
+    size_t applied = 0;
+    const MonoPair<const llvm::Function *> mainFunctions =
+        smtOpts.MainFunctions;
+    const string mainName = getFunctionName(mainFunctions);
+    for (const auto &path : analysisResults.at(mainFunctions.first).paths) {
+        const Mark mark = path.first;
+        if (mark == ENTRY_MARK) {
+            continue;
+        }
+        SharedSMTRef invariant = cachedInvariant(
+            cacheDir, signatures,
+            invariantName(mark, ProgramSelection::Both, mainName,
+                          InvariantAttr::MAIN));
+        if (invariant) {
+            smtOpts.IterativeRelationalInvariants[mark] = invariant;
+            ++applied;
+        }
+    }
+    for (const auto &coupledPair : smtOpts.CoupledFunctions) {
+        const MonoPair<const llvm::Function *> functions = coupledPair;
+        // Declarations have no paths and no invariants
+        if (hasMutualFixedAbstraction(functions)) {
+            continue;
+        }
+        const string funName = getFunctionName(functions);
+        for (const auto &path : analysisResults.at(functions.first).paths) {
+            const Mark mark = path.first;
+            SharedSMTRef postCondition = cachedInvariant(
+                cacheDir, signatures,
+                invariantName(mark, ProgramSelection::Both, funName));
+            SharedSMTRef preCondition = cachedInvariant(
+                cacheDir, signatures,
+                invariantName(mark, ProgramSelection::Both, funName,
+                              InvariantAttr::PRE));
+            if (preCondition && postCondition) {
+                smtOpts.FunctionalRelationalInvariants[functions][mark] = {
+                    preCondition, postCondition};
+                applied += 2;
+            }
+        }
+    }
+    stats::count("invariant cache.hits", applied);
+    return applied;
+}
+
+void storeSolvedInvariants(const string &cacheDir,
+                           const InvariantSignatures &signatures,
+                           const string &model) {
+    if (std::error_code errorCode =
+            llvm::sys::fs::create_directories(cacheDir)) {
+        logWarning("Couldn’t create invariant cache directory: " +
+                   errorCode.message() + "\n");
+        return;
+    }
+    for (const auto &definition : smt::modelDefinitions(model)) {
+        auto signatureIt = signatures.find(definition.first);
+        if (signatureIt == signatures.end()) {
+            continue;
+        }
+        // Write to a temporary file first so that concurrent runs never see
+        // a partially written entry
+        const string path = cachedInvariantPath(cacheDir, signatureIt->second);
+        int fd;
+        llvm::SmallString<128> tmpPath;
+        if (std::error_code errorCode = llvm::sys::fs::createUniqueFile(
+                path + ".tmp-%%%%%%", fd, tmpPath)) {
+            logWarning("Couldn’t write to invariant cache: " +
+                       errorCode.message() + "\n");
+            return;
+        }
+        {
+            llvm::raw_fd_ostream stream(fd, true);
+            stream << definition.second << "\n";
+        }
+        if (llvm::sys::fs::rename(tmpPath, path)) {
+            llvm::sys::fs::remove(tmpPath);
+        }
+        stats::count("invariant cache.stored");
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "JobQueue.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MD5.h"
+
+using std::string;
+
+static void hashString(llvm::MD5 &hash, llvm::StringRef tag,
+                       llvm::StringRef value) {
+    // Hash the lengths so that different fields can’t collide
+    hash.update(tag);
+    hash.update(std::to_string(value.size()));
+    hash.update(llvm::StringRef("\0", 1));
+    hash.update(value);
+}
+
+static void hashPairs(llvm::MD5 &hash, llvm::StringRef tag,
+                      const std::vector<std::pair<string, string>> &pairs) {
+    for (const auto &pair : pairs) {
+        hashString(hash, tag, pair.first);
+        hashString(hash, tag, pair.second);
+    }
+}
+
+string jobKey(const JobRequest &request) {
+    const llreve::api::Options &opts = request.Opts;
+    llvm::MD5 hash;
+    hashString(hash, "first", request.First.Name);
+    hashString(hash, "first", request.First.Contents);
+    hashString(hash, "second", request.Second.Name);
+    hashString(hash, "second", request.Second.Contents);
+    hashString(hash, "fun", opts.Function);
+    for (const auto &include : opts.Includes) {
+        hashString(hash, "I", include);
+    }
+    hashString(hash, "resource-dir", opts.ResourceDir);
+    const bool flags[] = {opts.Heap,
+                          opts.Stack,
+                          opts.GlobalConstants,
+                          opts.OnlyRecursive,
+                          opts.EverythingSigned,
+                          opts.BitVect,
+                          opts.InferMarks,
+                          opts.MuZ,
+                          opts.DisableAutoCoupling};
+    string flagString;
+    for (bool flag : flags) {
+        flagString += flag ? '1' : '0';
+    }
+    hashString(hash, "flags", flagString);
+    hashPairs(hash, "couple", opts.CoupledFunctions);
+    hashPairs(hash, "assume", opts.AssumeEquivalent);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    return hexResult.str();
+}
+
+std::pair<Job &, bool> JobQueue::submit(JobRequest request) {
+    string key = jobKey(request);
+    auto existing = JobsByKey.find(key);
+    if (existing != JobsByKey.end()) {
+        Job &job = *Jobs.at(existing->second);
+        if (job.State != JobState::Failed) {
+            if (job.State == JobState::Queued &&
+                request.Priority > job.Request.Priority) {
+                Queue.erase({-int64_t(job.Request.Priority), job.Id});
+                job.Request.Priority = request.Priority;
+                Queue.insert({-int64_t(job.Request.Priority), job.Id});
+            }
+            return {job, true};
+        }
+    }
+    const uint64_t id = NextId++;
+    std::unique_ptr<Job> job(new Job);
+    job->Id = id;
+    job->Request = std::move(request);
+    job->Key = key;
+    Queue.insert({-int64_t(job->Request.Priority), id});
+    JobsByKey[key] = id;
+    Job &result = *job;
+    Jobs[id] = std::move(job);
+    return {result, false};
+}
+
+Job *JobQueue::find(uint64_t id) {
+    auto it = Jobs.find(id);
+    return it == Jobs.end() ? nullptr : it->second.get();
+}
+
+Job *JobQueue::startNext() {
+    if (Queue.empty()) {
+        return nullptr;
+    }
+    Job &job = *Jobs.at(Queue.begin()->second);
+    Queue.erase(Queue.begin());
+    job.State = JobState::Running;
+    return &job;
+}
+
+void JobQueue::finish(Job &job, bool failed) {
+    job.State = failed ? JobState::Failed : JobState::Finished;
+    job.Request.First.Contents.clear();
+    job.Request.First.Contents.shrink_to_fit();
+    job.Request.Second.Contents.clear();
+    job.Request.Second.Contents.shrink_to_fit();
+    Done.push_back(job.Id);
+    if (Done.size() <= MaxJobs) {
+        return;
+    }
+    const uint64_t oldest = Done.front();
+    Done.erase(Done.begin());
+    auto it = Jobs.find(oldest);
+    auto byKey = JobsByKey.find(it->second->Key);
+    if (byKey != JobsByKey.end() && byKey->second == oldest) {
+        JobsByKey.erase(byKey);
+    }
+    Jobs.erase(it);
+}
@@ -0,0 +1,320 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Json.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using std::string;
+
+const JsonValue *JsonValue::member(llvm::StringRef key) const {
+    for (const auto &entry : Members) {
+        if (entry.first == key) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+class JsonParser {
+  public:
+    explicit JsonParser(llvm::StringRef text) : text(text) {}
+    auto parseValue(JsonValue &value, unsigned depth) -> bool;
+    auto atEnd() -> bool;
+    auto position() const -> size_t { return pos; }
+    string error;
+
+  private:
+    llvm::StringRef text;
+    size_t pos = 0;
+    auto peek() -> char;
+    auto fail(const string &message) -> bool;
+    auto parseString(string &result) -> bool;
+    auto parseCodeUnit(unsigned &unit) -> bool;
+    auto parseNumber(double &number) -> bool;
+    auto parseLiteral(llvm::StringRef literal) -> bool;
+};
+}
+
+static const unsigned MaxDepth = 64;
+
+bool JsonParser::fail(const string &message) {
+    error = message + " at offset " + std::to_string(pos);
+    return false;
+}
+
+char JsonParser::peek() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                 text[pos] == '\n' || text[pos] == '\r')) {
+        ++pos;
+    }
+    return pos < text.size() ? text[pos] : '\0';
+}
+
+bool JsonParser::atEnd() { return peek() == '\0' && pos == text.size(); }
+
+bool JsonParser::parseLiteral(llvm::StringRef literal) {
+    if (!text.substr(pos).startswith(literal)) {
+        return fail("invalid literal");
+    }
+    pos += literal.size();
+    return true;
+}
+
+bool JsonParser::parseNumber(double &number) {
+    const size_t start = pos;
+    while (pos < text.size() &&
+           llvm::StringRef("+-0123456789.eE").find(text[pos]) !=
+               llvm::StringRef::npos) {
+        ++pos;
+    }
+    const string digits = text.substr(start, pos - start).str();
+    char *end = nullptr;
+    number = std::strtod(digits.c_str(), &end);
+    if (digits.empty() || end != digits.c_str() + digits.size()) {
+        pos = start;
+        return fail("invalid number");
+    }
+    return true;
+}
+
+bool JsonParser::parseCodeUnit(unsigned &unit) {
+    if (pos + 4 > text.size()) {
+        return fail("incomplete escape sequence");
+    }
+    unit = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        const char c = text[pos++];
+        unit <<= 4;
+        if (c >= '0' && c <= '9') {
+            unit |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            unit |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            unit |= c - 'A' + 10;
+        } else {
+            return fail("invalid escape sequence");
+        }
+    }
+    return true;
+}
+
+static void appendUTF8(string &result, unsigned codePoint) {
+    if (codePoint < 0x80) {
+        result += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        result += static_cast<char>(0xc0 | (codePoint >> 6));
+        result += static_cast<char>(0x80 | (codePoint & 0x3f));
+    } else if (codePoint < 0x10000) {
+        result += static_cast<char>(0xe0 | (codePoint >> 12));
+        result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+        result += static_cast<char>(0x80 | (codePoint & 0x3f));
+    } else {
+        result += static_cast<char>(0xf0 | (codePoint >> 18));
+        result += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+        result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+        result += static_cast<char>(0x80 | (codePoint & 0x3f));
+    }
+}
+
+bool JsonParser::parseString(string &result) {
+    if (peek() != '"') {
+        return fail("expected a string");
+    }
+    ++pos;
+    while (pos < text.size() && text[pos] != '"') {
+        char c = text[pos++];
+        if (c != '\\') {
+            result += c;
+            continue;
+        }
+        if (pos >= text.size()) {
+            break;
+        }
+        c = text[pos++];
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            result += c;
+            break;
+        case 'b':
+            result += '\b';
+            break;
+        case 'f':
+            result += '\f';
+            break;
+        case 'n':
+            result += '\n';
+            break;
+        case 'r':
+            result += '\r';
+            break;
+        case 't':
+            result += '\t';
+            break;
+        case 'u': {
+            unsigned unit;
+            if (!parseCodeUnit(unit)) {
+                return false;
+            }
+            // Characters outside of the basic plane are written as a pair
+            // of surrogates
+            if (unit >= 0xd800 && unit < 0xdc00 &&
+                text.substr(pos).startswith("\\u")) {
+                pos += 2;
+                unsigned low;
+                if (!parseCodeUnit(low)) {
+                    return false;
+                }
+                if (low < 0xdc00 || low >= 0xe000) {
+                    return fail("invalid surrogate pair");
+                }
+                unit = 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+            }
+            appendUTF8(result, unit);
+            break;
+        }
+        default:
+            return fail(string("invalid escape sequence \\") + c);
+        }
+    }
+    if (pos >= text.size()) {
+        return fail("unterminated string");
+    }
+    ++pos;
+    return true;
+}
+
+bool JsonParser::parseValue(JsonValue &value, unsigned depth) {
+    if (depth > MaxDepth) {
+        return fail("nested too deeply");
+    }
+    switch (peek()) {
+    case '{':
+        ++pos;
+        value.ValueKind = JsonValue::Kind::Object;
+        if (peek() == '}') {
+            ++pos;
+            return true;
+        }
+        while (true) {
+            string key;
+            if (!parseString(key)) {
+                return false;
+            }
+            if (peek() != ':') {
+                return fail("expected ':'");
+            }
+            ++pos;
+            value.Members.emplace_back(std::move(key), JsonValue());
+            if (!parseValue(value.Members.back().second, depth + 1)) {
+                return false;
+            }
+            if (peek() != ',') {
+                break;
+            }
+            ++pos;
+        }
+        if (peek() != '}') {
+            return fail("expected '}'");
+        }
+        ++pos;
+        return true;
+    case '[':
+        ++pos;
+        value.ValueKind = JsonValue::Kind::Array;
+        if (peek() == ']') {
+            ++pos;
+            return true;
+        }
+        while (true) {
+            value.Elements.emplace_back();
+            if (!parseValue(value.Elements.back(), depth + 1)) {
+                return false;
+            }
+            if (peek() != ',') {
+                break;
+            }
+            ++pos;
+        }
+        if (peek() != ']') {
+            return fail("expected ']'");
+        }
+        ++pos;
+        return true;
+    case '"':
+        value.ValueKind = JsonValue::Kind::String;
+        return parseString(value.Text);
+    case 't':
+        value.ValueKind = JsonValue::Kind::Bool;
+        value.Bool = true;
+        return parseLiteral("true");
+    case 'f':
+        value.ValueKind = JsonValue::Kind::Bool;
+        return parseLiteral("false");
+    case 'n':
+        return parseLiteral("null");
+    case '\0':
+        return fail("unexpected end of the document");
+    default:
+        value.ValueKind = JsonValue::Kind::Number;
+        return parseNumber(value.Number);
+    }
+}
+
+bool parseJson(llvm::StringRef text, JsonValue &value, string &error) {
+    JsonParser parser(text);
+    value = JsonValue();
+    if (!parser.parseValue(value, 0)) {
+        error = parser.error;
+        return false;
+    }
+    if (!parser.atEnd()) {
+        error = "unexpected characters at offset " +
+                std::to_string(parser.position());
+        return false;
+    }
+    return true;
+}
+
+string jsonString(llvm::StringRef str) {
+    string result = "\"";
+    for (const char c : str) {
+        switch (c) {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        case '\r':
+            result += "\\r";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                result += escaped;
+            } else {
+                result += c;
+            }
+        }
+    }
+    return result + "\"";
+}
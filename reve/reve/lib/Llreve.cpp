@@ -0,0 +1,179 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Llreve.h"
+
+#include "Compile.h"
+#include "Helper.h"
+#include "ModuleSMTGeneration.h"
+#include "Opts.h"
+#include "Preprocess.h"
+#include "Serialize.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Threading.h"
+
+#include <mutex>
+#include <sstream>
+
+using std::set;
+using std::string;
+using std::unique_ptr;
+using Clock = std::chrono::steady_clock;
+
+using namespace llreve::opts;
+
+namespace llreve {
+namespace api {
+
+// The clang driver looks for the builtin headers relative to the executable
+static string executablePath;
+static std::once_flag initialized;
+
+void initialize() {
+    std::call_once(initialized, [] {
+        if (!llvm::llvm_is_multithreaded()) {
+            logError("libllreve has to be built with LLVM_ENABLE_THREADS\n");
+            exit(1);
+        }
+        executablePath = llvm::sys::fs::getMainExecutable(
+            "llreve", reinterpret_cast<void *>(&initialize));
+    });
+}
+
+static set<MonoPair<string>>
+functionPairs(const std::vector<std::pair<string, string>> &pairs) {
+    set<MonoPair<string>> result;
+    for (const auto &pair : pairs) {
+        result.insert({pair.first, pair.second});
+    }
+    return result;
+}
+
+static SerializeOpts serializeOptions(const Options &opts) {
+    SerializeOpts serializeOpts("", false, opts.BitVect, opts.Pretty,
+                                opts.InlineLets);
+    serializeOpts.Jobs = opts.Jobs;
+    return serializeOpts;
+}
+
+Clauses generateClauses(const Input &first, const Input &second,
+                        const Options &opts) {
+    initialize();
+    if (first.Name == second.Name) {
+        logError("The inputs need different names\n");
+        exit(1);
+    }
+    Timings times;
+    auto start = Clock::now();
+    InputOpts inputOpts(opts.Includes, opts.ResourceDir, first.Name,
+                        second.Name);
+    inputOpts.InMemory = true;
+    inputOpts.Contents = {first.Contents, second.Contents};
+    // The actions own the contexts of the modules
+    unique_ptr<clang::CodeGenAction> act1 = makeCodeGenAction(inputOpts);
+    unique_ptr<clang::CodeGenAction> act2 = makeCodeGenAction(inputOpts);
+    MonoPair<unique_ptr<llvm::Module>> modules =
+        compileToModules(executablePath.c_str(), inputOpts, {*act1, *act2});
+    const FileOptions fileOpts = getFileOptionsFromSources(inputOpts.Contents);
+    times.Compile = Clock::now() - start;
+
+    SMTGenerationOpts smtOpts;
+    SMTGenerationOpts::Scope optsScope(smtOpts);
+    MonoPair<llvm::Module &> moduleRefs = {*modules.first, *modules.second};
+    std::map<const llvm::Function *, int> functionNumerals;
+    MonoPair<std::map<int, const llvm::Function *>> reversedFunctionNumerals = {
+        {}, {}};
+    std::tie(functionNumerals, reversedFunctionNumerals) =
+        generateFunctionMap(moduleRefs);
+    SMTGenerationOpts::initialize(
+        findMainFunction(moduleRefs, opts.Function),
+        opts.Heap ? HeapOpt::Enabled : HeapOpt::Disabled,
+        opts.Stack ? StackOpt::Enabled : StackOpt::Disabled,
+        opts.GlobalConstants ? GlobalConstantsOpt::Enabled
+                             : GlobalConstantsOpt::Disabled,
+        opts.OnlyRecursive ? FunctionEncoding::OnlyRecursive
+                           : FunctionEncoding::Iterative,
+        ByteHeapOpt::Enabled, opts.EverythingSigned,
+        opts.MuZ ? SMTFormat::Z3 : SMTFormat::SMTHorn,
+        PerfectSynchronization::Disabled, false, opts.BitVect, false, false,
+        false, {}, {}, {},
+        addConstToFunctionPairSet(lookupFunctionNamePairs(
+            moduleRefs, functionPairs(opts.AssumeEquivalent))),
+        getCoupledFunctions(moduleRefs, opts.DisableAutoCoupling,
+                            functionPairs(opts.CoupledFunctions)),
+        functionNumerals, reversedFunctionNumerals);
+    smtOpts.Jobs = opts.Jobs;
+
+    start = Clock::now();
+    const PreprocessOpts preprocessOpts(false, false, opts.InferMarks);
+    AnalysisResultsMap analysisResults =
+        preprocessModules(moduleRefs, preprocessOpts);
+    times.Preprocess = Clock::now() - start;
+
+    start = Clock::now();
+    Clauses clauses = {generateSMT(moduleRefs, analysisResults, fileOpts),
+                       opts.MuZ, times};
+    clauses.Times.Generate = Clock::now() - start;
+    return clauses;
+}
+
+SerializedSMT serializeClauses(const Input &first, const Input &second,
+                               const Options &opts) {
+    Clauses clauses = generateClauses(first, second, opts);
+    const auto start = Clock::now();
+    std::ostringstream out;
+    writeSMT(out, std::move(clauses.Exprs), clauses.MuZ,
+             serializeOptions(opts));
+    SerializedSMT result = {out.str(), clauses.Times};
+    result.Times.Serialize = Clock::now() - start;
+    return result;
+}
+
+VerificationResult solveClauses(Clauses clauses, const Options &opts) {
+    if (clauses.MuZ) {
+        logError("Only clauses in the SMT-HORN format can be solved\n");
+        exit(1);
+    }
+    const auto start = Clock::now();
+    const SolverOutput output =
+        solveWithZ3(std::move(clauses.Exprs), serializeOptions(opts));
+    VerificationResult result = {Verdict::Unknown, "", clauses.Times};
+    result.Times.Solve = Clock::now() - start;
+    // In the SMT-HORN encoding the programs are equivalent iff the clauses
+    // are satisfiable
+    switch (output.Result) {
+    case SolverResult::Sat:
+        result.Result = Verdict::Equal;
+        result.Model = output.Model;
+        break;
+    case SolverResult::Unsat:
+        result.Result = Verdict::NotEqual;
+        break;
+    case SolverResult::Unknown:
+        break;
+    }
+    return result;
+}
+
+VerificationResult verify(const Input &first, const Input &second,
+                          const Options &opts) {
+    if (opts.MuZ) {
+        logError("Only clauses in the SMT-HORN format can be solved\n");
+        exit(1);
+    }
+    return solveClauses(generateClauses(first, second, opts), opts);
+}
+
+string clausesHash(const Clauses &clauses, const Options &opts) {
+    return queryHash(clauses.Exprs, serializeOptions(opts));
+}
+} // namespace api
+} // namespace llreve
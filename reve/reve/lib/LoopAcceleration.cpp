@@ -0,0 +1,587 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "LoopAcceleration.h"
+
+#include "Statistics.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <functional>
+#include <map>
+
+using smt::SharedSMTRef;
+using smt::SortedVar;
+using std::make_shared;
+using std::string;
+using std::vector;
+
+namespace {
+struct ClauseInfo {
+    // The number of applications of each predicate outside of the head
+    llvm::StringMap<unsigned> Uses;
+    // The predicate applied in the head or empty, e.g. for queries
+    string Head;
+};
+
+// The recursive clause of an accelerated predicate
+struct CountingLoop {
+    // The arguments of the application in the premise
+    vector<string> Vars;
+    // The constant that is added to each variable in every iteration
+    vector<int64_t> Steps;
+    // The linear conditions of an iteration, over 'Vars'
+    vector<SharedSMTRef> Guards;
+};
+}
+
+static auto headOf(const smt::SMTExpr &expr) -> const smt::SMTExpr & {
+    switch (expr.getTag()) {
+    case smt::ExprTag::Assert:
+        return headOf(*static_cast<const smt::Assert &>(expr).expr);
+    case smt::ExprTag::Forall:
+        return headOf(*static_cast<const smt::Forall &>(expr).expr);
+    case smt::ExprTag::Let:
+        return headOf(*static_cast<const smt::Let &>(expr).expr);
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        if (op.opName == "=>" && op.args.size() == 2) {
+            return headOf(*op.args[1]);
+        }
+        return expr;
+    }
+    default:
+        return expr;
+    }
+}
+
+static void countUses(const smt::SMTExpr &expr,
+                      const llvm::StringSet<> &predicates, ClauseInfo &info) {
+    switch (expr.getTag()) {
+    case smt::ExprTag::Assert:
+        countUses(*static_cast<const smt::Assert &>(expr).expr, predicates,
+                  info);
+        break;
+    case smt::ExprTag::Forall:
+        countUses(*static_cast<const smt::Forall &>(expr).expr, predicates,
+                  info);
+        break;
+    case smt::ExprTag::Let: {
+        const auto &let = static_cast<const smt::Let &>(expr);
+        for (const auto &def : let.defs) {
+            countUses(*def.second, predicates, info);
+        }
+        countUses(*let.expr, predicates, info);
+        break;
+    }
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        if (predicates.count(op.opName) > 0) {
+            ++info.Uses[op.opName];
+        }
+        for (const auto &arg : op.args) {
+            countUses(*arg, predicates, info);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static auto analyzeClause(const smt::SMTExpr &clause,
+                          const llvm::StringSet<> &predicates) -> ClauseInfo {
+    ClauseInfo info;
+    countUses(clause, predicates, info);
+    const smt::SMTExpr &head = headOf(clause);
+    if (head.getTag() == smt::ExprTag::Op) {
+        const string &name = static_cast<const smt::Op &>(head).opName;
+        if (predicates.count(name) > 0) {
+            info.Head = name;
+            if (--info.Uses[name] == 0) {
+                info.Uses.erase(name);
+            }
+        }
+    }
+    return info;
+}
+
+// The number of applications of the predicate that are conjuncts of the
+// premises along the path to the head. Applications anywhere else (e.g. in a
+// conjunction in the head) could derive new facts for the predicate.
+static auto premiseApplications(const smt::SMTExpr &expr,
+                                const string &predicate, bool premise)
+    -> unsigned {
+    switch (expr.getTag()) {
+    case smt::ExprTag::Assert:
+        return premiseApplications(*static_cast<const smt::Assert &>(expr).expr,
+                                   predicate, premise);
+    case smt::ExprTag::Forall:
+        return premiseApplications(*static_cast<const smt::Forall &>(expr).expr,
+                                   predicate, premise);
+    case smt::ExprTag::Let:
+        return premiseApplications(*static_cast<const smt::Let &>(expr).expr,
+                                   predicate, premise);
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        if (op.opName == predicate) {
+            return premise ? 1 : 0;
+        }
+        if (!premise && op.opName == "=>" && op.args.size() == 2) {
+            return premiseApplications(*op.args[0], predicate, true) +
+                   premiseApplications(*op.args[1], predicate, false);
+        }
+        unsigned count = 0;
+        if (premise && op.opName == "and") {
+            for (const auto &arg : op.args) {
+                count += premiseApplications(*arg, predicate, true);
+            }
+        }
+        return count;
+    }
+    default:
+        return 0;
+    }
+}
+
+static void addConjuncts(const SharedSMTRef &expr,
+                         vector<SharedSMTRef> &conjuncts) {
+    if (expr->getTag() == smt::ExprTag::Op) {
+        const auto &op = static_cast<const smt::Op &>(*expr);
+        if (op.opName == "and") {
+            for (const auto &arg : op.args) {
+                addConjuncts(arg, conjuncts);
+            }
+            return;
+        }
+    }
+    conjuncts.push_back(expr);
+}
+
+// Splits a clause without lets into the conjuncts of its premises and the
+// head
+static auto flattenClause(const SharedSMTRef &expr,
+                          vector<SharedSMTRef> &premises) -> const smt::Op * {
+    switch (expr->getTag()) {
+    case smt::ExprTag::Assert:
+        return flattenClause(static_cast<const smt::Assert &>(*expr).expr,
+                             premises);
+    case smt::ExprTag::Forall:
+        return flattenClause(static_cast<const smt::Forall &>(*expr).expr,
+                             premises);
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(*expr);
+        if (op.opName == "=>" && op.args.size() == 2) {
+            addConjuncts(op.args[0], premises);
+            return flattenClause(op.args[1], premises);
+        }
+        return &op;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+static auto variableName(const smt::SMTExpr &expr, string &name) -> bool {
+    if (expr.getTag() == smt::ExprTag::TypedVariable) {
+        name = static_cast<const smt::TypedVariable &>(expr).name;
+        return true;
+    }
+    if (expr.getTag() == smt::ExprTag::ConstantString) {
+        name = static_cast<const smt::ConstantString &>(expr).value;
+        return true;
+    }
+    return false;
+}
+
+static auto constantValue(const smt::SMTExpr &expr, int64_t &value) -> bool {
+    if (expr.getTag() == smt::ExprTag::ConstantInt) {
+        const auto &constant = static_cast<const smt::ConstantInt &>(expr);
+        if (constant.value.getMinSignedBits() > 32) {
+            return false;
+        }
+        value = constant.value.getSExtValue();
+        return true;
+    }
+    if (expr.getTag() == smt::ExprTag::Op) {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        if (op.opName == "-" && op.args.size() == 1 &&
+            constantValue(*op.args[0], value)) {
+            value = -value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Matches x, (+ x c), (+ c x) and (- x c)
+static auto stepOf(const smt::SMTExpr &expr, const string &var, int64_t &step)
+    -> bool {
+    string name;
+    if (variableName(expr, name)) {
+        step = 0;
+        return name == var;
+    }
+    if (expr.getTag() != smt::ExprTag::Op) {
+        return false;
+    }
+    const auto &op = static_cast<const smt::Op &>(expr);
+    if (op.args.size() != 2 || (op.opName != "+" && op.opName != "-")) {
+        return false;
+    }
+    if (variableName(*op.args[0], name) && name == var &&
+        constantValue(*op.args[1], step)) {
+        step = op.opName == "-" ? -step : step;
+        return true;
+    }
+    return op.opName == "+" && variableName(*op.args[1], name) &&
+           name == var && constantValue(*op.args[0], step);
+}
+
+static auto isLinear(const smt::SMTExpr &expr, const llvm::StringSet<> &vars)
+    -> bool {
+    string name;
+    int64_t value;
+    if (variableName(expr, name)) {
+        return vars.count(name) > 0;
+    }
+    if (constantValue(expr, value)) {
+        return true;
+    }
+    if (expr.getTag() != smt::ExprTag::Op) {
+        return false;
+    }
+    const auto &op = static_cast<const smt::Op &>(expr);
+    if (op.opName != "+" && op.opName != "-" && op.opName != "*") {
+        return false;
+    }
+    unsigned nonConstant = 0;
+    for (const auto &arg : op.args) {
+        if (!isLinear(*arg, vars)) {
+            return false;
+        }
+        nonConstant += !constantValue(*arg, value);
+    }
+    return op.opName != "*" || nonConstant <= 1;
+}
+
+static auto isComparison(const string &opName) -> bool {
+    return opName == "<" || opName == "<=" || opName == ">" ||
+           opName == ">=" || opName == "=";
+}
+
+// The condition as a linear comparison, negations of inequalities are
+// flipped. Disequalities are not convex and result in nullptr.
+static auto linearAtom(const SharedSMTRef &expr, const llvm::StringSet<> &vars)
+    -> SharedSMTRef {
+    if (expr->getTag() != smt::ExprTag::Op) {
+        return nullptr;
+    }
+    const auto &op = static_cast<const smt::Op &>(*expr);
+    if (op.opName == "not" && op.args.size() == 1 &&
+        op.args[0]->getTag() == smt::ExprTag::Op) {
+        const auto &negated = static_cast<const smt::Op &>(*op.args[0]);
+        static const std::map<string, string> flipped = {
+            {"<", ">="}, {"<=", ">"}, {">", "<="}, {">=", "<"}};
+        auto it = flipped.find(negated.opName);
+        if (it == flipped.end() || negated.args.size() != 2 ||
+            !isLinear(*negated.args[0], vars) ||
+            !isLinear(*negated.args[1], vars)) {
+            return nullptr;
+        }
+        return make_shared<smt::Op>(it->second, negated.args);
+    }
+    if (!isComparison(op.opName) || op.args.size() != 2 ||
+        !isLinear(*op.args[0], vars) || !isLinear(*op.args[1], vars)) {
+        return nullptr;
+    }
+    return expr;
+}
+
+// Matches the recursive clause of the predicate against the form described
+// in the header
+static auto countingLoop(const SharedSMTRef &clause, const smt::FunDecl &decl,
+                         CountingLoop &loop) -> bool {
+    vector<SharedSMTRef> premises;
+    const smt::Op *head = flattenClause(clause->inlineLets({}), premises);
+    if (head == nullptr || head->opName != decl.funName ||
+        head->args.size() != decl.inTypes.size()) {
+        return false;
+    }
+    const smt::Op *application = nullptr;
+    vector<SharedSMTRef> conditions;
+    for (const auto &premise : premises) {
+        if (premise->getTag() == smt::ExprTag::Op &&
+            static_cast<const smt::Op &>(*premise).opName == decl.funName) {
+            application = static_cast<const smt::Op *>(premise.get());
+        } else {
+            conditions.push_back(premise);
+        }
+    }
+    if (application == nullptr) {
+        return false;
+    }
+    llvm::StringSet<> vars;
+    bool counting = false;
+    for (size_t i = 0; i < application->args.size(); ++i) {
+        string name;
+        int64_t step;
+        if (!variableName(*application->args[i], name) ||
+            !vars.insert(name).second ||
+            !stepOf(*head->args[i], name, step)) {
+            return false;
+        }
+        // Arrays and booleans have to stay the same
+        if (step != 0 && decl.inTypes[i].getTag() != smt::TypeTag::Int) {
+            return false;
+        }
+        counting |= step != 0;
+        loop.Vars.push_back(name);
+        loop.Steps.push_back(step);
+    }
+    if (!counting) {
+        return false;
+    }
+    for (const auto &condition : conditions) {
+        if (condition->getTag() == smt::ExprTag::ConstantBool &&
+            static_cast<const smt::ConstantBool &>(*condition).value) {
+            continue;
+        }
+        SharedSMTRef atom = linearAtom(condition, vars);
+        if (!atom) {
+            return false;
+        }
+        loop.Guards.push_back(std::move(atom));
+    }
+    return true;
+}
+
+static auto intConstant(int64_t value) -> SharedSMTRef {
+    if (value < 0) {
+        return make_shared<smt::Op>(
+            "-", vector<SharedSMTRef>{make_shared<smt::ConstantInt>(
+                     llvm::APInt(64, static_cast<uint64_t>(-value)))});
+    }
+    return make_shared<smt::ConstantInt>(
+        llvm::APInt(64, static_cast<uint64_t>(value)));
+}
+
+// x + step * iterations for every variable of the loop
+static auto afterIterations(const CountingLoop &loop,
+                            const SharedSMTRef &iterations)
+    -> vector<SharedSMTRef> {
+    vector<SharedSMTRef> values;
+    for (size_t i = 0; i < loop.Vars.size(); ++i) {
+        SharedSMTRef var = make_shared<smt::ConstantString>(loop.Vars[i]);
+        if (loop.Steps[i] == 0) {
+            values.push_back(var);
+            continue;
+        }
+        values.push_back(make_shared<smt::Op>(
+            "+", vector<SharedSMTRef>{
+                     var, make_shared<smt::Op>(
+                              "*", vector<SharedSMTRef>{
+                                       intConstant(loop.Steps[i]),
+                                       iterations})}));
+    }
+    return values;
+}
+
+static auto guardsAt(const CountingLoop &loop,
+                     const vector<SharedSMTRef> &values)
+    -> vector<SharedSMTRef> {
+    std::map<string, SharedSMTRef> assignments;
+    for (size_t i = 0; i < loop.Vars.size(); ++i) {
+        assignments[loop.Vars[i]] = values[i];
+    }
+    vector<SharedSMTRef> guards;
+    for (const auto &guard : loop.Guards) {
+        guards.push_back(guard->inlineLets(assignments));
+    }
+    return guards;
+}
+
+static auto conjunction(vector<SharedSMTRef> conjuncts) -> SharedSMTRef {
+    if (conjuncts.empty()) {
+        return make_shared<smt::ConstantBool>(true);
+    }
+    if (conjuncts.size() == 1) {
+        return conjuncts.front();
+    }
+    return make_shared<smt::Op>("and", std::move(conjuncts));
+}
+
+// Replaces the head (P t) of the clause by
+//
+//   (let ((x t)) (=> (and (>= k 0) (or (= k 0) (and (G x) (G x')))) (P x'')))
+//
+// where x' and x'' are the values after k - 1 and k iterations. The let
+// binds the variables of the loop to the arguments in the scope of the
+// head, so the guards can be used without renaming.
+static auto acceleratedHead(const smt::Op &head, const CountingLoop &loop,
+                            const SharedSMTRef &iterations) -> SharedSMTRef {
+    smt::AssignmentVec defs;
+    vector<SharedSMTRef> start;
+    for (size_t i = 0; i < loop.Vars.size(); ++i) {
+        defs.push_back({loop.Vars[i], head.args[i]});
+        start.push_back(make_shared<smt::ConstantString>(loop.Vars[i]));
+    }
+    SharedSMTRef last = make_shared<smt::Op>(
+        "-", vector<SharedSMTRef>{iterations, intConstant(1)});
+    vector<SharedSMTRef> guards = guardsAt(loop, start);
+    for (auto &guard : guardsAt(loop, afterIterations(loop, last))) {
+        guards.push_back(std::move(guard));
+    }
+    SharedSMTRef condition = make_shared<smt::Op>(
+        "and",
+        vector<SharedSMTRef>{
+            make_shared<smt::Op>(">=", vector<SharedSMTRef>{iterations,
+                                                           intConstant(0)}),
+            make_shared<smt::Op>(
+                "or", vector<SharedSMTRef>{
+                          make_shared<smt::Op>(
+                              "=", vector<SharedSMTRef>{iterations,
+                                                        intConstant(0)}),
+                          conjunction(std::move(guards))})});
+    SharedSMTRef accelerated = make_shared<smt::Op>(
+        head.opName, afterIterations(loop, iterations), head.instantiate);
+    return make_shared<smt::Let>(
+        std::move(defs),
+        make_shared<smt::Op>("=>", vector<SharedSMTRef>{
+                                       std::move(condition),
+                                       std::move(accelerated)}));
+}
+
+using Replacement = std::function<SharedSMTRef(const smt::Op &)>;
+
+static auto replaceHead(const SharedSMTRef &expr,
+                        const Replacement &replacement) -> SharedSMTRef {
+    switch (expr->getTag()) {
+    case smt::ExprTag::Forall: {
+        const auto &forall = static_cast<const smt::Forall &>(*expr);
+        return make_shared<smt::Forall>(
+            forall.vars, replaceHead(forall.expr, replacement));
+    }
+    case smt::ExprTag::Let: {
+        const auto &let = static_cast<const smt::Let &>(*expr);
+        return make_shared<smt::Let>(let.defs,
+                                     replaceHead(let.expr, replacement));
+    }
+    default:
+        break;
+    }
+    const auto &op = static_cast<const smt::Op &>(*expr);
+    if (op.opName == "=>" && op.args.size() == 2) {
+        return make_shared<smt::Op>(
+            "=>",
+            vector<SharedSMTRef>{op.args[0],
+                                 replaceHead(op.args[1], replacement)},
+            op.instantiate);
+    }
+    return replacement(op);
+}
+
+static auto accelerateClause(const SharedSMTRef &clause,
+                             const CountingLoop &loop) -> SharedSMTRef {
+    // The variables of the loop are bound below, so the name is fresh
+    const SortedVar iterations("accel$k", smt::int64Type());
+    SharedSMTRef iterationsRef = smt::typedVariableFromSortedVar(iterations);
+    SharedSMTRef body = replaceHead(
+        static_cast<const smt::Assert &>(*clause).expr,
+        [&](const smt::Op &head) {
+            return acceleratedHead(head, loop, iterationsRef);
+        });
+    vector<SortedVar> vars = {iterations};
+    if (body->getTag() == smt::ExprTag::Forall) {
+        const auto &forall = static_cast<const smt::Forall &>(*body);
+        vars.insert(vars.end(), forall.vars.begin(), forall.vars.end());
+        body = forall.expr;
+    }
+    return make_shared<smt::Assert>(
+        make_shared<smt::Forall>(std::move(vars), std::move(body)));
+}
+
+size_t accelerateLoops(vector<SharedSMTRef> &smtExprs) {
+    llvm::StringSet<> predicates;
+    vector<const smt::FunDecl *> declarations;
+    for (const auto &expr : smtExprs) {
+        if (expr->getTag() == smt::ExprTag::FunDecl) {
+            const auto &decl = static_cast<const smt::FunDecl &>(*expr);
+            if (predicates.insert(decl.funName).second) {
+                declarations.push_back(&decl);
+            }
+        }
+    }
+    vector<ClauseInfo> infos(smtExprs.size());
+    llvm::StringMap<vector<size_t>> definingClauses;
+    llvm::StringMap<vector<size_t>> usingClauses;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        if (!smtExprs[i]->asAssert()) {
+            continue;
+        }
+        infos[i] = analyzeClause(*smtExprs[i], predicates);
+        if (!infos[i].Head.empty()) {
+            definingClauses[infos[i].Head].push_back(i);
+        }
+        for (const auto &use : infos[i].Uses) {
+            usingClauses[use.getKey()].push_back(i);
+        }
+    }
+
+    // Every clause has a single head, so accelerating one predicate doesn’t
+    // change the clauses of the others
+    vector<bool> removed(smtExprs.size(), false);
+    size_t accelerated = 0;
+    for (const smt::FunDecl *decl : declarations) {
+        const string &predicate = decl->funName;
+        size_t recursive = 0;
+        unsigned recursiveCount = 0;
+        bool applicable = true;
+        for (size_t use : usingClauses[predicate]) {
+            const ClauseInfo &info = infos[use];
+            if (premiseApplications(*smtExprs[use], predicate, false) !=
+                info.Uses.lookup(predicate)) {
+                applicable = false;
+            }
+            if (info.Head == predicate) {
+                recursive = use;
+                ++recursiveCount;
+                // The loop may not depend on other predicates
+                if (info.Uses.size() != 1 ||
+                    info.Uses.lookup(predicate) != 1) {
+                    applicable = false;
+                }
+            }
+        }
+        CountingLoop loop;
+        if (!applicable || recursiveCount != 1 ||
+            !countingLoop(smtExprs[recursive], *decl, loop)) {
+            continue;
+        }
+        for (size_t def : definingClauses[predicate]) {
+            if (def != recursive) {
+                smtExprs[def] = accelerateClause(smtExprs[def], loop);
+            }
+        }
+        removed[recursive] = true;
+        ++accelerated;
+    }
+
+    vector<SharedSMTRef> result;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        if (!removed[i]) {
+            result.push_back(smtExprs[i]);
+        }
+    }
+    smtExprs = std::move(result);
+    stats::count("loop acceleration.predicates", accelerated);
+    return accelerated;
+}
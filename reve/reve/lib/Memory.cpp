@@ -0,0 +1,37 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Memory.h"
+
+static bool startsWithProgramIndex(llvm::StringRef name) {
+    return !name.empty() && (name.front() == '1' || name.front() == '2');
+}
+
+auto variableRole(llvm::StringRef name) -> VarRole {
+    if (name.startswith("HEAP$") && startsWithProgramIndex(name.substr(5))) {
+        return VarRole::Heap;
+    }
+    if (name.startswith("STACK$") && startsWithProgramIndex(name.substr(6))) {
+        return VarRole::Stack;
+    }
+    if (name.startswith("i") && startsWithProgramIndex(name.substr(1))) {
+        llvm::StringRef suffix = name.substr(2);
+        // Indices of a heap region, e.g. i1_r2_res, see heapName
+        if (suffix.startswith("_r") && suffix.size() > 2 &&
+            suffix[2] >= '0' && suffix[2] <= '9') {
+            suffix = suffix.substr(2).ltrim("0123456789");
+        }
+        if (suffix.empty() || suffix == "_res" || suffix == "_old" ||
+            suffix == "_stack") {
+            return VarRole::Index;
+        }
+    }
+    return VarRole::Plain;
+}
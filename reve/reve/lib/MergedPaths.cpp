@@ -0,0 +1,437 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "MergedPaths.h"
+
+#include "Assignment.h"
+#include "Helper.h"
+#include "Opts.h"
+
+#include "llvm/IR/Intrinsics.h"
+
+using std::make_unique;
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+using namespace smt;
+using namespace llreve::opts;
+
+static bool hasCalls(const llvm::BasicBlock &block) {
+    for (const auto &instr : block) {
+        if (const auto callInst = llvm::dyn_cast<llvm::CallInst>(&instr)) {
+            const auto fun = callInst->getCalledFunction();
+            if (!fun || (fun->getIntrinsicID() != llvm::Intrinsic::memcpy &&
+                         fun->getIntrinsicID() != llvm::Intrinsic::memset)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool canMergePaths(const Paths &paths) {
+    for (const auto &path : paths) {
+        if (path.Edges.empty() || hasCalls(*path.Start)) {
+            return false;
+        }
+        for (const auto &edge : path.Edges) {
+            if (hasCalls(*edge.Block)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool shouldMergePaths(const Paths &paths1, const Paths &paths2) {
+    // With only a single combination of paths there is nothing to merge
+    return SMTGenerationOpts::getInstance().MergePaths &&
+           (paths1.size() > 1 || paths2.size() > 1) &&
+           canMergePaths(paths1) && canMergePaths(paths2);
+}
+
+namespace {
+struct MergedEdge {
+    size_t from;
+    size_t to;
+    const Condition *cond;
+};
+
+// Maps the names used in the program to the let-bound variables holding
+// their value at a specific block
+using Environment = map<string, string>;
+
+class PathMerger {
+  public:
+    PathMerger(llvm::BasicBlock *start, Program prog, bool toEnd)
+        : prog(prog), progIndex(programIndex(prog)), toEnd(toEnd) {
+        nodeId(start, false);
+    }
+    void addPath(const Path &path);
+    SharedSMTRef encode(const vector<SortedVar> &freeVars,
+                        const MergedEndClause &endClause);
+
+  private:
+    Program prog;
+    int progIndex;
+    bool toEnd;
+    // Marked blocks at the end of a path are distinct from the start block
+    // even if it’s the same basic block
+    vector<std::pair<llvm::BasicBlock *, bool>> nodes;
+    map<std::pair<llvm::BasicBlock *, bool>, size_t> nodeIds;
+    vector<MergedEdge> edges;
+    vector<vector<size_t>> incoming;
+    vector<vector<size_t>> outgoing;
+    map<string, Type> types;
+
+    // Encoding state
+    vector<Environment> environments;
+    vector<Environment> phiValues;
+    // The let-bound variable that the plain name currently refers to
+    Environment plainState;
+
+    size_t nodeId(llvm::BasicBlock *block, bool final);
+    vector<size_t> topologicalOrder() const;
+    Type typeOf(const string &name) const;
+    SharedSMTRef variable(const string &name) const;
+    SharedSMTRef reachedVia(size_t node) const;
+    string nodeVar(const string &name, size_t node) const;
+    string edgeVar(size_t edge) const;
+    Environment mergeIncoming(size_t node, vector<Assignment> &defs);
+    void rebind(const Environment &env, Environment &plainState,
+                vector<Assignment> &defs) const;
+};
+}
+
+size_t PathMerger::nodeId(llvm::BasicBlock *block, bool final) {
+    auto it = nodeIds.find({block, final});
+    if (it != nodeIds.end()) {
+        return it->second;
+    }
+    size_t id = nodes.size();
+    nodes.push_back({block, final});
+    nodeIds.insert({{block, final}, id});
+    incoming.emplace_back();
+    outgoing.emplace_back();
+    return id;
+}
+
+void PathMerger::addPath(const Path &path) {
+    size_t prev = 0;
+    for (size_t i = 0; i < path.Edges.size(); ++i) {
+        const auto &edge = path.Edges.at(i);
+        size_t next = nodeId(edge.Block, i + 1 == path.Edges.size());
+        bool known = false;
+        for (size_t e : outgoing.at(prev)) {
+            // Conditions are shared between paths that take the same edge
+            if (edges.at(e).to == next && edges.at(e).cond == edge.Cond) {
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            outgoing.at(prev).push_back(edges.size());
+            incoming.at(next).push_back(edges.size());
+            edges.push_back({prev, next, edge.Cond});
+        }
+        prev = next;
+    }
+}
+
+vector<size_t> PathMerger::topologicalOrder() const {
+    // The graph is acyclic since each cycle contains a mark
+    vector<size_t> postOrder;
+    vector<bool> visited(nodes.size(), false);
+    vector<std::pair<size_t, size_t>> stack = {{0, 0}};
+    visited.at(0) = true;
+    while (!stack.empty()) {
+        auto &top = stack.back();
+        if (top.second < outgoing.at(top.first).size()) {
+            size_t next = edges.at(outgoing.at(top.first).at(top.second)).to;
+            ++top.second;
+            if (!visited.at(next)) {
+                visited.at(next) = true;
+                stack.push_back({next, 0});
+            }
+        } else {
+            postOrder.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    return vector<size_t>(postOrder.rbegin(), postOrder.rend());
+}
+
+Type PathMerger::typeOf(const string &name) const {
+    auto it = types.find(name);
+    if (it != types.end()) {
+        return it->second;
+    }
+    return inferTypeByName(name);
+}
+
+SharedSMTRef PathMerger::variable(const string &name) const {
+    return make_unique<TypedVariable>(name, typeOf(name));
+}
+
+string PathMerger::nodeVar(const string &name, size_t node) const {
+    return name + "@" + std::to_string(node);
+}
+
+string PathMerger::edgeVar(size_t edge) const {
+    return "EDGE$" + std::to_string(progIndex) + "@" + std::to_string(edge);
+}
+
+SharedSMTRef PathMerger::reachedVia(size_t node) const {
+    const auto &in = incoming.at(node);
+    if (in.size() == 1) {
+        return make_unique<TypedVariable>(edgeVar(in.front()), boolType());
+    }
+    vector<SharedSMTRef> args;
+    for (size_t e : in) {
+        args.push_back(make_unique<TypedVariable>(edgeVar(e), boolType()));
+    }
+    return make_unique<Op>("or", std::move(args));
+}
+
+// The values of variables (including the phi nodes of 'node') after entering
+// 'node'. Variables that are not defined on all incoming edges can’t be used
+// in 'node' so they are dropped.
+Environment PathMerger::mergeIncoming(size_t node,
+                                      vector<Assignment> &defs) {
+    Environment result;
+    const auto &in = incoming.at(node);
+    auto merge = [&](string name, vector<string> values) {
+        bool allEqual = std::all_of(values.begin(), values.end(),
+                                    [&](const string &value) {
+                                        return value == values.front();
+                                    });
+        if (allEqual) {
+            result[name] = values.front();
+            return;
+        }
+        SharedSMTRef value = variable(values.back());
+        for (size_t i = values.size() - 1; i-- > 0;) {
+            value = makeOp(
+                "ite", make_unique<TypedVariable>(edgeVar(in.at(i)), boolType()),
+                variable(values.at(i)), std::move(value));
+        }
+        string mergedName = name + "@in" + std::to_string(node);
+        types.insert({mergedName, typeOf(name)});
+        defs.push_back({mergedName, std::move(value)});
+        result[name] = mergedName;
+    };
+    for (const auto &var : environments.at(edges.at(in.front()).from)) {
+        vector<string> values;
+        for (size_t e : in) {
+            const auto &env = environments.at(edges.at(e).from);
+            auto it = env.find(var.first);
+            if (it == env.end()) {
+                break;
+            }
+            values.push_back(it->second);
+        }
+        if (values.size() == in.size()) {
+            merge(var.first, std::move(values));
+        }
+    }
+    for (const auto &phi : phiValues.at(in.front())) {
+        vector<string> values;
+        for (size_t e : in) {
+            values.push_back(phiValues.at(e).at(phi.first));
+        }
+        merge(phi.first, std::move(values));
+    }
+    return result;
+}
+
+void PathMerger::rebind(const Environment &env, Environment &plainState,
+                        vector<Assignment> &defs) const {
+    for (const auto &var : env) {
+        auto it = plainState.find(var.first);
+        if (it == plainState.end() || it->second != var.second) {
+            defs.push_back({var.first, variable(var.second)});
+            plainState[var.first] = var.second;
+        }
+    }
+}
+
+SharedSMTRef PathMerger::encode(const vector<SortedVar> &freeVars,
+                                const MergedEndClause &endClause) {
+    set<string> freeVarNames;
+    for (const auto &var : freeVars) {
+        freeVarNames.insert(var.name);
+        types.insert({var.name, var.type});
+        types.insert({var.name + "_old", var.type});
+    }
+    for (const auto &node : nodes) {
+        for (const auto &instr : *node.first) {
+            if (!instr.getType()->isVoidTy() && instr.hasName()) {
+                auto var = llvmValToSortedVar(&instr);
+                types.insert({var.name, var.type});
+            }
+        }
+    }
+    environments.resize(nodes.size());
+    phiValues.resize(edges.size());
+
+    vector<Assignment> defs;
+    vector<size_t> finalNodes;
+    for (size_t node : topologicalOrder()) {
+        llvm::BasicBlock *block = nodes.at(node).first;
+        if (nodes.at(node).second) {
+            finalNodes.push_back(node);
+            continue;
+        }
+        Environment env;
+        vector<Assignment> nodeDefs;
+        if (node == 0) {
+            for (const auto &var : freeVars) {
+                env[var.name] = var.name + "_old";
+            }
+        } else {
+            nodeDefs.push_back(
+                {nodeVar("REACH$" + std::to_string(progIndex), node),
+                 reachedVia(node)});
+            env = mergeIncoming(node, nodeDefs);
+        }
+        rebind(env, plainState, nodeDefs);
+
+        map<string, unsigned> assignmentCounts;
+        vector<string> assigned;
+        for (auto &def : blockAssignments(*block, nullptr, false, prog)) {
+            assert(def.tag == DefOrCallInfoTag::Def);
+            if (assignmentCounts[def.definition->first]++ == 0) {
+                assigned.push_back(def.definition->first);
+            }
+            nodeDefs.push_back(std::move(*def.definition));
+        }
+        set<string> instructionNames;
+        for (const auto &instr : *block) {
+            if (instr.hasName()) {
+                instructionNames.insert(instr.getName().str());
+            }
+        }
+        for (const auto &name : assigned) {
+            if (assignmentCounts.at(name) == 1 &&
+                instructionNames.find(name) != instructionNames.end() &&
+                freeVarNames.find(name) == freeVarNames.end()) {
+                // Instructions are only assigned in their own block, so the
+                // plain name always refers to this value
+                plainState[name] = name;
+                env[name] = name;
+            } else {
+                // Other variables (e.g. the heap) are assigned in several
+                // blocks, so we save the value at this block before the
+                // plain name is rebound
+                string versioned = nodeVar(name, node);
+                types.insert({versioned, typeOf(name)});
+                nodeDefs.push_back({versioned, variable(name)});
+                plainState[name] = versioned;
+                env[name] = versioned;
+            }
+        }
+        // The start block is always reached
+        SharedSMTRef reached = nullptr;
+        if (node != 0) {
+            reached = make_unique<TypedVariable>(
+                nodeVar("REACH$" + std::to_string(progIndex), node),
+                boolType());
+        }
+        for (size_t e : outgoing.at(node)) {
+            const auto &edge = edges.at(e);
+            SharedSMTRef edgeTaken = reached;
+            if (edge.cond) {
+                edgeTaken = edgeTaken
+                                ? SharedSMTRef(makeOp("and", edgeTaken,
+                                                      edge.cond->toSmt()))
+                                : SharedSMTRef(edge.cond->toSmt());
+            } else if (!edgeTaken) {
+                edgeTaken = make_unique<ConstantBool>(true);
+            }
+            nodeDefs.push_back({edgeVar(e), edgeTaken});
+            // Phi nodes are evaluated using the values at the end of this
+            // block
+            for (auto &def :
+                 blockAssignments(*nodes.at(edge.to).first, block, true, prog)) {
+                assert(def.tag == DefOrCallInfoTag::Def);
+                string name = def.definition->first;
+                string versioned = name + "@e" + std::to_string(e);
+                types.insert({versioned, typeOf(name)});
+                nodeDefs.push_back({versioned, def.definition->second});
+                phiValues.at(e)[name] = versioned;
+            }
+        }
+        environments.at(node) = std::move(env);
+        defs.insert(defs.end(), std::make_move_iterator(nodeDefs.begin()),
+                    std::make_move_iterator(nodeDefs.end()));
+    }
+
+    // The ends of the paths. Nothing depends on the definitions in these
+    // blocks so they are encoded separately at the end of the chain of
+    // definitions.
+    vector<SharedSMTRef> leaves;
+    for (size_t node : finalNodes) {
+        llvm::BasicBlock *block = nodes.at(node).first;
+        vector<Assignment> nodeDefs;
+        Environment env = mergeIncoming(node, nodeDefs);
+        Environment leafState = plainState;
+        rebind(env, leafState, nodeDefs);
+        if (toEnd) {
+            for (auto &def : blockAssignments(*block, nullptr, false, prog)) {
+                assert(def.tag == DefOrCallInfoTag::Def);
+                nodeDefs.push_back(std::move(*def.definition));
+            }
+        }
+        leaves.push_back(
+            makeOp("=>", reachedVia(node),
+                   fastNestLets(endClause(block), std::move(nodeDefs))));
+    }
+
+    SharedSMTRef body;
+    if (leaves.size() == 1) {
+        body = std::move(leaves.front());
+    } else {
+        vector<SharedSMTRef> conjuncts;
+        for (auto &leaf : leaves) {
+            conjuncts.push_back(std::move(leaf));
+        }
+        body = make_unique<Op>("and", std::move(conjuncts));
+    }
+    return fastNestLets(std::move(body), defs);
+}
+
+SharedSMTRef mergedPathsSMT(const Paths &paths, Program prog,
+                            const vector<SortedVar> &freeVars, bool toEnd,
+                            MergedEndClause endClause) {
+    // Paths starting at different blocks with the same mark are independent
+    // of each other
+    map<llvm::BasicBlock *, vector<const Path *>> pathsByStart;
+    for (const auto &path : paths) {
+        pathsByStart[path.Start].push_back(&path);
+    }
+    vector<SharedSMTRef> clauses;
+    for (const auto &it : pathsByStart) {
+        PathMerger merger(it.first, prog, toEnd);
+        for (const Path *path : it.second) {
+            merger.addPath(*path);
+        }
+        clauses.push_back(merger.encode(freeVars, endClause));
+    }
+    if (clauses.size() == 1) {
+        return std::move(clauses.front());
+    }
+    vector<SharedSMTRef> conjuncts;
+    for (auto &clause : clauses) {
+        conjuncts.push_back(std::move(clause));
+    }
+    return make_unique<Op>("and", std::move(conjuncts));
+}
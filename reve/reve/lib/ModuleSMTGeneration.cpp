@@ -11,14 +11,19 @@
 #include "ModuleSMTGeneration.h"
 
 #include "Compat.h"
+#include "EqualVariables.h"
 #include "FixedAbstraction.h"
 #include "FunctionSMTGeneration.h"
+#include "HashCons.h"
+#include "HeapRegions.h"
 #include "Helper.h"
 #include "Invariant.h"
 #include "Memory.h"
 #include "Slicing.h"
+#include "Statistics.h"
 
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Operator.h"
 
 using std::make_unique;
 using std::shared_ptr;
@@ -32,6 +37,7 @@ using namespace llreve::opts;
 vector<SharedSMTRef> generateSMT(MonoPair<const llvm::Module &> modules,
                                  const AnalysisResultsMap &analysisResults,
                                  FileOptions fileOpts) {
+    stats::ScopedTimer timer("generate");
     std::vector<SharedSMTRef> declarations;
     std::vector<SortedVar> variableDeclarations;
     SMTGenerationOpts &smtOpts = SMTGenerationOpts::getInstance();
@@ -59,9 +65,21 @@ vector<SharedSMTRef> generateSMT(MonoPair<const llvm::Module &> modules,
 
     // We use an iterative encoding for the main function since this seems to
     // perform better than a recursive encoding
-    generateSMTForMainFunctions(modules, analysisResults, fileOpts, assertions,
-                                declarations);
+    {
+        // Repeated heap accesses and invariant applications share their
+        // nodes within the clauses built by one thread
+        HashConsFactory factory;
+        HashConsScope scope(factory);
+        generateSMTForMainFunctions(modules, analysisResults, fileOpts,
+                                    assertions, declarations);
+    }
 
+    // The clauses for different functions are independent of each other so
+    // they can be generated in parallel. Each task writes to its own slot and
+    // the results are concatenated in a fixed order afterwards to keep the
+    // output deterministic.
+    vector<std::function<void(vector<SharedSMTRef> &, vector<SharedSMTRef> &)>>
+        generators;
     for (auto &funPair : smtOpts.CoupledFunctions) {
         // We only need to generate a relational abstraction if both program
         // call a function transitively since we will never couple calls
@@ -70,28 +88,64 @@ vector<SharedSMTRef> generateSMT(MonoPair<const llvm::Module &> modules,
             callsTransitively(*smtOpts.MainFunctions.first, *funPair.first) &&
             callsTransitively(*smtOpts.MainFunctions.second, *funPair.second);
         // Main is abstracted using an iterative encoding except for the case
-        // where OnlyRecursive is enabled
+        // where the recursive encoding has been selected for it
         auto onlyRecursiveMain =
             funPair == smtOpts.MainFunctions &&
-            smtOpts.OnlyRecursive == FunctionEncoding::OnlyRecursive;
+            smtOpts.MainEncoding == FunctionEncoding::OnlyRecursive;
         if (!hasMutualFixedAbstraction(funPair) &&
             (onlyRecursiveMain || isCalledFromMain)) {
             if (funPair.first->getName() == "__criterion") {
-                auto newSmtExprs = slicingAssertion(funPair, analysisResults);
-                assertions.insert(assertions.end(), newSmtExprs.begin(),
-                                  newSmtExprs.end());
+                generators.push_back([&analysisResults, funPair](
+                    auto &assertions, auto & /* unused */) {
+                    auto newSmtExprs =
+                        slicingAssertion(funPair, analysisResults);
+                    assertions.insert(assertions.end(), newSmtExprs.begin(),
+                                      newSmtExprs.end());
+                });
             } else {
-                generateRelationalFunctionSMT(funPair, analysisResults,
-                                              assertions, declarations);
+                generators.push_back([&analysisResults, funPair](
+                    auto &assertions, auto &declarations) {
+                    generateRelationalFunctionSMT(funPair, analysisResults,
+                                                  assertions, declarations);
+                });
             }
         }
     }
-    generateFunctionalAbstractions(modules.first, smtOpts.MainFunctions.first,
-                                   analysisResults, Program::First, assertions,
-                                   declarations);
-    generateFunctionalAbstractions(modules.second, smtOpts.MainFunctions.second,
-                                   analysisResults, Program::Second, assertions,
-                                   declarations);
+    makeMonoPair(&modules.first, &modules.second)
+        .indexedForEachProgram([&](const llvm::Module *module, Program prog) {
+            const llvm::Function *mainFunction =
+                prog == Program::First ? smtOpts.MainFunctions.first
+                                       : smtOpts.MainFunctions.second;
+            for (auto &fun : *module) {
+                if (needsFunctionalAbstraction(fun, *mainFunction)) {
+                    generators.push_back([&analysisResults, &fun, prog](
+                        auto &assertions, auto &declarations) {
+                        generateFunctionalFunctionSMT(&fun, analysisResults,
+                                                      prog, assertions,
+                                                      declarations);
+                    });
+                }
+            }
+        });
+
+    vector<vector<SharedSMTRef>> generatedAssertions(generators.size());
+    vector<vector<SharedSMTRef>> generatedDeclarations(generators.size());
+    vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < generators.size(); ++i) {
+        tasks.push_back([&, i] {
+            HashConsFactory factory;
+            HashConsScope scope(factory);
+            generators[i](generatedAssertions[i], generatedDeclarations[i]);
+        });
+    }
+    runInParallel(tasks, smtOpts.Jobs);
+    for (size_t i = 0; i < generators.size(); ++i) {
+        assertions.insert(assertions.end(), generatedAssertions[i].begin(),
+                          generatedAssertions[i].end());
+        declarations.insert(declarations.end(),
+                            generatedDeclarations[i].begin(),
+                            generatedDeclarations[i].end());
+    }
 
     smtExprs.insert(smtExprs.end(), declarations.begin(), declarations.end());
     if (SMTGenerationOpts::getInstance().Invert) {
@@ -124,20 +178,61 @@ vector<SharedSMTRef> generateSMT(MonoPair<const llvm::Module &> modules,
     return smtExprs;
 }
 
+vector<SharedSMTRef> generateSMT(MonoPair<const llvm::Module &> modules,
+                                 const AnalysisResultsMap &analysisResults,
+                                 FileOptions fileOpts,
+                                 SMTGenerationOpts &smtOpts) {
+    SMTGenerationOpts::Scope optsScope(smtOpts);
+    return generateSMT(modules, analysisResults, fileOpts);
+}
+
 void generateSMTForMainFunctions(MonoPair<const llvm::Module &> modules,
                                  const AnalysisResultsMap &analysisResults,
                                  FileOptions fileOpts,
                                  std::vector<smt::SharedSMTRef> &assertions,
                                  std::vector<smt::SharedSMTRef> &declarations) {
-    const auto &smtOpts = SMTGenerationOpts::getInstance();
+    auto &smtOpts = SMTGenerationOpts::getInstance();
+    smtOpts.MainEncoding = smtOpts.OnlyRecursive;
+    if (smtOpts.OnlyRecursive == FunctionEncoding::Automatic) {
+        smtOpts.MainEncoding =
+            chooseFunctionEncoding(smtOpts.MainFunctions, analysisResults);
+    }
+    stats::count(smtOpts.MainEncoding == FunctionEncoding::OnlyRecursive
+                     ? "encoding.recursive"
+                     : "encoding.iterative");
+    smtOpts.EqualVariables.clear();
+    if (smtOpts.ReduceInvariantArguments && !smtOpts.Invert) {
+        // The arguments are only known to be equal if IN_INV requires it
+        const bool equalArguments =
+            !smtOpts.InitPredicate &&
+            (fileOpts.InRelation == nullptr || fileOpts.AdditionalInRelation);
+        smtOpts.EqualVariables =
+            findEqualVariables(smtOpts.MainFunctions, equalArguments);
+        stats::count("invariants.equal variables",
+                     smtOpts.EqualVariables.size());
+    }
+    // The values of constant arrays are defined once and only the cells that
+    // are loaded are constrained
+    vector<SharedSMTRef> constantArrays;
+    if (smtOpts.GlobalConstants == GlobalConstantsOpt::Enabled &&
+        smtOpts.Heap == HeapOpt::Enabled) {
+        constantArrays =
+            constantArrayDefinitions(modules.first, Program::First);
+        auto constantArrays2 =
+            constantArrayDefinitions(modules.second, Program::Second);
+        constantArrays.insert(constantArrays.end(), constantArrays2.begin(),
+                              constantArrays2.end());
+        declarations.insert(declarations.end(), constantArrays.begin(),
+                            constantArrays.end());
+    }
     std::shared_ptr<FunDef> inInv =
         inInvariant(smtOpts.MainFunctions, analysisResults, fileOpts.InRelation,
-                    modules.first, modules.second,
-                    smtOpts.GlobalConstants == GlobalConstantsOpt::Enabled,
-                    fileOpts.AdditionalInRelation);
+                    constantArrays, fileOpts.AdditionalInRelation);
     declarations.push_back(inInv);
+    // outInvariant sorts its own copy of the arguments
     declarations.push_back(outInvariant(
-        getFunctionArguments(smtOpts.MainFunctions, analysisResults),
+        MonoPair<vector<smt::SortedVar>>(
+            getFunctionArguments(smtOpts.MainFunctions, analysisResults)),
         fileOpts.OutRelation, smtOpts.MainFunctions.first->getReturnType()));
     if (smtOpts.InitPredicate) {
         declarations.push_back(initPredicate(*inInv));
@@ -148,14 +243,19 @@ void generateSMTForMainFunctions(MonoPair<const llvm::Module &> modules,
                                    assertions, declarations);
 }
 
+bool needsFunctionalAbstraction(const llvm::Function &fun,
+                                const llvm::Function &mainFunction) {
+    return !isLlreveIntrinsic(fun) && !hasFixedAbstraction(fun) &&
+           callsTransitively(mainFunction, fun);
+}
+
 void generateFunctionalAbstractions(
     const llvm::Module &module, const llvm::Function *mainFunction,
     const AnalysisResultsMap &analysisResults, Program prog,
     std::vector<smt::SharedSMTRef> &assertions,
     std::vector<smt::SharedSMTRef> &declarations) {
     for (auto &fun : module) {
-        if (!isLlreveIntrinsic(fun) && !hasFixedAbstraction(fun) &&
-            callsTransitively(*mainFunction, fun)) {
+        if (needsFunctionalAbstraction(fun, *mainFunction)) {
             generateFunctionalFunctionSMT(&fun, analysisResults, prog,
                                           assertions, declarations);
         }
@@ -255,40 +355,142 @@ std::vector<SharedSMTRef> globalDeclarations(const llvm::Module &mod1,
     return declarations;
 }
 
-vector<SharedSMTRef> stringConstants(const llvm::Module &mod, string memory) {
-    vector<SharedSMTRef> stringConstants;
-    for (const auto &global : mod.globals()) {
-        const string globalName = global.getName();
-        vector<SharedSMTRef> stringConstant;
-        if (global.hasInitializer() && global.isConstant()) {
-            if (const auto arr = llvm::dyn_cast<llvm::ConstantDataArray>(
-                    global.getInitializer())) {
-                for (unsigned int i = 0; i < arr->getNumElements(); ++i) {
-                    stringConstant.push_back(
-                        makeOp("=", std::to_string(arr->getElementAsInteger(i)),
-                               makeOp("select", makeOp("+", globalName,
-                                                       std::to_string(i)))));
+// Adds the offsets of the cells loaded from 'pointer', which points 'offset'
+// cells after the start of a constant global. Returns false if the pointer is
+// used in any other way, e.g. passed to a function or indexed by a variable,
+// so the accessed cells are not known.
+static bool collectConstantReads(const llvm::Value *pointer, int offset,
+                                 const llvm::DataLayout &layout,
+                                 set<int> &reads) {
+    for (const auto user : pointer->users()) {
+        if (llvm::isa<llvm::LoadInst>(user)) {
+            reads.insert(offset);
+        } else if (const auto gep = llvm::dyn_cast<llvm::GEPOperator>(user)) {
+            if (gep->getPointerOperand() != pointer) {
+                return false;
+            }
+            // The same offsets as resolveGEP
+            int gepOffset = offset;
+            vector<llvm::Value *> indices;
+            for (auto ix = gep->idx_begin(), e = gep->idx_end(); ix != e;
+                 ++ix) {
+                const auto constIx = llvm::dyn_cast<llvm::ConstantInt>(*ix);
+                if (!constIx) {
+                    return false;
                 }
+                indices.push_back(ix->get());
+                const auto indexedType =
+                    llvm::GetElementPtrInst::getIndexedType(
+                        gep->getSourceElementType(), indices);
+                gepOffset += typeSize(indexedType, layout) *
+                             static_cast<int>(constIx->getSExtValue());
             }
+            if (!collectConstantReads(gep, gepOffset, layout, reads)) {
+                return false;
+            }
+        } else if (const auto cast =
+                       llvm::dyn_cast<llvm::BitCastOperator>(user)) {
+            if (!collectConstantReads(cast, offset, layout, reads)) {
+                return false;
+            }
+        } else {
+            return false;
         }
-        if (!stringConstant.empty()) {
-            stringConstants.push_back(make_unique<Op>("and", stringConstant));
+    }
+    return true;
+}
+
+static auto constantName(const llvm::GlobalVariable &global) -> string {
+    return "CONST_" + global.getName().str();
+}
+
+// The constant integer arrays whose values are known to the invariants
+static auto constantArrays(const llvm::Module &mod)
+    -> vector<const llvm::GlobalVariable *> {
+    vector<const llvm::GlobalVariable *> arrays;
+    for (const auto &global : mod.globals()) {
+        if (!global.hasInitializer() || !global.isConstant()) {
+            continue;
+        }
+        const auto arr =
+            llvm::dyn_cast<llvm::ConstantDataArray>(global.getInitializer());
+        if (arr && arr->getElementType()->isIntegerTy()) {
+            arrays.push_back(&global);
+        }
+    }
+    return arrays;
+}
+
+vector<SharedSMTRef> constantArrayDefinitions(const llvm::Module &mod,
+                                              Program prog) {
+    vector<SharedSMTRef> definitions;
+    const auto &layout = mod.getDataLayout();
+    for (const auto global : constantArrays(mod)) {
+        const auto arr =
+            llvm::cast<llvm::ConstantDataArray>(global->getInitializer());
+        const int elementSize = typeSize(arr->getElementType(), layout);
+        set<int> reads;
+        if (!collectConstantReads(global, 0, layout, reads)) {
+            reads.clear();
+            for (unsigned i = 0; i < arr->getNumElements(); ++i) {
+                reads.insert(static_cast<int>(i) * elementSize);
+            }
+        }
+        const string heap = heapName(prog, heapRegion(global));
+        vector<SharedSMTRef> values;
+        for (const int offset : reads) {
+            // Loads of parts of an element or outside of the array are not
+            // constrained
+            if (offset < 0 || offset % elementSize != 0 ||
+                static_cast<unsigned>(offset / elementSize) >=
+                    arr->getNumElements()) {
+                continue;
+            }
+            const auto value = llvm::cast<llvm::ConstantInt>(
+                arr->getElementAsConstant(
+                    static_cast<unsigned>(offset / elementSize)));
+            values.push_back(makeOp(
+                "=", make_unique<ConstantInt>(value->getValue()),
+                makeOp("select", memoryVariable(heap),
+                       makeOp("+", global->getName().str(),
+                              make_unique<ConstantInt>(
+                                  llvm::APInt(64, offset))))));
         }
+        stats::count("constant array cells", values.size());
+        if (values.empty()) {
+            continue;
+        }
+        SharedSMTRef body = values.front();
+        if (values.size() > 1) {
+            body = make_unique<Op>("and", std::move(values));
+        }
+        definitions.push_back(make_unique<FunDef>(
+            constantName(*global), vector<SortedVar>{{heap, memoryType()}},
+            boolType(), std::move(body)));
+    }
+    return definitions;
+}
+
+vector<SharedSMTRef>
+stringConstants(const vector<SharedSMTRef> &constantArrayDefinitions) {
+    vector<SharedSMTRef> stringConstants;
+    for (const auto &definition : constantArrayDefinitions) {
+        const auto &funDef = static_cast<const FunDef &>(*definition);
+        stringConstants.push_back(
+            makeOp(funDef.funName, funDef.args.front().name));
     }
     return stringConstants;
 }
 
 std::unique_ptr<FunDef> inInvariant(MonoPair<const llvm::Function *> funs,
                                     const AnalysisResultsMap &analysisResults,
-                                    SharedSMTRef body, const llvm::Module &mod1,
-                                    const llvm::Module &mod2, bool strings,
+                                    SharedSMTRef body,
+                                    const vector<SharedSMTRef> &constantArrays,
                                     bool additionalIn) {
-    MonoPair<std::vector<smt::SortedVar>> functionArgumentsPair =
-        getFunctionArguments(funs, analysisResults);
-    functionArgumentsPair.first =
-        addMemoryArrays(functionArgumentsPair.first, Program::First);
-    functionArgumentsPair.second =
-        addMemoryArrays(functionArgumentsPair.second, Program::Second);
+    const auto functionArguments = getFunctionArguments(funs, analysisResults);
+    const MonoPair<std::vector<smt::SortedVar>> functionArgumentsPair = {
+        addMemoryArrays(functionArguments.first, Program::First),
+        addMemoryArrays(functionArguments.second, Program::Second)};
 
     vector<SortedVar> funArgs;
     funArgs.insert(funArgs.end(), functionArgumentsPair.first.begin(),
@@ -319,18 +521,11 @@ std::unique_ptr<FunDef> inInvariant(MonoPair<const llvm::Function *> funs,
         }
         body = make_unique<Op>("and", equalInputs);
     }
-    if (strings) {
+    if (!constantArrays.empty()) {
         // Add values of static arrays, strings and similar things
         vector<SharedSMTRef> smtArgs = {body};
-        auto stringConstants1 = stringConstants(mod1, heapName(Program::First));
-        auto stringConstants2 =
-            stringConstants(mod2, heapName(Program::Second));
-        if (!stringConstants1.empty()) {
-            smtArgs.push_back(make_unique<Op>("and", stringConstants1));
-        }
-        if (!stringConstants2.empty()) {
-            smtArgs.push_back(make_unique<Op>("and", stringConstants2));
-        }
+        auto constants = stringConstants(constantArrays);
+        smtArgs.insert(smtArgs.end(), constants.begin(), constants.end());
         body = make_unique<Op>("and", smtArgs);
     }
 
@@ -350,23 +545,32 @@ outInvariant(MonoPair<vector<smt::SortedVar>> functionArgs, SharedSMTRef body,
                        functionArgs.first.end());
     }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        funArgs.push_back({heapName(Program::First), memoryType()});
+        for (const auto &heap : heapNames(Program::First)) {
+            funArgs.push_back({heap, memoryType()});
+        }
     }
     if (SMTGenerationOpts::getInstance().PassInputThrough) {
         funArgs.insert(funArgs.end(), functionArgs.second.begin(),
                        functionArgs.second.end());
     }
     if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-        funArgs.push_back({heapName(Program::Second), memoryType()});
+        for (const auto &heap : heapNames(Program::Second)) {
+            funArgs.push_back({heap, memoryType()});
+        }
     }
     if (body == nullptr) {
         body = makeOp("=", resultName(Program::First),
                       resultName(Program::Second));
         if (SMTGenerationOpts::getInstance().Heap == HeapOpt::Enabled) {
-            body = makeOp(
-                "and", body,
-                makeOp("=", smt::memoryVariable(heapName(Program::First)),
-                       smt::memoryVariable(heapName(Program::Second))));
+            // The heaps are equal iff all of their regions are equal
+            const auto heaps = makeMonoPair(heapNames(Program::First),
+                                            heapNames(Program::Second));
+            for (size_t i = 0; i < heaps.first.size(); ++i) {
+                body = makeOp(
+                    "and", body,
+                    makeOp("=", smt::memoryVariable(heaps.first[i]),
+                           smt::memoryVariable(heaps.second[i])));
+            }
         }
     }
 
@@ -11,6 +11,7 @@
 #include "Opts.h"
 #include "Helper.h"
 #include "SMT.h"
+#include "SMTReader.h"
 
 #include <fstream>
 #include <regex>
@@ -28,6 +29,23 @@ namespace opts {
 llreve::cl::OptionCategory ReveCategory("Reve options",
                                         "Options for controlling reve.");
 
+static thread_local SMTGenerationOpts *currentSMTGenerationOpts = nullptr;
+
+SMTGenerationOpts &SMTGenerationOpts::getInstance() {
+    if (currentSMTGenerationOpts) {
+        return *currentSMTGenerationOpts;
+    }
+    static SMTGenerationOpts instance;
+    return instance;
+}
+
+SMTGenerationOpts::Scope::Scope(SMTGenerationOpts &opts)
+    : previous(currentSMTGenerationOpts) {
+    currentSMTGenerationOpts = &opts;
+}
+
+SMTGenerationOpts::Scope::~Scope() { currentSMTGenerationOpts = previous; }
+
 void SMTGenerationOpts::initialize(
     MonoPair<llvm::Function *> mainFunctions, enum HeapOpt heap,
     enum StackOpt stack, enum GlobalConstantsOpt globalConstants,
@@ -220,6 +238,20 @@ FileOptions getFileOptions(MonoPair<string> fileNames) {
                        additionalIn);
 }
 
+FileOptions getFileOptionsFromSources(MonoPair<string> sources) {
+    auto funConds1 = searchFunctionConditionsInFile(sources.first);
+    auto funConds2 = searchFunctionConditionsInFile(sources.second);
+    std::multimap<string, string> funConds;
+    std::merge(funConds1.begin(), funConds1.end(), funConds2.begin(),
+               funConds2.end(), std::inserter(funConds, std::end(funConds)));
+    SharedSMTRef in = nullptr;
+    SharedSMTRef out = nullptr;
+    bool additionalIn = false;
+    searchCustomRelationsInFile(sources.first, in, out, additionalIn);
+    searchCustomRelationsInFile(sources.second, in, out, additionalIn);
+    return FileOptions(funConds, in, out, additionalIn);
+}
+
 set<MonoPair<string>>
 parseFunctionPairFlags(llreve::cl::list<string> &functionPairFlags) {
     set<MonoPair<string>> functionPairs;
@@ -12,12 +12,13 @@
 
 #include "Helper.h"
 #include "InferMarks.h"
+#include "Statistics.h"
 
 #include <iostream>
 
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
 
-using std::make_shared;
 using std::unique_ptr;
 using smt::Op;
 using smt::stringExpr;
@@ -26,6 +27,7 @@ using smt::SharedSMTRef;
 using smt::SMTRef;
 using smt::SMTExpr;
 using smt::ConstantInt;
+using llreve::opts::SMTGenerationOpts;
 
 llvm::AnalysisKey PathAnalysis::Key;
 
@@ -36,6 +38,7 @@ PathMap PathAnalysis::run(llvm::Function &fun,
         return pathMap;
     }
     firstRun = false;
+    stats::ScopedTimer timer("preprocess.paths");
     if (InferMarks) {
         auto markedBlocks = am.getResult<InferMarksAnalysis>(fun);
         pathMap = findPaths(markedBlocks);
@@ -43,38 +46,84 @@ PathMap PathAnalysis::run(llvm::Function &fun,
         auto markedBlocks = am.getResult<MarkAnalysis>(fun);
         pathMap = findPaths(markedBlocks);
     }
+    if (stats::enabled()) {
+        for (const auto &pathsFrom : pathMap) {
+            uint64_t pathCount = 0;
+            for (const auto &pathsTo : pathsFrom.second) {
+                pathCount += pathsTo.second.size();
+            }
+            stats::count("paths", pathCount);
+            stats::maximum("paths.max per mark", pathCount);
+            stats::count("paths." + fun.getName().str() + "." +
+                             pathsFrom.first.toString(),
+                         pathCount);
+        }
+    }
     return pathMap;
 }
 
-PathMap findPaths(BidirBlockMarkMap markedBlocks) {
-    PathMap MyPaths;
-    for (auto BBTuple : markedBlocks.MarkToBlocksMap) {
-        // don't start at return instructäions
-        if (BBTuple.first != EXIT_MARK && BBTuple.first != UNREACHABLE_MARK) {
-            for (auto BB : BBTuple.second) {
-                const std::map<Mark, Paths> NewPaths =
-                    findPathsStartingAt(BBTuple.first, BB, markedBlocks);
-                for (auto NewPathTuple : NewPaths) {
-                    MyPaths[BBTuple.first][NewPathTuple.first].insert(
-                        MyPaths[BBTuple.first][NewPathTuple.first].end(),
-                        NewPathTuple.second.begin(), NewPathTuple.second.end());
-                }
-            }
+static void addPathsStartingAt(PathMap &MyPaths, Mark For,
+                               const std::set<llvm::BasicBlock *> &Blocks,
+                               const BidirBlockMarkMap &markedBlocks,
+                               SuffixMap &Suffixes) {
+    // don't start at return instructäions
+    if (For == EXIT_MARK || For == UNREACHABLE_MARK) {
+        return;
+    }
+    for (auto BB : Blocks) {
+        MarkMap<Paths> NewPaths = findPathsStartingAt(
+            For, BB, markedBlocks, Suffixes, MyPaths.conditions());
+        for (auto &NewPathTuple : NewPaths) {
+            auto &Target = MyPaths[For][NewPathTuple.first];
+            Target.insert(Target.end(),
+                          std::make_move_iterator(NewPathTuple.second.begin()),
+                          std::make_move_iterator(NewPathTuple.second.end()));
         }
     }
+}
+
+PathMap findPaths(const BidirBlockMarkMap &markedBlocks) {
+    PathMap MyPaths;
+    // Suffixes are independent of the block at which a path started so they
+    // can be shared by all start blocks
+    SuffixMap Suffixes;
+    for (const auto &BBTuple : markedBlocks.MarkToBlocksMap) {
+        addPathsStartingAt(MyPaths, BBTuple.first, BBTuple.second,
+                           markedBlocks, Suffixes);
+    }
     return MyPaths;
 }
 
-std::map<Mark, Paths> findPathsStartingAt(Mark For, llvm::BasicBlock *BB,
-                                          BidirBlockMarkMap BidirBlockMarkMap) {
-    std::map<Mark, Paths> FoundPaths;
-    const auto MyPaths = traverse(BB, BidirBlockMarkMap, true, {});
+void updatePaths(PathMap &pathMap, const BidirBlockMarkMap &markedBlocks,
+                 const std::set<Mark> &marks) {
+    // The suffixes of the old paths may go through changed blocks so they
+    // can’t be reused, neither can their conditions
+    SuffixMap Suffixes;
+    pathMap.conditions().startGeneration();
+    for (Mark mark : marks) {
+        pathMap.erase(mark);
+        auto blocksIt = markedBlocks.MarkToBlocksMap.find(mark);
+        if (blocksIt != markedBlocks.MarkToBlocksMap.end()) {
+            addPathsStartingAt(pathMap, mark, blocksIt->second, markedBlocks,
+                               Suffixes);
+        }
+    }
+}
+
+MarkMap<Paths> findPathsStartingAt(Mark For, llvm::BasicBlock *BB,
+                                   const BidirBlockMarkMap &MarkedBlocks,
+                                   SuffixMap &Suffixes,
+                                   ConditionTable &Conditions) {
+    MarkMap<Paths> FoundPaths;
+    std::set<const llvm::BasicBlock *> Visited;
+    auto MyPaths =
+        traverse(BB, MarkedBlocks, true, Visited, Suffixes, Conditions);
     for (auto &PathIt : MyPaths) {
         set<Mark> Indices;
         if (PathIt.empty()) {
             Indices.insert(EXIT_MARK);
         } else {
-            Indices = BidirBlockMarkMap.BlockToMarksMap.at(PathIt.back().Block);
+            Indices = MarkedBlocks.BlockToMarksMap.at(PathIt.back().Block);
         }
         for (auto Index : Indices) {
             // don't allow paths to the same node but with a different mark
@@ -87,9 +136,32 @@ std::map<Mark, Paths> findPathsStartingAt(Mark For, llvm::BasicBlock *BB,
     return FoundPaths;
 }
 
-Paths_ traverse(llvm::BasicBlock *BB, BidirBlockMarkMap MarkedBlocks,
-                bool First, std::set<const llvm::BasicBlock *> Visited) {
-    std::set<std::string> Constructed;
+/// Add the paths that start with the edge to Succ followed by one of the paths
+/// starting at Succ
+static void appendPathsThrough(Paths_ &Result, Edge Edge_,
+                               const BidirBlockMarkMap &MarkedBlocks,
+                               std::set<const llvm::BasicBlock *> &Visited,
+                               SuffixMap &Suffixes,
+                               ConditionTable &Conditions) {
+    auto Succ = Edge_.Block;
+    auto SuffixIt = Suffixes.find(Succ);
+    if (SuffixIt == Suffixes.end()) {
+        auto SuccPaths = traverse(Succ, MarkedBlocks, false, Visited,
+                                  Suffixes, Conditions);
+        SuffixIt = Suffixes.insert({Succ, std::move(SuccPaths)}).first;
+    }
+    for (const auto &Suffix : SuffixIt->second) {
+        Path_ P;
+        P.reserve(Suffix.size() + 1);
+        P.push_back(Edge_);
+        P.insert(P.end(), Suffix.begin(), Suffix.end());
+        Result.push_back(std::move(P));
+    }
+}
+
+Paths_ traverse(llvm::BasicBlock *BB, const BidirBlockMarkMap &MarkedBlocks,
+                bool First, std::set<const llvm::BasicBlock *> &Visited,
+                SuffixMap &Suffixes, ConditionTable &Conditions) {
     if ((!First && isMarked(*BB, MarkedBlocks)) ||
         isReturn(*BB, MarkedBlocks)) {
         Paths_ MyPaths;
@@ -100,69 +172,41 @@ Paths_ traverse(llvm::BasicBlock *BB, BidirBlockMarkMap MarkedBlocks,
         logErrorData("Found cycle at block:\n", *BB);
         exit(1);
     }
+    // Visited only contains the blocks on the current path, so we remove BB
+    // again once all paths through it have been found
     Visited.insert(BB);
+    Paths_ TraversedPaths;
     auto TermInst = BB->getTerminator();
     if (auto BranchInst = llvm::dyn_cast<llvm::BranchInst>(TermInst)) {
-        if (BranchInst->isUnconditional()) {
-            auto TraversedPaths = traverse(BranchInst->getSuccessor(0),
-                                           MarkedBlocks, false, Visited);
-            for (auto &P : TraversedPaths) {
-                P.insert(P.begin(), Edge(nullptr, BranchInst->getSuccessor(0)));
-            }
-            return TraversedPaths;
+        for (unsigned i = 0; i < BranchInst->getNumSuccessors(); ++i) {
+            appendPathsThrough(
+                TraversedPaths,
+                Edge(Conditions.successorCondition(BranchInst, i),
+                     BranchInst->getSuccessor(i)),
+                MarkedBlocks, Visited, Suffixes, Conditions);
         }
-        auto TraversedPaths0 =
-            traverse(BranchInst->getSuccessor(0), MarkedBlocks, false, Visited);
-        auto TraversedPaths1 =
-            traverse(BranchInst->getSuccessor(1), MarkedBlocks, false, Visited);
-        for (auto &P : TraversedPaths0) {
-            P.insert(P.begin(), Edge(make_shared<BooleanCondition>(
-                                         BranchInst->getCondition(), true),
-                                     BranchInst->getSuccessor(0)));
-        }
-        for (auto &P : TraversedPaths1) {
-            P.insert(P.begin(), Edge(make_shared<BooleanCondition>(
-                                         BranchInst->getCondition(), false),
-                                     BranchInst->getSuccessor(1)));
-        }
-        TraversedPaths0.insert(TraversedPaths0.end(), TraversedPaths1.begin(),
-                               TraversedPaths1.end());
-        return TraversedPaths0;
-    }
-    if (auto SwitchInst = llvm::dyn_cast<llvm::SwitchInst>(TermInst)) {
-        Paths_ TraversedPaths;
-        std::vector<llvm::APInt> Vals;
+    } else if (auto SwitchInst = llvm::dyn_cast<llvm::SwitchInst>(TermInst)) {
         for (auto Case : SwitchInst->cases()) {
-            Vals.push_back(Case.getCaseValue()->getValue());
-            auto TraversedPaths_ =
-                traverse(Case.getCaseSuccessor(), MarkedBlocks, false, Visited);
-            for (auto &P : TraversedPaths_) {
-                P.insert(P.begin(), Edge(make_shared<SwitchCondition>(
-                                             SwitchInst->getCondition(),
-                                             Case.getCaseValue()->getValue()),
-                                         Case.getCaseSuccessor()));
-            }
-            TraversedPaths.insert(TraversedPaths.end(), TraversedPaths_.begin(),
-                                  TraversedPaths_.end());
+            appendPathsThrough(
+                TraversedPaths,
+                Edge(Conditions.successorCondition(SwitchInst,
+                                                   Case.getSuccessorIndex()),
+                     Case.getCaseSuccessor()),
+                MarkedBlocks, Visited, Suffixes, Conditions);
         }
         // Handle default case separately
-        auto TraversedPaths_ = traverse(SwitchInst->getDefaultDest(),
-                                        MarkedBlocks, false, Visited);
-        for (auto &P : TraversedPaths_) {
-            P.insert(P.begin(), Edge(make_shared<SwitchDefault>(
-                                         SwitchInst->getCondition(), Vals),
-                                     SwitchInst->getDefaultDest()));
-        }
-        TraversedPaths.insert(TraversedPaths.end(), TraversedPaths_.begin(),
-                              TraversedPaths_.end());
-
-        return TraversedPaths;
+        appendPathsThrough(TraversedPaths,
+                           Edge(Conditions.successorCondition(SwitchInst, 0),
+                                SwitchInst->getDefaultDest()),
+                           MarkedBlocks, Visited, Suffixes, Conditions);
+    } else {
+        logWarningData("Unknown terminator\n", *TermInst);
     }
-    logWarningData("Unknown terminator\n", *TermInst);
-    return Paths_();
+    Visited.erase(BB);
+    return TraversedPaths;
 }
 
-bool isMarked(llvm::BasicBlock &BB, BidirBlockMarkMap MarkedBlocks) {
+bool isMarked(llvm::BasicBlock &BB, const BidirBlockMarkMap &MarkedBlocks) {
     const auto Marks = MarkedBlocks.BlockToMarksMap.find(&BB);
     if (Marks != MarkedBlocks.BlockToMarksMap.end()) {
         return !(Marks->second.empty());
@@ -170,7 +214,7 @@ bool isMarked(llvm::BasicBlock &BB, BidirBlockMarkMap MarkedBlocks) {
     return false;
 }
 
-bool isReturn(llvm::BasicBlock &BB, BidirBlockMarkMap MarkedBlocks) {
+bool isReturn(llvm::BasicBlock &BB, const BidirBlockMarkMap &MarkedBlocks) {
     const auto Marks = MarkedBlocks.BlockToMarksMap.find(&BB);
     if (Marks != MarkedBlocks.BlockToMarksMap.end()) {
         return Marks->second.find(EXIT_MARK) != Marks->second.end() ||
@@ -179,15 +223,91 @@ bool isReturn(llvm::BasicBlock &BB, BidirBlockMarkMap MarkedBlocks) {
     return false;
 }
 
-llvm::BasicBlock *lastBlock(Path Path) {
-    if (Path.Edges.empty()) {
-        return Path.Start;
+llvm::BasicBlock *lastBlock(const Path &path) {
+    if (path.Edges.empty()) {
+        return path.Start;
+    }
+    return path.Edges.back().Block;
+}
+
+bool isFeasible(const Path &path) {
+    ValueRanges ranges;
+    for (const auto &edge : path.Edges) {
+        if (edge.Cond && !edge.Cond->restrict(ranges)) {
+            return false;
+        }
     }
-    return Path.Edges.back().Block;
+    return true;
+}
+
+// Without -bitvect integers are unbounded, so the ranges use one more bit
+// than the values: the constants of a condition never reach the bounds of the
+// wider range and the values beyond the bit width remain possible
+static llvm::APInt encodedValue(const llvm::APInt &value) {
+    if (SMTGenerationOpts::getInstance().BitVect) {
+        return value;
+    }
+    return value.sext(value.getBitWidth() + 1);
+}
+
+// Intersects the possible values of 'val' with 'range', returns false if no
+// value is left
+static bool restrictValue(ValueRanges &ranges, const llvm::Value *val,
+                          const llvm::ConstantRange &range) {
+    if (const auto constant = llvm::dyn_cast<llvm::ConstantInt>(val)) {
+        return range.contains(encodedValue(constant->getValue()));
+    }
+    if (!val->getType()->isIntegerTy()) {
+        return true;
+    }
+    auto it = ranges.find(val);
+    if (it == ranges.end()) {
+        ranges.insert({val, range});
+        return !range.isEmptySet();
+    }
+    // The result of the intersection can be larger than the actual
+    // intersection but never smaller
+    it->second = it->second.intersectWith(range);
+    return !it->second.isEmptySet();
 }
 
 Condition::~Condition() = default;
 
+const Condition *
+ConditionTable::successorCondition(const llvm::Instruction *term,
+                                   unsigned index) {
+    auto it = Interned.find({term, index});
+    if (it != Interned.end()) {
+        return it->second;
+    }
+    unique_ptr<Condition> cond;
+    if (const auto branch = llvm::dyn_cast<llvm::BranchInst>(term)) {
+        if (branch->isConditional()) {
+            cond = std::make_unique<BooleanCondition>(branch->getCondition(),
+                                                      index == 0);
+        }
+    } else if (const auto switchInst = llvm::dyn_cast<llvm::SwitchInst>(term)) {
+        // The default destination is the first successor
+        if (index == 0) {
+            cond = std::make_unique<SwitchDefault>(switchInst);
+        }
+        for (auto Case : switchInst->cases()) {
+            if (Case.getSuccessorIndex() == index) {
+                cond = std::make_unique<SwitchCondition>(
+                    switchInst->getCondition(),
+                    Case.getCaseValue()->getValue());
+                break;
+            }
+        }
+    }
+    const Condition *result = cond.get();
+    if (cond) {
+        Conditions.push_back(std::move(cond));
+    }
+    Interned.insert({{term, index}, result});
+    return result;
+}
+
 SMTRef BooleanCondition::toSmt() const {
     SMTRef result = instrNameOrVal(Cond);
     if (True) {
@@ -196,16 +316,64 @@ SMTRef BooleanCondition::toSmt() const {
     return makeOp("not", std::move(result));
 }
 
+bool BooleanCondition::restrict(ValueRanges &ranges) const {
+    const llvm::ConstantRange holds(encodedValue(llvm::APInt(1, True)));
+    if (!restrictValue(ranges, Cond, holds)) {
+        return false;
+    }
+    // Comparisons with a constant also restrict the compared value
+    const auto cmp = llvm::dyn_cast<llvm::ICmpInst>(Cond);
+    if (!cmp) {
+        return true;
+    }
+    auto pred = True ? cmp->getPredicate() : cmp->getInversePredicate();
+    const llvm::Value *var = cmp->getOperand(0);
+    auto constant = llvm::dyn_cast<llvm::ConstantInt>(cmp->getOperand(1));
+    if (!constant) {
+        var = cmp->getOperand(1);
+        constant = llvm::dyn_cast<llvm::ConstantInt>(cmp->getOperand(0));
+        pred = llvm::CmpInst::getSwappedPredicate(pred);
+    }
+    // Unsigned comparisons of integers compare the absolute values (see
+    // predicateFun)
+    if (!constant ||
+        (!SMTGenerationOpts::getInstance().BitVect &&
+         llvm::CmpInst::isUnsigned(pred))) {
+        return true;
+    }
+    return restrictValue(
+        ranges, var,
+        llvm::ConstantRange::makeAllowedICmpRegion(
+            pred, llvm::ConstantRange(encodedValue(constant->getValue()))));
+}
+
 SMTRef SwitchCondition::toSmt() const {
     return makeOp("=", instrNameOrVal(Cond),
                   std::make_unique<ConstantInt>(Val));
 }
 
+bool SwitchCondition::restrict(ValueRanges &ranges) const {
+    return restrictValue(ranges, Cond,
+                         llvm::ConstantRange(encodedValue(Val)));
+}
+
 SMTRef SwitchDefault::toSmt() const {
     std::vector<SharedSMTRef> StringVals;
-    for (auto Val : Vals) {
-        StringVals.push_back(std::make_unique<ConstantInt>(Val));
+    for (auto Case : Switch->cases()) {
+        StringVals.push_back(
+            std::make_unique<ConstantInt>(Case.getCaseValue()->getValue()));
     }
     StringVals.push_back(instrNameOrVal(Cond));
     return std::make_unique<Op>("distinct", StringVals);
 }
+
+bool SwitchDefault::restrict(ValueRanges &ranges) const {
+    for (auto Case : Switch->cases()) {
+        const llvm::ConstantRange caseRange(
+            encodedValue(Case.getCaseValue()->getValue()));
+        if (!restrictValue(ranges, Cond, caseRange.inverse())) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,159 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "PathRelations.h"
+
+#include "FunctionSMTGeneration.h"
+#include "Statistics.h"
+
+#include <algorithm>
+
+using std::make_unique;
+using std::string;
+using std::vector;
+
+using namespace smt;
+
+static thread_local PathRelations *currentPathRelations = nullptr;
+
+PathRelations::PathRelations(string funName)
+    : funName(std::move(funName)), previous(currentPathRelations) {
+    currentPathRelations = this;
+}
+
+PathRelations::~PathRelations() { currentPathRelations = previous; }
+
+PathRelations *PathRelations::current() { return currentPathRelations; }
+
+vector<SharedSMTRef> PathRelations::takeDefinitions() {
+    return std::move(definitions);
+}
+
+static auto varNames(const vector<SortedVar> &vars) -> vector<string> {
+    vector<string> names;
+    for (const auto &var : vars) {
+        names.push_back(var.name);
+    }
+    return names;
+}
+
+static auto hasCalls(llvm::ArrayRef<AssignmentCallBlock> blocks) -> bool {
+    return std::any_of(
+        blocks.begin(), blocks.end(), [](const AssignmentCallBlock &block) {
+            return std::any_of(block.definitions.begin(),
+                               block.definitions.end(),
+                               [](const DefOrCallInfo &def) {
+                                   return def.tag == DefOrCallInfoTag::Call;
+                               });
+        });
+}
+
+// Like addAssignments but the conditions are conjuncts instead of premises
+static auto relationBody(SharedSMTRef end,
+                         llvm::ArrayRef<AssignmentBlock> blocks)
+    -> SharedSMTRef {
+    SharedSMTRef body = std::move(end);
+    for (auto blockIt = blocks.rbegin(); blockIt != blocks.rend(); ++blockIt) {
+        body = fastNestLets(std::move(body), blockIt->definitions);
+        if (blockIt->condition) {
+            body = makeOp("and", blockIt->condition, std::move(body));
+        }
+    }
+    return body;
+}
+
+string PathRelations::relationName(const Path &path, Program prog,
+                                   Mark startMark, Mark endMark,
+                                   const vector<SortedVar> &startVars,
+                                   const vector<SortedVar> &endVars) {
+    vector<std::pair<const Condition *, const llvm::BasicBlock *>> edges;
+    for (const auto &edge : path.Edges) {
+        edges.push_back({edge.Cond, edge.Block});
+    }
+    const Key key{prog, path.Start, std::move(edges), varNames(startVars),
+                  varNames(endVars)};
+    auto it = names.find(key);
+    if (it != names.end()) {
+        return it->second;
+    }
+
+    auto assignments = assignmentsOnPath(path, prog, startVars, false);
+    if (hasCalls(assignments)) {
+        names.insert({key, ""});
+        return "";
+    }
+    const string name = "PATH_" + funName + "_" +
+                        std::to_string(programIndex(prog)) + "_" +
+                        startMark.toString() + "_" + endMark.toString() + "_" +
+                        std::to_string(definitions.size());
+    vector<SortedVar> args;
+    for (const auto &var : startVars) {
+        args.push_back(SortedVar(var.name + "_old", var.type));
+    }
+    vector<SharedSMTRef> endEqualities;
+    for (const auto &var : endVars) {
+        args.push_back(SortedVar(var.name + "_new", var.type));
+        endEqualities.push_back(
+            makeOp("=", make_unique<TypedVariable>(var.name + "_new", var.type),
+                   typedVariableFromSortedVar(var)));
+    }
+    SharedSMTRef end = make_unique<ConstantBool>(true);
+    if (!endEqualities.empty()) {
+        end = make_unique<Op>("and", std::move(endEqualities));
+    }
+    const auto blocks = splitAssignmentsFromCalls(assignments).assignments;
+    definitions.push_back(
+        make_unique<FunDef>(name, std::move(args), boolType(),
+                            relationBody(std::move(end), blocks.front())));
+    stats::count("path relations");
+    names.insert({key, name});
+    return name;
+}
+
+SharedSMTRef pathRelation(const Path &path, Program prog, Mark startMark,
+                          Mark endMark, const vector<SortedVar> &startVars,
+                          const vector<SortedVar> &endVars) {
+    PathRelations *relations = PathRelations::current();
+    if (!relations || endMark == EXIT_MARK || endMark == UNREACHABLE_MARK) {
+        return nullptr;
+    }
+    auto isArrayVar = [](const SortedVar &var) { return isArray(var.type); };
+    if (std::any_of(startVars.begin(), startVars.end(), isArrayVar) ||
+        std::any_of(endVars.begin(), endVars.end(), isArrayVar)) {
+        return nullptr;
+    }
+    const string name = relations->relationName(path, prog, startMark,
+                                                 endMark, startVars, endVars);
+    if (name.empty()) {
+        return nullptr;
+    }
+    vector<SharedSMTRef> args;
+    for (const auto &var : startVars) {
+        args.push_back(make_unique<TypedVariable>(var.name + "_old", var.type));
+    }
+    for (const auto &var : endVars) {
+        args.push_back(typedVariableFromSortedVar(var));
+    }
+    return make_unique<Op>(name, std::move(args));
+}
+
+SharedSMTRef assumePathRelations(vector<SharedSMTRef> relations,
+                                 const vector<SortedVar> &endVars,
+                                 SharedSMTRef clause) {
+    SharedSMTRef premise = relations.front();
+    if (relations.size() > 1) {
+        premise = make_unique<Op>("and", std::move(relations));
+    }
+    clause = makeOp("=>", premise, std::move(clause));
+    if (endVars.empty()) {
+        return clause;
+    }
+    return make_unique<Forall>(endVars, std::move(clause));
+}
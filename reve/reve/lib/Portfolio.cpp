@@ -0,0 +1,340 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Portfolio.h"
+
+#include "GzipStream.h"
+#include "Logging.h"
+#include "SolverStatistics.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::vector;
+
+using Clock = std::chrono::steady_clock;
+
+auto defaultPortfolio(unsigned eldaricaTimeout, unsigned spacerTimeout,
+                      unsigned dualityTimeout) -> vector<SolverEngine> {
+    return {{findSolverBackend("eldarica"), eldaricaTimeout},
+            {findSolverBackend("spacer"), spacerTimeout},
+            {findSolverBackend("duality"), dualityTimeout}};
+}
+
+auto portfolioFormat(const vector<SolverEngine> &engines) -> BackendFormat {
+    for (const auto &engine : engines) {
+        if (engine.Backend->format() == BackendFormat::ChcComp) {
+            return BackendFormat::ChcComp;
+        }
+    }
+    return BackendFormat::SMTHorn;
+}
+
+#ifdef _WIN32
+auto runPortfolio(const vector<SolverEngine> & /* unused */,
+                  const string & /* unused */) -> PortfolioResult {
+    logError("The solver portfolio is not supported on Windows\n");
+    exit(1);
+}
+#else
+namespace {
+struct RunningEngine {
+    const SolverEngine *Engine;
+    pid_t Pid;
+    // -1 once the engine has finished
+    int OutputFd;
+    Clock::time_point Deadline;
+    // Output that has not yet been split into lines
+    string Pending;
+    // The lines consumed so far, only kept while statistics are recorded
+    string Log;
+};
+}
+
+auto closeOnExecPipe(int fds[2]) -> bool {
+#ifdef __APPLE__
+    // There is no pipe2, so another thread can fork before the flags are set
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#else
+    // The flags are set atomically, pipe followed by fcntl would leak the
+    // ends into a process forked in between
+    return pipe2(fds, O_CLOEXEC) == 0;
+#endif
+}
+
+static auto startEngine(const SolverEngine &engine, const string &smtFileName)
+    -> RunningEngine {
+    // Only async-signal-safe functions may be called between fork and exec
+    // since other threads might be running, so the arguments are prepared
+    // beforehand
+    // The progress reported by the engine is attributed to the predicates by
+    // recordSolverLog
+    const string name = engine.Backend->name();
+    vector<string> command =
+        engine.Backend->launchCommand(smtFileName, stats::enabled());
+    vector<char *> argv;
+    for (const auto &arg : command) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    // Engines started in parallel must not inherit the pipe, otherwise the
+    // end of the output is only detected once they have exited as well
+    int fds[2];
+    if (!closeOnExecPipe(fds)) {
+        logError("Could not create pipe for " + name + "\n");
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        logError("Could not start " + name + "\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDERR_FILENO);
+            close(devNull);
+        }
+        execvp(argv.front(), argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    Clock::time_point deadline = Clock::time_point::max();
+    if (engine.Timeout > 0) {
+        deadline = Clock::now() + std::chrono::seconds(engine.Timeout);
+    }
+    return {&engine, pid, fds[0], deadline, "", ""};
+}
+
+static void stopEngine(RunningEngine &running, bool kill) {
+    if (running.OutputFd < 0) {
+        return;
+    }
+    if (kill) {
+        ::kill(running.Pid, SIGKILL);
+    }
+    close(running.OutputFd);
+    running.OutputFd = -1;
+    waitpid(running.Pid, nullptr, 0);
+}
+
+// Read until the engine exits or exceeds its time limit
+static void readRemainingOutput(RunningEngine &running) {
+    while (running.OutputFd >= 0) {
+        int timeout = -1;
+        if (running.Deadline != Clock::time_point::max()) {
+            auto remaining = running.Deadline - Clock::now();
+            if (remaining <= Clock::duration::zero()) {
+                return;
+            }
+            timeout = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    remaining)
+                    .count() +
+                1);
+        }
+        pollfd fd = {running.OutputFd, POLLIN, 0};
+        int ready = poll(&fd, 1, timeout);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return;
+        }
+        char buffer[4096];
+        ssize_t n = read(running.OutputFd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return;
+        }
+        running.Pending.append(buffer, static_cast<size_t>(n));
+    }
+}
+
+// Consume the complete lines in the pending output and return the first
+// definitive answer. The consumed lines are appended to 'log' if it is set.
+static auto parseEngineOutput(const SolverBackend &backend, string &pending,
+                              string *log) -> SolverResult {
+    SolverResult result = SolverResult::Unknown;
+    size_t lineStart = 0;
+    size_t lineEnd;
+    while ((lineEnd = pending.find('\n', lineStart)) != string::npos) {
+        string line = pending.substr(lineStart, lineEnd - lineStart);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lineStart = lineEnd + 1;
+        if (log) {
+            *log += line;
+            *log += '\n';
+        }
+        result = backend.parseLine(line);
+        if (result != SolverResult::Unknown) {
+            break;
+        }
+    }
+    pending.erase(0, lineStart);
+    return result;
+}
+
+static auto runEngines(const vector<SolverEngine> &engines,
+                       const string &smtFileName) -> PortfolioResult {
+    vector<RunningEngine> running;
+    for (const auto &engine : engines) {
+        running.push_back(startEngine(engine, smtFileName));
+    }
+
+    PortfolioResult result = {SolverResult::Unknown, "", ""};
+    RunningEngine *winner = nullptr;
+    while (result.Engine.empty()) {
+        vector<pollfd> fds;
+        vector<RunningEngine *> polled;
+        Clock::time_point now = Clock::now();
+        Clock::time_point nextDeadline = Clock::time_point::max();
+        for (auto &engine : running) {
+            if (engine.OutputFd < 0) {
+                continue;
+            }
+            if (engine.Deadline <= now) {
+                logWarning(engine.Engine->Backend->name() +
+                           " exceeded its time limit\n");
+                stopEngine(engine, true);
+                continue;
+            }
+            nextDeadline = std::min(nextDeadline, engine.Deadline);
+            fds.push_back({engine.OutputFd, POLLIN, 0});
+            polled.push_back(&engine);
+        }
+        if (fds.empty()) {
+            break;
+        }
+        int timeout = -1;
+        if (nextDeadline != Clock::time_point::max()) {
+            timeout = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    nextDeadline - now)
+                    .count() +
+                1);
+        }
+        if (poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logError("Waiting for the solvers failed\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            RunningEngine &engine = *polled[i];
+            char buffer[4096];
+            ssize_t n = read(engine.OutputFd, buffer, sizeof(buffer));
+            if (n > 0) {
+                engine.Pending.append(buffer, static_cast<size_t>(n));
+            } else {
+                // Treat a final line without a newline like a complete one
+                engine.Pending += '\n';
+            }
+            SolverResult engineResult = parseEngineOutput(
+                *engine.Engine->Backend, engine.Pending,
+                stats::enabled() ? &engine.Log : nullptr);
+            if (engineResult != SolverResult::Unknown) {
+                result = {engineResult, engine.Engine->Backend->name(), ""};
+                winner = &engine;
+                break;
+            }
+            if (n <= 0) {
+                stopEngine(engine, false);
+            }
+        }
+    }
+
+    for (auto &engine : running) {
+        if (&engine != winner) {
+            stopEngine(engine, true);
+        }
+    }
+    if (winner) {
+        // The model is printed after the result
+        readRemainingOutput(*winner);
+        if (result.Result == SolverResult::Sat &&
+            winner->Engine->Backend->capabilities().Models) {
+            result.Model = winner->Pending;
+        }
+        stopEngine(*winner, true);
+    }
+    for (const auto &engine : running) {
+        if (!engine.Log.empty()) {
+            recordSolverLog(engine.Engine->Backend->name(), engine.Log);
+        }
+    }
+    return result;
+}
+
+// The engines only read plain SMT-LIB, so compressed queries are decompressed
+// into a temporary file first. Returns false if the query is not compressed.
+static auto decompressQuery(const string &smtFileName,
+                            llvm::SmallString<128> &plainFile) -> bool {
+    auto buffer = llvm::MemoryBuffer::getFile(smtFileName);
+    if (!buffer || !isGzip((*buffer)->getBuffer())) {
+        return false;
+    }
+    string plain;
+    if (!gunzip((*buffer)->getBuffer(), plain)) {
+        logError("Cannot decompress " + smtFileName + "\n");
+        exit(1);
+    }
+    int fd;
+    if (std::error_code errorCode = llvm::sys::fs::createTemporaryFile(
+            "llreve-portfolio", "smt2", fd, plainFile)) {
+        logError("Could not create a temporary file: " + errorCode.message() +
+                 "\n");
+        exit(1);
+    }
+    llvm::raw_fd_ostream stream(fd, true);
+    stream << plain;
+    return true;
+}
+
+auto runPortfolio(const vector<SolverEngine> &engines,
+                  const string &smtFileName) -> PortfolioResult {
+    llvm::SmallString<128> plainFile;
+    if (!decompressQuery(smtFileName, plainFile)) {
+        return runEngines(engines, smtFileName);
+    }
+    PortfolioResult result = runEngines(engines, plainFile.str().str());
+    llvm::sys::fs::remove(plainFile);
+    return result;
+}
+#endif
@@ -0,0 +1,431 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "PredicateElimination.h"
+
+#include "Statistics.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+#include <algorithm>
+#include <functional>
+#include <set>
+
+using smt::SharedSMTRef;
+using smt::SortedVar;
+using std::make_shared;
+using std::string;
+using std::vector;
+
+namespace {
+struct ClauseInfo {
+    // The number of applications of each predicate outside of the head
+    llvm::StringMap<unsigned> Uses;
+    // The predicate applied in the head or empty, e.g. for queries
+    string Head;
+    size_t Size = 0;
+    bool Removed = false;
+};
+
+// Appends a suffix to all bound variables. Horn clauses are closed, so every
+// variable is bound and the renamed clause shares no names with other
+// clauses.
+struct RenameApartVisitor : smt::SMTVisitor {
+    string suffix;
+    llvm::StringSet<> bound;
+    explicit RenameApartVisitor(string suffix) : suffix(std::move(suffix)) {}
+    bool handles(smt::ExprTag tag) const override {
+        return tag == smt::ExprTag::TypedVariable ||
+               tag == smt::ExprTag::ConstantString ||
+               tag == smt::ExprTag::Let || tag == smt::ExprTag::Forall;
+    }
+    void bind(string &name) {
+        bound.insert(name);
+        name += suffix;
+    }
+    void dispatch(smt::TypedVariable &var) override {
+        if (bound.count(var.name) > 0) {
+            var.rename(var.name + suffix);
+        }
+    }
+    void dispatch(smt::ConstantString &str) override {
+        if (bound.count(str.value) > 0) {
+            str.value += suffix;
+        }
+    }
+    void dispatch(smt::Let &let) override {
+        for (auto &assignment : let.defs) {
+            bind(assignment.first);
+        }
+    }
+    void dispatch(smt::Forall &forall) override {
+        for (auto &var : forall.vars) {
+            bind(var.name);
+        }
+    }
+};
+}
+
+// The conclusion of the (innermost) implication below the quantifiers and
+// lets
+static auto headOf(const smt::SMTExpr &expr) -> const smt::SMTExpr & {
+    switch (expr.getTag()) {
+    case smt::ExprTag::Assert:
+        return headOf(*static_cast<const smt::Assert &>(expr).expr);
+    case smt::ExprTag::Forall:
+        return headOf(*static_cast<const smt::Forall &>(expr).expr);
+    case smt::ExprTag::Let:
+        return headOf(*static_cast<const smt::Let &>(expr).expr);
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        if (op.opName == "=>" && op.args.size() == 2) {
+            return headOf(*op.args[1]);
+        }
+        return expr;
+    }
+    default:
+        return expr;
+    }
+}
+
+static void analyzeClause(const smt::SMTExpr &expr,
+                          const llvm::StringSet<> &predicates,
+                          ClauseInfo &info) {
+    ++info.Size;
+    switch (expr.getTag()) {
+    case smt::ExprTag::Assert:
+        analyzeClause(*static_cast<const smt::Assert &>(expr).expr, predicates,
+                      info);
+        break;
+    case smt::ExprTag::Forall:
+        analyzeClause(*static_cast<const smt::Forall &>(expr).expr, predicates,
+                      info);
+        break;
+    case smt::ExprTag::Let: {
+        const auto &let = static_cast<const smt::Let &>(expr);
+        for (const auto &def : let.defs) {
+            analyzeClause(*def.second, predicates, info);
+        }
+        analyzeClause(*let.expr, predicates, info);
+        break;
+    }
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(expr);
+        if (predicates.count(op.opName) > 0) {
+            ++info.Uses[op.opName];
+        }
+        for (const auto &arg : op.args) {
+            analyzeClause(*arg, predicates, info);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static auto analyzeClause(const SharedSMTRef &clause,
+                          const llvm::StringSet<> &predicates) -> ClauseInfo {
+    ClauseInfo info;
+    analyzeClause(*clause, predicates, info);
+    const smt::SMTExpr &head = headOf(*clause);
+    if (head.getTag() == smt::ExprTag::Op) {
+        const string &name = static_cast<const smt::Op &>(head).opName;
+        if (predicates.count(name) > 0) {
+            info.Head = name;
+            if (--info.Uses[name] == 0) {
+                info.Uses.erase(name);
+            }
+        }
+    }
+    return info;
+}
+
+// Turns the renamed defining clause into the condition under which it
+// derives (P args): the premises and the equalities of the arguments of the
+// head with 'args'. The quantified variables are added to 'vars'.
+static auto definitionCondition(const SharedSMTRef &expr,
+                                const vector<SharedSMTRef> &args,
+                                vector<SortedVar> &vars) -> SharedSMTRef {
+    switch (expr->getTag()) {
+    case smt::ExprTag::Assert:
+        return definitionCondition(
+            static_cast<const smt::Assert &>(*expr).expr, args, vars);
+    case smt::ExprTag::Forall: {
+        const auto &forall = static_cast<const smt::Forall &>(*expr);
+        vars.insert(vars.end(), forall.vars.begin(), forall.vars.end());
+        return definitionCondition(forall.expr, args, vars);
+    }
+    case smt::ExprTag::Let: {
+        const auto &let = static_cast<const smt::Let &>(*expr);
+        return make_shared<smt::Let>(
+            let.defs, definitionCondition(let.expr, args, vars));
+    }
+    default:
+        break;
+    }
+    const auto &op = static_cast<const smt::Op &>(*expr);
+    if (op.opName == "=>" && op.args.size() == 2) {
+        return make_shared<smt::Op>(
+            "and", vector<SharedSMTRef>{
+                       op.args[0], definitionCondition(op.args[1], args, vars)});
+    }
+    vector<SharedSMTRef> equalities;
+    for (size_t i = 0; i < args.size(); ++i) {
+        equalities.push_back(make_shared<smt::Op>(
+            "=", vector<SharedSMTRef>{args[i], op.args[i]}));
+    }
+    if (equalities.empty()) {
+        return make_shared<smt::ConstantBool>(true);
+    }
+    if (equalities.size() == 1) {
+        return equalities.front();
+    }
+    return make_shared<smt::Op>("and", std::move(equalities));
+}
+
+using Replacement = std::function<SharedSMTRef(const smt::Op &)>;
+
+// Replaces the application of the predicate if it is a conjunct of the
+// premise of the clause. Returns nullptr if there is no such application.
+static auto replaceInPremise(const SharedSMTRef &expr, const string &predicate,
+                             const Replacement &replacement) -> SharedSMTRef {
+    switch (expr->getTag()) {
+    case smt::ExprTag::Let: {
+        const auto &let = static_cast<const smt::Let &>(*expr);
+        SharedSMTRef body = replaceInPremise(let.expr, predicate, replacement);
+        return body ? make_shared<smt::Let>(let.defs, std::move(body))
+                    : nullptr;
+    }
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(*expr);
+        if (op.opName == predicate) {
+            return replacement(op);
+        }
+        if (op.opName != "and") {
+            return nullptr;
+        }
+        for (size_t i = 0; i < op.args.size(); ++i) {
+            if (SharedSMTRef arg =
+                    replaceInPremise(op.args[i], predicate, replacement)) {
+                vector<SharedSMTRef> args = op.args;
+                args[i] = std::move(arg);
+                return make_shared<smt::Op>("and", std::move(args),
+                                            op.instantiate);
+            }
+        }
+        return nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+// The same for the premises of the implications along the path to the head
+static auto replaceInClause(const SharedSMTRef &expr, const string &predicate,
+                            const Replacement &replacement) -> SharedSMTRef {
+    switch (expr->getTag()) {
+    case smt::ExprTag::Forall: {
+        const auto &forall = static_cast<const smt::Forall &>(*expr);
+        SharedSMTRef body =
+            replaceInClause(forall.expr, predicate, replacement);
+        return body ? make_shared<smt::Forall>(forall.vars, std::move(body))
+                    : nullptr;
+    }
+    case smt::ExprTag::Let: {
+        const auto &let = static_cast<const smt::Let &>(*expr);
+        SharedSMTRef body = replaceInClause(let.expr, predicate, replacement);
+        return body ? make_shared<smt::Let>(let.defs, std::move(body))
+                    : nullptr;
+    }
+    case smt::ExprTag::Op: {
+        const auto &op = static_cast<const smt::Op &>(*expr);
+        if (op.opName != "=>" || op.args.size() != 2) {
+            return nullptr;
+        }
+        if (SharedSMTRef premise =
+                replaceInPremise(op.args[0], predicate, replacement)) {
+            return make_shared<smt::Op>(
+                "=>", vector<SharedSMTRef>{std::move(premise), op.args[1]},
+                op.instantiate);
+        }
+        if (SharedSMTRef conclusion =
+                replaceInClause(op.args[1], predicate, replacement)) {
+            return make_shared<smt::Op>(
+                "=>", vector<SharedSMTRef>{op.args[0], std::move(conclusion)},
+                op.instantiate);
+        }
+        return nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+// Resolves the use of the predicate in 'use' with the defining clause, which
+// has already been renamed apart. Returns nullptr if the application is not
+// a conjunct of a premise.
+static auto resolve(const SharedSMTRef &use, const SharedSMTRef &definition,
+                    const string &predicate) -> SharedSMTRef {
+    vector<SortedVar> vars;
+    SharedSMTRef body = replaceInClause(
+        static_cast<const smt::Assert &>(*use).expr, predicate,
+        [&](const smt::Op &application) {
+            return definitionCondition(definition, application.args, vars);
+        });
+    if (!body) {
+        return nullptr;
+    }
+    // The variables of the definition are fresh, so quantifying them at the
+    // top of the clause is the same as quantifying them existentially in the
+    // premise
+    if (body->getTag() == smt::ExprTag::Forall) {
+        const auto &forall = static_cast<const smt::Forall &>(*body);
+        vars.insert(vars.begin(), forall.vars.begin(), forall.vars.end());
+        body = forall.expr;
+    }
+    return make_shared<smt::Assert>(
+        make_shared<smt::Forall>(std::move(vars), std::move(body)));
+}
+
+// (define-fun P ((a Int) …) Bool (not (forall (x …) (not condition))))
+static auto predicateDefinition(const smt::FunDecl &decl,
+                                const SharedSMTRef &definition)
+    -> SharedSMTRef {
+    vector<SortedVar> args;
+    vector<SharedSMTRef> argRefs;
+    for (size_t i = 0; i < decl.inTypes.size(); ++i) {
+        args.emplace_back("arg$" + std::to_string(i), decl.inTypes[i]);
+        argRefs.push_back(
+            make_shared<smt::TypedVariable>(args.back().name, args.back().type));
+    }
+    vector<SortedVar> vars;
+    SharedSMTRef condition = definitionCondition(definition, argRefs, vars);
+    SharedSMTRef body = condition;
+    if (!vars.empty()) {
+        body = make_shared<smt::Op>(
+            "not",
+            vector<SharedSMTRef>{make_shared<smt::Forall>(
+                std::move(vars),
+                make_shared<smt::Op>("not", vector<SharedSMTRef>{condition}))});
+    }
+    return make_shared<smt::FunDef>(decl.funName, std::move(args),
+                                    decl.outType, std::move(body));
+}
+
+auto eliminatePredicates(const vector<SharedSMTRef> &smtExprs,
+                         size_t maxClauseSize) -> EliminatedPredicates {
+    llvm::StringSet<> predicates;
+    llvm::StringMap<const smt::FunDecl *> declarations;
+    llvm::StringSet<> arrayPredicates;
+    for (const auto &expr : smtExprs) {
+        if (expr->getTag() != smt::ExprTag::FunDecl) {
+            continue;
+        }
+        const auto &decl = static_cast<const smt::FunDecl &>(*expr);
+        predicates.insert(decl.funName);
+        declarations[decl.funName] = &decl;
+        for (const auto &type : decl.inTypes) {
+            if (smt::isArray(type)) {
+                arrayPredicates.insert(decl.funName);
+            }
+        }
+    }
+
+    vector<SharedSMTRef> exprs = smtExprs;
+    vector<ClauseInfo> infos(exprs.size());
+    llvm::StringMap<std::set<size_t>> definingClauses;
+    llvm::StringMap<std::set<size_t>> usingClauses;
+    llvm::StringMap<unsigned> useCounts;
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        if (!exprs[i]->asAssert()) {
+            continue;
+        }
+        infos[i] = analyzeClause(exprs[i], predicates);
+        if (!infos[i].Head.empty()) {
+            definingClauses[infos[i].Head].insert(i);
+        }
+        for (const auto &use : infos[i].Uses) {
+            usingClauses[use.getKey()].insert(i);
+            useCounts[use.getKey()] += use.getValue();
+        }
+    }
+
+    EliminatedPredicates result;
+    vector<string> worklist;
+    for (const auto &expr : smtExprs) {
+        if (expr->getTag() == smt::ExprTag::FunDecl) {
+            worklist.push_back(static_cast<const smt::FunDecl &>(*expr).funName);
+        }
+    }
+    // Later definitions may use predicates that are eliminated afterwards, so
+    // they are reversed at the end
+    vector<SharedSMTRef> definitions;
+    llvm::StringSet<> eliminated;
+    std::reverse(worklist.begin(), worklist.end());
+    while (!worklist.empty()) {
+        const string predicate = worklist.back();
+        worklist.pop_back();
+        if (eliminated.count(predicate) > 0 ||
+            arrayPredicates.count(predicate) > 0 ||
+            definingClauses[predicate].size() != 1 ||
+            useCounts[predicate] != 1) {
+            continue;
+        }
+        const size_t def = *definingClauses[predicate].begin();
+        const size_t use = *usingClauses[predicate].begin();
+        // A recursive definition uses the predicate itself
+        if (def == use || infos[def].Size + infos[use].Size > maxClauseSize) {
+            continue;
+        }
+        const string suffix = "$e" + std::to_string(eliminated.size());
+        RenameApartVisitor renameVisitor(suffix);
+        SharedSMTRef definition = smt::visit(exprs[def], renameVisitor);
+        SharedSMTRef resolved = resolve(exprs[use], definition, predicate);
+        if (!resolved) {
+            continue;
+        }
+
+        definitions.push_back(
+            predicateDefinition(*declarations[predicate], definition));
+        eliminated.insert(predicate);
+        exprs[use] = resolved;
+        infos[def].Removed = true;
+        ClauseInfo resolvedInfo = analyzeClause(resolved, predicates);
+        for (const auto &defUse : infos[def].Uses) {
+            usingClauses[defUse.getKey()].erase(def);
+            usingClauses[defUse.getKey()].insert(use);
+            worklist.push_back(defUse.getKey().str());
+        }
+        infos[use] = std::move(resolvedInfo);
+        if (!infos[use].Head.empty()) {
+            worklist.push_back(infos[use].Head);
+        }
+        definingClauses.erase(predicate);
+        usingClauses.erase(predicate);
+        useCounts.erase(predicate);
+    }
+
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        if (infos[i].Removed) {
+            continue;
+        }
+        if (exprs[i]->getTag() == smt::ExprTag::FunDecl &&
+            eliminated.count(
+                static_cast<const smt::FunDecl &>(*exprs[i]).funName) > 0) {
+            continue;
+        }
+        result.Clauses.push_back(exprs[i]);
+    }
+    result.Definitions.assign(definitions.rbegin(), definitions.rend());
+    stats::count("eliminate.predicates", eliminated.size());
+    return result;
+}
@@ -10,6 +10,7 @@
 
 #include "Preprocess.h"
 
+#include "HeapRegions.h"
 #include "Helper.h"
 #include "InferMarks.h"
 #include "InlinePass.h"
@@ -20,20 +21,27 @@
 #include "RemoveMarkPass.h"
 #include "RemoveMarkRefsPass.h"
 #include "SplitEntryBlockPass.h"
+#include "Statistics.h"
 #include "UnifyFunctionExitNodes.h"
 #include "UniqueNamePass.h"
 
 #include "llvm/Analysis/CFGPrinter.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/ADCE.h"
+#include "llvm/Transforms/Scalar/SROA.h"
 #include "llvm/Transforms/Scalar/SimplifyCFG.h"
 #include "llvm/Transforms/Utils/LoopSimplify.h"
 #include "llvm/Transforms/Utils/Mem2Reg.h"
 
+#include <algorithm>
+
 using std::map;
+using std::set;
 using std::vector;
 using std::shared_ptr;
 using std::make_shared;
@@ -56,59 +64,141 @@ static void nameModuleGlobals(llvm::Module &module, Program prog) {
     }
 }
 
-static void detectMemoryOptions(MonoPair<const llvm::Module &> modules) {
+void detectMemoryOptions(MonoPair<const llvm::Module &> modules) {
+    auto &smtOpts = SMTGenerationOpts::getInstance();
     if (doesAccessHeap(modules.first) || doesAccessHeap(modules.second)) {
-        SMTGenerationOpts::getInstance().Heap = HeapOpt::Enabled;
+        smtOpts.Heap = HeapOpt::Enabled;
     }
     if (doesAccessStack(modules.first) || doesAccessStack(modules.second)) {
-        SMTGenerationOpts::getInstance().Stack = StackOpt::Enabled;
+        smtOpts.Stack = StackOpt::Enabled;
+    }
+    if (smtOpts.ByteHeap == ByteHeapOpt::Automatic) {
+        // The bitvector encoding always loads and stores single bytes
+        const bool wordHeap = !smtOpts.BitVect &&
+                              hasWordAlignedAccesses(modules.first) &&
+                              hasWordAlignedAccesses(modules.second);
+        smtOpts.ByteHeap =
+            wordHeap ? ByteHeapOpt::Disabled : ByteHeapOpt::Enabled;
+        stats::count(wordHeap ? "memory.word heap" : "memory.byte heap");
     }
 }
 AnalysisResultsMap preprocessModules(MonoPair<llvm::Module &> modules,
                                      PreprocessOpts opts) {
-    map<const llvm::Function *, PassAnalysisResults> passResults;
-    runFunctionPasses(modules.first, opts, passResults, Program::First);
-    runFunctionPasses(modules.second, opts, passResults, Program::Second);
-    nameModuleGlobals(modules.first, Program::First);
-    nameModuleGlobals(modules.second, Program::Second);
-    detectMemoryOptions(modules);
     AnalysisResultsMap analysisResults;
-    runAnalyses(modules.first, Program::First, passResults, analysisResults);
-    runAnalyses(modules.second, Program::Second, passResults, analysisResults);
+    AnalysisResultsMap secondResults;
+    // Functions of the same module can’t be preprocessed concurrently since
+    // they share an LLVMContext and InlinePass reads the bodies of callees.
+    // Modules with separate contexts are independent.
+    const unsigned jobs =
+        &modules.first.getContext() == &modules.second.getContext()
+            ? 1
+            : std::min(SMTGenerationOpts::getInstance().Jobs, 2u);
+    runInParallel(
+        {[&] {
+             analysisResults =
+                 preprocessModule(modules.first, Program::First, opts);
+         },
+         [&] {
+             secondResults =
+                 preprocessModule(modules.second, Program::Second, opts);
+         }},
+        jobs);
+    // The results are keyed by function so merging them after both modules
+    // have been preprocessed gives the same map as a serial run
+    analysisResults.insert(secondResults.begin(), secondResults.end());
+    detectMemoryOptions(modules);
+    const auto &smtOpts = SMTGenerationOpts::getInstance();
+    if (smtOpts.PartitionHeap && smtOpts.Heap == HeapOpt::Enabled) {
+        assignHeapRegions(modules);
+    }
     return analysisResults;
 }
 
-void runFunctionPasses(
-    llvm::Module &module, PreprocessOpts opts,
-    std::map<const llvm::Function *, PassAnalysisResults> &passResults,
-    Program prog) {
-    for (auto &f : module) {
-        if (!f.isIntrinsic() && !isLlreveIntrinsic(f)) {
-            if (hasFixedAbstraction(f)) {
-                nameFunctionArguments(f, prog);
-            } else {
-                passResults.insert({&f, runFunctionPasses(f, prog, opts)});
-            }
-        }
+static void materialize(llvm::Function &fun) {
+    if (llvm::Error error = fun.materialize()) {
+        logError("Couldn’t read " + fun.getName().str() + ": " +
+                 llvm::toString(std::move(error)) + "\n");
+        exit(1);
     }
 }
 
-static llvm::ReturnInst *getReturnInstruction(llvm::Function &fun) {
-    for (auto &bb : fun) {
-        for (auto &inst : bb) {
-            if (auto retInst = llvm::dyn_cast<llvm::ReturnInst>(&inst)) {
-                return retInst;
+// Functions that are not called transitively from the main function are
+// never encoded, see generateSMT. Their bodies are deleted so that they are
+// neither materialized nor preprocessed. Coupled pairs only need a
+// relational abstraction if both functions are called from main so they
+// don’t have to be considered separately.
+static void dropUnreachableFunctions(llvm::Module &module,
+                                     llvm::Function &mainFunction) {
+    set<const llvm::Function *> reachable = {&mainFunction};
+    vector<llvm::Function *> toProcess = {&mainFunction};
+    while (!toProcess.empty()) {
+        llvm::Function *f = toProcess.back();
+        toProcess.pop_back();
+        materialize(*f);
+        for (const auto callee : calledFunctions(*f)) {
+            // Indirect calls don’t have a called function
+            if (callee && reachable.insert(callee).second) {
+                toProcess.push_back(module.getFunction(callee->getName()));
             }
         }
     }
-    assert(false);
-    return nullptr;
+    for (auto &f : module) {
+        if (!f.isDeclaration() && reachable.find(&f) == reachable.end()) {
+            stats::count("preprocess.dropped functions");
+            f.deleteBody();
+        }
+    }
 }
 
-PassAnalysisResults runFunctionPasses(llvm::Function &fun, Program prog,
-                                      PreprocessOpts opts) {
-    llvm::FunctionAnalysisManager fam(false);
-    llvm::FunctionPassManager fpm(false);
+AnalysisResultsMap preprocessModule(llvm::Module &module, Program prog,
+                                    PreprocessOpts opts) {
+    stats::ScopedTimer timer("preprocess");
+    llvm::Function *mainFunction =
+        prog == Program::First
+            ? SMTGenerationOpts::getInstance().MainFunctions.first
+            : SMTGenerationOpts::getInstance().MainFunctions.second;
+    // The options don’t necessarily refer to this module, e.g. if it is a
+    // copy of one of the original programs
+    if (mainFunction && mainFunction->getParent() == &module) {
+        dropUnreachableFunctions(module, *mainFunction);
+    } else if (llvm::Error error = module.materializeAll()) {
+        logError("Couldn’t read " + module.getModuleIdentifier() + ": " +
+                 llvm::toString(std::move(error)) + "\n");
+        exit(1);
+    }
+    map<const llvm::Function *, PassAnalysisResults> passResults;
+    runFunctionPasses(module, opts, passResults, prog);
+    nameModuleGlobals(module, prog);
+    AnalysisResultsMap analysisResults;
+    runAnalyses(module, prog, passResults, analysisResults);
+    return analysisResults;
+}
+
+AnalysisResultsMap preprocessModules(MonoPair<llvm::Module &> modules,
+                                     PreprocessOpts opts,
+                                     SMTGenerationOpts &smtOpts) {
+    SMTGenerationOpts::Scope optsScope(smtOpts);
+    return preprocessModules(modules, opts);
+}
+
+namespace {
+// The pass pipeline used for all functions of one program. Building the
+// managers and registering the analyses is only done once, the analysis
+// manager is shared by all functions the pipeline runs on.
+class FunctionPipeline {
+  public:
+    FunctionPipeline(Program prog, PreprocessOpts opts);
+    auto run(llvm::Function &fun) -> PassAnalysisResults;
+
+  private:
+    PreprocessOpts opts;
+    llvm::FunctionAnalysisManager fam;
+    llvm::FunctionPassManager fpm;
+};
+}
+
+FunctionPipeline::FunctionPipeline(Program prog, PreprocessOpts opts)
+    : opts(opts), fam(false), fpm(false) {
     llvm::PassBuilder pb;
     pb.registerFunctionAnalyses(fam);
     fpm.addPass(UnifyFunctionExitNodes{});
@@ -116,12 +206,17 @@ PassAnalysisResults runFunctionPasses(llvm::Function &fun, Program prog,
 
     fpm.addPass(InlinePass{});
     fpm.addPass(llvm::PromotePass{});
+    if (opts.ScalarizeAllocas) {
+        // mem2reg only promotes allocas of scalars that are loaded and stored
+        // directly, the remaining ones are split into scalars and promoted
+        fpm.addPass(llvm::SROA{});
+    }
     fpm.addPass(llvm::LoopSimplifyPass{});
     fpm.addPass(llvm::SimplifyCFGPass{});
     fpm.addPass(SplitBlockPass{});
 
-    MarkAnalysis markAnalysis{};
-    fam.registerPass([] { return InferMarksAnalysis(); });
+    const unsigned pathLimit = opts.InferredPathLimit;
+    fam.registerPass([pathLimit] { return InferMarksAnalysis(pathLimit); });
     fam.registerPass([] { return MarkAnalysis{}; });
     if (!opts.InferMarks) {
         fpm.addPass(RemoveMarkRefsPass{});
@@ -130,21 +225,54 @@ PassAnalysisResults runFunctionPasses(llvm::Function &fun, Program prog,
     fpm.addPass(llvm::ADCEPass()); // supported
     // TODO reenable
     // fpm->add(llvm::createConstantPropagationPass());
-    // // Passes need to have a default ctor
-    UniqueNamePass::Prefix = std::to_string(programIndex(prog));
-    fpm.addPass(UniqueNamePass{}); // prefix register names
+    fpm.addPass(UniqueNamePass{
+        std::to_string(programIndex(prog))}); // prefix register names
     if (opts.ShowMarkedCFG) {
         fpm.addPass(llvm::CFGViewerPass()); // show marked cfg
     }
     if (!opts.InferMarks) {
         fpm.addPass(RemoveMarkPass{});
     }
-    fam.registerPass([&] { return PathAnalysis(opts.InferMarks); });
+    const bool inferMarks = opts.InferMarks;
+    fam.registerPass([inferMarks] { return PathAnalysis(inferMarks); });
     if (opts.ShowCFG) {
         fpm.addPass(llvm::CFGViewerPass{}); // show cfg
     }
     fpm.addPass(llvm::VerifierPass());
     // FPM.addPass(llvm::PrintFunctionPass(errs())); // dump function
+}
+
+void runFunctionPasses(
+    llvm::Module &module, PreprocessOpts opts,
+    std::map<const llvm::Function *, PassAnalysisResults> &passResults,
+    Program prog) {
+    stats::ScopedTimer timer("preprocess.passes");
+    FunctionPipeline pipeline(prog, opts);
+    for (auto &f : module) {
+        if (!f.isIntrinsic() && !isLlreveIntrinsic(f)) {
+            if (hasFixedAbstraction(f)) {
+                nameFunctionArguments(f, prog);
+            } else {
+                stats::count("preprocess.functions");
+                passResults.insert({&f, pipeline.run(f)});
+            }
+        }
+    }
+}
+
+static llvm::ReturnInst *getReturnInstruction(llvm::Function &fun) {
+    for (auto &bb : fun) {
+        for (auto &inst : bb) {
+            if (auto retInst = llvm::dyn_cast<llvm::ReturnInst>(&inst)) {
+                return retInst;
+            }
+        }
+    }
+    assert(false);
+    return nullptr;
+}
+
+PassAnalysisResults FunctionPipeline::run(llvm::Function &fun) {
     fpm.run(fun, fam);
 
     auto retInst = getReturnInstruction(fun);
@@ -157,9 +285,15 @@ PassAnalysisResults runFunctionPasses(llvm::Function &fun, Program prog,
     }
 }
 
+PassAnalysisResults runFunctionPasses(llvm::Function &fun, Program prog,
+                                      PreprocessOpts opts) {
+    return FunctionPipeline(prog, opts).run(fun);
+}
+
 void runAnalyses(const llvm::Module &module, Program prog,
                  map<const llvm::Function *, PassAnalysisResults> &passResults,
                  AnalysisResultsMap &analysisResults) {
+    stats::ScopedTimer timer("preprocess.analyses");
     for (auto &f : module) {
         if (!f.isIntrinsic() && !isLlreveIntrinsic(f)) {
             if (!hasFixedAbstraction(f)) {
@@ -172,12 +306,14 @@ void runAnalyses(const llvm::Module &module, Program prog,
 AnalysisResults runAnalyses(
     const llvm::Function &fun, Program prog,
     std::map<const llvm::Function *, PassAnalysisResults> &passResults) {
-    const auto functionArguments = functionArgs(fun);
-    const auto freeVariables =
-        freeVars(passResults.at(&fun).paths, functionArguments, prog);
+    auto functionArguments = functionArgs(fun);
+    auto localFreeVariables = localFreeVars(passResults.at(&fun).paths);
+    auto freeVariables = freeVars(localFreeVariables, functionArguments, prog);
     return AnalysisResults(passResults.at(&fun).blockMarkMap,
-                           passResults.at(&fun).paths, functionArguments,
-                           freeVariables,
+                           passResults.at(&fun).paths,
+                           std::move(functionArguments),
+                           std::move(localFreeVariables),
+                           std::move(freeVariables),
                            passResults.at(&fun).returnInstruction);
 }
 
@@ -197,6 +333,147 @@ bool doesAccessHeap(const llvm::Module &mod) {
     return false;
 }
 
+// The types for which typeSize can count the scalars
+static bool isWordLayout(const llvm::Type *ty) {
+    if (const auto intTy = llvm::dyn_cast<llvm::IntegerType>(ty)) {
+        return intTy->getBitWidth() <= 64;
+    }
+    if (ty->isDoubleTy()) {
+        return true;
+    }
+    if (const auto structTy = llvm::dyn_cast<llvm::StructType>(ty)) {
+        return std::all_of(structTy->element_begin(), structTy->element_end(),
+                           isWordLayout);
+    }
+    if (const auto arrayTy = llvm::dyn_cast<llvm::ArrayType>(ty)) {
+        return isWordLayout(arrayTy->getElementType());
+    }
+    return false;
+}
+
+static bool isWordAccess(const llvm::Type *ty, unsigned alignment,
+                         const llvm::DataLayout &layout) {
+    // An alignment of 0 is the ABI alignment of the type
+    return (ty->isIntegerTy() || ty->isDoubleTy()) && isWordLayout(ty) &&
+           (alignment == 0 ||
+            alignment >= layout.getTypeStoreSize(const_cast<llvm::Type *>(ty)));
+}
+
+static bool isMemoryIntrinsic(const llvm::User *user) {
+    const auto call = llvm::dyn_cast<llvm::CallInst>(user);
+    if (!call || !call->getCalledFunction()) {
+        return false;
+    }
+    const auto id = call->getCalledFunction()->getIntrinsicID();
+    return id == llvm::Intrinsic::memcpy || id == llvm::Intrinsic::memset;
+}
+
+// The scalars making up a type for which isWordLayout holds, in the order of
+// their cells
+static void wordScalars(llvm::Type *ty, vector<llvm::Type *> &scalars) {
+    if (const auto structTy = llvm::dyn_cast<llvm::StructType>(ty)) {
+        for (llvm::Type *elTy : structTy->elements()) {
+            wordScalars(elTy, scalars);
+        }
+    } else if (const auto arrayTy = llvm::dyn_cast<llvm::ArrayType>(ty)) {
+        for (uint64_t i = 0; i < arrayTy->getNumElements(); ++i) {
+            wordScalars(arrayTy->getElementType(), scalars);
+        }
+    } else {
+        scalars.push_back(ty);
+    }
+}
+
+// Casts between pointers to types made up of the same scalars only rename the
+// cells. Types of the same size can still differ in the number of cells, e.g.
+// {i32, i32} takes two cells but i64 only one.
+static bool isWordPointerCast(const llvm::Value &cast) {
+    const auto srcTy =
+        llvm::dyn_cast<llvm::PointerType>(
+            llvm::cast<llvm::Operator>(cast).getOperand(0)->getType());
+    const auto destTy = llvm::dyn_cast<llvm::PointerType>(cast.getType());
+    if (!srcTy || !destTy) {
+        return true;
+    }
+    llvm::Type *srcElTy = srcTy->getElementType();
+    llvm::Type *destElTy = destTy->getElementType();
+    if (srcElTy == destElTy) {
+        return true;
+    }
+    if (isWordLayout(srcElTy) && isWordLayout(destElTy)) {
+        vector<llvm::Type *> srcScalars, destScalars;
+        wordScalars(srcElTy, srcScalars);
+        wordScalars(destElTy, destScalars);
+        if (srcScalars == destScalars) {
+            return true;
+        }
+    }
+    return std::all_of(cast.user_begin(), cast.user_end(), isMemoryIntrinsic);
+}
+
+bool hasWordAlignedAccesses(const llvm::Module &mod) {
+    const auto &layout = mod.getDataLayout();
+    for (const auto &global : mod.globals()) {
+        if (!isWordLayout(global.getValueType())) {
+            return false;
+        }
+    }
+    for (const auto &fun : mod) {
+        if (hasFixedAbstraction(fun)) {
+            continue;
+        }
+        for (const auto &bb : fun) {
+            for (const auto &instr : bb) {
+                if (const auto load = llvm::dyn_cast<llvm::LoadInst>(&instr)) {
+                    if (!isWordAccess(load->getType(), load->getAlignment(),
+                                      layout)) {
+                        return false;
+                    }
+                } else if (const auto store =
+                               llvm::dyn_cast<llvm::StoreInst>(&instr)) {
+                    if (!isWordAccess(store->getValueOperand()->getType(),
+                                      store->getAlignment(), layout)) {
+                        return false;
+                    }
+                } else if (const auto alloca =
+                               llvm::dyn_cast<llvm::AllocaInst>(&instr)) {
+                    if (!isWordLayout(alloca->getAllocatedType())) {
+                        return false;
+                    }
+                } else if (const auto gep =
+                               llvm::dyn_cast<llvm::GetElementPtrInst>(
+                                   &instr)) {
+                    if (!isWordLayout(gep->getSourceElementType())) {
+                        return false;
+                    }
+                } else if (llvm::isa<llvm::PtrToIntInst>(&instr) ||
+                           llvm::isa<llvm::IntToPtrInst>(&instr)) {
+                    return false;
+                } else if (llvm::isa<llvm::BitCastInst>(&instr) &&
+                           !isWordPointerCast(instr)) {
+                    return false;
+                }
+                // Casts can also be folded into the operands
+                for (const auto &operand : instr.operands()) {
+                    const auto constExpr =
+                        llvm::dyn_cast<llvm::ConstantExpr>(operand.get());
+                    if (!constExpr) {
+                        continue;
+                    }
+                    if (constExpr->getOpcode() == llvm::Instruction::PtrToInt ||
+                        constExpr->getOpcode() == llvm::Instruction::IntToPtr ||
+                        (constExpr->getOpcode() ==
+                             llvm::Instruction::BitCast &&
+                         !isWordPointerCast(*constExpr))) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
 bool doesAccessStack(const llvm::Module &mod) {
     for (auto &fun : mod) {
         if (!hasFixedAbstraction(fun)) {
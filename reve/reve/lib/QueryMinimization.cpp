@@ -0,0 +1,239 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "QueryMinimization.h"
+
+#include "Helper.h"
+
+#include "llvm/ADT/StringMap.h"
+
+#include <algorithm>
+#include <numeric>
+
+using smt::ExprTag;
+using smt::SharedSMTRef;
+using std::string;
+using std::vector;
+
+// The indices of the units that are kept, in increasing order
+using Units = vector<size_t>;
+using UnitsProperty = std::function<bool(const Units &)>;
+
+// The index of the first candidate with the property, candidates.size() if
+// there is none. The candidates are tested in batches of 'jobs', so some
+// candidates after the first one with the property may be tested as well.
+static auto firstWithProperty(const vector<Units> &candidates,
+                              const UnitsProperty &property, unsigned jobs,
+                              unsigned &tests) -> size_t {
+    const size_t batchSize = std::max(jobs, 1u);
+    for (size_t start = 0; start < candidates.size(); start += batchSize) {
+        const size_t end = std::min(start + batchSize, candidates.size());
+        // Not vector<bool>, the tasks write to the elements concurrently
+        vector<char> results(end - start, false);
+        vector<std::function<void()>> tasks;
+        for (size_t i = start; i < end; ++i) {
+            tasks.push_back([&, i] {
+                results[i - start] = property(candidates[i]);
+            });
+        }
+        runInParallel(tasks, jobs);
+        tests += static_cast<unsigned>(end - start);
+        for (size_t i = start; i < end; ++i) {
+            if (results[i - start]) {
+                return i;
+            }
+        }
+    }
+    return candidates.size();
+}
+
+// Zeller's ddmin: the units are split into chunks which are tested on their
+// own and then as complements, the split gets finer until no chunk can be
+// removed any more. All units together are assumed to have the property.
+static auto ddmin(size_t units, const UnitsProperty &property, unsigned jobs,
+                  unsigned &tests) -> Units {
+    Units kept(units);
+    std::iota(kept.begin(), kept.end(), 0);
+    size_t granularity = 2;
+    while (kept.size() >= 2) {
+        granularity = std::min(granularity, kept.size());
+        vector<Units> candidates(granularity);
+        for (size_t i = 0; i < kept.size(); ++i) {
+            candidates[i * granularity / kept.size()].push_back(kept[i]);
+        }
+        // For two chunks the complements are the chunks themselves
+        if (granularity > 2) {
+            for (size_t chunk = 0; chunk < granularity; ++chunk) {
+                Units complement;
+                for (size_t i = 0; i < kept.size(); ++i) {
+                    if (i * granularity / kept.size() != chunk) {
+                        complement.push_back(kept[i]);
+                    }
+                }
+                candidates.push_back(std::move(complement));
+            }
+        }
+        const size_t found =
+            firstWithProperty(candidates, property, jobs, tests);
+        if (found < granularity) {
+            kept = candidates[found];
+            granularity = 2;
+        } else if (found < candidates.size()) {
+            kept = candidates[found];
+            granularity = std::max<size_t>(granularity - 1, 2);
+        } else if (granularity == kept.size()) {
+            break;
+        } else {
+            granularity = std::min(granularity * 2, kept.size());
+        }
+    }
+    return kept;
+}
+
+static auto asPredicateDecl(const smt::SMTExpr &expr)
+    -> const smt::FunDecl * {
+    if (expr.getTag() != ExprTag::FunDecl) {
+        return nullptr;
+    }
+    const auto &decl = static_cast<const smt::FunDecl &>(expr);
+    return decl.outType.getTag() == smt::TypeTag::Bool ? &decl : nullptr;
+}
+
+namespace {
+// Removes the arguments that are not kept from the declarations and the
+// applications of the predicates, all other nodes are shared with the input
+struct DropArgumentsVisitor : smt::SMTVisitor {
+    const llvm::StringMap<vector<bool>> &keptArguments;
+    explicit DropArgumentsVisitor(
+        const llvm::StringMap<vector<bool>> &keptArguments)
+        : keptArguments(keptArguments) {}
+    bool handlesNode(const smt::SMTExpr &expr) const override {
+        switch (expr.getTag()) {
+        case ExprTag::Op:
+            return keptArguments.count(
+                static_cast<const smt::Op &>(expr).opName);
+        case ExprTag::FunDecl:
+            return keptArguments.count(
+                static_cast<const smt::FunDecl &>(expr).funName);
+        default:
+            return false;
+        }
+    }
+    template <typename T>
+    auto keep(const string &predicate, const vector<T> &args) -> vector<T> {
+        const auto &kept = keptArguments.find(predicate)->second;
+        vector<T> result;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (i >= kept.size() || kept[i]) {
+                result.push_back(args[i]);
+            }
+        }
+        return result;
+    }
+    SharedSMTRef reassemble(smt::Op &op) override {
+        op.args = keep(op.opName, op.args);
+        return op.shared_from_this();
+    }
+    SharedSMTRef reassemble(smt::FunDecl &decl) override {
+        decl.inTypes = keep(decl.funName, decl.inTypes);
+        return decl.shared_from_this();
+    }
+};
+}
+
+// The query with only the clauses at the given indices of 'clauses'
+static auto keepClauses(const vector<SharedSMTRef> &query,
+                        const vector<size_t> &clauses, const Units &kept)
+    -> vector<SharedSMTRef> {
+    vector<bool> isKept(query.size(), true);
+    for (size_t clause : clauses) {
+        isKept[clause] = false;
+    }
+    for (size_t unit : kept) {
+        isKept[clauses[unit]] = true;
+    }
+    vector<SharedSMTRef> result;
+    for (size_t i = 0; i < query.size(); ++i) {
+        if (isKept[i]) {
+            result.push_back(query[i]);
+        }
+    }
+    return result;
+}
+
+using Argument = std::pair<string, size_t>;
+
+static auto keepArguments(const vector<SharedSMTRef> &query,
+                          const vector<Argument> &arguments,
+                          const Units &kept) -> vector<SharedSMTRef> {
+    llvm::StringMap<vector<bool>> keptArguments;
+    for (const auto &argument : arguments) {
+        auto &predicate = keptArguments[argument.first];
+        predicate.resize(std::max(predicate.size(), argument.second + 1),
+                         true);
+        predicate[argument.second] = false;
+    }
+    for (size_t unit : kept) {
+        keptArguments[arguments[unit].first][arguments[unit].second] = true;
+    }
+    DropArgumentsVisitor visitor(keptArguments);
+    vector<SharedSMTRef> result;
+    for (const auto &expr : query) {
+        result.push_back(smt::visit(expr, visitor));
+    }
+    return result;
+}
+
+auto minimizeQuery(const vector<SharedSMTRef> &query,
+                   const QueryProperty &property, unsigned jobs)
+    -> MinimizedQuery {
+    MinimizedQuery result;
+    vector<size_t> clauses;
+    for (size_t i = 0; i < query.size(); ++i) {
+        if (query[i]->asAssert()) {
+            clauses.push_back(i);
+        }
+    }
+    const Units keptClauses = ddmin(
+        clauses.size(),
+        [&](const Units &kept) {
+            return property(keepClauses(query, clauses, kept));
+        },
+        jobs, result.Tests);
+    result.Query = keepClauses(query, clauses, keptClauses);
+
+    vector<Argument> arguments;
+    for (const auto &expr : result.Query) {
+        if (const auto *decl = asPredicateDecl(*expr)) {
+            for (size_t i = 0; i < decl->inTypes.size(); ++i) {
+                arguments.push_back({decl->funName, i});
+            }
+        }
+    }
+    const vector<SharedSMTRef> reduced = result.Query;
+    const Units keptArgs = ddmin(
+        arguments.size(),
+        [&](const Units &kept) {
+            return property(keepArguments(reduced, arguments, kept));
+        },
+        jobs, result.Tests);
+    result.Query = keepArguments(reduced, arguments, keptArgs);
+    return result;
+}
+
+auto declaredPredicates(const vector<SharedSMTRef> &query) -> vector<string> {
+    vector<string> predicates;
+    for (const auto &expr : query) {
+        if (const auto *decl = asPredicateDecl(*expr)) {
+            predicates.push_back(decl->funName);
+        }
+    }
+    return predicates;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "ResultCache.h"
+
+#include "Logging.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fstream>
+#include <sstream>
+
+using std::string;
+
+static string resultCachePath(const string &cacheDir, const string &hash) {
+    llvm::SmallString<128> path(cacheDir);
+    llvm::sys::path::append(path, hash + ".result");
+    return path.str();
+}
+
+bool lookupCachedResult(const string &cacheDir, const string &hash,
+                        SolverOutput &output) {
+    std::ifstream file(resultCachePath(cacheDir, hash));
+    string result;
+    if (!std::getline(file, result)) {
+        return false;
+    }
+    if (result == "sat") {
+        output.Result = SolverResult::Sat;
+    } else if (result == "unsat") {
+        output.Result = SolverResult::Unsat;
+    } else {
+        logWarning("Ignoring invalid entry in result cache: " + hash + "\n");
+        return false;
+    }
+    std::ostringstream model;
+    model << file.rdbuf();
+    output.Model = model.str();
+    return true;
+}
+
+void storeCachedResult(const string &cacheDir, const string &hash,
+                       const SolverOutput &output) {
+    if (output.Result == SolverResult::Unknown) {
+        return;
+    }
+    if (std::error_code errorCode =
+            llvm::sys::fs::create_directories(cacheDir)) {
+        logWarning("Couldn’t create result cache directory: " +
+                   errorCode.message() + "\n");
+        return;
+    }
+    // Write to a temporary file first so that concurrent runs never see a
+    // partially written entry
+    const string path = resultCachePath(cacheDir, hash);
+    int fd;
+    llvm::SmallString<128> tmpPath;
+    if (std::error_code errorCode =
+            llvm::sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, tmpPath)) {
+        logWarning("Couldn’t write to result cache: " + errorCode.message() +
+                   "\n");
+        return;
+    }
+    {
+        llvm::raw_fd_ostream stream(fd, true);
+        stream << (output.Result == SolverResult::Sat ? "sat" : "unsat")
+               << "\n"
+               << output.Model;
+    }
+    if (llvm::sys::fs::rename(tmpPath, path)) {
+        llvm::sys::fs::remove(tmpPath);
+    }
+}
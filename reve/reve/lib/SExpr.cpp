@@ -9,6 +9,8 @@
  */
 #include "SExpr.h"
 
+#include <llvm/ADT/StringMap.h>
+
 #include <string>
 
 using namespace sexpr;
@@ -16,67 +18,177 @@ using namespace sexpr;
 using std::make_unique;
 using std::string;
 
-void Value::serialize(std::ostream &os, size_t /* unused */,
-                      bool /* unused */) const {
-    os << val;
+void OutputBuffer::flush() {
+    os.write(buffer, static_cast<std::streamsize>(size));
+    size = 0;
 }
 
-void Apply::serialize(std::ostream &os, size_t indent, bool pretty) const {
-    os << "(" << fun;
-    if (pretty) {
-        bool atomicOp = atomicOps.find(fun) != atomicOps.end();
-        bool simpleOp = args.size() <= 1 &&
-                        forceIndentOps.find(fun) == forceIndentOps.end();
-        bool inv = fun.substr(0, 3) == "INV" || fun == "OUT_INV" ||
-                   fun == "IN_INV" || fun == "INIT";
-        if (atomicOp || simpleOp || inv) {
-            for (auto &arg : args) {
-                os << " ";
-                arg->serialize(os, indent + fun.size() + 3, pretty);
-            }
+void OutputBuffer::writeSlow(llvm::StringRef str) {
+    flush();
+    if (str.size() > Capacity) {
+        os.write(str.data(), static_cast<std::streamsize>(str.size()));
+        return;
+    }
+    std::copy(str.begin(), str.end(), buffer);
+    size = str.size();
+}
+
+void OutputBuffer::newline(size_t indent) {
+    static const char blanks[] = "                                        "
+                                 "                                        ";
+    const size_t blankCount = sizeof(blanks) - 1;
+    put('\n');
+    while (indent > 0) {
+        size_t count = std::min(indent, blankCount);
+        write(llvm::StringRef(blanks, count));
+        indent -= count;
+    }
+}
+
+void SExpr::serialize(std::ostream &os, size_t indent, bool pretty) const {
+    OutputBuffer out(os);
+    WriteStack pending;
+    write(out, indent, pretty, pending);
+    while (!pending.empty()) {
+        const PendingWrite next = pending.back();
+        pending.pop_back();
+        switch (next.separator) {
+        case PendingWrite::Separator::None:
+            break;
+        case PendingWrite::Separator::Space:
+            out.put(' ');
+            break;
+        case PendingWrite::Separator::Newline:
+            out.newline(next.newlineIndent);
+            break;
+        }
+        if (next.expr) {
+            next.expr->write(out, next.indent, pretty, pending);
         } else {
-            for (auto &arg : args) {
-                os << "\n";
-                os << std::string(indent + 3, ' ');
-                arg->serialize(os, indent + 3, pretty);
-            }
+            out.put(')');
         }
-    } else {
-        for (auto &arg : args) {
-            os << ' ';
-            arg->serialize(os, indent + 3, pretty);
+    }
+}
+
+void Value::write(OutputBuffer &out, size_t /* unused */, bool /* unused */,
+                  WriteStack & /* unused */) const {
+    out.write(val);
+}
+
+namespace {
+enum class OpLayout {
+    // Arguments are always written on the same line
+    Atomic,
+    // Arguments are always written on separate lines
+    ForceIndent
+};
+}
+
+// Everything that is not in here is only written on a single line if it has
+// at most one argument
+static const llvm::StringMap<OpLayout> &opLayouts() {
+    static const llvm::StringMap<OpLayout> layouts = [] {
+        llvm::StringMap<OpLayout> layouts;
+        for (const char *op :
+             {"+", "-", "*", "<=", "<", ">", ">=", "=", "not", "distinct",
+              "select", "ite", "div", "_", "bvadd", "bvsub", "bvmul", "store",
+              "store_", "select_", "Array", "OUT_INV", "IN_INV", "INIT"}) {
+            layouts.insert({op, OpLayout::Atomic});
+        }
+        for (const char *op : {"assert", "and", "rule"}) {
+            layouts.insert({op, OpLayout::ForceIndent});
         }
+        return layouts;
+    }();
+    return layouts;
+}
+
+// Whether the arguments are written on the same line as the function in the
+// pretty printed output
+static bool argsOnSingleLine(llvm::StringRef fun, size_t argCount) {
+    // Invariants are always written on a single line
+    if (fun.startswith("INV")) {
+        return true;
     }
-    os << ")";
+    auto layout = opLayouts().find(fun);
+    if (layout == opLayouts().end()) {
+        return argCount <= 1;
+    }
+    return layout->getValue() == OpLayout::Atomic;
 }
 
-void List::serialize(std::ostream &os, size_t indent, bool pretty) const {
-    os << "(";
-    auto it = elements.begin();
-    auto e = elements.end();
-    if (it != e) {
-        (*it)->serialize(os, indent + 1, pretty);
-        ++it;
-        for (; it != e; ++it) {
-            os << "\n";
-            os << std::string(indent + 1, ' ');
-            (*it)->serialize(os, indent + 1, pretty);
+// Like the SMT expressions they are converted from, applications and lists
+// can be nested deeply. Their destructors hand the elements to the outermost
+// one, which destroys them one after another instead of recursively.
+static thread_local std::vector<SExprRef> *releasedElements = nullptr;
+
+static void releaseElements(SExprVec &elements) {
+    if (releasedElements != nullptr) {
+        for (auto &element : elements) {
+            releasedElements->push_back(std::move(element));
         }
+        return;
+    }
+    std::vector<SExprRef> pending;
+    releasedElements = &pending;
+    for (auto &element : elements) {
+        pending.push_back(std::move(element));
+    }
+    while (!pending.empty()) {
+        SExprRef element = std::move(pending.back());
+        pending.pop_back();
+        element.reset();
+    }
+    releasedElements = nullptr;
+}
+
+Apply::~Apply() { releaseElements(args); }
+
+List::~List() { releaseElements(elements); }
+
+// Schedules the elements and the closing parenthesis, which is pushed first
+// so it is written after all elements
+static void pushElements(WriteStack &pending, const SExprVec &elements,
+                         PendingWrite::Separator firstSeparator,
+                         PendingWrite::Separator separator,
+                         size_t newlineIndent, size_t indent) {
+    pending.push_back({PendingWrite::Separator::None, 0, nullptr, 0});
+    for (size_t i = elements.size(); i-- > 0;) {
+        pending.push_back({i == 0 ? firstSeparator : separator, newlineIndent,
+                           elements[i].get(), indent});
+    }
+}
+
+void Apply::write(OutputBuffer &out, size_t indent, bool pretty,
+                  WriteStack &pending) const {
+    out.put('(');
+    out.write(fun);
+    if (!pretty) {
+        pushElements(pending, args, PendingWrite::Separator::Space,
+                     PendingWrite::Separator::Space, 0, indent + 3);
+    } else if (argsOnSingleLine(fun, args.size())) {
+        pushElements(pending, args, PendingWrite::Separator::Space,
+                     PendingWrite::Separator::Space, 0,
+                     indent + fun.size() + 3);
+    } else {
+        pushElements(pending, args, PendingWrite::Separator::Newline,
+                     PendingWrite::Separator::Newline, indent + 3,
+                     indent + 3);
     }
-    os << ")";
 }
 
-void Comment::serialize(std::ostream &os, size_t /* unused */,
-                        bool /* unused */) const {
-    os << "; " << val;
+void List::write(OutputBuffer &out, size_t indent, bool /* unused */,
+                 WriteStack &pending) const {
+    out.put('(');
+    pushElements(pending, elements, PendingWrite::Separator::None,
+                 PendingWrite::Separator::Newline, indent + 1, indent + 1);
 }
 
-const llvm::StringSet<> Apply::forceIndentOps = {"assert", "and", "rule"};
-const llvm::StringSet<> Apply::atomicOps = {
-    "+",      "-",      "*",       "<=",       "<",      ">",
-    ">=",     "=",      "not",     "distinct", "select", "ite",
-    "div",    "_",      "bvadd",   "bvsub",    "bvmul",  "store",
-    "store_", "select", "select_", "Array"};
+void Comment::write(OutputBuffer &out, size_t /* unused */,
+                    bool /* unused */, WriteStack & /* unused */) const {
+    out.write("; ");
+    out.write(val);
+}
 
 SExprRef sexprFromString(string value) { return make_unique<Value>(value); }
 
@@ -16,6 +16,7 @@
 #include "Opts.h"
 
 #include <iostream>
+#include <sstream>
 
 namespace smt {
 using std::map;
@@ -30,6 +31,84 @@ using std::vector;
 using namespace llreve::opts;
 using namespace sexpr;
 
+// Destructors
+
+// Destroying the last reference to a deep expression would recurse once per
+// level. Nodes that can be nested deeply hand their uniquely owned children
+// to the outermost of these destructors instead, which releases them one
+// after another.
+static thread_local vector<SharedSMTRef> *releasedChildren = nullptr;
+
+namespace {
+class ReleaseScope {
+  public:
+    ReleaseScope() : outermost(releasedChildren == nullptr) {
+        if (outermost) {
+            releasedChildren = &children;
+        }
+    }
+    ~ReleaseScope() {
+        if (!outermost) {
+            return;
+        }
+        while (!children.empty()) {
+            SharedSMTRef child = std::move(children.back());
+            children.pop_back();
+            child.reset();
+        }
+        releasedChildren = nullptr;
+    }
+    ReleaseScope(const ReleaseScope &) = delete;
+    ReleaseScope &operator=(const ReleaseScope &) = delete;
+    void release(SharedSMTRef &child) {
+        if (child && child.use_count() == 1) {
+            releasedChildren->push_back(std::move(child));
+        }
+    }
+
+  private:
+    bool outermost;
+    vector<SharedSMTRef> children;
+};
+}
+
+Forall::~Forall() {
+    ReleaseScope scope;
+    scope.release(expr);
+}
+
+Let::~Let() {
+    ReleaseScope scope;
+    for (auto &def : defs) {
+        scope.release(def.second);
+    }
+    scope.release(expr);
+}
+
+Op::~Op() {
+    ReleaseScope scope;
+    for (auto &arg : args) {
+        scope.release(arg);
+    }
+}
+
+FPCmp::~FPCmp() {
+    ReleaseScope scope;
+    scope.release(op0);
+    scope.release(op1);
+}
+
+BinaryFPOperator::~BinaryFPOperator() {
+    ReleaseScope scope;
+    scope.release(op0);
+    scope.release(op1);
+}
+
+TypeCast::~TypeCast() {
+    ReleaseScope scope;
+    scope.release(operand);
+}
+
 // Implementations of toSExpr()
 
 SExprRef TypedVariable::toSExpr() const { return sexprFromString(name); }
@@ -113,67 +192,160 @@ SExprRef GetModel::toSExpr() const {
     return std::make_unique<Apply>("get-model", std::move(args));
 }
 
-SExprRef Assert::toSExpr() const {
-    SExprVec args;
-    args.push_back(expr->toSExpr());
-    const string keyword =
-        SMTGenerationOpts::getInstance().OutputFormat == SMTFormat::Z3
-            ? "rule"
-            : "assert";
-    return std::make_unique<Apply>(keyword, std::move(args));
+// Assert, Forall, Let and Op make up the deep part of the clauses, so they
+// are converted using an explicit stack. The other nodes only have few
+// levels below them and are converted by their own toSExpr.
+static bool isNestedNode(ExprTag tag) {
+    return tag == ExprTag::Assert || tag == ExprTag::Forall ||
+           tag == ExprTag::Let || tag == ExprTag::Op;
+}
+
+// The children whose SExprs are part of the SExpr of the node, in order
+static vector<const SMTExpr *> sexprChildren(const SMTExpr &expr) {
+    vector<const SMTExpr *> children;
+    switch (expr.getTag()) {
+    case ExprTag::Assert:
+        children.push_back(static_cast<const Assert &>(expr).expr.get());
+        break;
+    case ExprTag::Forall:
+        children.push_back(static_cast<const Forall &>(expr).expr.get());
+        break;
+    case ExprTag::Let: {
+        const auto &let = static_cast<const Let &>(expr);
+        for (const auto &def : let.defs) {
+            children.push_back(def.second.get());
+        }
+        children.push_back(let.expr.get());
+        break;
+    }
+    case ExprTag::Op: {
+        const auto &op = static_cast<const Op &>(expr);
+        if (op.opName == "and" && op.args.empty()) {
+            break;
+        }
+        if (op.opName == "=>" && op.args.at(1)->isConstantFalse()) {
+            children.push_back(op.args.at(0).get());
+            break;
+        }
+        for (const auto &arg : op.args) {
+            children.push_back(arg.get());
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return children;
+}
+
+// Combines the SExprs of the children returned by 'sexprChildren'
+static SExprRef assembleSExpr(const SMTExpr &expr, SExprVec children) {
+    switch (expr.getTag()) {
+    case ExprTag::Assert: {
+        const string keyword =
+            SMTGenerationOpts::getInstance().OutputFormat == SMTFormat::Z3
+                ? "rule"
+                : "assert";
+        return std::make_unique<Apply>(keyword, std::move(children));
+    }
+    case ExprTag::Forall: {
+        const auto &forall = static_cast<const Forall &>(expr);
+        if (forall.vars.empty()) {
+            return std::move(children.front());
+        }
+        SExprVec args;
+        SExprVec sortedVars;
+        for (auto &sortedVar : forall.vars) {
+            sortedVars.push_back(sortedVar.toSExpr());
+        }
+        args.push_back(std::make_unique<List>(std::move(sortedVars)));
+        args.push_back(std::move(children.front()));
+        return std::make_unique<Apply>("forall", std::move(args));
+    }
+    case ExprTag::Let: {
+        const auto &let = static_cast<const Let &>(expr);
+        SExprVec defSExprs;
+        for (size_t i = 0; i < let.defs.size(); ++i) {
+            SExprVec argSExprs;
+            argSExprs.push_back(std::move(children[i]));
+            defSExprs.push_back(std::make_unique<Apply>(let.defs[i].first,
+                                                        std::move(argSExprs)));
+        }
+        SExprVec args;
+        args.push_back(std::make_unique<List>(std::move(defSExprs)));
+        args.push_back(std::move(children.back()));
+        return std::make_unique<Apply>("let", std::move(args));
+    }
+    case ExprTag::Op: {
+        const auto &op = static_cast<const Op &>(expr);
+        // Special case for emty and
+        if (op.opName == "and" && op.args.empty()) {
+            return make_unique<Value>("true");
+        }
+        if (op.opName == "and" && op.args.size() == 1) {
+            return std::move(children.front());
+        }
+        if (op.opName == "=>" && op.args.at(1)->isConstantFalse()) {
+            return std::make_unique<Apply>("not", std::move(children));
+        }
+        return std::make_unique<Apply>(op.opName, std::move(children));
+    }
+    default:
+        return expr.toSExpr();
+    }
 }
 
-SExprRef Forall::toSExpr() const {
-    if (vars.empty()) {
-        return expr->toSExpr();
-    }
-    SExprVec args;
-    SExprVec sortedVars;
-    for (auto &sortedVar : vars) {
-        sortedVars.push_back(sortedVar.toSExpr());
+static SExprRef nestedToSExpr(const SMTExpr &root) {
+    struct Frame {
+        const SMTExpr *expr;
+        vector<const SMTExpr *> children;
+        // The index of the SExpr of the first child in 'converted'
+        size_t begin;
+    };
+    // The SExprs of the children of all nodes on the stack
+    vector<SExprRef> converted;
+    vector<Frame> stack;
+    stack.push_back({&root, sexprChildren(root), 0});
+    while (true) {
+        Frame &frame = stack.back();
+        const size_t next = converted.size() - frame.begin;
+        if (next < frame.children.size()) {
+            const SMTExpr *child = frame.children[next];
+            if (isNestedNode(child->getTag())) {
+                stack.push_back(
+                    {child, sexprChildren(*child), converted.size()});
+            } else {
+                converted.push_back(child->toSExpr());
+            }
+            continue;
+        }
+        SExprVec children;
+        for (size_t i = frame.begin; i < converted.size(); ++i) {
+            children.push_back(std::move(converted[i]));
+        }
+        converted.resize(frame.begin);
+        SExprRef result = assembleSExpr(*frame.expr, std::move(children));
+        stack.pop_back();
+        if (stack.empty()) {
+            return result;
+        }
+        converted.push_back(std::move(result));
     }
-    args.push_back(std::make_unique<List>(std::move(sortedVars)));
-    args.push_back(expr->toSExpr());
-    return std::make_unique<Apply>("forall", std::move(args));
 }
 
+SExprRef Assert::toSExpr() const { return nestedToSExpr(*this); }
+
+SExprRef Forall::toSExpr() const { return nestedToSExpr(*this); }
+
 SExprRef SortedVar::toSExpr() const {
     SExprVec typeSExpr;
     typeSExpr.push_back(type.toSExpr());
     return std::make_unique<Apply>(name, std::move(typeSExpr));
 }
 
-SExprRef Let::toSExpr() const {
-    SExprVec defSExprs;
-    for (const auto &def : defs) {
-        SExprVec argSExprs;
-        argSExprs.push_back(def.second->toSExpr());
-        defSExprs.push_back(
-            std::make_unique<Apply>(def.first, std::move(argSExprs)));
-    }
-    SExprVec args;
-    args.push_back(std::make_unique<List>(std::move(defSExprs)));
-    args.push_back(expr->toSExpr());
-    return std::make_unique<Apply>("let", std::move(args));
-}
+SExprRef Let::toSExpr() const { return nestedToSExpr(*this); }
 
-SExprRef Op::toSExpr() const {
-    SExprVec argSExprs;
-    // Special case for emty and
-    if (opName == "and" && args.empty()) {
-        return make_unique<Value>("true");
-    }
-    if (opName == "and" && args.size() == 1) {
-        return args.front()->toSExpr();
-    }
-    if (opName == "=>" && args.at(1)->isConstantFalse()) {
-        return makeOp("not", args.at(0))->toSExpr();
-    }
-    for (auto &arg : args) {
-        argSExprs.push_back(arg->toSExpr());
-    }
-    return std::make_unique<Apply>(opName, std::move(argSExprs));
-}
+SExprRef Op::toSExpr() const { return nestedToSExpr(*this); }
 
 SExprRef FunDecl::toSExpr() const {
     SExprVec inTypeSExprs;
@@ -343,8 +515,188 @@ SExprRef TypeCast::toSExpr() const {
     }
 }
 
+// Implementations of serialize()
+
+// Mirrors sexpr::List::serialize
+template <typename T, typename F>
+static void serializeList(std::ostream &os, size_t indent, const T &elements,
+                          F serializeElement) {
+    os << "(";
+    bool first = true;
+    for (const auto &element : elements) {
+        if (!first) {
+            os << "\n" << std::string(indent + 1, ' ');
+        }
+        first = false;
+        serializeElement(element, indent + 1);
+    }
+    os << ")";
+}
+
+void SortedVar::serialize(std::ostream &os, size_t indent) const {
+    os << "(" << name << " ";
+    type.toSExpr()->serialize(os, indent + 3, false);
+    os << ")";
+}
+
+namespace {
+// Text or an expression that 'serialize' still has to write
+struct PendingOutput {
+    enum class Kind { Expr, Text, Newline };
+    Kind kind;
+    const SMTExpr *expr;
+    llvm::StringRef text;
+    // The indentation of the expression or of the line started by a newline
+    size_t indent;
+};
+}
+
+static PendingOutput pendingExpr(const SharedSMTRef &expr, size_t indent) {
+    return {PendingOutput::Kind::Expr, expr.get(), "", indent};
+}
+
+static PendingOutput pendingText(llvm::StringRef text) {
+    return {PendingOutput::Kind::Text, nullptr, text, 0};
+}
+
+// Writes the beginning of the expression and appends the rest of it in order
+// to 'pending'. Nodes that don’t have many levels below them are written
+// completely via their SExpr.
+static void serializeNode(const SMTExpr &expr, std::ostream &os, size_t indent,
+                          vector<PendingOutput> &pending) {
+    switch (expr.getTag()) {
+    case ExprTag::TypedVariable:
+        os << static_cast<const TypedVariable &>(expr).name;
+        return;
+    case ExprTag::ConstantString:
+        os << static_cast<const ConstantString &>(expr).value;
+        return;
+    case ExprTag::ConstantBool:
+        os << (static_cast<const ConstantBool &>(expr).value ? "true"
+                                                             : "false");
+        return;
+    case ExprTag::Assert:
+        os << (SMTGenerationOpts::getInstance().OutputFormat == SMTFormat::Z3
+                   ? "(rule "
+                   : "(assert ");
+        pending.push_back(
+            pendingExpr(static_cast<const Assert &>(expr).expr, indent + 3));
+        pending.push_back(pendingText(")"));
+        return;
+    case ExprTag::Forall: {
+        const auto &forall = static_cast<const Forall &>(expr);
+        if (forall.vars.empty()) {
+            pending.push_back(pendingExpr(forall.expr, indent));
+            return;
+        }
+        os << "(forall ";
+        serializeList(os, indent + 3, forall.vars,
+                      [&os](const SortedVar &var, size_t indent) {
+                          var.serialize(os, indent);
+                      });
+        os << " ";
+        pending.push_back(pendingExpr(forall.expr, indent + 3));
+        pending.push_back(pendingText(")"));
+        return;
+    }
+    case ExprTag::Let: {
+        // Mirrors serializeList for the definitions
+        const auto &let = static_cast<const Let &>(expr);
+        os << "(let (";
+        for (size_t i = 0; i < let.defs.size(); ++i) {
+            if (i > 0) {
+                pending.push_back(
+                    {PendingOutput::Kind::Newline, nullptr, "", indent + 4});
+            }
+            pending.push_back(pendingText("("));
+            pending.push_back(pendingText(let.defs[i].first));
+            pending.push_back(pendingText(" "));
+            pending.push_back(pendingExpr(let.defs[i].second, indent + 7));
+            pending.push_back(pendingText(")"));
+        }
+        pending.push_back(pendingText(") "));
+        pending.push_back(pendingExpr(let.expr, indent + 3));
+        pending.push_back(pendingText(")"));
+        return;
+    }
+    case ExprTag::Op: {
+        // The special cases have to be kept in sync with assembleSExpr
+        const auto &op = static_cast<const Op &>(expr);
+        if (op.opName == "and" && op.args.empty()) {
+            os << "true";
+            return;
+        }
+        if (op.opName == "and" && op.args.size() == 1) {
+            pending.push_back(pendingExpr(op.args.front(), indent));
+            return;
+        }
+        if (op.opName == "=>" && op.args.at(1)->isConstantFalse()) {
+            os << "(not ";
+            pending.push_back(pendingExpr(op.args.at(0), indent + 3));
+            pending.push_back(pendingText(")"));
+            return;
+        }
+        os << "(" << op.opName;
+        for (const auto &arg : op.args) {
+            pending.push_back(pendingText(" "));
+            pending.push_back(pendingExpr(arg, indent + 3));
+        }
+        pending.push_back(pendingText(")"));
+        return;
+    }
+    case ExprTag::FunDef: {
+        const auto &funDef = static_cast<const FunDef &>(expr);
+        os << "(define-fun " << funDef.funName << " ";
+        serializeList(os, indent + 3, funDef.args,
+                      [&os](const SortedVar &var, size_t indent) {
+                          var.serialize(os, indent);
+                      });
+        os << " ";
+        funDef.outType.toSExpr()->serialize(os, indent + 3, false);
+        os << " ";
+        pending.push_back(pendingExpr(funDef.body, indent + 3));
+        pending.push_back(pendingText(")"));
+        return;
+    }
+    default:
+        expr.toSExpr()->serialize(os, indent, false);
+        return;
+    }
+}
+
+void SMTExpr::serialize(std::ostream &os, size_t indent) const {
+    // The outputs of a node are appended in order and then reversed, so the
+    // back of the stack is always the next output
+    vector<PendingOutput> pending;
+    serializeNode(*this, os, indent, pending);
+    std::reverse(pending.begin(), pending.end());
+    while (!pending.empty()) {
+        const PendingOutput next = pending.back();
+        pending.pop_back();
+        switch (next.kind) {
+        case PendingOutput::Kind::Text:
+            os.write(next.text.data(),
+                     static_cast<std::streamsize>(next.text.size()));
+            break;
+        case PendingOutput::Kind::Newline:
+            os << "\n" << std::string(next.indent, ' ');
+            break;
+        case PendingOutput::Kind::Expr: {
+            const size_t begin = pending.size();
+            serializeNode(*next.expr, os, next.indent, pending);
+            std::reverse(pending.begin() + static_cast<std::ptrdiff_t>(begin),
+                         pending.end());
+            break;
+        }
+        }
+    }
+}
+
 struct CollectUsesVisitor : SMTVisitor {
     llvm::StringSet<> uses;
+    bool handles(ExprTag tag) const override {
+        return tag == ExprTag::ConstantString || tag == ExprTag::TypedVariable;
+    }
     void dispatch(ConstantString &str) override { uses.insert(str.value); }
     void dispatch(TypedVariable &var) override { uses.insert(var.name); }
 };
@@ -357,7 +709,8 @@ static llvm::StringSet<> collectUses(SMTExpr &expr) {
 
 // Implementations of mergeImplications
 
-SharedSMTRef SMTExpr::mergeImplications(std::vector<SharedSMTRef> conditions) {
+SharedSMTRef
+SMTExpr::mergeImplications(std::vector<SharedSMTRef> &conditions) {
     if (conditions.empty()) {
         return shared_from_this();
     } else {
@@ -366,30 +719,42 @@ SharedSMTRef SMTExpr::mergeImplications(std::vector<SharedSMTRef> conditions) {
     }
 }
 
-SharedSMTRef Assert::mergeImplications(std::vector<SharedSMTRef> conditions) {
+SharedSMTRef Assert::mergeImplications(std::vector<SharedSMTRef> &conditions) {
     assert(conditions.empty());
-    return make_shared<Assert>(expr->mergeImplications(std::move(conditions)));
+    SharedSMTRef merged = expr->mergeImplications(conditions);
+    if (merged == expr) {
+        return shared_from_this();
+    }
+    return make_shared<Assert>(std::move(merged));
 }
 
-SharedSMTRef Let::mergeImplications(std::vector<SharedSMTRef> conditions) {
-    return make_shared<Let>(defs,
-                            expr->mergeImplications(std::move(conditions)));
+SharedSMTRef Let::mergeImplications(std::vector<SharedSMTRef> &conditions) {
+    SharedSMTRef merged = expr->mergeImplications(conditions);
+    if (merged == expr) {
+        return shared_from_this();
+    }
+    return make_shared<Let>(defs, std::move(merged));
 }
 
-SharedSMTRef Op::mergeImplications(std::vector<SharedSMTRef> conditions) {
+SharedSMTRef Op::mergeImplications(std::vector<SharedSMTRef> &conditions) {
     if (opName == "=>") {
         assert(args.size() == 2);
         conditions.push_back(args.at(0));
-        return args.at(1)->mergeImplications(std::move(conditions));
+        SharedSMTRef merged = args.at(1)->mergeImplications(conditions);
+        conditions.pop_back();
+        return merged;
     } else {
         return makeOp("=>", make_shared<Op>("and", conditions),
                       shared_from_this());
     }
 }
 
-SharedSMTRef Forall::mergeImplications(std::vector<SharedSMTRef> conditions) {
-    return std::make_shared<Forall>(
-        vars, expr->mergeImplications(std::move(conditions)));
+SharedSMTRef Forall::mergeImplications(std::vector<SharedSMTRef> &conditions) {
+    SharedSMTRef merged = expr->mergeImplications(conditions);
+    if (merged == expr) {
+        return shared_from_this();
+    }
+    return std::make_shared<Forall>(vars, std::move(merged));
 }
 
 // Implementations of splitConjunctions()
@@ -447,107 +812,213 @@ vector<SharedSMTRef> Forall::splitConjunctions() {
 unique_ptr<const HeapInfo> SMTExpr::heapInfo() const { return nullptr; }
 
 unique_ptr<const HeapInfo> TypedVariable::heapInfo() const {
-    std::smatch matchResult;
-    if (std::regex_match(name, matchResult, HEAP_REGEX)) {
-        // The actual match counts too
-        assert(matchResult.size() == 3 || matchResult.size() == 4);
-        return make_unique<HeapInfo>(matchResult[1], matchResult[2],
-                                     matchResult[3]);
+    if (role != VarRole::Heap && role != VarRole::Stack) {
+        return nullptr;
     }
-    return nullptr;
+    // HEAP$<index><suffix> or STACK$<index><suffix>
+    const size_t arrayNameLength = role == VarRole::Heap ? 4 : 5;
+    return make_unique<HeapInfo>(name.substr(0, arrayNameLength),
+                                 name.substr(arrayNameLength + 1, 1),
+                                 name.substr(arrayNameLength + 2));
 }
 
 // Implementations of inlineLets
 
-SharedSMTRef SMTExpr::inlineLets(map<string, SharedSMTRef> assignments) {
-    return shared_from_this();
-}
-
-SharedSMTRef Assert::inlineLets(map<string, SharedSMTRef> assignments) {
-    return make_unique<Assert>(expr->inlineLets(assignments));
+namespace {
+struct InlineFrame {
+    SMTExpr *expr;
+    vector<SharedSMTRef> results;
+    // The previous values of the assignments that are changed by the
+    // bindings of this node, null if there was none
+    vector<std::pair<string, SharedSMTRef>> shadowed;
+};
 }
 
-SharedSMTRef Let::inlineLets(map<string, SharedSMTRef> assignments) {
-    for (const auto &def : defs) {
-        assignments[def.first] = def.second->inlineLets(assignments);
+// The children that are inlined, with the definitions of a let before its
+// body. Returns nullptr if there are no more children.
+static SMTExpr *inlineChild(SMTExpr &expr, size_t i) {
+    switch (expr.getTag()) {
+    case ExprTag::Assert:
+        return i == 0 ? static_cast<Assert &>(expr).expr.get() : nullptr;
+    case ExprTag::Forall:
+        return i == 0 ? static_cast<Forall &>(expr).expr.get() : nullptr;
+    case ExprTag::Let: {
+        auto &let = static_cast<Let &>(expr);
+        if (i < let.defs.size()) {
+            return let.defs[i].second.get();
+        }
+        return i == let.defs.size() ? let.expr.get() : nullptr;
+    }
+    case ExprTag::Op: {
+        auto &op = static_cast<Op &>(expr);
+        return i < op.args.size() ? op.args[i].get() : nullptr;
+    }
+    case ExprTag::FPCmp: {
+        auto &cmp = static_cast<FPCmp &>(expr);
+        return i == 0 ? cmp.op0.get() : i == 1 ? cmp.op1.get() : nullptr;
+    }
+    case ExprTag::BinaryFPOperator: {
+        auto &binOp = static_cast<BinaryFPOperator &>(expr);
+        return i == 0 ? binOp.op0.get() : i == 1 ? binOp.op1.get() : nullptr;
+    }
+    case ExprTag::TypeCast:
+        return i == 0 ? static_cast<TypeCast &>(expr).operand.get() : nullptr;
+    default:
+        return nullptr;
     }
-    return expr->inlineLets(assignments);
 }
 
-SharedSMTRef Forall::inlineLets(map<string, SharedSMTRef> assignments) {
-    for (const auto &var : vars) {
-        assignments.erase(var.name);
-    }
-    return make_unique<Forall>(vars, expr->inlineLets(assignments));
+static void shadow(InlineFrame &frame, const string &name,
+                   map<string, SharedSMTRef> &assignments) {
+    auto it = assignments.find(name);
+    frame.shadowed.push_back(
+        {name, it == assignments.end() ? nullptr : it->second});
 }
 
-SharedSMTRef Op::inlineLets(map<string, SharedSMTRef> assignments) {
-    vector<SharedSMTRef> newArgs;
-    for (const auto &arg : args) {
-        newArgs.push_back(arg->inlineLets(assignments));
+static void restoreShadowed(InlineFrame &frame,
+                            map<string, SharedSMTRef> &assignments) {
+    for (auto it = frame.shadowed.rbegin(); it != frame.shadowed.rend();
+         ++it) {
+        if (it->second) {
+            assignments[it->first] = it->second;
+        } else {
+            assignments.erase(it->first);
+        }
     }
-    return make_unique<Op>(opName, newArgs);
 }
 
-SharedSMTRef TypedVariable::inlineLets(map<string, SharedSMTRef> assignments) {
-    auto mapIt = assignments.find(name);
-    if (mapIt == assignments.end()) {
-        return shared_from_this();
+static InlineFrame enterInline(SMTExpr &expr,
+                               map<string, SharedSMTRef> &assignments) {
+    InlineFrame frame{&expr, {}, {}};
+    if (expr.getTag() == ExprTag::Forall) {
+        for (const auto &var : static_cast<Forall &>(expr).vars) {
+            shadow(frame, var.name, assignments);
+            assignments.erase(var.name);
+        }
     }
-    return mapIt->second;
+    return frame;
 }
 
-SharedSMTRef ConstantString::inlineLets(map<string, SharedSMTRef> assignments) {
-    auto mapIt = assignments.find(value);
-    if (mapIt == assignments.end()) {
-        return shared_from_this();
+// The result for a node without children
+static SharedSMTRef inlineLeaf(SMTExpr &expr,
+                               const map<string, SharedSMTRef> &assignments) {
+    const string *name = nullptr;
+    if (expr.getTag() == ExprTag::TypedVariable) {
+        name = &static_cast<TypedVariable &>(expr).name;
+    } else if (expr.getTag() == ExprTag::ConstantString) {
+        name = &static_cast<ConstantString &>(expr).value;
+    }
+    if (name) {
+        auto mapIt = assignments.find(*name);
+        if (mapIt != assignments.end()) {
+            return mapIt->second;
+        }
+    }
+    return expr.shared_from_this();
+}
+
+static SharedSMTRef assembleInlined(const SMTExpr &expr,
+                                    vector<SharedSMTRef> results) {
+    switch (expr.getTag()) {
+    case ExprTag::Assert:
+        return make_unique<Assert>(std::move(results[0]));
+    case ExprTag::Forall:
+        return make_unique<Forall>(static_cast<const Forall &>(expr).vars,
+                                   std::move(results[0]));
+    case ExprTag::Let:
+        return std::move(results.back());
+    case ExprTag::Op:
+        return make_unique<Op>(static_cast<const Op &>(expr).opName,
+                               std::move(results));
+    case ExprTag::FPCmp: {
+        const auto &cmp = static_cast<const FPCmp &>(expr);
+        return make_unique<FPCmp>(cmp.op, cmp.type, std::move(results[0]),
+                                  std::move(results[1]));
+    }
+    case ExprTag::BinaryFPOperator: {
+        const auto &binOp = static_cast<const BinaryFPOperator &>(expr);
+        return make_unique<BinaryFPOperator>(binOp.op, binOp.type,
+                                             std::move(results[0]),
+                                             std::move(results[1]));
+    }
+    case ExprTag::TypeCast: {
+        const auto &cast = static_cast<const TypeCast &>(expr);
+        return make_unique<TypeCast>(cast.op, cast.sourceType, cast.destType,
+                                     std::move(results[0]));
+    }
+    default:
+        llvm_unreachable("Node without children");
     }
-    return mapIt->second;
 }
 
-SharedSMTRef TypeCast::inlineLets(map<string, SharedSMTRef> assignments) {
-    return std::make_unique<TypeCast>(op, sourceType, destType,
-                                      operand->inlineLets(assignments));
+SharedSMTRef SMTExpr::inlineLets(map<string, SharedSMTRef> assignments) {
+    if (inlineChild(*this, 0) == nullptr) {
+        return inlineLeaf(*this, assignments);
+    }
+    vector<InlineFrame> stack;
+    stack.push_back(enterInline(*this, assignments));
+    while (true) {
+        InlineFrame &frame = stack.back();
+        if (SMTExpr *child = inlineChild(*frame.expr, frame.results.size())) {
+            if (inlineChild(*child, 0) != nullptr) {
+                stack.push_back(enterInline(*child, assignments));
+                continue;
+            }
+            frame.results.push_back(inlineLeaf(*child, assignments));
+        } else {
+            restoreShadowed(frame, assignments);
+            SharedSMTRef result =
+                assembleInlined(*frame.expr, std::move(frame.results));
+            stack.pop_back();
+            if (stack.empty()) {
+                return result;
+            }
+            stack.back().results.push_back(std::move(result));
+        }
+        // The later definitions and the body of a let see the inlined
+        // definition
+        InlineFrame &parent = stack.back();
+        if (parent.expr->getTag() == ExprTag::Let) {
+            const auto &let = static_cast<const Let &>(*parent.expr);
+            const size_t def = parent.results.size() - 1;
+            if (def < let.defs.size()) {
+                shadow(parent, let.defs[def].first, assignments);
+                assignments[let.defs[def].first] = parent.results.back();
+            }
+        }
+    }
 }
 
-SharedSMTRef
-BinaryFPOperator::inlineLets(map<string, SharedSMTRef> assignments) {
-    return make_unique<BinaryFPOperator>(op, type, op0->inlineLets(assignments),
-                                         op1->inlineLets(assignments));
-}
+// Implementations for using the z3 API
 
-SharedSMTRef FPCmp::inlineLets(map<string, SharedSMTRef> assignments) {
-    return make_unique<FPCmp>(op, type, op0->inlineLets(assignments),
-                              op1->inlineLets(assignments));
+// Bitvectors are rejected before the clauses are passed to z3 (see
+// hornClausesToZ3), so integers are always mathematical integers
+static z3::sort toZ3Sort(z3::context &cxt, const Type &type) {
+    switch (type.getTag()) {
+    case TypeTag::Int:
+        return cxt.int_sort();
+    case TypeTag::Bool:
+        return cxt.bool_sort();
+    case TypeTag::Array: {
+        const auto &array = type.get<ArrayType>();
+        return cxt.array_sort(toZ3Sort(cxt, array.domain),
+                              toZ3Sort(cxt, array.target));
+    }
+    default:
+        std::ostringstream sexpr;
+        sexpr << *type.toSExpr();
+        logError("Unsupported type for z3: " + sexpr.str() + "\n");
+        exit(1);
+    }
 }
 
-// Implementations for using the z3 API
-
 void VarDecl::toZ3(z3::context &cxt, z3::solver & /* unused */,
                    llvm::StringMap<z3::expr> &nameMap,
                    llvm::StringMap<Z3DefineFun> & /* unused */) const {
-    if (var.type.getTag() == TypeTag::Int) {
-        z3::expr c = cxt.int_const(var.name.c_str());
-        auto it = nameMap.insert({var.name, c});
-        if (!it.second) {
-            it.first->second = c;
-        }
-    } else if (var.type.getTag() == TypeTag::Array) {
-        z3::sort intArraySort = cxt.array_sort(cxt.int_sort(), cxt.int_sort());
-        z3::expr c = cxt.constant(var.name.c_str(), intArraySort);
-        auto it = nameMap.insert({var.name, c});
-        if (!it.second) {
-            it.first->second = c;
-        }
-    } else if (var.type.getTag() == TypeTag::Bool) {
-        z3::expr c = cxt.bool_const(var.name.c_str());
-        auto it = nameMap.insert({var.name, c});
-        if (!it.second) {
-            it.first->second = c;
-        }
-    } else {
-        logError("Unsupported type\n");
-        exit(1);
+    z3::expr c = cxt.constant(var.name.c_str(), toZ3Sort(cxt, var.type));
+    auto it = nameMap.insert({var.name, c});
+    if (!it.second) {
+        it.first->second = c;
     }
 }
 
@@ -557,6 +1028,28 @@ void Assert::toZ3(z3::context &cxt, z3::solver &solver,
     solver.add(expr->toZ3Expr(cxt, nameMap, defineFunMap));
 }
 
+void SetLogic::toZ3(z3::context & /* unused */, z3::solver & /* unused */,
+                    llvm::StringMap<z3::expr> & /* unused */,
+                    llvm::StringMap<Z3DefineFun> & /* unused */) const {
+    /* noop, the logic is selected when creating the solver */
+}
+
+void FunDecl::toZ3(z3::context &cxt, z3::solver & /* unused */,
+                   llvm::StringMap<z3::expr> & /* unused */,
+                   llvm::StringMap<Z3DefineFun> &defineFunMap) const {
+    z3::sort_vector domain(cxt);
+    z3::expr_vector vars(cxt);
+    for (size_t i = 0; i < inTypes.size(); ++i) {
+        z3::sort sort = toZ3Sort(cxt, inTypes.at(i));
+        domain.push_back(sort);
+        vars.push_back(
+            cxt.constant((funName + "$arg" + std::to_string(i)).c_str(), sort));
+    }
+    z3::func_decl fun =
+        cxt.function(funName.c_str(), domain, toZ3Sort(cxt, outType));
+    defineFunMap.insert({funName, {vars, fun(vars)}});
+}
+
 void CheckSat::toZ3(z3::context & /* unused */, z3::solver & /* unused */,
                     llvm::StringMap<z3::expr> & /* unused */,
                     llvm::StringMap<Z3DefineFun> & /* unused */) const {
@@ -653,6 +1146,34 @@ z3::expr Let::toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
     return expr->toZ3Expr(cxt, nameMap, defineFunMap);
 }
 
+z3::expr Forall::toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
+                          const llvm::StringMap<Z3DefineFun> &defineFunMap) const {
+    // Quantified variables shadow variables of the same name, so the previous
+    // bindings are restored afterwards
+    z3::expr_vector z3Vars(cxt);
+    vector<std::pair<string, z3::expr>> shadowed;
+    vector<string> introduced;
+    for (const auto &var : vars) {
+        z3::expr c = cxt.constant(var.name.c_str(), toZ3Sort(cxt, var.type));
+        z3Vars.push_back(c);
+        auto it = nameMap.insert({var.name, c});
+        if (it.second) {
+            introduced.push_back(var.name);
+        } else {
+            shadowed.push_back({var.name, it.first->second});
+            it.first->second = c;
+        }
+    }
+    z3::expr body = expr->toZ3Expr(cxt, nameMap, defineFunMap);
+    for (const auto &name : introduced) {
+        nameMap.erase(name);
+    }
+    for (const auto &binding : shadowed) {
+        nameMap.find(binding.first)->second = binding.second;
+    }
+    return z3::forall(z3Vars, body);
+}
+
 z3::expr Op::toZ3Expr(z3::context &cxt, llvm::StringMap<z3::expr> &nameMap,
                       const llvm::StringMap<Z3DefineFun> &defineFunMap) const {
     if (defineFunMap.count(opName) > 0) {
@@ -806,8 +1327,8 @@ void FunDef::toZ3(z3::context &cxt, z3::solver & /* unused */,
     defineFunMap.insert({funName, {vars, z3Body}});
 }
 
-std::unique_ptr<smt::SMTExpr> fastNestLets(std::unique_ptr<smt::SMTExpr> clause,
-                                           llvm::ArrayRef<Assignment> defs) {
+SharedSMTRef fastNestLets(SharedSMTRef clause,
+                          llvm::ArrayRef<Assignment> defs) {
     for (auto i = defs.rbegin(); i != defs.rend(); ++i) {
         clause = std::make_unique<Let>(AssignmentVec({std::move(*i)}),
                                        std::move(clause));
@@ -855,7 +1376,7 @@ unique_ptr<Op> makeOp(std::string opName,
     return make_unique<Op>(opName, smtArgs);
 }
 
-unique_ptr<Assignment> makeAssignment(string name, unique_ptr<SMTExpr> val) {
+unique_ptr<Assignment> makeAssignment(string name, SharedSMTRef val) {
     return make_unique<Assignment>(name, std::move(val));
 }
 bool isArray(const Type &type) { return type.getTag() == TypeTag::Array; }
@@ -872,140 +1393,283 @@ SortedVar sortedVarFromTypedVariable(const TypedVariable &var) {
     return {var.name, var.type};
 }
 
+// Implementations of the visitor traversal
+
+// A copy of the node as done by 'accept'
+static shared_ptr<SMTExpr> copyNode(const SMTExpr &expr) {
+    switch (expr.getTag()) {
+#define COPY_NODE(Class)                                                       \
+    case ExprTag::Class:                                                       \
+        return shared_ptr<Class>{new Class(static_cast<const Class &>(expr))};
+        COPY_NODE(SetLogic)
+        COPY_NODE(Assert)
+        COPY_NODE(TypedVariable)
+        COPY_NODE(Forall)
+        COPY_NODE(CheckSat)
+        COPY_NODE(GetModel)
+        COPY_NODE(Let)
+        COPY_NODE(ConstantFP)
+        COPY_NODE(ConstantInt)
+        COPY_NODE(ConstantBool)
+        COPY_NODE(ConstantString)
+        COPY_NODE(Op)
+        COPY_NODE(FPCmp)
+        COPY_NODE(BinaryFPOperator)
+        COPY_NODE(TypeCast)
+        COPY_NODE(Query)
+        COPY_NODE(FunDecl)
+        COPY_NODE(FunDef)
+        COPY_NODE(Comment)
+        COPY_NODE(VarDecl)
+#undef COPY_NODE
+    }
+    llvm_unreachable("Unknown expression tag");
+}
+
+static void dispatchNode(SMTExpr &expr, SMTVisitor &visitor) {
+    switch (expr.getTag()) {
+#define DISPATCH_NODE(Class)                                                   \
+    case ExprTag::Class:                                                       \
+        visitor.dispatch(static_cast<Class &>(expr));                          \
+        return;
+        DISPATCH_NODE(SetLogic)
+        DISPATCH_NODE(Assert)
+        DISPATCH_NODE(TypedVariable)
+        DISPATCH_NODE(Forall)
+        DISPATCH_NODE(CheckSat)
+        DISPATCH_NODE(GetModel)
+        DISPATCH_NODE(Let)
+        DISPATCH_NODE(ConstantFP)
+        DISPATCH_NODE(ConstantInt)
+        DISPATCH_NODE(ConstantBool)
+        DISPATCH_NODE(ConstantString)
+        DISPATCH_NODE(Op)
+        DISPATCH_NODE(FPCmp)
+        DISPATCH_NODE(BinaryFPOperator)
+        DISPATCH_NODE(TypeCast)
+        DISPATCH_NODE(Query)
+        DISPATCH_NODE(FunDecl)
+        DISPATCH_NODE(FunDef)
+        DISPATCH_NODE(Comment)
+        DISPATCH_NODE(VarDecl)
+#undef DISPATCH_NODE
+    }
+}
+
+static SharedSMTRef reassembleNode(SMTExpr &expr, SMTVisitor &visitor) {
+    switch (expr.getTag()) {
+#define REASSEMBLE_NODE(Class)                                                 \
+    case ExprTag::Class:                                                       \
+        return visitor.reassemble(static_cast<Class &>(expr));
+        REASSEMBLE_NODE(SetLogic)
+        REASSEMBLE_NODE(Assert)
+        REASSEMBLE_NODE(TypedVariable)
+        REASSEMBLE_NODE(Forall)
+        REASSEMBLE_NODE(CheckSat)
+        REASSEMBLE_NODE(GetModel)
+        REASSEMBLE_NODE(Let)
+        REASSEMBLE_NODE(ConstantFP)
+        REASSEMBLE_NODE(ConstantInt)
+        REASSEMBLE_NODE(ConstantBool)
+        REASSEMBLE_NODE(ConstantString)
+        REASSEMBLE_NODE(Op)
+        REASSEMBLE_NODE(FPCmp)
+        REASSEMBLE_NODE(BinaryFPOperator)
+        REASSEMBLE_NODE(TypeCast)
+        REASSEMBLE_NODE(Query)
+        REASSEMBLE_NODE(FunDecl)
+        REASSEMBLE_NODE(FunDef)
+        REASSEMBLE_NODE(Comment)
+        REASSEMBLE_NODE(VarDecl)
+#undef REASSEMBLE_NODE
+    }
+    llvm_unreachable("Unknown expression tag");
+}
+
+// The children that are visited, in order. The bindings of a let come before
+// its body unless the visitor ignores them. The operands of floating point
+// comparisons are not visited. Returns nullptr if there are no more
+// children.
+static SharedSMTRef *visitedChild(SMTExpr &expr, size_t i,
+                                  const SMTVisitor &visitor) {
+    switch (expr.getTag()) {
+    case ExprTag::Assert:
+        return i == 0 ? &static_cast<Assert &>(expr).expr : nullptr;
+    case ExprTag::Forall:
+        return i == 0 ? &static_cast<Forall &>(expr).expr : nullptr;
+    case ExprTag::Let: {
+        auto &let = static_cast<Let &>(expr);
+        const size_t defCount =
+            visitor.ignoreLetBindings ? 0 : let.defs.size();
+        if (i < defCount) {
+            return &let.defs[i].second;
+        }
+        return i == defCount ? &let.expr : nullptr;
+    }
+    case ExprTag::Op: {
+        auto &op = static_cast<Op &>(expr);
+        return i < op.args.size() ? &op.args[i] : nullptr;
+    }
+    case ExprTag::BinaryFPOperator: {
+        auto &binOp = static_cast<BinaryFPOperator &>(expr);
+        return i == 0 ? &binOp.op0 : i == 1 ? &binOp.op1 : nullptr;
+    }
+    case ExprTag::TypeCast:
+        return i == 0 ? &static_cast<TypeCast &>(expr).operand : nullptr;
+    case ExprTag::FunDef:
+        return i == 0 ? &static_cast<FunDef &>(expr).body : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+// The number of children that are visited before 'dispatch' is called on a
+// handled node
+static size_t childrenBeforeDispatch(const SMTExpr &expr,
+                                     const SMTVisitor &visitor) {
+    switch (expr.getTag()) {
+    case ExprTag::Let:
+        return visitor.ignoreLetBindings
+                   ? 0
+                   : static_cast<const Let &>(expr).defs.size();
+    case ExprTag::TypeCast:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+namespace {
+struct VisitFrame {
+    // The node before visiting it, null for the root of 'accept'
+    SharedSMTRef original;
+    // The copy that is dispatched on for handled nodes. Other nodes are only
+    // copied once one of their children changes.
+    SharedSMTRef copy;
+    bool handled;
+    bool dispatched;
+    size_t next;
+    SMTExpr &node() { return copy ? *copy : *original; }
+};
+}
+
+static VisitFrame enterVisit(const SharedSMTRef &expr, SMTVisitor &visitor) {
+    const bool handled = visitor.handlesNode(*expr);
+    return {expr, handled ? copyNode(*expr) : nullptr, handled, false, 0};
+}
+
+// Visits the nodes in depth-first order, children before their parents, with
+// an explicit stack so that the depth of the expression doesn’t matter
+static SharedSMTRef visitFrom(VisitFrame root, SMTVisitor &visitor) {
+    vector<VisitFrame> stack;
+    stack.push_back(std::move(root));
+    while (true) {
+        VisitFrame &frame = stack.back();
+        if (frame.handled && !frame.dispatched &&
+            frame.next == childrenBeforeDispatch(frame.node(), visitor)) {
+            dispatchNode(frame.node(), visitor);
+            frame.dispatched = true;
+        }
+        if (SharedSMTRef *child =
+                visitedChild(frame.node(), frame.next, visitor)) {
+            // Copying the child reference keeps it alive while the copy of
+            // the node may be changed
+            SharedSMTRef childRef = *child;
+            stack.push_back(enterVisit(childRef, visitor));
+            continue;
+        }
+        SharedSMTRef result = frame.handled
+                                  ? reassembleNode(*frame.copy, visitor)
+                                  : (frame.copy ? frame.copy : frame.original);
+        stack.pop_back();
+        if (stack.empty()) {
+            return result;
+        }
+        VisitFrame &parent = stack.back();
+        SharedSMTRef &slot = *visitedChild(parent.node(), parent.next, visitor);
+        if (result != slot) {
+            if (!parent.copy) {
+                parent.copy = copyNode(*parent.original);
+            }
+            *visitedChild(*parent.copy, parent.next, visitor) =
+                std::move(result);
+        }
+        ++parent.next;
+    }
+}
+
+SharedSMTRef visit(const SharedSMTRef &expr, SMTVisitor &visitor) {
+    return visitFrom(enterVisit(expr, visitor), visitor);
+}
+
+// Every node is handled by 'accept' itself, its children only if the visitor
+// handles them
+static SharedSMTRef acceptNode(const SMTExpr &expr, SMTVisitor &visitor) {
+    return visitFrom({nullptr, copyNode(expr), true, false, 0}, visitor);
+}
+
 shared_ptr<SMTExpr> SetLogic::accept(SMTVisitor &visitor) const {
-    shared_ptr<SetLogic> result{new SetLogic(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> Assert::accept(SMTVisitor &visitor) const {
-    shared_ptr<Assert> result{new Assert(*this)};
-    visitor.dispatch(*result);
-    result->expr = result->expr->accept(visitor);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> TypedVariable::accept(SMTVisitor &visitor) const {
-    shared_ptr<TypedVariable> result{new TypedVariable(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> Forall::accept(SMTVisitor &visitor) const {
-    shared_ptr<Forall> result{new Forall(*this)};
-    visitor.dispatch(*result);
-    result->expr = result->expr->accept(visitor);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> CheckSat::accept(SMTVisitor &visitor) const {
-    shared_ptr<CheckSat> result{new CheckSat(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> GetModel::accept(SMTVisitor &visitor) const {
-    shared_ptr<GetModel> result{new GetModel(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> Let::accept(SMTVisitor &visitor) const {
-    shared_ptr<Let> result{new Let(*this)};
     // It is slightly unclear if bindings should be traversed before or after
     // the let itself. However let statements cannot be recursive and it thus
     // makes sense to traverse them first.
-    if (!visitor.ignoreLetBindings) {
-        for (auto &def : result->defs) {
-            def.second = def.second->accept(visitor);
-        }
-    }
-    visitor.dispatch(*result);
-    result->expr = result->expr->accept(visitor);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> ConstantFP::accept(SMTVisitor &visitor) const {
-    shared_ptr<ConstantFP> result{new ConstantFP(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> ConstantInt::accept(SMTVisitor &visitor) const {
-    shared_ptr<ConstantInt> result{new ConstantInt(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> ConstantBool::accept(SMTVisitor &visitor) const {
-    shared_ptr<ConstantBool> result{new ConstantBool(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> ConstantString::accept(SMTVisitor &visitor) const {
-    shared_ptr<ConstantString> result{new ConstantString(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> Op::accept(SMTVisitor &visitor) const {
-    shared_ptr<Op> result{new Op(*this)};
-    visitor.dispatch(*result);
-    for (auto &arg : result->args) {
-        arg = arg->accept(visitor);
-    }
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> FPCmp::accept(SMTVisitor &visitor) const {
-    shared_ptr<FPCmp> result{new FPCmp(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> BinaryFPOperator::accept(SMTVisitor &visitor) const {
-    shared_ptr<BinaryFPOperator> result{new BinaryFPOperator(*this)};
-    visitor.dispatch(*result);
-    result->op0 = result->op0->accept(visitor);
-    result->op1 = result->op1->accept(visitor);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> TypeCast::accept(SMTVisitor &visitor) const {
-    shared_ptr<TypeCast> result{new TypeCast(*this)};
-    result->operand = result->operand->accept(visitor);
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    // The operand is visited before the cast is dispatched on
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> Query::accept(SMTVisitor &visitor) const {
-    shared_ptr<Query> result{new Query(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> FunDecl::accept(SMTVisitor &visitor) const {
-    shared_ptr<FunDecl> result{new FunDecl(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> FunDef::accept(SMTVisitor &visitor) const {
-    shared_ptr<FunDef> result{new FunDef(*this)};
-    visitor.dispatch(*result);
-    result->body = result->body->accept(visitor);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> Comment::accept(SMTVisitor &visitor) const {
-    shared_ptr<Comment> result{new Comment(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
+    return acceptNode(*this, visitor);
 }
 shared_ptr<SMTExpr> VarDecl::accept(SMTVisitor &visitor) const {
-    shared_ptr<VarDecl> result{new VarDecl(*this)};
-    visitor.dispatch(*result);
-    return visitor.reassemble(*result);
-}
+    return acceptNode(*this, visitor);
 }
-
-static size_t lexerOffset;
-static const char *lexerInput;
-void setSMTLexerInput(const char *input) {
-    lexerOffset = 0;
-    lexerInput = input;
-}
-int readInputForLexer(char *buffer, int *numBytesRead, int maxBytesToRead) {
-    int numBytesToRead = maxBytesToRead;
-    int bytesRemaining = strlen(lexerInput) - lexerOffset;
-    if (numBytesToRead > bytesRemaining) {
-        numBytesToRead = bytesRemaining;
-    }
-    memcpy(buffer, lexerInput + lexerOffset, numBytesToRead);
-    *numBytesRead = numBytesToRead;
-    lexerOffset += numBytesToRead;
-    return 0;
 }
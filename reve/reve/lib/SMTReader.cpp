@@ -0,0 +1,609 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SMTReader.h"
+
+#include "GzipStream.h"
+#include "Logging.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+
+using std::make_shared;
+using std::make_unique;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace smt {
+
+SMTReader::SMTReader(llvm::StringRef input, llvm::StringRef bufferName,
+                     HashConsFactory &factory, SMTDialect dialect)
+    : input(input), bufferName(bufferName), factory(factory),
+      dialect(dialect), pos(input.begin()) {}
+
+void SMTReader::error(llvm::StringRef message, const char *at) {
+    llvm::StringRef before = input.slice(0, at - input.begin());
+    size_t line = before.count('\n') + 1;
+    size_t lineStart = before.rfind('\n');
+    size_t column = lineStart == llvm::StringRef::npos
+                        ? before.size() + 1
+                        : before.size() - lineStart;
+    logError(bufferName.str() + ":" + std::to_string(line) + ":" +
+             std::to_string(column) + ": " + message.str() + "\n");
+    exit(1);
+}
+
+void SMTReader::skipWhitespace() {
+    while (pos != input.end()) {
+        if (*pos == ';') {
+            while (pos != input.end() && *pos != '\n') {
+                ++pos;
+            }
+        } else if (isspace(static_cast<unsigned char>(*pos))) {
+            ++pos;
+        } else {
+            return;
+        }
+    }
+}
+
+static bool isSymbolChar(char c) {
+    return !isspace(static_cast<unsigned char>(c)) && c != '(' && c != ')' &&
+           c != ';' && c != '"' && c != '|';
+}
+
+auto SMTReader::next() -> Token {
+    skipWhitespace();
+    const char *start = pos;
+    const char *end = input.end();
+    if (pos == end) {
+        return {TokenKind::End, {}};
+    }
+    auto token = [&](TokenKind kind) -> Token {
+        return {kind, llvm::StringRef(start, pos - start)};
+    };
+    switch (*pos) {
+    case '(':
+        ++pos;
+        return token(TokenKind::LPar);
+    case ')':
+        ++pos;
+        return token(TokenKind::RPar);
+    case '"':
+        // Quotes are escaped by doubling them
+        for (++pos; pos != end; ++pos) {
+            if (*pos == '"') {
+                if (pos + 1 == end || pos[1] != '"') {
+                    ++pos;
+                    return token(TokenKind::String);
+                }
+                ++pos;
+            }
+        }
+        error("unterminated string literal", start);
+    case '|':
+        pos = std::find(pos + 1, end, '|');
+        if (pos == end) {
+            error("unterminated quoted symbol", start);
+        }
+        ++pos;
+        return token(TokenKind::Symbol);
+    case '#': {
+        TokenKind kind;
+        if (pos + 1 != end && pos[1] == 'x') {
+            kind = TokenKind::Hexadecimal;
+        } else if (pos + 1 != end && pos[1] == 'b') {
+            kind = TokenKind::Binary;
+        } else {
+            error("expected #x or #b", start);
+        }
+        pos += 2;
+        while (pos != end && isalnum(static_cast<unsigned char>(*pos))) {
+            ++pos;
+        }
+        if (pos - start == 2) {
+            error("expected digits", start);
+        }
+        return token(kind);
+    }
+    default:
+        break;
+    }
+    if (isdigit(static_cast<unsigned char>(*pos))) {
+        while (pos != end && isdigit(static_cast<unsigned char>(*pos))) {
+            ++pos;
+        }
+        if (pos != end && *pos == '.') {
+            error("decimals are not supported", start);
+        }
+        return token(TokenKind::Numeral);
+    }
+    // Everything that doesn’t start another token is part of a symbol, so
+    // this consumes at least one character
+    while (pos != end && isSymbolChar(*pos)) {
+        ++pos;
+    }
+    return token(*start == ':' ? TokenKind::Keyword : TokenKind::Symbol);
+}
+
+auto SMTReader::peek() -> Token {
+    const char *saved = pos;
+    Token token = next();
+    pos = saved;
+    return token;
+}
+
+auto SMTReader::expect(TokenKind kind, llvm::StringRef what) -> Token {
+    Token token = next();
+    if (token.kind != kind) {
+        error("expected " + what.str(), token.kind == TokenKind::End
+                                            ? input.end()
+                                            : token.text.begin());
+    }
+    return token;
+}
+
+auto SMTReader::atEnd() -> bool {
+    skipWhitespace();
+    return pos == input.end();
+}
+
+void SMTReader::skipList() {
+    const char *start = pos;
+    unsigned depth = 1;
+    while (depth > 0) {
+        Token token = next();
+        if (token.kind == TokenKind::LPar) {
+            ++depth;
+        } else if (token.kind == TokenKind::RPar) {
+            --depth;
+        } else if (token.kind == TokenKind::End) {
+            error("unterminated list", start);
+        }
+    }
+}
+
+auto SMTReader::readIndexedName() -> string {
+    const char *start = pos;
+    string name = "(";
+    unsigned depth = 1;
+    while (depth > 0) {
+        Token token = next();
+        switch (token.kind) {
+        case TokenKind::End:
+            error("unterminated list", start);
+        case TokenKind::RPar:
+            name += ')';
+            --depth;
+            break;
+        default:
+            if (name.back() != '(') {
+                name += ' ';
+            }
+            name += token.text.str();
+            if (token.kind == TokenKind::LPar) {
+                ++depth;
+            }
+            break;
+        }
+    }
+    return name;
+}
+
+static auto parseUnsigned(llvm::StringRef text) -> unsigned {
+    unsigned value = 0;
+    // The lexer only produces numerals consisting of digits, so this can only
+    // fail for values that don’t fit
+    if (text.getAsInteger(10, value)) {
+        logError("Numeral out of range: " + text.str() + "\n");
+        exit(1);
+    }
+    return value;
+}
+
+auto SMTReader::intWidth() const -> unsigned {
+    return dialect == SMTDialect::CustomRelation ? 32 : 64;
+}
+
+auto SMTReader::readSort() -> Type {
+    Token token = next();
+    if (token.kind == TokenKind::Symbol) {
+        if (token.text == "Int") {
+            return IntType(intWidth());
+        } else if (token.text == "Bool") {
+            return boolType();
+        } else if (token.text == "Real") {
+            // Reals are only used for floating point numbers if bitvectors
+            // are disabled so the precision doesn’t matter
+            return FloatType(11, 53);
+        }
+    } else if (token.kind == TokenKind::LPar) {
+        Token head = expect(TokenKind::Symbol, "a sort");
+        if (head.text == "Array") {
+            Type domain = readSort();
+            Type target = readSort();
+            expect(TokenKind::RPar, "')'");
+            return ArrayType(std::move(domain), std::move(target));
+        } else if (head.text == "_") {
+            Token kind = expect(TokenKind::Symbol, "a sort");
+            if (kind.text == "BitVec") {
+                unsigned width = parseUnsigned(
+                    expect(TokenKind::Numeral, "a bit width").text);
+                expect(TokenKind::RPar, "')'");
+                return IntType(width);
+            } else if (kind.text == "FloatingPoint") {
+                unsigned exponent = parseUnsigned(
+                    expect(TokenKind::Numeral, "an exponent width").text);
+                unsigned significand = parseUnsigned(
+                    expect(TokenKind::Numeral, "a significand width").text);
+                expect(TokenKind::RPar, "')'");
+                return FloatType(exponent, significand);
+            }
+            token = kind;
+        } else {
+            token = head;
+        }
+    }
+    error("unsupported sort", token.text.empty() ? pos : token.text.begin());
+}
+
+auto SMTReader::readSorts() -> vector<Type> {
+    expect(TokenKind::LPar, "a list of sorts");
+    vector<Type> sorts;
+    while (peek().kind != TokenKind::RPar) {
+        sorts.push_back(readSort());
+    }
+    next();
+    return sorts;
+}
+
+auto SMTReader::variableName(llvm::StringRef name) -> string {
+    if (dialect == SMTDialect::CustomRelation && name != "result$1" &&
+        name != "result$2" && name != "HEAP$1" && name != "HEAP$2") {
+        return name.str() + "_0";
+    }
+    return name.str();
+}
+
+void SMTReader::bind(llvm::StringRef name, string boundName,
+                     unique_ptr<Type> type) {
+    scope.push_back({name, std::move(boundName), std::move(type)});
+}
+
+auto SMTReader::readSortedVars() -> vector<SortedVar> {
+    expect(TokenKind::LPar, "a list of sorted variables");
+    vector<SortedVar> vars;
+    while (peek().kind != TokenKind::RPar) {
+        expect(TokenKind::LPar, "a sorted variable");
+        Token name = expect(TokenKind::Symbol, "a variable name");
+        Type type = readSort();
+        expect(TokenKind::RPar, "')'");
+        vars.emplace_back(variableName(name.text), type);
+        bind(name.text, vars.back().name, make_unique<Type>(std::move(type)));
+    }
+    next();
+    return vars;
+}
+
+auto SMTReader::identifier(llvm::StringRef name) -> SharedSMTRef {
+    for (auto it = scope.rbegin(), e = scope.rend(); it != e; ++it) {
+        if (it->name == name) {
+            if (it->type) {
+                return factory.variable(it->boundName, *it->type);
+            }
+            return factory.constantString(it->boundName);
+        }
+    }
+    if (dialect == SMTDialect::CustomRelation &&
+        (name == "HEAP$1" || name == "HEAP$2")) {
+        return factory.variable(name.str(), memoryType());
+    }
+    return factory.constantString(variableName(name));
+}
+
+auto SMTReader::readNumeral(llvm::StringRef text, unsigned radix,
+                            unsigned bitWidth) -> SharedSMTRef {
+    unsigned needed = llvm::APInt::getBitsNeeded(text, radix);
+    return factory.constantInt(
+        llvm::APInt(std::max(bitWidth, needed), text, radix));
+}
+
+auto SMTReader::readBinder(llvm::StringRef binder) -> SharedSMTRef {
+    size_t scopeSize = scope.size();
+    SharedSMTRef result;
+    if (binder == "forall") {
+        vector<SortedVar> vars = readSortedVars();
+        result = make_shared<Forall>(std::move(vars), readTerm());
+    } else {
+        // The bindings of a let are parallel, so they are only visible in
+        // the body
+        expect(TokenKind::LPar, "a list of bindings");
+        AssignmentVec defs;
+        vector<llvm::StringRef> names;
+        while (peek().kind != TokenKind::RPar) {
+            expect(TokenKind::LPar, "a binding");
+            Token name = expect(TokenKind::Symbol, "a variable name");
+            defs.push_back({variableName(name.text), readTerm()});
+            names.push_back(name.text);
+            expect(TokenKind::RPar, "')'");
+        }
+        next();
+        for (size_t i = 0; i < defs.size(); ++i) {
+            bind(names[i], defs[i].first, nullptr);
+        }
+        result = make_shared<Let>(std::move(defs), readTerm());
+    }
+    expect(TokenKind::RPar, "')'");
+    scope.resize(scopeSize);
+    return factory.adopt(std::move(result));
+}
+
+auto SMTReader::readTerm() -> SharedSMTRef {
+    Token token = next();
+    switch (token.kind) {
+    case TokenKind::LPar:
+        return readList();
+    case TokenKind::Numeral:
+        return readNumeral(token.text, 10, intWidth());
+    case TokenKind::Hexadecimal:
+        return readNumeral(token.text.drop_front(2), 16,
+                           4 * (token.text.size() - 2));
+    case TokenKind::Binary:
+        return readNumeral(token.text.drop_front(2), 2,
+                           token.text.size() - 2);
+    case TokenKind::Symbol:
+        if (token.text == "true") {
+            return factory.constantBool(true);
+        } else if (token.text == "false") {
+            return factory.constantBool(false);
+        }
+        return identifier(token.text);
+    case TokenKind::End:
+        error("expected a term", input.end());
+    default:
+        error("expected a term", token.text.begin());
+    }
+}
+
+// Called after the opening parenthesis has been read
+auto SMTReader::readList() -> SharedSMTRef {
+    Token head = peek();
+    string opName;
+    if (head.kind == TokenKind::LPar) {
+        next();
+        Token indexed = peek();
+        if (indexed.kind == TokenKind::Symbol &&
+            (indexed.text == "_" || indexed.text == "as")) {
+            opName = readIndexedName();
+        } else {
+            // Redundant parentheses around a term, these are allowed in
+            // custom relations
+            SharedSMTRef term = readList();
+            expect(TokenKind::RPar, "')'");
+            return term;
+        }
+    } else if (head.kind == TokenKind::Symbol) {
+        if (head.text == "forall" || head.text == "let") {
+            next();
+            return readBinder(head.text);
+        } else if (head.text == "exists") {
+            error("existential quantifiers are not supported",
+                  head.text.begin());
+        } else if (head.text == "!") {
+            // Annotations don’t change the meaning of a term
+            next();
+            SharedSMTRef term = readTerm();
+            skipList();
+            return term;
+        } else if (head.text == "_") {
+            next();
+            Token index = expect(TokenKind::Symbol, "an indexed identifier");
+            if (index.text.startswith("bv") &&
+                peek().kind == TokenKind::Numeral) {
+                llvm::StringRef value = index.text.drop_front(2);
+                unsigned width = parseUnsigned(next().text);
+                expect(TokenKind::RPar, "')'");
+                if (value.empty() ||
+                    !std::all_of(value.begin(), value.end(),
+                                 [](char c) { return isdigit(c) != 0; }) ||
+                    llvm::APInt::getBitsNeeded(value, 10) > width) {
+                    error("invalid bitvector constant", index.text.begin());
+                }
+                return factory.constantInt(llvm::APInt(width, value, 10));
+            }
+            // Other indexed constants are kept literally, like the ones
+            // created by makeOp("_", …)
+            vector<SharedSMTRef> args = {
+                factory.constantString(index.text.str())};
+            Token token;
+            while ((token = next()).kind != TokenKind::RPar) {
+                if (token.kind == TokenKind::End ||
+                    token.kind == TokenKind::LPar) {
+                    error("invalid indexed identifier", index.text.begin());
+                }
+                args.push_back(factory.constantString(token.text.str()));
+            }
+            return factory.op("_", std::move(args));
+        } else {
+            next();
+            opName = head.text.str();
+        }
+    } else {
+        // An atom in redundant parentheses
+        SharedSMTRef term = readTerm();
+        expect(TokenKind::RPar, "')'");
+        return term;
+    }
+    vector<SharedSMTRef> args;
+    while (peek().kind != TokenKind::RPar) {
+        args.push_back(readTerm());
+    }
+    next();
+    if (args.empty()) {
+        // An identifier in redundant parentheses
+        return identifier(opName);
+    }
+    return factory.op(std::move(opName), std::move(args));
+}
+
+auto SMTReader::readCommand(llvm::StringRef name) -> SharedSMTRef {
+    const char *start = name.begin();
+    auto symbol = [&](llvm::StringRef what) {
+        return expect(TokenKind::Symbol, what).text.str();
+    };
+    auto close = [&] { expect(TokenKind::RPar, "')'"); };
+    SharedSMTRef command;
+    if (name == "set-logic") {
+        command = make_shared<SetLogic>(symbol("a logic"));
+        close();
+    } else if (name == "declare-fun") {
+        string funName = symbol("a function name");
+        vector<Type> argTypes = readSorts();
+        Type outType = readSort();
+        close();
+        command = make_shared<FunDecl>(funName, std::move(argTypes), outType);
+    } else if (name == "declare-rel") {
+        string relName = symbol("a relation name");
+        vector<Type> argTypes = readSorts();
+        close();
+        command =
+            make_shared<FunDecl>(relName, std::move(argTypes), boolType());
+    } else if (name == "declare-const") {
+        string constName = symbol("a constant name");
+        Type type = readSort();
+        close();
+        command = make_shared<FunDecl>(constName, vector<Type>(), type);
+    } else if (name == "declare-var") {
+        string varName = symbol("a variable name");
+        Type type = readSort();
+        close();
+        command = make_shared<VarDecl>(SortedVar(varName, type));
+    } else if (name == "define-fun") {
+        string funName = symbol("a function name");
+        size_t scopeSize = scope.size();
+        vector<SortedVar> args = readSortedVars();
+        Type outType = readSort();
+        SharedSMTRef body = readTerm();
+        scope.resize(scopeSize);
+        close();
+        command = make_shared<FunDef>(funName, std::move(args), outType,
+                                      std::move(body));
+    } else if (name == "assert" || name == "rule") {
+        SharedSMTRef expr = readTerm();
+        // muZ rules can be named
+        if (name == "rule" && peek().kind == TokenKind::Symbol) {
+            next();
+        }
+        close();
+        command = make_shared<Assert>(std::move(expr));
+    } else if (name == "query") {
+        // The attributes are added again by Query::toSExpr
+        command = make_shared<Query>(symbol("a relation name"));
+        skipList();
+    } else if (name == "check-sat") {
+        close();
+        command = make_shared<CheckSat>();
+    } else if (name == "get-model") {
+        close();
+        command = make_shared<GetModel>();
+    } else if (name == "set-option" || name == "set-info" || name == "exit" ||
+               name == "echo" || name == "get-info") {
+        skipList();
+    } else {
+        error("unsupported command '" + name.str() + "'", start);
+    }
+    return command;
+}
+
+auto SMTReader::readCommands() -> vector<SharedSMTRef> {
+    vector<SharedSMTRef> commands;
+    while (!atEnd()) {
+        expect(TokenKind::LPar, "a command");
+        Token name = expect(TokenKind::Symbol, "a command");
+        if (SharedSMTRef command = readCommand(name.text)) {
+            commands.push_back(std::move(command));
+        }
+    }
+    return commands;
+}
+
+auto readSMTFile(const string &fileName, HashConsFactory &factory)
+    -> vector<SharedSMTRef> {
+    // The nodes copy the names they use, so the buffer can be unmapped once
+    // the file has been read
+    auto buffer = llvm::MemoryBuffer::getFile(fileName);
+    if (!buffer) {
+        logError("Cannot read " + fileName + ": " +
+                 buffer.getError().message() + "\n");
+        exit(1);
+    }
+    llvm::StringRef data = (*buffer)->getBuffer();
+    string decompressed;
+    if (isGzip(data)) {
+        if (!gunzip(data, decompressed)) {
+            logError("Cannot decompress " + fileName + "\n");
+            exit(1);
+        }
+        data = decompressed;
+    }
+    SMTReader reader(data, fileName, factory);
+    return reader.readCommands();
+}
+
+// The end of the s-expression starting at 'begin', or npos if it is not
+// closed. Symbols can be quoted by '|' and contain parentheses in that case.
+static size_t sexprEnd(llvm::StringRef text, size_t begin) {
+    int depth = 0;
+    bool quoted = false;
+    for (size_t i = begin; i < text.size(); ++i) {
+        if (text[i] == '|') {
+            quoted = !quoted;
+        } else if (!quoted && text[i] == '(') {
+            ++depth;
+        } else if (!quoted && text[i] == ')' && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return llvm::StringRef::npos;
+}
+
+auto modelDefinitions(llvm::StringRef model) -> std::map<string, string> {
+    std::map<string, string> definitions;
+    const llvm::StringRef defineFun = "(define-fun ";
+    size_t pos = model.find(defineFun);
+    while (pos != llvm::StringRef::npos) {
+        size_t end = sexprEnd(model, pos);
+        if (end == llvm::StringRef::npos) {
+            break;
+        }
+        llvm::StringRef definition = model.slice(pos, end);
+        llvm::StringRef name = definition.drop_front(defineFun.size()).ltrim();
+        name = name.substr(0, name.find_first_of(" \t\n("));
+        definitions[name.str()] = definition.str();
+        pos = model.find(defineFun, end);
+    }
+    return definitions;
+}
+}
+
+smt::SharedSMTRef parseSMT(llvm::StringRef input) {
+    smt::HashConsFactory factory;
+    smt::SMTReader reader(input, "custom relation", factory,
+                          smt::SMTDialect::CustomRelation);
+    smt::SharedSMTRef relation = reader.readTerm();
+    if (!reader.atEnd()) {
+        logError("Unexpected input after custom relation: " + input.str() +
+                 "\n");
+        exit(1);
+    }
+    return relation;
+}
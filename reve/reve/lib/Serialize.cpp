@@ -10,15 +10,32 @@
 
 #include "Serialize.h"
 
+#include "Components.h"
+#include "GzipStream.h"
+#include "HashCons.h"
+#include "Json.h"
+#include "Helper.h"
+#include "Simplify.h"
+#include "SolverStatistics.h"
+#include "Statistics.h"
+
+#include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/Path.h>
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <sstream>
 
 using smt::SharedSMTRef;
 using smt::SortedVar;
 using smt::VarDecl;
 using std::vector;
+using smt::ExprTag;
 using smt::Forall;
 using smt::Op;
 using std::set;
@@ -61,26 +78,37 @@ struct VariableRenamer : smt::SMTVisitor {
     const llvm::StringMap<std::string> &variableNameMap;
     VariableRenamer(const llvm::StringMap<std::string> &variableNameMap)
         : variableNameMap(variableNameMap) {}
+    bool handles(ExprTag tag) const override {
+        return tag == ExprTag::TypedVariable;
+    }
     void dispatch(smt::TypedVariable &var) override {
         auto foundIt = variableNameMap.find(var.name);
         if (foundIt != variableNameMap.end()) {
-            var.name = foundIt->second;
+            var.rename(foundIt->second);
         }
     }
 };
 
-static void renameVariables(smt::SMTExpr &expr,
-                            llvm::StringMap<std::string> variableNameMap) {
+static SharedSMTRef
+renameVariables(const smt::SMTExpr &expr,
+                const llvm::StringMap<std::string> &variableNameMap) {
     VariableRenamer renamer{variableNameMap};
-    expr.accept(renamer);
+    return expr.accept(renamer);
+}
+
+// Visitors that only rename variables and their binders
+static bool handlesNames(ExprTag tag) {
+    return tag == ExprTag::TypedVariable || tag == ExprTag::ConstantString ||
+           tag == ExprTag::Let || tag == ExprTag::Forall;
 }
 
 struct AssignmentRenameVisitor : smt::SMTVisitor {
     llvm::StringMap<unsigned> variableMap;
+    bool handles(ExprTag tag) const override { return handlesNames(tag); }
     void dispatch(smt::TypedVariable &var) override {
         auto foundIt = variableMap.find(var.name);
         if (foundIt != variableMap.end()) {
-            var.name += "_" + std::to_string(foundIt->getValue());
+            var.rename(var.name + "_" + std::to_string(foundIt->getValue()));
         }
     }
     // There are still some places left where we use ConstantString instead of
@@ -113,10 +141,47 @@ static shared_ptr<smt::SMTExpr> renameAssignments(smt::SMTExpr &expr) {
     return expr.accept(visitor);
 };
 
+// Rename bound variables to names that only depend on the order in which they
+// are bound. Names have to be unique for this to be correct, i.e.,
+// 'renameAssignments' needs to be applied first.
+struct CanonicalNameVisitor : smt::SMTVisitor {
+    llvm::StringMap<std::string> variableMap;
+    bool handles(ExprTag tag) const override { return handlesNames(tag); }
+    void bind(std::string &name) {
+        std::string canonicalName =
+            "bound$" + std::to_string(variableMap.size());
+        variableMap[name] = canonicalName;
+        name = canonicalName;
+    }
+    void dispatch(smt::TypedVariable &var) override {
+        auto foundIt = variableMap.find(var.name);
+        if (foundIt != variableMap.end()) {
+            var.rename(foundIt->getValue());
+        }
+    }
+    void dispatch(smt::ConstantString &str) override {
+        auto foundIt = variableMap.find(str.value);
+        if (foundIt != variableMap.end()) {
+            str.value = foundIt->getValue();
+        }
+    }
+    void dispatch(smt::Let &let) override {
+        for (auto &assignment : let.defs) {
+            bind(assignment.first);
+        }
+    }
+    void dispatch(Forall &forall) override {
+        for (auto &var : forall.vars) {
+            bind(var.name);
+        }
+    }
+};
+
 struct RemoveForallVisitor : smt::SMTVisitor {
     std::set<SortedVar> &introducedVariables;
     RemoveForallVisitor(std::set<SortedVar> &introducedVariables)
         : introducedVariables(introducedVariables) {}
+    bool handles(ExprTag tag) const override { return tag == ExprTag::Forall; }
     shared_ptr<smt::SMTExpr> reassemble(Forall &forall) override {
         for (const auto &var : forall.vars) {
             introducedVariables.insert(var);
@@ -175,23 +240,147 @@ static shared_ptr<smt::SMTExpr> compressLets(smt::SMTExpr &expr) {
     return expr.accept(visitor);
 }
 
+// Does the work of compressLets, renameAssignments and removeForalls (in this
+// order) in a single traversal, so each node is only copied once instead of
+// once per transformation. Lets are handled as in CompressLetVisitor and names
+// as in AssignmentRenameVisitor. Let bindings aren’t compressed, so they only
+// need to be renamed.
+struct NormalizeClauseVisitor : smt::SMTVisitor {
+    std::set<SortedVar> &introducedVariables;
+    AssignmentRenameVisitor renamer;
+    std::vector<smt::Assignment> defs;
+    std::map<smt::SMTExpr *, std::vector<smt::Assignment>> storedDefs;
+    NormalizeClauseVisitor(std::set<SortedVar> &introducedVariables)
+        : smt::SMTVisitor(true), introducedVariables(introducedVariables) {}
+    void dispatch(smt::TypedVariable &var) override { renamer.dispatch(var); }
+    void dispatch(smt::ConstantString &str) override { renamer.dispatch(str); }
+    void dispatch(Forall &forall) override {
+        renamer.dispatch(forall);
+        storedDefs.insert({&forall, defs});
+        defs.clear();
+    }
+    shared_ptr<smt::SMTExpr> reassemble(Forall &forall) override {
+        for (const auto &var : forall.vars) {
+            introducedVariables.insert(var);
+        }
+        defs.clear();
+        return nestLets(forall.expr, storedDefs.at(&forall));
+    }
+    void dispatch(smt::Let &let) override {
+        // The bindings of a let refer to the names before the let, so they
+        // are renamed before the let itself
+        for (auto &def : let.defs) {
+            def.second = smt::visit(def.second, renamer);
+        }
+        renamer.dispatch(let);
+        defs.insert(defs.end(), let.defs.begin(), let.defs.end());
+    }
+    shared_ptr<smt::SMTExpr> reassemble(smt::Let &let) override {
+        return let.expr;
+    }
+    void dispatch(Op &op) override {
+        storedDefs.insert({&op, defs});
+        defs.clear();
+    }
+    shared_ptr<smt::SMTExpr> reassemble(Op &op) override {
+        auto ret = nestLets(op.shared_from_this(), storedDefs.at(&op));
+        defs.clear();
+        return ret;
+    }
+    shared_ptr<smt::SMTExpr> reassemble(smt::ConstantString &str) override {
+        auto ret = nestLets(str.shared_from_this(), defs);
+        defs.clear();
+        return ret;
+    }
+    shared_ptr<smt::SMTExpr> reassemble(smt::ConstantBool &cbool) override {
+        auto ret = nestLets(cbool.shared_from_this(), defs);
+        defs.clear();
+        return ret;
+    }
+};
+
+// The transformations applied to each toplevel expression in the muZ format
+// except for inlining lets. Merging implications only rebuilds the nodes on
+// the path from the root to the conclusion, all other nodes are shared with
+// the result of the traversal.
+static SharedSMTRef normalizeClause(const smt::SMTExpr &expr,
+                                    std::set<SortedVar> &introducedVariables) {
+    NormalizeClauseVisitor visitor{introducedVariables};
+    vector<SharedSMTRef> conditions;
+    return expr.accept(visitor)->mergeImplications(conditions);
+}
+
+// For each predicate with array arguments the positions of these arguments,
+// taken from its declaration
+using ArrayArguments = llvm::StringMap<vector<bool>>;
+
+static ArrayArguments indexArrayArguments(const vector<SharedSMTRef> &exprs) {
+    ArrayArguments index;
+    for (const auto &expr : exprs) {
+        if (expr->getTag() != ExprTag::FunDecl) {
+            continue;
+        }
+        const auto &decl = static_cast<const smt::FunDecl &>(*expr);
+        vector<bool> isArrayArg;
+        for (const auto &type : decl.inTypes) {
+            isArrayArg.push_back(isArray(type));
+        }
+        if (std::find(isArrayArg.begin(), isArrayArg.end(), true) !=
+            isArrayArg.end()) {
+            index[decl.funName] = std::move(isArrayArg);
+        }
+    }
+    return index;
+}
+
+static bool isArrayVariable(const smt::SMTExpr &expr) {
+    return expr.getTag() == ExprTag::TypedVariable &&
+           isArray(static_cast<const smt::TypedVariable &>(expr).type);
+}
+
+// Only the declarations and applications of predicates with array arguments
+// and equalities of arrays are rewritten, all other nodes are shared with the
+// input, so clauses without arrays are returned as they are.
 struct InstantiateArraysVisitor : smt::SMTVisitor {
-    InstantiateArraysVisitor() : smt::SMTVisitor(true) {}
-    shared_ptr<smt::SMTExpr> reassemble(Op &op) {
-        if (op.opName.compare(0, 4, "INV_") == 0 || op.opName == "INIT") {
+    const ArrayArguments &arrayArguments;
+    explicit InstantiateArraysVisitor(const ArrayArguments &arrayArguments)
+        : smt::SMTVisitor(true), arrayArguments(arrayArguments) {}
+    bool handlesNode(const smt::SMTExpr &expr) const override {
+        switch (expr.getTag()) {
+        case ExprTag::Op: {
+            const auto &op = static_cast<const Op &>(expr);
+            if (op.opName == "=") {
+                return op.args.size() == 2 && isArrayVariable(*op.args[0]);
+            }
+            return isPredicate(op.opName) && arrayArguments.count(op.opName);
+        }
+        case ExprTag::FunDecl:
+            return arrayArguments.count(
+                static_cast<const smt::FunDecl &>(expr).funName);
+        default:
+            return false;
+        }
+    }
+    static bool isPredicate(const std::string &name) {
+        return name.compare(0, 4, "INV_") == 0 || name == "INIT";
+    }
+    shared_ptr<smt::SMTExpr> reassemble(Op &op) override {
+        if (isPredicate(op.opName)) {
+            const auto &isArrayArg = arrayArguments.find(op.opName)->second;
             std::vector<SortedVar> indices;
             std::vector<SharedSMTRef> newArgs;
-            for (const auto &arg : op.args) {
-                if (auto array = arg->heapInfo()) {
-                    if (op.instantiate) {
-                        std::string index = "i" + array->index + array->suffix;
-                        newArgs.push_back(smt::stringExpr(index));
-                        newArgs.push_back(
-                            makeOp("select", arg, smt::stringExpr(index)));
-                        indices.push_back({index, smt::pointerType()});
-                    } else {
-                        newArgs.push_back(arg);
-                    }
+            for (size_t i = 0; i < op.args.size(); ++i) {
+                const auto &arg = op.args[i];
+                std::unique_ptr<const smt::HeapInfo> array;
+                if (op.instantiate && i < isArrayArg.size() && isArrayArg[i]) {
+                    array = arg->heapInfo();
+                }
+                if (array) {
+                    std::string index = "i" + array->index + array->suffix;
+                    newArgs.push_back(smt::stringExpr(index));
+                    newArgs.push_back(
+                        makeOp("select", arg, smt::stringExpr(index)));
+                    indices.push_back({index, smt::pointerType()});
                 } else {
                     newArgs.push_back(arg);
                 }
@@ -199,8 +388,7 @@ struct InstantiateArraysVisitor : smt::SMTVisitor {
             return std::make_shared<Forall>(
                 indices, std::make_unique<Op>(op.opName, newArgs));
         }
-        if (op.opName == "=" && op.args.size() == 2 &&
-            op.args.at(0)->heapInfo()) {
+        if (op.args.at(0)->heapInfo()) {
             std::vector<SortedVar> indices = {{"i", smt::pointerType()}};
             return std::make_shared<Forall>(
                 indices, makeOp("=", makeOp("select", op.args.at(0), "i"),
@@ -208,7 +396,7 @@ struct InstantiateArraysVisitor : smt::SMTVisitor {
         }
         return op.shared_from_this();
     }
-    shared_ptr<smt::SMTExpr> reassemble(smt::FunDecl &funDecl) {
+    shared_ptr<smt::SMTExpr> reassemble(smt::FunDecl &funDecl) override {
         std::vector<smt::Type> newInTypes;
         for (const auto &type : funDecl.inTypes) {
             if (isArray(type)) {
@@ -223,46 +411,201 @@ struct InstantiateArraysVisitor : smt::SMTVisitor {
     }
 };
 
-static shared_ptr<smt::SMTExpr> instantiateArrays(smt::SMTExpr &expr) {
-    InstantiateArraysVisitor visitor;
-    return expr.accept(visitor);
+static SharedSMTRef instantiateArrays(const SharedSMTRef &expr,
+                                      const ArrayArguments &arrayArguments) {
+    InstantiateArraysVisitor visitor(arrayArguments);
+    return smt::visit(expr, visitor);
 }
 
-void serializeSMT(vector<SharedSMTRef> smtExprs, bool muZ, SerializeOpts opts) {
-    // write to file or to stdout
-    std::streambuf *buf;
-    std::ofstream ofStream;
+// The transformations applied to each toplevel expression in the SMT-HORN
+// format, both when serializing it and when passing it to z3 directly
+static SharedSMTRef prepareHornClause(SharedSMTRef expr,
+                                      const SerializeOpts &opts,
+                                      const ArrayArguments &arrayArguments,
+                                      smt::HashConsFactory &exprFactory) {
+    if (opts.InlineLets) {
+        expr = exprFactory.intern(*renameAssignments(*expr)->inlineLets({}));
+    }
+    if (opts.MergeImplications) {
+        vector<SharedSMTRef> conditions;
+        expr = expr->mergeImplications(conditions);
+    }
+    if (opts.Simplify) {
+        expr = smt::simplify(expr);
+        if (opts.InlineLets) {
+            expr = exprFactory.intern(*expr);
+        }
+    }
+    if (!opts.DontInstantiate) {
+        expr = instantiateArrays(expr, arrayArguments);
+    }
+    if (opts.ShareSubterms) {
+        expr = smt::bindSharedSubterms(expr);
+    }
+    return expr;
+}
 
-    if (!opts.OutputFileName.empty()) {
-        ofStream.open(opts.OutputFileName);
-        buf = ofStream.rdbuf();
+static void printHornClause(SharedSMTRef expr, const SerializeOpts &opts,
+                            const ArrayArguments &arrayArguments,
+                            smt::HashConsFactory &exprFactory,
+                            std::ostream &out) {
+    if (opts.Pretty) {
+        expr = compressLets(*expr);
+    }
+    expr = prepareHornClause(expr, opts, arrayArguments, exprFactory);
+    if (opts.Simplify && smt::isTriviallyTrue(*expr)) {
+        stats::count("serialize.dropped clauses");
+        return;
+    }
+    if (opts.Pretty) {
+        expr->toSExpr()->serialize(out, 0, true);
     } else {
-        buf = std::cout.rdbuf();
+        // Avoid building an SExpr mirror of the whole expression
+        expr->serialize(out, 0);
     }
+    out << "\n";
+}
 
-    std::ostream outFile(buf);
+// Calls 'process' for all indices in [begin, end) using up to 'jobs' threads.
+// The range is split into contiguous slices that are processed by separate
+// tasks. Factories can’t be shared between threads, so every slice gets its
+// own one.
+static void
+processInSlices(size_t begin, size_t end, unsigned jobs,
+                const std::function<void(size_t, smt::HashConsFactory &)>
+                    &process) {
+    vector<std::function<void()>> tasks;
+    const size_t sliceCount = std::max(jobs, 1u);
+    const size_t sliceSize = (end - begin + sliceCount - 1) / sliceCount;
+    for (size_t sliceBegin = begin; sliceBegin < end;
+         sliceBegin += sliceSize) {
+        const size_t sliceEnd = std::min(end, sliceBegin + sliceSize);
+        tasks.push_back([&process, sliceBegin, sliceEnd] {
+            smt::HashConsFactory exprFactory;
+            for (size_t i = sliceBegin; i < sliceEnd; ++i) {
+                process(i, exprFactory);
+            }
+            stats::count("serialize.shared nodes", exprFactory.size());
+        });
+    }
+    runInParallel(tasks, jobs);
+}
+
+// Writes the clauses printed by 'print' for the indices [0, count) to 'out'
+// in order. With more than one job the clauses are printed to separate
+// buffers on worker threads. The buffers are written out in batches, so only
+// a small part of the output is held in memory at once.
+static void
+printClauses(size_t count, unsigned jobs, std::ostream &out,
+             const std::function<void(size_t, std::ostream &,
+                                      smt::HashConsFactory &)> &print) {
+    if (jobs <= 1) {
+        // Inlining lets duplicates the assigned expressions at every use, so
+        // we share identical subterms across all clauses.
+        smt::HashConsFactory exprFactory;
+        for (size_t i = 0; i < count; ++i) {
+            print(i, out, exprFactory);
+        }
+        stats::count("serialize.shared nodes", exprFactory.size());
+        return;
+    }
+    const size_t batchSize = 8 * jobs;
+    vector<std::string> buffers;
+    for (size_t begin = 0; begin < count; begin += batchSize) {
+        const size_t end = std::min(count, begin + batchSize);
+        buffers.assign(end - begin, "");
+        processInSlices(begin, end, jobs,
+                        [&](size_t i, smt::HashConsFactory &exprFactory) {
+                            std::ostringstream buffer;
+                            print(i, buffer, exprFactory);
+                            buffers[i - begin] = buffer.str();
+                        });
+        for (const auto &buffer : buffers) {
+            out << buffer;
+        }
+    }
+}
+
+// The commands of a query that are part of the CHC-COMP format, the others
+// are dropped or are errors
+static auto chcCompCommands(const vector<SharedSMTRef> &smtExprs)
+    -> vector<SharedSMTRef> {
+    vector<SharedSMTRef> commands;
+    for (const auto &expr : smtExprs) {
+        switch (expr->getTag()) {
+        case ExprTag::SetLogic:
+        case ExprTag::Assert:
+        case ExprTag::CheckSat:
+            commands.push_back(expr);
+            break;
+        case ExprTag::GetModel:
+        case ExprTag::Comment:
+            break;
+        case ExprTag::FunDecl: {
+            const auto &decl = static_cast<const smt::FunDecl &>(*expr);
+            if (decl.outType.getTag() != smt::TypeTag::Bool) {
+                logError("The CHC-COMP format has no uninterpreted "
+                         "functions, " +
+                         decl.funName + " cannot be declared\n");
+                exit(1);
+            }
+            commands.push_back(expr);
+            break;
+        }
+        case ExprTag::FunDef:
+            logError("The CHC-COMP format has no definitions, " +
+                     static_cast<const smt::FunDef &>(*expr).funName +
+                     " cannot be defined\n");
+            exit(1);
+        default:
+            logError("Only Horn clauses can be written in the CHC-COMP "
+                     "format\n");
+            exit(1);
+        }
+    }
+    return commands;
+}
+
+void writeSMT(std::ostream &outFile, vector<SharedSMTRef> smtExprs, bool muZ,
+              const SerializeOpts &opts) {
+    // Not available if we write to a pipe
+    const std::streamoff startPos = outFile.tellp();
 
-    int i = 0;
     if (muZ) {
-        set<SortedVar> introducedVariables;
-        vector<SharedSMTRef> preparedSMTExprs;
         // Explicit casts are significantly easier to debug
         outFile << *makeOp("set-option", ":int-real-coercions",
                            std::make_unique<smt::ConstantBool>(false))
                         ->toSExpr()
                 << "\n";
-        vector<SharedSMTRef> letCompressedExprs;
-        for (const auto &smt : smtExprs) {
-            auto splitSMTs = smt->splitConjunctions();
-            for (auto &expr : splitSMTs) {
-                expr = renameAssignments(*compressLets(*expr));
-                if (opts.InlineLets) {
-                    expr = expr->inlineLets({});
+        // The variables introduced by a clause have to be known before any
+        // clause can be written, so normalizing and printing the clauses are
+        // two separate steps
+        vector<vector<SharedSMTRef>> splitSMTExprs(smtExprs.size());
+        vector<set<SortedVar>> clauseVariables(smtExprs.size());
+        processInSlices(
+            0, smtExprs.size(), opts.Jobs,
+            [&](size_t i, smt::HashConsFactory &exprFactory) {
+                splitSMTExprs[i] = smtExprs[i]->splitConjunctions();
+                for (auto &expr : splitSMTExprs[i]) {
+                    expr = normalizeClause(*expr, clauseVariables[i]);
+                    // Bound variables have unique names at this point, so
+                    // inlining after foralls have been removed and
+                    // implications have been merged yields the same clauses
+                    if (opts.InlineLets) {
+                        expr = exprFactory.intern(*expr->inlineLets({}));
+                    }
                 }
-                expr = removeForalls(*expr, introducedVariables);
-                preparedSMTExprs.push_back(expr->mergeImplications({}));
-            }
+            });
+        set<SortedVar> introducedVariables;
+        vector<SharedSMTRef> preparedSMTExprs;
+        for (size_t i = 0; i < smtExprs.size(); ++i) {
+            introducedVariables.insert(clauseVariables[i].begin(),
+                                       clauseVariables[i].end());
+            preparedSMTExprs.insert(preparedSMTExprs.end(),
+                                    splitSMTExprs[i].begin(),
+                                    splitSMTExprs[i].end());
         }
+        splitSMTExprs.clear();
         const auto renamedVariables =
             simplifyVariableNames(introducedVariables, opts.InlineLets);
         for (const auto &var : introducedVariables) {
@@ -270,32 +613,286 @@ void serializeSMT(vector<SharedSMTRef> smtExprs, bool muZ, SerializeOpts opts) {
                             .toSExpr();
             outFile << "\n";
         }
-        for (const auto &smt : preparedSMTExprs) {
-            renameVariables(*smt, renamedVariables);
-            outFile << *smt->toSExpr();
-            outFile << "\n";
-        }
+        printClauses(preparedSMTExprs.size(), opts.Jobs, outFile,
+                     [&](size_t i, std::ostream &out,
+                         smt::HashConsFactory & /* unused */) {
+                         auto smt = renameVariables(*preparedSMTExprs[i],
+                                                    renamedVariables);
+                         if (opts.Pretty) {
+                             out << *smt->toSExpr();
+                         } else {
+                             smt->serialize(out, 0);
+                         }
+                         out << "\n";
+                     });
+        stats::count("serialize.clauses", preparedSMTExprs.size());
     } else {
-        for (auto &expr : smtExprs) {
-            if (opts.Pretty) {
-                expr = compressLets(*expr);
-            }
-            if (opts.InlineLets) {
-                expr = renameAssignments(*expr)->inlineLets({});
-            }
-            if (opts.MergeImplications) {
-                expr = expr->mergeImplications({});
-            }
-            if (!opts.DontInstantiate) {
-                expr = instantiateArrays(*expr);
-            }
-            expr->toSExpr()->serialize(outFile, 0, opts.Pretty);
-            outFile << "\n";
-            ++i;
+        SerializeOpts hornOpts = opts;
+        if (opts.ChcComp) {
+            smtExprs = chcCompCommands(smtExprs);
+            hornOpts.MergeImplications = true;
+            hornOpts.InlineLets = true;
+            hornOpts.ShareSubterms = false;
+        }
+        if (opts.Order == ClauseOrder::Topological) {
+            smtExprs = orderClauses(smtExprs);
         }
+        const ArrayArguments arrayArguments = indexArrayArguments(smtExprs);
+        printClauses(
+            smtExprs.size(), hornOpts.Jobs, outFile,
+            [&](size_t i, std::ostream &out,
+                smt::HashConsFactory &exprFactory) {
+                printHornClause(smtExprs[i], hornOpts, arrayArguments,
+                                exprFactory, out);
+            });
+        if (opts.ChcComp) {
+            outFile << "(exit)\n";
+        }
+        stats::count("serialize.clauses", smtExprs.size());
+    }
+    const std::streamoff endPos = outFile.tellp();
+    if (startPos >= 0 && endPos >= startPos) {
+        stats::count("serialize.bytes", endPos - startPos);
+    }
+}
+
+void serializeSMT(vector<SharedSMTRef> smtExprs, bool muZ, SerializeOpts opts) {
+    stats::ScopedTimer timer("serialize");
+    // write to file or to stdout
+    std::streambuf *buf;
+    std::ofstream ofStream;
+    std::unique_ptr<GzipFileBuffer> gzipBuffer;
+    // The output files can get very large so use a bigger buffer than the
+    // default one. This needs to be set before opening the file.
+    std::vector<char> fileBuffer(1 << 16);
+
+    if (!opts.OutputFileName.empty() && opts.Compress) {
+        gzipBuffer = std::make_unique<GzipFileBuffer>(opts.OutputFileName);
+        if (!gzipBuffer->isOpen()) {
+            logError("Couldn’t open " + opts.OutputFileName + "\n");
+            exit(1);
+        }
+        buf = gzipBuffer.get();
+    } else if (!opts.OutputFileName.empty()) {
+        ofStream.rdbuf()->pubsetbuf(fileBuffer.data(), fileBuffer.size());
+        ofStream.open(opts.OutputFileName);
+        buf = ofStream.rdbuf();
+    } else {
+        buf = std::cout.rdbuf();
     }
 
+    std::ostream outFile(buf);
+    writeSMT(outFile, std::move(smtExprs), muZ, opts);
+
+    if (gzipBuffer && !gzipBuffer->close()) {
+        logError("Couldn’t write " + opts.OutputFileName + "\n");
+        exit(1);
+    }
     if (!opts.OutputFileName.empty()) {
         ofStream.close();
     }
 }
+
+namespace {
+// The expressions written to a single file of the sharded output
+struct Shard {
+    std::string FileName;
+    vector<SharedSMTRef> Exprs;
+};
+}
+
+static void writeShard(const Shard &shard, const SerializeOpts &opts,
+                       const ArrayArguments &arrayArguments) {
+    std::vector<char> fileBuffer(1 << 16);
+    std::ofstream outFile;
+    outFile.rdbuf()->pubsetbuf(fileBuffer.data(), fileBuffer.size());
+    outFile.open(shard.FileName);
+    if (!outFile) {
+        logError("Couldn’t open " + shard.FileName + "\n");
+        exit(1);
+    }
+    smt::HashConsFactory exprFactory;
+    for (const auto &expr : shard.Exprs) {
+        printHornClause(expr, opts, arrayArguments, exprFactory, outFile);
+    }
+    stats::count("serialize.shared nodes", exprFactory.size());
+    const std::streamoff size = outFile.tellp();
+    if (size >= 0) {
+        stats::count("serialize.bytes", size);
+    }
+}
+
+// The manifest is written to a temporary file first so that its presence
+// implies that all shards are complete
+static void writeManifest(const std::string &fileName, const Shard &header,
+                          const vector<Shard> &shards) {
+    std::ostringstream manifest;
+    manifest << "{\"header\": ";
+    manifest << jsonString(llvm::sys::path::filename(header.FileName));
+    manifest << ",\n \"shards\": [";
+    for (size_t i = 0; i < shards.size(); ++i) {
+        manifest << (i > 0 ? ",\n  " : "\n  ") << "{\"file\": ";
+        manifest << jsonString(llvm::sys::path::filename(shards[i].FileName));
+        manifest << ", \"clauses\": " << shards[i].Exprs.size() << "}";
+    }
+    manifest << "\n]}\n";
+
+    const std::string tmpFileName = fileName + ".tmp";
+    {
+        std::ofstream outFile(tmpFileName);
+        outFile << manifest.str();
+        if (!outFile) {
+            logError("Couldn’t write " + tmpFileName + "\n");
+            exit(1);
+        }
+    }
+    if (std::error_code errorCode =
+            llvm::sys::fs::rename(tmpFileName, fileName)) {
+        logError("Couldn’t write " + fileName + ": " + errorCode.message() +
+                 "\n");
+        exit(1);
+    }
+}
+
+auto manifestFileName(const std::string &fileName) -> std::string {
+    llvm::SmallString<128> path(fileName);
+    llvm::sys::path::replace_extension(path, "manifest.json");
+    return path.str().str();
+}
+
+void serializeShards(const vector<SharedSMTRef> &smtExprs,
+                     const SerializeOpts &opts) {
+    stats::ScopedTimer timer("serialize");
+    const ComponentAssignment assignment = assignComponents(smtExprs);
+    const ArrayArguments arrayArguments = indexArrayArguments(smtExprs);
+
+    Shard header{componentFileName(opts.OutputFileName, "header"), {}};
+    vector<Shard> shards(assignment.ComponentCount);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i].FileName = componentFileName(opts.OutputFileName, i);
+    }
+    // Commands that have to come after the clauses are repeated at the end
+    // of every shard
+    vector<SharedSMTRef> trailer;
+    for (size_t i = 0; i < smtExprs.size(); ++i) {
+        const SharedSMTRef &expr = smtExprs[i];
+        const size_t component = assignment.Components[i];
+        if (expr->getTag() == ExprTag::CheckSat ||
+            expr->getTag() == ExprTag::GetModel) {
+            trailer.push_back(expr);
+        } else if (component == ComponentAssignment::SharedComponent ||
+                   expr->getTag() == ExprTag::FunDecl) {
+            // Predicates are declared in the header even if they are unused
+            // so every shard can be solved together with the header alone
+            header.Exprs.push_back(expr);
+        } else if (component != ComponentAssignment::NoComponent) {
+            shards[component].Exprs.push_back(expr);
+        }
+    }
+    size_t clauseCount = 0;
+    for (auto &shard : shards) {
+        clauseCount += shard.Exprs.size();
+        shard.Exprs.insert(shard.Exprs.end(), trailer.begin(), trailer.end());
+    }
+
+    // Every file is written by a single task in one pass, the shards are
+    // independent so they can be printed concurrently
+    vector<std::function<void()>> tasks;
+    tasks.push_back([&] { writeShard(header, opts, arrayArguments); });
+    for (const auto &shard : shards) {
+        tasks.push_back([&opts, &arrayArguments, &shard] {
+            writeShard(shard, opts, arrayArguments);
+        });
+    }
+    runInParallel(tasks, opts.Jobs);
+    writeManifest(manifestFileName(opts.OutputFileName), header, shards);
+    stats::count("serialize.clauses", clauseCount);
+    stats::count("serialize.shards", shards.size());
+}
+
+std::string queryHash(vector<SharedSMTRef> smtExprs, SerializeOpts opts) {
+    smt::HashConsFactory exprFactory;
+    const ArrayArguments arrayArguments = indexArrayArguments(smtExprs);
+    llvm::MD5 hash;
+    for (auto &expr : smtExprs) {
+        expr = renameAssignments(
+            *prepareHornClause(expr, opts, arrayArguments, exprFactory));
+        CanonicalNameVisitor visitor;
+        expr = smt::visit(expr, visitor);
+        std::ostringstream clause;
+        expr->serialize(clause, 0);
+        hash.update(clause.str());
+        hash.update(llvm::StringRef("\0", 1));
+    }
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hexResult;
+    llvm::MD5::stringifyResult(result, hexResult);
+    return hexResult.str();
+}
+
+auto hornClausesToZ3(vector<SharedSMTRef> smtExprs, const SerializeOpts &opts,
+                     z3::context &cxt, llvm::StringSet<> &predicates)
+    -> llvm::Optional<vector<z3::expr>> {
+    if (SMTGenerationOpts::getInstance().BitVect) {
+        logError("Bitvectors are not supported by the z3 API, solve the "
+                 "clauses with an external solver instead\n");
+        return llvm::None;
+    }
+    // Declarations and definitions do not add assertions to the solver
+    z3::solver unused(cxt);
+    llvm::StringMap<z3::expr> nameMap;
+    llvm::StringMap<smt::Z3DefineFun> defineFunMap;
+    smt::HashConsFactory exprFactory;
+    if (opts.Order == ClauseOrder::Topological) {
+        smtExprs = orderClauses(smtExprs);
+    }
+    const ArrayArguments arrayArguments = indexArrayArguments(smtExprs);
+    vector<z3::expr> clauses;
+    for (auto &expr : smtExprs) {
+        expr = prepareHornClause(expr, opts, arrayArguments, exprFactory);
+        if (opts.Simplify && smt::isTriviallyTrue(*expr)) {
+            continue;
+        }
+        if (const auto assertion = expr->asAssert()) {
+            clauses.push_back(
+                assertion->expr->toZ3Expr(cxt, nameMap, defineFunMap));
+            continue;
+        }
+        if (expr->getTag() == ExprTag::FunDecl) {
+            predicates.insert(
+                static_cast<const smt::FunDecl &>(*expr).funName);
+        }
+        expr->toZ3(cxt, unused, nameMap, defineFunMap);
+    }
+    return clauses;
+}
+
+SolverOutput solveWithZ3(vector<SharedSMTRef> smtExprs, SerializeOpts opts) {
+    z3::context cxt;
+    // The HORN logic selects the same engine (spacer) that is used when the
+    // serialized clauses are passed to z3
+    z3::solver solver(cxt, "HORN");
+    llvm::StringSet<> predicates;
+    const auto clauses =
+        hornClausesToZ3(std::move(smtExprs), opts, cxt, predicates);
+    if (!clauses) {
+        return {SolverResult::Unknown, ""};
+    }
+    for (const auto &clause : *clauses) {
+        solver.add(clause);
+    }
+    const z3::check_result result = solver.check();
+    recordZ3Statistics(solver, predicates, result == z3::sat);
+    switch (result) {
+    case z3::sat: {
+        std::ostringstream model;
+        model << solver.get_model() << "\n";
+        return {SolverResult::Sat, model.str()};
+    }
+    case z3::unsat:
+        return {SolverResult::Unsat, ""};
+    default:
+        return {SolverResult::Unknown, ""};
+    }
+}
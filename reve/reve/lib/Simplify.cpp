@@ -0,0 +1,364 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Simplify.h"
+
+#include "Statistics.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+namespace smt {
+
+// Integer constants are folded in this width and only kept if the result
+// fits into 64 bits, so the folding can’t overflow
+static const unsigned FoldWidth = 128;
+
+static auto boolValue(const SMTExpr &expr) -> llvm::Optional<bool> {
+    if (expr.getTag() == ExprTag::ConstantBool) {
+        return static_cast<const ConstantBool &>(expr).value;
+    }
+    return llvm::None;
+}
+
+static auto intValue(const SMTExpr &expr) -> llvm::Optional<llvm::APInt> {
+    if (expr.getTag() == ExprTag::ConstantInt) {
+        return static_cast<const ConstantInt &>(expr).value.sext(FoldWidth);
+    }
+    return llvm::None;
+}
+
+static auto constantBool(bool value) -> SharedSMTRef {
+    return make_shared<ConstantBool>(value);
+}
+
+// Structural equality of terms, variables are equal if they have the same
+// name which is fine since both terms are in the same scope
+static bool syntacticallyEqual(const SMTExpr &a, const SMTExpr &b) {
+    if (&a == &b) {
+        return true;
+    }
+    if (a.getTag() != b.getTag()) {
+        return false;
+    }
+    switch (a.getTag()) {
+    case ExprTag::TypedVariable:
+        return static_cast<const TypedVariable &>(a).name ==
+               static_cast<const TypedVariable &>(b).name;
+    case ExprTag::ConstantBool:
+        return *boolValue(a) == *boolValue(b);
+    case ExprTag::ConstantInt:
+        return static_cast<const ConstantInt &>(a).value.getBitWidth() ==
+                   static_cast<const ConstantInt &>(b).value.getBitWidth() &&
+               *intValue(a) == *intValue(b);
+    case ExprTag::Op: {
+        const auto &opA = static_cast<const Op &>(a);
+        const auto &opB = static_cast<const Op &>(b);
+        if (opA.opName != opB.opName || opA.args.size() != opB.args.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < opA.args.size(); ++i) {
+            if (!syntacticallyEqual(*opA.args[i], *opB.args[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Flattens nested applications of 'opName', drops the neutral element and
+// returns the absorbing element if it is one of the arguments
+static auto simplifyJunction(const Op &op, bool neutral) -> SharedSMTRef {
+    vector<SharedSMTRef> args;
+    vector<SharedSMTRef> worklist(op.args.rbegin(), op.args.rend());
+    bool changed = false;
+    while (!worklist.empty()) {
+        SharedSMTRef arg = std::move(worklist.back());
+        worklist.pop_back();
+        if (auto value = boolValue(*arg)) {
+            if (*value != neutral) {
+                return constantBool(!neutral);
+            }
+            changed = true;
+            continue;
+        }
+        if (arg->getTag() == ExprTag::Op &&
+            static_cast<const Op &>(*arg).opName == op.opName) {
+            const auto &nested = static_cast<const Op &>(*arg).args;
+            worklist.insert(worklist.end(), nested.rbegin(), nested.rend());
+            changed = true;
+            continue;
+        }
+        args.push_back(std::move(arg));
+    }
+    if (args.empty()) {
+        return constantBool(neutral);
+    }
+    if (args.size() == 1) {
+        return args.front();
+    }
+    if (!changed) {
+        return nullptr;
+    }
+    return make_shared<Op>(op.opName, std::move(args), op.instantiate);
+}
+
+static auto foldArithmetic(const Op &op) -> SharedSMTRef {
+    vector<llvm::APInt> values;
+    for (const auto &arg : op.args) {
+        auto value = intValue(*arg);
+        if (!value) {
+            return nullptr;
+        }
+        values.push_back(*value);
+    }
+    if (values.empty()) {
+        return nullptr;
+    }
+    bool overflow = false;
+    llvm::APInt result = values.front();
+    if (op.opName == "-" && values.size() == 1) {
+        result = llvm::APInt(FoldWidth, 0).ssub_ov(result, overflow);
+    }
+    for (size_t i = 1; i < values.size(); ++i) {
+        bool stepOverflow = false;
+        if (op.opName == "+") {
+            result = result.sadd_ov(values[i], stepOverflow);
+        } else if (op.opName == "-") {
+            result = result.ssub_ov(values[i], stepOverflow);
+        } else {
+            result = result.smul_ov(values[i], stepOverflow);
+        }
+        overflow |= stepOverflow;
+    }
+    if (overflow || result.getMinSignedBits() > 64) {
+        return nullptr;
+    }
+    return make_shared<ConstantInt>(result.trunc(64));
+}
+
+static auto foldComparison(const Op &op) -> SharedSMTRef {
+    if (op.args.size() != 2) {
+        return nullptr;
+    }
+    auto left = intValue(*op.args[0]);
+    auto right = intValue(*op.args[1]);
+    if (!left || !right) {
+        return nullptr;
+    }
+    if (op.opName == "<") {
+        return constantBool(left->slt(*right));
+    }
+    if (op.opName == "<=") {
+        return constantBool(left->sle(*right));
+    }
+    if (op.opName == ">") {
+        return constantBool(left->sgt(*right));
+    }
+    return constantBool(left->sge(*right));
+}
+
+// Returns nullptr if the operation can’t be simplified
+static auto simplifyOp(const Op &op) -> SharedSMTRef {
+    const string &name = op.opName;
+    const auto &args = op.args;
+    if (name == "and") {
+        return simplifyJunction(op, true);
+    }
+    if (name == "or") {
+        return simplifyJunction(op, false);
+    }
+    if (name == "not" && args.size() == 1) {
+        if (auto value = boolValue(*args[0])) {
+            return constantBool(!*value);
+        }
+        if (args[0]->getTag() == ExprTag::Op) {
+            const auto &inner = static_cast<const Op &>(*args[0]);
+            if (inner.opName == "not" && inner.args.size() == 1) {
+                return inner.args[0];
+            }
+        }
+        return nullptr;
+    }
+    if (name == "=>" && args.size() == 2) {
+        auto premise = boolValue(*args[0]);
+        auto conclusion = boolValue(*args[1]);
+        if ((premise && !*premise) || (conclusion && *conclusion) ||
+            syntacticallyEqual(*args[0], *args[1])) {
+            return constantBool(true);
+        }
+        if (premise) {
+            return args[1];
+        }
+        return nullptr;
+    }
+    if (name == "=" && args.size() == 2) {
+        if (syntacticallyEqual(*args[0], *args[1])) {
+            return constantBool(true);
+        }
+        auto left = intValue(*args[0]);
+        auto right = intValue(*args[1]);
+        if (left && right) {
+            return constantBool(*left == *right);
+        }
+        auto leftBool = boolValue(*args[0]);
+        auto rightBool = boolValue(*args[1]);
+        if (leftBool && rightBool) {
+            return constantBool(*leftBool == *rightBool);
+        }
+        return nullptr;
+    }
+    if (name == "ite" && args.size() == 3) {
+        if (auto condition = boolValue(*args[0])) {
+            return *condition ? args[1] : args[2];
+        }
+        if (syntacticallyEqual(*args[1], *args[2])) {
+            return args[1];
+        }
+        return nullptr;
+    }
+    // Only the integer operations use these names, the bitvector encoding
+    // uses bvadd etc.
+    if (name == "+" || name == "-" || name == "*") {
+        return foldArithmetic(op);
+    }
+    if (name == "<" || name == "<=" || name == ">" || name == ">=") {
+        return foldComparison(op);
+    }
+    return nullptr;
+}
+
+namespace {
+class Simplifier {
+  public:
+    auto simplify(const SharedSMTRef &expr) -> SharedSMTRef;
+    size_t Rewrites = 0;
+
+  private:
+    // Subterms can be shared, e.g. after inlining lets, so each node is only
+    // simplified once
+    llvm::DenseMap<const SMTExpr *, SharedSMTRef> simplified;
+    auto simplifyNode(const SharedSMTRef &expr) -> SharedSMTRef;
+};
+}
+
+SharedSMTRef Simplifier::simplify(const SharedSMTRef &expr) {
+    auto it = simplified.find(expr.get());
+    if (it != simplified.end()) {
+        return it->second;
+    }
+    SharedSMTRef result = simplifyNode(expr);
+    simplified.insert({expr.get(), result});
+    return result;
+}
+
+SharedSMTRef Simplifier::simplifyNode(const SharedSMTRef &expr) {
+    switch (expr->getTag()) {
+    case ExprTag::Assert: {
+        const auto &assertion = static_cast<const Assert &>(*expr);
+        SharedSMTRef body = simplify(assertion.expr);
+        if (body == assertion.expr) {
+            return expr;
+        }
+        return make_shared<Assert>(std::move(body));
+    }
+    case ExprTag::Forall: {
+        const auto &forall = static_cast<const Forall &>(*expr);
+        SharedSMTRef body = simplify(forall.expr);
+        // Sorts are not empty, so this also holds for false
+        if (boolValue(*body)) {
+            ++Rewrites;
+            return body;
+        }
+        if (body == forall.expr) {
+            return expr;
+        }
+        return make_shared<Forall>(forall.vars, std::move(body));
+    }
+    case ExprTag::Let: {
+        const auto &let = static_cast<const Let &>(*expr);
+        SharedSMTRef body = simplify(let.expr);
+        if (boolValue(*body)) {
+            ++Rewrites;
+            return body;
+        }
+        bool changed = body != let.expr;
+        AssignmentVec defs = let.defs;
+        for (auto &def : defs) {
+            SharedSMTRef value = simplify(def.second);
+            changed |= value != def.second;
+            def.second = std::move(value);
+        }
+        if (!changed) {
+            return expr;
+        }
+        return make_shared<Let>(std::move(defs), std::move(body));
+    }
+    case ExprTag::FunDef: {
+        const auto &funDef = static_cast<const FunDef &>(*expr);
+        SharedSMTRef body = simplify(funDef.body);
+        if (body == funDef.body) {
+            return expr;
+        }
+        return make_shared<FunDef>(funDef.funName, funDef.args,
+                                   funDef.outType, std::move(body));
+    }
+    case ExprTag::Op: {
+        const auto &op = static_cast<const Op &>(*expr);
+        vector<SharedSMTRef> args;
+        args.reserve(op.args.size());
+        bool changed = false;
+        for (const auto &arg : op.args) {
+            args.push_back(simplify(arg));
+            changed |= args.back() != arg;
+        }
+        std::shared_ptr<Op> newOp;
+        const Op *current = &op;
+        if (changed) {
+            newOp = make_shared<Op>(op.opName, std::move(args), op.instantiate);
+            current = newOp.get();
+        }
+        if (SharedSMTRef result = simplifyOp(*current)) {
+            ++Rewrites;
+            return result;
+        }
+        if (newOp) {
+            return newOp;
+        }
+        return expr;
+    }
+    default:
+        return expr;
+    }
+}
+
+SharedSMTRef simplify(const SharedSMTRef &expr) {
+    Simplifier simplifier;
+    SharedSMTRef result = simplifier.simplify(expr);
+    stats::count("simplify.rewrites", simplifier.Rewrites);
+    return result;
+}
+
+bool isTriviallyTrue(const SMTExpr &expr) {
+    const Assert *assertion = expr.asAssert();
+    if (!assertion) {
+        return false;
+    }
+    auto value = boolValue(*assertion->expr);
+    return value && *value;
+}
+}
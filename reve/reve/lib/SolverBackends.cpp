@@ -0,0 +1,153 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SolverBackends.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+#include <algorithm>
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+auto SolverBackend::parseLine(llvm::StringRef line) const -> SolverResult {
+    line = line.rtrim("\r");
+    if (line == "sat") {
+        return SolverResult::Sat;
+    }
+    if (line == "unsat") {
+        return SolverResult::Unsat;
+    }
+    return SolverResult::Unknown;
+}
+
+namespace {
+class CommandLineBackend : public SolverBackend {
+  public:
+    CommandLineBackend(string name, vector<string> command,
+                       BackendFormat format, BackendCapabilities capabilities)
+        : Name(std::move(name)), Command(std::move(command)), Format(format),
+          Capabilities(capabilities) {}
+    auto name() const -> string override { return Name; }
+    auto format() const -> BackendFormat override { return Format; }
+    auto capabilities() const -> BackendCapabilities override {
+        return Capabilities;
+    }
+    auto launchCommand(const string &fileName, bool /* unused */) const
+        -> vector<string> override {
+        vector<string> command = Command;
+        command.push_back(fileName);
+        return command;
+    }
+
+  private:
+    string Name;
+    vector<string> Command;
+    BackendFormat Format;
+    BackendCapabilities Capabilities;
+};
+
+class EldaricaBackend : public CommandLineBackend {
+  public:
+    EldaricaBackend()
+        : CommandLineBackend("eldarica", {"eld-client"},
+                             BackendFormat::SMTHorn, BackendCapabilities()) {}
+    // Eldarica reports the predicates it works on with -log
+    auto launchCommand(const string &fileName, bool log) const
+        -> vector<string> override {
+        vector<string> command = {"eld-client"};
+        if (log) {
+            command.push_back("-log");
+        }
+        command.push_back(fileName);
+        return command;
+    }
+};
+}
+
+static auto registry() -> vector<unique_ptr<SolverBackend>> & {
+    static vector<unique_ptr<SolverBackend>> backends = [] {
+        vector<unique_ptr<SolverBackend>> builtin;
+        builtin.push_back(std::make_unique<EldaricaBackend>());
+        builtin.push_back(commandLineBackend(
+            "spacer", {"z3", "fixedpoint.engine=spacer"},
+            BackendFormat::SMTHorn, BackendCapabilities()));
+        builtin.push_back(commandLineBackend(
+            "duality", {"z3", "fixedpoint.engine=duality"},
+            BackendFormat::SMTHorn, BackendCapabilities()));
+        return builtin;
+    }();
+    return backends;
+}
+
+auto commandLineBackend(string name, vector<string> command,
+                        BackendFormat format, BackendCapabilities capabilities)
+    -> unique_ptr<SolverBackend> {
+    return std::make_unique<CommandLineBackend>(
+        std::move(name), std::move(command), format, capabilities);
+}
+
+auto registerSolverBackend(unique_ptr<SolverBackend> backend) -> void {
+    auto &backends = registry();
+    auto existing = std::find_if(
+        backends.begin(), backends.end(),
+        [&](const unique_ptr<SolverBackend> &registered) {
+            return registered->name() == backend->name();
+        });
+    if (existing != backends.end()) {
+        *existing = std::move(backend);
+    } else {
+        backends.push_back(std::move(backend));
+    }
+}
+
+auto findSolverBackend(llvm::StringRef name) -> const SolverBackend * {
+    for (const auto &backend : registry()) {
+        if (backend->name() == name) {
+            return backend.get();
+        }
+    }
+    return nullptr;
+}
+
+auto solverBackendNames() -> vector<string> {
+    vector<string> names;
+    for (const auto &backend : registry()) {
+        names.push_back(backend->name());
+    }
+    return names;
+}
+
+auto registerSolverBackend(llvm::StringRef description) -> bool {
+    llvm::StringRef name;
+    llvm::StringRef command;
+    std::tie(name, command) = description.split('=');
+    name = name.trim();
+    llvm::SmallVector<llvm::StringRef, 4> words;
+    command.split(words, ' ', -1, false);
+    if (name.empty() || words.empty()) {
+        return false;
+    }
+    vector<string> args;
+    for (const auto &word : words) {
+        args.push_back(word.str());
+    }
+    // Solvers written for the competition only promise to answer, they
+    // neither print models nor support every theory
+    BackendCapabilities capabilities;
+    capabilities.Models = false;
+    capabilities.Arrays = false;
+    capabilities.BitVectors = false;
+    registerSolverBackend(commandLineBackend(name.str(), std::move(args),
+                                             BackendFormat::ChcComp,
+                                             capabilities));
+    return true;
+}
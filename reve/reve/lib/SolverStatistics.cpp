@@ -0,0 +1,194 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SolverStatistics.h"
+
+#include "Opts.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+
+#include <cctype>
+#include <cmath>
+#include <set>
+#include <unordered_set>
+
+using std::string;
+
+using llreve::opts::SMTGenerationOpts;
+
+// The numeral of the function of the given program, -1 if it has none
+static auto functionNumeral(llvm::StringRef name, bool secondProgram) -> int {
+    const auto &numerals =
+        SMTGenerationOpts::getInstance().ReversedFunctionNumerals;
+    for (const auto &numeral :
+         secondProgram ? numerals.second : numerals.first) {
+        if (numeral.second && numeral.second->getName() == name) {
+            return numeral.first;
+        }
+    }
+    return -1;
+}
+
+// "f^g (functions 0^1)" for a function pair, "f (function 0)" for a single
+// function of the given program
+static auto describeFunctions(llvm::StringRef functions, int program)
+    -> string {
+    llvm::SmallVector<llvm::StringRef, 2> names;
+    functions.split(names, '^');
+    string numerals;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const bool second = program == 2 || (program == 0 && i == 1);
+        const int numeral = functionNumeral(names[i], second);
+        numerals += (i > 0 ? "^" : "") +
+                    (numeral < 0 ? string("?") : std::to_string(numeral));
+    }
+    const char *label = names.size() > 1 ? " (functions " : " (function ";
+    return functions.str() + label + numerals + ")";
+}
+
+auto predicateOrigin(llvm::StringRef predicate) -> string {
+    llvm::StringRef name = predicate;
+    if (!name.startswith("INV_") || name.startswith("INV_INDEX")) {
+        return "";
+    }
+    if (name.endswith("_PRE")) {
+        name = name.drop_back(4);
+    }
+    // 0 for predicates relating both programs
+    int program = 0;
+    if (name.endswith("__1") || name.endswith("__2")) {
+        program = name.back() - '0';
+        name = name.drop_back(3);
+    }
+    if (name.endswith("varargs")) {
+        name = name.rsplit('_').first;
+    }
+
+    string origin;
+    if (name.startswith("INV_MAIN_")) {
+        const auto &mainFunctions =
+            SMTGenerationOpts::getInstance().MainFunctions;
+        string functions;
+        if (mainFunctions.first && mainFunctions.second) {
+            functions = mainFunctions.first->getName().str() + "^" +
+                        mainFunctions.second->getName().str();
+        }
+        origin = "mark " + name.drop_front(9).str();
+        if (!functions.empty()) {
+            origin += " of " + describeFunctions(functions, 0);
+        }
+    } else if (name.startswith("INV_REC_")) {
+        origin = "entry of " + describeFunctions(name.drop_front(8), program);
+    } else {
+        origin = "mark " + name.drop_front(4).str();
+    }
+    if (program != 0) {
+        origin += " in program " + std::to_string(program);
+    }
+    return origin;
+}
+
+static void recordPredicateEffort(llvm::StringRef predicate,
+                                  llvm::StringRef measure, uint64_t n) {
+    stats::predicateEffort(predicate, predicateOrigin(predicate), measure, n);
+}
+
+// The number of distinct subterms
+static auto termSize(const z3::expr &term) -> uint64_t {
+    std::unordered_set<unsigned> visited;
+    std::vector<z3::expr> pending = {term};
+    while (!pending.empty()) {
+        z3::expr current = pending.back();
+        pending.pop_back();
+        if (!visited.insert(Z3_get_ast_id(current.ctx(), current)).second) {
+            continue;
+        }
+        if (current.is_app()) {
+            for (unsigned i = 0; i < current.num_args(); ++i) {
+                pending.push_back(current.arg(i));
+            }
+        } else if (current.is_quantifier()) {
+            pending.push_back(current.body());
+        }
+    }
+    return visited.size();
+}
+
+auto recordZ3Statistics(z3::solver &solver,
+                        const llvm::StringSet<> &predicates, bool sat)
+    -> void {
+    if (!stats::enabled()) {
+        return;
+    }
+    const z3::stats statistics = solver.statistics();
+    for (unsigned i = 0; i < statistics.size(); ++i) {
+        const string key = "solver.z3." + statistics.key(i);
+        if (statistics.is_uint(i)) {
+            stats::count(key, statistics.uint_value(i));
+        } else {
+            // Times and memory are reported in seconds and megabytes
+            stats::count(key + " (thousandths)",
+                         static_cast<uint64_t>(
+                             std::llround(statistics.double_value(i) * 1000)));
+        }
+    }
+    if (!sat) {
+        return;
+    }
+    const z3::model model = solver.get_model();
+    for (unsigned i = 0; i < model.num_funcs(); ++i) {
+        const z3::func_decl decl = model.get_func_decl(i);
+        const string name = decl.name().str();
+        if (predicates.count(name) == 0) {
+            continue;
+        }
+        const z3::func_interp interpretation = model.get_func_interp(decl);
+        recordPredicateEffort(name, "invariant size",
+                              termSize(interpretation.else_value()));
+    }
+}
+
+static auto isNameCharacter(char c) -> bool {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+           c == '^' || c == '.' || c == '$';
+}
+
+auto recordSolverLog(llvm::StringRef engine, llvm::StringRef log) -> void {
+    if (!stats::enabled()) {
+        return;
+    }
+    const string measure = engine.str() + " log lines";
+    uint64_t lines = 0;
+    while (!log.empty()) {
+        llvm::StringRef line;
+        std::tie(line, log) = log.split('\n');
+        ++lines;
+        std::set<string> mentioned;
+        for (size_t start = line.find("INV_"); start != llvm::StringRef::npos;
+             start = line.find("INV_", start + 1)) {
+            if (start > 0 && isNameCharacter(line[start - 1])) {
+                continue;
+            }
+            size_t end = start;
+            while (end < line.size() && isNameCharacter(line[end])) {
+                ++end;
+            }
+            mentioned.insert(line.slice(start, end).str());
+        }
+        for (const string &predicate : mentioned) {
+            if (!predicateOrigin(predicate).empty()) {
+                recordPredicateEffort(predicate, measure, 1);
+            }
+        }
+    }
+    stats::count("solver." + engine.str() + ".log lines", lines);
+}
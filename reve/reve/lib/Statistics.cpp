@@ -0,0 +1,394 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Statistics.h"
+
+#include "Json.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+using std::string;
+using std::vector;
+
+namespace stats {
+
+namespace {
+struct TraceEvent {
+    string phase;
+    unsigned thread;
+    Clock::time_point start;
+    Clock::duration duration;
+};
+
+struct Statistics {
+    std::mutex mutex;
+    bool trace = false;
+    Clock::time_point epoch;
+    // std::map so the report is sorted by name
+    std::map<string, Clock::duration> times;
+    std::map<string, uint64_t> counters;
+    // The peak of the live heap bytes during each phase
+    std::map<string, uint64_t> memory;
+    std::map<string, string> predicateOrigins;
+    std::map<string, std::map<string, uint64_t>> predicateEfforts;
+    vector<TraceEvent> events;
+};
+}
+
+static std::atomic<bool> Enabled{false};
+
+// The memory counters are updated by the global operator new which can be
+// called before any constructor has run, so they only rely on zero
+// initialization.
+using Counter = std::atomic<int64_t>;
+static Counter LiveBytes;
+static Counter PeakBytes;
+// The number of timers whose peak memory can be recorded at the same time.
+// Each bit of 'ActiveSlots' marks a slot of 'SlotPeaks' as used by a timer.
+static const int PeakSlots = 32;
+static std::atomic<uint32_t> ActiveSlots;
+static Counter SlotPeaks[PeakSlots];
+// Indexed by NodeKind
+static Counter LiveNodes[2];
+static Counter PeakNodes[2];
+
+static void raiseTo(Counter &peak, int64_t value) {
+    int64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current &&
+           !peak.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+static void recordAllocation(int64_t size) {
+    const int64_t live =
+        LiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raiseTo(PeakBytes, live);
+    uint32_t slots = ActiveSlots.load(std::memory_order_relaxed);
+    for (int i = 0; slots != 0; ++i, slots >>= 1) {
+        if (slots & 1) {
+            raiseTo(SlotPeaks[i], live);
+        }
+    }
+}
+
+static void recordDeallocation(int64_t size) {
+    LiveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+// Returns the slot or -1 if all slots are in use
+static int acquirePeakSlot() {
+    uint32_t slots = ActiveSlots.load();
+    while (slots != ~uint32_t(0)) {
+        int slot = 0;
+        while (slots & (uint32_t(1) << slot)) {
+            ++slot;
+        }
+        SlotPeaks[slot].store(LiveBytes.load(std::memory_order_relaxed));
+        if (ActiveSlots.compare_exchange_weak(slots,
+                                              slots | (uint32_t(1) << slot))) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static uint64_t releasePeakSlot(int slot) {
+    const int64_t peak = SlotPeaks[slot].load();
+    ActiveSlots.fetch_and(~(uint32_t(1) << slot));
+    return static_cast<uint64_t>(std::max(peak, int64_t(0)));
+}
+
+// The maximum resident set size of the process in bytes, 0 if it is unknown
+static uint64_t maxResidentSetSize() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    // Linux reports kilobytes
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static Statistics &statistics() {
+    static Statistics stats;
+    return stats;
+}
+
+// Small consecutive thread ids make the trace easier to read than the ids of
+// std::thread
+static unsigned threadIndex() {
+    static std::atomic<unsigned> nextIndex{0};
+    static thread_local unsigned index = nextIndex++;
+    return index;
+}
+
+void enable(bool trace) {
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.trace = trace;
+    stats.epoch = Clock::now();
+    stats.times.clear();
+    stats.counters.clear();
+    stats.memory.clear();
+    stats.predicateOrigins.clear();
+    stats.predicateEfforts.clear();
+    stats.events.clear();
+    PeakBytes = LiveBytes.load();
+    for (int kind = 0; kind < 2; ++kind) {
+        PeakNodes[kind] = LiveNodes[kind].load();
+    }
+    Enabled = true;
+}
+
+bool enabled() { return Enabled; }
+
+void nodeAllocated(NodeKind kind) {
+    if (!Enabled) {
+        return;
+    }
+    const int index = static_cast<int>(kind);
+    raiseTo(PeakNodes[index],
+            LiveNodes[index].fetch_add(1, std::memory_order_relaxed) + 1);
+}
+
+void nodeFreed(NodeKind kind) {
+    if (!Enabled) {
+        return;
+    }
+    LiveNodes[static_cast<int>(kind)].fetch_sub(1, std::memory_order_relaxed);
+}
+
+void count(llvm::StringRef counter, uint64_t n) {
+    if (!Enabled) {
+        return;
+    }
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.counters[counter.str()] += n;
+}
+
+void maximum(llvm::StringRef counter, uint64_t n) {
+    if (!Enabled) {
+        return;
+    }
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    uint64_t &value = stats.counters[counter.str()];
+    value = std::max(value, n);
+}
+
+void predicateEffort(llvm::StringRef predicate, llvm::StringRef origin,
+                     llvm::StringRef measure, uint64_t n) {
+    if (!Enabled) {
+        return;
+    }
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.predicateOrigins.insert({predicate.str(), origin.str()});
+    stats.predicateEfforts[predicate.str()][measure.str()] += n;
+}
+
+ScopedTimer::ScopedTimer(llvm::StringRef phase)
+    : phase(phase), active(Enabled) {
+    if (active) {
+        slot = acquirePeakSlot();
+        start = Clock::now();
+    }
+}
+
+ScopedTimer::~ScopedTimer() {
+    if (!active) {
+        return;
+    }
+    auto duration = Clock::now() - start;
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.times[phase.str()] += duration;
+    if (slot >= 0) {
+        uint64_t &peak = stats.memory[phase.str()];
+        peak = std::max(peak, releasePeakSlot(slot));
+    }
+    if (stats.trace) {
+        stats.events.push_back({phase.str(), threadIndex(), start, duration});
+    }
+}
+
+void writeJSON(std::ostream &out) {
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    out << "{\"times\": {";
+    bool first = true;
+    for (const auto &time : stats.times) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+        out << jsonString(time.first);
+        out << ": " << std::chrono::duration<double>(time.second).count();
+    }
+    auto counters = stats.counters;
+    counters["memory.peak heap bytes"] = PeakBytes.load();
+    counters["memory.peak smt nodes"] =
+        PeakNodes[static_cast<int>(NodeKind::SMT)].load();
+    counters["memory.peak sexpr nodes"] =
+        PeakNodes[static_cast<int>(NodeKind::SExpr)].load();
+    counters["memory.max rss bytes"] = maxResidentSetSize();
+    out << "}, \"counters\": {";
+    first = true;
+    for (const auto &counter : counters) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+        out << jsonString(counter.first);
+        out << ": " << counter.second;
+    }
+    out << "}, \"memory\": {";
+    first = true;
+    for (const auto &memory : stats.memory) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+        out << jsonString(memory.first);
+        out << ": " << memory.second;
+    }
+    out << "}, \"predicates\": {";
+    first = true;
+    for (const auto &predicate : stats.predicateEfforts) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+        out << jsonString(predicate.first);
+        out << ": {\"origin\": ";
+        out << jsonString(stats.predicateOrigins[predicate.first]);
+        for (const auto &effort : predicate.second) {
+            out << ", ";
+            out << jsonString(effort.first);
+            out << ": " << effort.second;
+        }
+        out << "}";
+    }
+    out << "}}\n";
+}
+
+void writeTrace(std::ostream &out) {
+    using Microseconds = std::chrono::duration<double, std::micro>;
+    auto &stats = statistics();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    out << "{\"traceEvents\": [";
+    for (size_t i = 0; i < stats.events.size(); ++i) {
+        const auto &event = stats.events[i];
+        out << (i > 0 ? ",\n" : "\n") << "{\"name\": ";
+        out << jsonString(event.phase);
+        out << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.thread
+            << ", \"ts\": " << Microseconds(event.start - stats.epoch).count()
+            << ", \"dur\": " << Microseconds(event.duration).count() << "}";
+    }
+    out << "\n]}\n";
+}
+}
+
+// Count the bytes that are live on the heap. The size is looked up from the
+// allocator so that the unsized operator delete can subtract it again. Until
+// the statistics are enabled nothing is counted, so the allocations only pay
+// for loading the flag. Memory allocated before and freed afterwards lowers
+// the live bytes, they only count the growth since the statistics have been
+// enabled.
+static int64_t allocationSize(void *ptr) {
+#if defined(__APPLE__)
+    return static_cast<int64_t>(malloc_size(ptr));
+#elif defined(_WIN32)
+    return static_cast<int64_t>(_msize(ptr));
+#else
+    return static_cast<int64_t>(malloc_usable_size(ptr));
+#endif
+}
+
+static void *countedAllocate(size_t size, bool throwOnFailure) {
+    if (size == 0) {
+        size = 1;
+    }
+    void *ptr;
+    while ((ptr = std::malloc(size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            if (throwOnFailure) {
+                throw std::bad_alloc();
+            }
+            return nullptr;
+        }
+        handler();
+    }
+    if (stats::Enabled.load(std::memory_order_relaxed)) {
+        stats::recordAllocation(allocationSize(ptr));
+    }
+    return ptr;
+}
+
+static void countedDeallocate(void *ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (stats::Enabled.load(std::memory_order_relaxed)) {
+        stats::recordDeallocation(allocationSize(ptr));
+    }
+    std::free(ptr);
+}
+
+void *operator new(size_t size) { return countedAllocate(size, true); }
+void *operator new[](size_t size) { return countedAllocate(size, true); }
+void *operator new(size_t size, const std::nothrow_t & /*unused*/) noexcept {
+    return countedAllocate(size, false);
+}
+void *operator new[](size_t size, const std::nothrow_t & /*unused*/) noexcept {
+    return countedAllocate(size, false);
+}
+void operator delete(void *ptr) noexcept { countedDeallocate(ptr); }
+void operator delete[](void *ptr) noexcept { countedDeallocate(ptr); }
+void operator delete(void *ptr, const std::nothrow_t & /*unused*/) noexcept {
+    countedDeallocate(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t & /*unused*/) noexcept {
+    countedDeallocate(ptr);
+}
+void operator delete(void *ptr, size_t /*unused*/) noexcept {
+    countedDeallocate(ptr);
+}
+void operator delete[](void *ptr, size_t /*unused*/) noexcept {
+    countedDeallocate(ptr);
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "StructuralCoupling.h"
+
+#include "Opts.h"
+#include "Statistics.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+using std::map;
+using std::set;
+using std::vector;
+
+// Integer types are distinguished by their width, all other types only by
+// their kind
+static llvm::hash_code typeHash(const llvm::Type *type) {
+    if (const auto intType = llvm::dyn_cast<llvm::IntegerType>(type)) {
+        return llvm::hash_combine(type->getTypeID(), intType->getBitWidth());
+    }
+    return llvm::hash_value(type->getTypeID());
+}
+
+uint64_t structuralHash(const llvm::Function &fun) {
+    llvm::hash_code hash = typeHash(fun.getReturnType());
+    for (const auto &arg : fun.args()) {
+        hash = llvm::hash_combine(hash, typeHash(arg.getType()));
+    }
+    // The blocks are sorted so that the hash does not depend on their order
+    vector<std::pair<size_t, size_t>> blockShapes;
+    map<unsigned, size_t> opcodes;
+    for (const auto &block : fun) {
+        blockShapes.emplace_back(
+            std::distance(pred_begin(&block), pred_end(&block)),
+            std::distance(succ_begin(&block), succ_end(&block)));
+        for (const auto &instr : block) {
+            ++opcodes[instr.getOpcode()];
+            if (const auto call = llvm::dyn_cast<llvm::CallInst>(&instr)) {
+                hash = llvm::hash_combine(hash, call->getNumArgOperands());
+            }
+        }
+    }
+    std::sort(blockShapes.begin(), blockShapes.end());
+    for (const auto &shape : blockShapes) {
+        hash = llvm::hash_combine(hash, shape.first, shape.second);
+    }
+    for (const auto &opcode : opcodes) {
+        hash = llvm::hash_combine(hash, opcode.first, opcode.second);
+    }
+    return static_cast<uint64_t>(static_cast<size_t>(hash));
+}
+
+// The hashes of the uncoupled functions with a body that have been
+// preprocessed, a hash that occurs several times maps to nullptr
+static map<uint64_t, llvm::Function *>
+uniqueHashes(llvm::Module &module, const AnalysisResultsMap &analysisResults,
+             const set<const llvm::Function *> &coupled) {
+    map<uint64_t, llvm::Function *> hashes;
+    for (auto &fun : module) {
+        if (fun.isDeclaration() || llreve::opts::isLlreveIntrinsic(fun) ||
+            analysisResults.find(&fun) == analysisResults.end() ||
+            coupled.find(&fun) != coupled.end()) {
+            continue;
+        }
+        auto inserted = hashes.insert({structuralHash(fun), &fun});
+        if (!inserted.second) {
+            inserted.first->second = nullptr;
+        }
+    }
+    return hashes;
+}
+
+size_t coupleFunctionsByStructure(
+    MonoPair<llvm::Module &> modules, const AnalysisResultsMap &analysisResults,
+    set<MonoPair<llvm::Function *>> &coupledFunctions) {
+    set<const llvm::Function *> coupled;
+    for (const auto &funPair : coupledFunctions) {
+        coupled.insert(funPair.first);
+        coupled.insert(funPair.second);
+    }
+    auto hashes1 = uniqueHashes(modules.first, analysisResults, coupled);
+    auto hashes2 = uniqueHashes(modules.second, analysisResults, coupled);
+    size_t added = 0;
+    for (const auto &entry : hashes1) {
+        auto match = hashes2.find(entry.first);
+        if (entry.second == nullptr || match == hashes2.end() ||
+            match->second == nullptr) {
+            continue;
+        }
+        coupledFunctions.insert({entry.second, match->second});
+        ++added;
+    }
+    stats::count("coupling.structural pairs", added);
+    return added;
+}
@@ -0,0 +1,91 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Symbol.h"
+
+#include "llvm/ADT/StringMap.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace smt {
+
+// The names are stored in chunks that never move, so they can be read while
+// another thread interns a new name. A thread only knows the id of a symbol
+// after the name has been stored, so reading it needs no lock.
+static const unsigned ChunkBits = 14;
+static const uint32_t ChunkSize = 1u << ChunkBits;
+static const uint32_t MaxChunks = 1u << (32 - ChunkBits);
+
+// The caches of the threads are dropped once they get this large, the names
+// are still found in the table
+static const unsigned MaxCachedNames = 1 << 16;
+
+namespace {
+struct SymbolTable {
+    std::mutex mutex;
+    // Owns the names, guarded by 'mutex'
+    llvm::StringMap<uint32_t> ids;
+    uint32_t size = 0;
+    // Zero initialized since the table has static storage duration, so the
+    // unused entries don’t take up any memory
+    std::atomic<llvm::StringRef *> chunks[MaxChunks];
+    SymbolTable() { intern(""); }
+    ~SymbolTable() {
+        for (auto &chunk : chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+    auto intern(llvm::StringRef name) -> uint32_t;
+    auto name(uint32_t id) const -> llvm::StringRef {
+        return chunks[id >> ChunkBits].load(
+            std::memory_order_acquire)[id & (ChunkSize - 1)];
+    }
+};
+}
+
+uint32_t SymbolTable::intern(llvm::StringRef name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ids.insert({name, size});
+    if (it.second) {
+        auto &chunk = chunks[size >> ChunkBits];
+        llvm::StringRef *names = chunk.load(std::memory_order_relaxed);
+        if (names == nullptr) {
+            names = new llvm::StringRef[ChunkSize];
+        }
+        names[size & (ChunkSize - 1)] = it.first->getKey();
+        chunk.store(names, std::memory_order_release);
+        ++size;
+    }
+    return it.first->getValue();
+}
+
+static SymbolTable &symbolTable() {
+    static SymbolTable table;
+    return table;
+}
+
+static thread_local llvm::StringMap<uint32_t> cachedIds;
+
+Symbol::Symbol(llvm::StringRef name) {
+    auto it = cachedIds.find(name);
+    if (it != cachedIds.end()) {
+        symbolId = it->getValue();
+        return;
+    }
+    symbolId = symbolTable().intern(name);
+    if (cachedIds.size() >= MaxCachedNames) {
+        cachedIds.clear();
+    }
+    cachedIds.insert({name, symbolId});
+}
+
+llvm::StringRef Symbol::str() const { return symbolTable().name(symbolId); }
+}
@@ -82,7 +82,8 @@ Type llvmType(const llvm::Type *type) {
 }
 
 Type inferTypeByName(string arg) {
-    if (std::regex_match(arg, HEAP_REGEX) ||
+    const VarRole role = variableRole(arg);
+    if (role == VarRole::Heap || role == VarRole::Stack ||
         oneOf(arg, heapResultName(Program::First),
               heapResultName(Program::Second))) {
         return memoryType();
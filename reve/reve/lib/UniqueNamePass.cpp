@@ -60,4 +60,3 @@ void makePrefixed(llvm::Value &Val, std::string Prefix,
     }
 }
 
-string UniqueNamePass::Prefix = "ERROR";
@@ -9,8 +9,10 @@
 # UNSUPPORTED_INPUT | llreve cannot translate the input to SMT, this could also mean that llreve has crashed.
 # INTERNAL_ERROR    | The solver crashed or returned an error because SMT produced by llreve was invalid.
 
+import os
 import subprocess
 import sys
+import tempfile
 
 verboseOpt = False
 z3Opt = False
@@ -57,28 +59,38 @@ def detectOptions():
     detectVerboseOption()
 
 
-def runProcess(args):
+# The output is discarded unless it is redirected to a file object or -v is
+# passed
+def runProcess(args, stdout=None):
     log("Running %s" % args)
-    stdout = None
     stderr = None
     if not verboseOpt:
-        stdout = open('/dev/null', 'w')
+        if stdout is None:
+            stdout = open('/dev/null', 'w')
         stderr = open('/dev/null', 'w')
     return subprocess.call(args, stdout=stdout, stderr=stderr)
 
 
-def llreve(fileName):
+# Runs llreve with its output written to 'output', which has to be a file
+# object
+def llreve(output):
     log("Running llreve")
     args = ["llreve"] + sys.argv[1:]
     if (z3Opt):
         args.append("-muz")
-    args.append("-o")
-    args.append(fileName)
-    return runProcess(args)
+    return runProcess(args, output)
 
 
-def getSMTFileName():
-    return "out.smt2"
+# A file for the SMT problem that is not stored on the disk if possible. The
+# solvers open it by its path in /proc, which also works for the Eldarica
+# server since it runs as the same user. Unlike a fixed file name this allows
+# several instances to run in the same directory.
+def createSMTFile():
+    if hasattr(os, "memfd_create"):
+        fd = os.memfd_create("llreve-smt")
+        return (os.fdopen(fd, "w+b"), "/proc/%d/fd/%d" % (os.getpid(), fd))
+    smtFile = tempfile.NamedTemporaryFile(suffix=".smt2")
+    return (smtFile, smtFile.name)
 
 
 def z3(fileName):
@@ -111,15 +123,15 @@ def eldarica(fileName):
     process = subprocess.Popen(args, stdout=subprocess.PIPE,
                                stderr=subprocess.PIPE)
     result = "INTERNAL_ERROR"
-    for line in iter(process.stdout.readline, ''):
+    for line in process.stdout:
         if verboseOpt:
-            sys.stdout.write(line)
+            sys.stdout.buffer.write(line)
         line = line.strip()
-        if line == "sat":
+        if line == b"sat":
             result = "EQUAL"
-        elif line == "unsat":
+        elif line == b"unsat":
             result = "NOT_EQUAL"
-        elif line == "unknown":
+        elif line == b"unknown":
             result = "UNKNOWN"
     process.wait()
     if process.returncode == 0:
@@ -130,17 +142,18 @@ def eldarica(fileName):
 def main():
     detectZ3Option()
     detectVerboseOption()
-    smtFileName = getSMTFileName()
-    exit = llreve(smtFileName)
-    if exit != 0:
-        print("UNSUPPORTED_INPUT")
-        return
-    if z3Opt:
-        ret = z3(smtFileName)
-        print(ret)
-    else:
-        ret = eldarica(smtFileName)
-        print(ret)
+    (smtFile, smtFileName) = createSMTFile()
+    with smtFile:
+        exit = llreve(smtFile)
+        if exit != 0:
+            print("UNSUPPORTED_INPUT")
+            return
+        if z3Opt:
+            ret = z3(smtFileName)
+            print(ret)
+        else:
+            ret = eldarica(smtFileName)
+            print(ret)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,291 @@
+#! /usr/bin/env python3
+
+# Generates parametrized pairs of C programs in the style of examples/loop and
+# examples/rec and measures how llreve scales with each parameter.
+#
+# The programs are controlled by four parameters
+# depth     | the nesting depth of the loops
+# branches  | the number of if statements between two marks
+# functions | the number of coupled functions, each one calls the next
+# heap      | the number of heap accesses in the innermost loop
+#
+# Usage:
+#   scalability.py generate [parameters] DIRECTORY
+#     writes DIRECTORY/scale_1.c and DIRECTORY/scale_2.c
+#   scalability.py run [parameters] [-sweep=PARAMETER=V1,V2,...]
+#                      [-llreve=PATH] [-o=FILE] [-plot=FILE] [-- ARGS]
+#     runs llreve once for every value of every sweep, the parameters that
+#     are not swept keep the values given by [parameters]. The results are
+#     written as CSV, one row per run, and if matplotlib is installed plotted
+#     against the swept parameter. ARGS are passed to llreve.
+#
+# The parameters are given as -depth=N, -branches=N, -functions=N and -heap=N.
+# Without -sweep each parameter is swept separately from 0 (or 1 for
+# functions) to 4.
+
+import csv
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+defaultParameters = {"depth": 1, "branches": 1, "functions": 1, "heap": 0}
+defaultSweeps = [("depth", [0, 1, 2, 3, 4]),
+                 ("branches", [0, 1, 2, 3, 4]),
+                 ("functions", [1, 2, 3, 4]),
+                 ("heap", [0, 1, 2, 3, 4])]
+# The counters and timers of -stats-json that are reported for each run, the
+# timers of the phases that are known to grow faster than the output come
+# first
+reportedCounters = ["paths", "clauses.synchronized", "clauses.forbidden",
+                    "clauses.stutter", "serialize.clauses", "serialize.bytes"]
+reportedTimes = ["preprocess.paths", "generate.forbidden", "compile",
+                 "preprocess", "generate", "serialize"]
+
+
+def indent(level):
+    return "    " * level
+
+
+def functionName(index):
+    return "f%d" % index
+
+
+def parameterList(parameters):
+    if parameters["heap"] > 0:
+        return "int n, int c, int *a"
+    return "int n, int c"
+
+
+def argumentList(parameters, n):
+    if parameters["heap"] > 0:
+        return "%s, c, a" % n
+    return "%s, c" % n
+
+
+def loopVariable(level):
+    return "i%d" % level
+
+
+# The body of the innermost loop. The two programs compute the same values but
+# the second one swaps the branches of each if statement, changes the order
+# of additions and accesses the heap via pointer arithmetic. 'n' is the
+# variable that bounds the loops and is passed to the called function.
+def loopBody(parameters, program, index, level, n):
+    lines = []
+    for branch in range(parameters["branches"]):
+        if program == 1:
+            lines.append("if (c > %d) {" % branch)
+            lines.append(indent(1) + "x = x + %d;" % (branch + 1))
+            lines.append("} else {")
+            lines.append(indent(1) + "x = x - 1;")
+            lines.append("}")
+        else:
+            lines.append("if (c <= %d) {" % branch)
+            lines.append(indent(1) + "x = x - 1;")
+            lines.append("} else {")
+            lines.append(indent(1) + "x = %d + x;" % (branch + 1))
+            lines.append("}")
+    for access in range(parameters["heap"]):
+        if program == 1:
+            lines.append("a[%s + %d] = a[%s + %d] + x;" %
+                         (n, access, n, access))
+        else:
+            lines.append("*(a + %s + %d) = x + *(a + %s + %d);" %
+                         (n, access, n, access))
+    if index + 1 < parameters["functions"]:
+        call = "%s(%s)" % (functionName(index + 1),
+                           argumentList(parameters, n))
+        if program == 1:
+            lines.append("x = x + %s;" % call)
+        else:
+            lines.append("x = %s + x;" % call)
+    return [indent(level) + line for line in lines]
+
+
+def function(parameters, program, index):
+    name = functionName(index)
+    lines = ["int %s(%s) {" % (name, parameterList(parameters)),
+             indent(1) + "int x = 0;"]
+    n = "n"
+    for level in range(parameters["depth"]):
+        i = loopVariable(level)
+        lines.append(indent(level + 1) + "int %s = 0;" % i)
+        lines.append(indent(level + 1) + "while (__mark(%d) & (%s < %s)) {" %
+                     (level + 1, i, n))
+        n = i
+    depth = parameters["depth"]
+    lines += loopBody(parameters, program, index, depth + 1, n)
+    for level in reversed(range(depth)):
+        i = loopVariable(level)
+        if program == 1:
+            lines.append(indent(level + 2) + "%s++;" % i)
+        else:
+            lines.append(indent(level + 2) + "%s = %s + 1;" % (i, i))
+        lines.append(indent(level + 1) + "}")
+    lines.append(indent(1) + "return x;")
+    lines.append("}")
+    return lines
+
+
+def programSource(parameters, program):
+    lines = ["/*@ opt -fun %s @*/" % functionName(0),
+             "extern int __mark(int);",
+             ""]
+    functions = range(parameters["functions"])
+    # Declare all functions first so they can be emitted in order
+    for index in functions:
+        lines.append("int %s(%s);" % (functionName(index),
+                                      parameterList(parameters)))
+    for index in functions:
+        lines.append("")
+        lines += function(parameters, program, index)
+    return "\n".join(lines) + "\n"
+
+
+def writeProgramPair(parameters, directory):
+    fileNames = []
+    for i in [1, 2]:
+        fileName = os.path.join(directory, "scale_%d.c" % i)
+        with open(fileName, "w") as f:
+            f.write(programSource(parameters, i))
+        fileNames.append(fileName)
+    return fileNames
+
+
+def runLlreve(llreve, parameters, directory, extraArgs):
+    fileNames = writeProgramPair(parameters, directory)
+    statsFileName = os.path.join(directory, "stats.json")
+    args = [llreve, "-o", os.path.join(directory, "out.smt2"),
+            "-stats-json=" + statsFileName] + extraArgs + fileNames
+    if parameters["heap"] > 0:
+        args.append("-heap")
+    start = time.time()
+    exitCode = subprocess.call(args, stdout=subprocess.DEVNULL)
+    seconds = time.time() - start
+    if exitCode != 0:
+        print("Failed: %s" % " ".join(args), file=sys.stderr)
+        return None
+    with open(statsFileName) as f:
+        stats = json.load(f)
+    row = {"total": seconds}
+    for counter in reportedCounters:
+        row[counter] = stats["counters"].get(counter, 0)
+    for phase in reportedTimes:
+        row[phase] = stats["times"].get(phase, 0)
+    return row
+
+
+def plot(rows, fileName):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib is not installed, skipping the plot",
+              file=sys.stderr)
+        return
+    sweeps = []
+    for row in rows:
+        if row["parameter"] not in sweeps:
+            sweeps.append(row["parameter"])
+    columns = [["paths", "serialize.clauses"], ["serialize.bytes"],
+               ["total"] + reportedTimes[:2]]
+    figure, axes = plt.subplots(len(sweeps), len(columns), squeeze=False,
+                                figsize=(5 * len(columns), 3 * len(sweeps)))
+    for i, sweep in enumerate(sweeps):
+        sweepRows = [row for row in rows if row["parameter"] == sweep]
+        values = [row["value"] for row in sweepRows]
+        for j, names in enumerate(columns):
+            for name in names:
+                axes[i][j].plot(values, [row[name] for row in sweepRows],
+                                marker="o", label=name)
+            axes[i][j].set_xlabel(sweep)
+            axes[i][j].legend()
+    figure.tight_layout()
+    figure.savefig(fileName)
+
+
+def parseSweep(arg):
+    name, values = arg.split("=", 1)
+    if name not in defaultParameters:
+        print("Unknown parameter: %s" % name, file=sys.stderr)
+        sys.exit(1)
+    return (name, [int(value) for value in values.split(",")])
+
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] not in ["generate", "run"]:
+        print("Usage: %s generate|run [options]" % sys.argv[0],
+              file=sys.stderr)
+        sys.exit(1)
+    command = sys.argv[1]
+    parameters = dict(defaultParameters)
+    sweeps = []
+    llreve = "llreve"
+    outputFileName = None
+    plotFileName = None
+    extraArgs = []
+    positional = []
+    args = sys.argv[2:]
+    for i, arg in enumerate(args):
+        if arg == "--":
+            extraArgs = args[i + 1:]
+            break
+        elif arg.startswith("-sweep="):
+            sweeps.append(parseSweep(arg[len("-sweep="):]))
+        elif arg.startswith("-llreve="):
+            llreve = arg[len("-llreve="):]
+        elif arg.startswith("-o="):
+            outputFileName = arg[len("-o="):]
+        elif arg.startswith("-plot="):
+            plotFileName = arg[len("-plot="):]
+        elif arg.startswith("-") and "=" in arg and \
+                arg[1:arg.index("=")] in parameters:
+            parameters[arg[1:arg.index("=")]] = int(arg[arg.index("=") + 1:])
+        elif not arg.startswith("-"):
+            positional.append(arg)
+        else:
+            print("Unknown argument: %s" % arg, file=sys.stderr)
+            sys.exit(1)
+
+    if command == "generate":
+        if len(positional) != 1:
+            print("generate expects a single directory", file=sys.stderr)
+            sys.exit(1)
+        os.makedirs(positional[0], exist_ok=True)
+        writeProgramPair(parameters, positional[0])
+        return
+
+    if not sweeps:
+        sweeps = defaultSweeps
+    rows = []
+    with tempfile.TemporaryDirectory(prefix="llreve-scale") as directory:
+        for name, values in sweeps:
+            for value in values:
+                runParameters = dict(parameters)
+                runParameters[name] = value
+                print("%s=%d" % (name, value), file=sys.stderr)
+                row = runLlreve(llreve, runParameters, directory, extraArgs)
+                if row is None:
+                    continue
+                row["parameter"] = name
+                row["value"] = value
+                rows.append(row)
+
+    fieldNames = ["parameter", "value"] + reportedCounters + ["total"] + \
+        reportedTimes
+    out = open(outputFileName, "w") if outputFileName else sys.stdout
+    writer = csv.DictWriter(out, fieldnames=fieldNames)
+    writer.writeheader()
+    writer.writerows(rows)
+    if outputFileName:
+        out.close()
+    if plotFileName:
+        plot(rows, plotFileName)
+
+
+if __name__ == "__main__":
+    main()
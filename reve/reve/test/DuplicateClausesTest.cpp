@@ -0,0 +1,127 @@
+#include "DuplicateClauses.h"
+
+#include <gtest/gtest.h>
+
+using namespace smt;
+
+static SharedSMTRef var(const std::string &name) {
+    return std::make_shared<TypedVariable>(name, int64Type());
+}
+
+static SharedSMTRef num(int64_t value) {
+    return std::make_shared<ConstantInt>(llvm::APInt(64, value, true));
+}
+
+static SharedSMTRef op(const std::string &name,
+                       std::vector<SharedSMTRef> args) {
+    return std::make_shared<Op>(name, std::move(args));
+}
+
+static SharedSMTRef forall(std::vector<std::string> names,
+                           SharedSMTRef body) {
+    std::vector<SortedVar> vars;
+    for (const auto &name : names) {
+        vars.push_back(SortedVar(name, int64Type()));
+    }
+    return std::make_shared<Forall>(std::move(vars), std::move(body));
+}
+
+static SharedSMTRef let(const std::string &name, SharedSMTRef value,
+                        SharedSMTRef body) {
+    return std::make_shared<Let>(AssignmentVec{{name, std::move(value)}},
+                                 std::move(body));
+}
+
+static SharedSMTRef clause(SharedSMTRef body) {
+    return std::make_shared<Assert>(std::move(body));
+}
+
+// The number of expressions that are kept if 'second' follows 'first'
+static size_t keptOf(SharedSMTRef first, SharedSMTRef second) {
+    return removeDuplicateClauses({std::move(first), std::move(second)})
+        .size();
+}
+
+// (=> (INV x y) (INV (+ x 1) y))
+static SharedSMTRef step(const std::string &x, const std::string &y) {
+    return op("=>", {op("INV", {var(x), var(y)}),
+                     op("INV", {op("+", {var(x), num(1)}), var(y)})});
+}
+
+TEST(RemoveDuplicateClauses, RemovesAlphaEquivalentClauses) {
+    auto first = clause(forall({"x", "y"}, step("x", "y")));
+    auto second = clause(forall({"a", "b"}, step("a", "b")));
+    auto result = removeDuplicateClauses({first, second});
+    ASSERT_EQ(result.size(), 1u);
+    EXPECT_EQ(result.front(), first);
+}
+
+TEST(RemoveDuplicateClauses, KeepsClausesBindingVariablesInAnotherOrder) {
+    EXPECT_EQ(keptOf(clause(forall({"x", "y"}, step("x", "y"))),
+                     clause(forall({"y", "x"}, step("x", "y")))),
+              2u);
+}
+
+// The inner let refers to the outer binding in its definition and shadows it
+// in its body
+TEST(RemoveDuplicateClauses, RenamesShadowedLets) {
+    auto shadowing =
+        let("x", num(1), let("x", op("+", {var("x"), num(1)}),
+                             op(">", {var("x"), num(0)})));
+    auto renamed =
+        let("a", num(1), let("b", op("+", {var("a"), num(1)}),
+                             op(">", {var("b"), num(0)})));
+    EXPECT_EQ(keptOf(clause(shadowing), clause(renamed)), 1u);
+    // Here the body refers to the outer binding
+    auto outer =
+        let("a", num(1), let("b", op("+", {var("a"), num(1)}),
+                             op(">", {var("a"), num(0)})));
+    EXPECT_EQ(keptOf(clause(shadowing), clause(outer)), 2u);
+}
+
+TEST(RemoveDuplicateClauses, IgnoresTheOrderOfConjunctsAndDisjuncts) {
+    auto x = var("x");
+    auto y = var("y");
+    auto conditions = [&](bool swapped) {
+        SharedSMTRef positive = op(">", {x, num(0)});
+        SharedSMTRef smaller = op("<", {x, y});
+        SharedSMTRef equal = op("=", {y, num(2)});
+        if (swapped) {
+            return op("and", {op("or", {equal, smaller}), positive});
+        }
+        return op("and", {positive, op("or", {smaller, equal})});
+    };
+    auto first =
+        clause(forall({"x", "y"}, op("=>", {conditions(false),
+                                            op("INV", {x, y})})));
+    auto second =
+        clause(forall({"x", "y"}, op("=>", {conditions(true),
+                                            op("INV", {x, y})})));
+    EXPECT_EQ(keptOf(first, second), 1u);
+    // The order of the arguments of other operations matters
+    EXPECT_EQ(keptOf(clause(op("<", {x, y})), clause(op("<", {y, x}))), 2u);
+}
+
+TEST(RemoveDuplicateClauses, KeepsClausesThatDifferInAFreeName) {
+    // y is free, so it can't be renamed like the bound x
+    auto first = clause(forall({"x"}, step("x", "y")));
+    auto second = clause(forall({"x"}, step("x", "z")));
+    EXPECT_EQ(keptOf(first, second), 2u);
+    // The same for the names of the predicates
+    auto other =
+        clause(forall({"x"}, op("=>", {op("INV", {var("x"), var("y")}),
+                                       op("INV2", {op("+", {var("x"), num(1)}),
+                                                   var("y")})})));
+    EXPECT_EQ(keptOf(first, other), 2u);
+}
+
+TEST(RemoveDuplicateClauses, RemovesRepeatedDeclarations) {
+    auto declaration = [] {
+        return std::make_shared<FunDecl>(
+            "INV", std::vector<Type>{int64Type(), int64Type()}, boolType());
+    };
+    auto first = declaration();
+    auto result = removeDuplicateClauses({first, declaration()});
+    ASSERT_EQ(result.size(), 1u);
+    EXPECT_EQ(result.front(), first);
+}
@@ -0,0 +1,81 @@
+#include "HashCons.h"
+
+#include <gtest/gtest.h>
+
+using namespace smt;
+
+// True if the variable or string 'name' occurs in 'expr'
+static bool mentions(const SMTExpr &expr, const std::string &name) {
+    switch (expr.getTag()) {
+    case ExprTag::TypedVariable:
+        return static_cast<const TypedVariable &>(expr).name == name;
+    case ExprTag::ConstantString:
+        return static_cast<const ConstantString &>(expr).value == name;
+    case ExprTag::Op:
+        for (const auto &arg : expr.asOp()->args) {
+            if (mentions(*arg, name)) {
+                return true;
+            }
+        }
+        return false;
+    case ExprTag::Forall:
+        return mentions(*expr.asForall()->expr, name);
+    case ExprTag::Let: {
+        const auto &let = static_cast<const Let &>(expr);
+        for (const auto &def : let.defs) {
+            if (mentions(*def.second, name)) {
+                return true;
+            }
+        }
+        return mentions(*let.expr, name);
+    }
+    default:
+        return false;
+    }
+}
+
+// The nested forall below the bindings of the clause
+static const Forall &nestedForall(const SMTExpr &clause) {
+    const SMTExpr *expr = &clause;
+    while (expr->getTag() == ExprTag::Let) {
+        expr = static_cast<const Let *>(expr)->expr.get();
+    }
+    const SMTExpr &conclusion = *expr->asOp()->args.at(1);
+    return *conclusion.asOp()->args.at(1)->asForall();
+}
+
+// (=> (> t 0) (and true (forall ((var Int)) (> t 1)))) with t = (+ (* x y) y)
+static SharedSMTRef clauseWithNestedForall(HashConsFactory &factory,
+                                           const std::string &var) {
+    auto x = factory.variable("x", int64Type());
+    auto y = factory.variable("y", int64Type());
+    auto term = factory.op("+", {factory.op("*", {x, y}), y});
+    auto zero = factory.constantInt(llvm::APInt(64, 0));
+    auto one = factory.constantInt(llvm::APInt(64, 1));
+    auto nested = std::make_shared<Forall>(
+        std::vector<SortedVar>{SortedVar(var, int64Type())},
+        factory.op(">", {term, one}));
+    return factory.op(
+        "=>", {factory.op(">", {term, zero}),
+               factory.op("and", {factory.constantBool(true), nested})});
+}
+
+TEST(BindSharedSubterms, BindsTermsUnderUnrelatedQuantifiers) {
+    HashConsFactory factory;
+    auto clause = bindSharedSubterms(clauseWithNestedForall(factory, "z"));
+    ASSERT_EQ(clause->getTag(), ExprTag::Let);
+    const Forall &forall = nestedForall(*clause);
+    EXPECT_TRUE(mentions(*forall.expr, "shared$0"));
+    EXPECT_FALSE(mentions(*forall.expr, "x"));
+}
+
+// x is rebound by the nested forall, so its occurrence of the term refers to
+// another variable and must not be replaced by the binding outside
+TEST(BindSharedSubterms, KeepsTermsMentioningShadowedVariables) {
+    HashConsFactory factory;
+    auto clause = bindSharedSubterms(clauseWithNestedForall(factory, "x"));
+    const Forall &forall = nestedForall(*clause);
+    EXPECT_FALSE(mentions(*forall.expr, "shared$0"));
+    EXPECT_TRUE(mentions(*forall.expr, "x"));
+    EXPECT_TRUE(mentions(*forall.expr, "y"));
+}
@@ -0,0 +1,298 @@
+// Runs llreve-verify on the examples and reports the time spent in each phase
+// (compile, preprocess, generate, serialize and solve) as CSV or JSON. The
+// output only depends on the measured times, so the output of two revisions
+// can be compared directly.
+//
+// Usage: llreve-bench [options] [directory/name ...]
+//   -repetitions=N  run every example N times (default 3) and report the
+//                   minimum, median and maximum of each phase
+//   -no-solve       only generate and write out the clauses
+//   -json           write JSON instead of CSV
+//   -o=FILE         write the results to FILE instead of stdout
+//   -clause-orders=ORDER,...
+//                   run every example once per clause order (see
+//                   -clause-order of llreve-verify), the rows are labeled
+//                   e.g. loop/fib[topological]
+//   -- ARGS         pass the remaining arguments to llreve-verify
+// Without explicit examples the examples from LlreveTest are used.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+static string PathToBenchExecutable;
+
+static std::pair<int, string> exec(const string &cmd) {
+    std::array<char, 128> buffer;
+    string result;
+    auto pipe = popen(cmd.c_str(), "r");
+    if (!pipe) {
+        perror("popen");
+        exit(1);
+    }
+    while (!feof(pipe)) {
+        if (fgets(buffer.data(), 128, pipe) != NULL)
+            result += buffer.data();
+    }
+    int exitCode = pclose(pipe);
+    return {exitCode, result};
+}
+
+// An example consists of the files examples/<Directory>/<Name>_{1,2}.c
+struct Example {
+    string Directory;
+    string Name;
+};
+
+// The same examples as in LlreveTest except for the faulty ones
+static vector<Example> defaultExamples() {
+    const vector<std::pair<string, vector<string>>> directories = {
+        {"loop",
+         {"barthe", "barthe2", "barthe2-big", "barthe2-big2", "break",
+          "break_single", "bug15", "digits10_inl", "fib", "loop", "loop2",
+          "loop3", "loop_unswitching", "nested-while", "simple-loop",
+          "upcount", "while_after_while_if", "while-if"}},
+        {"heap",
+         {"clearstr", "cocome2", "fib", "heap_call", "memcpy_a", "memcpy_b",
+          "propagate"}},
+        {"rec",
+         {"ackermann", "add-horn", "cocome1", "inlining", "limit1unrolled",
+          "limit2", "limit3", "loop_rec", "mccarthy91", "triangular"}},
+        {"libc",
+         {"memccpy_1", "memchr_1", "memmove_1", "memrchr_1", "memset_1",
+          "sbrk_1", "stpcpy_1", "strcmp", "strncmp_2", "strncmp_3",
+          "strpbrk_3"}},
+        {"redis/t_zset", {"t_zset"}}};
+    vector<Example> examples;
+    for (const auto &directory : directories) {
+        for (const auto &name : directory.second) {
+            examples.push_back({directory.first, name});
+        }
+    }
+    return examples;
+}
+
+// The measurements of all repetitions of one example
+struct Result {
+    Example Input;
+    // The clause order, empty if llreve-verify uses its default
+    string Variant;
+    string Verdict;
+    // The phases in the order in which llreve-verify reports them
+    vector<string> Phases;
+    std::map<string, vector<double>> Times;
+};
+
+// Extracts the verdict and the times from the JSON printed by llreve-verify,
+// e.g. {"verdict": "EQUAL", "times": {"compile": 0.1, "solve": 0.2}}
+static void parseReport(const string &report, Result &result) {
+    size_t pos = report.find("\"verdict\": \"");
+    if (pos != string::npos) {
+        pos += 12;
+        result.Verdict = report.substr(pos, report.find('"', pos) - pos);
+    }
+    pos = report.find("\"times\": {");
+    if (pos == string::npos) {
+        return;
+    }
+    pos += 10;
+    while ((pos = report.find('"', pos)) != string::npos) {
+        const size_t end = report.find('"', pos + 1);
+        const string phase = report.substr(pos + 1, end - pos - 1);
+        const double seconds = std::strtod(report.c_str() + end + 2, nullptr);
+        if (result.Times.count(phase) == 0) {
+            result.Phases.push_back(phase);
+        }
+        result.Times[phase].push_back(seconds);
+        pos = end + 1;
+    }
+}
+
+static auto runExample(const Example &example, unsigned repetitions,
+                       bool solve, const string &clauseOrder,
+                       const string &extraArgs) -> Result {
+    const string fileName = PathToBenchExecutable + "../../examples/" +
+                            example.Directory + "/" + example.Name;
+    char smtOutput[] = "/tmp/llreve-bench-XXXXXX";
+    int fd = mkstemp(smtOutput);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+    std::ostringstream command;
+    command << PathToBenchExecutable << "llreve-verify -inline-opts"
+            << " -I=" << PathToBenchExecutable << "../../examples/headers"
+            << " -o=" << smtOutput << (solve ? "" : " -solve=");
+    if (!clauseOrder.empty()) {
+        command << " -clause-order=" << clauseOrder;
+    }
+    command << " " << extraArgs << " " << fileName << "_1.c " << fileName
+            << "_2.c";
+
+    Result result;
+    result.Input = example;
+    result.Variant = clauseOrder;
+    for (unsigned i = 0; i < repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        int exitCode;
+        string report;
+        std::tie(exitCode, report) = exec(command.str());
+        const std::chrono::duration<double> total =
+            std::chrono::steady_clock::now() - start;
+        if (exitCode != 0) {
+            std::cerr << "Failed: " << command.str() << "\n";
+            result.Verdict = "ERROR";
+            break;
+        }
+        parseReport(report, result);
+        if (result.Times.count("total") == 0) {
+            result.Phases.push_back("total");
+        }
+        result.Times["total"].push_back(total.count());
+    }
+    std::remove(smtOutput);
+    return result;
+}
+
+static auto label(const Result &result) -> string {
+    string label = result.Input.Directory + "/" + result.Input.Name;
+    if (!result.Variant.empty()) {
+        label += "[" + result.Variant + "]";
+    }
+    return label;
+}
+
+struct Summary {
+    double Min;
+    double Median;
+    double Max;
+};
+
+static auto summarize(vector<double> times) -> Summary {
+    std::sort(times.begin(), times.end());
+    return {times.front(), times[times.size() / 2], times.back()};
+}
+
+// One row per example and phase
+static void writeCSV(std::ostream &out, const vector<Result> &results) {
+    out << "example,verdict,phase,repetitions,min,median,max\n";
+    for (const auto &result : results) {
+        for (const auto &phase : result.Phases) {
+            const auto &times = result.Times.at(phase);
+            const Summary summary = summarize(times);
+            out << label(result) << "," << result.Verdict << "," << phase << ","
+                << times.size() << "," << summary.Min << ","
+                << summary.Median << "," << summary.Max << "\n";
+        }
+    }
+}
+
+static void writeJSON(std::ostream &out, const vector<Result> &results) {
+    out << "[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &result = results[i];
+        out << (i > 0 ? ",\n" : "\n") << "{\"example\": \"" << label(result)
+            << "\", \"verdict\": \"" << result.Verdict << "\", \"times\": {";
+        for (size_t j = 0; j < result.Phases.size(); ++j) {
+            const auto &phase = result.Phases[j];
+            const auto &times = result.Times.at(phase);
+            const Summary summary = summarize(times);
+            out << (j > 0 ? ", " : "") << "\"" << phase
+                << "\": {\"repetitions\": " << times.size()
+                << ", \"min\": " << summary.Min
+                << ", \"median\": " << summary.Median
+                << ", \"max\": " << summary.Max << "}";
+        }
+        out << "}}";
+    }
+    out << "\n]\n";
+}
+
+static string getDirectory(string filePath) {
+    auto pos = filePath.rfind('/');
+    if (pos != string::npos) {
+        filePath = filePath.substr(0, pos) + "/";
+    }
+    return filePath;
+}
+
+int main(int argc, char **argv) {
+    PathToBenchExecutable = getDirectory(argv[0]);
+    unsigned repetitions = 3;
+    bool solve = true;
+    bool json = false;
+    string outputFileName;
+    string extraArgs;
+    vector<string> clauseOrders;
+    vector<Example> examples;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg.compare(0, 13, "-repetitions=") == 0) {
+            repetitions = std::max(std::atoi(arg.c_str() + 13), 1);
+        } else if (arg == "-no-solve") {
+            solve = false;
+        } else if (arg == "-json") {
+            json = true;
+        } else if (arg.compare(0, 3, "-o=") == 0) {
+            outputFileName = arg.substr(3);
+        } else if (arg.compare(0, 15, "-clause-orders=") == 0) {
+            std::istringstream orders(arg.substr(15));
+            string order;
+            while (std::getline(orders, order, ',')) {
+                clauseOrders.push_back(order);
+            }
+        } else if (arg == "--") {
+            for (++i; i < argc; ++i) {
+                extraArgs += string(" ") + argv[i];
+            }
+        } else if (arg[0] != '-' && arg.rfind('/') != string::npos) {
+            const size_t slash = arg.rfind('/');
+            examples.push_back({arg.substr(0, slash), arg.substr(slash + 1)});
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (examples.empty()) {
+        examples = defaultExamples();
+    }
+    if (clauseOrders.empty()) {
+        clauseOrders.push_back("");
+    }
+
+    vector<Result> results;
+    for (const auto &example : examples) {
+        for (const auto &order : clauseOrders) {
+            std::cerr << example.Directory << "/" << example.Name
+                      << (order.empty() ? "" : "[" + order + "]") << "\n";
+            results.push_back(
+                runExample(example, repetitions, solve, order, extraArgs));
+        }
+    }
+
+    std::ofstream outFile;
+    if (!outputFileName.empty()) {
+        outFile.open(outputFileName);
+    }
+    std::ostream &out = outputFileName.empty() ? std::cout : outFile;
+    if (json) {
+        writeJSON(out, results);
+    } else {
+        writeCSV(out, results);
+    }
+    return 0;
+}
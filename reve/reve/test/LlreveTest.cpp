@@ -1,10 +1,19 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
 #include <memory>
 #include <regex>
+#include <sys/wait.h>
 
 using std::string;
 
 static std::string PathToTestExecutable;
+// Time limit in seconds for each command run by a test, can be set using the
+// environment variable LLREVE_TEST_TIMEOUT. 0 means no limit.
+static unsigned CommandTimeout = 300;
+// Exit code of timeout(1) if the command did not finish in time
+static const int TimedOut = 124;
 
 static std::pair<int, std::string> exec(const std::string &cmd) {
     std::array<char, 128> buffer;
@@ -20,6 +29,40 @@ static std::pair<int, std::string> exec(const std::string &cmd) {
     return {exitCode, result};
 }
 
+// Run the command with the time limit and return its exit code and output
+static std::pair<int, std::string> execWithTimeout(const std::string &cmd) {
+    std::string command = cmd;
+    if (CommandTimeout > 0) {
+        command = "timeout " + std::to_string(CommandTimeout) + " " + cmd;
+    }
+    auto result = exec(command);
+    if (WIFEXITED(result.first)) {
+        result.first = WEXITSTATUS(result.first);
+    }
+    return result;
+}
+
+// Prints the tests of this run sorted by their duration, slowest first, so
+// examples that dominate the run time are easy to spot
+class SlowestTestsPrinter : public testing::EmptyTestEventListener {
+  public:
+    void OnTestEnd(const testing::TestInfo &info) override {
+        times.push_back({info.result()->elapsed_time(),
+                         std::string(info.test_case_name()) + "." +
+                             info.name()});
+    }
+    void OnTestProgramEnd(const testing::UnitTest & /* unused */) override {
+        std::sort(times.rbegin(), times.rend());
+        std::cout << "Slowest tests:\n";
+        for (const auto &time : times) {
+            std::cout << "  " << time.first << " ms  " << time.second << "\n";
+        }
+    }
+
+  private:
+    std::vector<std::pair<testing::TimeInMillis, std::string>> times;
+};
+
 enum class Solver { Z3, ELDARICA };
 enum class ExpectedResult { EQUIVALENT, NOT_EQUIVALENT, UNKNOWN };
 
@@ -63,20 +106,11 @@ ExpectedResult parseEldResult(const std::string &output) {
     return ExpectedResult::UNKNOWN;
 }
 
-class LlreveTest
-    : public testing::TestWithParam<
-          ::testing::tuple<std::string, std::string, ExpectedResult, Solver>> {
-  protected:
-    virtual void SetUp() {}
-    virtual void TearDown() {}
-};
-
-TEST_P(LlreveTest, Llreve) {
-    std::string directory;
-    std::string fileName;
-    ExpectedResult expectedResult;
-    Solver solver;
-    std::tie(directory, fileName, expectedResult, solver) = GetParam();
+// Encode the example using llreve with the additional flags and check the
+// verdict of the solver
+static void runLlreve(const std::string &directory, std::string fileName,
+                      ExpectedResult expectedResult, Solver solver,
+                      const std::string &flags) {
     fileName =
         PathToTestExecutable + "../../examples/" + directory + "/" + fileName;
     char smtOutput[7] = "XXXXXX";
@@ -94,33 +128,104 @@ TEST_P(LlreveTest, Llreve) {
     if (solver == Solver::Z3) {
         llreveCommand << "-muz ";
     }
+    if (!flags.empty()) {
+        llreveCommand << flags << " ";
+    }
     llreveCommand << fileName << "_1.c"
                   << " " << fileName << "_2.c";
     std::string llreveOutput;
     int exitCode;
-    std::tie(exitCode, llreveOutput) = exec(llreveCommand.str());
+    std::tie(exitCode, llreveOutput) = execWithTimeout(llreveCommand.str());
+    ASSERT_NE(exitCode, TimedOut) << "llreve timed out";
     ASSERT_EQ(exitCode, 0);
     switch (solver) {
     case Solver::Z3: {
         std::ostringstream z3Command;
         z3Command << "z3 fixedpoint.engine=duality " << smtOutput;
         std::string z3Output;
-        std::tie(exitCode, z3Output) = exec(z3Command.str());
+        std::tie(exitCode, z3Output) = execWithTimeout(z3Command.str());
+        ASSERT_NE(exitCode, TimedOut) << "z3 timed out";
         ASSERT_EQ(exitCode, 0);
         ASSERT_EQ(parseZ3Result(z3Output), expectedResult);
         break;
     }
-    case Solver::ELDARICA:
-        std::ostringstream eldCommand;
-        eldCommand << "eld-client -hsmt " << smtOutput;
-        std::string eldOutput;
-        std::tie(exitCode, eldOutput) = exec(eldCommand.str());
-        ASSERT_EQ(exitCode, 0);
-        parseEldResult(eldOutput);
+    case Solver::ELDARICA: {
+        // With -split-components each component is written to its own file
+        // and the programs are equivalent iff all of them are satisfiable
+        std::vector<std::string> outputFiles;
+        if (flags.find("-split-components") == std::string::npos) {
+            outputFiles.push_back(smtOutput);
+        } else {
+            for (size_t i = 0;; ++i) {
+                std::string component =
+                    std::string(smtOutput) + "." + std::to_string(i);
+                if (!std::ifstream(component)) {
+                    break;
+                }
+                outputFiles.push_back(component);
+            }
+            ASSERT_FALSE(outputFiles.empty()) << "no components written";
+        }
+        ExpectedResult result = ExpectedResult::EQUIVALENT;
+        for (const auto &outputFile : outputFiles) {
+            std::ostringstream eldCommand;
+            eldCommand << "eld-client -hsmt " << outputFile;
+            std::string eldOutput;
+            std::tie(exitCode, eldOutput) = execWithTimeout(eldCommand.str());
+            if (outputFile != smtOutput) {
+                std::remove(outputFile.c_str());
+            }
+            ASSERT_NE(exitCode, TimedOut) << "eldarica timed out";
+            ASSERT_EQ(exitCode, 0);
+            ExpectedResult componentResult = parseEldResult(eldOutput);
+            if (componentResult == ExpectedResult::NOT_EQUIVALENT ||
+                result == ExpectedResult::EQUIVALENT) {
+                result = componentResult;
+            }
+        }
+        ASSERT_EQ(result, expectedResult);
         break;
     }
+    }
     std::remove(smtOutput);
-    EXPECT_EQ(0, 0);
+}
+
+class LlreveTest
+    : public testing::TestWithParam<
+          ::testing::tuple<std::string, std::string, ExpectedResult, Solver>> {
+  protected:
+    virtual void SetUp() {}
+    virtual void TearDown() {}
+};
+
+TEST_P(LlreveTest, Llreve) {
+    std::string directory;
+    std::string fileName;
+    ExpectedResult expectedResult;
+    Solver solver;
+    std::tie(directory, fileName, expectedResult, solver) = GetParam();
+    runLlreve(directory, fileName, expectedResult, solver, "");
+}
+
+// Flags that change the encoding are run over examples with both verdicts, so
+// an unsound encoding shows up as a wrong verdict
+class LlreveFlagsTest
+    : public testing::TestWithParam<
+          ::testing::tuple<std::string, std::string, std::string,
+                           ExpectedResult, Solver>> {
+  protected:
+    virtual void SetUp() {}
+    virtual void TearDown() {}
+};
+
+TEST_P(LlreveFlagsTest, Llreve) {
+    std::string flags;
+    std::string directory;
+    std::string fileName;
+    ExpectedResult expectedResult;
+    Solver solver;
+    std::tie(flags, directory, fileName, expectedResult, solver) = GetParam();
+    runLlreve(directory, fileName, expectedResult, solver, flags);
 }
 
 INSTANTIATE_TEST_CASE_P(
@@ -144,6 +249,22 @@ INSTANTIATE_TEST_CASE_P(
                      testing::Values(ExpectedResult::NOT_EQUIVALENT),
                      testing::Values(Solver::Z3, Solver::ELDARICA)));
 
+// Paths with contradicting conditions are dropped before encoding. The faulty
+// examples only contradict each other for bounded integers.
+INSTANTIATE_TEST_CASE_P(
+    Pruning, LlreveTest,
+    testing::Combine(testing::Values("pruning"),
+                     testing::Values("contradiction"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyPruning, LlreveTest,
+    testing::Combine(testing::Values("pruning"),
+                     testing::Values("bounds!", "unsigned!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
 // This example cannot be solved by Z3. It can be solved when we instantiate the
 // array in the custom precondition but Z3 issues a warning and it is unclear if
 // that is actually handled correctly.
@@ -191,6 +312,241 @@ INSTANTIATE_TEST_CASE_P(
                      testing::Values(ExpectedResult::EQUIVALENT),
                      testing::Values(Solver::Z3)));
 
+INSTANTIATE_TEST_CASE_P(
+    HeapRegions, LlreveFlagsTest,
+    testing::Combine(testing::Values("-heap -heap-regions"),
+                     testing::Values("heap"),
+                     testing::Values("clearstr", "fib", "memcpy_a", "memcpy_b",
+                                     "propagate"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+// Without aliasing the two stores commute, so splitting the heap of the
+// faulty example into disjoint regions would prove it equivalent
+INSTANTIATE_TEST_CASE_P(
+    FaultyHeapRegions, LlreveFlagsTest,
+    testing::Combine(testing::Values("-heap -heap-regions"),
+                     testing::Values("faulty"), testing::Values("alias!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    ReduceInvariantArgs, LlreveFlagsTest,
+    testing::Combine(testing::Values("-reduce-invariant-args"),
+                     testing::Values("loop"),
+                     testing::Values("barthe", "loop", "nested-while",
+                                     "simple-loop", "upcount"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyReduceInvariantArgs, LlreveFlagsTest,
+    testing::Combine(testing::Values("-reduce-invariant-args"),
+                     testing::Values("faulty"),
+                     testing::Values("barthe!", "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+// Predicates can only be eliminated in the SMT-HORN format, which is not
+// used for z3
+INSTANTIATE_TEST_CASE_P(
+    EliminatePredicatesLoop, LlreveFlagsTest,
+    testing::Combine(testing::Values("-eliminate-predicates"),
+                     testing::Values("loop"),
+                     testing::Values("loop", "simple-loop", "while-if"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    EliminatePredicatesRec, LlreveFlagsTest,
+    testing::Combine(testing::Values("-eliminate-predicates"),
+                     testing::Values("rec"),
+                     testing::Values("add-horn", "inlining", "limit2"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyEliminatePredicates, LlreveFlagsTest,
+    testing::Combine(testing::Values("-eliminate-predicates"),
+                     testing::Values("faulty"),
+                     testing::Values("add-horn!", "inlining!", "limit1!",
+                                     "loop5!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+// Loops are only accelerated if they are the only recursive clause of their
+// invariant, so the loops of these examples have to run in lockstep. Loop
+// acceleration is not supported for the muZ format.
+INSTANTIATE_TEST_CASE_P(
+    AccelerateLoops, LlreveFlagsTest,
+    testing::Combine(testing::Values("-accelerate-loops -perfect-sync"),
+                     testing::Values("loop"),
+                     testing::Values("barthe", "loop", "loop2"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyAccelerateLoops, LlreveFlagsTest,
+    testing::Combine(testing::Values("-accelerate-loops -perfect-sync"),
+                     testing::Values("faulty"),
+                     testing::Values("barthe!", "loop5!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    MergePathsLoop, LlreveFlagsTest,
+    testing::Combine(testing::Values("-merge-paths"), testing::Values("loop"),
+                     testing::Values("barthe", "barthe2", "break",
+                                     "break_single", "fib", "loop", "loop2",
+                                     "loop3", "loop_unswitching",
+                                     "nested-while", "simple-loop", "upcount",
+                                     "while_after_while_if", "while-if"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    MergePathsRec, LlreveFlagsTest,
+    testing::Combine(testing::Values("-merge-paths"), testing::Values("rec"),
+                     testing::Values("ackermann", "add-horn", "inlining",
+                                     "limit1unrolled", "limit2", "limit3",
+                                     "loop_rec", "mccarthy91", "triangular"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyMergePaths, LlreveFlagsTest,
+    testing::Combine(testing::Values("-merge-paths"), testing::Values("faulty"),
+                     testing::Values("ackermann!", "add-horn!", "barthe!",
+                                     "inlining!", "limit1!", "limit2!",
+                                     "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    LinearForbiddenPaths, LlreveFlagsTest,
+    testing::Combine(testing::Values("-linear-forbidden-paths"),
+                     testing::Values("loop"),
+                     testing::Values("barthe", "break", "loop", "nested-while",
+                                     "simple-loop", "while-if"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyLinearForbiddenPaths, LlreveFlagsTest,
+    testing::Combine(testing::Values("-linear-forbidden-paths"),
+                     testing::Values("faulty"),
+                     testing::Values("ackermann!", "add-horn!", "barthe!",
+                                     "inlining!", "limit1!", "limit2!",
+                                     "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
+// The clauses are only simplified in the SMT-HORN format, which is not used
+// for z3
+INSTANTIATE_TEST_CASE_P(
+    SimplifyLoop, LlreveFlagsTest,
+    testing::Combine(testing::Values("-simplify"), testing::Values("loop"),
+                     testing::Values("barthe", "barthe2", "break",
+                                     "break_single", "bug15", "fib", "loop",
+                                     "loop2", "loop3", "loop_unswitching",
+                                     "nested-while", "simple-loop", "upcount",
+                                     "while_after_while_if", "while-if"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    SimplifyRec, LlreveFlagsTest,
+    testing::Combine(testing::Values("-simplify"), testing::Values("rec"),
+                     testing::Values("ackermann", "add-horn", "cocome1",
+                                     "inlining", "limit1unrolled", "limit2",
+                                     "limit3", "loop_rec", "mccarthy91",
+                                     "triangular"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultySimplify, LlreveFlagsTest,
+    testing::Combine(testing::Values("-simplify"), testing::Values("faulty"),
+                     testing::Values("ackermann!", "add-horn!", "barthe!",
+                                     "inlining!", "limit1!", "limit2!",
+                                     "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+// The cone of influence reduction is not supported for the muZ format. The
+// recursive examples contain functional abstractions the queries don't use.
+INSTANTIATE_TEST_CASE_P(
+    ConeOfInfluence, LlreveFlagsTest,
+    testing::Combine(testing::Values("-cone-of-influence"),
+                     testing::Values("rec"),
+                     testing::Values("ackermann", "add-horn", "inlining",
+                                     "limit2", "loop_rec", "triangular"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultyConeOfInfluence, LlreveFlagsTest,
+    testing::Combine(testing::Values("-cone-of-influence"),
+                     testing::Values("faulty"),
+                     testing::Values("ackermann!", "add-horn!", "barthe!",
+                                     "inlining!", "limit1!", "limit2!",
+                                     "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+// Splitting components is not supported for the muZ format
+INSTANTIATE_TEST_CASE_P(
+    SplitComponents, LlreveFlagsTest,
+    testing::Combine(testing::Values("-split-components"),
+                     testing::Values("loop"),
+                     testing::Values("barthe", "break", "fib", "loop",
+                                     "nested-while", "simple-loop", "upcount",
+                                     "while-if"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultySplitComponents, LlreveFlagsTest,
+    testing::Combine(testing::Values("-split-components"),
+                     testing::Values("faulty"),
+                     testing::Values("ackermann!", "add-horn!", "barthe!",
+                                     "inlining!", "limit1!", "limit2!",
+                                     "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+// The muZ format uses the assignments of the paths directly
+INSTANTIATE_TEST_CASE_P(
+    SharedPathRelations, LlreveFlagsTest,
+    testing::Combine(testing::Values("-shared-path-relations"),
+                     testing::Values("loop"),
+                     testing::Values("barthe", "barthe2", "break",
+                                     "break_single", "fib", "loop", "loop2",
+                                     "loop3", "loop_unswitching",
+                                     "nested-while", "simple-loop", "upcount",
+                                     "while_after_while_if", "while-if"),
+                     testing::Values(ExpectedResult::EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+INSTANTIATE_TEST_CASE_P(
+    FaultySharedPathRelations, LlreveFlagsTest,
+    testing::Combine(testing::Values("-shared-path-relations"),
+                     testing::Values("faulty"),
+                     testing::Values("ackermann!", "add-horn!", "barthe!",
+                                     "inlining!", "limit1!", "limit2!",
+                                     "loop5!", "nested-while!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::ELDARICA)));
+
+// The store through the long pointer clears both fields of the pair, so the
+// accesses must not be mapped to one cell per primitive
+INSTANTIATE_TEST_CASE_P(
+    FaultyWordHeap, LlreveFlagsTest,
+    testing::Combine(testing::Values("-word-heap"), testing::Values("faulty"),
+                     testing::Values("pun!"),
+                     testing::Values(ExpectedResult::NOT_EQUIVALENT),
+                     testing::Values(Solver::Z3, Solver::ELDARICA)));
+
 static std::string getDirectory(std::string filePath) {
     auto pos = filePath.rfind('/');
     if (pos != std::string::npos) {
@@ -201,6 +557,11 @@ static std::string getDirectory(std::string filePath) {
 
 int main(int argc, char **argv) {
     PathToTestExecutable = getDirectory(argv[0]);
+    if (const char *timeout = std::getenv("LLREVE_TEST_TIMEOUT")) {
+        CommandTimeout = std::atoi(timeout);
+    }
     ::testing::InitGoogleTest(&argc, argv);
+    ::testing::UnitTest::GetInstance()->listeners().Append(
+        new SlowestTestsPrinter);
     return RUN_ALL_TESTS();
 }
@@ -0,0 +1,129 @@
+#include "Simplify.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace smt;
+
+static SharedSMTRef var(const std::string &name) {
+    return std::make_shared<TypedVariable>(name, int64Type());
+}
+
+static SharedSMTRef boolVar(const std::string &name) {
+    return std::make_shared<TypedVariable>(name, boolType());
+}
+
+static SharedSMTRef num(int64_t value) {
+    return std::make_shared<ConstantInt>(llvm::APInt(64, value, true));
+}
+
+static SharedSMTRef boolean(bool value) {
+    return std::make_shared<ConstantBool>(value);
+}
+
+static SharedSMTRef op(const std::string &name,
+                       std::vector<SharedSMTRef> args) {
+    return std::make_shared<Op>(name, std::move(args));
+}
+
+static std::string show(const SharedSMTRef &expr) {
+    std::ostringstream out;
+    expr->toSExpr()->serialize(out, 0, false);
+    return out.str();
+}
+
+static std::string simplified(const SharedSMTRef &expr) {
+    return show(simplify(expr));
+}
+
+TEST(Simplify, FoldsIntegerArithmetic) {
+    EXPECT_EQ(simplified(op("+", {num(2), op("*", {num(3), num(4)})})), "14");
+    EXPECT_EQ(simplified(op("-", {num(5)})), "(- 5)");
+    EXPECT_EQ(simplified(op("-", {num(1), num(2), num(3)})), "(- 4)");
+    EXPECT_EQ(simplified(op("+", {var("x"), op("+", {num(1), num(2)})})),
+              "(+ x 3)");
+}
+
+TEST(Simplify, KeepsFoldsThatDontFitIntoSixtyFourBits) {
+    auto product = op("*", {num(INT64_MAX), num(2)});
+    EXPECT_EQ(simplify(product), product);
+    auto difference = op("-", {num(INT64_MIN)});
+    EXPECT_EQ(simplify(difference), difference);
+}
+
+TEST(Simplify, FoldsComparisons) {
+    EXPECT_EQ(simplified(op("<", {num(-1), num(2)})), "true");
+    EXPECT_EQ(simplified(op("<=", {num(2), num(2)})), "true");
+    EXPECT_EQ(simplified(op(">", {num(1), num(2)})), "false");
+    EXPECT_EQ(simplified(op(">=", {num(-3), num(2)})), "false");
+    EXPECT_EQ(simplified(op("=", {num(2), op("+", {num(1), num(1)})})),
+              "true");
+    EXPECT_EQ(simplified(op("=", {boolean(true), boolean(false)})), "false");
+}
+
+TEST(Simplify, AbsorbsBooleanConstants) {
+    auto x = boolVar("x");
+    auto y = boolVar("y");
+    EXPECT_EQ(simplified(op("and", {boolean(true), x})), "x");
+    EXPECT_EQ(simplified(op("and", {x, boolean(false), y})), "false");
+    EXPECT_EQ(simplified(op("and", {boolean(true), boolean(true)})), "true");
+    EXPECT_EQ(simplified(op("or", {x, boolean(true)})), "true");
+    EXPECT_EQ(simplified(op("or", {boolean(false), boolean(false)})), "false");
+    EXPECT_EQ(simplified(op("not", {op("not", {x})})), "x");
+    EXPECT_EQ(simplified(op("not", {boolean(false)})), "true");
+}
+
+TEST(Simplify, FlattensNestedJunctions) {
+    auto x = boolVar("x");
+    auto y = boolVar("y");
+    auto z = boolVar("z");
+    EXPECT_EQ(
+        simplified(op("and", {x, op("and", {y, boolean(true)}), z})),
+        "(and x y z)");
+    // Only applications of the same junction are flattened
+    EXPECT_EQ(simplified(op("or", {x, op("and", {y, z})})),
+              "(or x (and y z))");
+}
+
+TEST(Simplify, SimplifiesImplications) {
+    auto x = boolVar("x");
+    EXPECT_EQ(simplified(op("=>", {boolean(false), x})), "true");
+    EXPECT_EQ(simplified(op("=>", {x, boolean(true)})), "true");
+    EXPECT_EQ(simplified(op("=>", {boolean(true), x})), "x");
+    EXPECT_EQ(simplified(op("=>", {x, x})), "true");
+}
+
+TEST(Simplify, SimplifiesEqualitiesAndIfThenElse) {
+    auto x = var("x");
+    auto y = var("y");
+    EXPECT_EQ(simplified(op("=", {op("+", {x, y}), op("+", {x, y})})),
+              "true");
+    EXPECT_EQ(simplified(op("ite", {boolean(true), x, y})), "x");
+    EXPECT_EQ(simplified(op("ite", {boolean(false), x, y})), "y");
+    EXPECT_EQ(simplified(op("ite", {boolVar("c"), x, x})), "x");
+    // Equal names are not enough for different operators
+    EXPECT_EQ(simplified(op("=", {op("+", {x, y}), op("-", {x, y})})),
+              "(= (+ x y) (- x y))");
+}
+
+TEST(Simplify, ReplacesBindersOfConstants) {
+    auto forall = std::make_shared<Forall>(
+        std::vector<SortedVar>{SortedVar("x", int64Type())},
+        op("=>", {op("<", {var("x"), var("x")}), boolean(true)}));
+    EXPECT_EQ(simplified(forall), "true");
+    auto let = std::make_shared<Let>(
+        AssignmentVec{{"x", num(1)}}, op("<", {num(1), num(2)}));
+    EXPECT_EQ(simplified(let), "true");
+    EXPECT_TRUE(isTriviallyTrue(*simplify(std::make_shared<Assert>(forall))));
+}
+
+TEST(Simplify, SharesUnchangedSubterms) {
+    auto x = var("x");
+    auto unchanged = op("+", {x, num(1)});
+    auto expr = op("<", {unchanged, op("+", {num(1), num(2)})});
+    auto result = simplify(expr);
+    ASSERT_NE(result, expr);
+    EXPECT_EQ(result->asOp()->args.at(0), unchanged);
+    EXPECT_EQ(simplify(unchanged), unchanged);
+}
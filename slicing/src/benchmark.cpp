@@ -0,0 +1,186 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "core/Util.h"
+#include "util/FileOperations.h"
+#include "util/misc.h"
+#include "util/SlicingStatistics.h"
+#include "slicingMethods/BruteForce.h"
+#include "slicingMethods/DeltaDebugging.h"
+#include "slicingMethods/DRMSlicing.h"
+#include "slicingMethods/SyntacticBruteForce.h"
+#include "slicingMethods/SyntacticSlicing.h"
+#include "smtSolver/SmtSolver.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace llvm;
+
+void parseArgs(int argc, const char **argv);
+vector<string> benchmarkFiles(string folder);
+unsigned countInstructions(Module& module);
+
+static llvm::cl::OptionCategory BenchmarkCategory("Benchmark options",
+	"Options for controlling the slicing benchmarks.");
+
+static llvm::cl::opt<std::string> FolderFlag(llvm::cl::Positional,
+	llvm::cl::desc("<benchmark folder>"),
+	llvm::cl::init("../testdata/benchmarks/"), llvm::cl::cat(BenchmarkCategory));
+
+enum BenchmarkMethod{syntactic, bruteforce, syntacticbruteforce, drm, ddmin};
+static llvm::cl::list<BenchmarkMethod> MethodsFlag("methods",
+	llvm::cl::desc("The slicing methods to benchmark, defaults to all of them:"),
+	llvm::cl::values(
+		clEnumVal(syntactic, "Syntactic slicing, folowd by verification of the slice."),
+		clEnumVal(bruteforce, "Bruteforce all slicecandidates."),
+		clEnumVal(syntacticbruteforce, "Bruteforce only the instructions kept by the syntactic slice."),
+		clEnumVal(drm, "Slice using the transitive closure of the dependence matrix."),
+		clEnumVal(ddmin, "Remove ever smaller sets of instructions, as long as the slice stays valid."),
+		clEnumValEnd),
+	llvm::cl::CommaSeparated, llvm::cl::cat(BenchmarkCategory));
+
+static llvm::cl::opt<string> ResourceDir("resource-dir",
+	llvm::cl::desc("Directory containing the clang resource files, "
+		"e.g. /usr/local/lib/clang/3.8.0"),
+	llvm::cl::cat(BenchmarkCategory));
+
+static const char* methodName(BenchmarkMethod method) {
+	switch (method) {
+		case syntactic:
+		return "syntactic";
+		case bruteforce:
+		return "bruteforce";
+		case syntacticbruteforce:
+		return "syntacticbruteforce";
+		case drm:
+		return "drm";
+		case ddmin:
+		return "ddmin";
+	}
+	return "";
+}
+
+static SlicingMethodPtr createMethod(BenchmarkMethod method, ModulePtr program) {
+	switch (method) {
+		case syntactic:
+		return shared_ptr<SlicingMethod>(new SyntacticSlicing(program));
+		case bruteforce:
+		return shared_ptr<SlicingMethod>(new BruteForce(program, nullptr));
+		case syntacticbruteforce:
+		return shared_ptr<SlicingMethod>(new SyntacticBruteForce(program, nullptr));
+		case drm:
+		return shared_ptr<SlicingMethod>(new DRMSlicing(program));
+		case ddmin:
+		return shared_ptr<SlicingMethod>(new DeltaDebugging(program));
+	}
+	return shared_ptr<SlicingMethod>(nullptr);
+}
+
+void parseArgs(int argc, const char **argv) {
+	vector<llvm::cl::OptionCategory*> optionCategorys;
+	optionCategorys.push_back(&BenchmarkCategory);
+	llvm::cl::HideUnrelatedOptions(optionCategorys);
+	llvm::cl::ParseCommandLineOptions(argc, argv);
+}
+
+/** The C files of the folder, sorted by name */
+vector<string> benchmarkFiles(string folder) {
+	vector<string> files;
+	std::error_code errorCode;
+	for (sys::fs::directory_iterator it(folder, errorCode), end;
+		it != end && !errorCode; it.increment(errorCode)) {
+		if (sys::path::extension(it->path()) == ".c") {
+			files.push_back(it->path());
+		}
+	}
+	if (errorCode) {
+		errs() << "ERROR: Could not read the benchmark folder " << folder << "\n";
+		exit(1);
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+unsigned countInstructions(Module& module) {
+	unsigned instructions = 0;
+	for (Function& function: module) {
+		if (!Util::isSpecialFunction(function)) {
+			for (Instruction& instruction : Util::getInstructions(function)) {
+				(void) instruction;
+				instructions++;
+			}
+		}
+	}
+	return instructions;
+}
+
+/**
+ * Slices every program of the benchmark folder with every method and prints
+ * a tab separated table of the time spent and the work done, e.g. to compare
+ * optimizations of the slicing methods.
+ */
+int main(int argc, const char **argv) {
+	parseArgs(argc, argv);
+	vector<BenchmarkMethod> methods(MethodsFlag.begin(), MethodsFlag.end());
+	if (methods.empty()) {
+		methods = {syntactic, bruteforce, syntacticbruteforce, drm, ddmin};
+	}
+	// Like the slicing tool all methods share one solver
+	SmtSolverPtr solver = createSmtSolver();
+	SlicingStatistics& statistics = SlicingStatistics::getInstance();
+
+	outs() << "file name\tmethod\twall clock time in s\tcandidates\tsolver calls"
+		<< "\tsolver time in s\tinstructions program\tinstructions slice\n";
+	for (string fileName : benchmarkFiles(FolderFlag)) {
+		ModulePtr program = getModuleFromSource(fileName, ResourceDir, {});
+		CriterionPtr criterion = shared_ptr<Criterion>(new PresentCriterion());
+		if (criterion->getInstructions(*program).empty()) {
+			criterion = shared_ptr<Criterion>(new ReturnValueCriterion());
+		}
+
+		for (BenchmarkMethod method : methods) {
+			statistics.reset();
+			SlicingMethodPtr slicingMethod = createMethod(method, program);
+			slicingMethod->setSolver(solver);
+			// The verdicts of syntactic and drm are not part of the table
+			string messages;
+			raw_string_ostream messageStream(messages);
+			slicingMethod->setMessageStream(&messageStream);
+
+			auto start = SlicingStatistics::Clock::now();
+			ModulePtr slice = slicingMethod->computeSlice(criterion);
+			chrono::duration<double> wallClockTime = SlicingStatistics::Clock::now() - start;
+			chrono::duration<double> solverTime = statistics.getTime(SlicingPhase::solver);
+
+			outs() << sys::path::filename(fileName) << "\t" << methodName(method)
+				<< "\t" << wallClockTime.count()
+				<< "\t" << statistics.getValidatedCandidates()
+				<< "\t" << statistics.getCount(SlicingPhase::solver)
+				<< "\t" << solverTime.count()
+				<< "\t" << countInstructions(*program) << "\t";
+			if (slice) {
+				outs() << countInstructions(*slice);
+			} else {
+				outs() << "-";
+			}
+			outs() << "\n";
+			outs().flush();
+		}
+	}
+	return 0;
+}
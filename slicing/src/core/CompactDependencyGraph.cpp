@@ -0,0 +1,118 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "CompactDependencyGraph.h"
+
+using namespace std;
+using namespace llvm;
+
+CompactDependencyGraph::CompactDependencyGraph(
+		LinearizedFunction const&           numbering,
+		DependencyGraph<Instruction> const& graph) :
+	_numbering  (numbering),
+	_predOffsets(numbering.size() + 1, 0),
+	_succOffsets(numbering.size() + 1, 0) {
+	
+	unsigned int const size = numbering.size();
+	
+	// Count the edges first, so every list can be filled in place
+	for(unsigned int i = 0; i < size; i++) {
+		for(auto pred : graph[numbering[i]].predecessors) {
+			if(pred->innerNode) {
+				_predOffsets[i + 1]++;
+				_succOffsets[numbering[*pred->innerNode] + 1]++;
+			}
+		}
+	}
+	
+	for(unsigned int i = 0; i < size; i++) {
+		_predOffsets[i + 1] += _predOffsets[i];
+		_succOffsets[i + 1] += _succOffsets[i];
+	}
+	
+	_predIndices.resize(_predOffsets[size]);
+	_succIndices.resize(_succOffsets[size]);
+	
+	vector<unsigned int> succFill(_succOffsets.begin(), _succOffsets.end() - 1);
+	
+	for(unsigned int i = 0; i < size; i++) {
+		unsigned int predFill = _predOffsets[i];
+		
+		for(auto pred : graph[numbering[i]].predecessors) {
+			if(pred->innerNode) {
+				unsigned int const j = numbering[*pred->innerNode];
+				_predIndices[predFill++]    = j;
+				_succIndices[succFill[j]++] = i;
+			}
+		}
+	}
+}
+
+unsigned int CompactDependencyGraph::size(void) const {
+	
+	return _numbering.size();
+}
+
+LinearizedFunction const& CompactDependencyGraph::getNumbering(void) const {
+	
+	return _numbering;
+}
+
+ArrayRef<unsigned int> CompactDependencyGraph::predecessors(
+		unsigned int node) const {
+	
+	return ArrayRef<unsigned int>(
+		_predIndices.data() + _predOffsets[node],
+		_predIndices.data() + _predOffsets[node + 1]);
+}
+
+ArrayRef<unsigned int> CompactDependencyGraph::successors(
+		unsigned int node) const {
+	
+	return ArrayRef<unsigned int>(
+		_succIndices.data() + _succOffsets[node],
+		_succIndices.data() + _succOffsets[node + 1]);
+}
+
+BitArray CompactDependencyGraph::reach(
+		BitArray const&             initNodes,
+		vector<unsigned int> const& offsets,
+		vector<unsigned int> const& indices) const {
+	
+	BitArray             visited(initNodes);
+	vector<unsigned int> workList(
+		initNodes.setBits().begin(), initNodes.setBits().end());
+	
+	while(!workList.empty()) {
+		unsigned int const node = workList.back();
+		workList.pop_back();
+		
+		for(unsigned int i = offsets[node]; i < offsets[node + 1]; i++) {
+			if(!visited[indices[i]]) {
+				visited.set(indices[i]);
+				workList.push_back(indices[i]);
+			}
+		}
+	}
+	
+	return visited;
+}
+
+BitArray CompactDependencyGraph::getInfluencingNodes(
+		BitArray const& initNodes) const {
+	
+	return reach(initNodes, _predOffsets, _predIndices);
+}
+
+BitArray CompactDependencyGraph::getInfluencedNodes(
+		BitArray const& initNodes) const {
+	
+	return reach(initNodes, _succOffsets, _succIndices);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "DependencyGraph.h"
+#include "LinearizedFunction.h"
+#include "util/BitArray.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Instruction.h"
+
+#include <vector>
+
+/**
+ * A read-only copy of a dependency graph of a function in compressed sparse
+ * row format. The nodes are the instructions numbered by a LinearizedFunction,
+ * the adjacency lists of all nodes are stored in contiguous arrays. Nodes
+ * without an instruction, like the root of a CDG, are dropped.
+ */
+class CompactDependencyGraph {
+	
+	public:
+	
+	CompactDependencyGraph(
+		LinearizedFunction const&                numbering,
+		DependencyGraph<llvm::Instruction> const& graph);
+	
+	unsigned int size(void) const;
+	
+	LinearizedFunction const& getNumbering(void) const;
+	
+	llvm::ArrayRef<unsigned int> predecessors(unsigned int node) const;
+	llvm::ArrayRef<unsigned int> successors  (unsigned int node) const;
+	
+	/**
+	 * Returns all nodes the initial nodes depend on, including themselves.
+	 */
+	BitArray getInfluencingNodes(BitArray const& initNodes) const;
+	
+	/**
+	 * Returns all nodes that depend on the initial nodes, including themselves.
+	 */
+	BitArray getInfluencedNodes(BitArray const& initNodes) const;
+	
+	private:
+	
+	LinearizedFunction const& _numbering;
+	
+	// The adjacency list of node i is [offsets[i], offsets[i + 1])
+	std::vector<unsigned int> _predOffsets;
+	std::vector<unsigned int> _predIndices;
+	std::vector<unsigned int> _succOffsets;
+	std::vector<unsigned int> _succIndices;
+	
+	BitArray reach(
+		BitArray const&                  initNodes,
+		std::vector<unsigned int> const& offsets,
+		std::vector<unsigned int> const& indices) const;
+};
@@ -0,0 +1,64 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "InterproceduralSlicePass.h"
+
+#include "SlicingPass.h"
+#include "Util.h"
+#include "util/misc.h"
+
+using namespace std;
+using namespace llvm;
+
+static RegisterPass<InterproceduralSlicePass> tmp(
+	"interprocedural-slice", "Interprocedural Slice", true, false);
+
+char InterproceduralSlicePass::ID = 0;
+
+void InterproceduralSlicePass::getAnalysisUsage(
+		AnalysisUsage &au) const {
+
+	au.addRequiredTransitive<SDGPass>();
+}
+
+bool InterproceduralSlicePass::runOnModule(
+		Module& module) {
+
+	SDGPass const& sdg = getAnalysis<SDGPass>();
+
+	unordered_set<Instruction const*> remainInSlice =
+		sdg.getInfluencingInstructions(criterion->getInstructions(module));
+
+	for(Function& func : module) {
+		if(func.isDeclaration() || Util::isSpecialFunction(func)) {
+			continue;
+		}
+
+		bool inSlice = false;
+		for(Instruction& i : Util::getInstructions(func)) {
+			if(remainInSlice.find(&i) != remainInSlice.end()) {
+				inSlice = true;
+				break;
+			}
+		}
+		if(!inSlice) {
+			continue;
+		}
+
+		// Mark all instructions, that are not in 'remainInSlice'
+		for(Instruction& i : Util::getInstructions(func)) {
+			if(remainInSlice.find(&i) == remainInSlice.end()) {
+				SlicingPass::toBeSliced(i);
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SystemDependenceGraph.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/LegacyPassManager.h"
+
+#include "core/Criterion.h"
+
+/**
+ * Syntactic slice based on the system dependence graph, so the slice can
+ * cross function boundaries. Functions that contain no instruction of the
+ * slice are left untouched.
+ */
+class InterproceduralSlicePass : public llvm::ModulePass {
+
+	public:
+
+	static char ID;
+
+	InterproceduralSlicePass(CriterionPtr criterionPtr = Criterion::getReturnValueCriterion()) : llvm::ModulePass(ID), criterion(criterionPtr) {}
+
+	virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override;
+
+	virtual bool runOnModule(llvm::Module &module) override;
+
+private:
+	CriterionPtr criterion;
+};
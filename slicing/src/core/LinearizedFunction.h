@@ -0,0 +1,38 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+
+#include <unordered_map>
+
+/**
+ * Numbers the instructions of a function densely from zero.
+ */
+class LinearizedFunction {
+	
+	public:
+	
+	LinearizedFunction(llvm::Function& func);
+	~LinearizedFunction(void);
+	
+	llvm::Instruction& operator[](unsigned int const       index) const;
+	unsigned int       operator[](llvm::Instruction const& inst)  const;
+	
+	// The number of instructions of the function
+	unsigned int size(void) const;
+	
+	private:
+	
+	std::unordered_map<llvm::Instruction const*, unsigned int> mapInstToInt;
+	llvm::Instruction**                                        mapIntToInst;
+};
@@ -10,27 +10,167 @@
 
 #include "SliceCandidateValidation.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "preprocessing/StripExplicitAssignPass.h"
 
 #include "Opts.h"
 #include "Preprocess.h"
 #include "ModuleSMTGeneration.h"
+#include "SMT.h"
 #include "Serialize.h"
 
 #include "smtSolver/SmtSolver.h"
+#include "smtSolver/Z3.h"
+#include "util/SlicingStatistics.h"
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <sstream>
+
 
 using namespace llvm;
 using namespace std;
+using namespace llreve::opts;
 
 using smt::SharedSMTRef;
 
+unsigned ValidationTestSamples = CounterExampleCache::defaultSampleCount;
 
-ValidationResult SliceCandidateValidation::validate(llvm::Module* program, llvm::Module* candidate,
-	CriterionPtr criterion, CounterExample* counterExample){
-	string outputFileName("candidate.smt");
+namespace {
+/**
+ * Renames the functions of one candidate of a batch so that they don't clash
+ * with those of the other candidates.
+ */
+struct RenameFunctionsVisitor : smt::SMTVisitor {
+	const map<string, string>& renamed;
+	RenameFunctionsVisitor(const map<string, string>& renamed):renamed(renamed){}
+	bool handles(smt::ExprTag tag) const override {
+		return tag == smt::ExprTag::Op || tag == smt::ExprTag::FunDecl ||
+			tag == smt::ExprTag::FunDef || tag == smt::ExprTag::ConstantString;
+	}
+	void rename(string& name) {
+		auto it = renamed.find(name);
+		if (it != renamed.end()) {
+			name = it->second;
+		}
+	}
+	void dispatch(smt::Op& op) override { rename(op.opName); }
+	void dispatch(smt::FunDecl& decl) override { rename(decl.funName); }
+	void dispatch(smt::FunDef& def) override { rename(def.funName); }
+	void dispatch(smt::ConstantString& str) override { rename(str.value); }
+};
+
+/**
+ * Collects the functions that are applied in an expression
+ */
+struct CollectAppliedVisitor : smt::SMTVisitor {
+	set<string> applied;
+	bool handles(smt::ExprTag tag) const override {
+		return tag == smt::ExprTag::Op || tag == smt::ExprTag::ConstantString;
+	}
+	void dispatch(smt::Op& op) override { applied.insert(op.opName); }
+	void dispatch(smt::ConstantString& str) override { applied.insert(str.value); }
+};
+}
+
+static string exprText(const SharedSMTRef& expr) {
+	ostringstream text;
+	expr->serialize(text, 0);
+	return text.str();
+}
+
+/**
+ * Merges the problems of several candidates into one. The declared relations
+ * of candidate i get the suffix "__i". Definitions that are the same in all
+ * candidates and don't use a relation, the logic and the final commands are
+ * only emitted once.
+ */
+static vector<SharedSMTRef> mergeProblems(const vector<const vector<SharedSMTRef>*>& problems) {
+	// Definitions are shared if they have the same text in every candidate
+	map<string, set<string>> definitionTexts;
+	set<string> relations;
+	for (const vector<SharedSMTRef>* problem : problems) {
+		for (const SharedSMTRef& expr : *problem) {
+			if (expr->getTag() == smt::ExprTag::FunDecl) {
+				relations.insert(static_cast<const smt::FunDecl&>(*expr).funName);
+			} else if (expr->getTag() == smt::ExprTag::FunDef) {
+				definitionTexts[static_cast<const smt::FunDef&>(*expr).funName].insert(exprText(expr));
+			}
+		}
+	}
+	set<string> renamedNames = relations;
+	for (const auto& definition : definitionTexts) {
+		if (definition.second.size() > 1) {
+			renamedNames.insert(definition.first);
+		}
+	}
+	// A definition that uses a renamed function has to be renamed as well,
+	// this is repeated until nothing changes as definitions can use each other
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (const vector<SharedSMTRef>* problem : problems) {
+			for (const SharedSMTRef& expr : *problem) {
+				if (expr->getTag() != smt::ExprTag::FunDef) {
+					continue;
+				}
+				const string& name = static_cast<const smt::FunDef&>(*expr).funName;
+				if (renamedNames.count(name)) {
+					continue;
+				}
+				CollectAppliedVisitor applied;
+				smt::visit(expr, applied);
+				for (const string& appliedName : applied.applied) {
+					if (renamedNames.count(appliedName)) {
+						renamedNames.insert(name);
+						changed = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	vector<SharedSMTRef> merged;
+	vector<SharedSMTRef> commands;
+	set<string> emitted;
+	for (size_t i = 0; i < problems.size(); i++) {
+		map<string, string> renamed;
+		for (const string& name : renamedNames) {
+			renamed[name] = name + "__" + to_string(i);
+		}
+		RenameFunctionsVisitor renameVisitor(renamed);
+		for (const SharedSMTRef& expr : *problems[i]) {
+			bool isCommand = expr->getTag() == smt::ExprTag::CheckSat ||
+				expr->getTag() == smt::ExprTag::GetModel;
+			bool isShared = isCommand || expr->getTag() == smt::ExprTag::SetLogic ||
+				expr->getTag() == smt::ExprTag::FunDef;
+			SharedSMTRef renamedExpr = smt::visit(expr, renameVisitor);
+			if (isShared && !emitted.insert(exprText(renamedExpr)).second) {
+				continue;
+			}
+			(isCommand ? commands : merged).push_back(renamedExpr);
+		}
+	}
+	merged.insert(merged.end(), commands.begin(), commands.end());
+	return merged;
+}
 
-	SMTGenerationOpts &smtOpts = SMTGenerationOpts::getInstance();
+ValidationSession::ValidationSession(llvm::Module* program, CriterionPtr criterion,
+	SmtSolverPtr solver) :
+	// Use a private copy of the options so that validating a candidate does
+	// not change the options of other verification runs.
+	smtOpts(SMTGenerationOpts::getInstance()),
+	fileOpts(getFileOptions(MonoPair<string>("",""))),
+	preprocessOpts(false, false, true),
+	solver(solver),
+	testInputs(*program, criterion, ValidationTestSamples) {
+	{
+		SlicingStatistics::Timer timer(SlicingPhase::cloneModule);
+		programCopy = shared_ptr<Module>(CloneModule(program));
+	}
 	smtOpts.PerfectSync = true;
 
 	auto criterionInstructions = criterion->getInstructions(*program);
@@ -41,37 +181,253 @@ ValidationResult SliceCandidateValidation::validate(llvm::Module* program, llvm:
 		assert((!slicedFunction || function == slicedFunction) && "Not Supported: Got criterion with multiple functions.");
 
 		slicedFunction = function;
-		smtOpts.MainFunction = smtOpts.MainFunction = slicedFunction->getName().str();
+		smtOpts.MainFunction = slicedFunction->getName().str();
 	}
 
-	MonoPair<string> fileNames("","");
-	FileOptions fileOpts = getFileOptions(fileNames);
 	if (!criterion->isReturnValue()) {
 		fileOpts.OutRelation = make_shared<smt::Primitive<string>>("true");
 	}
 
-	PreprocessOpts preprocessOpts(false, false, true);
+	SlicingStatistics::Timer timer(SlicingPhase::preprocessing);
+	llvm::legacy::PassManager PM;
+	PM.add(new StripExplicitAssignPass());
+	PM.run(*programCopy);
+
+	SMTGenerationOpts::Scope optsScope(smtOpts);
+	programResults = preprocessModule(*programCopy, Program::First, preprocessOpts);
+	// A candidate only accesses memory if the program does
+	detectMemoryOptions(MonoPair<const Module&>(*programCopy, *programCopy));
 
-	shared_ptr<Module> programCopy(CloneModule(program));
-	shared_ptr<Module> candiateCopy(CloneModule(candidate));
+	if (solver->asZ3Library()) {
+		// The functional abstractions of the program are part of every
+		// problem, the workers of the solver only add them once
+		vector<SharedSMTRef> assertions;
+		vector<SharedSMTRef> declarations;
+		generateFunctionalAbstractions(*programCopy, programCopy->getFunction(smtOpts.MainFunction),
+			programResults, Program::First, assertions, declarations);
+		for (const SharedSMTRef& assertion : assertions) {
+			sharedAssertionTexts.insert(exprText(assertion));
+		}
+		sharedAssertions = make_shared<const vector<SharedSMTRef>>(std::move(assertions));
+	}
+}
 
+AnalysisResultsMap ValidationSession::preprocessCandidate(llvm::Module& candidate){
+	SMTGenerationOpts candidateOpts = smtOpts;
+	SMTGenerationOpts::Scope optsScope(candidateOpts);
+
+	SlicingStatistics::Timer timer(SlicingPhase::preprocessing);
 	llvm::legacy::PassManager PM;
 	PM.add(new StripExplicitAssignPass());
-	PM.run(*programCopy);
-	PM.run(*candiateCopy);
+	PM.run(candidate);
 
+	AnalysisResultsMap analysisResults = programResults;
+	AnalysisResultsMap candidateResults = preprocessModule(candidate, Program::Second, preprocessOpts);
+	analysisResults.insert(candidateResults.begin(), candidateResults.end());
+	return analysisResults;
+}
 
-	MonoPair<shared_ptr<Module>> modules(programCopy, candiateCopy);
+vector<SharedSMTRef> ValidationSession::generateValidationProblem(llvm::Module& candidate,
+	const AnalysisResultsMap& analysisResults){
+	SMTGenerationOpts candidateOpts = smtOpts;
+	SMTGenerationOpts::Scope optsScope(candidateOpts);
 
-	auto preprocessedFuns = preprocessFunctions(modules, preprocessOpts);
+	SlicingStatistics::Timer timer(SlicingPhase::smtGeneration);
+	return generateSMT(MonoPair<const Module&>(*programCopy, candidate), analysisResults, fileOpts);
+}
 
-	vector<SharedSMTRef> smtExprs =
-	generateSMT(modules, preprocessedFuns, fileOpts);
+/**
+ * The preprocessing names the values of all candidates the same way, so
+ * candidates are equal if their printed IR is.
+ */
+static string candidateHash(llvm::Module& candidate){
+	string text;
+	raw_string_ostream stream(text);
+	candidate.print(stream, nullptr);
+	MD5 hash;
+	hash.update(stream.str());
+	MD5::MD5Result result;
+	hash.final(result);
+	SmallString<32> hexResult;
+	MD5::stringifyResult(result, hexResult);
+	return hexResult.str();
+}
 
-	SerializeOpts serializeOpts(outputFileName, false, false, false, true);
-	serializeSMT(smtExprs, SMTGenerationOpts::getInstance().MuZ, serializeOpts);
+static shared_future<SatResult> finishedCheck(SatResult result){
+	promise<SatResult> finished;
+	finished.set_value(result);
+	return finished.get_future().share();
+}
+
+bool ValidationSession::findValidatedCandidate(const string& hash, shared_future<SatResult>& check){
+	auto it = validatedCandidates.find(hash);
+	bool found = it != validatedCandidates.end();
+	if (found && it->second.wait_for(chrono::milliseconds::zero()) == future_status::ready) {
+		// Cancelled checks end with unknown as well
+		SatResult result = it->second.get();
+		found = result == SatResult::sat || result == SatResult::unsat;
+	}
+	SlicingStatistics::getInstance().addValidationMemoLookup(found);
+	if (found) {
+		check = it->second;
+	}
+	return found;
+}
+
+string ValidationSession::serializeProblem(const vector<SharedSMTRef>& smtExprs){
+	SlicingStatistics::Timer timer(SlicingPhase::serialization);
+	SerializeOpts serializeOpts("", false, false, false, true);
+	ostringstream problem;
+	writeSMT(problem, smtExprs, smtOpts.MuZ, serializeOpts);
+	return problem.str();
+}
+
+SatCheck ValidationSession::checkProblem(const vector<SharedSMTRef>& smtExprs){
+	Z3Library* z3 = solver->asZ3Library();
+	if (!z3) {
+		return solver->checkProblemAsync(serializeProblem(smtExprs));
+	}
+	vector<SharedSMTRef> clauses;
+	for (const SharedSMTRef& expr : smtExprs) {
+		if (expr->asAssert() && sharedAssertionTexts.count(exprText(expr))) {
+			continue;
+		}
+		clauses.push_back(expr);
+	}
+	return z3->checkClausesAsync(sharedAssertions, std::move(clauses), smtOpts);
+}
+
+static SatResult waitForCheck(shared_future<SatResult> check){
+	SatResult result = check.get();
+	if (result == SatResult::error) {
+		exit(1);
+	}
+	return result;
+}
+
+ValidationResult ValidationSession::validate(shared_ptr<Module> candidate, CounterExample* counterExample){
+	SlicingStatistics::getInstance().addValidatedCandidate();
+	if (testInputs.rejects(*candidate, counterExample)) {
+		return ValidationResult::invalid;
+	}
+	AnalysisResultsMap analysisResults = preprocessCandidate(*candidate);
+	string hash = candidateHash(*candidate);
+	shared_future<SatResult> validated;
+	if (findValidatedCandidate(hash, validated)) {
+		return SliceCandidateValidation::toValidationResult(waitForCheck(validated));
+	}
+	SatCheck check = checkProblem(generateValidationProblem(*candidate, analysisResults));
+	validatedCandidates[hash] = check.result;
+	return SliceCandidateValidation::toValidationResult(waitForCheck(check.result));
+}
+
+vector<ValidationResult> ValidationSession::validateBatch(vector<shared_ptr<Module>> candidates){
+	vector<ValidationResult> results(candidates.size(), ValidationResult::unknown);
+	vector<vector<SharedSMTRef>> problems(candidates.size());
+	vector<size_t> remaining;
+	// Candidates that are equal to an earlier one of the batch get its result
+	vector<pair<size_t, size_t>> duplicates;
+	map<string, size_t> batchCandidates;
+	vector<string> hashes(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++) {
+		SlicingStatistics::getInstance().addValidatedCandidate();
+		if (testInputs.rejects(*candidates[i])) {
+			results[i] = ValidationResult::invalid;
+			continue;
+		}
+		AnalysisResultsMap analysisResults = preprocessCandidate(*candidates[i]);
+		hashes[i] = candidateHash(*candidates[i]);
+		shared_future<SatResult> validated;
+		auto batchCandidate = batchCandidates.find(hashes[i]);
+		if (batchCandidate != batchCandidates.end()) {
+			SlicingStatistics::getInstance().addValidationMemoLookup(true);
+			duplicates.push_back({i, batchCandidate->second});
+		} else if (findValidatedCandidate(hashes[i], validated)) {
+			results[i] = SliceCandidateValidation::toValidationResult(waitForCheck(validated));
+		} else {
+			batchCandidates[hashes[i]] = i;
+			problems[i] = generateValidationProblem(*candidates[i], analysisResults);
+			remaining.push_back(i);
+		}
+	}
+	if (!remaining.empty()) {
+		validateGroup(problems, remaining, results);
+	}
+	for (size_t i : remaining) {
+		if (results[i] != ValidationResult::unknown) {
+			validatedCandidates[hashes[i]] = finishedCheck(
+				results[i] == ValidationResult::valid ? SatResult::sat : SatResult::unsat);
+		}
+	}
+	for (const pair<size_t, size_t>& duplicate : duplicates) {
+		results[duplicate.first] = results[duplicate.second];
+	}
+	return results;
+}
+
+void ValidationSession::validateGroup(const vector<vector<SharedSMTRef>>& problems,
+	const vector<size_t>& group, vector<ValidationResult>& results){
+	vector<const vector<SharedSMTRef>*> groupProblems;
+	for (size_t i : group) {
+		groupProblems.push_back(&problems[i]);
+	}
+	SatCheck check = checkProblem(group.size() == 1 ? problems[group[0]] : mergeProblems(groupProblems));
+	ValidationResult result = SliceCandidateValidation::toValidationResult(waitForCheck(check.result));
+
+	if (result == ValidationResult::valid || group.size() == 1) {
+		for (size_t i : group) {
+			results[i] = result;
+		}
+		return;
+	}
+	// At least one of the candidates is invalid (or the solver gave up), the
+	// halves are validated separately to find out which
+	size_t half = group.size() / 2;
+	validateGroup(problems, vector<size_t>(group.begin(), group.begin() + static_cast<ptrdiff_t>(half)), results);
+	validateGroup(problems, vector<size_t>(group.begin() + static_cast<ptrdiff_t>(half), group.end()), results);
+}
+
+SatCheck ValidationSession::validateAsync(shared_ptr<Module> candidate){
+	SlicingStatistics::getInstance().addValidatedCandidate();
+	if (testInputs.rejects(*candidate)) {
+		// Horn clauses of an invalid candidate are unsatisfiable
+		return SatCheck{finishedCheck(SatResult::unsat), [](){}};
+	}
+	AnalysisResultsMap analysisResults = preprocessCandidate(*candidate);
+	string hash = candidateHash(*candidate);
+	shared_future<SatResult> validated;
+	if (findValidatedCandidate(hash, validated)) {
+		return SatCheck{validated, [](){}};
+	}
+	SatCheck check = checkProblem(generateValidationProblem(*candidate, analysisResults));
+	validatedCandidates[hash] = check.result;
+	// The check keeps the solver alive, it may outlive the session
+	SmtSolverPtr checkSolver = solver;
+	std::function<void()> cancel = check.cancel;
+	check.cancel = [checkSolver, cancel]() { cancel(); };
+	return check;
+}
+
+ValidationResult SliceCandidateValidation::validate(llvm::Module* program, llvm::Module* candidate,
+	CriterionPtr criterion, CounterExample* counterExample, SmtSolverPtr solver){
+	return ValidationSession(program, criterion, solver).validate(shared_ptr<Module>(CloneModule(candidate)), counterExample);
+}
+
+vector<ValidationResult> SliceCandidateValidation::validateBatch(llvm::Module* program,
+	const vector<llvm::Module*>& candidates, CriterionPtr criterion, SmtSolverPtr solver){
+	vector<shared_ptr<Module>> copies;
+	for (llvm::Module* candidate : candidates) {
+		copies.push_back(shared_ptr<Module>(CloneModule(candidate)));
+	}
+	return ValidationSession(program, criterion, solver).validateBatch(copies);
+}
+
+SatCheck SliceCandidateValidation::validateAsync(llvm::Module* program, llvm::Module* candidate,
+	CriterionPtr criterion, SmtSolverPtr solver){
+	return ValidationSession(program, criterion, solver).validateAsync(shared_ptr<Module>(CloneModule(candidate)));
+}
 
-	SatResult satResult = SmtSolver::getInstance().checkSat(outputFileName);
+ValidationResult SliceCandidateValidation::toValidationResult(SatResult satResult){
 	ValidationResult result;
 
 	switch (satResult) {
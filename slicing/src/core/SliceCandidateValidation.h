@@ -12,16 +12,140 @@
 
 #include "llvm/IR/Module.h"
 #include "core/Criterion.h"
+#include "dynamic/CounterExample.h"
+#include "smtSolver/SmtSolver.h"
 
-enum class ValidationResult {valid, invalid, unknown};
+#include "AnalysisResults.h"
+#include "Opts.h"
+#include "SMT.h"
+
+#include <future>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
-class CounterExample;
+enum class ValidationResult {valid, invalid, unknown};
 
 extern bool CriterionPresent;
+/**
+ * The number of sampled inputs on which candidates are tested before they are
+ * validated by the solver, zero disables the test.
+ */
+extern unsigned ValidationTestSamples;
 
 class SliceCandidateValidation {
 public:
+	/**
+	 * If the candidate is invalid and counterExample is given, it is set to
+	 * arguments on which the candidate diverges from the program if such
+	 * arguments are found (see CounterExampleCache). Otherwise it is left
+	 * unchanged.
+	 */
 	static ValidationResult validate(llvm::Module* program, llvm::Module* candidate,
 		CriterionPtr criterion = Criterion::getReturnValueCriterion(),
+		CounterExample* counterExample = nullptr,
+		SmtSolverPtr solver = createSmtSolver());
+	/**
+	 * Starts the solver on the verification problem in the background. Only
+	 * the solver runs concurrently, the problem is generated on the calling
+	 * thread because the modules share their LLVMContext.
+	 */
+	static SatCheck validateAsync(llvm::Module* program, llvm::Module* candidate,
+		CriterionPtr criterion, SmtSolverPtr solver = createSmtSolver());
+	/**
+	 * Validates all candidates, see ValidationSession::validateBatch.
+	 */
+	static std::vector<ValidationResult> validateBatch(llvm::Module* program,
+		const std::vector<llvm::Module*>& candidates,
+		CriterionPtr criterion = Criterion::getReturnValueCriterion(),
+		SmtSolverPtr solver = createSmtSolver());
+	static ValidationResult toValidationResult(SatResult satResult);
+};
+
+/**
+ * Validates several candidates against the same program. The program is
+ * copied and preprocessed once when the session is created instead of once per
+ * candidate.
+ *
+ * Before a candidate is sent to the solver it is run on the test inputs of a
+ * CounterExampleCache. Candidates that diverge from the program on one of them
+ * are invalid without calling the solver, the program must not be modified
+ * or destroyed while the session is used.
+ *
+ * All problems are checked by the solver of the session, which may be shared
+ * with other sessions. Different candidates are often the same after the
+ * preprocessing, e.g. if an instruction is only used by removed instructions
+ * it does not matter whether it is removed too. The session remembers the
+ * result for every preprocessed candidate, so each of them is only checked by
+ * the solver once.
+ */
+class ValidationSession {
+public:
+	ValidationSession(llvm::Module* program, CriterionPtr criterion,
+		SmtSolverPtr solver = createSmtSolver());
+	/**
+	 * The candidate is preprocessed in place, so it must not be used for
+	 * anything else afterwards. This saves copying every candidate.
+	 * If the test finds an input on which the candidate diverges it is
+	 * stored in counterExample.
+	 */
+	ValidationResult validate(std::shared_ptr<llvm::Module> candidate,
 		CounterExample* counterExample = nullptr);
+	/**
+	 * If the candidate is rejected by the test the returned check has
+	 * already finished. If an equal candidate has been validated before, the
+	 * returned check is the one of that candidate and cannot be cancelled.
+	 */
+	SatCheck validateAsync(std::shared_ptr<llvm::Module> candidate);
+	/**
+	 * Validates several candidates, e.g. all candidates that differ by one
+	 * removed instruction, with a single solver query if all of them are
+	 * valid. Their problems are merged into one file, the relations of each
+	 * candidate are renamed apart and the definitions they share are only
+	 * emitted once. Horn clauses are only satisfiable if the clauses of every
+	 * candidate are, so if the solver refutes the batch it is split in halves
+	 * until the invalid candidates are found. This pays off if most
+	 * candidates are valid, which is the case for those that pass the test.
+	 * Consumes the candidates like validate.
+	 */
+	std::vector<ValidationResult> validateBatch(std::vector<std::shared_ptr<llvm::Module>> candidates);
+
+private:
+	llreve::opts::SMTGenerationOpts smtOpts;
+	llreve::opts::FileOptions fileOpts;
+	llreve::opts::PreprocessOpts preprocessOpts;
+	SmtSolverPtr solver;
+	std::shared_ptr<llvm::Module> programCopy;
+	AnalysisResultsMap programResults;
+	CounterExampleCache testInputs;
+	/// Only set if the solver checks the clauses in process
+	std::shared_ptr<const std::vector<smt::SharedSMTRef>> sharedAssertions;
+	std::set<std::string> sharedAssertionTexts;
+	/// The checks of the validated candidates by the hash of the
+	/// preprocessed candidate
+	std::map<std::string, std::shared_future<SatResult>> validatedCandidates;
+
+	/**
+	 * Preprocesses the candidate like the program, returns the analysis
+	 * results of both.
+	 */
+	AnalysisResultsMap preprocessCandidate(llvm::Module& candidate);
+	std::vector<smt::SharedSMTRef> generateValidationProblem(llvm::Module& candidate,
+		const AnalysisResultsMap& analysisResults);
+	/**
+	 * Sets check to the check of an equal candidate unless that one has been
+	 * cancelled or the solver gave up on it.
+	 */
+	bool findValidatedCandidate(const std::string& hash, std::shared_future<SatResult>& check);
+	std::string serializeProblem(const std::vector<smt::SharedSMTRef>& smtExprs);
+	/**
+	 * Passes the serialized problem to the solver without writing a file (see
+	 * SmtSolver::checkProblemAsync), or passes the clauses directly if the
+	 * solver runs in process.
+	 */
+	SatCheck checkProblem(const std::vector<smt::SharedSMTRef>& smtExprs);
+	void validateGroup(const std::vector<std::vector<smt::SharedSMTRef>>& problems,
+		const std::vector<size_t>& group, std::vector<ValidationResult>& results);
 };
@@ -0,0 +1,163 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SliceFeasibility.h"
+
+#include "core/Util.h"
+#include "preprocessing/AddVariableNamePass.h"
+#include "util/misc.h"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+
+#include <cassert>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+using namespace std;
+using namespace llvm;
+
+static unsigned countInstructions(Module& program) {
+	unsigned count = 0;
+	for (Function& function: program) {
+		if (!Util::isSpecialFunction(function)) {
+			for (Instruction& instruction : Util::getInstructions(function)) {
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+static bool isParameter(DIVariable* variable, Function& function) {
+	if (DILocalVariable* localVariable = dyn_cast<DILocalVariable>(variable)) {
+		return localVariable->isParameter()
+			&& localVariable->getArg() >= 1
+			&& localVariable->getArg() <= function.arg_size();
+	}
+	return false;
+}
+
+SliceFeasibility::SliceFeasibility(Module& program, Criterion& criterion):
+	numInstructions(countInstructions(program)),
+	operands(numInstructions),
+	mayVanish(numInstructions),
+	neverRemoved(numInstructions),
+	replaceable(numInstructions) {
+
+	set<Instruction*> criterionInstructions = criterion.getInstructions(program);
+	unordered_map<const Instruction*, unsigned> ids;
+
+	for (Function& function: program) {
+		if (Util::isSpecialFunction(function)) {
+			continue;
+		}
+
+		// The DeleteVisitor looks for earlier definitions of a variable in
+		// the dominator tree of the unsliced function
+		DominatorTree domTree(function);
+		map<DIVariable*, vector<Instruction*>> definitions;
+		for (Instruction& instruction : Util::getInstructions(function)) {
+			unsigned id = static_cast<unsigned>(ids.size());
+			ids[&instruction] = id;
+			if (criterionInstructions.find(&instruction) == criterionInstructions.end()) {
+				relevantIds.push_back(id);
+			}
+			if (DIVariable* variable = AddVariableNamePass::getSrcVariable(instruction)) {
+				definitions[variable].push_back(&instruction);
+			}
+
+			if (isa<PHINode>(instruction) || isa<BranchInst>(instruction)) {
+				mayVanish.set(id);
+			} else if (isa<TerminatorInst>(instruction)) {
+				neverRemoved.set(id);
+			} else if (CallInst* call = dyn_cast<CallInst>(&instruction)) {
+				if (call->getCalledFunction()
+					&& call->getCalledFunction()->getName() == Criterion::FUNCTION_NAME) {
+					neverRemoved.set(id);
+				}
+			}
+			if (isa<PHINode>(instruction)) {
+				replaceable.set(id);
+			}
+		}
+
+		for (auto& variableDefinitions : definitions) {
+			bool parameter = isParameter(variableDefinitions.first, function);
+			for (Instruction* instruction : variableDefinitions.second) {
+				bool hasEarlierDefinition = false;
+				for (Instruction* other : variableDefinitions.second) {
+					if (domTree.dominates(other, instruction)) {
+						hasEarlierDefinition = true;
+						break;
+					}
+				}
+				if (parameter || hasEarlierDefinition) {
+					replaceable.set(ids[instruction]);
+				}
+			}
+		}
+
+		for (Instruction& instruction : Util::getInstructions(function)) {
+			vector<unsigned>& used = operands[ids[&instruction]];
+			for (Value* operand : instruction.operands()) {
+				if (Instruction* operandInstruction = dyn_cast<Instruction>(operand)) {
+					auto it = ids.find(operandInstruction);
+					if (it != ids.end()) {
+						used.push_back(it->second);
+					}
+				}
+			}
+		}
+	}
+	assert(ids.size() == numInstructions);
+}
+
+bool SliceFeasibility::isInfeasible(const vector<bool>& pattern) const {
+	assert(pattern.size() == relevantIds.size());
+
+	BitArray sliced(numInstructions);
+	for (unsigned i = 0; i < pattern.size(); i++) {
+		if (pattern[i]) {
+			sliced.set(relevantIds[i]);
+		}
+	}
+
+	// The instructions that certainly remain in the candidate: the unsliced
+	// ones the DeleteVisitor does not touch and the sliced ones it never
+	// removes
+	BitArray kept(sliced);
+	kept.invert().andNot(mayVanish);
+	BitArray pinned(sliced);
+	pinned &= neverRemoved;
+	kept |= pinned;
+
+	// A sliced instruction that is used by a remaining one is only removed if
+	// it can be replaced, otherwise it remains as well
+	vector<unsigned> worklist;
+	for (unsigned id : kept.setBits()) {
+		worklist.push_back(id);
+	}
+	while (!worklist.empty()) {
+		unsigned id = worklist.back();
+		worklist.pop_back();
+		for (unsigned operand : operands[id]) {
+			if (sliced[operand] && !replaceable[operand] && !kept[operand]) {
+				kept.set(operand);
+				worklist.push_back(operand);
+			}
+		}
+	}
+
+	kept &= sliced;
+	return !kept.none();
+}
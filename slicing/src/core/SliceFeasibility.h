@@ -0,0 +1,57 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "core/Criterion.h"
+#include "util/BitArray.h"
+
+#include "llvm/IR/Module.h"
+
+#include <vector>
+
+/**
+ * Tells for a pattern of relevant instructions (see
+ * SlicingMethod::createCandidate) whether the SlicingPass would be left with
+ * unsliced instructions, without cloning and slicing the program. The
+ * dominance relation and the uses between the instructions do not change
+ * between the patterns, so they are computed once over dense instruction ids
+ * and a pattern is judged on bit arrays.
+ *
+ * The check is conservative: every pattern it rejects is rejected by the
+ * SlicingPass, but the pass may still reject patterns it accepts.
+ */
+class SliceFeasibility {
+public:
+	SliceFeasibility(llvm::Module& program, Criterion& criterion);
+
+	/**
+	 * pattern[i] tells whether the i-th relevant instruction is removed.
+	 * Returns true if the SlicingPass certainly fails to remove one of them.
+	 */
+	bool isInfeasible(const std::vector<bool>& pattern) const;
+
+private:
+	unsigned numInstructions;
+	// The dense id of the i-th relevant instruction
+	std::vector<unsigned> relevantIds;
+	// The ids of the instructions used by an instruction
+	std::vector<std::vector<unsigned>> operands;
+	// Instructions that may be removed even if they are not sliced, i.e. phi
+	// nodes and branches (see DeleteVisitor)
+	BitArray mayVanish;
+	// Instructions the DeleteVisitor never removes, i.e. terminators other
+	// than branches and calls of the criterion
+	BitArray neverRemoved;
+	// Instructions that can be removed although they are still used: phi
+	// nodes and definitions of a variable that is a parameter or that has a
+	// dominating definition
+	BitArray replaceable;
+};
@@ -13,6 +13,8 @@
 // *** END ***
 #include "SyntacticSlicePass.h"
 
+#include "CompactDependencyGraph.h"
+#include "LinearizedFunction.h"
 #include "SlicingPass.h"
 #include "Util.h"
 
@@ -20,8 +22,6 @@
 #include "llvm/IR/CFG.h"
 
 #include <iostream>
-#include <queue>
-#include <set>
 
 using namespace std;
 using namespace llvm;
@@ -42,15 +42,27 @@ bool SyntacticSlicePass::runOnFunction(
 
 	PDGPass const& pdg = getAnalysis<PDGPass>();
 
-	set<Instruction*>                         initInstructions = criterion->getInstructions(*func.getParent());
-	unordered_set<GenericNode<Instruction*>*> remainInSlice;
-	
-	pdg.getInfluencingNodes(initInstructions, remainInSlice);
+	LinearizedFunction     linearizedFunc(func);
+	CompactDependencyGraph graph(linearizedFunc, pdg);
+	BitArray               initInstructions(graph.size());
+
+	for(Instruction* i : criterion->getInstructions(*func.getParent())) {
+		if(i->getParent()->getParent() == &func) {
+			initInstructions.set(linearizedFunc[*i]);
+		}
+	}
+
+	// Functions without a criterion are left untouched
+	if(initInstructions.none()) {
+		return false;
+	}
+
+	BitArray const remainInSlice = graph.getInfluencingNodes(initInstructions);
 	
 	// Mark all instructions, that are not in 'remainInSlice'
-	for(Instruction& i : Util::getInstructions(func)) {
-		if(remainInSlice.find(&pdg[i]) == remainInSlice.end()) {
-			SlicingPass::toBeSliced(i);
+	for(unsigned int i = 0; i < graph.size(); i++) {
+		if(!remainInSlice[i]) {
+			SlicingPass::toBeSliced(linearizedFunc[i]);
 		}
 	}
 
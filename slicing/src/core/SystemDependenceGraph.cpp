@@ -0,0 +1,290 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SystemDependenceGraph.h"
+
+#include "DependencyGraphPasses.h"
+#include "Util.h"
+#include "util/misc.h"
+
+#include "llvm/IR/Instructions.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace llvm;
+
+static RegisterPass<SDGPass> tmpSDG("sdg-creation", "SDG Creation", true, true);
+
+char SDGPass::ID = 0;
+
+void SDGPass::getAnalysisUsage(
+		AnalysisUsage &au) const {
+	
+	au.setPreservesAll();
+	au.addRequired<PDGPass>();
+}
+
+static bool isAnalyzedFunction(
+		Function& func) {
+	
+	return !func.isDeclaration() && !Util::isSpecialFunction(func);
+}
+
+static Function* getAnalyzedCallee(
+		Instruction const& inst) {
+	
+	if(CallInst const* call = dyn_cast<CallInst>(&inst)) {
+		Function* callee = call->getCalledFunction();
+		if(callee && isAnalyzedFunction(*callee)) {
+			return callee;
+		}
+	}
+	
+	return nullptr;
+}
+
+bool SDGPass::runOnModule(
+		Module& module) {
+	
+	// Make sure, the previous state gets forgotten
+	_values.clear();
+	_nodes.clear();
+	_predecessors.clear();
+	
+	for(Function& i : module) {
+		if(isAnalyzedFunction(i)) {
+			createNode(i);
+			for(Argument& j : i.args()) {
+				createNode(j);
+			}
+			for(Instruction& j : Util::getInstructions(i)) {
+				createNode(j);
+			}
+		}
+	}
+	
+	// The PDG of a function is only valid until the next one is requested
+	for(Function& i : module) {
+		if(isAnalyzedFunction(i)) {
+			addFunction(i);
+		}
+	}
+	
+	addCallEdges(module);
+	addSummaryEdges(module);
+	
+	return false;
+}
+
+unsigned int SDGPass::createNode(
+		Value const& value) {
+	
+	unsigned int const node = _values.size();
+	
+	_values.push_back(&value);
+	_nodes[&value] = node;
+	_predecessors.emplace_back();
+	
+	return node;
+}
+
+bool SDGPass::addEdge(
+		unsigned int from,
+		unsigned int to,
+		EdgeKind     kind) {
+	
+	for(Edge const& i : _predecessors[from]) {
+		if(i.node == to && i.kind == kind) {
+			return false;
+		}
+	}
+	
+	_predecessors[from].push_back({to, kind});
+	
+	return true;
+}
+
+bool SDGPass::hasNode(
+		Value const& value) const {
+	
+	return _nodes.find(&value) != _nodes.end();
+}
+
+void SDGPass::addFunction(
+		Function& func) {
+	
+	PDGPass const& pdg   = getAnalysis<PDGPass>(func);
+	unsigned int   entry = (*this)[func];
+	
+	for(Instruction& i : Util::getInstructions(func)) {
+		unsigned int const node = (*this)[i];
+		
+		for(auto j : pdg[i].predecessors) {
+			// The root of the PDG is the entry of the function
+			addEdge(node, j->innerNode ? (*this)[*j->innerNode] : entry, EdgeKind::Intra);
+		}
+		
+		// The PDG only contains dependencies between instructions
+		for(Use const& j : i.operands()) {
+			if(Argument const* arg = dyn_cast<Argument>(&j)) {
+				addEdge(node, (*this)[*arg], EdgeKind::Intra);
+			}
+		}
+	}
+}
+
+void SDGPass::addCallEdges(
+		Module& module) {
+	
+	for(Function& i : module) {
+		if(!isAnalyzedFunction(i)) {
+			continue;
+		}
+		for(Instruction& j : Util::getInstructions(i)) {
+			Function* callee = getAnalyzedCallee(j);
+			if(!callee) {
+				continue;
+			}
+			
+			CallInst&          call     = cast<CallInst>(j);
+			unsigned int const callNode = (*this)[call];
+			
+			addEdge((*this)[*callee], callNode, EdgeKind::Call);
+			
+			unsigned int argIndex = 0;
+			for(Argument& k : callee->args()) {
+				Value const* actual = call.getArgOperand(argIndex++);
+				if(hasNode(*actual)) {
+					addEdge((*this)[k], (*this)[*actual], EdgeKind::ParameterIn);
+				}
+			}
+			
+			for(Instruction& k : Util::getInstructions(*callee)) {
+				if(isa<ReturnInst>(k)) {
+					addEdge(callNode, (*this)[k], EdgeKind::ParameterOut);
+				}
+			}
+		}
+	}
+}
+
+void SDGPass::addSummaryEdges(
+		Module& module) {
+	
+	// Summary edges of a callee can create new summary edges of its callers,
+	// so iterate until nothing changes
+	bool changed = true;
+	
+	while(changed) {
+		changed = false;
+		
+		for(Function& i : module) {
+			if(!isAnalyzedFunction(i)) {
+				continue;
+			}
+			
+			// The formal parameters the return value depends on
+			vector<bool> visited(size(), false);
+			for(Instruction& j : Util::getInstructions(i)) {
+				if(isa<ReturnInst>(j)) {
+					visited[(*this)[j]] = true;
+				}
+			}
+			reach(visited, {EdgeKind::Intra, EdgeKind::Summary});
+			
+			for(User* j : i.users()) {
+				CallInst* call = dyn_cast<CallInst>(j);
+				if(!call || call->getCalledFunction() != &i || !hasNode(*call)) {
+					continue;
+				}
+				
+				unsigned int argIndex = 0;
+				for(Argument& k : i.args()) {
+					Value const* actual = call->getArgOperand(argIndex++);
+					if(visited[(*this)[k]] && hasNode(*actual)) {
+						changed |= addEdge((*this)[*call], (*this)[*actual], EdgeKind::Summary);
+					}
+				}
+			}
+		}
+	}
+}
+
+void SDGPass::reach(
+		vector<bool>&           visited,
+		vector<EdgeKind> const& kinds) const {
+	
+	vector<unsigned int> workList;
+	for(unsigned int i = 0; i < visited.size(); i++) {
+		if(visited[i]) {
+			workList.push_back(i);
+		}
+	}
+	
+	while(!workList.empty()) {
+		unsigned int const node = workList.back();
+		workList.pop_back();
+		
+		for(Edge const& i : _predecessors[node]) {
+			if(!visited[i.node] &&
+					find(kinds.begin(), kinds.end(), i.kind) != kinds.end()) {
+				visited[i.node] = true;
+				workList.push_back(i.node);
+			}
+		}
+	}
+}
+
+unordered_set<Instruction const*> SDGPass::getInfluencingInstructions(
+		set<Instruction*> const& initInstructions) const {
+	
+	vector<bool> visited(size(), false);
+	for(Instruction* i : initInstructions) {
+		visited[(*this)[*i]] = true;
+	}
+	
+	reach(visited, {EdgeKind::Intra, EdgeKind::Call, EdgeKind::ParameterIn, EdgeKind::Summary});
+	reach(visited, {EdgeKind::Intra, EdgeKind::ParameterOut, EdgeKind::Summary});
+	
+	unordered_set<Instruction const*> result;
+	for(unsigned int i = 0; i < visited.size(); i++) {
+		if(visited[i]) {
+			if(Instruction const* inst = dyn_cast<Instruction>(_values[i])) {
+				result.insert(inst);
+			}
+		}
+	}
+	
+	return result;
+}
+
+unsigned int SDGPass::size(void) const {
+	
+	return _values.size();
+}
+
+unsigned int SDGPass::operator[](
+		Value const& value) const {
+	
+	return _nodes.at(&value);
+}
+
+Value const& SDGPass::operator[](
+		unsigned int node) const {
+	
+	return *_values[node];
+}
+
+vector<SDGPass::Edge> const& SDGPass::predecessors(
+		unsigned int node) const {
+	
+	return _predecessors[node];
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Value.h"
+#include "llvm/Pass.h"
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * The system dependence graph of a module. The per function PDGs are computed
+ * once and linked by interprocedural edges. Besides the instructions there is
+ * an entry node for every function, represented by the function itself, and a
+ * formal-in node for every argument.
+ *
+ * Edges point from a node to the nodes it depends on.
+ */
+class SDGPass : public llvm::ModulePass {
+	
+	public:
+	
+	enum class EdgeKind {
+		// Dependencies within a function
+		Intra,
+		// The entry of a function depends on its call sites
+		Call,
+		// A formal-in node depends on the actual argument of a call site
+		ParameterIn,
+		// A call depends on the return instructions of the callee
+		ParameterOut,
+		// A call depends on an actual argument, because the return value of
+		// the callee depends on the corresponding formal parameter
+		Summary
+	};
+	
+	struct Edge {
+		unsigned int node;
+		EdgeKind     kind;
+	};
+	
+	static char ID;
+	
+	SDGPass() : llvm::ModulePass(ID) {}
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override;
+	virtual bool runOnModule(llvm::Module &module) override;
+	
+	unsigned int size(void) const;
+	
+	unsigned int       operator[](llvm::Value const& value) const;
+	llvm::Value const& operator[](unsigned int node)        const;
+	
+	std::vector<Edge> const& predecessors(unsigned int node) const;
+	
+	/**
+	 * Computes the interprocedural backward slice in two phases: The first
+	 * phase ascends to the callers but does not descend into callees, their
+	 * effect is covered by summary edges. The second phase descends into
+	 * the callees of all nodes found so far without ascending again. This
+	 * way only realizable call paths are considered.
+	 */
+	std::unordered_set<llvm::Instruction const*> getInfluencingInstructions(
+		std::set<llvm::Instruction*> const& initInstructions) const;
+	
+	private:
+	
+	std::vector<llvm::Value const*>                       _values;
+	std::unordered_map<llvm::Value const*, unsigned int>  _nodes;
+	std::vector<std::vector<Edge>>                        _predecessors;
+	
+	unsigned int createNode(llvm::Value const& value);
+	bool         addEdge(unsigned int from, unsigned int to, EdgeKind kind);
+	bool         hasNode(llvm::Value const& value) const;
+	
+	void addFunction(llvm::Function& func);
+	void addCallEdges(llvm::Module& module);
+	void addSummaryEdges(llvm::Module& module);
+	
+	/**
+	 * Marks all nodes reachable from the marked nodes via the given edge
+	 * kinds.
+	 */
+	void reach(
+		std::vector<bool>&           visited,
+		std::vector<EdgeKind> const& kinds) const;
+};
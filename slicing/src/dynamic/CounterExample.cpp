@@ -0,0 +1,296 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "CounterExample.h"
+
+#include "util/SlicingStatistics.h"
+
+#include "llvm/IR/Instructions.h"
+
+#include <random>
+
+using namespace std;
+using namespace llvm;
+
+// Small values and the extremes are the most likely to expose a difference,
+// the others are uniformly distributed
+static APInt sampleValue(
+		unsigned int const width,
+		mt19937_64&        generator) {
+
+	switch(generator() % 4) {
+		case 0:
+			return APInt(width, static_cast<uint64_t>(
+				static_cast<int64_t>(generator() % 17) - 8), true);
+		case 1:
+			switch(generator() % 3) {
+				case 0:  return APInt::getSignedMinValue(width);
+				case 1:  return APInt::getSignedMaxValue(width);
+				default: return APInt::getAllOnesValue(width);
+			}
+		default:
+			return APInt(width, generator());
+	}
+}
+
+CounterExampleCache::CounterExampleCache(
+		Module&            program,
+		CriterionPtr       criterion,
+		unsigned int const sampleCount) :
+	criterion(criterion),
+	pFunction(nullptr) {
+
+	for(Instruction* pInstruction : criterion->getInstructions(program)) {
+		pFunction = pInstruction->getFunction();
+	}
+
+	if(!pFunction || pFunction->isDeclaration()) {
+		return;
+	}
+
+	pProgramTemplate.reset(new FunctionStateTemplate(*pFunction));
+
+	// The samples are the same for every session so the results are
+	// reproducible
+	mt19937_64 generator(0);
+	FunctionInput const zero(*pFunction);
+
+	for(unsigned int sample = 0; sample < sampleCount; sample++) {
+		CounterExample input;
+
+		for(APInt const& arg : zero.getArguments()) {
+			input.arguments.push_back(sample == 0 ?
+				arg : sampleValue(arg.getBitWidth(), generator));
+		}
+
+		Observation observation = observe(*pProgramTemplate, input);
+
+		// Inputs on which the program doesn't return can't show a divergence
+		if(observation.status == ExecutionStatus::returned) {
+			samples.push_back(move(input));
+			sampleObservations.push_back(move(observation));
+		}
+	}
+}
+
+ReplayResult CounterExampleCache::replay(
+		Module&               candidate,
+		CounterExample const& input) {
+
+	Function const* const pCandidateFunction = getCandidateFunction(candidate);
+
+	if(!pCandidateFunction) {
+		return ReplayResult::inconclusive;
+	}
+
+	FunctionStateTemplate const candidateTemplate(*pCandidateFunction);
+
+	return compare(
+		observe(*pProgramTemplate, input),
+		observe(candidateTemplate, input));
+}
+
+bool CounterExampleCache::refutes(
+		Module& candidate) {
+
+	if(counterExamples.empty()) {
+		return false;
+	}
+
+	Function const* const pCandidateFunction = getCandidateFunction(candidate);
+
+	if(!pCandidateFunction) {
+		return false;
+	}
+
+	FunctionStateTemplate const candidateTemplate(*pCandidateFunction);
+	bool const                  refuted = findCached(candidateTemplate) < counterExamples.size();
+
+	SlicingStatistics::getInstance().addCounterExampleReplay(refuted);
+
+	return refuted;
+}
+
+bool CounterExampleCache::findCounterExample(
+		Module&         candidate,
+		CounterExample* pResult) {
+
+	Function const* const pCandidateFunction = getCandidateFunction(candidate);
+
+	if(!pCandidateFunction) {
+		return false;
+	}
+
+	FunctionStateTemplate const candidateTemplate(*pCandidateFunction);
+
+	for(size_t i = 0; i < samples.size(); i++) {
+		if(compare(sampleObservations[i], observe(candidateTemplate, samples[i])) !=
+				ReplayResult::diverges) {
+			continue;
+		}
+
+		if(pResult) {
+			*pResult = samples[i];
+		}
+
+		// Cached counterexamples are replayed before the samples, so the
+		// sample is moved
+		counterExamples.push_back(move(samples[i]));
+		programObservations.push_back(move(sampleObservations[i]));
+		samples.erase(samples.begin() + static_cast<ptrdiff_t>(i));
+		sampleObservations.erase(sampleObservations.begin() + static_cast<ptrdiff_t>(i));
+		SlicingStatistics::getInstance().addConfirmedCounterExample();
+
+		return true;
+	}
+
+	return false;
+}
+
+bool CounterExampleCache::rejects(
+		Module&         candidate,
+		CounterExample* pResult) {
+
+	Function const* const pCandidateFunction = getCandidateFunction(candidate);
+
+	if(!pCandidateFunction) {
+		return false;
+	}
+
+	FunctionStateTemplate const candidateTemplate(*pCandidateFunction);
+	size_t const                index = findCached(candidateTemplate);
+
+	if(index < counterExamples.size()) {
+		SlicingStatistics::getInstance().addCounterExampleReplay(true);
+
+		if(pResult) {
+			*pResult = counterExamples[index];
+		}
+
+		return true;
+	}
+
+	SlicingStatistics::getInstance().addCounterExampleReplay(false);
+
+	return findCounterExample(candidate, pResult);
+}
+
+size_t CounterExampleCache::findCached(
+		FunctionStateTemplate const& candidateTemplate) const {
+
+	for(size_t i = 0; i < counterExamples.size(); i++) {
+		if(compare(programObservations[i], observe(candidateTemplate, counterExamples[i])) ==
+				ReplayResult::diverges) {
+			return i;
+		}
+	}
+
+	return counterExamples.size();
+}
+
+size_t CounterExampleCache::size(void) const {
+
+	return counterExamples.size();
+}
+
+CounterExampleCache::Observation CounterExampleCache::observe(
+		FunctionStateTemplate const& stateTemplate,
+		CounterExample        const& input) const {
+
+	FunctionInput functionInput(stateTemplate.func);
+
+	for(unsigned int i = 0; i < input.arguments.size(); i++) {
+		functionInput.setArgument(i, input.arguments[i]);
+	}
+
+	Interpreter interpreter(stateTemplate, functionInput);
+	Observation observation;
+
+	for(unsigned long step = 0; step < maxSteps &&
+			interpreter.getStatus() == ExecutionStatus::running; step++) {
+		interpreter.executeNextInstruction();
+
+		CallInst const* const pCall =
+			dyn_cast_or_null<CallInst>(interpreter.getRecentInstruction());
+
+		// Calls of the criterion function are only observable if it is the
+		// criterion
+		if(!pCall || criterion->isReturnValue() ||
+				interpreter.getStatus() != ExecutionStatus::running ||
+				!pCall->getCalledFunction() ||
+				pCall->getCalledFunction()->getName() != Criterion::FUNCTION_NAME) {
+			continue;
+		}
+
+		// The callee is the last operand, so the arguments come first
+		ArrayRef<unsigned int> const operandSlots =
+			stateTemplate.getOperandSlots(stateTemplate[*pCall]);
+
+		for(unsigned int i = 0; i < pCall->getNumArgOperands(); i++) {
+			if(operandSlots[i] != FunctionStateTemplate::noSlot) {
+				observation.values.push_back(interpreter.getState()[operandSlots[i]]);
+			}
+		}
+	}
+
+	observation.status = interpreter.getStatus();
+
+	if(observation.status == ExecutionStatus::running) {
+		observation.status = ExecutionStatus::stepLimit;
+	}
+
+	if(observation.status == ExecutionStatus::returned && criterion->isReturnValue() &&
+			!stateTemplate.func.getReturnType()->isVoidTy()) {
+		observation.values.push_back(interpreter.getReturnValue());
+	}
+
+	return observation;
+}
+
+ReplayResult CounterExampleCache::compare(
+		Observation const& expected,
+		Observation const& actual) const {
+
+	if(expected.status != ExecutionStatus::returned ||
+			actual.status != ExecutionStatus::returned) {
+		return ReplayResult::inconclusive;
+	}
+
+	if(expected.values.size() != actual.values.size()) {
+		return ReplayResult::diverges;
+	}
+
+	for(size_t i = 0; i < expected.values.size(); i++) {
+		if(expected.values[i].getBitWidth() != actual.values[i].getBitWidth() ||
+				expected.values[i] != actual.values[i]) {
+			return ReplayResult::diverges;
+		}
+	}
+
+	return ReplayResult::agrees;
+}
+
+Function const* CounterExampleCache::getCandidateFunction(
+		Module& candidate) const {
+
+	if(!pProgramTemplate) {
+		return nullptr;
+	}
+
+	Function const* const pCandidateFunction =
+		candidate.getFunction(pFunction->getName());
+
+	if(!pCandidateFunction || pCandidateFunction->isDeclaration() ||
+			pCandidateFunction->getFunctionType() != pFunction->getFunctionType()) {
+		return nullptr;
+	}
+
+	return pCandidateFunction;
+}
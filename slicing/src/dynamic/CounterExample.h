@@ -0,0 +1,102 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "core/Criterion.h"
+#include "dynamic/Interpreter.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+#include <memory>
+#include <vector>
+
+// Arguments of the sliced function on which a candidate produces different
+// criterion values than the program
+class CounterExample {
+
+	public:
+
+	std::vector<llvm::APInt> arguments;
+};
+
+enum class ReplayResult {diverges, agrees, inconclusive};
+
+// Replays counterexamples on the program and slice candidates with the fixed
+// width interpreter. A candidate diverges if both functions return and the
+// values passed to the criterion (or the return values for the return value
+// criterion) differ, this is a proof that the candidate is not a slice. If one
+// of the executions can't be completed the result is inconclusive.
+//
+// The solver only answers whether a candidate is valid, Eldarica doesn't
+// provide a model for invalid candidates. So witnesses are searched in a bank
+// of sampled inputs, the program is run on them once when the cache is
+// created. Confirmed counterexamples are cached and replayed first, as a
+// counterexample of one candidate often refutes others as well. All of this
+// takes milliseconds instead of a solver query.
+class CounterExampleCache {
+
+	public:
+
+	static unsigned int const defaultSampleCount = 64;
+
+	CounterExampleCache(
+			llvm::Module& program,
+			CriterionPtr  criterion,
+			unsigned int  sampleCount = defaultSampleCount);
+
+	ReplayResult replay(llvm::Module& candidate, CounterExample const& input);
+
+	// True if one of the cached counterexamples shows that the candidate
+	// diverges
+	bool refutes(llvm::Module& candidate);
+
+	// Searches the sampled inputs for one on which the candidate diverges
+	// and caches it
+	bool findCounterExample(llvm::Module& candidate, CounterExample* pResult = nullptr);
+
+	// Replays the cached counterexamples and then the samples, true if the
+	// candidate diverges on one of them. Only candidates that agree on all
+	// inputs need to be validated by the solver.
+	bool rejects(llvm::Module& candidate, CounterExample* pResult = nullptr);
+
+	size_t size(void) const;
+
+	private:
+
+	// The values observed in one execution
+	struct Observation {
+		ExecutionStatus          status;
+		std::vector<llvm::APInt> values;
+	};
+
+	static unsigned long const maxSteps = 100000;
+
+	CriterionPtr                           criterion;
+	llvm::Function const*                  pFunction;
+	std::unique_ptr<FunctionStateTemplate> pProgramTemplate;
+	// The observations of the program on the cached counterexamples
+	std::vector<Observation>               programObservations;
+	std::vector<CounterExample>            counterExamples;
+	std::vector<CounterExample>            samples;
+	std::vector<Observation>               sampleObservations;
+
+	// The index of the first cached counterexample on which the candidate
+	// diverges, or the number of counterexamples if there is none
+	size_t findCached(FunctionStateTemplate const& candidateTemplate) const;
+
+	Observation observe(FunctionStateTemplate const& stateTemplate, CounterExample const& input) const;
+
+	ReplayResult compare(Observation const& expected, Observation const& actual) const;
+
+	llvm::Function const* getCandidateFunction(llvm::Module& candidate) const;
+};
@@ -10,45 +10,38 @@
 
 #include "DRM.h"
 
-#include "core/Util.h"
-
 using namespace std;
 using namespace llvm;
 
-LinearizedFunction::LinearizedFunction(
-		Function& func) {
-	
-	unsigned int index = 0;
+DRM::DRM(
+		CompactDependencyGraph const& graph) :
+	accumulator(graph.size()) {
 	
-	for(Instruction& i : Util::getInstructions(func)) {
-		mapInstToInt[&i] = index++;
-	}
+	unsigned int const size = graph.size();
 	
-	// 'index' is the number of instructions
-	mapIntToInst = new Instruction*[index];
+	matrix.reserve(size);
 	
-	for(Instruction& i : Util::getInstructions(func)) {
-		// use the previous generated mapping as the iteration may vary
-		// between different iterations
-		mapIntToInst[mapInstToInt[&i]] = &i;
+	for(unsigned int i = 0; i < size; i++) {
+		matrix.emplace_back(size);
+		matrix[i].set(i);
+		
+		for(unsigned int pred : graph.predecessors(i)) {
+			matrix[i].set(pred);
+		}
 	}
-}
-	
-LinearizedFunction::~LinearizedFunction(void) {
 	
-	delete [] mapIntToInst;
+	computeTransitiveClosure();
 }
 
-Instruction& LinearizedFunction::operator[](
-		unsigned int const index) const {
+void DRM::computeTransitiveClosure(void) {
 	
-	return *mapIntToInst[index];
-}
-
-unsigned int LinearizedFunction::operator[](
-		Instruction const& inst)  const {
-	
-	return mapInstToInt.at(&inst);
+	for(unsigned int k = 0; k < matrix.size(); k++) {
+		for(unsigned int i = 0; i < matrix.size(); i++) {
+			if(i != k && matrix[i][k]) {
+				matrix[i] |= matrix[k];
+			}
+		}
+	}
 }
 
 BitArray const& DRM::computeSlice(
@@ -56,10 +49,8 @@ BitArray const& DRM::computeSlice(
 	
 	accumulator.reset();
 	
-	for(unsigned int i = 0; i < apriori.size; i++) {
-		if(apriori[i]) {
-			accumulator |= matrix[i];
-		}
+	for(unsigned int i : apriori.setBits()) {
+		accumulator |= matrix[i];
 	}
 	
 	return accumulator;
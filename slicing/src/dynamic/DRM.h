@@ -10,41 +10,39 @@
 
 #pragma once
 
+#include "core/CompactDependencyGraph.h"
+#include "core/LinearizedFunction.h"
 #include "util/BitArray.h"
 
-#include "llvm/IR/Function.h"
-#include "llvm/IR/Instruction.h"
-
-#include <unordered_map>
-
-class LinearizedFunction {
-	
-	public:
-	
-	LinearizedFunction(llvm::Function& func);
-	~LinearizedFunction(void);
-	
-	llvm::Instruction& operator[](unsigned int const       index) const;
-	unsigned int       operator[](llvm::Instruction const& inst)  const;
-	
-	private:
-	
-	std::unordered_map<llvm::Instruction const*, unsigned int> mapInstToInt;
-	llvm::Instruction**                                        mapIntToInst;
-};
+#include <vector>
 
 class DRM {
 	
 	public:
 	
-	// TODO: DRM(LinearizedFunction, CounterExample);
-	// Use the Algorithm for DRM creation
-	
+	/**
+	 * Creates the relevance matrix of the function. Row i contains all
+	 * instructions that instruction i depends on, directly or transitively,
+	 * according to the dependence graph. Every instruction is relevant for
+	 * itself.
+	 */
+	DRM(CompactDependencyGraph const& graph);
+	
+	/**
+	 * Returns all instructions that are relevant for at least one of the
+	 * instructions set in 'apriori'. The result is only valid until the next
+	 * call.
+	 */
 	BitArray const& computeSlice(BitArray const& apriori);
 	
 	private:
 	
-	//LinearizedFunction const& func;
-	BitArray const*           matrix;
-	BitArray                  accumulator;
+	std::vector<BitArray> matrix;
+	BitArray              accumulator;
+	
+	/**
+	 * Warshall's algorithm, a whole row is updated with one word-parallel or
+	 * at a time.
+	 */
+	void computeTransitiveClosure(void);
 };
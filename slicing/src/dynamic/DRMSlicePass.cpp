@@ -0,0 +1,61 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "DRMSlicePass.h"
+
+#include "DRM.h"
+
+#include "core/SlicingPass.h"
+
+using namespace std;
+using namespace llvm;
+
+static RegisterPass<DRMSlicePass> tmp(
+	"drm-slice", "DRM Slice", true, false);
+
+char DRMSlicePass::ID = 0;
+
+void DRMSlicePass::getAnalysisUsage(
+		AnalysisUsage &au) const {
+
+	au.addRequiredTransitive<PDGPass>();
+}
+
+bool DRMSlicePass::runOnFunction(
+		Function& func) {
+
+	PDGPass const& pdg = getAnalysis<PDGPass>();
+
+	LinearizedFunction linearizedFunc(func);
+	BitArray           apriori(linearizedFunc.size());
+
+	for(Instruction* i : criterion->getInstructions(*func.getParent())) {
+		if(i->getParent()->getParent() == &func) {
+			apriori.set(linearizedFunc[*i]);
+		}
+	}
+
+	// Functions without a criterion are left untouched
+	if(apriori.none()) {
+		return false;
+	}
+
+	CompactDependencyGraph graph(linearizedFunc, pdg);
+	DRM                    drm(graph);
+	BitArray const&        relevant = drm.computeSlice(apriori);
+
+	for(unsigned int i = 0; i < linearizedFunc.size(); i++) {
+		if(!relevant[i]) {
+			SlicingPass::toBeSliced(linearizedFunc[i]);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "core/Criterion.h"
+#include "core/DependencyGraphPasses.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LegacyPassManager.h"
+
+/**
+ * Marks all instructions that are not relevant for the criterion according to
+ * the dynamic relevance matrix of the function.
+ */
+class DRMSlicePass : public llvm::FunctionPass {
+
+	public:
+
+	static char ID;
+
+	DRMSlicePass(CriterionPtr criterionPtr = Criterion::getReturnValueCriterion()) : llvm::FunctionPass(ID), criterion(criterionPtr) {}
+
+	virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override;
+
+	virtual bool runOnFunction(llvm::Function &func) override;
+
+private:
+	CriterionPtr criterion;
+};
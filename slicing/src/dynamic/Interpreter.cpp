@@ -10,114 +10,569 @@
 
 #include "Interpreter.h"
 
+#include "core/Criterion.h"
+#include "preprocessing/ExplicitAssignPass.h"
+#include "preprocessing/PromoteAssertSlicedPass.h"
+
 #include "llvm/IR/InstrTypes.h"
-#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include <algorithm>
 
 using namespace std;
 using namespace llvm;
 
-Integer::~Integer(void) {
-	
-	if(constant) delete pValue;
+using llreve::interpreter::BoundedArithmetic;
+using llreve::interpreter::EvalStatus;
+using llreve::interpreter::TraceObserver;
+
+// Values of other types get a slot too, so that every instruction has one,
+// but they are never read
+static unsigned int getBitWidth(Type const& type) {
+
+	return type.isIntegerTy() ? type.getIntegerBitWidth() : 1;
 }
 
-FunctionStateTemplate::FunctionStateTemplate(
+FunctionInput::FunctionInput(
 		Function const& func) : func(func) {
-	
-	
+
+	arguments.reserve(func.arg_size());
+
+	for(Argument const& arg : func.args()) {
+		arguments.emplace_back(getBitWidth(*arg.getType()), 0);
+	}
+}
+
+FunctionInput& FunctionInput::setArgument(
+		unsigned int const index,
+		uint64_t     const value) {
+
+	arguments.at(index) = APInt(arguments[index].getBitWidth(), value);
+
+	return *this;
+}
+
+FunctionInput& FunctionInput::setArgument(
+		unsigned int const index,
+		APInt const&       value) {
+
+	assert(value.getBitWidth() == arguments.at(index).getBitWidth() &&
+		"The value has to have the bit width of the argument");
+
+	arguments[index] = value;
+
+	return *this;
+}
+
+ArrayRef<APInt> FunctionInput::getArguments(void) const {
+
+	return arguments;
+}
+
+FunctionStateTemplate::FunctionStateTemplate(
+		Function const& func) :
+	func     (func),
+	layout   (func),
+	constants(layout),
+	argCount (static_cast<unsigned int>(func.arg_size())) {
+
+	// The layout already assigned a slot to every instruction, which is
+	// necessary as phi nodes may use values that are defined later. Constants
+	// get a slot after those of the instructions when they are used for the
+	// first time.
+	for(unsigned int slot = argCount; slot < layout.variableCount(); slot++) {
+		operandBegins.push_back(static_cast<unsigned int>(operandSlots.size()));
+
+		for(Value const* pOperand : getInstruction(slot).operand_values()) {
+			if(isa<BasicBlock>(pOperand)) {
+				continue;
+			}
+
+			auto const operandSlot = layout.slot(pOperand);
+
+			operandSlots.push_back(
+				operandSlot ? *operandSlot : getConstantSlot(*pOperand));
+		}
+	}
+
+	operandBegins.push_back(static_cast<unsigned int>(operandSlots.size()));
+}
+
+unsigned int FunctionStateTemplate::getConstantSlot(
+		Value const& value) {
+
+	auto const slot = constants.constant(&value,
+		[](Value const& constant) -> Optional<APInt> {
+
+			if(!constant.getType()->isIntegerTy()) {
+				return None;
+			}
+
+			if(auto const pConstInt = dyn_cast<ConstantInt>(&constant)) {
+				return pConstInt->getValue();
+			} else if(isa<UndefValue>(&constant)) {
+				// Any value is a valid choice for undef
+				return APInt(getBitWidth(*constant.getType()), 0);
+			}
+
+			// Constant expressions, e.g. casts of pointers
+			return None;
+		});
+
+	return slot ? *slot : noSlot;
 }
 
 unsigned int FunctionStateTemplate::getValueCount(void) const {
-	
-	return static_cast<unsigned int>(indices.size());
+
+	return getConstantsBegin() +
+		static_cast<unsigned int>(constants.values().size());
 }
 
 unsigned int FunctionStateTemplate::operator[](
 		Value const& value) const {
-	
-	return indices.at(&value);
+
+	if(auto const slot = layout.slot(&value)) {
+		return *slot;
+	}
+
+	auto const slot = constants.lookup(&value);
+
+	assert(slot && "The value has to be used in the function");
+
+	return *slot;
 }
 
-APInt& FunctionState::getUIntValue(
-		Value const& value) {
-	
-	return *static_cast<APInt*>(values[stateTemplate[value]]);
+Instruction const& FunctionStateTemplate::getInstruction(
+		unsigned int const slot) const {
+
+	return *cast<Instruction>(layout.variable(slot));
+}
+
+unsigned int FunctionStateTemplate::getFirstSlot(
+		BasicBlock const& block) const {
+
+	return layout.firstSlot(layout.blockIndex(block));
+}
+
+ArrayRef<unsigned int> FunctionStateTemplate::getOperandSlots(
+		unsigned int const slot) const {
+
+	unsigned int const begin = operandBegins[slot - argCount];
+	unsigned int const end   = operandBegins[slot - argCount + 1];
+
+	return ArrayRef<unsigned int>(operandSlots).slice(begin, end - begin);
+}
+
+ArrayRef<APInt> FunctionStateTemplate::getConstants(void) const {
+
+	return constants.values();
+}
+
+unsigned int FunctionStateTemplate::getConstantsBegin(void) const {
+
+	return constants.begin();
 }
 
 FunctionState::FunctionState(
-		FunctionStateTemplate const& stateTemplate) :
-	stateTemplate(stateTemplate),
-	values       (new void*[stateTemplate.getValueCount()]) {
-	
-	
+		FunctionStateTemplate const& stateTemplate,
+		FunctionInput         const& input) :
+	stateTemplate(stateTemplate) {
+
+	assert(&input.func == &stateTemplate.func &&
+		"The input has to belong to the function of the template");
+
+	values.reserve(stateTemplate.getValueCount());
+	values.insert(values.end(),
+		input.getArguments().begin(), input.getArguments().end());
+
+	unsigned int const constantsBegin = stateTemplate.getConstantsBegin();
+
+	for(unsigned int slot = static_cast<unsigned int>(values.size());
+			slot < constantsBegin; slot++) {
+		values.emplace_back(
+			getBitWidth(*stateTemplate.getInstruction(slot).getType()), 0);
+	}
+
+	values.insert(values.end(),
+		stateTemplate.getConstants().begin(),
+		stateTemplate.getConstants().end());
 }
 
-FunctionState::~FunctionState(void) {
-	
-	// TODO: einzelne Werte löschen
-	
-	delete [] values;
+void ExecutionTrace::executeInstruction(
+		Instruction const& inst,
+		llreve::interpreter::Slot) {
+
+	steps.push_back(&inst);
+}
+
+APInt const& FunctionState::getUIntValue(
+		Value const& value) const {
+
+	return values[stateTemplate[value]];
+}
+
+Interpreter::Interpreter(
+		FunctionStateTemplate const& stateTemplate,
+		FunctionInput         const& input) :
+	func         (stateTemplate.func),
+	stateTemplate(stateTemplate),
+	state        (stateTemplate, input),
+	status       (ExecutionStatus::running),
+	recentSlot   (FunctionStateTemplate::noSlot),
+	nextSlot     (FunctionStateTemplate::noSlot),
+	blockBegin   (FunctionStateTemplate::noSlot),
+	pObserver    (nullptr) {
+
+	if(func.isDeclaration()) {
+		status = ExecutionStatus::unsupported;
+		return;
+	}
+
+	size_t maxPhiCount = 0;
+
+	for(BasicBlock const& block : func) {
+		size_t const phiCount = static_cast<size_t>(distance(
+			block.begin(), block.getFirstNonPHI()->getIterator()));
+		maxPhiCount = max(maxPhiCount, phiCount);
+	}
+
+	phiValues.resize(maxPhiCount);
+
+	blockBegin = stateTemplate.getFirstSlot(func.getEntryBlock());
+	nextSlot   = blockBegin;
 }
 
 Interpreter& Interpreter::executeNextInstruction(void) {
-	
-	pRecentInst = pNextInst;
-	
-	if(isa<BinaryOperator>(pRecentInst)) {
-		executeBinaryOperator();
-	} else if(isa<BranchInst>(pRecentInst)) {
-		executeBranchInst();
-	} else if(isa<PHINode>(pRecentInst)) {
-		executePHINode();
+
+	if(status != ExecutionStatus::running) {
+		return *this;
+	}
+
+	recentSlot = nextSlot++;
+
+	Instruction const& inst = stateTemplate.getInstruction(recentSlot);
+
+	if(auto const pBinOp = dyn_cast<BinaryOperator>(&inst)) {
+		executeBinaryOperator(*pBinOp);
+	} else if(auto const pCmp = dyn_cast<ICmpInst>(&inst)) {
+		executeCmpInst(*pCmp);
+	} else if(auto const pCast = dyn_cast<CastInst>(&inst)) {
+		executeCastInst(*pCast);
+	} else if(isa<SelectInst>(&inst)) {
+		executeSelectInst();
+	} else if(auto const pCall = dyn_cast<CallInst>(&inst)) {
+		executeCallInst(*pCall);
+	} else if(auto const pBranch = dyn_cast<BranchInst>(&inst)) {
+		executeBranchInst(*pBranch);
+	} else if(auto const pSwitch = dyn_cast<SwitchInst>(&inst)) {
+		executeSwitchInst(*pSwitch);
+	} else if(auto const pReturn = dyn_cast<ReturnInst>(&inst)) {
+		executeReturnInst(*pReturn);
+	} else if(auto const pPhi = dyn_cast<PHINode>(&inst)) {
+		executePHINode(*pPhi);
+	} else if(isa<UnreachableInst>(&inst)) {
+		status = ExecutionStatus::undefinedBehavior;
 	} else {
-		// TODO: Unsupported instruction
+		// Memory accesses, floating point operations, ...
+		status = ExecutionStatus::unsupported;
 	}
-	
+
 	return *this;
 }
 
+ExecutionStatus Interpreter::run(
+		TraceObserver&      observer,
+		unsigned long const maxSteps) {
+
+	pObserver = &observer;
+
+	if(status == ExecutionStatus::running &&
+			recentSlot == FunctionStateTemplate::noSlot) {
+		observer.enterBlock(func.getEntryBlock(), nullptr);
+	}
+
+	for(unsigned long step = 0; status == ExecutionStatus::running; step++) {
+		if(maxSteps != 0 && step == maxSteps) {
+			pObserver = nullptr;
+			return ExecutionStatus::stepLimit;
+		}
+
+		executeNextInstruction();
+
+		// Instructions that could not be executed are not part of the trace
+		if(status == ExecutionStatus::running ||
+				status == ExecutionStatus::returned) {
+			observer.executeInstruction(*getRecentInstruction(), recentSlot);
+		}
+	}
+
+	if(status == ExecutionStatus::returned) {
+		observer.exitFunction(func);
+	}
+
+	pObserver = nullptr;
+
+	return status;
+}
+
+ExecutionTrace& Interpreter::run(
+		ExecutionTrace&     trace,
+		unsigned long const maxSteps) {
+
+	trace.status = run(static_cast<TraceObserver&>(trace), maxSteps);
+
+	if(status == ExecutionStatus::returned && !func.getReturnType()->isVoidTy()) {
+		trace.returnValue = returnValue;
+	}
+
+	return trace;
+}
+
+ExecutionStatus Interpreter::getStatus(void) const {
+
+	return status;
+}
+
+FunctionState const& Interpreter::getState(void) const {
+
+	return state;
+}
+
+APInt const& Interpreter::getReturnValue(void) const {
+
+	return returnValue;
+}
+
 Instruction const* Interpreter::getNextInstruction(void) const {
-	
-	return pNextInst;
+
+	if(status != ExecutionStatus::running) {
+		return nullptr;
+	}
+
+	return &stateTemplate.getInstruction(nextSlot);
 }
 
 Instruction const* Interpreter::getRecentInstruction(void) const {
-	
-	return pRecentInst;
+
+	if(recentSlot == FunctionStateTemplate::noSlot) {
+		return nullptr;
+	}
+
+	return &stateTemplate.getInstruction(recentSlot);
 }
 
-FunctionState const& Interpreter::getState(void) const {
-	
-	return *pCurrentState;
-}
-
-Integer& Interpreter::resolveValue(
-		Value const* pVal) {
-	
-	if(isa<Instruction>(pVal) || isa<Argument>(pVal)) {
-		
-		// TODO: resolve
-		//return state.variables.at(val);
-		
-	} else if (auto const constInt = dyn_cast<ConstantInt>(pVal)) {
-		
-		// For the moment treat all integers, no matter which bit width
-		return *new Integer(*constInt);
-		
-	//} else if (isa<ConstantPointerNull>(val)) {
-		//return make_shared<VarInt>(Integer(makeBoundedInt(64, 0)));
+APInt const* Interpreter::resolveOperand(
+		unsigned int const index) {
+
+	unsigned int const slot = stateTemplate.getOperandSlots(recentSlot)[index];
+
+	if(slot == FunctionStateTemplate::noSlot) {
+		status = ExecutionStatus::unsupported;
+		return nullptr;
+	}
+
+	return &state[slot];
+}
+
+void Interpreter::jumpTo(
+		BasicBlock const& block) {
+
+	BasicBlock const* const pFrom = stateTemplate.getInstruction(recentSlot).getParent();
+
+	blockBegin = stateTemplate.getFirstSlot(block);
+	nextSlot   = blockBegin;
+
+	if(pObserver) {
+		pObserver->enterBlock(block, pFrom);
+	}
+
+	// All phi nodes read the values of the predecessor, so they have to be
+	// evaluated before the first one is assigned
+	unsigned int slot = blockBegin;
+
+	for(auto it = block.begin(); isa<PHINode>(*it); ++it, ++slot) {
+		PHINode const& phi   = cast<PHINode>(*it);
+		int const      index = phi.getBasicBlockIndex(pFrom);
+		unsigned int const operandSlot =
+			stateTemplate.getOperandSlots(slot)[static_cast<unsigned int>(index)];
+
+		if(operandSlot == FunctionStateTemplate::noSlot) {
+			status = ExecutionStatus::unsupported;
+			return;
+		}
+
+		phiValues[slot - blockBegin] = state[operandSlot];
+	}
+}
+
+void Interpreter::executeBinaryOperator(
+		BinaryOperator const& inst) {
+
+	if(!inst.getType()->isIntegerTy()) {
+		status = ExecutionStatus::unsupported;
+		return;
+	}
+
+	APInt const* const pOp1 = resolveOperand(0);
+	APInt const* const pOp2 = resolveOperand(1);
+
+	if(!pOp1 || !pOp2) {
+		return;
+	}
+
+	EvalStatus evalStatus;
+
+	if(!llreve::interpreter::evalBinaryOp<BoundedArithmetic>(
+			inst.getOpcode(), *pOp1, *pOp2, state[recentSlot], evalStatus)) {
+		status = ExecutionStatus::unsupported;
+	} else if(evalStatus != EvalStatus::Ok) {
+		// Division by zero, signed overflow of a division and shifting by the
+		// bit width or more
+		status = ExecutionStatus::undefinedBehavior;
+	}
+}
+
+void Interpreter::executeCmpInst(
+		ICmpInst const& inst) {
+
+	APInt const* const pOp1 = resolveOperand(0);
+	APInt const* const pOp2 = resolveOperand(1);
+
+	if(!pOp1 || !pOp2) {
+		return;
+	}
+
+	bool result;
+
+	if(!llreve::interpreter::evalPredicate<BoundedArithmetic>(
+			inst.getPredicate(), *pOp1, *pOp2, result)) {
+		status = ExecutionStatus::unsupported;
+		return;
+	}
+
+	state[recentSlot] = APInt(1, result);
+}
+
+void Interpreter::executeCastInst(
+		CastInst const& inst) {
+
+	if(!inst.getType()->isIntegerTy()) {
+		status = ExecutionStatus::unsupported;
+		return;
+	}
+
+	APInt const* const pOp = resolveOperand(0);
+
+	if(!pOp) {
+		return;
+	}
+
+	unsigned int const width = inst.getType()->getIntegerBitWidth();
+
+	switch(inst.getOpcode()) {
+		case Instruction::Trunc: state[recentSlot] = pOp->trunc(width); break;
+		case Instruction::ZExt:  state[recentSlot] = pOp->zext (width); break;
+		case Instruction::SExt:  state[recentSlot] = pOp->sext (width); break;
+		default:
+			// Casts from pointers and floating point values
+			status = ExecutionStatus::unsupported;
+			break;
+	}
+}
+
+void Interpreter::executeSelectInst(void) {
+
+	APInt const* const pCondition = resolveOperand(0);
+	APInt const* const pTrue      = resolveOperand(1);
+	APInt const* const pFalse     = resolveOperand(2);
+
+	if(!pCondition || !pTrue || !pFalse) {
+		return;
+	}
+
+	state[recentSlot] = pCondition->getBoolValue() ? *pTrue : *pFalse;
+}
+
+void Interpreter::executeCallInst(
+		CallInst const& inst) {
+
+	Function const* const pCallee = inst.getCalledFunction();
+
+	if(!pCallee) {
+		status = ExecutionStatus::unsupported;
+		return;
+	}
+
+	StringRef const name = pCallee->getName();
+
+	// The identity functions inserted by the ExplicitAssignPass get a numeric
+	// suffix if there is more than one of them
+	if(name.startswith(ExplicitAssignPass::FUNCTION_NAME) &&
+			inst.getNumArgOperands() == 1 &&
+			inst.getType() == inst.getArgOperand(0)->getType()) {
+		if(APInt const* const pArg = resolveOperand(0)) {
+			state[recentSlot] = *pArg;
+		}
+	} else if(isa<DbgInfoIntrinsic>(&inst) ||
+			name == Criterion::FUNCTION_NAME ||
+			name == PromoteAssertSlicedPass::FUNCTION_NAME ||
+			name == "__mark") {
+		// These only annotate the program
 	} else {
-		
+		status = ExecutionStatus::unsupported;
 	}
 }
 
-void Interpreter::executeBinaryOperator(void) {
-	
-	Integer& op1 = resolveValue(pRecentInst->getOperand(0));
-	Integer& op2 = resolveValue(pRecentInst->getOperand(0));
-	
-	
-	
-	delete &op1;
-	delete &op2;
+void Interpreter::executeBranchInst(
+		BranchInst const& inst) {
+
+	if(inst.isUnconditional()) {
+		jumpTo(*inst.getSuccessor(0));
+		return;
+	}
+
+	if(APInt const* const pCondition = resolveOperand(0)) {
+		jumpTo(*inst.getSuccessor(pCondition->getBoolValue() ? 0 : 1));
+	}
+}
+
+void Interpreter::executeSwitchInst(
+		SwitchInst const& inst) {
+
+	APInt const* const pCondition = resolveOperand(0);
+
+	if(!pCondition) {
+		return;
+	}
+
+	for(auto caseIt : inst.cases()) {
+		if(caseIt.getCaseValue()->getValue() == *pCondition) {
+			jumpTo(*caseIt.getCaseSuccessor());
+			return;
+		}
+	}
+
+	jumpTo(*inst.getDefaultDest());
+}
+
+void Interpreter::executeReturnInst(
+		ReturnInst const& inst) {
+
+	if(inst.getReturnValue()) {
+		APInt const* const pValue = resolveOperand(0);
+
+		if(!pValue) {
+			return;
+		}
+
+		returnValue = *pValue;
+	}
+
+	status = ExecutionStatus::returned;
+}
+
+void Interpreter::executePHINode(
+		PHINode const&) {
+
+	state[recentSlot] = phiValues[recentSlot - blockBegin];
 }
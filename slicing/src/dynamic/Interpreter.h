@@ -10,103 +10,195 @@
 
 #pragma once
 
+#include "InterpreterCore.h"
+
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
 
-#include <unordered_map>
+#include <vector>
 
-class Integer {
-	
-	public:
-	
-	Integer(llvm::APInt& apInt) : constant(false), pValue(&apInt) {}
-	Integer(llvm::ConstantInt const& constInt) :
-		constant(true),
-		pValue  (new llvm::APInt(constInt.getValue())) {}
-	~Integer(void);
-	
-	private:
-	
-	bool         const constant;
-	llvm::APInt* const pValue;
-};
+enum class ExecutionStatus {running, returned, unsupported, undefinedBehavior, stepLimit};
 
 // The input signature equals the function signature
 class FunctionInput {
-	
+
 	public:
-	
+
 	llvm::Function const& func;
+
+	// All arguments are initialized to zero
+	FunctionInput(llvm::Function const& func);
+
+	FunctionInput& setArgument(unsigned int const index, uint64_t const value);
+	FunctionInput& setArgument(unsigned int const index, llvm::APInt const& value);
+
+	llvm::ArrayRef<llvm::APInt> getArguments(void) const;
+
+	private:
+
+	std::vector<llvm::APInt> arguments;
 };
 
 // This class provides indices for each value in a function, that are used in a
-// concrete function state
+// concrete function state. The layout is the one of llreve's interpreter core:
+// The arguments come first, followed by one slot per instruction in the order
+// of the function and the constants, every distinct constant gets only one
+// slot. The template is built once per function and shared by all states and
+// interpreters of that function.
 class FunctionStateTemplate {
-	
+
 	public:
-	
+
+	// Marks operands that can't be represented as fixed width integers, e.g.
+	// pointers and globals
+	static unsigned int const noSlot = ~0u;
+
 	llvm::Function const& func;
-	
+
 	FunctionStateTemplate(llvm::Function const& func);
-	
+
 	unsigned int getValueCount(void) const;
-	
+
 	unsigned int operator[](llvm::Value const& value) const;
-	
+
+	// The instruction that is stored in 'slot'
+	llvm::Instruction const& getInstruction(unsigned int const slot) const;
+
+	// The slot of the first instruction of 'block'
+	unsigned int getFirstSlot(llvm::BasicBlock const& block) const;
+
+	// The slots of the operands of the instruction stored in 'slot', labels
+	// are skipped
+	llvm::ArrayRef<unsigned int> getOperandSlots(unsigned int const slot) const;
+
+	// The values of the pooled constants, starting at slot
+	// getConstantsBegin()
+	llvm::ArrayRef<llvm::APInt> getConstants(void) const;
+	unsigned int                getConstantsBegin(void) const;
+
 	private:
-	
-	std::unordered_map<llvm::Value const*, unsigned int> indices;
+
+	llreve::interpreter::SlotLayout               layout;
+	llreve::interpreter::ConstantPool<llvm::APInt> constants;
+	std::vector<unsigned int>                      operandSlots;
+	// Operands of slot i are operandSlots[operandBegins[i - argCount]] up to
+	// operandSlots[operandBegins[i - argCount + 1]]
+	std::vector<unsigned int>                      operandBegins;
+	unsigned int                                   argCount;
+
+	unsigned int getConstantSlot(llvm::Value const& value);
 };
 
 // The state signature is the union of the input signature and all variables
 // that occure within the function
 class FunctionState {
-	
+
 	public:
-	
+
 	FunctionStateTemplate const& stateTemplate;
-	
-	FunctionState(FunctionStateTemplate const& stateTemplate);
-	~FunctionState(void);
-	
-	llvm::APInt& getUIntValue(llvm::Value const& value);
-	
+
+	FunctionState(FunctionStateTemplate const& stateTemplate, FunctionInput const& input);
+
+	llvm::APInt const& getUIntValue(llvm::Value const& value) const;
+
+	llvm::APInt&       operator[](unsigned int const slot)       {return values[slot];}
+	llvm::APInt const& operator[](unsigned int const slot) const {return values[slot];}
+
 	private:
-	
-	// Array which values are of type APInt or APSInt
-	void** values;
+
+	std::vector<llvm::APInt> values;
+};
+
+// The instructions in the order they have been executed
+class ExecutionTrace : public llreve::interpreter::TraceObserver {
+
+	public:
+
+	std::vector<llvm::Instruction const*> steps;
+	ExecutionStatus                       status = ExecutionStatus::running;
+
+	// Only set if the function returned a value
+	llvm::APInt returnValue;
+
+	void executeInstruction(
+			llvm::Instruction const&  inst,
+			llreve::interpreter::Slot slot) override;
 };
 
+// Executes a function on fixed width integers. The values are stored in the
+// slots given by the FunctionStateTemplate, so the interpreter only allocates
+// memory when it is constructed (and for integers wider than 64 bits). All
+// instructions that operate on integers are supported as well as calls of the
+// functions introduced by the preprocessing. Memory accesses and other calls
+// stop the execution with ExecutionStatus::unsupported.
 class Interpreter {
-	
+
 	public:
-	
+
 	llvm::Function const& func;
-	
-	Interpreter(FunctionInput const& input);
-	
+
+	Interpreter(FunctionStateTemplate const& stateTemplate, FunctionInput const& input);
+
 	Interpreter& executeNextInstruction(void);
-	
+
+	// Executes instructions until the function returns or the execution can't
+	// continue. At most 'maxSteps' are executed if it is not zero. The
+	// observer is notified of every executed instruction and every entered
+	// block. Returns ExecutionStatus::stepLimit if the limit has been hit.
+	ExecutionStatus run(
+			llreve::interpreter::TraceObserver& observer,
+			unsigned long const                 maxSteps = 0);
+
+	// Same as above, the executed instructions are appended to the trace
+	ExecutionTrace& run(ExecutionTrace& trace, unsigned long const maxSteps = 0);
+
+	ExecutionStatus getStatus(void) const;
+
 	// Provides the current state
 	FunctionState const& getState(void) const;
-	
+
+	// Only valid if the status is ExecutionStatus::returned and the function
+	// is not void
+	llvm::APInt const& getReturnValue(void) const;
+
 	// Provide the instructions that caused the current state and that will be
 	// executed in this state
 	llvm::Instruction const* getRecentInstruction(void) const;
 	llvm::Instruction const* getNextInstruction  (void) const;
-	
+
 	private:
-	
-	llvm::Instruction const* pRecentInst;
-	llvm::Instruction const* pNextInst;
-	FunctionState     const* pCurrentState;
-	
-	Integer& resolveValue(llvm::Value const* pVal);
-	
+
+	FunctionStateTemplate const& stateTemplate;
+	FunctionState                state;
+	ExecutionStatus              status;
+	unsigned int                 recentSlot;
+	unsigned int                 nextSlot;
+	// The slot of the first instruction of the current block
+	unsigned int                 blockBegin;
+	llvm::APInt                  returnValue;
+	// The values of the phi nodes of the current block are computed at once
+	// when the block is entered
+	std::vector<llvm::APInt>     phiValues;
+	// Only set while run() is executing
+	llreve::interpreter::TraceObserver* pObserver;
+
+	llvm::APInt const* resolveOperand(unsigned int const index);
+
+	void jumpTo(llvm::BasicBlock const& block);
+
 	// There is special function for every instruction type
-	void executeBinaryOperator(void);
-	void executeBranchInst(void);
-	void executePHINode(void);
+	void executeBinaryOperator(llvm::BinaryOperator const& inst);
+	void executeCmpInst(llvm::ICmpInst const& inst);
+	void executeCastInst(llvm::CastInst const& inst);
+	void executeSelectInst(void);
+	void executeCallInst(llvm::CallInst const& inst);
+	void executeBranchInst(llvm::BranchInst const& inst);
+	void executeSwitchInst(llvm::SwitchInst const& inst);
+	void executeReturnInst(llvm::ReturnInst const& inst);
+	void executePHINode(llvm::PHINode const& inst);
 };
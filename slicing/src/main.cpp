@@ -14,14 +14,21 @@
 
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/IRPrintingPasses.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Scalar.h"
 
 
 #include "util/FileOperations.h"
 #include "slicingMethods/BruteForce.h"
+#include "slicingMethods/DeltaDebugging.h"
+#include "slicingMethods/DRMSlicing.h"
+#include "slicingMethods/MultiCriterionSlicing.h"
+#include "slicingMethods/SyntacticBruteForce.h"
 #include "slicingMethods/SyntacticSlicing.h"
 #include "core/SliceCandidateValidation.h"
+#include "smtSolver/SmtSolver.h"
+#include "util/SlicingStatistics.h"
 
 
 using namespace std;
@@ -29,6 +36,9 @@ using namespace llvm;
 
 void store(string fileName, Module& module);
 void parseArgs(int argc, const char **argv);
+SlicingMethodPtr createMethod(ModulePtr program, raw_ostream* progress);
+void writeStatistics();
+int sliceAllOutputs(ModulePtr program, SmtSolverPtr solver);
 
 
 static llvm::cl::OptionCategory ClangCategory("Clang options",
@@ -41,11 +51,14 @@ static llvm::cl::opt<std::string> FileName(llvm::cl::Positional,
 	llvm::cl::desc("<input file>"),
 	llvm::cl::Required);
 
-enum SlicingMethodOptions{syntactic, bruteforce};
+enum SlicingMethodOptions{syntactic, bruteforce, syntacticbruteforce, drm, ddmin};
 static cl::opt<SlicingMethodOptions> SlicingMethodOption(cl::desc("Choose slicing method:"),
 	cl::values(
 		clEnumVal(syntactic , "Classical syntactic slicing, folowd by verification of the slice."),
 		clEnumVal(bruteforce, "Bruteforce all slicecandidates, returns smalest."),
+		clEnumVal(syntacticbruteforce, "Bruteforce only the instructions kept by the syntactic slice, returns smalest."),
+		clEnumVal(drm       , "Slice using the transitive closure of the dependence matrix, folowd by verification of the slice."),
+		clEnumVal(ddmin     , "Remove basic blocks, then ever smaller sets of instructions, as long as the slice stays valid."),
 		clEnumValEnd),
 	llvm::cl::cat(SlicingCategory),
 	llvm::cl::Required);
@@ -56,6 +69,51 @@ static llvm::cl::opt<bool,true> CriterionPresentFlag("criterion-present", llvm::
 static llvm::cl::alias     CriterionPresentShort("p", cl::desc("Alias for -criterion-present"),
     cl::aliasopt(CriterionPresentFlag), llvm::cl::cat(SlicingCategory));
 
+static llvm::cl::opt<bool> AllOutputsFlag("all-outputs",
+	llvm::cl::desc("Slice the program for every call of __criterion and for the return value in one session instead of a single criterion. The slices are written to slice.<n>.llvm."),
+	llvm::cl::cat(SlicingCategory));
+static llvm::cl::opt<unsigned> OutputJobsFlag("output-jobs",
+	llvm::cl::desc("Number of outputs that are sliced concurrently with -all-outputs, defaults to the number of cores."),
+	llvm::cl::init(0), llvm::cl::cat(SlicingCategory));
+
+static cl::opt<SmtSolverBackend> SolverFlag("solver",
+	cl::desc("Choose the solver that validates the slice candidates:"),
+	cl::values(
+		clEnumValN(SmtSolverBackend::eldarica, "eldarica", "Start Eldarica (eld) for every query."),
+		clEnumValN(SmtSolverBackend::eldaricaServer, "eldarica-server", "Keep a pool of long-lived Eldarica servers (eld-server)."),
+		clEnumValN(SmtSolverBackend::z3, "z3", "Start z3 with the spacer engine for every query."),
+		clEnumValN(SmtSolverBackend::z3Library, "z3-lib", "Pass the queries to the z3 library inside this process without writing them to files."),
+		clEnumValEnd),
+	cl::init(SmtSolverBackend::eldarica), llvm::cl::cat(SlicingCategory));
+static llvm::cl::opt<bool> SolverPoolFlag("solver-pool",
+	llvm::cl::desc("Alias for -solver=eldarica-server"),
+	llvm::cl::cat(SlicingCategory));
+static llvm::cl::opt<unsigned> SolverWorkersFlag("solver-workers",
+	llvm::cl::desc("Number of queries the solver checks at the same time, 0 means no limit. For the Eldarica servers and the z3 library it is the number of workers and defaults to the number of cores."),
+	llvm::cl::init(0), llvm::cl::cat(SlicingCategory));
+static llvm::cl::opt<string> EldaricaPathFlag("eldarica",
+	llvm::cl::desc("Path to Eldarica"), llvm::cl::init("eld"),
+	llvm::cl::cat(SlicingCategory));
+static llvm::cl::opt<string> EldaricaServerPathFlag("eldarica-server",
+	llvm::cl::desc("Path to the Eldarica server"), llvm::cl::init("eld-server"),
+	llvm::cl::cat(SlicingCategory));
+static llvm::cl::opt<string> Z3PathFlag("z3",
+	llvm::cl::desc("Path to z3"), llvm::cl::init("z3"),
+	llvm::cl::cat(SlicingCategory));
+
+static llvm::cl::opt<unsigned> ValidationJobsFlag("validation-jobs",
+	llvm::cl::desc("Number of slice candidates of the same size that bruteforce validates concurrently, defaults to the number of cores."),
+	llvm::cl::init(0), llvm::cl::cat(SlicingCategory));
+
+static llvm::cl::opt<unsigned, true> TestSamplesFlag("test-samples",
+	llvm::cl::desc("Number of random inputs on which slice candidates are interpreted before they are validated by the solver, 0 disables this test."),
+	llvm::cl::location(ValidationTestSamples), llvm::cl::init(CounterExampleCache::defaultSampleCount),
+	llvm::cl::cat(SlicingCategory));
+
+static llvm::cl::opt<string> StatsFileFlag("stats",
+	llvm::cl::desc("Write the time spent in the phases of the slicing session, the solver latencies and cache hit rates as JSON to this file."),
+	llvm::cl::cat(SlicingCategory));
+
 static llvm::cl::list<string> Includes("I", llvm::cl::desc("Include path"),
 	llvm::cl::cat(ClangCategory));
 
@@ -74,9 +132,85 @@ void parseArgs(int argc, const char **argv) {
 	llvm::cl::ParseCommandLineOptions(argc, argv);
 }
 
+SlicingMethodPtr createMethod(ModulePtr program, raw_ostream* progress) {
+	SlicingMethodPtr method;
+	switch (SlicingMethodOption) {
+		case syntactic:
+		method = shared_ptr<SlicingMethod>(new SyntacticSlicing(program));
+		break;
+		case bruteforce:
+		method = shared_ptr<SlicingMethod>(new BruteForce(program, progress, ValidationJobsFlag));
+		break;
+		case syntacticbruteforce:
+		method = shared_ptr<SlicingMethod>(new SyntacticBruteForce(program, progress, ValidationJobsFlag));
+		break;
+		case drm:
+		method = shared_ptr<SlicingMethod>(new DRMSlicing(program));
+		break;
+		case ddmin:
+		method = shared_ptr<SlicingMethod>(new DeltaDebugging(program));
+		break;
+	}
+	return method;
+}
+
+void writeStatistics() {
+	if (!StatsFileFlag.empty()) {
+		std::error_code errorCode;
+		llvm::raw_fd_ostream statsStream(StatsFileFlag, errorCode, llvm::sys::fs::OpenFlags::F_None);
+		if (errorCode) {
+			outs() << "ERROR: Could not write statistics to " << StatsFileFlag << "\n";
+		} else {
+			SlicingStatistics::getInstance().printJSON(statsStream);
+		}
+	}
+}
+
+/**
+ * Slices the program for all outputs, the progress of bruteforce is not
+ * printed since the outputs are sliced concurrently.
+ */
+int sliceAllOutputs(ModulePtr program, SmtSolverPtr solver) {
+	MultiCriterionSlicing slicing(program,
+		[](ModulePtr variant) { return createMethod(variant, nullptr); },
+		solver, OutputJobsFlag);
+	vector<string> outputs = slicing.getOutputs();
+	if (outputs.empty()) {
+		outs() << "ERROR: The program has neither a criterion nor a return value! \n";
+		exit(1);
+	}
+
+	vector<ModulePtr> slices = slicing.computeSlices(outs());
+	writeStatistics();
+
+	writeModuleToFile("program.llvm", *program);
+	for (unsigned i = 0; i < slices.size(); i++) {
+		string fileName = "slice." + to_string(i + 1) + ".llvm";
+		if (!slices[i]) {
+			outs() << "An error occured. Could not produce slice for the " << outputs[i] << ". \n";
+		} else {
+			writeModuleToFile(fileName, *slices[i]);
+			outs() << "See " << fileName << " for the slice for the " << outputs[i] << " \n";
+		}
+	}
+	return 0;
+}
+
 int main(int argc, const char **argv) {
 	parseArgs(argc, argv);
+	SmtSolverOptions solverOptions;
+	solverOptions.backend = SolverPoolFlag ? SmtSolverBackend::eldaricaServer : SolverFlag;
+	solverOptions.eldaricaPath = EldaricaPathFlag;
+	solverOptions.eldaricaServerPath = EldaricaServerPathFlag;
+	solverOptions.z3Path = Z3PathFlag;
+	solverOptions.workers = SolverWorkersFlag;
+	// All candidates are validated by this solver, the slicing methods may
+	// use it from several threads
+	SmtSolverPtr solver = createSmtSolver(solverOptions);
 	ModulePtr program = getModuleFromSource(FileName, ResourceDir, Includes);
+	if (AllOutputsFlag) {
+		return sliceAllOutputs(program, solver);
+	}
 
 	CriterionPtr criterion;
 	CriterionPtr presentCriterion = shared_ptr<Criterion>(new PresentCriterion());
@@ -94,18 +228,12 @@ int main(int argc, const char **argv) {
 	}
 
 
-	SlicingMethodPtr method;
-	switch (SlicingMethodOption) {
-		case syntactic:
-		method = shared_ptr<SlicingMethod>(new SyntacticSlicing(program));
-		break;
-		case bruteforce:
-		method = shared_ptr<SlicingMethod>(new BruteForce(program));
-		break;
-	}
-
+	SlicingMethodPtr method = createMethod(program, &llvm::outs());
+	method->setSolver(solver);
 	ModulePtr slice = method->computeSlice(criterion);
 
+	writeStatistics();
+
 	if (!slice){
 		outs() << "An error occured. Could not produce slice. \n";
 	} else {
@@ -15,22 +15,57 @@
 
 #include "util/LambdaFunctionPass.h"
 #include "core/Util.h"
+#include "core/SliceFeasibility.h"
 #include "core/SlicingPass.h"
 #include "util/misc.h"
+#include "util/SlicingStatistics.h"
 #include <iostream>
 #include <bitset>
+#include <thread>
+#include <unordered_set>
 
 #include "core/SliceCandidateValidation.h"
 
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
 
 using namespace std;
 using namespace llvm;
 
-BruteForce::BruteForce(ModulePtr program, llvm::raw_ostream* ostream):SlicingMethod(program),ostream_(ostream){
+BruteForce::BruteForce(ModulePtr program, llvm::raw_ostream* ostream, unsigned jobs):SlicingMethod(program),ostream_(ostream),jobs_(jobs){
 	callsToReve_ = 0;
 	numberOfTries_ = 0;
+	if (jobs_ == 0) {
+		jobs_ = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+namespace {
+struct PendingValidation {
+	// The candidate module is consumed by the validation, so it is rebuilt
+	// from its pattern if it turns out to be valid
+	vector<bool> pattern;
+	int sliced;
+	SatCheck check;
+};
+}
+
+static const std::chrono::milliseconds ValidationPollInterval(10);
+
+/**
+ * Blocks until one of the validations has finished and returns it.
+ */
+static vector<PendingValidation>::iterator waitForValidation(vector<PendingValidation>& pending) {
+	assert(!pending.empty());
+	while (true) {
+		for (auto it = pending.begin(); it != pending.end(); ++it) {
+			if (it->check.result.wait_for(std::chrono::milliseconds::zero()) == std::future_status::ready) {
+				return it;
+			}
+		}
+		std::this_thread::sleep_for(ValidationPollInterval);
+	}
 }
 
 shared_ptr<Module> BruteForce::computeSlice(CriterionPtr c) {
@@ -41,8 +76,24 @@ shared_ptr<Module> BruteForce::computeSlice(CriterionPtr c) {
 		numInstructions++;
 	});
 
+	// Only the instructions that are not sliced anyway are enumerated
+	vector<bool> alwaysSliced = initiallySliced(*program, c);
+	assert(alwaysSliced.size() == numInstructions);
+	vector<unsigned> freeInstructions;
+	for (unsigned i = 0; i < numInstructions; i++) {
+		if (!alwaysSliced[i]) {
+			freeInstructions.push_back(i);
+		}
+	}
+
 	ModulePtr bestCandidate = shared_ptr<Module>(nullptr);
 	int maxSliced = -1;
+	// The program is only preprocessed once for all candidates. Most
+	// candidates are already rejected by the tests of the session.
+	ValidationSession session(&*program, c, getSolver());
+	// Patterns that leave unsliced instructions are mostly recognized before
+	// the program is cloned and sliced
+	SliceFeasibility feasibility(*program, *c);
 
 	if (ostream_) {
 		*ostream_ << "|--------------------|\n";
@@ -52,15 +103,42 @@ shared_ptr<Module> BruteForce::computeSlice(CriterionPtr c) {
 
 	int progress = 0;
 
-	unsigned maxIterations = 1 << numInstructions;
+	unsigned maxIterations = 1 << freeInstructions.size();
 	float step = maxIterations / 20.f;
 
 	numberOfPossibleTries_ = maxIterations;
 	numberOfTries_ = 0;
 	callsToReve_ = 0;
 
+	// All candidates with the same number of sliced instructions are
+	// independent, so up to jobs_ of them are validated at the same time.
+	// Any valid candidate of the first level that has one is a largest slice.
+	vector<PendingValidation> pending;
+	// Different patterns can lead to the same candidate, e.g. the slicing pass
+	// also removes branches that are not marked if their block becomes empty.
+	// A candidate that is refuted for one pattern is refuted for all of them,
+	// so every distinct candidate is only validated once.
+	unordered_set<string> submittedCandidates;
+	auto finishValidation = [&](vector<PendingValidation>::iterator it) {
+		ValidationResult isValid = SliceCandidateValidation::toValidationResult(it->check.result.get());
+		vector<bool> pattern = it->pattern;
+		int sliced = it->sliced;
+		pending.erase(it);
+		if (isValid == ValidationResult::valid && !bestCandidate) {
+			maxSliced = sliced;
+			bestCandidate = createCandidate(*program, *c, pattern, nullptr);
+			for (PendingValidation& other : pending) {
+				other.check.cancel();
+			}
+			for (PendingValidation& other : pending) {
+				other.check.result.wait();
+			}
+			pending.clear();
+		}
+	};
+
 	int iterations = 0;
-	for_each_pattern(numInstructions, [&](const vector<bool>& pattern, bool* done){
+	for_each_pattern(freeInstructions.size(), [&](const vector<bool>& freePattern, bool* done){
 		if ((progress * step) < iterations) {
 			progress++;
 			if (ostream_) {
@@ -69,38 +147,50 @@ shared_ptr<Module> BruteForce::computeSlice(CriterionPtr c) {
 			}
 		}
 
-		ModulePtr sliceCandidate = CloneModule(&*program);
-		int sliced = 0;
-		unsigned instructionCounter = 0;
-
-		for_each_relevant_instruction(*sliceCandidate, *c, [&](Instruction& instruction){
-			if (pattern[instructionCounter]) {
-				SlicingPass::toBeSliced(instruction);
-				sliced++;
-			}
-			instructionCounter++;
-		});
+		vector<bool> pattern = alwaysSliced;
+		for (unsigned i = 0; i < freeInstructions.size(); i++) {
+			pattern[freeInstructions[i]] = freePattern[i];
+		}
 
-		//Will be deleted from pass manager!
-		SlicingPass* slicingPass = new SlicingPass();
-		llvm::legacy::PassManager PM;
-		PM.add(slicingPass);
-		PM.run(*sliceCandidate);
+		int sliced = 0;
+		ModulePtr sliceCandidate;
+		bool infeasible = feasibility.isInfeasible(pattern);
+		SlicingStatistics::getInstance().addFeasibilityCheck(infeasible);
+		if (!infeasible) {
+			sliceCandidate = createCandidate(*program, *c, pattern, &sliced);
+		}
 
-		if (!slicingPass->hasUnSlicedInstructions()) {
+		if (sliceCandidate) {
 			assert(sliced >= maxSliced && "InternalError: The first valid slice should be the largest!");
-			callsToReve_++;
 
-			ValidationResult isValid = SliceCandidateValidation::validate(&*program, &*sliceCandidate, c);
-			if (isValid == ValidationResult::valid) {
-				maxSliced = sliced;
-				bestCandidate = sliceCandidate;
+			while (pending.size() >= jobs_) {
+				finishValidation(waitForValidation(pending));
+			}
+			if (bestCandidate) {
 				*done = true;
+			} else {
+				string candidateText;
+				raw_string_ostream candidateStream(candidateText);
+				sliceCandidate->print(candidateStream, nullptr);
+				bool isNew = submittedCandidates.insert(candidateStream.str()).second;
+				SlicingStatistics::getInstance().addCandidateCacheLookup(!isNew);
+				if (isNew) {
+					callsToReve_++;
+					SatCheck check = session.validateAsync(sliceCandidate);
+					pending.push_back({pattern, sliced, check});
+				}
 			}
 		}
 
 		numberOfTries_++;
 		iterations++;
+	}, [&](bool* done){
+		while (!pending.empty()) {
+			finishValidation(waitForValidation(pending));
+		}
+		if (bestCandidate) {
+			*done = true;
+		}
 	});
 
 	if (ostream_) {
@@ -111,7 +201,16 @@ shared_ptr<Module> BruteForce::computeSlice(CriterionPtr c) {
 	return bestCandidate;
 }
 
-void BruteForce::for_each_pattern(unsigned numInstructions, std::function<void (vector<bool>& pattern, bool* done)> lambda) {
+vector<bool> BruteForce::initiallySliced(Module& program, CriterionPtr criterion) {
+	unsigned numInstructions = 0;
+	for_each_relevant_instruction(program, *criterion, [&numInstructions](Instruction& instruction){
+		numInstructions++;
+	});
+	return vector<bool>(numInstructions, false);
+}
+
+void BruteForce::for_each_pattern(unsigned numInstructions, std::function<void (vector<bool>& pattern, bool* done)> lambda,
+	std::function<void (bool* done)> endOfLevel) {
 	vector<bool> pattern(numInstructions, true);
 	bool done = false;
 
@@ -127,28 +226,12 @@ void BruteForce::for_each_pattern(unsigned numInstructions, std::function<void (
 				break;
 		} while (std::next_permutation(pattern.begin(), pattern.end()));
 
+		endOfLevel(&done);
 		if (done)
 			break;
 	}
 }
 
-void BruteForce::for_each_relevant_instruction(Module& program,
-	Criterion& criterion, std::function<void (llvm::Instruction& instruction)> lambda) {
-	set<Instruction*> criterionInstructions = criterion.getInstructions(program);
-
-
-	for (Function& function: program) {
-		if (!Util::isSpecialFunction(function)) {
-			for(Instruction& instruction : Util::getInstructions(function)) {
-				const bool isCriterion = criterionInstructions.find(&instruction) != criterionInstructions.end();
-				if (!isCriterion) {
-					lambda(instruction);
-				}
-			}
-		}
-	}
-}
-
 unsigned BruteForce::getNumberOfReveCalls(){
 	return callsToReve_;
 }
@@ -22,20 +22,33 @@ public:
 	/**
 	 * @param program to slice
 	 * @param ostream target for progress output. Use nullptr to supress progress printing.
+	 * @param jobs number of candidates of the same size that are validated
+	 * concurrently, zero means one per core.
 	 */
-	BruteForce(ModulePtr program, llvm::raw_ostream* ostream = &llvm::outs());
+	BruteForce(ModulePtr program, llvm::raw_ostream* ostream = &llvm::outs(), unsigned jobs = 0);
 	virtual ModulePtr computeSlice(CriterionPtr c) override;
 	unsigned getNumberOfReveCalls();
 	unsigned getNumberOfTries();
 	unsigned getNumberOfPossibleTries();
 
+protected:
+	/**
+	 * Returns which relevant instructions are removed in every candidate, only
+	 * the others are enumerated. By default no instruction is fixed.
+	 */
+	virtual std::vector<bool> initiallySliced(llvm::Module& program, CriterionPtr criterion);
+
 private:
 	llvm::raw_ostream* ostream_;
+	unsigned jobs_;
 	unsigned callsToReve_;
 	unsigned numberOfTries_;
 	unsigned numberOfPossibleTries_;
 
-	void for_each_relevant_instruction(llvm::Module& program, Criterion& criterion,
-		std::function<void (llvm::Instruction& instruction)> lambda);
-	void for_each_pattern(unsigned numInstructions, std::function<void (std::vector<bool>& pattern, bool* done)> lambda);
+	/**
+	 * Patterns are enumerated by increasing number of zeros, endOfLevel is
+	 * called after all patterns with the same number of zeros.
+	 */
+	void for_each_pattern(unsigned numInstructions, std::function<void (std::vector<bool>& pattern, bool* done)> lambda,
+		std::function<void (bool* done)> endOfLevel);
 };
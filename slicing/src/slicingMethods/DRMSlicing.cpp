@@ -0,0 +1,50 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "DRMSlicing.h"
+
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "core/DependencyGraphPasses.h"
+#include "core/SlicingPass.h"
+#include "core/SliceCandidateValidation.h"
+#include "dynamic/DRMSlicePass.h"
+
+using namespace std;
+using namespace llvm;
+
+shared_ptr<Module> DRMSlicing::computeSlice(CriterionPtr criterion) {
+	ModulePtr result = shared_ptr<Module>(nullptr);
+
+	ModulePtr program = getProgram();
+	ModulePtr sliceCandidate = CloneModule(&*program);
+
+	llvm::legacy::PassManager PM;
+	PM.add(new llvm::PostDominatorTree());
+	PM.add(new CDGPass());
+	PM.add(new DDGPass());
+	PM.add(new PDGPass());
+	PM.add(new DRMSlicePass(criterion));
+	PM.add(new SlicingPass());
+	PM.run(*sliceCandidate);
+
+	ValidationResult valid = SliceCandidateValidation::validate(&*program, &*sliceCandidate, criterion,
+		nullptr, getSolver());
+	if (valid == ValidationResult::valid) {
+		result = sliceCandidate;
+		messages() << "The produced DRM slice was verified by reve. \n";
+	} else if (valid == ValidationResult::invalid) {
+		messages() << "The produced DRM slice is not valid! \n";
+	} else {
+		messages() << "Could not verify the validity! \n";
+	}
+
+	return result;
+}
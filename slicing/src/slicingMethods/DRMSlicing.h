@@ -0,0 +1,20 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SlicingMethod.h"
+
+class DRMSlicing: public SlicingMethod {
+public:
+	DRMSlicing(ModulePtr program):SlicingMethod(program){}
+	virtual ModulePtr computeSlice(CriterionPtr c) override;
+
+};
@@ -0,0 +1,125 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "DeltaDebugging.h"
+
+#include "core/SliceCandidateValidation.h"
+
+#include <map>
+
+using namespace std;
+using namespace llvm;
+
+DeltaDebugging::DeltaDebugging(ModulePtr program, llvm::raw_ostream* ostream):SlicingMethod(program),ostream_(ostream){
+	callsToReve_ = 0;
+}
+
+bool DeltaDebugging::tryRemove(ValidationSession& session, Criterion& criterion,
+	vector<bool>& removed, const vector<unsigned>& chunk) {
+	vector<bool> pattern = removed;
+	for (unsigned index : chunk) {
+		pattern[index] = true;
+	}
+
+	ModulePtr sliceCandidate = createCandidate(*getProgram(), criterion, pattern, nullptr);
+	if (!sliceCandidate) {
+		return false;
+	}
+
+	callsToReve_++;
+	if (session.validate(sliceCandidate) != ValidationResult::valid) {
+		return false;
+	}
+
+	removed = pattern;
+	if (ostream_) {
+		*ostream_ << "=";
+		ostream_->flush();
+	}
+	return true;
+}
+
+shared_ptr<Module> DeltaDebugging::computeSlice(CriterionPtr c) {
+	ModulePtr program = getProgram();
+	callsToReve_ = 0;
+
+	// The relevant instructions grouped by their basic block, in program order
+	vector<vector<unsigned>> blocks;
+	map<BasicBlock*, unsigned> blockIndices;
+	unsigned numInstructions = 0;
+	for_each_relevant_instruction(*program, *c, [&](Instruction& instruction){
+		auto it = blockIndices.insert({instruction.getParent(), blocks.size()});
+		if (it.second) {
+			blocks.emplace_back();
+		}
+		blocks[it.first->second].push_back(numInstructions++);
+	});
+
+	ValidationSession session(&*program, c, getSolver());
+	vector<bool> removed(numInstructions, false);
+
+	if (ostream_) {
+		*ostream_ << "|";
+		ostream_->flush();
+	}
+
+	for (const vector<unsigned>& block : blocks) {
+		tryRemove(session, *c, removed, block);
+	}
+
+	vector<unsigned> remaining;
+	for (unsigned i = 0; i < numInstructions; i++) {
+		if (!removed[i]) {
+			remaining.push_back(i);
+		}
+	}
+
+	size_t granularity = 2;
+	while (!remaining.empty()) {
+		granularity = std::min(granularity, remaining.size());
+		size_t chunkSize = (remaining.size() + granularity - 1) / granularity;
+		bool progress = false;
+
+		for (size_t start = 0; start < remaining.size(); start += chunkSize) {
+			vector<unsigned> chunk(remaining.begin() + start,
+				remaining.begin() + std::min(start + chunkSize, remaining.size()));
+			if (tryRemove(session, *c, removed, chunk)) {
+				progress = true;
+			}
+		}
+
+		if (progress) {
+			vector<unsigned> stillRemaining;
+			for (unsigned index : remaining) {
+				if (!removed[index]) {
+					stillRemaining.push_back(index);
+				}
+			}
+			remaining = stillRemaining;
+			granularity = std::max<size_t>(granularity - 1, 2);
+		} else if (chunkSize == 1) {
+			break;
+		} else {
+			granularity *= 2;
+		}
+	}
+
+	if (ostream_) {
+		*ostream_ << "|\n";
+		ostream_->flush();
+	}
+
+	// The validated candidates have been consumed by the session
+	return createCandidate(*program, *c, removed, nullptr);
+}
+
+unsigned DeltaDebugging::getNumberOfReveCalls(){
+	return callsToReve_;
+}
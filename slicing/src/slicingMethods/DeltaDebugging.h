@@ -0,0 +1,49 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SlicingMethod.h"
+#include "llvm/Support/raw_ostream.h"
+#include "core/Criterion.h"
+
+#include <vector>
+
+class ValidationSession;
+
+/**
+ * Searches a slice like ddmin: First whole basic blocks are removed, then
+ * the remaining instructions are split into chunks, which are removed if the
+ * candidate stays valid. The chunks are refined until they consist of single
+ * instructions. This needs a polynomial number of validations, in contrast to
+ * brute force the result is only minimal with respect to removing a single
+ * further instruction.
+ */
+class DeltaDebugging: public SlicingMethod {
+public:
+	/**
+	 * @param program to slice
+	 * @param ostream target for progress output. Use nullptr to supress progress printing.
+	 */
+	DeltaDebugging(ModulePtr program, llvm::raw_ostream* ostream = &llvm::outs());
+	virtual ModulePtr computeSlice(CriterionPtr c) override;
+	unsigned getNumberOfReveCalls();
+
+private:
+	llvm::raw_ostream* ostream_;
+	unsigned callsToReve_;
+
+	/**
+	 * Removes the instructions in chunk in addition to the ones in removed if
+	 * the resulting candidate is valid.
+	 */
+	bool tryRemove(ValidationSession& session, Criterion& criterion,
+		std::vector<bool>& removed, const std::vector<unsigned>& chunk);
+};
@@ -0,0 +1,161 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "MultiCriterionSlicing.h"
+
+#include "core/Util.h"
+#include "util/misc.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+using namespace llvm;
+
+/** The calls of __criterion in the order of the module */
+static vector<CallInst*> criterionCalls(Module& module) {
+	vector<CallInst*> calls;
+	for (Function& function: module) {
+		if (!Util::isSpecialFunction(function)) {
+			for (Instruction& instruction: Util::getInstructions(function)) {
+				if (CallInst* callInst = dyn_cast<CallInst>(&instruction)) {
+					if ((callInst->getCalledFunction() != nullptr) &&
+						(callInst->getCalledFunction()->getName() == Criterion::FUNCTION_NAME)) {
+						calls.push_back(callInst);
+					}
+				}
+			}
+		}
+	}
+	return calls;
+}
+
+/** Whether the return value criterion can be used for the module */
+static bool hasReturnValue(Module& module) {
+	unsigned functions = 0;
+	bool returnsValue = false;
+	for (Function& function: module) {
+		if (!Util::isSpecialFunction(function)) {
+			functions++;
+			returnsValue = !function.getReturnType()->isVoidTy();
+		}
+	}
+	return functions == 1 && returnsValue;
+}
+
+MultiCriterionSlicing::MultiCriterionSlicing(ModulePtr program,
+	MethodFactory createMethod, SmtSolverPtr solver, unsigned jobs):
+	program(program), createMethod(createMethod), solver(solver), jobs(jobs) {
+
+	unsigned calls = criterionCalls(*program).size();
+	for (unsigned i = 0; i < calls; i++) {
+		outputs.push_back({static_cast<int>(i),
+			"call " + to_string(i + 1) + " of " + Criterion::FUNCTION_NAME});
+	}
+	if (hasReturnValue(*program)) {
+		outputs.push_back({-1, "return value"});
+	}
+
+	raw_svector_ostream stream(bitcode);
+	WriteBitcodeToFile(&*program, stream);
+}
+
+MultiCriterionSlicing::~MultiCriterionSlicing() = default;
+
+vector<string> MultiCriterionSlicing::getOutputs() const {
+	vector<string> descriptions;
+	for (const Output& output: outputs) {
+		descriptions.push_back(output.description);
+	}
+	return descriptions;
+}
+
+vector<ModulePtr> MultiCriterionSlicing::computeSlices(raw_ostream& messages) {
+	vector<ModulePtr> slices(outputs.size());
+	vector<string> outputMessages(outputs.size());
+	contexts.resize(outputs.size());
+	for (unique_ptr<LLVMContext>& context: contexts) {
+		if (!context) {
+			context.reset(new LLVMContext());
+		}
+	}
+
+	unsigned workers = jobs ? jobs : max(1u, thread::hardware_concurrency());
+	workers = min(workers, static_cast<unsigned>(outputs.size()));
+	atomic<unsigned> nextOutput(0);
+	auto work = [&]() {
+		for (unsigned output = nextOutput++; output < outputs.size();
+			output = nextOutput++) {
+			raw_string_ostream stream(outputMessages[output]);
+			slices[output] = sliceOutput(output, *contexts[output], stream);
+		}
+	};
+
+	vector<thread> threads;
+	for (unsigned i = 1; i < workers; i++) {
+		threads.emplace_back(work);
+	}
+	work();
+	for (thread& worker: threads) {
+		worker.join();
+	}
+
+	for (unsigned output = 0; output < outputs.size(); output++) {
+		messages << "Slice " << output + 1 << " (" << outputs[output].description
+			<< "): " << outputMessages[output];
+	}
+	return slices;
+}
+
+ModulePtr MultiCriterionSlicing::sliceOutput(unsigned output,
+	LLVMContext& context, raw_ostream& messages) {
+	auto parsed = parseBitcodeFile(MemoryBufferRef(
+		StringRef(bitcode.data(), bitcode.size()),
+		program->getModuleIdentifier()), context);
+	if (!parsed) {
+		messages << "Could not copy the program: "
+			<< toString(parsed.takeError()) << "\n";
+		return ModulePtr(nullptr);
+	}
+	ModulePtr variant = std::move(parsed.get());
+
+	const int call = outputs[output].call;
+	vector<CallInst*> calls = criterionCalls(*variant);
+	for (unsigned i = 0; i < calls.size(); i++) {
+		if (static_cast<int>(i) != call) {
+			// __criterion may return its argument (see slicing_marks.h)
+			if (!calls[i]->use_empty() && calls[i]->getNumArgOperands() > 0 &&
+				calls[i]->getArgOperand(0)->getType() == calls[i]->getType()) {
+				calls[i]->replaceAllUsesWith(calls[i]->getArgOperand(0));
+			}
+			if (calls[i]->use_empty()) {
+				calls[i]->eraseFromParent();
+			}
+		}
+	}
+	CriterionPtr criterion = call < 0 ? Criterion::getReturnValueCriterion()
+		: CriterionPtr(new PresentCriterion());
+
+	SlicingMethodPtr method = createMethod(variant);
+	method->setSolver(solver);
+	method->setMessageStream(&messages);
+	ModulePtr slice = method->computeSlice(criterion);
+	if (!slice) {
+		messages << "Could not produce slice.\n";
+	}
+	return slice;
+}
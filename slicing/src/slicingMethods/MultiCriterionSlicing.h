@@ -0,0 +1,76 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "SlicingMethod.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/LLVMContext.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Slices a program for all of its outputs in one session: every call of
+ * __criterion and the return value if there is a single non-void function.
+ * The program is compiled and preprocessed only once and all slices are
+ * validated by the same solver.
+ *
+ * Every call of __criterion is part of the proof obligation, so the slice for
+ * one call is computed on a variant of the program without the other calls,
+ * the slice for the return value on a variant without any of them. A context
+ * must not be used by several threads, hence every variant is parsed from the
+ * bitcode of the program into its own context and the outputs are sliced
+ * concurrently.
+ */
+class MultiCriterionSlicing {
+public:
+	/** Creates the method that slices the variant of one output */
+	typedef std::function<SlicingMethodPtr (ModulePtr program)> MethodFactory;
+
+	/**
+	 * At most jobs outputs are sliced at the same time, 0 means the number
+	 * of cores.
+	 */
+	MultiCriterionSlicing(ModulePtr program, MethodFactory createMethod,
+		SmtSolverPtr solver, unsigned jobs = 0);
+	~MultiCriterionSlicing();
+
+	/** Describes the outputs, e.g. "return value" */
+	std::vector<std::string> getOutputs() const;
+	/**
+	 * Returns the slices in the order of getOutputs(), nullptr for outputs
+	 * that could not be sliced. The messages of the slicing methods are
+	 * written to 'messages' once all outputs are sliced. The slices belong to
+	 * contexts owned by this object and must not outlive it.
+	 */
+	std::vector<ModulePtr> computeSlices(llvm::raw_ostream& messages);
+
+private:
+	struct Output {
+		/** The index of the call of __criterion, -1 for the return value */
+		int call;
+		std::string description;
+	};
+
+	ModulePtr sliceOutput(unsigned output, llvm::LLVMContext& context,
+		llvm::raw_ostream& messages);
+
+	ModulePtr program;
+	MethodFactory createMethod;
+	SmtSolverPtr solver;
+	unsigned jobs;
+	std::vector<Output> outputs;
+	llvm::SmallVector<char, 0> bitcode;
+	std::vector<std::unique_ptr<llvm::LLVMContext>> contexts;
+};
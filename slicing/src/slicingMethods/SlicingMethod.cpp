@@ -10,6 +10,13 @@
 
 #include "SlicingMethod.h"
 
+#include "core/SlicingPass.h"
+#include "core/Util.h"
+#include "util/misc.h"
+#include "util/SlicingStatistics.h"
+
+#include "llvm/Transforms/Utils/Cloning.h"
+
 using namespace std;
 using namespace llvm;
 
@@ -19,3 +26,68 @@ SlicingMethod::~SlicingMethod() = default;
 shared_ptr<Module> SlicingMethod::getProgram(){
 	return this->program;
 }
+
+void SlicingMethod::setSolver(SmtSolverPtr solver){
+	this->solver = solver;
+}
+
+SmtSolverPtr SlicingMethod::getSolver(){
+	return this->solver;
+}
+
+void SlicingMethod::setMessageStream(raw_ostream* messageStream){
+	this->messageStream = messageStream;
+}
+
+raw_ostream& SlicingMethod::messages(){
+	return *this->messageStream;
+}
+
+ModulePtr SlicingMethod::createCandidate(Module& program, Criterion& criterion,
+	const vector<bool>& pattern, int* sliced) {
+	ModulePtr sliceCandidate;
+	{
+		SlicingStatistics::Timer timer(SlicingPhase::cloneModule);
+		sliceCandidate = CloneModule(&program);
+	}
+	unsigned instructionCounter = 0;
+
+	for_each_relevant_instruction(*sliceCandidate, criterion, [&](Instruction& instruction){
+		if (pattern[instructionCounter]) {
+			SlicingPass::toBeSliced(instruction);
+			if (sliced) {
+				(*sliced)++;
+			}
+		}
+		instructionCounter++;
+	});
+
+	SlicingStatistics::Timer timer(SlicingPhase::slicingPass);
+	//Will be deleted from pass manager!
+	SlicingPass* slicingPass = new SlicingPass();
+	llvm::legacy::PassManager PM;
+	PM.add(slicingPass);
+	PM.run(*sliceCandidate);
+
+	if (slicingPass->hasUnSlicedInstructions()) {
+		return shared_ptr<Module>(nullptr);
+	}
+	return sliceCandidate;
+}
+
+void SlicingMethod::for_each_relevant_instruction(Module& program,
+	Criterion& criterion, std::function<void (llvm::Instruction& instruction)> lambda) {
+	set<Instruction*> criterionInstructions = criterion.getInstructions(program);
+
+
+	for (Function& function: program) {
+		if (!Util::isSpecialFunction(function)) {
+			for(Instruction& instruction : Util::getInstructions(function)) {
+				const bool isCriterion = criterionInstructions.find(&instruction) != criterionInstructions.end();
+				if (!isCriterion) {
+					lambda(instruction);
+				}
+			}
+		}
+	}
+}
@@ -9,9 +9,13 @@
  */
 
 #pragma once
+#include <functional>
 #include <memory>
+#include <vector>
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/raw_ostream.h"
 #include "core/Criterion.h"
+#include "smtSolver/SmtSolver.h"
 
 class SlicingMethod;
 typedef std::shared_ptr<llvm::Module> ModulePtr;
@@ -20,12 +24,44 @@ typedef std::shared_ptr<SlicingMethod> SlicingMethodPtr;
 
 class SlicingMethod {
 public:
-	SlicingMethod(ModulePtr program):program(program){}
+	SlicingMethod(ModulePtr program):program(program),solver(createSmtSolver()),
+		messageStream(&llvm::outs()){}
 	virtual ~SlicingMethod();
 
 	virtual ModulePtr computeSlice(CriterionPtr c) = 0;
 	virtual ModulePtr getProgram();
+	/**
+	 * The solver that validates the candidates, by default Eldarica is
+	 * started for every query. Methods that validate candidates on several
+	 * threads share it between them.
+	 */
+	void setSolver(SmtSolverPtr solver);
+	SmtSolverPtr getSolver();
+	/**
+	 * The stream the method reports the validity of its slice to, outs() by
+	 * default.
+	 */
+	void setMessageStream(llvm::raw_ostream* messageStream);
+
+protected:
+	llvm::raw_ostream& messages();
+	/**
+	 * Calls lambda for every instruction that may be sliced, i.e. all
+	 * instructions of non-special functions that are not part of the
+	 * criterion. The order is the same for a module and its clones.
+	 */
+	void for_each_relevant_instruction(llvm::Module& program, Criterion& criterion,
+		std::function<void (llvm::Instruction& instruction)> lambda);
+	/**
+	 * Slices a copy of the program, pattern[i] tells whether the i-th relevant
+	 * instruction is removed. Returns nullptr if the slicing pass could not
+	 * remove all of them.
+	 */
+	ModulePtr createCandidate(llvm::Module& program, Criterion& criterion,
+		const std::vector<bool>& pattern, int* sliced);
 
 private:
 	ModulePtr program;
+	SmtSolverPtr solver;
+	llvm::raw_ostream* messageStream;
 };
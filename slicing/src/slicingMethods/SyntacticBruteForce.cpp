@@ -0,0 +1,35 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SyntacticBruteForce.h"
+
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "core/InterproceduralSlicePass.h"
+#include "core/SlicingPass.h"
+
+using namespace std;
+using namespace llvm;
+
+vector<bool> SyntacticBruteForce::initiallySliced(Module& program, CriterionPtr criterion) {
+	ModulePtr marked = CloneModule(&program);
+
+	// Only mark the instructions, they are removed per candidate
+	llvm::legacy::PassManager PM;
+	// The per function PDGs are created on demand by the SDG
+	PM.add(new InterproceduralSlicePass(criterion));
+	PM.run(*marked);
+
+	vector<bool> result;
+	for_each_relevant_instruction(*marked, *criterion, [&](Instruction& instruction){
+		result.push_back(SlicingPass::isToBeSliced(instruction));
+	});
+	return result;
+}
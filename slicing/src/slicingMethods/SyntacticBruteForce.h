@@ -0,0 +1,27 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "BruteForce.h"
+
+/**
+ * Brute force search that starts from the syntactic slice. The instructions
+ * that are removed by the syntactic slice stay removed without asking the
+ * solver, only the remaining ones are enumerated.
+ */
+class SyntacticBruteForce: public BruteForce {
+public:
+	SyntacticBruteForce(ModulePtr program, llvm::raw_ostream* ostream = &llvm::outs(), unsigned jobs = 0):
+		BruteForce(program, ostream, jobs){}
+
+protected:
+	virtual std::vector<bool> initiallySliced(llvm::Module& program, CriterionPtr criterion) override;
+};
@@ -12,9 +12,8 @@
 
 #include "llvm/Transforms/Utils/Cloning.h"
 
-#include "core/DependencyGraphPasses.h"
+#include "core/InterproceduralSlicePass.h"
 #include "core/SlicingPass.h"
-#include "core/SyntacticSlicePass.h"
 #include "core/Util.h"
 #include "core/SliceCandidateValidation.h"
 
@@ -28,23 +27,21 @@ shared_ptr<Module> SyntacticSlicing::computeSlice(CriterionPtr criterion) {
 	ModulePtr sliceCandidate = CloneModule(&*program);
 
 	llvm::legacy::PassManager PM;
-	PM.add(new llvm::PostDominatorTree());
-	PM.add(new CDGPass());
-	PM.add(new DDGPass());
-	PM.add(new PDGPass());
-	PM.add(new SyntacticSlicePass(criterion));
+	// The per function PDGs are created on demand by the SDG
+	PM.add(new InterproceduralSlicePass(criterion));
 	PM.add(new SlicingPass());
 	PM.run(*sliceCandidate);
 
-	ValidationResult valid = SliceCandidateValidation::validate(&*program, &*sliceCandidate, criterion);
+	ValidationResult valid = SliceCandidateValidation::validate(&*program, &*sliceCandidate, criterion,
+		nullptr, getSolver());
 	if (valid == ValidationResult::valid) {
 		result = sliceCandidate;
-		outs() << "The produced syntactic slice was verified by reve. :) \n";
+		messages() << "The produced syntactic slice was verified by reve. :) \n";
 
 	} else if (valid == ValidationResult::valid){
-		outs() << "Ups! The produced syntactic slice is not valid! :/ \n";
+		messages() << "Ups! The produced syntactic slice is not valid! :/ \n";
 	} else {
-		outs() << "Could not verify the vlidity! :( \n";
+		messages() << "Could not verify the vlidity! :( \n";
 	}
 
 	return result;
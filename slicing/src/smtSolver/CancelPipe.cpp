@@ -0,0 +1,60 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "CancelPipe.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+void closeOnExec(int fd) {
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+CancelPipe::CancelPipe() {
+	if (pipe(fds) != 0) {
+		fds[0] = -1;
+		fds[1] = -1;
+		return;
+	}
+	closeOnExec(fds[0]);
+	closeOnExec(fds[1]);
+}
+
+CancelPipe::~CancelPipe() {
+	finish();
+	if (fds[0] >= 0) {
+		close(fds[0]);
+	}
+}
+
+bool CancelPipe::isValid() const {
+	return fds[0] >= 0;
+}
+
+int CancelPipe::getReadFd() const {
+	return fds[0];
+}
+
+void CancelPipe::cancel() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!finished && fds[1] >= 0) {
+		char wakeUp = 0;
+		ssize_t written = write(fds[1], &wakeUp, 1);
+		(void) written;
+	}
+}
+
+void CancelPipe::finish() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!finished && fds[1] >= 0) {
+		close(fds[1]);
+	}
+	finished = true;
+}
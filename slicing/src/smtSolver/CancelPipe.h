@@ -0,0 +1,38 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+#include <mutex>
+
+/**
+ * Used to cancel a check running on another thread. The thread waits for the
+ * read end in poll() in addition to the solver, so it wakes up as soon as the
+ * check is canceled.
+ */
+class CancelPipe {
+public:
+	CancelPipe();
+	CancelPipe(const CancelPipe&) = delete;
+	CancelPipe& operator=(const CancelPipe&) = delete;
+	~CancelPipe();
+	bool isValid() const;
+	int getReadFd() const;
+	/// Can be called from any thread, has no effect once the check has finished
+	void cancel();
+	/// Called by the thread running the check once it is done
+	void finish();
+private:
+	std::mutex mutex;
+	bool finished = false;
+	int fds[2] = {-1, -1};
+};
+
+/// Prevents processes started in parallel from inheriting the descriptor
+void closeOnExec(int fd);
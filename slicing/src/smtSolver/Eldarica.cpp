@@ -9,43 +9,33 @@
  */
 
 #include "Eldarica.h"
-#include <fstream>
-#include <sstream>
-#include <cassert>
 
-std::string EldaricaCommand::getCommandStr(std::string smtFilePath, std::string resultFilePath) {
-	std::stringstream ss;
-	ss << this->pathToEldarica;
-	ss << " -hsmt ";
-	ss << smtFilePath;
-	ss << " > ";
-	ss << resultFilePath;
-	return ss.str();
+std::vector<std::string> EldaricaCommand::getArguments(std::string smtFilePath) {
+	return {this->pathToEldarica, "-hsmt", smtFilePath};
 }
 
 
-SatResult Eldarica::parseResult(std::string resultFile) {
-	std::ifstream input(resultFile);
+SatResult Eldarica::parseResult(std::istream& output) {
+	return parseEldaricaOutput(output);
+}
+
+SatResult parseEldaricaOutput(std::istream& output) {
 	std::string line;
-	SatResult result = SatResult::unknown;
-	bool foundResult = false;
-	while (getline(input, line)) {
+	while (getline(output, line)) {
 		if (line == "sat") {
-			result = SatResult::sat;
-			foundResult = true;
-			break;
+			return SatResult::sat;
 		}
 		if (line == "unsat") {
-			result = SatResult::unsat;
-			foundResult = true;
-			break;
+			return SatResult::unsat;
 		}
 	}
-	assert(foundResult && "Did not find result information, please report a bug!");
-
-	return result;
+	return SatResult::unknown;
 }
 
 SmtCommand& Eldarica::getCommand(){
 	return this->command;
 }
+
+Eldarica::~Eldarica() {
+	waitForChecks();
+}
@@ -15,7 +15,7 @@
 class EldaricaCommand : public SmtCommand {
 public:
 	EldaricaCommand(std::string pathToEldarica): SmtCommand(), pathToEldarica(pathToEldarica){}
-	virtual std::string getCommandStr(std::string smtFilePath, std::string resultFilePath) override;
+	virtual std::vector<std::string> getArguments(std::string smtFilePath) override;
 private:
 	std::string pathToEldarica;
 
@@ -24,8 +24,12 @@ private:
 class Eldarica : public SmtSolverCommandLineAdapter {
 public:
 	Eldarica(std::string pathToEldarica):SmtSolverCommandLineAdapter(), command(pathToEldarica) {}
-	virtual SatResult parseResult(std::string resultFile) override;
+	virtual SatResult parseResult(std::istream& output) override;
 	virtual SmtCommand& getCommand() override;
+	virtual ~Eldarica();
 private:
 	EldaricaCommand command;
 };
+
+/// Returns unknown if the output contains no result
+SatResult parseEldaricaOutput(std::istream& output);
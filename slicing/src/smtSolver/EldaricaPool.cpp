@@ -0,0 +1,262 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "EldaricaPool.h"
+#include "CancelPipe.h"
+#include "Eldarica.h"
+
+#include "util/SlicingStatistics.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <netinet/in.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using Clock = std::chrono::steady_clock;
+
+struct EldaricaPool::Worker {
+	pid_t pid = -1;
+	// The output of the server, only needed until the handshake has been read
+	int outputFd = -1;
+	int port = 0;
+	std::string ticket;
+
+	bool isRunning() const {
+		return pid > 0;
+	}
+
+	/// The server needs some time to start so this is only done on first use
+	bool readHandshake() {
+		if (port != 0) {
+			return true;
+		}
+		std::string output;
+		std::vector<std::string> lines;
+		char c;
+		while (lines.size() < 2 && read(outputFd, &c, 1) == 1) {
+			if (c == '\n') {
+				lines.push_back(output);
+				output.clear();
+			} else {
+				output += c;
+			}
+		}
+		close(outputFd);
+		outputFd = -1;
+		if (lines.size() < 2) {
+			return false;
+		}
+		port = std::atoi(lines[0].c_str());
+		ticket = lines[1];
+		return port > 0;
+	}
+
+	void stop() {
+		if (outputFd >= 0) {
+			close(outputFd);
+			outputFd = -1;
+		}
+		if (pid > 0) {
+			kill(pid, SIGKILL);
+			waitpid(pid, nullptr, 0);
+			pid = -1;
+		}
+	}
+
+	~Worker() {
+		stop();
+	}
+};
+
+// Sends the query to the server and reads the answer. Returns false if the
+// check timed out, has been canceled or waiting for the answer failed, the
+// server is then in an unknown state.
+static bool runQuery(EldaricaPool::Worker& worker, const std::string& smtFilePath,
+		Clock::time_point deadline, const CancelPipe& cancelPipe, SatResult& result) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		result = SatResult::error;
+		return true;
+	}
+	closeOnExec(fd);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(worker.port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		close(fd);
+		result = SatResult::error;
+		return true;
+	}
+
+	// The server might have been started in a different directory
+	char absolutePath[PATH_MAX];
+	std::string path = realpath(smtFilePath.c_str(), absolutePath) ? absolutePath : smtFilePath;
+	std::stringstream request;
+	request << worker.ticket << "\n" << "-hsmt\n" << path << "\n" << "PROVE_AND_FLUSH\n";
+	std::string requestStr = request.str();
+	size_t sent = 0;
+	while (sent < requestStr.size()) {
+		ssize_t n = send(fd, requestStr.data() + sent, requestStr.size() - sent, 0);
+		if (n <= 0) {
+			close(fd);
+			result = SatResult::error;
+			return true;
+		}
+		sent += static_cast<size_t>(n);
+	}
+
+	std::string output;
+	while (true) {
+		int pollTimeout = -1;
+		if (deadline != Clock::time_point::max()) {
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - Clock::now()).count();
+			pollTimeout = remaining > 0 ? static_cast<int>(remaining) + 1 : 0;
+		}
+		pollfd fds[2] = {{fd, POLLIN, 0}, {cancelPipe.getReadFd(), POLLIN, 0}};
+		int ready = poll(fds, 2, pollTimeout);
+		if (ready < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ready < 0) {
+			close(fd);
+			result = SatResult::unknown;
+			return false;
+		}
+		if (ready == 0 || fds[1].revents != 0) {
+			close(fd);
+			result = ready == 0 ? SatResult::timeout : SatResult::unknown;
+			return false;
+		}
+		char buffer[4096];
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n <= 0) {
+			break;
+		}
+		output.append(buffer, static_cast<size_t>(n));
+	}
+	close(fd);
+	std::istringstream outputStream(output);
+	result = parseEldaricaOutput(outputStream);
+	return true;
+}
+
+EldaricaPool::EldaricaPool(std::string pathToServer, unsigned workers):
+		SmtSolver(), pathToServer(pathToServer) {
+	if (workers == 0) {
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// The servers start in parallel, so they are usually warm by the time the
+	// first queries arrive
+	for (unsigned i = 0; i < workers; ++i) {
+		idleWorkers.push_back(startWorker());
+	}
+}
+
+EldaricaPool::~EldaricaPool() {
+	waitForChecks();
+}
+
+std::unique_ptr<EldaricaPool::Worker> EldaricaPool::startWorker() {
+	auto worker = std::unique_ptr<Worker>(new Worker());
+	int outputFds[2];
+	if (pipe(outputFds) != 0) {
+		return worker;
+	}
+	closeOnExec(outputFds[0]);
+	closeOnExec(outputFds[1]);
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+	posix_spawn_file_actions_adddup2(&fileActions, outputFds[1], STDOUT_FILENO);
+	std::vector<char*> argv = {&pathToServer[0], nullptr};
+	pid_t pid;
+	if (posix_spawnp(&pid, argv[0], &fileActions, nullptr, argv.data(), environ) == 0) {
+		worker->pid = pid;
+		worker->outputFd = outputFds[0];
+	} else {
+		close(outputFds[0]);
+	}
+	posix_spawn_file_actions_destroy(&fileActions);
+	close(outputFds[1]);
+	return worker;
+}
+
+std::unique_ptr<EldaricaPool::Worker> EldaricaPool::acquireWorker() {
+	std::unique_lock<std::mutex> lock(mutex);
+	workerAvailable.wait(lock, [this]() { return !idleWorkers.empty(); });
+	auto worker = std::move(idleWorkers.back());
+	idleWorkers.pop_back();
+	return worker;
+}
+
+void EldaricaPool::releaseWorker(std::unique_ptr<Worker> worker) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		idleWorkers.push_back(std::move(worker));
+	}
+	workerAvailable.notify_one();
+}
+
+SatCheck EldaricaPool::checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) {
+	Clock::time_point start = Clock::now();
+	std::promise<SatResult> promise;
+	SatCheck check;
+	check.result = promise.get_future().share();
+	auto cancelPipe = std::make_shared<CancelPipe>();
+	check.cancel = [cancelPipe]() { cancelPipe->cancel(); };
+	if (!cancelPipe->isValid()) {
+		promise.set_value(SatResult::error);
+		return check;
+	}
+
+	Clock::time_point deadline = Clock::time_point::max();
+	if (timeout > std::chrono::milliseconds::zero()) {
+		deadline = Clock::now() + timeout;
+	}
+	// The destructor waits for the thread, so it is safe to use 'this' on it
+	beginCheck();
+	std::thread([this, cancelPipe, smtFilePath, start, deadline]
+			(std::promise<SatResult> promise) {
+		auto worker = acquireWorker();
+		SatResult result = SatResult::error;
+		bool reusable = worker->isRunning() && worker->readHandshake() &&
+			runQuery(*worker, smtFilePath, deadline, *cancelPipe, result);
+		if (result == SatResult::error) {
+			std::cerr << "The Eldarica server " << pathToServer << " did not answer the query for " << smtFilePath << "." << std::endl;
+		}
+		if (!reusable || result == SatResult::error) {
+			worker->stop();
+			worker = startWorker();
+		}
+		cancelPipe->finish();
+		releaseWorker(std::move(worker));
+		SlicingStatistics::getInstance().addSolverLatency(Clock::now() - start);
+		promise.set_value(result);
+		endCheck();
+	}, std::move(promise)).detach();
+
+	return check;
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+#include "SmtSolver.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Keeps a pool of long-lived Eldarica servers so that JVM start up and JIT
+ * warm up are only paid once per server instead of once per query.
+ *
+ * The servers are started the same way eld-client does it: On start up
+ * eld-server prints the port it listens on (on localhost) and a ticket. A
+ * request consists of the ticket, the command line arguments and
+ * PROVE_AND_FLUSH, each on a separate line. The server answers with the
+ * output of Eldarica and closes the connection.
+ *
+ * Each server handles one query at a time. A server whose query timed out or
+ * has been canceled is replaced by a new one.
+ */
+class EldaricaPool : public SmtSolver {
+public:
+	/// Zero workers means one per core
+	EldaricaPool(std::string pathToServer, unsigned workers);
+	EldaricaPool(const EldaricaPool&) = delete;
+	EldaricaPool& operator=(const EldaricaPool&) = delete;
+	virtual SatCheck checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) override;
+	virtual ~EldaricaPool();
+
+	struct Worker;
+private:
+	std::unique_ptr<Worker> startWorker();
+	std::unique_ptr<Worker> acquireWorker();
+	void releaseWorker(std::unique_ptr<Worker> worker);
+
+	std::string pathToServer;
+	std::mutex mutex;
+	std::condition_variable workerAvailable;
+	std::vector<std::unique_ptr<Worker>> idleWorkers;
+};
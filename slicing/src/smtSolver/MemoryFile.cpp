@@ -0,0 +1,72 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "MemoryFile.h"
+#include "CancelPipe.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Can be opened by every process through /proc, unlike /dev/fd
+static std::string procPath(int fd) {
+	return "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+}
+
+MemoryFile::MemoryFile(const std::string& content) {
+#ifdef SYS_memfd_create
+	fd = static_cast<int>(syscall(SYS_memfd_create, "smt-problem", 0));
+	if (fd >= 0) {
+		path = procPath(fd);
+	}
+#endif
+	if (fd < 0) {
+		const char* tmpDir = getenv("TMPDIR");
+		std::string pattern = std::string(tmpDir ? tmpDir : "/tmp") + "/smt-problem-XXXXXX";
+		std::vector<char> name(pattern.begin(), pattern.end());
+		name.push_back('\0');
+		fd = mkstemp(name.data());
+		if (fd < 0) {
+			return;
+		}
+		path = name.data();
+	}
+	closeOnExec(fd);
+
+	size_t written = 0;
+	while (written < content.size()) {
+		ssize_t n = write(fd, content.data() + written, content.size() - written);
+		if (n <= 0) {
+			close(fd);
+			fd = -1;
+			return;
+		}
+		written += static_cast<size_t>(n);
+	}
+}
+
+MemoryFile::~MemoryFile() {
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (!path.empty() && path.compare(0, 6, "/proc/") != 0) {
+		unlink(path.c_str());
+	}
+}
+
+bool MemoryFile::isValid() const {
+	return fd >= 0;
+}
+
+std::string MemoryFile::getPath() const {
+	return path;
+}
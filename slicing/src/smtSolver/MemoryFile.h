@@ -0,0 +1,32 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+#include <string>
+
+/**
+ * Passes a problem to a solver that expects a path without writing it to the
+ * disk. The content is written to an anonymous file in memory (memfd), which
+ * other processes of the same user can open by its path in /proc as long as
+ * this object exists. Where memfd_create is not available a file in the
+ * temporary directory is used instead, which is removed with this object.
+ */
+class MemoryFile {
+public:
+	explicit MemoryFile(const std::string& content);
+	MemoryFile(const MemoryFile&) = delete;
+	MemoryFile& operator=(const MemoryFile&) = delete;
+	~MemoryFile();
+	bool isValid() const;
+	std::string getPath() const;
+private:
+	int fd = -1;
+	std::string path;
+};
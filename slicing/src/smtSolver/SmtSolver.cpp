@@ -10,10 +10,81 @@
 
 #include "SmtSolver.h"
 #include "Eldarica.h"
+#include "MemoryFile.h"
+#include "EldaricaPool.h"
+#include "SmtSolverPool.h"
+#include "Z3.h"
 
-SmtSolver& SmtSolver::getInstance() {
-	static Eldarica instance("eld");
-	return instance;
+#include <cstdlib>
+#include <iostream>
+
+SatResult SmtSolver::checkSat(std::string smtFilePath) {
+	SatResult result = this->checkSatAsync(smtFilePath,
+		std::chrono::milliseconds::zero()).result.get();
+	if (result == SatResult::error) {
+		exit(1);
+	}
+	return result;
+}
+
+SatCheck SmtSolver::checkProblemAsync(const std::string& problem,
+		std::chrono::milliseconds timeout) {
+	auto file = std::make_shared<MemoryFile>(problem);
+	if (!file->isValid()) {
+		std::cerr << "Could not create a file for the smt problem." << std::endl;
+		std::promise<SatResult> failed;
+		failed.set_value(SatResult::error);
+		return SatCheck{failed.get_future().share(), [](){}};
+	}
+	SatCheck check = this->checkSatAsync(file->getPath(), timeout);
+	std::function<void()> cancel = check.cancel;
+	check.cancel = [file, cancel]() { cancel(); };
+	return check;
+}
+
+void SmtSolver::beginCheck() {
+	std::lock_guard<std::mutex> lock(checksMutex);
+	++runningChecks;
+}
+
+void SmtSolver::endCheck() {
+	std::lock_guard<std::mutex> lock(checksMutex);
+	if (--runningChecks == 0) {
+		checksFinished.notify_all();
+	}
+}
+
+void SmtSolver::waitForChecks() {
+	std::unique_lock<std::mutex> lock(checksMutex);
+	checksFinished.wait(lock, [this]() { return runningChecks == 0; });
+}
+
+Z3Library* SmtSolver::asZ3Library() {
+	return nullptr;
 }
 
 SmtSolver::~SmtSolver() = default;
+
+static SmtSolverPtr createBackend(const SmtSolverOptions& options) {
+	switch (options.backend) {
+		case SmtSolverBackend::eldarica:
+		return std::make_shared<Eldarica>(options.eldaricaPath);
+		case SmtSolverBackend::eldaricaServer:
+		return std::make_shared<EldaricaPool>(options.eldaricaServerPath, options.workers);
+		case SmtSolverBackend::z3:
+		return std::make_shared<Z3Spacer>(options.z3Path);
+		case SmtSolverBackend::z3Library:
+		return std::make_shared<Z3Library>(options.workers);
+	}
+	return nullptr;
+}
+
+SmtSolverPtr createSmtSolver(const SmtSolverOptions& options) {
+	SmtSolverPtr solver = createBackend(options);
+	// The server pool and the z3 library limit the number of checks themselves
+	if (options.workers == 0 || options.backend == SmtSolverBackend::eldaricaServer ||
+			options.backend == SmtSolverBackend::z3Library) {
+		return solver;
+	}
+	return std::make_shared<SmtSolverPool>(solver, options.workers);
+}
@@ -9,29 +9,99 @@
  */
 
 #pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 
-enum class SatResult {sat, unsat, unknown, timeout};
+enum class SatResult {sat, unsat, unknown, timeout, error};
 
-class SmtSolverOption {
-	SmtSolverOption(std::string eldaricaPath, std::string z3Path):
-		eldaricaPath(eldaricaPath), z3Path(z3Path){}
+/**
+ * A satisfiability check running in the background. The result is available
+ * once the solver has finished, exceeded its time limit (timeout) or the
+ * check has been canceled (unknown).
+ */
+struct SatCheck {
+	std::shared_future<SatResult> result;
+	/// Stops the solver, has no effect if it has already finished
+	std::function<void()> cancel;
+};
 
-private:
-	std::string eldaricaPath;
-	std::string z3Path;
+class SmtSolver;
+class Z3Library;
+typedef std::shared_ptr<SmtSolver> SmtSolverPtr;
+
+enum class SmtSolverBackend {
+	/// Starts Eldarica for every query
+	eldarica,
+	/// A pool of long-lived Eldarica servers, see EldaricaPool
+	eldaricaServer,
+	/// Starts z3 with the spacer engine for every query
+	z3,
+	/// Solves the queries with the z3 library inside this process
+	z3Library
+};
+
+struct SmtSolverOptions {
+	SmtSolverBackend backend = SmtSolverBackend::eldarica;
+	std::string eldaricaPath = "eld";
+	std::string eldaricaServerPath = "eld-server";
+	std::string z3Path = "z3";
+	/**
+	 * Number of checks that run at the same time, further checks wait until
+	 * one of them has finished (see SmtSolverPool). Zero means no limit,
+	 * except for the Eldarica servers and the z3 library where it means one
+	 * worker per core.
+	 */
+	unsigned workers = 0;
 };
 
+/**
+ * Solvers are created by createSmtSolver and shared by everything that needs
+ * them, there is no global instance. All methods may be called from several
+ * threads at the same time. A solver must not be destroyed while one of its
+ * checks is running, the destructors wait for them.
+ */
 class SmtSolver {
 public:
-	static SmtSolver& getInstance();
-	static void setOptions(std::shared_ptr<SmtSolverOption> option);
-
 	//virtual bool isAvailable() = 0;
 	//virtual void setTimeout(int miliSeconds) = 0;
-	virtual SatResult checkSat(std::string smtFilePath) = 0;
+	virtual SatResult checkSat(std::string smtFilePath);
+	/**
+	 * Starts the solver and returns immediately so several checks can run at
+	 * the same time. A timeout of zero means no limit.
+	 */
+	virtual SatCheck checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout = std::chrono::milliseconds::zero()) = 0;
+	/**
+	 * Checks a problem that is not stored in a file. It is passed to the
+	 * solver through a MemoryFile, which is released with the last copy of
+	 * the returned check, so the check has to be kept until it has finished.
+	 */
+	virtual SatCheck checkProblemAsync(const std::string& problem,
+		std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+	/// Non-null if the solver can check clauses without a file
+	virtual Z3Library* asZ3Library();
 	virtual ~SmtSolver();
+
+protected:
+	/// Called before a check leaves a thread running in the background
+	void beginCheck();
+	/// Called by the background thread as its last access to the solver
+	void endCheck();
+	/**
+	 * Has to be called by the destructor of every class that can be
+	 * instantiated, before the members used by the checks are destroyed.
+	 */
+	void waitForChecks();
+
 private:
-	static std::shared_ptr<SmtSolverOption> option;
+	std::mutex checksMutex;
+	std::condition_variable checksFinished;
+	unsigned runningChecks = 0;
 };
 
+SmtSolverPtr createSmtSolver(const SmtSolverOptions& options = SmtSolverOptions());
@@ -8,39 +8,149 @@
  * See LICENSE (distributed with this file) for details.
  */
 
-// *** ADDED BY HEADER FIXUP ***
-#include <istream>
-// *** END ***
 #include "SmtSolverCommandLineAdapter.h"
+#include "CancelPipe.h"
+
+#include "util/SlicingStatistics.h"
 
-#include <stdlib.h>
 #include <iostream>
+#include <sstream>
+#include <thread>
+
+// Note, that we assume a POSIX system. Will propably not work corectly on Windows!
+#include <cerrno>
 #include <csignal>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using Clock = std::chrono::steady_clock;
 
 SmtCommand::~SmtCommand() = default;
 
 SmtSolverCommandLineAdapter::~SmtSolverCommandLineAdapter() = default;
 
-SatResult SmtSolverCommandLineAdapter::checkSat(std::string smtFilePath){
-	std::string resultFilePath = "solverResult.txt";
-	std::string command = this->getCommand().getCommandStr(smtFilePath, resultFilePath);
-
-	// Note, that we assume a POSIX system. Will propably not work corectly on Windows!
-	int ret = system(command.c_str());
-	// During the system call sigint or sigquit will not be passed to us, as we will
-	// execute this within a loop we need to handle the signals. Other wise it will not
-	// be possible to terminate the program.
-	if (WIFSIGNALED(ret) &&
-		(WTERMSIG(ret) == SIGINT || WTERMSIG(ret) == SIGQUIT)) {
-		std::cerr << "Got SIGINT or SIGQUIT during execution of SMT solver going to terminate!" << std::endl;
-		exit(WTERMSIG(ret));
+static std::string commandString(const std::vector<std::string>& arguments) {
+	std::stringstream ss;
+	for (size_t i = 0; i < arguments.size(); ++i) {
+		ss << (i == 0 ? "" : " ") << arguments[i];
+	}
+	return ss.str();
+}
+
+SatCheck SmtSolverCommandLineAdapter::checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) {
+	Clock::time_point start = Clock::now();
+	std::vector<std::string> arguments = this->getCommand().getArguments(smtFilePath);
+	std::promise<SatResult> promise;
+	SatCheck check;
+	check.result = promise.get_future().share();
+	check.cancel = [](){};
+
+	auto cancelPipe = std::make_shared<CancelPipe>();
+	int outputFds[2];
+	if (!cancelPipe->isValid() || pipe(outputFds) != 0) {
+		std::cerr << "Could not create pipe for the smt solver." << std::endl;
+		promise.set_value(SatResult::error);
+		return check;
 	}
+	closeOnExec(outputFds[0]);
+	closeOnExec(outputFds[1]);
 
-	if (WEXITSTATUS(ret) != 0) {
-		std::cerr << "The execution of smt command went wrong (Exitcode: " << WEXITSTATUS(ret) << "). The following command was tried to be executed:" << std::endl;
-		std::cerr << "\"" << command << "\"" << std::endl;
-		exit(1);
+	std::vector<char*> argv;
+	for (auto& argument : arguments) {
+		argv.push_back(&argument[0]);
 	}
+	argv.push_back(nullptr);
+
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+	posix_spawn_file_actions_adddup2(&fileActions, outputFds[1], STDOUT_FILENO);
+	pid_t pid;
+	int spawnError = posix_spawnp(&pid, argv[0], &fileActions, nullptr,
+		argv.data(), environ);
+	posix_spawn_file_actions_destroy(&fileActions);
+	close(outputFds[1]);
+	if (spawnError != 0) {
+		std::cerr << "Could not execute the smt solver. The following command was tried to be executed:" << std::endl;
+		std::cerr << "\"" << commandString(arguments) << "\"" << std::endl;
+		close(outputFds[0]);
+		promise.set_value(SatResult::error);
+		return check;
+	}
+
+	check.cancel = [cancelPipe]() { cancelPipe->cancel(); };
+
+	Clock::time_point deadline = Clock::time_point::max();
+	if (timeout > std::chrono::milliseconds::zero()) {
+		deadline = Clock::now() + timeout;
+	}
+	int outputFd = outputFds[0];
+
+	// The destructor waits for the thread, so it is safe to use 'this' on it
+	beginCheck();
+	std::thread([this, cancelPipe, pid, outputFd, start, deadline, arguments]
+			(std::promise<SatResult> promise) {
+		std::string output;
+		bool stopped = false;
+		SatResult result = SatResult::unknown;
+		while (!stopped) {
+			int pollTimeout = -1;
+			if (deadline != Clock::time_point::max()) {
+				auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+					deadline - Clock::now()).count();
+				pollTimeout = remaining > 0 ? static_cast<int>(remaining) + 1 : 0;
+			}
+			pollfd fds[2] = {{outputFd, POLLIN, 0},
+				{cancelPipe->getReadFd(), POLLIN, 0}};
+			int ready = poll(fds, 2, pollTimeout);
+			if (ready < 0 && errno == EINTR) {
+				continue;
+			}
+			if (ready < 0) {
+				kill(pid, SIGKILL);
+				result = SatResult::unknown;
+				stopped = true;
+			} else if (ready == 0) {
+				kill(pid, SIGKILL);
+				result = SatResult::timeout;
+				stopped = true;
+			} else if (fds[1].revents != 0) {
+				kill(pid, SIGKILL);
+				result = SatResult::unknown;
+				stopped = true;
+			} else {
+				char buffer[4096];
+				ssize_t n = read(outputFd, buffer, sizeof(buffer));
+				if (n <= 0) {
+					break;
+				}
+				output.append(buffer, static_cast<size_t>(n));
+			}
+		}
+
+		int status = 0;
+		waitpid(pid, &status, 0);
+		cancelPipe->finish();
+		close(outputFd);
+
+		if (!stopped) {
+			if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+				std::istringstream outputStream(output);
+				result = this->parseResult(outputStream);
+			} else {
+				std::cerr << "The execution of smt command went wrong (Exitcode: " << WEXITSTATUS(status) << "). The following command was tried to be executed:" << std::endl;
+				std::cerr << "\"" << commandString(arguments) << "\"" << std::endl;
+				result = SatResult::error;
+			}
+		}
+		SlicingStatistics::getInstance().addSolverLatency(Clock::now() - start);
+		promise.set_value(result);
+		this->endCheck();
+	}, std::move(promise)).detach();
 
-	return this->parseResult(resultFilePath);
+	return check;
 }
@@ -10,19 +10,29 @@
 
 #pragma once
 #include "SmtSolver.h"
+#include <istream>
 #include <string>
+#include <vector>
 
 class SmtCommand {
 public:
-	virtual std::string getCommandStr(std::string smtFilePath, std::string resultFilePath) = 0;
+	/// The program (looked up in PATH) followed by its arguments
+	virtual std::vector<std::string> getArguments(std::string smtFilePath) = 0;
 	virtual ~SmtCommand();
 };
 
+/**
+ * Runs the solver as a separate process and parses its standard output. The
+ * process is started directly (without a shell) and its output is read
+ * through a pipe.
+ */
 class SmtSolverCommandLineAdapter: public SmtSolver {
 public:
 	SmtSolverCommandLineAdapter():SmtSolver() {}
-	virtual SatResult checkSat(std::string smtFilePath) override;
-	virtual SatResult parseResult(std::string resultFile) = 0;
+	virtual SatCheck checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) override;
+	/// Returns unknown if the output contains no result
+	virtual SatResult parseResult(std::istream& output) = 0;
 	virtual SmtCommand& getCommand() = 0;
 	virtual ~SmtSolverCommandLineAdapter();
 };
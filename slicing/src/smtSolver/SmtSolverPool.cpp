@@ -0,0 +1,99 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SmtSolverPool.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace {
+/**
+ * Forwards the cancellation to the check of the solver once it has been
+ * started.
+ */
+class PooledCheck {
+public:
+	/// Returns false if the check has been canceled while it was waiting
+	bool start(SmtSolver& solver, const std::string& smtFilePath,
+			std::chrono::milliseconds timeout, std::shared_future<SatResult>& result) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (canceled) {
+			return false;
+		}
+		SatCheck check = solver.checkSatAsync(smtFilePath, timeout);
+		result = check.result;
+		cancelCheck = check.cancel;
+		return true;
+	}
+	void cancel() {
+		std::lock_guard<std::mutex> lock(mutex);
+		canceled = true;
+		if (cancelCheck) {
+			cancelCheck();
+		}
+	}
+private:
+	std::mutex mutex;
+	bool canceled = false;
+	std::function<void()> cancelCheck;
+};
+}
+
+SmtSolverPool::SmtSolverPool(SmtSolverPtr solver, unsigned workers):
+		SmtSolver(), solver(solver), idleWorkers(workers) {
+	if (idleWorkers == 0) {
+		idleWorkers = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+SmtSolverPool::~SmtSolverPool() {
+	waitForChecks();
+}
+
+void SmtSolverPool::acquireWorker() {
+	std::unique_lock<std::mutex> lock(mutex);
+	workerAvailable.wait(lock, [this]() { return idleWorkers > 0; });
+	--idleWorkers;
+}
+
+void SmtSolverPool::releaseWorker() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++idleWorkers;
+	}
+	workerAvailable.notify_one();
+}
+
+SatCheck SmtSolverPool::checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) {
+	std::promise<SatResult> promise;
+	SatCheck check;
+	check.result = promise.get_future().share();
+	auto pooledCheck = std::make_shared<PooledCheck>();
+	check.cancel = [pooledCheck]() { pooledCheck->cancel(); };
+
+	// The destructor waits for the thread, so it is safe to use 'this' on it
+	beginCheck();
+	std::thread([this, pooledCheck, smtFilePath, timeout]
+			(std::promise<SatResult> promise) {
+		acquireWorker();
+		SatResult result = SatResult::unknown;
+		std::shared_future<SatResult> solverResult;
+		if (pooledCheck->start(*solver, smtFilePath, timeout, solverResult)) {
+			result = solverResult.get();
+		}
+		releaseWorker();
+		promise.set_value(result);
+		endCheck();
+	}, std::move(promise)).detach();
+
+	return check;
+}
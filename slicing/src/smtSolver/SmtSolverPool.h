@@ -0,0 +1,43 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+#include "SmtSolver.h"
+
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Limits the number of checks of a solver that run at the same time, e.g. to
+ * keep the worker threads of a slicing method from starting more solver
+ * processes than there are cores. A check that is started while all workers
+ * are busy waits in the background until one of them is free, its timeout
+ * only starts once it is passed to the solver. Checks that are canceled while
+ * they wait are never passed to the solver.
+ */
+class SmtSolverPool : public SmtSolver {
+public:
+	/// Zero workers means one per core
+	SmtSolverPool(SmtSolverPtr solver, unsigned workers);
+	SmtSolverPool(const SmtSolverPool&) = delete;
+	SmtSolverPool& operator=(const SmtSolverPool&) = delete;
+	virtual SatCheck checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) override;
+	virtual ~SmtSolverPool();
+
+private:
+	void acquireWorker();
+	void releaseWorker();
+
+	SmtSolverPtr solver;
+	std::mutex mutex;
+	std::condition_variable workerAvailable;
+	unsigned idleWorkers;
+};
@@ -0,0 +1,282 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "Z3.h"
+#include "Eldarica.h"
+
+#include "util/SlicingStatistics.h"
+
+#include "Serialize.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+#include "z3++.h"
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<std::string> Z3Command::getArguments(std::string smtFilePath) {
+	return {this->pathToZ3, "fixedpoint.engine=spacer", smtFilePath};
+}
+
+SatResult Z3Spacer::parseResult(std::istream& output) {
+	// z3 prints the result on a line of its own just like Eldarica
+	return parseEldaricaOutput(output);
+}
+
+SmtCommand& Z3Spacer::getCommand() {
+	return this->command;
+}
+
+Z3Spacer::~Z3Spacer() {
+	waitForChecks();
+}
+
+namespace {
+/**
+ * Interrupts the context of a check, which can only be done while the check
+ * is running since the context belongs to the worker running it.
+ */
+class Z3Interrupt {
+public:
+	/// Returns false if the check has already been canceled
+	bool start(z3::context& context) {
+		std::lock_guard<std::mutex> lock(mutex);
+		this->context = &context;
+		return !canceled;
+	}
+	void finish() {
+		std::lock_guard<std::mutex> lock(mutex);
+		context = nullptr;
+	}
+	void cancel() {
+		std::lock_guard<std::mutex> lock(mutex);
+		canceled = true;
+		if (context) {
+			context->interrupt();
+		}
+	}
+	bool isCanceled() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return canceled;
+	}
+private:
+	std::mutex mutex;
+	z3::context* context = nullptr;
+	bool canceled = false;
+};
+}
+
+struct Z3Library::Job {
+	/// Both are empty if the clauses are checked
+	std::string smtFilePath;
+	std::string problem;
+	std::shared_ptr<const std::vector<smt::SharedSMTRef>> sharedAssertions;
+	std::vector<smt::SharedSMTRef> clauses;
+	llreve::opts::SMTGenerationOpts smtOpts;
+	std::chrono::milliseconds timeout;
+	Clock::time_point start;
+	std::shared_ptr<Z3Interrupt> interrupt;
+	std::promise<SatResult> promise;
+};
+
+struct Z3Library::Worker {
+	std::unique_ptr<z3::context> context;
+	std::unique_ptr<z3::solver> solver;
+	/// Whether the base scope of the solver contains the shared assertions
+	bool baseLoaded = false;
+	std::shared_ptr<const std::vector<smt::SharedSMTRef>> sharedAssertions;
+
+	void reset() {
+		solver.reset();
+		context.reset(new z3::context());
+		// The HORN logic selects the spacer engine just like the z3 binary
+		solver.reset(new z3::solver(*context, "HORN"));
+		baseLoaded = false;
+		sharedAssertions.reset();
+	}
+};
+
+static void addClauses(z3::solver& solver, z3::context& context,
+		const std::vector<smt::SharedSMTRef>& clauses) {
+	llreve::opts::SerializeOpts serializeOpts("", false, false, false, true);
+	llvm::StringSet<> predicates;
+	for (const z3::expr& clause : hornClausesToZ3(clauses, serializeOpts, context, predicates)) {
+		solver.add(clause);
+	}
+}
+
+static SatResult runJob(Z3Library::Worker& worker, Z3Library::Job& job) {
+	z3::context& context = *worker.context;
+	z3::solver& solver = *worker.solver;
+	z3::params params(context);
+	params.set("timeout", job.timeout > std::chrono::milliseconds::zero() ?
+		static_cast<unsigned>(job.timeout.count()) : std::numeric_limits<unsigned>::max());
+	solver.set(params);
+
+	llreve::opts::SMTGenerationOpts::Scope optsScope(job.smtOpts);
+	const bool checksClauses = job.smtFilePath.empty() && job.problem.empty();
+	if (!worker.baseLoaded) {
+		if (checksClauses) {
+			// The shared assertions need the declarations of the problem
+			std::vector<smt::SharedSMTRef> base;
+			for (const smt::SharedSMTRef& expr : job.clauses) {
+				if (!expr->asAssert()) {
+					base.push_back(expr);
+				}
+			}
+			if (job.sharedAssertions) {
+				base.insert(base.end(), job.sharedAssertions->begin(), job.sharedAssertions->end());
+			}
+			addClauses(solver, context, base);
+		}
+		worker.baseLoaded = true;
+		worker.sharedAssertions = job.sharedAssertions;
+	}
+
+	solver.push();
+	if (checksClauses) {
+		addClauses(solver, context, job.clauses);
+	} else {
+		z3::expr_vector clauses = job.problem.empty() ?
+			context.parse_file(job.smtFilePath.c_str()) : context.parse_string(job.problem.c_str());
+		for (unsigned i = 0; i < clauses.size(); ++i) {
+			solver.add(clauses[i]);
+		}
+	}
+	z3::check_result result = solver.check();
+	solver.pop();
+	switch (result) {
+		case z3::sat:
+		return SatResult::sat;
+		case z3::unsat:
+		return SatResult::unsat;
+		default:
+		return SatResult::unknown;
+	}
+}
+
+Z3Library::Z3Library(unsigned workers):SmtSolver() {
+	if (workers == 0) {
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned i = 0; i < workers; ++i) {
+		this->workers.emplace_back([this]() { runWorker(); });
+	}
+}
+
+Z3Library::~Z3Library() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	// The workers finish the checks that are still queued
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+Z3Library* Z3Library::asZ3Library() {
+	return this;
+}
+
+void Z3Library::runWorker() {
+	Worker worker;
+	worker.reset();
+	while (true) {
+		std::unique_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return !jobs.empty() || stopping; });
+			if (jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		// Problems of a different session or files start from an empty solver
+		if (!worker.baseLoaded || worker.sharedAssertions != job->sharedAssertions ||
+				!job->smtFilePath.empty() || !job->problem.empty()) {
+			worker.reset();
+		}
+		Clock::time_point solverStart = Clock::now();
+		SatResult result = SatResult::unknown;
+		if (job->interrupt->start(*worker.context)) {
+			try {
+				result = runJob(worker, *job);
+			} catch (const z3::exception& e) {
+				// An interrupted check throws as well
+				if (!job->interrupt->isCanceled()) {
+					std::string source = !job->smtFilePath.empty() ? job->smtFilePath :
+						job->problem.empty() ? "the clauses" : "the problem";
+					std::cerr << "z3 could not check " << source << ": " << e.msg() << std::endl;
+					result = SatResult::error;
+				}
+			}
+		}
+		job->interrupt->finish();
+		if (result == SatResult::unknown && !job->interrupt->isCanceled() &&
+				job->timeout > std::chrono::milliseconds::zero() &&
+				Clock::now() - solverStart >= job->timeout) {
+			result = SatResult::timeout;
+		}
+		// The context may still be interrupted or in an unknown state
+		if (result != SatResult::sat && result != SatResult::unsat) {
+			worker.reset();
+		}
+		SlicingStatistics::getInstance().addSolverLatency(Clock::now() - job->start);
+		job->promise.set_value(result);
+	}
+}
+
+SatCheck Z3Library::submit(std::unique_ptr<Job> job) {
+	job->start = Clock::now();
+	job->interrupt = std::make_shared<Z3Interrupt>();
+	SatCheck check;
+	check.result = job->promise.get_future().share();
+	auto interrupt = job->interrupt;
+	check.cancel = [interrupt]() { interrupt->cancel(); };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+	return check;
+}
+
+SatCheck Z3Library::checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) {
+	auto job = std::unique_ptr<Job>(new Job());
+	job->smtFilePath = smtFilePath;
+	job->timeout = timeout;
+	return submit(std::move(job));
+}
+
+SatCheck Z3Library::checkProblemAsync(const std::string& problem,
+		std::chrono::milliseconds timeout) {
+	auto job = std::unique_ptr<Job>(new Job());
+	job->problem = problem;
+	job->timeout = timeout;
+	return submit(std::move(job));
+}
+
+SatCheck Z3Library::checkClausesAsync(std::shared_ptr<const std::vector<smt::SharedSMTRef>> sharedAssertions,
+		std::vector<smt::SharedSMTRef> clauses, llreve::opts::SMTGenerationOpts smtOpts,
+		std::chrono::milliseconds timeout) {
+	auto job = std::unique_ptr<Job>(new Job());
+	job->sharedAssertions = sharedAssertions;
+	job->clauses = std::move(clauses);
+	job->smtOpts = smtOpts;
+	job->timeout = timeout;
+	return submit(std::move(job));
+}
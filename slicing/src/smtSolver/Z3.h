@@ -0,0 +1,95 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SmtSolverCommandLineAdapter.h"
+
+#include "Opts.h"
+#include "SMT.h"
+
+class Z3Command : public SmtCommand {
+public:
+	Z3Command(std::string pathToZ3): SmtCommand(), pathToZ3(pathToZ3){}
+	virtual std::vector<std::string> getArguments(std::string smtFilePath) override;
+private:
+	std::string pathToZ3;
+};
+
+/// Runs z3 with the spacer engine as a separate process for every query
+class Z3Spacer : public SmtSolverCommandLineAdapter {
+public:
+	Z3Spacer(std::string pathToZ3):SmtSolverCommandLineAdapter(), command(pathToZ3) {}
+	virtual SatResult parseResult(std::istream& output) override;
+	virtual SmtCommand& getCommand() override;
+	virtual ~Z3Spacer();
+private:
+	Z3Command command;
+};
+
+/**
+ * Solves the Horn clauses with the z3 library linked into the process, which
+ * saves starting a process per query. The checks are run by a fixed number of
+ * worker threads, each of them has its own z3 context so they don't share any
+ * state. A worker whose check has been canceled, has timed out or failed
+ * starts over with a new context.
+ *
+ * Files have to be in the SMT-LIB format, the muZ format (declare-rel, query)
+ * is not supported.
+ */
+class Z3Library : public SmtSolver {
+public:
+	/// Zero workers means one per core
+	explicit Z3Library(unsigned workers = 0);
+	Z3Library(const Z3Library&) = delete;
+	Z3Library& operator=(const Z3Library&) = delete;
+	virtual SatCheck checkSatAsync(std::string smtFilePath,
+		std::chrono::milliseconds timeout) override;
+	/// Parses the problem on the worker, no file is involved
+	virtual SatCheck checkProblemAsync(const std::string& problem,
+		std::chrono::milliseconds timeout) override;
+	/**
+	 * Checks the clauses generated by llreve without serializing them, they
+	 * are converted to z3 expressions by hornClausesToZ3 on the worker.
+	 *
+	 * The shared assertions (e.g. the functional abstractions of the original
+	 * program when slice candidates are validated) are added to the solver
+	 * of a worker once and kept for all following checks with the same
+	 * vector, only the other clauses are added and removed again for each
+	 * check. They must not be contained in clauses, the declarations and
+	 * definitions they use must be.
+	 *
+	 * The expressions are converted using smtOpts, the options of the thread
+	 * that generated them.
+	 */
+	SatCheck checkClausesAsync(std::shared_ptr<const std::vector<smt::SharedSMTRef>> sharedAssertions,
+		std::vector<smt::SharedSMTRef> clauses, llreve::opts::SMTGenerationOpts smtOpts,
+		std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+	virtual Z3Library* asZ3Library() override;
+	virtual ~Z3Library();
+
+	struct Job;
+	struct Worker;
+private:
+	SatCheck submit(std::unique_ptr<Job> job);
+	void runWorker();
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::deque<std::unique_ptr<Job>> jobs;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+};
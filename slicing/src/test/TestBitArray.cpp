@@ -0,0 +1,126 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "catch.hpp"
+
+#include "util/BitArray.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+TEST_CASE("Bits can be set and combined across slots", "[BitArray]") {
+	BitArray a(100);
+	BitArray b(100);
+
+	a.set(3).set(70);
+	b.set(70).set(99);
+
+	CHECK(a[3]);
+	CHECK(a[70]);
+	CHECK_FALSE(a[4]);
+	CHECK_FALSE(a[99]);
+
+	BitArray c(a);
+	c |= b;
+	CHECK(c[3]);
+	CHECK(c[99]);
+	CHECK(a != c);
+
+	a &= b;
+	CHECK_FALSE(a[3]);
+	CHECK(a[70]);
+
+	a.set(70, false);
+	CHECK(a == BitArray(100));
+}
+
+TEST_CASE("Set bits can be counted and iterated", "[BitArray]") {
+	for(unsigned int size : {1u, 64u, 65u, 128u, 300u}) {
+		BitArray     bits(size);
+		vector<unsigned int> expected;
+
+		for(unsigned int i = 0; i < size; i += 7) {
+			bits.set(i);
+			expected.push_back(i);
+		}
+
+		vector<unsigned int> found;
+		for(unsigned int i : bits.setBits()) {
+			found.push_back(i);
+		}
+
+		CHECK(found == expected);
+		CHECK(bits.count() == expected.size());
+		CHECK(bits.findFirst() == 0);
+
+		BitArray inverted(bits);
+		inverted.invert();
+		CHECK(inverted.count() == size - expected.size());
+
+		inverted.andNot(inverted);
+		CHECK(inverted.none());
+		CHECK(inverted.findFirst() == size);
+	}
+}
+
+TEST_CASE("BitArray closure against vector<bool>", "[benchmark],[BitArray]") {
+	unsigned int const size = 1024;
+
+	vector<BitArray>     bitMatrix(size, BitArray(size));
+	vector<vector<bool>> boolMatrix(size, vector<bool>(size));
+
+	// A chain, its closure is a triangular matrix
+	for(unsigned int i = 0; i < size; i++) {
+		bitMatrix[i].set(i);
+		boolMatrix[i][i] = true;
+		if(i > 0) {
+			bitMatrix[i].set(i - 1);
+			boolMatrix[i][i - 1] = true;
+		}
+	}
+
+	auto start = chrono::steady_clock::now();
+	for(unsigned int k = 0; k < size; k++) {
+		for(unsigned int i = 0; i < size; i++) {
+			if(i != k && bitMatrix[i][k]) {
+				bitMatrix[i] |= bitMatrix[k];
+			}
+		}
+	}
+	auto bitTime = chrono::steady_clock::now() - start;
+
+	start = chrono::steady_clock::now();
+	for(unsigned int k = 0; k < size; k++) {
+		for(unsigned int i = 0; i < size; i++) {
+			if(i != k && boolMatrix[i][k]) {
+				for(unsigned int j = 0; j < size; j++) {
+					boolMatrix[i][j] = boolMatrix[i][j] || boolMatrix[k][j];
+				}
+			}
+		}
+	}
+	auto boolTime = chrono::steady_clock::now() - start;
+
+	cout << "closure of " << size << "x" << size << ": BitArray "
+		<< chrono::duration_cast<chrono::microseconds>(bitTime).count()
+		<< " us, vector<bool> "
+		<< chrono::duration_cast<chrono::microseconds>(boolTime).count()
+		<< " us" << endl;
+
+	for(unsigned int i = 0; i < size; i++) {
+		CHECK(bitMatrix[i].count() == i + 1);
+		for(unsigned int j = 0; j < size; j++) {
+			REQUIRE(bitMatrix[i][j] == boolMatrix[i][j]);
+		}
+	}
+}
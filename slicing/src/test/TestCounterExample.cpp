@@ -0,0 +1,85 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "catch.hpp"
+
+#include "dynamic/CounterExample.h"
+#include "util/FileOperations.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace std;
+using namespace llvm;
+
+TEST_CASE("The program agrees with itself", "[CounterExample]") {
+	shared_ptr<Module> program   = getModuleFromSource("../testdata/intermediate.c");
+	shared_ptr<Module> candidate = shared_ptr<Module>(CloneModule(&*program));
+
+	CounterExampleCache cache(*program, Criterion::getReturnValueCriterion());
+
+	CHECK_FALSE(cache.findCounterExample(*candidate));
+	CHECK(cache.size() == 0);
+	CHECK_FALSE(cache.refutes(*candidate));
+}
+
+TEST_CASE("Confirmed counterexamples refute later candidates", "[CounterExample]") {
+	shared_ptr<Module> program = getModuleFromSource("../testdata/intermediate.c");
+
+	// A 'slice' that always returns zero instead of b
+	auto createCandidate = [&program](void) {
+
+		shared_ptr<Module> candidate = shared_ptr<Module>(CloneModule(&*program));
+
+		for(BasicBlock& block : *candidate->getFunction("foo")) {
+			if(auto const pReturn = dyn_cast<ReturnInst>(block.getTerminator())) {
+				pReturn->setOperand(0, ConstantInt::get(pReturn->getOperand(0)->getType(), 0));
+			}
+		}
+
+		return candidate;
+	};
+
+	CounterExampleCache cache(*program, Criterion::getReturnValueCriterion());
+
+	shared_ptr<Module> first = createCandidate();
+	CounterExample     counterExample;
+
+	REQUIRE(cache.findCounterExample(*first, &counterExample));
+	CHECK(cache.size() == 1);
+	CHECK(cache.replay(*first, counterExample) == ReplayResult::diverges);
+
+	shared_ptr<Module> second = createCandidate();
+
+	CHECK(cache.refutes(*second));
+}
+
+TEST_CASE("Candidates that agree on all samples are not rejected", "[CounterExample]") {
+	shared_ptr<Module> program   = getModuleFromSource("../testdata/intermediate.c");
+	shared_ptr<Module> candidate = shared_ptr<Module>(CloneModule(&*program));
+
+	CounterExampleCache cache(*program, Criterion::getReturnValueCriterion());
+
+	CHECK_FALSE(cache.rejects(*candidate));
+
+	// Without samples nothing can be rejected
+	CounterExampleCache noSamples(*program, Criterion::getReturnValueCriterion(), 0);
+
+	for(BasicBlock& block : *candidate->getFunction("foo")) {
+		if(auto const pReturn = dyn_cast<ReturnInst>(block.getTerminator())) {
+			pReturn->setOperand(0, ConstantInt::get(pReturn->getOperand(0)->getType(), 0));
+		}
+	}
+
+	CHECK(cache.rejects(*candidate));
+	CHECK_FALSE(noSamples.rejects(*candidate));
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "catch.hpp"
+
+#include "dynamic/Interpreter.h"
+#include "util/FileOperations.h"
+
+#include "llvm/IR/Module.h"
+
+using namespace std;
+using namespace llvm;
+
+static ExecutionTrace runFunction(
+		FunctionStateTemplate const& stateTemplate,
+		vector<uint64_t>             arguments,
+		unsigned long const          maxSteps = 0) {
+
+	FunctionInput input(stateTemplate.func);
+
+	for(unsigned int i = 0; i < arguments.size(); i++) {
+		input.setArgument(i, arguments[i]);
+	}
+
+	Interpreter    interpreter(stateTemplate, input);
+	ExecutionTrace trace;
+
+	return interpreter.run(trace, maxSteps);
+}
+
+TEST_CASE("Straight line code is interpreted", "[Interpreter]") {
+	shared_ptr<Module> program = getModuleFromSource("../testdata/InterleavedAddition.c");
+	Function const&    func    = *program->getFunction("foo");
+
+	FunctionStateTemplate stateTemplate(func);
+
+	for(uint64_t a : {0u, 5u, 1000u}) {
+		ExecutionTrace trace = runFunction(stateTemplate, {a, 7});
+
+		REQUIRE(trace.status == ExecutionStatus::returned);
+		CHECK(trace.returnValue == a);
+
+		// Every instruction is executed exactly once
+		unsigned int instructionCount = 0;
+		for(BasicBlock const& block : func) {
+			instructionCount += static_cast<unsigned int>(block.size());
+		}
+		CHECK(trace.steps.size() == instructionCount);
+	}
+}
+
+TEST_CASE("Phi nodes take the value of the predecessor", "[Interpreter]") {
+	shared_ptr<Module> program = getModuleFromSource("../testdata/intermediate.c");
+
+	FunctionStateTemplate stateTemplate(*program->getFunction("foo"));
+
+	ExecutionTrace positive = runFunction(stateTemplate, {1, 41, 3});
+	ExecutionTrace negative = runFunction(stateTemplate, {static_cast<uint64_t>(-1), 41, 3});
+
+	REQUIRE(positive.status == ExecutionStatus::returned);
+	REQUIRE(negative.status == ExecutionStatus::returned);
+	CHECK(positive.returnValue == 42);
+	CHECK(negative.returnValue == 41);
+}
+
+TEST_CASE("Nonterminating loops stop at the step limit", "[Interpreter]") {
+	shared_ptr<Module> program = getModuleFromSource("../testdata/termination_test.c");
+
+	FunctionStateTemplate stateTemplate(*program->getFunction("baa"));
+
+	ExecutionTrace trace = runFunction(stateTemplate, {0}, 1000);
+
+	CHECK(trace.status == ExecutionStatus::stepLimit);
+	CHECK(trace.steps.size() == 1000);
+}
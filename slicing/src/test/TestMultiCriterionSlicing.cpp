@@ -0,0 +1,38 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "catch.hpp"
+#include "util/FileOperations.h"
+
+#include "slicingMethods/MultiCriterionSlicing.h"
+#include "slicingMethods/SyntacticSlicing.h"
+
+using namespace std;
+using namespace llvm;
+
+TEST_CASE("Every output is sliced", "[MultiCriterionSlicing],[basic]") {
+	ModulePtr program = getModuleFromSource("../testdata/multiple_criteria.c");
+	MultiCriterionSlicing slicing(program, [](ModulePtr variant) {
+		return SlicingMethodPtr(new SyntacticSlicing(variant));
+	}, createSmtSolver(), 2);
+
+	vector<string> outputs = slicing.getOutputs();
+	REQUIRE(outputs.size() == 3);
+	CHECK(outputs[2] == "return value");
+
+	string messages;
+	raw_string_ostream stream(messages);
+	vector<ModulePtr> slices = slicing.computeSlices(stream);
+	INFO(stream.str());
+	REQUIRE(slices.size() == 3);
+	for (ModulePtr& slice: slices) {
+		CHECK(slice);
+	}
+}
@@ -11,12 +11,60 @@
 #include "catch.hpp"
 #include "smtSolver/SmtSolver.h"
 
+#include <fstream>
+#include <sstream>
+#include <string>
+
+static std::string readFile(std::string fileName) {
+	std::ifstream file(fileName);
+	std::stringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
 
 TEST_CASE("Test satisfiable", "[SMT]") {
+	SmtSolverPtr solver = createSmtSolver();
 	SatResult result;
-	result = SmtSolver::getInstance().checkSat("../testdata/smt/simple-sat.smt");
+	result = solver->checkSat("../testdata/smt/simple-sat.smt");
 	CHECK( result == SatResult::sat );
 
-	result = SmtSolver::getInstance().checkSat("../testdata/smt/simple-unsat.smt");
+	result = solver->checkSat("../testdata/smt/simple-unsat.smt");
 	CHECK( result == SatResult::unsat );
 }
+
+TEST_CASE("Test asynchronous checks", "[SMT]") {
+	SmtSolverPtr solver = createSmtSolver();
+	SatCheck satCheck = solver->checkSatAsync("../testdata/smt/simple-sat.smt");
+	SatCheck unsatCheck = solver->checkSatAsync("../testdata/smt/simple-unsat.smt");
+	CHECK( satCheck.result.get() == SatResult::sat );
+	CHECK( unsatCheck.result.get() == SatResult::unsat );
+
+	SatCheck canceledCheck = solver->checkSatAsync("../testdata/smt/simple-sat.smt");
+	canceledCheck.cancel();
+	SatResult result = canceledCheck.result.get();
+	CHECK( (result == SatResult::unknown || result == SatResult::sat) );
+}
+
+TEST_CASE("Test solver pool", "[SMT]") {
+	SmtSolverOptions options;
+	options.workers = 1;
+	SmtSolverPtr solver = createSmtSolver(options);
+	// The second check waits until the first one has finished
+	SatCheck satCheck = solver->checkSatAsync("../testdata/smt/simple-sat.smt");
+	SatCheck unsatCheck = solver->checkSatAsync("../testdata/smt/simple-unsat.smt");
+	SatCheck canceledCheck = solver->checkSatAsync("../testdata/smt/simple-sat.smt");
+	canceledCheck.cancel();
+	CHECK( satCheck.result.get() == SatResult::sat );
+	CHECK( unsatCheck.result.get() == SatResult::unsat );
+	SatResult result = canceledCheck.result.get();
+	CHECK( (result == SatResult::unknown || result == SatResult::sat) );
+}
+
+TEST_CASE("Test problems without files", "[SMT]") {
+	SmtSolverPtr solver = createSmtSolver();
+	SatCheck satCheck = solver->checkProblemAsync(readFile("../testdata/smt/simple-sat.smt"));
+	SatCheck unsatCheck = solver->checkProblemAsync(readFile("../testdata/smt/simple-unsat.smt"));
+	CHECK( satCheck.result.get() == SatResult::sat );
+	CHECK( unsatCheck.result.get() == SatResult::unsat );
+}
@@ -40,9 +40,10 @@ using clang::CodeGenAction;
 
 void testSingleLineElemination(string fileName, int line, ValidationResult expectedResult);
 
-void testSingleLineElemination(string fileName, int line, ValidationResult expectedResult) {
-	shared_ptr<llvm::Module> program = getModuleFromSource(fileName);
-	shared_ptr<llvm::Module> sliceCandidate = CloneModule(&*program);
+shared_ptr<llvm::Module> sliceSingleLine(llvm::Module& program, int line);
+
+shared_ptr<llvm::Module> sliceSingleLine(llvm::Module& program, int line) {
+	shared_ptr<llvm::Module> sliceCandidate = CloneModule(&program);
 
 	{
 		string ir;
@@ -67,6 +68,13 @@ void testSingleLineElemination(string fileName, int line, ValidationResult expec
 		PM.run(*sliceCandidate);
 	}
 
+	return sliceCandidate;
+}
+
+void testSingleLineElemination(string fileName, int line, ValidationResult expectedResult) {
+	shared_ptr<llvm::Module> program = getModuleFromSource(fileName);
+	shared_ptr<llvm::Module> sliceCandidate = sliceSingleLine(*program, line);
+
 	ValidationResult result = SliceCandidateValidation::validate(&*program, &*sliceCandidate);
 	CHECK(result == expectedResult);
 }
@@ -78,3 +86,21 @@ TEST_CASE("Validation of valid Slicecandidate", "[SliceCandidateValidation],[bas
 TEST_CASE("Validation of invalid Slicecandidate", "[SliceCandidateValidation],[basic]") {
 	testSingleLineElemination("../testdata/simple_unsliceable.c", 1, ValidationResult::invalid);
 }
+
+TEST_CASE("Batch validation of Slicecandidates", "[SliceCandidateValidation],[basic]") {
+	shared_ptr<llvm::Module> sliceable = getModuleFromSource("../testdata/simple_sliceable.c");
+	shared_ptr<llvm::Module> validCandidate = sliceSingleLine(*sliceable, 1);
+	shared_ptr<llvm::Module> unchanged = CloneModule(&*sliceable);
+
+	vector<ValidationResult> results = SliceCandidateValidation::validateBatch(&*sliceable,
+		{&*validCandidate, &*unchanged});
+	CHECK(results == vector<ValidationResult>({ValidationResult::valid, ValidationResult::valid}));
+
+	shared_ptr<llvm::Module> unsliceable = getModuleFromSource("../testdata/simple_unsliceable.c");
+	shared_ptr<llvm::Module> invalidCandidate = sliceSingleLine(*unsliceable, 1);
+	unchanged = CloneModule(&*unsliceable);
+
+	results = SliceCandidateValidation::validateBatch(&*unsliceable,
+		{&*invalidCandidate, &*unchanged});
+	CHECK(results == vector<ValidationResult>({ValidationResult::invalid, ValidationResult::valid}));
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "catch.hpp"
+#include "util/FileOperations.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "llvm/IR/LegacyPassManager.h"
+
+#include "core/Criterion.h"
+#include "core/SliceFeasibility.h"
+#include "core/SlicingPass.h"
+#include "core/Util.h"
+#include "util/misc.h"
+
+using namespace std;
+using namespace llvm;
+
+static vector<Instruction*> relevantInstructions(Module& program, Criterion& criterion) {
+	set<Instruction*> criterionInstructions = criterion.getInstructions(program);
+	vector<Instruction*> result;
+	for (Function& function: program) {
+		if (!Util::isSpecialFunction(function)) {
+			for (Instruction& instruction : Util::getInstructions(function)) {
+				if (criterionInstructions.find(&instruction) == criterionInstructions.end()) {
+					result.push_back(&instruction);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+static bool slicingPassAccepts(Module& program, Criterion& criterion, const vector<bool>& pattern) {
+	shared_ptr<Module> candidate = CloneModule(&program);
+	vector<Instruction*> instructions = relevantInstructions(*candidate, criterion);
+	for (unsigned i = 0; i < pattern.size(); i++) {
+		if (pattern[i]) {
+			SlicingPass::toBeSliced(*instructions[i]);
+		}
+	}
+
+	SlicingPass* slicingPass = new SlicingPass();
+	llvm::legacy::PassManager PM;
+	PM.add(slicingPass);
+	PM.run(*candidate);
+	return !slicingPass->hasUnSlicedInstructions();
+}
+
+/**
+ * Every pattern that is rejected without slicing has to be rejected by the
+ * slicing pass as well.
+ */
+static void testFeasibility(string fileName, CriterionPtr criterion) {
+	shared_ptr<Module> program = getModuleFromSource(fileName);
+	SliceFeasibility feasibility(*program, *criterion);
+
+	unsigned numInstructions = relevantInstructions(*program, *criterion).size();
+	REQUIRE(numInstructions <= 16);
+
+	for (unsigned mask = 0; mask < (1u << numInstructions); mask++) {
+		vector<bool> pattern(numInstructions);
+		for (unsigned i = 0; i < numInstructions; i++) {
+			pattern[i] = (mask >> i) & 1;
+		}
+		if (feasibility.isInfeasible(pattern)) {
+			INFO("pattern " << mask);
+			CHECK_FALSE(slicingPassAccepts(*program, *criterion, pattern));
+		}
+	}
+
+	// Slicing nothing is always possible
+	CHECK_FALSE(feasibility.isInfeasible(vector<bool>(numInstructions, false)));
+}
+
+TEST_CASE("Infeasible patterns are rejected by the slicing pass", "[SliceFeasibility]") {
+	testFeasibility("../testdata/simple_sliceable.c", shared_ptr<Criterion>(new ReturnValueCriterion()));
+	testFeasibility("../testdata/intermediate.c", shared_ptr<Criterion>(new PresentCriterion()));
+}
@@ -10,49 +10,70 @@
 
 #include "BitArray.h"
 
-#include <stdexcept>
-
 using namespace std;
 
 BitArray::BitArray(
 		unsigned int size) :
 	size     (size),
 	_intCount(size % _slotSize == 0 ? size / _slotSize : size / _slotSize + 1),
-	_data    (new SlotType[_intCount]) {}
+	_inline  (),
+	_data    (_intCount <= _inlineSlots ? _inline : new SlotType[_intCount]()) {}
+
+BitArray::BitArray(
+		BitArray const& other) :
+	size     (other.size),
+	_intCount(other._intCount),
+	_inline  (),
+	_data    (_intCount <= _inlineSlots ? _inline : new SlotType[_intCount]) {
+	
+	for(unsigned int i = 0; i < _intCount; i++) {
+		_data[i] = other._data[i];
+	}
+}
 
 BitArray::~BitArray() {
 	
-	delete [] _data;
+	if(_data != _inline) {
+		delete [] _data;
+	}
 }
 
-BitArray& BitArray::invert(void) {
+BitArray& BitArray::operator=(
+		BitArray const& rhs) {
+	
+	if(size != rhs.size) {
+		throw range_error("Bit arrays of different size");
+	}
 	
 	for(unsigned int i = 0; i < _intCount; i++) {
-		_data[i] = ~_data[i];
+		_data[i] = rhs._data[i];
 	}
 	
 	return *this;
 }
 
-BitArray& BitArray::reset(void) {
+void BitArray::clearPadding(void) {
+	
+	if(size % _slotSize != 0) {
+		_data[_intCount - 1] &= (SlotType(1) << size % _slotSize) - 1;
+	}
+}
+
+BitArray& BitArray::invert(void) {
 	
 	for(unsigned int i = 0; i < _intCount; i++) {
-		_data[i] = 0;
+		_data[i] = ~_data[i];
 	}
 	
+	clearPadding();
+	
 	return *this;
 }
 
-BitArray& BitArray::performBinaryOp(
-		BitArray const&                               rhs,
-		function<SlotType(SlotType, SlotType)> const& op) {
-	
-	if(size != rhs.size) {
-		throw range_error("Bit arrays of different size");
-	}
+BitArray& BitArray::reset(void) {
 	
 	for(unsigned int i = 0; i < _intCount; i++) {
-		_data[i] = op(_data[i], rhs._data[i]);
+		_data[i] = 0;
 	}
 	
 	return *this;
@@ -81,22 +102,25 @@ bool BitArray::operator!=(
 BitArray& BitArray::operator&=(
 		BitArray const& rhs) {
 	
-	return performBinaryOp(
-		rhs, [](SlotType a, SlotType b) {return a & b;});
+	return performBinaryOp<AndOp>(rhs);
 }
 
 BitArray& BitArray::operator|=(
 		BitArray const& rhs) {
 	
-	return performBinaryOp(
-		rhs, [](SlotType a, SlotType b) {return a | b;});
+	return performBinaryOp<OrOp>(rhs);
 }
 
 BitArray& BitArray::operator^=(
 		BitArray const& rhs) {
 	
-	return performBinaryOp(
-		rhs, [](SlotType a, SlotType b) {return a ^ b;});
+	return performBinaryOp<XorOp>(rhs);
+}
+
+BitArray& BitArray::andNot(
+		BitArray const& rhs) {
+	
+	return performBinaryOp<AndNotOp>(rhs);
 }
 
 bool BitArray::operator[](
@@ -106,5 +130,69 @@ bool BitArray::operator[](
 		throw range_error("Position out of range");
 	}
 	
-	return (_data[pos / _slotSize] & (pos % _slotSize << 1)) > 0;
+	return (_data[pos / _slotSize] & (SlotType(1) << pos % _slotSize)) > 0;
+}
+
+BitArray& BitArray::set(
+		unsigned int pos,
+		bool         value) {
+	
+	if(pos >= size) {
+		throw range_error("Position out of range");
+	}
+	
+	SlotType const mask = SlotType(1) << pos % _slotSize;
+	
+	if(value) {
+		_data[pos / _slotSize] |= mask;
+	} else {
+		_data[pos / _slotSize] &= ~mask;
+	}
+	
+	return *this;
+}
+
+unsigned int BitArray::count(void) const {
+	
+	unsigned int result = 0;
+	
+	for(unsigned int i = 0; i < _intCount; i++) {
+		result += __builtin_popcountll(_data[i]);
+	}
+	
+	return result;
+}
+
+bool BitArray::none(void) const {
+	
+	for(unsigned int i = 0; i < _intCount; i++) {
+		if(_data[i] != 0) return false;
+	}
+	
+	return true;
+}
+
+unsigned int BitArray::findNext(
+		unsigned int pos) const {
+	
+	if(pos >= size) {
+		return size;
+	}
+	
+	unsigned int slot    = pos / _slotSize;
+	SlotType     current = _data[slot] & (~SlotType(0) << pos % _slotSize);
+	
+	while(current == 0) {
+		if(++slot == _intCount) {
+			return size;
+		}
+		current = _data[slot];
+	}
+	
+	return slot * _slotSize + __builtin_ctzll(current);
+}
+
+unsigned int BitArray::findFirst(void) const {
+	
+	return findNext(0);
 }
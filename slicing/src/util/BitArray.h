@@ -11,39 +11,167 @@
 #pragma once
 
 #include <cstdint>
-#include <functional>
+#include <iterator>
+#include <stdexcept>
 
 class BitArray {
-	
+
+	private:
+
+	typedef unsigned long long SlotType;
+
 	public:
-	
+
+	/**
+	 * Iterates over the positions of all set bits in ascending order.
+	 */
+	class SetBitIterator : public std::iterator<std::forward_iterator_tag, unsigned int> {
+
+		public:
+
+		SetBitIterator(BitArray const& bits, unsigned int pos) :
+			_bits(bits), _pos(pos) {}
+
+		unsigned int operator*(void) const {
+			return _pos;
+		}
+
+		SetBitIterator& operator++(void) {
+			_pos = _bits.findNext(_pos + 1);
+			return *this;
+		}
+
+		bool operator==(SetBitIterator const& rhs) const {
+			return _pos == rhs._pos;
+		}
+
+		bool operator!=(SetBitIterator const& rhs) const {
+			return _pos != rhs._pos;
+		}
+
+		private:
+
+		BitArray const& _bits;
+		unsigned int    _pos;
+	};
+
+	class SetBitRange {
+
+		public:
+
+		SetBitRange(BitArray const& bits) : _bits(bits) {}
+
+		SetBitIterator begin(void) const {
+			return SetBitIterator(_bits, _bits.findFirst());
+		}
+
+		SetBitIterator end(void) const {
+			return SetBitIterator(_bits, _bits.size);
+		}
+
+		private:
+
+		BitArray const& _bits;
+	};
+
 	unsigned int const size;
-	
+
+	// All bits are initially cleared
 	BitArray(unsigned int size);
+	BitArray(BitArray const& other);
 	~BitArray();
-	
+
+	BitArray& operator=(BitArray const& rhs);
+
 	BitArray& invert(void);
 	BitArray& reset (void);
-	
+
 	bool operator==(BitArray const& rhs) const;
 	bool operator!=(BitArray const& rhs) const;
-	
+
 	BitArray& operator&=(BitArray const& rhs);
 	BitArray& operator|=(BitArray const& rhs);
 	BitArray& operator^=(BitArray const& rhs);
-	
+
+	/**
+	 * Clears all bits that are set in 'rhs'.
+	 */
+	BitArray& andNot(BitArray const& rhs);
+
 	bool operator[](unsigned int pos) const;
-	
+
+	BitArray& set(unsigned int pos, bool value = true);
+
+	/**
+	 * The number of set bits.
+	 */
+	unsigned int count(void) const;
+
+	bool none(void) const;
+
+	/**
+	 * Returns the position of the first set bit that is not before 'pos' or
+	 * 'size' if there is none.
+	 */
+	unsigned int findNext (unsigned int pos) const;
+	unsigned int findFirst(void)             const;
+
+	SetBitRange setBits(void) const {
+		return SetBitRange(*this);
+	}
+
 	private:
-	
-	typedef unsigned long long SlotType;
-	
-	static constexpr unsigned int _slotSize = sizeof(SlotType) * 8;
-	
+
+	static constexpr unsigned int _slotSize    = sizeof(SlotType) * 8;
+	// Arrays with up to this number of slots do not allocate
+	static constexpr unsigned int _inlineSlots = 2;
+
+	struct AndOp {
+		static SlotType apply(SlotType a, SlotType b) {return a & b;}
+	};
+
+	struct OrOp {
+		static SlotType apply(SlotType a, SlotType b) {return a | b;}
+	};
+
+	struct XorOp {
+		static SlotType apply(SlotType a, SlotType b) {return a ^ b;}
+	};
+
+	struct AndNotOp {
+		static SlotType apply(SlotType a, SlotType b) {return a & ~b;}
+	};
+
 	unsigned int const _intCount;
+	SlotType           _inline[_inlineSlots];
 	SlotType* const    _data;
-	
-	BitArray& performBinaryOp(
-		BitArray const&                                    rhs,
-		std::function<SlotType(SlotType, SlotType)> const& op);
+
+	/**
+	 * The operation is a template parameter, so the loop has no indirect
+	 * calls and can be vectorized by the compiler.
+	 */
+	template <class Op> BitArray& performBinaryOp(BitArray const& rhs) {
+
+		if(size != rhs.size) {
+			throw std::range_error("Bit arrays of different size");
+		}
+
+		SlotType*       __restrict__ data    = _data;
+		SlotType const* __restrict__ rhsData = rhs._data;
+
+		if(data == rhsData) {
+			for(unsigned int i = 0; i < _intCount; i++) {
+				data[i] = Op::apply(data[i], data[i]);
+			}
+		} else {
+			for(unsigned int i = 0; i < _intCount; i++) {
+				data[i] = Op::apply(data[i], rhsData[i]);
+			}
+		}
+
+		return *this;
+	}
+
+	// Clears the unused bits of the last slot
+	void clearPadding(void);
 };
@@ -0,0 +1,180 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#include "SlicingStatistics.h"
+
+using namespace std;
+using namespace llvm;
+
+static const char* phaseName(unsigned phase) {
+	switch (static_cast<SlicingPhase>(phase)) {
+		case SlicingPhase::cloneModule:
+		return "cloneModule";
+		case SlicingPhase::slicingPass:
+		return "slicingPass";
+		case SlicingPhase::preprocessing:
+		return "preprocessing";
+		case SlicingPhase::smtGeneration:
+		return "smtGeneration";
+		case SlicingPhase::serialization:
+		return "serialization";
+		case SlicingPhase::solver:
+		return "solver";
+	}
+	return "";
+}
+
+SlicingStatistics::Timer::~Timer() {
+	SlicingStatistics::getInstance().addTime(phase, Clock::now() - start);
+}
+
+SlicingStatistics& SlicingStatistics::getInstance() {
+	static SlicingStatistics instance;
+	return instance;
+}
+
+void SlicingStatistics::addTime(SlicingPhase phase, Clock::duration duration) {
+	lock_guard<std::mutex> lock(mutex);
+	phaseTimes[static_cast<unsigned>(phase)] += duration;
+	phaseCounts[static_cast<unsigned>(phase)]++;
+}
+
+void SlicingStatistics::addSolverLatency(Clock::duration latency) {
+	addTime(SlicingPhase::solver, latency);
+
+	auto milliseconds = chrono::duration_cast<chrono::milliseconds>(latency).count();
+	unsigned bucket = 0;
+	while (bucket + 1 < NUM_LATENCY_BUCKETS && milliseconds >= (1ll << bucket)) {
+		bucket++;
+	}
+
+	lock_guard<std::mutex> lock(mutex);
+	latencyBuckets[bucket]++;
+}
+
+void SlicingStatistics::addValidatedCandidate() {
+	lock_guard<std::mutex> lock(mutex);
+	validatedCandidates++;
+}
+
+void SlicingStatistics::addCandidateCacheLookup(bool hit) {
+	lock_guard<std::mutex> lock(mutex);
+	if (hit) {
+		candidateCacheHits++;
+	} else {
+		candidateCacheMisses++;
+	}
+}
+
+void SlicingStatistics::addFeasibilityCheck(bool rejected) {
+	lock_guard<std::mutex> lock(mutex);
+	if (rejected) {
+		infeasiblePatterns++;
+	} else {
+		feasiblePatterns++;
+	}
+}
+
+void SlicingStatistics::addValidationMemoLookup(bool hit) {
+	lock_guard<std::mutex> lock(mutex);
+	if (hit) {
+		validationMemoHits++;
+	} else {
+		validationMemoMisses++;
+	}
+}
+
+void SlicingStatistics::addCounterExampleReplay(bool refuted) {
+	lock_guard<std::mutex> lock(mutex);
+	if (refuted) {
+		counterExampleRefutations++;
+	} else {
+		counterExampleMisses++;
+	}
+}
+
+void SlicingStatistics::addConfirmedCounterExample() {
+	lock_guard<std::mutex> lock(mutex);
+	confirmedCounterExamples++;
+}
+
+SlicingStatistics::Clock::duration SlicingStatistics::getTime(SlicingPhase phase) {
+	lock_guard<std::mutex> lock(mutex);
+	return phaseTimes[static_cast<unsigned>(phase)];
+}
+
+unsigned SlicingStatistics::getCount(SlicingPhase phase) {
+	lock_guard<std::mutex> lock(mutex);
+	return phaseCounts[static_cast<unsigned>(phase)];
+}
+
+unsigned SlicingStatistics::getValidatedCandidates() {
+	lock_guard<std::mutex> lock(mutex);
+	return validatedCandidates;
+}
+
+void SlicingStatistics::reset() {
+	lock_guard<std::mutex> lock(mutex);
+	phaseTimes.fill(Clock::duration::zero());
+	phaseCounts.fill(0);
+	latencyBuckets.fill(0);
+	validatedCandidates = 0;
+	candidateCacheHits = 0;
+	candidateCacheMisses = 0;
+	infeasiblePatterns = 0;
+	feasiblePatterns = 0;
+	validationMemoHits = 0;
+	validationMemoMisses = 0;
+	counterExampleRefutations = 0;
+	counterExampleMisses = 0;
+	confirmedCounterExamples = 0;
+}
+
+void SlicingStatistics::printJSON(raw_ostream& out) {
+	lock_guard<std::mutex> lock(mutex);
+
+	out << "{\"phases\": {";
+	for (unsigned i = 0; i < NUM_PHASES; i++) {
+		if (i > 0) {
+			out << ", ";
+		}
+		out << "\"" << phaseName(i) << "\": {\"seconds\": "
+			<< chrono::duration<double>(phaseTimes[i]).count()
+			<< ", \"count\": " << phaseCounts[i] << "}";
+	}
+	out << "}, \"solverLatency\": [";
+	for (unsigned i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+		if (i > 0) {
+			out << ", ";
+		}
+		out << "{\"belowMs\": ";
+		if (i + 1 < NUM_LATENCY_BUCKETS) {
+			out << (1ll << i);
+		} else {
+			out << "null";
+		}
+		out << ", \"count\": " << latencyBuckets[i] << "}";
+	}
+	unsigned lookups = candidateCacheHits + candidateCacheMisses;
+	unsigned memoLookups = validationMemoHits + validationMemoMisses;
+	out << "], \"candidates\": " << validatedCandidates
+		<< ", \"patterns\": {\"infeasible\": " << infeasiblePatterns
+		<< ", \"feasible\": " << feasiblePatterns << "}"
+		<< ", \"caches\": {\"candidates\": {\"hits\": " << candidateCacheHits
+		<< ", \"misses\": " << candidateCacheMisses
+		<< ", \"hitRate\": " << (lookups > 0 ? double(candidateCacheHits) / lookups : 0.0)
+		<< "}, \"validations\": {\"hits\": " << validationMemoHits
+		<< ", \"misses\": " << validationMemoMisses
+		<< ", \"hitRate\": " << (memoLookups > 0 ? double(validationMemoHits) / memoLookups : 0.0)
+		<< "}, \"counterExamples\": {\"refuted\": " << counterExampleRefutations
+		<< ", \"misses\": " << counterExampleMisses
+		<< ", \"confirmed\": " << confirmedCounterExamples
+		<< "}}}\n";
+}
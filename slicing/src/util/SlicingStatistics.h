@@ -0,0 +1,101 @@
+/*
+ * This file is part of
+ *    llreve - Automatic regression verification for LLVM programs
+ *
+ * Copyright (C) 2016 Karlsruhe Institute of Technology
+ *
+ * The system is published under a BSD license.
+ * See LICENSE (distributed with this file) for details.
+ */
+
+#pragma once
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+enum class SlicingPhase {cloneModule, slicingPass, preprocessing, smtGeneration, serialization, solver};
+
+/**
+ * Collects where the time of a slicing session goes. All methods may be called
+ * concurrently, e.g. the solver latencies are reported by the threads waiting
+ * for the solver.
+ */
+class SlicingStatistics {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	 * Adds the wall clock time from its construction to its destruction to
+	 * the given phase.
+	 */
+	class Timer {
+	public:
+		Timer(SlicingPhase phase):phase(phase), start(Clock::now()){}
+		~Timer();
+	private:
+		SlicingPhase phase;
+		Clock::time_point start;
+	};
+
+	static SlicingStatistics& getInstance();
+
+	void addTime(SlicingPhase phase, Clock::duration duration);
+	/**
+	 * The time of a single solver query, it is also added to the solver phase.
+	 */
+	void addSolverLatency(Clock::duration latency);
+	/**
+	 * A candidate has been passed to a validation session, whether or not
+	 * the solver is called for it.
+	 */
+	void addValidatedCandidate();
+	void addCandidateCacheLookup(bool hit);
+	/**
+	 * A pattern has been checked with SliceFeasibility, if it is rejected no
+	 * candidate is built for it.
+	 */
+	void addFeasibilityCheck(bool rejected);
+	/**
+	 * A preprocessed candidate has been looked up in the validation results
+	 * of its session, on a hit the solver is not called.
+	 */
+	void addValidationMemoLookup(bool hit);
+	/**
+	 * A candidate has been replayed on the cached counterexamples, if it is
+	 * refuted the solver is not called.
+	 */
+	void addCounterExampleReplay(bool refuted);
+	void addConfirmedCounterExample();
+
+	Clock::duration getTime(SlicingPhase phase);
+	/** How often time was added to the phase, e.g. the number of solver queries */
+	unsigned getCount(SlicingPhase phase);
+	unsigned getValidatedCandidates();
+
+	void reset();
+	void printJSON(llvm::raw_ostream& out);
+
+private:
+	static const unsigned NUM_PHASES = static_cast<unsigned>(SlicingPhase::solver) + 1;
+	// Bucket i counts the latencies below 2^i ms, the last one all others
+	static const unsigned NUM_LATENCY_BUCKETS = 24;
+
+	std::mutex mutex;
+	std::array<Clock::duration, NUM_PHASES> phaseTimes{};
+	std::array<unsigned, NUM_PHASES> phaseCounts{};
+	std::array<unsigned, NUM_LATENCY_BUCKETS> latencyBuckets{};
+	unsigned validatedCandidates = 0;
+	unsigned candidateCacheHits = 0;
+	unsigned candidateCacheMisses = 0;
+	unsigned infeasiblePatterns = 0;
+	unsigned feasiblePatterns = 0;
+	unsigned validationMemoHits = 0;
+	unsigned validationMemoMisses = 0;
+	unsigned counterExampleRefutations = 0;
+	unsigned counterExampleMisses = 0;
+	unsigned confirmedCounterExamples = 0;
+};
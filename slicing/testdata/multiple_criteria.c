@@ -0,0 +1,9 @@
+void __criterion(int a){};
+
+int foo(int a, int b){
+	int x = a + 1;
+	int y = b * 2;
+	__criterion(x);
+	__criterion(y);
+	return x + y;
+}